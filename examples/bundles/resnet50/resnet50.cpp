@@ -19,11 +19,15 @@
 #include <stdlib.h>
 
 #include <string>
+#include <thread>
 #include <vector>
 
 /// This is an example demonstrating how to use auto-generated bundles and
 /// create standalone executables that can perform neural network computations.
-/// This example loads and runs the compiled resnet50 network model.
+/// This example loads and runs the compiled resnet50 network model. Every
+/// input image is classified by its own thread. The threads share the constant
+/// weights and run the same bundle, each with its own mutable weights and
+/// activations.
 
 #define DEFAULT_HEIGHT 224
 #define DEFAULT_WIDTH 224
@@ -322,10 +326,11 @@ static uint8_t *allocateMutableWeightVars(const BundleConfig &config) {
   return weights;
 }
 
-/// Dump the result of the inference by looking at the results vector and
-/// finding the index of the max element.
+/// Dump the result of the inference on the image \p filename by looking at the
+/// results vector and finding the index of the max element.
 static void dumpInferenceResults(const BundleConfig &config,
-                                 uint8_t *mutableWeightVars) {
+                                 uint8_t *mutableWeightVars,
+                                 const std::string &filename) {
   const SymbolTableEntry &outputWeights =
       getMutableWeightVar(config, "save_gpu_0_softmax");
   int maxIdx = 0;
@@ -337,16 +342,18 @@ static void dumpInferenceResults(const BundleConfig &config,
       maxIdx = i;
     }
   }
-  printf("Result: %u\n", maxIdx);
+  printf("Result for %s: %u\n", filename.c_str(), maxIdx);
 }
 
 /// The assumed layout of the area for mutable WeightVars is:
 /// data | gpu_0/data | results
-static uint8_t *initMutableWeightVars(const BundleConfig &config) {
+/// The input is the image \p filename.
+static uint8_t *initMutableWeightVars(const BundleConfig &config,
+                                      const std::string &filename) {
   uint8_t *mutableWeightVarsAddr = allocateMutableWeightVars(config);
   size_t inputDims[4];
   float *inputT{nullptr};
-  loadImagesAndPreprocess(inputImageFilenames, inputT, inputDims);
+  loadImagesAndPreprocess({filename}, inputT, inputDims);
   // Copy image data into the gpu_0/data input variable in the
   // mutableWeightVars area.
   size_t imageDataSizeInBytes =
@@ -357,6 +364,7 @@ static uint8_t *initMutableWeightVars(const BundleConfig &config) {
       getMutableWeightVar(config, "gpu_0_data");
   memcpy(mutableWeightVarsAddr + inputGPUDataVar.offset, inputT,
          imageDataSizeInBytes);
+  free(inputT);
   return mutableWeightVarsAddr;
 }
 
@@ -365,22 +373,41 @@ static uint8_t *initActivations(const BundleConfig &config) {
       alignedAlloc(config, config.activationsMemSize));
 }
 
-int main(int argc, char **argv) {
-  parseCommandLineOptions(argc, argv);
-  // Allocate and initialize constant and mutable weights.
-  uint8_t *constantWeightVarsAddr =
-      initConstantWeights("resnet50.weights", resnet50_config);
-  uint8_t *mutableWeightVarsAddr = initMutableWeightVars(resnet50_config);
+/// Classify the image \p filename with the constant weights at
+/// \p constantWeightVarsAddr. The mutable weights and the activations belong to
+/// this call only, so that several calls can run at the same time.
+static void classifyImage(uint8_t *constantWeightVarsAddr,
+                          const std::string &filename) {
+  uint8_t *mutableWeightVarsAddr =
+      initMutableWeightVars(resnet50_config, filename);
   uint8_t *activationsAddr = initActivations(resnet50_config);
 
   // Perform the computation.
   resnet50(constantWeightVarsAddr, mutableWeightVarsAddr, activationsAddr);
 
   // Report the results.
-  dumpInferenceResults(resnet50_config, mutableWeightVarsAddr);
+  dumpInferenceResults(resnet50_config, mutableWeightVarsAddr, filename);
 
-  // Free all resources.
   free(activationsAddr);
-  free(constantWeightVarsAddr);
   free(mutableWeightVarsAddr);
 }
+
+int main(int argc, char **argv) {
+  parseCommandLineOptions(argc, argv);
+  // Allocate and initialize the constant weights, which are shared by all the
+  // threads.
+  uint8_t *constantWeightVarsAddr =
+      initConstantWeights("resnet50.weights", resnet50_config);
+
+  // Classify every image on its own thread.
+  std::vector<std::thread> threads;
+  for (const auto &filename : inputImageFilenames) {
+    threads.emplace_back(classifyImage, constantWeightVarsAddr, filename);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Free all resources.
+  free(constantWeightVarsAddr);
+}
@@ -58,6 +58,12 @@ llvm::cl::opt<unsigned>
     generateChars("chars", llvm::cl::desc("Generate this number of chars."),
                   llvm::cl::init(1000), llvm::cl::value_desc("N"),
                   llvm::cl::cat(category));
+llvm::cl::opt<bool> streaming(
+    "streaming",
+    llvm::cl::desc("Generate the text with one step of the LSTM per char, "
+                   "which carries its state over from the previous char, "
+                   "instead of running the network over the whole window"),
+    llvm::cl::init(true), llvm::cl::cat(category));
 
 } // namespace
 
@@ -195,6 +201,31 @@ static Function *createNetwork(Module &mod, size_t minibatchSize,
   return F;
 }
 
+/// Creates the function that computes the next char from a single char, with
+/// one step of the LSTM layer of createNetwork whose states are the variables
+/// "step_hidden_state" and "step_cell_state". The cost of a step does not
+/// depend on the number of chars that came before.
+static Function *createStepNetwork(Module &mod, size_t hiddenSize) {
+  Function *F = mod.createFunction("step");
+
+  Variable *X = mod.createVariable(ElemKind::FloatTy, {1, 128}, "step_input",
+                                   VisibilityKind::Public, false);
+  Variable *Y = mod.createVariable(ElemKind::Int64ITy, {1, 1}, "step_expected",
+                                   VisibilityKind::Public, false);
+  Variable *H =
+      mod.createVariable(ElemKind::FloatTy, {1, hiddenSize},
+                         "step_hidden_state", VisibilityKind::Public, false);
+  Variable *C =
+      mod.createVariable(ElemKind::FloatTy, {1, hiddenSize}, "step_cell_state",
+                         VisibilityKind::Public, false);
+
+  auto O = F->createLSTMStep("rnn", X, H, C);
+  auto *SM = F->createSoftMax("step_softmax", O, Y);
+  auto *K = F->createReshape("step_reshape", SM, {1, 1, 128});
+  F->createSave("step_result", K);
+  return F;
+}
+
 int main(int argc, char **argv) {
   llvm::cl::ParseCommandLineOptions(argc, argv, " The char-rnn test\n\n");
   auto mb = loadFile(inputFilename);
@@ -220,6 +251,7 @@ int main(int argc, char **argv) {
   //// Train the network ////
   Function *F = createNetwork(mod, minibatchSize, numSteps, hiddenSize);
   Function *TF = differentiate(F, TC);
+  Function *stepF = createStepNetwork(mod, hiddenSize);
 
   auto *X = mod.getVariableByName("input");
   auto *Y = mod.getVariableByName("expected");
@@ -245,6 +277,37 @@ int main(int argc, char **argv) {
 
     //// Use the trained network to generate some text ////
     Context ctx;
+    if (streaming) {
+      EE.compile(CompilationMode::Infer, stepF, ctx);
+      auto *stepX = mod.getVariableByName("step_input");
+      mod.getVariableByName("step_hidden_state")->getPayload().zero();
+      mod.getVariableByName("step_cell_state")->getPayload().zero();
+      auto *res = llvm::cast<SaveNode>(stepF->getNodeByName("step_result"));
+      auto &T = res->getVariable()->getPayload();
+
+      // Run a step of the network on the char c.
+      Tensor oneHot(ElemKind::FloatTy, {1, 128});
+      auto feedChar = [&](char c) {
+        oneHot.zero();
+        oneHot.getHandle().at({0, clipASCII(c)}) = 1.0;
+        updateVariables({stepX}, {&oneHot});
+        EE.run();
+      };
+
+      // Feed the first chars of the text, and then every generated char.
+      std::string result(text.begin(), text.begin() + numSteps);
+      for (char c : result) {
+        feedChar(c);
+      }
+      for (unsigned i = 0; i < generateChars; i++) {
+        char c = getPredictedChar(T, 0, 0);
+        result.push_back(c);
+        feedChar(c);
+      }
+
+      llvm::outs() << "Generated output:\n" << result << "\n";
+      continue;
+    }
     EE.compile(CompilationMode::Infer, F, ctx);
 
     // Load a few characters to start the text that we generate.
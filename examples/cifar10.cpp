@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "glow/ExecutionEngine/DataLoader.h"
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Support/Support.h"
@@ -47,48 +48,61 @@ llvm::cl::opt<BackendKind> executionBackend(
 const size_t cifarImageSize = 1 + (32 * 32 * 3);
 const size_t cifarNumImages = 10000;
 
+/// Reads the samples of a CIFAR database file, one record at a time. The
+/// pixels are normalized to [0, 1].
+class CIFARSource final : public DataSource {
+  std::ifstream input_;
+  /// The record that is being read.
+  std::vector<uint8_t> record_;
+
+public:
+  CIFARSource(const char *filename)
+      : input_(filename, std::ios::binary), record_(cifarImageSize) {
+    if (!input_.is_open()) {
+      llvm::outs() << "Failed to open cifar10 data file, probably missing.\n";
+      llvm::outs() << "Run 'python ../glow/utils/download_test_db.py'\n";
+      exit(1);
+    }
+    input_.seekg(0, std::ios::end);
+    GLOW_ASSERT(size_t(input_.tellg()) == cifarImageSize * cifarNumImages &&
+                "Invalid input file");
+  }
+
+  size_t size() const override { return cifarNumImages; }
+
+  void read(size_t index, llvm::ArrayRef<Tensor *> batch,
+            size_t slot) override {
+    input_.seekg(index * cifarImageSize);
+    input_.read(reinterpret_cast<char *>(record_.data()), cifarImageSize);
+    GLOW_ASSERT(input_ && "Invalid input file");
+
+    auto imagesH = batch[0]->getHandle<>();
+    batch[1]->getHandle<int64_t>().at({slot, 0}) = record_[0];
+    size_t idx = 1;
+    for (size_t z = 0; z < 3; z++) {
+      for (size_t y = 0; y < 32; y++) {
+        for (size_t x = 0; x < 32; x++) {
+          imagesH.at({slot, x, y, z}) =
+              static_cast<float>(record_[idx++]) / 255.0;
+        }
+      }
+    }
+  }
+};
+
 /// This test classifies digits from the CIFAR labeled dataset.
 /// Details: http://www.cs.toronto.edu/~kriz/cifar.html
 /// Dataset: http://www.cs.toronto.edu/~kriz/cifar-10-binary.tar.gz
 void testCIFAR10() {
-  (void)cifarImageSize;
   const char *textualLabels[] = {"airplane", "automobile", "bird", "cat",
                                  "deer",     "dog",        "frog", "horse",
                                  "ship",     "truck"};
 
-  std::ifstream dbInput("cifar-10-batches-bin/data_batch_1.bin",
-                        std::ios::binary);
-
-  if (!dbInput.is_open()) {
-    llvm::outs() << "Failed to open cifar10 data file, probably missing.\n";
-    llvm::outs() << "Run 'python ../glow/utils/download_test_db.py'\n";
-    exit(1);
-  }
-
-  llvm::outs() << "Loading the CIFAR-10 database.\n";
-
-  /// Load the CIFAR database into a 4d tensor.
-  Tensor images(ElemKind::FloatTy, {cifarNumImages, 32, 32, 3});
-  Tensor labels(ElemKind::Int64ITy, {cifarNumImages, 1});
-  size_t idx = 0;
-
-  auto labelsH = labels.getHandle<int64_t>();
-  auto imagesH = images.getHandle<>();
-  for (unsigned w = 0; w < cifarNumImages; w++) {
-    labelsH.at({w, 0}) = static_cast<uint8_t>(dbInput.get());
-    idx++;
-
-    for (unsigned z = 0; z < 3; z++) {
-      for (unsigned y = 0; y < 32; y++) {
-        for (unsigned x = 0; x < 32; x++) {
-          imagesH.at({w, x, y, z}) =
-              static_cast<float>(static_cast<uint8_t>(dbInput.get())) / 255.0;
-          idx++;
-        }
-      }
-    }
-  }
-  GLOW_ASSERT(idx == cifarImageSize * cifarNumImages && "Invalid input file");
+  const char *filename = "cifar-10-batches-bin/data_batch_1.bin";
+  // The loader reads the training batches in the background, so the scoring
+  // reads the database through a stream of its own.
+  CIFARSource trainSource(filename);
+  CIFARSource scoreSource(filename);
 
   unsigned minibatchSize = 8;
 
@@ -137,9 +151,10 @@ void testCIFAR10() {
 
   llvm::outs() << "Training.\n";
 
-  // This variable records the number of the next sample to be used for
-  // training.
-  size_t sampleCounter = 0;
+  DataLoader loader(trainSource, {A->getType(), E->getType()});
+  Tensor sample(ElemKind::FloatTy, {minibatchSize, 32, 32, 3});
+  Tensor labels(ElemKind::Int64ITy, {minibatchSize, 1});
+  auto labelsH = labels.getHandle<int64_t>();
 
   for (int iter = 0; iter < 100000; iter++) {
     llvm::outs() << "Training - iteration #" << iter << "\n";
@@ -147,15 +162,16 @@ void testCIFAR10() {
     llvm::Timer timer("Training", "Training");
     timer.startTimer();
 
-    // Bind the images tensor to the input array A, and the labels tensor
-    // to the softmax node SM.
-    runBatch(EE, reportRate, sampleCounter, {A, E}, {&images, &labels});
+    // Copy the batches of images into the input array A, and the batches of
+    // labels into the input of the softmax node SM.
+    runBatch(EE, reportRate, loader, {A, E});
 
     unsigned score = 0;
 
     for (unsigned int i = 0; i < 100 / minibatchSize; i++) {
-      Tensor sample(ElemKind::FloatTy, {minibatchSize, 32, 32, 3});
-      sample.copyConsecutiveSlices(&images, minibatchSize * i);
+      for (unsigned j = 0; j < minibatchSize; j++) {
+        scoreSource.read(minibatchSize * i + j, {&sample, &labels}, j);
+      }
       updateVariables({A}, {&sample});
       EE.run();
       result->getOutput();
@@ -164,7 +180,7 @@ void testCIFAR10() {
       for (unsigned int iter = 0; iter < minibatchSize; iter++) {
         auto T = res.getHandle<>().extractSlice(iter);
         size_t guess = T.getHandle<>().minMaxArg().second;
-        size_t correct = labelsH.at({minibatchSize * i + iter, 0});
+        size_t correct = labelsH.at({iter, 0});
         score += guess == correct;
 
         if ((iter < 10) && i == 0) {
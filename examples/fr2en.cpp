@@ -189,42 +189,6 @@ private:
                        result->getPayload());
     return result;
   }
-
-  Node *createPyTorchGRUCell(Function *G, Node *input, Node *hidden,
-                             Variable *w_ih, Variable *b_ih, Variable *w_hh,
-                             Variable *b_hh) {
-    // reference implementation:
-    // https://github.com/pytorch/pytorch/blob/dd5c195646b941d3e20a72847ac48c41e272b8b2/torch/nn/_functions/rnn.py#L46
-    Node *gi = G->createFullyConnected("pytorch.GRU.gi", input, w_ih, b_ih);
-    Node *gh = G->createFullyConnected("pytorch.GRU.gh", hidden, w_hh, b_hh);
-
-    Node *i_r = G->createSlice("pytorch.GRU.i_r", gi, {0, 0},
-                               {batchSize_, EMBEDDING_SIZE});
-    Node *i_i = G->createSlice("pytorch.GRU.i_i", gi, {0, EMBEDDING_SIZE},
-                               {batchSize_, 2 * EMBEDDING_SIZE});
-    Node *i_n = G->createSlice("pytorch.GRU.i_n", gi, {0, 2 * EMBEDDING_SIZE},
-                               {batchSize_, 3 * EMBEDDING_SIZE});
-
-    Node *h_r = G->createSlice("pytorch.GRU.h_r", gh, {0, 0},
-                               {batchSize_, EMBEDDING_SIZE});
-    Node *h_i = G->createSlice("pytorch.GRU.h_i", gh, {0, EMBEDDING_SIZE},
-                               {batchSize_, 2 * EMBEDDING_SIZE});
-    Node *h_n = G->createSlice("pytorch.GRU.h_n", gh, {0, 2 * EMBEDDING_SIZE},
-                               {batchSize_, 3 * EMBEDDING_SIZE});
-
-    Node *resetgate = G->createSigmoid("pytorch.GRU.resetgate",
-                                       G->createAdd("i_r_plus_h_r", i_r, h_r));
-    Node *inputgate = G->createSigmoid("pytorch.GRU.inputgate",
-                                       G->createAdd("i_i_plus_h_i", i_i, h_i));
-    Node *newgate = G->createTanh(
-        "pytorch.GRU.newgate",
-        G->createAdd("i_n_plus_rg_mult_h_n", i_n,
-                     G->createMul("rg_mult_h_n", resetgate, h_n)));
-    return G->createAdd(
-        "pytorch.GRU.hy", newgate,
-        G->createMul("ig_mult_hmng", inputgate,
-                     G->createSub("hidden_minus_newgate", hidden, newgate)));
-  }
 };
 
 void Model::loadLanguages() {
@@ -284,7 +248,8 @@ void Model::loadEncoder() {
     Node *reshape =
         F_->createReshape("encoder." + std::to_string(step) + ".reshape",
                           inputSlice, {batchSize_, EMBEDDING_SIZE});
-    hidden = createPyTorchGRUCell(F_, reshape, hidden, w_ih, b_ih, w_hh, b_hh);
+    hidden = F_->createGRUCell("encoder." + std::to_string(step) + ".gru",
+                               reshape, hidden, w_ih, b_ih, w_hh, b_hh);
     outputs.push_back(hidden);
   }
 
@@ -345,7 +310,8 @@ void Model::loadDecoder() {
                          embedding_en_, lastWordIdx);
 
     Node *relu = F_->createRELU("decoder.relu", embedded);
-    hidden = createPyTorchGRUCell(F_, relu, hidden, w_ih, b_ih, w_hh, b_hh);
+    hidden = F_->createGRUCell("decoder.gru", relu, hidden, w_ih, b_ih, w_hh,
+                               b_hh);
 
     Node *FC = F_->createFullyConnected("decoder.outFC", hidden, out_w, out_b);
     auto *topK = F_->createTopK("decoder.topK", FC, 1);
@@ -13,6 +13,7 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include "glow/ExecutionEngine/DataLoader.h"
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Support/Support.h"
@@ -26,7 +27,8 @@
 
 using namespace glow;
 
-const size_t mnistNumImages = 50000;
+/// The number of pixels of an image.
+const size_t mnistImageSize = 28 * 28;
 
 namespace {
 llvm::cl::OptionCategory mnistCat("MNIST Options");
@@ -39,59 +41,55 @@ llvm::cl::opt<BackendKind> executionBackend(
     llvm::cl::init(BackendKind::Interpreter), llvm::cl::cat(mnistCat));
 } // namespace
 
-unsigned loadMNIST(Tensor &imageInputs, Tensor &labelInputs) {
-  /// Load the MNIST database into 4D tensor of images and 2D tensor of labels.
-  imageInputs.reset(ElemKind::FloatTy, {50000u, 28, 28, 1});
-  labelInputs.reset(ElemKind::Int64ITy, {50000u, 1});
-
-  std::ifstream imgInput("mnist_images.bin", std::ios::binary);
-  std::ifstream labInput("mnist_labels.bin", std::ios::binary);
-
-  if (!imgInput.is_open()) {
-    llvm::errs() << "Error loading mnist_images.bin\n";
-    std::exit(EXIT_FAILURE);
-  }
-  if (!labInput.is_open()) {
-    llvm::errs() << "Error loading mnist_labels.bin\n";
-    std::exit(EXIT_FAILURE);
+/// Reads the samples of the MNIST database, from mnist_images.bin, which holds
+/// the 28x28 images as floats, and from mnist_labels.bin, which holds a one
+/// byte label per image.
+class MNISTSource final : public DataSource {
+  std::ifstream images_;
+  std::ifstream labels_;
+  size_t numImages_;
+
+public:
+  MNISTSource()
+      : images_("mnist_images.bin", std::ios::binary),
+        labels_("mnist_labels.bin", std::ios::binary) {
+    if (!images_.is_open()) {
+      llvm::errs() << "Error loading mnist_images.bin\n";
+      std::exit(EXIT_FAILURE);
+    }
+    if (!labels_.is_open()) {
+      llvm::errs() << "Error loading mnist_labels.bin\n";
+      std::exit(EXIT_FAILURE);
+    }
+    images_.seekg(0, std::ios::end);
+    labels_.seekg(0, std::ios::end);
+    numImages_ = labels_.tellg();
+    GLOW_ASSERT(numImages_ * mnistImageSize * sizeof(float) ==
+                    size_t(images_.tellg()) &&
+                "The size of the image buffer does not match the labels vector");
+    GLOW_ASSERT(numImages_ && "No images were found.");
   }
 
-  std::vector<char> images((std::istreambuf_iterator<char>(imgInput)),
-                           (std::istreambuf_iterator<char>()));
-  std::vector<char> labels((std::istreambuf_iterator<char>(labInput)),
-                           (std::istreambuf_iterator<char>()));
-  float *imagesAsFloatPtr = reinterpret_cast<float *>(&images[0]);
-
-  GLOW_ASSERT(labels.size() * 28 * 28 * sizeof(float) == images.size() &&
-              "The size of the image buffer does not match the labels vector");
-
-  size_t idx = 0;
-
-  auto LIH = labelInputs.getHandle<int64_t>();
-  auto IIH = imageInputs.getHandle<>();
-
-  for (unsigned w = 0; w < mnistNumImages; w++) {
-    LIH.at({w, 0}) = labels[w];
-    for (unsigned x = 0; x < 28; x++) {
-      for (unsigned y = 0; y < 28; y++) {
-        IIH.at({w, x, y, 0}) = imagesAsFloatPtr[idx++];
-      }
-    }
+  size_t size() const override { return numImages_; }
+
+  void read(size_t index, llvm::ArrayRef<Tensor *> batch,
+            size_t slot) override {
+    auto IH = batch[0]->getHandle<>();
+    images_.seekg(index * mnistImageSize * sizeof(float));
+    images_.read(reinterpret_cast<char *>(&IH.raw(slot * mnistImageSize)),
+                 mnistImageSize * sizeof(float));
+    labels_.seekg(index);
+    batch[1]->getHandle<int64_t>().at({slot, 0}) = labels_.get();
+    GLOW_ASSERT(images_ && labels_ && "Error reading the mnist database");
   }
-  size_t numImages = labels.size();
-  GLOW_ASSERT(numImages && "No images were found.");
-  return numImages;
-}
+};
 
 /// This test classifies digits from the MNIST labeled dataset.
 void testMNIST() {
   llvm::outs() << "Loading the mnist database.\n";
 
-  Tensor imageInputs;
-  Tensor labelInputs;
-
-  unsigned numImages = loadMNIST(imageInputs, labelInputs);
-  llvm::outs() << "Loaded " << numImages << " images.\n";
+  MNISTSource source;
+  llvm::outs() << "Found " << source.size() << " images.\n";
 
   unsigned minibatchSize = 8;
 
@@ -139,36 +137,39 @@ void testMNIST() {
 
   llvm::outs() << "Training.\n";
 
-  // This variable records the number of the next sample to be used for
-  // training.
-  size_t sampleCounter = 0;
+  {
+    // The loader shuffles the database and reads the next batches while the
+    // network trains on the current one.
+    DataLoader loader(source, {A->getType(), selected->getType()});
 
-  for (int epoch = 0; epoch < 60; epoch++) {
-    llvm::outs() << "Training - epoch #" << epoch << "\n";
+    for (int epoch = 0; epoch < 60; epoch++) {
+      llvm::outs() << "Training - epoch #" << epoch << "\n";
 
-    timer.startTimer();
+      timer.startTimer();
 
-    // On each training iteration take a slice of imageInputs and labelInputs
-    // and put them into variables A and B, then run forward and backward passes
-    // and update weights.
-    runBatch(EE, numIterations, sampleCounter, {A, selected},
-             {&imageInputs, &labelInputs});
+      // On each training iteration put the next batch of images and labels
+      // into variables A and B, then run forward and backward passes and
+      // update weights.
+      runBatch(EE, numIterations, loader, {A, selected});
 
-    timer.stopTimer();
+      timer.stopTimer();
+    }
   }
   llvm::outs() << "Validating.\n";
   EE.compile(CompilationMode::Infer, F, ctx);
 
-  auto LIH = labelInputs.getHandle<int64_t>();
-
   // Check how many examples out of eighty previously unseen digits we can
   // classify correctly.
   int rightAnswer = 0;
 
   Tensor sample(ElemKind::FloatTy, {minibatchSize, 28, 28, 1});
+  Tensor labels(ElemKind::Int64ITy, {minibatchSize, 1});
+  auto LIH = labels.getHandle<int64_t>();
 
   for (int iter = numIterations; iter < numIterations + 10; iter++) {
-    sample.copyConsecutiveSlices(&imageInputs, minibatchSize * iter);
+    for (unsigned i = 0; i < minibatchSize; i++) {
+      source.read(minibatchSize * iter + i, {&sample, &labels}, i);
+    }
     updateVariables({A}, {&sample});
     EE.run();
 
@@ -178,7 +179,7 @@ void testMNIST() {
       auto T = res.getHandle<>().extractSlice(i);
       int64_t guess = T.getHandle<>().minMaxArg().second;
 
-      int64_t correct = LIH.at({minibatchSize * iter + i, 0});
+      int64_t correct = LIH.at({i, 0});
       rightAnswer += (guess == correct);
 
       if (iter == numIterations) {
@@ -300,6 +300,48 @@ void testPTB() {
     timer.stopTimer();
   }
 
+  // Evaluate the trained network on the words of the first sequence of the
+  // batches with one step of the RNN per word. The step carries the state
+  // over from the previous word instead of restarting every numSteps words,
+  // and costs the same for every word.
+  Function *stepF = mod.createFunction("step");
+  Variable *stepX =
+      mod.createVariable(ElemKind::FloatTy, {1, vocabSize}, "step_input",
+                         VisibilityKind::Public, false);
+  Variable *stepY =
+      mod.createVariable(ElemKind::Int64ITy, {1, 1}, "step_selected",
+                         VisibilityKind::Public, false);
+  Variable *stepH =
+      mod.createVariable(ElemKind::FloatTy, {1, hiddenSize}, "step_state",
+                         VisibilityKind::Public, false);
+  stepH->getPayload().zero();
+  auto *stepO = stepF->createSimpleRNNStep("rnn", stepX, stepH);
+  auto *stepResult = stepF->createSave(
+      "step_result", stepF->createSoftMax("step_softmax", stepO, stepY));
+  EE.compile(CompilationMode::Infer, stepF, ctx);
+
+  float streamPerplexity = 0;
+  Tensor word(ElemKind::FloatTy, {1, vocabSize});
+  auto IWH = inputWords.getHandle<>();
+  for (size_t batch = 0; batch < numBatches; batch++) {
+    size_t sequence = batch * minibatchSize;
+    for (size_t step = 0; step < numSteps; step++) {
+      for (size_t i = 0; i < vocabSize; i++) {
+        word.getHandle().at({0, i}) =
+            IWH.at({sequence, step * vocabSize + i});
+      }
+      updateVariables({stepX}, {&word});
+      EE.run();
+      size_t correct = targetWords.getHandle<int64_t>().at({sequence, step});
+      auto SH = stepResult->getVariable()->getPayload().getHandle();
+      streamPerplexity -= std::log(SH.at({0, correct}));
+    }
+  }
+  llvm::outs() << "Streaming perplexity: "
+               << format("%0.4f", std::exp(streamPerplexity /
+                                           (numBatches * numSteps)))
+               << "\n\n";
+
   llvm::outs() << "Perplexity scores in copy-pastable format:\n";
   for (size_t iter = 0; iter < numEpochs; iter++) {
     if (iter != 0 && iter % 2 == 0)
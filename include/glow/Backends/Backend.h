@@ -20,8 +20,11 @@
 #include "glow/Base/Traits.h"
 #include "glow/Optimizer/Optimizer.h"
 
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
 
+#include <string>
+
 namespace glow {
 
 class IRFunction;
@@ -34,6 +37,12 @@ enum class BackendKind {
   CPU,         // Compile and run the code on the host.
 };
 
+/// An entry point of a bundle: the function \p F, exported as \p name.
+struct BundleEntry {
+  Function *F;
+  std::string name;
+};
+
 // This is the interface that glow backends need to implement.
 class Backend {
 public:
@@ -54,6 +63,16 @@ public:
     GLOW_UNREACHABLE("Saving a bundle is not supported by the backend");
   }
 
+  /// Save a single bundle with an entry point for each of the functions of
+  /// \p entries in \p outputDir. The functions belong to the same module, and
+  /// the entry points share the weights of its variables, so the bundle has a
+  /// single weights file. Prepend all generated files with \p bundleName.
+  virtual void save(llvm::ArrayRef<BundleEntry> entries,
+                    llvm::StringRef outputDir,
+                    llvm::StringRef bundleName) const {
+    GLOW_UNREACHABLE("Saving a bundle is not supported by the backend");
+  }
+
   /// @name Backend transform methods for different phases.
   /// These methods are called by the compiler before code generation and gives
   /// the backend an opportunity to transform the graph before IRGen. The
@@ -80,11 +99,41 @@ public:
   /// \returns true if the Backend wants the buffer sharing optimization
   /// performed.
   virtual bool shouldShareBuffers() const { return true; }
+
+  /// \returns the kind of the scheduler that orders the graph nodes of the
+  /// functions compiled by the Backend.
+  virtual SchedulerKind getSchedulerKind() const {
+    return SchedulerKind::ChildMemSize;
+  }
+
+  /// Make the functions compiled after this call use the scheduler that
+  /// minimizes their peak memory usage instead of the one the backend prefers,
+  /// e.g. to fit a memory budget.
+  void setMinimizePeakMemory(bool enable) { minimizePeakMemory_ = enable; }
+
+  /// \returns the kind of the scheduler that the compilation uses: the one
+  /// the backend prefers, unless the peak memory usage is minimized.
+  SchedulerKind getCompileSchedulerKind() const {
+    return minimizePeakMemory_ ? SchedulerKind::MinPeakMemory
+                               : getSchedulerKind();
+  }
+
+private:
+  /// Whether the compilation minimizes the peak memory usage.
+  bool minimizePeakMemory_{false};
 };
 
 /// Create a backend of kind \p kind.
 Backend *createBackend(BackendKind backendKind);
 
+/// Create a backend of kind \p backendKind that executes on its device number
+/// \p deviceIdx. The backends with a single device ignore \p deviceIdx.
+Backend *createBackend(BackendKind backendKind, unsigned deviceIdx);
+
+/// \returns the number of devices that the backends of kind \p backendKind
+/// can execute on.
+unsigned getNumDevices(BackendKind backendKind);
+
 // Backends that use Glow low-level IR should inherit from this class. It allows
 // for unit tests to create low-level IR to compile and run.
 class BackendUsingGlowIR : public Backend {
@@ -16,18 +16,46 @@
 #ifndef GLOW_BACKENDS_COMPILEDFUNCTION_H
 #define GLOW_BACKENDS_COMPILEDFUNCTION_H
 
+#include "glow/Base/MemoryUsage.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
 #include <unordered_map>
 
 namespace glow {
 
+class Context;
+class Variable;
+
 /// Interface for executing a compiled function.
 class CompiledFunction {
 public:
   /// Dtor.
   virtual ~CompiledFunction() = default;
 
-  /// Execute the network.
+  /// Execute the network using the tensors of the context the function was
+  /// compiled with.
   virtual void execute() = 0;
+
+  /// Execute the network using the tensors of \p ctx to back the
+  /// placeholders. The context must provide a tensor of the right type for
+  /// every placeholder that was bound at compile time. Backends that support
+  /// it allow for invoking this method concurrently from multiple threads
+  /// with different contexts: every invocation uses its own memory for the
+  /// activations, while the variables of the module are shared between them.
+  /// Therefore, only networks that do not write to variables can be executed
+  /// concurrently.
+  virtual void execute(Context &ctx) = 0;
+
+  /// Notify the function that the payloads of the variables \p vars were
+  /// updated in place, e.g. by Module::updateWeights(), so that the copies of
+  /// them that the function keeps are refreshed. The function must not be
+  /// executing. Backends that read the payloads directly have nothing to do.
+  virtual void updateWeights(llvm::ArrayRef<Variable *> vars) {}
+
+  /// \returns the memory that the function uses, broken down by its use.
+  /// Backends that do not track it report nothing.
+  virtual MemoryUsage getMemoryUsage() const { return MemoryUsage(); }
 };
 
 } // end namespace glow
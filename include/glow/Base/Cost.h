@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BASE_COST_H
+#define GLOW_BASE_COST_H
+
+#include <cstdint>
+
+namespace glow {
+
+/// The static cost of a node or of an instruction: the number of arithmetic
+/// operations that it performs and the number of bytes that it moves. The
+/// costs of the nodes of a function add up to the cost of the function.
+struct Cost {
+  /// The number of arithmetic operations. A multiply-add counts as two.
+  uint64_t flops{0};
+  /// The number of bytes of the operands that are read.
+  uint64_t bytesRead{0};
+  /// The number of bytes of the results that are written.
+  uint64_t bytesWritten{0};
+
+  Cost &operator+=(const Cost &other) {
+    flops += other.flops;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    return *this;
+  }
+
+  /// \returns the total number of bytes moved.
+  uint64_t getBytes() const { return bytesRead + bytesWritten; }
+
+  /// \returns the number of operations per byte moved, which tells whether
+  /// the computation is bound by the memory bandwidth or by the arithmetic.
+  double getArithmeticIntensity() const {
+    return getBytes() ? double(flops) / getBytes() : 0;
+  }
+};
+
+} // namespace glow
+
+#endif // GLOW_BASE_COST_H
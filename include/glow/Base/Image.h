@@ -21,6 +21,30 @@
 #include <tuple>
 
 namespace glow {
+
+/// The range of the normalized pixel values.
+enum class ImageNormalizationMode {
+  kneg1to1,     // Values are in the range: -1 and 1.
+  k0to1,        // Values are in the range: 0 and 1.
+  k0to256,      // Values are in the range: 0 and 256.
+  kneg128to127, // Values are in the range: -128 .. 127
+};
+
+/// The layout of a batch of images.
+enum class ImageLayout {
+  NCHW,
+  NHWC,
+};
+
+/// The order of the color channels of an image.
+enum class ImageChannelOrder {
+  BGR,
+  RGB,
+};
+
+/// Convert the normalization to numeric floating poing ranges.
+std::pair<float, float> normModeToRange(ImageNormalizationMode mode);
+
 /// Reads a png image header from png file \p filename and \returns a tuple
 /// containing height, width, and a bool if it is grayscale or not.
 std::tuple<size_t, size_t, bool> getPngInfo(const char *filename);
@@ -30,6 +54,16 @@ std::tuple<size_t, size_t, bool> getPngInfo(const char *filename);
 bool readPngImage(Tensor *T, const char *filename,
                   std::pair<float, float> range);
 
+/// Reads the png image \p filename into the image \p n of \p batch, a float
+/// tensor in the layout \p layout, e.g. {N x C x H x W} for NCHW. The values
+/// are normalized to the range \p range and the channels are stored in the
+/// order \p order. The conversion, the reordering and the layout change are
+/// done in a single pass over the decoded rows. \returns True if an error
+/// occurred or if the image does not have the dimensions of the batch.
+bool readPngImageIntoBatch(Tensor *batch, size_t n, const char *filename,
+                           std::pair<float, float> range,
+                           ImageChannelOrder order, ImageLayout layout);
+
 /// Writes a png image. \returns True if an error occurred. The values of the
 /// image are in the range \p range.
 bool writePngImage(Tensor *T, const char *filename,
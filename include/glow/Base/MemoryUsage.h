@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BASE_MEMORYUSAGE_H
+#define GLOW_BASE_MEMORYUSAGE_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+
+namespace glow {
+
+/// The memory that a function needs, in bytes, broken down by its use. It is
+/// either estimated from the graph before the compilation, see
+/// Function::estimateMemoryUsage(), or reported by the compiled function, see
+/// CompiledFunction::getMemoryUsage(). The tensors backing the placeholders
+/// are provided by the caller and are not counted.
+struct MemoryUsage {
+  /// The weights that the function only reads. They may be shared with the
+  /// other functions of the module.
+  uint64_t constantWeights{0};
+  /// The weights that the function writes to.
+  uint64_t mutableWeights{0};
+  /// The heap holding the intermediate results of an execution.
+  uint64_t activations{0};
+  /// The machine code generated for the function.
+  uint64_t code{0};
+  /// The other memory the function owns, e.g. the copies of the weights or
+  /// the buffers through which they are streamed.
+  uint64_t scratch{0};
+
+  /// \returns the sum of all of the areas.
+  uint64_t getTotal() const {
+    return constantWeights + mutableWeights + activations + code + scratch;
+  }
+
+  /// Print the areas and their total to \p os.
+  void dump(llvm::raw_ostream &os) const;
+
+  /// Print the areas and their total to llvm::outs().
+  void dump() const;
+};
+
+} // namespace glow
+
+#endif // GLOW_BASE_MEMORYUSAGE_H
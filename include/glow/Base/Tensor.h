@@ -16,15 +16,19 @@
 #ifndef GLOW_BASE_TENSOR_H
 #define GLOW_BASE_TENSOR_H
 
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <vector>
 
 #include "glow/Base/Type.h"
 #include "glow/Support/Compiler.h"
+#include "glow/Support/HugePages.h"
 #include "glow/Support/Memory.h"
 #include "glow/Support/Random.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
 
 namespace glow {
 
@@ -39,12 +43,27 @@ class Tensor;
 void genericTranspose(Tensor *src, Tensor *dest,
                       llvm::ArrayRef<unsigned_t> shuffle);
 
+/// Copy the region of shape \p dims from \p src to \p dest. The elements are
+/// \p elemSize bytes large, and \p destStrides and \p srcStrides are the
+/// distances, in elements, between consecutive coordinates of each dimension.
+/// Dimensions that are contiguous in both buffers are copied with memcpy, and
+/// transposed dimensions are copied one cache sized tile at a time.
+void copyStrided(char *dest, const char *src, llvm::ArrayRef<size_t> dims,
+                 llvm::ArrayRef<size_t> destStrides,
+                 llvm::ArrayRef<size_t> srcStrides, size_t elemSize);
+
 /// Helper function that \returns a ShapeVector of those dimensions in \p
 /// currDims expanded with dimension = 1 until the maximum tensor dimension is
 /// reached. The number of elements in the input dims is the same as in the
 /// returned dims. For example, input {2,1,4} would result in {2,1,4,1,1,1}.
 ShapeVector expandDimsToMax(llvm::ArrayRef<size_t> currDims);
 
+/// Invoke \p fn on the blocks [begin, end) that split the range [0, \p size).
+/// Large ranges are split among the threads of the shared thread pool, which
+/// call \p fn in parallel.
+void forEachBlock(size_t size,
+                  const std::function<void(size_t begin, size_t end)> &fn);
+
 /// A class that represents a contiguous n-dimensional array (a tensor).
 class Tensor final {
 public:
@@ -235,7 +254,9 @@ public:
     // Note: zero-dimensional tensors have size 1.
     assert(size() > 0 && "Tensors must always have positive size.");
     size_t count = size() * type_.getElementSize();
-    data_ = reinterpret_cast<char *>(alignedAlloc(count, TensorAlignment));
+    data_ = reinterpret_cast<char *>(alignedAlloc(
+        count, getTensorPayloadAlignment(count, TensorAlignment)));
+    adviseTensorPayload(data_, count);
     zero();
   }
 
@@ -260,6 +281,14 @@ public:
     return *this;
   }
 
+  /// \returns the hash of the type and of the whole content of the tensor,
+  /// which is hashed as a single range of bytes.
+  llvm::hash_code getContentHash() const {
+    auto *data = getData();
+    return llvm::hash_combine(
+        type_, llvm::hash_combine_range(data, data + type_.getSizeInBytes()));
+  }
+
   /// \returns true if the content of the other tensor \p other is identical to
   /// this one.
   bool isEqual(const Tensor &other, float allowedError = 0.0001) const {
@@ -270,6 +299,10 @@ public:
     switch (getElementType()) {
     case ElemKind::FloatTy:
       return isEqualImpl<float>(other, allowedError);
+    case ElemKind::Float16Ty:
+      return isEqualImpl<float16_t>(other, allowedError);
+    case ElemKind::BFloat16Ty:
+      return isEqualImpl<bfloat16_t>(other, allowedError);
     case ElemKind::Int8QTy:
       assert(getType().getScale() == other.getType().getScale() &&
              "Scales must match.");
@@ -319,6 +352,18 @@ public:
               &t->getData()[bufferSize * (slice + 1)], getData());
   }
 
+  /// Update the slice \p slice of the tensor with the content of the tensor
+  /// \p t. This is the inverse of copySlice.
+  void insertSlice(const Tensor *t, size_t slice) {
+    assert(t->dims() == dims().slice(1) && "Invalid slice size");
+    assert(getElementType() == t->getElementType() && "Invalid element type");
+    assert(slice < dims()[0] && "Invalid slice index");
+
+    size_t bufferSize = t->size() * type_.getElementSize();
+    std::copy(&t->getData()[0], &t->getData()[bufferSize],
+              &getData()[bufferSize * slice]);
+  }
+
   /// Update the content of the tensor with a sequence of slices from the
   /// tensor \p t. A slice is one index from the first dimension of the tensor.
   /// The copying operation may overlap the end of the tensor \p t one or more
@@ -379,9 +424,17 @@ private:
   bool isEqualImpl(const Tensor &other, float allowedError) const {
     auto const *myData = getRawDataPointer<ElemTy>();
     auto const *otherData = other.getRawDataPointer<ElemTy>();
-    for (size_t i = 0, e = size(); i < e; i++) {
-      double delta = myData[i] - otherData[i];
-      if (std::abs(delta) > allowedError) {
+    // Compare blocks of elements without a branch per element, so that the
+    // comparisons are vectorized, and stop at the first block that differs.
+    constexpr size_t blockSize = 256;
+    for (size_t begin = 0, e = size(); begin < e; begin += blockSize) {
+      size_t end = std::min(begin + blockSize, e);
+      bool differs = false;
+      for (size_t i = begin; i < end; i++) {
+        double delta = myData[i] - otherData[i];
+        differs |= std::abs(delta) > allowedError;
+      }
+      if (differs) {
         return false;
       }
     }
@@ -530,6 +583,58 @@ public:
     return data[index];
   }
 
+  /// \returns all of the elements, in the order of their raw indices. Loops
+  /// over the array do no index calculation, unlike at(), and are vectorized.
+  llvm::MutableArrayRef<ElemTy> getRawData() {
+    return {tensor_->getRawDataPointer<ElemTy>(), size()};
+  }
+
+  /// \returns all of the elements, in the order of their raw indices.
+  llvm::ArrayRef<ElemTy> getRawData() const {
+    return {tensor_->getRawDataPointer<ElemTy>(), size()};
+  }
+
+  ElemTy *begin() { return tensor_->getRawDataPointer<ElemTy>(); }
+  ElemTy *end() { return begin() + size(); }
+  const ElemTy *begin() const { return tensor_->getRawDataPointer<ElemTy>(); }
+  const ElemTy *end() const { return begin() + size(); }
+
+  /// Copy the elements of \p src, which has as many elements as the tensor,
+  /// converting them to ElemTy.
+  template <class SrcTy> void copyFrom(llvm::ArrayRef<SrcTy> src) {
+    assert(size() == src.size() && "Invalid input size.");
+    std::transform(src.begin(), src.end(), begin(),
+                   [](SrcTy v) { return static_cast<ElemTy>(v); });
+  }
+
+  /// Copy the elements of the tensor into \p dest, of the same size,
+  /// converting them to DestTy.
+  template <class DestTy>
+  void copyTo(llvm::MutableArrayRef<DestTy> dest) const {
+    assert(size() == dest.size() && "Invalid output size.");
+    std::transform(begin(), end(), dest.begin(),
+                   [](ElemTy v) { return static_cast<DestTy>(v); });
+  }
+
+  /// \returns the smallest and the largest of the raw elements in
+  /// [\p first, \p last).
+  std::pair<ElemTy, ElemTy> minMax(size_t first, size_t last) const {
+    assert(first < last && last <= size() && "Invalid range.");
+    const ElemTy *data = begin();
+    // Without a branch that depends on the order of the elements, the
+    // reduction is vectorized.
+    ElemTy min = data[first];
+    ElemTy max = data[first];
+    for (size_t i = first + 1; i < last; i++) {
+      min = data[i] < min ? data[i] : min;
+      max = data[i] > max ? data[i] : max;
+    }
+    return std::make_pair(min, max);
+  }
+
+  /// \returns the smallest and the largest elements of the tensor.
+  std::pair<ElemTy, ElemTy> minMax() const { return minMax(0, size()); }
+
   /// Extract a smaller dimension tensor from a specific slice (that has to be
   /// the first dimension).
   Tensor extractSlice(size_t idx) const {
@@ -562,9 +667,7 @@ public:
 
   void operator=(llvm::ArrayRef<ElemTy> array) {
     assert(size() == array.size() && "Invalid input size.");
-    for (size_t i = 0, e = array.size(); i < e; ++i) {
-      raw(i) = array[i];
-    }
+    std::copy(array.begin(), array.end(), begin());
   }
 
   void dumpAscii(llvm::raw_ostream &os) const { dumpAsciiImpl(tensor_, os); }
@@ -573,33 +676,30 @@ public:
   /// \returns the raw indices of a min and max values from the tensor.
   /// In case of multiple min or max, the smallest index is returned.
   std::pair<size_t, size_t> minMaxArg() const {
-    ElemTy max = raw(0);
-    ElemTy min = raw(0);
-
-    size_t maxIdx = 0;
-    size_t minIdx = 0;
-
-    for (size_t i = 1, e = size(); i < e; i++) {
-      ElemTy val = raw(i);
-      if (val > max) {
-        max = val;
-        maxIdx = i;
-      } else if (val < min) {
-        min = val;
-        minIdx = i;
-      }
-    }
-
+    // Find the values with a vectorized reduction, then their first indices.
+    auto minMaxValues = minMax();
+    size_t minIdx = std::find(begin(), end(), minMaxValues.first) - begin();
+    size_t maxIdx = std::find(begin(), end(), minMaxValues.second) - begin();
+    // A NaN in the first element is never found, and is both extremes.
+    minIdx = minIdx < size() ? minIdx : 0;
+    maxIdx = maxIdx < size() ? maxIdx : 0;
     return std::make_pair(minIdx, maxIdx);
   }
 
   /// \returns true if tensor contains only elements equal to zero.
   bool isZero() const {
-    for (size_t i = 0, e = size(); i < e; i++) {
-      if (raw(i) != 0)
+    const ElemTy *data = begin();
+    constexpr size_t blockSize = 256;
+    for (size_t first = 0, e = size(); first < e; first += blockSize) {
+      size_t last = std::min(first + blockSize, e);
+      bool nonZero = false;
+      for (size_t i = first; i < last; i++) {
+        nonZero |= data[i] != 0;
+      }
+      if (nonZero) {
         return false;
+      }
     }
-
     return true;
   }
 
@@ -617,10 +717,15 @@ public:
   void initXavier(size_t filterSize, PseudoRNG &PRNG) {
     assert(filterSize > 0 && "invalid filter size");
     double scale = std::sqrt(3.0 / double(filterSize));
-    std::uniform_real_distribution<> dist(-scale, scale);
-    for (size_t i = 0, e = size(); i < e; i++) {
-      raw(i) = dist(PRNG);
-    }
+    // Each element is a function of its index and of a single key drawn from
+    // PRNG, so the tensor is filled in parallel and the values do not depend
+    // on the number of threads.
+    CounterRNG CRNG(PRNG);
+    forEachBlock(size(), [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        raw(i) = CRNG.nextRandReal(i, -scale, scale);
+      }
+    });
   }
 
   /// Fill the tensor with uniformly distributed values in the range
@@ -635,6 +740,19 @@ public:
     }
   }
 
+  /// Fill the half precision or bfloat16 tensor with uniformly distributed
+  /// values in the range [low .. high], rounded to the element type.
+  template <typename T = ElemTy>
+  typename std::enable_if<std::is_same<T, float16_t>::value ||
+                          std::is_same<T, bfloat16_t>::value>::type
+  randomize(float low, float high, PseudoRNG &PRNG) {
+    assert(low < high && "invalid range");
+    std::uniform_real_distribution<float> dist(low, high);
+    for (size_t i = 0, e = size(); i < e; i++) {
+      raw(i) = dist(PRNG);
+    }
+  }
+
   /// Fill the tensor with uniformly distributed values in the range
   /// [low .. high].
   template <typename T = ElemTy>
@@ -679,10 +797,7 @@ public:
   /// tensors must be of the right dimensions.
   void insertTensors(Handle<ElemTy> &slice, llvm::ArrayRef<size_t> offset,
                      size_t count = 1, size_t axis = 0) {
-    auto sliceCoor = slice.dims().vec();
-    auto fusedCoor = dims().vec();
-    insertTensorsImpl(sliceCoor, fusedCoor, slice, true, offset, count, axis,
-                      0);
+    insertTensorsImpl(slice, true, offset, count, axis);
   }
 
   /// Extract the tensor \p slice at location \p offset. This operation is
@@ -691,55 +806,36 @@ public:
   /// tensor at {d_0 + O_0, d_1 + O_1, ... d_n + O_n}, where O is the offset
   /// vector. The tensors must be of the right dimensions.
   void extractTensors(Handle<ElemTy> &slice, llvm::ArrayRef<size_t> offset) {
-    auto sliceCoor = slice.dims().vec();
-    auto fusedCoor = dims().vec();
-    insertTensorsImpl(sliceCoor, fusedCoor, slice, false, offset, /* count */ 1,
-                      /* axis */ 0, 0);
+    insertTensorsImpl(slice, false, offset, /* count */ 1, /* axis */ 0);
   }
 
 private:
   /// Concats or splits tensors.
-  /// This method concats or extracts a slice from a tensor.
-  /// \p sliceCoor and \p fusedCoor are temporary storage that the function uses
-  /// to construct the coordinates to access the tensor. They must be
-  /// initialized to be the size of the shape of the tensor. \p slice and \p
-  /// fused are the tensors to concat or extract. \p offset is the offset of the
-  /// slice to add or extract along the dimension \p offsetDim. \p d is the
-  /// recursion depth parameter that's following the number of the axis. if \p
-  /// isInsert is set then data is copied from \p slice to \p fused. Otherwise
-  /// data is copied from \p fused to \p slice. \p count and \p axis are used in
-  /// conjunction for inserting the same tensor \p count times along the \p
-  /// axis.
-  void insertTensorsImpl(llvm::MutableArrayRef<size_t> sliceCoor,
-                         llvm::MutableArrayRef<size_t> fusedCoor,
-                         Handle<ElemTy> &slice, bool isInsert,
+  /// This method concats or extracts a slice from a tensor. \p slice is the
+  /// tensor to concat or extract. \p offset is the offset of the slice in this
+  /// tensor. if \p isInsert is set then data is copied from \p slice to this
+  /// tensor. Otherwise data is copied from this tensor to \p slice. \p count
+  /// and \p axis are used in conjunction for inserting the same tensor \p
+  /// count times along the \p axis.
+  void insertTensorsImpl(Handle<ElemTy> &slice, bool isInsert,
                          llvm::ArrayRef<size_t> offset, size_t count,
-                         size_t axis, unsigned d) {
-    bool isDone = (d == slice.dims().size());
-
-    if (isDone) {
+                         size_t axis) {
+    assert(slice.dims().size() == numDims_ && "Invalid slice dimensions");
+    auto sliceDims = slice.dims();
+    llvm::ArrayRef<size_t> fusedStrides(sizeIntegral_, numDims_);
+    llvm::ArrayRef<size_t> sliceStrides(slice.sizeIntegral_, numDims_);
+    char *sliceData = slice.tensor_->getUnsafePtr();
+    char *fusedData =
+        tensor_->getUnsafePtr() + getElementPtr(offset) * sizeof(ElemTy);
+    size_t countStride = sliceDims[axis] * sizeIntegral_[axis] * sizeof(ElemTy);
+    for (size_t c = 0; c < count; c++) {
+      char *fused = fusedData + c * countStride;
       if (isInsert) {
-        at(fusedCoor) = slice.at(sliceCoor);
+        copyStrided(fused, sliceData, sliceDims, fusedStrides, sliceStrides,
+                    sizeof(ElemTy));
       } else {
-        slice.at(sliceCoor) = at(fusedCoor);
-      }
-      return;
-    }
-
-    // Only need to iterate over count if the current dimension d is equal to
-    // the axis we're inserting over.
-    const size_t countIters = (axis == d) ? count : 1;
-    for (size_t c = 0; c < countIters; c++) {
-      for (size_t i = 0, e = slice.dims()[d]; i < e; i++) {
-        // Construct the coordinates for the slice and for the joint shape.
-        // Add the 'offset' to the dimension that we concat the shapes on.
-        sliceCoor[d] = i;
-        // If this is the correct axis to insert multiple times then calcuate
-        // the additional offset to use.
-        const size_t countAxisOffset = (axis == d) ? c * slice.dims()[d] : 0;
-        fusedCoor[d] = i + offset[d] + countAxisOffset;
-        insertTensorsImpl(sliceCoor, fusedCoor, slice, isInsert, offset, count,
-                          axis, d + 1);
+        copyStrided(sliceData, fused, sliceDims, sliceStrides, fusedStrides,
+                    sizeof(ElemTy));
       }
     }
   }
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BASE_TENSORFILE_H
+#define GLOW_BASE_TENSORFILE_H
+
+#include "glow/Base/Tensor.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace glow {
+
+/// A file of samples in the NPY format of numpy, mapped in memory, so that
+/// preprocessed inputs are fed to a network without decoding them. The first
+/// dimension of the array is the sample, and the other ones are the dims of a
+/// sample, e.g. N x C x H x W for images in the NCHW layout. The array is in
+/// row-major order, with float32, int64 or uint8 elements in the byte order
+/// of the host.
+class NpyFile {
+public:
+  /// The kinds of the elements of a file.
+  enum class Kind { Float32, Int64, UInt8 };
+
+private:
+  /// The mapped file.
+  std::unique_ptr<llvm::MemoryBuffer> buffer_;
+  /// The kind of the elements.
+  Kind kind_;
+  /// The dims of the array.
+  std::vector<size_t> dims_;
+  /// The first element of the array.
+  const char *data_;
+
+  NpyFile() = default;
+
+public:
+  /// Map the NPY file \p filename. \returns null, after printing why, if it
+  /// can't be read or if its array is not supported.
+  static std::unique_ptr<NpyFile> open(llvm::StringRef filename);
+
+  /// \returns the kind of the elements.
+  Kind getKind() const { return kind_; }
+
+  /// \returns the number of samples.
+  size_t getNumSamples() const { return dims_[0]; }
+
+  /// \returns the dims of a sample.
+  llvm::ArrayRef<size_t> getSampleDims() const {
+    return llvm::ArrayRef<size_t>(dims_).drop_front();
+  }
+
+  /// \returns the size in bytes of a sample.
+  size_t getSampleSize() const;
+
+  /// \returns an unowned tensor over the \p count samples from \p first,
+  /// whose dims are {count} followed by the dims of a sample. The elements
+  /// must be float32 or int64. No data is copied: the tensor is valid as long
+  /// as the file is.
+  Tensor getSamples(size_t first, size_t count) const;
+
+  /// Copy the \p count samples from \p first into the first samples of the
+  /// float tensor \p batch, whose samples have the dims of the samples of the
+  /// file. The uint8 elements are normalized to the range \p range, like the
+  /// pixels of the images.
+  void copySamples(size_t first, size_t count, Tensor *batch,
+                   std::pair<float, float> range) const;
+};
+
+} // namespace glow
+
+#endif // GLOW_BASE_TENSORFILE_H
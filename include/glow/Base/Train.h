@@ -26,14 +26,50 @@ namespace glow {
 
 class Tensor;
 
+/// The algorithms that update the trained weights with their gradients.
+enum class OptimizerKind {
+  SGD,     // Stochastic gradient descent, with an optional momentum.
+  Adagrad, // Scales the steps by the accumulated squares of the gradients.
+  RMSProp, // Scales the steps by the moving average of the squared gradients.
+  Adam,    // Adaptive moment estimation.
+};
+
 /// This is a list of parameters that the network trainers (such as sgd and
 /// adam) use for training the network.
 struct TrainingConfig {
+  /// The algorithm that updates the weights.
+  OptimizerKind optimizer{OptimizerKind::SGD};
   float L1Decay{0};
   float L2Decay{0};
   float learningRate{0.01f};
+  /// The momentum of SGD.
   float momentum{0.0};
+  /// The decay of the moving average of the squared gradients of RMSProp.
+  float decay{0.9f};
+  /// The decay rates of the first and second moment estimates of Adam.
+  float beta1{0.9f};
+  float beta2{0.999f};
+  /// Added to the denominators of the adaptive optimizers to avoid divisions
+  /// by zero.
+  float epsilon{1e-8f};
   unsigned batchSize{1};
+  /// The number of bytes of forward activations that the backward pass may
+  /// keep alive. Cheap activations beyond the budget are recomputed during the
+  /// backward pass instead. Zero keeps all activations.
+  size_t activationMemoryBudget{0};
+  /// Store the forward activations that the backward pass reads, and the
+  /// gradients that the backward nodes pass to each other, in half precision.
+  /// The weights, their updates and the arithmetic stay in float.
+  bool float16Gradients{false};
+  /// The factor that the gradients of the losses are multiplied by, so that
+  /// small gradients do not flush to zero in half precision. The gradients of
+  /// the weights are divided by it before the update.
+  float lossScale{1};
+  /// Adjust the loss scale while training: a step whose gradients overflow
+  /// halves the scale and updates the weights with zero gradients, and
+  /// lossScaleGrowthInterval steps in a row without overflow double it.
+  bool dynamicLossScaling{false};
+  unsigned lossScaleGrowthInterval{2000};
 };
 
 } // namespace glow
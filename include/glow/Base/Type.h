@@ -16,13 +16,17 @@
 #ifndef GLOW_BASE_TYPE_H
 #define GLOW_BASE_TYPE_H
 
+#include "glow/Support/BFloat16.h"
 #include "glow/Support/Compiler.h"
+#include "glow/Support/Float16.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/StringRef.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <type_traits>
 #include <utility>
 
@@ -180,11 +184,13 @@ inline bool operator==(const ShapeNCHW &LHS, const ShapeNCHW &RHS) {
 /// An enum representing the type used by the elements of a tensor. The types of
 /// Handles for these tensors should match the element kind.
 enum class ElemKind : unsigned char {
-  FloatTy,  // 32-bit float type (float)
-  Int8QTy,  // 8-bit quantized type (int8_t)
-  Int16QTy, // 16-bit quantized type (int16_t)
-  Int32QTy, // 32-bit quantized type (int32_t)
-  Int64ITy, // 64-bit index type (int64_t)
+  FloatTy,    // 32-bit float type (float)
+  Float16Ty,  // 16-bit float type (float16_t)
+  BFloat16Ty, // 16-bit brain float type (bfloat16_t)
+  Int8QTy,    // 8-bit quantized type (int8_t)
+  Int16QTy,   // 16-bit quantized type (int16_t)
+  Int32QTy,   // 32-bit quantized type (int32_t)
+  Int64ITy,   // 64-bit index type (int64_t)
 };
 
 /// A class that represents a type of a tensor.
@@ -341,6 +347,10 @@ struct Type final {
     switch (Ty) {
     case ElemKind::FloatTy:
       return std::is_same<ElemTy, float>::value;
+    case ElemKind::Float16Ty:
+      return std::is_same<ElemTy, float16_t>::value;
+    case ElemKind::BFloat16Ty:
+      return std::is_same<ElemTy, bfloat16_t>::value;
     case ElemKind::Int8QTy:
       return std::is_same<ElemTy, int8_t>::value;
     case ElemKind::Int16QTy:
@@ -371,6 +381,10 @@ struct Type final {
     switch (Ty) {
     case ElemKind::FloatTy:
       return sizeof(float);
+    case ElemKind::Float16Ty:
+      return sizeof(float16_t);
+    case ElemKind::BFloat16Ty:
+      return sizeof(bfloat16_t);
     case ElemKind::Int8QTy:
       return sizeof(int8_t);
     case ElemKind::Int16QTy:
@@ -391,7 +405,7 @@ struct Type final {
   /// \return the textual name of the element \p Ty.
   static llvm::StringRef getElementName(ElemKind Ty) {
     static const char *names[] = {
-        "float", "i8", "i16", "i32", "index",
+        "float", "float16", "bfloat16", "i8", "i16", "i32", "index",
     };
     return names[(int)Ty];
   }
@@ -414,6 +428,27 @@ inline bool operator==(const Type &LHS, const Type &RHS) {
   return LHS.isEqual(RHS);
 }
 
+/// \returns a hash of the contents of the type \p T. Equal types, in the sense
+/// of Type::isEqual(), have the same hash.
+inline llvm::hash_code hash_value(const Type &T) {
+  auto dims = T.dims();
+  llvm::hash_code hash =
+      llvm::hash_combine(static_cast<int>(T.getElementType()),
+                         llvm::hash_combine_range(dims.begin(), dims.end()));
+  if (T.isQuantizedType()) {
+    float scale = T.getScale();
+    uint32_t scaleBits;
+    memcpy(&scaleBits, &scale, sizeof(scale));
+    // Zero and negative zero are equal scales, so they must hash alike. The
+    // bits are tested, because fast-math may ignore the sign of zeros.
+    if (!(scaleBits << 1)) {
+      scaleBits = 0;
+    }
+    hash = llvm::hash_combine(hash, scaleBits, T.getOffset());
+  }
+  return hash;
+}
+
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const Type &type);
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const TypeRef &type);
 
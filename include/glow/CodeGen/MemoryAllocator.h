@@ -17,7 +17,8 @@
 #define GLOW_CODEGEN_MEMORYALLOCATOR_H
 #include <cstddef>
 #include <cstdint>
-#include <list>
+#include <iterator>
+#include <map>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -42,6 +43,60 @@ public:
   bool contains(uint64_t idx) const { return idx >= begin_ && idx < end_; }
 };
 
+/// An ordered set of disjoint free segments, which finds the free segment with
+/// the lowest address among those of at least a given size in O(log n). This
+/// is a treap ordered by the addresses of the segments, whose nodes also know
+/// the size of the largest segment in their subtree.
+class FreeSegmentTree {
+public:
+  /// Adds the free segment [\p begin .. \p end).
+  void insert(uint64_t begin, uint64_t end);
+
+  /// Removes the free segment that starts at \p begin.
+  void erase(uint64_t begin);
+
+  /// \returns the free segment with the lowest address whose size is at least
+  /// \p size, or nullptr if there is none.
+  const Segment *findFirstFit(uint64_t size) const;
+
+  /// Removes all of the segments.
+  void clear();
+
+  /// \returns the number of free segments.
+  size_t size() const { return nodes_.size() - freeNodes_.size(); }
+
+private:
+  /// A node of the treap. Children are indices into nodes_, or -1.
+  struct Node {
+    Segment segment;
+    /// The size of the largest segment in the subtree of the node.
+    uint64_t maxSize;
+    /// The heap priority of the node, which keeps the tree balanced.
+    uint32_t priority;
+    int left;
+    int right;
+  };
+
+  /// The storage of the nodes.
+  std::vector<Node> nodes_;
+  /// The indices of the unused entries of nodes_.
+  std::vector<int> freeNodes_;
+  /// The index of the root, or -1 if the tree is empty.
+  int root_{-1};
+  /// The state of the generator of priorities. The sequence is fixed, so that
+  /// the allocations are deterministic.
+  uint32_t seed_{2463534242};
+
+  /// Recomputes the largest segment size of the node \p t.
+  void update(int t);
+  /// Splits the subtree \p t into the segments that start before \p key and
+  /// those that do not.
+  void split(int t, uint64_t key, int &left, int &right);
+  /// \returns the root of the union of the subtrees \p left and \p right,
+  /// where all of the segments of \p left start before those of \p right.
+  int merge(int left, int right);
+};
+
 /// Allocates segments of memory.
 /// Each allocation is associated with a user-defined handle, typically
 /// representing a client-specific object, e.g. a handle can be a `Value *` and
@@ -57,24 +112,37 @@ public:
   /// A reserved value to mark invalid allocation.
   static const uint64_t npos;
 
+  /// A request to allocate (if \p alloc is true) or to free the buffer of
+  /// \p size bytes associated with \p handle, as one step of the sequence of
+  /// allocations of a program. The size is ignored when freeing.
+  struct Allocation {
+    Handle handle;
+    bool alloc;
+    uint64_t size;
+
+    Allocation(Handle handle, bool alloc, uint64_t size)
+        : handle(handle), alloc(alloc), size(size) {}
+  };
+
   explicit MemoryAllocator(const std::string &name, uint64_t poolSize)
       : name_(name), poolSize_(poolSize) {}
 
   void reset() {
     maxMemoryAllocated_ = 0;
+    lowerBoundMemoryUsage_ = 0;
     allocations_.clear();
+    freeSegments_.clear();
     handleToAllocInfo_.clear();
     addrToHandle_.clear();
   }
 
   /// \returns True if the value \p idx is within the currently allocated range.
   bool contains(uint64_t idx) const {
-    for (auto &s : allocations_) {
-      if (s.contains(idx)) {
-        return true;
-      }
+    auto it = allocations_.upper_bound(idx);
+    if (it == allocations_.begin()) {
+      return false;
     }
-    return false;
+    return idx < std::prev(it)->second;
   }
 
   /// Allocate a region of size \p size and associate a \p handle with it.
@@ -94,6 +162,23 @@ public:
                     const std::set<Handle> &mustNotEvict,
                     std::vector<Handle> &evicted);
 
+  /// Assigns addresses to all of the buffers of the sequence of allocations
+  /// and deallocations \p allocList at once. Knowing the whole sequence, the
+  /// allocator places every buffer into the smallest hole left by the placed
+  /// buffers whose lifetimes overlap with its own. It tries two orders, the
+  /// largest buffers first (greedy by size) and the buffers live during the
+  /// steps with the most live memory first (greedy by breadth), as well as
+  /// replaying the sequence with first-fit allocations, and keeps the
+  /// assignment with the lowest high water mark. Buffers that are
+  /// not freed by the sequence live until its end. The allocator must be
+  /// empty. Afterwards, getAddress() and getSize() return the assignment of
+  /// every handle and getMaxMemoryUsage() returns the required memory size,
+  /// but there are no live allocations.
+  ///
+  /// \returns the required memory size, or MemoryAllocator::npos if the
+  /// buffers do not fit into the memory region.
+  uint64_t allocateAll(const std::vector<Allocation> &allocList);
+
   /// \returns the handle currently associated with the allocation at \p
   /// address.
   Handle getHandle(uint64_t ptr) const;
@@ -119,6 +204,11 @@ public:
   /// \returns the high water mark for the allocated memory.
   uint64_t getMaxMemoryUsage() const { return maxMemoryAllocated_; }
 
+  /// \returns the largest total size of the buffers that are live at the same
+  /// time in the sequence of the last allocateAll(). No assignment of
+  /// addresses needs less memory than this.
+  uint64_t getMemoryUsageLowerBound() const { return lowerBoundMemoryUsage_; }
+
   /// \returns the size of the whole memory region that we can allocate segments
   /// into.
   uint64_t getMemorySize() const { return poolSize_; }
@@ -129,12 +219,17 @@ public:
 private:
   /// The name of the memory region.
   std::string name_;
-  /// A list of live buffers.
-  std::list<Segment> allocations_;
+  /// Maps the begin addresses of the live buffers to their end addresses.
+  std::map<uint64_t, uint64_t> allocations_;
+  /// The free segments between the live buffers. The memory after the last
+  /// live buffer is not part of it.
+  FreeSegmentTree freeSegments_;
   /// The size of the memory region that we can allocate segments into.
   uint64_t poolSize_;
   /// This is the high water mark for the allocated memory.
   uint64_t maxMemoryAllocated_{0};
+  /// The lower bound of the memory needed by the last allocateAll().
+  uint64_t lowerBoundMemoryUsage_{0};
   /// Maps allocated addresses to the currently associated handles.
   std::unordered_map<uint64_t, Handle> addrToHandle_;
   /// Maps handles to the allocation information about the memory block
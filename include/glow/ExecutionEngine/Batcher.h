@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_BATCHER_H
+#define GLOW_EXECUTIONENGINE_BATCHER_H
+
+#include "glow/Base/Tensor.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/ExecutionEngine/ResultCache.h"
+#include "glow/Graph/Context.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace glow {
+
+class Placeholder;
+
+/// The Batcher packs single-sample inference requests into the batch
+/// dimension of a function compiled by an ExecutionEngine. The first dimension
+/// of every input and output placeholder of the function is the batch size.
+/// A batch is executed as soon as it is full, or once the oldest request in it
+/// has waited for the maximal latency. The slots of a partial batch are padded
+/// with zeros. The outputs of each sample are then copied back to the tensors
+/// provided by the caller. With a ResultCache, a request whose inputs were
+/// already served is answered from the cache without entering a batch.
+class Batcher final {
+  /// A single-sample inference request.
+  struct Request {
+    /// Copies of the input samples, one per input placeholder.
+    std::vector<Tensor> inputs;
+    /// The tensors receiving the output samples, one per output placeholder.
+    std::vector<Tensor *> outputs;
+    /// The hash of the inputs in the result cache.
+    llvm::hash_code hash;
+    /// The time the request was enqueued.
+    std::chrono::steady_clock::time_point arrival;
+    /// Fulfilled once the outputs are written.
+    std::promise<void> done;
+  };
+
+  /// The engine that holds the compiled function.
+  ExecutionEngine &EE_;
+  /// The input placeholders of the function.
+  std::vector<Placeholder *> inputs_;
+  /// The output placeholders of the function.
+  std::vector<Placeholder *> outputs_;
+  /// The maximal number of samples in a batch.
+  size_t maxBatchSize_;
+  /// The maximal time a request waits for the batch to fill up.
+  std::chrono::microseconds maxLatency_;
+  /// Holds the batched tensors of the placeholders.
+  Context ctx_;
+  /// The cache of the results of the samples, or null.
+  ResultCache *cache_;
+  /// The version of the model in the result cache.
+  uint64_t modelVersion_;
+
+  /// The pending requests, in arrival order.
+  std::deque<Request> requests_;
+  /// Set when the worker thread needs to exit.
+  bool stop_{false};
+  /// Protects the request queue.
+  std::mutex mutex_;
+  /// Notifies the worker thread about new requests.
+  std::condition_variable cv_;
+  /// The thread forming and executing the batches.
+  std::thread worker_;
+
+  /// The body of the worker thread.
+  void processRequests();
+
+  /// Execute the requests \p batch as a single batch.
+  void runBatch(std::vector<Request> &batch);
+
+public:
+  /// Ctor. The function compiled by \p EE reads the batched \p inputs and
+  /// writes the batched \p outputs. A partial batch is executed when its
+  /// oldest request waited for \p maxLatency. If \p maxBatchSize is not zero,
+  /// it limits the number of samples in a batch, which is otherwise the batch
+  /// size the function was compiled for. If \p cache is not null, the results
+  /// of the samples are cached in it, as computed by the model \p modelVersion,
+  /// and the requests that hit the cache bypass the batches.
+  Batcher(ExecutionEngine &EE, llvm::ArrayRef<Placeholder *> inputs,
+          llvm::ArrayRef<Placeholder *> outputs,
+          std::chrono::microseconds maxLatency, size_t maxBatchSize = 0,
+          ResultCache *cache = nullptr, uint64_t modelVersion = 0);
+
+  /// Execute the pending requests and stop the worker thread.
+  ~Batcher();
+
+  /// Enqueue a single-sample request. The samples \p inputs are copied before
+  /// the method returns. The dims of each input and output sample are the
+  /// dims of the corresponding placeholder without the batch dimension.
+  /// \returns a future that becomes ready once the results are written to
+  /// \p outputs, which must stay alive until then. The future of a request
+  /// served by the result cache is ready when the method returns.
+  std::future<void> enqueue(llvm::ArrayRef<Tensor *> inputs,
+                            llvm::ArrayRef<Tensor *> outputs);
+};
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_BATCHER_H
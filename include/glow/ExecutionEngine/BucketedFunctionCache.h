@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_BUCKETEDFUNCTIONCACHE_H
+#define GLOW_EXECUTIONENGINE_BUCKETEDFUNCTIONCACHE_H
+
+#include "glow/Backends/Backend.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Context.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace glow {
+
+class Function;
+class Placeholder;
+class Tensor;
+
+/// Builds the network for the batch size \p batchSize into the function \p F.
+/// The first dimension of the placeholders added to \p inputs and \p outputs
+/// must be \p batchSize, and each call must produce the same placeholders, in
+/// the same order, up to the batch dimension.
+using BatchedNetBuilderTy =
+    std::function<void(Function *F, size_t batchSize,
+                       std::vector<Placeholder *> &inputs,
+                       std::vector<Placeholder *> &outputs)>;
+
+/// A cache of the compiled versions of one network for a set of batch sizes
+/// (buckets), e.g. 1/4/16/64. A request is routed to the smallest bucket that
+/// fits its batch size, and its inputs are padded to the size of the bucket by
+/// repeating its samples. Each bucket is compiled lazily when it is used for
+/// the first time. The network, the backend and the compilation mode are fixed
+/// for a cache, so a bucket is identified by its batch size.
+class BucketedFunctionCache final {
+  /// A compiled version of the network.
+  struct Bucket {
+    /// The batch size of the bucket.
+    size_t batchSize;
+    /// The engine holding the module and the compiled function. It is null
+    /// until the bucket is compiled.
+    std::unique_ptr<ExecutionEngine> EE;
+    /// The context that the function was compiled with.
+    std::unique_ptr<Context> compileCtx;
+    /// The input placeholders of the function.
+    std::vector<Placeholder *> inputs;
+    /// The output placeholders of the function.
+    std::vector<Placeholder *> outputs;
+  };
+
+  /// Builds the network for a given batch size.
+  BatchedNetBuilderTy builder_;
+  /// The backend used for the compilation.
+  BackendKind backendKind_;
+  /// The compilation mode.
+  CompilationMode mode_;
+  /// The buckets, sorted by the batch size.
+  std::vector<Bucket> buckets_;
+  /// Protects the lazy compilation of the buckets.
+  mutable std::mutex mutex_;
+
+  /// \returns the bucket with the smallest batch size that is not less than
+  /// \p batchSize, or the largest bucket if there is no such bucket. The
+  /// bucket is compiled if needed.
+  Bucket &getBucket(size_t batchSize);
+
+public:
+  /// Ctor. \p builder creates the network for a batch size from the list
+  /// \p batchSizes. The network is compiled for the backend \p backendKind in
+  /// the mode \p mode.
+  BucketedFunctionCache(BatchedNetBuilderTy builder,
+                        llvm::ArrayRef<size_t> batchSizes,
+                        BackendKind backendKind = BackendKind::Interpreter,
+                        CompilationMode mode = CompilationMode::Infer);
+
+  /// \returns the batch size of the bucket that serves a request with
+  /// \p batchSize samples. Requests that are larger than the largest bucket
+  /// are split into several executions of the largest bucket.
+  size_t getBucketSize(size_t batchSize) const;
+
+  /// \returns the number of buckets that were compiled so far.
+  size_t getNumCompiledBuckets() const;
+
+  /// Run the network on the batch \p inputs and write the results to
+  /// \p outputs. All the tensors must have the same first dimension, and the
+  /// other dimensions must match the ones of the placeholders produced by the
+  /// builder. This method may be called concurrently from several threads.
+  void run(llvm::ArrayRef<Tensor *> inputs, llvm::ArrayRef<Tensor *> outputs);
+};
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_BUCKETEDFUNCTIONCACHE_H
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_DATALOADER_H
+#define GLOW_EXECUTIONENGINE_DATALOADER_H
+
+#include "glow/Base/Tensor.h"
+#include "glow/Graph/Context.h"
+#include "glow/Support/Random.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace glow {
+
+class ExecutionEngine;
+class Placeholder;
+class Variable;
+
+/// A dataset of training samples that a DataLoader reads one sample at a
+/// time, so that the dataset never needs to be in memory as a whole.
+class DataSource {
+public:
+  virtual ~DataSource() = default;
+
+  /// \returns the number of samples in the dataset.
+  virtual size_t size() const = 0;
+
+  /// Write the sample \p index into the slice \p slot of each tensor of
+  /// \p batch, which holds one batched tensor per input of the network, e.g.
+  /// the images and the labels. This is called from the thread of the loader.
+  virtual void read(size_t index, llvm::ArrayRef<Tensor *> batch,
+                    size_t slot) = 0;
+};
+
+/// The DataLoader reads the batches of a DataSource on a background thread,
+/// while the network runs on the previous ones. The samples are visited in a
+/// new random order on each pass over the dataset. The batches are read
+/// directly into a small ring of batched tensors, which the consumer gets one
+/// at a time; the first dimension of each tensor is the batch size.
+class DataLoader final {
+  /// The batched tensors of one batch.
+  struct Batch {
+    /// The batched tensors, one per input.
+    std::vector<Tensor> tensors;
+    /// The pointers to the tensors above.
+    std::vector<Tensor *> pointers;
+    /// Maps the placeholders of the loader to the tensors above.
+    Context ctx;
+  };
+
+  /// The dataset.
+  DataSource &source_;
+  /// The number of samples in a batch.
+  size_t batchSize_;
+  /// Whether the order of the samples is shuffled on each pass.
+  bool shuffle_;
+  /// Generates the orders of the samples.
+  PseudoRNG rng_;
+  /// The order of the samples in the current pass.
+  std::vector<size_t> order_;
+  /// The position of the next sample to read in order_.
+  size_t position_{0};
+  /// The number of complete passes over the dataset.
+  size_t epoch_{0};
+
+  /// The ring of batches.
+  std::vector<std::unique_ptr<Batch>> batches_;
+  /// The batches that are ready to be read into.
+  std::deque<Batch *> free_;
+  /// The batches that are read, in order.
+  std::deque<Batch *> ready_;
+  /// The batch that the consumer holds, if any.
+  Batch *current_{nullptr};
+  /// Set when the worker thread needs to exit.
+  bool stop_{false};
+  /// Protects the queues.
+  std::mutex mutex_;
+  /// Notifies the worker thread about free batches and the consumer about
+  /// ready ones.
+  std::condition_variable cv_;
+  /// The thread reading the batches.
+  std::thread worker_;
+
+  /// Start a new pass over the dataset.
+  void startEpoch();
+
+  /// The body of the worker thread.
+  void readBatches();
+
+public:
+  /// Ctor. Reads the batches of the types \p types from \p source, with
+  /// \p numBatches batches in flight. If \p shuffle is false the samples are
+  /// read in order.
+  DataLoader(DataSource &source, llvm::ArrayRef<TypeRef> types,
+             bool shuffle = true, unsigned numBatches = 2);
+
+  /// Ctor. Reads the batches of the placeholders \p placeholders, which
+  /// nextContext() binds to the batched tensors.
+  DataLoader(DataSource &source, llvm::ArrayRef<Placeholder *> placeholders,
+             bool shuffle = true, unsigned numBatches = 2);
+
+  /// Stop the worker thread.
+  ~DataLoader();
+
+  /// \returns the tensors of the next batch, one per input, blocking until
+  /// the batch is read. The tensors stay valid until the next call.
+  llvm::ArrayRef<Tensor *> next();
+
+  /// \returns the context of the next batch, in which the placeholders the
+  /// loader was constructed with are backed by the batched tensors, without
+  /// a copy. The context stays valid until the next call.
+  Context &nextContext();
+
+  /// \returns the number of samples in a batch.
+  size_t getBatchSize() const { return batchSize_; }
+
+  /// \returns the number of complete passes over the dataset that the worker
+  /// thread has made. The worker runs ahead of the consumer by the batches in
+  /// flight.
+  size_t getEpoch();
+};
+
+/// Runs \p iterations iterations of the function compiled by \p EE on the
+/// next batches of \p loader, which are copied into the payloads of the
+/// variables \p vars, one per input of the loader.
+void runBatch(ExecutionEngine &EE, size_t iterations, DataLoader &loader,
+              llvm::ArrayRef<Variable *> vars);
+
+/// Runs \p iterations iterations of the function compiled by \p EE on the
+/// contexts of the next batches of \p loader, which must have been
+/// constructed with the input placeholders of the function.
+void runBatch(ExecutionEngine &EE, size_t iterations, DataLoader &loader);
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_DATALOADER_H
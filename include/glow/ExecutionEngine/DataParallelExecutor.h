@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_DATAPARALLELEXECUTOR_H
+#define GLOW_EXECUTIONENGINE_DATAPARALLELEXECUTOR_H
+
+#include "glow/Backends/Backend.h"
+#include "glow/Base/Train.h"
+#include "glow/ExecutionEngine/BucketedFunctionCache.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/ExecutionEngine/FunctionDAGExecutor.h"
+#include "glow/Graph/Context.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Optimizer/Partition.h"
+#include "glow/Support/ThreadPool.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace glow {
+
+class Placeholder;
+class Tensor;
+
+/// Runs one network on several devices of a backend at once. Every device
+/// holds its own copy of the network and of its weights, compiled for a fixed
+/// batch size. A request is split along the batch dimension into one
+/// contiguous share per device, and the devices process their shares
+/// concurrently, in chunks of the compiled batch size. The shares are
+/// proportional to the throughput that each device achieved in the previous
+/// requests, so faster devices get more samples.
+class DataParallelExecutor final {
+  /// A device with its compiled copy of the network.
+  struct Device {
+    /// The engine holding the module and the compiled function.
+    std::unique_ptr<ExecutionEngine> EE;
+    /// The context that the function was compiled with.
+    std::unique_ptr<Context> compileCtx;
+    /// The input placeholders of the function.
+    std::vector<Placeholder *> inputs;
+    /// The output placeholders of the function.
+    std::vector<Placeholder *> outputs;
+    /// The measured number of samples per second, or 0 until measured.
+    double throughput{0};
+  };
+
+  /// The devices, indexed by their number in the backend.
+  std::vector<Device> devices_;
+  /// The batch size that the network is compiled for.
+  size_t batchSize_;
+  /// Runs the devices concurrently.
+  ThreadPool pool_;
+  /// Serializes the requests, which share the devices and their throughput.
+  std::mutex mutex_;
+
+  /// \returns the number of devices that \p numDevices asks for, where 0 means
+  /// all the devices of \p backendKind.
+  static unsigned selectNumDevices(BackendKind backendKind,
+                                   unsigned numDevices);
+
+  /// \returns the shares of a request with \p batchSize samples. The caller
+  /// must hold mutex_.
+  std::vector<size_t> computeSplit(size_t batchSize) const;
+
+  /// Run the samples [\p start, \p start + \p count) of \p inputs on the
+  /// device \p dev and write their results to \p outputs.
+  void runShare(Device &dev, llvm::ArrayRef<Tensor *> inputs,
+                llvm::ArrayRef<Tensor *> outputs, size_t start, size_t count);
+
+public:
+  /// Ctor. \p builder creates the network for the batch size \p batchSize,
+  /// which is compiled in the mode \p mode for \p numDevices devices of the
+  /// backend \p backendKind, or for all its devices if \p numDevices is 0.
+  /// If \p numDevices exceeds the number of devices of the backend, the copies
+  /// of the network are assigned to the devices round robin. The builder is
+  /// invoked once per copy and must create the same weights every time.
+  DataParallelExecutor(BatchedNetBuilderTy builder, size_t batchSize,
+                       BackendKind backendKind, unsigned numDevices = 0,
+                       CompilationMode mode = CompilationMode::Infer);
+
+  /// \returns the number of copies of the network, one per device.
+  unsigned getNumDevices() const { return devices_.size(); }
+
+  /// \returns the number of samples that each device gets out of a request
+  /// with \p batchSize samples. The devices whose throughput is not known yet
+  /// get equal shares.
+  std::vector<size_t> getSplit(size_t batchSize);
+
+  /// Run the network on the batch \p inputs and write the results to
+  /// \p outputs. All the tensors must have the same first dimension, and the
+  /// other dimensions must match the ones of the placeholders produced by the
+  /// builder. This method may be called concurrently from several threads.
+  void run(llvm::ArrayRef<Tensor *> inputs, llvm::ArrayRef<Tensor *> outputs);
+};
+
+/// Build the functions of one data-parallel training step of the forward
+/// function \p F. Each of the \p numReplicas replicas computes the gradients
+/// of the forward and backward passes of \p F, reading its own copy of the
+/// placeholders \p inputs, which \p replicaInputs receives in the order of
+/// \p inputs, one list per replica. The gradients of the replicas are summed
+/// pairwise by a tree of functions, so the independent sums run concurrently,
+/// and the last function updates every trained weight once with the total,
+/// using the optimizer of \p conf. Its batch size is the one of the whole
+/// step, so the update is the one that a single function computes from the
+/// concatenated shards, as long as the samples of a batch are independent.
+/// The replicas do not save the results of \p F.
+FunctionDAG differentiateDataParallel(
+    Function *F, const TrainingConfig &conf,
+    llvm::ArrayRef<Placeholder *> inputs, unsigned numReplicas,
+    std::vector<std::vector<Placeholder *>> &replicaInputs);
+
+/// Trains a network on the threads of one machine. Every step splits the
+/// batch into one shard per replica of the network, the replicas compute the
+/// gradients of their shards concurrently, and the weights, which the
+/// replicas share, are updated once with the sum of the gradients.
+class DataParallelTrainer final {
+  /// Runs the functions of the training step.
+  FunctionDAGExecutor executor_;
+  /// The input placeholders of every replica.
+  std::vector<std::vector<Placeholder *>> replicaInputs_;
+  /// The number of samples of the shard of a replica.
+  size_t shardSize_;
+  /// The tensors of the inputs and of the gradients, which are reused by all
+  /// the steps.
+  Context ctx_;
+
+public:
+  /// Ctor. \p F is the forward pass of the network for the batch size of a
+  /// shard, which is the first dimension of its placeholders \p inputs. The
+  /// network is trained with the configuration \p conf, whose batch size is
+  /// the one of the whole step, by \p numReplicas replicas compiled for the
+  /// backend \p backendKind.
+  DataParallelTrainer(Function *F, llvm::ArrayRef<Placeholder *> inputs,
+                      const TrainingConfig &conf, unsigned numReplicas,
+                      BackendKind backendKind = BackendKind::Interpreter);
+
+  /// \returns the number of replicas of the network.
+  unsigned getNumReplicas() const { return replicaInputs_.size(); }
+
+  /// Run one training step on the batch \p inputs, whose tensors match the
+  /// placeholders given to the constructor, except for the first dimension,
+  /// which holds the shards of all the replicas one after another.
+  void train(llvm::ArrayRef<Tensor *> inputs);
+};
+
+/// Build the functions of a training step of the forward function \p F that
+/// accumulates the gradients of several micro-batches before updating the
+/// weights. The returned function computes the gradients of the forward and
+/// backward passes of \p F for one micro-batch and adds the gradient of every
+/// trained weight to a placeholder, which \p accumulators receives. The
+/// function that \p update receives updates every trained weight once with
+/// its accumulated gradient, using the optimizer of \p conf, whose batch size
+/// is the one of all the micro-batches together. The accumulators must be
+/// zeroed before the first micro-batch of every step. The returned function
+/// does not save the results of \p F.
+Function *differentiateAccumulated(Function *F, const TrainingConfig &conf,
+                                   Function *&update,
+                                   std::vector<Placeholder *> &accumulators);
+
+/// Trains a network on batches that are too large for the memory of the
+/// activations. Every step splits the batch into micro-batches, runs the
+/// forward and backward passes on them one after another while summing the
+/// gradients, and updates the weights once with the sum. The activations only
+/// take the memory of a micro-batch, and the update is the one of the whole
+/// batch.
+class MicroBatchTrainer final {
+  /// Runs the passes of a micro-batch.
+  FunctionDAGExecutor accumulate_;
+  /// Runs the update of the weights.
+  FunctionDAGExecutor update_;
+  /// The input placeholders of the network.
+  std::vector<Placeholder *> inputs_;
+  /// The placeholders holding the sums of the gradients.
+  std::vector<Placeholder *> accumulators_;
+  /// The number of micro-batches of a step.
+  unsigned numMicroBatches_;
+  /// The number of samples of a micro-batch.
+  size_t microBatchSize_;
+  /// The tensors of the inputs and of the accumulators, which are reused by
+  /// all the steps.
+  Context ctx_;
+
+public:
+  /// Ctor. \p F is the forward pass of the network for the batch size of a
+  /// micro-batch, which is the first dimension of its placeholders \p inputs.
+  /// The network is trained with the configuration \p conf, whose batch size
+  /// is the one of the whole step, on \p numMicroBatches micro-batches per
+  /// step, compiled for the backend \p backendKind.
+  MicroBatchTrainer(Function *F, llvm::ArrayRef<Placeholder *> inputs,
+                    const TrainingConfig &conf, unsigned numMicroBatches,
+                    BackendKind backendKind = BackendKind::Interpreter);
+
+  /// \returns the number of micro-batches of a step.
+  unsigned getNumMicroBatches() const { return numMicroBatches_; }
+
+  /// Run one training step on the batch \p inputs, whose tensors match the
+  /// placeholders given to the constructor, except for the first dimension,
+  /// which holds the micro-batches one after another.
+  void train(llvm::ArrayRef<Tensor *> inputs);
+};
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_DATAPARALLELEXECUTOR_H
@@ -23,10 +23,21 @@
 #include "glow/Graph/Context.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/Cancellation.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/ThreadPool.h"
 
 #include "llvm/ADT/ArrayRef.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <unordered_map>
 
 namespace glow {
@@ -42,10 +53,110 @@ class ExecutionEngine final {
   std::unique_ptr<Backend> backend_;
   /// A glow function compiled for this ExecutionEngine's backend.
   std::unique_ptr<CompiledFunction> function_;
+  /// The statistics of the last compilation.
+  CompileReport compileReport_;
+  /// The memory that the compiled functions may use in bytes, or 0 if it is
+  /// unlimited.
+  uint64_t memoryBudget_;
+  /// The priority of the parallel loops of the runs.
+  std::atomic<RunPriority> runPriority_{RunPriority::LatencyCritical};
+
+  /// A function of the module compiled by the multi-function compile() or
+  /// compileLazily().
+  struct FunctionEntry {
+    /// The compiled function, or null if it is not compiled yet or does not
+    /// fit in the memory budget.
+    std::unique_ptr<CompiledFunction> compiled;
+    /// The context that a lazily compiled function is compiled with on its
+    /// first run.
+    const Context *lazyCtx{nullptr};
+    /// Makes the first runs of a lazy function compile it once.
+    std::once_flag compileOnce;
+  };
+  /// The functions compiled by the multi-function compile() and
+  /// compileLazily().
+  std::unordered_map<const Function *, std::unique_ptr<FunctionEntry>>
+      functions_;
+  /// Protects functions_, but not the entries, which are never erased while
+  /// the engine runs them.
+  mutable std::mutex functionsMutex_;
+  /// Serializes the compilations of the lazy functions.
+  std::mutex lazyCompileMutex_;
+
+public:
+  /// The type of the callbacks invoked when an asynchronous run completes.
+  using CompletionCallbackTy = std::function<void()>;
+
+private:
+  /// A request for an asynchronous execution of the compiled function.
+  struct RunRequest {
+    /// The context to run with. If null, the tensors that the function was
+    /// compiled with are used.
+    Context *ctx;
+    /// The token that drops or stops the run, if any.
+    std::shared_ptr<const CancellationToken> token;
+    /// Invoked by the worker thread when the execution is done.
+    CompletionCallbackTy callback;
+    /// Fulfilled after the callback returns, with false if the run was
+    /// dropped or stopped by its token.
+    std::promise<bool> done;
+  };
+
+  /// The queue of the pending asynchronous runs, in submission order.
+  std::deque<RunRequest> requests_;
+  /// The number of requests that were submitted but are not completed yet.
+  size_t numPendingRequests_{0};
+  /// Set when the worker thread needs to exit.
+  bool stopWorker_{false};
+  /// Protects the request queue and the fields above.
+  std::mutex requestsMutex_;
+  /// Notifies the worker thread about new requests.
+  std::condition_variable requestsCV_;
+  /// Notifies the waiters about completed requests.
+  std::condition_variable completedCV_;
+  /// The thread processing the request queue. It is started by the first
+  /// asynchronous run.
+  std::thread worker_;
+  /// Held shared by the runs and exclusively by updateWeights(), so that a
+  /// run sees either all the old weights or all the new ones.
+  std::shared_timed_mutex weightsMutex_;
 
   /// Optimize the Function \p F given compilation mode \p mode.
   void optimizeFunction(CompilationMode mode, Function *F);
 
+  /// Compile the optimized function \p F with the backend, with a schedule
+  /// that fits the memory budget if the preferred one does not. \returns the
+  /// compiled function, or null if \p F does not fit.
+  std::unique_ptr<CompiledFunction> compileWithinBudget(Function *F,
+                                                        const Context &ctx);
+
+  /// \returns \p compiled, the function \p F compiled with the preferred
+  /// schedule, if it fits in the memory budget, or else \p F compiled again
+  /// with the schedule that minimizes the peak memory, or null if that does
+  /// not fit either. The compilation changes the backend, so it must not run
+  /// in parallel with other ones.
+  std::unique_ptr<CompiledFunction>
+  fitBudget(Function *F, const Context &ctx,
+            std::unique_ptr<CompiledFunction> compiled);
+
+  /// \returns false, after printing why, if the estimate of the weights of
+  /// \p F exceeds the memory budget.
+  bool weightsFitBudget(Function *F) const;
+
+  /// \returns the entry of \p F compiled by the multi-function compile() or
+  /// by compileLazily(), compiling it first if it is lazy.
+  FunctionEntry &getFunctionEntry(Function *F);
+
+  /// Add a request to run with \p ctx and \p token to the queue and \returns a
+  /// future that becomes ready once the run is done and \p callback has
+  /// returned.
+  std::future<bool> enqueueRun(Context *ctx,
+                               std::shared_ptr<const CancellationToken> token,
+                               CompletionCallbackTy callback);
+
+  /// The body of the worker thread.
+  void processRequests();
+
 public:
   ExecutionEngine(BackendKind backendKind = BackendKind::Interpreter);
 
@@ -69,8 +180,67 @@ public:
   /// Optimize the graph and pass it to the backend to compile it for a specific
   /// target. This method should be invoked before the run method. The context
   /// \p ctx contains the mapping between symbolic values to concrete backing
-  /// tensors.
-  void compile(CompilationMode mode, Function *F, const Context &ctx);
+  /// tensors. \returns false if the function does not fit in the memory
+  /// budget, in which case no function is compiled.
+  bool compile(CompilationMode mode, Function *F, const Context &ctx);
+
+  /// Optimize the functions \p functions of the module and compile them for
+  /// the backend, e.g. the partitions made by partition() or the variants of
+  /// a network for several batch sizes. The optimizations change the module,
+  /// which the functions share, so they run one function at a time, and the
+  /// code generation runs on up to -compile-threads threads. The functions
+  /// are run by run(F). \returns false if one of them does not fit in the
+  /// memory budget, in which case the others are still compiled.
+  bool compile(CompilationMode mode, llvm::ArrayRef<Function *> functions,
+               const Context &ctx);
+
+  /// Optimize the functions \p functions like compile() does, but leave the
+  /// code generation of each one to its first run(F), so that a process only
+  /// pays for the functions that it runs. \p ctx must stay alive until all of
+  /// them are compiled, and a function that does not fit in the memory
+  /// budget fails on its first run.
+  void compileLazily(CompilationMode mode,
+                     llvm::ArrayRef<Function *> functions, const Context &ctx);
+
+  /// \returns whether \p F was compiled by the multi-function compile() or by
+  /// a run after compileLazily().
+  bool isCompiled(const Function *F) const;
+
+  /// \returns the wall time of the phases, the sizes of the code and the peak
+  /// memory usage of the last compile() or compileOptimized(). The phases of
+  /// the multi-function compile() are prefixed by the names of the functions.
+  const CompileReport &getCompileReport() const { return compileReport_; }
+
+  /// Compile \p F, which is already optimized and lowered for the backend of
+  /// this engine, without optimizing it again. This is meant for functions of
+  /// modules that were optimized by serialize() and restored by loadModule().
+  /// \returns false if the function does not fit in the memory budget.
+  bool compileOptimized(Function *F, const Context &ctx);
+
+  /// Limit the memory of the functions compiled after this call to \p bytes,
+  /// or lift the limit if it is 0. The default comes from -memory-budget-mb.
+  /// A function whose weights alone exceed the budget, as estimated by
+  /// Function::estimateMemoryUsage(), fails before its code is generated. If
+  /// the memory usage of the compiled function exceeds it, it is compiled
+  /// again with the schedule that minimizes the peak memory of the
+  /// activations, and fails if it still does not fit. The backends that do
+  /// not report the memory usage of their functions only check the estimate
+  /// of the weights.
+  void setMemoryBudget(uint64_t bytes) { memoryBudget_ = bytes; }
+
+  /// \returns the memory budget in bytes, or 0 if it is unlimited.
+  uint64_t getMemoryBudget() const { return memoryBudget_; }
+
+  /// \returns the memory used by the compiled function.
+  MemoryUsage getMemoryUsage() const;
+
+  /// Optimize \p F for the backend of this engine, in the same way as
+  /// compile() does, and write the module along with the payloads of its
+  /// variables to \p filename. Another process can then restore the module
+  /// with loadModule() and pass the function to compileOptimized(), skipping
+  /// the model import and the graph optimizations. \returns false if the file
+  /// can't be written.
+  bool serialize(CompilationMode mode, Function *F, llvm::StringRef filename);
 
   /// Save a bundle for a standalone execution. This method takes care of
   /// everything when preparing the bundle for saving. There is no need to
@@ -81,14 +251,104 @@ public:
   void save(CompilationMode mode, Function *F, llvm::StringRef outputDir,
             llvm::StringRef networkName);
 
+  /// Save a single bundle with an entry point for each of the functions of
+  /// \p entries, e.g. the variants of a network for different batch sizes or
+  /// a quantized and a floating point variant. The entry points share the
+  /// constant weights and the symbol table, so the bundle has a single
+  /// weights file. All the functions are optimized before any code is
+  /// generated. Prepend all generated files with \p bundleName.
+  void save(CompilationMode mode, llvm::ArrayRef<BundleEntry> entries,
+            llvm::StringRef outputDir, llvm::StringRef bundleName);
+
+  /// Set the priority class of the parallel loops of the runs that start
+  /// after this call to \p priority. It matters when the functions of several
+  /// engines share a pool of threads, see -shared-thread-pool: the chunks of
+  /// the latency critical runs are taken before the ones of the batch runs.
+  void setRunPriority(RunPriority priority) { runPriority_ = priority; }
+
+  /// \returns the priority class of the runs.
+  RunPriority getRunPriority() const { return runPriority_; }
+
   /// Runs a single execution of the function.
   void run();
+
+  /// Runs a single execution of \p F, which was passed to the multi-function
+  /// compile() or to compileLazily(), with the tensors it was compiled with.
+  /// Functions that do not share any mutable tensors may run concurrently.
+  void run(Function *F);
+
+  /// Same as above, but uses the tensors of \p ctx for the placeholders of
+  /// \p F.
+  void run(Function *F, Context &ctx);
+
+  /// Runs a single execution of the function, using the tensors of \p ctx for
+  /// the placeholders of the function. This method may be called concurrently
+  /// from several threads, as long as each thread passes its own context.
+  void run(Context &ctx);
+
+  /// Runs a single execution of the function that is dropped if \p token is
+  /// cancelled, or its deadline has passed, before it starts, and stopped if
+  /// that happens while it runs. The Interpreter and the CPU backend stop the
+  /// runs between their instructions, the other backends complete the runs
+  /// that started. \returns false if the run was dropped or stopped, in which
+  /// case the results are undefined.
+  bool run(const CancellationToken &token);
+
+  /// Same as above, but uses the tensors of \p ctx for the placeholders of the
+  /// function.
+  bool run(Context &ctx, const CancellationToken &token);
+
+  /// Enqueue a single execution of the function and return immediately. The
+  /// requests of an engine are executed one after another, in the order of
+  /// submission, by a worker thread owned by the engine. \p callback, if
+  /// provided, is invoked on the worker thread once the execution is done.
+  /// \returns a future that becomes ready after the callback has returned.
+  /// This overload uses the tensors that the function was compiled with, so
+  /// it must not be mixed with concurrent synchronous runs.
+  std::future<bool> runAsync(CompletionCallbackTy callback = nullptr);
+
+  /// Same as above, but uses the tensors of \p ctx for the placeholders of the
+  /// function. \p ctx must stay alive and untouched until the run completes.
+  std::future<bool> runAsync(Context &ctx,
+                             CompletionCallbackTy callback = nullptr);
+
+  /// Same as above, but the request is dropped if \p token is cancelled, or
+  /// its deadline has passed, by the time it reaches the front of the queue,
+  /// and stopped like by run(ctx, token) if that happens while it runs, so
+  /// that the queue of an overloaded engine does not spend its time on runs
+  /// whose results are no longer wanted. The callback is invoked either way,
+  /// and the future holds false if the run was dropped or stopped.
+  std::future<bool> runAsync(Context &ctx,
+                             std::shared_ptr<const CancellationToken> token,
+                             CompletionCallbackTy callback = nullptr);
+
+  /// Block until all asynchronous runs submitted so far are completed.
+  void waitForAsyncRuns();
+
+  /// Replace the payloads of the constant variables named \p names with the
+  /// tensors \p values in the compiled function, without compiling it again,
+  /// e.g. to deploy a retrained model with the same topology. The
+  /// transformations that the optimizer and the backend applied to the
+  /// variables, such as the folding of batch normalizations and the layouts
+  /// of the filters, are replayed on the new data, see
+  /// Module::updateWeights(). The update waits for the runs in flight, which
+  /// finish with the old weights, and the runs that start afterwards see all
+  /// of the new ones. \returns false, leaving the weights unchanged, if the
+  /// update requires a new compilation.
+  bool updateWeights(llvm::ArrayRef<llvm::StringRef> names,
+                     llvm::ArrayRef<Tensor *> values);
 };
 
 //===----------------------------------------------------------------------===//
 //         Helper methods for running the execution engine.
 //===----------------------------------------------------------------------===//
 
+/// Evaluate the subgraphs of \p F whose inputs are all constant variables,
+/// i.e. private variables that are neither trained nor written, once on the
+/// Interpreter, and replace their results with new constant variables.
+/// \returns true if \p F was changed.
+bool constantFold(Function *F);
+
 /// This method updates the variables in \p vars with the tensor content
 /// values \p inputs.
 void updateVariables(llvm::ArrayRef<Variable *> vars,
@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_FUNCTIONDAGEXECUTOR_H
+#define GLOW_EXECUTIONENGINE_FUNCTIONDAGEXECUTOR_H
+
+#include "glow/Backends/Backend.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Context.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Optimizer/Partition.h"
+#include "glow/Support/ThreadPool.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace glow {
+
+class Function;
+class Placeholder;
+
+/// Runs the functions of a FunctionDAG. Every function is compiled for its
+/// own backend, and a run dispatches each function to a thread of a pool as
+/// soon as the functions it depends on are done, so independent functions
+/// execute concurrently. The functions exchange their results through the
+/// tensors of the context of the run, without copies: the tensor that backs
+/// a placeholder is written by the function that saves to it and read in
+/// place by the functions that use it.
+class FunctionDAGExecutor final {
+public:
+  /// Maps functions to the backends that execute them.
+  using BackendAssignment = std::unordered_map<Function *, BackendKind>;
+
+private:
+  /// A function of the DAG, compiled for its backend.
+  struct DAGNode {
+    /// The engine holding the compiled function.
+    std::unique_ptr<ExecutionEngine> EE;
+    /// The indices of the functions that depend on this function.
+    std::vector<size_t> users;
+    /// The number of distinct functions that this function depends on.
+    size_t numDependencies{0};
+  };
+
+  /// The compiled functions, in the topological order of the DAG.
+  std::vector<DAGNode> nodes_;
+  /// The placeholders used by any of the functions.
+  std::vector<Placeholder *> placeholders_;
+  /// The threads executing the functions.
+  ThreadPool pool_;
+
+public:
+  /// Create an executor running up to \p numThreads functions at once.
+  explicit FunctionDAGExecutor(unsigned numThreads);
+
+  /// Compile the functions of \p G in the mode \p mode. A function is compiled
+  /// for the backend that \p backends assigns to it, or for \p defaultBackend
+  /// if it is not assigned one. The previously compiled DAG is discarded.
+  void compile(CompilationMode mode, const FunctionDAG &G,
+               const BackendAssignment &backends = {},
+               BackendKind defaultBackend = BackendKind::Interpreter);
+
+  /// Run every function of the compiled DAG once, using the tensors of \p ctx
+  /// for the placeholders. Tensors are allocated in \p ctx for the
+  /// placeholders that it does not provide yet, such as the ones that connect
+  /// the functions. The method returns after all functions are done.
+  void run(Context &ctx);
+};
+
+/// Runs the functions of a FunctionDAG as the stages of a pipeline for a
+/// stream of requests. Every stage has its own worker thread and executes the
+/// requests in submission order, while the following stage works on the
+/// previous requests. The stages are connected by bounded queues, so a slow
+/// stage eventually blocks the submission of new requests. Every request
+/// carries its own context, which holds the tensors passed between the stages
+/// for that request. The functions must therefore only write to placeholders.
+class PipelineExecutor final {
+public:
+  using BackendAssignment = FunctionDAGExecutor::BackendAssignment;
+
+private:
+  /// A request flowing through the pipeline.
+  struct Request {
+    /// The context of the request.
+    Context *ctx;
+    /// Fulfilled when the last stage is done with the request.
+    std::promise<void> done;
+  };
+
+  /// A bounded queue of the requests waiting for a stage.
+  class RequestQueue {
+    /// The waiting requests, in submission order.
+    std::deque<Request> requests_;
+    /// The maximum number of waiting requests.
+    size_t capacity_;
+    /// Set when no more requests will be pushed.
+    bool closed_{false};
+    /// Protects the fields above.
+    std::mutex mutex_;
+    /// Notifies the consumer about new requests and about the closing.
+    std::condition_variable notEmptyCV_;
+    /// Notifies the producer about free space.
+    std::condition_variable notFullCV_;
+
+  public:
+    explicit RequestQueue(size_t capacity);
+
+    /// Add \p request to the queue, blocking while the queue is full.
+    void push(Request request);
+
+    /// Move the oldest request to \p request, blocking while the queue is
+    /// empty. \returns false if the queue is closed and empty.
+    bool pop(Request &request);
+
+    /// Wake up the consumer once the remaining requests are popped.
+    void close();
+  };
+
+  /// A stage of the pipeline.
+  struct Stage {
+    /// The engine holding the compiled function of the stage.
+    std::unique_ptr<ExecutionEngine> EE;
+    /// The requests waiting for the stage.
+    std::unique_ptr<RequestQueue> input;
+    /// The thread executing the stage.
+    std::thread worker;
+  };
+
+  /// The stages, in pipeline order.
+  std::vector<Stage> stages_;
+  /// The placeholders used by any of the stages.
+  std::vector<Placeholder *> placeholders_;
+  /// The capacity of the queue in front of every stage.
+  size_t queueCapacity_;
+
+  /// The body of the worker thread of the stage \p idx.
+  void processStage(size_t idx);
+
+  /// Finish the submitted requests and stop the worker threads.
+  void stop();
+
+public:
+  /// Create an executor whose stages queue up to \p queueCapacity requests.
+  explicit PipelineExecutor(size_t queueCapacity = 2);
+
+  /// Finishes the submitted requests.
+  ~PipelineExecutor();
+
+  /// Compile the functions of \p G as the stages of the pipeline, in the
+  /// order of the DAG, for the same backends as FunctionDAGExecutor::compile.
+  /// The requests submitted to the previous pipeline are finished first.
+  void compile(CompilationMode mode, const FunctionDAG &G,
+               const BackendAssignment &backends = {},
+               BackendKind defaultBackend = BackendKind::Interpreter);
+
+  /// Submit a request that runs the pipeline using the tensors of \p ctx for
+  /// the placeholders. Tensors are allocated in \p ctx for the placeholders
+  /// it does not provide yet. This blocks while the queue of the first stage
+  /// is full. \p ctx must stay alive and untouched until the request is done.
+  /// \returns a future that becomes ready when the last stage is done.
+  std::future<void> submit(Context &ctx);
+};
+
+/// Split an input Function \p F into islands that each run on a single
+/// backend. A node is assigned to the first of \p backends, in the order of
+/// preference, that supports it, or to the last one if none does. Save nodes
+/// stay with the node that they save. \p assignment receives the backend of
+/// every function of the returned FunctionDAG, which can be handed to
+/// FunctionDAGExecutor::compile.
+FunctionDAG
+partitionForBackends(Function *F, llvm::ArrayRef<BackendKind> backends,
+                     FunctionDAGExecutor::BackendAssignment &assignment);
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_FUNCTIONDAGEXECUTOR_H
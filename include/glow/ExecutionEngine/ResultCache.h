@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_EXECUTIONENGINE_RESULTCACHE_H
+#define GLOW_EXECUTIONENGINE_RESULTCACHE_H
+
+#include "glow/Base/Tensor.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace glow {
+
+/// A content-addressed cache of the results of inferences, so that repeated
+/// identical requests are answered without running the network. An entry is
+/// keyed by the version of the model and the content of the input tensors.
+/// The key is found by a hash, and the inputs are then compared in full, so a
+/// hash collision never returns the results of other inputs. The entries are
+/// evicted in least recently used order once the bytes of their input and
+/// output tensors exceed the memory budget. All of the methods may be called
+/// concurrently from several threads.
+class ResultCache final {
+  /// The cached results of one inference.
+  struct Entry {
+    /// The hash of the key.
+    llvm::hash_code hash;
+    /// The version of the model that computed the results.
+    uint64_t version;
+    /// The inputs of the inference.
+    std::vector<Tensor> inputs;
+    /// The results of the inference.
+    std::vector<Tensor> outputs;
+    /// The number of bytes of the tensors of the entry.
+    size_t sizeInBytes;
+  };
+
+  /// The maximal number of bytes of the tensors of all the entries.
+  size_t maxBytes_;
+  /// The number of bytes of the tensors of all the entries.
+  size_t bytes_{0};
+  /// The entries, from the most to the least recently used.
+  std::list<Entry> entries_;
+  /// The entries by the hash of their key.
+  std::unordered_multimap<size_t, std::list<Entry>::iterator> index_;
+  /// The number of lookups that found an entry.
+  uint64_t hits_{0};
+  /// The number of lookups that did not find an entry.
+  uint64_t misses_{0};
+  /// The number of entries evicted to stay within the memory budget.
+  uint64_t evictions_{0};
+  /// Protects the entries and the counters.
+  mutable std::mutex mutex_;
+
+  /// \returns the entry for the inputs \p inputs of the model \p version with
+  /// the hash \p hash, or entries_.end() if there is none.
+  std::list<Entry>::iterator find(llvm::hash_code hash, uint64_t version,
+                                  llvm::ArrayRef<Tensor *> inputs);
+
+public:
+  /// The counters of a cache, for monitoring its effectiveness.
+  struct Stats {
+    /// The number of lookups that found an entry.
+    uint64_t hits;
+    /// The number of lookups that did not find an entry.
+    uint64_t misses;
+    /// The number of entries evicted to stay within the memory budget.
+    uint64_t evictions;
+    /// The number of entries in the cache.
+    size_t numEntries;
+    /// The number of bytes of the tensors of the entries.
+    size_t sizeInBytes;
+
+    /// \returns the fraction of the lookups that found an entry.
+    double getHitRate() const {
+      uint64_t lookups = hits + misses;
+      return lookups ? double(hits) / lookups : 0;
+    }
+  };
+
+  /// Ctor. The tensors of the entries take at most \p maxBytes bytes.
+  explicit ResultCache(size_t maxBytes) : maxBytes_(maxBytes) {}
+
+  /// \returns the hash of the inputs \p inputs of the model \p version, which
+  /// is the key of their results in the cache.
+  static llvm::hash_code getKeyHash(uint64_t version,
+                                    llvm::ArrayRef<Tensor *> inputs);
+
+  /// Look up the results of the inputs \p inputs of the model \p version,
+  /// whose key hashes to \p hash. \returns true and copies the results to
+  /// \p outputs, which must have the types of the cached results, if they are
+  /// cached.
+  bool lookup(llvm::hash_code hash, uint64_t version,
+              llvm::ArrayRef<Tensor *> inputs,
+              llvm::ArrayRef<Tensor *> outputs);
+
+  /// Cache copies of the results \p outputs that the model \p version
+  /// computed for \p inputs, whose key hashes to \p hash. The least recently
+  /// used entries are evicted to make room for them. Results that are larger
+  /// than the whole budget are not cached.
+  void insert(llvm::hash_code hash, uint64_t version,
+              std::vector<Tensor> &&inputs, llvm::ArrayRef<Tensor *> outputs);
+
+  /// Remove all of the entries, e.g. when a new version of the model
+  /// replaces the old one. The counters are kept.
+  void clear();
+
+  /// \returns the counters of the cache.
+  Stats getStats() const;
+};
+
+} // namespace glow
+
+#endif // GLOW_EXECUTIONENGINE_RESULTCACHE_H
@@ -31,6 +31,11 @@ class GraphGradMapper {
   Function *F_;
   /// Maps activation values to their gradient values.
   std::unordered_map<NodeValue, NodeValue> map_;
+  /// Maps the values whose gradients are sparse to the indices of the rows
+  /// that have a gradient, and to the gradients of these rows.
+  std::unordered_map<NodeValue, std::pair<NodeValue, NodeValue>> sparseMap_;
+  /// The scalar that the registered gradients are multiplied by, if any.
+  NodeValue scale_;
 
 public:
   GraphGradMapper(Function *F) : F_(F) {}
@@ -40,11 +45,29 @@ public:
   /// into the grad buffer.
   void addGradient(NodeValue activation, NodeValue grad);
 
+  /// Multiply the floating point gradients that addGradient registers by the
+  /// scalar \p scale, of shape {1}, until a null value resets it. This scales
+  /// the gradients that the losses produce.
+  void setGradientScale(NodeValue scale) { scale_ = scale; }
+
   /// \returns the node that \p activation is mapped to.
   NodeValue getGradient(NodeValue activation);
 
   /// \returns True if the node \p activation is mapped.
   bool hasGradient(NodeValue activation);
+
+  /// Register the gradients \p rows of the rows \p indices of \p activation,
+  /// e.g. of the rows of an embedding table that a lookup reads. The rows of
+  /// several registrations are concatenated.
+  void addSparseGradient(NodeValue activation, NodeValue indices,
+                         NodeValue rows);
+
+  /// \returns the indices and the gradients of the rows of \p activation
+  /// that have a sparse gradient.
+  std::pair<NodeValue, NodeValue> getSparseGradient(NodeValue activation);
+
+  /// \returns True if \p activation has a sparse gradient.
+  bool hasSparseGradient(NodeValue activation);
 };
 
 } // namespace glow
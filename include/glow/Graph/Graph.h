@@ -16,22 +16,41 @@
 #ifndef GLOW_GRAPH_GRAPH_H
 #define GLOW_GRAPH_GRAPH_H
 
+#include "glow/Base/MemoryUsage.h"
 #include "glow/Base/Type.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Support/Arena.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/ilist.h"
 #include "llvm/ADT/ilist_node.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace glow {
 
 /// List of Types.
-using TypesList = std::list<Type>;
+/// Hashes and compares the uniqued types of a module by their contents.
+struct TypeContentInfo {
+  size_t operator()(const Type *T) const { return hash_value(*T); }
+  bool operator()(const Type *LHS, const Type *RHS) const {
+    return LHS->isEqual(*RHS);
+  }
+};
+using TypesSet =
+    std::unordered_set<const Type *, TypeContentInfo, TypeContentInfo>;
 /// Intrusive list of Nodes.
 using NodesList = llvm::iplist<glow::Node>;
 /// List of pointers to Nodes. The nodes are not owned by the list.
@@ -43,11 +62,21 @@ using PlaceholderList = std::list<Placeholder *>;
 using UnsignedArrayRef = llvm::ArrayRef<size_t>;
 
 class Module final {
+  /// The arena that the types of the module are allocated from, as well as the
+  /// nodes and the small variable payloads that are created in an ArenaScope
+  /// of it. It is declared first, so that it is destroyed last, and shared, so
+  /// that the module stays copyable.
+  std::shared_ptr<Arena> arena_{std::make_shared<Arena>()};
   /// Stores the functions in the module.
   FunctionList functions_;
-  /// A uniqued list of types. Types in this list can be equated by comparing
-  /// their addresses.
-  TypesList types_{};
+  /// The uniqued types, allocated from the arena of the module and hashed on
+  /// their contents. Uniqued types can be equated by comparing their
+  /// addresses.
+  TypesSet types_{};
+  /// Serializes uniqueType() and the allocations of the types from the arena,
+  /// so that the backends may compile several functions of the module in
+  /// parallel. It is shared along with the arena.
+  std::shared_ptr<std::mutex> typesMutex_{std::make_shared<std::mutex>()};
   /// Stores a list of unique variable names that were used by the module at
   /// some point.
   llvm::StringSet<> uniqueVariableNames_{};
@@ -57,6 +86,66 @@ class Module final {
   PlaceholderList placeholders_;
   /// Deterministic PRNG used to initialize weights in this module.
   PseudoRNG PRNG_;
+  /// File mappings that back the payloads of some of the variables, such as
+  /// the ones of a module loaded by loadModule(). They are shared, so that
+  /// the module stays copyable.
+  std::vector<std::shared_ptr<llvm::sys::fs::mapped_file_region>>
+      mappedFiles_;
+  /// The mappings of mappedFiles_ that are read-only, because other processes
+  /// share their pages.
+  std::vector<const llvm::sys::fs::mapped_file_region *> readOnlyMappings_;
+
+public:
+  /// Computes the payload \p dest of a derived variable from the payloads
+  /// \p srcs of its sources, see getDerivedVariable(). \returns false if the
+  /// sources can't be transformed into the type of \p dest, e.g. when the type
+  /// depends on their content.
+  using DeriveFn =
+      std::function<bool(llvm::ArrayRef<Tensor *> srcs, Tensor &dest)>;
+
+private:
+  /// A variable that holds a transformation of the payloads of other ones.
+  struct DerivedVariable {
+    /// The names of the sources, which identify them even after they are
+    /// erased, as names are never reused.
+    std::vector<std::string> sources;
+    /// The types of the sources.
+    std::vector<TypeRef> sourceTypes;
+    /// The type of the derived variable.
+    TypeRef type;
+    /// The name of the transformation, see getDerivedVariable().
+    std::string recipe;
+    /// The content hash of the sources when the variable was derived.
+    size_t sourceHash;
+    /// Whether other functions may use the variable, which is not the case
+    /// for the transformations of trainable variables.
+    bool isShared;
+    /// The name of the derived variable.
+    std::string name;
+    /// The derived variable, or null once it is erased.
+    Variable *var;
+    /// Computes the payload again from new sources. Null if the
+    /// transformation can't be replayed.
+    DeriveFn derive;
+  };
+  /// The derivations, in the order they were made, so that each one comes
+  /// after the ones that its sources are derived from. They outlive the
+  /// variables, so that updateWeights() can replay the transformations of
+  /// erased ones.
+  std::list<DerivedVariable> derivations_;
+  /// The derivations of each variable, indexed by the name of its first
+  /// source.
+  llvm::StringMap<std::vector<DerivedVariable *>> derivedFrom_;
+  /// The derivation of each derived variable.
+  llvm::DenseMap<const Variable *, DerivedVariable *> derivationOf_;
+  /// The types of the sources of the derivations, by name.
+  llvm::StringMap<TypeRef> derivationSources_;
+
+  /// Forget that \p V was derived, before erasing it.
+  void forgetDerivedVariable(Variable *V);
+
+  /// \returns the combined content hash of the payloads of \p srcs.
+  static size_t getSourceHash(llvm::ArrayRef<Tensor *> srcs);
 
 public:
   Module() = default;
@@ -74,7 +163,8 @@ public:
   /// Inserts the placeholder node \p ph to the list of variables.
   Placeholder *addPlaceholder(Placeholder *ph);
 
-  /// Return a pointer to a uniqued type \p T.
+  /// Return a pointer to a uniqued type \p T. This is the only member of the
+  /// module that may be called from several threads at once.
   TypeRef uniqueType(const Type &T);
 
   /// Return a pointer to a uniqued type \p T.
@@ -91,6 +181,11 @@ public:
   /// Return the void type.
   TypeRef getVoidTy();
 
+  /// \returns the arena of the module. Importers and Function::clone() build
+  /// their nodes in an ArenaScope of it, which makes the construction of large
+  /// graphs cheaper, and their destruction with the module.
+  Arena &getArena() { return *arena_; }
+
   /// \returns True if a function by the name \p name exists in the module.
   bool hasFunction(llvm::StringRef name);
   /// \returns the function with the name \p name, or nullptr if the function
@@ -98,6 +193,14 @@ public:
   Function *getFunction(llvm::StringRef name);
   /// \returns a new function with the name \p name.
   Function *createFunction(llvm::StringRef name);
+  /// \returns a new function with the name \p name that computes all of the
+  /// outputs of \p members, e.g. the models of an ensemble that score the
+  /// same input. The members are cloned, and share their placeholders and
+  /// variables with the new function, so the inputs they have in common are
+  /// bound once, and the graph optimizations deduplicate the subgraphs that
+  /// they have in common, such as the preprocessing of the shared inputs.
+  Function *createEnsemble(llvm::StringRef name,
+                           llvm::ArrayRef<Function *> members);
   /// \returns the list of Functions that the Module owns.
   FunctionList &getFunctions() { return functions_; }
 
@@ -113,6 +216,49 @@ public:
   /// if no node has this name.
   Variable *getVariableByName(llvm::StringRef name);
 
+  /// \returns a private variable of type \p T whose payload \p derive computes
+  /// from the payloads of the private variables \p srcs. \p recipe names the
+  /// transformation and all of its parameters that \p T does not imply. The
+  /// constant variables derived from the same sources with the same recipe
+  /// and type are shared by all the functions of the module, so that the
+  /// variants of a function that are built from its clones, such as the
+  /// quantized ones, reuse the transformed weights instead of copying them
+  /// again. The variable is derived again if the payloads of \p srcs have
+  /// changed since. \p derive is kept to replay the transformation in
+  /// updateWeights(), so it must not refer to the state of the caller, and
+  /// must succeed on \p srcs. Derived variables must not be written to.
+  Variable *getDerivedVariable(llvm::ArrayRef<Variable *> srcs, TypeRef T,
+                               llvm::StringRef recipe, DeriveFn derive);
+
+  /// Record that the payload of the private variable \p V, which was just
+  /// created, is a transformation of the payloads of \p srcs. \p derive
+  /// replays it, and is null if it can't be replayed, in which case the
+  /// updates of \p srcs fail.
+  void addDerivedVariable(llvm::ArrayRef<Variable *> srcs, Variable *V,
+                          llvm::StringRef recipe, DeriveFn derive);
+
+  /// \returns true if \p V is derived from other variables, or other
+  /// variables are derived from it.
+  bool isDerivationOperand(const Variable *V) const;
+
+  /// Replace the payloads of the private variables named \p names with the
+  /// tensors \p values, of the same types, and replay the transformations
+  /// that were derived from them, transitively, on the new data. A name may
+  /// refer to a variable that was erased after it was transformed, such as
+  /// the filter of a convolution that a backend swizzled, in which case only
+  /// the variables derived from it are updated. The payloads are updated in
+  /// place, so compiled functions see the new data, although the ones that
+  /// keep copies of the weights must also be told about the variables that
+  /// are appended to \p updated. Nothing is changed, and false is returned,
+  /// if a name does not refer to a private variable that is not derived, or
+  /// to a source of a transformation, if a type does not match, or if a
+  /// transformation can't be replayed: either it is not replayable, or one of
+  /// its sources was erased and is not in \p names, or if a variable to be
+  /// updated has its payload in a read-only mapping.
+  bool updateWeights(llvm::ArrayRef<llvm::StringRef> names,
+                     llvm::ArrayRef<Tensor *> values,
+                     std::vector<Variable *> *updated = nullptr);
+
   /// \returns the list of variables that the Module owns.
   VariablesList &getVars() { return vars_; }
 
@@ -152,6 +298,23 @@ public:
 
   ///@}
 
+  /// Keep the file mapping \p region, which backs the payloads of some
+  /// variables, alive for as long as the module. \p isReadOnly tells that the
+  /// pages of the mapping can't be written, e.g. because they are shared with
+  /// other processes.
+  void
+  addMappedFile(std::unique_ptr<llvm::sys::fs::mapped_file_region> region,
+                bool isReadOnly = false) {
+    if (isReadOnly) {
+      readOnlyMappings_.push_back(region.get());
+    }
+    mappedFiles_.push_back(std::move(region));
+  }
+
+  /// \returns true if the payload of \p V is in a read-only file mapping, so
+  /// it must not be written.
+  bool isPayloadReadOnly(const Variable *V) const;
+
   /// Verify the correctness of the Module.
   void verify() const;
 
@@ -234,6 +397,16 @@ public:
                               unsigned_t kernel, unsigned_t stride,
                               unsigned_t pad, unsigned_t group);
 
+  /// Creates a quantized convolution where each output channel of the int8
+  /// \p filter is quantized with its own scale and offset taken from the
+  /// float \p scales and int32 \p offsets tensors. The int32 \p bias must be
+  /// quantized in the scale of the input times the channel scale.
+  ChannelwiseQuantizedConvolutionNode *createChannelwiseQuantizedConv(
+      llvm::StringRef name, NodeValue input, NodeValue filter, NodeValue bias,
+      NodeValue scales, NodeValue offsets, TypeRef outTy,
+      llvm::ArrayRef<unsigned_t> kernels, llvm::ArrayRef<unsigned_t> strides,
+      llvm::ArrayRef<unsigned_t> pads, unsigned_t group);
+
   MaxPoolNode *createMaxPool(llvm::StringRef name, NodeValue input,
                              llvm::ArrayRef<unsigned_t> kernels,
                              llvm::ArrayRef<unsigned_t> strides,
@@ -267,6 +440,36 @@ public:
   FullyConnectedNode *createFullyConnected(llvm::StringRef name,
                                            NodeValue input, size_t outDepth);
 
+  /// Create a fully connected node with float \p input and \p bias whose
+  /// \p weights are an int8 matrix with a row for every output column. Row j
+  /// dequantizes as scales[j] * (weights[j] - offsets[j]), with float
+  /// \p scales and int32 \p offsets. The result is float.
+  RowwiseQuantizedFullyConnectedNode *
+  createRowwiseQuantizedFullyConnected(llvm::StringRef name, NodeValue input,
+                                       NodeValue weights, NodeValue scales,
+                                       NodeValue offsets, NodeValue bias);
+
+  /// Same as above, but quantizes every column of the float K x N weight
+  /// matrix \p W to int8 with its own range. The quantized weights, their
+  /// scales and their offsets are stored in new private variables.
+  RowwiseQuantizedFullyConnectedNode *
+  createRowwiseQuantizedFullyConnected(llvm::StringRef name, NodeValue input,
+                                       Tensor &W, NodeValue bias);
+
+  /// Same as createRowwiseQuantizedFullyConnected, but every row of \p input
+  /// is also quantized to int8 at runtime, with the range of its values, and
+  /// the products are computed in integer arithmetic.
+  DynamicQuantizedFullyConnectedNode *
+  createDynamicQuantizedFullyConnected(llvm::StringRef name, NodeValue input,
+                                       NodeValue weights, NodeValue scales,
+                                       NodeValue offsets, NodeValue bias);
+
+  /// Same as above, but quantizes every column of the float K x N weight
+  /// matrix \p W to int8 with its own range, into new private variables.
+  DynamicQuantizedFullyConnectedNode *
+  createDynamicQuantizedFullyConnected(llvm::StringRef name, NodeValue input,
+                                       Tensor &W, NodeValue bias);
+
   /// Create a ReLU node with the given \p name and \p input.
   /// Result type will be implicitly set based on the \p input type.
   ReluNode *createRELU(llvm::StringRef name, NodeValue input);
@@ -279,7 +482,10 @@ public:
 
   TanhNode *createTanh(llvm::StringRef name, NodeValue input);
 
-  LogNode *createLog(llvm::StringRef name, NodeValue input);
+  /// Create a natural log node with the given \p name and \p input. The
+  /// result type is \p outTy, or the type of \p input if it is not given.
+  LogNode *createLog(llvm::StringRef name, NodeValue input,
+                     TypeRef outTy = nullptr);
 
   SoftMaxNode *createSoftMax(llvm::StringRef name, NodeValue input,
                              NodeValue selected, TypeRef outTy = nullptr);
@@ -288,6 +494,14 @@ public:
                                                NodeValue input,
                                                NodeValue labels);
 
+  /// Creates a node that computes the cross entropy loss of the softmax of
+  /// the 2D \p logits with the int64 \p labels, one per row, without
+  /// materializing the probabilities. Training it is equivalent to training a
+  /// SoftMax node whose Selected input is \p labels.
+  SoftMaxCrossEntropyLossNode *
+  createSoftMaxCrossEntropyLoss(llvm::StringRef name, NodeValue logits,
+                                NodeValue labels);
+
   RegressionNode *createRegression(llvm::StringRef name, NodeValue input,
                                    NodeValue expected);
 
@@ -302,13 +516,18 @@ public:
   TransposeNode *createTranspose(llvm::StringRef name, NodeValue input,
                                  llvm::ArrayRef<unsigned_t> shuffle);
 
-  /// Create a series of nodes that implement a Broadcast operation. The \p
-  /// input Tensor is broadcasted based on \p newShape and along the \p axis,
-  /// which defines the offset from the leading dimension under which
-  /// broadcasting is performed.
+  /// Create the nodes that implement a Broadcast operation. The \p input
+  /// Tensor is broadcasted based on \p newShape and along the \p axis, which
+  /// defines the offset from the leading dimension under which broadcasting is
+  /// performed. The input is reshaped to the rank of \p newShape, and then
+  /// broadcasted by a Broadcast node if any of its dimensions is repeated.
   Node *createBroadcast(llvm::StringRef name, NodeValue input,
                         UnsignedArrayRef newShape, unsigned_t axis);
 
+  /// Create a node that adds all of the \p inputs elementwise. All of the
+  /// inputs must have the same type, which is the type of the result.
+  SumNode *createSum(llvm::StringRef name, llvm::ArrayRef<NodeValue> inputs);
+
   /// Create concat node which concatenates input tensors along \p dimension.
   ConcatNode *createConcat(llvm::StringRef name,
                            llvm::ArrayRef<NodeValue> inputs,
@@ -410,10 +629,14 @@ public:
 
   SplatNode *createSplat(llvm::StringRef name, TypeRef ty, float value);
 
-  MatMulNode *createMatMul(llvm::StringRef name, NodeValue lhs, NodeValue rhs);
+  /// Create a matrix multiplication of \p lhs and \p rhs. If \p transposeRHS
+  /// is set, \p rhs is the transpose of the right-hand side matrix, which the
+  /// backends read directly instead of materializing the transpose.
+  MatMulNode *createMatMul(llvm::StringRef name, NodeValue lhs, NodeValue rhs,
+                           bool transposeRHS = false);
 
   MatMulNode *createMatMul(llvm::StringRef name, TypeRef outTy, NodeValue lhs,
-                           NodeValue rhs);
+                           NodeValue rhs, bool transposeRHS = false);
 
   /// \p lhs is a 3d matrix, where the leading dimension is the batch size. \p
   /// rhs is a 2d matrix, which every batch from \p lhs (a 2d matrix) is
@@ -424,12 +647,19 @@ public:
 
   /// \p lhs and \p rhs are 3d matrices, where the leading dimension is the
   /// batch size. For each batch element number i, lhs.slice(i) is multiplied by
-  /// rhs.slice(i). This is implemented by unrolling loop over batch size and
-  /// issuing multiple slice, reshape and matmul instructions, and then
-  /// concatenating results and bringing them back to 3d shape.
+  /// rhs.slice(i). This creates a single BatchedMatMul node.
   Node *createParallelBatchMatMul(llvm::StringRef name, NodeValue lhs,
                                   NodeValue rhs);
 
+  /// Create a node that multiplies the matrices {N, M} of the 3d tensor \p lhs
+  /// with the matrices {M, P} of the 3d tensor \p rhs, batch entry by batch
+  /// entry, into a 3d tensor of matrices {N, P}.
+  BatchedMatMulNode *createBatchedMatMul(llvm::StringRef name, NodeValue lhs,
+                                         NodeValue rhs);
+
+  BatchedMatMulNode *createBatchedMatMul(llvm::StringRef name, TypeRef outTy,
+                                         NodeValue lhs, NodeValue rhs);
+
   BatchedReduceAddNode *createBatchedReduceAdd(llvm::StringRef name,
                                                NodeValue batch,
                                                unsigned_t axis);
@@ -476,8 +706,28 @@ public:
                                  NodeValue weights, NodeValue indices,
                                  NodeValue lengths);
 
+  /// Same as SparseLengthsWeightedSum, but \p data is an int8 table whose
+  /// i-th row dequantizes as scales[i] * (data[i] - offsets[i]), with float
+  /// \p scales and int32 \p offsets. The result is float.
+  RowwiseQuantizedSparseLengthsWeightedSumNode *
+  createRowwiseQuantizedSparseLengthsWeightedSum(
+      llvm::StringRef name, NodeValue data, NodeValue scales, NodeValue offsets,
+      NodeValue weights, NodeValue indices, NodeValue lengths);
+
+  /// Same as above, but quantizes every row of the float table \p data to
+  /// int8 with its own range. The quantized table, its scales and its offsets
+  /// are stored in new private variables.
+  RowwiseQuantizedSparseLengthsWeightedSumNode *
+  createRowwiseQuantizedSparseLengthsWeightedSum(llvm::StringRef name,
+                                                 Tensor &data,
+                                                 NodeValue weights,
+                                                 NodeValue indices,
+                                                 NodeValue lengths);
+
   SaveNode *createSave(llvm::StringRef name, NodeValue input);
   SaveNode *createSave(llvm::StringRef name, NodeValue input, Variable *output);
+  SaveNode *createSave(llvm::StringRef name, NodeValue input,
+                       Placeholder *output);
 
   /// Create quantization profile node named \p name for the output tensor from
   /// \p input. Capture observed node name in quantization profile node as
@@ -505,6 +755,90 @@ public:
 
   TopKNode *createTopK(llvm::StringRef name, NodeValue input, unsigned_t k);
 
+  /// Create a node that computes one time step of an LSTM layer from the
+  /// \p input {B, X}, the hidden state \p H {B, H} and the cell state \p C
+  /// {B, H}. The weights {X, 4H} and {H, 4H} and the biases {4H} compute the
+  /// input, forget, cell and output gates at once, in this order.
+  LSTMCellNode *createLSTMCell(llvm::StringRef name, NodeValue input,
+                               NodeValue H, NodeValue C,
+                               NodeValue inputWeights, NodeValue inputBias,
+                               NodeValue hiddenWeights, NodeValue hiddenBias);
+
+  /// Create a node that computes the new hidden and cell states of an LSTM
+  /// from the cell state \p C {B, H} and the gate pre-activations {B, 4H}
+  /// \p inputGates and \p hiddenGates, which are added.
+  LSTMUnitNode *createLSTMUnit(llvm::StringRef name, NodeValue inputGates,
+                               NodeValue hiddenGates, NodeValue C);
+
+  /// Create a node that computes one time step of a GRU layer from the
+  /// \p input {B, X} and the hidden state \p H {B, H}. The weights {X, 3H}
+  /// and {H, 3H} and the biases {3H} compute the reset, update and new gates
+  /// at once, in this order, with the same formulation as PyTorch: the reset
+  /// gate scales the hidden contribution to the new gate.
+  GRUCellNode *createGRUCell(llvm::StringRef name, NodeValue input,
+                             NodeValue H, NodeValue inputWeights,
+                             NodeValue inputBias, NodeValue hiddenWeights,
+                             NodeValue hiddenBias);
+
+  /// Create a node that computes the new hidden state of a GRU from the
+  /// hidden state \p H {B, H} and the contributions {B, 3H} \p inputGates and
+  /// \p hiddenGates of the input and of \p H to the gates.
+  GRUUnitNode *createGRUUnit(llvm::StringRef name, NodeValue inputGates,
+                             NodeValue hiddenGates, NodeValue H);
+
+  /// Create a node that runs a simple RNN over the time steps of
+  /// \p inputGates {T, B, H}, the contributions of the input, starting from
+  /// the hidden state \p initH {B, H}. \returns the hidden states {T, B, H}.
+  /// \p lengths {B} (Int64) holds the number of steps of each batch entry,
+  /// which may change from run to run without recompiling: the steps past the
+  /// largest length are not computed, and the states of an entry past its
+  /// length repeat its last state, so that the last step holds the final
+  /// states of all the entries. All the entries run T steps if \p lengths is
+  /// empty.
+  RNNSequenceNode *createRNNSequence(llvm::StringRef name,
+                                     NodeValue inputGates, NodeValue initH,
+                                     NodeValue hiddenWeights,
+                                     NodeValue hiddenBias,
+                                     NodeValue lengths = NodeValue());
+
+  /// Create a node that runs an LSTM over the time steps of \p inputGates
+  /// {T, B, 4H}, the contributions of the input to the gates, starting from
+  /// the states \p initH and \p initC {B, H}. \returns the hidden states
+  /// {T, B, H}. \p lengths is the same as in createRNNSequence.
+  LSTMSequenceNode *createLSTMSequence(llvm::StringRef name,
+                                       NodeValue inputGates, NodeValue initH,
+                                       NodeValue initC, NodeValue hiddenWeights,
+                                       NodeValue hiddenBias,
+                                       NodeValue lengths = NodeValue());
+
+  /// Create a node that runs a GRU over the time steps of \p inputGates
+  /// {T, B, 3H}, the contributions of the input to the gates, starting from
+  /// the hidden state \p initH {B, H}. \returns the hidden states {T, B, H}.
+  /// \p lengths is the same as in createRNNSequence.
+  GRUSequenceNode *createGRUSequence(llvm::StringRef name,
+                                     NodeValue inputGates, NodeValue initH,
+                                     NodeValue hiddenWeights,
+                                     NodeValue hiddenBias,
+                                     NodeValue lengths = NodeValue());
+
+  /// Replace the uses of the results of \p N, a recurrent cell, unit or
+  /// sequence node, with the nodes that compute it. A cell becomes two fully
+  /// connected nodes that compute all the gates and a unit node, a unit
+  /// becomes element-wise nodes, and a sequence is unrolled into one unit per
+  /// time step. The lengths of a sequence must be a constant variable, as the
+  /// unrolled steps can't be masked at run time. \returns false if \p N is
+  /// not one of these nodes.
+  bool expandRecurrentNode(Node *N);
+
+  /// Expand with expandRecurrentNode the recurrent cells and units of the
+  /// function for which \p shouldExpand returns true, the cells first, so
+  /// that the units of the expanded cells can be expanded too. The expanded
+  /// nodes have no users left, and are erased unless \p keepExpanded is set.
+  /// \returns the number of expanded nodes.
+  unsigned
+  expandRecurrentCells(const std::function<bool(const Node *)> &shouldExpand,
+                       bool keepExpanded = false);
+
   /// Gathers entries of the outer-most dimension of \p data indexed by
   /// \p indices, and concatenates them. A non-zero \p batchDims specifies the
   /// batch, and the result is the concatenation of the operation on each sample
@@ -519,6 +853,12 @@ public:
   ScatterAssignNode *createScatterAssign(llvm::StringRef name, NodeValue data,
                                          NodeValue indices, NodeValue slices);
 
+  /// Create a node that converts the floating point tensor \p input to the
+  /// floating point element kind \p k, e.g. to keep weights in half
+  /// precision and expand them to single precision before their use.
+  ConvertToNode *createConvertTo(llvm::StringRef name, NodeValue input,
+                                 ElemKind k);
+
   /// Create quantization node which transforms floating point tensor to a
   /// quantized one with given Scale and Offset. Scale and Offset params are
   /// part of the \p outTy.
@@ -550,7 +890,8 @@ public:
   /// and the number of time steps is equal to the size of the \p inputs. The
   /// names of the created variables are prefixed by \p namePrefix.
   /// The output variables are written to \p outputs, they represent the
-  /// activations of the output layer, unrolled over time.
+  /// activations of the output layer, unrolled over time. The time steps are
+  /// computed by an RNNSequence node.
   // The dimensionality of the output variables is \p batchSize x \p outputSize.
   void createSimpleRNN(llvm::StringRef namePrefix,
                        const llvm::ArrayRef<Node *> inputs, unsigned batchSize,
@@ -563,7 +904,8 @@ public:
   /// and the number of time steps is equal to the size of the \p inputs. The
   /// names of the created variables are prefixed by \p namePrefix.
   /// The output variables are written to \p outputs, they represent the
-  /// activation of the output layer, unrolled over time.
+  /// activation of the output layer, unrolled over time. The time steps are
+  /// computed by a GRUSequence node.
   // The dimensionality of the output variables is \p batchSize x \p outputSize.
   void createGRU(llvm::StringRef namePrefix,
                  const llvm::ArrayRef<Node *> inputs, unsigned batchSize,
@@ -576,13 +918,29 @@ public:
   /// and the number of time steps is equal to the size of the \p inputs. The
   /// names of the created variables are prefixed by \p namePrefix.
   /// The output variables are written to \p outputs, they represent the
-  /// activation of the output layer, unrolled over time.
+  /// activation of the output layer, unrolled over time. The time steps are
+  /// computed by an LSTMSequence node.
   // The dimensionality of the output variables is \p batchSize x \p outputSize.
   void createLSTM(llvm::StringRef namePrefix,
                   const llvm::ArrayRef<Node *> inputs, unsigned batchSize,
                   unsigned hiddenSize, unsigned outputSize,
                   std::vector<NodeValue> &outputs);
 
+  /// Create one time step of the recurrent layer that createSimpleRNN,
+  /// createGRU or createLSTM created with the same \p namePrefix, for
+  /// streaming inference. The step shares the weights of the layer and
+  /// \returns the output {B, outputSize} of the \p input {B, X}. The state
+  /// of the layer is the variable \p H {B, hiddenSize}, together with \p C
+  /// for an LSTM. The step reads the state and saves the new state back into
+  /// it, so that every run continues the sequence where the previous run
+  /// stopped and costs the same. Zero the state to start a new sequence.
+  NodeValue createSimpleRNNStep(llvm::StringRef namePrefix, NodeValue input,
+                                Variable *H);
+  NodeValue createGRUStep(llvm::StringRef namePrefix, NodeValue input,
+                          Variable *H);
+  NodeValue createLSTMStep(llvm::StringRef namePrefix, NodeValue input,
+                           Variable *H, Variable *C);
+
   /// @}
 
   /// Erase the node \p N from the Function.
@@ -593,7 +951,9 @@ public:
 
   /// Clone the current function into a new function with the name \p newName.
   /// If \p map is non-null then the procedure records the mapping between the
-  /// old node to the new node in \p map.
+  /// old node to the new node in \p map. The variables are shared, not copied,
+  /// and the variants that transform them should do it with
+  /// Module::getDerivedVariable().
   /// \returns a new function that is a copy of the current function.
   Function *clone(llvm::StringRef newName,
                   llvm::DenseMap<Node *, Node *> *map = nullptr);
@@ -604,6 +964,24 @@ public:
   /// Dumps the textual representation of the network.
   void dump() const;
 
+  /// \returns the sum of the static costs of the nodes of the function.
+  Cost getCost() const;
+
+  /// Print to \p os the operations, the bytes moved and the arithmetic
+  /// intensity of every node of the function that performs operations,
+  /// followed by the totals of the function.
+  void dumpCost(llvm::raw_ostream &os) const;
+
+  /// \returns an estimate of the memory that the function needs once it is
+  /// compiled, computed from the graph without compiling it: the payloads of
+  /// the variables that it reads and writes, and the peak size of the results
+  /// of its nodes that are alive at the same time when the nodes are executed
+  /// in a depth-first order. The code and scratch areas are unknown and 0.
+  /// The estimate is usually above the compiled size, whose activations share
+  /// buffers, and is meant to be done after the graph is optimized and
+  /// lowered.
+  MemoryUsage estimateMemoryUsage() const;
+
   /// Dump a dotty graph that depicts the function.
   void dumpDAG();
 
@@ -641,6 +1019,12 @@ Function *differentiate(Function *F, const TrainingConfig &config,
                         llvm::StringRef newFuncName = "",
                         VariableGradientsList *varGrads = nullptr);
 
+/// Add to \p F the nodes that update the trained weight \p W with its
+/// gradient \p grad, using the optimizer of \p config, and that save the
+/// updated weight into \p W. \returns the save node.
+SaveNode *createWeightUpdate(Function *F, const TrainingConfig &config,
+                             Storage *W, NodeValue grad);
+
 /// Helper vectors for common transpose shuffles.
 #define NCHW2NHWC                                                              \
   { 0u, 2u, 3u, 1u }
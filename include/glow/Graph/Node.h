@@ -22,6 +22,7 @@
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/Support/Casting.h"
 
+#include "glow/Base/Cost.h"
 #include "glow/Base/Traits.h"
 #include "glow/Base/Type.h"
 #include "glow/Graph/UseDef.h"
@@ -32,6 +33,8 @@ namespace glow {
 
 class Function;
 class Node;
+class ModuleReader;
+class ModuleWriter;
 class NodeWalker;
 struct NodeUse;
 template <bool is_const_iter> class NodeValueIteratorImpl;
@@ -254,10 +257,20 @@ protected:
   /// Link to the function holding this node.
   Function *parent_;
 
+  /// Whether this node recomputes a forward activation for the backward pass
+  /// instead of keeping the original one alive.
+  bool isRecomputation_{false};
+
 public:
   Node(Kinded::Kind k, llvm::StringRef name)
       : Named(name), Kinded(k), predicate_(this, nullptr), parent_(nullptr) {}
 
+  /// Nodes are allocated from the current arena of the thread, see
+  /// ArenaScope, and from the heap when there is none. The arena is recorded in
+  /// front of the node, so that nodes can be destroyed from any scope.
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
   /// \returns the nullable predicate of the current node.
   const NodeValue getPredicate() const;
   /// Assigns a nullable predicate to the current node.
@@ -279,6 +292,12 @@ public:
   /// Set the link to the function that holds this node.
   void setParent(Function *parent) { parent_ = parent; }
 
+  /// \returns true if the node recomputes a forward activation. Such nodes
+  /// must not be merged with the node they duplicate.
+  bool isRecomputation() const { return isRecomputation_; }
+  /// Marks the node as a recomputation of a forward activation.
+  void setRecomputation(bool recompute) { isRecomputation_ = recompute; }
+
   /// Getters/setters to access Node's inputs and outputs.
   unsigned getNumInputs() const;
   std::string getInputName(unsigned idx) const;
@@ -319,6 +338,14 @@ public:
   /// Verify node.
   void verify() const;
 
+  /// \returns the number of arithmetic operations performed by the node.
+  uint64_t getFlops() const;
+
+  /// \returns the static cost of the node: its arithmetic operations, the
+  /// bytes of its inputs that are read and the bytes of its results that are
+  /// written.
+  Cost getCost() const;
+
   /// Replace all uses of this node with null. This method is used by the
   /// destruction sequence. When the node is deleted we need to unregister all
   /// users. This allows us to deconstruct the graph in an arbitrary order.
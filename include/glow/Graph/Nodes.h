@@ -51,7 +51,10 @@ public:
   NodeValue getNthInput(unsigned idx);
   llvm::StringRef getOutputName(unsigned idx) const;
   bool hasSideEffects() const;
+  uint64_t getFlops() const { return 0; }
   Node *clone() const;
+  void serialize(ModuleWriter &W) const;
+  static Node *deserialize(llvm::StringRef name, ModuleReader &R);
   /// @}
 
   /// \returns True if the Variable or placeholder are trainable during
@@ -95,6 +98,17 @@ public:
     addResult(&payload_.getType());
   }
 
+  /// Create a new variable of type \p Ty that holds \p payload, which must
+  /// have the same type.
+  Variable(llvm::StringRef name, TypeRef Ty, VisibilityKind visibility,
+           bool isTrainable, Tensor &&payload)
+      : Storage(Kinded::Kind::VariableKind, name, isTrainable),
+        visibility_(visibility), payload_(std::move(payload)) {
+    assert(Ty->isEqual(payload_.getType()) &&
+           "The payload does not match the type of the variable");
+    addResult(Ty);
+  }
+
   /// \returns True if the Variable is private.
   bool isPrivate() const { return visibility_ == VisibilityKind::Private; }
 
@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_GRAPH_SERIALIZATION_H
+#define GLOW_GRAPH_SERIALIZATION_H
+
+#include "glow/Graph/Graph.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace glow {
+
+/// Writes the description of a module into a binary buffer. The payloads of
+/// the variables are not part of the description; they are laid out by
+/// saveModule() after it. Every node class has a generated serialize() method
+/// that writes the fields of the node with the write() methods of this class.
+class ModuleWriter {
+  /// The serialized description.
+  std::string buffer_;
+  /// The ids of the written storage nodes and of the written nodes of the
+  /// current function. The ids of the nodes of a function follow the ones of
+  /// the storage nodes.
+  std::unordered_map<const Node *, uint32_t> ids_;
+
+  /// Append \p size bytes at \p data to the buffer.
+  void writeBytes(const void *data, size_t size);
+
+  /// Write the id of \p N, which must have been written before.
+  void writeId(const Node *N);
+
+  /// Write the storage node \p S, whose payload, if any, is at \p offset in
+  /// the payload section.
+  void writeStorage(const Storage *S, uint64_t offset);
+
+  /// Write the node \p N of a function, after the nodes that it uses.
+  void writeNode(const Node *N);
+
+public:
+  /// Write the fields of the different types of node members.
+  /// @{
+  void write(uint64_t v);
+  void write(unsigned_t v);
+  void write(float v);
+  void write(bool v);
+  void write(llvm::StringRef v);
+  void write(TypeRef v);
+  void write(const NodeValue &v);
+  void write(llvm::ArrayRef<float> v);
+  void write(llvm::ArrayRef<unsigned_t> v);
+  void write(llvm::ArrayRef<size_t> v);
+  void write(NodeValueArrayRef v);
+  /// @}
+
+  /// Describe the module \p M, whose variable payloads are placed in the
+  /// payload section at the offsets \p payloadOffsets, in the order of the
+  /// variables of the module.
+  void writeModule(Module &M, llvm::ArrayRef<uint64_t> payloadOffsets);
+
+  /// \returns the serialized description.
+  const std::string &getBuffer() const { return buffer_; }
+};
+
+/// Recreates a module from the description written by ModuleWriter. The
+/// payloads of the variables alias the payload section, which must stay
+/// alive for as long as the module uses them.
+class ModuleReader {
+  /// The module being populated.
+  Module &M_;
+  /// The unread part of the description.
+  const char *cur_;
+  /// The end of the description.
+  const char *end_;
+  /// The payload section.
+  char *payloads_;
+  /// The size of the payload section.
+  uint64_t payloadsSize_;
+  /// The nodes read so far, indexed by their id.
+  std::vector<Node *> nodes_;
+  /// Whether the public variables get a copy of their payload, because the
+  /// payload section can't be written.
+  bool copyPublicPayloads_;
+
+  /// Copy the next \p size bytes of the description to \p data.
+  void readBytes(void *data, size_t size);
+
+  /// \returns the node with the next id of the description.
+  Node *readNodeRef();
+
+  /// Read a variable and add it to the module.
+  void readVariable();
+
+  /// Read a placeholder and add it to the module.
+  void readPlaceholder();
+
+  /// Read a node and add it to \p F.
+  void readNode(Function *F);
+
+public:
+  /// Create a reader for the description [\p begin, \p end) that populates
+  /// \p M. The payloads of the variables are in the section [\p payloads,
+  /// \p payloads + \p payloadsSize). If \p copyPublicPayloads is set, the
+  /// public variables, which the functions may write, own a copy of their
+  /// payload, and only the private ones alias the section.
+  ModuleReader(Module &M, const char *begin, const char *end, char *payloads,
+               uint64_t payloadsSize, bool copyPublicPayloads = false)
+      : M_(M), cur_(begin), end_(end), payloads_(payloads),
+        payloadsSize_(payloadsSize), copyPublicPayloads_(copyPublicPayloads) {}
+
+  /// Read the fields of the different types of node members.
+  /// @{
+  void read(uint64_t &v);
+  void read(unsigned_t &v);
+  void read(float &v);
+  void read(bool &v);
+  void read(std::string &v);
+  void read(TypeRef &v);
+  void read(NodeValue &v);
+  void read(std::vector<float> &v);
+  void read(std::vector<unsigned_t> &v);
+  void read(std::vector<size_t> &v);
+  void read(std::vector<NodeValue> &v);
+  /// @}
+
+  /// Read the whole description into the module.
+  void readModule();
+};
+
+/// How loadModule() maps the payloads of the variables.
+enum class ModuleMapping {
+  /// The mapping is private: the variables may be written, and the pages
+  /// that are written are copied for the process.
+  CopyOnWrite,
+  /// The private variables, i.e. the constant weights of the functions,
+  /// alias a read-only shared mapping of the file, so all the processes that
+  /// load the same file, e.g. from /dev/shm, share a single copy of them in
+  /// the page cache. The public variables get a copy of their payload. The
+  /// functions must only be compiled for inference, and the weights of the
+  /// module can't be updated.
+  SharedReadOnly,
+};
+
+/// Write the module \p M, all its functions and the payloads of its variables
+/// to the file \p filename. The payloads are aligned in the file, so that
+/// loadModule() can map them in place. This is typically applied to modules
+/// whose functions have already been optimized and lowered for a backend.
+/// The file is written under a temporary name and renamed, so other
+/// processes never map a partially written module. \returns false if the
+/// file can't be written.
+bool saveModule(Module &M, llvm::StringRef filename);
+
+/// Load the module that saveModule() wrote to \p filename into the empty
+/// module \p M. The file is mapped as \p mapping tells, and the payloads of
+/// the variables point into the mapping, so the time it takes does not depend
+/// on the size of the weights. The module keeps the mapping alive. \returns
+/// false if the file can't be read or is not a serialized module of this
+/// version.
+bool loadModule(llvm::StringRef filename, Module &M,
+                ModuleMapping mapping = ModuleMapping::CopyOnWrite);
+
+} // namespace glow
+
+#endif // GLOW_GRAPH_SERIALIZATION_H
@@ -16,10 +16,12 @@
 #ifndef GLOW_IR_IR_H
 #define GLOW_IR_IR_H
 
+#include "glow/Base/Cost.h"
 #include "glow/Base/Traits.h"
 #include "glow/Base/Type.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/UseDef.h"
+#include "glow/Optimizer/Optimizer.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
@@ -171,6 +173,15 @@ public:
   /// \returns True if this instruction is data parallel.
   bool isDataParallel() const;
 
+  /// \returns the number of arithmetic operations performed by the
+  /// instruction.
+  uint64_t getFlops() const;
+
+  /// \returns the static cost of the instruction. The @in operands are read,
+  /// the @out operands are written, and the @inout operands are both read and
+  /// written.
+  Cost getCost() const;
+
   /// Sets the ith operand at index \p idx to the value \p v.
   void setOperand(unsigned idx, Value *v);
 
@@ -279,9 +290,9 @@ private:
   /// A list of unique instruction names use by the function.
   llvm::StringSet<> stringTable_;
 
-  /// Perform scheduling on the graph.
+  /// Perform scheduling on the graph with a scheduler of kind \p kind.
   /// \returns computed schedule in the \p Schedule parameter.
-  void scheduleGraph(NodesPtrList &Schedule);
+  void scheduleGraph(NodesPtrList &Schedule, SchedulerKind kind);
 
 public:
   /// Add an instruction to the instr stream.
@@ -293,7 +304,8 @@ public:
 
   /// Generate IR from the graph nodes. If the compilation mode is 'training'
   /// then this procedure will also generate the code for the backward pass.
-  void generateIR();
+  /// The nodes are ordered by a scheduler of kind \p schedulerKind.
+  void generateIR(SchedulerKind schedulerKind = SchedulerKind::ChildMemSize);
 
   /// Wipe out the content of the function. This allows the function to be used
   /// again for another round of code generation.
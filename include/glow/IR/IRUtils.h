@@ -22,6 +22,8 @@
 
 namespace glow {
 
+class TensorViewInst;
+
 /// \returns true if the value \v is a tensor view.
 bool isTensorView(Value *v);
 
@@ -133,6 +135,55 @@ Value *getOrigin(Value *V);
 /// \returns peels off the layers of tensorviews from a value \p V.
 const Value *getOrigin(const Value *V);
 
+/// \returns the offset, in elements, of the first element of the tensorview
+/// \p TVI into its source. The view covers the elements from there on in the
+/// order of the memory, so the offsets of \p TVI must select a region that is
+/// contiguous in its source.
+size_t getTensorViewOffset(const TensorViewInst *TVI);
+
+/// \returns true if \p V is a broadcast view. Such a tensorview has the rank
+/// of its source and repeats the elements of the source along the dimensions
+/// in which the source has a single element, so it is larger than the source.
+/// Broadcast views are only read, by the instructions for which
+/// canReadBroadcastViews holds.
+bool isBroadcastView(const Value *V);
+
+/// \returns true if the instruction \p I may read broadcast views through its
+/// operands that are only read. The backends compute the index of the element
+/// of the source of the view that every element of the view repeats.
+bool canReadBroadcastViews(const Instruction *I);
+
+/// A group of consecutive dimensions of a broadcast view, along which the view
+/// reads the elements of its source in order. The element \p idx of the view
+/// repeats the element of its source at the sum of
+/// ((idx / viewStride) % size) * srcStride over all of the groups.
+struct BroadcastDim {
+  /// The number of elements of the view between two consecutive indices.
+  size_t viewStride;
+  /// The number of indices of the group.
+  size_t size;
+  /// The number of elements of the source between two consecutive indices.
+  size_t srcStride;
+};
+
+/// \returns the groups of dimensions of the broadcast view \p TVI, from the
+/// innermost. The dimensions along which the view repeats its source are not
+/// represented.
+llvm::SmallVector<BroadcastDim, 4>
+getBroadcastDims(const TensorViewInst *TVI);
+
+/// \returns the index of the element of the source of a broadcast view with
+/// the groups of dimensions \p dims that the element \p idx of the view
+/// repeats.
+inline size_t getBroadcastSourceIndex(llvm::ArrayRef<BroadcastDim> dims,
+                                      size_t idx) {
+  size_t srcIdx = 0;
+  for (const auto &dim : dims) {
+    srcIdx += ((idx / dim.viewStride) % dim.size) * dim.srcStride;
+  }
+  return srcIdx;
+}
+
 } // namespace glow
 
 #endif // GLOW_IR_IRUTILS_H
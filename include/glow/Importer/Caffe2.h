@@ -23,6 +23,8 @@
 #include "llvm/ADT/ArrayRef.h"
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace caffe2 {
 class Argument;
@@ -42,11 +44,19 @@ class caffe2ModelLoader
   bool getBroadcast(const ArgumentDictionaryTy &dict) override;
 
   /// Load the weight tensors from the 'init' file and register them in the map
-  /// \p tensors.
+  /// \p tensors. The operators of \p net are released once they are loaded.
   void loadWeights(caffe2::NetDef &net);
 
-  /// Loads an individual weight \p op.
-  void loadWeight(const caffe2::OperatorDef &op);
+  /// The GivenTensorFill operators whose values are still to be copied into
+  /// their tensors.
+  using GivenTensorListTy =
+      std::vector<std::pair<const caffe2::OperatorDef *, Tensor *>>;
+
+  /// Loads an individual weight \p op. If \p pendingValues is given, the
+  /// values of a GivenTensorFill operator are not copied but added to it, so
+  /// that the caller can copy them later.
+  void loadWeight(const caffe2::OperatorDef &op,
+                  GivenTensorListTy *pendingValues = nullptr);
 
   /// Load the structure of the network from the 'net' file.
   void loadNetwork(caffe2::NetDef &net);
@@ -25,6 +25,7 @@
 #include "llvm/ADT/ArrayRef.h"
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 
@@ -70,17 +71,21 @@ protected:
   }
 
   void loadShape(const OpType &op, ArgumentDictionaryTy &dict) {
-    const std::string &opName = loadOperatorName(op);
-    auto in = getNodeValueOrCreateVariableByName(op.input(0));
+    // The shape of a constant is taken from its tensor, so that no Variable is
+    // created just to be measured.
+    llvm::ArrayRef<size_t> dims;
+    if (Tensor *in = getConstantByNameOrNull(op.input(0))) {
+      dims = in->dims();
+    } else {
+      dims = getNodeValueOrCreateVariableByName(op.input(0)).dims();
+    }
 
     // This is statically known data, and so we create a Tensor for it and
-    // register it in tensors_.
-    auto *T = new Tensor(ElemKind::Int64ITy, {in.dims().size()});
-    tensors_[opName] = T;
-    T->template getHandle<int64_t>() =
-        std::vector<int64_t>(in.dims().begin(), in.dims().end());
-
-    createAndRememberVariable(opName, *T);
+    // register it as a constant. It only becomes a Variable if an operator
+    // that can't be folded reads it.
+    auto *T = new Tensor(ElemKind::Int64ITy, {dims.size()});
+    T->template getHandle<int64_t>().copyFrom(dims);
+    registerConstant(op.output(0), T);
   }
 
   /// Loads Sqrt operator, given its protobuf representation and parsed args.
@@ -101,12 +106,22 @@ protected:
   }
 
   void loadSum(const OpType &op, ArgumentDictionaryTy &dict) {
-    // TODO: support variadic arguments
-    assert(op.input_size() == 2 && "Only Sum of 2 inputs is supported.");
     const std::string &opName = loadOperatorName(op);
-    auto in0 = getNodeValueOrCreateVariableByName(op.input(0));
-    auto in1 = getNodeValueOrCreateVariableByName(op.input(1));
-    auto *node = G_.createAdd(opName, in0, in1);
+    // Two inputs are loaded as an Add, which the graph optimizer knows best.
+    // Longer sums read all of their inputs in one pass instead of producing a
+    // chain of partial sums.
+    if (op.input_size() == 2) {
+      auto in0 = getNodeValueOrCreateVariableByName(op.input(0));
+      auto in1 = getNodeValueOrCreateVariableByName(op.input(1));
+      auto *node = G_.createAdd(opName, in0, in1);
+      addNodeAsOutput(op, node);
+      return;
+    }
+    std::vector<NodeValue> inputs;
+    for (int i = 0, e = op.input_size(); i < e; i++) {
+      inputs.push_back(getNodeValueOrCreateVariableByName(op.input(i)));
+    }
+    auto *node = G_.createSum(opName, inputs);
     addNodeAsOutput(op, node);
   }
 
@@ -229,10 +244,11 @@ protected:
     }
   }
 
-  void loadReshape(const OpType &op, ArgumentDictionaryTy &dict) {
-    const std::string &opName = loadOperatorName(op);
-    NodeValue in = getNodeValueOrCreateVariableByName(op.input(0));
-
+  /// \returns the shape that the Reshape operator \p op gives to an input of
+  /// shape \p inputDims.
+  std::vector<size_t> loadReshapeDims(const OpType &op,
+                                      ArgumentDictionaryTy &dict,
+                                      llvm::ArrayRef<size_t> inputDims) {
     // Get the requested shape from the model.
     // First look at input tensors, then at the "shape" attribute.
     std::vector<int64_t> requestedDims;
@@ -256,7 +272,6 @@ protected:
 
     // Compute the actual new shape
     ssize_t negOneIndex = -1;
-    llvm::ArrayRef<size_t> inputDims = in.dims();
     std::vector<size_t> outputDims;
     int64_t dimProduct = 1;
     for (size_t i = 0, e = requestedDims.size(); i != e; i++) {
@@ -280,9 +295,19 @@ protected:
       }
     }
     if (negOneIndex >= 0) {
-      outputDims[negOneIndex] = in.getType()->size() / dimProduct;
+      size_t inputSize = 1;
+      for (size_t dim : inputDims) {
+        inputSize *= dim;
+      }
+      outputDims[negOneIndex] = inputSize / dimProduct;
     }
+    return outputDims;
+  }
 
+  void loadReshape(const OpType &op, ArgumentDictionaryTy &dict) {
+    const std::string &opName = loadOperatorName(op);
+    NodeValue in = getNodeValueOrCreateVariableByName(op.input(0));
+    std::vector<size_t> outputDims = loadReshapeDims(op, dict, in.dims());
     auto *node = G_.createReshape(opName, in, outputDims);
 
     // Caffe2 sometimes outputs old_shape which goes unused. We do not currently
@@ -370,12 +395,101 @@ protected:
     addNodeAsOutput(op, node);
   }
 
+  /// \returns the axes named by the attribute \p attrName of an operator in
+  /// \p dict, or the attribute \p altAttrName if it has none.
+  std::vector<size_t> loadAxes(ArgumentDictionaryTy &dict,
+                               llvm::StringRef attrName,
+                               llvm::StringRef altAttrName) {
+    auto it = dict.find(attrName.str());
+    if (it == dict.end()) {
+      it = dict.find(altAttrName.str());
+    }
+    return it == dict.end() ? std::vector<size_t>() : getShape(it->second);
+  }
+
+  /// If all of the inputs of \p op are known while loading, evaluates \p op
+  /// and registers its first output as a constant instead of adding nodes to
+  /// the graph. The shapes that exporters compute with Shape, Gather, Concat
+  /// and arithmetic operators are then folded into the Reshapes that read
+  /// them. \returns true if \p op was folded.
+  bool tryFoldConstantOperator(llvm::StringRef typeName, const OpType &op,
+                               ArgumentDictionaryTy &dict) {
+    llvm::SmallVector<const Tensor *, 4> inputs;
+    for (int i = 0, e = op.input_size(); i < e; i++) {
+      const Tensor *T = getConstantByNameOrNull(op.input(i));
+      if (!T) {
+        return false;
+      }
+      inputs.push_back(T);
+    }
+    if (inputs.empty() || op.output_size() == 0) {
+      return false;
+    }
+    size_t rank = inputs[0]->dims().size();
+
+    Tensor *R = nullptr;
+    if ((typeName == "Gather" || typeName == "BatchGather") &&
+        inputs.size() == 2) {
+      int axis = dict.count("axis") ? loadInt(dict["axis"]) : 0;
+      if (typeName == "BatchGather") {
+        axis = 1;
+      }
+      R = foldGather(*inputs[0], *inputs[1], axis < 0 ? axis + rank : axis);
+    } else if (typeName == "Concat" && dict.count("axis")) {
+      // A Caffe2 Concat without an axis concatenates along the channel of
+      // its order, which is left to the Caffe2 loader.
+      int axis = loadInt(dict["axis"]);
+      size_t concatAxis = axis < 0 ? axis + rank : axis;
+      bool addAxis = dict.count("add_axis") && loadInt(dict["add_axis"]);
+      if (!addAxis) {
+        R = foldConcat(inputs, concatAxis);
+      } else {
+        // The inputs are stacked along a new dimension at the axis.
+        std::vector<std::unique_ptr<Tensor>> expanded;
+        llvm::SmallVector<const Tensor *, 4> expandedInputs;
+        for (const Tensor *T : inputs) {
+          expanded.emplace_back(foldExpandDims(*T, {concatAxis}));
+          expandedInputs.push_back(expanded.back().get());
+        }
+        R = foldConcat(expandedInputs, concatAxis);
+      }
+    } else if (typeName == "Unsqueeze" || typeName == "ExpandDims") {
+      auto axes = loadAxes(dict, "axes", "dims");
+      if (!axes.empty()) {
+        R = foldExpandDims(*inputs[0], axes);
+      }
+    } else if (typeName == "Squeeze") {
+      auto axes = loadAxes(dict, "axes", "dims");
+      if (!axes.empty()) {
+        R = foldSqueeze(*inputs[0], axes);
+      }
+    } else if (typeName == "Reshape") {
+      auto dims = loadReshapeDims(op, dict, inputs[0]->dims());
+      R = foldReshape(*inputs[0], dims);
+    } else if ((typeName == "Mul" || typeName == "Add" || typeName == "Sub" ||
+                typeName == "Div") &&
+               inputs.size() == 2) {
+      R = foldArithmetic(typeName, *inputs[0], *inputs[1]);
+    } else if (typeName == "Identity" || typeName == "Dropout") {
+      R = new Tensor(inputs[0]->clone());
+    }
+
+    if (!R) {
+      return false;
+    }
+    registerConstant(op.output(0), R);
+    return true;
+  }
+
   using ProtobufLoader::ProtobufLoader;
 
   /// If operator type is supported, returns true and creates new operator.
   /// Otherwise returns false.
   bool tryLoadCommonOperator(llvm::StringRef typeName, const OpType &op,
                              ArgumentDictionaryTy &dict) {
+    if (tryFoldConstantOperator(typeName, op, dict)) {
+      return true;
+    }
     if (typeName == "Relu") {
       loadRelu(op, dict);
       return true;
@@ -40,7 +40,8 @@ class ONNXModelLoader
   /// Get the broadcast attribute based on different ONNX op versions.
   bool getBroadcast(const ArgumentDictionaryTy &dict) override;
 
-  /// Load the network initializers from the GraphProto.
+  /// Load the network initializers from the GraphProto. The payload of every
+  /// initializer is released from \p net once it is loaded.
   void loadInitializers(ONNX_NAMESPACE::GraphProto &net);
 
   /// \returns true if operator \p op can be loaded.
@@ -54,6 +55,10 @@ class ONNXModelLoader
   /// ONNX model op_version;
   size_t opsetVersion_;
 
+  /// The directory of the model file, which the locations of the external
+  /// data files are relative to.
+  std::string modelDir_;
+
 protected:
   /// Creates a ONNX model loader to build \p F.
   ONNXModelLoader(Function &F);
@@ -68,7 +73,7 @@ protected:
   bool setOutputNodes(ONNX_NAMESPACE::GraphProto &net);
 
   /// Set ir verion and op version.
-  void setVersion(ONNX_NAMESPACE::ModelProto MP);
+  void setVersion(const ONNX_NAMESPACE::ModelProto &MP);
 
   /// \returns true if ModelProto \p net can be loaded from the stream \p
   /// iStream.
@@ -79,6 +84,7 @@ public:
   /// \returns true if ModelProto \p net can be constructed from the content
   /// of the file \p filename.
   /// Loads ModelProto \p net from the file containing serialized protobuf.
+  /// Binary files are mapped into memory and parsed in place.
   static bool loadProto(ONNX_NAMESPACE::ModelProto &net,
                         const std::string &filename);
 
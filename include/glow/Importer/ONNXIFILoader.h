@@ -20,6 +20,7 @@
 #include "onnx/onnxifi.h"
 
 #include "glow/Importer/ONNX.h"
+#include "glow/Optimizer/Partition.h"
 
 #include "llvm/ADT/StringMap.h"
 
@@ -30,26 +31,33 @@ class ModelLoader : public ONNXModelLoader {
 private:
   ModelLoader(Function &F) : ONNXModelLoader(F) {}
 
-  /// Load the inputs from the GraphProto. This is useful when the
-  /// initializers are not available.
+  /// Load the inputs from the GraphProto as placeholders. This is useful when
+  /// the initializers are not available.
   void loadInputs(ONNX_NAMESPACE::GraphProto &net);
 
+  /// Save the outputs of the network \p net to placeholders.
+  /// \returns true if output nodes were found.
+  bool setOutputPlaceholders(ONNX_NAMESPACE::GraphProto &net);
+
   /// Load pre-trained weights from \p weightDescriptors.
   bool loadWeights(uint32_t weightsCount,
                    const onnxTensorDescriptorV1 *weightDescriptors);
 
-  /// Mapping between ONNX names for inputs and actual Glow input vars.
-  llvm::StringMap<Variable *> onnxNameToInputVars_;
+  /// Mapping between ONNX names for inputs and Glow input placeholders.
+  llvm::StringMap<Placeholder *> onnxNameToInputPlaceholders_;
+
+  /// Mapping between ONNX names for outputs and Glow output placeholders.
+  llvm::StringMap<Placeholder *> onnxNameToOutputPlaceholders_;
 
 public:
-  /// \returns mapping between ONNX names and actual Glow input vars.
-  const llvm::StringMap<Variable *> &getInputVarsMapping() const {
-    return onnxNameToInputVars_;
+  /// \returns mapping between ONNX names and Glow input placeholders.
+  const llvm::StringMap<Placeholder *> &getInputPlaceholdersMapping() const {
+    return onnxNameToInputPlaceholders_;
   }
 
-  /// \returns mapping between ONNX names and actual Glow output nodes.
-  const llvm::StringMap<Variable *> &getOutputVarsMapping() const {
-    return outputVarsByName_;
+  /// \returns mapping between ONNX names and Glow output placeholders.
+  const llvm::StringMap<Placeholder *> &getOutputPlaceholdersMapping() const {
+    return onnxNameToOutputPlaceholders_;
   }
 
   /// \returns unique pointer to ModelLoader if \p onnxModel can be parsed
@@ -67,6 +75,12 @@ public:
   /// \param onnxModel contains a single ONNX operator.
   static std::vector<std::pair<Kinded::Kind, ElemKind>>
   parseOperator(const void *onnxModel, size_t onnxModelSize);
+
+  /// Estimate the work of the single ONNX operator in \p onnxModel from the
+  /// shapes of its inputs and outputs, and store it in \p cost.
+  /// \returns false if the model cannot be parsed or some shapes are unknown.
+  static bool estimateOperatorCost(const void *onnxModel, size_t onnxModelSize,
+                                   NodeCost &cost);
 };
 
 } // namespace onnxifi
@@ -21,6 +21,7 @@
 #include "glow/Graph/Graph.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/raw_ostream.h"
@@ -38,6 +39,44 @@ namespace glow {
 /// Returns true iff all elements of \p a are the same.
 bool isArrayConstant(const llvm::ArrayRef<size_t> a);
 
+/// Invoke \p fn on every index in [0, \p numItems) in parallel, on up to one
+/// thread per core. A thread claims the next unprocessed index whenever it is
+/// done with the previous one, so items of very different costs, such as the
+/// weights of a model, are balanced across the threads. \p fn must be safe to
+/// invoke concurrently for different indices.
+void parallelForEachItem(size_t numItems,
+                         llvm::function_ref<void(size_t)> fn);
+
+/// The following helpers evaluate operators of a model whose inputs are all
+/// known while loading, such as the Shape->Gather->Concat->Reshape chains that
+/// exporters emit to compute the shapes of Reshapes. Each returns a new tensor
+/// with the result, or nullptr if it does not support the element types or the
+/// shapes of its inputs, in which case the operator is loaded as a node.
+
+/// \returns a copy of \p T with the shape \p dims, which must have as many
+/// elements as \p T.
+Tensor *foldReshape(const Tensor &T, llvm::ArrayRef<size_t> dims);
+
+/// \returns \p T without the dimensions of size 1 at \p axes.
+Tensor *foldSqueeze(const Tensor &T, llvm::ArrayRef<size_t> axes);
+
+/// \returns \p T with dimensions of size 1 inserted at \p axes, which are the
+/// positions of the new dimensions in the result.
+Tensor *foldExpandDims(const Tensor &T, llvm::ArrayRef<size_t> axes);
+
+/// \returns the slices of \p data along \p axis that the Int64ITy \p indices
+/// select. Negative indices count from the end of the axis.
+Tensor *foldGather(const Tensor &data, const Tensor &indices, size_t axis);
+
+/// \returns the concatenation of \p inputs along \p axis.
+Tensor *foldConcat(llvm::ArrayRef<const Tensor *> inputs, size_t axis);
+
+/// \returns the element-wise Add, Sub, Mul or Div \p typeName of the FloatTy
+/// or Int64ITy tensors \p LHS and \p RHS, which must have the same shape
+/// unless one of them has a single element.
+Tensor *foldArithmetic(llvm::StringRef typeName, const Tensor &LHS,
+                       const Tensor &RHS);
+
 /// Prints a single serialized protocol buffer node. This method is useful for
 /// debugging the network and printing errors.
 template <typename T>
@@ -104,6 +143,16 @@ protected:
   /// \returns the tensor that was registered under the name \p name.
   Tensor *getTensorByName(llvm::StringRef name);
 
+  /// \returns the tensor registered under \p name if the value of \p name is
+  /// known while loading, i.e. it is a weight, a constant or the result of a
+  /// folded operator. Otherwise \returns nullptr.
+  Tensor *getConstantByNameOrNull(llvm::StringRef name) const;
+
+  /// Registers \p T, which the loader takes ownership of, as the value of
+  /// \p name, replacing any tensor or node registered under \p name. A
+  /// Variable for it is only created once a node of the graph reads it.
+  void registerConstant(llvm::StringRef name, Tensor *T);
+
   /// Create a new variable \p name initialized with \p tensor.
   /// \returns The newly created variable.
   /// \pre !hasNodeByName(name)
@@ -151,6 +200,11 @@ public:
     return outputVarsByName_.begin()->second;
   }
 
+  /// \returns the Variables of all of the external outputs, by name.
+  const llvm::StringMap<Variable *> &getOutputs() const {
+    return outputVarsByName_;
+  }
+
   /// \returns the Variable for the external output with \p name.
   /// \pre outputVarsByName_.find(name) != outputVarsByName_.end()
   Variable *getOutputByName(llvm::StringRef name) const;
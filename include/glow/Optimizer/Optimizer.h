@@ -30,11 +30,41 @@ enum class CompilationMode {
          /// changes the graph in a way that is not reversible.
 };
 
+/// The strategies for ordering the nodes of a graph before IRGen.
+enum class SchedulerKind {
+  /// Schedule first the children that free more memory after their
+  /// computation.
+  ChildMemSize,
+  /// Minimize the peak memory usage by reordering small windows of the
+  /// ChildMemSize schedule optimally.
+  MinPeakMemory,
+  /// Keep shape compatible data parallel nodes together, so that their
+  /// instructions can be fused into a single kernel.
+  DataParallel,
+  /// Schedule the consumers of a value right after its producer.
+  CacheLocality,
+};
+
 /// Perform optimizations on the IR representation.
 void optimize(IRFunction &M, bool shouldShareBuffers);
 /// Perform optimizations on the graph representation.
 void optimize(Function *F, CompilationMode mode);
 
+/// Remove redundant Quantize, Dequantize and RescaleQuantized nodes from \p F.
+/// Conversions are sunk through layout operations (Reshape, Transpose, Slice
+/// and Concat) so that the ones around floating-point regions of a partially
+/// quantized function can cancel out or merge into a single rescale.
+/// \returns the number of conversion nodes that were removed.
+unsigned optimizeQuantizationConversions(Function *F);
+
+/// Choose the layout of the regions of layout agnostic nodes of \p F, such as
+/// elementwise operations, batch normalization and concat, so that the
+/// fewest transposes are needed between them and the layout specific nodes.
+/// The backends express their layout preference by wrapping the nodes they
+/// implement in another layout in transposes; this pass removes the ones that
+/// local sinking can't. \returns the number of transposes that were removed.
+unsigned assignLayouts(Function *F, CompilationMode mode);
+
 /// Lower the high-level neural network operators into low-level linear algebra
 /// operators.
 void lower(Function *F, const Backend &B);
@@ -42,13 +72,17 @@ void lower(Function *F, const Backend &B);
 /// Instrument function \p F by inserting quantization profile nodes
 /// for capturing stats for quantization. The new quantized function is called
 /// \p newFuncName. If no name is given the method will generate a name.
+/// The recurrent cells and units are also profiled expanded, as
+/// quantizeFunction quantizes their gates.
 /// \returns a new function with the added quantization nodes.
 Function *profileQuantization(Function *F, llvm::StringRef newFuncName = "");
 
 /// Helper to generate and optimize IR from given Function \p F. \p
 /// shouldShareBuffers signifies whether to use the share buffers optimization.
-std::unique_ptr<IRFunction> generateAndOptimizeIR(Function *F,
-                                                  bool shouldShareBuffers);
+/// The nodes of \p F are ordered by a scheduler of kind \p schedulerKind.
+std::unique_ptr<IRFunction> generateAndOptimizeIR(
+    Function *F, bool shouldShareBuffers,
+    SchedulerKind schedulerKind = SchedulerKind::ChildMemSize);
 
 } // namespace glow
 
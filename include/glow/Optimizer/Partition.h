@@ -20,6 +20,9 @@
 
 #include <llvm/ADT/DenseMap.h>
 
+#include <functional>
+#include <vector>
+
 namespace glow {
 
 /// Maps a set of functions to the set of functions it depends on.  The
@@ -73,9 +76,57 @@ public:
   bool verify() const;
 };
 
-/// Split an input Function into a FunctionDAG.
+/// Split an input Function into a FunctionDAG. The tensors that flow between
+/// the functions of the DAG are passed through placeholders.
 FunctionDAG partition(Function *F);
 
+/// Maps a node to the index of the device that should execute it.
+using DeviceOfNodeFn = std::function<unsigned(const Node *N)>;
+
+/// Split an input Function \p F into islands of nodes that execute on the
+/// same device, as given by \p deviceOf. A node belongs to the earliest
+/// island of its device that comes after all of the islands of its inputs on
+/// other devices, so the islands of different devices that do not depend on
+/// each other can run concurrently. \p devices receives the device of every
+/// function of the returned FunctionDAG, in order.
+FunctionDAG partitionByDevice(Function *F, const DeviceOfNodeFn &deviceOf,
+                              std::vector<unsigned> &devices);
+
+/// The estimated amount of work performed by a node.
+struct NodeCost {
+  /// The number of arithmetic operations.
+  uint64_t flops{0};
+  /// The number of bytes read from the inputs and written to the results.
+  uint64_t bytes{0};
+};
+
+/// \returns the estimated cost of executing the node \p N.
+NodeCost estimateNodeCost(const Node *N);
+
+/// Parameters of the pipeline partitioner.
+struct PipelineConfig {
+  /// The number of pipeline stages to produce.
+  unsigned numStages{2};
+  /// The maximum number of bytes of weights, inputs and results that a stage
+  /// may use. Zero means that the memory is not limited.
+  uint64_t memoryLimit{0};
+  /// The number of operations a device performs in the time it takes to move
+  /// one byte of memory. This balances the flops and the bytes of a node.
+  uint64_t flopsPerByte{8};
+  /// The fraction by which the slowest stage may exceed the best achievable
+  /// one in exchange for smaller tensors flowing between the stages.
+  float balanceTolerance{0.1};
+};
+
+/// Split an input Function \p F into a linear pipeline of contiguous stages
+/// of similar estimated cost, as described by \p config. Every stage stays
+/// under the memory limit and the cuts between stages carry as few bytes as
+/// the balance allows. A node that alone exceeds the limit gets a stage of its
+/// own, and if the stages cannot all stay under the limit, a warning is
+/// printed and the limit is ignored. \returns the FunctionDAG of the stages,
+/// in pipeline order.
+FunctionDAG partitionPipeline(Function *F, const PipelineConfig &config);
+
 } // namespace glow
 
 #endif // GLOW_OPTIMIZER_PARTITION_H
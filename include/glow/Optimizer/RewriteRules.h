@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_OPTIMIZER_REWRITERULES_H
+#define GLOW_OPTIMIZER_REWRITERULES_H
+
+#include "glow/Graph/Graph.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Casting.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace glow {
+
+/// A rewrite rule replaces the nodes of one kind that match its predicate
+/// with a new node. The first result of the matched node is replaced with the
+/// first result of the node that the rule returns, and the matched node is
+/// left to DCE.
+struct RewriteRule {
+  /// \returns true if the rule applies to the node.
+  using Predicate = std::function<bool(const Node *)>;
+  /// \returns the node that replaces the node, or nullptr if the rule decided
+  /// not to apply after all.
+  using Replacement = std::function<Node *(Node *, Function *)>;
+
+  /// The name of the rule.
+  std::string name;
+  /// The kind of the nodes that the rule applies to.
+  Kinded::Kind kind;
+  /// The condition that the node must satisfy. Always true if empty.
+  Predicate predicate;
+  /// Creates the node that replaces the matched node.
+  Replacement replacement;
+};
+
+/// A set of rewrite rules, which backends build once and apply to their
+/// functions in transformPreLowering or transformPostLowering. The rules of a
+/// kind are tried in the order they were added, and the first that returns a
+/// node wins.
+class RewriteRuleSet {
+  /// The rules, indexed by the kind that they apply to.
+  std::vector<std::vector<RewriteRule>> rules_;
+
+public:
+  /// Adds the rule \p rule.
+  RewriteRuleSet &add(RewriteRule rule);
+
+  /// Adds the rule \p name, which replaces the nodes of kind \p kind that
+  /// satisfy \p predicate with the result of \p replace. NodeTy is the class
+  /// of the nodes of kind \p kind.
+  template <class NodeTy>
+  RewriteRuleSet &add(Kinded::Kind kind, llvm::StringRef name,
+                      std::function<Node *(NodeTy *, Function *)> replace,
+                      RewriteRule::Predicate predicate = nullptr) {
+    return add(RewriteRule{name, kind, std::move(predicate),
+                           [replace](Node *N, Function *F) {
+                             return replace(llvm::cast<NodeTy>(N), F);
+                           }});
+  }
+
+  /// \returns the rules that apply to the nodes of kind \p kind.
+  llvm::ArrayRef<RewriteRule> getRules(Kinded::Kind kind) const;
+
+  /// \returns the number of rules in the set.
+  size_t size() const;
+
+  /// Applies the rules to the nodes of \p F once, in the order of the nodes
+  /// in the function. The nodes created by the rules are at the end of the
+  /// list, and so are visited as well, which lets a rule match the result of
+  /// another. \returns true if any node was replaced.
+  bool apply(Function *F) const;
+};
+
+/// Predicates for the rules.
+namespace rewrite {
+
+/// \returns a predicate that holds if all of \p predicates hold.
+RewriteRule::Predicate allOf(std::vector<RewriteRule::Predicate> predicates);
+
+/// \returns a predicate that holds if the first result of the node has the
+/// element type \p elemTy.
+RewriteRule::Predicate hasElemType(ElemKind elemTy);
+
+/// \returns a predicate that holds if the first result of the node is
+/// quantized.
+RewriteRule::Predicate isQuantized();
+
+/// \returns a predicate that holds if the node has a single user.
+RewriteRule::Predicate hasSingleUser();
+
+/// \returns a predicate that holds if the input \p idx of the node is the
+/// result of a node of kind \p kind.
+RewriteRule::Predicate inputIs(unsigned idx, Kinded::Kind kind);
+
+} // namespace rewrite
+
+} // namespace glow
+
+#endif // GLOW_OPTIMIZER_REWRITERULES_H
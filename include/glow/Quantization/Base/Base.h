@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
 #include <limits>
 
@@ -68,13 +69,15 @@ enum Schema {
   SymmetricWithUInt8,
 };
 
-/// Converts floating point value to int8 based on the quantization
-/// parameters \p TQP.
-int8_t quantize(float input, const TensorQuantizationParams &TQP);
-
-/// Converts int8 quantized value back to floating point number based on
-/// the quantization parameters \p TQP.
-float dequantize(int8_t input, const TensorQuantizationParams &TQP);
+enum Calibration {
+  /// Use the profiled minimum and maximum as the quantization range.
+  MinMax,
+  /// Clip the profiled range to the one minimizing the Kullback-Leibler
+  /// divergence between the profiled histogram and its quantized version.
+  /// This trades the precision of rare outliers for the precision of the bulk
+  /// of the distribution.
+  KLMinimization,
+};
 
 /// \returns the value \p in as clipped to the range of \p DestTy.
 template <class SrcTy, class DestTy> DestTy clip(SrcTy in) {
@@ -85,6 +88,21 @@ template <class SrcTy, class DestTy> DestTy clip(SrcTy in) {
   return std::max<SrcTy>(mn, std::min<SrcTy>(mx, in));
 }
 
+/// Converts floating point value to \p DestTy (int8 by default) based on the
+/// quantization parameters \p TQP.
+template <class DestTy = int8_t>
+inline DestTy quantize(float input, const TensorQuantizationParams &TQP) {
+  float result = input / TQP.scale + TQP.offset;
+  return quantization::clip<int32_t, DestTy>((int32_t)nearbyintf(result));
+}
+
+/// Converts quantized value back to floating point number based on the
+/// quantization parameters \p TQP.
+template <class SrcTy>
+inline float dequantize(SrcTy input, const TensorQuantizationParams &TQP) {
+  return TQP.scale * (input - TQP.offset);
+}
+
 /// Convert the floating point quantization parameters \p scale and \p offset
 /// into the integer sequence of:
 /// result = ((input >> pre) * scale) >> post + offset.
@@ -36,6 +36,27 @@ void generateTensorHistogram(const Handle<float> inputTensor,
                              Handle<float> existingHistogram, float &min,
                              float &max);
 
+/// Merge the histogram \p srcHistogram, which covers the range
+/// [\p srcMin, \p srcMax], into \p destHistogram, which covers the range
+/// [\p destMin, \p destMax]. Both histograms are redistributed over the union
+/// of their ranges before their counts are added, so profiles gathered on
+/// separate batches or processes can be combined. \p destMin and \p destMax
+/// are updated to the merged range.
+void mergeTensorHistograms(Handle<float> srcHistogram, float srcMin,
+                           float srcMax, Handle<float> destHistogram,
+                           float &destMin, float &destMax);
+
+/// Search for the sub-range of [\p min, \p max], the range covered by
+/// \p histogram, that minimizes the Kullback-Leibler divergence between the
+/// distribution of \p histogram clipped to that sub-range and its
+/// approximation with \p numQuantizedBins quantization levels. The upper
+/// bound is selected first and the lower bound second, one bin at a time.
+/// The selected range always contains zero. \returns the selected range as
+/// a pair (min, max).
+std::pair<float, float> optimizeKLRange(const Handle<float> histogram,
+                                        float min, float max,
+                                        size_t numQuantizedBins = 255);
+
 } // namespace quantization
 } // namespace glow
 
@@ -50,13 +50,60 @@ struct NodeQuantizationInfo {
   }
 };
 
+/// Raw profile of a given node output: the range and the histogram of the
+/// values seen so far. Unlike NodeQuantizationInfo, profiles gathered on
+/// different inputs or processes can be merged.
+struct NodeProfilingInfo {
+  std::string nodeOutputName_;
+  float min_{0};
+  float max_{0};
+  std::vector<float> histogram_;
+
+  NodeProfilingInfo() = default;
+  NodeProfilingInfo(const std::string &nodeOutputName, float min, float max,
+                    std::vector<float> histogram)
+      : nodeOutputName_(nodeOutputName), min_(min), max_(max),
+        histogram_(std::move(histogram)) {}
+};
+
+/// The precision of a node of a function, as chosen by a mixed precision
+/// policy: FloatTy keeps the node in float, and Int8QTy or Int16QTy quantize
+/// it to 8 or 16 bits.
+struct NodePrecisionInfo {
+  std::string nodeName_;
+  ElemKind precision_{ElemKind::Int8QTy};
+
+  NodePrecisionInfo() = default;
+  NodePrecisionInfo(const std::string &nodeName, ElemKind precision)
+      : nodeName_(nodeName), precision_(precision) {}
+};
+
 namespace quantization {
 
 /// Generate NodeQuantizationInfo for all required nodes from graph \p G
-/// using the method specified by \p schema.
+/// using the method specified by \p schema. The quantization range of every
+/// node is selected with \p calibration.
 std::vector<NodeQuantizationInfo>
 generateNodeQuantizationInfos(const Function *F,
-                              Schema schema = Schema::Asymmetric);
+                              Schema schema = Schema::Asymmetric,
+                              Calibration calibration = Calibration::MinMax);
+
+/// Generate NodeQuantizationInfo from the raw profiles \p profilingInfos
+/// using the method specified by \p schema. The quantization range of every
+/// node is selected with \p calibration.
+std::vector<NodeQuantizationInfo>
+generateNodeQuantizationInfos(llvm::ArrayRef<NodeProfilingInfo> profilingInfos,
+                              Schema schema = Schema::Asymmetric,
+                              Calibration calibration = Calibration::MinMax);
+
+/// Collect the raw profiles captured by the QuantizationProfile nodes of \p F.
+std::vector<NodeProfilingInfo> generateNodeProfilingInfos(const Function *F);
+
+/// Merge the raw profiles \p src into \p dest. Profiles of the same node
+/// output have their ranges and histograms combined; profiles that only exist
+/// in \p src are appended to \p dest.
+void mergeNodeProfilingInfos(std::vector<NodeProfilingInfo> &dest,
+                             llvm::ArrayRef<NodeProfilingInfo> src);
 
 /// Quantizes the function \p F into a new unoptimized partially quantized
 /// function based on \p quantizationInfos. This method converts to integer as
@@ -66,12 +113,45 @@ generateNodeQuantizationInfos(const Function *F,
 /// cleaning up/erasing original function \p F if needed. Any nodes of kinds
 /// contained in \p doNotQuantizeKinds will not be quantized, even if a profile
 /// was gathered for them and the backend supports the quantized operation.
+/// If \p enableChannelwise is set, convolutions with constant filters are
+/// quantized with a separate scale and offset for every output channel,
+/// provided the backend supports ChannelwiseQuantizedConvolution.
+/// Nodes of kinds contained in \p int16Kinds are quantized to Int16QTy
+/// instead of Int8QTy when the backend supports it, for accuracy-sensitive
+/// layers such as the fully connected layers of recurrent networks.
+/// Unless Concat is in \p doNotQuantizeKinds, the inputs of every Concat are
+/// produced with the parameters of the Concat when that loses at most one bit
+/// of precision, so that they need no rescale.
+/// The precisions of \p nodePrecisions, keyed by the names of the nodes of
+/// \p F, take precedence over \p doNotQuantizeKinds and \p int16Kinds.
+/// The recurrent cells and units to quantize that the backend does not support
+/// in Int8QTy are expanded first, so that their gates are quantized, with the
+/// profiles that profileQuantization gathers for them.
 /// \returns a new quantized function.
 Function *
 quantizeFunction(const ExecutionEngine &EE,
                  llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
                  Function *F, llvm::StringRef newFuncName = "",
-                 const KindSet &doNotQuantizeKinds = {});
+                 const KindSet &doNotQuantizeKinds = {},
+                 bool enableChannelwise = false,
+                 const KindSet &int16Kinds = {},
+                 llvm::ArrayRef<NodePrecisionInfo> nodePrecisions = {});
+
+/// Quantizes only the weights of the fully connected layers of \p F, which
+/// needs no profile. Every FullyConnected whose weights are a private float
+/// variable is replaced in place by a RowwiseQuantizedFullyConnected, whose
+/// int8 weights have a separate scale and offset for every output column,
+/// provided the backend of \p EE supports it. The activations stay float, so
+/// the resulting function can only be used for inference. \returns the
+/// number of layers whose weights were quantized.
+unsigned quantizeWeightsOnly(const ExecutionEngine &EE, Function *F);
+
+/// Same as quantizeWeightsOnly, but the fully connected layers are replaced
+/// by DynamicQuantizedFullyConnected nodes, which also quantize their inputs
+/// to int8 at runtime with the range of the actual values, and multiply in
+/// integer arithmetic. This suits models whose activation ranges vary too
+/// much between inputs for a static profile.
+unsigned quantizeDynamically(const ExecutionEngine &EE, Function *F);
 
 } // namespace quantization
 } // namespace glow
@@ -30,6 +30,26 @@ void serializeToYaml(llvm::StringRef fileName,
 /// Deserialize quantization infos from the file \p fileName.
 std::vector<NodeQuantizationInfo> deserializeFromYaml(llvm::StringRef fileName);
 
+/// Serialize the raw profiles \p profilingInfos into the file named
+/// \p fileName. Unlike quantization infos, raw profiles from several files
+/// can be merged with mergeNodeProfilingInfos().
+void serializeProfilingInfosToYaml(
+    llvm::StringRef fileName,
+    llvm::ArrayRef<NodeProfilingInfo> profilingInfos);
+
+/// Deserialize raw profiles from the file \p fileName.
+std::vector<NodeProfilingInfo>
+deserializeProfilingInfosFromYaml(llvm::StringRef fileName);
+
+/// Serialize the mixed precision policy \p nodePrecisions into the file named
+/// \p fileName.
+void serializePrecisionPolicyToYaml(
+    llvm::StringRef fileName, llvm::ArrayRef<NodePrecisionInfo> nodePrecisions);
+
+/// Deserialize a mixed precision policy from the file \p fileName.
+std::vector<NodePrecisionInfo>
+deserializePrecisionPolicyFromYaml(llvm::StringRef fileName);
+
 } // namespace glow
 
 #endif
@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_ARENA_H
+#define GLOW_SUPPORT_ARENA_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace glow {
+
+/// A bump allocator for many small objects that die together, such as the
+/// nodes and types of a module. Blocks are carved out of large slabs, and the
+/// blocks that are returned with deallocate() are kept on free lists, by size,
+/// for later allocations. All the memory is released at once when the arena is
+/// destroyed, without running any destructor. An arena is not thread safe.
+class Arena final {
+public:
+  /// The size of the slabs that blocks are carved out of.
+  static constexpr size_t slabSize = 64 * 1024;
+  /// The alignment of the recycled blocks, and the granularity of their sizes.
+  static constexpr size_t blockAlignment = 16;
+  /// Blocks up to this size are recycled when they are deallocated.
+  static constexpr size_t maxRecycledSize = 1024;
+
+private:
+  /// The slabs, and the blocks that were too large to be put in a slab.
+  std::vector<void *> slabs_;
+  /// The unused part of the current slab.
+  char *cur_{nullptr};
+  char *end_{nullptr};
+  /// The heads of the lists of deallocated blocks. The list i holds the
+  /// blocks of (i + 1) * blockAlignment bytes.
+  std::array<void *, maxRecycledSize / blockAlignment> freeLists_{};
+  /// The number of bytes of the slabs and of the large blocks.
+  size_t bytesAllocated_{0};
+
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  /// \returns a block of \p size bytes aligned to \p alignment.
+  void *allocate(size_t size, size_t alignment = blockAlignment);
+
+  /// Return the block \p p that allocate() returned for \p size bytes and
+  /// \p alignment. Small blocks are reused by later allocations, the other
+  /// ones are only released with the arena.
+  void deallocate(void *p, size_t size, size_t alignment = blockAlignment);
+
+  /// \returns the number of bytes that the arena took from the heap.
+  size_t getBytesAllocated() const { return bytesAllocated_; }
+};
+
+/// Makes an arena the current one of the thread while the scope is alive.
+/// The graph nodes that are created on the thread are allocated from the
+/// current arena, so a scope must only surround the construction of nodes
+/// that are destroyed before the arena. Scopes nest.
+class ArenaScope final {
+  /// The arena that was current when the scope was opened.
+  Arena *prev_;
+
+public:
+  explicit ArenaScope(Arena *arena);
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope &operator=(const ArenaScope &) = delete;
+  ~ArenaScope();
+
+  /// \returns the current arena of the thread, or nullptr if there is none.
+  static Arena *getCurrent();
+};
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_ARENA_H
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_BFLOAT16_H
+#define GLOW_SUPPORT_BFLOAT16_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace glow {
+
+/// \returns the bfloat16 encoding of \p value, i.e. the upper half of the
+/// float, rounded to the nearest representable value (ties to even). bfloat16
+/// has the exponent range of float, so only NaNs need special care: they stay
+/// quiet NaNs.
+inline uint16_t floatToBFloat16Bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  // A carry out of the mantissa correctly bumps the exponent, and rounds the
+  // largest finite values up to infinity.
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+/// \returns the float value of the bfloat16 encoding \p bits. The conversion
+/// is exact.
+inline float bfloat16BitsToFloat(uint16_t bits) {
+  uint32_t result = uint32_t(bits) << 16;
+  float value;
+  memcpy(&value, &result, sizeof(value));
+  return value;
+}
+
+/// A 16-bit brain floating point number: a float with the mantissa truncated
+/// to 7 bits. This is a storage type: the value converts implicitly to and
+/// from float and all arithmetic is performed in single precision.
+class bfloat16 {
+  /// The bfloat16 encoding of the value.
+  uint16_t bits_{0};
+
+public:
+  bfloat16() = default;
+
+  /// Initialize the value by rounding \p value to bfloat16.
+  bfloat16(float value) : bits_(floatToBFloat16Bits(value)) {}
+
+  /// \returns the value as a float.
+  operator float() const { return bfloat16BitsToFloat(bits_); }
+
+  /// \returns the bfloat16 encoding of the value.
+  uint16_t getBits() const { return bits_; }
+
+  /// \returns the value whose bfloat16 encoding is \p bits.
+  static bfloat16 fromBits(uint16_t bits) {
+    bfloat16 value;
+    value.bits_ = bits;
+    return value;
+  }
+
+  bfloat16 &operator+=(float other) { return *this = float(*this) + other; }
+  bfloat16 &operator-=(float other) { return *this = float(*this) - other; }
+  bfloat16 &operator*=(float other) { return *this = float(*this) * other; }
+  bfloat16 &operator/=(float other) { return *this = float(*this) / other; }
+};
+
+static_assert(sizeof(bfloat16) == 2, "bfloat16 must be 16 bits wide");
+
+/// The element type of BFloat16Ty tensors.
+using bfloat16_t = bfloat16;
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_BFLOAT16_H
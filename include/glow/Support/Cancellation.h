@@ -0,0 +1,102 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_CANCELLATION_H
+#define GLOW_SUPPORT_CANCELLATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace glow {
+
+/// Tells the runs that it is passed to to stop early, either when cancel() is
+/// called, e.g. by the thread that gave up on their results, or when their
+/// deadline passes. The runs check it between their instructions, so a run
+/// that has missed its deadline does not keep the cores busy. The token may
+/// be cancelled from any thread.
+class CancellationToken {
+  /// Set by cancel().
+  std::atomic<bool> cancelled_{false};
+  /// The deadline in nanoseconds of the steady clock, or 0 if there is none.
+  std::atomic<int64_t> deadlineNs_{0};
+  /// The token whose cancellation cancels this one too, if any.
+  const CancellationToken *parent_{nullptr};
+
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Create a token that is also cancelled when \p parent is, e.g. the token
+  /// of a request with its own deadline but which is dropped with the others
+  /// when its client goes away. \p parent must outlive the token.
+  explicit CancellationToken(const CancellationToken *parent = nullptr)
+      : parent_(parent) {}
+
+  /// Create a token whose deadline is \p timeout from now.
+  explicit CancellationToken(Clock::duration timeout) { setTimeout(timeout); }
+
+  /// Cancel the runs that use this token.
+  void cancel() { cancelled_ = true; }
+
+  /// Set the deadline of the runs to \p deadline.
+  void setDeadline(Clock::time_point deadline) {
+    deadlineNs_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      deadline.time_since_epoch())
+                      .count();
+  }
+
+  /// Set the deadline of the runs to \p timeout from now.
+  void setTimeout(Clock::duration timeout) {
+    setDeadline(Clock::now() + timeout);
+  }
+
+  /// \returns true if the token was cancelled or its deadline has passed, or
+  /// if that is the case of its parent.
+  bool isCancelled() const;
+};
+
+/// Make \p token the token of the runs on the calling thread for the lifetime
+/// of the object, see shouldStopRun().
+class ScopedCancellation {
+  /// The token of the runs.
+  const CancellationToken &token_;
+  /// The scope that was current before.
+  ScopedCancellation *previous_;
+  /// Whether a run stopped early because of the token.
+  bool stopped_{false};
+
+  friend bool shouldStopRun();
+
+public:
+  explicit ScopedCancellation(const CancellationToken &token);
+  ~ScopedCancellation();
+
+  /// \returns true if a run of the scope stopped before it was complete, in
+  /// which case its results are undefined.
+  bool hasStopped() const { return stopped_; }
+
+  ScopedCancellation(const ScopedCancellation &) = delete;
+  ScopedCancellation &operator=(const ScopedCancellation &) = delete;
+};
+
+/// \returns true if the run executing on the calling thread should stop,
+/// because the token of the current ScopedCancellation is cancelled, and
+/// records it in the scope. \returns false if there is no such scope. The
+/// executors call it between the instructions of a run.
+bool shouldStopRun();
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_CANCELLATION_H
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_COMPILEREPORT_H
+#define GLOW_SUPPORT_COMPILEREPORT_H
+
+#include "glow/Support/Trace.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace glow {
+
+/// The statistics of the compilation of a function: the wall time of its
+/// phases, the size of the code before and after each of them, and the memory
+/// the compiled code needs.
+class CompileReport {
+public:
+  /// A phase of the compilation.
+  struct Phase {
+    /// The name of the phase, e.g. "lower" or "IRGen".
+    std::string name;
+    /// The wall time of the phase in seconds.
+    double seconds;
+    /// What the sizes count, e.g. "nodes" or "instructions". It is empty if
+    /// the phase does not transform countable code.
+    std::string unit;
+    /// The number of nodes or instructions before the phase.
+    size_t sizeBefore;
+    /// The number of nodes or instructions after the phase.
+    size_t sizeAfter;
+  };
+
+  /// An amount of memory computed by a memory allocator.
+  struct Memory {
+    /// The name of the memory area, e.g. "Activations".
+    std::string name;
+    /// The peak usage of the area in bytes.
+    uint64_t bytes;
+  };
+
+  /// Append the phase \p phase.
+  void addPhase(Phase phase) { phases_.push_back(std::move(phase)); }
+
+  /// Record that the area \p name needs \p bytes.
+  void addMemoryUsage(llvm::StringRef name, uint64_t bytes) {
+    memory_.push_back({name, bytes});
+  }
+
+  /// \returns the phases in the order they ran.
+  const std::vector<Phase> &getPhases() const { return phases_; }
+
+  /// \returns the memory areas in the order they were allocated.
+  const std::vector<Memory> &getMemoryUsage() const { return memory_; }
+
+  /// Set the wall time of the whole compilation to \p seconds. It includes
+  /// the time spent outside of the phases.
+  void setTotalSeconds(double seconds) { totalSeconds_ = seconds; }
+
+  /// \returns the wall time of the whole compilation in seconds, or the sum
+  /// of the times of the phases if it was not set.
+  double getTotalSeconds() const;
+
+  /// Forget the phases and the memory areas.
+  void clear();
+
+  /// Print the report to \p os.
+  void dump(llvm::raw_ostream &os) const;
+
+  /// Print the report to llvm::outs().
+  void dump() const;
+
+private:
+  std::vector<Phase> phases_;
+  std::vector<Memory> memory_;
+  /// The wall time of the whole compilation, or 0 if it is unknown.
+  double totalSeconds_{0};
+};
+
+/// \returns the report that the compilation running on the calling thread
+/// fills in, or nullptr if none was set by a CompileReportScope.
+CompileReport *getCurrentCompileReport();
+
+/// Make \p report the report of the compilations running on the calling thread
+/// for the lifetime of the object.
+class CompileReportScope {
+  /// The report that was current before.
+  CompileReport *previous_;
+
+public:
+  explicit CompileReportScope(CompileReport &report);
+  ~CompileReportScope();
+
+  CompileReportScope(const CompileReportScope &) = delete;
+  CompileReportScope &operator=(const CompileReportScope &) = delete;
+};
+
+/// Adds a phase that lasts from the construction to the destruction of the
+/// object to the current compile report, and to the trace. \p size, if given,
+/// counts the \p unit of the code at both ends of the phase.
+class ScopedCompilePhase {
+  /// The size of the code.
+  std::function<size_t()> size_;
+  /// The phase being filled in.
+  CompileReport::Phase phase_;
+  /// The report, or nullptr if there is none.
+  CompileReport *report_;
+  /// The start of the phase.
+  std::chrono::steady_clock::time_point begin_;
+  /// The event of the phase on the trace.
+  ScopedTraceEvent trace_;
+
+public:
+  ScopedCompilePhase(llvm::StringRef name, llvm::StringRef unit = "",
+                     std::function<size_t()> size = nullptr);
+  ~ScopedCompilePhase();
+
+  ScopedCompilePhase(const ScopedCompilePhase &) = delete;
+  ScopedCompilePhase &operator=(const ScopedCompilePhase &) = delete;
+};
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_COMPILEREPORT_H
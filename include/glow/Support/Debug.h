@@ -46,6 +46,20 @@ extern bool DebugFlag;
 /// '-debug-glow' or '-debug-glow-only'.
 #define DEBUG_GLOW(X) DEBUG_GLOW_WITH_TYPE(DEBUG_TYPE, X)
 
+/// How often the graph and the IR are verified during the compilation.
+enum class VerificationLevel {
+  /// Never verify them.
+  None,
+  /// Verify them at the boundaries of the compilation: before and after the
+  /// optimizations, and after the generation of the IR.
+  Boundaries,
+  /// Also verify the graph after every pass of the graph optimizer.
+  Passes,
+};
+
+/// Set by the '-verify-level' command line option.
+extern VerificationLevel VerifyLevel;
+
 } // namespace glow
 
 #endif // GLOW_SUPPORT_DEBUG_H
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_FLOAT16_H
+#define GLOW_SUPPORT_FLOAT16_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace glow {
+
+/// \returns the IEEE 754 half-precision encoding of \p value, rounded to the
+/// nearest representable value (ties to even). Values beyond the half-precision
+/// range become infinities and NaNs stay NaNs.
+inline uint16_t floatToHalfBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t abs = bits & 0x7fffffff;
+
+  // Infinity and NaN. Keep NaNs quiet.
+  if (abs >= 0x7f800000) {
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  // 65520 and above round to infinity.
+  if (abs >= 0x477ff000) {
+    return sign | 0x7c00;
+  }
+  // Values below 2^-14 are subnormal halves, whose unit is 2^-24. The scaling
+  // is exact and the rounding uses the nearest-even mode of the FPU.
+  if (abs < 0x38800000) {
+    float absValue;
+    memcpy(&absValue, &abs, sizeof(absValue));
+    return sign | (uint16_t)std::nearbyint(absValue * 16777216.0f);
+  }
+  // Normal values: round the mantissa to 10 bits and rebias the exponent from
+  // 127 to 15. A carry out of the mantissa correctly bumps the exponent.
+  abs += 0xfff + ((abs >> 13) & 1);
+  return sign | (uint16_t)((abs - 0x38000000) >> 13);
+}
+
+/// \returns the float value of the IEEE 754 half-precision encoding \p bits.
+/// The conversion is exact.
+inline float halfBitsToFloat(uint16_t bits) {
+  uint32_t sign = uint32_t(bits & 0x8000) << 16;
+  uint32_t exp = (bits >> 10) & 0x1f;
+  uint32_t mant = bits & 0x3ff;
+
+  uint32_t result;
+  if (exp == 0x1f) {
+    // Infinity and NaN.
+    result = sign | 0x7f800000 | (mant << 13);
+  } else if (exp == 0) {
+    // Zero and subnormals.
+    float value = std::ldexp(float(mant), -24);
+    return sign ? -value : value;
+  } else {
+    result = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+  float value;
+  memcpy(&value, &result, sizeof(value));
+  return value;
+}
+
+/// A 16-bit IEEE 754 half-precision floating point number. This is a storage
+/// type: the value converts implicitly to and from float and all arithmetic
+/// is performed in single precision.
+class float16 {
+  /// The half-precision encoding of the value.
+  uint16_t bits_{0};
+
+public:
+  float16() = default;
+
+  /// Initialize the value by rounding \p value to half precision.
+  float16(float value) : bits_(floatToHalfBits(value)) {}
+
+  /// \returns the value as a float.
+  operator float() const { return halfBitsToFloat(bits_); }
+
+  /// \returns the half-precision encoding of the value.
+  uint16_t getBits() const { return bits_; }
+
+  /// \returns the value whose half-precision encoding is \p bits.
+  static float16 fromBits(uint16_t bits) {
+    float16 value;
+    value.bits_ = bits;
+    return value;
+  }
+
+  float16 &operator+=(float other) { return *this = float(*this) + other; }
+  float16 &operator-=(float other) { return *this = float(*this) - other; }
+  float16 &operator*=(float other) { return *this = float(*this) * other; }
+  float16 &operator/=(float other) { return *this = float(*this) / other; }
+};
+
+static_assert(sizeof(float16) == 2, "float16 must be 16 bits wide");
+
+/// The element type of Float16Ty tensors.
+using float16_t = float16;
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_FLOAT16_H
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_HUGEPAGES_H
+#define GLOW_SUPPORT_HUGEPAGES_H
+
+#include <cstddef>
+
+namespace glow {
+
+/// How a large block of memory is backed by huge pages, which cover it with
+/// fewer TLB entries than the ordinary pages.
+enum class HugePagePolicy {
+  /// Ordinary pages.
+  None,
+  /// Anonymous memory that the kernel is advised to back with transparent
+  /// huge pages, when it has some.
+  Transparent,
+  /// Pages from the reserved pool of 2MB huge pages.
+  Explicit2MB,
+  /// Pages from the reserved pool of 1GB huge pages.
+  Explicit1GB,
+};
+
+/// \returns the size of the pages of \p policy. The transparent huge pages
+/// are 2MB.
+size_t getHugePageSize(HugePagePolicy policy);
+
+/// Map an anonymous block of \p size bytes backed as \p policy tells, which
+/// is not None. An explicit policy falls back to the smaller explicit pages
+/// and then to the transparent ones when the reserved pool is exhausted.
+/// \returns the block, which is aligned to the size of its pages, or null if
+/// no mapping could be made. \p used receives the policy that was applied.
+void *mapHugePages(size_t size, HugePagePolicy policy, HugePagePolicy &used);
+
+/// Unmap the block \p p of \p size bytes that mapHugePages() mapped with the
+/// policy \p used.
+void unmapHugePages(void *p, size_t size, HugePagePolicy used);
+
+/// Advise the kernel to back the part of [\p p, \p p + \p size) that covers
+/// whole huge pages with transparent huge pages. It does nothing on systems
+/// that don't support them.
+void adviseTransparentHugePages(void *p, size_t size);
+
+/// Make the tensor payloads of at least \p minSize bytes that are allocated
+/// from now on aligned to the huge pages and advised to use transparent huge
+/// pages, if \p enable is set. Explicit huge pages are not used for tensors,
+/// which are freed without knowing how they were allocated.
+void setTensorHugePages(bool enable, size_t minSize = size_t(2) << 20);
+
+/// \returns the alignment of a tensor payload of \p size bytes, which is at
+/// least \p alignment, and advises the kernel about the block \p p once it is
+/// allocated, see setTensorHugePages().
+/// @{
+size_t getTensorPayloadAlignment(size_t size, size_t alignment);
+void adviseTensorPayload(void *p, size_t size);
+/// @}
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_HUGEPAGES_H
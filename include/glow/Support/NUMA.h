@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_NUMA_H
+#define GLOW_SUPPORT_NUMA_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <vector>
+
+namespace glow {
+
+/// \returns the number of NUMA nodes of the machine. It is 1 if the machine
+/// is not a NUMA system or if the topology is unknown.
+unsigned getNumNUMANodes();
+
+/// \returns the CPUs that belong to the NUMA node \p node.
+std::vector<unsigned> getCPUsOfNUMANode(unsigned node);
+
+/// \returns the NUMA node of the CPU that runs the calling thread.
+unsigned getCurrentNUMANode();
+
+/// Restrict the calling thread to the CPUs \p cpus. \returns false if the
+/// system does not support thread affinity or rejects the CPU set.
+bool pinCurrentThread(llvm::ArrayRef<unsigned> cpus);
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_NUMA_H
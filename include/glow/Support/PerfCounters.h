@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_PERFCOUNTERS_H
+#define GLOW_SUPPORT_PERFCOUNTERS_H
+
+#include <cstdint>
+
+namespace glow {
+
+/// The hardware performance counters read by readPerfCounters(), in the order
+/// of their values.
+enum class PerfCounter : unsigned {
+  Cycles,
+  Instructions,
+  /// The misses of the last level cache.
+  LLCMisses,
+  /// The floating point operations, as counted by the raw event set with
+  /// setPerfCounterFPEvent().
+  FPOps,
+};
+
+/// The number of counters of PerfCounter.
+constexpr unsigned NumPerfCounters = 4;
+
+/// \returns the name of the counter \p counter.
+const char *getPerfCounterName(PerfCounter counter);
+
+/// Set the raw, model-specific PMU event that counts the floating point
+/// operations to \p config, in the format of perf_event_attr::config. No
+/// portable event counts them. 0 disables the counter. It applies to the
+/// threads that read the counters for the first time after this call.
+void setPerfCounterFPEvent(uint64_t config);
+
+/// Write the values of the counters of the calling thread, in user space, to
+/// \p values. The counters are opened the first time that a thread reads
+/// them. The counters that are unavailable read as 0. \returns false if none
+/// of the counters is available, e.g. on systems other than Linux or when
+/// perf_event_paranoid forbids it.
+bool readPerfCounters(uint64_t values[NumPerfCounters]);
+
+/// \returns whether the counter \p counter could be opened by any of the
+/// threads that read the counters so far.
+bool isPerfCounterAvailable(PerfCounter counter);
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_PERFCOUNTERS_H
@@ -16,6 +16,7 @@
 #ifndef GLOW_SUPPORT_RANDOM_H
 #define GLOW_SUPPORT_RANDOM_H
 
+#include <cstdint>
 #include <random>
 
 namespace glow {
@@ -65,6 +66,41 @@ public:
   static constexpr result_type max() { return Engine::max(); }
 };
 
+/// A counter-based pseudo-random number generator. The number \p n of the
+/// sequence of a key is a hash of the key and of n, so any range of the
+/// sequence can be generated independently of the others, e.g. by the threads
+/// filling the blocks of a tensor, and the numbers do not depend on how the
+/// sequence is split.
+class CounterRNG {
+  uint64_t key_;
+
+public:
+  explicit CounterRNG(uint64_t key) : key_(key) {}
+
+  /// Ctor. The key is drawn from \p PRNG, so the sequence is controlled by
+  /// the "-pseudo-random-seed" command line option.
+  explicit CounterRNG(PseudoRNG &PRNG)
+      : key_((uint64_t(PRNG()) << 32) ^ uint64_t(PRNG())) {}
+
+  /// \returns the 64 random bits number \p n of the sequence. This is the
+  /// SplitMix64 finalizer, which is cheap enough to be vectorized by the
+  /// compiler.
+  uint64_t bits(uint64_t n) const {
+    uint64_t z = key_ + (n + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  /// \returns the number \p n of the sequence as a floating point number
+  /// uniformly distributed in the half-open range [a; b).
+  double nextRandReal(uint64_t n, double a, double b) const {
+    // The top 53 bits make a double in [0; 1).
+    double unit = double(bits(n) >> 11) * (1.0 / double(1ull << 53));
+    return a + unit * (b - a);
+  }
+};
+
 } // namespace glow
 
 #endif // GLOW_SUPPORT_RANDOM_H
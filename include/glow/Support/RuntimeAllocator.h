@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_RUNTIMEALLOCATOR_H
+#define GLOW_SUPPORT_RUNTIMEALLOCATOR_H
+
+#include "glow/Support/HugePages.h"
+
+#include <cstddef>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace glow {
+
+/// The regions of memory that compiled code needs at runtime. They match the
+/// regions described by the configuration of a bundle.
+enum class RuntimeMemoryKind {
+  ConstantWeights, // Weights that the code only reads.
+  MutableWeights,  // Weights that the code reads and writes.
+  Activations,     // Scratch memory of a single execution.
+};
+
+/// The interface of the allocators of the runtime memory of compiled code.
+/// Implementations may place the memory on huge pages, pin it, bind it to a
+/// NUMA node or reuse it. All the methods may be called concurrently.
+class RuntimeAllocator {
+public:
+  virtual ~RuntimeAllocator() = default;
+
+  /// \returns a block of \p size bytes aligned to \p alignment for a region of
+  /// kind \p kind. \p size is not 0.
+  virtual void *allocate(size_t size, size_t alignment,
+                         RuntimeMemoryKind kind) = 0;
+
+  /// Release the block \p p that allocate() returned for the same \p size,
+  /// \p alignment and \p kind.
+  virtual void deallocate(void *p, size_t size, size_t alignment,
+                          RuntimeMemoryKind kind) = 0;
+};
+
+/// Allocates every block from the heap with alignedAlloc().
+class HeapRuntimeAllocator final : public RuntimeAllocator {
+public:
+  void *allocate(size_t size, size_t alignment,
+                 RuntimeMemoryKind kind) override;
+
+  void deallocate(void *p, size_t size, size_t alignment,
+                  RuntimeMemoryKind kind) override;
+};
+
+/// Places the large blocks of each kind of region on huge pages, as the
+/// policy of the kind tells, and takes the other blocks from the upstream
+/// allocator. The policies are set before the allocator is used.
+class HugePageRuntimeAllocator final : public RuntimeAllocator {
+  /// The allocator of the blocks that are not on huge pages.
+  RuntimeAllocator &upstream_;
+  /// The minimum size of the blocks placed on huge pages.
+  size_t minSize_;
+  /// The policy of each kind of region.
+  HugePagePolicy policies_[3]{HugePagePolicy::None, HugePagePolicy::None,
+                              HugePagePolicy::None};
+  /// The policy applied to each mapped block, which may be a fallback of the
+  /// policy of its kind.
+  std::unordered_map<void *, HugePagePolicy> mapped_;
+  /// The number of mapped bytes.
+  size_t mappedBytes_{0};
+  /// Protects the mapped blocks.
+  mutable std::mutex mutex_;
+
+public:
+  /// Create an allocator over \p upstream that maps the blocks of at least
+  /// \p minSize bytes.
+  explicit HugePageRuntimeAllocator(RuntimeAllocator &upstream,
+                                    size_t minSize = size_t(2) << 20)
+      : upstream_(upstream), minSize_(minSize) {}
+
+  /// Dtor. All the blocks must have been deallocated.
+  ~HugePageRuntimeAllocator() override;
+
+  /// Place the large blocks of kind \p kind as \p policy tells.
+  void setPolicy(RuntimeMemoryKind kind, HugePagePolicy policy) {
+    policies_[static_cast<unsigned>(kind)] = policy;
+  }
+
+  /// \returns the policy of the blocks of kind \p kind.
+  HugePagePolicy getPolicy(RuntimeMemoryKind kind) const {
+    return policies_[static_cast<unsigned>(kind)];
+  }
+
+  void *allocate(size_t size, size_t alignment,
+                 RuntimeMemoryKind kind) override;
+
+  void deallocate(void *p, size_t size, size_t alignment,
+                  RuntimeMemoryKind kind) override;
+
+  /// \returns the number of bytes currently mapped on huge pages, or on
+  /// advised ones.
+  size_t getMappedBytes() const;
+};
+
+/// Keeps the activation blocks that are deallocated and hands them out again
+/// for allocations of the same size and alignment, so that repeated
+/// executions of a function don't go to the upstream allocator every time.
+/// The blocks are pooled by the NUMA node of the thread that releases them
+/// and are only reused by threads of the same node. The weights are passed
+/// through to the upstream allocator.
+class PoolRuntimeAllocator final : public RuntimeAllocator {
+  /// The allocator of the memory that is pooled.
+  RuntimeAllocator &upstream_;
+  /// The maximum number of bytes kept in the pool. The blocks that don't fit
+  /// are returned to the upstream allocator.
+  size_t maxPooledBytes_;
+  /// The pooled blocks, by NUMA node, size and alignment.
+  std::map<std::tuple<unsigned, size_t, size_t>, std::vector<void *>> pool_;
+  /// The number of bytes in the pool.
+  size_t pooledBytes_{0};
+  /// The number of activation blocks taken from the upstream allocator.
+  size_t numUpstreamAllocations_{0};
+  /// Protects the state of the pool.
+  mutable std::mutex mutex_;
+
+public:
+  /// Create a pool over \p upstream that keeps up to \p maxPooledBytes.
+  explicit PoolRuntimeAllocator(RuntimeAllocator &upstream,
+                                size_t maxPooledBytes = size_t(256) << 20)
+      : upstream_(upstream), maxPooledBytes_(maxPooledBytes) {}
+
+  /// Dtor. Returns the pooled blocks to the upstream allocator.
+  ~PoolRuntimeAllocator() override;
+
+  void *allocate(size_t size, size_t alignment,
+                 RuntimeMemoryKind kind) override;
+
+  void deallocate(void *p, size_t size, size_t alignment,
+                  RuntimeMemoryKind kind) override;
+
+  /// Return all the pooled blocks to the upstream allocator.
+  void releasePooledMemory();
+
+  /// \returns the number of bytes kept in the pool.
+  size_t getPooledBytes() const;
+
+  /// \returns the number of activation blocks taken from the upstream
+  /// allocator.
+  size_t getNumUpstreamAllocations() const;
+};
+
+/// \returns the allocator that uses the heap.
+RuntimeAllocator &getHeapRuntimeAllocator();
+
+/// \returns the allocator used by the backends when no other is given: a pool
+/// over the heap. It lives until the end of the program.
+RuntimeAllocator &getDefaultRuntimeAllocator();
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_RUNTIMEALLOCATOR_H
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_THREADPOOL_H
+#define GLOW_SUPPORT_THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace glow {
+
+/// The priority class of the parallel loops of a run. The threads of a pool
+/// take the chunks of the latency critical loops before the ones of the batch
+/// loops, so that the interactive models that share a pool with batch jobs
+/// keep their latency.
+enum class RunPriority : unsigned {
+  LatencyCritical = 0,
+  Batch = 1,
+};
+
+/// The number of priority classes.
+constexpr unsigned NumRunPriorities = 2;
+
+/// A pool of persistent worker threads used to split a loop over an iteration
+/// space into chunks and to execute these chunks in parallel.
+///
+/// The thread calling parallelFor() participates in the execution of the
+/// chunks, therefore a pool with N threads owns only N - 1 worker threads.
+/// The workers are created once by the constructor and are parked on a
+/// condition variable between the jobs, so that dispatching a job does not
+/// pay the cost of spawning threads. Several threads may call parallelFor()
+/// at once, e.g. the functions of several engines that share a pool: the
+/// idle workers take the chunks of the pending loops of the highest priority
+/// first, in the order the loops were posted. A chunk may call parallelFor()
+/// on the same pool, since a caller only waits for the chunks of its loop
+/// that other threads already run.
+class ThreadPool {
+public:
+  /// The type of the function executed for each chunk. It processes the
+  /// iterations in the half-open range [begin, end).
+  using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+  /// Create a pool of \p numThreads threads, including the calling thread.
+  /// A value of 0 or 1 creates a pool that executes everything serially on
+  /// the calling thread. If \p cpus is not empty, the worker threads are
+  /// restricted to these CPUs, e.g. to the CPUs of a NUMA node.
+  explicit ThreadPool(unsigned numThreads, std::vector<unsigned> cpus = {});
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// \returns the number of threads executing the chunks, including the
+  /// calling thread.
+  unsigned getNumThreads() const { return workers_.size() + 1; }
+
+  /// Split the iteration space [0, \p numIterations) into at most
+  /// getNumThreads() chunks and invoke \p fn on each of them in parallel.
+  /// Every chunk except the last one contains a multiple of \p minChunkSize
+  /// iterations. The function returns after all chunks have been processed.
+  /// The loop has the priority of the calling thread, see
+  /// getCurrentPriority().
+  void parallelFor(size_t numIterations, size_t minChunkSize,
+                   const RangeFn &fn);
+
+  /// \returns the pool of the process, with a thread per core or
+  /// -shared-thread-pool-threads threads, created on first use.
+  static ThreadPool &getShared();
+
+  /// \returns true if the functions should run their parallel loops on
+  /// getShared() instead of pools of their own, as set by -shared-thread-pool,
+  /// so that the engines of a process do not oversubscribe the cores.
+  static bool isSharedPoolEnabled();
+
+  /// \returns the priority of the loops posted by the calling thread. The
+  /// workers take the priority of the loop whose chunk they run, so that the
+  /// nested loops inherit it.
+  static RunPriority getCurrentPriority();
+
+  /// Set the priority of the loops posted by the calling thread to
+  /// \p priority.
+  static void setCurrentPriority(RunPriority priority);
+
+private:
+  /// A loop posted by parallelFor(). It lives on the stack of the caller.
+  struct Job {
+    /// The function of the loop.
+    const RangeFn *fn;
+    /// The number of iterations of the loop.
+    size_t numIterations;
+    /// The number of iterations in each chunk.
+    size_t chunkSize;
+    /// The number of chunks.
+    size_t numChunks;
+    /// The priority of the loop.
+    RunPriority priority;
+    /// The index of the next unclaimed chunk.
+    size_t nextChunk{0};
+    /// The number of processed chunks.
+    size_t doneChunks{0};
+  };
+
+  /// The main loop of a worker thread, which runs on the CPUs \p cpus or
+  /// anywhere if \p cpus is empty.
+  void workerLoop(const std::vector<unsigned> &cpus);
+
+  /// Claim the next chunk of \p job, and remove the job from its queue once
+  /// all of its chunks are claimed. \returns false if there is none left.
+  /// The caller holds mutex_.
+  bool claimChunk(Job &job, size_t &chunk);
+
+  /// Run the chunk \p chunk of \p job, with the priority of the job, and
+  /// record that it is done.
+  void runChunk(Job &job, size_t chunk);
+
+  /// The worker threads owned by the pool.
+  std::vector<std::thread> workers_;
+  /// Protects the queues and the progress of the jobs.
+  std::mutex mutex_;
+  /// Signalled when a new job is posted or the pool is shutting down.
+  std::condition_variable workCV_;
+  /// Signalled when a chunk is done.
+  std::condition_variable doneCV_;
+  /// The jobs that have unclaimed chunks, for each priority class, in the
+  /// order they were posted.
+  std::deque<Job *> queues_[NumRunPriorities];
+  /// Set when the pool is being destroyed.
+  bool shutdown_{false};
+};
+
+/// Set the priority of the loops that the calling thread posts to a thread
+/// pool for the lifetime of the object.
+class ScopedRunPriority {
+  /// The priority that was current before.
+  RunPriority previous_;
+
+public:
+  explicit ScopedRunPriority(RunPriority priority)
+      : previous_(ThreadPool::getCurrentPriority()) {
+    ThreadPool::setCurrentPriority(priority);
+  }
+  ~ScopedRunPriority() { ThreadPool::setCurrentPriority(previous_); }
+
+  ScopedRunPriority(const ScopedRunPriority &) = delete;
+  ScopedRunPriority &operator=(const ScopedRunPriority &) = delete;
+};
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_THREADPOOL_H
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_SUPPORT_TRACE_H
+#define GLOW_SUPPORT_TRACE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace glow {
+
+/// The processes of the timeline. The host threads are the threads of the
+/// host process, the command queues of the devices are the threads of the
+/// device process.
+enum class TraceProcess : unsigned {
+  Host = 0,
+  Device = 1,
+};
+
+/// An interval of the timeline of the compilation and the execution of the
+/// networks.
+struct TraceEvent {
+  /// The name of the event, e.g. the name of a compilation phase, of a
+  /// function or of a kernel.
+  std::string name;
+  /// The category of the event: "compile", "execute", "instruction",
+  /// "kernel" or "copy".
+  std::string category;
+  /// The beginning of the event in microseconds since the start of the trace.
+  uint64_t timestamp;
+  /// The duration of the event in microseconds.
+  uint64_t duration;
+  /// The process of the event.
+  TraceProcess process;
+  /// The thread of the host, or the queue of the device, of the event.
+  uint64_t thread;
+};
+
+/// \returns true if the events are recorded. This is the case if tracing was
+/// enabled with setTracingEnabled() or if a -trace-file is given.
+bool isTracingEnabled();
+
+/// Start or stop recording the events.
+void setTracingEnabled(bool enable);
+
+/// \returns the time in microseconds since the start of the trace, on the
+/// steady clock of the host.
+uint64_t getTraceTimestamp();
+
+/// \returns the small number identifying the calling thread in the trace.
+uint64_t getTraceThread();
+
+/// Record the event \p name of the category \p category lasting from \p begin
+/// to \p end, as returned by getTraceTimestamp(), on the thread \p thread of
+/// \p process. Does nothing if tracing is disabled.
+void addTraceEvent(llvm::StringRef name, llvm::StringRef category,
+                   uint64_t begin, uint64_t end,
+                   TraceProcess process = TraceProcess::Host,
+                   uint64_t thread = getTraceThread());
+
+/// \returns a copy of the recorded events.
+std::vector<TraceEvent> getTraceEvents();
+
+/// Forget the recorded events.
+void clearTraceEvents();
+
+/// Write the recorded events to \p os in the Chrome trace event format, which
+/// chrome://tracing and Perfetto load.
+void dumpTraceEvents(llvm::raw_ostream &os);
+
+/// Write the recorded events to the file \p filename. \returns false if the
+/// file can't be written. The events are written to the -trace-file when the
+/// program exits.
+bool dumpTraceEvents(llvm::StringRef filename);
+
+/// Records an event of the calling thread that lasts from the construction to
+/// the destruction of the object, if tracing is enabled at the construction.
+class ScopedTraceEvent {
+  /// The name of the event.
+  std::string name_;
+  /// The category of the event.
+  llvm::StringRef category_;
+  /// The time of the construction.
+  uint64_t begin_{0};
+  /// Whether the event is recorded.
+  bool enabled_;
+
+public:
+  ScopedTraceEvent(llvm::StringRef name, llvm::StringRef category)
+      : category_(category), enabled_(isTracingEnabled()) {
+    if (enabled_) {
+      name_ = name;
+      begin_ = getTraceTimestamp();
+    }
+  }
+
+  ~ScopedTraceEvent() {
+    if (enabled_) {
+      addTraceEvent(name_, category_, begin_, getTraceTimestamp());
+    }
+  }
+
+  ScopedTraceEvent(const ScopedTraceEvent &) = delete;
+  ScopedTraceEvent &operator=(const ScopedTraceEvent &) = delete;
+};
+
+} // namespace glow
+
+#endif // GLOW_SUPPORT_TRACE_H
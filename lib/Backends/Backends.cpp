@@ -41,10 +41,19 @@ Backend *createCPUBackend() {
 #if defined(GLOW_WITH_OPENCL)
 /// Create a new instance of the OpenCL backend.
 Backend *createOCLBackend();
+/// Create a new instance of the OpenCL backend for the device \p deviceIdx of
+/// the selected platform.
+Backend *createOCLBackend(unsigned deviceIdx);
+/// \returns the number of devices of the selected OpenCL platform.
+unsigned getNumOCLDevices();
 #else
 Backend *createOCLBackend() {
   GLOW_UNREACHABLE("Must compile with OpenCL support");
 }
+Backend *createOCLBackend(unsigned deviceIdx) {
+  GLOW_UNREACHABLE("Must compile with OpenCL support");
+}
+unsigned getNumOCLDevices() { return 0; }
 #endif
 } // namespace glow
 
@@ -62,3 +71,17 @@ Backend *glow::createBackend(BackendKind backendKind) {
   // always covers all possible values.
   llvm_unreachable("unreachable");
 }
+
+Backend *glow::createBackend(BackendKind backendKind, unsigned deviceIdx) {
+  if (backendKind == BackendKind::OpenCL) {
+    return createOCLBackend(deviceIdx);
+  }
+  return createBackend(backendKind);
+}
+
+unsigned glow::getNumDevices(BackendKind backendKind) {
+  if (backendKind == BackendKind::OpenCL) {
+    return getNumOCLDevices();
+  }
+  return 1;
+}
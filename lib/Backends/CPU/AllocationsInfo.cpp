@@ -22,7 +22,9 @@
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Support/CompileReport.h"
 #include "glow/Support/Debug.h"
+#include "glow/Support/Memory.h"
 
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
@@ -93,6 +95,10 @@ void AllocationsInfo::allocateWeightVars(const IRFunction *F,
   // Remember that max required memory size for each kind of weights.
   constantWeightVarsMemSize_ = constantWeightVarsAllocator.getMaxMemoryUsage();
   mutableWeightVarsMemSize_ = mutableWeightVarsAllocator.getMaxMemoryUsage();
+  if (auto *report = getCurrentCompileReport()) {
+    report->addMemoryUsage("constant weights", constantWeightVarsMemSize_);
+    report->addMemoryUsage("mutable weights", mutableWeightVarsMemSize_);
+  }
 
   DEBUG_GLOW(for (auto &A
                   : allocatedAddressed_) {
@@ -120,25 +126,48 @@ void AllocationsInfo::allocateActivations(const IRFunction *F) {
   // Maps activations and views to some offset within the heap.
   llvm::DenseMap<const Value *, uint64_t> activationAddr;
 
-  // Assign device-space addresses to the activations.
+  // Collect the lifetimes of the activations, and assign device-space
+  // addresses to all of them at once.
+  std::vector<MemoryAllocator::Allocation> allocList;
   for (const auto &I : F->getInstrs()) {
     if (auto *A = dyn_cast<AllocActivationInst>(&I)) {
-      auto numBytes = I.getSizeInBytes();
-      size_t addr = activationsAllocator.allocate(numBytes, A);
-      assert(!activationAddr.count(A) && "Allocation already made!");
-      activationAddr[A] = addr;
+      allocList.emplace_back(A, true, I.getSizeInBytes());
       continue;
     }
 
     if (auto *D = dyn_cast<DeallocActivationInst>(&I)) {
-      auto *A = D->getAlloc();
-      assert(activationAddr.count(A) && "Invalid deallocation!");
-      activationsAllocator.deallocate(A);
+      allocList.emplace_back(D->getAlloc(), false, 0);
       continue;
     }
   }
+  activationsAllocator.allocateAll(allocList);
+
+  for (auto &A : allocList) {
+    if (A.alloc) {
+      auto *V = static_cast<const Value *>(A.handle);
+      assert(!activationAddr.count(V) && "Allocation already made!");
+      activationAddr[V] = activationsAllocator.getAddress(A.handle);
+    }
+  }
 
   activationsMemSize_ = activationsAllocator.getMaxMemoryUsage();
+  activationsMemLowerBound_ = activationsAllocator.getMemoryUsageLowerBound();
+  DEBUG_GLOW(llvm::dbgs() << "Activations need " << activationsMemSize_
+                          << " bytes, the lower bound is "
+                          << activationsMemLowerBound_ << " bytes\n");
+
+  // Append the scratch area to the activations.
+  scratchMemSize_ = 0;
+  for (const auto &I : F->getInstrs()) {
+    scratchMemSize_ = std::max(scratchMemSize_, getScratchSize(I));
+  }
+  scratchOffset_ = alignedSize(activationsMemSize_, TensorAlignment);
+  if (scratchMemSize_) {
+    activationsMemSize_ = scratchOffset_ + scratchMemSize_;
+  }
+  if (auto *report = getCurrentCompileReport()) {
+    report->addMemoryUsage("activations", activationsMemSize_);
+  }
 
   // Register specific addresses within the heap to activations.
   for (auto &A : activationAddr) {
@@ -155,6 +184,46 @@ void AllocationsInfo::allocateActivations(const IRFunction *F) {
   });
 }
 
+/// The largest scratch area, in bytes, that the gradient of a convolution may
+/// use for its matrix multiplications. The gradients of larger convolutions
+/// are computed by the direct kernels.
+static constexpr size_t maxConvGradScratchSize = 256 << 20;
+
+size_t AllocationsInfo::getScratchSize(const Instruction &I) {
+  if (auto *CI = dyn_cast<CPUIm2colConvInst>(&I)) {
+    // The im2col matrix has a row for each output pixel, with the size of a
+    // row of the packed filter.
+    auto odim = CI->getDest()->dims();
+    return odim[0] * odim[1] * odim[2] * CI->getFilter()->dims()[1] *
+           sizeof(float);
+  }
+  if (auto *CI = dyn_cast<CPUQuantizedIm2colConvInst>(&I)) {
+    // The int8 im2col matrix has a row for each output pixel, with a value
+    // for each element of the filter of an output channel.
+    auto odim = CI->getDest()->dims();
+    auto *src = CI->getSrc();
+    return odim[0] * odim[1] * odim[2] * CI->getKernels()[0] *
+           CI->getKernels()[1] * src->dims()[3];
+  }
+  if (auto *CG = dyn_cast<ConvolutionGradInst>(&I)) {
+    // The im2col matrix of the input, whose rows have a trailing 1, is
+    // followed by the transposed gradient of the output and by the product
+    // of both. The gradient of the input patches reuses the im2col matrix.
+    if (CG->getGroup() != 1 ||
+        CG->getSrc()->getElementType() != ElemKind::FloatTy) {
+      return 0;
+    }
+    auto *destGrad = CG->getDestGrad();
+    size_t depth = destGrad->dims()[3];
+    size_t numPixels = destGrad->size() / depth;
+    size_t rowSize = CG->getFilterGrad()->size() / depth + 1;
+    size_t size = (numPixels * rowSize + depth * numPixels + depth * rowSize) *
+                  sizeof(float);
+    return size <= maxConvGradScratchSize ? size : 0;
+  }
+  return 0;
+}
+
 /// Calculate the offset for \p TVI into the underlying alloc activation.
 static size_t calculateTensorViewOffset(const TensorViewInst *TVI) {
   // Pop tensor views off repeatedly until we reach the origin, in case there
@@ -165,12 +234,7 @@ static size_t calculateTensorViewOffset(const TensorViewInst *TVI) {
     // Calculate and store the length of the current tensorview's offset
     // into the the source of the tensorview. Note that this source may be
     // another tensorview.
-    size_t currOffsetLength =
-        currTVI->getOffsets().empty() ? 0 : currTVI->getOffsets()[0];
-    auto *tvSource = currTVI->getSrc();
-    for (size_t i = 1; i < tvSource->dims().size(); ++i) {
-      currOffsetLength *= tvSource->dims()[i];
-    }
+    size_t currOffsetLength = getTensorViewOffset(currTVI);
 
     // Increment the running total offset length which will be used to store
     // into allocatedAddressed.
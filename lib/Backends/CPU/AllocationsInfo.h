@@ -22,6 +22,7 @@
 
 namespace glow {
 class Value;
+class Instruction;
 class IRFunction;
 class WeightVar;
 class Variable;
@@ -46,6 +47,18 @@ struct AllocationsInfo {
   size_t mutableWeightVarsMemSize_{0};
   /// Amount of memory to be allocated for activations.
   size_t activationsMemSize_{0};
+  /// The largest total size of the activations that are live at the same
+  /// time. The activations need at least this much memory, whatever their
+  /// offsets.
+  size_t activationsMemLowerBound_{0};
+  /// Offset of the scratch area at the end of the activations memory. It
+  /// holds the temporary buffers of instructions, like the im2col matrix of
+  /// CPUIm2colConv. The instructions run one at a time, so all of them share
+  /// the same area.
+  uint64_t scratchOffset_{0};
+  /// Size of the scratch area, which is the largest scratch buffer that any of
+  /// the instructions needs. It is included in activationsMemSize_.
+  size_t scratchMemSize_{0};
   /// Base address of constant weights.
   uint8_t *baseConstantWeightVarsAddress_{nullptr};
   /// Base address of mutable WeightVars.
@@ -62,7 +75,7 @@ struct AllocationsInfo {
   /// WeightVars will get new offsets assigned.
   void allocateWeightVars(const IRFunction *F, const Context &ctx,
                           bool absoluteAddr);
-  /// Assign offsets to all activations.
+  /// Assign offsets to all activations and to the scratch area.
   /// No actual memory allocation is performed. All the allocations should be
   /// performed by the client based on the information provided by the
   /// AllocationsInfo.
@@ -75,6 +88,9 @@ struct AllocationsInfo {
   /// Number all allocations and weight variables by assigning them unique
   /// numbers.
   void numberValues(const IRFunction *F);
+  /// \returns the size in bytes of the scratch buffer that the instruction
+  /// \p I needs during its execution.
+  static size_t getScratchSize(const Instruction &I);
 };
 
 } // namespace glow
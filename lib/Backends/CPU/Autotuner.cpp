@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define DEBUG_TYPE "cpu-autotune"
+
+#include "Autotuner.h"
+#include "CPUBackend.h"
+#include "CommandLine.h"
+
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/Debug.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+using namespace glow;
+
+static llvm::cl::opt<std::string> tuningDatabase(
+    "cpu-tuning-db",
+    llvm::cl::desc("File of the algorithms that implement the convolutions "
+                   "and matrix multiplications of each shape the fastest on "
+                   "this host; the heuristics are used if empty"),
+    llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> autotune(
+    "cpu-autotune",
+    llvm::cl::desc("Benchmark the candidate algorithms of the layers that are "
+                   "missing from the -cpu-tuning-db file, and record the "
+                   "fastest ones in it"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> autotuneReps(
+    "cpu-autotune-reps",
+    llvm::cl::desc("Number of timed runs of each candidate algorithm, of "
+                   "which the fastest one counts"),
+    llvm::cl::init(10), llvm::cl::cat(CPUBackendCat));
+
+bool CPUTuningDatabase::load(llvm::StringRef filename) {
+  auto buffer = llvm::MemoryBuffer::getFile(filename);
+  if (!buffer) {
+    return false;
+  }
+  std::istringstream is((*buffer)->getBuffer().str());
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream ls(line);
+    std::string key;
+    Entry entry;
+    if (line.empty() || line[0] == '#' ||
+        !(ls >> key >> entry.algorithm >> entry.seconds)) {
+      continue;
+    }
+    entries_[key] = entry;
+  }
+  return true;
+}
+
+bool CPUTuningDatabase::save(llvm::StringRef filename) const {
+  // Write to a temporary file first, so that concurrent compilations never
+  // read a partially written database.
+  int fd;
+  llvm::SmallString<256> tmpPath;
+  if (llvm::sys::fs::createUniqueFile(filename + "-%%%%%%.tmp", fd,
+                                      tmpPath)) {
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+    os << "# <layer>@<host cpu> <algorithm> <seconds>\n";
+    for (const auto &entry : entries_) {
+      os << entry.first << " " << entry.second.algorithm << " "
+         << llvm::format("%.9f", entry.second.seconds) << "\n";
+    }
+  }
+  if (llvm::sys::fs::rename(tmpPath, filename)) {
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+const std::string *CPUTuningDatabase::lookup(const std::string &key) const {
+  auto it = entries_.find(key);
+  return it == entries_.end() ? nullptr : &it->second.algorithm;
+}
+
+void CPUTuningDatabase::record(const std::string &key,
+                               llvm::StringRef algorithm, double seconds) {
+  entries_[key] = Entry{algorithm.str(), seconds};
+}
+
+Variable *glow::createTuningVariable(Function *F, TypeRef T,
+                                     llvm::StringRef name,
+                                     VisibilityKind visibility) {
+  auto *M = F->getParent();
+  auto *V = M->createVariable(M->uniqueType(*T), name, visibility,
+                              /* isTrainable */ false);
+  if (T->getElementType() == ElemKind::FloatTy) {
+    V->getPayload().getHandle().randomize(-1, 1, M->getPRNG());
+  }
+  return V;
+}
+
+/// \returns the best wall time in seconds of the layer built by \p build with
+/// the algorithm \p algorithm, on its own in a function compiled for the CPU,
+/// or infinity if the algorithm does not apply to the layer.
+static double benchmarkAlgorithm(const TuningLayerBuilder &build,
+                                 llvm::StringRef algorithm) {
+  Module M;
+  Function *F = M.createFunction("autotune");
+  NodeValue result = build(F, algorithm);
+  if (!result.getNode()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  F->createSave("save", result);
+  // Remove the generic layer that the algorithm replaced.
+  ::glow::optimize(F, CompilationMode::Infer);
+
+  CPUBackend backend;
+  backend.setTieredCompilation(false);
+  backend.setInstrumentTime(false);
+  Context ctx;
+  auto function = backend.compile(F, ctx);
+
+  // The first run warms up the caches and the pages of the activations.
+  function->execute();
+  double best = std::numeric_limits<double>::infinity();
+  for (unsigned i = 0; i < autotuneReps; i++) {
+    auto start = std::chrono::steady_clock::now();
+    function->execute();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+/// Serializes the accesses to the -cpu-tuning-db file.
+static std::mutex tuningDatabaseMutex;
+
+std::string glow::getTuningSettings() {
+  if (tuningDatabase.empty()) {
+    return "";
+  }
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  os << tuningDatabase << " " << autotune << " " << autotuneReps << "\n";
+  std::lock_guard<std::mutex> lock(tuningDatabaseMutex);
+  auto buffer = llvm::MemoryBuffer::getFile(tuningDatabase);
+  if (buffer) {
+    os << (*buffer)->getBuffer();
+  }
+  return os.str();
+}
+
+std::string glow::getTunedAlgorithm(llvm::StringRef key,
+                                    llvm::ArrayRef<llvm::StringRef> candidates,
+                                    const TuningLayerBuilder &build) {
+  if (tuningDatabase.empty()) {
+    return "";
+  }
+
+  // The database is shared by all of the compilations of the process, and it
+  // is read the first time that it is needed.
+  static CPUTuningDatabase database;
+  static bool loaded = false;
+  std::lock_guard<std::mutex> lock(tuningDatabaseMutex);
+  if (!loaded) {
+    database.load(tuningDatabase);
+    loaded = true;
+  }
+
+  std::string hostKey = (key + "@" + llvm::sys::getHostCPUName()).str();
+  if (const std::string *algorithm = database.lookup(hostKey)) {
+    return *algorithm;
+  }
+  if (!autotune) {
+    return "";
+  }
+
+  llvm::StringRef bestAlgorithm;
+  double bestSeconds = std::numeric_limits<double>::infinity();
+  for (auto algorithm : candidates) {
+    double seconds = benchmarkAlgorithm(build, algorithm);
+    DEBUG_GLOW(llvm::dbgs() << hostKey << ": " << algorithm << " " << seconds
+                            << " s\n");
+    if (seconds < bestSeconds) {
+      bestSeconds = seconds;
+      bestAlgorithm = algorithm;
+    }
+  }
+  if (bestAlgorithm.empty()) {
+    return "";
+  }
+  database.record(hostKey, bestAlgorithm, bestSeconds);
+  // Failing to update the database is not fatal, the layer just gets tuned
+  // again next time.
+  database.save(tuningDatabase);
+  return bestAlgorithm.str();
+}
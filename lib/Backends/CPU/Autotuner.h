@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_BACKENDS_CPU_AUTOTUNER_H
+#define GLOW_BACKENDS_CPU_AUTOTUNER_H
+
+#include "glow/Graph/Nodes.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <functional>
+#include <map>
+#include <string>
+
+namespace glow {
+
+class Function;
+
+/// A persistent map from the layers of a given operation, shape and host to
+/// the name of the algorithm that implements them the fastest. The database
+/// is a text file with a line "<key> <algorithm> <seconds>" per layer.
+class CPUTuningDatabase {
+  struct Entry {
+    std::string algorithm;
+    double seconds;
+  };
+  std::map<std::string, Entry> entries_;
+
+public:
+  /// Add the entries of the file \p filename, replacing the existing entries
+  /// with the same keys. \returns false if the file can't be read.
+  bool load(llvm::StringRef filename);
+
+  /// Write all of the entries to the file \p filename. \returns false if the
+  /// file can't be written.
+  bool save(llvm::StringRef filename) const;
+
+  /// \returns the algorithm recorded for \p key, or nullptr if there is none.
+  const std::string *lookup(const std::string &key) const;
+
+  /// Record that \p algorithm runs the layer \p key in \p seconds.
+  void record(const std::string &key, llvm::StringRef algorithm,
+              double seconds);
+
+  /// \returns the number of entries.
+  size_t size() const { return entries_.size(); }
+};
+
+/// Builds into the function that it is given a layer with the shape of the
+/// tuned one, implemented with the algorithm whose name it is given, and
+/// \returns the result of the layer, or an empty value if the algorithm does
+/// not apply to the layer.
+using TuningLayerBuilder =
+    std::function<NodeValue(Function *F, llvm::StringRef algorithm)>;
+
+/// \returns a new variable of the module of \p F, for the layers built by a
+/// TuningLayerBuilder, with the type \p T of another module. The float
+/// variables are filled with random values.
+Variable *createTuningVariable(Function *F, TypeRef T, llvm::StringRef name,
+                               VisibilityKind visibility);
+
+/// \returns the name of the algorithm of the layer \p key to use, in the
+/// database given by -cpu-tuning-db, or an empty string if the database has no
+/// entry for it. With -cpu-autotune, the layers that are missing from the
+/// database are benchmarked with each of \p candidates, built by \p build, and
+/// the fastest one is recorded. The key is extended with the name of the host
+/// CPU.
+std::string getTunedAlgorithm(llvm::StringRef key,
+                              llvm::ArrayRef<llvm::StringRef> candidates,
+                              const TuningLayerBuilder &build);
+
+/// \returns a description of the tuning settings that the algorithms chosen
+/// by getTunedAlgorithm() depend on: the -cpu-tuning-db file and its contents,
+/// -cpu-autotune and -cpu-autotune-reps. It is empty if there is no database.
+std::string getTuningSettings();
+
+} // namespace glow
+
+#endif // GLOW_BACKENDS_CPU_AUTOTUNER_H
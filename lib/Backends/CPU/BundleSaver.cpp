@@ -18,29 +18,245 @@
 #include "BundleSaver.h"
 
 #include "CPUBackend.h"
+#include "CommandLine.h"
 
 #include "glow/Graph/Context.h"
 #include "glow/Graph/Graph.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Support/Debug.h"
+#include "glow/Support/Float16.h"
+#include "glow/Support/Memory.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeReader.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace glow;
 using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
 
-BundleSaver::BundleSaver(const IRFunction *F)
-    : F_(F), irgen_(F_, allocationsInfo_, "") {}
+namespace {
+/// The ways of compressing the weights file of a bundle.
+enum class WeightsCompression { None, Sparse, Float16 };
+} // namespace
+
+static llvm::cl::opt<WeightsCompression> bundleWeightsCompression(
+    "bundle-weights-compression",
+    llvm::cl::desc("Compress the weights file of the bundles. The client "
+                   "decodes it with <bundle>_decompress_weights()"),
+    llvm::cl::values(
+        clEnumValN(WeightsCompression::None, "none", "Store the raw weights"),
+        clEnumValN(WeightsCompression::Sparse, "sparse",
+                   "Encode the runs of zeros, which is lossless"),
+        clEnumValN(WeightsCompression::Float16, "fp16",
+                   "Encode the runs of zeros and store the float weights in "
+                   "half precision, which is lossy")),
+    llvm::cl::init(WeightsCompression::None), llvm::cl::cat(CPUBackendCat));
+
+namespace {
+/// The x86 CPUs that a multi-versioned bundle can be compiled for. Each one
+/// extends the previous one, and the value is the level returned by
+/// libjit_x86_cpu_level for the CPUs that can run it.
+enum class CPUVariantKind { X86_64, SSE42, AVX2, AVX512 };
+
+/// The target machine settings of a CPU variant.
+struct CPUVariantInfo {
+  /// The suffix of the entry points of the variant.
+  const char *suffix;
+  /// The target CPU.
+  const char *cpu;
+  /// The target attributes.
+  const char *features;
+};
+} // namespace
+
+static llvm::cl::list<CPUVariantKind> bundleCPUVariants(
+    "bundle-cpu-variants", llvm::cl::CommaSeparated,
+    llvm::cl::desc("Compile the code of x86 bundles for each of these CPUs and "
+                   "run the best one that the host supports. The lowest one "
+                   "is the fallback"),
+    llvm::cl::values(
+        clEnumValN(CPUVariantKind::X86_64, "x86-64", "Baseline x86-64"),
+        clEnumValN(CPUVariantKind::SSE42, "sse4.2", "SSE4.2"),
+        clEnumValN(CPUVariantKind::AVX2, "avx2", "AVX2 and FMA"),
+        clEnumValN(CPUVariantKind::AVX512, "avx512",
+                   "AVX-512 F, CD, BW, DQ and VL")),
+    llvm::cl::cat(CPUBackendCat));
+
+/// The settings of the CPU variants, indexed by CPUVariantKind. They must
+/// agree with the features that libjit_x86_cpu_level checks.
+static const CPUVariantInfo cpuVariants[] = {
+    {"x86_64", "x86-64", ""},
+    {"sse42", "x86-64", "+sse4.2,+popcnt"},
+    {"avx2", "x86-64", "+avx2,+fma,+popcnt,+bmi,+bmi2"},
+    {"avx512", "x86-64",
+     "+avx512f,+avx512cd,+avx512bw,+avx512dq,+avx512vl,+avx2,+fma,+popcnt,"
+     "+bmi,+bmi2"},
+};
+
+/// The kinds of the records of a compressed weights file. The format is
+/// described, and decoded, by libjit_decompress_weights.
+enum WeightsRecordKind : uint32_t {
+  RawBytesRecord = 0,
+  ZeroBytesRecord = 1,
+  HalfFloatsRecord = 2,
+};
+
+/// The minimal number of zero bytes that is worth a record of its own.
+static constexpr size_t minZeroBytesRecord = 32;
+
+/// Append to \p out the record of kind \p kind for \p count elements, whose
+/// payload is [\p data, \p data + \p size).
+static void appendWeightsRecord(std::string &out, WeightsRecordKind kind,
+                                size_t count, const void *data, size_t size) {
+  uint32_t header = (uint32_t(kind) << 30) | uint32_t(count);
+  out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.append(static_cast<const char *>(data), size);
+  out.append(alignedSize(size, sizeof(header)) - size, '\0');
+}
+
+std::string glow::compressBundleWeights(llvm::ArrayRef<char> image,
+                                        const std::vector<bool> &isFloat,
+                                        size_t maxRecordCount) {
+  GLOW_ASSERT(maxRecordCount && maxRecordCount <= maxWeightsRecordCount &&
+              "The records can not hold that many elements");
+  std::string out("GLOWWZ\0\1", 8);
+  uint64_t size = image.size();
+  out.append(reinterpret_cast<const char *>(&size), sizeof(size));
+
+  // \returns the number of zero bytes from pos on, up to limit.
+  auto countZeros = [&](size_t pos, size_t limit) {
+    size_t end = pos;
+    while (end < image.size() && end - pos < limit && !image[end]) {
+      end++;
+    }
+    return end - pos;
+  };
+  // \returns true if a run of zeros worth a record starts at pos.
+  auto startsZeroRun = [&](size_t pos) {
+    size_t zeros = countZeros(pos, minZeroBytesRecord);
+    return zeros == minZeroBytesRecord || (zeros && pos + zeros == size);
+  };
+  auto isHalf = [&](size_t pos) {
+    return pos % sizeof(float) == 0 && pos / sizeof(float) < isFloat.size() &&
+           isFloat[pos / sizeof(float)];
+  };
+
+  size_t pos = 0;
+  while (pos < size) {
+    if (startsZeroRun(pos)) {
+      size_t zeros = countZeros(pos, maxRecordCount);
+      appendWeightsRecord(out, ZeroBytesRecord, zeros, nullptr, 0);
+      pos += zeros;
+      continue;
+    }
+    // Extend the record up to the next run of zeros or change of kind.
+    bool half = isHalf(pos);
+    size_t step = half ? sizeof(float) : 1;
+    size_t end = pos + step;
+    while (end < size && (end - pos) / step < maxRecordCount &&
+           isHalf(end) == half && !startsZeroRun(end)) {
+      end += step;
+    }
+    size_t count = (end - pos) / step;
+    if (half) {
+      std::vector<uint16_t> halves(count);
+      for (size_t i = 0; i < count; i++) {
+        float value;
+        memcpy(&value, &image[pos + i * sizeof(float)], sizeof(value));
+        halves[i] = floatToHalfBits(value);
+      }
+      appendWeightsRecord(out, HalfFloatsRecord, count, halves.data(),
+                          count * sizeof(uint16_t));
+    } else {
+      appendWeightsRecord(out, RawBytesRecord, count, &image[pos], count);
+    }
+    pos = end;
+  }
+  return out;
+}
+
+BundleSaver::BundleSaver(const IRFunction *F) {
+  entries_.push_back(llvm::make_unique<Entry>(F, ""));
+}
+
+BundleSaver::BundleSaver(
+    llvm::ArrayRef<std::pair<const IRFunction *, std::string>> entries) {
+  GLOW_ASSERT(!entries.empty() && "A bundle needs an entry point");
+  auto *M = entries.front().first->getGraph()->getParent();
+  for (const auto &entry : entries) {
+    GLOW_ASSERT(entry.first->getGraph()->getParent() == M &&
+                "The entry points of a bundle must belong to the same module");
+    entries_.push_back(llvm::make_unique<Entry>(entry.first, entry.second));
+  }
+}
+
+void BundleSaver::expandCPUVariants(llvm::StringRef target) {
+  llvm::Triple triple(target.empty() ? llvm::sys::getProcessTriple()
+                                     : target.str());
+  GLOW_ASSERT(triple.getArch() == llvm::Triple::x86_64 &&
+              "Only x86-64 bundles can be multi-versioned");
+  std::vector<int> variants;
+  for (auto kind : bundleCPUVariants) {
+    variants.push_back(static_cast<int>(kind));
+  }
+  std::sort(variants.begin(), variants.end());
+  variants.erase(std::unique(variants.begin(), variants.end()),
+                 variants.end());
+  std::vector<std::unique_ptr<Entry>> expanded;
+  for (auto &E : entries_) {
+    for (int variant : variants) {
+      expanded.push_back(llvm::make_unique<Entry>(E->F, E->name, variant));
+    }
+  }
+  entries_ = std::move(expanded);
+}
+
+/// \returns the name of the function that runs the code of the entry point
+/// \p name compiled for the CPU variant \p cpuVariant.
+static std::string getCodeName(const std::string &name, int cpuVariant) {
+  if (cpuVariant < 0) {
+    return name;
+  }
+  return name + "_" + cpuVariants[cpuVariant].suffix;
+}
+
+/// Move the code of \p src into \p dest. The modules belong to different LLVM
+/// contexts, so the code is carried over as bitcode.
+static void linkModule(llvm::Module &dest, llvm::Module &src) {
+  llvm::SmallVector<char, 0> buffer;
+  llvm::raw_svector_ostream os(buffer);
+#if LLVM_VERSION_MAJOR > 6
+  llvm::WriteBitcodeToFile(src, os);
+#else
+  llvm::WriteBitcodeToFile(&src, os);
+#endif
+  llvm::MemoryBufferRef bitcode(llvm::StringRef(buffer.data(), buffer.size()),
+                                src.getModuleIdentifier());
+  auto parsed = llvm::parseBitcodeFile(bitcode, dest.getContext());
+  if (!parsed) {
+    llvm::consumeError(parsed.takeError());
+    GLOW_UNREACHABLE("Could not read the code of a bundle entry point");
+  }
+  bool failed = llvm::Linker::linkModules(dest, std::move(parsed.get()));
+  GLOW_ASSERT(!failed && "Could not link the entry points of the bundle");
+}
 
 void BundleSaver::saveWeights(llvm::StringRef weightsFileName) {
   std::error_code EC;
@@ -50,15 +266,40 @@ void BundleSaver::saveWeights(llvm::StringRef weightsFileName) {
   // Serialize only constant weights.
   // Do not serialize mutable weights representing inputs and outputs, because
   // it should be configurable and set by the client.
+  // All the entry points share the weights, so the layout of the first one is
+  // used.
+  const auto &E = *entries_.front();
+  if (bundleWeightsCompression != WeightsCompression::None) {
+    // Lay the weights out in memory, and compress the whole area at once.
+    bool toHalf = bundleWeightsCompression == WeightsCompression::Float16;
+    std::vector<char> image(E.allocationsInfo.constantWeightVarsMemSize_);
+    std::vector<bool> isFloat(toHalf ? image.size() / sizeof(float) : 0);
+    for (auto &v : E.F->getGraph()->getParent()->getVars()) {
+      auto *w = cast<WeightVar>(E.F->getWeightForNode(v));
+      if (v->getVisibilityKind() == VisibilityKind::Public)
+        continue;
+      auto numBytes = w->getSizeInBytes();
+      auto addr = E.allocationsInfo.allocatedAddressed_.lookup(w);
+      memcpy(&image[addr], v->getPayload().getUnsafePtr(), numBytes);
+      if (toHalf && w->getElementType() == ElemKind::FloatTy) {
+        std::fill(isFloat.begin() + addr / sizeof(float),
+                  isFloat.begin() + (addr + numBytes) / sizeof(float), true);
+      }
+    }
+    auto compressed = compressBundleWeights(image, isFloat);
+    weightsFile.write(compressed.data(), compressed.size());
+    weightsFile.close();
+    return;
+  }
   size_t pos = 0;
   size_t maxPos = 0;
-  for (auto &v : F_->getGraph()->getParent()->getVars()) {
-    auto *w = cast<WeightVar>(F_->getWeightForNode(v));
+  for (auto &v : E.F->getGraph()->getParent()->getVars()) {
+    auto *w = cast<WeightVar>(E.F->getWeightForNode(v));
     if (v->getVisibilityKind() == VisibilityKind::Public)
       continue;
     auto numBytes = w->getSizeInBytes();
     auto payload = v->getPayload().getUnsafePtr();
-    auto addr = allocationsInfo_.allocatedAddressed_[w];
+    auto addr = E.allocationsInfo.allocatedAddressed_.lookup(w);
     if (addr < pos) {
       // The payload was written already. It aliases something we have seen
       // already.
@@ -72,14 +313,19 @@ void BundleSaver::saveWeights(llvm::StringRef weightsFileName) {
   // Make sure that the file is as long as the constantWeightVarsMemSize_.
   // This is needed to properly handle alignments.
   weightsFile.seek(maxPos);
-  for (size_t endPos = irgen_.getAllocationsInfo().constantWeightVarsMemSize_;
+  for (size_t endPos = E.allocationsInfo.constantWeightVarsMemSize_;
        maxPos < endPos; maxPos++) {
     weightsFile.write(0);
   }
   weightsFile.close();
 }
 
-void BundleSaver::emitSymbolTable() {
+llvm::GlobalVariable *BundleSaver::emitSymbolTable(llvm::StringRef name) {
+  // The table is the same for all the entry points, since it describes the
+  // variables of their module. It is emitted once, along with the code of the
+  // first entry point.
+  auto &E = *entries_.front();
+  auto &irgen = E.irgen;
   // Define a struct for symbol table entries:
   // struct SymbolTableEntry {
   //  const char *name;
@@ -87,27 +333,27 @@ void BundleSaver::emitSymbolTable() {
   //  size_t size;
   //  char kind;
   // };
-  auto *charTy = llvm::Type::getInt8Ty(irgen_.getLLVMContext());
+  auto *charTy = llvm::Type::getInt8Ty(irgen.getLLVMContext());
   auto *sizeTTy =
-      llvm::Type::getIntNTy(irgen_.getLLVMContext(), sizeof(size_t) * 8);
+      llvm::Type::getIntNTy(irgen.getLLVMContext(), sizeof(size_t) * 8);
   auto symbolTableEntryTy =
-      llvm::StructType::get(irgen_.getLLVMContext(),
+      llvm::StructType::get(irgen.getLLVMContext(),
                             {charTy->getPointerTo(), sizeTTy, sizeTTy, charTy});
   // Set of entries in the symbol table.
   llvm::SmallVector<llvm::Constant *, 128> entries;
   // Iterate over all weights and record information about their names, offset,
   // size and kind.
-  for (auto &v : F_->getGraph()->getParent()->getVars()) {
-    auto *w = cast<WeightVar>(F_->getWeightForNode(v));
+  for (auto &v : E.F->getGraph()->getParent()->getVars()) {
+    auto *w = cast<WeightVar>(E.F->getWeightForNode(v));
     bool isConstWeight = v->getVisibilityKind() != VisibilityKind::Public;
     auto size = w->getType()->size();
-    auto addr = allocationsInfo_.allocatedAddressed_[w];
+    auto addr = E.allocationsInfo.allocatedAddressed_.lookup(w);
     // Create an SymbolTableEntry.
     auto *entry = llvm::ConstantStruct::get(
         symbolTableEntryTy,
         {// name.
-         dyn_cast<llvm::Constant>(irgen_.getBuilder().CreateBitCast(
-             irgen_.emitStringConst(irgen_.getBuilder(), w->getName()),
+         dyn_cast<llvm::Constant>(irgen.getBuilder().CreateBitCast(
+             irgen.emitStringConst(irgen.getBuilder(), w->getName()),
              charTy->getPointerTo())),
          // offset.
          llvm::ConstantInt::get(sizeTTy, addr),
@@ -122,19 +368,41 @@ void BundleSaver::emitSymbolTable() {
   auto *arr = llvm::ConstantArray::get(
       llvm::ArrayType::get(symbolTableEntryTy, entries.size()), entries);
   // Create a global variable and initialize it with the constructed array.
-  new llvm::GlobalVariable(irgen_.getModule(), arr->getType(), true,
-                           llvm::GlobalValue::InternalLinkage, arr,
-                           irgen_.getMainEntryName() + "SymbolTable");
+  return new llvm::GlobalVariable(irgen.getModule(), arr->getType(), true,
+                                  llvm::GlobalValue::InternalLinkage, arr,
+                                  name);
 }
 
-void BundleSaver::produceBundle(llvm::StringRef outputDir) {
+void BundleSaver::produceBundle(llvm::StringRef outputDir,
+                                llvm::StringRef bundleName) {
+  auto &irgen = entries_.front()->irgen;
+  auto &M = irgen.getModule();
+  // Gather the code of all the entry points in a single module.
+  for (size_t i = 1, e = entries_.size(); i < e; i++) {
+    linkModule(M, entries_[i]->irgen.getModule());
+  }
+  // The CPU variants are only called by the dispatch functions.
+  for (auto &E : entries_) {
+    if (E->cpuVariant < 0) {
+      continue;
+    }
+    auto *F = M.getFunction(getCodeName(E->name, E->cpuVariant));
+    if (F->use_empty()) {
+      F->eraseFromParent();
+    } else {
+      F->setLinkage(llvm::Function::InternalLinkage);
+    }
+  }
   // Emit the symbol table for weight variables.
-  emitSymbolTable();
-  // Emit the config for the bundle.
-  emitBundleConfig();
+  auto *symbolTable = emitSymbolTable((bundleName + "SymbolTable").str());
+  // Emit the config for every entry point. The CPU variants of an entry point
+  // share it.
+  for (size_t i = 0, e = entries_.size(); i < e; i++) {
+    if (i == 0 || entries_[i - 1]->name != entries_[i]->name) {
+      emitBundleConfig(*entries_[i], symbolTable);
+    }
+  }
 
-  auto &M = irgen_.getModule();
-  auto bundleName = irgen_.getMainEntryName();
   auto bundleCodeOutput = (outputDir + "/" + bundleName + ".o").str();
   auto bundleWeightsOutput = (outputDir + "/" + bundleName + ".weights").str();
   DEBUG_GLOW(llvm::outs() << "Producing a bundle:\n"
@@ -156,7 +424,7 @@ void BundleSaver::produceBundle(llvm::StringRef outputDir) {
   } else if (fileName.endswith(".o")) {
     // Emit the object file.
     llvm::legacy::PassManager PM;
-    auto &TM = irgen_.getTargetMachine();
+    auto &TM = irgen.getTargetMachine();
     TM.addPassesToEmitFile(
         PM, outputFile, llvm::TargetMachine::CodeGenFileType::CGFT_ObjectFile);
     PM.run(M);
@@ -171,20 +439,24 @@ void BundleSaver::produceBundle(llvm::StringRef outputDir) {
 /// provides the constant array of offsets. Since these offsets are constants,
 /// the LLVM optimizer will constant propagate them into relative addressing
 /// computations and the like and produce a very efficient code that uses
-/// absolute addressing whenever possible.
-void BundleSaver::emitBundleEntryFunction() {
+/// absolute addressing whenever possible. The offsets are relative to the base
+/// addresses passed in each call, so the entry function is reentrant: threads
+/// can share the constant weights and run it concurrently, each with its own
+/// mutable weights and activations.
+void BundleSaver::emitBundleEntryFunction(Entry &E) {
+  auto &irgen = E.irgen;
   // The bundle entry point has the following API:
   // void entry(uint8_t *baseConstantWeightVars, uint8_t *baseInoutWeightVars,
   // uint8_t *baseActivations);
-  llvm::Type *voidTy = llvm::Type::getVoidTy(irgen_.getLLVMContext());
-  auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen_.getLLVMContext());
+  llvm::Type *voidTy = llvm::Type::getVoidTy(irgen.getLLVMContext());
+  auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen.getLLVMContext());
   llvm::FunctionType *bundleFuncTy =
       llvm::FunctionType::get(voidTy, {int8PtrTy, int8PtrTy, int8PtrTy}, false);
   auto *func =
       llvm::Function::Create(bundleFuncTy, llvm::Function::ExternalLinkage,
-                             irgen_.getMainEntryName(), &irgen_.getModule());
+                             irgen.getMainEntryName(), &irgen.getModule());
   llvm::BasicBlock *entry_bb =
-      llvm::BasicBlock::Create(irgen_.getLLVMContext(), "entry", func);
+      llvm::BasicBlock::Create(irgen.getLLVMContext(), "entry", func);
   llvm::IRBuilder<> builder(entry_bb);
 
   // Prepare arguments for the "main" function.
@@ -193,17 +465,103 @@ void BundleSaver::emitBundleEntryFunction() {
   initFunctionCallArgs.push_back(func->args().begin() + 1);
   initFunctionCallArgs.push_back(func->args().begin() + 2);
   // Now form the offsets array and pass it as the last argument.
-  auto offsetsArray = irgen_.emitConstOffsetsArray(builder, allocationsInfo_);
+  auto offsetsArray = irgen.emitConstOffsetsArray(builder, E.allocationsInfo);
   initFunctionCallArgs.push_back(offsetsArray);
   // Invoke the main entry with constant arguments and let LLVM optimizer make
   // use of it.
-  auto *entryF = irgen_.getModule().getFunction("main");
+  auto *entryF = irgen.getModule().getFunction("main");
   entryF->setLinkage(llvm::Function::InternalLinkage);
   createCall(builder, entryF, initFunctionCallArgs);
   // Terminate the function.
   builder.CreateRetVoid();
   // Create the debug info for the bundle entry point function.
-  irgen_.generateFunctionDebugInfo(func);
+  irgen.generateFunctionDebugInfo(func);
+}
+
+/// The dispatch function has the signature of the entry points and tail calls
+/// the code of the highest CPU variant at most at the level that
+/// libjit_x86_cpu_level reports, or the lowest one. It is emitted along with
+/// the code of the lowest variant of the first entry point, so that it only
+/// uses baseline instructions, and the other variants are declared there.
+void BundleSaver::emitCPUDispatchFunction(llvm::StringRef name) {
+  auto &irgen = entries_.front()->irgen;
+  auto &M = irgen.getModule();
+  std::vector<int> variants;
+  for (auto &E : entries_) {
+    if (E->name == name) {
+      variants.push_back(E->cpuVariant);
+    }
+  }
+  llvm::Type *voidTy = llvm::Type::getVoidTy(irgen.getLLVMContext());
+  auto *int8PtrTy = llvm::Type::getInt8PtrTy(irgen.getLLVMContext());
+  auto *bundleFuncTy =
+      llvm::FunctionType::get(voidTy, {int8PtrTy, int8PtrTy, int8PtrTy}, false);
+  auto *func = llvm::Function::Create(
+      bundleFuncTy, llvm::Function::ExternalLinkage, name, &M);
+  llvm::SmallVector<llvm::Value *, 3> args;
+  for (auto &arg : func->args()) {
+    args.push_back(&arg);
+  }
+  auto *entryBB =
+      llvm::BasicBlock::Create(irgen.getLLVMContext(), "entry", func);
+  llvm::IRBuilder<> builder(entryBB);
+  auto *level = createCall(builder, irgen.getFunction("x86_cpu_level"), {});
+  for (size_t i = variants.size(); i-- > 0;) {
+    auto codeName = getCodeName(name.str(), variants[i]);
+    auto *code = M.getFunction(codeName);
+    if (!code) {
+      code = llvm::Function::Create(
+          bundleFuncTy, llvm::Function::ExternalLinkage, codeName, &M);
+    }
+    auto *callBB =
+        llvm::BasicBlock::Create(irgen.getLLVMContext(), codeName, func);
+    if (i > 0) {
+      auto *nextBB =
+          llvm::BasicBlock::Create(irgen.getLLVMContext(), "next", func);
+      auto *supported = builder.CreateICmpSGE(
+          level, builder.getInt32(static_cast<uint32_t>(variants[i])));
+      builder.CreateCondBr(supported, callBB, nextBB);
+      builder.SetInsertPoint(callBB);
+      createCall(builder, code, args)->setTailCall();
+      builder.CreateRetVoid();
+      builder.SetInsertPoint(nextBB);
+    } else {
+      builder.CreateBr(callBB);
+      builder.SetInsertPoint(callBB);
+      createCall(builder, code, args)->setTailCall();
+      builder.CreateRetVoid();
+    }
+  }
+  irgen.generateFunctionDebugInfo(func);
+}
+
+/// Emit the function that decodes the compressed weights file of the bundle
+/// into the constant weights area, along with the code of the entry \p E:
+/// size_t <bundleName>_decompress_weights(const uint8_t *weights,
+///                                        size_t weightsSize,
+///                                        uint8_t *constantWeightVars);
+/// It \returns the number of bytes written, or 0 if the file is malformed.
+void BundleSaver::emitDecompressWeightsFunction(Entry &E,
+                                                llvm::StringRef bundleName) {
+  auto &irgen = E.irgen;
+  auto *sizeTTy =
+      llvm::Type::getIntNTy(irgen.getLLVMContext(), sizeof(size_t) * 8);
+  auto *int8PtrTy = llvm::Type::getInt8PtrTy(irgen.getLLVMContext());
+  auto *funcTy = llvm::FunctionType::get(
+      sizeTTy, {int8PtrTy, sizeTTy, int8PtrTy}, false);
+  auto *func = llvm::Function::Create(
+      funcTy, llvm::Function::ExternalLinkage,
+      (bundleName + "_decompress_weights").str(), &irgen.getModule());
+  llvm::BasicBlock *entry_bb =
+      llvm::BasicBlock::Create(irgen.getLLVMContext(), "entry", func);
+  llvm::IRBuilder<> builder(entry_bb);
+  auto *destSize = llvm::ConstantInt::get(
+      sizeTTy, E.allocationsInfo.constantWeightVarsMemSize_);
+  auto *result = createCall(builder, irgen.getFunction("decompress_weights"),
+                            {func->args().begin(), func->args().begin() + 1,
+                             func->args().begin() + 2, destSize});
+  builder.CreateRet(result);
+  irgen.generateFunctionDebugInfo(func);
 }
 
 // Create a config for this network. It will be exposed to the clients,
@@ -217,58 +575,110 @@ void BundleSaver::emitBundleEntryFunction() {
 //   size_t numSymbols;
 //   SymbolTableEntry *symbolTable;
 // };
-void BundleSaver::emitBundleConfig() {
-  auto symbolTable = irgen_.getModule().getGlobalVariable(
-      irgen_.getMainEntryName() + "SymbolTable", true);
-  GLOW_ASSERT(symbolTable &&
-              "Expected to find a symbol table for the AOT bundle");
+void BundleSaver::emitBundleConfig(Entry &E,
+                                   llvm::GlobalVariable *symbolTable) {
+  // The config is emitted into the module that gathers the code of all the
+  // entry points.
+  auto &irgen = entries_.front()->irgen;
+  const auto &allocationsInfo = E.allocationsInfo;
   // Get the integer type having the same size in bits as size_t.
-  auto *SizeTType = irgen_.getBuilder().getIntNTy(sizeof(size_t) * 8);
+  auto *SizeTType = irgen.getBuilder().getIntNTy(sizeof(size_t) * 8);
   auto symbolTableEntryTy = symbolTable->getType()->getPointerElementType();
   auto *bundleConfigTy = llvm::StructType::get(
-      irgen_.getLLVMContext(), {SizeTType, SizeTType, SizeTType, SizeTType,
-                                SizeTType, symbolTableEntryTy->getPointerTo()});
+      irgen.getLLVMContext(), {SizeTType, SizeTType, SizeTType, SizeTType,
+                               SizeTType, symbolTableEntryTy->getPointerTo()});
   auto config = new llvm::GlobalVariable(
-      irgen_.getModule(), bundleConfigTy, /* isConst */ true,
+      irgen.getModule(), bundleConfigTy, /* isConst */ true,
       llvm::GlobalValue::LinkageTypes::ExternalLinkage, nullptr,
-      irgen_.getMainEntryName() + "_config");
+      E.name + "_config");
   config->setInitializer(llvm::ConstantStruct::get(
       bundleConfigTy,
-      llvm::ConstantInt::get(
-          SizeTType, irgen_.getAllocationsInfo().constantWeightVarsMemSize_),
-      llvm::ConstantInt::get(
-          SizeTType, irgen_.getAllocationsInfo().mutableWeightVarsMemSize_),
       llvm::ConstantInt::get(SizeTType,
-                             irgen_.getAllocationsInfo().activationsMemSize_),
+                             allocationsInfo.constantWeightVarsMemSize_),
+      llvm::ConstantInt::get(SizeTType,
+                             allocationsInfo.mutableWeightVarsMemSize_),
+      llvm::ConstantInt::get(SizeTType, allocationsInfo.activationsMemSize_),
       llvm::ConstantInt::get(SizeTType, TensorAlignment),
       llvm::ConstantInt::get(SizeTType,
-                             F_->getGraph()->getParent()->getVars().size()),
+                             E.F->getGraph()->getParent()->getVars().size()),
       symbolTable));
 }
 
-void BundleSaver::performBundleMemoryAllocation() {
-  allocationsInfo_.numberValues(F_);
-  allocationsInfo_.allocateActivations(F_);
+void BundleSaver::performBundleMemoryAllocation(Entry &E) {
+  auto &allocationsInfo = E.allocationsInfo;
+  allocationsInfo.numberValues(E.F);
+  allocationsInfo.allocateActivations(E.F);
   // Tell the allocateWeightVars to not reuse any existing addresses for weights
   // and to assign new ones.
   Context empty;
-  allocationsInfo_.allocateWeightVars(F_, empty, false);
-  allocationsInfo_.allocateTensorViews(F_);
+  allocationsInfo.allocateWeightVars(E.F, empty, false);
+  allocationsInfo.allocateTensorViews(E.F);
 }
 
 void BundleSaver::save(llvm::StringRef target, llvm::StringRef outputDir,
                        llvm::StringRef networkName) {
-  // Object files generation works properly only in small mode.
-  irgen_.initTargetMachine(target, llvm::CodeModel::Model::Small);
-  irgen_.setMainEntryName(networkName);
-  irgen_.setOutputDir(outputDir);
-  irgen_.initCodeGen();
-  // Perform the address assignment for activations and WeightVars.
-  performBundleMemoryAllocation();
-  // Create the bundle entry function.
-  emitBundleEntryFunction();
-  // Emit the code for the body of the entry function.
-  irgen_.performCodeGen();
+  // A bundle with a single entry point that has no name of its own is named
+  // after the bundle.
+  if (entries_.size() == 1 && entries_.front()->name.empty()) {
+    entries_.front()->name = networkName;
+  }
+  if (!bundleCPUVariants.empty()) {
+    expandCPUVariants(target);
+  }
+  auto &first = *entries_.front();
+  for (auto &E : entries_) {
+    auto &irgen = E->irgen;
+    // Object files generation works properly only in small mode.
+    if (E->cpuVariant < 0) {
+      irgen.initTargetMachine(target, llvm::CodeModel::Model::Small);
+    } else {
+      const auto &variant = cpuVariants[E->cpuVariant];
+      irgen.initTargetMachine(target, llvm::CodeModel::Model::Small,
+                              variant.cpu, variant.features);
+    }
+    irgen.setMainEntryName(getCodeName(E->name, E->cpuVariant));
+    irgen.setOutputDir(outputDir);
+    // Several threads may run the bundle at the same time, each with its own
+    // mutable weights and activations.
+    irgen.setThreadLocalGlobals(true);
+    irgen.initCodeGen();
+    // Perform the address assignment for activations and WeightVars.
+    performBundleMemoryAllocation(*E);
+    // The layout of the weights only depends on the variables of the module,
+    // so all the entry points agree on it.
+    GLOW_ASSERT(E->allocationsInfo.constantWeightVarsMemSize_ ==
+                        first.allocationsInfo.constantWeightVarsMemSize_ &&
+                    E->allocationsInfo.mutableWeightVarsMemSize_ ==
+                        first.allocationsInfo.mutableWeightVarsMemSize_ &&
+                "The entry points disagree on the layout of the weights");
+    // Create the bundle entry function.
+    emitBundleEntryFunction(*E);
+    if (E == entries_.front() &&
+        bundleWeightsCompression != WeightsCompression::None) {
+      emitDecompressWeightsFunction(*E, networkName);
+    }
+    if (E == entries_.front() && E->cpuVariant >= 0) {
+      for (size_t i = 0, e = entries_.size(); i < e; i++) {
+        if (i == 0 || entries_[i - 1]->name != entries_[i]->name) {
+          emitCPUDispatchFunction(entries_[i]->name);
+        }
+      }
+    }
+    // Emit the code for the body of the entry function.
+    irgen.performCodeGen();
+    // The functions of all the variants end up in one module, which is
+    // compiled with the target machine of the lowest one, so each function
+    // records the CPU it is optimized for.
+    if (E->cpuVariant >= 0) {
+      const auto &variant = cpuVariants[E->cpuVariant];
+      for (auto &FF : irgen.getModule()) {
+        if (!FF.isDeclaration()) {
+          FF.addFnAttr("target-cpu", variant.cpu);
+          FF.addFnAttr("target-features", variant.features);
+        }
+      }
+    }
+  }
   // Produce the bundle.
-  produceBundle(outputDir);
+  produceBundle(outputDir, networkName);
 }
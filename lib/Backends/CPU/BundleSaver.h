@@ -21,32 +21,82 @@
 
 #include "glow/IR/IR.h"
 
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace glow {
 
+/// The largest count of a record of a compressed weights file.
+constexpr size_t maxWeightsRecordCount = (1u << 30) - 1;
+
+/// \returns the compressed weights file for the constant weights area
+/// \p image, which libjit_decompress_weights decodes. The 4-byte words of the
+/// area for which \p isFloat is true hold floats, which are stored in half
+/// precision. The records hold at most \p maxRecordCount elements each.
+std::string compressBundleWeights(llvm::ArrayRef<char> image,
+                                  const std::vector<bool> &isFloat,
+                                  size_t maxRecordCount = maxWeightsRecordCount);
+
 class BundleSaver final {
-  /// The IR to be compiled.
-  const IRFunction *F_;
-  /// Information about allocations.
-  AllocationsInfo allocationsInfo_;
-  /// The LLVM IR code generator.
-  LLVMIRGen irgen_;
-
-  /// Perform memory allocation for a bundle.
-  void performBundleMemoryAllocation();
+  /// An entry point of the bundle.
+  struct Entry {
+    /// The IR to be compiled.
+    const IRFunction *F;
+    /// The name of the entry point.
+    std::string name;
+    /// Information about allocations.
+    AllocationsInfo allocationsInfo;
+    /// The LLVM IR code generator.
+    LLVMIRGen irgen;
+    /// The index of the CPU variant the code is compiled for, or -1 if the
+    /// bundle is not multi-versioned.
+    int cpuVariant;
+
+    Entry(const IRFunction *F, llvm::StringRef name, int cpuVariant = -1)
+        : F(F), name(name), irgen(F, allocationsInfo, ""),
+          cpuVariant(cpuVariant) {}
+  };
+  /// The entry points. The code of all of them ends up in the module of the
+  /// first one, which also holds the configs and the symbol table. The CPU
+  /// variants of an entry point are consecutive, from the lowest one up.
+  std::vector<std::unique_ptr<Entry>> entries_;
+
+  /// Replace every entry point by one entry per CPU variant of the bundle,
+  /// which is built for \p target.
+  void expandCPUVariants(llvm::StringRef target);
+  /// Emit the entry point named \p name of a multi-versioned bundle, which
+  /// runs the code of the best of its CPU variants that the host supports.
+  void emitCPUDispatchFunction(llvm::StringRef name);
+
+  /// Perform memory allocation for the entry \p E.
+  void performBundleMemoryAllocation(Entry &E);
   /// Save weights for the bundle.
   void saveWeights(llvm::StringRef weightsFileName);
-  /// Produce a bundle.
-  void produceBundle(llvm::StringRef outputDir);
-  /// Emit config for a bundle.
-  void emitBundleConfig();
-  /// Emit the symbol table for a bundle.
-  void emitSymbolTable();
-  /// Emit the entry function for the bundle.
-  void emitBundleEntryFunction();
+  /// Produce a bundle named \p bundleName.
+  void produceBundle(llvm::StringRef outputDir, llvm::StringRef bundleName);
+  /// Emit the config for the entry \p E, which refers to the symbol table
+  /// \p symbolTable.
+  void emitBundleConfig(Entry &E, llvm::GlobalVariable *symbolTable);
+  /// Emit the symbol table named \p name for the bundle.
+  llvm::GlobalVariable *emitSymbolTable(llvm::StringRef name);
+  /// Emit the entry function for the entry \p E.
+  void emitBundleEntryFunction(Entry &E);
+  /// Emit the function of the bundle named \p bundleName that decompresses
+  /// its weights, with the code of the entry \p E.
+  void emitDecompressWeightsFunction(Entry &E, llvm::StringRef bundleName);
 
 public:
-  /// Ctor.
+  /// Ctor for a bundle with a single entry point, which is named after the
+  /// bundle.
   explicit BundleSaver(const IRFunction *F);
+  /// Ctor for a bundle with an entry point for each of the functions of
+  /// \p entries, paired with the names of the entry points. The functions
+  /// belong to the same module: the entry points share its constant weights
+  /// and the symbol table of its variables.
+  explicit BundleSaver(
+      llvm::ArrayRef<std::pair<const IRFunction *, std::string>> entries);
   /// Save code bundle built for \p target to \p outputDir.
   /// Make \p networkName the function name for
   /// the entry point of the network and prepend all generated
@@ -15,22 +15,192 @@
  */
 
 #include "CPUBackend.h"
+#include "Autotuner.h"
 #include "BundleSaver.h"
 #include "CPUFunction.h"
+#include "CommandLine.h"
 
+#include "glow/Graph/Context.h"
 #include "glow/Graph/Graph.h"
+#include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Support/Debug.h"
+#include "glow/Support/NUMA.h"
+#include "glow/Support/PerfCounters.h"
+#include "glow/Support/CompileReport.h"
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace glow;
 
 static llvm::cl::opt<std::string> target("target", llvm::cl::desc("target"));
 
+static llvm::cl::opt<unsigned> cpuNumThreads(
+    "cpu-num-threads",
+    llvm::cl::desc("Number of threads used to execute data-parallel kernels, "
+                   "matrix multiplications and convolutions of each JITted "
+                   "function (1 means single-threaded)"),
+    llvm::cl::init(1), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> cpuCodeGenThreads(
+    "cpu-codegen-threads",
+    llvm::cl::desc("Number of threads generating the machine code of each "
+                   "JITted function. The instructions are outlined into "
+                   "separate functions, which are split between the threads "
+                   "(1 generates the code of the whole function on one "
+                   "thread)"),
+    llvm::cl::init(1), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> cpuNUMAReplicateWeights(
+    "cpu-numa-replicate-weights",
+    llvm::cl::desc("Copy the weights that the JITted functions only read to "
+                   "every NUMA node, and execute with the copy of the node "
+                   "of the calling thread"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> cpuNUMAPinThreads(
+    "cpu-numa-pin-threads",
+    llvm::cl::desc("Restrict the worker threads of a JITted function to the "
+                   "NUMA node of the thread that compiles it"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<std::string> jitCacheDir(
+    "jit-cache-dir",
+    llvm::cl::desc("Directory of the persistent cache of the JITted object "
+                   "code (the cache is disabled if empty)"),
+    llvm::cl::init(""), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> tieredCompilation(
+    "cpu-tiered-compilation",
+    llvm::cl::desc("Make the JITted functions available after a quick "
+                   "compilation with few optimizations, and switch them to "
+                   "fully optimized code compiled in the background"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> instrumentTime(
+    "instrument-time",
+    llvm::cl::desc("Time every instruction and every data-parallel kernel of "
+                   "the JITted functions and print the profile when the "
+                   "functions are destroyed"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> cancellationChecks(
+    "cpu-cancellation-checks",
+    llvm::cl::desc("Make the JITted functions check before every instruction "
+                   "and every data-parallel kernel whether the run was "
+                   "cancelled or missed its deadline, and stop it if so"),
+    llvm::cl::init(true), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> weightPrefetchBudget(
+    "cpu-weight-prefetch-kb",
+    llvm::cl::desc("Prefetch the constant weights of the next layers into the "
+                   "last level cache on a helper thread while the current "
+                   "layer runs, keeping at most this many KB prefetched ahead, "
+                   "e.g. half of the last level cache (0 disables it)"),
+    llvm::cl::init(0), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> instrumentCounters(
+    "instrument-counters",
+    llvm::cl::desc("Read the hardware performance counters around the regions "
+                   "timed by -instrument-time, which it implies, and print "
+                   "their profile when the functions are destroyed"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<std::string> instrumentCountersFPEvent(
+    "instrument-counters-fp-event",
+    llvm::cl::desc("The raw PMU event, in hexadecimal, that counts the "
+                   "floating point operations of this host for "
+                   "-instrument-counters, e.g. r3fc7 for the FP arithmetic "
+                   "instructions of recent Intel cores (none by default)"),
+    llvm::cl::init(""), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> instrumentHealth(
+    "instrument-health",
+    llvm::cl::desc("Compute the minimum, maximum, mean and the numbers of NaNs "
+                   "and infinities of the float outputs of every instruction "
+                   "in one of every -instrument-health-rate executions of the "
+                   "JITted functions, and print them when the functions are "
+                   "destroyed"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> instrumentHealthRate(
+    "instrument-health-rate",
+    llvm::cl::desc("One execution in this many computes the statistics of "
+                   "-instrument-health"),
+    llvm::cl::init(100), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> instrumentHealthElements(
+    "instrument-health-elements",
+    llvm::cl::desc("The number of evenly spaced elements of every tensor that "
+                   "-instrument-health reads (0 reads them all)"),
+    llvm::cl::init(4096), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> instrumentHealthHistory(
+    "instrument-health-history",
+    llvm::cl::desc("The number of sampled executions whose statistics "
+                   "-instrument-health keeps"),
+    llvm::cl::init(16), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> cpuSpatialTilingCacheKB(
+    "cpu-spatial-tiling-cache-kb",
+    llvm::cl::desc("Split the chains of convolutions, pools and activations "
+                   "whose intermediate activations exceed this many KB into "
+                   "horizontal strips that each flow through the whole chain "
+                   "while they are in the cache (0 disables the tiling)"),
+    llvm::cl::init(0), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> cpuClusterWeightsBits(
+    "cpu-cluster-weights-bits",
+    llvm::cl::desc("Cluster the large constant weights of the fully connected "
+                   "and embedding layers into a codebook with indices of this "
+                   "many bits, 4 or 8 (0 disables the clustering)"),
+    llvm::cl::init(0), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<unsigned> cpuClusterWeightsMin(
+    "cpu-cluster-weights-min",
+    llvm::cl::desc("The number of weights of the smallest layers whose "
+                   "weights -cpu-cluster-weights-bits clusters"),
+    llvm::cl::init(1 << 16), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<HugePagePolicy> cpuHugePagesWeights(
+    "cpu-huge-pages-weights",
+    llvm::cl::desc("Huge pages backing the large runtime blocks of weights of "
+                   "the JITted functions, such as their NUMA replicas:"),
+    llvm::cl::values(
+        clEnumValN(HugePagePolicy::None, "none", "Ordinary pages"),
+        clEnumValN(HugePagePolicy::Transparent, "thp",
+                   "Transparent huge pages, advised with madvise"),
+        clEnumValN(HugePagePolicy::Explicit2MB, "2mb",
+                   "Reserved 2MB huge pages, falling back to thp"),
+        clEnumValN(HugePagePolicy::Explicit1GB, "1gb",
+                   "Reserved 1GB huge pages, falling back to 2mb")),
+    llvm::cl::init(HugePagePolicy::None), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<HugePagePolicy> cpuHugePagesActivations(
+    "cpu-huge-pages-activations",
+    llvm::cl::desc("Huge pages backing the large activation heaps of the "
+                   "JITted functions:"),
+    llvm::cl::values(
+        clEnumValN(HugePagePolicy::None, "none", "Ordinary pages"),
+        clEnumValN(HugePagePolicy::Transparent, "thp",
+                   "Transparent huge pages, advised with madvise"),
+        clEnumValN(HugePagePolicy::Explicit2MB, "2mb",
+                   "Reserved 2MB huge pages, falling back to thp"),
+        clEnumValN(HugePagePolicy::Explicit1GB, "1gb",
+                   "Reserved 1GB huge pages, falling back to 2mb")),
+    llvm::cl::init(HugePagePolicy::None), llvm::cl::cat(CPUBackendCat));
+
 namespace glow {
 Backend *createCPUBackend() { return new CPUBackend(); }
 } // namespace glow
@@ -42,15 +212,23 @@ namespace {
 //===----------------------------------------------------------------------===//
 
 /// Emit the entry point for JIT called "jitmain". It simply calls the main
-/// entry of the module with the constant concrete addresses of all the memory
-/// areas. Since these addresses are constants, the LLVM optimizer will constant
-/// propagate them into relative addressing computations and the like and
-/// produce a very efficient code that uses absolute addressing whenever
-/// possible.
+/// entry of the module with the constant concrete addresses of the weights
+/// memory areas. Since these addresses are constants, the LLVM optimizer will
+/// constant propagate them into relative addressing computations and the like.
+/// The base address of the activations and the offsets array are parameters
+/// of "jitmain": this allows for running the same code concurrently with
+/// different scratch memories for the activations and different tensors
+/// backing the placeholders.
 static void emitJitMain(LLVMIRGen &irgen) {
   AllocationsInfo &allocationsInfo = irgen.getAllocationsInfo();
   llvm::Type *voidTy = llvm::Type::getVoidTy(irgen.getLLVMContext());
-  llvm::FunctionType *jitFuncTy = llvm::FunctionType::get(voidTy, {}, false);
+  auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen.getLLVMContext());
+  auto sizeTPtrTy =
+      llvm::Type::getIntNPtrTy(irgen.getLLVMContext(), sizeof(size_t) * 8);
+  // The JIT entry point has the following API:
+  // void jitmain(uint8_t *baseActivations, size_t *offsets);
+  llvm::FunctionType *jitFuncTy =
+      llvm::FunctionType::get(voidTy, {int8PtrTy, sizeTPtrTy}, false);
   auto *func =
       llvm::Function::Create(jitFuncTy, llvm::Function::ExternalLinkage,
                              "jitmain", &irgen.getModule());
@@ -62,7 +240,6 @@ static void emitJitMain(LLVMIRGen &irgen) {
   llvm::SmallVector<llvm::Value *, 4> initFunctionCallArgs;
   // Get the integer type having the same size in bits as size_t.
   auto *sizeTType = builder.getIntNTy(sizeof(size_t) * 8);
-  auto int8PtrTy = llvm::Type::getInt8PtrTy(irgen.getLLVMContext());
 
   initFunctionCallArgs.push_back(builder.CreateIntToPtr(
       llvm::ConstantInt::get(
@@ -74,17 +251,11 @@ static void emitJitMain(LLVMIRGen &irgen) {
           sizeTType, reinterpret_cast<size_t>(
                          allocationsInfo.baseMutableWeightVarsAddress_)),
       int8PtrTy));
-  initFunctionCallArgs.push_back(builder.CreateIntToPtr(
-      llvm::ConstantInt::get(
-          sizeTType,
-          reinterpret_cast<size_t>(allocationsInfo.baseActivationsAddress_)),
-      int8PtrTy));
-  // Now form the offsets array and pass it as the last argument.
-  auto offsetsArray =
-      irgen.emitConstOffsetsArray(irgen.getBuilder(), allocationsInfo);
-  initFunctionCallArgs.push_back(offsetsArray);
-  // Invoke the main entry with constant arguments and let LLVM optimizer make
-  // use of it.
+  // The activations and the offsets array are provided by the caller.
+  initFunctionCallArgs.push_back(func->args().begin());
+  initFunctionCallArgs.push_back(func->args().begin() + 1);
+  // Invoke the main entry and let LLVM optimizer make use of the constant
+  // arguments.
   auto *entryF = irgen.getModule().getFunction(irgen.getMainEntryName());
   entryF->setLinkage(llvm::Function::InternalLinkage);
   createCall(builder, entryF, initFunctionCallArgs);
@@ -94,10 +265,114 @@ static void emitJitMain(LLVMIRGen &irgen) {
   irgen.generateFunctionDebugInfo(func);
 }
 
-/// Perform memory allocation for a JIT execution.
+/// Collect the information about the memory that needs to be passed to the
+/// "jitmain" of the function \p F at runtime, using the addresses assigned by
+/// \p allocationsInfo. \p ctx is the context the function is compiled with.
+static CPURuntimeInfo collectRuntimeInfo(const IRFunction *F,
+                                         const AllocationsInfo &allocationsInfo,
+                                         const Context &ctx) {
+  CPURuntimeInfo info;
+  info.activationsMemSize = allocationsInfo.activationsMemSize_;
+
+  // Form the offsets array, which is indexed by the value numbers.
+  info.offsets.resize(allocationsInfo.valueNumbers_.size());
+  for (auto &I : allocationsInfo.valueNumbers_) {
+    info.offsets[I.second.second] =
+        allocationsInfo.allocatedAddressed_.lookup(I.first);
+  }
+
+  // Find the entries of the offsets array, which contain the addresses of the
+  // tensors backing the placeholders and the variables, or of the views into
+  // such tensors. The absolute addresses of the tensors from \p ctx and of the
+  // payloads are used for them at compile time.
+  llvm::DenseMap<const Value *, Placeholder *> weightToPlaceholder;
+  for (auto &PH : ctx.pairs()) {
+    weightToPlaceholder[F->getWeightForNode(PH.first)] = PH.first;
+  }
+  llvm::DenseMap<const Value *, const Variable *> weightToVariable;
+  for (auto *V : F->getGraph()->getParent()->getVars()) {
+    weightToVariable[F->getWeightForNode(V)] = V;
+  }
+  for (auto &I : allocationsInfo.valueNumbers_) {
+    const Value *origin = getOrigin(I.first);
+    size_t byteOffset = allocationsInfo.allocatedAddressed_.lookup(I.first) -
+                        allocationsInfo.allocatedAddressed_.lookup(origin);
+    auto PH = weightToPlaceholder.find(origin);
+    if (PH != weightToPlaceholder.end()) {
+      info.placeholderSlots.push_back(
+          {PH->second, I.second.second, byteOffset});
+      continue;
+    }
+    auto V = weightToVariable.find(origin);
+    if (V != weightToVariable.end()) {
+      info.variableSlots.push_back({V->second, I.second.second, byteOffset});
+    }
+  }
+
+  // Find the entries that refer to the weights that the function never
+  // writes to. These weights can be replicated.
+  llvm::DenseMap<const Value *, size_t> constantWeightIndex;
+  for (auto &I : allocationsInfo.valueNumbers_) {
+    if (I.second.first != AllocationsInfo::ValueKind::ConstantWeight) {
+      continue;
+    }
+    auto *W = llvm::cast<WeightVar>(getOrigin(I.first));
+    if (W->getMutability() != WeightVar::MutabilityKind::Constant) {
+      continue;
+    }
+    size_t address = allocationsInfo.allocatedAddressed_.lookup(W);
+    auto it = constantWeightIndex.find(W);
+    if (it == constantWeightIndex.end()) {
+      it = constantWeightIndex.insert({W, info.constantWeights.size()}).first;
+      info.constantWeights.push_back(
+          {weightToVariable.lookup(W),
+           reinterpret_cast<const uint8_t *>(address), W->getSizeInBytes()});
+    }
+    size_t byteOffset =
+        allocationsInfo.allocatedAddressed_.lookup(I.first) - address;
+    info.constantWeightSlots.push_back(
+        {it->second, I.second.second, byteOffset});
+  }
+  return info;
+}
+
+/// \returns the key of the object code of \p F in the JIT cache. The key is a
+/// hash of everything the generated code depends on: the optimized Glow IR,
+/// the libjit bitcode, the target, the number of threads and the settings of
+/// the code generation and of the graph transformations, \p transformSettings.
+/// The code does not depend on the addresses of the tensors, which are passed
+/// at runtime.
+static std::string computeJITCacheKey(const IRFunction *F, LLVMIRGen &irgen,
+                                      unsigned numThreads,
+                                      llvm::StringRef transformSettings) {
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  F->dump(os);
+  auto &TM = irgen.getTargetMachine();
+  os << TM.getTargetTriple().str() << "\n"
+     << TM.getTargetCPU() << "\n"
+     << TM.getTargetFeatureString() << "\n"
+     << irgen.getLibjitDigest() << "\n"
+     << numThreads << "\n"
+     << irgen.getCancellationChecks() << "\n"
+     << irgen.getWeightPrefetchBudget() << "\n"
+     << transformSettings << "\n";
+
+  llvm::MD5 hash;
+  hash.update(os.str());
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> key;
+  llvm::MD5::stringifyResult(result, key);
+  return key.str();
+}
+
+/// Perform memory allocation for a JIT execution. The heap of the activations
+/// is taken from \p allocator.
 static void *allocateJITMemory(const IRFunction *F,
                                AllocationsInfo &allocationsInfo,
-                               const Context &ctx) {
+                               const Context &ctx,
+                               RuntimeAllocator &allocator) {
   allocationsInfo.numberValues(F);
   allocationsInfo.allocateActivations(F);
   // Tell the allocateWeightVars to use absolute addresses for weights.
@@ -109,13 +384,95 @@ static void *allocateJITMemory(const IRFunction *F,
     return nullptr;
   }
   auto heap =
-      alignedAlloc(allocationsInfo.activationsMemSize_, TensorAlignment);
+      allocator.allocate(allocationsInfo.activationsMemSize_, TensorAlignment,
+                         RuntimeMemoryKind::Activations);
   allocationsInfo.baseActivationsAddress_ = (uint8_t *)heap;
   return heap;
 }
 
+/// Add the optimized \p module to \p JIT. If \p numParts is greater than one,
+/// the module is split into \p numParts partitions, whose machine code is
+/// generated in parallel, each by its own copy of the target machine of the
+/// JIT. Otherwise, the JIT generates the code of the whole module when the
+/// entry point is looked up.
+static void addModuleToJIT(llvm::orc::GlowJIT &JIT,
+                           std::unique_ptr<llvm::Module> module,
+                           unsigned numParts) {
+  if (numParts < 2) {
+    JIT.addModule(std::move(module));
+    return;
+  }
+  auto &TM = JIT.getTargetMachine();
+  auto createTargetMachine = [&TM]() {
+    return std::unique_ptr<llvm::TargetMachine>(
+        TM.getTarget().createTargetMachine(
+            TM.getTargetTriple().str(), TM.getTargetCPU(),
+            TM.getTargetFeatureString(), TM.Options, TM.getRelocationModel(),
+            TM.getCodeModel(), TM.getOptLevel()));
+  };
+  std::vector<llvm::SmallString<0>> objects(numParts);
+  std::vector<std::unique_ptr<llvm::raw_svector_ostream>> streams;
+  llvm::SmallVector<llvm::raw_pwrite_stream *, 8> outputs;
+  for (auto &object : objects) {
+    streams.push_back(llvm::make_unique<llvm::raw_svector_ostream>(object));
+    outputs.push_back(streams.back().get());
+  }
+  llvm::splitCodeGen(std::move(module), outputs, {}, createTargetMachine);
+  for (auto &object : objects) {
+    JIT.addObject(llvm::MemoryBuffer::getMemBufferCopy(object.str()));
+  }
+}
+
+/// The state of the background recompilation of a function with the full
+/// optimizations.
+struct TierUpState {
+  /// The IR of the function.
+  std::unique_ptr<IRFunction> IR;
+  /// The allocations of the function, which the code generator refers to.
+  AllocationsInfo allocationsInfo;
+  /// The code generator.
+  std::unique_ptr<LLVMIRGen> irgen;
+  /// The persistent cache receiving the optimized object code, or null.
+  std::unique_ptr<llvm::orc::JITObjectCache> cache;
+};
+
+/// \returns the runtime allocator selected by the command line: the default
+/// one, or a pool over the huge pages if any region uses them. The options
+/// are read once, when the first backend is created.
+static RuntimeAllocator &getCommandLineRuntimeAllocator() {
+  static RuntimeAllocator *allocator = []() -> RuntimeAllocator * {
+    if (cpuHugePagesWeights == HugePagePolicy::None &&
+        cpuHugePagesActivations == HugePagePolicy::None) {
+      return &getDefaultRuntimeAllocator();
+    }
+    // Like the default allocator, they live until the end of the program.
+    auto *hugePages = new HugePageRuntimeAllocator(getHeapRuntimeAllocator());
+    hugePages->setPolicy(RuntimeMemoryKind::ConstantWeights,
+                         cpuHugePagesWeights);
+    hugePages->setPolicy(RuntimeMemoryKind::MutableWeights,
+                         cpuHugePagesWeights);
+    hugePages->setPolicy(RuntimeMemoryKind::Activations,
+                         cpuHugePagesActivations);
+    return new PoolRuntimeAllocator(*hugePages);
+  }();
+  return *allocator;
+}
+
 } // end namespace
 
+CPUBackend::CPUBackend()
+    : numThreads_(cpuNumThreads), codeGenThreads_(cpuCodeGenThreads),
+      instrumentTime_(instrumentTime || instrumentCounters),
+      instrumentCounters_(instrumentCounters),
+      instrumentHealth_(instrumentHealth),
+      healthSampleRate_(std::max(1u, unsigned(instrumentHealthRate))),
+      tieredCompilation_(tieredCompilation),
+      spatialTilingCacheSize_(size_t(cpuSpatialTilingCacheKB) << 10),
+      weightPrefetchBudget_(size_t(weightPrefetchBudget) << 10),
+      weightClusteringBits_(cpuClusterWeightsBits),
+      weightClusteringMinSize_(cpuClusterWeightsMin),
+      allocator_(&getCommandLineRuntimeAllocator()) {}
+
 std::unique_ptr<LLVMIRGen>
 CPUBackend::createIRGen(IRFunction *IR,
                         AllocationsInfo &allocationsInfo) const {
@@ -132,55 +489,214 @@ CPUBackend::compileIR(std::unique_ptr<IRFunction> IR,
                            llvm::CodeModel::Model::Large);
   irgen->initCodeGen();
   // Perform the address assignment for activations and WeightVars.
-  auto heap = allocateJITMemory(IR.get(), irgen->getAllocationsInfo(), ctx);
-  // Create the jitmain function to be invoked by JIT.
-  emitJitMain(*irgen);
-  // Emit the code for the body of the entry function.
-  irgen->performCodeGen();
-  // Hand over the module to JIT for the machine code generation.
-  auto JIT = llvm::make_unique<llvm::orc::GlowJIT>(irgen->getTargetMachine());
-  JIT->addModule(irgen->borrowModule());
-  return llvm::make_unique<CPUFunction>(std::move(JIT), heap);
+  auto heap = allocateJITMemory(IR.get(), irgen->getAllocationsInfo(), ctx,
+                                *allocator_);
+  // With -shared-thread-pool, the parallel parts are split between the
+  // threads of the pool of the process, which the other functions share.
+  std::unique_ptr<ThreadPool> threadPool;
+  ThreadPool *sharedThreadPool = nullptr;
+  if (ThreadPool::isSharedPoolEnabled()) {
+    sharedThreadPool = &ThreadPool::getShared();
+    irgen->setThreadPool(sharedThreadPool);
+  } else if (numThreads_ > 1) {
+    std::vector<unsigned> cpus;
+    if (cpuNUMAPinThreads) {
+      cpus = getCPUsOfNUMANode(getCurrentNUMANode());
+    }
+    threadPool = llvm::make_unique<ThreadPool>(numThreads_, std::move(cpus));
+    irgen->setThreadPool(threadPool.get());
+  }
+  irgen->setInstrumentTime(instrumentTime_);
+  irgen->setCancellationChecks(cancellationChecks);
+  irgen->setWeightPrefetchBudget(weightPrefetchBudget_);
+  irgen->setInstrumentHealth(instrumentHealth_, instrumentHealthElements);
+  irgen->setInstrumentCounters(instrumentTime_ && instrumentCounters_);
+  if (instrumentCounters_ && !instrumentCountersFPEvent.empty()) {
+    llvm::StringRef event = instrumentCountersFPEvent;
+    uint64_t config;
+    event.consume_front("r");
+    GLOW_ASSERT(!event.getAsInteger(16, config) &&
+                "Invalid -instrument-counters-fp-event");
+    setPerfCounterFPEvent(config);
+  }
+  // Look up the object code in the persistent cache. Instrumented code is not
+  // cached, since the description of the timed regions and of the checked
+  // tensors is only known after the code generation.
+  bool instrumented = instrumentTime_ || instrumentHealth_;
+  std::unique_ptr<llvm::orc::JITObjectCache> cache;
+  if (!jitCacheDir.empty() && !instrumented) {
+    // The graph transformations are reflected in the IR, but their settings
+    // are part of the key too, e.g. for the weights that they rewrite.
+    std::string transformSettings;
+    llvm::raw_string_ostream os(transformSettings);
+    os << spatialTilingCacheSize_ << " " << weightClusteringBits_ << " "
+       << weightClusteringMinSize_ << "\n"
+       << getTuningSettings();
+    cache = llvm::make_unique<llvm::orc::JITObjectCache>(
+        jitCacheDir,
+        computeJITCacheKey(IR.get(), *irgen,
+                           sharedThreadPool ? sharedThreadPool->getNumThreads()
+                                            : numThreads_,
+                           os.str()));
+  }
+  // The tiered compilation first generates quickly optimized code, and
+  // recompiles the function with the full pipeline in the background. Cached
+  // code is already fully optimized, and instrumented code is only compiled
+  // once, so that all of its executions are timed alike.
+  bool cached = cache && cache->hasObject();
+  bool tiered = tieredCompilation_ && !cached && !instrumented;
+  // The object code of the quick compilation is not cached. The cache holds a
+  // single object file per function, so the machine code of the cached
+  // functions is generated in one piece.
+  auto *objectCache = tiered ? nullptr : cache.get();
+  unsigned codeGenParts = objectCache ? 1 : codeGenThreads_;
+  std::unique_ptr<llvm::Module> module;
+  if (cached) {
+    // The JIT takes the code from the cache, so it only needs an empty module.
+    module =
+        llvm::make_unique<llvm::Module>("jitmain", irgen->getLLVMContext());
+    module->setDataLayout(irgen->getTargetMachine().createDataLayout());
+  } else {
+    ScopedCompilePhase phase("LLVM codegen");
+    if (tiered) {
+      irgen->setOptLevel(1);
+    }
+    // The profilers attribute the samples to the outlined segments, which
+    // are named after their instructions.
+    irgen->setOutlineSegments(codeGenParts > 1 ||
+                              llvm::orc::GlowJIT::reportsToProfilers());
+    // Create the jitmain function to be invoked by JIT.
+    emitJitMain(*irgen);
+    // Emit the code for the body of the entry function.
+    irgen->performCodeGen();
+    module = irgen->borrowModule();
+  }
+  auto runtimeInfo =
+      collectRuntimeInfo(IR.get(), irgen->getAllocationsInfo(), ctx);
+  runtimeInfo.name = IR->getGraph()->getName();
+  runtimeInfo.timeProfileRegions = irgen->getTimeProfileRegions();
+  runtimeInfo.instrumentCounters = instrumentTime_ && instrumentCounters_;
+  // The address of the health statistics follows the values in the offsets
+  // array, and is null in the executions that are not sampled.
+  if (!irgen->getHealthTensors().empty()) {
+    runtimeInfo.healthTensors = irgen->getHealthTensors();
+    runtimeInfo.healthOffsetIndex = irgen->getHealthOffsetIndex();
+    assert(runtimeInfo.offsets.size() == runtimeInfo.healthOffsetIndex &&
+           "The values are not numbered densely");
+    runtimeInfo.offsets.push_back(0);
+    runtimeInfo.healthSampleRate = healthSampleRate_;
+    runtimeInfo.healthHistorySize =
+        std::max(1u, unsigned(instrumentHealthHistory));
+  }
+  // Hand over the module to JIT for the machine code generation, which
+  // happens when the function looks up its entry point, or right away if it
+  // is generated in parallel.
+  ScopedCompilePhase phase("JIT");
+  auto JIT = llvm::make_unique<llvm::orc::GlowJIT>(irgen->getTargetMachine(),
+                                                   objectCache);
+  addModuleToJIT(*JIT, std::move(module), codeGenParts);
+  auto *pool = sharedThreadPool ? sharedThreadPool : threadPool.get();
+  auto function = llvm::make_unique<CPUFunction>(
+      std::move(JIT), *allocator_, heap, std::move(runtimeInfo),
+      std::move(threadPool), sharedThreadPool);
+  if (cpuNUMAReplicateWeights) {
+    function->replicateWeightsPerNUMANode();
+  }
+  if (tiered) {
+    // The recompilation owns the IR and a copy of the allocations, which the
+    // code generator refers to. The addresses of the heap and of the weights
+    // stay the same.
+    auto state = std::make_shared<TierUpState>();
+    state->allocationsInfo = irgen->getAllocationsInfo();
+    state->IR = std::move(IR);
+    state->irgen = createIRGen(state->IR.get(), state->allocationsInfo);
+    state->irgen->setCancellationChecks(irgen->getCancellationChecks());
+    state->irgen->setWeightPrefetchBudget(irgen->getWeightPrefetchBudget());
+    state->cache = std::move(cache);
+    std::string tgt = target.empty() ? "" : target.getValue();
+    unsigned tierUpParts = state->cache ? 1 : codeGenThreads_;
+    function->startTierUp([state, tgt, pool, tierUpParts]() {
+      auto &tierGen = *state->irgen;
+      tierGen.initTargetMachine(tgt, llvm::CodeModel::Model::Large);
+      tierGen.initCodeGen();
+      tierGen.setThreadPool(pool);
+      tierGen.setOutlineSegments(tierUpParts > 1 ||
+                                 llvm::orc::GlowJIT::reportsToProfilers());
+      emitJitMain(tierGen);
+      tierGen.performCodeGen();
+      auto JIT = llvm::make_unique<llvm::orc::GlowJIT>(
+          tierGen.getTargetMachine(), state->cache.get());
+      addModuleToJIT(*JIT, tierGen.borrowModule(), tierUpParts);
+      // Generate the machine code while the target machine is alive.
+      auto address = JIT->findSymbol("jitmain").getAddress();
+      GLOW_ASSERT(address && "Error getting address.");
+      return JIT;
+    });
+  }
+  return std::move(function);
 }
 
 std::unique_ptr<CompiledFunction>
 CPUBackend::compile(Function *F, const Context &ctx) const {
-  auto IR = generateAndOptimizeIR(F, shouldShareBuffers());
+  auto IR = generateAndOptimizeIR(F, shouldShareBuffers(),
+                                  getCompileSchedulerKind());
   return compileIR(std::move(IR), ctx);
 }
 
 void CPUBackend::save(Function *F, llvm::StringRef outputDir,
                       llvm::StringRef networkName) const {
   std::string tgt = target.empty() ? "" : target.getValue();
-  auto IR = generateAndOptimizeIR(F, shouldShareBuffers());
+  auto IR = generateAndOptimizeIR(F, shouldShareBuffers(),
+                                  getCompileSchedulerKind());
   BundleSaver(IR.get()).save(tgt, outputDir, networkName);
 }
 
+void CPUBackend::save(llvm::ArrayRef<BundleEntry> entries,
+                      llvm::StringRef outputDir,
+                      llvm::StringRef bundleName) const {
+  std::string tgt = target.empty() ? "" : target.getValue();
+  std::vector<std::unique_ptr<IRFunction>> IRs;
+  std::vector<std::pair<const IRFunction *, std::string>> IREntries;
+  for (const auto &entry : entries) {
+    IRs.push_back(generateAndOptimizeIR(entry.F, shouldShareBuffers(),
+                                        getCompileSchedulerKind()));
+    IREntries.emplace_back(IRs.back().get(), entry.name);
+  }
+  BundleSaver(IREntries).save(tgt, outputDir, bundleName);
+}
+
 bool CPUBackend::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
   // Check for quantization support.
   if (elementTy == ElemKind::Int8QTy) {
     switch (opKind) {
     case Kinded::Kind::AddNodeKind:
     case Kinded::Kind::BatchedAddNodeKind:
+    // Lowered to the quantized MatMuls of its slices.
+    case Kinded::Kind::BatchedMatMulNodeKind:
     case Kinded::Kind::BatchedReduceAddNodeKind:
+    case Kinded::Kind::BroadcastNodeKind:
+    case Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind:
     case Kinded::Kind::CmpLTENodeKind:
     case Kinded::Kind::ConcatNodeKind:
     case Kinded::Kind::ConvolutionNodeKind:
     case Kinded::Kind::DequantizeNodeKind:
     case Kinded::Kind::DivNodeKind:
     case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::LogNodeKind:
     case Kinded::Kind::MatMulNodeKind:
     case Kinded::Kind::MaxNodeKind:
     case Kinded::Kind::MinNodeKind:
     case Kinded::Kind::MulNodeKind:
     case Kinded::Kind::AvgPoolNodeKind:
     case Kinded::Kind::MaxPoolNodeKind:
+    case Kinded::Kind::PowNodeKind:
     case Kinded::Kind::QuantizeNodeKind:
     case Kinded::Kind::ReluNodeKind:
     case Kinded::Kind::RescaleQuantizedNodeKind:
     case Kinded::Kind::ReshapeNodeKind:
     case Kinded::Kind::SelectNodeKind:
     case Kinded::Kind::SigmoidNodeKind:
+    case Kinded::Kind::SoftMaxNodeKind:
     case Kinded::Kind::SubNodeKind:
     case Kinded::Kind::TanhNodeKind:
     case Kinded::Kind::TopKNodeKind:
@@ -191,13 +707,107 @@ bool CPUBackend::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     }
   }
 
+  // The 16-bit kernels of libjit cover the same nodes as the Interpreter: the
+  // arithmetic of fully connected and recurrent layers, and the data movement
+  // around them. FullyConnected and BatchedMatMul are lowered to MatMuls.
+  if (elementTy == ElemKind::Int16QTy) {
+    switch (opKind) {
+    case Kinded::Kind::AddNodeKind:
+    case Kinded::Kind::BatchedAddNodeKind:
+    case Kinded::Kind::BatchedMatMulNodeKind:
+    case Kinded::Kind::BroadcastNodeKind:
+    case Kinded::Kind::ConcatNodeKind:
+    case Kinded::Kind::DequantizeNodeKind:
+    case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::MatMulNodeKind:
+    case Kinded::Kind::MulNodeKind:
+    case Kinded::Kind::QuantizeNodeKind:
+    case Kinded::Kind::RescaleQuantizedNodeKind:
+    case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::SliceNodeKind:
+    case Kinded::Kind::SplatNodeKind:
+    case Kinded::Kind::SubNodeKind:
+    case Kinded::Kind::TransposeNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // Half precision tensors are only stored. MatMuls and SparseLengthsSums
+  // expand half precision weights and tables in registers.
+  if (elementTy == ElemKind::Float16Ty || elementTy == ElemKind::BFloat16Ty) {
+    switch (opKind) {
+    case Kinded::Kind::ConcatNodeKind:
+    case Kinded::Kind::ConvertToNodeKind:
+    case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::SliceNodeKind:
+    case Kinded::Kind::SparseLengthsWeightedSumNodeKind:
+    case Kinded::Kind::SplatNodeKind:
+    case Kinded::Kind::TransposeNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
+
   return true;
 }
 
 bool CPUBackend::shouldLower(const Node *N) const {
-  if (N->getKind() == Kinded::Kind::ConvolutionNodeKind)
+  switch (N->getKind()) {
+  case Kinded::Kind::ConvolutionNodeKind:
     return false;
-  return true;
+  case Kinded::Kind::BatchedMatMulNodeKind:
+    // libjit only has a floating point batched kernel.
+    return N->getType(0)->getElementType() != ElemKind::FloatTy;
+  case Kinded::Kind::LSTMUnitNodeKind:
+  case Kinded::Kind::GRUUnitNodeKind:
+    // The gates are computed by a single fused libjit kernel.
+    return N->getType(0)->getElementType() != ElemKind::FloatTy;
+  case Kinded::Kind::RNNSequenceNodeKind:
+  case Kinded::Kind::LSTMSequenceNodeKind:
+  case Kinded::Kind::GRUSequenceNodeKind:
+    // libjit runs all the time steps in one call, so the size of the code does
+    // not depend on the number of steps.
+    return N->getType(0)->getElementType() != ElemKind::FloatTy;
+  case Kinded::Kind::SGDNodeKind:
+    // The update of every weight is a single pass of a libjit kernel.
+    return N->getType(0)->getElementType() != ElemKind::FloatTy;
+  case Kinded::Kind::SigmoidCrossEntropyWithLogitsNodeKind:
+    // A single libjit kernel instead of about ten elementwise passes.
+    return N->getType(0)->getElementType() != ElemKind::FloatTy;
+  case Kinded::Kind::BatchNormalizationNodeKind:
+  case Kinded::Kind::BatchNormalizationGradNodeKind:
+  case Kinded::Kind::MeanVarNormalizationNodeKind:
+    // One pass per statistic and one elementwise pass, instead of the passes
+    // of the broadcasts, reductions and arithmetic of the lowering.
+    return N->getType(0)->getElementType() != ElemKind::FloatTy;
+  case Kinded::Kind::BroadcastNodeKind: {
+    // The data-parallel kernels read the broadcast operands in place.
+    auto elemTy = N->getType(0)->getElementType();
+    return (elemTy != ElemKind::FloatTy && elemTy != ElemKind::Int8QTy) ||
+           !llvm::cast<BroadcastNode>(N)->hasOnlyArithmeticUsers();
+  }
+  default:
+    return true;
+  }
+}
+
+bool glow::isCPUTargetARM() {
+  llvm::Triple triple(target.empty() ? llvm::sys::getProcessTriple()
+                                     : target.getValue());
+  switch (triple.getArch()) {
+  case llvm::Triple::aarch64:
+  case llvm::Triple::aarch64_be:
+  case llvm::Triple::arm:
+  case llvm::Triple::armeb:
+  case llvm::Triple::thumb:
+  case llvm::Triple::thumbeb:
+    return true;
+  default:
+    return false;
+  }
 }
 
 llvm::CallInst *glow::createCall(llvm::IRBuilder<> &builder,
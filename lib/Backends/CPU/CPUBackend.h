@@ -20,10 +20,13 @@
 #include "LLVMIRGen.h"
 #include "glow/Backends/Backend.h"
 #include "glow/Base/Tensor.h"
+#include "glow/Support/RuntimeAllocator.h"
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/IRBuilder.h"
 
+#include <algorithm>
+
 namespace glow {
 
 /// Helper function to create a new CallInst, with the specified \p builder, \p
@@ -32,10 +35,147 @@ namespace glow {
 llvm::CallInst *createCall(llvm::IRBuilder<> &builder, llvm::Function *callee,
                            llvm::ArrayRef<llvm::Value *> args);
 
+/// \returns true if the CPU backend generates code for an AArch64 or 32-bit
+/// ARM target, i.e. if -target names an ARM triple, or if no -target is given
+/// and the host is ARM. The graph transformations use it to prefer the
+/// kernels that are blocked for 128-bit NEON vectors.
+bool isCPUTargetARM();
+
 class CPUBackend : public BackendUsingGlowIR {
+  /// The number of threads used by each function compiled by this backend.
+  unsigned numThreads_;
+  /// The number of threads generating the machine code of each function.
+  unsigned codeGenThreads_;
+  /// Whether the compiled functions profile the time of their instructions.
+  bool instrumentTime_;
+  /// Whether the timed regions also read the hardware performance counters.
+  bool instrumentCounters_;
+  /// Whether the compiled functions compute the statistics of their float
+  /// outputs, and in one of how many executions.
+  bool instrumentHealth_;
+  unsigned healthSampleRate_;
+  /// Whether the functions are first compiled quickly and recompiled with the
+  /// full optimizations in the background.
+  bool tieredCompilation_;
+  /// The size of the cache that the intermediate activations of a tiled chain
+  /// of layers must fit in, in bytes, or 0 if the chains are not tiled.
+  size_t spatialTilingCacheSize_;
+  /// The bytes of constant weights that are prefetched ahead of the layers
+  /// that use them, or 0 if they are not prefetched.
+  size_t weightPrefetchBudget_;
+  /// The bits of the indices of the clustered weights, or 0 if the weights are
+  /// not clustered, and the number of weights of the smallest ones that are.
+  unsigned weightClusteringBits_;
+  size_t weightClusteringMinSize_;
+  /// The allocator of the runtime memory of the compiled functions.
+  RuntimeAllocator *allocator_;
+
 public:
-  /// Ctor.
-  CPUBackend() = default;
+  /// Ctor. The number of threads is initialized from the -cpu-num-threads
+  /// command line option, the number of code generation threads from
+  /// -cpu-codegen-threads, the time instrumentation from -instrument-time and
+  /// -instrument-counters, the health instrumentation from -instrument-health
+  /// and -instrument-health-rate, the tiered compilation from
+  /// -cpu-tiered-compilation, the spatial tiling from
+  /// -cpu-spatial-tiling-cache-kb, the weight prefetches from
+  /// -cpu-weight-prefetch-kb and the weight clustering from
+  /// -cpu-cluster-weights-bits and -cpu-cluster-weights-min. The functions
+  /// use the default runtime allocator, unless -cpu-huge-pages-weights or
+  /// -cpu-huge-pages-activations place their large blocks on huge pages.
+  CPUBackend();
+
+  /// Set the number of threads used to execute data-parallel kernels, matrix
+  /// multiplications and convolutions of the functions compiled after this
+  /// call. Each compiled function owns its own pool of \p numThreads threads,
+  /// unless -shared-thread-pool makes them share the pool of the process. A
+  /// value of 1 produces single-threaded code.
+  void setNumThreads(unsigned numThreads) { numThreads_ = numThreads; }
+
+  /// \returns the number of threads used by the compiled functions.
+  unsigned getNumThreads() const { return numThreads_; }
+
+  /// Generate the machine code of the functions compiled after this call on
+  /// \p numThreads threads. Every instruction and data-parallel kernel is
+  /// outlined into its own LLVM function, and the optimized module is split
+  /// into \p numThreads partitions, which are compiled in parallel and linked
+  /// by the JIT. The code that goes through the JIT cache is generated on one
+  /// thread.
+  void setCodeGenThreads(unsigned numThreads) { codeGenThreads_ = numThreads; }
+
+  /// \returns the number of threads generating the machine code.
+  unsigned getCodeGenThreads() const { return codeGenThreads_; }
+
+  /// Make the functions compiled after this call measure the time spent in
+  /// each of their instructions and data-parallel kernels, see
+  /// CPUFunction::getTimeProfile().
+  void setInstrumentTime(bool enable) { instrumentTime_ = enable; }
+
+  /// Make the regions timed by the functions compiled after this call also
+  /// read the hardware performance counters, see
+  /// CPUFunction::getCounterProfile(). It only applies to the functions whose
+  /// time is instrumented.
+  void setInstrumentCounters(bool enable) { instrumentCounters_ = enable; }
+
+  /// Make one in every \p sampleRate executions of the functions compiled
+  /// after this call compute the minimum, maximum, mean and the numbers of
+  /// NaNs and infinities of the float outputs of their instructions, see
+  /// CPUFunction::getHealthSample().
+  void setInstrumentHealth(bool enable, unsigned sampleRate = 1) {
+    instrumentHealth_ = enable;
+    healthSampleRate_ = std::max(1u, sampleRate);
+  }
+
+  /// Make the functions compiled after this call available after a quick
+  /// compilation with few optimizations. The function is then recompiled with
+  /// all of the optimizations on a background thread, and switches to the
+  /// optimized code once it is ready, see CPUFunction::hasTieredUp(). Code
+  /// found in the JIT cache and instrumented code are compiled only once.
+  void setTieredCompilation(bool enable) { tieredCompilation_ = enable; }
+
+  /// Split the chains of convolutions, pools and activations whose
+  /// intermediate activations exceed \p cacheSize bytes into horizontal
+  /// strips, which each flow through the whole chain before the next one
+  /// starts, so that the intermediate strips stay in the cache. Every strip
+  /// recomputes the rows of the previous layers that the windows of the
+  /// following ones overlap. 0 disables the tiling. It applies to the
+  /// functions optimized for inference after this call.
+  void setSpatialTilingCacheSize(size_t cacheSize) {
+    spatialTilingCacheSize_ = cacheSize;
+  }
+
+  /// Make the functions compiled after this call prefetch the constant
+  /// weights of their next layers into the last level cache on a helper
+  /// thread, keeping at most \p budget bytes prefetched ahead of the layers
+  /// that use them, see LLVMIRGen::setWeightPrefetchBudget(). 0 disables the
+  /// prefetches.
+  void setWeightPrefetchBudget(size_t budget) {
+    weightPrefetchBudget_ = budget;
+  }
+
+  /// Store the constant float weights of the MatMuls, e.g. of the fully
+  /// connected layers, and the tables of the SparseLengthsWeightedSums that
+  /// have at least \p minWeights elements as indices of \p codeBits bits, 4
+  /// or 8, into a codebook of 2^codeBits centroids, which the k-means
+  /// algorithm finds at compile time. Their kernels decode the weights through
+  /// the codebook, so they read 8 or 4 times fewer bytes than the float
+  /// weights. The clustering is lossy unless the weights have at most
+  /// 2^codeBits distinct values. 0 disables it. It applies to the functions
+  /// optimized for inference after this call.
+  void setWeightClustering(unsigned codeBits, size_t minWeights) {
+    assert((codeBits == 0 || codeBits == 4 || codeBits == 8) &&
+           "Invalid code size");
+    weightClusteringBits_ = codeBits;
+    weightClusteringMinSize_ = minWeights;
+  }
+
+  /// Make the functions compiled after this call take their activations and
+  /// the replicas of their weights from \p allocator, which must outlive them.
+  void setRuntimeAllocator(RuntimeAllocator &allocator) {
+    allocator_ = &allocator;
+  }
+
+  /// \returns the allocator of the runtime memory of the compiled functions.
+  RuntimeAllocator &getRuntimeAllocator() const { return *allocator_; }
 
   /// @name Backend methods.
   /// This is the implementation of the Backend interface.
@@ -51,11 +191,20 @@ public:
   void save(Function *F, llvm::StringRef outputDir,
             llvm::StringRef networkName) const override;
 
+  void save(llvm::ArrayRef<BundleEntry> entries, llvm::StringRef outputDir,
+            llvm::StringRef bundleName) const override;
+
   bool transformPostLowering(Function *F, CompilationMode mode) const override;
 
   bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override;
 
   bool shouldLower(const Node *N) const override;
+
+  /// Keep the data parallel nodes together, so that their instructions get
+  /// fused into the same data parallel kernels.
+  SchedulerKind getSchedulerKind() const override {
+    return SchedulerKind::DataParallel;
+  }
   /// @}
 
 protected:
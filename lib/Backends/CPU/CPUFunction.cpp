@@ -15,26 +15,544 @@
  */
 
 #include "CPUFunction.h"
+#include "LLVMIRGen.h"
 
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Nodes.h"
 #include "glow/Support/Compiler.h"
 #include "glow/Support/Memory.h"
+#include "glow/Support/NUMA.h"
+#include "glow/Support/PerfCounters.h"
+#include "glow/Support/Trace.h"
 
-using namespace glow;
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
 
-CPUFunction::CPUFunction(std::unique_ptr<llvm::orc::GlowJIT> JIT, void *heap)
-    : JIT_(std::move(JIT)), heap_(heap) {}
+#include <algorithm>
+#include <cstring>
+#include <thread>
 
-CPUFunction::~CPUFunction() { alignedFree(heap_); }
+using namespace glow;
 
-void CPUFunction::execute() {
-  auto sym = JIT_->findSymbol("jitmain");
+CPUFunction::CPUFunction(std::unique_ptr<llvm::orc::GlowJIT> JIT,
+                         RuntimeAllocator &allocator, void *heap,
+                         CPURuntimeInfo runtimeInfo,
+                         std::unique_ptr<ThreadPool> threadPool,
+                         ThreadPool *sharedThreadPool)
+    : JIT_(std::move(JIT)), allocator_(allocator), heap_(heap),
+      runtimeInfo_(std::move(runtimeInfo)),
+      ownedThreadPool_(std::move(threadPool)),
+      threadPool_(sharedThreadPool ? sharedThreadPool
+                                   : ownedThreadPool_.get()) {
+  if (!runtimeInfo_.timeProfileRegions.empty()) {
+    timeProfile_.resize(runtimeInfo_.timeProfileRegions.size());
+    if (runtimeInfo_.instrumentCounters) {
+      counterProfile_.resize(timeProfile_.size() * NumPerfCounters);
+    }
+  }
+  healthHistory_.resize(runtimeInfo_.healthTensors.size() * NumHealthStats *
+                        runtimeInfo_.healthHistorySize);
+  // Resolve the entry point once, so that concurrent executions do not need to
+  // query the JIT.
+  entry_ = bindCode(*JIT_);
+}
+
+CPUFunction::JitFuncType CPUFunction::bindCode(llvm::orc::GlowJIT &JIT) {
+  JitFuncType entry = nullptr;
+  auto sym = JIT.findSymbol("jitmain");
   assert(sym && "Unable to JIT the code!");
-  using JitFuncType = void (*)(void);
   auto address = sym.getAddress();
   if (address) {
-    JitFuncType funcPtr = reinterpret_cast<JitFuncType>(address.get());
-    funcPtr();
+    entry = reinterpret_cast<JitFuncType>(address.get());
   } else {
     GLOW_ASSERT(false && "Error getting address.");
   }
+
+  // Bind the thread pool to the code. The variables are missing if the code
+  // does not contain any parallel operations.
+  if (threadPool_) {
+    auto poolVar = JIT.findSymbol(LLVMIRGen::getThreadPoolVarName());
+    auto dispatcherVar = JIT.findSymbol(LLVMIRGen::getDispatcherVarName());
+    if (poolVar && dispatcherVar) {
+      auto poolAddress = poolVar.getAddress();
+      auto dispatcherAddress = dispatcherVar.getAddress();
+      GLOW_ASSERT(poolAddress && dispatcherAddress &&
+                  "Error getting address.");
+      LLVMIRGen::initParallelRuntime(
+          reinterpret_cast<void *>(poolAddress.get()),
+          reinterpret_cast<void *>(dispatcherAddress.get()), threadPool_);
+    }
+  }
+
+  // Let the runtime stop the runs. The variable is missing if the code has no
+  // cancellation checks.
+  if (auto shouldStopVar = JIT.findSymbol(LLVMIRGen::getShouldStopVarName())) {
+    auto shouldStopAddress = shouldStopVar.getAddress();
+    GLOW_ASSERT(shouldStopAddress && "Error getting address.");
+    LLVMIRGen::initCancellationRuntime(
+        reinterpret_cast<void *>(shouldStopAddress.get()));
+  }
+
+  // Let the helper thread prefetch the weights. The variable is missing if
+  // the code has no weight prefetches.
+  if (auto prefetchVar =
+          JIT.findSymbol(LLVMIRGen::getPrefetchWeightsVarName())) {
+    auto prefetchAddress = prefetchVar.getAddress();
+    GLOW_ASSERT(prefetchAddress && "Error getting address.");
+    LLVMIRGen::initPrefetchRuntime(
+        reinterpret_cast<void *>(prefetchAddress.get()));
+  }
+
+  // Bind the profile to the instrumented code.
+  if (!timeProfile_.empty()) {
+    auto profileVar = JIT.findSymbol(LLVMIRGen::getTimeProfileVarName());
+    assert(profileVar && "The instrumented code has no profile");
+    auto profileAddress = profileVar.getAddress();
+    GLOW_ASSERT(profileAddress && "Error getting address.");
+    *reinterpret_cast<uint64_t **>(profileAddress.get()) =
+        timeProfile_.data();
+  }
+  if (!counterProfile_.empty()) {
+    auto profileVar = JIT.findSymbol(LLVMIRGen::getCounterProfileVarName());
+    auto beginVar = JIT.findSymbol(LLVMIRGen::getCountersBeginVarName());
+    auto endVar = JIT.findSymbol(LLVMIRGen::getCountersEndVarName());
+    assert(profileVar && beginVar && endVar &&
+           "The instrumented code has no counter profile");
+    auto profileAddress = profileVar.getAddress();
+    auto beginAddress = beginVar.getAddress();
+    auto endAddress = endVar.getAddress();
+    GLOW_ASSERT(profileAddress && beginAddress && endAddress &&
+                "Error getting address.");
+    *reinterpret_cast<uint64_t **>(profileAddress.get()) =
+        counterProfile_.data();
+    LLVMIRGen::initCounterRuntime(reinterpret_cast<void *>(beginAddress.get()),
+                                  reinterpret_cast<void *>(endAddress.get()));
+  }
+  return entry;
+}
+
+void CPUFunction::startTierUp(TierUpFn compile) {
+  assert(!tierUpThread_.joinable() && "The function is already recompiling");
+  tierUpThread_ = std::thread([this, compile]() mutable {
+    ScopedTraceEvent trace(runtimeInfo_.name, "tier up");
+    auto JIT = compile();
+    // Release the code generator before binding the new code.
+    compile = nullptr;
+    auto entry = bindCode(*JIT);
+    tieredJIT_ = std::move(JIT);
+    entry_.store(entry, std::memory_order_release);
+    tieredUp_ = true;
+  });
+}
+
+void CPUFunction::waitForTierUp() {
+  if (tierUpThread_.joinable()) {
+    tierUpThread_.join();
+  }
+}
+
+/// \returns the size of the memory holding a replica of \p weights.
+static size_t
+getReplicaSize(llvm::ArrayRef<CPURuntimeInfo::ConstantWeight> weights) {
+  size_t size = 0;
+  for (const auto &weight : weights) {
+    size += alignedSize(weight.size, TensorAlignment);
+  }
+  return size;
+}
+
+CPUFunction::~CPUFunction() {
+  waitForTierUp();
+  if (numProfiledExecutions_ && !timeProfile_.empty()) {
+    dumpTimeProfile(llvm::outs());
+    if (!counterProfile_.empty()) {
+      dumpCounterProfile(llvm::outs());
+    }
+  }
+  if (getNumHealthSamples()) {
+    dumpHealth(llvm::outs());
+  }
+  if (heap_) {
+    allocator_.deallocate(heap_, runtimeInfo_.activationsMemSize,
+                          TensorAlignment, RuntimeMemoryKind::Activations);
+  }
+  size_t replicaSize = getReplicaSize(runtimeInfo_.constantWeights);
+  for (auto &replica : replicas_) {
+    allocator_.deallocate(replica.weights, replicaSize, TensorAlignment,
+                          RuntimeMemoryKind::ConstantWeights);
+  }
+}
+
+void CPUFunction::replicateWeightsPerNUMANode() {
+  replicateWeightsPerNUMANode(getNumNUMANodes());
+}
+
+void CPUFunction::replicateWeightsPerNUMANode(unsigned numNodes) {
+  assert(replicas_.empty() && "The weights are already replicated");
+  const auto &weights = runtimeInfo_.constantWeights;
+  if (numNodes < 2 || weights.empty()) {
+    return;
+  }
+
+  // Every replica holds the weights one after another at the same offsets.
+  std::vector<size_t> weightOffsets;
+  size_t size = 0;
+  for (const auto &weight : weights) {
+    weightOffsets.push_back(size);
+    size += alignedSize(weight.size, TensorAlignment);
+  }
+
+  // Build each replica on a thread running on its node. Nodes without CPUs,
+  // or that the machine does not have, get a replica too, although no
+  // execution will pick it.
+  replicas_.resize(numNodes);
+  std::vector<std::thread> threads;
+  for (unsigned node = 0; node < numNodes; node++) {
+    threads.emplace_back([&, node]() {
+      pinCurrentThread(getCPUsOfNUMANode(node));
+      auto &replica = replicas_[node];
+      auto *base = static_cast<uint8_t *>(allocator_.allocate(
+          size, TensorAlignment, RuntimeMemoryKind::ConstantWeights));
+      for (size_t i = 0, e = weights.size(); i < e; i++) {
+        memcpy(base + weightOffsets[i], weights[i].data, weights[i].size);
+      }
+      replica.weights = base;
+      replica.offsets = runtimeInfo_.offsets;
+      for (const auto &slot : runtimeInfo_.constantWeightSlots) {
+        replica.offsets[slot.valueNumber] =
+            reinterpret_cast<size_t>(base) + weightOffsets[slot.weight] +
+            slot.byteOffset;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+bool CPUFunction::bindVariable(const Variable *V, Tensor *T) {
+  GLOW_ASSERT(T->getType().isEqual(*V->getType()) &&
+              "The tensor does not match the type of the variable");
+  bool isBound = false;
+  auto address = reinterpret_cast<size_t>(T->getUnsafePtr());
+  for (const auto &slot : runtimeInfo_.variableSlots) {
+    if (slot.variable == V) {
+      runtimeInfo_.offsets[slot.valueNumber] = address + slot.byteOffset;
+      isBound = true;
+    }
+  }
+
+  // The replicas keep their own copies of the constant weights, at the same
+  // offsets in every replica.
+  size_t replicaOffset = 0;
+  for (auto &weight : runtimeInfo_.constantWeights) {
+    if (weight.variable == V) {
+      weight.data = reinterpret_cast<const uint8_t *>(T->getUnsafePtr());
+      for (auto &replica : replicas_) {
+        memcpy(static_cast<uint8_t *>(replica.weights) + replicaOffset,
+               weight.data, weight.size);
+      }
+    }
+    replicaOffset += alignedSize(weight.size, TensorAlignment);
+  }
+  return isBound;
+}
+
+void CPUFunction::updateWeights(llvm::ArrayRef<Variable *> vars) {
+  // The payloads stay where they are, only the replicas of the constant
+  // weights need to be copied again.
+  for (auto *V : vars) {
+    bindVariable(V, &V->getPayload());
+  }
+}
+
+MemoryUsage CPUFunction::getMemoryUsage() const {
+  // The code reads and writes the payloads of the variables in place, and the
+  // NUMA replicas of the constant weights are owned by the function.
+  MemoryUsage usage;
+  llvm::DenseSet<const Variable *> constantVars;
+  for (const auto &weight : runtimeInfo_.constantWeights) {
+    constantVars.insert(weight.variable);
+    usage.constantWeights += weight.size;
+  }
+  llvm::DenseSet<const Variable *> mutableVars;
+  for (const auto &slot : runtimeInfo_.variableSlots) {
+    if (!constantVars.count(slot.variable) &&
+        mutableVars.insert(slot.variable).second) {
+      usage.mutableWeights += slot.variable->getType()->getSizeInBytes();
+    }
+  }
+  usage.activations = runtimeInfo_.activationsMemSize;
+  usage.code = JIT_->getLoadedSize();
+  if (tieredUp_) {
+    usage.code += tieredJIT_->getLoadedSize();
+  }
+  usage.scratch =
+      replicas_.size() * getReplicaSize(runtimeInfo_.constantWeights);
+  return usage;
+}
+
+void CPUFunction::resetTimeProfile() {
+  std::fill(timeProfile_.begin(), timeProfile_.end(), 0);
+  std::fill(counterProfile_.begin(), counterProfile_.end(), 0);
+  numProfiledExecutions_ = 0;
+}
+
+void CPUFunction::dumpTimeProfile(llvm::raw_ostream &os) const {
+  const auto &regions = runtimeInfo_.timeProfileRegions;
+  size_t numExecutions = numProfiledExecutions_;
+  uint64_t total = 0;
+  for (auto ns : timeProfile_) {
+    total += ns;
+  }
+  os << "Time profile over " << numExecutions << " executions, "
+     << llvm::format("%.3f", numExecutions ? total * 1e-3 / numExecutions : 0.)
+     << " us per execution:\n";
+  if (!numExecutions) {
+    return;
+  }
+  os << "       time(us)      %   GFLOP/s     GB/s  kind: instructions\n";
+  for (size_t i = 0, e = regions.size(); i < e; i++) {
+    // A FLOP per nanosecond is a GFLOP per second.
+    double ns = timeProfile_[i] ? timeProfile_[i] : 1;
+    os << llvm::format("%15.3f %6.2f %9.3f %8.3f  ",
+                       timeProfile_[i] * 1e-3 / numExecutions,
+                       total ? timeProfile_[i] * 100. / total : 0.,
+                       regions[i].flops * numExecutions / ns,
+                       regions[i].bytes * numExecutions / ns)
+       << regions[i].kind << ": " << regions[i].name << "\n";
+  }
+}
+
+void CPUFunction::dumpCounterProfile(llvm::raw_ostream &os) const {
+  const auto &regions = runtimeInfo_.timeProfileRegions;
+  size_t numExecutions = numProfiledExecutions_;
+  os << "Hardware counter profile over " << numExecutions
+     << " executions, per execution:\n";
+  if (!isPerfCounterAvailable(PerfCounter::Cycles) &&
+      !isPerfCounterAvailable(PerfCounter::Instructions)) {
+    os << "  the hardware counters are unavailable, see perf_event_paranoid\n";
+    return;
+  }
+  if (!numExecutions) {
+    return;
+  }
+  // On a core that reaches an IPC of several instructions per cycle, a region
+  // with an IPC below 1 and many LLC misses per thousand instructions waits
+  // for the memory, and one with a high IPC or FP ops per cycle is bound by
+  // the arithmetic.
+  os << "         Mcycles     Minstrs    IPC   LLC misses   MPKI"
+        "     MFP ops  FP/cycle  kind: instructions\n";
+  for (size_t i = 0, e = regions.size(); i < e; i++) {
+    const uint64_t *counters = &counterProfile_[i * NumPerfCounters];
+    double cycles = counters[unsigned(PerfCounter::Cycles)];
+    double instrs = counters[unsigned(PerfCounter::Instructions)];
+    double misses = counters[unsigned(PerfCounter::LLCMisses)];
+    double fpOps = counters[unsigned(PerfCounter::FPOps)];
+    os << llvm::format("%16.3f %11.3f %6.2f %12.0f %6.2f %11.3f %9.2f  ",
+                       cycles * 1e-6 / numExecutions,
+                       instrs * 1e-6 / numExecutions,
+                       cycles ? instrs / cycles : 0.,
+                       misses / numExecutions,
+                       instrs ? misses * 1e3 / instrs : 0.,
+                       fpOps * 1e-6 / numExecutions,
+                       cycles ? fpOps / cycles : 0.)
+       << regions[i].kind << ": " << regions[i].name << "\n";
+  }
+}
+
+void CPUFunction::beginHealthSample(std::vector<size_t> &offsets,
+                                    std::vector<float> &stats) {
+  if (runtimeInfo_.healthTensors.empty()) {
+    return;
+  }
+  size_t &statsAddr = offsets[runtimeInfo_.healthOffsetIndex];
+  if (numHealthExecutions_++ % runtimeInfo_.healthSampleRate) {
+    statsAddr = 0;
+    return;
+  }
+  stats.resize(runtimeInfo_.healthTensors.size() * NumHealthStats);
+  statsAddr = reinterpret_cast<size_t>(stats.data());
+}
+
+void CPUFunction::endHealthSample(const std::vector<float> &stats) {
+  if (stats.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(healthMutex_);
+  size_t slot = numHealthSamples_++ % runtimeInfo_.healthHistorySize;
+  std::copy(stats.begin(), stats.end(),
+            healthHistory_.begin() + slot * stats.size());
+}
+
+size_t CPUFunction::getNumHealthSamples() const {
+  std::lock_guard<std::mutex> lock(healthMutex_);
+  return std::min<size_t>(numHealthSamples_, runtimeInfo_.healthHistorySize);
+}
+
+std::vector<TensorHealth> CPUFunction::getHealthSample(size_t age) const {
+  std::lock_guard<std::mutex> lock(healthMutex_);
+  size_t numTensors = runtimeInfo_.healthTensors.size();
+  assert(age < std::min<size_t>(numHealthSamples_,
+                                runtimeInfo_.healthHistorySize) &&
+         "The sample is not in the history");
+  size_t slot =
+      (numHealthSamples_ - 1 - age) % runtimeInfo_.healthHistorySize;
+  const float *raw = &healthHistory_[slot * numTensors * NumHealthStats];
+  std::vector<TensorHealth> sample(numTensors);
+  for (size_t i = 0; i < numTensors; i++, raw += NumHealthStats) {
+    auto &health = sample[i];
+    health.numFinite = raw[3];
+    health.numNaNs = raw[4];
+    health.numInfs = raw[5];
+    if (health.numFinite) {
+      health.min = raw[0];
+      health.max = raw[1];
+      health.mean = raw[2] / health.numFinite;
+    }
+  }
+  return sample;
+}
+
+void CPUFunction::dumpHealth(llvm::raw_ostream &os) const {
+  size_t numSamples = getNumHealthSamples();
+  os << "Tensor health of the last of " << numSamples
+     << " sampled executions, with the range over all of them:\n";
+  if (!numSamples) {
+    return;
+  }
+  std::vector<TensorHealth> latest = getHealthSample(0);
+  std::vector<TensorHealth> range = latest;
+  for (size_t age = 1; age < numSamples; age++) {
+    auto sample = getHealthSample(age);
+    for (size_t i = 0, e = sample.size(); i < e; i++) {
+      if (!sample[i].numFinite) {
+        continue;
+      }
+      if (!range[i].numFinite) {
+        range[i] = sample[i];
+        continue;
+      }
+      range[i].min = std::min(range[i].min, sample[i].min);
+      range[i].max = std::max(range[i].max, sample[i].max);
+    }
+  }
+  os << "            min          max         mean   history min  history max"
+        "   NaNs   Infs  tensor\n";
+  const auto &names = runtimeInfo_.healthTensors;
+  for (size_t i = 0, e = names.size(); i < e; i++) {
+    const auto &health = latest[i];
+    os << llvm::format("%13g %12g %12g %13g %12g %6zu %6zu  ", health.min,
+                       health.max, health.mean, range[i].min, range[i].max,
+                       health.numNaNs, health.numInfs)
+       << names[i];
+    if (health.numNaNs || health.numInfs) {
+      os << "  <- not finite";
+    }
+    os << "\n";
+  }
+}
+
+std::vector<size_t> &CPUFunction::getOffsets() {
+  if (replicas_.empty()) {
+    return runtimeInfo_.offsets;
+  }
+  unsigned node = getCurrentNUMANode();
+  return node < replicas_.size() ? replicas_[node].offsets
+                                 : runtimeInfo_.offsets;
+}
+
+void CPUFunction::execute() {
+  ScopedTraceEvent trace(runtimeInfo_.name, "execute");
+  auto &offsets = getOffsets();
+  std::vector<float> healthStats;
+  beginHealthSample(offsets, healthStats);
+  auto entry = entry_.load(std::memory_order_acquire);
+  entry(static_cast<uint8_t *>(heap_), offsets.data());
+  numProfiledExecutions_++;
+  endHealthSample(healthStats);
+}
+
+void CPUFunction::execute(Context &ctx) {
+  ScopedTraceEvent trace(runtimeInfo_.name, "execute");
+  // Use the tensors from the context for the placeholders, and the weights
+  // that are local to the NUMA node of the calling thread.
+  std::vector<size_t> offsets(getOffsets());
+  for (const auto &slot : runtimeInfo_.placeholderSlots) {
+    Tensor *T = ctx.get(slot.placeholder);
+    GLOW_ASSERT(T && "The context does not provide a tensor for a placeholder");
+    GLOW_ASSERT(T->getType().isEqual(*slot.placeholder->getType()) &&
+                "The tensor does not match the type of the placeholder");
+    offsets[slot.valueNumber] =
+        reinterpret_cast<size_t>(T->getUnsafePtr()) + slot.byteOffset;
+  }
+
+  // Each invocation gets its own scratch memory for the activations. It is
+  // allocated by the calling thread, so that its pages land on the node the
+  // invocation runs on. The weights are shared between all invocations. The
+  // default allocator hands the same buffers out again to later invocations.
+  size_t size = runtimeInfo_.activationsMemSize;
+  void *activations = nullptr;
+  if (size) {
+    activations = allocator_.allocate(size, TensorAlignment,
+                                      RuntimeMemoryKind::Activations);
+  }
+  std::vector<float> healthStats;
+  beginHealthSample(offsets, healthStats);
+  auto entry = entry_.load(std::memory_order_acquire);
+  entry(static_cast<uint8_t *>(activations), offsets.data());
+  numProfiledExecutions_++;
+  endHealthSample(healthStats);
+  if (activations) {
+    allocator_.deallocate(activations, size, TensorAlignment,
+                          RuntimeMemoryKind::Activations);
+  }
+}
+
+CPUFunction::ExecutionHandle::ExecutionHandle(
+    CPUFunction &function, llvm::ArrayRef<Placeholder *> placeholders)
+    : function_(function), offsets_(function.getOffsets()) {
+  for (const auto &slot : function.runtimeInfo_.placeholderSlots) {
+    auto it = std::find(placeholders.begin(), placeholders.end(),
+                        slot.placeholder);
+    if (it != placeholders.end()) {
+      slots_.push_back({size_t(it - placeholders.begin()), slot.valueNumber,
+                        slot.byteOffset});
+    }
+  }
+  size_t size = function.runtimeInfo_.activationsMemSize;
+  if (size) {
+    activations_ = function.allocator_.allocate(
+        size, TensorAlignment, RuntimeMemoryKind::Activations);
+  }
+}
+
+CPUFunction::ExecutionHandle::~ExecutionHandle() {
+  if (activations_) {
+    function_.allocator_.deallocate(activations_,
+                                    function_.runtimeInfo_.activationsMemSize,
+                                    TensorAlignment,
+                                    RuntimeMemoryKind::Activations);
+  }
+}
+
+void CPUFunction::ExecutionHandle::run(void *const *buffers) {
+  for (const auto &slot : slots_) {
+    offsets_[slot.valueNumber] =
+        reinterpret_cast<size_t>(buffers[slot.buffer]) + slot.byteOffset;
+  }
+  // A sampled call allocates the buffer of the statistics.
+  std::vector<float> healthStats;
+  function_.beginHealthSample(offsets_, healthStats);
+  auto entry = function_.entry_.load(std::memory_order_acquire);
+  entry(static_cast<uint8_t *>(activations_), offsets_.data());
+  function_.numProfiledExecutions_++;
+  function_.endHealthSample(healthStats);
+}
+
+std::unique_ptr<CPUFunction::ExecutionHandle>
+CPUFunction::createExecutionHandle(llvm::ArrayRef<Placeholder *> placeholders) {
+  return std::unique_ptr<ExecutionHandle>(
+      new ExecutionHandle(*this, placeholders));
 }
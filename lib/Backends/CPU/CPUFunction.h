@@ -17,28 +17,366 @@
 #define GLOW_BACKENDS_CPU_CPUFUNCTION_H
 
 #include "GlowJIT.h"
+#include "LLVMIRGen.h"
 
 #include "glow/Backends/CompiledFunction.h"
+#include "glow/Support/RuntimeAllocator.h"
+#include "glow/Support/ThreadPool.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace glow {
 
+class Placeholder;
+class Tensor;
+class Variable;
+
+/// Information about the memory that needs to be provided to the JITted code
+/// at runtime.
+struct CPURuntimeInfo {
+  /// Describes an entry of the offsets array, which holds the address of a
+  /// tensor backing a placeholder or of a view into such a tensor.
+  struct PlaceholderSlot {
+    /// The placeholder.
+    Placeholder *placeholder;
+    /// The index of the entry in the offsets array.
+    size_t valueNumber;
+    /// The offset of the view from the beginning of the tensor in bytes.
+    size_t byteOffset;
+  };
+  /// Describes an entry of the offsets array, which holds the address of a
+  /// constant weight or of a view into such a weight.
+  struct ConstantWeightSlot {
+    /// The index of the weight in constantWeights.
+    size_t weight;
+    /// The index of the entry in the offsets array.
+    size_t valueNumber;
+    /// The offset of the view from the beginning of the weight in bytes.
+    size_t byteOffset;
+  };
+  /// Describes an entry of the offsets array, which holds the address of the
+  /// payload of a variable or of a view into such a payload.
+  struct VariableSlot {
+    /// The variable.
+    const Variable *variable;
+    /// The index of the entry in the offsets array.
+    size_t valueNumber;
+    /// The offset of the view from the beginning of the payload in bytes.
+    size_t byteOffset;
+  };
+  /// A weight that the function never writes to.
+  struct ConstantWeight {
+    /// The variable of the weight.
+    const Variable *variable;
+    /// The payload of the weight.
+    const uint8_t *data;
+    /// The size of the payload in bytes.
+    size_t size;
+  };
+  /// The name of the compiled function.
+  std::string name;
+  /// Amount of memory to be allocated for activations.
+  size_t activationsMemSize{0};
+  /// The offsets array computed at compile time. It refers to the tensors of
+  /// the context the function was compiled with.
+  std::vector<size_t> offsets;
+  /// The entries of the offsets array that depend on the context.
+  std::vector<PlaceholderSlot> placeholderSlots;
+  /// The entries of the offsets array that refer to the variables.
+  std::vector<VariableSlot> variableSlots;
+  /// The weights that can be replicated, since the function only reads them.
+  std::vector<ConstantWeight> constantWeights;
+  /// The entries of the offsets array that refer to the constant weights.
+  std::vector<ConstantWeightSlot> constantWeightSlots;
+  /// The regions timed by the code, if it is instrumented.
+  std::vector<TimeProfileRegion> timeProfileRegions;
+  /// Whether the timed regions also read the hardware performance counters.
+  bool instrumentCounters{false};
+  /// The tensors whose statistics the code computes, if the health is
+  /// instrumented.
+  std::vector<std::string> healthTensors;
+  /// The entry of the offsets array that holds the address of the statistics.
+  size_t healthOffsetIndex{0};
+  /// One execution in this many computes the statistics.
+  unsigned healthSampleRate{1};
+  /// The number of sampled executions kept in the history of the statistics.
+  unsigned healthHistorySize{1};
+};
+
+/// The statistics of a tensor checked by the health instrumentation, over the
+/// elements that were sampled.
+struct TensorHealth {
+  /// The extrema of the finite elements, which are 0 if there are none.
+  float min{0};
+  float max{0};
+  /// The mean of the finite elements.
+  float mean{0};
+  /// The number of finite elements that were sampled.
+  size_t numFinite{0};
+  size_t numNaNs{0};
+  size_t numInfs{0};
+};
+
 /// A Glow IR function compiled for the CPU using LLVM.
 class CPUFunction final : public CompiledFunction {
+  /// The type of the JITted entry point. It takes the base address of the
+  /// activations and the offsets array.
+  using JitFuncType = void (*)(uint8_t *, size_t *);
   /// The LLVM JIT engine. The jit must be initialized after the ctor
   /// initializes the LLVM backends.
   std::unique_ptr<llvm::orc::GlowJIT> JIT_;
-  /// This represents the heap, that stores the activations at runtime.
+  /// The allocator of the activations and of the replicas of the weights.
+  RuntimeAllocator &allocator_;
+  /// This represents the heap, that stores the activations at runtime when
+  /// the function is executed with the context it was compiled with. It was
+  /// taken from allocator_.
   void *heap_;
+  /// The memory layout expected by the JITted code.
+  CPURuntimeInfo runtimeInfo_;
+  /// The address of the JITted entry point. The background recompilation
+  /// replaces it while the function may be executing.
+  std::atomic<JitFuncType> entry_{nullptr};
+  /// The JIT holding the code of the background recompilation, once it is
+  /// done. The code of JIT_ stays alive for the executions that started
+  /// before.
+  std::unique_ptr<llvm::orc::GlowJIT> tieredJIT_;
+  /// The thread running the background recompilation.
+  std::thread tierUpThread_;
+  /// Whether the executions use the code of the background recompilation.
+  std::atomic<bool> tieredUp_{false};
+  /// The pool of threads that the function owns, if it does not share one.
+  std::unique_ptr<ThreadPool> ownedThreadPool_;
+  /// The pool of threads executing the parallel parts of the JITted code,
+  /// either ownedThreadPool_ or the shared pool of the process. The code
+  /// refers to the pool by its address. It is null if the function is
+  /// single-threaded.
+  ThreadPool *threadPool_;
+  /// The copy of the constant weights that lives on a NUMA node.
+  struct NUMAReplica {
+    /// The memory holding the copies of the weights.
+    void *weights{nullptr};
+    /// The offsets array referring to the copies of the weights.
+    std::vector<size_t> offsets;
+  };
+  /// The replicas of the constant weights, indexed by the NUMA node. It is
+  /// empty if the weights are not replicated.
+  std::vector<NUMAReplica> replicas_;
+  /// The nanoseconds spent in each region of the instrumented code, summed
+  /// over the executions. The JITted code adds to the entries atomically.
+  std::vector<uint64_t> timeProfile_;
+  /// The increments of the hardware counters of each region, NumPerfCounters
+  /// entries per region, summed over the executions. It is empty if the
+  /// counters are not instrumented.
+  std::vector<uint64_t> counterProfile_;
+  /// The number of executions since the profile was reset.
+  std::atomic<size_t> numProfiledExecutions_{0};
+  /// The number of executions that decided whether to compute the health
+  /// statistics.
+  std::atomic<size_t> numHealthExecutions_{0};
+  /// The ring buffer of the raw statistics of the last sampled executions,
+  /// NumHealthStats entries per tensor and healthTensors entries per
+  /// execution.
+  std::vector<float> healthHistory_;
+  /// The number of sampled executions written to the history.
+  size_t numHealthSamples_{0};
+  /// Guards the history of the statistics.
+  mutable std::mutex healthMutex_;
+
+  /// Bind the thread pool and the profile of the function to the code held by
+  /// \p JIT. \returns the entry point of the code.
+  JitFuncType bindCode(llvm::orc::GlowJIT &JIT);
+
+  /// \returns the offsets array that the calling thread should use. It refers
+  /// to the weights that are local to the NUMA node of the thread.
+  std::vector<size_t> &getOffsets();
+
+  /// Decide whether the execution using \p offsets computes the health
+  /// statistics, and point the code at \p stats, which is resized to hold
+  /// them, if so.
+  void beginHealthSample(std::vector<size_t> &offsets,
+                         std::vector<float> &stats);
+
+  /// Add \p stats of a finished execution to the history, if it was sampled.
+  void endHealthSample(const std::vector<float> &stats);
 
 public:
-  /// Ctor.
-  CPUFunction(std::unique_ptr<llvm::orc::GlowJIT> JIT, void *heap);
+  /// Ctor. The function takes the ownership of \p heap, which \p allocator
+  /// allocated, and allocates the rest of its runtime memory from
+  /// \p allocator, which must outlive the function. The parallel parts run
+  /// on \p threadPool, or on \p sharedThreadPool, which must outlive the
+  /// function, if it is given.
+  CPUFunction(std::unique_ptr<llvm::orc::GlowJIT> JIT,
+              RuntimeAllocator &allocator, void *heap,
+              CPURuntimeInfo runtimeInfo,
+              std::unique_ptr<ThreadPool> threadPool = nullptr,
+              ThreadPool *sharedThreadPool = nullptr);
+
+  /// The type of the recompilation of the function. It returns the JIT
+  /// holding the new code, whose machine code is already generated.
+  using TierUpFn = std::function<std::unique_ptr<llvm::orc::GlowJIT>()>;
+
+  /// Start the recompilation \p compile on a background thread, and make the
+  /// executions that start after it is done use its code. The function keeps
+  /// executing its current code in the meantime.
+  void startTierUp(TierUpFn compile);
+
+  /// \returns true if the executions use the code of the background
+  /// recompilation.
+  bool hasTieredUp() const { return tieredUp_; }
+
+  /// Wait until the background recompilation, if any, is done.
+  void waitForTierUp();
+
+  /// \returns the number of threads used to execute this function.
+  unsigned getNumThreads() const {
+    return threadPool_ ? threadPool_->getNumThreads() : 1;
+  }
+
+  /// Copy the constant weights to every NUMA node of the machine, so that
+  /// every execution reads the weights from the memory of the node it runs
+  /// on. The pages of a copy are first touched by a thread running on its
+  /// node, which makes the kernel place them there. The executions no longer
+  /// read the payloads of the constant variables, so a payload that is
+  /// modified in place is only seen after updateWeights() or bindVariable()
+  /// copies it to the replicas.
+  void replicateWeightsPerNUMANode();
+
+  /// Copy the constant weights to the NUMA nodes 0 to \p numNodes - 1, which
+  /// may be more than the machine has, e.g. to test the replicas on a machine
+  /// with a single node. Nothing is copied if \p numNodes is less than 2.
+  void replicateWeightsPerNUMANode(unsigned numNodes);
+
+  /// \returns the number of NUMA nodes the weights are replicated to, or 0 if
+  /// they are not replicated.
+  unsigned getNumWeightReplicas() const { return replicas_.size(); }
+
+  /// Make the executions read and write \p T instead of the payload of the
+  /// variable \p V, without recompiling the function. \p T must have the type
+  /// of \p V and outlive the function, or the next call of this method for
+  /// \p V. The replicas of a constant weight are updated with the content of
+  /// \p T. The function must not be executing. \returns false if the code
+  /// does not refer to the payload of \p V, for instance because the backend
+  /// transformed the variable into another one at compile time.
+  bool bindVariable(const Variable *V, Tensor *T);
+
+  /// An execution of the function prepared for the calls with the least
+  /// overhead, like the inferences of single samples. The handle owns the
+  /// memory of the activations and an offsets array, in which every call binds
+  /// the placeholders the handle was created for to raw pointers. A call
+  /// neither allocates memory nor looks anything up, unless it samples the
+  /// health statistics. A handle is used by one thread at a time, and the
+  /// handles of a function may run concurrently.
+  class ExecutionHandle {
+    friend class CPUFunction;
+    /// An entry of the offsets array that refers to a placeholder.
+    struct Slot {
+      /// The index of the buffer of the placeholder in the calls.
+      size_t buffer;
+      /// The index of the entry in the offsets array.
+      size_t valueNumber;
+      /// The offset of the view from the beginning of the tensor in bytes.
+      size_t byteOffset;
+    };
+    /// The function.
+    CPUFunction &function_;
+    /// The offsets array of the calls.
+    std::vector<size_t> offsets_;
+    /// The entries of the offsets array that the calls bind.
+    std::vector<Slot> slots_;
+    /// The memory of the activations, or null if there are none.
+    void *activations_{nullptr};
+
+    ExecutionHandle(CPUFunction &function,
+                    llvm::ArrayRef<Placeholder *> placeholders);
+
+  public:
+    ~ExecutionHandle();
+
+    /// Execute the function with \p buffers backing the placeholders that
+    /// the handle was created for, in the same order. The buffers hold
+    /// tensors of the types of the placeholders. The other placeholders are
+    /// backed by the tensors of the context the function was compiled with.
+    void run(void *const *buffers);
+  };
+
+  /// \returns a handle executing the function with the buffers of each call
+  /// backing \p placeholders. The handle uses the weights local to the NUMA
+  /// node of the calling thread, and must not outlive the function.
+  std::unique_ptr<ExecutionHandle>
+  createExecutionHandle(llvm::ArrayRef<Placeholder *> placeholders);
+
+  /// \returns the regions timed by the code: its instructions and
+  /// data-parallel kernels. It is empty if the code is not instrumented.
+  llvm::ArrayRef<TimeProfileRegion> getTimeProfileRegions() const {
+    return runtimeInfo_.timeProfileRegions;
+  }
+
+  /// \returns the nanoseconds spent in each of the regions, summed over the
+  /// executions since the profile was reset. The profile must not be read
+  /// while the function is executing.
+  llvm::ArrayRef<uint64_t> getTimeProfile() const { return timeProfile_; }
+
+  /// \returns the number of executions the profile covers.
+  size_t getNumProfiledExecutions() const { return numProfiledExecutions_; }
+
+  /// \returns the increments of the hardware counters in each of the
+  /// regions, summed over the executions since the profile was reset. The
+  /// entry i * NumPerfCounters + c holds the counter c of the region i, see
+  /// PerfCounter. Only the thread that executes the entry point is counted,
+  /// not the threads of the pool. It is empty if the code is not instrumented
+  /// with the counters.
+  llvm::ArrayRef<uint64_t> getCounterProfile() const {
+    return counterProfile_;
+  }
+
+  /// Clear the profiles.
+  void resetTimeProfile();
+
+  /// Print the average time of the regions per execution, with the achieved
+  /// GFLOP/s and GB/s and the share of the total time, to \p os.
+  void dumpTimeProfile(llvm::raw_ostream &os) const;
+
+  /// Print the average hardware counters of the regions per execution, with
+  /// the instructions per cycle and the LLC misses per thousand instructions,
+  /// to \p os.
+  void dumpCounterProfile(llvm::raw_ostream &os) const;
+
+  /// \returns the names of the tensors checked by the health instrumentation.
+  /// It is empty if the code is not instrumented.
+  llvm::ArrayRef<std::string> getHealthTensors() const {
+    return runtimeInfo_.healthTensors;
+  }
+
+  /// \returns the number of sampled executions in the history of the health
+  /// statistics.
+  size_t getNumHealthSamples() const;
+
+  /// \returns the statistics of the tensors of getHealthTensors() in the
+  /// sampled execution \p age, where 0 is the most recent one.
+  /// \pre age < getNumHealthSamples()
+  std::vector<TensorHealth> getHealthSample(size_t age) const;
+
+  /// Print the statistics of the most recent sampled execution to \p os,
+  /// with the extrema over the history, and flag the tensors holding NaNs or
+  /// infinities.
+  void dumpHealth(llvm::raw_ostream &os) const;
 
   /// \name CompiledFunction interface
   ///@{
   ~CPUFunction() override;
 
   void execute() override;
+
+  void execute(Context &ctx) override;
+
+  void updateWeights(llvm::ArrayRef<Variable *> vars) override;
+
+  MemoryUsage getMemoryUsage() const override;
   ///@}
 };
 
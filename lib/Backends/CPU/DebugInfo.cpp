@@ -173,10 +173,11 @@ LLVMIRGen::getOrCreateFunctionDebugInfo(llvm::Function *F, llvm::DIScope *scope,
 }
 
 /// Create and initialize global variables holding the bases addresses of
-/// different memory areas.
+/// different memory areas. The variables are thread local if \p threadLocal
+/// is true, so that concurrent executions describe their own memory areas.
 static void initBaseAddressesOfMemoryAreas(DebugInfo &dbgInfo,
                                            llvm::IRBuilder<> &builder,
-                                           llvm::Module &M) {
+                                           llvm::Module &M, bool threadLocal) {
   auto *main = M.getFunction("main");
   // Initialize the names of base address variables.
   // Only 3 memory areas are currently supported: constant weights, mutable
@@ -206,6 +207,7 @@ static void initBaseAddressesOfMemoryAreas(DebugInfo &dbgInfo,
         llvm::GlobalValue::CommonLinkage, nullptr, name);
     baseAddressVar->setInitializer(
         llvm::ConstantPointerNull::get(builder.getInt8PtrTy()));
+    baseAddressVar->setThreadLocal(threadLocal);
     // Initialize the variable by the corresponding base address passed to
     // "main" as a parameter.
     builder.CreateStore(main->args().begin() + idx, baseAddressVar);
@@ -246,7 +248,8 @@ void LLVMIRGen::initDebugInfo() {
   auto *main = getModule().getFunction("main");
 
   // Init global variables holding base address of different memory areas.
-  initBaseAddressesOfMemoryAreas(dbgInfo_, *builder_, getModule());
+  initBaseAddressesOfMemoryAreas(dbgInfo_, *builder_, getModule(),
+                                 threadLocalGlobals_);
 
   // Construct the DIBuilder.
   DIBuilder_ = llvm::make_unique<llvm::DIBuilder>(getModule());
@@ -27,6 +27,8 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 
+#include <algorithm>
+
 using namespace glow;
 
 using llvm::cast;
@@ -43,6 +45,46 @@ static llvm::cl::opt<bool>
                                      "operations with constant dimensions"),
                       llvm::cl::init(true), llvm::cl::cat(CPUBackendCat));
 
+/// The kernels whose calls are specialized for the constant arguments, even if
+/// some of their other arguments are only known at runtime, e.g. the range of
+/// iterations of a chunk executed by a worker thread. This makes the
+/// dimensions, kernel sizes, strides and pads of the hot kernels constant, so
+/// that LLVM can fully unroll and vectorize their inner loops.
+static llvm::cl::list<std::string> jitSpecializeKernels(
+    "jit-specialize-kernels",
+    llvm::cl::desc("Comma-separated names of the libjit kernels that are "
+                   "specialized for their constant arguments even if some "
+                   "other arguments are not constant (an empty value disables "
+                   "it, the default is the convolutions and the poolings)"),
+    llvm::cl::CommaSeparated, llvm::cl::ZeroOrMore,
+    llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> dumpJITSpecializations(
+    "dump-jit-specializations",
+    llvm::cl::desc("Dump the number of calls and specializations of every "
+                   "libjit kernel"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+/// The kernels specialized for their constant arguments when
+/// -jit-specialize-kernels is not given.
+static const char *defaultSpecializedKernels[] = {
+    "libjit_convolution_f",
+    "libjit_convolution_i8",
+    "libjit_convolution_samples_f",
+    "libjit_convDKKC8_samples_f",
+    "libjit_depthwise_conv_samples_f",
+    "libjit_depthwise_conv_samples_i8",
+    "libjit_group_conv_samples_f",
+    "libjit_group_conv_samples_i8",
+    "libjit_im2col_rows_f",
+    "libjit_col2im_samples_f",
+    "libjit_max_pool_f",
+    "libjit_max_pool_i8",
+    "libjit_max_pool_xy_f",
+    "libjit_avg_pool_f",
+    "libjit_avg_pool_i8",
+};
+
 STATISTIC(NumSpecializations, "Number of created specializations");
 STATISTIC(NumSharedSpecializations, "Number of shared specializations");
 
@@ -133,6 +175,17 @@ class FunctionSpecializer {
     return true;
   }
 
+  /// \returns true if the calls of \p callee are specialized for their
+  /// constant arguments, even if some of the other arguments are not
+  /// constant.
+  bool isShapeSpecializedKernel(const llvm::Function *callee) {
+    auto name = callee->getName();
+    if (jitSpecializeKernels.getNumOccurrences()) {
+      return llvm::is_contained(jitSpecializeKernels, name);
+    }
+    return llvm::is_contained(defaultSpecializedKernels, name);
+  }
+
   /// Find an existing specialization or create a new one.
   /// \param CI the call that is being specialized.
   /// \param F the function being specialized.
@@ -178,6 +231,7 @@ class FunctionSpecializer {
         specializedFnArgIdx++;
       }
       NumSharedSpecializations++;
+      stats_[F->getName()].numSharedSpecializations++;
       return specializedF;
     }
 
@@ -219,20 +273,21 @@ class FunctionSpecializer {
                             << specializedName << "\n";
                specializedF->print(llvm::errs(), nullptr));
     NumSpecializations++;
+    stats_[F->getName()].numSpecializations++;
     return specializedF;
   }
 
   /// \returns true if a function is eligible for specialization.
   bool isEligibleForSpecialization(const llvm::CallInst *call) {
-    // For now, specialize all functions invoked from "main". In the future, we
-    // may introduce more complex logic for making this decision. It could be
-    // based in the number of invocations of a function, number of its
-    // arguments, its code size, etc.
+    // For now, specialize all functions invoked from "main" or from its
+    // outlined segments. In the future, we may introduce more complex logic
+    // for making this decision. It could be based in the number of invocations
+    // of a function, number of its arguments, its code size, etc.
     const auto *caller = call->getFunction();
     const auto *callee = call->getCalledFunction();
-    // Specialized only calls inside main.
-    assert(caller == entryF_ &&
-           "Only calls inside the entry function are specialized");
+    // Specialized only calls inside main, its segments and the parallel tasks.
+    assert(llvm::is_contained(entryFs_, caller) &&
+           "Only calls inside the entry functions are specialized");
     (void)caller;
     // Do not specialize any LLVM internal functions.
     if (callee && callee->getName().startswith("llvm."))
@@ -244,9 +299,11 @@ class FunctionSpecializer {
   }
 
 public:
-  FunctionSpecializer(llvm::Function *entryF,
-                      llvm::DenseSet<llvm::Value *> &dontSpec)
-      : entryF_(entryF), dontSpecializeArgsSet_(dontSpec) {}
+  FunctionSpecializer(llvm::ArrayRef<llvm::Function *> entryFs,
+                      llvm::DenseSet<llvm::Value *> &dontSpec,
+                      llvm::StringMap<KernelSpecializationStats> &stats)
+      : entryFs_(entryFs.begin(), entryFs.end()),
+        dontSpecializeArgsSet_(dontSpec), stats_(stats) {}
 
   /// Specialize a single call.
   /// \returns the specialized Call instruction if it was possible to specialize
@@ -254,6 +311,10 @@ public:
   llvm::CallInst *specializeCall(llvm::CallInst *call) {
     llvm::IRBuilder<> builder(call->getParent());
     auto *callee = call->getCalledFunction();
+    stats_[callee->getName()].numCalls++;
+    // The hot kernels are specialized for the arguments that are constant,
+    // the other kernels only if all of their arguments are constant.
+    bool partial = isShapeSpecializedKernel(callee);
     // Args to be used for calling the specialized function.
     llvm::SmallVector<llvm::Value *, 16> argsForSpecialized;
     // Set of arguments that need to be specialized. See SpecializationKey
@@ -272,14 +333,24 @@ public:
         continue;
       }
 
-      addArgToBeSpecialized(argsToBeSpecialized, curArgIdx);
-
-      // Bail if the values of arguments are not constants.
+      // Bail if the values of arguments are not constants, unless the other
+      // arguments are specialized anyway.
       if (!getConstantValue(arg)) {
+        if (partial) {
+          argsForSpecialized.push_back(arg);
+          continue;
+        }
         DEBUG_GLOW(llvm::dbgs() << "Could not specialize call:\n";
                    call->print(llvm::dbgs()));
         return nullptr;
       }
+
+      addArgToBeSpecialized(argsToBeSpecialized, curArgIdx);
+    }
+
+    // Bail if none of the arguments of a hot kernel is constant.
+    if (partial && !argsToBeSpecialized) {
+      return nullptr;
     }
 
     auto *specializedF =
@@ -298,17 +369,18 @@ public:
     // The removal should happen after all specializations are done, because
     // these call instructions are used by the keys in Specializations_ map.
     llvm::SmallVector<llvm::Instruction *, 32> erasedInstructions;
-    auto *F = entryF_;
-    // Collect all eligable calls in the current function.
+    // Collect all eligable calls in the entry functions.
     llvm::SmallVector<llvm::CallInst *, 64> calls;
-    for (auto &BB : *F) {
-      for (auto &I : BB) {
-        auto *CI = dyn_cast<llvm::CallInst>(&I);
-        if (!CI)
-          continue;
-        if (!isEligibleForSpecialization(CI))
-          continue;
-        calls.push_back(CI);
+    for (auto *F : entryFs_) {
+      for (auto &BB : *F) {
+        for (auto &I : BB) {
+          auto *CI = dyn_cast<llvm::CallInst>(&I);
+          if (!CI)
+            continue;
+          if (!isEligibleForSpecialization(CI))
+            continue;
+          calls.push_back(CI);
+        }
       }
     }
     // Try to specialize all the collected calls.
@@ -390,8 +462,8 @@ private:
     }
   };
 
-  /// The entry function of the module.
-  llvm::Function *entryF_;
+  /// The entry function of the module and its outlined segments.
+  std::vector<llvm::Function *> entryFs_;
   /// Mapping from specialization keys to the specialized functions.
   std::unordered_map<SpecializationKey, llvm::Function *,
                      SpecializationKeyHasher, SpecializationKeyEq>
@@ -407,12 +479,35 @@ private:
   /// A reference to a set of values that the specializer was requested not to
   /// specialize.
   llvm::DenseSet<llvm::Value *> &dontSpecializeArgsSet_;
+
+  /// The statistics of the specialization, by the name of the kernel.
+  llvm::StringMap<KernelSpecializationStats> &stats_;
 };
 
 } // namespace
 
 void LLVMIRGen::performSpecialization() {
-  FunctionSpecializer FuncSpecializer(llmodule_->getFunction("main"),
-                                      dontSpecializeArgsSet_);
+  // The kernels are called from main, from its segments and from the tasks
+  // executed on the thread pool.
+  std::vector<llvm::Function *> entryFs{llmodule_->getFunction("main")};
+  entryFs.insert(entryFs.end(), segments_.begin(), segments_.end());
+  entryFs.insert(entryFs.end(), parallelTasks_.begin(), parallelTasks_.end());
+  FunctionSpecializer FuncSpecializer(entryFs, dontSpecializeArgsSet_,
+                                      specializationStats_);
   FuncSpecializer.run();
+
+  if (dumpJITSpecializations) {
+    std::vector<llvm::StringRef> names;
+    for (auto &entry : specializationStats_) {
+      names.push_back(entry.getKey());
+    }
+    std::sort(names.begin(), names.end());
+    llvm::outs() << "Specializations of the libjit kernels:\n";
+    for (auto name : names) {
+      const auto &stats = specializationStats_[name];
+      llvm::outs() << "  " << name << ": " << stats.numCalls << " calls, "
+                   << stats.numSpecializations << " specialized, "
+                   << stats.numSharedSpecializations << " shared\n";
+    }
+  }
 }
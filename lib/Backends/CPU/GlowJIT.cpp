@@ -17,7 +17,15 @@
 #include "GlowJIT.h"
 #include "CommandLine.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+
+#include <mutex>
+
+#include <unistd.h>
 
 using GlowJIT = llvm::orc::GlowJIT;
 
@@ -30,65 +38,209 @@ static llvm::cl::opt<bool> dumpJITSymbolInfo(
     llvm::cl::desc("Dump the load addresses and sizes of JITted symbols"),
     llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
 
-#if LLVM_VERSION_MAJOR <= 6
+static llvm::cl::opt<bool> jitPerfMap(
+    "jit-perf-map",
+    llvm::cl::desc("Append the address ranges and names of the JITted "
+                   "functions to /tmp/perf-<pid>.map, where perf looks up the "
+                   "samples in anonymous memory"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> jitPerfEvents(
+    "jit-perf-events",
+    llvm::cl::desc("Report the JITted code to perf through the LLVM perf "
+                   "event listener, for 'perf inject --jit' (requires LLVM "
+                   "built with LLVM_USE_PERF)"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<bool> jitIntelEvents(
+    "jit-intel-events",
+    llvm::cl::desc("Report the JITted code to VTune through the LLVM Intel "
+                   "JIT event listener (requires LLVM built with "
+                   "LLVM_USE_INTEL_JITEVENTS)"),
+    llvm::cl::init(false), llvm::cl::cat(CPUBackendCat));
+
+/// Call \p fn with the name, the load address and the size of every named
+/// symbol defined by the object file \p loadedObj, which is loaded as
+/// described by \p objInfo.
+static void forEachLoadedSymbol(
+    const llvm::object::ObjectFile &loadedObj,
+    const llvm::RuntimeDyld::LoadedObjectInfo &objInfo,
+    llvm::function_ref<void(llvm::StringRef, uint64_t, uint64_t)> fn) {
+  for (auto symSizePair : llvm::object::computeSymbolSizes(loadedObj)) {
+    auto sym = symSizePair.first;
+    auto size = symSizePair.second;
+    auto symName = sym.getName();
+    // Skip any unnamed symbols.
+    if (!symName || symName->empty())
+      continue;
+    // The relative address of the symbol inside its section.
+    auto symAddr = sym.getAddress();
+    if (!symAddr)
+      continue;
+    // The address the functions was loaded at.
+    auto loadedSymAddress = *symAddr;
+    auto symbolSection = sym.getSection();
+    if (symbolSection) {
+      // Compute the load address of the symbol by adding the section load
+      // address.
+      loadedSymAddress += objInfo.getSectionLoadAddress(*symbolSection.get());
+    }
+    fn(*symName, loadedSymAddress, size);
+  }
+}
+
+/// Appends the functions of the loaded object files to the perf map of the
+/// process. The map is shared by all the JITs of the process.
+class PerfMapWriter {
+  std::mutex mutex_;
+  std::unique_ptr<llvm::raw_fd_ostream> os_;
+
+public:
+  PerfMapWriter() {
+    std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    std::error_code EC;
+    os_ = llvm::make_unique<llvm::raw_fd_ostream>(path, EC,
+                                                  llvm::sys::fs::F_Append);
+    if (EC) {
+      llvm::errs() << "Cannot open the perf map " << path << ": "
+                   << EC.message() << "\n";
+      os_.reset();
+    }
+  }
+
+  void write(const llvm::object::ObjectFile &loadedObj,
+             const llvm::RuntimeDyld::LoadedObjectInfo &objInfo) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!os_) {
+      return;
+    }
+    forEachLoadedSymbol(
+        loadedObj, objInfo,
+        [&](llvm::StringRef name, uint64_t address, uint64_t size) {
+          // Only the code is sampled.
+          if (size) {
+            *os_ << llvm::format("%llx %llx ", (unsigned long long)address,
+                                 (unsigned long long)size)
+                 << name << "\n";
+          }
+        });
+    // perf may read the map while the process is running.
+    os_->flush();
+  }
+};
+
 /// This is a callback that is invoked when an LLVM module is compiled and
 /// loaded by the JIT for execution.
 class NotifyLoadedFunctor {
-  /// The listener for debugger events. It is used to provide debuggers with the
-  /// information about JITted code.
-  llvm::JITEventListener *dbgRegistrationListener_;
+  /// The listeners of the JIT events: the debugger registration, which
+  /// provides debuggers with the information about JITted code, and the
+  /// profilers selected on the command line. The listeners are shared by all
+  /// the JITs of the process.
+  std::vector<llvm::JITEventListener *> listeners_;
+  /// The perf map, if it is written.
+  PerfMapWriter *perfMap_{nullptr};
+  /// The size of the loaded sections of the JIT, which the loaded object
+  /// files add to.
+  std::atomic<uint64_t> *loadedSize_;
+
   /// Dump symbol information for symbols defined by the object file.
   void dumpSymbolInfo(const llvm::object::ObjectFile &loadedObj,
                       const llvm::RuntimeDyld::LoadedObjectInfo &objInfo) {
     if (!dumpJITSymbolInfo)
       return;
     // Dump information about symbols.
-    for (auto symSizePair : llvm::object::computeSymbolSizes(loadedObj)) {
-      auto sym = symSizePair.first;
-      auto size = symSizePair.second;
-      auto symName = sym.getName();
-      // Skip any unnamed symbols.
-      if (!symName || symName->empty())
-        continue;
-      // The relative address of the symbol inside its section.
-      auto symAddr = sym.getAddress();
-      if (!symAddr)
-        continue;
-      // The address the functions was loaded at.
-      auto loadedSymAddress = *symAddr;
-      auto symbolSection = sym.getSection();
-      if (symbolSection) {
-        // Compute the load address of the symbol by adding the section load
-        // address.
-        loadedSymAddress += objInfo.getSectionLoadAddress(*symbolSection.get());
-      }
-      llvm::outs() << llvm::format("Address range: [%12p, %12p]",
-                                   loadedSymAddress, loadedSymAddress + size)
-                   << "\tSymbol: " << *symName << "\n";
+    forEachLoadedSymbol(
+        loadedObj, objInfo,
+        [](llvm::StringRef name, uint64_t address, uint64_t size) {
+          llvm::outs() << llvm::format("Address range: [%12p, %12p]",
+                                       address, address + size)
+                       << "\tSymbol: " << name << "\n";
+        });
+  }
+
+  /// \returns the listener created by \p create on the first call, or null
+  /// if LLVM is built without it, in which case the option \p option is
+  /// reported to be ignored.
+  static llvm::JITEventListener *
+  getListener(llvm::JITEventListener *(*create)(), llvm::StringRef option) {
+    auto *listener = create();
+    if (!listener) {
+      llvm::errs() << "Ignoring -" << option
+                   << ": LLVM is built without the JIT event listener\n";
     }
+    return listener;
   }
 
 public:
-  NotifyLoadedFunctor(GlowJIT *jit)
-      : dbgRegistrationListener_(
-            llvm::JITEventListener::createGDBRegistrationListener()) {}
+  explicit NotifyLoadedFunctor(std::atomic<uint64_t> *loadedSize)
+      : loadedSize_(loadedSize) {
+    listeners_.push_back(
+        llvm::JITEventListener::createGDBRegistrationListener());
+    if (jitPerfEvents) {
+      static auto *perfListener = getListener(
+          llvm::JITEventListener::createPerfJITEventListener,
+          jitPerfEvents.ArgStr);
+      if (perfListener) {
+        listeners_.push_back(perfListener);
+      }
+    }
+    if (jitIntelEvents) {
+      static auto *intelListener = getListener(
+          llvm::JITEventListener::createIntelJITEventListener,
+          jitIntelEvents.ArgStr);
+      if (intelListener) {
+        listeners_.push_back(intelListener);
+      }
+    }
+    if (jitPerfMap) {
+      static PerfMapWriter perfMap;
+      perfMap_ = &perfMap;
+    }
+  }
+
+  void notify(const llvm::object::ObjectFile &loadedObj,
+              const llvm::RuntimeDyld::LoadedObjectInfo &objInfo) {
+    // Inform the debugger and the profilers about the loaded object file.
+    // This should allow for more complete stack traces under debugger. And
+    // even it should even enable the stepping functionality on platforms
+    // supporting it.
+    for (auto *listener : listeners_) {
+      listener->NotifyObjectEmitted(loadedObj, objInfo);
+    }
+    if (perfMap_) {
+      perfMap_->write(loadedObj, objInfo);
+    }
+    // Dump symbol information for the JITed symbols.
+    dumpSymbolInfo(loadedObj, objInfo);
+    for (const auto &section : loadedObj.sections()) {
+      if (objInfo.getSectionLoadAddress(section)) {
+        *loadedSize_ += section.getSize();
+      }
+    }
+  }
+
+#if LLVM_VERSION_MAJOR > 6
+  void operator()(llvm::orc::VModuleKey,
+                  const llvm::object::ObjectFile &loadedObj,
+                  const llvm::RuntimeDyld::LoadedObjectInfo &objInfo) {
+    notify(loadedObj, objInfo);
+  }
+#else
   void operator()(llvm::orc::RTDyldObjectLinkingLayerBase::ObjHandleT,
                   const llvm::orc::RTDyldObjectLinkingLayerBase::ObjectPtr &obj,
                   const llvm::RuntimeDyld::LoadedObjectInfo &objInfo) {
-    auto loadedObj = obj->getBinary();
-    // Inform the debugger about the loaded object file. This should allow for
-    // more complete stack traces under debugger. And even it should even enable
-    // the stepping functionality on platforms supporting it.
-    dbgRegistrationListener_->NotifyObjectEmitted(*loadedObj, objInfo);
-    // Dump symbol information for the JITed symbols.
-    dumpSymbolInfo(*loadedObj, objInfo);
+    notify(*obj->getBinary(), objInfo);
   }
-};
 #endif
+};
 
 } // namespace
 
-GlowJIT::GlowJIT(llvm::TargetMachine &TM)
+bool GlowJIT::reportsToProfilers() {
+  return jitPerfMap || jitPerfEvents || jitIntelEvents;
+}
+
+GlowJIT::GlowJIT(llvm::TargetMachine &TM, ObjectCache *cache)
     : TM_(TM), DL_(TM_.createDataLayout()),
 #if LLVM_VERSION_MAJOR > 6
       ES_(SSP_),
@@ -108,12 +260,13 @@ GlowJIT::GlowJIT(llvm::TargetMachine &TM)
                    [this](llvm::orc::VModuleKey) {
                      return RTDyldObjectLinkingLayer::Resources{
                          std::make_shared<SectionMemoryManager>(), resolver_};
-                   }),
+                   },
+                   NotifyLoadedFunctor(&loadedSize_)),
 #else
       objectLayer_([]() { return std::make_shared<SectionMemoryManager>(); },
-                   NotifyLoadedFunctor(this)),
+                   NotifyLoadedFunctor(&loadedSize_)),
 #endif
-      compileLayer_(objectLayer_, SimpleCompiler(TM_)) {
+      compileLayer_(objectLayer_, SimpleCompiler(TM_, cache)) {
   llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
 }
 
@@ -125,12 +278,33 @@ GlowJIT::ModuleHandle GlowJIT::addModule(std::unique_ptr<Module> M) {
   cantFail(compileLayer_.addModule(K, std::move(M)));
   return K;
 #else
+  return cantFail(compileLayer_.addModule(std::move(M), createResolver()));
+#endif
+}
+
+GlowJIT::ModuleHandle
+GlowJIT::addObject(std::unique_ptr<MemoryBuffer> object) {
+#if LLVM_VERSION_MAJOR > 6
+  auto K = ES_.allocateVModule();
+  cantFail(objectLayer_.addObject(K, std::move(object)));
+  return K;
+#else
+  auto objectFile = cantFail(
+      object::ObjectFile::createObjectFile(object->getMemBufferRef()));
+  auto binary = std::make_shared<object::OwningBinary<object::ObjectFile>>(
+      std::move(objectFile), std::move(object));
+  return cantFail(objectLayer_.addObject(std::move(binary), createResolver()));
+#endif
+}
+
+#if LLVM_VERSION_MAJOR <= 6
+std::shared_ptr<llvm::JITSymbolResolver> GlowJIT::createResolver() {
   // Build our symbol resolver:
   // Lambda 1: Look back into the JIT itself to find symbols that are part of
   //           the same "logical dylib".
   // Lambda 2: Search for external symbols in the host process.
-  auto resolver = createLambdaResolver(
-      [&](const std::string &name) {
+  return createLambdaResolver(
+      [this](const std::string &name) {
         if (auto sym = compileLayer_.findSymbol(name, false))
           return sym;
         return JITSymbol(nullptr);
@@ -140,10 +314,8 @@ GlowJIT::ModuleHandle GlowJIT::addModule(std::unique_ptr<Module> M) {
           return JITSymbol(symAddr, JITSymbolFlags::Exported);
         return JITSymbol(nullptr);
       });
-
-  return cantFail(compileLayer_.addModule(std::move(M), std::move(resolver)));
-#endif
 }
+#endif
 
 void GlowJIT::removeModule(GlowJIT::ModuleHandle H) {
   cantFail(compileLayer_.removeModule(H));
@@ -155,3 +327,41 @@ llvm::JITSymbol GlowJIT::findSymbol(const std::string name) {
   Mangler::getNameWithPrefix(MangledNameStream, name, DL_);
   return compileLayer_.findSymbol(MangledNameStream.str(), true);
 }
+
+llvm::orc::JITObjectCache::JITObjectCache(StringRef dir, StringRef key) {
+  SmallString<256> path(dir);
+  sys::path::append(path, key + ".o");
+  path_ = path.str();
+  auto buffer = MemoryBuffer::getFile(path_);
+  if (buffer) {
+    object_ = std::move(*buffer);
+  }
+}
+
+void llvm::orc::JITObjectCache::notifyObjectCompiled(const Module *M,
+                                                     MemoryBufferRef obj) {
+  // Failing to update the cache is not fatal, the code just gets compiled
+  // again next time.
+  if (sys::fs::create_directories(sys::path::parent_path(path_))) {
+    return;
+  }
+  // Write to a temporary file first, so that concurrent processes never see a
+  // partially written object file.
+  int fd;
+  SmallString<256> tmpPath;
+  if (sys::fs::createUniqueFile(path_ + "-%%%%%%.tmp", fd, tmpPath)) {
+    return;
+  }
+  {
+    raw_fd_ostream os(fd, /* shouldClose */ true);
+    os << obj.getBuffer();
+  }
+  if (sys::fs::rename(tmpPath, path_)) {
+    sys::fs::remove(tmpPath);
+  }
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+llvm::orc::JITObjectCache::getObject(const Module *M) {
+  return std::move(object_);
+}
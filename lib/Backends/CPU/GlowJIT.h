@@ -19,6 +19,7 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
@@ -29,9 +30,11 @@
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -45,6 +48,8 @@ class GlowJIT {
 private:
   TargetMachine &TM_;
   const DataLayout DL_;
+  /// The bytes of the sections of the loaded object files.
+  std::atomic<uint64_t> loadedSize_{0};
 #if LLVM_VERSION_MAJOR > 6
   SymbolStringPool SSP_;
   ExecutionSession ES_;
@@ -53,13 +58,28 @@ private:
   RTDyldObjectLinkingLayer objectLayer_;
   IRCompileLayer<decltype(objectLayer_), SimpleCompiler> compileLayer_;
 
+#if LLVM_VERSION_MAJOR <= 6
+  /// \returns the resolver of the symbols of a newly added module or object.
+  std::shared_ptr<JITSymbolResolver> createResolver();
+#endif
+
 public:
-  GlowJIT(llvm::TargetMachine &TM);
+  /// Ctor. If \p cache is provided, it is consulted before compiling a module
+  /// and notified about the newly compiled object files.
+  GlowJIT(llvm::TargetMachine &TM, ObjectCache *cache = nullptr);
 
   TargetMachine &getTargetMachine() { return TM_; }
 
+  /// \returns true if the JITted code is reported to a sampling profiler, as
+  /// selected by -jit-perf-map, -jit-perf-events or -jit-intel-events.
+  static bool reportsToProfilers();
+
   JITSymbol findSymbol(const std::string name);
 
+  /// \returns the bytes of the code and data loaded so far. The modules are
+  /// compiled and loaded when their symbols are first looked up.
+  uint64_t getLoadedSize() const { return loadedSize_; }
+
 #if LLVM_VERSION_MAJOR > 6
   using ModuleHandle = orc::VModuleKey;
 #else
@@ -68,9 +88,38 @@ public:
 
   ModuleHandle addModule(std::unique_ptr<Module> M);
 
+  /// Add the object file \p object, e.g. one of the partitions of a module
+  /// compiled by llvm::splitCodeGen. Its symbols are linked with the other
+  /// modules and object files of the JIT.
+  ModuleHandle addObject(std::unique_ptr<MemoryBuffer> object);
+
   void removeModule(ModuleHandle H);
 };
 
+/// A persistent cache of the object code of a single module. The object file
+/// is stored on disk under the cache key, so that a later process compiling
+/// the same code can load it instead of compiling it again.
+class JITObjectCache final : public ObjectCache {
+  /// The path of the object file in the cache.
+  std::string path_;
+  /// The object file loaded from the cache, if any.
+  std::unique_ptr<MemoryBuffer> object_;
+
+public:
+  /// Ctor. Look up the object file for \p key in the directory \p dir.
+  JITObjectCache(StringRef dir, StringRef key);
+
+  /// \returns true if the object file was found in the cache.
+  bool hasObject() const { return object_ != nullptr; }
+
+  /// @name ObjectCache interface
+  ///@{
+  void notifyObjectCompiled(const Module *M, MemoryBufferRef obj) override;
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module *M) override;
+  ///@}
+};
+
 } // end namespace orc
 } // end namespace llvm
 
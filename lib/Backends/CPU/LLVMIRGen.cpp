@@ -23,16 +23,31 @@
 #include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Quantization/Base/Base.h"
+#include "glow/Support/Cancellation.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/PerfCounters.h"
+#include "glow/Support/ThreadPool.h"
 
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/MC/MCSubtargetInfo.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/FunctionComparator.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 using namespace glow;
 using llvm::cast;
@@ -64,6 +79,26 @@ llvm::cl::opt<llvm::Reloc::Model> relocModel(
         clEnumValN(llvm::Reloc::PIC_, "pic", "Position independent code")),
     llvm::cl::init(llvm::Reloc::Static), llvm::cl::cat(CPUBackendCat));
 
+static llvm::cl::opt<bool> jitShareKernels(
+    "jit-share-kernels",
+    llvm::cl::desc("Emit the identical data-parallel kernels of the layers "
+                   "with the same shapes as a single function"),
+    llvm::cl::init(true), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::opt<std::string>
+    mcpu("mcpu",
+         llvm::cl::desc("Target CPU to generate code for (defaults to the "
+                        "host CPU when no -target is given)"),
+         llvm::cl::init(""), llvm::cl::cat(CPUBackendCat));
+
+static llvm::cl::list<std::string>
+    mattr("mattr", llvm::cl::CommaSeparated,
+          llvm::cl::desc("Target specific attributes, e.g. +avx2,+fma "
+                         "(defaults to the host attributes when no -target "
+                         "is given)"),
+          llvm::cl::value_desc("a1,+a2,-a3,..."),
+          llvm::cl::cat(CPUBackendCat));
+
 /// Generate the LLVM MAttr list of attributes.
 static llvm::SmallVector<std::string, 0> getMachineAttributes() {
   llvm::SmallVector<std::string, 0> result;
@@ -96,23 +131,88 @@ LLVMIRGen::LLVMIRGen(const IRFunction *F, AllocationsInfo &allocationsInfo,
     : F_(F), allocationsInfo_(allocationsInfo), mainEntryName_(mainEntryName) {}
 
 void LLVMIRGen::initTargetMachine(llvm::StringRef T,
-                                  llvm::CodeModel::Model codeModel) {
+                                  llvm::CodeModel::Model codeModel,
+                                  llvm::StringRef cpu,
+                                  llvm::StringRef features) {
   llvm::InitializeAllTargets();
   llvm::InitializeAllTargetMCs();
   llvm::InitializeAllAsmPrinters();
 
+  if (!cpu.empty() || !features.empty()) {
+    llvm::SmallVector<llvm::StringRef, 8> parts;
+    features.split(parts, ',', -1, false);
+    llvm::SmallVector<std::string, 0> attrs(parts.begin(), parts.end());
+    // An empty triple selects the host.
+    TM_.reset(llvm::EngineBuilder()
+                  .setCodeModel(codeModel)
+                  .setRelocationModel(relocModel)
+                  .selectTarget(llvm::Triple(T), "", cpu, attrs));
+    return;
+  }
+
+  // Explicitly requested CPUs and attributes override the host defaults.
+  llvm::SmallVector<std::string, 0> attrs(mattr.begin(), mattr.end());
   if (T.empty())
     TM_.reset(llvm::EngineBuilder()
                   .setCodeModel(codeModel)
                   .setRelocationModel(relocModel)
-                  .selectTarget(llvm::Triple(), "", getHostCpuName(),
-                                getMachineAttributes()));
+                  .selectTarget(llvm::Triple(), "",
+                                mcpu.empty() ? getHostCpuName()
+                                             : llvm::StringRef(mcpu),
+                                mattr.empty() ? getMachineAttributes()
+                                              : attrs));
   else
     TM_.reset(llvm::EngineBuilder()
                   .setCodeModel(codeModel)
                   .setRelocationModel(relocModel)
-                  .selectTarget(llvm::Triple(T), "", "",
-                                llvm::SmallVector<std::string, 0>()));
+                  .selectTarget(llvm::Triple(T), "", mcpu, attrs));
+}
+
+llvm::StringRef LLVMIRGen::getMatMulKernelSuffix() const {
+  const llvm::MCSubtargetInfo *STI = TM_->getMCSubtargetInfo();
+  if (!STI) {
+    return "";
+  }
+  // The libjit vectors are twice as wide as the NEON registers, so the ARM
+  // targets get kernels that are blocked for 128-bit vectors. AArch64 always
+  // has NEON and twice as many registers as ARMv7.
+  switch (TM_->getTargetTriple().getArch()) {
+  case llvm::Triple::aarch64:
+  case llvm::Triple::aarch64_be:
+    return "_neon";
+  case llvm::Triple::arm:
+  case llvm::Triple::armeb:
+  case llvm::Triple::thumb:
+  case llvm::Triple::thumbeb:
+    return STI->checkFeatures("+neon") ? "_neon32" : "";
+  case llvm::Triple::x86_64:
+    break;
+  default:
+    return "";
+  }
+  // The features may be implied by the CPU name, so ask the subtarget rather
+  // than parsing the feature string.
+  if (STI->checkFeatures("+avx512f")) {
+    return "_avx512";
+  }
+  if (STI->checkFeatures("+avx2,+fma")) {
+    return "_avx2";
+  }
+  return "";
+}
+
+llvm::StringRef LLVMIRGen::getQuantizedMatMulKernelSuffix() const {
+  const llvm::MCSubtargetInfo *STI = TM_->getMCSubtargetInfo();
+  if (TM_->getTargetTriple().getArch() != llvm::Triple::x86_64 || !STI) {
+    return "";
+  }
+  if (STI->checkFeatures("+avx512f,+avx512vnni")) {
+    return "_vnni";
+  }
+  if (STI->checkFeatures("+avx2")) {
+    return "_avx2";
+  }
+  return "";
 }
 
 std::string LLVMIRGen::getMainEntryName() const {
@@ -138,11 +238,35 @@ void LLVMIRGen::loadBaseAddresses(llvm::IRBuilder<> &builder) {
   offsetsArray_ = F->args().begin() + 3;
 }
 
+/// Load the bitcode file \p path into an LLVM module in the context \p ctx.
+/// Store the MD5 digest of the contents of the file into \p digest.
+static std::unique_ptr<llvm::Module>
+parseLibraryFile(llvm::StringRef path, llvm::SMDiagnostic &error,
+                 llvm::LLVMContext *ctx, std::string &digest) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    error = llvm::SMDiagnostic(path, llvm::SourceMgr::DK_Error,
+                               "Could not open input file: " +
+                                   buffer.getError().message());
+    return nullptr;
+  }
+  llvm::MD5 hash;
+  hash.update((*buffer)->getBuffer());
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> str;
+  llvm::MD5::stringifyResult(result, str);
+  digest = str.str();
+  return llvm::parseIR((*buffer)->getMemBufferRef(), error, *ctx);
+}
+
 // Search for the standard library bitcode file on disk and load it into an
 // LLVM module. We search for the standard library around the current executable
-// and also in the current directory.
+// and also in the current directory. The MD5 digest of the file is stored into
+// \p digest.
 static std::unique_ptr<llvm::Module>
-loadStandardLibrary(llvm::LLVMContext *ctx, llvm::StringRef filename) {
+loadStandardLibrary(llvm::LLVMContext *ctx, llvm::StringRef filename,
+                    std::string &digest) {
   using llvm::sys::path::append;
   using llvm::sys::path::parent_path;
 
@@ -150,7 +274,7 @@ loadStandardLibrary(llvm::LLVMContext *ctx, llvm::StringRef filename) {
 
   auto *envPath = getenv("GLOW_LIBJIT_PATH");
   if (envPath != nullptr) {
-    return llvm::parseIRFile(envPath, error, *ctx);
+    return parseLibraryFile(envPath, error, ctx, digest);
   }
 
   // Figure out the location of the current executable.
@@ -164,7 +288,7 @@ loadStandardLibrary(llvm::LLVMContext *ctx, llvm::StringRef filename) {
     llvm::SmallString<256> libPath(basePath);
     append(libPath, filename);
     if (llvm::sys::fs::exists(libPath)) {
-      auto res = llvm::parseIRFile(libPath, error, *ctx);
+      auto res = parseLibraryFile(libPath, error, ctx, digest);
 
       // If we could not parse the bitcode file then print an error.
       if (!res.get()) {
@@ -177,7 +301,7 @@ loadStandardLibrary(llvm::LLVMContext *ctx, llvm::StringRef filename) {
     basePath = parent_path(basePath);
   }
 
-  return llvm::parseIRFile(filename, error, *ctx);
+  return parseLibraryFile(filename, error, ctx, digest);
 }
 
 /// Register a diagnostics handler that prevents the compiler from printing to
@@ -198,7 +322,7 @@ static void registerEmptyDiagHandler(llvm::LLVMContext &ctx) {
 void LLVMIRGen::initCodeGen() {
   instrNumbering_.reset(new InstructionNumbering(*F_));
   // Load the jit library as a new module.
-  llmodule_ = loadStandardLibrary(&ctx_, "libjit.bc");
+  llmodule_ = loadStandardLibrary(&ctx_, "libjit.bc", libjitDigest_);
   GLOW_ASSERT(llmodule_.get() && "Unable to load the JIT library.");
 
   // By default, LLVM would emit some diagnostics, remarks, etc. It is fine for
@@ -240,6 +364,10 @@ llvm::Type *LLVMIRGen::getElementType(llvm::IRBuilder<> &builder,
     return builder.getInt64Ty();
   case ElemKind::FloatTy:
     return builder.getFloatTy();
+  case ElemKind::Float16Ty:
+  case ElemKind::BFloat16Ty:
+    // Half precision and bfloat16 values are stored as raw 16-bit words.
+    return builder.getInt16Ty();
   case ElemKind::Int8QTy:
     return builder.getInt8Ty();
   case ElemKind::Int16QTy:
@@ -311,9 +439,16 @@ llvm::Value *LLVMIRGen::emitValueAddress(llvm::IRBuilder<> &builder,
   case ElemKind::FloatTy:
     T = llvm::Type::getFloatPtrTy(ctx_);
     break;
+  case ElemKind::Float16Ty:
+  case ElemKind::BFloat16Ty:
+    T = llvm::Type::getInt16PtrTy(ctx_);
+    break;
   case ElemKind::Int8QTy:
     T = llvm::Type::getInt8PtrTy(ctx_);
     break;
+  case ElemKind::Int16QTy:
+    T = llvm::Type::getInt16PtrTy(ctx_);
+    break;
   case ElemKind::Int64ITy:
     T = llvm::Type::getInt64PtrTy(ctx_);
     break;
@@ -349,6 +484,15 @@ llvm::Value *LLVMIRGen::emitValueAddress(llvm::IRBuilder<> &builder,
   return builder.CreateIntToPtr(addr, T);
 }
 
+llvm::Value *LLVMIRGen::emitScratchAddress(llvm::IRBuilder<> &builder) {
+  assert(allocationsInfo_.scratchMemSize_ && "No scratch area was allocated");
+  auto sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto *offset =
+      llvm::ConstantInt::get(sizeTTy, allocationsInfo_.scratchOffset_);
+  llvm::Value *addr = builder.CreateAdd(baseActivationsAddr_, offset);
+  return builder.CreateIntToPtr(addr, llvm::Type::getFloatPtrTy(ctx_));
+}
+
 llvm::Value *
 LLVMIRGen::emitConstOffsetsArray(llvm::IRBuilder<> &builder,
                                  const AllocationsInfo &allocationsInfo) {
@@ -450,6 +594,10 @@ llvm::Value *LLVMIRGen::emitConst(llvm::IRBuilder<> &builder, float val,
   switch (kind) {
   case ElemKind::FloatTy:
     return llvm::ConstantFP::get(llvm::Type::getFloatTy(ctx_), val);
+  case ElemKind::Float16Ty:
+    return builder.getInt16(float16_t(val).getBits());
+  case ElemKind::BFloat16Ty:
+    return builder.getInt16(bfloat16_t(val).getBits());
   case ElemKind::Int64ITy:
     return builder.getInt64(static_cast<int64_t>(val));
   case ElemKind::Int8QTy:
@@ -503,8 +651,14 @@ llvm::Function *LLVMIRGen::getFunction(const std::string &name,
   switch (elemTy) {
   case ElemKind::FloatTy:
     return get("libjit_" + name + "_f");
+  case ElemKind::Float16Ty:
+    return get("libjit_" + name + "_f16");
+  case ElemKind::BFloat16Ty:
+    return get("libjit_" + name + "_bf16");
   case ElemKind::Int8QTy:
     return get("libjit_" + name + "_i8");
+  case ElemKind::Int16QTy:
+    return get("libjit_" + name + "_i16");
   case ElemKind::Int32QTy:
     return get("libjit_" + name + "_i32");
   case ElemKind::Int64ITy:
@@ -514,15 +668,14 @@ llvm::Function *LLVMIRGen::getFunction(const std::string &name,
   }
 }
 
-/// Create LLVM IR for the for loop with a loop count specified by the only
-/// parameter of the enclosing function.
+/// Create LLVM IR for the for loop iterating over the non-empty range
+/// [\p begin, \p end).
 /// \returns a pair of basic blocks. The first BB is the BB of the loop body,
 /// the second BB is the loop exit BB.
 static std::pair<llvm::BasicBlock *, llvm::BasicBlock *>
 createLoop(llvm::IRBuilder<> &builder, llvm::LLVMContext &ctx,
-           llvm::Value *numElements) {
+           llvm::Value *begin, llvm::Value *end) {
   auto sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
-  auto *initVal = llvm::ConstantInt::get(sizeTTy, 0);
 
   // Make the new basic block for the loop header. Insert it after current
   // block.
@@ -538,14 +691,14 @@ createLoop(llvm::IRBuilder<> &builder, llvm::LLVMContext &ctx,
 
   // Create the PHI node with an entry for initial value.
   llvm::PHINode *var = builder.CreatePHI(sizeTTy, 2);
-  var->addIncoming(initVal, preheaderBB);
+  var->addIncoming(begin, preheaderBB);
 
   // Emit the step value.
   auto *stepVal = llvm::ConstantInt::get(sizeTTy, 1);
   auto *nextVal = builder.CreateAdd(var, stepVal, "nextvar", /* HasNUW */ true,
                                     /* HasNSW */ true);
   // Compute the end condition.
-  auto *endCond = builder.CreateICmpULT(nextVal, numElements, "loopcond");
+  auto *endCond = builder.CreateICmpULT(nextVal, end, "loopcond");
 
   // Create the "after loop" block and insert it.
   auto *afterBB = llvm::BasicBlock::Create(ctx, "afterloop", func);
@@ -590,6 +743,446 @@ emitBufferAddress(llvm::IRBuilder<> &builder, Value *val,
   return kernel->args().begin() + bufferToArgNum[val];
 }
 
+/// Emit the address of the operand \p val of a data-parallel kernel, which
+/// reads the element \p loopCount of the operand. The address of a broadcast
+/// view is moved by the distance between the element of the source that the
+/// element \p loopCount repeats and \p loopCount, so that the kernels read the
+/// source in place.
+static llvm::Value *
+emitOperandAddress(llvm::IRBuilder<> &builder, Value *val,
+                   llvm::Function *kernel,
+                   llvm::DenseMap<Value *, int> &bufferToArgNum,
+                   llvm::Value *loopCount) {
+  auto *ptr = emitBufferAddress(builder, val, kernel, bufferToArgNum);
+  if (!isBroadcastView(val)) {
+    return ptr;
+  }
+  auto *idxTy = loopCount->getType();
+  llvm::Value *srcIdx = llvm::ConstantInt::get(idxTy, 0);
+  for (const auto &dim : getBroadcastDims(cast<TensorViewInst>(val))) {
+    llvm::Value *idx = loopCount;
+    if (dim.viewStride != 1) {
+      idx = builder.CreateUDiv(
+          idx, llvm::ConstantInt::get(idxTy, dim.viewStride), "bcast.div");
+    }
+    // The outermost dimension does not wrap around.
+    if (dim.viewStride * dim.size != val->size()) {
+      idx = builder.CreateURem(idx, llvm::ConstantInt::get(idxTy, dim.size),
+                               "bcast.rem");
+    }
+    if (dim.srcStride != 1) {
+      idx = builder.CreateMul(
+          idx, llvm::ConstantInt::get(idxTy, dim.srcStride), "bcast.mul");
+    }
+    srcIdx = builder.CreateAdd(srcIdx, idx, "bcast.idx");
+  }
+  auto *elementTy = ptr->getType()->getPointerElementType();
+  return builder.CreateGEP(elementTy, ptr,
+                           builder.CreateSub(srcIdx, loopCount, "bcast.delta"),
+                           "bcast.addr");
+}
+
+/// The entry point invoked by the generated code to execute \p task on the
+/// thread pool \p pool. Each invocation of \p task processes a range of
+/// iterations of [0, \p numIterations) using the arguments packed into
+/// \p closure.
+static void dispatchParallelTask(void *pool,
+                                 void (*task)(void *, size_t, size_t),
+                                 void *closure, size_t numIterations,
+                                 size_t minChunkSize) {
+  static_cast<ThreadPool *>(pool)->parallelFor(
+      numIterations, minChunkSize,
+      [&](size_t begin, size_t end) { task(closure, begin, end); });
+}
+
+/// To invoke \p callee on a thread pool, the generated code creates a "task"
+/// function with the signature void(i8 *closure, size_t begin, size_t end).
+/// The non-constant arguments of \p callee are stored into a closure struct
+/// allocated on the stack of the caller and the task function loads them from
+/// there. Constant arguments, like dimensions or kernel sizes, are directly
+/// embedded into the task function, so that \p callee can still be
+/// specialized for them.
+void LLVMIRGen::emitParallelCall(llvm::IRBuilder<> &builder,
+                                 llvm::Function *callee,
+                                 llvm::ArrayRef<llvm::Value *> args,
+                                 size_t numIterations, size_t minChunkSize) {
+  auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto *int8PtrTy = builder.getInt8PtrTy();
+  llvm::Type *voidTy = llvm::Type::getVoidTy(ctx_);
+  auto *numIterationsVal = emitConstSizeT(builder, numIterations);
+  size_t maxChunks = (numIterations + minChunkSize - 1) / minChunkSize;
+
+  if (!threadPool_ || threadPool_->getNumThreads() < 2 || maxChunks < 2) {
+    llvm::SmallVector<llvm::Value *, 32> callArgs(args.begin(), args.end());
+    callArgs.push_back(emitConstSizeT(builder, 0));
+    callArgs.push_back(numIterationsVal);
+    createCall(builder, callee, callArgs);
+    return;
+  }
+
+  // Collect the non-constant arguments, which need to be stored into the
+  // closure.
+  llvm::SmallVector<llvm::Type *, 32> closureTypes;
+  for (auto *arg : args) {
+    if (!isa<llvm::Constant>(arg)) {
+      closureTypes.push_back(arg->getType());
+    }
+  }
+  auto *closureTy = llvm::StructType::get(ctx_, closureTypes);
+  // Allocate the closure in the entry block of the caller.
+  auto *callerF = builder.GetInsertBlock()->getParent();
+  llvm::IRBuilder<> allocaBuilder(&callerF->getEntryBlock(),
+                                  callerF->getEntryBlock().begin());
+  auto *closure = allocaBuilder.CreateAlloca(closureTy, nullptr, "closure");
+  unsigned fieldIdx = 0;
+  for (auto *arg : args) {
+    if (!isa<llvm::Constant>(arg)) {
+      builder.CreateStore(
+          arg, builder.CreateStructGEP(closureTy, closure, fieldIdx++));
+    }
+  }
+
+  // Create the task function, which unpacks the closure and calls the callee.
+  auto *taskTy =
+      llvm::FunctionType::get(voidTy, {int8PtrTy, sizeTTy, sizeTTy}, false);
+  auto *task = llvm::Function::Create(taskTy, llvm::Function::InternalLinkage,
+                                      "libjit_parallel_task", llmodule_.get());
+  parallelTasks_.push_back(task);
+  llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(ctx_, "entry", task);
+  llvm::IRBuilder<> taskBuilder(entryBB);
+  auto taskArgs = task->arg_begin();
+  auto *taskClosure =
+      taskBuilder.CreateBitCast(&*taskArgs, closureTy->getPointerTo());
+  llvm::SmallVector<llvm::Value *, 32> callArgs;
+  fieldIdx = 0;
+  for (auto *arg : args) {
+    if (isa<llvm::Constant>(arg)) {
+      callArgs.push_back(arg);
+      continue;
+    }
+    callArgs.push_back(taskBuilder.CreateLoad(
+        arg->getType(),
+        taskBuilder.CreateStructGEP(closureTy, taskClosure, fieldIdx++)));
+  }
+  callArgs.push_back(&*(taskArgs + 1));
+  callArgs.push_back(&*(taskArgs + 2));
+  createCall(taskBuilder, callee, callArgs);
+  taskBuilder.CreateRetVoid();
+
+  // Emit the call of the dispatcher. The addresses of the dispatcher and of the
+  // thread pool are loaded from the global variables that are initialized by
+  // the runtime.
+  auto *dispatchTy = llvm::FunctionType::get(
+      voidTy, {int8PtrTy, taskTy->getPointerTo(), int8PtrTy, sizeTTy, sizeTTy},
+      false);
+  auto *dispatchPtrTy = dispatchTy->getPointerTo();
+  auto *dispatch = builder.CreateLoad(
+      dispatchPtrTy, getRuntimeVar(getDispatcherVarName(), dispatchPtrTy));
+  auto *pool = builder.CreateLoad(
+      int8PtrTy, getRuntimeVar(getThreadPoolVarName(), int8PtrTy));
+  builder.CreateCall(dispatchTy, dispatch,
+                     {pool, task, builder.CreateBitCast(closure, int8PtrTy),
+                      numIterationsVal, emitConstSizeT(builder, minChunkSize)});
+}
+
+llvm::GlobalVariable *LLVMIRGen::getRuntimeVar(llvm::StringRef name,
+                                               llvm::PointerType *ty) {
+  if (auto *var = llmodule_->getNamedGlobal(name)) {
+    return var;
+  }
+  return new llvm::GlobalVariable(*llmodule_, ty, /* isConstant */ false,
+                                  llvm::GlobalValue::ExternalLinkage,
+                                  llvm::ConstantPointerNull::get(ty), name);
+}
+
+void LLVMIRGen::initParallelRuntime(void *poolVar, void *dispatcherVar,
+                                    ThreadPool *pool) {
+  using DispatcherTy = void (*)(void *, void (*)(void *, size_t, size_t),
+                                void *, size_t, size_t);
+  *static_cast<void **>(poolVar) = pool;
+  *static_cast<DispatcherTy *>(dispatcherVar) = &dispatchParallelTask;
+}
+
+/// The values of the hardware counters of the thread at the beginning of the
+/// region it executes. The regions do not nest, and the threads executing
+/// the same code concurrently have their own ones.
+static thread_local uint64_t countersAtRegionBegin[NumPerfCounters];
+
+/// Called by the instrumented code at the beginning of a region.
+static void beginCounters() { readPerfCounters(countersAtRegionBegin); }
+
+/// Called by the instrumented code at the end of the region \p region. Adds
+/// the increments of the counters since beginCounters() to the entries of the
+/// region in \p profile.
+static void endCounters(uint64_t *profile, size_t region) {
+  uint64_t values[NumPerfCounters];
+  if (!readPerfCounters(values)) {
+    return;
+  }
+  for (unsigned i = 0; i < NumPerfCounters; i++) {
+    __atomic_fetch_add(&profile[region * NumPerfCounters + i],
+                       values[i] - countersAtRegionBegin[i], __ATOMIC_RELAXED);
+  }
+}
+
+void LLVMIRGen::initCounterRuntime(void *beginVar, void *endVar) {
+  using BeginTy = void (*)();
+  using EndTy = void (*)(uint64_t *, size_t);
+  *static_cast<BeginTy *>(beginVar) = &beginCounters;
+  *static_cast<EndTy *>(endVar) = &endCounters;
+}
+
+/// Called by the code with cancellation checks before its instructions.
+static int shouldStopJITRun() { return shouldStopRun(); }
+
+void LLVMIRGen::initCancellationRuntime(void *shouldStopVar) {
+  using ShouldStopTy = int (*)();
+  *static_cast<ShouldStopTy *>(shouldStopVar) = &shouldStopJITRun;
+}
+
+namespace {
+/// A thread that reads the weights that the JITted code is about to use, so
+/// that they are in the last level cache, which it shares with the thread
+/// executing the code, by the time the instructions load them. The executing
+/// thread only queues the requests, and is not stalled by the misses. The
+/// thread is shared by all of the functions, and drops the requests that it
+/// cannot keep up with.
+class WeightPrefetcher {
+  /// The largest number of ranges that wait to be read.
+  static constexpr size_t maxPending = 64;
+  /// The distance between the loads, which bring in a cache line each.
+  static constexpr size_t lineSize = 64;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  /// The ranges to read, oldest first.
+  std::deque<std::pair<const char *, size_t>> pending_;
+  bool stop_{false};
+  std::thread thread_;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait(lock, [&] { return stop_ || !pending_.empty(); });
+      if (stop_) {
+        return;
+      }
+      auto range = pending_.front();
+      pending_.pop_front();
+      lock.unlock();
+      for (size_t i = 0; i < range.second; i += lineSize) {
+        (void)*reinterpret_cast<const volatile char *>(range.first + i);
+      }
+      lock.lock();
+    }
+  }
+
+public:
+  WeightPrefetcher() : thread_([this]() { run(); }) {}
+
+  ~WeightPrefetcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+  }
+
+  /// Queue the reading of the \p size bytes at \p data.
+  void prefetch(const void *data, size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_.size() >= maxPending) {
+        return;
+      }
+      pending_.emplace_back(static_cast<const char *>(data), size);
+    }
+    cv_.notify_one();
+  }
+
+  static WeightPrefetcher &get() {
+    static WeightPrefetcher prefetcher;
+    return prefetcher;
+  }
+};
+} // namespace
+
+/// Called by the code with weight prefetches before the instructions that
+/// precede the uses of the weights.
+static void prefetchJITWeights(const void *data, size_t size) {
+  WeightPrefetcher::get().prefetch(data, size);
+}
+
+void LLVMIRGen::initPrefetchRuntime(void *prefetchVar) {
+  using PrefetchTy = void (*)(const void *, size_t);
+  *static_cast<PrefetchTy *>(prefetchVar) = &prefetchJITWeights;
+}
+
+void LLVMIRGen::emitCancellationCheck(llvm::IRBuilder<> &builder) {
+  if (!cancellationChecks_) {
+    return;
+  }
+  auto *F = builder.GetInsertBlock()->getParent();
+  auto *checkTy = llvm::FunctionType::get(builder.getInt32Ty(), {}, false);
+  auto *checkPtrTy = checkTy->getPointerTo();
+  auto *check = builder.CreateLoad(
+      checkPtrTy, getRuntimeVar(getShouldStopVarName(), checkPtrTy));
+  auto *stop = builder.CreateICmpNE(builder.CreateCall(checkTy, check),
+                                    builder.getInt32(0));
+  if (!stopBlock_) {
+    stopBlock_ = llvm::BasicBlock::Create(ctx_, "stop_run", F);
+    llvm::IRBuilder<> stopBuilder(stopBlock_);
+    stopBuilder.CreateRetVoid();
+  }
+  auto *next = llvm::BasicBlock::Create(ctx_, "run", F);
+  // The runs are rarely stopped.
+  builder.CreateCondBr(stop, stopBlock_, next,
+                       llvm::MDBuilder(ctx_).createBranchWeights(1, 1 << 20));
+  builder.SetInsertPoint(next);
+}
+
+void LLVMIRGen::emitWeightPrefetch(llvm::IRBuilder<> &builder,
+                                   const glow::Value *W, size_t bytes) {
+  auto sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto *int8PtrTy = builder.getInt8PtrTy();
+  auto *prefetchTy = llvm::FunctionType::get(
+      builder.getVoidTy(), {int8PtrTy, sizeTTy}, false);
+  auto *prefetchPtrTy = prefetchTy->getPointerTo();
+  auto *prefetch = builder.CreateLoad(
+      prefetchPtrTy, getRuntimeVar(getPrefetchWeightsVarName(), prefetchPtrTy));
+  auto &kindAndValue = allocationsInfo_.valueNumbers_[W];
+  assert(kindAndValue.first == AllocationsInfo::ValueKind::ConstantWeight &&
+         "Only the constant weights are prefetched");
+  auto *offset = builder.CreateLoad(
+      sizeTTy,
+      builder.CreateGEP(sizeTTy, offsetsArray_,
+                        llvm::ConstantInt::get(sizeTTy, kindAndValue.second)));
+  auto *addr = builder.CreateIntToPtr(
+      builder.CreateAdd(baseConstantWeightVarsAddr_, offset), int8PtrTy);
+  builder.CreateCall(prefetchTy, prefetch,
+                     {addr, emitConstSizeT(builder, bytes)});
+}
+
+/// \returns true if \p I can be emitted in the loop of a data-parallel kernel.
+/// Besides the data-parallel instructions, these are the int8 Quantize and
+/// Dequantize, so that the conversion is done in the loop of the element-wise
+/// instructions that produce or consume the floats instead of as a separate
+/// pass over the tensor.
+static bool isStackable(const Instruction &I) {
+  if (I.isDataParallel()) {
+    return true;
+  }
+  if (auto *QI = dyn_cast<QuantizeInst>(&I)) {
+    return QI->getDest()->getElementType() == ElemKind::Int8QTy;
+  }
+  if (auto *DQI = dyn_cast<DequantizeInst>(&I)) {
+    return DQI->getSrc()->getElementType() == ElemKind::Int8QTy;
+  }
+  return false;
+}
+
+/// The minimal number of elements processed by a data-parallel kernel on a
+/// single thread. Smaller kernels are not worth the synchronization overhead.
+/// It also keeps the chunks processed by different threads apart by more than
+/// a cache line.
+static constexpr size_t dataParallelMinChunkSize = 4096;
+
+/// The minimal number of multiply-accumulate operations performed by a
+/// single thread when a matrix multiplication is split between threads.
+static constexpr size_t matMulMinChunkWork = 1 << 16;
+
+/// \returns true if no instruction other than \p I and the deallocation
+/// accesses the activation \p V, i.e. what \p I writes to it is never read.
+static bool isOnlyAccessedBy(const Value *V, const Instruction *I) {
+  if (!isa<AllocActivationInst>(V)) {
+    return false;
+  }
+  for (const auto &U : ValueUses(V)) {
+    if (U.get() != I && !isa<DeallocActivationInst>(U.get())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// \returns the name of the libjit range kernel that implements the quantized
+/// data-parallel instruction \p I in SIMD, or null if it has none. The range
+/// kernels only take whole tensors, not the broadcast views of the operands.
+static const char *getQuantizedRangeKernelName(const Instruction *I) {
+  const char *name = nullptr;
+  switch (I->getKind()) {
+  case Kinded::Kind::ElementAddInstKind:
+    name = "element_add";
+    break;
+  case Kinded::Kind::ElementSubInstKind:
+    name = "element_sub";
+    break;
+  case Kinded::Kind::ElementMaxInstKind:
+    name = "elementmax";
+    break;
+  case Kinded::Kind::ElementMinInstKind:
+    name = "elementmin";
+    break;
+  case Kinded::Kind::ElementMulInstKind:
+    name = "element_mul";
+    break;
+  default:
+    return nullptr;
+  }
+  for (unsigned i = 0, e = I->getNumOperands(); i < e; i++) {
+    auto *op = I->getOperand(i).first;
+    if (op->getElementType() != ElemKind::Int8QTy || isBroadcastView(op)) {
+      return nullptr;
+    }
+  }
+  return name;
+}
+
+bool LLVMIRGen::emitQuantizedRangeKernel(llvm::IRBuilder<> &builder,
+                                         const Instruction *I) {
+  const char *name = getQuantizedRangeKernelName(I);
+  if (!name) {
+    return false;
+  }
+  auto *dest = I->getOperand(0).first;
+  auto *lhs = I->getOperand(1).first;
+  auto *rhs = I->getOperand(2).first;
+  auto *destTy = dest->getType();
+  auto *lhsTy = lhs->getType();
+  auto *rhsTy = rhs->getType();
+  llvm::SmallVector<llvm::Value *, 16> args = {
+      emitValueAddress(builder, dest),
+      emitValueAddress(builder, lhs),
+      emitValueAddress(builder, rhs),
+      emitConstI32(builder, destTy->getOffset()),
+      emitConstI32(builder, lhsTy->getOffset()),
+      emitConstI32(builder, rhsTy->getOffset())};
+  if (isa<ElementMulInst>(I)) {
+    // The same scale as the one of the mini-kernel, s_l * s_r / s_d.
+    float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
+    auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
+    args.push_back(emitConstI32(builder, scaleParams.pre));
+    args.push_back(emitConstI32(builder, scaleParams.post));
+    args.push_back(emitConstI32(builder, scaleParams.scale));
+  } else {
+    float destScale = destTy->getScale();
+    for (auto *opTy : {lhsTy, rhsTy}) {
+      auto scaleParams = quantization::quantizeScaleOffset32To8(
+          opTy->getScale() / destScale, opTy->getOffset());
+      args.push_back(emitConstI32(builder, scaleParams.pre));
+      args.push_back(emitConstI32(builder, scaleParams.post));
+      args.push_back(emitConstI32(builder, scaleParams.scale));
+    }
+  }
+  auto *F = getFunction(name, ElemKind::Int8QTy);
+  auto *begin = emitTimeProfileBegin(builder, {"", "DataParallel"}, I);
+  emitParallelCall(builder, F, args, dest->size(), dataParallelMinChunkSize);
+  emitTimeProfileEnd(builder, begin);
+  emitHealthChecks(builder, I);
+  return true;
+}
+
 /// Emit the function that implements a data-parallel kernel and calls it.
 ///
 /// The generated kernel functions get buffers as their parameters. The buffers
@@ -597,11 +1190,21 @@ emitBufferAddress(llvm::IRBuilder<> &builder, Value *val,
 /// only once. This allows us to mark all parameters of the generated kernel as
 /// noalias. As a result, the LLVM optimizer makes use of the noalias attributes
 /// and produces nicely vectorized code for the generated data-parallel kernels.
+/// The last two parameters of the kernel are the range [begin, end) of the
+/// elements to be processed, which allows for splitting the kernel between
+/// threads.
 void LLVMIRGen::emitDataParallelKernel(
     llvm::IRBuilder<> &builder, llvm::ArrayRef<const Instruction *> bundle) {
   if (bundle.empty())
     return;
+  // The loop of a stacked kernel calls the mini-kernels one element at a
+  // time, which LLVM only partially vectorizes for the quantized ones. A
+  // quantized instruction that is alone in its bundle calls the SIMD range
+  // kernel of libjit instead.
+  if (bundle.size() == 1 && emitQuantizedRangeKernel(builder, bundle[0]))
+    return;
   llvm::Type *voidTy = llvm::Type::getVoidTy(ctx_);
+  auto *sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
   // Types of arguments for the kernel function being generated.
   llvm::SmallVector<llvm::Type *, 32> argTypes;
   // Map each buffer used by the kernel to the argument number of the kernel
@@ -621,6 +1224,9 @@ void LLVMIRGen::emitDataParallelKernel(
       }
     }
   }
+  // The range of elements to be processed.
+  argTypes.push_back(sizeTTy);
+  argTypes.push_back(sizeTTy);
 
   // Create stacked kernel function type.
   llvm::FunctionType *kernelFuncTy =
@@ -628,6 +1234,7 @@ void LLVMIRGen::emitDataParallelKernel(
   auto *kernelFunc =
       llvm::Function::Create(kernelFuncTy, llvm::Function::InternalLinkage,
                              "libjit_stacked_kernel", llmodule_.get());
+  dataParallelKernels_.push_back(kernelFunc);
   // Mark all kernel function buffer parameters as no-alias, because above
   // we ensured that they are uniqued.
   for (unsigned paramIdx = 0; paramIdx < bufferToArgNum.size(); ++paramIdx) {
@@ -638,11 +1245,11 @@ void LLVMIRGen::emitDataParallelKernel(
   llvm::BasicBlock *entryBB =
       llvm::BasicBlock::Create(ctx_, "entry", kernelFunc);
   llvm::IRBuilder<> kernelBuilder(entryBB);
-  // Number of tensor elements.
-  auto *numElements =
-      emitValueSize(kernelBuilder, bundle[0]->getOperand(0).first);
-  // Create a loop inside the stacked kernel function being generated.
-  auto loopBBs = createLoop(kernelBuilder, ctx_, numElements);
+  // Create a loop over the range of elements inside the stacked kernel
+  // function being generated.
+  auto *rangeBegin = kernelFunc->args().begin() + buffers.size();
+  auto *rangeEnd = rangeBegin + 1;
+  auto loopBBs = createLoop(kernelBuilder, ctx_, rangeBegin, rangeEnd);
 
   // Get the index parameter of the loop.
   // This is the PHI node of the BB.
@@ -654,7 +1261,7 @@ void LLVMIRGen::emitDataParallelKernel(
   // instruction.
   for (auto &BI : bundle) {
     // Name of the stacked operation to be invoked.
-    assert(BI->isDataParallel() && "Data parallel operation is expected");
+    assert(isStackable(*BI) && "Data parallel operation is expected");
     generateLLVMIRForDataParallelInstr(kernelBuilder, BI, kernelFunc,
                                        bufferToArgNum, kernelLoopIdx);
   }
@@ -662,8 +1269,67 @@ void LLVMIRGen::emitDataParallelKernel(
   // Add a return.
   kernelBuilder.CreateRetVoid();
 
-  // Emit a call of the kernel.
-  createCall(builder, kernelFunc, buffers);
+  // Emit a call of the kernel for all elements of the tensors.
+  size_t numElements = bundle[0]->getOperand(0).first->size();
+  auto *begin = emitTimeProfileBegin(builder, {"", "DataParallel"}, bundle);
+  emitParallelCall(builder, kernelFunc, buffers, numElements,
+                   dataParallelMinChunkSize);
+  emitTimeProfileEnd(builder, begin);
+  emitHealthChecks(builder, bundle);
+}
+
+/// \returns the number of LLVM instructions of the functions \p Fs.
+static size_t countInstructions(llvm::ArrayRef<llvm::Function *> Fs) {
+  size_t count = 0;
+  for (auto *F : Fs) {
+    for (auto &BB : *F) {
+      count += BB.size();
+    }
+  }
+  return count;
+}
+
+void LLVMIRGen::shareDataParallelKernels() {
+  if (!jitShareKernels || dataParallelKernels_.size() < 2) {
+    return;
+  }
+  // The phase reports the instructions of the kernels before and after the
+  // sharing, which the LLVM pipeline and the machine code generation no
+  // longer process.
+  ScopedCompilePhase phase("share kernels", "LLVM instructions", [this]() {
+    return countInstructions(dataParallelKernels_);
+  });
+  // The kernels differ only if their code differs, including the constants
+  // the instructions are specialized for. The kernels that are kept are
+  // found by their structural hash, and compared in full.
+  llvm::GlobalNumberState globalNumbers;
+  std::unordered_multimap<llvm::FunctionComparator::FunctionHash,
+                          llvm::Function *>
+      keptByHash;
+  std::vector<llvm::Function *> kept;
+  for (auto *kernel : dataParallelKernels_) {
+    auto hash = llvm::FunctionComparator::functionHash(*kernel);
+    llvm::Function *same = nullptr;
+    auto range = keptByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second && !same; ++it) {
+      llvm::FunctionComparator cmp(kernel, it->second, &globalNumbers);
+      if (cmp.compare() == 0) {
+        same = it->second;
+      }
+    }
+    if (!same) {
+      keptByHash.insert({hash, kernel});
+      kept.push_back(kernel);
+      continue;
+    }
+    // The kernels get their buffers as arguments, so the calls of the
+    // duplicate can call the kernel that is kept. The shared kernel is not
+    // inlined, otherwise its code would be duplicated again.
+    kernel->replaceAllUsesWith(same);
+    kernel->eraseFromParent();
+    same->addFnAttr(llvm::Attribute::AttrKind::NoInline);
+  }
+  dataParallelKernels_ = std::move(kept);
 }
 
 /// Check if the provided operand overlaps with an operand of an instruction
@@ -699,66 +1365,378 @@ static bool isOverlappingWithAnyBundleBufferOperands(
   return false;
 }
 
-void LLVMIRGen::generateLLVMIRForModule(llvm::IRBuilder<> &builder) {
-  // Go over the instructions and try to group them into bundles.
-  auto &instrs = F_->getInstrs();
+/// \returns true if the data-parallel instruction \p I can join \p bundle:
+/// its operands have as many elements as the ones of the bundle, and the
+/// buffers it mutates have no partial overlap with the buffers of the bundle,
+/// since overlapping operand buffers are not data parallel.
+static bool
+isBundleCompatible(AllocationsInfo &allocationsInfo,
+                   llvm::SmallVectorImpl<const Instruction *> &bundle,
+                   const Instruction *I) {
+  if (bundle.empty()) {
+    return true;
+  }
+  // Check if shapes have the same amount of elements.
+  if (I->getOperand(0).first->size() !=
+      bundle.back()->getOperand(0).first->size()) {
+    return false;
+  }
+  for (auto op : I->getOperands()) {
+    // Skip non-mutated operands.
+    if (op.second == OperandKind::In)
+      continue;
+    if (isOverlappingWithAnyBundleBufferOperands(allocationsInfo, bundle,
+                                                 op.first)) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  // Group instructions into bundles of shape compatible data parallel
-  // instructions and emit them.
-  llvm::SmallVector<const Instruction *, 32> bundle;
-  for (auto &I : instrs) {
-    if (!I.isDataParallel()) {
-      // Ignore memory management instructions as they are handled by the
-      // MemoryManager and are NOPs for a JIT.
-      if (isa<AllocActivationInst>(&I) || isa<DeallocActivationInst>(&I) ||
-          isa<TensorViewInst>(&I))
+/// \returns true if \p A and \p B access overlapping memory and one of them
+/// writes it, so that they must execute in their original order.
+static bool dependsOn(AllocationsInfo &allocationsInfo, const Instruction *A,
+                      const Instruction *B) {
+  for (const auto &opA : A->getOperands()) {
+    auto addrA = allocationsInfo.allocatedAddressed_[opA.first];
+    auto sizeA = opA.first->getSizeInBytes();
+    for (const auto &opB : B->getOperands()) {
+      if (opA.second == OperandKind::In && opB.second == OperandKind::In) {
         continue;
-      emitDataParallelKernel(builder, bundle);
-      bundle.clear();
-      generateLLVMIRForInstr(builder, &I);
-      continue;
+      }
+      auto addrB = allocationsInfo.allocatedAddressed_[opB.first];
+      auto sizeB = opB.first->getSizeInBytes();
+      if (addrA < addrB + sizeB && addrB < addrA + sizeA) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// \returns the instructions of \p instrs that generate code, in the order of
+/// emission. Each data-parallel instruction that starts a bundle is followed
+/// by the compatible data-parallel instructions of the next
+/// \p maxLookahead ones that can be hoisted next to it, so that they share
+/// one loop over the memory. An instruction is hoisted over the instructions
+/// that stay in place only if they access disjoint memory or only read the
+/// memory that both access. The offsets of the buffers are already assigned,
+/// so the memory that the allocator reuses between the buffers is compared
+/// too, and none of the buffers is used outside of its live range.
+static std::vector<const Instruction *>
+formDataParallelBundles(const IRFunction::InstListTy &instrs,
+                        AllocationsInfo &allocationsInfo,
+                        size_t maxLookahead) {
+  std::vector<const Instruction *> code;
+  for (const auto &I : instrs) {
+    // Ignore memory management instructions as they are handled by the
+    // MemoryManager and are NOPs for a JIT.
+    if (!isa<AllocActivationInst>(&I) && !isa<DeallocActivationInst>(&I) &&
+        !isa<TensorViewInst>(&I)) {
+      code.push_back(&I);
     }
+  }
 
-    // This is a data parallel instruction.
+  std::vector<const Instruction *> order;
+  order.reserve(code.size());
+  std::vector<bool> scheduled(code.size());
+  for (size_t i = 0, e = code.size(); i < e; i++) {
+    if (scheduled[i]) {
+      continue;
+    }
+    order.push_back(code[i]);
+    if (!isStackable(*code[i])) {
+      continue;
+    }
+    llvm::SmallVector<const Instruction *, 32> bundle{code[i]};
+    for (size_t j = i + 1, end = std::min(e, i + 1 + maxLookahead); j < end;
+         j++) {
+      if (scheduled[j] || !isStackable(*code[j]) ||
+          !isBundleCompatible(allocationsInfo, bundle, code[j])) {
+        continue;
+      }
+      bool canHoist = true;
+      for (size_t k = i + 1; k < j && canHoist; k++) {
+        canHoist =
+            scheduled[k] || !dependsOn(allocationsInfo, code[k], code[j]);
+      }
+      if (!canHoist) {
+        continue;
+      }
+      scheduled[j] = true;
+      order.push_back(code[j]);
+      bundle.push_back(code[j]);
+    }
+  }
+  return order;
+}
 
-    // Check if the current instruction is shape compatible with the bundle.
-    bool isBundleCompatible = true;
-    if (!bundle.empty()) {
-      auto val = I.getOperand(0).first;
-      auto bundleVal = bundle.back()->getOperand(0).first;
-      // Check if shapes have the same amount of elements.
-      isBundleCompatible = val->size() == bundleVal->size();
+llvm::Value *
+LLVMIRGen::emitTimeProfileBegin(llvm::IRBuilder<> &builder,
+                                TimeProfileRegion region,
+                                llvm::ArrayRef<const Instruction *> instrs) {
+  if (!instrumentTime_ || instrs.empty()) {
+    return nullptr;
+  }
+  for (const auto *I : instrs) {
+    if (!region.name.empty()) {
+      region.name += ",";
     }
+    region.name += I->getName();
+    // The operands that are read and written are moved twice.
+    auto cost = I->getCost();
+    region.flops += cost.flops;
+    region.bytes += cost.getBytes();
+  }
+  timeProfileRegions_.push_back(std::move(region));
+  if (instrumentCounters_) {
+    // The counters are read outside of the clock readings, which keeps their
+    // cost out of the times.
+    auto *beginTy = llvm::FunctionType::get(builder.getVoidTy(), false);
+    auto *beginPtrTy = beginTy->getPointerTo();
+    auto *countersBegin = builder.CreateLoad(
+        beginPtrTy, getRuntimeVar(getCountersBeginVarName(), beginPtrTy));
+    builder.CreateCall(beginTy, countersBegin, {});
+  }
+  return createCall(builder, getFunction("time_ns"), {});
+}
+
+void LLVMIRGen::emitTimeProfileEnd(llvm::IRBuilder<> &builder,
+                                   llvm::Value *begin) {
+  if (!begin) {
+    return;
+  }
+  auto *int64PtrTy = builder.getInt64Ty()->getPointerTo();
+  auto *profile = builder.CreateLoad(
+      int64PtrTy, getRuntimeVar(getTimeProfileVarName(), int64PtrTy));
+  auto *region = emitConstSizeT(builder, timeProfileRegions_.size() - 1);
+  markArgAsUnspecialized(region);
+  createCall(builder, getFunction("time_profile_add"),
+             {profile, region, begin});
+  if (instrumentCounters_) {
+    auto *endTy = llvm::FunctionType::get(
+        builder.getVoidTy(), {int64PtrTy, region->getType()}, false);
+    auto *endPtrTy = endTy->getPointerTo();
+    auto *countersEnd = builder.CreateLoad(
+        endPtrTy, getRuntimeVar(getCountersEndVarName(), endPtrTy));
+    auto *counterProfile = builder.CreateLoad(
+        int64PtrTy, getRuntimeVar(getCounterProfileVarName(), int64PtrTy));
+    builder.CreateCall(endTy, countersEnd, {counterProfile, region});
+  }
+}
 
-    // Check all mutated operands of the current instruction. Their memory
-    // regions should not have a non-exact overlap with any operands of the
-    // bundled instructions. In case this condition does not hold, the current
-    // instruction cannot be included into the data-parallel bundle, because
-    // overlapping operand buffers are not data parallel.
-    for (auto op : I.getOperands()) {
-      // Skip non-mutated operands.
-      if (op.second == OperandKind::In)
+void LLVMIRGen::emitHealthChecks(llvm::IRBuilder<> &builder,
+                                 llvm::ArrayRef<const Instruction *> instrs) {
+  if (!instrumentHealth_) {
+    return;
+  }
+  // A value written by several instructions of a kernel is checked once, with
+  // the name of its last writer.
+  llvm::SmallVector<std::pair<Value *, const Instruction *>, 4> outputs;
+  for (const auto *I : instrs) {
+    for (const auto &op : I->getOperands()) {
+      if (op.second == OperandKind::In ||
+          op.first->getElementType() != ElemKind::FloatTy) {
         continue;
-      // If the mutated operand buffer overlaps with any buffer already used by
-      // the bundle, the current instruction cannot become a part of the bundle.
-      if (isOverlappingWithAnyBundleBufferOperands(allocationsInfo_, bundle,
-                                                   op.first)) {
-        isBundleCompatible = false;
+      }
+      auto it = std::find_if(
+          outputs.begin(), outputs.end(),
+          [&](const std::pair<Value *, const Instruction *> &output) {
+            return output.first == op.first;
+          });
+      if (it != outputs.end()) {
+        it->second = I;
+      } else {
+        outputs.push_back({op.first, I});
+      }
+    }
+  }
+  if (outputs.empty()) {
+    return;
+  }
+
+  // The executions that are not sampled leave the address of the statistics
+  // null, which costs them one load and branch per checked tensor.
+  auto *F = builder.GetInsertBlock()->getParent();
+  auto sizeTTy = builder.getIntNTy(sizeof(size_t) * 8);
+  auto *statsIdx = llvm::ConstantInt::get(sizeTTy, getHealthOffsetIndex());
+  auto *statsAddr = builder.CreateLoad(
+      sizeTTy, builder.CreateGEP(sizeTTy, offsetsArray_, statsIdx));
+  auto *sampled =
+      builder.CreateICmpNE(statsAddr, llvm::ConstantInt::get(sizeTTy, 0));
+  auto *checkBB = llvm::BasicBlock::Create(ctx_, "health_check", F);
+  auto *nextBB = llvm::BasicBlock::Create(ctx_, "health_next", F);
+  builder.CreateCondBr(sampled, checkBB, nextBB,
+                       llvm::MDBuilder(ctx_).createBranchWeights(1, 100));
+  builder.SetInsertPoint(checkBB);
+  auto *statsBase =
+      builder.CreateIntToPtr(statsAddr, builder.getFloatTy()->getPointerTo());
+  for (const auto &output : outputs) {
+    Value *V = output.first;
+    size_t step = 1;
+    if (healthMaxElements_ && V->size() > healthMaxElements_) {
+      step = V->size() / healthMaxElements_;
+    }
+    auto *stats = builder.CreateGEP(
+        builder.getFloatTy(), statsBase,
+        emitConstSizeT(builder, healthTensors_.size() * NumHealthStats));
+    healthTensors_.push_back(std::string(V->getName()) + "@" +
+                             std::string(output.second->getName()));
+    createCall(builder, getFunction("tensor_health", ElemKind::FloatTy),
+               {stats, emitValueAddress(builder, V),
+                emitConstSizeT(builder, V->size()),
+                emitConstSizeT(builder, step)});
+  }
+  builder.CreateBr(nextBB);
+  builder.SetInsertPoint(nextBB);
+}
+
+void LLVMIRGen::emitSegment(
+    llvm::IRBuilder<> &builder, llvm::StringRef name,
+    llvm::function_ref<void(llvm::IRBuilder<> &)> emit) {
+  if (!outlineSegments_ || emitDebugInfo) {
+    emit(builder);
+    return;
+  }
+  auto *F = builder.GetInsertBlock()->getParent();
+  auto *segment = llvm::Function::Create(
+      F->getFunctionType(), llvm::Function::InternalLinkage,
+      "jit_segment_" + std::to_string(segments_.size()) + "_" + name.str(),
+      llmodule_.get());
+  segments_.push_back(segment);
+  llvm::IRBuilder<> segmentBuilder(
+      llvm::BasicBlock::Create(ctx_, "entry", segment));
+  // The segment computes the addresses from its own arguments, which are the
+  // same as the arguments of the caller.
+  auto *baseActivationsAddr = baseActivationsAddr_;
+  auto *baseConstantWeightVarsAddr = baseConstantWeightVarsAddr_;
+  auto *baseMutableWeightVarsAddr = baseMutableWeightVarsAddr_;
+  auto *offsetsArray = offsetsArray_;
+  loadBaseAddresses(segmentBuilder);
+  emit(segmentBuilder);
+  segmentBuilder.CreateRetVoid();
+  baseActivationsAddr_ = baseActivationsAddr;
+  baseConstantWeightVarsAddr_ = baseConstantWeightVarsAddr;
+  baseMutableWeightVarsAddr_ = baseMutableWeightVarsAddr;
+  offsetsArray_ = offsetsArray;
+
+  llvm::SmallVector<llvm::Value *, 4> args;
+  for (auto &arg : F->args()) {
+    args.push_back(&arg);
+  }
+  createCall(builder, segment, args);
+}
+
+void LLVMIRGen::generateLLVMIRForModule(llvm::IRBuilder<> &builder) {
+  // Go over the instructions and try to group them into bundles. The
+  // data-parallel instructions that are separated by independent ones are
+  // brought together first.
+  constexpr size_t maxBundleLookahead = 32;
+  auto instrs = formDataParallelBundles(F_->getInstrs(), allocationsInfo_,
+                                        maxBundleLookahead);
+
+  // The constant weights that are worth prefetching, in the order of their
+  // first uses, with the indices of the instructions that first use them.
+  // The smaller weights are left to the hardware prefetchers.
+  constexpr size_t minPrefetchBytes = 4096;
+  std::vector<std::pair<size_t, const Value *>> weightUses;
+  if (weightPrefetchBudget_) {
+    llvm::DenseSet<const Value *> seen;
+    size_t idx = 0;
+    for (const auto *I : instrs) {
+      for (const auto &op : I->getOperands()) {
+        auto it = allocationsInfo_.valueNumbers_.find(op.first);
+        if (op.second == OperandKind::In && isa<WeightVar>(op.first) &&
+            it != allocationsInfo_.valueNumbers_.end() &&
+            it->second.first == AllocationsInfo::ValueKind::ConstantWeight &&
+            op.first->getSizeInBytes() >= minPrefetchBytes &&
+            seen.insert(op.first).second) {
+          weightUses.push_back({idx, op.first});
+        }
+      }
+      idx++;
+    }
+  }
+  // The uses [0, firstInFlight) are done, the weights of the uses
+  // [firstInFlight, nextPrefetch) are prefetched and add up to bytesInFlight.
+  size_t firstInFlight = 0;
+  size_t nextPrefetch = 0;
+  size_t bytesInFlight = 0;
+  std::vector<size_t> prefetchedBytes(weightUses.size());
+  // Before the instructions up to the index \p last run, prefetch the
+  // weights of the next instructions, as long as they fit the budget.
+  auto emitWeightPrefetches = [&](size_t last) {
+    while (firstInFlight < nextPrefetch &&
+           weightUses[firstInFlight].first <= last) {
+      bytesInFlight -= prefetchedBytes[firstInFlight++];
+    }
+    // Skip the weights that did not fit the budget before their use.
+    if (firstInFlight == nextPrefetch) {
+      while (nextPrefetch < weightUses.size() &&
+             weightUses[nextPrefetch].first <= last) {
+        nextPrefetch++;
+      }
+      firstInFlight = nextPrefetch;
+    }
+    while (nextPrefetch < weightUses.size()) {
+      // Only the head of a weight larger than the budget is prefetched.
+      const Value *W = weightUses[nextPrefetch].second;
+      size_t bytes = std::min(W->getSizeInBytes(), weightPrefetchBudget_);
+      if (bytesInFlight + bytes > weightPrefetchBudget_) {
         break;
       }
+      emitWeightPrefetch(builder, W, bytes);
+      bytesInFlight += bytes;
+      prefetchedBytes[nextPrefetch++] = bytes;
+    }
+  };
+  size_t instrIdx = 0;
+
+  // Group instructions into bundles of shape compatible data parallel
+  // instructions and emit them.
+  llvm::SmallVector<const Instruction *, 32> bundle;
+  size_t bundleEnd = 0;
+  auto emitBundle = [&]() {
+    if (bundle.empty()) {
+      return;
+    }
+    emitCancellationCheck(builder);
+    emitWeightPrefetches(bundleEnd);
+    emitSegment(builder, bundle.front()->getName(),
+                [&](llvm::IRBuilder<> &segmentBuilder) {
+                  emitDataParallelKernel(segmentBuilder, bundle);
+                });
+    bundle.clear();
+  };
+  for (const auto *I : instrs) {
+    size_t idx = instrIdx++;
+    if (!isStackable(*I)) {
+      emitBundle();
+      emitCancellationCheck(builder);
+      emitWeightPrefetches(idx);
+      emitSegment(builder, I->getName(),
+                  [&](llvm::IRBuilder<> &segmentBuilder) {
+                    auto *begin = emitTimeProfileBegin(
+                        segmentBuilder, {"", I->getKindName()}, I);
+                    generateLLVMIRForInstr(segmentBuilder, I);
+                    emitTimeProfileEnd(segmentBuilder, begin);
+                    emitHealthChecks(segmentBuilder, I);
+                  });
+      continue;
     }
 
-    // If the instruction cannot be added to the current bundle, emit the kernel
-    // for the current bundle and start a new bundle.
-    if (!isBundleCompatible) {
-      emitDataParallelKernel(builder, bundle);
-      bundle.clear();
+    // This is a data parallel instruction. If it cannot be added to the
+    // current bundle, emit the kernel for the current bundle and start a new
+    // bundle.
+    if (!isBundleCompatible(allocationsInfo_, bundle, I)) {
+      emitBundle();
     }
     // Add a data parallel instruction to the bundle.
-    bundle.push_back(&I);
+    bundle.push_back(I);
+    bundleEnd = idx;
   }
 
-  emitDataParallelKernel(builder, bundle);
+  emitBundle();
 }
 
 void LLVMIRGen::generateLLVMIRForDataParallelInstr(
@@ -766,7 +1744,7 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     llvm::Function *kernel, llvm::DenseMap<Value *, int> &bufferToArgNum,
     llvm::Value *loopCount) {
   setCurrentDebugLocation(builder, I);
-  assert(I->isDataParallel() && "Expected a data parallel instruction");
+  assert(isStackable(*I) && "Expected a data parallel instruction");
   switch (I->getKind()) {
 
 #define ARITHMETIC_UNARY_OP_WITH_IMM_CASE(INST_NAME_, FUN_NAME_, VALUE_)       \
@@ -785,8 +1763,12 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
       /* Perform this early and let jit library to work */                     \
       /* with quantized number. */                                             \
       TensorQuantizationParams TQP{destTy->getScale(), destTy->getOffset()};   \
-      auto quantizedValue = quantization::quantize(value, TQP);                \
-      auto *val = emitConstI8(builder, quantizedValue);                        \
+      auto *val =                                                              \
+          destTy->getElementType() == ElemKind::Int16QTy                       \
+              ? emitConst(builder,                                             \
+                          quantization::quantize<int16_t>(value, TQP),         \
+                          ElemKind::Int16QTy)                                  \
+              : emitConstI8(builder, quantization::quantize(value, TQP));      \
       auto *stackedOpCall =                                                    \
           createCall(builder, F, {loopCount, val, pointerNull, pointerNull});  \
       auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,        \
@@ -907,12 +1889,48 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     ARITHMETIC_UNARY_OP_CASE(ElementLog, "element_log");
 #undef ARITHMETIC_UNARY_OP_CASE
 
+  case Kinded::Kind::QuantizeInstKind: {
+    auto *QI = cast<QuantizeInst>(I);
+    auto *dest = QI->getDest();
+    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
+    auto *srcPtr =
+        emitBufferAddress(builder, QI->getSrc(), kernel, bufferToArgNum);
+    auto *destType = dest->getType();
+    auto *scale = emitConstF32(builder, destType->getScale());
+    auto *offset = emitConstI32(builder, destType->getOffset());
+    auto *F = getFunction("quantize_kernel", dest->getElementType());
+    auto *stackedOpCall =
+        createCall(builder, F, {loopCount, srcPtr, scale, offset});
+    auto *destAddr = builder.CreateGEP(builder.getInt8Ty(), destPtr, loopCount,
+                                       "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
+    break;
+  }
+
+  case Kinded::Kind::DequantizeInstKind: {
+    auto *DQI = cast<DequantizeInst>(I);
+    auto *dest = DQI->getDest();
+    auto *src = DQI->getSrc();
+    auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
+    auto *srcPtr = emitBufferAddress(builder, src, kernel, bufferToArgNum);
+    auto *srcType = src->getType();
+    auto *scale = emitConstF32(builder, srcType->getScale());
+    auto *offset = emitConstI32(builder, srcType->getOffset());
+    auto *F = getFunction("dequantize_kernel", dest->getElementType());
+    auto *stackedOpCall =
+        createCall(builder, F, {loopCount, srcPtr, scale, offset});
+    auto *destAddr = builder.CreateGEP(builder.getFloatTy(), destPtr,
+                                       loopCount, "buffer.element.addr");
+    builder.CreateStore(stackedOpCall, destAddr);
+    break;
+  }
+
   case Kinded::Kind::CopyInstKind: {
     auto *CI = cast<CopyInst>(I);
     auto *dest = CI->getDest();
     auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
-    auto *srcPtr =
-        emitBufferAddress(builder, CI->getSrc(), kernel, bufferToArgNum);
+    auto *srcPtr = emitOperandAddress(builder, CI->getSrc(), kernel,
+                                      bufferToArgNum, loopCount);
     auto *F = getFunction("copy_kernel", dest->getElementType());
     auto *elementTy = getElementType(builder, dest);
     auto *pointerNull =
@@ -968,8 +1986,10 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhs = AN->getLHS();                                                  \
     auto *rhs = AN->getRHS();                                                  \
     auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);  \
-    auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);    \
-    auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);    \
+    auto *lhsPtr =                                                             \
+        emitOperandAddress(builder, lhs, kernel, bufferToArgNum, loopCount);   \
+    auto *rhsPtr =                                                             \
+        emitOperandAddress(builder, rhs, kernel, bufferToArgNum, loopCount);   \
                                                                                \
     auto *F = getFunction(FUN_NAME_ "_kernel", dest->getElementType());        \
     auto *elementTy = getElementType(builder, dest);                           \
@@ -987,6 +2007,20 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
                                                                                \
       float destScale = destTy->getScale();                                    \
                                                                                \
+      if (destTy->getElementType() == ElemKind::Int16QTy) {                    \
+        /* The 16-bit kernels scale the operands in floating point. */         \
+        auto *lhsScale = emitConstF32(builder, lhsTy->getScale() / destScale); \
+        auto *rhsScale = emitConstF32(builder, rhsTy->getScale() / destScale); \
+        auto *stackedOpCall = createCall(                                      \
+            builder, F,                                                        \
+            {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,      \
+             lhsScale, rhsScale});                                             \
+        auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,      \
+                                           "buffer.element.addr");             \
+        builder.CreateStore(stackedOpCall, destAddr);                          \
+        break;                                                                 \
+      }                                                                        \
+                                                                               \
       auto lhsScaleParams = quantization::quantizeScaleOffset32To8(            \
           lhsTy->getScale() / destScale, lhsTy->getOffset());                  \
       auto rhsScaleParams = quantization::quantizeScaleOffset32To8(            \
@@ -1102,8 +2136,10 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhs = MI->getLHS();
     auto *rhs = MI->getRHS();
     auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
-    auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
-    auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);
+    auto *lhsPtr =
+        emitOperandAddress(builder, lhs, kernel, bufferToArgNum, loopCount);
+    auto *rhsPtr =
+        emitOperandAddress(builder, rhs, kernel, bufferToArgNum, loopCount);
 
     // Need _kernel suffix since these operations are implemented as
     // "data-parallel" kernels in libjit.
@@ -1125,6 +2161,16 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
       //    s_d * (i_d - o_d) = s_l * (i_l - o_l) * s_r * (i_r - o_r)
       // => i_d = (s_l * s_r / s_d) * (i_l - o_l) * (i_r - o_r) + o_d
       float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
+      if (destTy->getElementType() == ElemKind::Int16QTy) {
+        auto *stackedOpCall = createCall(
+            builder, F,
+            {loopCount, lhsPtr, rhsPtr, destOffset, lhsOffset, rhsOffset,
+             emitConstF32(builder, scale)});
+        auto *destAddr = builder.CreateGEP(elementTy, destPtr, loopCount,
+                                           "buffer.element.addr");
+        builder.CreateStore(stackedOpCall, destAddr);
+        break;
+      }
       auto scaleParams = quantization::quantizeScaleOffset32To8(scale, 0);
       auto *mulPre = emitConstI32(builder, scaleParams.pre);
       auto *mulPost = emitConstI32(builder, scaleParams.post);
@@ -1153,8 +2199,10 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
     auto *lhs = MI->getLHS();
     auto *rhs = MI->getRHS();
     auto *destPtr = emitBufferAddress(builder, dest, kernel, bufferToArgNum);
-    auto *lhsPtr = emitBufferAddress(builder, lhs, kernel, bufferToArgNum);
-    auto *rhsPtr = emitBufferAddress(builder, rhs, kernel, bufferToArgNum);
+    auto *lhsPtr =
+        emitOperandAddress(builder, lhs, kernel, bufferToArgNum, loopCount);
+    auto *rhsPtr =
+        emitOperandAddress(builder, rhs, kernel, bufferToArgNum, loopCount);
 
     // Need _kernel suffix since these operations are implemented as
     // "data-parallel" kernels in libjit.
@@ -1210,6 +2258,130 @@ void LLVMIRGen::generateLLVMIRForDataParallelInstr(
   }
 }
 
+void LLVMIRGen::emitRecurrentSequence(llvm::IRBuilder<> &builder,
+                                      const glow::Instruction *I) {
+  Value *dest, *inputGates, *initH, *weights, *bias, *lengths, *scratch;
+  Value *initC = nullptr;
+  std::string stepName;
+  if (auto *RS = dyn_cast<RNNSequenceInst>(I)) {
+    dest = RS->getDest();
+    inputGates = RS->getInputGates();
+    initH = RS->getInitH();
+    weights = RS->getHiddenWeights();
+    bias = RS->getHiddenBias();
+    lengths = RS->getLengths();
+    scratch = RS->getScratch();
+    stepName = "rnn_step";
+  } else if (auto *LS = dyn_cast<LSTMSequenceInst>(I)) {
+    dest = LS->getDest();
+    inputGates = LS->getInputGates();
+    initH = LS->getInitH();
+    initC = LS->getInitC();
+    weights = LS->getHiddenWeights();
+    bias = LS->getHiddenBias();
+    lengths = LS->getLengths();
+    scratch = LS->getScratch();
+    stepName = "lstm_step";
+  } else {
+    auto *GS = cast<GRUSequenceInst>(I);
+    dest = GS->getDest();
+    inputGates = GS->getInputGates();
+    initH = GS->getInitH();
+    weights = GS->getHiddenWeights();
+    bias = GS->getHiddenBias();
+    lengths = GS->getLengths();
+    scratch = GS->getScratch();
+    stepName = "gru_step";
+  }
+  auto elemTy = dest->getElementType();
+  auto *floatTy = builder.getFloatTy();
+  size_t batch = dest->dims()[1];
+  size_t hidden = dest->dims()[2];
+  size_t gatesSize = bias->dims()[0];
+  size_t stateSize = batch * hidden;
+
+  auto *destPtr = emitValueAddress(builder, dest);
+  auto *inputGatesPtr = emitValueAddress(builder, inputGates);
+  auto *initHPtr = emitValueAddress(builder, initH);
+  auto *weightsPtr = emitValueAddress(builder, weights);
+  auto *biasPtr = emitValueAddress(builder, bias);
+  auto *lengthsPtr = emitValueAddress(builder, lengths);
+  auto *scratchPtr = emitValueAddress(builder, scratch);
+  auto *steps = emitConstSizeT(builder, dest->dims()[0]);
+  auto *batchVal = emitConstSizeT(builder, batch);
+  auto *hiddenVal = emitConstSizeT(builder, hidden);
+  auto *gatesSizeVal = emitConstSizeT(builder, gatesSize);
+  auto *stateSizeVal = emitConstSizeT(builder, stateSize);
+  auto *zero = emitConstSizeT(builder, 0);
+  // The LSTM keeps its cell state after the gates in the scratch buffer.
+  llvm::Value *initCPtr = nullptr;
+  llvm::Value *CPtr = nullptr;
+  if (initC) {
+    initCPtr = emitValueAddress(builder, initC);
+    CPtr = builder.CreateGEP(floatTy, scratchPtr,
+                             emitConstSizeT(builder, batch * gatesSize));
+  }
+
+  // The time steps depend on each other, so they run one after the other,
+  // and each of them is split between threads. The steps past the longest
+  // entry are not computed.
+  auto *activeSteps = createCall(
+      builder, getFunction("sequence_steps", lengths->getElementType()),
+      {lengthsPtr, steps, batchVal});
+  auto *func = builder.GetInsertBlock()->getParent();
+  auto *stepsBB = llvm::BasicBlock::Create(ctx_, "sequence_steps", func);
+  auto *doneBB = llvm::BasicBlock::Create(ctx_, "sequence_done", func);
+  builder.CreateCondBr(builder.CreateICmpNE(activeSteps, zero), stepsBB,
+                       doneBB);
+  builder.SetInsertPoint(stepsBB);
+  auto loopBBs = createLoop(builder, ctx_, zero, activeSteps);
+  auto *t = cast<llvm::PHINode>(loopBBs.first->begin());
+  builder.SetInsertPoint(loopBBs.first->getFirstNonPHIOrDbg());
+
+  // The previous states are the initial ones in the first step.
+  auto *isFirst = builder.CreateICmpEQ(t, zero);
+  auto *prevT = builder.CreateSub(t, emitConstSizeT(builder, 1));
+  auto *h = builder.CreateSelect(
+      isFirst, initHPtr,
+      builder.CreateGEP(floatTy, destPtr,
+                        builder.CreateMul(prevT, stateSizeVal)));
+  auto *newH =
+      builder.CreateGEP(floatTy, destPtr, builder.CreateMul(t, stateSizeVal));
+  auto *stepInputGates = builder.CreateGEP(
+      floatTy, inputGatesPtr,
+      builder.CreateMul(t, emitConstSizeT(builder, batch * gatesSize)));
+
+  // The batches of recurrent layers are small, so the gates are split by
+  // columns rather than by rows between threads.
+  auto *gatesF = getFunction(
+      "recurrent_gates_cols" + getMatMulKernelSuffix().str(), elemTy);
+  size_t minCols = std::max<size_t>(1, matMulMinChunkWork / stateSize);
+  emitParallelCall(builder, gatesF,
+                   {scratchPtr, h, weightsPtr, biasPtr, batchVal, hiddenVal,
+                    gatesSizeVal},
+                   gatesSize, minCols);
+
+  auto *stepF = getFunction(stepName, elemTy);
+  if (initC) {
+    auto *C = builder.CreateSelect(isFirst, initCPtr, CPtr);
+    emitParallelCall(builder, stepF,
+                     {newH, CPtr, stepInputGates, h, C, scratchPtr,
+                      lengthsPtr, t, hiddenVal},
+                     stateSize, dataParallelMinChunkSize);
+  } else {
+    emitParallelCall(builder, stepF,
+                     {newH, stepInputGates, h, scratchPtr, lengthsPtr, t,
+                      hiddenVal},
+                     stateSize, dataParallelMinChunkSize);
+  }
+
+  builder.SetInsertPoint(loopBBs.second);
+  builder.CreateBr(doneBB);
+  builder.SetInsertPoint(doneBB);
+  createCall(builder, getFunction("sequence_repeat", elemTy),
+             {destPtr, initHPtr, activeSteps, steps, stateSizeVal});
+}
+
 void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
                                        const glow::Instruction *I) {
   setCurrentDebugLocation(builder, I);
@@ -1229,9 +2401,29 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *lhsDims = emitValueDims(builder, lhs);
     auto *rhsDims = emitValueDims(builder, rhs);
 
-    auto *F = getFunction("matmul", dest->getElementType());
+    // A transposed RHS is read in place by the "trans" kernels.
+    std::string kernelName = MM->getTransposeRHS() ? "matmul_trans" : "matmul";
 
-    if (lhs->getType()->isQuantizedType()) {
+    if (dest->getElementType() == ElemKind::Int16QTy) {
+      // The 16-bit kernels scale the 64-bit sums in floating point. Split the
+      // rows of the result between threads like the float kernels.
+      auto *destTy = dest->getType();
+      auto *lhsTy = lhs->getType();
+      auto *rhsTy = rhs->getType();
+      auto *F = getFunction(kernelName + "_rows", ElemKind::Int16QTy);
+      auto *outScale = emitConstF32(builder, lhsTy->getScale() *
+                                                 rhsTy->getScale() /
+                                                 destTy->getScale());
+      size_t rowWork = dest->dims()[1] * lhs->dims()[1];
+      size_t minRows = std::max<size_t>(1, matMulMinChunkWork / rowWork);
+      emitParallelCall(builder, F,
+                       {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims,
+                        emitConstI32(builder, destTy->getOffset()),
+                        emitConstI32(builder, lhsTy->getOffset()),
+                        emitConstI32(builder, rhsTy->getOffset()), outScale},
+                       dest->dims()[0], minRows);
+    } else if (lhs->getType()->isQuantizedType()) {
+      auto *F = getFunction(kernelName, dest->getElementType());
       auto *destTy = dest->getType();
       auto *lhsTy = lhs->getType();
       auto *rhsTy = rhs->getType();
@@ -1251,12 +2443,218 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
                  {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims,
                   destOffset, lhsOffset, rhsOffset, outPre, outPost, outScale});
     } else {
-      createCall(builder, F,
-                 {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims});
+      // Split the rows of the result between threads. Make sure that every
+      // thread gets enough work.
+      // Use the microkernel that is register-blocked for the target.
+      auto *rowsF =
+          getFunction(kernelName + "_rows" + getMatMulKernelSuffix().str(),
+                      dest->getElementType());
+      size_t rowWork = dest->dims()[1] * lhs->dims()[1];
+      size_t minRows = std::max<size_t>(1, matMulMinChunkWork / rowWork);
+      emitParallelCall(builder, rowsF,
+                       {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims},
+                       dest->dims()[0], minRows);
     }
     break;
   }
 
+  case Kinded::Kind::BatchedMatMulInstKind: {
+    auto *BMM = cast<BatchedMatMulInst>(I);
+    auto *dest = BMM->getDest();
+    auto *lhs = BMM->getLHS();
+    auto *rhs = BMM->getRHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *rhsPtr = emitValueAddress(builder, rhs);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *rhsDims = emitValueDims(builder, rhs);
+
+    // Split the rows of all the batch entries between threads with a single
+    // call, instead of one multiplication per batch entry.
+    auto *F = getFunction("batched_matmul_rows" +
+                              getMatMulKernelSuffix().str(),
+                          dest->getElementType());
+    size_t rowWork = dest->dims()[2] * lhs->dims()[2];
+    size_t minRows = std::max<size_t>(1, matMulMinChunkWork / rowWork);
+    emitParallelCall(builder, F,
+                     {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims},
+                     dest->dims()[0] * dest->dims()[1], minRows);
+    break;
+  }
+
+  case Kinded::Kind::CPUPackedMatMulInstKind: {
+    auto *MM = cast<CPUPackedMatMulInst>(I);
+    auto *dest = MM->getDest();
+    auto *lhs = MM->getLHS();
+    auto *rhs = MM->getRHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *rhsPtr = emitValueAddress(builder, rhs);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *rhsDims = emitValueDims(builder, rhs);
+    auto *activation = emitConstI32(builder, MM->getFusedActivation());
+
+    // Split the panels of the weights between threads, so that batch-1
+    // inference is parallel as well. Make sure that every thread gets enough
+    // work.
+    // Half precision and bfloat16 weights are expanded to floats in
+    // registers by the _f16w and _bf16w variants of the kernel.
+    std::string suffix = getMatMulKernelSuffix().str();
+    if (rhs->getElementType() == ElemKind::Float16Ty) {
+      // The AVX2 and AVX-512 variants expand half precision with F16C.
+      const llvm::MCSubtargetInfo *STI = TM_->getMCSubtargetInfo();
+      if ((suffix == "_avx2" || suffix == "_avx512") &&
+          !STI->checkFeatures("+f16c")) {
+        suffix = "";
+      }
+    }
+    std::string name = "matmul_packed_panels" + suffix;
+    if (rhs->getElementType() == ElemKind::Float16Ty) {
+      name += "_f16w";
+    } else if (rhs->getElementType() == ElemKind::BFloat16Ty) {
+      name += "_bf16w";
+    }
+    auto *F = getFunction(name, dest->getElementType());
+    size_t panelWork = dest->dims()[0] * lhs->dims()[1] * rhs->dims()[2];
+    size_t minPanels = std::max<size_t>(1, matMulMinChunkWork / panelWork);
+    emitParallelCall(builder, F,
+                     {destPtr, lhsPtr, rhsPtr, destDims, lhsDims, rhsDims,
+                      activation},
+                     rhs->dims()[0], minPanels);
+    break;
+  }
+
+  case Kinded::Kind::CPUQuantizedPackedMatMulInstKind: {
+    auto *MM = cast<CPUQuantizedPackedMatMulInst>(I);
+    auto *dest = MM->getDest();
+    auto *lhs = MM->getLHS();
+    auto *rhs = MM->getRHS();
+    auto *colSums = MM->getColSums();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *rhsPtr = emitValueAddress(builder, rhs);
+    auto *colSumsPtr = emitValueAddress(builder, colSums);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *rhsDims = emitValueDims(builder, rhs);
+
+    auto *destTy = dest->getType();
+    auto *lhsTy = lhs->getType();
+    auto *rhsTy = rhs->getType();
+
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *lhsOffset = emitConstI32(builder, lhsTy->getOffset());
+    auto *rhsOffset = emitConstI32(builder, rhsTy->getOffset());
+
+    auto outScaleParams = quantization::quantizeScaleOffset32To8(
+        lhsTy->getScale() * rhsTy->getScale() / destTy->getScale(), 0);
+
+    auto *outPre = emitConstI32(builder, outScaleParams.pre);
+    auto *outPost = emitConstI32(builder, outScaleParams.post);
+    auto *outScale = emitConstI32(builder, outScaleParams.scale);
+
+    // Split the panels of the weights between threads. Make sure that every
+    // thread gets enough work.
+    auto *F = getFunction("matmul_packed_panels" +
+                              getQuantizedMatMulKernelSuffix().str(),
+                          dest->getElementType());
+    size_t panelWork = dest->dims()[0] * rhs->dims()[1] * rhs->dims()[2];
+    size_t minPanels = std::max<size_t>(1, matMulMinChunkWork / panelWork);
+    emitParallelCall(builder, F,
+                     {destPtr, lhsPtr, rhsPtr, colSumsPtr, destDims, lhsDims,
+                      rhsDims, destOffset, lhsOffset, rhsOffset, outPre,
+                      outPost, outScale},
+                     rhs->dims()[0], minPanels);
+    break;
+  }
+
+  case Kinded::Kind::CPUSparseMatMulInstKind: {
+    auto *MM = cast<CPUSparseMatMulInst>(I);
+    auto *dest = MM->getDest();
+    auto *lhs = MM->getLHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *valuesPtr = emitValueAddress(builder, MM->getValues());
+    auto *rowIndicesPtr = emitValueAddress(builder, MM->getRowIndices());
+    auto *colOffsetsPtr = emitValueAddress(builder, MM->getColOffsets());
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *activation = emitConstI32(builder, MM->getFusedActivation());
+
+    // Split the columns between threads, based on the average number of
+    // non-zero weights of a column.
+    auto *F = getFunction("matmul_sparse_cols", dest->getElementType());
+    size_t numCols = dest->dims()[1];
+    size_t colWork = std::max<size_t>(
+        1, dest->dims()[0] * MM->getValues()->size() / numCols);
+    size_t minCols = std::max<size_t>(1, matMulMinChunkWork / colWork);
+    emitParallelCall(builder, F,
+                     {destPtr, lhsPtr, valuesPtr, rowIndicesPtr, colOffsetsPtr,
+                      destDims, lhsDims, activation},
+                     numCols, minCols);
+    break;
+  }
+
+  case Kinded::Kind::CPUClusteredMatMulInstKind: {
+    auto *MM = cast<CPUClusteredMatMulInst>(I);
+    auto *dest = MM->getDest();
+    auto *lhs = MM->getLHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *codebookPtr = emitValueAddress(builder, MM->getCodebook());
+    auto *codesPtr = emitValueAddress(builder, MM->getCodes());
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *codeBits = emitConstI32(builder, MM->getCodeBits());
+    auto *activation = emitConstI32(builder, MM->getFusedActivation());
+
+    // Split the columns between threads. Every column decodes its k weights
+    // once for the m rows of the LHS.
+    auto *F = getFunction("matmul_clustered_cols", dest->getElementType());
+    size_t colWork = dest->dims()[0] * lhs->dims()[1];
+    size_t minCols = std::max<size_t>(1, matMulMinChunkWork / colWork);
+    emitParallelCall(builder, F,
+                     {destPtr, lhsPtr, codebookPtr, codesPtr, destDims,
+                      lhsDims, codeBits, activation},
+                     dest->dims()[1], minCols);
+    break;
+  }
+
+  case Kinded::Kind::CPUTransposedLHSMatMulInstKind: {
+    auto *MM = cast<CPUTransposedLHSMatMulInst>(I);
+    auto *dest = MM->getDest();
+    auto *lhs = MM->getLHS();
+    auto *rhs = MM->getRHS();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *colSumsPtr = emitValueAddress(builder, MM->getRHSColSums());
+    auto *lhsPtr = emitValueAddress(builder, lhs);
+    auto *rhsPtr = emitValueAddress(builder, rhs);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *lhsDims = emitValueDims(builder, lhs);
+    auto *rhsDims = emitValueDims(builder, rhs);
+
+    // Split the rows of the result, which are the columns of the LHS, between
+    // threads. The thread of the first rows also sums the columns of the RHS.
+    auto *rowsF = getFunction("matmul_trans_lhs_rows" +
+                                  getMatMulKernelSuffix().str(),
+                              dest->getElementType());
+    size_t rowWork = dest->dims()[1] * lhs->dims()[0];
+    size_t minRows = std::max<size_t>(1, matMulMinChunkWork / rowWork);
+    emitParallelCall(builder, rowsF,
+                     {destPtr, colSumsPtr, lhsPtr, rhsPtr, destDims, lhsDims,
+                      rhsDims},
+                     dest->dims()[0], minRows);
+    break;
+  }
+
   case Kinded::Kind::BatchedAddInstKind: {
     auto *BA = cast<BatchedAddInst>(I);
     auto *dest = BA->getDest();
@@ -1272,7 +2670,19 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
 
     auto *F = getFunction("batchedadd", dest->getElementType());
 
-    if (batch->getType()->isQuantizedType()) {
+    if (dest->getElementType() == ElemKind::Int16QTy) {
+      auto *destTy = dest->getType();
+      auto *batchTy = batch->getType();
+      auto *sliceTy = slice->getType();
+      float destScale = destTy->getScale();
+      createCall(builder, F,
+                 {destPtr, batchPtr, slicePtr, numSlice, sliceSize,
+                  emitConstI32(builder, destTy->getOffset()),
+                  emitConstI32(builder, batchTy->getOffset()),
+                  emitConstI32(builder, sliceTy->getOffset()),
+                  emitConstF32(builder, batchTy->getScale() / destScale),
+                  emitConstF32(builder, sliceTy->getScale() / destScale)});
+    } else if (batch->getType()->isQuantizedType()) {
       auto *destTy = dest->getType();
       auto *batchTy = batch->getType();
       auto *sliceTy = slice->getType();
@@ -1378,10 +2788,28 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *pads = emitConstSizeTArray(builder, CI->getPads());
     auto *group = emitConstSizeT(builder, CI->getGroup());
 
-    const char *kernelName = "convolution";
-
     auto destDepth = dest->dims()[3];
 
+    // In a depthwise convolution every group has one input and one output
+    // channel. The generic kernel would run its innermost loop over that
+    // single channel, so use the kernel that vectorizes across channels.
+    bool isDepthwise = CI->getGroup() > 1 && CI->getGroup() == destDepth &&
+                       CI->getGroup() == src->dims()[3];
+
+    // The grouped convolutions with few channels per group, as in ResNeXt,
+    // have the same problem. Their kernel vectorizes across the output
+    // channels of several groups, and keeps the [K, K, C/G] filter taps of 64
+    // output channels on the stack, so the taps must fit in 128KB.
+    size_t inCperG = src->dims()[3] / CI->getGroup();
+    size_t outCperG = destDepth / CI->getGroup();
+    auto kdims = CI->getKernels();
+    bool isSmallGroup = CI->getGroup() > 1 && !isDepthwise && outCperG < 64 &&
+                        kdims[0] * kdims[1] * inCperG <= 512;
+
+    const char *kernelName =
+        isDepthwise ? "depthwise_conv_samples"
+                    : isSmallGroup ? "group_conv_samples" : "convolution";
+
     // Try to 'block' the convolution on the 'depth' dimension. We will process
     // this number output slices each iteration.
     unsigned unrollDFactor = 1;
@@ -1428,21 +2856,99 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
       auto *outPost = emitConstI32(builder, outScaleParam.post);
       auto *outScale = emitConstI32(builder, outScaleParam.scale);
 
-      createCall(builder, F,
-                 {destPtr,    srcPtr,     filterPtr,  biasPtr,   destDims,
-                  srcDims,    filterDims, biasDims,   kernels,   strides,
-                  pads,       group,      destOffset, srcOffset, filterOffset,
-                  biasOffset, biasPre,    biasPost,   biasScale, outPre,
-                  outPost,    outScale,   unrollD});
+      if (isDepthwise) {
+        emitParallelCall(builder, F,
+                         {destPtr, srcPtr, filterPtr, biasPtr, destDims,
+                          srcDims, kernels, strides, pads, destOffset,
+                          srcOffset, filterOffset, biasOffset, biasPre,
+                          biasPost, biasScale, outPre, outPost, outScale},
+                         dest->dims()[0], 1);
+      } else if (isSmallGroup) {
+        emitParallelCall(builder, F,
+                         {destPtr, srcPtr, filterPtr, biasPtr, destDims,
+                          srcDims, kernels, strides, pads, group, destOffset,
+                          srcOffset, filterOffset, biasOffset, biasPre,
+                          biasPost, biasScale, outPre, outPost, outScale},
+                         dest->dims()[0], 1);
+      } else {
+        createCall(builder, F,
+                   {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
+                    filterDims, biasDims, kernels, strides, pads, group,
+                    destOffset, srcOffset, filterOffset, biasOffset, biasPre,
+                    biasPost, biasScale, outPre, outPost, outScale, unrollD});
+      }
+    } else if (isDepthwise) {
+      emitParallelCall(builder, F,
+                       {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
+                        kernels, strides, pads},
+                       dest->dims()[0], 1);
+    } else if (isSmallGroup) {
+      emitParallelCall(builder, F,
+                       {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
+                        kernels, strides, pads, group},
+                       dest->dims()[0], 1);
     } else {
-      createCall(builder, F,
-                 {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
-                  filterDims, biasDims, kernels, strides, pads, group,
-                  unrollD});
+      // Split the samples of the batch between threads.
+      auto *samplesF =
+          getFunction("convolution_samples", dest->getElementType());
+      emitParallelCall(builder, samplesF,
+                       {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
+                        filterDims, biasDims, kernels, strides, pads, group,
+                        unrollD},
+                       dest->dims()[0], 1);
     }
     break;
   }
 
+  case Kinded::Kind::ChannelwiseQuantizedConvolutionInstKind: {
+    auto *CI = cast<ChannelwiseQuantizedConvolutionInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *filter = CI->getFilter();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+    auto *biasPtr = emitValueAddress(builder, CI->getBias());
+    auto *scalesPtr = emitValueAddress(builder, CI->getScales());
+    auto *offsetsPtr = emitValueAddress(builder, CI->getOffsets());
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *filterDims = emitValueDims(builder, filter);
+
+    auto *kernels = emitConstSizeTArray(builder, CI->getKernels());
+    auto *strides = emitConstSizeTArray(builder, CI->getStrides());
+    auto *pads = emitConstSizeTArray(builder, CI->getPads());
+    auto *group = emitConstSizeT(builder, CI->getGroup());
+
+    auto *destOffset = emitConstI32(builder, dest->getType()->getOffset());
+    auto *srcOffset = emitConstI32(builder, src->getType()->getOffset());
+    auto *srcScale = emitConstF32(builder, src->getType()->getScale());
+    auto *destScale = emitConstF32(builder, dest->getType()->getScale());
+
+    auto *F = getFunction("channelwise_quantized_conv", dest->getElementType());
+    createCall(builder, F,
+               {destPtr, srcPtr, filterPtr, biasPtr, scalesPtr, offsetsPtr,
+                destDims, srcDims, filterDims, kernels, strides, pads, group,
+                destOffset, srcOffset, srcScale, destScale});
+    break;
+  }
+
+  case Kinded::Kind::QuantizationProfileInstKind: {
+    auto *QPI = cast<QuantizationProfileInst>(I);
+    auto *inputTensor = QPI->getInputTensor();
+    auto *histogram = QPI->getHistogram();
+    auto *inputPtr = emitValueAddress(builder, inputTensor);
+    auto *numElem = emitConstSizeT(builder, inputTensor->size());
+    auto *compInfoPtr = emitValueAddress(builder, QPI->getComputationInfo());
+    auto *histPtr = emitValueAddress(builder, histogram);
+    auto *histDims = emitValueDims(builder, histogram);
+
+    auto *F = getFunction("quantization_profile");
+    createCall(builder, F, {inputPtr, numElem, compInfoPtr, histPtr, histDims});
+    break;
+  }
+
   case Kinded::Kind::CPUConvDKKC8InstKind: {
     auto *CI = cast<CPUConvDKKC8Inst>(I);
     auto *dest = CI->getDest();
@@ -1502,15 +3008,164 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *numDepthRegsVal = emitConstI32(builder, numDepthRegs);
     auto *sizeGroupYVal = emitConstI32(builder, sizeGroupY);
     auto *depthStripsVal = emitConstI32(builder, depthStrips);
+    auto *activation = emitConstI32(builder, CI->getFusedActivation());
 
-    const char *kernelName = "convDKKC8";
+    // Split the samples of the batch between threads.
+    const char *kernelName = "convDKKC8_samples";
     auto *F = getFunction(kernelName, dest->getElementType());
 
-    createCall(builder, F,
-               {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
-                filterDims, biasDims, kernels, strides, pads, group,
-                pixelScanFirstVal, numDepthRegsVal, sizeGroupYVal,
-                depthStripsVal});
+    emitParallelCall(builder, F,
+                     {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
+                      filterDims, biasDims, kernels, strides, pads, group,
+                      pixelScanFirstVal, numDepthRegsVal, sizeGroupYVal,
+                      depthStripsVal, activation},
+                     dest->dims()[0], 1);
+    break;
+  }
+
+  case Kinded::Kind::CPUWinogradConvInstKind: {
+    auto *CI = cast<CPUWinogradConvInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *filter = CI->getFilter();
+    auto *bias = CI->getBias();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+    auto *biasPtr = emitValueAddress(builder, bias);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+
+    auto *pads = emitConstSizeTArray(builder, CI->getPads());
+    auto *activation = emitConstI32(builder, CI->getFusedActivation());
+
+    // Split the rows of output tiles of all samples between threads, so that
+    // batch-1 inference is parallel as well.
+    unsigned tileSize = CI->getTileSize();
+    size_t tilesY = (dest->dims()[1] + tileSize - 1) / tileSize;
+    const char *kernelName =
+        tileSize == 4 ? "conv_winograd4x4_rows" : "conv_winograd2x2_rows";
+    auto *F = getFunction(kernelName, dest->getElementType());
+
+    emitParallelCall(builder, F,
+                     {destPtr, srcPtr, filterPtr, biasPtr, destDims, srcDims,
+                      pads, activation},
+                     dest->dims()[0] * tilesY, 1);
+    break;
+  }
+
+  case Kinded::Kind::CPUIm2colConvInstKind: {
+    auto *CI = cast<CPUIm2colConvInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *filter = CI->getFilter();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+    auto *colsPtr = emitScratchAddress(builder);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *filterDims = emitValueDims(builder, filter);
+
+    auto *kernels = emitConstSizeTArray(builder, CI->getKernels());
+    auto *strides = emitConstSizeTArray(builder, CI->getStrides());
+    auto *pads = emitConstSizeTArray(builder, CI->getPads());
+    auto *activation = emitConstI32(builder, CI->getFusedActivation());
+
+    // Copy the input patches into the im2col matrix in the scratch area.
+    // Split the rows of output pixels of all samples between threads.
+    auto odim = dest->dims();
+    auto *im2colF = getFunction("im2col_rows", dest->getElementType());
+    emitParallelCall(builder, im2colF,
+                     {colsPtr, srcPtr, destDims, srcDims, kernels, strides,
+                      pads},
+                     odim[0] * odim[1], 1);
+
+    // Multiply the [pixels, K*K*C + 1] im2col matrix with the pre-packed
+    // filter and bias, applying the fused activation to the result. The
+    // result is the NHWC output viewed as a [pixels, D] matrix.
+    size_t numPixels = odim[0] * odim[1] * odim[2];
+    size_t rowSize = filter->dims()[1];
+    auto *resDims = emitConstSizeTArray(
+        builder, llvm::ArrayRef<size_t>({numPixels, odim[3]}));
+    auto *colsDims = emitConstSizeTArray(
+        builder, llvm::ArrayRef<size_t>({numPixels, rowSize}));
+    auto *matmulF = getFunction("matmul_packed_panels" +
+                                    getMatMulKernelSuffix().str(),
+                                dest->getElementType());
+    size_t panelWork = numPixels * rowSize * filter->dims()[2];
+    size_t minPanels = std::max<size_t>(1, matMulMinChunkWork / panelWork);
+    emitParallelCall(builder, matmulF,
+                     {destPtr, colsPtr, filterPtr, resDims, colsDims,
+                      filterDims, activation},
+                     filter->dims()[0], minPanels);
+    break;
+  }
+
+  case Kinded::Kind::CPUQuantizedIm2colConvInstKind: {
+    auto *CI = cast<CPUQuantizedIm2colConvInst>(I);
+    auto *dest = CI->getDest();
+    auto *src = CI->getSrc();
+    auto *filter = CI->getFilter();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *filterPtr = emitValueAddress(builder, filter);
+    auto *colSumsPtr = emitValueAddress(builder, CI->getColSums());
+    auto *biasPtr = emitValueAddress(builder, CI->getBias());
+    auto *colsPtr = emitScratchAddress(builder);
+
+    auto *destDims = emitValueDims(builder, dest);
+    auto *srcDims = emitValueDims(builder, src);
+    auto *filterDims = emitValueDims(builder, filter);
+
+    auto *kernels = emitConstSizeTArray(builder, CI->getKernels());
+    auto *strides = emitConstSizeTArray(builder, CI->getStrides());
+    auto *pads = emitConstSizeTArray(builder, CI->getPads());
+
+    auto *destTy = dest->getType();
+    auto *srcTy = src->getType();
+    auto *filterTy = filter->getType();
+    auto *destOffset = emitConstI32(builder, destTy->getOffset());
+    auto *srcOffset = emitConstI32(builder, srcTy->getOffset());
+    auto *filterOffset = emitConstI32(builder, filterTy->getOffset());
+    auto outScaleParams = quantization::quantizeScaleOffset32To8(
+        srcTy->getScale() * filterTy->getScale() / destTy->getScale(), 0);
+    auto *outPre = emitConstI32(builder, outScaleParams.pre);
+    auto *outPost = emitConstI32(builder, outScaleParams.post);
+    auto *outScale = emitConstI32(builder, outScaleParams.scale);
+
+    // Copy the input patches into the im2col matrix in the scratch area,
+    // padded with the quantized zero. Split the rows of output pixels of all
+    // samples between threads.
+    auto odim = dest->dims();
+    auto *im2colF = getFunction("im2col_rows", dest->getElementType());
+    emitParallelCall(builder, im2colF,
+                     {colsPtr, srcPtr, destDims, srcDims, kernels, strides,
+                      pads, srcOffset},
+                     odim[0] * odim[1], 1);
+
+    // Multiply the [pixels, K*K*C] im2col matrix with the pre-packed filter
+    // and add the bias. The result is the NHWC output viewed as a
+    // [pixels, D] matrix.
+    auto kdims = CI->getKernels();
+    size_t numPixels = odim[0] * odim[1] * odim[2];
+    size_t rowSize = kdims[0] * kdims[1] * src->dims()[3];
+    auto *resDims = emitConstSizeTArray(
+        builder, llvm::ArrayRef<size_t>({numPixels, odim[3]}));
+    auto *colsDims = emitConstSizeTArray(
+        builder, llvm::ArrayRef<size_t>({numPixels, rowSize}));
+    auto *matmulF = getFunction("matmul_bias_packed_panels" +
+                                    getQuantizedMatMulKernelSuffix().str(),
+                                dest->getElementType());
+    size_t panelWork = numPixels * filter->dims()[1] * filter->dims()[2];
+    size_t minPanels = std::max<size_t>(1, matMulMinChunkWork / panelWork);
+    emitParallelCall(builder, matmulF,
+                     {destPtr, colsPtr, filterPtr, colSumsPtr, biasPtr,
+                      resDims, colsDims, filterDims, destOffset, srcOffset,
+                      filterOffset, outPre, outPost, outScale},
+                     filter->dims()[0], minPanels);
     break;
   }
 
@@ -1536,11 +3191,95 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *pads = emitConstSizeTArray(builder, CG->getPads());
     auto *group = emitConstSizeT(builder, CG->getGroup());
 
-    auto *F = getFunction("convolution_grad", srcGrad->getElementType());
-    createCall(builder, F,
-               {srcGradPtr, destGradPtr, srcPtr, filterGradPtr, biasGradPtr,
-                filterPtr, destGradDims, srcDims, filterGradDims, kernels,
-                strides, pads, group});
+    if (AllocationsInfo::getScratchSize(*CG)) {
+      // Both gradients are matrix multiplications with the microkernels of
+      // MatMul. The output gradient is a [pixels, D] matrix and the filter a
+      // [D, K*K*C] one.
+      size_t depth = destGrad->dims()[3];
+      size_t numPixels = destGrad->size() / depth;
+      size_t filterSize = filterGrad->size() / depth;
+      auto *floatTy = builder.getFloatTy();
+      auto *colsPtr = emitScratchAddress(builder);
+      size_t colsSize = numPixels * (filterSize + 1);
+      auto *destGradTPtr = builder.CreateGEP(floatTy, colsPtr,
+                                             emitConstSizeT(builder, colsSize));
+      auto *productPtr = builder.CreateGEP(
+          floatTy, destGradTPtr, emitConstSizeT(builder, depth * numPixels));
+      auto *rowsF = getFunction("matmul_rows" + getMatMulKernelSuffix().str(),
+                                srcGrad->getElementType());
+
+      // The gradients of the input patches are the product of the output
+      // gradient with the filter, and are scattered back onto the input.
+      auto *colsGDims = emitConstSizeTArray(
+          builder, llvm::ArrayRef<size_t>({numPixels, filterSize}));
+      auto *destGradMDims = emitConstSizeTArray(
+          builder, llvm::ArrayRef<size_t>({numPixels, depth}));
+      auto *filterMDims = emitConstSizeTArray(
+          builder, llvm::ArrayRef<size_t>({depth, filterSize}));
+      size_t minRows =
+          std::max<size_t>(1, matMulMinChunkWork / (filterSize * depth));
+      emitParallelCall(builder, rowsF,
+                       {colsPtr, destGradPtr, filterPtr, colsGDims,
+                        destGradMDims, filterMDims},
+                       numPixels, minRows);
+      auto *col2imF = getFunction("col2im_samples", srcGrad->getElementType());
+      emitParallelCall(builder, col2imF,
+                       {srcGradPtr, colsPtr, destGradDims, srcDims, kernels,
+                        strides, pads},
+                       src->dims()[0], 1);
+
+      // The gradients of the filter and of the bias are the product of the
+      // transposed output gradient with the im2col matrix of the input,
+      // [D, K*K*C + 1], whose last column comes from the 1s of the matrix.
+      auto *im2colF = getFunction("im2col_rows", srcGrad->getElementType());
+      emitParallelCall(builder, im2colF,
+                       {colsPtr, srcPtr, destGradDims, srcDims, kernels,
+                        strides, pads},
+                       destGrad->dims()[0] * destGrad->dims()[1], 1);
+      auto *transposeF =
+          getFunction("conv_grad_transpose", srcGrad->getElementType());
+      emitParallelCall(builder, transposeF,
+                       {destGradTPtr, destGradPtr, destGradDims}, depth,
+                       std::max<size_t>(1, matMulMinChunkWork / numPixels));
+      auto *productDims = emitConstSizeTArray(
+          builder, llvm::ArrayRef<size_t>({depth, filterSize + 1}));
+      auto *destGradTDims = emitConstSizeTArray(
+          builder, llvm::ArrayRef<size_t>({depth, numPixels}));
+      auto *colsDims = emitConstSizeTArray(
+          builder, llvm::ArrayRef<size_t>({numPixels, filterSize + 1}));
+      minRows = std::max<size_t>(
+          1, matMulMinChunkWork / ((filterSize + 1) * numPixels));
+      emitParallelCall(builder, rowsF,
+                       {productPtr, destGradTPtr, colsPtr, productDims,
+                        destGradTDims, colsDims},
+                       depth, minRows);
+      auto *unpackF =
+          getFunction("conv_grad_filter_unpack", srcGrad->getElementType());
+      emitParallelCall(builder, unpackF,
+                       {filterGradPtr, biasGradPtr, productPtr, filterGradDims},
+                       depth, 1);
+      break;
+    }
+
+    // The gradient of the input is split by the samples of the batch, and the
+    // gradients of the filter and the bias by the output channels, so that no
+    // two threads accumulate into the same elements.
+    auto *inputF =
+        getFunction("convolution_grad_input", srcGrad->getElementType());
+    emitParallelCall(builder, inputF,
+                     {srcGradPtr, destGradPtr, filterPtr, destGradDims, srcDims,
+                      filterGradDims, kernels, strides, pads, group},
+                     src->dims()[0], 1);
+    auto *filterF =
+        getFunction("convolution_grad_filter", srcGrad->getElementType());
+    size_t depthWork = destGrad->size() / destGrad->dims()[3] *
+                       filterGrad->size() / filterGrad->dims()[0];
+    size_t minDepths = std::max<size_t>(1, matMulMinChunkWork / depthWork);
+    emitParallelCall(builder, filterF,
+                     {filterGradPtr, biasGradPtr, destGradPtr, srcPtr,
+                      destGradDims, srcDims, filterGradDims, kernels, strides,
+                      pads, group},
+                     filterGrad->dims()[0], minDepths);
     break;
   }
 
@@ -1560,13 +3299,62 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     break;
   }
 
+  case Kinded::Kind::SoftMaxCrossEntropyLossInstKind: {
+    auto *SCE = cast<SoftMaxCrossEntropyLossInst>(I);
+    auto *logits = SCE->getLogits();
+    auto *CEPtr = emitValueAddress(builder, SCE->getDest());
+    auto *logitsPtr = emitValueAddress(builder, logits);
+    auto *labelsPtr = emitValueAddress(builder, SCE->getLabels());
+    auto *dims = emitValueDims(builder, logits);
+
+    auto *F = getFunction("softmax_cross_entropy_loss",
+                          logits->getElementType());
+    createCall(builder, F, {CEPtr, logitsPtr, labelsPtr, dims});
+    break;
+  }
+
+  case Kinded::Kind::SoftMaxCrossEntropyLossGradInstKind: {
+    auto *SCEG = cast<SoftMaxCrossEntropyLossGradInst>(I);
+    auto *logitsG = SCEG->getLogitsGrad();
+    auto *logitsGPtr = emitValueAddress(builder, logitsG);
+    auto *logitsPtr = emitValueAddress(builder, SCEG->getLogits());
+    auto *labelsPtr = emitValueAddress(builder, SCEG->getLabels());
+    auto *dims = emitValueDims(builder, logitsG);
+
+    // Split the rows between threads.
+    auto *F = getFunction("softmax_cross_entropy_loss_grad",
+                          logitsG->getElementType());
+    size_t minRows =
+        std::max<size_t>(1, dataParallelMinChunkSize / logitsG->dims()[1]);
+    emitParallelCall(builder, F, {logitsGPtr, logitsPtr, labelsPtr, dims},
+                     logitsG->dims()[0], minRows);
+    break;
+  }
+
+  case Kinded::Kind::SigmoidCrossEntropyWithLogitsInstKind: {
+    auto *SCE = cast<SigmoidCrossEntropyWithLogitsInst>(I);
+    auto *dest = SCE->getDest();
+    auto *logits = SCE->getLogits();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *logitsPtr = emitValueAddress(builder, logits);
+    auto *targetsPtr = emitValueAddress(builder, SCE->getTargets());
+    size_t inner = logits->dims().back();
+    auto *innerVal = emitConstSizeT(builder, inner);
+
+    auto *F = getFunction("sigmoid_cross_entropy_with_logits",
+                          dest->getElementType());
+    size_t minRows = std::max<size_t>(1, dataParallelMinChunkSize / inner);
+    emitParallelCall(builder, F, {destPtr, logitsPtr, targetsPtr, innerVal},
+                     dest->size(), minRows);
+    break;
+  }
+
   case Kinded::Kind::LocalResponseNormalizationInstKind: {
     auto *LRN = cast<LocalResponseNormalizationInst>(I);
     auto *dest = LRN->getDest();
     auto *src = LRN->getSrc();
     auto *destPtr = emitValueAddress(builder, dest);
     auto *srcPtr = emitValueAddress(builder, src);
-    auto *scalePtr = emitValueAddress(builder, LRN->getScale());
 
     auto *destDims = emitValueDims(builder, dest);
     auto *srcDims = emitValueDims(builder, src);
@@ -1575,6 +3363,22 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *beta = emitConstF32(builder, LRN->getBeta());
     auto *k = emitConstF32(builder, LRN->getK());
 
+    // The scales are only stored for the gradient. Without one, the pixels
+    // are split between threads and normalized by the inference kernel.
+    if (isOnlyAccessedBy(LRN->getScale(), LRN)) {
+      auto *F = getFunction("local_response_normalization_inference",
+                            dest->getElementType());
+      size_t channels = src->dims()[3];
+      size_t minPixels =
+          std::max<size_t>(1, dataParallelMinChunkSize / channels);
+      emitParallelCall(
+          builder, F,
+          {destPtr, srcPtr, destDims, srcDims, halfWindow, alpha, beta, k},
+          src->size() / channels, minPixels);
+      break;
+    }
+
+    auto *scalePtr = emitValueAddress(builder, LRN->getScale());
     auto *F =
         getFunction("local_response_normalization", dest->getElementType());
     createCall(builder, F,
@@ -1607,6 +3411,89 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     break;
   }
 
+  case Kinded::Kind::BatchNormalizationInstKind: {
+    auto *BN = cast<BatchNormalizationInst>(I);
+    auto *dest = BN->getDest();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, BN->getSrc());
+    auto *scalePtr = emitValueAddress(builder, BN->getScale());
+    auto *biasPtr = emitValueAddress(builder, BN->getBias());
+    auto *meanPtr = emitValueAddress(builder, BN->getMean());
+    auto *varPtr = emitValueAddress(builder, BN->getVar());
+    unsigned channelIdx = BN->getChannelIdx();
+    size_t numChannels = dest->dims()[channelIdx];
+    size_t inner = flattenCdr(dest->dims(), channelIdx + 1).second;
+    auto *numChannelsVal = emitConstSizeT(builder, numChannels);
+    auto *innerVal = emitConstSizeT(builder, inner);
+    auto *epsilon = emitConstF32(builder, BN->getEpsilon());
+
+    // Split the rows of the channels between threads.
+    auto *F = getFunction("batch_normalization", dest->getElementType());
+    size_t minRows = std::max<size_t>(1, dataParallelMinChunkSize / inner);
+    emitParallelCall(builder, F,
+                     {destPtr, srcPtr, scalePtr, biasPtr, meanPtr, varPtr,
+                      numChannelsVal, innerVal, epsilon},
+                     dest->size() / inner, minRows);
+    break;
+  }
+
+  case Kinded::Kind::BatchNormalizationGradInstKind: {
+    auto *BNG = cast<BatchNormalizationGradInst>(I);
+    auto *src = BNG->getSrc();
+    auto *srcGPtr = emitValueAddress(builder, BNG->getSrcGrad());
+    auto *scaleGPtr = emitValueAddress(builder, BNG->getScaleGrad());
+    auto *biasGPtr = emitValueAddress(builder, BNG->getBiasGrad());
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *scalePtr = emitValueAddress(builder, BNG->getScale());
+    auto *meanPtr = emitValueAddress(builder, BNG->getMean());
+    auto *varPtr = emitValueAddress(builder, BNG->getVar());
+    auto *destGPtr = emitValueAddress(builder, BNG->getDestGrad());
+    unsigned channelIdx = BNG->getChannelIdx();
+    size_t numChannels = src->dims()[channelIdx];
+    size_t inner = flattenCdr(src->dims(), channelIdx + 1).second;
+    size_t outer = src->size() / (numChannels * inner);
+    auto *epsilon = emitConstF32(builder, BNG->getEpsilon());
+
+    // Split the channels between threads.
+    auto *F = getFunction("batch_normalization_grad", src->getElementType());
+    size_t minChannels = std::max<size_t>(
+        1, dataParallelMinChunkSize / (outer * inner));
+    emitParallelCall(builder, F,
+                     {srcGPtr, scaleGPtr, biasGPtr, srcPtr, scalePtr, meanPtr,
+                      varPtr, destGPtr, emitConstSizeT(builder, outer),
+                      emitConstSizeT(builder, numChannels),
+                      emitConstSizeT(builder, inner), epsilon},
+                     numChannels, minChannels);
+    break;
+  }
+
+  case Kinded::Kind::MeanVarNormalizationInstKind: {
+    auto *MVN = cast<MeanVarNormalizationInst>(I);
+    auto *src = MVN->getSrc();
+    auto *newMeanPtr = emitValueAddress(builder, MVN->getNewMean());
+    auto *newVarPtr = emitValueAddress(builder, MVN->getNewVar());
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *meanPtr = emitValueAddress(builder, MVN->getMean());
+    auto *varPtr = emitValueAddress(builder, MVN->getVar());
+    unsigned channelIdx = MVN->getChannelIdx();
+    size_t numChannels = src->dims()[channelIdx];
+    size_t inner = flattenCdr(src->dims(), channelIdx + 1).second;
+    size_t outer = src->size() / (numChannels * inner);
+    auto *momentum = emitConstF32(builder, MVN->getMomentum());
+
+    // Split the channels between threads.
+    auto *F = getFunction("mean_var_normalization", src->getElementType());
+    size_t minChannels = std::max<size_t>(
+        1, dataParallelMinChunkSize / (outer * inner));
+    emitParallelCall(builder, F,
+                     {newMeanPtr, newVarPtr, srcPtr, meanPtr, varPtr,
+                      emitConstSizeT(builder, outer),
+                      emitConstSizeT(builder, numChannels),
+                      emitConstSizeT(builder, inner), momentum},
+                     numChannels, minChannels);
+    break;
+  }
+
   case Kinded::Kind::MaxPoolInstKind: {
     auto *PM = cast<MaxPoolInst>(I);
     auto *dest = PM->getDest();
@@ -1659,9 +3546,11 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *srcGradDims = emitValueDims(builder, srcGrad);
     auto *destDims = emitValueDims(builder, PMG->getDest());
 
+    // Split the samples of the batch between threads.
     auto *F = getFunction("max_pool_xy_grad", srcGrad->getElementType());
-    createCall(builder, F,
-               {srcGradPtr, destGradPtr, srcXYPtr, srcGradDims, destDims});
+    emitParallelCall(builder, F,
+                     {srcGradPtr, destGradPtr, srcXYPtr, srcGradDims, destDims},
+                     srcGrad->dims()[0], 1);
     break;
   }
 
@@ -1721,10 +3610,36 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *strides = emitConstSizeTArray(builder, PAG->getStrides());
     auto *pads = emitConstSizeTArray(builder, PAG->getPads());
 
+    // Split the samples of the batch between threads.
     auto *F = getFunction("avg_pool_grad", srcGrad->getElementType());
-    createCall(builder, F,
-               {srcGradPtr, destGradPtr, srcGradDims, destDims, kernels,
-                strides, pads});
+    emitParallelCall(builder, F,
+                     {srcGradPtr, destGradPtr, srcGradDims, destDims, kernels,
+                      strides, pads},
+                     srcGrad->dims()[0], 1);
+    break;
+  }
+
+  case Kinded::Kind::ConvertToInstKind: {
+    auto *CTI = cast<ConvertToInst>(I);
+    auto *dest = CTI->getDest();
+    auto *src = CTI->getSrc();
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, src);
+    auto *numElem = emitConstSizeT(builder, dest->size());
+
+    // The kernels are named after the source and the destination types, e.g.
+    // libjit_convertto_f16_f expands half precision values to floats.
+    GLOW_ASSERT(src->getElementType() != dest->getElementType() &&
+                "ConvertTo must change the element type");
+    const char *srcName = "f";
+    if (src->getElementType() == ElemKind::Float16Ty) {
+      srcName = "f16";
+    } else if (src->getElementType() == ElemKind::BFloat16Ty) {
+      srcName = "bf16";
+    }
+    auto *F = getFunction(std::string("convertto_") + srcName,
+                          dest->getElementType());
+    createCall(builder, F, {destPtr, srcPtr, numElem});
     break;
   }
 
@@ -1756,7 +3671,11 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *scale = emitConstF32(builder, srcType->getScale());
     auto *offset = emitConstI32(builder, srcType->getOffset());
 
-    auto *F = getFunction("dequantize", dest->getElementType());
+    // The kernels are named after the source type when it is not int8.
+    std::string kernelName = src->getElementType() == ElemKind::Int16QTy
+                                 ? "dequantize_i16"
+                                 : "dequantize";
+    auto *F = getFunction(kernelName, dest->getElementType());
     createCall(builder, F, {destPtr, srcPtr, numElem, scale, offset});
     break;
   }
@@ -1772,6 +3691,23 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *srcType = src->getType();
     auto *numElem = emitConstSizeT(builder, destType->size());
 
+    // The rescales from and to int16 scale in floating point, and are named
+    // after the source type too.
+    if (srcType->getElementType() == ElemKind::Int16QTy ||
+        destType->getElementType() == ElemKind::Int16QTy) {
+      std::string kernelName =
+          srcType->getElementType() == ElemKind::Int16QTy ? "rescale_from_i16"
+                                                          : "rescale_from_i8";
+      auto *F = getFunction(kernelName, dest->getElementType());
+      createCall(builder, F,
+                 {destPtr, srcPtr, numElem,
+                  emitConstI32(builder, destType->getOffset()),
+                  emitConstI32(builder, srcType->getOffset()),
+                  emitConstF32(builder,
+                               srcType->getScale() / destType->getScale())});
+      break;
+    }
+
     auto rescaleParams = quantization::quantizeScaleOffset32To8(
         srcType->getScale() / destType->getScale(), srcType->getOffset());
 
@@ -1799,7 +3735,29 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *srcDims = emitValueDims(builder, src);
 
     auto *F = getFunction("softmax", dest->getElementType());
-    createCall(builder, F, {srcPtr, destPtr, srcDims, destDims});
+    if (!src->getType()->isQuantizedType()) {
+      createCall(builder, F, {srcPtr, destPtr, srcDims, destDims});
+      break;
+    }
+
+    // The exponentials of the 256 distances from an input to the maximum of
+    // its row are known at compile time.
+    std::vector<llvm::Constant *> expTable;
+    for (int d = 0; d < 256; d++) {
+      expTable.push_back(llvm::ConstantFP::get(
+          builder.getFloatTy(), std::exp(-d * src->getType()->getScale())));
+    }
+    auto *expTablePtr = emitConstArray(builder, expTable, builder.getFloatTy());
+    auto *invOutScale = emitConstF32(builder, 1 / dest->getType()->getScale());
+    auto *outOffset = emitConstI32(builder, dest->getType()->getOffset());
+
+    // Split the rows between threads.
+    size_t minRows =
+        std::max<size_t>(1, dataParallelMinChunkSize / src->dims()[1]);
+    emitParallelCall(builder, F,
+                     {srcPtr, destPtr, srcDims, destDims, expTablePtr,
+                      invOutScale, outOffset},
+                     src->dims()[0], minRows);
     break;
   }
 
@@ -1814,12 +3772,234 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     auto *srcGradDims = emitValueDims(builder, srcGrad);
     auto *selectedDims = emitValueDims(builder, selected);
 
+    // Split the rows between threads.
     auto *F = getFunction("softmax_grad", srcGrad->getElementType());
+    size_t minRows =
+        std::max<size_t>(1, dataParallelMinChunkSize / srcGrad->dims()[1]);
+    emitParallelCall(builder, F,
+                     {srcGradPtr, destPtr, selectedPtr, srcGradDims,
+                      selectedDims},
+                     srcGrad->dims()[0], minRows);
+    break;
+  }
+
+  case Kinded::Kind::LSTMUnitInstKind: {
+    auto *LU = cast<LSTMUnitInst>(I);
+    auto *C = LU->getC();
+    auto *newHPtr = emitValueAddress(builder, LU->getNewH());
+    auto *newCPtr = emitValueAddress(builder, LU->getNewC());
+    auto *inputGatesPtr = emitValueAddress(builder, LU->getInputGates());
+    auto *hiddenGatesPtr = emitValueAddress(builder, LU->getHiddenGates());
+    auto *CPtr = emitValueAddress(builder, C);
+    auto *hidden = emitConstSizeT(builder, C->dims()[1]);
+
+    auto *F = getFunction("lstm_unit", C->getElementType());
+    emitParallelCall(builder, F,
+                     {newHPtr, newCPtr, inputGatesPtr, hiddenGatesPtr, CPtr,
+                      hidden},
+                     C->size(), dataParallelMinChunkSize);
+    break;
+  }
+
+  case Kinded::Kind::SGDInstKind: {
+    auto *SGD = cast<SGDInst>(I);
+    auto *W = SGD->getWeight();
+    auto *newWPtr = emitValueAddress(builder, SGD->getUpdatedWeight());
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, SGD->getGradient());
+    auto *L1Decay = emitConstF32(builder, SGD->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, SGD->getL2Decay());
+    auto *scale = emitConstF32(builder, -SGD->getLearningRate() /
+                                            std::max(1u, SGD->getBatchSize()));
+
+    auto *F = getFunction("sgd", W->getElementType());
+    emitParallelCall(builder, F, {newWPtr, WPtr, GPtr, L1Decay, L2Decay, scale},
+                     W->size(), dataParallelMinChunkSize);
+    break;
+  }
+
+  case Kinded::Kind::MomentumSGDInstKind: {
+    auto *SGD = cast<MomentumSGDInst>(I);
+    auto *W = SGD->getWeight();
+    auto *newWPtr = emitValueAddress(builder, SGD->getUpdatedWeight());
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, SGD->getGradient());
+    auto *gsumPtr = emitValueAddress(builder, SGD->getGsum());
+    auto *L1Decay = emitConstF32(builder, SGD->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, SGD->getL2Decay());
+    auto *scale = emitConstF32(builder, -SGD->getLearningRate() /
+                                            std::max(1u, SGD->getBatchSize()));
+    auto *momentum = emitConstF32(builder, SGD->getMomentum());
+
+    auto *F = getFunction("momentum_sgd", W->getElementType());
+    emitParallelCall(builder, F,
+                     {newWPtr, WPtr, GPtr, gsumPtr, L1Decay, L2Decay, scale,
+                      momentum},
+                     W->size(), dataParallelMinChunkSize);
+    break;
+  }
+
+  case Kinded::Kind::AdagradInstKind: {
+    auto *AG = cast<AdagradInst>(I);
+    auto *W = AG->getWeight();
+    auto *newWPtr = emitValueAddress(builder, AG->getUpdatedWeight());
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, AG->getGradient());
+    auto *sumSqPtr = emitValueAddress(builder, AG->getSumSq());
+    auto *L1Decay = emitConstF32(builder, AG->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, AG->getL2Decay());
+    auto *gradScale =
+        emitConstF32(builder, 1.0f / std::max(1u, AG->getBatchSize()));
+    auto *learningRate = emitConstF32(builder, AG->getLearningRate());
+    auto *epsilon = emitConstF32(builder, AG->getEpsilon());
+
+    auto *F = getFunction("adagrad", W->getElementType());
+    emitParallelCall(builder, F,
+                     {newWPtr, WPtr, GPtr, sumSqPtr, L1Decay, L2Decay,
+                      gradScale, learningRate, epsilon},
+                     W->size(), dataParallelMinChunkSize);
+    break;
+  }
+
+  case Kinded::Kind::RMSPropInstKind: {
+    auto *RP = cast<RMSPropInst>(I);
+    auto *W = RP->getWeight();
+    auto *newWPtr = emitValueAddress(builder, RP->getUpdatedWeight());
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, RP->getGradient());
+    auto *meanSqPtr = emitValueAddress(builder, RP->getMeanSq());
+    auto *L1Decay = emitConstF32(builder, RP->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, RP->getL2Decay());
+    auto *gradScale =
+        emitConstF32(builder, 1.0f / std::max(1u, RP->getBatchSize()));
+    auto *learningRate = emitConstF32(builder, RP->getLearningRate());
+    auto *decay = emitConstF32(builder, RP->getDecay());
+    auto *epsilon = emitConstF32(builder, RP->getEpsilon());
+
+    auto *F = getFunction("rmsprop", W->getElementType());
+    emitParallelCall(builder, F,
+                     {newWPtr, WPtr, GPtr, meanSqPtr, L1Decay, L2Decay,
+                      gradScale, learningRate, decay, epsilon},
+                     W->size(), dataParallelMinChunkSize);
+    break;
+  }
+
+  case Kinded::Kind::AdamInstKind: {
+    auto *AD = cast<AdamInst>(I);
+    auto *W = AD->getWeight();
+    auto *newWPtr = emitValueAddress(builder, AD->getUpdatedWeight());
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, AD->getGradient());
+    auto *MPtr = emitValueAddress(builder, AD->getFirstMoment());
+    auto *VPtr = emitValueAddress(builder, AD->getSecondMoment());
+    auto *stepPtr = emitValueAddress(builder, AD->getStep());
+    auto *L1Decay = emitConstF32(builder, AD->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, AD->getL2Decay());
+    auto *gradScale =
+        emitConstF32(builder, 1.0f / std::max(1u, AD->getBatchSize()));
+    auto *learningRate = emitConstF32(builder, AD->getLearningRate());
+    auto *beta1 = emitConstF32(builder, AD->getBeta1());
+    auto *beta2 = emitConstF32(builder, AD->getBeta2());
+    auto *epsilon = emitConstF32(builder, AD->getEpsilon());
+
+    // All the chunks read the number of updates, which is incremented once
+    // they are done.
+    auto *F = getFunction("adam", W->getElementType());
+    emitParallelCall(builder, F,
+                     {newWPtr, WPtr, GPtr, MPtr, VPtr, stepPtr, L1Decay,
+                      L2Decay, gradScale, learningRate, beta1, beta2, epsilon},
+                     W->size(), dataParallelMinChunkSize);
+    auto *stepF = getFunction("adam_step", W->getElementType());
+    createCall(builder, stepF, {stepPtr});
+    break;
+  }
+
+  case Kinded::Kind::SparseLengthsWeightedSumRowGradInstKind: {
+    auto *RG = cast<SparseLengthsWeightedSumRowGradInst>(I);
+    auto *outG = RG->getOutputGrad();
+    auto *lengths = RG->getLengths();
+    auto *destPtr = emitValueAddress(builder, RG->getDest());
+    auto *outGPtr = emitValueAddress(builder, outG);
+    auto *weightsPtr = emitValueAddress(builder, RG->getWeights());
+    auto *lengthsPtr = emitValueAddress(builder, lengths);
+    auto *segments = emitConstSizeT(builder, lengths->dims()[0]);
+    auto *lineSize = emitConstSizeT(builder, outG->size() / outG->dims()[0]);
+
+    auto *F = getFunction("sparse_lengths_weighted_sum_row_grad",
+                          outG->getElementType());
     createCall(builder, F,
-               {srcGradPtr, destPtr, selectedPtr, srcGradDims, selectedDims});
+               {destPtr, outGPtr, weightsPtr, lengthsPtr, segments, lineSize});
+    break;
+  }
+
+  case Kinded::Kind::SparseSGDInstKind: {
+    auto *SGD = cast<SparseSGDInst>(I);
+    auto *W = SGD->getWeight();
+    auto *indices = SGD->getIndices();
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, SGD->getGradient());
+    auto *indicesPtr = emitValueAddress(builder, indices);
+    auto *numIndices = emitConstSizeT(builder, indices->size());
+    auto *lineSize = emitConstSizeT(builder, W->size() / W->dims()[0]);
+    auto *L1Decay = emitConstF32(builder, SGD->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, SGD->getL2Decay());
+    auto *scale = emitConstF32(builder, -SGD->getLearningRate() /
+                                            std::max(1u, SGD->getBatchSize()));
+
+    // The rows are updated serially, since an index may appear several times.
+    auto *F = getFunction("sparse_sgd", W->getElementType());
+    createCall(builder, F,
+               {WPtr, GPtr, indicesPtr, numIndices, lineSize, L1Decay, L2Decay,
+                scale});
+    break;
+  }
+
+  case Kinded::Kind::SparseAdagradInstKind: {
+    auto *AG = cast<SparseAdagradInst>(I);
+    auto *W = AG->getWeight();
+    auto *indices = AG->getIndices();
+    auto *WPtr = emitValueAddress(builder, W);
+    auto *GPtr = emitValueAddress(builder, AG->getGradient());
+    auto *indicesPtr = emitValueAddress(builder, indices);
+    auto *sumSqPtr = emitValueAddress(builder, AG->getSumSq());
+    auto *numIndices = emitConstSizeT(builder, indices->size());
+    auto *lineSize = emitConstSizeT(builder, W->size() / W->dims()[0]);
+    auto *L1Decay = emitConstF32(builder, AG->getL1Decay());
+    auto *L2Decay = emitConstF32(builder, AG->getL2Decay());
+    auto *gradScale =
+        emitConstF32(builder, 1.0f / std::max(1u, AG->getBatchSize()));
+    auto *learningRate = emitConstF32(builder, AG->getLearningRate());
+    auto *epsilon = emitConstF32(builder, AG->getEpsilon());
+
+    auto *F = getFunction("sparse_adagrad", W->getElementType());
+    createCall(builder, F,
+               {WPtr, GPtr, indicesPtr, sumSqPtr, numIndices, lineSize,
+                L1Decay, L2Decay, gradScale, learningRate, epsilon});
+    break;
+  }
+
+  case Kinded::Kind::GRUUnitInstKind: {
+    auto *GU = cast<GRUUnitInst>(I);
+    auto *H = GU->getH();
+    auto *destPtr = emitValueAddress(builder, GU->getDest());
+    auto *inputGatesPtr = emitValueAddress(builder, GU->getInputGates());
+    auto *hiddenGatesPtr = emitValueAddress(builder, GU->getHiddenGates());
+    auto *HPtr = emitValueAddress(builder, H);
+    auto *hidden = emitConstSizeT(builder, H->dims()[1]);
+
+    auto *F = getFunction("gru_unit", H->getElementType());
+    emitParallelCall(builder, F,
+                     {destPtr, inputGatesPtr, hiddenGatesPtr, HPtr, hidden},
+                     H->size(), dataParallelMinChunkSize);
     break;
   }
 
+  case Kinded::Kind::RNNSequenceInstKind:
+  case Kinded::Kind::LSTMSequenceInstKind:
+  case Kinded::Kind::GRUSequenceInstKind:
+    emitRecurrentSequence(builder, I);
+    break;
+
   case Kinded::Kind::TopKInstKind: {
     auto *TI = cast<TopKInst>(I);
     auto *input = TI->getInput();
@@ -1962,6 +4142,152 @@ void LLVMIRGen::generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
     break;
   }
 
+  case Kinded::Kind::SparseLengthsWeightedSumInstKind: {
+    auto *SI = llvm::cast<SparseLengthsWeightedSumInst>(I);
+    auto *dest = SI->getDest();
+    auto *data = SI->getData();
+    auto *weights = SI->getWeights();
+    auto *indices = SI->getIndices();
+    auto *lengths = SI->getLengths();
+
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *dataPtr = emitValueAddress(builder, data);
+    auto *weightsPtr = emitValueAddress(builder, weights);
+    auto *indicesPtr = emitValueAddress(builder, indices);
+    auto *lengthsPtr = emitValueAddress(builder, lengths);
+
+    auto *segments = emitConstSizeT(builder, lengths->dims()[0]);
+    auto *lineSize = emitConstSizeT(builder, data->size() / data->dims()[0]);
+
+    // The kernel is selected by the type of the table.
+    auto *F =
+        getFunction("sparse_lengths_weighted_sum", data->getElementType());
+    createCall(builder, F,
+               {destPtr, dataPtr, weightsPtr, indicesPtr, lengthsPtr, segments,
+                lineSize});
+    break;
+  }
+
+  case Kinded::Kind::CPUClusteredSparseLengthsWeightedSumInstKind: {
+    auto *SI = llvm::cast<CPUClusteredSparseLengthsWeightedSumInst>(I);
+    auto *dest = SI->getDest();
+    auto *lengths = SI->getLengths();
+
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *codebookPtr = emitValueAddress(builder, SI->getCodebook());
+    auto *codesPtr = emitValueAddress(builder, SI->getCodes());
+    auto *weightsPtr = emitValueAddress(builder, SI->getWeights());
+    auto *indicesPtr = emitValueAddress(builder, SI->getIndices());
+    auto *lengthsPtr = emitValueAddress(builder, lengths);
+
+    auto *segments = emitConstSizeT(builder, lengths->dims()[0]);
+    auto *lineSize = emitConstSizeT(builder, dest->size() / dest->dims()[0]);
+    auto *codeBits = emitConstI32(builder, SI->getCodeBits());
+
+    auto *F = getFunction("clustered_sparse_lengths_weighted_sum",
+                          dest->getElementType());
+    createCall(builder, F,
+               {destPtr, codebookPtr, codesPtr, weightsPtr, indicesPtr,
+                lengthsPtr, segments, lineSize, codeBits});
+    break;
+  }
+
+  case Kinded::Kind::RowwiseQuantizedSparseLengthsWeightedSumInstKind: {
+    auto *SI = llvm::cast<RowwiseQuantizedSparseLengthsWeightedSumInst>(I);
+    auto *dest = SI->getDest();
+    auto *data = SI->getData();
+    auto *lengths = SI->getLengths();
+
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *dataPtr = emitValueAddress(builder, data);
+    auto *scalesPtr = emitValueAddress(builder, SI->getScales());
+    auto *offsetsPtr = emitValueAddress(builder, SI->getOffsets());
+    auto *weightsPtr = emitValueAddress(builder, SI->getWeights());
+    auto *indicesPtr = emitValueAddress(builder, SI->getIndices());
+    auto *lengthsPtr = emitValueAddress(builder, lengths);
+
+    auto *segments = emitConstSizeT(builder, lengths->dims()[0]);
+    auto *lineSize = emitConstSizeT(builder, data->size() / data->dims()[0]);
+
+    auto *F = getFunction("rowwise_quantized_sparse_lengths_weighted_sum",
+                          dest->getElementType());
+    createCall(builder, F,
+               {destPtr, dataPtr, scalesPtr, offsetsPtr, weightsPtr,
+                indicesPtr, lengthsPtr, segments, lineSize});
+    break;
+  }
+
+  case Kinded::Kind::RowwiseQuantizedFullyConnectedInstKind: {
+    auto *FC = cast<RowwiseQuantizedFullyConnectedInst>(I);
+    auto *dest = FC->getDest();
+    auto *weights = FC->getWeights();
+
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, FC->getSrc());
+    auto *weightsPtr = emitValueAddress(builder, weights);
+    auto *scalesPtr = emitValueAddress(builder, FC->getScales());
+    auto *offsetsPtr = emitValueAddress(builder, FC->getOffsets());
+    auto *biasPtr = emitValueAddress(builder, FC->getBias());
+
+    size_t batch = dest->dims()[0];
+    size_t outSize = dest->dims()[1];
+    size_t inSize = weights->dims()[1];
+    auto *batchVal = emitConstSizeT(builder, batch);
+    auto *inSizeVal = emitConstSizeT(builder, inSize);
+    auto *outSizeVal = emitConstSizeT(builder, outSize);
+
+    // Split the rows of the weights between threads, so that every row is
+    // only streamed by one of them. Make sure that every thread gets enough
+    // work.
+    auto *F = getFunction("rowwise_quantized_fc", dest->getElementType());
+    size_t colWork = batch * inSize;
+    size_t minCols = std::max<size_t>(1, matMulMinChunkWork / colWork);
+    emitParallelCall(builder, F,
+                     {destPtr, srcPtr, weightsPtr, scalesPtr, offsetsPtr,
+                      biasPtr, batchVal, inSizeVal, outSizeVal},
+                     outSize, minCols);
+    break;
+  }
+
+  case Kinded::Kind::DynamicQuantizedFullyConnectedInstKind: {
+    auto *FC = cast<DynamicQuantizedFullyConnectedInst>(I);
+    auto *dest = FC->getDest();
+    auto *weights = FC->getWeights();
+    auto *scratch = FC->getScratch();
+
+    auto *destPtr = emitValueAddress(builder, dest);
+    auto *srcPtr = emitValueAddress(builder, FC->getSrc());
+    auto *weightsPtr = emitValueAddress(builder, weights);
+    auto *scalesPtr = emitValueAddress(builder, FC->getScales());
+    auto *offsetsPtr = emitValueAddress(builder, FC->getOffsets());
+    auto *biasPtr = emitValueAddress(builder, FC->getBias());
+    auto *scratchPtr = emitValueAddress(builder, scratch);
+
+    size_t batch = dest->dims()[0];
+    size_t outSize = dest->dims()[1];
+    size_t inSize = weights->dims()[1];
+    auto *batchVal = emitConstSizeT(builder, batch);
+    auto *inSizeVal = emitConstSizeT(builder, inSize);
+    auto *outSizeVal = emitConstSizeT(builder, outSize);
+    auto *rowStride = emitConstSizeT(builder, scratch->dims()[1]);
+
+    // Quantize the input rows once, before the threads share them.
+    auto *QF = getFunction("dynamic_quantize_rows", dest->getElementType());
+    createCall(builder, QF,
+               {scratchPtr, srcPtr, batchVal, inSizeVal, rowStride});
+
+    // Split the rows of the weights between threads, as for
+    // RowwiseQuantizedFullyConnected.
+    auto *F = getFunction("dynamic_quantized_fc", dest->getElementType());
+    size_t colWork = batch * inSize;
+    size_t minCols = std::max<size_t>(1, matMulMinChunkWork / colWork);
+    emitParallelCall(builder, F,
+                     {destPtr, scratchPtr, weightsPtr, scalesPtr, offsetsPtr,
+                      biasPtr, batchVal, inSizeVal, outSizeVal, rowStride},
+                     outSize, minCols);
+    break;
+  }
+
   case Kinded::Kind::ScatterAssignInstKind: {
     auto *SAI = llvm::cast<ScatterAssignInst>(I);
     auto *data = SAI->getData();
@@ -22,12 +22,16 @@
 
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Target/TargetMachine.h"
 
+#include <vector>
+
 namespace glow {
 
 class Context;
@@ -37,6 +41,7 @@ class Tensor;
 class Variable;
 class Instruction;
 class WeightVar;
+class ThreadPool;
 struct AllocationsInfo;
 
 /// Different kinds of memory areas used by the emitted LLVM function.
@@ -49,6 +54,16 @@ enum MemoryAreaKind {
   LastMemoryArea
 };
 
+/// The activation that a CPU-specific convolution or matrix multiplication
+/// applies to its result in its output loop. The values are passed to libjit
+/// and must match libjit_activation in libjit_defs.h.
+enum FusedActivationKind : unsigned_t {
+  NoFusedActivation = 0,
+  FusedRelu = 1,
+  FusedSigmoid = 2,
+  FusedTanh = 3,
+};
+
 /// A POD struct that stores information related to debug info.
 struct DebugInfo {
   /// Source file for the main function.
@@ -77,6 +92,36 @@ struct DebugInfo {
       baseAddressesVariables_;
 };
 
+/// How the function specializer handled the calls of a libjit kernel.
+struct KernelSpecializationStats {
+  /// The number of calls that were considered for the specialization.
+  unsigned numCalls{0};
+  /// The number of specialized functions created for the kernel.
+  unsigned numSpecializations{0};
+  /// The number of calls that reuse a specialized function created for an
+  /// earlier call.
+  unsigned numSharedSpecializations{0};
+};
+
+/// A region of the generated code that is timed when the code is instrumented:
+/// a single instruction or a data-parallel kernel fusing several
+/// instructions.
+struct TimeProfileRegion {
+  /// The names of the instructions of the region, separated by commas.
+  std::string name;
+  /// The kind of the instruction, or "DataParallel" for a fused kernel.
+  std::string kind;
+  /// The estimated number of floating point or integer operations.
+  uint64_t flops{0};
+  /// The number of bytes of the operands that the region reads and writes.
+  uint64_t bytes{0};
+};
+
+/// The statistics that the health instrumentation computes for every checked
+/// tensor, in this order: the minimum, the maximum and the sum of the sampled
+/// finite elements, their number, and the numbers of NaNs and infinities.
+constexpr size_t NumHealthStats = 6;
+
 /// This is a class containing a common logic for the generation of the LLVM IR
 /// from an IRFunction. The primary clients of this class are JITs and bundlers.
 class LLVMIRGen {
@@ -115,15 +160,76 @@ protected:
   DebugInfo dbgInfo_;
   /// Debug info builder.
   std::unique_ptr<llvm::DIBuilder> DIBuilder_;
+  /// The thread pool used by the generated code to execute data-parallel
+  /// kernels, matrix multiplications and convolutions in parallel. If it is
+  /// null, the generated code is single-threaded.
+  ThreadPool *threadPool_{nullptr};
+  /// The MD5 digest of the contents of the libjit bitcode file.
+  std::string libjitDigest_;
+  /// Whether the global variables written by the generated code are thread
+  /// local, so that several threads can execute the code at the same time.
+  bool threadLocalGlobals_{false};
+
+  /// The level of the LLVM optimizations. Level 1 only inlines and cleans up
+  /// the kernels, which compiles quickly. Level 2 runs the full pipeline.
+  unsigned optLevel_{2};
+
+  /// Whether every instruction and every data-parallel kernel is emitted into
+  /// its own function, which the entry function calls.
+  bool outlineSegments_{false};
+  /// The functions holding the outlined instructions and kernels, in the
+  /// order of the entry function.
+  std::vector<llvm::Function *> segments_;
+  /// The task functions that call the kernels executed on the thread pool.
+  std::vector<llvm::Function *> parallelTasks_;
+  /// The functions of the data-parallel kernels, in the order they were
+  /// emitted.
+  std::vector<llvm::Function *> dataParallelKernels_;
+  /// The statistics of the specialization, by the name of the kernel.
+  llvm::StringMap<KernelSpecializationStats> specializationStats_;
+
+  /// Whether every instruction and every data-parallel kernel is timed.
+  bool instrumentTime_{false};
+  /// Whether the hardware performance counters are read around the timed
+  /// regions too.
+  bool instrumentCounters_{false};
+  /// The regions that are timed, in the order of the generated code.
+  std::vector<TimeProfileRegion> timeProfileRegions_;
+  /// Whether the float outputs of the instructions are checked for NaNs and
+  /// range drift.
+  bool instrumentHealth_{false};
+  /// The largest number of elements of a tensor that the health checks read,
+  /// or 0 to read them all.
+  size_t healthMaxElements_{0};
+  /// The names of the checked tensors, in the order of their statistics.
+  std::vector<std::string> healthTensors_;
+  /// Whether the entry function asks the runtime whether to stop the run
+  /// before every instruction and every data-parallel kernel.
+  bool cancellationChecks_{false};
+  /// The block of the entry function that the checks branch to when the run
+  /// stops. It is created by the first check.
+  llvm::BasicBlock *stopBlock_{nullptr};
+  /// The largest number of bytes of constant weights that are prefetched for
+  /// the instructions after the current one, or 0 to not prefetch them.
+  size_t weightPrefetchBudget_{0};
 
   /// A set that contains all of the argument that we request from the
   /// specializer not to specialize.
   llvm::DenseSet<llvm::Value *> dontSpecializeArgsSet_;
 
+  /// \returns the global variable \p name of the type \p ty, which holds an
+  /// address provided by the runtime. The variable is created if needed.
+  llvm::GlobalVariable *getRuntimeVar(llvm::StringRef name,
+                                      llvm::PointerType *ty);
+
   /// Generates LLVM IR that computes the address of \p val using \p builder.
   /// The address type is specified by \p ptrTy.
   llvm::Value *emitValueAddress(llvm::IRBuilder<> &builder,
                                 const glow::Value *val);
+  /// Generates LLVM IR that computes the address of the scratch area that
+  /// AllocationsInfo reserved at the end of the activations, as a float
+  /// pointer.
+  llvm::Value *emitScratchAddress(llvm::IRBuilder<> &builder);
   /// Generates LLVM IR that computes the size of the tensor of \p val using
   /// \p builder. The size type is native to the machine (size_t).
   llvm::Value *emitValueSize(llvm::IRBuilder<> &builder,
@@ -159,11 +265,53 @@ protected:
   /// weightvars, mutable weight vars) so that they can be reused inside the
   /// body of the function.
   void loadBaseAddresses(llvm::IRBuilder<> &builder);
+  /// Emit a call of \p callee, which processes the range of iterations
+  /// [begin, end) passed as the two trailing arguments after \p args. The
+  /// range [0, \p numIterations) is split into chunks of at least
+  /// \p minChunkSize iterations, which are executed in parallel on the thread
+  /// pool, if there is one. Otherwise, a single call processing the whole
+  /// range is emitted.
+  void emitParallelCall(llvm::IRBuilder<> &builder, llvm::Function *callee,
+                        llvm::ArrayRef<llvm::Value *> args,
+                        size_t numIterations, size_t minChunkSize);
+  /// Emit the time steps of the recurrent sequence \p I, a RNNSequenceInst,
+  /// LSTMSequenceInst or GRUSequenceInst, as a loop over the steps that the
+  /// lengths of its batch entries need. Every step computes the gates of the
+  /// hidden state with the blocked matmul kernels, and then the new states,
+  /// both split between the threads of the pool.
+  void emitRecurrentSequence(llvm::IRBuilder<> &builder,
+                             const glow::Instruction *I);
+  /// \returns the value of the clock at the beginning of the region
+  /// \p region, which is made of \p instrs. The hardware counters are read
+  /// first if they are instrumented. \returns nullptr if the code is not
+  /// instrumented. The regions do not nest.
+  llvm::Value *emitTimeProfileBegin(llvm::IRBuilder<> &builder,
+                                    TimeProfileRegion region,
+                                    llvm::ArrayRef<const Instruction *> instrs);
+  /// Add the time elapsed since \p begin to the entry of the last region in
+  /// the profile, and the counter increments to the counter profile. Does
+  /// nothing if \p begin is nullptr.
+  void emitTimeProfileEnd(llvm::IRBuilder<> &builder, llvm::Value *begin);
+  /// Compute the statistics of the float outputs of \p instrs, if the health
+  /// is instrumented and the execution provides a buffer for them.
+  void emitHealthChecks(llvm::IRBuilder<> &builder,
+                        llvm::ArrayRef<const Instruction *> instrs);
+  /// Emit the code generated by \p emit. If the segments are outlined, the
+  /// code is emitted into a new function, whose name ends with \p name and
+  /// which is called using \p builder with the arguments of the current
+  /// function. Otherwise, \p emit uses \p builder directly.
+  void emitSegment(llvm::IRBuilder<> &builder, llvm::StringRef name,
+                   llvm::function_ref<void(llvm::IRBuilder<> &)> emit);
   /// Create a function representing a stacked kernel for instructions provided
   /// in \p stackedInstrs.
   void
   emitDataParallelKernel(llvm::IRBuilder<> &builder,
                          llvm::ArrayRef<const Instruction *> stackedInstrs);
+  /// Emit a call of the SIMD libjit kernel of the quantized data-parallel
+  /// instruction \p I over its whole range. \returns false, and emits
+  /// nothing, if \p I has no such kernel.
+  bool emitQuantizedRangeKernel(llvm::IRBuilder<> &builder,
+                                const Instruction *I);
   /// Emit IR for the data parallel instruction \p I which is invoked inside the
   /// stacked \p kernel. The current loop count is described by \p loopCount.
   /// The \p bufferToArgNum map can be used to find the required buffers, which
@@ -206,14 +354,27 @@ public:
   explicit LLVMIRGen(const IRFunction *M, AllocationsInfo &allocationsInfo,
                      std::string mainEntryName);
 
-  /// Init the TargetMachine using a given target and code model.
-  void initTargetMachine(llvm::StringRef T, llvm::CodeModel::Model CM);
+  /// Init the TargetMachine using a given target and code model. A non-empty
+  /// \p cpu or \p features, a comma-separated list of attributes, override
+  /// the -mcpu and -mattr options.
+  void initTargetMachine(llvm::StringRef T, llvm::CodeModel::Model CM,
+                         llvm::StringRef cpu = "",
+                         llvm::StringRef features = "");
 
   /// Emit LLVM-IR for the instruction \p I, using the builder \p builder.
   virtual void generateLLVMIRForInstr(llvm::IRBuilder<> &builder,
                                       const glow::Instruction *I);
   /// Emit LLVM-IR for the whole IRFunction.
   void generateLLVMIRForModule(llvm::IRBuilder<> &builder);
+  /// Emit a call of the runtime that tells whether the run was cancelled or
+  /// missed its deadline, and a branch to the end of the entry function if
+  /// it was. The rest of the function is emitted after the check.
+  void emitCancellationCheck(llvm::IRBuilder<> &builder);
+  /// Emit a call of the runtime that reads the first \p bytes of the
+  /// constant weight \p W into the last level cache on a helper thread,
+  /// while the code that follows the call runs.
+  void emitWeightPrefetch(llvm::IRBuilder<> &builder, const glow::Value *W,
+                          size_t bytes);
   /// \returns a libjit API function by name.
   llvm::Function *getFunction(const std::string &name);
   /// \returns a libjit API function by name and tensor element type.
@@ -228,6 +389,11 @@ public:
   void optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM);
   /// Performs specialization of operations based on constant parameters.
   void performSpecialization();
+  /// Replace the data-parallel kernels that are identical to a kernel emitted
+  /// before, e.g. for the repeated layers of the same shape, by that kernel.
+  /// The shared kernels are not inlined, and the instructions saved are
+  /// reported in the current compile report.
+  void shareDataParallelKernels();
   /// \returns allocations info.
   AllocationsInfo &getAllocationsInfo() { return allocationsInfo_; }
   /// \returns the name of the main entry point.
@@ -242,6 +408,17 @@ public:
   void performCodeGen();
   /// \returns the current builder.
   llvm::IRBuilder<> &getBuilder() { return *builder_; }
+  /// \returns the suffix of the libjit matrix multiplication kernels that are
+  /// register-blocked for the features of the target machine, e.g. "_avx2" for
+  /// the AVX2 6x16 kernel, "_avx512" for the AVX-512 14x32 kernel, or "_neon"
+  /// and "_neon32" for the AArch64 and ARMv7 NEON kernels. The suffix is empty
+  /// for the generic kernel.
+  llvm::StringRef getMatMulKernelSuffix() const;
+  /// \returns the suffix of the libjit quantized matrix multiplication kernels
+  /// that use the int8 dot-product instructions of the target machine, i.e.
+  /// "_vnni" for AVX-512 VNNI or "_avx2" for AVX2. The suffix is empty for the
+  /// portable kernel.
+  llvm::StringRef getQuantizedMatMulKernelSuffix() const;
   /// \returns the target machine description.
   llvm::TargetMachine &getTargetMachine() { return *TM_; }
   /// \returns the LLVMContext being used.
@@ -266,6 +443,133 @@ public:
   llvm::Value *emitStringConst(llvm::IRBuilder<> &builder, llvm::StringRef str);
   /// Register \p val as an argument that should not be specialized.
   void markArgAsUnspecialized(llvm::Value *val);
+  /// Make the generated code execute the parallelizable operations on a
+  /// thread pool with the same number of threads as \p pool. The runtime binds
+  /// the pool to the loaded code with initParallelRuntime. This is only
+  /// supported when JITting.
+  void setThreadPool(ThreadPool *pool) { threadPool_ = pool; }
+  /// Make the global variables that the generated code writes to, such as the
+  /// base addresses described by the debug info, thread local. This makes the
+  /// code reentrant. It is not supported when JITting.
+  void setThreadLocalGlobals(bool enable) { threadLocalGlobals_ = enable; }
+  /// Make the generated code add the time spent in every instruction, or in
+  /// every data-parallel kernel, to a profile provided by the runtime. This is
+  /// only supported when JITting.
+  void setInstrumentTime(bool enable) { instrumentTime_ = enable; }
+  /// Make the timed regions also add the increments of the hardware
+  /// performance counters of the executing thread to a profile provided by
+  /// the runtime, see readPerfCounters(). It requires the time
+  /// instrumentation.
+  void setInstrumentCounters(bool enable) { instrumentCounters_ = enable; }
+  /// Make the generated code compute the statistics of the float outputs of
+  /// every instruction, reading at most \p maxElements elements of each, or
+  /// all of them if it is 0. The checks only run if the entry of the offsets
+  /// array after the values, see getHealthOffsetIndex(), holds the address of
+  /// a buffer of NumHealthStats floats per tensor of getHealthTensors().
+  void setInstrumentHealth(bool enable, size_t maxElements) {
+    instrumentHealth_ = enable;
+    healthMaxElements_ = maxElements;
+  }
+  /// \returns the names of the tensors checked by the health instrumentation,
+  /// in the order of their statistics.
+  llvm::ArrayRef<std::string> getHealthTensors() const {
+    return healthTensors_;
+  }
+  /// \returns the entry of the offsets array that holds the address of the
+  /// statistics of the health instrumentation.
+  size_t getHealthOffsetIndex() const {
+    return allocationsInfo_.valueNumbers_.size();
+  }
+  /// Make the generated code stop a run before the next instruction, or the
+  /// next data-parallel kernel, when the runtime tells it to, see
+  /// shouldStopRun(). This is only supported when JITting.
+  void setCancellationChecks(bool enable) { cancellationChecks_ = enable; }
+  /// \returns whether the generated code checks for the cancellation of runs.
+  bool getCancellationChecks() const { return cancellationChecks_; }
+  /// Make the generated code prefetch the constant weights of the next
+  /// instructions into the last level cache, on a helper thread, while the
+  /// current instruction runs. The weights are prefetched in the order of
+  /// their first uses as long as the ones prefetched and not used yet add up
+  /// to at most \p budget bytes, so that the distance of the prefetches
+  /// follows the sizes of the layers. 0 disables the prefetches. This is only
+  /// supported when JITting.
+  void setWeightPrefetchBudget(size_t budget) {
+    weightPrefetchBudget_ = budget;
+  }
+  /// \returns the budget of the weight prefetches, in bytes.
+  size_t getWeightPrefetchBudget() const { return weightPrefetchBudget_; }
+  /// Set the level of the LLVM optimizations of the generated code to
+  /// \p level, which is 1 or 2.
+  void setOptLevel(unsigned level) { optLevel_ = level; }
+  /// \returns the level of the LLVM optimizations of the generated code.
+  unsigned getOptLevel() const { return optLevel_; }
+  /// Make the entry function call a separate function for every instruction
+  /// and every data-parallel kernel. The module can then be split between
+  /// several threads for the machine code generation, see
+  /// llvm::splitCodeGen. The segments are not outlined when the debug info is
+  /// emitted.
+  void setOutlineSegments(bool enable) { outlineSegments_ = enable; }
+  /// \returns the functions of the outlined segments.
+  llvm::ArrayRef<llvm::Function *> getSegments() const { return segments_; }
+  /// \returns how the calls of every libjit kernel were specialized, by the
+  /// name of the kernel. It is filled in by performSpecialization().
+  const llvm::StringMap<KernelSpecializationStats> &
+  getSpecializationStats() const {
+    return specializationStats_;
+  }
+  /// \returns the regions timed by the instrumented code. The entry i of the
+  /// profile holds the nanoseconds spent in the region i.
+  llvm::ArrayRef<TimeProfileRegion> getTimeProfileRegions() const {
+    return timeProfileRegions_;
+  }
+  /// \returns the MD5 digest of the libjit bitcode the code is generated with.
+  llvm::StringRef getLibjitDigest() const { return libjitDigest_; }
+
+  /// The generated code refers to the thread pool and to the function that
+  /// dispatches tasks on it through the global variables of the module with
+  /// these names. This keeps the code free of process-specific addresses.
+  static const char *getThreadPoolVarName() { return "glow_thread_pool"; }
+  static const char *getDispatcherVarName() {
+    return "glow_dispatch_parallel_task";
+  }
+  /// The instrumented code adds the times of its regions to the array of
+  /// uint64_t whose address is stored in the global variable with this name.
+  static const char *getTimeProfileVarName() { return "glow_time_profile"; }
+  /// The code instrumented with the hardware counters adds their increments
+  /// to the array of NumPerfCounters uint64_t per region whose address is
+  /// stored in the first variable, through the functions whose addresses are
+  /// stored in the two others.
+  static const char *getCounterProfileVarName() {
+    return "glow_counter_profile";
+  }
+  static const char *getCountersBeginVarName() {
+    return "glow_counters_begin";
+  }
+  static const char *getCountersEndVarName() { return "glow_counters_end"; }
+  /// The code with cancellation checks calls the function whose address is
+  /// stored in the global variable with this name, and stops the run when it
+  /// returns a non-zero value.
+  static const char *getShouldStopVarName() { return "glow_should_stop_run"; }
+  /// The code with weight prefetches calls the function whose address is
+  /// stored in the global variable with this name, with the address and the
+  /// size of the weights.
+  static const char *getPrefetchWeightsVarName() {
+    return "glow_prefetch_weights";
+  }
+  /// Make the loaded code execute on the thread pool \p pool. \p poolVar and
+  /// \p dispatcherVar are the addresses of the global variables named above.
+  static void initParallelRuntime(void *poolVar, void *dispatcherVar,
+                                  ThreadPool *pool);
+  /// Make the loaded code read the hardware counters of the executing thread.
+  /// \p beginVar and \p endVar are the addresses of the global variables
+  /// named above.
+  static void initCounterRuntime(void *beginVar, void *endVar);
+  /// Make the loaded code stop the runs that shouldStopRun() tells it to.
+  /// \p shouldStopVar is the address of the global variable named above.
+  static void initCancellationRuntime(void *shouldStopVar);
+  /// Make the loaded code prefetch the weights on the helper thread.
+  /// \p prefetchVar is the address of the global variable named above.
+  static void initPrefetchRuntime(void *prefetchVar);
 };
 
 } // namespace glow
@@ -39,6 +39,7 @@
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/IPO/ForceFunctionAttrs.h"
 #include "llvm/Transforms/IPO/FunctionAttrs.h"
 #include "llvm/Transforms/IPO/InferFunctionAttrs.h"
@@ -81,17 +82,31 @@ void LLVMIRGen::optimizeLLVMModule(llvm::Function *F, llvm::TargetMachine &TM) {
   for (auto &FF : *M) {
     FF.removeFnAttr(llvm::Attribute::AttrKind::NoInline);
   }
+  // The outlined segments stay separate functions, so that their machine code
+  // can be generated in parallel.
+  for (auto *segment : segments_) {
+    segment->addFnAttr(llvm::Attribute::AttrKind::NoInline);
+  }
+
+  // Emit the identical data-parallel kernels once.
+  shareDataParallelKernels();
 
   // Perform specialization of functions for constant arguments before anything
   // else.
   performSpecialization();
 
+  // The quick level only inlines the kernels, which are all marked as always
+  // inline below, and runs the cheap scalar cleanups. It skips the loop
+  // vectorizer and the heavier machine code optimizations.
+  bool quick = optLevel_ < 2;
   llvm::PassManagerBuilder PMB;
-  PMB.OptLevel = 2;
+  PMB.OptLevel = quick ? 1 : 2;
   PMB.SizeLevel = 0;
-  PMB.LoopVectorize = true;
+  PMB.LoopVectorize = !quick;
   PMB.SLPVectorize = false;
-  PMB.Inliner = llvm::createFunctionInliningPass();
+  PMB.Inliner = quick ? llvm::createAlwaysInlinerLegacyPass()
+                      : llvm::createFunctionInliningPass();
+  TM.setOptLevel(quick ? llvm::CodeGenOpt::Less : llvm::CodeGenOpt::Default);
 
   M->setTargetTriple(TM.getTargetTriple().normalize());
   M->setDataLayout(TM.createDataLayout());
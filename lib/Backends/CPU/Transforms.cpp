@@ -14,15 +14,145 @@
  * limitations under the License.
  */
 
+#include "Autotuner.h"
 #include "CPUBackend.h"
+#include "CommandLine.h"
 
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/RewriteRules.h"
+#include "glow/Quantization/Base/Base.h"
+
+#include <algorithm>
+#include <limits>
 
 using namespace glow;
+using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
 
+static llvm::cl::opt<float> cpuSparseMatMulThreshold(
+    "cpu-sparse-matmul-threshold",
+    llvm::cl::desc("Fraction of zeros above which the constant weights of a "
+                   "MatMul are stored as a sparse matrix (1 disables the "
+                   "sparse kernel)"),
+    llvm::cl::init(0.75), llvm::cl::cat(CPUBackendCat));
+
+/// \returns the elements of \p dims separated by 'x', which identify a shape
+/// in the keys of the tuning database.
+template <typename T> static std::string getDimsKey(llvm::ArrayRef<T> dims) {
+  std::string key;
+  for (size_t i = 0; i < dims.size(); i++) {
+    key += (i ? "x" : "") + std::to_string(dims[i]);
+  }
+  return key;
+}
+
+/// The filter transform G of the Winograd convolution F(2x2, 3x3).
+static const float winograd2x2G[4][3] = {
+    {1, 0, 0}, {0.5, 0.5, 0.5}, {0.5, -0.5, 0.5}, {0, 0, 1}};
+
+/// The filter transform G of the Winograd convolution F(4x4, 3x3).
+static const float winograd4x4G[6][3] = {{1.0 / 4, 0, 0},
+                                         {-1.0 / 6, -1.0 / 6, -1.0 / 6},
+                                         {-1.0 / 6, 1.0 / 6, -1.0 / 6},
+                                         {1.0 / 24, 1.0 / 12, 1.0 / 6},
+                                         {1.0 / 24, -1.0 / 12, 1.0 / 6},
+                                         {0, 0, 1}};
+
+/// \returns true if \p filter is only used as the filter of convolutions,
+/// like the spatial tiles of a single convolution, which can all share its
+/// transformation. The transformations of trainable variables are not
+/// shared, so they must have a single user.
+static bool isOnlyConvFilter(Variable *filter) {
+  if (filter->getNumUsers() == 1) {
+    return true;
+  }
+  if (filter->isTraining()) {
+    return false;
+  }
+  for (const auto &U : filter->getUsers()) {
+    auto *CN = dyn_cast<ConvolutionNode>(U.getUser());
+    if (!CN || CN->getFilter().getNode() != filter) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Try to optimize a 3x3 stride-1 Convolution into a Winograd convolution. The
+/// Winograd algorithm F(M x M, 3x3) replaces the 9 * M * M multiplications of
+/// each output tile with (M + 2)^2 element-wise multiplications of transformed
+/// input tiles and filters, which turn into matrix multiplications over the
+/// channels. The filter, with the format DKKC, is transformed at compile time
+/// into the format [(M + 2)^2, C, D]. Unless \p onlyIfProfitable, the layers
+/// with few channels are transformed too.
+static Node *optimizeCPUWinogradConv(ConvolutionNode *CN, Function *F,
+                                     bool onlyIfProfitable = true) {
+  auto *M = F->getParent();
+
+  auto kernels = CN->getKernels();
+  auto strides = CN->getStrides();
+  if (kernels[0] != 3 || kernels[1] != 3 || strides[0] != 1 ||
+      strides[1] != 1 || CN->getGroup() != 1) {
+    return nullptr;
+  }
+
+  // The transforms of the input and output tiles are only amortized by the
+  // matrix multiplications when there are enough channels.
+  ShapeNHWC idim(CN->getInput().dims());
+  ShapeNHWC odim(CN->getResult().dims());
+  if (onlyIfProfitable && (idim.c < 64 || odim.c < 64)) {
+    return nullptr;
+  }
+
+  Variable *filter = dyn_cast<Variable>(CN->getFilter());
+  if (!filter || !isOnlyConvFilter(filter) || !filter->isPrivate()) {
+    // Can't mutate the filter.
+    return nullptr;
+  }
+
+  // We only support Floats for now.
+  if (filter->getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  // Large tiles need fewer multiplications, but waste more work at the edges
+  // of small images.
+  unsigned tileSize = (odim.h >= 8 && odim.w >= 8) ? 4 : 2;
+  size_t alpha = tileSize + 2;
+  auto *G = tileSize == 4 ? winograd4x4G : winograd2x2G;
+
+  // Get a filter with the layout [(M + 2)^2, C, D].
+  auto *filterWTy = M->uniqueType(filter->getElementType(),
+                                  {alpha * alpha, idim.c, odim.c});
+  auto *filterW = M->getDerivedVariable(
+      {filter}, filterWTy, "cpu-winograd",
+      [G, alpha](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        auto WH = T.getHandle();
+        auto FH = srcs[0]->getHandle();
+        auto dims = T.dims();
+
+        // Compute U = G * g * G^T for each pair of output and input channels.
+        for (size_t d = 0; d < dims[2]; d++)
+          for (size_t c = 0; c < dims[1]; c++)
+            for (size_t i = 0; i < alpha; i++)
+              for (size_t j = 0; j < alpha; j++) {
+                float sum = 0;
+                for (size_t k = 0; k < 3; k++)
+                  for (size_t l = 0; l < 3; l++) {
+                    sum += G[i][k] * FH.at({d, k, l, c}) * G[j][l];
+                  }
+                WH.at({i * alpha + j, c, d}) = sum;
+              }
+        return true;
+      });
+
+  return F->addNode(new CPUWinogradConvNode(
+      CN->getName(), CN->getResult().getType(), CN->getInput(), filterW,
+      CN->getBias(), CN->getPads(), tileSize, NoFusedActivation));
+}
+
 /// Try to optimize the regular Convolution into a target-specific convolution
 /// with a different filter memory layout. This optimization adds a new kind of
 /// cpu-specific convolution that operates on filter weight data in a
@@ -44,7 +174,7 @@ static Node *optimizeCPUConv(ConvolutionNode *CN, Function *F) {
   }
 
   Variable *filter = dyn_cast<Variable>(CN->getFilter());
-  if (!filter || filter->getNumUsers() != 1 || !filter->isPrivate()) {
+  if (!filter || !isOnlyConvFilter(filter) || !filter->isPrivate()) {
     // Can't mutate the filter.
     return nullptr;
   }
@@ -54,29 +184,919 @@ static Node *optimizeCPUConv(ConvolutionNode *CN, Function *F) {
     return nullptr;
   }
 
-  // Create a new variable filter with the layout [D/8, K, K, C, 8];
+  // Get a filter with the layout [D/8, K, K, C, 8];
   TypeRef filterTy = filter->getType();
   auto dims = filterTy->dims();
   assert(dims.size() == 4 && "Invalid filter size");
-  auto *filter8 = M->createVariable(
-      filterTy->getElementType(), {dims[0] / 8, dims[1], dims[2], dims[3], 8},
-      filter->getName(), VisibilityKind::Private, false);
-
-  auto F8H = filter8->getHandle();
-  auto FH = filter->getHandle();
-
-  // Transpose the weights into the format [D/8, K, K, C, 8], where the depth
-  // dimension is consecutive in memory.
-  for (size_t c0 = 0; c0 < dims[0]; c0++)
-    for (size_t c1 = 0; c1 < dims[1]; c1++)
-      for (size_t c2 = 0; c2 < dims[2]; c2++)
-        for (size_t c3 = 0; c3 < dims[3]; c3++) {
-          F8H.at({c0 / 8, c1, c2, c3, c0 % 8}) = FH.at({c0, c1, c2, c3});
-        }
+  auto *filter8Ty = M->uniqueType(filterTy->getElementType(),
+                                  {dims[0] / 8, dims[1], dims[2], dims[3], 8});
+  auto *filter8 = M->getDerivedVariable(
+      {filter}, filter8Ty, "cpu-dkkc8",
+      [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        auto F8H = T.getHandle();
+        auto FH = srcs[0]->getHandle();
+        auto dims = srcs[0]->dims();
+
+        // Transpose the weights into the format [D/8, K, K, C, 8], where the
+        // depth dimension is consecutive in memory.
+        for (size_t c0 = 0; c0 < dims[0]; c0++)
+          for (size_t c1 = 0; c1 < dims[1]; c1++)
+            for (size_t c2 = 0; c2 < dims[2]; c2++)
+              for (size_t c3 = 0; c3 < dims[3]; c3++) {
+                F8H.at({c0 / 8, c1, c2, c3, c0 % 8}) = FH.at({c0, c1, c2, c3});
+              }
+        return true;
+      });
 
   return F->addNode(new CPUConvDKKC8Node(
       CN->getName(), CN->getResult().getType(), CN->getInput(), filter8,
-      CN->getBias(), CN->getKernels(), CN->getStrides(), CN->getPads(), group));
+      CN->getBias(), CN->getKernels(), CN->getStrides(), CN->getPads(), group,
+      NoFusedActivation));
+}
+
+/// Number of columns in each panel of a pre-packed weight matrix. This must
+/// match the panel width of the libjit_matmul_packed_panels kernels.
+static constexpr size_t packedMatMulPanelWidth = 16;
+
+/// \returns the type of the K x N weight matrix with the element type \p kind
+/// pre-packed into panels of 16 columns, with the layout [ceil(N/16), K, 16].
+static TypeRef getPackedWeightsType(Module *M, ElemKind kind, size_t K,
+                                    size_t N) {
+  size_t W = packedMatMulPanelWidth;
+  return M->uniqueType(kind, {(N + W - 1) / W, K, W});
+}
+
+/// Pack into \p packed the K x N weight matrix whose elements are given by
+/// \p weightAt(k, n). The last panel is zero-padded. The elements have the
+/// type \p ElemTy, which is either float, float16_t or bfloat16_t.
+template <typename ElemTy = float, typename FnTy>
+static void packWeights(Tensor &packed, size_t K, size_t N, FnTy weightAt) {
+  size_t W = packedMatMulPanelWidth;
+  packed.zero();
+
+  auto PH = packed.getHandle<ElemTy>();
+  for (size_t k = 0; k < K; k++) {
+    for (size_t n = 0; n < N; n++) {
+      PH.at({n / W, k, n % W}) = weightAt(k, n);
+    }
+  }
+}
+
+/// Try to optimize a MatMul with a constant weight matrix into a
+/// target-specific MatMul that reads the weights pre-packed into panels. The
+/// default layout of the weights is KN, where K is the reduction dimension and
+/// N is the number of output columns. This optimization changes the layout to
+/// [ceil(N/16), K, 16] and zero-pads the last panel, so that the kernel
+/// streams each panel sequentially instead of packing the matrix at runtime.
+/// A transposed RHS, with the layout NK, is packed into the same panels.
+/// Unless \p onlyIfProfitable, the matrices narrower than a panel are packed
+/// too.
+static Node *packCPUMatMul(MatMulNode *MM, Function *F,
+                           bool onlyIfProfitable) {
+  auto *M = F->getParent();
+
+  // Half precision and bfloat16 weights keep their precision in the packed
+  // panels and are expanded to float by the kernel.
+  NodeValue RHS = MM->getRHS();
+  auto *convert = dyn_cast<ConvertToNode>(RHS);
+  if (convert && convert->hasOneUse()) {
+    RHS = convert->getInput();
+  }
+  Variable *weights = dyn_cast<Variable>(RHS);
+  if (!weights || weights->getNumUsers() != 1 || !weights->isPrivate()) {
+    // Can't mutate the weights.
+    return nullptr;
+  }
+
+  // We only support float results with float, half precision or bfloat16
+  // weights.
+  ElemKind weightsKind = weights->getElementType();
+  if ((weightsKind != ElemKind::FloatTy && weightsKind != ElemKind::Float16Ty &&
+       weightsKind != ElemKind::BFloat16Ty) ||
+      MM->getResult().getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  // Narrow matrices do not fill a single panel.
+  auto dims = weights->dims();
+  bool transposed = MM->getTransposeRHS();
+  size_t K = transposed ? dims[1] : dims[0];
+  size_t N = transposed ? dims[0] : dims[1];
+  if (onlyIfProfitable && N < packedMatMulPanelWidth) {
+    return nullptr;
+  }
+
+  // Get a variable with the layout [ceil(N/16), K, 16], which the clones of
+  // F share.
+  auto *packedTy = getPackedWeightsType(M, weightsKind, K, N);
+  auto *packed = M->getDerivedVariable(
+      {weights}, packedTy,
+      transposed ? "cpu-packed-matmul-trans" : "cpu-packed-matmul",
+      [weightsKind, transposed, K, N](llvm::ArrayRef<Tensor *> srcs,
+                                      Tensor &T) {
+        if (weightsKind == ElemKind::Float16Ty) {
+          auto WH = srcs[0]->getHandle<float16_t>();
+          packWeights<float16_t>(T, K, N, [&](size_t k, size_t n) {
+            return transposed ? WH.at({n, k}) : WH.at({k, n});
+          });
+        } else if (weightsKind == ElemKind::BFloat16Ty) {
+          auto WH = srcs[0]->getHandle<bfloat16_t>();
+          packWeights<bfloat16_t>(T, K, N, [&](size_t k, size_t n) {
+            return transposed ? WH.at({n, k}) : WH.at({k, n});
+          });
+        } else {
+          auto WH = srcs[0]->getHandle();
+          packWeights(T, K, N, [&](size_t k, size_t n) {
+            return transposed ? WH.at({n, k}) : WH.at({k, n});
+          });
+        }
+        return true;
+      });
+
+  return F->addNode(new CPUPackedMatMulNode(MM->getName(),
+                                            MM->getResult().getType(),
+                                            MM->getLHS(), packed,
+                                            NoFusedActivation));
+}
+
+/// \returns the name of the algorithm of the tuning database for the float
+/// MatMul \p MM with constant weights, "generic" or "packed", or an empty
+/// string if the database does not know its shape.
+static std::string getTunedMatMulAlgorithm(MatMulNode *MM) {
+  if (MM->getResult().getElementType() != ElemKind::FloatTy ||
+      MM->getRHS().getElementType() != ElemKind::FloatTy ||
+      !isa<Variable>(MM->getRHS())) {
+    return "";
+  }
+  std::string key = "matmul,lhs=" + getDimsKey(MM->getLHS().dims()) +
+                    ",rhs=" + getDimsKey(MM->getRHS().dims());
+  if (MM->getTransposeRHS()) {
+    key += ",trans";
+  }
+  static const llvm::StringRef candidates[] = {"generic", "packed"};
+  return getTunedAlgorithm(
+      key, candidates, [MM](Function *TF, llvm::StringRef algorithm) {
+        auto *LHS = createTuningVariable(TF, MM->getLHS().getType(), "lhs",
+                                         VisibilityKind::Public);
+        auto *RHS = createTuningVariable(TF, MM->getRHS().getType(), "rhs",
+                                         VisibilityKind::Private);
+        auto *outTy = TF->getParent()->uniqueType(*MM->getResult().getType());
+        auto *TMM = TF->createMatMul("matmul", outTy, LHS, RHS,
+                                     MM->getTransposeRHS());
+        if (algorithm == "generic") {
+          return TMM->getResult();
+        }
+        Node *N = packCPUMatMul(TMM, TF, /* onlyIfProfitable */ false);
+        return N ? N->getNthResult(0) : NodeValue();
+      });
+}
+
+/// Replace \p MM with the pre-packed MatMul if the tuning database says that
+/// it is faster for the shape of \p MM, or, if the shape is not in the
+/// database, if the weights fill at least one panel.
+static Node *optimizeCPUMatMul(MatMulNode *MM, Function *F) {
+  auto algorithm = getTunedMatMulAlgorithm(MM);
+  if (algorithm == "generic") {
+    return nullptr;
+  }
+  return packCPUMatMul(MM, F, /* onlyIfProfitable */ algorithm.empty());
+}
+
+/// \returns the number of non-zero elements of the float tensor \p T.
+static size_t countNonZeros(Tensor &T) {
+  auto TH = T.getHandle();
+  size_t nnz = 0;
+  for (size_t i = 0, e = TH.size(); i < e; i++) {
+    nnz += TH.raw(i) != 0;
+  }
+  return nnz;
+}
+
+/// Store the K x N float matrix \p weights in the compressed sparse column
+/// format into the arrays among \p values, \p rowIndices and \p colOffsets
+/// that are not null. \returns false if \p values or \p rowIndices do not have
+/// an element for each non-zero weight.
+static bool compressSparseColumns(Tensor &weights, Tensor *values,
+                                  Tensor *rowIndices, Tensor *colOffsets) {
+  size_t nnz = countNonZeros(weights);
+  if ((values && values->size() != nnz) ||
+      (rowIndices && rowIndices->size() != nnz)) {
+    return false;
+  }
+
+  auto WH = weights.getHandle();
+  size_t K = weights.dims()[0];
+  size_t N = weights.dims()[1];
+  size_t idx = 0;
+  for (size_t n = 0; n < N; n++) {
+    if (colOffsets) {
+      colOffsets->getHandle<int32_t>().at({n}) = idx;
+    }
+    for (size_t k = 0; k < K; k++) {
+      float w = WH.at({k, n});
+      if (w != 0) {
+        if (values) {
+          values->getHandle().at({idx}) = w;
+        }
+        if (rowIndices) {
+          rowIndices->getHandle<int32_t>().at({idx}) = k;
+        }
+        idx++;
+      }
+    }
+  }
+  if (colOffsets) {
+    colOffsets->getHandle<int32_t>().at({N}) = idx;
+  }
+  return true;
+}
+
+/// Try to optimize a MatMul with a mostly zero constant weight matrix, e.g.
+/// the one of a pruned FullyConnected layer, into a sparse-dense matrix
+/// multiplication. The K x N weights are stored in the compressed sparse column
+/// format: the non-zero values of each output column, their row indices, and
+/// the offset of every column in these arrays. Below the threshold the dense
+/// pre-packed kernel is faster, because the sparse kernel gathers the LHS
+/// values that it multiplies and reads an index for every weight.
+static Node *optimizeCPUSparseMatMul(MatMulNode *MM, Function *F) {
+  auto *M = F->getParent();
+
+  // The columns are compressed from the KN layout.
+  if (MM->getTransposeRHS()) {
+    return nullptr;
+  }
+
+  Variable *weights = dyn_cast<Variable>(MM->getRHS());
+  if (!weights || weights->getNumUsers() != 1 || !weights->isPrivate()) {
+    // Can't mutate the weights.
+    return nullptr;
+  }
+
+  // We only support Floats for now.
+  if (weights->getElementType() != ElemKind::FloatTy ||
+      MM->getResult().getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  auto dims = weights->dims();
+  size_t K = dims[0];
+  size_t N = dims[1];
+  size_t nnz = countNonZeros(weights->getPayload());
+  if (nnz == 0 || nnz > std::numeric_limits<int32_t>::max() ||
+      float(K * N - nnz) <= cpuSparseMatMulThreshold * float(K * N)) {
+    return nullptr;
+  }
+
+  // The sizes of the arrays depend on the number of non-zero values, so new
+  // weights can only replace these ones if they have as many.
+  auto *values = M->getDerivedVariable(
+      {weights}, M->uniqueType(ElemKind::FloatTy, {nnz}), "cpu-sparse-values",
+      [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        return compressSparseColumns(*srcs[0], &T, nullptr, nullptr);
+      });
+  auto *rowIndices = M->getDerivedVariable(
+      {weights}, M->uniqueType(ElemKind::Int32QTy, {nnz}, 1.0, 0),
+      "cpu-sparse-rows", [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        return compressSparseColumns(*srcs[0], nullptr, &T, nullptr);
+      });
+  auto *colOffsets = M->getDerivedVariable(
+      {weights}, M->uniqueType(ElemKind::Int32QTy, {N + 1}, 1.0, 0),
+      "cpu-sparse-columns", [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        return compressSparseColumns(*srcs[0], nullptr, nullptr, &T);
+      });
+
+  return F->addNode(new CPUSparseMatMulNode(
+      MM->getName(), MM->getResult().getType(), MM->getLHS(), values,
+      rowIndices, colOffsets, NoFusedActivation));
+}
+
+/// Number of consecutive values of the reduction dimension that are
+/// interleaved for each column of a pre-packed int8 weight matrix. This must
+/// match the libjit_matmul_packed_panels_i8 kernels.
+static constexpr size_t packedQuantizedMatMulDepth = 4;
+
+/// Pack the K x N int8 matrix \p weights into \p packed, with the layout
+/// [ceil(N/16), ceil(K/4), 16 * 4], and store the sums of its columns into
+/// \p colSums. Either of them may be null.
+static void packQuantizedWeights(Tensor &weights, Tensor *packed,
+                                 Tensor *colSums) {
+  size_t K = weights.dims()[0];
+  size_t N = weights.dims()[1];
+  size_t W = packedMatMulPanelWidth;
+  size_t D = packedQuantizedMatMulDepth;
+  auto WH = weights.getHandle<int8_t>();
+  if (packed) {
+    packed->zero();
+    auto PH = packed->getHandle<int8_t>();
+    for (size_t k = 0; k < K; k++) {
+      for (size_t n = 0; n < N; n++) {
+        PH.at({n / W, k / D, (n % W) * D + k % D}) = WH.at({k, n});
+      }
+    }
+  }
+  if (colSums) {
+    colSums->zero();
+    auto CH = colSums->getHandle<int32_t>();
+    for (size_t k = 0; k < K; k++) {
+      for (size_t n = 0; n < N; n++) {
+        CH.at({n}) += WH.at({k, n});
+      }
+    }
+  }
+}
+
+/// Try to optimize a quantized MatMul with a constant int8 weight matrix into a
+/// target-specific MatMul that reads the weights pre-packed into panels of 16
+/// columns. Within a panel, the 4 consecutive values of the reduction
+/// dimension of each column are adjacent, which is the operand layout of the
+/// 4-way int8 dot-product instructions. The layout is
+/// [ceil(N/16), ceil(K/4), 16 * 4], zero-padded. The sums of the columns of the
+/// weights are precomputed so that the kernel can apply the offsets after the
+/// multiplication.
+static Node *optimizeCPUQuantizedMatMul(MatMulNode *MM, Function *F) {
+  auto *M = F->getParent();
+
+  // The panels are packed from the KN layout.
+  if (MM->getTransposeRHS()) {
+    return nullptr;
+  }
+
+  Variable *weights = dyn_cast<Variable>(MM->getRHS());
+  if (!weights || weights->getNumUsers() != 1 || !weights->isPrivate()) {
+    // Can't mutate the weights.
+    return nullptr;
+  }
+
+  if (weights->getElementType() != ElemKind::Int8QTy ||
+      MM->getLHS().getElementType() != ElemKind::Int8QTy ||
+      MM->getResult().getElementType() != ElemKind::Int8QTy) {
+    return nullptr;
+  }
+
+  // Narrow matrices do not fill a single panel.
+  auto dims = weights->dims();
+  size_t K = dims[0];
+  size_t N = dims[1];
+  size_t W = packedMatMulPanelWidth;
+  size_t D = packedQuantizedMatMulDepth;
+  if (N < W) {
+    return nullptr;
+  }
+
+  size_t numPanels = (N + W - 1) / W;
+  size_t numGroups = (K + D - 1) / D;
+  auto *weightsTy = weights->getType();
+  auto *packed = M->getDerivedVariable(
+      {weights},
+      M->uniqueType(ElemKind::Int8QTy, {numPanels, numGroups, W * D},
+                    weightsTy->getScale(), weightsTy->getOffset()),
+      "cpu-packed-matmul-i8", [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        packQuantizedWeights(*srcs[0], &T, nullptr);
+        return true;
+      });
+  auto *colSums = M->getDerivedVariable(
+      {weights}, M->uniqueType(ElemKind::Int32QTy, {numPanels * W}, 1.0, 0),
+      "cpu-packed-matmul-i8-sums",
+      [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        packQuantizedWeights(*srcs[0], nullptr, &T);
+        return true;
+      });
+
+  return F->addNode(new CPUQuantizedPackedMatMulNode(
+      MM->getName(), MM->getResult().getType(), MM->getLHS(), packed, colSums));
+}
+
+/// Replace the float MatMul \p MM of a 2D transpose with
+/// CPUTransposedLHSMatMul, which reads the operand of the transpose in place.
+/// This is the weight gradient of a FullyConnected, whose bias gradient is the
+/// BatchedReduceAdd of the RHS over the batch, so such a reduction is replaced
+/// with the column sums that the node computes while it packs the RHS.
+static Node *optimizeCPUTransposedLHSMatMul(MatMulNode *MM, Function *F) {
+  auto *TN = dyn_cast<TransposeNode>(MM->getLHS());
+  if (MM->getTransposeRHS() || !TN || TN->getShuffle().size() != 2 ||
+      TN->getShuffle()[0] != 1 ||
+      MM->getResult().getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+  NodeValue rhs = MM->getRHS();
+  auto *colSumsTy = F->getParent()->uniqueTypeWithNewShape(
+      rhs.getType(), {rhs.dims()[1]});
+  auto *TMM = F->addNode(
+      new CPUTransposedLHSMatMulNode(MM->getName(), MM->getResult().getType(),
+                                     colSumsTy, TN->getInput(), rhs));
+  if (MM->hasPredicate()) {
+    TMM->setPredicate(MM->getPredicate());
+  }
+  for (auto &U : rhs.getUsers()) {
+    auto *BRA = dyn_cast<BatchedReduceAddNode>(U.getUser());
+    if (BRA && BRA->getParent() == F && BRA->getBatch() == rhs &&
+        BRA->getAxis() == 0 && BRA->getResult().getType() == colSumsTy &&
+        BRA->getPredicate() == MM->getPredicate()) {
+      BRA->getResult().replaceAllUsesOfWith(TMM->getRHSColSums());
+    }
+  }
+  return TMM;
+}
+
+/// \returns the \p numCodes centroids, in increasing order, that the k-means
+/// algorithm finds for the values of the float tensor \p weights. If the
+/// tensor has at most \p numCodes distinct values, they are the centroids,
+/// and the clustering is exact. Otherwise the centroids start evenly spread
+/// between the smallest and the largest value, which keeps some of them on
+/// the rare large weights. The values are sorted once, so that every
+/// iteration assigns them to the clusters in a single pass.
+static std::vector<float> clusterWeights(Tensor &weights, size_t numCodes) {
+  constexpr unsigned maxIterations = 32;
+  auto WH = weights.getHandle();
+  std::vector<float> values(WH.size());
+  for (size_t i = 0, e = WH.size(); i < e; i++) {
+    values[i] = WH.raw(i);
+  }
+  std::sort(values.begin(), values.end());
+
+  std::vector<float> centroids;
+  for (float v : values) {
+    if (centroids.empty() || v != centroids.back()) {
+      centroids.push_back(v);
+    }
+    if (centroids.size() > numCodes) {
+      break;
+    }
+  }
+  if (centroids.size() <= numCodes) {
+    // The unused codes repeat the largest value.
+    centroids.resize(numCodes, centroids.empty() ? 0 : centroids.back());
+    return centroids;
+  }
+
+  float lo = values.front();
+  float hi = values.back();
+  for (size_t c = 0; c < numCodes; c++) {
+    centroids[c] = lo + (hi - lo) * c / (numCodes - 1);
+  }
+  centroids.resize(numCodes);
+  for (unsigned iter = 0; iter < maxIterations; iter++) {
+    // The values between the midpoints of two neighbouring centroids belong
+    // to the cluster of the first one.
+    std::vector<double> sums(numCodes, 0);
+    std::vector<size_t> counts(numCodes, 0);
+    size_t c = 0;
+    for (float v : values) {
+      while (c + 1 < numCodes && v > (centroids[c] + centroids[c + 1]) / 2) {
+        c++;
+      }
+      sums[c] += v;
+      counts[c]++;
+    }
+    bool changed = false;
+    for (c = 0; c < numCodes; c++) {
+      // An empty cluster keeps its centroid.
+      float mean = counts[c] ? float(sums[c] / counts[c]) : centroids[c];
+      changed |= mean != centroids[c];
+      centroids[c] = mean;
+    }
+    std::sort(centroids.begin(), centroids.end());
+    if (!changed) {
+      break;
+    }
+  }
+  return centroids;
+}
+
+/// Store into \p codes the indices of the centroids of \p codebook that are
+/// the closest to the elements of the \p rows rows of \p lineSize weights
+/// given by \p weightAt(row, i). \p codes has a row of
+/// ceil(lineSize * codeBits / 8) bytes for every row of weights, with the
+/// layout of libjit_decode_clustered_row().
+template <typename FnTy>
+static void encodeClusteredWeights(Tensor &codes,
+                                   llvm::ArrayRef<float> codebook,
+                                   unsigned codeBits, size_t rows,
+                                   size_t lineSize, FnTy weightAt) {
+  std::vector<float> midpoints;
+  for (size_t c = 0; c + 1 < codebook.size(); c++) {
+    midpoints.push_back((codebook[c] + codebook[c + 1]) / 2);
+  }
+  codes.zero();
+  auto CH = codes.getHandle<int8_t>();
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t i = 0; i < lineSize; i++) {
+      float w = weightAt(r, i);
+      uint8_t code =
+          std::lower_bound(midpoints.begin(), midpoints.end(), w) -
+          midpoints.begin();
+      if (codeBits == 8) {
+        CH.at({r, i}) = code;
+      } else {
+        int8_t &byte = CH.at({r, i / 2});
+        byte |= code << (i % 2 ? 4 : 0);
+      }
+    }
+  }
+}
+
+/// \returns the codebook and the codes of the weights \p weights, which are
+/// clustered with indices of \p codeBits bits, see clusterCPUWeights(). The
+/// codes have \p rows rows of \p lineSize weights, given by
+/// \p weightAt(weights, row, i). \p recipe names the layout of the rows.
+template <typename FnTy>
+static std::pair<Variable *, Variable *>
+getClusteredWeights(Module *M, Variable *weights, unsigned codeBits,
+                    size_t rows, size_t lineSize, llvm::StringRef recipe,
+                    FnTy weightAt) {
+  size_t numCodes = size_t(1) << codeBits;
+  std::string bits = std::to_string(codeBits);
+  auto *codebook = M->getDerivedVariable(
+      {weights}, M->uniqueType(ElemKind::FloatTy, {numCodes}),
+      "cpu-clustered-codebook" + bits,
+      [numCodes](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        auto centroids = clusterWeights(*srcs[0], numCodes);
+        auto TH = T.getHandle();
+        for (size_t c = 0; c < numCodes; c++) {
+          TH.raw(c) = centroids[c];
+        }
+        return true;
+      });
+  auto *codes = M->getDerivedVariable(
+      {weights},
+      M->uniqueType(ElemKind::Int8QTy, {rows, (lineSize * codeBits + 7) / 8},
+                    1.0, 0),
+      recipe.str() + bits,
+      [=](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        auto centroids = clusterWeights(*srcs[0], numCodes);
+        auto WH = srcs[0]->getHandle();
+        encodeClusteredWeights(T, centroids, codeBits, rows, lineSize,
+                               [&](size_t r, size_t i) {
+                                 return weightAt(WH, r, i);
+                               });
+        return true;
+      });
+  return {codebook, codes};
+}
+
+/// \returns the float weights \p V if clusterCPUWeights() may replace them,
+/// i.e. if they are constant, have at least \p minWeights elements and a
+/// single user, or null otherwise.
+static Variable *getClusterableWeights(NodeValue V, size_t minWeights) {
+  auto *weights = dyn_cast<Variable>(V);
+  if (!weights || weights->getNumUsers() != 1 || !weights->isPrivate()) {
+    // Can't mutate the weights.
+    return nullptr;
+  }
+  if (weights->getElementType() != ElemKind::FloatTy ||
+      weights->getType()->size() < minWeights) {
+    return nullptr;
+  }
+  return weights;
+}
+
+/// Replace the MatMuls and the SparseLengthsWeightedSums of \p F with
+/// constant float weights of at least \p minWeights elements by kernels that
+/// read them clustered into a codebook of 2^\p codeBits centroids, see
+/// CPUBackend::setWeightClustering(). \returns true if any node was replaced.
+static bool clusterCPUWeights(Function *F, unsigned codeBits,
+                              size_t minWeights) {
+  auto *M = F->getParent();
+  std::vector<Node *> candidates;
+  for (auto &N : F->getNodes()) {
+    if (isa<MatMulNode>(&N) || isa<SparseLengthsWeightedSumNode>(&N)) {
+      candidates.push_back(&N);
+    }
+  }
+
+  bool changed = false;
+  for (auto *node : candidates) {
+    Node *clustered = nullptr;
+    if (auto *MM = dyn_cast<MatMulNode>(node)) {
+      auto *weights = getClusterableWeights(MM->getRHS(), minWeights);
+      if (!weights || MM->getResult().getElementType() != ElemKind::FloatTy) {
+        continue;
+      }
+      // Every column of the weights is a row of codes.
+      bool transposed = MM->getTransposeRHS();
+      auto dims = weights->dims();
+      size_t K = transposed ? dims[1] : dims[0];
+      size_t N = transposed ? dims[0] : dims[1];
+      auto CW = getClusteredWeights(
+          M, weights, codeBits, N, K,
+          transposed ? "cpu-clustered-matmul-trans" : "cpu-clustered-matmul",
+          [transposed](Handle<float> &WH, size_t n, size_t k) {
+            return transposed ? WH.at({n, k}) : WH.at({k, n});
+          });
+      clustered = F->addNode(new CPUClusteredMatMulNode(
+          MM->getName(), MM->getResult().getType(), MM->getLHS(), CW.first,
+          CW.second, codeBits, NoFusedActivation));
+    } else {
+      auto *SLWS = cast<SparseLengthsWeightedSumNode>(node);
+      auto *data = getClusterableWeights(SLWS->getData(), minWeights);
+      if (!data) {
+        continue;
+      }
+      size_t rows = data->dims()[0];
+      size_t lineSize = data->getType()->size() / rows;
+      auto CW = getClusteredWeights(
+          M, data, codeBits, rows, lineSize, "cpu-clustered-table",
+          [lineSize](Handle<float> &WH, size_t r, size_t i) {
+            return WH.raw(r * lineSize + i);
+          });
+      clustered = F->addNode(new CPUClusteredSparseLengthsWeightedSumNode(
+          SLWS->getName(), SLWS->getResult().getType(), CW.first, CW.second,
+          SLWS->getWeights(), SLWS->getIndices(), SLWS->getLengths(),
+          codeBits));
+    }
+    node->getNthResult(0).replaceAllUsesOfWith(clustered);
+    changed = true;
+  }
+  return changed;
+}
+
+/// The largest im2col matrix, in bytes, that we are willing to keep in the
+/// scratch area of the activations.
+static constexpr size_t maxIm2colScratchSize = 64 << 20;
+
+/// Try to optimize the Convolution into an im2col copy followed by a matrix
+/// multiplication with the pre-packed filter. The input patch of each output
+/// pixel becomes a row of a [pixels, K*K*C + 1] matrix in the scratch area,
+/// whose last column is 1. The DKKC filter is transposed and packed together
+/// with the bias, which makes up the last row, into the layout
+/// [ceil(D/16), K*K*C + 1, 16]. Unless \p onlyIfProfitable, the layers with
+/// little work per output pixel are transformed too.
+static Node *optimizeCPUIm2colConv(ConvolutionNode *CN, Function *F,
+                                   bool onlyIfProfitable = true) {
+  auto *M = F->getParent();
+
+  if (CN->getGroup() != 1) {
+    return nullptr;
+  }
+
+  Variable *filter = dyn_cast<Variable>(CN->getFilter());
+  if (!filter || !isOnlyConvFilter(filter) || !filter->isPrivate()) {
+    // Can't mutate the filter.
+    return nullptr;
+  }
+
+  // The bias is folded into the packed filter, so it must be constant.
+  Variable *bias = dyn_cast<Variable>(CN->getBias());
+  if (!bias || !bias->isPrivate()) {
+    return nullptr;
+  }
+
+  // We only support Floats for now.
+  if (filter->getElementType() != ElemKind::FloatTy ||
+      bias->getElementType() != ElemKind::FloatTy) {
+    return nullptr;
+  }
+
+  // The copy is only amortized when each output pixel has enough work and
+  // the output channels fill at least one panel.
+  ShapeNHWC idim(CN->getInput().dims());
+  ShapeNHWC odim(CN->getResult().dims());
+  ShapeHW kdim(CN->getKernels());
+  size_t rowSize = kdim.height * kdim.width * idim.c + 1;
+  if (onlyIfProfitable &&
+      (rowSize < 32 || odim.c < packedMatMulPanelWidth)) {
+    return nullptr;
+  }
+  if (odim.n * odim.h * odim.w * rowSize * sizeof(float) >
+      maxIm2colScratchSize) {
+    return nullptr;
+  }
+
+  size_t C = idim.c;
+  size_t KW = kdim.width;
+  size_t D = odim.c;
+  auto *packed = M->getDerivedVariable(
+      {filter, bias}, getPackedWeightsType(M, ElemKind::FloatTy, rowSize, D),
+      "cpu-im2col-filter",
+      [rowSize, C, KW, D](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        auto FH = srcs[0]->getHandle();
+        auto BH = srcs[1]->getHandle();
+        packWeights(T, rowSize, D, [&](size_t k, size_t d) {
+          if (k == rowSize - 1) {
+            return BH.at({d});
+          }
+          return FH.at({d, k / C / KW, k / C % KW, k % C});
+        });
+        return true;
+      });
+
+  return F->addNode(new CPUIm2colConvNode(
+      CN->getName(), CN->getResult().getType(), CN->getInput(), packed,
+      CN->getKernels(), CN->getStrides(), CN->getPads(), NoFusedActivation));
+}
+
+/// \returns the DKKC filter of a convolution \p filter viewed as a
+/// [K*K*C, D] matrix, whose rows follow the order of the values of the input
+/// patches of im2col.
+static Tensor getIm2colFilterMatrix(Tensor &filter) {
+  auto dims = filter.dims();
+  size_t D = dims[0];
+  size_t rowSize = dims[1] * dims[2] * dims[3];
+  auto &ty = filter.getType();
+  Tensor matrix(ElemKind::Int8QTy, {rowSize, D}, ty.getScale(), ty.getOffset());
+  auto FH = filter.getHandle<int8_t>();
+  auto MH = matrix.getHandle<int8_t>();
+  for (size_t d = 0; d < D; d++) {
+    for (size_t k = 0; k < rowSize; k++) {
+      MH.at({k, d}) = FH.raw(d * rowSize + k);
+    }
+  }
+  return matrix;
+}
+
+/// Try to optimize the quantized int8 Convolution \p CN into an im2col copy
+/// followed by the matrix multiplication of CPUQuantizedPackedMatMul. The
+/// input patches are copied into a [pixels, K*K*C] int8 matrix in the scratch
+/// area, padded with the offset of the input. The filter is packed like the
+/// weights of a quantized MatMul, and the bias is scaled at compile time to
+/// the int32 scale of the products, as libjit_convolution_i8 does it for
+/// every output pixel.
+static Node *optimizeCPUQuantizedIm2colConv(ConvolutionNode *CN, Function *F) {
+  auto *M = F->getParent();
+
+  if (CN->getGroup() != 1) {
+    return nullptr;
+  }
+
+  Variable *filter = dyn_cast<Variable>(CN->getFilter());
+  if (!filter || !isOnlyConvFilter(filter) || !filter->isPrivate()) {
+    // Can't mutate the filter.
+    return nullptr;
+  }
+  Variable *bias = dyn_cast<Variable>(CN->getBias());
+  if (!bias || !bias->isPrivate()) {
+    return nullptr;
+  }
+
+  if (CN->getInput().getElementType() != ElemKind::Int8QTy ||
+      filter->getElementType() != ElemKind::Int8QTy ||
+      bias->getElementType() != ElemKind::Int8QTy ||
+      CN->getResult().getElementType() != ElemKind::Int8QTy) {
+    return nullptr;
+  }
+
+  // The copy is only amortized when each output pixel has enough work and
+  // the output channels fill at least one panel.
+  ShapeNHWC idim(CN->getInput().dims());
+  ShapeNHWC odim(CN->getResult().dims());
+  ShapeHW kdim(CN->getKernels());
+  size_t rowSize = kdim.height * kdim.width * idim.c;
+  if (rowSize < 32 || odim.c < packedMatMulPanelWidth) {
+    return nullptr;
+  }
+  if (odim.n * odim.h * odim.w * rowSize > maxIm2colScratchSize) {
+    return nullptr;
+  }
+
+  size_t W = packedMatMulPanelWidth;
+  size_t D = packedQuantizedMatMulDepth;
+  size_t numPanels = (odim.c + W - 1) / W;
+  size_t numGroups = (rowSize + D - 1) / D;
+  auto *filterTy = filter->getType();
+  auto *packed = M->getDerivedVariable(
+      {filter},
+      M->uniqueType(ElemKind::Int8QTy, {numPanels, numGroups, W * D},
+                    filterTy->getScale(), filterTy->getOffset()),
+      "cpu-im2col-filter-i8", [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        Tensor matrix = getIm2colFilterMatrix(*srcs[0]);
+        packQuantizedWeights(matrix, &T, nullptr);
+        return true;
+      });
+  auto *colSums = M->getDerivedVariable(
+      {filter}, M->uniqueType(ElemKind::Int32QTy, {numPanels * W}, 1.0, 0),
+      "cpu-im2col-filter-i8-sums",
+      [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+        Tensor matrix = getIm2colFilterMatrix(*srcs[0]);
+        packQuantizedWeights(matrix, nullptr, &T);
+        return true;
+      });
+
+  // Scale the bias like libjit_convolution_i8, so that the results are the
+  // same.
+  float matMulScale = CN->getInput().getType()->getScale() *
+                      filterTy->getScale();
+  auto *biasTy = bias->getType();
+  auto biasScale = quantization::quantizeScaleOffset32To8(
+      biasTy->getScale() / matMulScale, biasTy->getOffset());
+  int32_t pre = biasScale.pre;
+  int32_t post = biasScale.post;
+  int32_t scale = biasScale.scale;
+  int32_t biasOffset = biasTy->getOffset();
+  std::string recipe = "cpu-im2col-bias-i8:" + std::to_string(pre) + "," +
+                       std::to_string(post) + "," + std::to_string(scale);
+  auto *scaledBias = M->getDerivedVariable(
+      {bias},
+      M->uniqueType(ElemKind::Int32QTy, {numPanels * W}, matMulScale, 0),
+      recipe,
+      [pre, post, scale, biasOffset](llvm::ArrayRef<Tensor *> srcs,
+                                     Tensor &T) {
+        T.zero();
+        auto BH = srcs[0]->getHandle<int8_t>();
+        auto TH = T.getHandle<int32_t>();
+        int32_t rtn = post > 0 ? (1 << (post - 1)) : 0;
+        for (size_t d = 0, e = BH.size(); d < e; d++) {
+          int32_t b = (int32_t)BH.raw(d) - biasOffset;
+          TH.raw(d) = (((b >> pre) * scale) + rtn) >> post;
+        }
+        return true;
+      });
+
+  return F->addNode(new CPUQuantizedIm2colConvNode(
+      CN->getName(), CN->getResult().getType(), CN->getInput(), packed,
+      colSums, scaledBias, CN->getKernels(), CN->getStrides(),
+      CN->getPads()));
+}
+
+/// Replace \p CN with the convolution algorithm named \p algorithm. The
+/// algorithms are applied even if their heuristics say that they are not
+/// profitable. \returns nullptr if the algorithm is the generic "direct"
+/// convolution or if it can't implement \p CN.
+static Node *applyConvAlgorithm(ConvolutionNode *CN, Function *F,
+                                llvm::StringRef algorithm) {
+  if (algorithm == "winograd") {
+    return optimizeCPUWinogradConv(CN, F, /* onlyIfProfitable */ false);
+  }
+  if (algorithm == "dkkc8") {
+    return optimizeCPUConv(CN, F);
+  }
+  if (algorithm == "im2col") {
+    return optimizeCPUIm2colConv(CN, F, /* onlyIfProfitable */ false);
+  }
+  return nullptr;
+}
+
+/// \returns the name of the algorithm of the tuning database for the float
+/// convolution \p CN, or an empty string if the database does not know its
+/// shape.
+static std::string getTunedConvAlgorithm(ConvolutionNode *CN) {
+  if (CN->getResult().getElementType() != ElemKind::FloatTy) {
+    return "";
+  }
+  std::string key = "conv,in=" + getDimsKey(CN->getInput().dims()) +
+                    ",filter=" + getDimsKey(CN->getFilter().dims()) +
+                    ",out=" + getDimsKey(CN->getResult().dims()) +
+                    ",strides=" + getDimsKey(CN->getStrides()) +
+                    ",pads=" + getDimsKey(CN->getPads()) +
+                    ",group=" + std::to_string(CN->getGroup());
+  static const llvm::StringRef candidates[] = {"direct", "winograd", "dkkc8",
+                                               "im2col"};
+  return getTunedAlgorithm(
+      key, candidates, [CN](Function *TF, llvm::StringRef algorithm) {
+        auto *input = createTuningVariable(TF, CN->getInput().getType(),
+                                           "input", VisibilityKind::Public);
+        auto *filter = createTuningVariable(TF, CN->getFilter().getType(),
+                                            "filter", VisibilityKind::Private);
+        auto *bias = createTuningVariable(TF, CN->getBias().getType(), "bias",
+                                          VisibilityKind::Private);
+        auto *outTy = TF->getParent()->uniqueType(*CN->getResult().getType());
+        auto *TCN = TF->addNode(new ConvolutionNode(
+            "conv", outTy, input, filter, bias, CN->getKernels(),
+            CN->getStrides(), CN->getPads(), CN->getGroup()));
+        if (algorithm == "direct") {
+          return TCN->getResult();
+        }
+        Node *N = applyConvAlgorithm(TCN, TF, algorithm);
+        return N ? N->getNthResult(0) : NodeValue();
+      });
+}
+
+/// Pick a convolution algorithm for \p CN, with the tuning database if it
+/// knows the shape of \p CN and based on its shape otherwise, and replace the
+/// generic convolution with it. \returns nullptr if the generic direct
+/// convolution should be kept.
+static Node *optimizeCPUConvolution(ConvolutionNode *CN, Function *F) {
+  // The quantized convolutions only have the im2col algorithm.
+  if (CN->getResult().getElementType() == ElemKind::Int8QTy) {
+    return optimizeCPUQuantizedIm2colConv(CN, F);
+  }
+  auto algorithm = getTunedConvAlgorithm(CN);
+  if (algorithm == "direct") {
+    return nullptr;
+  }
+  // The tuned algorithm may not apply to this layer, e.g. if its filter is
+  // not constant, in which case the heuristics pick another one.
+  if (!algorithm.empty()) {
+    if (Node *N = applyConvAlgorithm(CN, F, algorithm)) {
+      return N;
+    }
+  }
+  // The Winograd convolution needs the fewest multiplications for the 3x3
+  // stride-1 layers with many channels.
+  if (Node *N = optimizeCPUWinogradConv(CN, F)) {
+    return N;
+  }
+  // The DKKC8 direct convolution is tuned for the layers whose output depth
+  // per group is a multiple of 64. Its blocks of 8 output channels take two
+  // NEON registers each, so ARM targets multiply the matrices of im2col
+  // instead, with the GEMM kernels that are blocked for NEON.
+  if (!isCPUTargetARM()) {
+    if (Node *N = optimizeCPUConv(CN, F)) {
+      return N;
+    }
+  }
+  // Everything else that has enough work per output pixel is faster as a
+  // matrix multiplication than with the naive direct loop.
+  return optimizeCPUIm2colConv(CN, F);
 }
 
 /// Merge Max and Splat nodes into target-specific CPUMaxSplat node.
@@ -113,28 +1133,468 @@ static Node *optimizeCPUMaxSplat(MaxNode *MN, Function *F) {
       new CPUMaxSplatNode(MN->getName(), input, splat->getValue()));
 }
 
-bool CPUBackend::transformPostLowering(Function *F,
-                                       CompilationMode mode) const {
-  bool changed = false;
-  for (auto &node : F->getNodes()) {
-    // Try to replace generic convolution with cpu-optimized version.
-    if (auto *CN = dyn_cast<ConvolutionNode>(&node)) {
-      if (Node *NCN = optimizeCPUConv(CN, F)) {
-        NodeValue(&node, 0).replaceAllUsesOfWith(NCN);
-        changed = true;
-        continue;
-      }
+/// \returns the activation that \p N computes on its input \p input, or
+/// NoFusedActivation if \p N is not an activation that the CPU kernels can
+/// fuse. A ReLU is lowered to a max with a zero Splat.
+static FusedActivationKind getFusibleActivation(Node *N, NodeValue &input) {
+  if (auto *MN = dyn_cast<MaxNode>(N)) {
+    SplatNode *splat;
+    if ((splat = dyn_cast<SplatNode>(MN->getLHS()))) {
+      input = MN->getRHS();
+    } else if ((splat = dyn_cast<SplatNode>(MN->getRHS()))) {
+      input = MN->getLHS();
+    } else {
+      return NoFusedActivation;
     }
+    return splat->getValue() == 0 ? FusedRelu : NoFusedActivation;
+  }
+  if (auto *SN = dyn_cast<SigmoidNode>(N)) {
+    input = SN->getInput();
+    return FusedSigmoid;
+  }
+  if (auto *TN = dyn_cast<TanhNode>(N)) {
+    input = TN->getInput();
+    return FusedTanh;
+  }
+  return NoFusedActivation;
+}
 
-    // Merge Max and Splat nodes into CPUMaxSplat.
-    if (auto *MN = dyn_cast<MaxNode>(&node)) {
-      if (Node *MSN = optimizeCPUMaxSplat(MN, F)) {
-        NodeValue(&node, 0).replaceAllUsesOfWith(MSN);
-        changed = true;
-        continue;
+/// Fuse the activation that \p N computes into the cpu-specific convolution
+/// or matrix multiplication that produces its input. The activation is then
+/// applied by the output loop of the kernel while the results are still in
+/// the cache, instead of by a separate pass over the whole output tensor.
+static Node *fuseCPUActivation(Node *N, Function *F) {
+  NodeValue input;
+  FusedActivationKind activation = getFusibleActivation(N, input);
+  if (activation == NoFusedActivation ||
+      input.getType() != N->getNthResult(0).getType()) {
+    return nullptr;
+  }
+
+  // The producer must not have other users that need the value before the
+  // activation.
+  Node *P = input.getNode();
+  if (P->getNumUsers() != 1) {
+    return nullptr;
+  }
+
+  if (auto *C = dyn_cast<CPUConvDKKC8Node>(P)) {
+    if (C->getFusedActivation() != NoFusedActivation) {
+      return nullptr;
+    }
+    return F->addNode(new CPUConvDKKC8Node(
+        C->getName(), C->getResult().getType(), C->getInput(), C->getFilter(),
+        C->getBias(), C->getKernels(), C->getStrides(), C->getPads(),
+        C->getGroup(), activation));
+  }
+
+  if (auto *C = dyn_cast<CPUWinogradConvNode>(P)) {
+    if (C->getFusedActivation() != NoFusedActivation) {
+      return nullptr;
+    }
+    return F->addNode(new CPUWinogradConvNode(
+        C->getName(), C->getResult().getType(), C->getInput(), C->getFilter(),
+        C->getBias(), C->getPads(), C->getTileSize(), activation));
+  }
+
+  if (auto *C = dyn_cast<CPUIm2colConvNode>(P)) {
+    if (C->getFusedActivation() != NoFusedActivation) {
+      return nullptr;
+    }
+    return F->addNode(new CPUIm2colConvNode(
+        C->getName(), C->getResult().getType(), C->getInput(), C->getFilter(),
+        C->getKernels(), C->getStrides(), C->getPads(), activation));
+  }
+
+  if (auto *MM = dyn_cast<CPUPackedMatMulNode>(P)) {
+    if (MM->getFusedActivation() != NoFusedActivation) {
+      return nullptr;
+    }
+    return F->addNode(new CPUPackedMatMulNode(MM->getName(),
+                                              MM->getResult().getType(),
+                                              MM->getLHS(), MM->getRHS(),
+                                              activation));
+  }
+
+  if (auto *MM = dyn_cast<CPUClusteredMatMulNode>(P)) {
+    if (MM->getFusedActivation() != NoFusedActivation) {
+      return nullptr;
+    }
+    return F->addNode(new CPUClusteredMatMulNode(
+        MM->getName(), MM->getResult().getType(), MM->getLHS(),
+        MM->getCodebook(), MM->getCodes(), MM->getCodeBits(), activation));
+  }
+
+  if (auto *MM = dyn_cast<CPUSparseMatMulNode>(P)) {
+    if (MM->getFusedActivation() != NoFusedActivation) {
+      return nullptr;
+    }
+    return F->addNode(new CPUSparseMatMulNode(
+        MM->getName(), MM->getResult().getType(), MM->getLHS(),
+        MM->getValues(), MM->getRowIndices(), MM->getColOffsets(),
+        activation));
+  }
+
+  return nullptr;
+}
+
+/// \returns the rules that replace the generic nodes with the cpu-specific
+/// ones. The rules of a kind are tried in order.
+//===----------------------------------------------------------------------===//
+//                 Spatial tiling of chains of layers
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// A layer of a chain that is tiled along the height of its NHWC tensors.
+struct TiledLayer {
+  /// The node of the layer.
+  Node *node;
+  /// The input that comes from the previous layer of the chain, or that is
+  /// the input of the chain.
+  NodeValue input;
+  /// The window of the layer along the height. The element-wise layers have
+  /// a window of one row.
+  size_t kernel{1};
+  size_t stride{1};
+  size_t padTop{0};
+  size_t padBottom{0};
+};
+
+/// A range of rows of an NHWC tensor, which may extend beyond the tensor for
+/// the padding of a window.
+struct RowRange {
+  int64_t begin;
+  int64_t end;
+};
+} // namespace
+
+/// Set the window of \p layer along the height to \p kernels, \p strides and
+/// \p pads.
+static void setTiledWindow(TiledLayer &layer,
+                           llvm::ArrayRef<unsigned_t> kernels,
+                           llvm::ArrayRef<unsigned_t> strides,
+                           llvm::ArrayRef<unsigned_t> pads) {
+  PaddingTLBR pdim(pads);
+  layer.kernel = ShapeHW(kernels).height;
+  layer.stride = ShapeHW(strides).height;
+  layer.padTop = pdim.top;
+  layer.padBottom = pdim.bottom;
+}
+
+/// \returns true and describes \p N in \p layer if \p N can be a layer of a
+/// tiled chain: a convolution, a pool, a ReLU, a sigmoid or a tanh on NHWC
+/// tensors. Each output row of these layers only depends on a window of rows
+/// of their input.
+static bool getTiledLayer(Node *N, TiledLayer &layer) {
+  layer = TiledLayer();
+  layer.node = N;
+  if (auto *CN = dyn_cast<ConvolutionNode>(N)) {
+    layer.input = CN->getInput();
+    setTiledWindow(layer, CN->getKernels(), CN->getStrides(), CN->getPads());
+  } else if (auto *PN = dyn_cast<MaxPoolNode>(N)) {
+    layer.input = PN->getInput();
+    setTiledWindow(layer, PN->getKernels(), PN->getStrides(), PN->getPads());
+  } else if (auto *PN = dyn_cast<AvgPoolNode>(N)) {
+    layer.input = PN->getInput();
+    setTiledWindow(layer, PN->getKernels(), PN->getStrides(), PN->getPads());
+  } else if (auto *MN = dyn_cast<MaxNode>(N)) {
+    // A ReLU is lowered to a max with a zero Splat.
+    if (isa<SplatNode>(MN->getRHS())) {
+      layer.input = MN->getLHS();
+    } else if (isa<SplatNode>(MN->getLHS())) {
+      layer.input = MN->getRHS();
+    } else {
+      return false;
+    }
+  } else if (auto *SN = dyn_cast<SigmoidNode>(N)) {
+    layer.input = SN->getInput();
+  } else if (auto *TN = dyn_cast<TanhNode>(N)) {
+    layer.input = TN->getInput();
+  } else {
+    return false;
+  }
+  return N->getNumResults() == 1 && layer.input.dims().size() == 4 &&
+         N->getNthResult(0).dims().size() == 4;
+}
+
+/// \returns true if \p layer is a convolution or a pool.
+static bool isSpatialLayer(const TiledLayer &layer) {
+  return isa<ConvolutionNode>(layer.node) || isa<MaxPoolNode>(layer.node) ||
+         isa<AvgPoolNode>(layer.node);
+}
+
+/// \returns the chains of layers of \p F that can be tiled: the maximal
+/// sequences of layers whose results are only used by the next layer, with
+/// at least two convolutions or pools.
+static std::vector<std::vector<TiledLayer>> findTiledChains(Function *F) {
+  std::vector<std::vector<TiledLayer>> chains;
+  for (auto &N : F->getNodes()) {
+    TiledLayer layer;
+    if (!getTiledLayer(&N, layer)) {
+      continue;
+    }
+    // The layer continues the chain of its input.
+    TiledLayer prev;
+    if (getTiledLayer(layer.input.getNode(), prev) &&
+        layer.input.getNode()->hasOneUse()) {
+      continue;
+    }
+    std::vector<TiledLayer> chain{layer};
+    Node *cur = &N;
+    while (cur->hasOneUse()) {
+      Node *user = cur->getUsers().begin()->getUser();
+      TiledLayer next;
+      if (!getTiledLayer(user, next) || next.input.getNode() != cur) {
+        break;
       }
+      chain.push_back(next);
+      cur = user;
+    }
+    if (std::count_if(chain.begin(), chain.end(), isSpatialLayer) >= 2) {
+      chains.push_back(std::move(chain));
     }
   }
+  return chains;
+}
 
+/// \returns the rows of the input of \p layer that the output rows \p rows
+/// need, which extend beyond the input for the padding.
+static RowRange getInputRows(const TiledLayer &layer, RowRange rows) {
+  return {rows.begin * int64_t(layer.stride) - int64_t(layer.padTop),
+          (rows.end - 1) * int64_t(layer.stride) - int64_t(layer.padTop) +
+              int64_t(layer.kernel)};
+}
+
+/// \returns \p rows clamped to the \p height rows of a tensor.
+static RowRange clampRows(RowRange rows, size_t height) {
+  return {std::max<int64_t>(rows.begin, 0),
+          std::min<int64_t>(rows.end, height)};
+}
+
+/// Compute into \p rows the rows of the result of each layer of \p chain that
+/// the output rows \p outRows of the last layer need.
+static void getStripRows(llvm::ArrayRef<TiledLayer> chain, RowRange outRows,
+                         std::vector<RowRange> &rows) {
+  rows.resize(chain.size());
+  rows.back() = outRows;
+  for (size_t i = chain.size() - 1; i > 0; i--) {
+    rows[i - 1] = clampRows(getInputRows(chain[i], rows[i]),
+                            chain[i].input.dims()[1]);
+  }
+}
+
+/// \returns the output rows of the strip \p strip out of \p numStrips of a
+/// result with \p height rows.
+static RowRange getStripOutputRows(size_t strip, size_t numStrips,
+                                   size_t height) {
+  return {int64_t(height * strip / numStrips),
+          int64_t(height * (strip + 1) / numStrips)};
+}
+
+/// \returns the number of rows of all the layers of \p chain, but the last
+/// one, that \p numStrips strips compute, relative to the rows of the
+/// untiled layers. It is above 1 because of the rows that neighbouring strips
+/// both compute.
+static double getStripOverhead(llvm::ArrayRef<TiledLayer> chain,
+                               size_t numStrips) {
+  size_t height = chain.back().node->getNthResult(0).dims()[1];
+  size_t computed = 0;
+  size_t total = 0;
+  std::vector<RowRange> rows;
+  for (size_t s = 0; s < numStrips; s++) {
+    getStripRows(chain, getStripOutputRows(s, numStrips, height), rows);
+    for (size_t i = 0; i + 1 < chain.size(); i++) {
+      computed += rows[i].end - rows[i].begin;
+    }
+  }
+  for (size_t i = 0; i + 1 < chain.size(); i++) {
+    total += chain[i].node->getNthResult(0).dims()[1];
+  }
+  return total ? double(computed) / total : 1;
+}
+
+/// Create the copy of \p layer that reads the rows \p inRows of its input
+/// from \p input and computes the rows \p outRows of its result. \returns the
+/// result.
+static NodeValue createTiledLayer(Function *F, const TiledLayer &layer,
+                                  NodeValue input, RowRange inRows,
+                                  RowRange outRows) {
+  Module *M = F->getParent();
+  NodeValue result = layer.node->getNthResult(0);
+  llvm::SmallVector<size_t, 4> dims(result.dims().begin(),
+                                    result.dims().end());
+  dims[1] = outRows.end - outRows.begin;
+  TypeRef outTy = M->uniqueTypeWithNewShape(result.getType(), dims);
+
+  // The padding that remains is the one of the rows beyond the input.
+  RowRange needed = getInputRows(layer, outRows);
+  auto getPads = [&](llvm::ArrayRef<unsigned_t> pads) {
+    std::vector<unsigned_t> stripPads(pads.begin(), pads.end());
+    stripPads[0] = inRows.begin - needed.begin;
+    stripPads[2] = needed.end - inRows.end;
+    return stripPads;
+  };
+  std::string name = layer.node->getName().str() + "_tile";
+  if (auto *CN = dyn_cast<ConvolutionNode>(layer.node)) {
+    return F->addNode(new ConvolutionNode(
+        name, outTy, input, CN->getFilter(), CN->getBias(), CN->getKernels(),
+        CN->getStrides(), getPads(CN->getPads()), CN->getGroup()));
+  }
+  if (auto *PN = dyn_cast<MaxPoolNode>(layer.node)) {
+    return F->addNode(new MaxPoolNode(name, outTy, input, PN->getKernels(),
+                                      PN->getStrides(),
+                                      getPads(PN->getPads())));
+  }
+  if (auto *PN = dyn_cast<AvgPoolNode>(layer.node)) {
+    return F->addNode(new AvgPoolNode(name, outTy, input, PN->getKernels(),
+                                      PN->getStrides(),
+                                      getPads(PN->getPads())));
+  }
+  if (auto *MN = dyn_cast<MaxNode>(layer.node)) {
+    auto *splat = dyn_cast<SplatNode>(MN->getRHS());
+    if (!splat) {
+      splat = cast<SplatNode>(MN->getLHS());
+    }
+    auto *stripSplat = F->createSplat(
+        splat->getName(),
+        M->uniqueTypeWithNewShape(splat->getResult().getType(), dims),
+        splat->getValue());
+    return F->addNode(new MaxNode(name, outTy, input, stripSplat));
+  }
+  if (isa<SigmoidNode>(layer.node)) {
+    return F->createSigmoid(name, input);
+  }
+  return F->createTanh(name, input);
+}
+
+/// Split \p chain into \p numStrips horizontal strips of its output. Each
+/// strip slices the rows of the input of the chain that it needs, computes
+/// them through all the layers, and the strips of the output are
+/// concatenated. The intermediate results of a strip are only as large as
+/// the strip, so they stay in the cache from a layer to the next.
+static void tileChain(Function *F, llvm::ArrayRef<TiledLayer> chain,
+                      size_t numStrips) {
+  // The input may be the result of a chain that was tiled before.
+  TiledLayer first;
+  getTiledLayer(chain.front().node, first);
+  NodeValue chainInput = first.input;
+  NodeValue chainResult = chain.back().node->getNthResult(0);
+  auto inDims = chainInput.dims();
+  size_t height = chainResult.dims()[1];
+
+  std::vector<NodeValue> strips;
+  std::vector<RowRange> rows;
+  for (size_t s = 0; s < numStrips; s++) {
+    getStripRows(chain, getStripOutputRows(s, numStrips, height), rows);
+    RowRange inRows =
+        clampRows(getInputRows(chain.front(), rows.front()), inDims[1]);
+    NodeValue cur = F->createSlice(
+        chainInput.getNode()->getName().str() + "_tile", chainInput,
+        {0, size_t(inRows.begin), 0, 0},
+        {inDims[0], size_t(inRows.end), inDims[2], inDims[3]});
+    for (size_t i = 0; i < chain.size(); i++) {
+      cur = createTiledLayer(F, chain[i], cur, inRows, rows[i]);
+      inRows = rows[i];
+    }
+    strips.push_back(cur);
+  }
+
+  auto *concat = F->createConcat(chain.back().node->getName().str() + "_tiles",
+                                 strips, 1, chainResult.getType());
+  chainResult.replaceAllUsesOfWith(concat);
+  for (auto it = chain.rbegin(), e = chain.rend(); it != e; ++it) {
+    F->eraseNode(it->node);
+  }
+}
+
+/// Tile the chains of layers of \p F whose intermediate results are larger
+/// than \p cacheSize bytes, see CPUBackend::setSpatialTilingCacheSize().
+/// \returns true if a chain was tiled.
+static bool tileCPULayerChains(Function *F, size_t cacheSize) {
+  // The strips recompute the overlapping rows of the windows, which is only
+  // worth it while the overlap stays small.
+  constexpr double maxStripOverhead = 1.25;
+  // The strips of the outputs have at least that many rows.
+  constexpr size_t minStripRows = 2;
+  bool changed = false;
+  for (auto &chain : findTiledChains(F)) {
+    size_t intermediateSize = 0;
+    for (size_t i = 0; i + 1 < chain.size(); i++) {
+      intermediateSize +=
+          chain[i].node->getNthResult(0).getType()->getSizeInBytes();
+    }
+    if (intermediateSize <= cacheSize) {
+      continue;
+    }
+    size_t height = chain.back().node->getNthResult(0).dims()[1];
+    size_t numStrips = std::min((intermediateSize + cacheSize - 1) / cacheSize,
+                                height / minStripRows);
+    while (numStrips > 1 &&
+           getStripOverhead(chain, numStrips) > maxStripOverhead) {
+      numStrips--;
+    }
+    if (numStrips < 2) {
+      continue;
+    }
+    tileChain(F, chain, numStrips);
+    changed = true;
+  }
+  return changed;
+}
+
+static const RewriteRuleSet &getCPURewriteRules() {
+  static const RewriteRuleSet rules = [] {
+    RewriteRuleSet rules;
+    // Replace generic convolutions with the cpu-optimized versions.
+    rules.add<ConvolutionNode>(Kinded::Kind::ConvolutionNodeKind,
+                               "cpu-convolution", optimizeCPUConvolution);
+
+    // Replace MatMuls with constant weights with the sparse or the
+    // pre-packed version.
+    rules.add<MatMulNode>(Kinded::Kind::MatMulNodeKind, "cpu-sparse-matmul",
+                          optimizeCPUSparseMatMul);
+    rules.add<MatMulNode>(Kinded::Kind::MatMulNodeKind, "cpu-packed-matmul",
+                          optimizeCPUMatMul);
+    rules.add<MatMulNode>(Kinded::Kind::MatMulNodeKind,
+                          "cpu-quantized-matmul", optimizeCPUQuantizedMatMul);
+    // Read the transposed input of the weight gradient matmuls in place, and
+    // fuse the bias gradient into them.
+    rules.add<MatMulNode>(Kinded::Kind::MatMulNodeKind,
+                          "cpu-transposed-lhs-matmul",
+                          optimizeCPUTransposedLHSMatMul);
+
+    // Fuse activations into the convolution or matrix multiplication that
+    // produces their input.
+    rules.add<Node>(Kinded::Kind::MaxNodeKind, "cpu-fuse-relu",
+                    fuseCPUActivation);
+    rules.add<Node>(Kinded::Kind::SigmoidNodeKind, "cpu-fuse-sigmoid",
+                    fuseCPUActivation);
+    rules.add<Node>(Kinded::Kind::TanhNodeKind, "cpu-fuse-tanh",
+                    fuseCPUActivation);
+
+    // Merge Max and Splat nodes into CPUMaxSplat.
+    rules.add<MaxNode>(Kinded::Kind::MaxNodeKind, "cpu-max-splat",
+                       optimizeCPUMaxSplat);
+    return rules;
+  }();
+  return rules;
+}
+
+bool CPUBackend::transformPostLowering(Function *F,
+                                       CompilationMode mode) const {
+  // The layers are tiled before the convolutions are specialized, so that
+  // every strip gets the algorithm that suits its shape. The gradients refer
+  // to the results of the untiled layers, so only inference is tiled.
+  bool changed = false;
+  if (spatialTilingCacheSize_ && mode == CompilationMode::Infer) {
+    changed |= tileCPULayerChains(F, spatialTilingCacheSize_);
+  }
+  // The weights are clustered before the rewrite rules pack the remaining
+  // ones.
+  if (weightClusteringBits_ && mode == CompilationMode::Infer) {
+    changed |= clusterCPUWeights(F, weightClusteringBits_,
+                                 weightClusteringMinSize_);
+  }
+  changed |= getCPURewriteRules().apply(F);
   return changed;
 }
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -21,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "libjit_defs.h"
 
@@ -128,232 +130,291 @@ static size_t get_element_ptr(const ElemTy *tensor, const size_t *dims,
   return index;
 }
 
-template <typename ElemTy>
-void libjit_insert_tensor(ElemTy *tensor, ElemTy *slice, size_t *offset,
-                          size_t *tensorDim, size_t *sliceDim,
-                          size_t numDimsTensor, size_t numDimsSlice,
-                          size_t offsetDim, size_t count, size_t axis) {
-  // Destination coordinates.
-  size_t C[5];
+/// The maximum number of dimensions of a strided copy.
+#define LIBJIT_MAX_COPY_DIMS 6
 
-  // A local copy of the offsets buffer. We copy the buffer to make it clear
-  // to the optimizer that the inputs don't alias. This loop is optimized away.
-  size_t offsets_cpy[5];
-  for (size_t i = 0; i < numDimsSlice; i++) {
-    offsets_cpy[i] = offset[i];
-  }
-
-  if (numDimsSlice == 5) {
-    for (size_t c = 0; c < count; c++)
-      for (size_t x = 0; x < sliceDim[0]; x++)
-        for (size_t y = 0; y < sliceDim[1]; y++)
-          for (size_t z = 0; z < sliceDim[2]; z++)
-            for (size_t w = 0; w < sliceDim[3]; w++)
-              for (size_t q = 0; q < sliceDim[4]; q++) {
-                const size_t countAxisOffset = c * sliceDim[axis];
-                C[0] = x + offsets_cpy[0] + ((axis == 0) ? countAxisOffset : 0);
-                C[1] = y + offsets_cpy[1] + ((axis == 1) ? countAxisOffset : 0);
-                C[2] = z + offsets_cpy[2] + ((axis == 2) ? countAxisOffset : 0);
-                C[3] = w + offsets_cpy[3] + ((axis == 3) ? countAxisOffset : 0);
-                C[4] = q + offsets_cpy[4] + ((axis == 4) ? countAxisOffset : 0);
-                tensor[libjit_getXYZWQ(tensorDim, C[0], C[1], C[2], C[3],
-                                       C[4])] =
-                    slice[libjit_getXYZWQ(sliceDim, x, y, z, w, q)];
-              }
-    return;
-  }
+/// A dimension of a strided copy: its size and the distances, in elements,
+/// between its consecutive coordinates in the destination and in the source.
+struct libjit_strided_dim {
+  size_t size;
+  size_t destStride;
+  size_t srcStride;
+};
 
-  if (numDimsSlice == 4) {
-    for (size_t c = 0; c < count; c++)
-      for (size_t x = 0; x < sliceDim[0]; x++)
-        for (size_t y = 0; y < sliceDim[1]; y++)
-          for (size_t z = 0; z < sliceDim[2]; z++)
-            for (size_t w = 0; w < sliceDim[3]; w++) {
-              const size_t countAxisOffset = c * sliceDim[axis];
-              C[0] = x + offsets_cpy[0] + ((axis == 0) ? countAxisOffset : 0);
-              C[1] = y + offsets_cpy[1] + ((axis == 1) ? countAxisOffset : 0);
-              C[2] = z + offsets_cpy[2] + ((axis == 2) ? countAxisOffset : 0);
-              C[3] = w + offsets_cpy[3] + ((axis == 3) ? countAxisOffset : 0);
-              tensor[libjit_getXYZW(tensorDim, C[0], C[1], C[2], C[3])] =
-                  slice[libjit_getXYZW(sliceDim, x, y, z, w)];
-            }
-    return;
-  }
+/// The side, in bytes, of the tiles that transposed copies are split into. A
+/// tile of the destination and the matching tile of the source fit in L1.
+#define LIBJIT_COPY_TILE_BYTES 64
 
-  if (numDimsSlice == 3) {
-    for (size_t c = 0; c < count; c++)
-      for (size_t x = 0; x < sliceDim[0]; x++)
-        for (size_t y = 0; y < sliceDim[1]; y++)
-          for (size_t z = 0; z < sliceDim[2]; z++) {
-            const size_t countAxisOffset = c * sliceDim[axis];
-            C[0] = x + offsets_cpy[0] + ((axis == 0) ? countAxisOffset : 0);
-            C[1] = y + offsets_cpy[1] + ((axis == 1) ? countAxisOffset : 0);
-            C[2] = z + offsets_cpy[2] + ((axis == 2) ? countAxisOffset : 0);
-            tensor[libjit_getXYZ(tensorDim, C[0], C[1], C[2])] =
-                slice[libjit_getXYZ(sliceDim, x, y, z)];
-          }
+/// Copy the rows \p R by the columns \p C of \p src to \p dest. The copy is
+/// recursively split along its longer side until it fits in a tile, which
+/// keeps the accesses local at every level of the cache hierarchy.
+template <typename ElemTy>
+void libjit_copy_tiled(ElemTy *dest, const ElemTy *src,
+                       const libjit_strided_dim &R,
+                       const libjit_strided_dim &C, size_t rows,
+                       size_t cols) {
+  const size_t tile = LIBJIT_COPY_TILE_BYTES / sizeof(ElemTy);
+  if (rows <= tile && cols <= tile) {
+    for (size_t r = 0; r < rows; r++) {
+      for (size_t c = 0; c < cols; c++) {
+        dest[r * R.destStride + c * C.destStride] =
+            src[r * R.srcStride + c * C.srcStride];
+      }
+    }
     return;
   }
+  if (rows >= cols) {
+    size_t half = rows / 2;
+    libjit_copy_tiled(dest, src, R, C, half, cols);
+    libjit_copy_tiled(dest + half * R.destStride, src + half * R.srcStride, R,
+                      C, rows - half, cols);
+  } else {
+    size_t half = cols / 2;
+    libjit_copy_tiled(dest, src, R, C, rows, half);
+    libjit_copy_tiled(dest + half * C.destStride, src + half * C.srcStride, R,
+                      C, rows, cols - half);
+  }
+}
 
-  if (numDimsSlice == 2) {
-    for (size_t c = 0; c < count; c++)
-      for (size_t x = 0; x < sliceDim[0]; x++)
-        for (size_t y = 0; y < sliceDim[1]; y++) {
-          const size_t countAxisOffset = c * sliceDim[axis];
-          C[0] = x + offsets_cpy[0] + ((axis == 0) ? countAxisOffset : 0);
-          C[1] = y + offsets_cpy[1] + ((axis == 1) ? countAxisOffset : 0);
-          tensor[libjit_getXY(tensorDim, C[0], C[1])] =
-              slice[libjit_getXY(sliceDim, x, y)];
-        }
+/// Copy the region of the \p numDims normalized dimensions \p dims from
+/// \p src to \p dest.
+template <typename ElemTy>
+void libjit_copy_strided_impl(ElemTy *dest, const ElemTy *src,
+                              const libjit_strided_dim *dims, size_t numDims) {
+  const libjit_strided_dim &D = dims[0];
+  if (numDims == 1) {
+    if (D.destStride == 1 && D.srcStride == 1) {
+      memcpy(dest, src, D.size * sizeof(ElemTy));
+      return;
+    }
+    for (size_t i = 0; i < D.size; i++) {
+      dest[i * D.destStride] = src[i * D.srcStride];
+    }
     return;
   }
-
-  if (numDimsSlice == 1) {
-    for (size_t c = 0; c < count; c++)
-      for (size_t x = 0; x < sliceDim[0]; x++) {
-        const size_t countAxisOffset = c * sliceDim[axis];
-        tensor[x + offsets_cpy[0] + ((axis == 0) ? countAxisOffset : 0)] =
-            slice[x];
-      }
+  const libjit_strided_dim &inner = dims[1];
+  if (numDims == 2 && (inner.destStride != 1 || inner.srcStride != 1)) {
+    libjit_copy_tiled(dest, src, D, inner, D.size, inner.size);
     return;
   }
+  for (size_t i = 0; i < D.size; i++) {
+    libjit_copy_strided_impl(dest + i * D.destStride, src + i * D.srcStride,
+                             dims + 1, numDims - 1);
+  }
 }
 
+/// Copy the region of shape \p sizes from \p src to \p dest, where
+/// \p destStrides and \p srcStrides are the strides of the \p numDims
+/// dimensions in the two buffers. The dimensions of size one are dropped and
+/// the ones that are contiguous in both buffers are merged, so that the inner
+/// dimension is copied with memcpy whenever possible. If the inner dimension is
+/// contiguous in only one buffer, the dimension with the smallest stride in
+/// the other buffer is moved next to it, turning the copy into a transpose of
+/// tiles.
 template <typename ElemTy>
-void libjit_extract_tensor(ElemTy *tensor, ElemTy *slice, size_t *offset,
-                           size_t *tensorDim, size_t *sliceDim,
-                           size_t numDimsTensor, size_t numDimsSlice,
-                           size_t offsetDim) {
-  // Source coordinates.
-  size_t C[5];
-
-  // A local copy of the offsets buffer. We copy the buffer to make it clear
-  // to the optimizer that the inputs don't alias. This loop is optimized away.
-  size_t offsets_cpy[5];
-  for (size_t i = 0; i < numDimsSlice; i++) {
-    offsets_cpy[i] = offset[i];
-  }
-
-  if (numDimsSlice == 5) {
-    for (size_t x = 0; x < sliceDim[0]; x++)
-      for (size_t y = 0; y < sliceDim[1]; y++)
-        for (size_t z = 0; z < sliceDim[2]; z++)
-          for (size_t w = 0; w < sliceDim[3]; w++)
-            for (size_t q = 0; q < sliceDim[4]; q++) {
-              C[0] = x + offsets_cpy[0];
-              C[1] = y + offsets_cpy[1];
-              C[2] = z + offsets_cpy[2];
-              C[3] = w + offsets_cpy[3];
-              C[4] = q + offsets_cpy[4];
-              slice[libjit_getXYZWQ(sliceDim, x, y, z, w, q)] =
-                  tensor[libjit_getXYZWQ(tensorDim, C[0], C[1], C[2], C[3],
-                                         C[4])];
-            }
+void libjit_copy_strided(ElemTy *dest, const ElemTy *src, const size_t *sizes,
+                         const size_t *destStrides, const size_t *srcStrides,
+                         size_t numDims) {
+  libjit_strided_dim dims[LIBJIT_MAX_COPY_DIMS];
+  size_t n = 0;
+  for (size_t i = 0; i < numDims; i++) {
+    if (!sizes[i]) {
+      return;
+    }
+    if (sizes[i] == 1) {
+      continue;
+    }
+    if (n && dims[n - 1].destStride == destStrides[i] * sizes[i] &&
+        dims[n - 1].srcStride == srcStrides[i] * sizes[i]) {
+      dims[n - 1].size *= sizes[i];
+      dims[n - 1].destStride = destStrides[i];
+      dims[n - 1].srcStride = srcStrides[i];
+      continue;
+    }
+    dims[n++] = {sizes[i], destStrides[i], srcStrides[i]};
+  }
+  if (!n) {
+    *dest = *src;
     return;
   }
 
-  if (numDimsSlice == 4) {
-    for (size_t x = 0; x < sliceDim[0]; x++)
-      for (size_t y = 0; y < sliceDim[1]; y++)
-        for (size_t z = 0; z < sliceDim[2]; z++)
-          for (size_t w = 0; w < sliceDim[3]; w++) {
-            C[0] = x + offsets_cpy[0];
-            C[1] = y + offsets_cpy[1];
-            C[2] = z + offsets_cpy[2];
-            C[3] = w + offsets_cpy[3];
-            slice[libjit_getXYZW(sliceDim, x, y, z, w)] =
-                tensor[libjit_getXYZW(tensorDim, C[0], C[1], C[2], C[3])];
-          }
-    return;
+  const libjit_strided_dim inner = dims[n - 1];
+  bool destContiguous = inner.destStride == 1;
+  if (n > 2 && destContiguous != (inner.srcStride == 1)) {
+    size_t best = n - 2;
+    for (size_t i = 0; i < n - 1; i++) {
+      size_t stride = destContiguous ? dims[i].srcStride : dims[i].destStride;
+      size_t bestStride =
+          destContiguous ? dims[best].srcStride : dims[best].destStride;
+      if (stride < bestStride) {
+        best = i;
+      }
+    }
+    libjit_strided_dim moved = dims[best];
+    for (size_t i = best; i < n - 2; i++) {
+      dims[i] = dims[i + 1];
+    }
+    dims[n - 2] = moved;
   }
+  libjit_copy_strided_impl(dest, src, dims, n);
+}
 
-  if (numDimsSlice == 3) {
-    for (size_t x = 0; x < sliceDim[0]; x++)
-      for (size_t y = 0; y < sliceDim[1]; y++)
-        for (size_t z = 0; z < sliceDim[2]; z++) {
-          C[0] = x + offsets_cpy[0];
-          C[1] = y + offsets_cpy[1];
-          C[2] = z + offsets_cpy[2];
-          slice[libjit_getXYZ(sliceDim, x, y, z)] =
-              tensor[libjit_getXYZ(tensorDim, C[0], C[1], C[2])];
-        }
-    return;
+/// Compute the \p strides of the contiguous tensor of the \p numDims
+/// dimensions \p dims.
+inline void libjit_get_strides(size_t *strides, const size_t *dims,
+                               size_t numDims) {
+  for (size_t i = numDims, stride = 1; i > 0; i--) {
+    strides[i - 1] = stride;
+    stride *= dims[i - 1];
   }
+}
 
-  if (numDimsSlice == 2) {
-    for (size_t x = 0; x < sliceDim[0]; x++)
-      for (size_t y = 0; y < sliceDim[1]; y++) {
-        C[0] = x + offsets_cpy[0];
-        C[1] = y + offsets_cpy[1];
-        slice[libjit_getXY(sliceDim, x, y)] =
-            tensor[libjit_getXY(tensorDim, C[0], C[1])];
-      }
-    return;
+template <typename ElemTy>
+void libjit_insert_tensor(ElemTy *tensor, ElemTy *slice, size_t *offset,
+                          size_t *tensorDim, size_t *sliceDim,
+                          size_t numDimsTensor, size_t numDimsSlice,
+                          size_t offsetDim, size_t count, size_t axis) {
+  size_t tensorStrides[LIBJIT_MAX_COPY_DIMS];
+  size_t sliceStrides[LIBJIT_MAX_COPY_DIMS];
+  libjit_get_strides(tensorStrides, tensorDim, numDimsTensor);
+  libjit_get_strides(sliceStrides, sliceDim, numDimsSlice);
+  size_t base = 0;
+  for (size_t i = 0; i < numDimsSlice; i++) {
+    base += offset[i] * tensorStrides[i];
+  }
+  size_t countStride = sliceDim[axis] * tensorStrides[axis];
+  for (size_t c = 0; c < count; c++) {
+    libjit_copy_strided(tensor + base + c * countStride, slice, sliceDim,
+                        tensorStrides, sliceStrides, numDimsSlice);
   }
+}
 
-  if (numDimsSlice == 1) {
-    for (size_t x = 0; x < sliceDim[0]; x++) {
-      slice[x] = tensor[x + offsets_cpy[0]];
-    }
-    return;
+template <typename ElemTy>
+void libjit_extract_tensor(ElemTy *tensor, ElemTy *slice, size_t *offset,
+                           size_t *tensorDim, size_t *sliceDim,
+                           size_t numDimsTensor, size_t numDimsSlice,
+                           size_t offsetDim) {
+  size_t tensorStrides[LIBJIT_MAX_COPY_DIMS];
+  size_t sliceStrides[LIBJIT_MAX_COPY_DIMS];
+  libjit_get_strides(tensorStrides, tensorDim, numDimsTensor);
+  libjit_get_strides(sliceStrides, sliceDim, numDimsSlice);
+  size_t base = 0;
+  for (size_t i = 0; i < numDimsSlice; i++) {
+    base += offset[i] * tensorStrides[i];
   }
+  libjit_copy_strided(slice, tensor + base, sliceDim, sliceStrides,
+                      tensorStrides, numDimsSlice);
 }
 
-/// Helper struct for TopK
 template <typename T> struct value_index {
   size_t index;
   T value;
 };
 
-/// Helper function for TopK
-template <typename T> int value_index_sort(const void *va, const void *vb) {
-  value_index<T> *a = (value_index<T> *)va;
-  value_index<T> *b = (value_index<T> *)vb;
-  if (a->value != b->value)
-    return a->value > b->value ? -1 : 1;
-  return a->index < b->index ? -1 : 1;
+/// \returns true if \p a comes before \p b in the output of TopK: it has a
+/// larger value, or the same value and a smaller index.
+template <typename T>
+inline bool libjit_topk_before(const value_index<T> &a,
+                               const value_index<T> &b) {
+  return a.value != b.value ? a.value > b.value : a.index < b.index;
+}
+
+/// Restore the order of the min-heap \p heap of \p size elements, whose root
+/// is the element that comes last in the output of TopK, after the element at
+/// \p pos was replaced.
+template <typename T>
+void libjit_topk_sift_down(value_index<T> *heap, size_t size, size_t pos) {
+  value_index<T> elem = heap[pos];
+  for (size_t child = 2 * pos + 1; child < size; child = 2 * pos + 1) {
+    if (child + 1 < size &&
+        libjit_topk_before(heap[child], heap[child + 1])) {
+      child++;
+    }
+    if (!libjit_topk_before(elem, heap[child])) {
+      break;
+    }
+    heap[pos] = heap[child];
+    pos = child;
+  }
+  heap[pos] = elem;
 }
 
+/// The number of elements of a row of TopK that are compared to the smallest
+/// selected element together. The blocks that have no larger element are
+/// skipped, and the comparison of a block is a vectorized reduction.
+constexpr size_t topk_block_size = 16;
+
 /// Generic Top-K function. Here, \p scratch is some allocated buffer space, \p
 /// size is the size of the input, and \p n is the size of the last dimension of
-/// the input.
+/// the input. The k selected elements of a row are kept in a min-heap in
+/// \p scratch, and the elements that can't enter the heap are filtered out
+/// one block at a time, so the rows are read once.
 template <typename T>
 void libjit_topk(T *values, size_t *indices, const T *input, size_t *scratch,
                  size_t k, size_t n, size_t size) {
-  size_t in = 0;
-  size_t out = 0;
-
-  value_index<T> *buffer = (value_index<T> *)scratch;
-
-  // Specialize TopK for the case where K is 1.
-  if (k == 1) {
-    while (in < size) {
-      // Find the largest value by iterating over the array instead of calling
-      // 'sort'.
-      value_index<T> mx = {0, input[in]};
+  value_index<T> *heap = (value_index<T> *)scratch;
+
+  for (size_t in = 0, out = 0; in < size; in += n, out += k) {
+    const T *row = input + in;
+
+    // Specialize TopK for the case where K is 1: find the first largest
+    // value. The maximum is a select-based reduction, which has no
+    // loop-carried index and can be vectorized, and the index is the first
+    // element equal to it. A NaN is never larger than the maximum, so the
+    // NaNs after the first element are skipped. A NaN first element is never
+    // replaced, and is not equal to itself, so it is selected directly.
+    if (k == 1) {
+      T mx = row[0];
       for (size_t i = 1; i < n; i++) {
-        if (input[i + in] > mx.value) {
-          mx = {i, input[i + in]};
+        mx = row[i] > mx ? row[i] : mx;
+      }
+      size_t index = 0;
+      if (mx == mx) {
+        while (index < n - 1 && !(row[index] == mx)) {
+          index++;
         }
       }
-      indices[out] = mx.index;
-      values[out] = mx.value;
-      out++;
-      in += n;
+      indices[out] = index;
+      values[out] = row[index];
+      continue;
     }
-    return;
-  }
 
-  while (in < size) {
-    for (size_t i = 0; i < n; i++) {
-      buffer[i].index = i;
-      buffer[i].value = input[in++];
-    }
-    qsort(buffer, n, sizeof(value_index<T>), value_index_sort<T>);
+    // Build the heap from the first k elements.
     for (size_t i = 0; i < k; i++) {
-      indices[out] = buffer[i].index;
-      values[out] = buffer[i].value;
-      out++;
+      heap[i] = {i, row[i]};
+    }
+    for (size_t i = k / 2; i-- > 0;) {
+      libjit_topk_sift_down(heap, k, i);
+    }
+
+    // The later elements only enter the heap if they are larger than its
+    // root, because on equal values the element with the smaller index wins.
+    // The comparisons are reduced rather than the values, so that a NaN in a
+    // block does not hide its larger elements.
+    for (size_t i = k; i < n;) {
+      size_t end = MIN(n, i + topk_block_size);
+      T root = heap[0].value;
+      bool anyLarger = false;
+      for (size_t j = i; j < end; j++) {
+        anyLarger |= row[j] > root;
+      }
+      if (anyLarger) {
+        for (size_t j = i; j < end; j++) {
+          if (row[j] > heap[0].value) {
+            heap[0] = {j, row[j]};
+            libjit_topk_sift_down(heap, k, 0);
+          }
+        }
+      }
+      i = end;
+    }
+
+    // Pop the elements from the last one to the first one.
+    for (size_t i = k; i-- > 0;) {
+      indices[out + i] = heap[0].index;
+      values[out + i] = heap[0].value;
+      heap[0] = heap[i];
+      libjit_topk_sift_down(heap, i, 0);
     }
   }
 }
@@ -373,6 +434,13 @@ void libjit_gather(T *dest, const T *data, const size_t *indices,
     for (size_t i = 0; i < numIndices; i++) {
       size_t slice = indices[i];
 
+      // Start fetching a slice that is copied a few iterations from now.
+      if (i + LIBJIT_PREFETCH_DISTANCE < numIndices) {
+        size_t next = indices[i + LIBJIT_PREFETCH_DISTANCE];
+        libjit_prefetch_row(data + sampleStart + next * sliceSize,
+                            sliceSize * sizeof(T));
+      }
+
       // Copy the slice.
       memcpy(dest + outIdx * sliceSize, data + sampleStart + slice * sliceSize,
              sliceSize * sizeof(T));
@@ -383,6 +451,84 @@ void libjit_gather(T *dest, const T *data, const size_t *indices,
   }
 }
 
+/// \returns the element \p v of a float, half precision, bfloat16 or int8
+/// table as a float.
+inline float libjit_table_elem(float v) { return v; }
+inline float libjit_table_elem(uint16_t v) { return libjit_fp16_to_fp32(v); }
+inline float libjit_table_elem(libjit_bf16 v) { return libjit_bf16_to_fp32(v); }
+inline float libjit_table_elem(int8_t v) { return v; }
+
+/// \returns the float8 of the elements of a table row at \p p.
+inline float8 libjit_load_table_row(const float *p) { return LoaduFloat8(p); }
+inline float8 libjit_load_table_row(const int8_t *p) {
+  char8 v;
+  memcpy(&v, p, sizeof(char8));
+  return __builtin_convertvector(v, float8);
+}
+template <typename T> inline float8 libjit_load_table_row(const T *p) {
+  float tmp[sizeof(float8) / sizeof(float)];
+  for (size_t i = 0; i < sizeof(float8) / sizeof(float); i++) {
+    tmp[i] = libjit_table_elem(p[i]);
+  }
+  return LoaduFloat8(tmp);
+}
+
+/// Accumulates the rows of \p data selected by \p indices into the
+/// \p segments rows of \p dest, whose sizes are given by \p lengths. Every
+/// row is scaled by its weight. If \p scales is not null, the table is
+/// row-wise quantized and row r dequantizes as scales[r] * (data[r] -
+/// offsets[r]). The rows are prefetched ahead of the accumulation, which is
+/// done in SIMD registers.
+template <typename T>
+void libjit_sparse_lengths_weighted_sum(float *dest, const T *data,
+                                        const float *scales,
+                                        const int32_t *offsets,
+                                        const float *weights,
+                                        const size_t *indices,
+                                        const size_t *lengths, size_t segments,
+                                        size_t lineSize) {
+  const size_t width = sizeof(float8) / sizeof(float);
+  memset(dest, 0, segments * lineSize * sizeof(float));
+
+  size_t numIndices = 0;
+  for (size_t i = 0; i < segments; i++) {
+    numIndices += lengths[i];
+  }
+
+  size_t curIdx = 0;
+  for (size_t i = 0; i < segments; i++) {
+    float *out = dest + i * lineSize;
+    for (size_t j = 0, e = lengths[i]; j < e; j++, curIdx++) {
+      // Start fetching a row that is accumulated a few iterations from now.
+      if (curIdx + LIBJIT_PREFETCH_DISTANCE < numIndices) {
+        size_t next = indices[curIdx + LIBJIT_PREFETCH_DISTANCE];
+        libjit_prefetch_row(data + next * lineSize, lineSize * sizeof(T));
+      }
+
+      size_t rowIdx = indices[curIdx];
+      const T *row = data + rowIdx * lineSize;
+      // Fold the dequantization into the weight: (q - o) * s * w is
+      // q * (s * w) - o * (s * w).
+      float weight = weights[curIdx];
+      float bias = 0;
+      if (scales) {
+        weight *= scales[rowIdx];
+        bias = -offsets[rowIdx] * weight;
+      }
+
+      float8 weight8 = BroadcastFloat8(weight);
+      float8 bias8 = BroadcastFloat8(bias);
+      size_t k = 0;
+      for (; k + width <= lineSize; k += width) {
+        AdduFloat8(out + k, libjit_load_table_row(row + k) * weight8 + bias8);
+      }
+      for (; k < lineSize; k++) {
+        out[k] += libjit_table_elem(row[k]) * weight + bias;
+      }
+    }
+  }
+}
+
 template <typename T>
 void libjit_scatterassign(T *data, const size_t *indices, const T *slices,
                           size_t numIndices, size_t sliceSize) {
@@ -397,84 +543,23 @@ template <typename T>
 void libjit_transpose_generic(const T *inW, T *outW, const size_t *idim,
                               const size_t *odim, const size_t *shuffle,
                               size_t numDims) {
-  // Transpose 2d matrices one tile at a time. This access pattern ensures
-  // that the whole tile is kept in L1 cache. When scanning the whole row at
-  // once we invalidate many cache lines when we touch a single column.
-  const unsigned tileSize = 64;
-
-  // Source coordinate.
-  size_t SC[5];
-
-  if (numDims == 5) {
-    for (size_t x = 0; x < odim[0]; x++)
-      for (size_t y = 0; y < odim[1]; y++)
-        for (size_t z = 0; z < odim[2]; z++)
-          for (size_t w = 0; w < odim[3]; w++)
-            for (size_t q = 0; q < odim[4]; q++) {
-              SC[shuffle[0]] = x;
-              SC[shuffle[1]] = y;
-              SC[shuffle[2]] = z;
-              SC[shuffle[3]] = w;
-              SC[shuffle[4]] = q;
-              outW[libjit_getXYZWQ(odim, x, y, z, w, q)] =
-                  inW[libjit_getXYZWQ(idim, SC[0], SC[1], SC[2], SC[3], SC[4])];
-            }
-    return;
-  }
-  if (numDims == 4) {
-    for (size_t x = 0; x < odim[0]; x++)
-      for (size_t y = 0; y < odim[1]; y++)
-        for (size_t z = 0; z < odim[2]; z++)
-          for (size_t w = 0; w < odim[3]; w++) {
-            SC[shuffle[0]] = x;
-            SC[shuffle[1]] = y;
-            SC[shuffle[2]] = z;
-            SC[shuffle[3]] = w;
-            outW[libjit_getXYZW(odim, x, y, z, w)] =
-                inW[libjit_getXYZW(idim, SC[0], SC[1], SC[2], SC[3])];
-          }
-    return;
-  }
-  if (numDims == 3) {
-    for (size_t x = 0; x < odim[0]; x++) {
-      // Process the tiles in the innermost two dimensions:
-      for (size_t sy = 0; sy < odim[1]; sy += tileSize) {
-        for (size_t sz = 0; sz < odim[2]; sz += tileSize) {
-          // Process the inner tile:
-          for (size_t y = sy; y < MIN(sy + tileSize, odim[1]); y++) {
-            for (size_t z = sz; z < MIN(sz + tileSize, odim[2]); z++) {
-              SC[shuffle[0]] = x;
-              SC[shuffle[1]] = y;
-              SC[shuffle[2]] = z;
-              outW[libjit_getXYZ(odim, x, y, z)] =
-                  inW[libjit_getXYZ(idim, SC[0], SC[1], SC[2])];
-            }
-          }
-        }
-      }
-    }
-    return;
-  }
-
-  if (numDims == 2) {
-    // Process the tiles in the matrix:
-    for (size_t sx = 0; sx < odim[0]; sx += tileSize) {
-      for (size_t sy = 0; sy < odim[1]; sy += tileSize) {
-        // Process the inner tile:
-        for (size_t x = sx; x < MIN(sx + tileSize, odim[0]); x++) {
-          for (size_t y = sy; y < MIN(sy + tileSize, odim[1]); y++) {
-            SC[shuffle[0]] = x;
-            SC[shuffle[1]] = y;
-            outW[libjit_getXY(odim, x, y)] =
-                inW[libjit_getXY(idim, SC[0], SC[1])];
-          }
-        }
-      }
-    }
-    return;
+  // Coordinate i of the output is coordinate shuffle[i] of the input.
+  size_t inStrides[LIBJIT_MAX_COPY_DIMS];
+  size_t outStrides[LIBJIT_MAX_COPY_DIMS];
+  size_t shuffledStrides[LIBJIT_MAX_COPY_DIMS];
+  libjit_get_strides(inStrides, idim, numDims);
+  libjit_get_strides(outStrides, odim, numDims);
+  for (size_t i = 0; i < numDims; i++) {
+    shuffledStrides[i] = inStrides[shuffle[i]];
   }
+  libjit_copy_strided(outW, inW, odim, outStrides, shuffledStrides, numDims);
 }
 
+/// The number of channels that the pooling kernels process together. The
+/// channels are contiguous in NHWC, so the loops over a block are vectorized,
+/// and the partial results of the block are kept on the stack.
+constexpr size_t pool_block_size = 64;
+
 template <typename T>
 void libjit_max_pool_generic(const T *inW, T *outW, const size_t *inWdims,
                              const size_t *outWdims, size_t *kernelSizes,
@@ -485,6 +570,8 @@ void libjit_max_pool_generic(const T *inW, T *outW, const size_t *inWdims,
   size_t stride_w = strides[1];
   size_t kernel_h = kernelSizes[0];
   size_t kernel_w = kernelSizes[1];
+  size_t channels = outWdims[3];
+  constexpr size_t cbSize = pool_block_size;
   // For each sample in the batch:
   for (size_t n = 0; n < outWdims[0]; n++) {
     // For each (x,y) step in the input/output tensor:
@@ -493,10 +580,11 @@ void libjit_max_pool_generic(const T *inW, T *outW, const size_t *inWdims,
       ssize_t y = -(ssize_t)pad_l;
       for (size_t ay = 0; ay < outWdims[2]; y += stride_w, ay++) {
 
-        // For each layer in the output tensor:
-        for (size_t z = 0; z < inWdims[3]; z++) {
+        // For each block of channels in the output tensor:
+        for (size_t cb = 0; cb < channels; cb += cbSize) {
+          size_t cbLen = MIN(cbSize, channels - cb);
           int first = 1;
-          T max = 0;
+          T max[cbSize];
 
           // For each element in the pool filter:
           for (size_t fx = 0; fx < kernel_h; fx++) {
@@ -510,23 +598,34 @@ void libjit_max_pool_generic(const T *inW, T *outW, const size_t *inWdims,
                 continue;
               }
 
-              float val =
-                  inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)];
-
-              if (first || (val >= max)) {
+              const T *in =
+                  inW + libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, cb);
+              if (first) {
                 first = 0;
-                max = val;
+                for (size_t c = 0; c < cbLen; c++) {
+                  max[c] = in[c];
+                }
+              } else {
+                for (size_t c = 0; c < cbLen; c++) {
+                  max[c] = MAX(max[c], in[c]);
+                }
               }
             }
           }
 
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = max;
+          T *out = outW + libjit_getXYZW(outWdims, n, ax, ay, cb);
+          for (size_t c = 0; c < cbLen; c++) {
+            out[c] = first ? 0 : max[c];
+          }
         } // C
       }   // W
     }     // H
   }       // N
 }
 
+/// Max pool that also records the coordinates of the maximum of every output
+/// element in \p inXY. It is only used when the gradient needs them, because
+/// the IR optimizer replaces it with the plain max pool otherwise.
 template <typename T>
 void libjit_max_pool_xy_generic(const T *inW, T *outW, size_t *inXY,
                                 const size_t *inWdims, const size_t *outWdims,
@@ -538,6 +637,8 @@ void libjit_max_pool_xy_generic(const T *inW, T *outW, size_t *inXY,
   size_t stride_w = strides[1];
   size_t kernel_h = kernels[0];
   size_t kernel_w = kernels[1];
+  size_t channels = outWdims[3];
+  constexpr size_t cbSize = pool_block_size;
   // For each input in the batch:
   for (size_t n = 0; n < outWdims[0]; n++) {
 
@@ -547,12 +648,18 @@ void libjit_max_pool_xy_generic(const T *inW, T *outW, size_t *inXY,
       ssize_t y = -(ssize_t)pad_l;
       for (size_t ay = 0; ay < outWdims[2]; y += stride_w, ay++) {
 
-        // For each channel in the output tensor:
-        for (size_t z = 0; z < outWdims[3]; z++) {
-          size_t maxX = x;
-          size_t maxY = y;
+        // For each block of channels in the output tensor:
+        for (size_t cb = 0; cb < channels; cb += cbSize) {
+          size_t cbLen = MIN(cbSize, channels - cb);
+          T max[cbSize];
+          size_t maxX[cbSize];
+          size_t maxY[cbSize];
+          for (size_t c = 0; c < cbLen; c++) {
+            max[c] = 0;
+            maxX[c] = x;
+            maxY[c] = y;
+          }
           int first = 1;
-          T max = 0;
 
           for (size_t kx = 0; kx < kernel_h; kx++) {
             for (size_t ky = 0; ky < kernel_w; ky++) {
@@ -564,29 +671,137 @@ void libjit_max_pool_xy_generic(const T *inW, T *outW, size_t *inXY,
                 continue;
               }
 
-              T val =
-                  inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)];
-              if (first || (val >= max)) {
-                first = 0;
-                max = val;
-                maxX = ox;
-                maxY = oy;
+              const T *in =
+                  inW + libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, cb);
+              for (size_t c = 0; c < cbLen; c++) {
+                bool isMax = first || in[c] >= max[c];
+                max[c] = isMax ? in[c] : max[c];
+                maxX[c] = isMax ? ox : maxX[c];
+                maxY[c] = isMax ? oy : maxY[c];
               }
+              first = 0;
             }
           }
 
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = max;
-          // For the x and y argmax's, we use a 5-dimensional
-          // tensor whose fifth dimension has size 2:
-          size_t ix = 2 * libjit_getXYZW(outWdims, n, ax, ay, z);
-          inXY[ix] = maxX;
-          inXY[ix + 1] = maxY;
+          size_t outIdx = libjit_getXYZW(outWdims, n, ax, ay, cb);
+          for (size_t c = 0; c < cbLen; c++) {
+            outW[outIdx + c] = max[c];
+            // For the x and y argmax's, we use a 5-dimensional
+            // tensor whose fifth dimension has size 2:
+            inXY[2 * (outIdx + c)] = maxX[c];
+            inXY[2 * (outIdx + c) + 1] = maxY[c];
+          }
         } // C
       }   // W
     }     // H
   }       // N
 }
 
+/// Computes the average pool of a block of \p cbLen channels of the output
+/// pixel (\p ax, \p ay) of the sample \p n into \p sum, and returns the
+/// number of input pixels that were added. The pixels that fall into the
+/// padding are not added.
+template <typename T, typename AccT>
+size_t libjit_avg_pool_sum_block(AccT *sum, const T *inW,
+                                 const size_t *inWdims, size_t n, ssize_t x,
+                                 ssize_t y, size_t cb, size_t cbLen,
+                                 size_t kernel_h, size_t kernel_w) {
+  size_t count = 0;
+  for (size_t c = 0; c < cbLen; c++) {
+    sum[c] = 0;
+  }
+  for (size_t fx = 0; fx < kernel_h; fx++) {
+    for (size_t fy = 0; fy < kernel_w; fy++) {
+      ssize_t ox = x + fx;
+      ssize_t oy = y + fy;
+
+      // Ignore index access below zero (this is due to padding).
+      if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
+          oy >= (ssize_t)inWdims[2]) {
+        continue;
+      }
+
+      const T *in =
+          inW + libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, cb);
+      for (size_t c = 0; c < cbLen; c++) {
+        sum[c] += in[c];
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+/// Gen a bin number to insert \p value into the histogram which has \p nBins
+/// with \p minValue and \p binWidth in histogram.
+size_t libjit_get_bin(size_t nBins, float binWidth, float minValue,
+                      float value) {
+  if (binWidth == 0) {
+    return 0;
+  }
+  size_t bin = (value - minValue) / binWidth;
+  return MIN(bin, nBins - 1);
+}
+
+/// Redistribute the counts of \p histogram, which covers the range
+/// [\p min, \p max], over the wider range [\p newMin, \p newMax].
+void libjit_rescale_histogram(float *histogram, size_t nBins, float min,
+                              float max, float newMin, float newMax) {
+  float destBinWidth = (newMax - newMin) / nBins;
+  float srcBinWidth = (max - min) / nBins;
+  float scaledHistogram[nBins];
+  memset(scaledHistogram, 0, nBins * sizeof(float));
+
+  for (size_t i = 0; i < nBins; i++) {
+    if (histogram[i] == 0) {
+      continue;
+    }
+
+    float srcBinBegin = min + srcBinWidth * i;
+    size_t destBin = (srcBinBegin - newMin) / destBinWidth;
+    float destBinEnd = newMin + destBinWidth * (destBin + 1);
+
+    // Calculate how much we need to redistribute.
+    uint64_t dstBinCnt = (uint64_t)MIN(
+        roundf((destBinEnd - srcBinBegin) / srcBinWidth * histogram[i]),
+        histogram[i]);
+
+    size_t newBin = libjit_get_bin(nBins, destBinWidth, newMin, srcBinBegin);
+    scaledHistogram[newBin] += dstBinCnt;
+
+    if (dstBinCnt < histogram[i]) {
+      newBin = libjit_get_bin(nBins, destBinWidth, newMin,
+                              srcBinBegin + destBinWidth);
+      scaledHistogram[newBin] += histogram[i] - dstBinCnt;
+    }
+  }
+
+  memcpy(histogram, scaledHistogram, nBins * sizeof(float));
+}
+
+/// The number of outputs of a quantized BatchedReduceAdd whose int32 sums are
+/// kept on the stack while the batch is accumulated.
+constexpr size_t reduce_block_size = 256;
+
+/// Splits the elements [\p begin, \p end) of the states {batch, \p hidden}
+/// of the time step \p t of a sequence by batch entry. Calls \p step on the
+/// ranges of the entries that run the step, whose length in \p lengths is
+/// past \p t, and \p keep on the ranges of the other ones.
+template <typename StepFn, typename KeepFn>
+void libjit_sequence_step(const size_t *lengths, size_t t, size_t hidden,
+                          size_t begin, size_t end, StepFn step, KeepFn keep) {
+  while (begin < end) {
+    size_t n = begin / hidden;
+    size_t last = MIN(end, (n + 1) * hidden);
+    if (lengths[n] > t) {
+      step(begin, last);
+    } else {
+      keep(begin, last);
+    }
+    begin = last;
+  }
+}
+
 } // namespace
 
 extern "C" {
@@ -649,6 +864,35 @@ extern "C" {
         libjit_scale_i32i8((body), pre, post, scale, destOffset));             \
   }
 
+/// Macro to define a kernel for the data-parallel arithmetic quantized
+/// operation \p kernel on the range [begin, end) of the elements of tensors
+/// that are not broadcast. Eight elements at a time are computed in the 32-bit
+/// lanes of SIMD registers, and the remainder by \p kernel.
+/// \p name the name of the kernel
+/// \p kernel the mini-kernel of the operation
+/// \p body the operation on the int32x8 lhs and rhs
+#define DEFINE_DATA_PARALLEL_RANGE_KERNEL_QUANTIZED(name, kernel, body)        \
+  void name(int8_t *dest, const int8_t *LHS, const int8_t *RHS,                \
+            int32_t destOffset, int32_t lhsOffset, int32_t rhsOffset,          \
+            int32_t lhsPre, int32_t lhsPost, int32_t lhsScale, int32_t rhsPre, \
+            int32_t rhsPost, int32_t rhsScale, size_t begin, size_t end) {     \
+    size_t idx = begin;                                                        \
+    for (; idx + 8 <= end; idx += 8) {                                         \
+      int32x8 lhs = libjit_scale_i32i8x8(libjit_load_i8x8(LHS + idx) -        \
+                                             lhsOffset,                        \
+                                         lhsPre, lhsPost, lhsScale, 0);        \
+      int32x8 rhs = libjit_scale_i32i8x8(libjit_load_i8x8(RHS + idx) -        \
+                                             rhsOffset,                        \
+                                         rhsPre, rhsPost, rhsScale, 0);        \
+      libjit_store_i8x8(dest + idx, (body) + destOffset);                      \
+    }                                                                          \
+    for (; idx < end; idx++) {                                                 \
+      dest[idx] = kernel(idx, LHS, RHS, destOffset, lhsOffset, rhsOffset,      \
+                         lhsPre, lhsPost, lhsScale, rhsPre, rhsPost,           \
+                         rhsScale);                                            \
+    }                                                                          \
+  }
+
 /// Define mini-kernels for all data parallel operations. They are invoked from
 /// the generated kernels for sequences of data parallel operations.
 DEFINE_DATA_PARALLEL_KERNEL(libjit_elementmax_kernel_f, float,
@@ -658,6 +902,9 @@ DEFINE_DATA_PARALLEL_KERNEL(libjit_elementmin_kernel_f, float,
 DEFINE_DATA_PARALLEL_KERNEL(libjit_copy_kernel_f, float, LHS[idx])
 DEFINE_DATA_PARALLEL_KERNEL(libjit_copy_kernel_u, size_t, LHS[idx])
 DEFINE_DATA_PARALLEL_KERNEL(libjit_copy_kernel_i8, int8_t, LHS[idx])
+DEFINE_DATA_PARALLEL_KERNEL(libjit_copy_kernel_i16, int16_t, LHS[idx])
+DEFINE_DATA_PARALLEL_KERNEL(libjit_copy_kernel_f16, uint16_t, LHS[idx])
+DEFINE_DATA_PARALLEL_KERNEL(libjit_copy_kernel_bf16, uint16_t, LHS[idx])
 DEFINE_DATA_PARALLEL_KERNEL(libjit_element_cmp_lte_kernel_f, float,
                             LHS[idx] <= RHS[idx] ? 1.0 : 0.0)
 DEFINE_DATA_PARALLEL_KERNEL(libjit_element_cmp_eq_kernel_u, size_t,
@@ -686,6 +933,71 @@ DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED(libjit_elementmin_kernel_i8, int8_t,
 DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED_M(libjit_element_mul_kernel_i8, lhs *rhs)
 DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED_M(libjit_element_div_kernel_i8, lhs / rhs)
 
+/// The kernels of the quantized instructions that are not stacked with other
+/// ones, like the residual adds of quantized networks. The loops of the
+/// mini-kernels above are only partially vectorized by LLVM.
+DEFINE_DATA_PARALLEL_RANGE_KERNEL_QUANTIZED(libjit_element_add_i8,
+                                            libjit_element_add_kernel_i8,
+                                            lhs + rhs)
+DEFINE_DATA_PARALLEL_RANGE_KERNEL_QUANTIZED(libjit_element_sub_i8,
+                                            libjit_element_sub_kernel_i8,
+                                            lhs - rhs)
+DEFINE_DATA_PARALLEL_RANGE_KERNEL_QUANTIZED(libjit_elementmax_i8,
+                                            libjit_elementmax_kernel_i8,
+                                            libjit_max_i32x8(lhs, rhs))
+DEFINE_DATA_PARALLEL_RANGE_KERNEL_QUANTIZED(libjit_elementmin_i8,
+                                            libjit_elementmin_kernel_i8,
+                                            libjit_min_i32x8(lhs, rhs))
+
+void libjit_element_mul_i8(int8_t *dest, const int8_t *LHS, const int8_t *RHS,
+                           int32_t destOffset, int32_t lhsOffset,
+                           int32_t rhsOffset, int32_t pre, int32_t post,
+                           int32_t scale, size_t begin, size_t end) {
+  size_t idx = begin;
+  for (; idx + 8 <= end; idx += 8) {
+    int32x8 lhs = libjit_load_i8x8(LHS + idx) - lhsOffset;
+    int32x8 rhs = libjit_load_i8x8(RHS + idx) - rhsOffset;
+    libjit_store_i8x8(dest + idx, libjit_scale_i32i8x8(lhs * rhs, pre, post,
+                                                       scale, destOffset));
+  }
+  for (; idx < end; idx++) {
+    dest[idx] = libjit_element_mul_kernel_i8(idx, LHS, RHS, destOffset,
+                                             lhsOffset, rhsOffset, pre, post,
+                                             scale);
+  }
+}
+
+#undef DEFINE_DATA_PARALLEL_RANGE_KERNEL_QUANTIZED
+
+/// The mini-kernels of the 16-bit quantized operations. The products of
+/// 16-bit operands overflow the fixed-point scaling of the 8-bit kernels, so
+/// the operands are scaled in floating point, like in the Interpreter.
+/// \p lhsScale and \p rhsScale are the ratios of the operand scales to the
+/// scale of the result.
+#define DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED_I16(name, body)                  \
+  int16_t name(size_t idx, const int16_t *LHS, const int16_t *RHS,             \
+               int32_t destOffset, int32_t lhsOffset, int32_t rhsOffset,       \
+               float lhsScale, float rhsScale) {                               \
+    float lhs = lhsScale * (LHS[idx] - lhsOffset);                             \
+    float rhs = rhsScale * (RHS[idx] - rhsOffset);                             \
+    return libjit_round_clip_i16((body) + destOffset);                         \
+  }
+
+DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED_I16(libjit_element_add_kernel_i16,
+                                          lhs + rhs)
+DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED_I16(libjit_element_sub_kernel_i16,
+                                          lhs - rhs)
+#undef DEFINE_DATA_PARALLEL_KERNEL_QUANTIZED_I16
+
+/// \p scale is s_l * s_r / s_d. The product is accumulated in 64 bits.
+int16_t libjit_element_mul_kernel_i16(size_t idx, const int16_t *LHS,
+                                      const int16_t *RHS, int32_t destOffset,
+                                      int32_t lhsOffset, int32_t rhsOffset,
+                                      float scale) {
+  int64_t mul = (int64_t)(LHS[idx] - lhsOffset) * (RHS[idx] - rhsOffset);
+  return libjit_round_clip_i16(scale * mul + destOffset);
+}
+
 int8_t libjit_element_cmp_lte_kernel_i8(size_t idx, const int8_t *LHS,
                                         const int8_t *RHS, int32_t lhsOffset,
                                         int32_t rhsOffset, int32_t pre,
@@ -695,16 +1007,26 @@ int8_t libjit_element_cmp_lte_kernel_i8(size_t idx, const int8_t *LHS,
   return libjit_scale_i32i8(lhs, pre, post, scale, 0) <= rhs ? 1 : 0;
 }
 
-// tanh cannot be vectorized by LLVM yet. Therefore we use the following
-// formula instead: 1 - 2 / (exp(x * 2) + 1), which is also used by Caffe2 and
-// provides a good accuracy.
-// Once LLVM supports the vectorization of tanh, we can replace this
-// approximation by a direct tanh call.
+// tanh and expf cannot be vectorized by LLVM. Therefore we use the
+// approximations of libjit_defs.h, which are made of vectorizable operations.
 DEFINE_DATA_PARALLEL_KERNEL(libjit_tanh_kernel_f, float,
-                            1 - 2 / (expf(LHS[idx] * 2) + 1))
+                            libjit_tanhf(LHS[idx]))
 DEFINE_DATA_PARALLEL_KERNEL(libjit_elementselect_kernel_f, float,
                             (LHS[idx] != 0.0) ? RHS[idx] : op3[idx])
 
+/// The element-wise kernels of Quantize and Dequantize, which the CPU backend
+/// stacks with the float kernels around them.
+int8_t libjit_quantize_kernel_i8(size_t idx, const float *src, float scale,
+                                 int32_t offset) {
+  int32_t result = (int32_t)nearbyintf(src[idx] / scale + offset);
+  return MAX(INT8_MIN, MIN(INT8_MAX, result));
+}
+
+float libjit_dequantize_kernel_f(size_t idx, const int8_t *src, float scale,
+                                 int32_t offset) {
+  return scale * (src[idx] - offset);
+}
+
 int8_t libjit_intlookuptable_kernel_i8(size_t idx, const int8_t *src,
                                        const int8_t *mapping) {
   return mapping[src[idx] + 128];
@@ -725,8 +1047,7 @@ int8_t libjit_elementselect_kernel_i8(size_t idx, const int8_t *cond,
 }
 
 DEFINE_DATA_PARALLEL_KERNEL_FUNC(libjit_sigmoid_kernel_f) {
-  float e = expf(LHS[idx]);
-  return e / (e + 1);
+  return libjit_sigmoidf(LHS[idx]);
 }
 DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_element_maxsplat_kernel_f,
                                              float, MAX(LHS[idx], val))
@@ -736,6 +1057,12 @@ DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_f, float, val)
 DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_u, size_t, val)
 DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_i8, int8_t,
                                              val)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_i16, int16_t,
+                                             val)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_f16, uint16_t,
+                                             val)
+DEFINE_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(libjit_splat_kernel_bf16,
+                                             uint16_t, val)
 
 #undef DEFINE_DATA_PARALLEL_KERNEL
 #undef DEFINE_DATA_PARALLEL_KERNEL_FUNC
@@ -763,7 +1090,15 @@ void libjit_batchedadd_i8(int8_t *dest, const int8_t *batch,
                           int32_t slicePost, int32_t sliceScale) {
   for (size_t n = 0; n < numSlice; n++) {
     size_t base = n * sliceSize;
-    for (size_t i = 0; i < sliceSize; i++) {
+    size_t i = 0;
+    for (; i + 8 <= sliceSize; i += 8) {
+      int32x8 b = libjit_load_i8x8(batch + base + i) - batchOffset;
+      int32x8 s = libjit_load_i8x8(slice + i) - sliceOffset;
+      int32x8 x = libjit_scale_i32i8x8(b, batchPre, batchPost, batchScale, 0);
+      int32x8 y = libjit_scale_i32i8x8(s, slicePre, slicePost, sliceScale, 0);
+      libjit_store_i8x8(dest + base + i, x + y + destOffset);
+    }
+    for (; i < sliceSize; i++) {
       int32_t b = batch[base + i] - batchOffset;
       int32_t s = slice[i] - sliceOffset;
       int32_t x = libjit_scale_i32i8(b, batchPre, batchPost, batchScale, 0);
@@ -773,6 +1108,23 @@ void libjit_batchedadd_i8(int8_t *dest, const int8_t *batch,
   }
 }
 
+/// \p batchScale and \p sliceScale are the ratios of the scales of the
+/// operands to the scale of \p dest.
+void libjit_batchedadd_i16(int16_t *dest, const int16_t *batch,
+                           const int16_t *slice, size_t numSlice,
+                           size_t sliceSize, int32_t destOffset,
+                           int32_t batchOffset, int32_t sliceOffset,
+                           float batchScale, float sliceScale) {
+  for (size_t n = 0; n < numSlice; n++) {
+    size_t base = n * sliceSize;
+    for (size_t i = 0; i < sliceSize; i++) {
+      float b = batchScale * (batch[base + i] - batchOffset);
+      float s = sliceScale * (slice[i] - sliceOffset);
+      dest[base + i] = libjit_round_clip_i16(b + s + destOffset);
+    }
+  }
+}
+
 /// The dimensions passed in here are pre-expanded in LLVMIRGen with 1s so that
 /// we can iterate over the shape here, regardless of the shape of the tensor.
 void libjit_batchedreduceadd_f(float *dest, const float *batch, size_t destSize,
@@ -796,46 +1148,43 @@ void libjit_batchedreduceadd_f(float *dest, const float *batch, size_t destSize,
 }
 
 /// Same as the non-quantized version, the dimensions here are pre-expanded in
-/// LLVMIRGen. However, for quantization, we must accumulate in the inner-most
-/// loop with higher precision (int32_t) and then clip the result back into the
-/// dest tensor. Thus we add max_tensor_dimensions different cases for this to
-/// ensure the axis is used as the inner-most loop.
+/// LLVMIRGen. For quantization, the sums are accumulated in int32_t and
+/// requantized once per output. The batch is read in memory order: the
+/// dimensions before the axis are the outer loop, and the contiguous ones after
+/// it are the inner loop, which is vectorized over a block of local sums.
 void libjit_batchedreduceadd_i8(int8_t *dest, const int8_t *batch,
                                 const size_t *destDims, const size_t *batchDims,
                                 int32_t destOffset, int32_t batchOffset,
                                 int32_t batchPre, int32_t batchPost,
                                 int32_t batchScale, size_t axis) {
-  switch (axis) {
-#define LOOP_AXIS_CASE(_D0, _D1, _D2, _D3, _D4, _D5_AXIS)                      \
-  case _D5_AXIS:                                                               \
-    for (size_t i##_D0 = 0; i##_D0 < batchDims[_D0]; i##_D0++)                 \
-      for (size_t i##_D1 = 0; i##_D1 < batchDims[_D1]; i##_D1++)               \
-        for (size_t i##_D2 = 0; i##_D2 < batchDims[_D2]; i##_D2++)             \
-          for (size_t i##_D3 = 0; i##_D3 < batchDims[_D3]; i##_D3++)           \
-            for (size_t i##_D4 = 0; i##_D4 < batchDims[_D4]; i##_D4++) {       \
-              int32_t sum = 0.0;                                               \
-              for (size_t i##_D5_AXIS = 0; i##_D5_AXIS < batchDims[_D5_AXIS];  \
-                   i##_D5_AXIS++) {                                            \
-                sum += batch[libjit_getXYZWQR(batchDims, i0, i1, i2, i3, i4,   \
-                                              i5)] -                           \
-                       batchOffset;                                            \
-              }                                                                \
-              size_t i##_D5_AXIS = 0;                                          \
-              int32_t res = libjit_scale_i32i8(sum, batchPre, batchPost,       \
-                                               batchScale, destOffset);        \
-              dest[libjit_getXYZWQR(destDims, i0, i1, i2, i3, i4, i5)] =       \
-                  libjit_clip(res);                                            \
-            }                                                                  \
-    return;
-
-    // Each loop order, with the inner-most dimension/index equal to the axis.
-    LOOP_AXIS_CASE(1, 2, 3, 4, 5, 0);
-    LOOP_AXIS_CASE(0, 2, 3, 4, 5, 1);
-    LOOP_AXIS_CASE(0, 1, 3, 4, 5, 2);
-    LOOP_AXIS_CASE(0, 1, 2, 4, 5, 3);
-    LOOP_AXIS_CASE(0, 1, 2, 3, 5, 4);
-    LOOP_AXIS_CASE(0, 1, 2, 3, 4, 5);
-#undef LOOP_AXIS_CASE
+  size_t outer = 1;
+  for (size_t i = 0; i < axis; i++) {
+    outer *= batchDims[i];
+  }
+  size_t inner = 1;
+  for (size_t i = axis + 1; i < 6; i++) {
+    inner *= batchDims[i];
+  }
+  size_t axisSize = batchDims[axis];
+  int32_t sumOffset = (int32_t)axisSize * batchOffset;
+
+  for (size_t o = 0; o < outer; o++) {
+    const int8_t *slice = batch + o * axisSize * inner;
+    int8_t *out = dest + o * inner;
+    for (size_t jb = 0; jb < inner; jb += reduce_block_size) {
+      size_t bSize = MIN(reduce_block_size, inner - jb);
+      int32_t sum[reduce_block_size] = {0};
+      for (size_t a = 0; a < axisSize; a++) {
+        const int8_t *row = slice + a * inner + jb;
+        for (size_t j = 0; j < bSize; j++) {
+          sum[j] += row[j];
+        }
+      }
+      for (size_t j = 0; j < bSize; j++) {
+        out[jb + j] = libjit_clip(libjit_scale_i32i8(
+            sum[j] - sumOffset, batchPre, batchPost, batchScale, destOffset));
+      }
+    }
   }
 }
 
@@ -849,6 +1198,77 @@ void libjit_cross_entropy_loss_f(float *CE, float *P, size_t *labels,
   }
 }
 
+/// Computes the sum over the rows of \p logits of -log(softmax(row)[label]),
+/// as log(sum(exp(row - max))) + max - row[label], in a single pass over
+/// the exponentials and without storing the probabilities.
+void libjit_softmax_cross_entropy_loss_f(float *CE, const float *logits,
+                                         const size_t *labels,
+                                         const size_t *dims) {
+  float loss = 0;
+  for (size_t n = 0; n < dims[0]; n++) {
+    const float *row = logits + libjit_getXY(dims, n, 0);
+    float max = row[0];
+    for (size_t i = 1; i < dims[1]; i++) {
+      max = MAX(max, row[i]);
+    }
+    float sum = 0;
+    for (size_t i = 0; i < dims[1]; i++) {
+      sum += libjit_expf(row[i] - max);
+    }
+    loss += logf(sum) + max - row[labels[n]];
+  }
+  CE[0] = loss;
+}
+
+/// Computes the rows [\p rowBegin, \p rowEnd) of the gradient \p logitsG of
+/// the logits of a softmax cross entropy loss: the softmax of the row minus
+/// the one-hot label.
+void libjit_softmax_cross_entropy_loss_grad_f(float *logitsG,
+                                              const float *logits,
+                                              const size_t *labels,
+                                              const size_t *dims,
+                                              size_t rowBegin, size_t rowEnd) {
+  for (size_t n = rowBegin; n < rowEnd; n++) {
+    const float *row = logits + libjit_getXY(dims, n, 0);
+    float *rowG = logitsG + libjit_getXY(dims, n, 0);
+    float max = row[0];
+    for (size_t i = 1; i < dims[1]; i++) {
+      max = MAX(max, row[i]);
+    }
+    float sum = 0;
+    for (size_t i = 0; i < dims[1]; i++) {
+      float e = libjit_expf(row[i] - max);
+      sum += e;
+      rowG[i] = e;
+    }
+    float inv = 1 / sum;
+    for (size_t i = 0; i < dims[1]; i++) {
+      rowG[i] *= inv;
+    }
+    rowG[labels[n]] -= 1;
+  }
+}
+
+/// Computes the elements [\p begin, \p end) of \p dest, the means over rows
+/// of \p inner elements of the sigmoid cross entropy of \p logits with
+/// \p targets: max(x, 0) - x * t + log(1 + exp(-|x|)).
+void libjit_sigmoid_cross_entropy_with_logits_f(float *dest,
+                                                const float *logits,
+                                                const float *targets,
+                                                size_t inner, size_t begin,
+                                                size_t end) {
+  for (size_t n = begin; n < end; n++) {
+    const float *x = logits + n * inner;
+    const float *t = targets + n * inner;
+    float sum = 0;
+    for (size_t i = 0; i < inner; i++) {
+      sum += MAX(x[i], 0.0f) - x[i] * t[i] +
+             log1pf(libjit_expf(-fabsf(x[i])));
+    }
+    dest[n] = sum / inner;
+  }
+}
+
 void libjit_gather_f(float *dest, const float *data, const size_t *indices,
                      size_t numIndices, size_t sliceSize, size_t numSamples,
                      size_t sampleSize) {
@@ -870,6 +1290,235 @@ void libjit_gather_u(size_t *dest, const size_t *data, const size_t *indices,
                 sampleSize);
 }
 
+void libjit_sparse_lengths_weighted_sum_f(float *dest, const float *data,
+                                          const float *weights,
+                                          const size_t *indices,
+                                          const size_t *lengths,
+                                          size_t segments, size_t lineSize) {
+  libjit_sparse_lengths_weighted_sum<float>(dest, data, nullptr, nullptr,
+                                            weights, indices, lengths,
+                                            segments, lineSize);
+}
+
+void libjit_sparse_lengths_weighted_sum_f16(float *dest, const uint16_t *data,
+                                            const float *weights,
+                                            const size_t *indices,
+                                            const size_t *lengths,
+                                            size_t segments, size_t lineSize) {
+  libjit_sparse_lengths_weighted_sum<uint16_t>(dest, data, nullptr, nullptr,
+                                               weights, indices, lengths,
+                                               segments, lineSize);
+}
+
+void libjit_sparse_lengths_weighted_sum_bf16(float *dest, const uint16_t *data,
+                                             const float *weights,
+                                             const size_t *indices,
+                                             const size_t *lengths,
+                                             size_t segments, size_t lineSize) {
+  libjit_sparse_lengths_weighted_sum<libjit_bf16>(
+      dest, (const libjit_bf16 *)data, nullptr, nullptr, weights, indices,
+      lengths, segments, lineSize);
+}
+
+void libjit_rowwise_quantized_sparse_lengths_weighted_sum_f(
+    float *dest, const int8_t *data, const float *scales,
+    const int32_t *offsets, const float *weights, const size_t *indices,
+    const size_t *lengths, size_t segments, size_t lineSize) {
+  libjit_sparse_lengths_weighted_sum<int8_t>(dest, data, scales, offsets,
+                                             weights, indices, lengths,
+                                             segments, lineSize);
+}
+
+/// Same as libjit_sparse_lengths_weighted_sum_f, but the table is clustered:
+/// row r of \p codes holds the indices of the \p codeBits bits of the
+/// centroids of \p codebook that make up the row r of the table, see
+/// libjit_decode_clustered_row(). Every row is decoded a chunk at a time into
+/// a buffer on the stack, from which it is accumulated.
+void libjit_clustered_sparse_lengths_weighted_sum_f(
+    float *dest, const float *codebook, const uint8_t *codes,
+    const float *weights, const size_t *indices, const size_t *lengths,
+    size_t segments, size_t lineSize, unsigned codeBits) {
+  const size_t width = sizeof(float8) / sizeof(float);
+  // An even number of weights, so that the chunks start on a byte.
+  const size_t chunk = 512;
+  size_t rowBytes = (lineSize * codeBits + 7) / 8;
+  float decoded[chunk];
+  memset(dest, 0, segments * lineSize * sizeof(float));
+
+  size_t numIndices = 0;
+  for (size_t i = 0; i < segments; i++) {
+    numIndices += lengths[i];
+  }
+
+  size_t curIdx = 0;
+  for (size_t i = 0; i < segments; i++) {
+    float *out = dest + i * lineSize;
+    for (size_t j = 0, e = lengths[i]; j < e; j++, curIdx++) {
+      if (curIdx + LIBJIT_PREFETCH_DISTANCE < numIndices) {
+        size_t next = indices[curIdx + LIBJIT_PREFETCH_DISTANCE];
+        libjit_prefetch_row(codes + next * rowBytes, rowBytes);
+      }
+
+      const uint8_t *row = codes + indices[curIdx] * rowBytes;
+      float weight = weights[curIdx];
+      float8 weight8 = BroadcastFloat8(weight);
+      for (size_t k0 = 0; k0 < lineSize; k0 += chunk) {
+        size_t len = MIN(chunk, lineSize - k0);
+        libjit_decode_clustered_row(decoded, row, codebook, k0, len, codeBits);
+        size_t k = 0;
+        for (; k + width <= len; k += width) {
+          AdduFloat8(out + k0 + k, LoaduFloat8(decoded + k) * weight8);
+        }
+        for (; k < len; k++) {
+          out[k0 + k] += decoded[k] * weight;
+        }
+      }
+    }
+  }
+}
+
+/// Computes the output columns [\p colBegin, \p colEnd) of the fully
+/// connected layer dest = in * dequantize(weights)^T + bias. \p weights has a
+/// row of \p inSize int8 values for every one of the \p outSize output
+/// columns, and row j dequantizes as scales[j] * (weights[j] - offsets[j]).
+/// The weights are expanded to floats in registers, and every row is read once
+/// for all of the \p batch rows of \p in.
+void libjit_rowwise_quantized_fc_f(float *dest, const float *in,
+                                   const int8_t *weights, const float *scales,
+                                   const int32_t *offsets, const float *bias,
+                                   size_t batch, size_t inSize, size_t outSize,
+                                   size_t colBegin, size_t colEnd) {
+  const size_t width = sizeof(float8) / sizeof(float);
+  for (size_t j = colBegin; j < colEnd; j++) {
+    const int8_t *row = weights + j * inSize;
+    if (j + 1 < colEnd) {
+      libjit_prefetch_row(row + inSize, inSize);
+    }
+    float offset = offsets[j];
+    float8 offset8 = BroadcastFloat8(offset);
+    for (size_t n = 0; n < batch; n++) {
+      const float *x = in + n * inSize;
+      float8 sum8 = BroadcastFloat8(0);
+      size_t k = 0;
+      for (; k + width <= inSize; k += width) {
+        sum8 += LoaduFloat8(x + k) * (libjit_load_table_row(row + k) - offset8);
+      }
+      float sum = 0;
+      for (size_t i = 0; i < width; i++) {
+        sum += sum8[i];
+      }
+      for (; k < inSize; k++) {
+        sum += x[k] * (row[k] - offset);
+      }
+      dest[n * outSize + j] = sum * scales[j] + bias[j];
+    }
+  }
+}
+
+/// Size of the header of every quantized row in the scratch of the dynamic
+/// quantized fully connected layer: the float scale, the int32 offset and the
+/// int32 sum of the row, padded to 16 bytes.
+#define LIBJIT_DYNAMIC_ROW_HEADER 16
+
+/// Quantizes every one of the \p batch rows of \p inSize floats of \p in
+/// to int8 with the range of its values, including zero. Row n of
+/// \p scratch, which has the stride \p rowStride, starts with a header
+/// holding the quantization parameters and the sum of the quantized row,
+/// followed by the row itself.
+void libjit_dynamic_quantize_rows_f(int8_t *scratch, const float *in,
+                                    size_t batch, size_t inSize,
+                                    size_t rowStride) {
+  const size_t width = sizeof(float8) / sizeof(float);
+  for (size_t n = 0; n < batch; n++) {
+    const float *x = in + n * inSize;
+    // Reduce the range in independent lanes, which become vector min and max
+    // instructions.
+    float mins[width], maxs[width];
+    for (size_t i = 0; i < width; i++) {
+      mins[i] = maxs[i] = 0;
+    }
+    size_t k = 0;
+    for (; k + width <= inSize; k += width) {
+      for (size_t i = 0; i < width; i++) {
+        mins[i] = MIN(mins[i], x[k + i]);
+        maxs[i] = MAX(maxs[i], x[k + i]);
+      }
+    }
+    for (; k < inSize; k++) {
+      mins[0] = MIN(mins[0], x[k]);
+      maxs[0] = MAX(maxs[0], x[k]);
+    }
+    float min = mins[0], max = maxs[0];
+    for (size_t i = 1; i < width; i++) {
+      min = MIN(min, mins[i]);
+      max = MAX(max, maxs[i]);
+    }
+
+    // Same as the asymmetric schema of chooseQuantizationParams.
+    float scale = (max - min) / 255;
+    if (scale == 0) {
+      scale = 0.1;
+    }
+    int32_t offset = (int32_t)nearbyintf(-128 - min / scale);
+    offset = MAX(-128, MIN(127, offset));
+
+    int8_t *row = scratch + n * rowStride;
+    int8_t *q = row + LIBJIT_DYNAMIC_ROW_HEADER;
+    int32_t sum = 0;
+    for (k = 0; k < inSize; k++) {
+      q[k] = libjit_clip((int32_t)nearbyintf(x[k] / scale + offset));
+      sum += q[k];
+    }
+    memcpy(row, &scale, sizeof(float));
+    memcpy(row + 4, &offset, sizeof(int32_t));
+    memcpy(row + 8, &sum, sizeof(int32_t));
+  }
+}
+
+/// Computes the output columns [\p colBegin, \p colEnd) of the fully
+/// connected layer whose \p batch input rows were quantized into \p scratch
+/// by libjit_dynamic_quantize_rows_f. The int8 \p weights are laid out as in
+/// libjit_rowwise_quantized_fc_f. The products are accumulated in int32,
+/// and the offsets are applied once per output with the sums of the rows:
+/// sum((x - ox) * (w - ow)) = sum(x * w) - ow * sum(x) - ox * sum(w) +
+/// inSize * ox * ow.
+void libjit_dynamic_quantized_fc_f(float *dest, const int8_t *scratch,
+                                   const int8_t *weights, const float *scales,
+                                   const int32_t *offsets, const float *bias,
+                                   size_t batch, size_t inSize, size_t outSize,
+                                   size_t rowStride, size_t colBegin,
+                                   size_t colEnd) {
+  for (size_t j = colBegin; j < colEnd; j++) {
+    const int8_t *w = weights + j * inSize;
+    if (j + 1 < colEnd) {
+      libjit_prefetch_row(w + inSize, inSize);
+    }
+    int32_t wOffset = offsets[j];
+    int32_t wSum = 0;
+    for (size_t k = 0; k < inSize; k++) {
+      wSum += w[k];
+    }
+    for (size_t n = 0; n < batch; n++) {
+      const int8_t *row = scratch + n * rowStride;
+      const int8_t *q = row + LIBJIT_DYNAMIC_ROW_HEADER;
+      float xScale;
+      int32_t xOffset, xSum;
+      memcpy(&xScale, row, sizeof(float));
+      memcpy(&xOffset, row + 4, sizeof(int32_t));
+      memcpy(&xSum, row + 8, sizeof(int32_t));
+      // The widening multiply-add of int8 values is vectorized by the
+      // compiler.
+      int32_t sum = 0;
+      for (size_t k = 0; k < inSize; k++) {
+        sum += (int32_t)q[k] * (int32_t)w[k];
+      }
+      sum += -wOffset * xSum - xOffset * wSum +
+             (int32_t)inSize * xOffset * wOffset;
+      dest[n * outSize + j] = sum * xScale * scales[j] + bias[j];
+    }
+  }
+}
+
 void libjit_scatterassign_f(float *data, const size_t *indices,
                             const float *slices, size_t numIndices,
                             size_t sliceSize) {
@@ -912,6 +1561,64 @@ void libjit_local_response_normalization_f(float *outW, const float *inW,
   }       // N
 }
 
+/// Same as libjit_local_response_normalization_f for the pixels [\p
+/// pixelBegin, \p pixelEnd) of the NHWC tensor \p inW, without storing the
+/// scales for the gradient. The squares of the channels of a pixel are kept
+/// in a buffer with \p halfWindow zeros on both sides, so that every window
+/// is full and the window sums of 8 channels are computed with vector loads.
+/// The common exponents 0.5 and 0.75 are computed with square roots, which
+/// are vectorized, instead of pow.
+void libjit_local_response_normalization_inference_f(
+    float *outW, const float *inW, const size_t *outWdims,
+    const size_t *inWdims, size_t halfWindow, float alpha, float beta, float k,
+    size_t pixelBegin, size_t pixelEnd) {
+  size_t C = inWdims[3];
+  size_t window = 2 * halfWindow + 1;
+  float normedAlpha = alpha / window;
+  float squares[C + 2 * halfWindow];
+  float scales[C];
+  memset(squares, 0, sizeof(squares));
+  float *channelSquares = squares + halfWindow;
+
+  for (size_t px = pixelBegin; px < pixelEnd; px++) {
+    // The output may be the input, so it is only written by the last loop.
+    const float *in = inW + px * C;
+    float *out = outW + px * outWdims[3];
+    for (size_t c = 0; c < C; c++) {
+      channelSquares[c] = in[c] * in[c];
+    }
+    size_t c = 0;
+    for (; c + 8 <= C; c += 8) {
+      float8 m2 = LoaduFloat8(squares + c);
+      for (size_t i = 1; i < window; i++) {
+        m2 += LoaduFloat8(squares + c + i);
+      }
+      StoreuFloat8(scales + c, k + normedAlpha * m2);
+    }
+    for (; c < C; c++) {
+      float m2 = 0;
+      for (size_t i = 0; i < window; i++) {
+        m2 += squares[c + i];
+      }
+      scales[c] = k + normedAlpha * m2;
+    }
+
+    if (beta == 0.75f) {
+      for (size_t c = 0; c < C; c++) {
+        out[c] = in[c] / sqrtf(scales[c] * sqrtf(scales[c]));
+      }
+    } else if (beta == 0.5f) {
+      for (size_t c = 0; c < C; c++) {
+        out[c] = in[c] / sqrtf(scales[c]);
+      }
+    } else {
+      for (size_t c = 0; c < C; c++) {
+        out[c] = in[c] * powf(scales[c], -beta);
+      }
+    }
+  }
+}
+
 void libjit_local_response_normalization_grad_f(
     float *inG, const float *outG, const float *inW, const float *outW,
     const float *scaleCache, const size_t *outWdims, size_t halfWindow,
@@ -960,6 +1667,99 @@ void libjit_local_response_normalization_grad_f(
   }     // N
 }
 
+/// The batch normalization kernels see the tensors as {outer, numChannels,
+/// inner}, where outer and inner are the products of the dimensions before
+/// and after the channel.
+
+/// Computes the rows [\p rowBegin, \p rowEnd) of \p outer * \p numChannels
+/// rows of \p inner elements of the batch normalization \p dest of \p src.
+void libjit_batch_normalization_f(float *dest, const float *src,
+                                  const float *scale, const float *bias,
+                                  const float *mean, const float *var,
+                                  size_t numChannels, size_t inner,
+                                  float epsilon, size_t rowBegin,
+                                  size_t rowEnd) {
+  for (size_t r = rowBegin; r < rowEnd; r++) {
+    size_t c = r % numChannels;
+    float coef = scale[c] / sqrtf(var[c] + epsilon);
+    float shift = bias[c] - mean[c] * coef;
+    const float *in = src + r * inner;
+    float *out = dest + r * inner;
+    for (size_t i = 0; i < inner; i++) {
+      out[i] = in[i] * coef + shift;
+    }
+  }
+}
+
+/// Computes the channels [\p cBegin, \p cEnd) of the gradients of the input,
+/// the scale and the bias of a batch normalization, with a reduction pass
+/// and an elementwise pass over each channel.
+void libjit_batch_normalization_grad_f(
+    float *srcG, float *scaleG, float *biasG, const float *src,
+    const float *scale, const float *mean, const float *var,
+    const float *destG, size_t outer, size_t numChannels, size_t inner,
+    float epsilon, size_t cBegin, size_t cEnd) {
+  float N = outer * inner;
+  for (size_t c = cBegin; c < cEnd; c++) {
+    float mu = mean[c];
+    float sumDy = 0, sumDyhmu = 0;
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        float dy = destG[base + i];
+        sumDy += dy;
+        sumDyhmu += dy * (src[base + i] - mu);
+      }
+    }
+    float invVar = 1 / (var[c] + epsilon);
+    float invVarSqrt = sqrtf(invVar);
+    float coef1 = scale[c] * invVarSqrt / N;
+    float coef2 = invVar * sumDyhmu;
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        srcG[base + i] = coef1 * (N * destG[base + i] - sumDy -
+                                  (src[base + i] - mu) * coef2);
+      }
+    }
+    biasG[c] = sumDy;
+    scaleG[c] = sumDyhmu * invVarSqrt;
+  }
+}
+
+/// Computes the channels [\p cBegin, \p cEnd) of the running mean and
+/// variance of a batch normalization: the mean and the variance of the
+/// channel in \p src, computed in two passes, blended with \p mean and
+/// \p var with \p momentum.
+void libjit_mean_var_normalization_f(float *newMean, float *newVar,
+                                     const float *src, const float *mean,
+                                     const float *var, size_t outer,
+                                     size_t numChannels, size_t inner,
+                                     float momentum, size_t cBegin,
+                                     size_t cEnd) {
+  float N = outer * inner;
+  for (size_t c = cBegin; c < cEnd; c++) {
+    float sum = 0;
+    for (size_t o = 0; o < outer; o++) {
+      const float *in = src + (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        sum += in[i];
+      }
+    }
+    float localMean = sum / N;
+    float sumSq = 0;
+    for (size_t o = 0; o < outer; o++) {
+      const float *in = src + (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        float d = in[i] - localMean;
+        sumSq += d * d;
+      }
+    }
+    newMean[c] = momentum * localMean + (1 - momentum) * mean[c];
+    newVar[c] = momentum * (sumSq / N) + (1 - momentum) * var[c];
+  }
+}
+
 void libjit_max_pool_i8(const int8_t *inW, int8_t *outW, const size_t *inWdims,
                         const size_t *outWdims, size_t *kernelSizes,
                         size_t *strides, size_t *pads) {
@@ -987,11 +1787,14 @@ void libjit_max_pool_xy_f(const float *inW, float *outW, size_t *inXY,
                              strides, pads);
 }
 
+/// Computes the gradient \p inG of the input of a max pool for the samples
+/// [\p sampleBegin, \p sampleEnd) of the batch.
 void libjit_max_pool_xy_grad_f(float *inG, const float *outG,
                                const size_t *inXY, const size_t *inGdims,
-                               const size_t *outWdims) {
+                               const size_t *outWdims, size_t sampleBegin,
+                               size_t sampleEnd) {
   // NHWC format is assumed
-  for (size_t n = 0; n < outWdims[0]; n++) {
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
     for (size_t z = 0; z < outWdims[3]; z++) {
       // Clear inG
       for (size_t x = 0; x < inGdims[1]; x++) {
@@ -1027,6 +1830,8 @@ void libjit_avg_pool_i8(const int8_t *inW, int8_t *outW, const size_t *inWdims,
   size_t stride_w = strides[1];
   size_t kernel_h = kernelSizes[0];
   size_t kernel_w = kernelSizes[1];
+  size_t channels = outWdims[3];
+  constexpr size_t cbSize = pool_block_size;
   // For each input in the batch:
   for (size_t n = 0; n < outWdims[0]; n++) {
     // For each (x,y) step in the input/output tensor:
@@ -1034,28 +1839,19 @@ void libjit_avg_pool_i8(const int8_t *inW, int8_t *outW, const size_t *inWdims,
     for (size_t ax = 0; ax < outWdims[1]; x += stride_h, ax++) {
       ssize_t y = -ssize_t(pad_l);
       for (size_t ay = 0; ay < outWdims[2]; y += stride_w, ay++) {
-        // For each layer in the output tensor:
-        for (size_t z = 0; z < inWdims[3]; z++) {
-          int32_t sum = 0;
-
-          for (size_t fx = 0; fx < kernel_h; fx++) {
-            for (size_t fy = 0; fy < kernel_w; fy++) {
-              ssize_t ox = x + fx;
-              ssize_t oy = y + fy;
-
-              // Ignore index access below zero (this is due to padding).
-              if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
-                  oy >= (ssize_t)inWdims[2]) {
-                continue;
-              }
-              sum +=
-                  inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)] -
-                  inOffset;
-            }
+        // For each block of channels in the output tensor:
+        for (size_t cb = 0; cb < channels; cb += cbSize) {
+          size_t cbLen = MIN(cbSize, channels - cb);
+          int32_t sum[cbSize];
+          int32_t count = libjit_avg_pool_sum_block(
+              sum, inW, inWdims, n, x, y, cb, cbLen, kernel_h, kernel_w);
+
+          int8_t *out = outW + libjit_getXYZW(outWdims, n, ax, ay, cb);
+          for (size_t c = 0; c < cbLen; c++) {
+            out[c] = libjit_clip(libjit_scale_i32i8(sum[c] - count * inOffset,
+                                                    outPre, outPost, outScale,
+                                                    outOffset));
           }
-
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = libjit_clip(
-              libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset));
         } // C
       }   // W
     }     // H
@@ -1071,6 +1867,8 @@ void libjit_avg_pool_f(const float *inW, float *outW, const size_t *inWdims,
   size_t stride_w = strides[1];
   size_t kernel_h = kernelSizes[0];
   size_t kernel_w = kernelSizes[1];
+  size_t channels = outWdims[3];
+  constexpr size_t cbSize = pool_block_size;
   float filterArea = kernel_h * kernel_w;
   // For each input in the batch:
   for (size_t n = 0; n < outWdims[0]; n++) {
@@ -1079,36 +1877,30 @@ void libjit_avg_pool_f(const float *inW, float *outW, const size_t *inWdims,
     for (size_t ax = 0; ax < outWdims[1]; x += stride_h, ax++) {
       ssize_t y = -(ssize_t)pad_l;
       for (size_t ay = 0; ay < outWdims[2]; y += stride_w, ay++) {
-        // For each layer in the output tensor:
-        for (size_t z = 0; z < inWdims[3]; z++) {
-
-          float sum = 0;
-
-          for (size_t fx = 0; fx < kernel_h; fx++) {
-            for (size_t fy = 0; fy < kernel_w; fy++) {
-              ssize_t ox = x + fx;
-              ssize_t oy = y + fy;
-
-              // Ignore index access below zero (this is due to padding).
-              if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
-                  oy >= (ssize_t)inWdims[2]) {
-                continue;
-              }
-
-              sum += inW[libjit_getXYZW(inWdims, n, (size_t)ox, (size_t)oy, z)];
-            }
+        // For each block of channels in the output tensor:
+        for (size_t cb = 0; cb < channels; cb += cbSize) {
+          size_t cbLen = MIN(cbSize, channels - cb);
+          float sum[cbSize];
+          libjit_avg_pool_sum_block(sum, inW, inWdims, n, x, y, cb, cbLen,
+                                    kernel_h, kernel_w);
+
+          float *out = outW + libjit_getXYZW(outWdims, n, ax, ay, cb);
+          for (size_t c = 0; c < cbLen; c++) {
+            // The padding counts as zeros.
+            out[c] = sum[c] / filterArea;
           }
-
-          outW[libjit_getXYZW(outWdims, n, ax, ay, z)] = sum / filterArea;
         } // C
       }   // W
     }     // H
   }       // N
 }
 
+/// Computes the gradient \p inG of the input of an average pool for the
+/// samples [\p sampleBegin, \p sampleEnd) of the batch.
 void libjit_avg_pool_grad_f(float *inG, const float *outG,
                             const size_t *inGdims, const size_t *outWdims,
-                            size_t *kernels, size_t *strides, size_t *pads) {
+                            size_t *kernels, size_t *strides, size_t *pads,
+                            size_t sampleBegin, size_t sampleEnd) {
   size_t pad_t = pads[0];
   size_t pad_l = pads[1];
   size_t stride_h = strides[0];
@@ -1118,7 +1910,7 @@ void libjit_avg_pool_grad_f(float *inG, const float *outG,
   float kernelArea = kernel_h * kernel_w;
 
   // NHWC format is assumed
-  for (size_t n = 0; n < outWdims[0]; n++) {
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
     for (size_t z = 0; z < outWdims[3]; z++) {
       // Clear inG
       for (size_t x = 0; x < inGdims[1]; x++) {
@@ -1157,6 +1949,73 @@ void libjit_quantize_i8(int8_t *outW, const float *inW, size_t numElem,
   }
 }
 
+void libjit_quantize_i16(int16_t *outW, const float *inW, size_t numElem,
+                         float scale, int32_t offset) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = libjit_round_clip_i16(inW[i] / scale + offset);
+  }
+}
+
+/// Update the histogram \p histogram of \p nBins bins and the range stored in
+/// \p compInfo with the \p numElem values of \p inW. This mirrors
+/// quantization::generateTensorHistogram().
+void libjit_quantization_profile(const float *inW, size_t numElem,
+                                 float *compInfo, float *histogram,
+                                 const size_t *histDims) {
+  size_t nBins = histDims[0];
+
+  // Find the range of the input. Keep 8 independent partial results, so that
+  // the loop can be vectorized.
+  float mins[8];
+  float maxs[8];
+  for (size_t j = 0; j < 8; j++) {
+    mins[j] = inW[0];
+    maxs[j] = inW[0];
+  }
+  size_t i = 0;
+  for (; i + 8 <= numElem; i += 8) {
+    for (size_t j = 0; j < 8; j++) {
+      mins[j] = MIN(mins[j], inW[i + j]);
+      maxs[j] = MAX(maxs[j], inW[i + j]);
+    }
+  }
+  for (; i < numElem; i++) {
+    mins[0] = MIN(mins[0], inW[i]);
+    maxs[0] = MAX(maxs[0], inW[i]);
+  }
+  float minInput = mins[0];
+  float maxInput = maxs[0];
+  for (size_t j = 1; j < 8; j++) {
+    minInput = MIN(minInput, mins[j]);
+    maxInput = MAX(maxInput, maxs[j]);
+  }
+
+  bool isEmpty = true;
+  for (size_t b = 0; b < nBins; b++) {
+    isEmpty &= histogram[b] == 0;
+  }
+
+  float min = isEmpty ? minInput : compInfo[0];
+  float max = isEmpty ? maxInput : compInfo[1];
+
+  // Check if we need to rescale histogram.
+  if (minInput < min || maxInput > max) {
+    float newMin = MIN(minInput, min);
+    float newMax = MAX(maxInput, max);
+    libjit_rescale_histogram(histogram, nBins, min, max, newMin, newMax);
+    min = newMin;
+    max = newMax;
+  }
+
+  float binWidth = (max - min) / nBins;
+  for (i = 0; i < numElem; i++) {
+    histogram[libjit_get_bin(nBins, binWidth, min, inW[i])]++;
+  }
+
+  compInfo[0] = min;
+  compInfo[1] = max;
+}
+
 void libjit_dequantize_f(float *outW, const int8_t *inW, size_t numElem,
                          float scale, int32_t offset) {
   for (size_t i = 0; i < numElem; i++) {
@@ -1164,16 +2023,48 @@ void libjit_dequantize_f(float *outW, const int8_t *inW, size_t numElem,
   }
 }
 
+void libjit_dequantize_i16_f(float *outW, const int16_t *inW, size_t numElem,
+                             float scale, int32_t offset) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = scale * (inW[i] - offset);
+  }
+}
+
 void libjit_rescale_i8(int8_t *outW, const int8_t *inW, size_t numElem,
                        int32_t outOffset, int32_t inOffset, int32_t pre,
                        int32_t post, int32_t scale) {
-  for (size_t i = 0; i < numElem; i++) {
+  size_t i = 0;
+  for (; i + 8 <= numElem; i += 8) {
+    libjit_store_i8x8(outW + i,
+                      libjit_scale_i32i8x8(libjit_load_i8x8(inW + i) - inOffset,
+                                           pre, post, scale, outOffset));
+  }
+  for (; i < numElem; i++) {
     int32_t s =
         libjit_scale_i32i8(inW[i] - inOffset, pre, post, scale, outOffset);
     outW[i] = libjit_clip(s);
   }
 }
 
+/// The rescales from and to 16-bit quantized values, which are inserted where
+/// the precision of the graph changes. \p scale is the ratio of the input
+/// scale to the output scale.
+#define DEFINE_RESCALE_I16(name, outTy, inTy, clip)                            \
+  void name(outTy *outW, const inTy *inW, size_t numElem, int32_t outOffset,   \
+            int32_t inOffset, float scale) {                                   \
+    for (size_t i = 0; i < numElem; i++) {                                     \
+      outW[i] = clip(scale * (inW[i] - inOffset) + outOffset);                 \
+    }                                                                          \
+  }
+
+DEFINE_RESCALE_I16(libjit_rescale_from_i16_i16, int16_t, int16_t,
+                   libjit_round_clip_i16)
+DEFINE_RESCALE_I16(libjit_rescale_from_i8_i16, int16_t, int8_t,
+                   libjit_round_clip_i16)
+DEFINE_RESCALE_I16(libjit_rescale_from_i16_i8, int8_t, int16_t,
+                   libjit_round_clip_i8)
+#undef DEFINE_RESCALE_I16
+
 void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
                       const size_t *odim) {
   for (size_t n = 0; n < idim[0]; n++) {
@@ -1188,7 +2079,7 @@ void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
 
     // Compute exp.
     for (size_t i = 0; i < idim[1]; i++) {
-      float e = expf(inW[libjit_getXY(idim, n, i)] - max);
+      float e = libjit_expf(inW[libjit_getXY(idim, n, i)] - max);
       sum += e;
       outW[libjit_getXY(odim, n, i)] = e;
     }
@@ -1200,9 +2091,42 @@ void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
   } // N
 }
 
+/// Computes the rows [\p rowBegin, \p rowEnd) of the int8 softmax of \p inW.
+/// The softmax of a row only depends on the distance d from each input to the
+/// maximum of the row, so \p expTable holds exp(-d * s) for the 256 distances
+/// and the input scale s, and no exponential is computed here. The outputs
+/// are quantized with \p invOutScale and \p outOffset.
+void libjit_softmax_i8(const int8_t *inW, int8_t *outW, const size_t *idim,
+                       const size_t *odim, const float *expTable,
+                       float invOutScale, int32_t outOffset, size_t rowBegin,
+                       size_t rowEnd) {
+  for (size_t n = rowBegin; n < rowEnd; n++) {
+    const int8_t *in = inW + libjit_getXY(idim, n, 0);
+    int8_t *out = outW + libjit_getXY(odim, n, 0);
+    int32_t max = in[0];
+    for (size_t i = 1; i < idim[1]; i++) {
+      max = MAX(max, in[i]);
+    }
+
+    float sum = 0;
+    for (size_t i = 0; i < idim[1]; i++) {
+      sum += expTable[max - in[i]];
+    }
+
+    float mul = invOutScale / sum;
+    for (size_t i = 0; i < idim[1]; i++) {
+      int32_t q = (int32_t)nearbyintf(expTable[max - in[i]] * mul) + outOffset;
+      out[i] = libjit_clip(q);
+    }
+  }
+}
+
+/// Computes the rows [\p rowBegin, \p rowEnd) of the gradient \p inG of the
+/// input of a softmax.
 void libjit_softmax_grad_f(float *inG, float *outW, const size_t *selectedW,
-                           const size_t *idim, const size_t *selectdim) {
-  for (size_t n = 0; n < idim[0]; n++) {
+                           const size_t *idim, const size_t *selectdim,
+                           size_t rowBegin, size_t rowEnd) {
+  for (size_t n = rowBegin; n < rowEnd; n++) {
     for (size_t i = 0; i < idim[1]; i++) {
       float delta = (selectedW[libjit_getXY(selectdim, n, 0)] == i);
       inG[libjit_getXY(idim, n, i)] = outW[libjit_getXY(idim, n, i)] - delta;
@@ -1212,11 +2136,263 @@ void libjit_softmax_grad_f(float *inG, float *outW, const size_t *selectedW,
 
 void libjit_sigmoid_f(const float *inW, float *outW, size_t numElem) {
   for (size_t i = 0; i < numElem; i++) {
-    float e = expf(inW[i]);
-    outW[i] = e / (e + 1);
+    outW[i] = libjit_sigmoidf(inW[i]);
+  }
+}
+
+/// Computes the elements [\p begin, \p end) of the new hidden and cell states
+/// of an LSTM, whose hidden size is \p hidden, in a single pass over the
+/// gates. The gates are in the order input, forget, cell, output.
+void libjit_lstm_unit_f(float *newH, float *newC, const float *inputGates,
+                        const float *hiddenGates, const float *C, size_t hidden,
+                        size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    size_t n = i / hidden;
+    size_t j = i % hidden;
+    const float *ig = inputGates + 4 * hidden * n + j;
+    const float *hg = hiddenGates + 4 * hidden * n + j;
+    float g[4];
+    for (size_t k = 0; k < 4; k++) {
+      g[k] = ig[k * hidden] + hg[k * hidden];
+    }
+    float inputGate = libjit_sigmoidf(g[0]);
+    float forgetGate = libjit_sigmoidf(g[1]);
+    float cellGate = libjit_tanhf(g[2]);
+    float outputGate = libjit_sigmoidf(g[3]);
+    float c = forgetGate * C[i] + inputGate * cellGate;
+    newC[i] = c;
+    newH[i] = outputGate * libjit_tanhf(c);
+  }
+}
+
+/// Computes the elements [\p begin, \p end) of the SGD update \p newW of the
+/// weights \p W with the gradients \p G in a single pass. \p scale is the
+/// negated learning rate divided by the batch size. \p newW may be \p W.
+void libjit_sgd_f(float *newW, const float *W, const float *G, float L1Decay,
+                  float L2Decay, float scale, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    float w = W[i];
+    float gij = G[i] + L1Decay * (w >= 0 ? 1.0f : -1.0f) + L2Decay * w;
+    newW[i] = w + scale * gij;
+  }
+}
+
+/// Same as libjit_sgd_f, but adds the accumulated update \p gsum times
+/// \p momentum to the update, and stores the result back into \p gsum.
+void libjit_momentum_sgd_f(float *newW, const float *W, const float *G,
+                           float *gsum, float L1Decay, float L2Decay,
+                           float scale, float momentum, size_t begin,
+                           size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    float w = W[i];
+    float gij = G[i] + L1Decay * (w >= 0 ? 1.0f : -1.0f) + L2Decay * w;
+    float dx = momentum * gsum[i] + scale * gij;
+    gsum[i] = dx;
+    newW[i] = w + dx;
+  }
+}
+
+/// Computes the elements [\p begin, \p end) of the Adagrad update \p newW of
+/// the weights \p W with the gradients \p G, and adds the squares of the
+/// gradients to \p sumSq. \p gradScale is the inverse of the batch size.
+/// \p newW may be \p W.
+void libjit_adagrad_f(float *newW, const float *W, const float *G,
+                      float *sumSq, float L1Decay, float L2Decay,
+                      float gradScale, float learningRate, float epsilon,
+                      size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    float w = W[i];
+    float g =
+        (G[i] + L1Decay * (w >= 0 ? 1.0f : -1.0f) + L2Decay * w) * gradScale;
+    float s = sumSq[i] + g * g;
+    sumSq[i] = s;
+    newW[i] = w - learningRate * g / (sqrtf(s) + epsilon);
+  }
+}
+
+/// Same as libjit_adagrad_f, but \p meanSq holds the moving average of the
+/// squares of the gradients with the decay \p decay.
+void libjit_rmsprop_f(float *newW, const float *W, const float *G,
+                      float *meanSq, float L1Decay, float L2Decay,
+                      float gradScale, float learningRate, float decay,
+                      float epsilon, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    float w = W[i];
+    float g =
+        (G[i] + L1Decay * (w >= 0 ? 1.0f : -1.0f) + L2Decay * w) * gradScale;
+    float s = decay * meanSq[i] + (1 - decay) * g * g;
+    meanSq[i] = s;
+    newW[i] = w - learningRate * g / (sqrtf(s) + epsilon);
+  }
+}
+
+/// Computes the elements [\p begin, \p end) of the Adam update \p newW of the
+/// weights \p W with the gradients \p G, and updates the moment estimates
+/// \p M and \p V. \p step holds the number of previous updates, which
+/// libjit_adam_step_f increments once all the elements are updated.
+void libjit_adam_f(float *newW, const float *W, const float *G, float *M,
+                   float *V, const float *step, float L1Decay, float L2Decay,
+                   float gradScale, float learningRate, float beta1,
+                   float beta2, float epsilon, size_t begin, size_t end) {
+  float t = step[0] + 1;
+  float stepSize = learningRate / (1 - powf(beta1, t));
+  float invCorrection2 = 1 / (1 - powf(beta2, t));
+  for (size_t i = begin; i < end; i++) {
+    float w = W[i];
+    float g =
+        (G[i] + L1Decay * (w >= 0 ? 1.0f : -1.0f) + L2Decay * w) * gradScale;
+    float m = beta1 * M[i] + (1 - beta1) * g;
+    float v = beta2 * V[i] + (1 - beta2) * g * g;
+    M[i] = m;
+    V[i] = v;
+    newW[i] = w - stepSize * m / (sqrtf(v * invCorrection2) + epsilon);
+  }
+}
+
+/// Increments the number of updates \p step of an Adam optimizer.
+void libjit_adam_step_f(float *step) { step[0] += 1; }
+
+/// Computes the gradients \p rows of the rows that a sparse lengths weighted
+/// sum gathers: row i is the gradient \p outG of the segment of index i,
+/// scaled by the weight \p weights[i]. The rows and the segments have
+/// \p lineSize elements.
+void libjit_sparse_lengths_weighted_sum_row_grad_f(
+    float *rows, const float *outG, const float *weights,
+    const size_t *lengths, size_t segments, size_t lineSize) {
+  size_t i = 0;
+  for (size_t n = 0; n < segments; n++) {
+    const float *segG = outG + n * lineSize;
+    for (size_t j = 0; j < lengths[n]; j++, i++) {
+      float w = weights[i];
+      float *row = rows + i * lineSize;
+      for (size_t k = 0; k < lineSize; k++) {
+        row[k] = w * segG[k];
+      }
+    }
+  }
+}
+
+/// Updates in place the rows \p indices of the weights \p W, of \p lineSize
+/// elements, with the SGD steps of the rows of the gradients \p G. \p scale is
+/// the negated learning rate divided by the batch size.
+void libjit_sparse_sgd_f(float *W, const float *G, const size_t *indices,
+                         size_t numIndices, size_t lineSize, float L1Decay,
+                         float L2Decay, float scale) {
+  for (size_t i = 0; i < numIndices; i++) {
+    float *row = W + indices[i] * lineSize;
+    libjit_sgd_f(row, row, G + i * lineSize, L1Decay, L2Decay, scale, 0,
+                 lineSize);
+  }
+}
+
+/// Same as libjit_sparse_sgd_f, but with the Adagrad steps, which add the
+/// squares of the gradients to the rows \p indices of \p sumSq.
+void libjit_sparse_adagrad_f(float *W, const float *G, const size_t *indices,
+                             float *sumSq, size_t numIndices, size_t lineSize,
+                             float L1Decay, float L2Decay, float gradScale,
+                             float learningRate, float epsilon) {
+  for (size_t i = 0; i < numIndices; i++) {
+    size_t offset = indices[i] * lineSize;
+    libjit_adagrad_f(W + offset, W + offset, G + i * lineSize, sumSq + offset,
+                     L1Decay, L2Decay, gradScale, learningRate, epsilon, 0,
+                     lineSize);
   }
 }
 
+/// Computes the elements [\p begin, \p end) of the new hidden state of a GRU,
+/// whose hidden size is \p hidden, in a single pass over the gates. The gates
+/// are in the order reset, update, new.
+void libjit_gru_unit_f(float *dest, const float *inputGates,
+                       const float *hiddenGates, const float *H, size_t hidden,
+                       size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    size_t n = i / hidden;
+    size_t j = i % hidden;
+    const float *ig = inputGates + 3 * hidden * n + j;
+    const float *hg = hiddenGates + 3 * hidden * n + j;
+    float resetGate = libjit_sigmoidf(ig[0] + hg[0]);
+    float updateGate = libjit_sigmoidf(ig[hidden] + hg[hidden]);
+    float newGate = libjit_tanhf(ig[2 * hidden] + resetGate * hg[2 * hidden]);
+    dest[i] = newGate + updateGate * (H[i] - newGate);
+  }
+}
+
+/// \returns the number of time steps out of \p steps that a sequence of the
+/// \p batch entries of lengths \p lengths has to compute.
+size_t libjit_sequence_steps_u(const size_t *lengths, size_t steps,
+                               size_t batch) {
+  size_t maxLength = 0;
+  for (size_t n = 0; n < batch; n++) {
+    maxLength = MAX(maxLength, lengths[n]);
+  }
+  return MIN(maxLength, steps);
+}
+
+/// Fills the time steps [\p begin, \p steps) of \p dest with the state of
+/// the step before \p begin, or \p initH if \p begin is zero.
+void libjit_sequence_repeat_f(float *dest, const float *initH, size_t begin,
+                              size_t steps, size_t stateSize) {
+  const float *last = begin ? dest + (begin - 1) * stateSize : initH;
+  for (size_t t = begin; t < steps; t++) {
+    memcpy(dest + t * stateSize, last, stateSize * sizeof(float));
+  }
+}
+
+/// Computes the elements [\p begin, \p end) of the hidden state \p newH of
+/// the time step \p t of a simple RNN from the contributions \p inputGates
+/// of the input and \p hiddenGates of the previous hidden state \p h. The
+/// entries past their length in \p lengths keep their state.
+void libjit_rnn_step_f(float *newH, const float *inputGates, const float *h,
+                       const float *hiddenGates, const size_t *lengths,
+                       size_t t, size_t hidden, size_t begin, size_t end) {
+  libjit_sequence_step(
+      lengths, t, hidden, begin, end,
+      [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+          newH[i] = libjit_tanhf(inputGates[i] + hiddenGates[i]);
+        }
+      },
+      [&](size_t first, size_t last) {
+        memcpy(newH + first, h + first, (last - first) * sizeof(float));
+      });
+}
+
+/// Same as libjit_rnn_step_f for an LSTM, which also computes the cell state
+/// \p newC from the previous one \p C. \p newC may be \p C.
+void libjit_lstm_step_f(float *newH, float *newC, const float *inputGates,
+                        const float *h, const float *C,
+                        const float *hiddenGates, const size_t *lengths,
+                        size_t t, size_t hidden, size_t begin, size_t end) {
+  libjit_sequence_step(
+      lengths, t, hidden, begin, end,
+      [&](size_t first, size_t last) {
+        libjit_lstm_unit_f(newH, newC, inputGates, hiddenGates, C, hidden,
+                           first, last);
+      },
+      [&](size_t first, size_t last) {
+        size_t bytes = (last - first) * sizeof(float);
+        memcpy(newH + first, h + first, bytes);
+        if (newC != C) {
+          memcpy(newC + first, C + first, bytes);
+        }
+      });
+}
+
+/// Same as libjit_rnn_step_f for a GRU.
+void libjit_gru_step_f(float *newH, const float *inputGates, const float *h,
+                       const float *hiddenGates, const size_t *lengths,
+                       size_t t, size_t hidden, size_t begin, size_t end) {
+  libjit_sequence_step(
+      lengths, t, hidden, begin, end,
+      [&](size_t first, size_t last) {
+        libjit_gru_unit_f(newH, inputGates, hiddenGates, h, hidden, first,
+                          last);
+      },
+      [&](size_t first, size_t last) {
+        memcpy(newH + first, h + first, (last - first) * sizeof(float));
+      });
+}
+
 void libjit_topk_f(float *values, size_t *indices, const float *input,
                    size_t *scratch, size_t k, size_t n, size_t size) {
   libjit_topk(values, indices, input, scratch, k, n, size);
@@ -1245,6 +2421,24 @@ void libjit_transpose_u(const size_t *inW, size_t *outW, const size_t *idim,
   libjit_transpose_generic(inW, outW, idim, odim, shuffle, numDims);
 }
 
+void libjit_transpose_i16(const int16_t *inW, int16_t *outW,
+                          const size_t *idim, const size_t *odim,
+                          const size_t *shuffle, size_t numDims) {
+  libjit_transpose_generic(inW, outW, idim, odim, shuffle, numDims);
+}
+
+void libjit_transpose_f16(const uint16_t *inW, uint16_t *outW,
+                          const size_t *idim, const size_t *odim,
+                          const size_t *shuffle, size_t numDims) {
+  libjit_transpose_generic(inW, outW, idim, odim, shuffle, numDims);
+}
+
+void libjit_transpose_bf16(const uint16_t *inW, uint16_t *outW,
+                           const size_t *idim, const size_t *odim,
+                           const size_t *shuffle, size_t numDims) {
+  libjit_transpose_generic(inW, outW, idim, odim, shuffle, numDims);
+}
+
 void libjit_insert_tensor_f(float *tensor, float *slice, size_t *offset,
                             size_t *tensorDim, size_t *sliceDim,
                             size_t numDimsTensor, size_t numDimsSlice,
@@ -1293,6 +2487,229 @@ void libjit_insert_tensor_i8(int8_t *tensor, int8_t *slice, size_t *offset,
                        numDimsTensor, numDimsSlice, offsetDim, count, axis);
 }
 
+void libjit_insert_tensor_i16(int16_t *tensor, int16_t *slice, size_t *offset,
+                              size_t *tensorDim, size_t *sliceDim,
+                              size_t numDimsTensor, size_t numDimsSlice,
+                              size_t offsetDim, size_t count, size_t axis) {
+  libjit_insert_tensor(tensor, slice, offset, tensorDim, sliceDim,
+                       numDimsTensor, numDimsSlice, offsetDim, count, axis);
+}
+
+void libjit_extract_tensor_i16(int16_t *tensor, int16_t *slice, size_t *offset,
+                               size_t *tensorDim, size_t *sliceDim,
+                               size_t numDimsTensor, size_t numDimsSlice,
+                               size_t offsetDim) {
+  libjit_extract_tensor(tensor, slice, offset, tensorDim, sliceDim,
+                        numDimsTensor, numDimsSlice, offsetDim);
+}
+
+void libjit_insert_tensor_f16(uint16_t *tensor, uint16_t *slice,
+                              size_t *offset, size_t *tensorDim,
+                              size_t *sliceDim, size_t numDimsTensor,
+                              size_t numDimsSlice, size_t offsetDim,
+                              size_t count, size_t axis) {
+  libjit_insert_tensor(tensor, slice, offset, tensorDim, sliceDim,
+                       numDimsTensor, numDimsSlice, offsetDim, count, axis);
+}
+
+void libjit_extract_tensor_f16(uint16_t *tensor, uint16_t *slice,
+                               size_t *offset, size_t *tensorDim,
+                               size_t *sliceDim, size_t numDimsTensor,
+                               size_t numDimsSlice, size_t offsetDim) {
+  libjit_extract_tensor(tensor, slice, offset, tensorDim, sliceDim,
+                        numDimsTensor, numDimsSlice, offsetDim);
+}
+
+void libjit_insert_tensor_bf16(uint16_t *tensor, uint16_t *slice,
+                               size_t *offset, size_t *tensorDim,
+                               size_t *sliceDim, size_t numDimsTensor,
+                               size_t numDimsSlice, size_t offsetDim,
+                               size_t count, size_t axis) {
+  libjit_insert_tensor(tensor, slice, offset, tensorDim, sliceDim,
+                       numDimsTensor, numDimsSlice, offsetDim, count, axis);
+}
+
+void libjit_extract_tensor_bf16(uint16_t *tensor, uint16_t *slice,
+                                size_t *offset, size_t *tensorDim,
+                                size_t *sliceDim, size_t numDimsTensor,
+                                size_t numDimsSlice, size_t offsetDim) {
+  libjit_extract_tensor(tensor, slice, offset, tensorDim, sliceDim,
+                        numDimsTensor, numDimsSlice, offsetDim);
+}
+
+/// Expands the \p numElem half-precision values \p inW into the floats \p outW.
+void libjit_convertto_f16_f(float *outW, const uint16_t *inW, size_t numElem) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = libjit_fp16_to_fp32(inW[i]);
+  }
+}
+
+/// Rounds the \p numElem floats \p inW to the half-precision values \p outW.
+void libjit_convertto_f_f16(uint16_t *outW, const float *inW, size_t numElem) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = libjit_fp32_to_fp16(inW[i]);
+  }
+}
+
+/// Expands the \p numElem bfloat16 values \p inW into the floats \p outW.
+void libjit_convertto_bf16_f(float *outW, const uint16_t *inW,
+                             size_t numElem) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = libjit_bf16_to_fp32(libjit_bf16{inW[i]});
+  }
+}
+
+/// Rounds the \p numElem floats \p inW to the bfloat16 values \p outW.
+void libjit_convertto_f_bf16(uint16_t *outW, const float *inW,
+                             size_t numElem) {
+  for (size_t i = 0; i < numElem; i++) {
+    outW[i] = libjit_fp32_to_bf16(inW[i]);
+  }
+}
+
+/// \returns the highest CPU variant of a multi-versioned bundle that the host
+/// can run: 0 for baseline x86-64, 1 for SSE4.2, 2 for AVX2 and FMA, and 3 for
+/// the AVX-512 subset of Skylake servers. The levels and the features match
+/// the CPU variants of BundleSaver. The CPU model is resolved by libgcc or
+/// compiler-rt, which also check that the OS saves the vector registers.
+int libjit_x86_cpu_level() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt")) {
+    return 0;
+  }
+  if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma") ||
+      !__builtin_cpu_supports("bmi") || !__builtin_cpu_supports("bmi2")) {
+    return 1;
+  }
+  if (!__builtin_cpu_supports("avx512f") ||
+      !__builtin_cpu_supports("avx512cd") ||
+      !__builtin_cpu_supports("avx512bw") ||
+      !__builtin_cpu_supports("avx512dq") ||
+      !__builtin_cpu_supports("avx512vl")) {
+    return 2;
+  }
+  return 3;
+#else
+  return 0;
+#endif
+}
+
+/// Decodes the compressed weights file [\p src, \p src + \p srcSize), which
+/// BundleSaver writes, into the constant weights area \p dest of \p destSize
+/// bytes. The file starts with an 8-byte magic and the 64-bit size of the
+/// decoded weights, followed by records. Each record has a 32-bit header with
+/// the kind of the record in its two top bits and a count in the others:
+/// - 0: count bytes, copied as is, padded to 4 bytes in the file;
+/// - 1: count zero bytes, stored in the header alone;
+/// - 2: count floats stored as half-precision values, padded to 4 bytes.
+/// \returns the number of decoded bytes, or 0 if the file is malformed or does
+/// not fit into \p dest.
+size_t libjit_decompress_weights(const uint8_t *src, size_t srcSize,
+                                 uint8_t *dest, size_t destSize) {
+  static const char magic[8] = {'G', 'L', 'O', 'W', 'W', 'Z', 0, 1};
+  uint64_t size;
+  if (srcSize < sizeof(magic) + sizeof(size) ||
+      memcmp(src, magic, sizeof(magic))) {
+    return 0;
+  }
+  memcpy(&size, src + sizeof(magic), sizeof(size));
+  if (size > destSize) {
+    return 0;
+  }
+  const uint8_t *p = src + sizeof(magic) + sizeof(size);
+  const uint8_t *end = src + srcSize;
+  size_t pos = 0;
+  while (p < end) {
+    uint32_t header;
+    if (end - p < (ptrdiff_t)sizeof(header)) {
+      return 0;
+    }
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    size_t count = header & 0x3fffffff;
+    size_t numBytes = (header >> 30) == 2 ? count * sizeof(float) : count;
+    if (numBytes > size - pos) {
+      return 0;
+    }
+    switch (header >> 30) {
+    case 0:
+      if ((size_t)(end - p) < count) {
+        return 0;
+      }
+      memcpy(dest + pos, p, count);
+      p += (count + 3) & ~(size_t)3;
+      break;
+    case 1:
+      memset(dest + pos, 0, count);
+      break;
+    case 2:
+      if ((size_t)(end - p) < count * sizeof(uint16_t)) {
+        return 0;
+      }
+      for (size_t i = 0; i < count; i++) {
+        uint16_t h;
+        memcpy(&h, p + i * sizeof(h), sizeof(h));
+        float f = libjit_fp16_to_fp32(h);
+        memcpy(dest + pos + i * sizeof(f), &f, sizeof(f));
+      }
+      p += (count * sizeof(uint16_t) + 3) & ~(size_t)3;
+      break;
+    default:
+      return 0;
+    }
+    pos += numBytes;
+  }
+  return pos == size ? pos : 0;
+}
+
+/// \returns the value of the monotonic clock in nanoseconds.
+uint64_t libjit_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// Adds the time elapsed since \p begin, as returned by libjit_time_ns, to
+/// the entry \p region of \p profile. The executions of a function running
+/// on different threads share the profile, so the addition is atomic.
+void libjit_time_profile_add(uint64_t *profile, size_t region,
+                             uint64_t begin) {
+  __atomic_fetch_add(&profile[region], libjit_time_ns() - begin,
+                     __ATOMIC_RELAXED);
+}
+
+/// Computes the statistics of every \p step-th element of the \p size
+/// elements of \p data into \p stats: the minimum, the maximum and the sum
+/// of the finite elements, their number, and the numbers of NaNs and
+/// infinities. The elements are classified by their bits, which the fast math
+/// flags of the library can not optimize away, and the loop has no branches,
+/// so that it is vectorized for contiguous tensors.
+void libjit_tensor_health_f(float *stats, const float *data, size_t size,
+                            size_t step) {
+  float min = FLT_MAX, max = -FLT_MAX, sum = 0;
+  size_t numFinite = 0, numNaNs = 0, numInfs = 0;
+  for (size_t i = 0; i < size; i += step) {
+    uint32_t bits;
+    memcpy(&bits, &data[i], sizeof(bits));
+    uint32_t magnitude = bits & 0x7fffffff;
+    bool finite = magnitude < 0x7f800000;
+    float value = finite ? data[i] : 0;
+    min = finite && value < min ? value : min;
+    max = finite && value > max ? value : max;
+    sum += value;
+    numFinite += finite;
+    numNaNs += magnitude > 0x7f800000;
+    numInfs += magnitude == 0x7f800000;
+  }
+  stats[0] = min;
+  stats[1] = max;
+  stats[2] = sum;
+  stats[3] = numFinite;
+  stats[4] = numNaNs;
+  stats[5] = numInfs;
+}
+
 __attribute__((noinline)) void
 libjit_dump_tensor(uint8_t *tensor, size_t *tensorDim, size_t numDimsTensor,
                    size_t elemKind, const char *name) {
@@ -1300,7 +2717,10 @@ libjit_dump_tensor(uint8_t *tensor, size_t *tensorDim, size_t numDimsTensor,
   /// This definition should match the defintion in Glow.
   enum ElemKind {
     FloatTy,
+    Float16Ty,
+    BFloat16Ty,
     Int8QTy,
+    Int16QTy,
     Int32QTy,
     Int64ITy,
   };
@@ -24,6 +24,13 @@
 
 #include "libjit_defs.h"
 
+extern "C" {
+// Forward declare functions from libjit_matmul.
+void libjit_matmul_f(float *c, const float *a, const float *b,
+                     const size_t *cDims, const size_t *aDims,
+                     const size_t *bDims);
+}
+
 namespace {
 // Initialize the convolution output frame for slice \p N with the bias \p
 // biasW.
@@ -251,16 +258,299 @@ void libjit_convDKKC8_foreach_xy_pixels_filter(
   }       // For each X in the output.
 }
 
+/// Transform matrices of the Winograd convolution F(M x M, 3 x 3), which
+/// computes an M x M output tile from an (M + 2) x (M + 2) input tile. The
+/// transformed filter G * g * G^T is computed by the compiler.
+template <size_t M> struct WinogradMatrices;
+
+template <> struct WinogradMatrices<2> {
+  /// The input transform B^T.
+  static const float BT[4][4];
+  /// The output transform A^T.
+  static const float AT[2][4];
+};
+
+const float WinogradMatrices<2>::BT[4][4] = {
+    {1, 0, -1, 0}, {0, 1, 1, 0}, {0, -1, 1, 0}, {0, 1, 0, -1}};
+const float WinogradMatrices<2>::AT[2][4] = {{1, 1, 1, 0}, {0, 1, -1, -1}};
+
+template <> struct WinogradMatrices<4> {
+  /// The input transform B^T.
+  static const float BT[6][6];
+  /// The output transform A^T.
+  static const float AT[4][6];
+};
+
+const float WinogradMatrices<4>::BT[6][6] = {
+    {4, 0, -5, 0, 1, 0},  {0, -4, -4, 1, 1, 0}, {0, 4, -4, -1, 1, 0},
+    {0, -2, -1, 2, 1, 0}, {0, 2, -1, -2, 1, 0}, {0, 4, 0, -5, 0, 1}};
+const float WinogradMatrices<4>::AT[4][6] = {{1, 1, 1, 1, 1, 0},
+                                             {0, 1, -1, 2, -2, 0},
+                                             {0, 1, 1, 4, 4, 0},
+                                             {0, 1, -1, 8, -8, 1}};
+
+/// The number of floats of the transformed input and output tiles that are
+/// kept on the stack. The tiles of a row are processed in groups that fit this
+/// budget, so that the element-wise products turn into matrix multiplications
+/// with as many rows as possible.
+constexpr size_t winograd_scratch_size = 1 << 18;
+
+/// The number of output channels of a depthwise or grouped convolution that
+/// are accumulated together. The accumulators and the filter taps of a block
+/// are kept on the stack, and the innermost loops over the block are
+/// vectorized.
+constexpr size_t conv_channel_block_size = 64;
+
+/// Compute \p dst += \p coef * \p src for \p n channels.
+inline void libjit_axpy(float *dst, const float *src, float coef, size_t n) {
+  for (size_t c = 0; c < n; c++) {
+    dst[c] += coef * src[c];
+  }
+}
+
+/// Perform the Winograd convolution F(M x M, 3 x 3) with stride 1 for the rows
+/// of output tiles [\p rowBegin, \p rowEnd), where the tile rows of all of
+/// the samples of the batch are numbered consecutively. \p filterW is the
+/// transformed filter with the shape [(M + 2) * (M + 2), C, D]. The
+/// libjit_activation \p activation is applied to the result.
+template <size_t M>
+void libjit_conv_winograd_rows(float *outW, const float *inW,
+                               const float *filterW, const float *biasW,
+                               const size_t *outWdims, const size_t *inWdims,
+                               const size_t *pads, unsigned activation,
+                               size_t rowBegin, size_t rowEnd) {
+  typedef WinogradMatrices<M> W;
+  constexpr size_t alpha = M + 2;
+  constexpr size_t numXi = alpha * alpha;
+  size_t inH = inWdims[1];
+  size_t inWidth = inWdims[2];
+  size_t C = inWdims[3];
+  size_t outH = outWdims[1];
+  size_t outWidth = outWdims[2];
+  size_t D = outWdims[3];
+  ssize_t pad_t = pads[0];
+  ssize_t pad_l = pads[1];
+  size_t tilesY = (outH + M - 1) / M;
+  size_t tilesX = (outWidth + M - 1) / M;
+  size_t T = MAX(winograd_scratch_size / (numXi * (C + D)), (size_t)1);
+  T = MIN(T, tilesX);
+
+  // The transformed input tiles, with the shape [numXi, T, C].
+  float V[numXi * T * C];
+  // The products of the transformed tiles and filters, [numXi, T, D].
+  float P[numXi * T * D];
+  // An input tile and its partially transformed version, [alpha, alpha, C].
+  float patch[numXi * C];
+  float tmp[numXi * C];
+  // A partially transformed output tile, [M, alpha, D].
+  float outTmp[M * alpha * D];
+
+  for (size_t r = rowBegin; r < rowEnd; r++) {
+    size_t n = r / tilesY;
+    ssize_t oy = (r % tilesY) * M;
+    for (size_t tx = 0; tx < tilesX; tx += T) {
+      size_t numTiles = MIN(T, tilesX - tx);
+
+      // Transform the input tiles: V = B^T * d * B, for all channels at once.
+      for (size_t t = 0; t < numTiles; t++) {
+        ssize_t ox = (tx + t) * M;
+        for (size_t i = 0; i < alpha; i++) {
+          for (size_t j = 0; j < alpha; j++) {
+            ssize_t y = oy + i - pad_t;
+            ssize_t x = ox + j - pad_l;
+            float *dst = patch + (i * alpha + j) * C;
+            if (y < 0 || x < 0 || y >= ssize_t(inH) || x >= ssize_t(inWidth)) {
+              memset(dst, 0, C * sizeof(float));
+              continue;
+            }
+            memcpy(dst, &inW[libjit_getXYZW(inWdims, n, y, x, 0)],
+                   C * sizeof(float));
+          }
+        }
+        memset(tmp, 0, numXi * C * sizeof(float));
+        for (size_t i = 0; i < alpha; i++) {
+          for (size_t k = 0; k < alpha; k++) {
+            if (W::BT[i][k] == 0) {
+              continue;
+            }
+            for (size_t l = 0; l < alpha; l++) {
+              libjit_axpy(tmp + (i * alpha + l) * C,
+                          patch + (k * alpha + l) * C, W::BT[i][k], C);
+            }
+          }
+        }
+        for (size_t i = 0; i < alpha; i++) {
+          for (size_t j = 0; j < alpha; j++) {
+            float *dst = V + ((i * alpha + j) * T + t) * C;
+            memset(dst, 0, C * sizeof(float));
+            for (size_t l = 0; l < alpha; l++) {
+              if (W::BT[j][l] != 0) {
+                libjit_axpy(dst, tmp + (i * alpha + l) * C, W::BT[j][l], C);
+              }
+            }
+          }
+        }
+      }
+
+      // The element-wise products of the tiles and the filters, summed over
+      // the input channels, are a matrix multiplication for each of the
+      // alpha x alpha positions of the tile.
+      size_t pDims[] = {numTiles, D};
+      size_t vDims[] = {numTiles, C};
+      size_t uDims[] = {C, D};
+      for (size_t xi = 0; xi < numXi; xi++) {
+        libjit_matmul_f(P + xi * T * D, V + xi * T * C, filterW + xi * C * D,
+                        pDims, vDims, uDims);
+      }
+
+      // Transform the output tiles: Y = A^T * P * A + bias.
+      for (size_t t = 0; t < numTiles; t++) {
+        ssize_t ox = (tx + t) * M;
+        memset(outTmp, 0, M * alpha * D * sizeof(float));
+        for (size_t i = 0; i < M; i++) {
+          for (size_t k = 0; k < alpha; k++) {
+            if (W::AT[i][k] == 0) {
+              continue;
+            }
+            for (size_t l = 0; l < alpha; l++) {
+              libjit_axpy(outTmp + (i * alpha + l) * D,
+                          P + ((k * alpha + l) * T + t) * D, W::AT[i][k], D);
+            }
+          }
+        }
+        for (size_t i = 0; i < M && oy + i < outH; i++) {
+          for (size_t j = 0; j < M && ox + j < outWidth; j++) {
+            float *dst = &outW[libjit_getXYZW(outWdims, n, oy + i, ox + j, 0)];
+            memcpy(dst, biasW, D * sizeof(float));
+            for (size_t l = 0; l < alpha; l++) {
+              if (W::AT[j][l] != 0) {
+                libjit_axpy(dst, outTmp + (i * alpha + l) * D, W::AT[j][l], D);
+              }
+            }
+            libjit_activation_inplace(dst, D, activation);
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Copy the input patches of the rows of output pixels [\p rowBegin,
+/// \p rowEnd) into the rows of the matrix \p colsW, padding the borders with
+/// \p padValue. If \p appendOne, every row ends with a 1. See
+/// libjit_im2col_rows_f.
+template <typename T>
+void libjit_im2col_rows(T *colsW, const T *inW, const size_t *outWdims,
+                        const size_t *inWdims, const size_t *kernelSizes,
+                        const size_t *strides, const size_t *pads, T padValue,
+                        bool appendOne, size_t rowBegin, size_t rowEnd) {
+  size_t inChannels = inWdims[3];
+  size_t outH = outWdims[1];
+  size_t outWidth = outWdims[2];
+  ssize_t pad_t = pads[0];
+  ssize_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernelSizes[0];
+  size_t kernel_w = kernelSizes[1];
+  size_t rowSize = kernel_h * kernel_w * inChannels + (appendOne ? 1 : 0);
+
+  for (size_t r = rowBegin; r < rowEnd; r++) {
+    size_t n = r / outH;
+    ssize_t x = ssize_t(r % outH) * stride_h - pad_t;
+    for (size_t ay = 0; ay < outWidth; ay++) {
+      ssize_t y = ssize_t(ay) * stride_w - pad_l;
+      T *row = colsW + (r * outWidth + ay) * rowSize;
+      for (size_t fx = 0; fx < kernel_h; fx++) {
+        for (size_t fy = 0; fy < kernel_w; fy++) {
+          ssize_t ox = x + fx;
+          ssize_t oy = y + fy;
+          T *dst = row + (fx * kernel_w + fy) * inChannels;
+          if (ox < 0 || oy < 0 || ox >= ssize_t(inWdims[1]) ||
+              oy >= ssize_t(inWdims[2])) {
+            for (size_t c = 0; c < inChannels; c++) {
+              dst[c] = padValue;
+            }
+            continue;
+          }
+          memcpy(dst, &inW[libjit_getXYZW(inWdims, n, ox, oy, 0)],
+                 inChannels * sizeof(T));
+        }
+      }
+      if (appendOne) {
+        row[rowSize - 1] = 1;
+      }
+    }
+  }
+}
+
 } // namespace
 
 extern "C" {
-void libjit_convDKKC8_f(float *outW, const float *inW, const float *filterW,
-                        const float *biasW, const size_t *outWdims,
-                        const size_t *inWdims, const size_t *filterWdims,
-                        const size_t *biasWdims, const size_t *kernelSizes,
-                        const size_t *strides, const size_t *pads, size_t group,
-                        unsigned pixelScanFirst, unsigned numDepthRegs,
-                        unsigned sizeGroupY, unsigned depthStrips) {
+/// Perform the Winograd convolution F(2x2, 3x3) for the rows of output tiles
+/// [\p rowBegin, \p rowEnd), numbered consecutively across the samples of the
+/// batch. Disjoint ranges of rows can be computed independently, e.g. by
+/// different threads. \p filterW is the transformed filter with the shape
+/// [16, C, D]. The libjit_activation \p activation is applied to the result.
+void libjit_conv_winograd2x2_rows_f(float *outW, const float *inW,
+                                    const float *filterW, const float *biasW,
+                                    const size_t *outWdims,
+                                    const size_t *inWdims, const size_t *pads,
+                                    unsigned activation, size_t rowBegin,
+                                    size_t rowEnd) {
+  libjit_conv_winograd_rows<2>(outW, inW, filterW, biasW, outWdims, inWdims,
+                               pads, activation, rowBegin, rowEnd);
+}
+
+/// Perform the Winograd convolution F(4x4, 3x3) for the rows of output tiles
+/// [\p rowBegin, \p rowEnd). \p filterW is the transformed filter with the
+/// shape [36, C, D]. See libjit_conv_winograd2x2_rows_f.
+void libjit_conv_winograd4x4_rows_f(float *outW, const float *inW,
+                                    const float *filterW, const float *biasW,
+                                    const size_t *outWdims,
+                                    const size_t *inWdims, const size_t *pads,
+                                    unsigned activation, size_t rowBegin,
+                                    size_t rowEnd) {
+  libjit_conv_winograd_rows<4>(outW, inW, filterW, biasW, outWdims, inWdims,
+                               pads, activation, rowBegin, rowEnd);
+}
+
+/// Copy the input patches of the rows of output pixels [\p rowBegin,
+/// \p rowEnd), numbered consecutively across the samples of the batch, into
+/// the rows of the matrix \p colsW. The row of each output pixel holds the
+/// K x K x C input patch, zero-padded at the borders, followed by a 1 that
+/// multiplies the bias folded into the last row of the weights. The
+/// convolution then becomes a single matrix multiplication.
+void libjit_im2col_rows_f(float *colsW, const float *inW,
+                          const size_t *outWdims, const size_t *inWdims,
+                          const size_t *kernelSizes, const size_t *strides,
+                          const size_t *pads, size_t rowBegin, size_t rowEnd) {
+  libjit_im2col_rows(colsW, inW, outWdims, inWdims, kernelSizes, strides, pads,
+                     0.0f, true, rowBegin, rowEnd);
+}
+
+/// Same as libjit_im2col_rows_f for int8 values, without the trailing 1. The
+/// borders are padded with \p inOffset, the quantized zero.
+void libjit_im2col_rows_i8(int8_t *colsW, const int8_t *inW,
+                           const size_t *outWdims, const size_t *inWdims,
+                           const size_t *kernelSizes, const size_t *strides,
+                           const size_t *pads, int32_t inOffset,
+                           size_t rowBegin, size_t rowEnd) {
+  libjit_im2col_rows(colsW, inW, outWdims, inWdims, kernelSizes, strides, pads,
+                     (int8_t)inOffset, false, rowBegin, rowEnd);
+}
+
+/// Perform the convolution for the samples [\p sampleBegin, \p sampleEnd) of
+/// the batch. Disjoint ranges of samples can be computed independently, e.g.
+/// by different threads. The libjit_activation \p activation is applied to
+/// the result.
+void libjit_convDKKC8_samples_f(
+    float *outW, const float *inW, const float *filterW, const float *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    const size_t *biasWdims, const size_t *kernelSizes, const size_t *strides,
+    const size_t *pads, size_t group, unsigned pixelScanFirst,
+    unsigned numDepthRegs, unsigned sizeGroupY, unsigned depthStrips,
+    unsigned activation, size_t sampleBegin, size_t sampleEnd) {
   size_t inChannels = inWdims[3];
   size_t outChannels = outWdims[3];
   size_t inCperG = inChannels / group;
@@ -271,8 +561,8 @@ void libjit_convDKKC8_f(float *outW, const float *inW, const float *filterW,
       (pixelScanFirst ? &libjit_convDKKC8_foreach_xy_pixels_filter
                       : &libjit_convDKKC8_foreach_xy_filter_pixels);
 
-  // For each input in the batch:
-  for (size_t n = 0; n < inWdims[0]; n++) {
+  // For each input in the range of the batch:
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
 
     // Initialize the output frame for the N'th slice with the bias.
     // Later we will accumulate values into this slice.
@@ -295,15 +585,38 @@ void libjit_convDKKC8_f(float *outW, const float *inW, const float *filterW,
 
       } // For each D (the depth, or the output channel).
     }   // for each G, the group
-  }     // For each N, the sample in the batch.
+
+    // Apply the fused activation while the output frame is still hot in the
+    // cache.
+    size_t frameSize = outWdims[1] * outWdims[2] * outWdims[3];
+    libjit_activation_inplace(&outW[libjit_getXYZW(outWdims, n, 0, 0, 0)],
+                              frameSize, activation);
+  } // For each N, the sample in the batch.
 }
 
-void libjit_convolution_f(float *outW, const float *inW, const float *filterW,
-                          const float *biasW, const size_t *outWdims,
-                          const size_t *inWdims, const size_t *filterWdims,
-                          const size_t *biasWdims, const size_t *kernelSizes,
-                          const size_t *strides, const size_t *pads,
-                          size_t group, unsigned depthUnroll) {
+void libjit_convDKKC8_f(float *outW, const float *inW, const float *filterW,
+                        const float *biasW, const size_t *outWdims,
+                        const size_t *inWdims, const size_t *filterWdims,
+                        const size_t *biasWdims, const size_t *kernelSizes,
+                        const size_t *strides, const size_t *pads, size_t group,
+                        unsigned pixelScanFirst, unsigned numDepthRegs,
+                        unsigned sizeGroupY, unsigned depthStrips) {
+  libjit_convDKKC8_samples_f(outW, inW, filterW, biasW, outWdims, inWdims,
+                             filterWdims, biasWdims, kernelSizes, strides, pads,
+                             group, pixelScanFirst, numDepthRegs, sizeGroupY,
+                             depthStrips, libjit_activation_none, 0,
+                             inWdims[0]);
+}
+
+/// Perform the convolution for the samples [\p sampleBegin, \p sampleEnd) of
+/// the batch. Disjoint ranges of samples can be computed independently, e.g.
+/// by different threads.
+void libjit_convolution_samples_f(
+    float *outW, const float *inW, const float *filterW, const float *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    const size_t *biasWdims, const size_t *kernelSizes, const size_t *strides,
+    const size_t *pads, size_t group, unsigned depthUnroll, size_t sampleBegin,
+    size_t sampleEnd) {
   size_t inChannels = inWdims[3];
   size_t outChannels = outWdims[3];
   size_t inCperG = inChannels / group;
@@ -325,8 +638,8 @@ void libjit_convolution_f(float *outW, const float *inW, const float *filterW,
   // compromise between the two.
   constexpr unsigned cbSize = 512;
 
-  // For each input in the batch:
-  for (size_t n = 0; n < inWdims[0]; n++) {
+  // For each input in the range of the batch:
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
 
     // Initialize the output frame for the N'th slice with the bias.
     // Later we will accumulate values into this slice.
@@ -417,6 +730,17 @@ void libjit_convolution_f(float *outW, const float *inW, const float *filterW,
   }           // For each N, the sample in the batch.
 }
 
+void libjit_convolution_f(float *outW, const float *inW, const float *filterW,
+                          const float *biasW, const size_t *outWdims,
+                          const size_t *inWdims, const size_t *filterWdims,
+                          const size_t *biasWdims, const size_t *kernelSizes,
+                          const size_t *strides, const size_t *pads,
+                          size_t group, unsigned depthUnroll) {
+  libjit_convolution_samples_f(outW, inW, filterW, biasW, outWdims, inWdims,
+                               filterWdims, biasWdims, kernelSizes, strides,
+                               pads, group, depthUnroll, 0, inWdims[0]);
+}
+
 void libjit_convolution_i8(
     int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
     const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
@@ -513,19 +837,409 @@ void libjit_convolution_i8(
   }         // N
 }
 
-void libjit_convolution_grad_f(float *inG, const float *outG, const float *inW,
-                               float *filterG, float *biasG,
-                               const float *filterW, const size_t *outGdims,
-                               const size_t *inWdims, const size_t *filterGdims,
-                               const size_t *kernels, const size_t *strides,
-                               const size_t *pads, size_t group) {
+/// Perform the depthwise convolution, in which every output channel only reads
+/// the input channel with the same index, for the samples [\p sampleBegin,
+/// \p sampleEnd) of the batch. The channels are contiguous in NHWC, so the
+/// innermost loop runs over a block of channels instead of over the single
+/// input channel of the group, which is what the generic kernel does.
+void libjit_depthwise_conv_samples_f(
+    float *outW, const float *inW, const float *filterW, const float *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *kernelSizes,
+    const size_t *strides, const size_t *pads, size_t sampleBegin,
+    size_t sampleEnd) {
+  size_t channels = outWdims[3];
+  size_t pad_t = pads[0];
+  size_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernelSizes[0];
+  size_t kernel_w = kernelSizes[1];
+  size_t filterSize = kernel_h * kernel_w;
+  constexpr size_t cbSize = conv_channel_block_size;
+  // The filter taps of the block, transposed from the [C, KH, KW] layout of
+  // the filter to [KH, KW, cbSize] to read them contiguously.
+  float taps[filterSize * cbSize];
+
+  // For each input in the range of the batch:
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
+    // For each block of channels:
+    for (size_t cb = 0; cb < channels; cb += cbSize) {
+      size_t cbLen = MIN(cbSize, channels - cb);
+      for (size_t k = 0; k < filterSize; k++) {
+        for (size_t c = 0; c < cbLen; c++) {
+          taps[k * cbSize + c] = filterW[(cb + c) * filterSize + k];
+        }
+      }
+
+      // For each convolution 'jump' in the input tensor:
+      for (size_t outx = 0; outx < outWdims[1]; outx++) {
+        for (size_t outy = 0; outy < outWdims[2]; outy++) {
+          float sum[cbSize];
+          for (size_t c = 0; c < cbLen; c++) {
+            sum[c] = biasW[cb + c];
+          }
+
+          // For each element in the convolution-filter:
+          for (size_t fx = 0; fx < kernel_h; fx++) {
+            for (size_t fy = 0; fy < kernel_w; fy++) {
+              ssize_t inx = (ssize_t)outx * stride_h - pad_t + fx;
+              ssize_t iny = (ssize_t)outy * stride_w - pad_l + fy;
+
+              // Ignore index access below zero (this is due to padding).
+              if (inx < 0 || iny < 0 || inx >= (ssize_t)inWdims[1] ||
+                  iny >= (ssize_t)inWdims[2]) {
+                continue;
+              }
+
+              const float *in = inW + libjit_getXYZW(inWdims, n, (size_t)inx,
+                                                     (size_t)iny, cb);
+              const float *tap = taps + (fx * kernel_w + fy) * cbSize;
+              for (size_t c = 0; c < cbLen; c++) {
+                sum[c] += in[c] * tap[c];
+              }
+            }
+          }
+
+          float *out = outW + libjit_getXYZW(outWdims, n, outx, outy, cb);
+          for (size_t c = 0; c < cbLen; c++) {
+            out[c] = sum[c];
+          }
+        } // W
+      }   // H
+    }     // For each block of channels.
+  }       // For each N, the sample in the batch.
+}
+
+/// The quantized variant of libjit_depthwise_conv_samples_f. The offsets and
+/// the scaling parameters have the same meaning as in libjit_convolution_i8.
+void libjit_depthwise_conv_samples_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *kernelSizes,
+    const size_t *strides, const size_t *pads, int32_t outOffset,
+    int32_t inOffset, int32_t filterOffset, int32_t biasOffset, int32_t biasPre,
+    int32_t biasPost, int32_t biasScale, int32_t outPre, int32_t outPost,
+    int32_t outScale, size_t sampleBegin, size_t sampleEnd) {
+  size_t channels = outWdims[3];
+  size_t pad_t = pads[0];
+  size_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernelSizes[0];
+  size_t kernel_w = kernelSizes[1];
+  size_t filterSize = kernel_h * kernel_w;
+  constexpr size_t cbSize = conv_channel_block_size;
+  // The filter taps of the block without their offset, in the [KH, KW, cbSize]
+  // layout.
+  int32_t taps[filterSize * cbSize];
+
+  // For each input in the range of the batch:
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
+    // For each block of channels:
+    for (size_t cb = 0; cb < channels; cb += cbSize) {
+      size_t cbLen = MIN(cbSize, channels - cb);
+      for (size_t k = 0; k < filterSize; k++) {
+        for (size_t c = 0; c < cbLen; c++) {
+          taps[k * cbSize + c] =
+              (int32_t)filterW[(cb + c) * filterSize + k] - filterOffset;
+        }
+      }
+
+      // For each convolution 'jump' in the input tensor:
+      for (size_t outx = 0; outx < outWdims[1]; outx++) {
+        for (size_t outy = 0; outy < outWdims[2]; outy++) {
+          int32_t sum[cbSize];
+          for (size_t c = 0; c < cbLen; c++) {
+            // Scale the bias to match the scale of the matrix multiplication.
+            sum[c] = libjit_scale_i32i8((int32_t)biasW[cb + c] - biasOffset,
+                                        biasPre, biasPost, biasScale, 0);
+          }
+
+          // For each element in the convolution-filter:
+          for (size_t fx = 0; fx < kernel_h; fx++) {
+            for (size_t fy = 0; fy < kernel_w; fy++) {
+              ssize_t inx = (ssize_t)outx * stride_h - pad_t + fx;
+              ssize_t iny = (ssize_t)outy * stride_w - pad_l + fy;
+
+              // Ignore index access below zero (this is due to padding).
+              if (inx < 0 || iny < 0 || inx >= (ssize_t)inWdims[1] ||
+                  iny >= (ssize_t)inWdims[2]) {
+                continue;
+              }
+
+              const int8_t *in = inW + libjit_getXYZW(inWdims, n, (size_t)inx,
+                                                      (size_t)iny, cb);
+              const int32_t *tap = taps + (fx * kernel_w + fy) * cbSize;
+              for (size_t c = 0; c < cbLen; c++) {
+                sum[c] += ((int32_t)in[c] - inOffset) * tap[c];
+              }
+            }
+          }
+
+          int8_t *out = outW + libjit_getXYZW(outWdims, n, outx, outy, cb);
+          for (size_t c = 0; c < cbLen; c++) {
+            // Scale the result back to the expected destination scale.
+            out[c] = libjit_clip(libjit_scale_i32i8(sum[c], outPre, outPost,
+                                                    outScale, outOffset));
+          }
+        } // W
+      }   // H
+    }     // For each block of channels.
+  }       // For each N, the sample in the batch.
+}
+
+/// Perform the grouped convolution with few channels per group for the
+/// samples [\p sampleBegin, \p sampleEnd) of the batch. As in the depthwise
+/// kernel, the innermost loop runs over a block of output channels, which
+/// spans several groups. Each output channel of the block reads the input
+/// channels of its own group, at the offsets kept in inChannel.
+void libjit_group_conv_samples_f(
+    float *outW, const float *inW, const float *filterW, const float *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *kernelSizes,
+    const size_t *strides, const size_t *pads, size_t group, size_t sampleBegin,
+    size_t sampleEnd) {
+  size_t outChannels = outWdims[3];
+  size_t inCperG = inWdims[3] / group;
+  size_t outCperG = outChannels / group;
+  size_t pad_t = pads[0];
+  size_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernelSizes[0];
+  size_t kernel_w = kernelSizes[1];
+  size_t filterSize = kernel_h * kernel_w;
+  constexpr size_t cbSize = conv_channel_block_size;
+  // The filter taps of the block, transposed from the [D, KH, KW, C/G] layout
+  // of the filter to [KH, KW, C/G, cbSize].
+  float taps[filterSize * inCperG * cbSize];
+  // The first input channel of the group of every output channel of the block.
+  size_t inChannel[cbSize];
+
+  // For each input in the range of the batch:
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
+    // For each block of output channels:
+    for (size_t cb = 0; cb < outChannels; cb += cbSize) {
+      size_t cbLen = MIN(cbSize, outChannels - cb);
+      for (size_t j = 0; j < cbLen; j++) {
+        inChannel[j] = (cb + j) / outCperG * inCperG;
+      }
+      for (size_t k = 0; k < filterSize * inCperG; k++) {
+        for (size_t j = 0; j < cbLen; j++) {
+          taps[k * cbSize + j] = filterW[(cb + j) * filterSize * inCperG + k];
+        }
+      }
+
+      // For each convolution 'jump' in the input tensor:
+      for (size_t outx = 0; outx < outWdims[1]; outx++) {
+        for (size_t outy = 0; outy < outWdims[2]; outy++) {
+          float sum[cbSize];
+          for (size_t j = 0; j < cbLen; j++) {
+            sum[j] = biasW[cb + j];
+          }
+
+          // For each element in the convolution-filter:
+          for (size_t fx = 0; fx < kernel_h; fx++) {
+            for (size_t fy = 0; fy < kernel_w; fy++) {
+              ssize_t inx = (ssize_t)outx * stride_h - pad_t + fx;
+              ssize_t iny = (ssize_t)outy * stride_w - pad_l + fy;
+
+              // Ignore index access below zero (this is due to padding).
+              if (inx < 0 || iny < 0 || inx >= (ssize_t)inWdims[1] ||
+                  iny >= (ssize_t)inWdims[2]) {
+                continue;
+              }
+
+              const float *in = inW + libjit_getXYZW(inWdims, n, (size_t)inx,
+                                                     (size_t)iny, 0);
+              const float *tap = taps + (fx * kernel_w + fy) * inCperG * cbSize;
+              for (size_t c = 0; c < inCperG; c++) {
+                for (size_t j = 0; j < cbLen; j++) {
+                  sum[j] += in[inChannel[j] + c] * tap[c * cbSize + j];
+                }
+              }
+            }
+          }
+
+          float *out = outW + libjit_getXYZW(outWdims, n, outx, outy, cb);
+          for (size_t j = 0; j < cbLen; j++) {
+            out[j] = sum[j];
+          }
+        } // W
+      }   // H
+    }     // For each block of output channels.
+  }       // For each N, the sample in the batch.
+}
+
+/// The quantized variant of libjit_group_conv_samples_f. The offsets and the
+/// scaling parameters have the same meaning as in libjit_convolution_i8.
+void libjit_group_conv_samples_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *kernelSizes,
+    const size_t *strides, const size_t *pads, size_t group, int32_t outOffset,
+    int32_t inOffset, int32_t filterOffset, int32_t biasOffset, int32_t biasPre,
+    int32_t biasPost, int32_t biasScale, int32_t outPre, int32_t outPost,
+    int32_t outScale, size_t sampleBegin, size_t sampleEnd) {
+  size_t outChannels = outWdims[3];
+  size_t inCperG = inWdims[3] / group;
+  size_t outCperG = outChannels / group;
+  size_t pad_t = pads[0];
+  size_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernelSizes[0];
+  size_t kernel_w = kernelSizes[1];
+  size_t filterSize = kernel_h * kernel_w;
+  constexpr size_t cbSize = conv_channel_block_size;
+  // The filter taps of the block without their offset, in the
+  // [KH, KW, C/G, cbSize] layout.
+  int32_t taps[filterSize * inCperG * cbSize];
+  // The first input channel of the group of every output channel of the block.
+  size_t inChannel[cbSize];
+
+  // For each input in the range of the batch:
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
+    // For each block of output channels:
+    for (size_t cb = 0; cb < outChannels; cb += cbSize) {
+      size_t cbLen = MIN(cbSize, outChannels - cb);
+      for (size_t j = 0; j < cbLen; j++) {
+        inChannel[j] = (cb + j) / outCperG * inCperG;
+      }
+      for (size_t k = 0; k < filterSize * inCperG; k++) {
+        for (size_t j = 0; j < cbLen; j++) {
+          taps[k * cbSize + j] =
+              (int32_t)filterW[(cb + j) * filterSize * inCperG + k] -
+              filterOffset;
+        }
+      }
+
+      // For each convolution 'jump' in the input tensor:
+      for (size_t outx = 0; outx < outWdims[1]; outx++) {
+        for (size_t outy = 0; outy < outWdims[2]; outy++) {
+          int32_t sum[cbSize];
+          for (size_t j = 0; j < cbLen; j++) {
+            // Scale the bias to match the scale of the matrix multiplication.
+            sum[j] = libjit_scale_i32i8((int32_t)biasW[cb + j] - biasOffset,
+                                        biasPre, biasPost, biasScale, 0);
+          }
+
+          // For each element in the convolution-filter:
+          for (size_t fx = 0; fx < kernel_h; fx++) {
+            for (size_t fy = 0; fy < kernel_w; fy++) {
+              ssize_t inx = (ssize_t)outx * stride_h - pad_t + fx;
+              ssize_t iny = (ssize_t)outy * stride_w - pad_l + fy;
+
+              // Ignore index access below zero (this is due to padding).
+              if (inx < 0 || iny < 0 || inx >= (ssize_t)inWdims[1] ||
+                  iny >= (ssize_t)inWdims[2]) {
+                continue;
+              }
+
+              const int8_t *in = inW + libjit_getXYZW(inWdims, n, (size_t)inx,
+                                                      (size_t)iny, 0);
+              const int32_t *tap =
+                  taps + (fx * kernel_w + fy) * inCperG * cbSize;
+              for (size_t c = 0; c < inCperG; c++) {
+                for (size_t j = 0; j < cbLen; j++) {
+                  sum[j] += ((int32_t)in[inChannel[j] + c] - inOffset) *
+                            tap[c * cbSize + j];
+                }
+              }
+            }
+          }
+
+          int8_t *out = outW + libjit_getXYZW(outWdims, n, outx, outy, cb);
+          for (size_t j = 0; j < cbLen; j++) {
+            // Scale the result back to the expected destination scale.
+            out[j] = libjit_clip(libjit_scale_i32i8(sum[j], outPre, outPost,
+                                                    outScale, outOffset));
+          }
+        } // W
+      }   // H
+    }     // For each block of output channels.
+  }       // For each N, the sample in the batch.
+}
+
+void libjit_channelwise_quantized_conv_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW,
+    const int32_t *biasW, const float *scalesW, const int32_t *offsetsW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    const size_t *kernelSizes, const size_t *strides, const size_t *pads,
+    size_t group, int32_t outOffset, int32_t inOffset, float inScale,
+    float outScale) {
+  size_t inChannels = inWdims[3];
+  size_t outChannels = outWdims[3];
+  size_t inCperG = inChannels / group;
+  size_t outCperG = outChannels / group;
+  size_t pad_t = pads[0];
+  size_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernelSizes[0];
+  size_t kernel_w = kernelSizes[1];
+  size_t sliceSize = filterWdims[1] * filterWdims[2] * filterWdims[3];
+  // For each input in the batch:
+  for (size_t n = 0; n < inWdims[0]; n++) {
+    // For each group of input channels:
+    for (size_t g = 0; g < group; g++) {
+      // For each output channel in the group:
+      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
+        // Every output channel has its own filter scale and offset.
+        int32_t filterOffset = offsetsW[d];
+        float scale = inScale * scalesW[d] / outScale;
+        const int8_t *filterSlice = filterW + d * sliceSize;
+
+        // For each convolution 'jump' in the input tensor:
+        ssize_t x = -(ssize_t)pad_t;
+        for (size_t ax = 0; ax < outWdims[1]; x += stride_h, ax++) {
+          ssize_t y = -(ssize_t)pad_l;
+          for (size_t ay = 0; ay < outWdims[2]; y += stride_w, ay++) {
+            // The bias is already in the scale of the matrix multiplication.
+            int32_t sum = biasW[d];
+
+            // For each element in the convolution-filter:
+            for (size_t fx = 0; fx < kernel_h; fx++) {
+              for (size_t fy = 0; fy < kernel_w; fy++) {
+                ssize_t ox = x + fx;
+                ssize_t oy = y + fy;
+
+                // Ignore index access below zero (this is due to padding).
+                if (ox < 0 || oy < 0 || ox >= (ssize_t)inWdims[1] ||
+                    oy >= (ssize_t)inWdims[2]) {
+                  continue;
+                }
+
+                size_t inIdx = libjit_getXYZW(inWdims, n, (size_t)ox,
+                                              (size_t)oy, g * inCperG);
+                size_t filterIdx = (fx * kernel_w + fy) * inCperG;
+                for (size_t fd = 0; fd < inCperG; fd++) {
+                  sum += (filterSlice[filterIdx + fd] - filterOffset) *
+                         (inW[inIdx + fd] - inOffset);
+                }
+              }
+            }
+
+            // Scale the result back to the expected destination scale.
+            int32_t scaledSum = (int32_t)roundf((float)sum * scale + outOffset);
+            outW[libjit_getXYZW(outWdims, n, ax, ay, d)] =
+                libjit_clip(scaledSum);
+          } // W
+        }   // H
+      }     // C
+    }       // G
+  }         // N
+}
+
+/// Computes the gradient \p inG of the input of a convolution for the samples
+/// [\p sampleBegin, \p sampleEnd) of the batch. Disjoint ranges of samples can
+/// be computed by different threads.
+void libjit_convolution_grad_input_f(
+    float *inG, const float *outG, const float *filterW, const size_t *outGdims,
+    const size_t *inWdims, const size_t *filterGdims, const size_t *kernels,
+    const size_t *strides, const size_t *pads, size_t group,
+    size_t sampleBegin, size_t sampleEnd) {
   // NHWC format is assumed
-  // Clear inG, filterG, and biasG
-  size_t p = sizeof(float);
-  memset(inG, 0, inWdims[0] * inWdims[1] * inWdims[2] * inWdims[3] * p);
-  memset(filterG, 0,
-         filterGdims[0] * filterGdims[1] * filterGdims[2] * filterGdims[3] * p);
-  memset(biasG, 0, outGdims[3] * p);
+  size_t sampleSize = inWdims[1] * inWdims[2] * inWdims[3];
+  memset(inG + sampleBegin * sampleSize, 0,
+         (sampleEnd - sampleBegin) * sampleSize * sizeof(float));
 
   size_t pad_t = pads[0];
   size_t pad_l = pads[1];
@@ -537,7 +1251,7 @@ void libjit_convolution_grad_f(float *inG, const float *outG, const float *inW,
   size_t outCperG = outGdims[3] / group;
 
   // For each input in the batch:
-  for (size_t n = 0; n < outGdims[0]; n++) {
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
     // For each group of input channels:
     for (size_t g = 0; g < group; g++) {
       for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
@@ -557,23 +1271,162 @@ void libjit_convolution_grad_f(float *inG, const float *outG, const float *inW,
                   continue;
                 }
 
+                float *inGRow = &inG[libjit_getXYZW(inWdims, n, (size_t)ax,
+                                                    (size_t)ay, g * inCperG)];
+                const float *filterRow =
+                    &filterW[libjit_getXYZW(filterGdims, d, kx, ky, 0)];
                 for (size_t c = 0; c < inCperG; c++) {
-                  inG[libjit_getXYZW(inWdims, n, (size_t)ax, (size_t)ay,
-                                     g * inCperG + c)] +=
-                      filterW[libjit_getXYZW(filterGdims, d, kx, ky, c)] * grad;
-                  filterG[libjit_getXYZW(filterGdims, d, kx, ky, c)] +=
-                      inW[libjit_getXYZW(inWdims, n, (size_t)ax, (size_t)ay,
-                                         g * inCperG + c)] *
-                      grad;
+                  inGRow[c] += filterRow[c] * grad;
                 }
               }
             }
-
-            biasG[d] += grad;
           } // W
         }   // H
       }     // C
     }       // G
   }         // N
 }
+
+/// Computes the gradients \p filterG and \p biasG of the filter and the bias
+/// of a convolution for the output channels [\p depthBegin, \p depthEnd).
+/// Disjoint ranges of channels can be computed by different threads.
+void libjit_convolution_grad_filter_f(
+    float *filterG, float *biasG, const float *outG, const float *inW,
+    const size_t *outGdims, const size_t *inWdims, const size_t *filterGdims,
+    const size_t *kernels, const size_t *strides, const size_t *pads,
+    size_t group, size_t depthBegin, size_t depthEnd) {
+  // NHWC format is assumed
+  size_t filterSize = filterGdims[1] * filterGdims[2] * filterGdims[3];
+  memset(filterG + depthBegin * filterSize, 0,
+         (depthEnd - depthBegin) * filterSize * sizeof(float));
+  memset(biasG + depthBegin, 0, (depthEnd - depthBegin) * sizeof(float));
+
+  size_t pad_t = pads[0];
+  size_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernels[0];
+  size_t kernel_w = kernels[1];
+  size_t inCperG = inWdims[3] / group;
+  size_t outCperG = outGdims[3] / group;
+
+  // For each output channel:
+  for (size_t d = depthBegin; d < depthEnd; d++) {
+    size_t g = d / outCperG;
+    // For each input in the batch:
+    for (size_t n = 0; n < outGdims[0]; n++) {
+      ssize_t x = -(ssize_t)pad_t;
+      for (size_t bx = 0; bx < outGdims[1]; bx++, x += stride_h) {
+        ssize_t y = -(ssize_t)pad_l;
+        for (size_t by = 0; by < outGdims[2]; by++, y += stride_w) {
+          float grad = outG[libjit_getXYZW(outGdims, n, bx, by, d)];
+
+          for (size_t kx = 0; kx < kernel_h; kx++) {
+            for (size_t ky = 0; ky < kernel_w; ky++) {
+              ssize_t ax = x + kx;
+              ssize_t ay = y + ky;
+
+              if (ax < 0 || ay < 0 || ax >= (ssize_t)inWdims[1] ||
+                  ay >= (ssize_t)inWdims[2]) {
+                continue;
+              }
+
+              float *filterGRow =
+                  &filterG[libjit_getXYZW(filterGdims, d, kx, ky, 0)];
+              const float *inWRow = &inW[libjit_getXYZW(
+                  inWdims, n, (size_t)ax, (size_t)ay, g * inCperG)];
+              for (size_t c = 0; c < inCperG; c++) {
+                filterGRow[c] += inWRow[c] * grad;
+              }
+            }
+          }
+
+          biasG[d] += grad;
+        } // W
+      }   // H
+    }     // N
+  }       // C
+}
+
+/// Scatter-add the rows of \p colsG into the gradient \p inG of the input of
+/// a convolution, for the samples [\p sampleBegin, \p sampleEnd) of the
+/// batch. \p colsG holds the gradient of the input patch of every output
+/// pixel, laid out as the matrix of libjit_im2col_rows_f without its last
+/// column. Disjoint ranges of samples can be computed by different threads.
+void libjit_col2im_samples_f(float *inG, const float *colsG,
+                             const size_t *outGdims, const size_t *inWdims,
+                             const size_t *kernels, const size_t *strides,
+                             const size_t *pads, size_t sampleBegin,
+                             size_t sampleEnd) {
+  size_t inChannels = inWdims[3];
+  size_t sampleSize = inWdims[1] * inWdims[2] * inChannels;
+  memset(inG + sampleBegin * sampleSize, 0,
+         (sampleEnd - sampleBegin) * sampleSize * sizeof(float));
+
+  ssize_t pad_t = pads[0];
+  ssize_t pad_l = pads[1];
+  size_t stride_h = strides[0];
+  size_t stride_w = strides[1];
+  size_t kernel_h = kernels[0];
+  size_t kernel_w = kernels[1];
+  size_t rowSize = kernel_h * kernel_w * inChannels;
+
+  for (size_t n = sampleBegin; n < sampleEnd; n++) {
+    for (size_t bx = 0; bx < outGdims[1]; bx++) {
+      ssize_t x = ssize_t(bx) * stride_h - pad_t;
+      for (size_t by = 0; by < outGdims[2]; by++) {
+        ssize_t y = ssize_t(by) * stride_w - pad_l;
+        const float *row =
+            colsG + ((n * outGdims[1] + bx) * outGdims[2] + by) * rowSize;
+        for (size_t fx = 0; fx < kernel_h; fx++) {
+          for (size_t fy = 0; fy < kernel_w; fy++) {
+            ssize_t ox = x + fx;
+            ssize_t oy = y + fy;
+            if (ox < 0 || oy < 0 || ox >= ssize_t(inWdims[1]) ||
+                oy >= ssize_t(inWdims[2])) {
+              continue;
+            }
+            float *dst = &inG[libjit_getXYZW(inWdims, n, ox, oy, 0)];
+            const float *src = row + (fx * kernel_w + fy) * inChannels;
+            for (size_t c = 0; c < inChannels; c++) {
+              dst[c] += src[c];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Copy the output channels [\p depthBegin, \p depthEnd) of the gradient
+/// \p outG of the output of a convolution, a [pixels, D] matrix in NHWC, into
+/// the rows of its transpose \p outGT.
+void libjit_conv_grad_transpose_f(float *outGT, const float *outG,
+                                  const size_t *outGdims, size_t depthBegin,
+                                  size_t depthEnd) {
+  size_t depth = outGdims[3];
+  size_t numPixels = outGdims[0] * outGdims[1] * outGdims[2];
+  for (size_t d = depthBegin; d < depthEnd; d++) {
+    float *dst = outGT + d * numPixels;
+    for (size_t p = 0; p < numPixels; p++) {
+      dst[p] = outG[p * depth + d];
+    }
+  }
+}
+
+/// Copy the rows [\p depthBegin, \p depthEnd) of \p G, the product of the
+/// transposed output gradient with the matrix of libjit_im2col_rows_f, into
+/// the gradients \p filterG and \p biasG. The last column of \p G, which
+/// multiplies the 1s of the matrix, is the gradient of the bias.
+void libjit_conv_grad_filter_unpack_f(float *filterG, float *biasG,
+                                      const float *G,
+                                      const size_t *filterGdims,
+                                      size_t depthBegin, size_t depthEnd) {
+  size_t filterSize = filterGdims[1] * filterGdims[2] * filterGdims[3];
+  for (size_t d = depthBegin; d < depthEnd; d++) {
+    const float *row = G + d * (filterSize + 1);
+    memcpy(filterG + d * filterSize, row, filterSize * sizeof(float));
+    biasG[d] = row[filterSize];
+  }
+}
 }
@@ -16,6 +16,7 @@
 #ifndef GLOW_BACKENDS_CPU_LIBJIT_LIBJIT_DEFS_H
 #define GLOW_BACKENDS_CPU_LIBJIT_LIBJIT_DEFS_H
 
+#include <math.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -26,6 +27,9 @@ typedef SSIZE_T ssize_t;
 
 typedef float float4 __attribute__((ext_vector_type(4)));
 typedef float float8 __attribute__((ext_vector_type(8)));
+typedef float float16 __attribute__((ext_vector_type(16)));
+typedef int8_t char8 __attribute__((ext_vector_type(8)));
+typedef int32_t int32x8 __attribute__((ext_vector_type(8)));
 
 /// Loads a simd float8 value from \p ptr.
 #define LoadFloat8(PTR) *((const float8 *)(PTR))
@@ -44,6 +48,51 @@ typedef float float8 __attribute__((ext_vector_type(8)));
 #define AT(tensor, dims, numDims, indices, numIndices)                         \
   tensor[get_element_ptr(tensor, dims, numDims, indices, numIndices)]
 
+/// \returns an approximation of e^\p x. Unlike the calls of expf, it is made
+/// of operations that LLVM can vectorize. The argument is reduced to
+/// r = x - n * ln(2) with |r| <= ln(2) / 2, using a two-part ln(2) so that
+/// n * ln(2) is exact, e^r is evaluated with the degree 5 minimax polynomial of
+/// the Cephes expf, and the result is scaled by 2^n through its exponent
+/// bits. The argument is clamped to [-87.33, 88.37], so that 2^n stays a
+/// normal float: the result is about 1.2e-38 below this range and 2.4e38
+/// above it. In the range, the relative error is below 1e-7 (1.5 ulp) when
+/// the operations are evaluated in order. The reassociations allowed by
+/// -ffast-math may fold the two parts of ln(2) together, which raises the
+/// relative error up to 4e-6 for the largest |x|. The OpenCL exp is within 3
+/// ulp, so the bounds of libjit_sigmoidf and libjit_tanhf hold in the OpenCL
+/// kernels as well.
+inline float libjit_expf(float x) {
+  x = MIN(MAX(x, -87.33f), 88.37f);
+  float t = x * 1.44269504088896341f;
+  int32_t n = (int32_t)(t + (t >= 0 ? 0.5f : -0.5f));
+  float fn = (float)n;
+  float r = x - fn * 0.693359375f + fn * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  float y = p * r * r + r + 1;
+  uint32_t bits = (uint32_t)(n + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return y * scale;
+}
+
+/// \returns an approximation of 1 / (1 + e^-\p x) computed with
+/// libjit_expf. The absolute error is below 2e-7.
+inline float libjit_sigmoidf(float x) {
+  float e = libjit_expf(x);
+  return e / (e + 1);
+}
+
+/// \returns an approximation of tanh(\p x) computed as
+/// 1 - 2 / (e^(2 * x) + 1) with libjit_expf, which is also used by Caffe2.
+/// The absolute error is below 3e-7. The relative error is larger near 0,
+/// where the subtraction cancels.
+inline float libjit_tanhf(float x) { return 1 - 2 / (libjit_expf(x * 2) + 1); }
+
 /// Perform an unaligned load of a float8 from a float pointer.
 inline float8 LoaduFloat8(const float *p) {
   float8 res;
@@ -59,6 +108,167 @@ inline void AdduFloat8(float *p, float8 v) {
   StoreuFloat8(p, LoaduFloat8(p) + v);
 }
 
+/// The number of iterations ahead of the current one whose table rows the
+/// sparse kernels prefetch. Embedding rows are picked at random, so the
+/// hardware prefetcher does not find them.
+#define LIBJIT_PREFETCH_DISTANCE 8
+
+/// Prefetch the row of \p size bytes at \p p into the cache for reading.
+/// The hardware prefetcher streams long rows, so only their head is fetched.
+inline void libjit_prefetch_row(const void *p, size_t size) {
+  const char *bytes = (const char *)p;
+  size = MIN(size, 1024);
+  for (size_t i = 0; i < size; i += 64) {
+    __builtin_prefetch(bytes + i, 0, 3);
+  }
+}
+
+/// Decode into \p dest the \p num clustered weights that start at the weight
+/// \p first, which is even, of the row \p codes. Every weight is the centroid
+/// of \p codebook whose index is stored in \p codeBits bits, 4 or 8. Two 4-bit
+/// indices share a byte, the first one in its low bits. The 16 centroids of a
+/// 4-bit codebook are copied into a local table, which stays in registers or
+/// in the L1 cache while the row is decoded.
+inline void libjit_decode_clustered_row(float *dest, const uint8_t *codes,
+                                        const float *codebook, size_t first,
+                                        size_t num, unsigned codeBits) {
+  if (codeBits == 8) {
+    for (size_t i = 0; i < num; i++) {
+      dest[i] = codebook[codes[first + i]];
+    }
+    return;
+  }
+  float lut[16];
+  memcpy(lut, codebook, sizeof(lut));
+  const uint8_t *bytes = codes + first / 2;
+  size_t i = 0;
+  for (; i + 2 <= num; i += 2) {
+    uint8_t b = bytes[i / 2];
+    dest[i] = lut[b & 15];
+    dest[i + 1] = lut[b >> 4];
+  }
+  if (i < num) {
+    dest[i] = lut[bytes[i / 2] & 15];
+  }
+}
+
+/// \returns the float value of the IEEE 754 half-precision encoding \p h.
+/// The conversion is exact and free of branches, so that loops that expand
+/// half-precision weights vectorize.
+inline float libjit_fp16_to_fp32(uint16_t h) {
+  const uint32_t shiftedExp = 0x7c00 << 13;
+  const uint32_t magicBits = 113 << 23;
+  // Move the exponent and the mantissa into place and rebias the exponent.
+  uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+  uint32_t exp = bits & shiftedExp;
+  bits += (127 - 15) << 23;
+  // Infinity and NaN keep the maximal exponent.
+  bits += (exp == shiftedExp) ? (128 - 16) << 23 : 0;
+  float normal;
+  memcpy(&normal, &bits, sizeof(float));
+  // Zero and subnormals are renormalized with a float subtraction.
+  uint32_t subnormalBits = bits + (1 << 23);
+  float subnormal, magic;
+  memcpy(&subnormal, &subnormalBits, sizeof(float));
+  memcpy(&magic, &magicBits, sizeof(float));
+  subnormal -= magic;
+  float res = (exp == 0) ? subnormal : normal;
+  uint32_t resBits;
+  memcpy(&resBits, &res, sizeof(float));
+  resBits |= (uint32_t)(h & 0x8000) << 16;
+  memcpy(&res, &resBits, sizeof(float));
+  return res;
+}
+
+/// \returns the IEEE 754 half-precision encoding of \p f, rounded to the
+/// nearest representable value (ties to even). This must match
+/// glow::floatToHalfBits.
+inline uint16_t libjit_fp32_to_fp16(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t abs = bits & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  }
+  if (abs >= 0x477ff000) {
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) {
+    float absValue;
+    memcpy(&absValue, &abs, sizeof(absValue));
+    return sign | (uint16_t)nearbyintf(absValue * 16777216.0f);
+  }
+  abs += 0xfff + ((abs >> 13) & 1);
+  return sign | (uint16_t)((abs - 0x38000000) >> 13);
+}
+
+/// A bfloat16 value, i.e. the upper half of a float. The exported kernels take
+/// bfloat16 tensors as uint16_t pointers, like half-precision tensors; this
+/// type only selects the bfloat16 overloads of the templates.
+struct libjit_bf16 {
+  uint16_t bits;
+};
+
+/// \returns the float value of the bfloat16 \p h. The conversion is exact and
+/// is a single shift, so loops that expand bfloat16 weights vectorize.
+inline float libjit_bf16_to_fp32(libjit_bf16 h) {
+  uint32_t bits = (uint32_t)h.bits << 16;
+  float res;
+  memcpy(&res, &bits, sizeof(float));
+  return res;
+}
+
+/// \returns the bfloat16 encoding of \p f, rounded to the nearest
+/// representable value (ties to even). This must match
+/// glow::floatToBFloat16Bits.
+inline uint16_t libjit_fp32_to_bf16(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+/// The activations that can be fused into the output loops of the
+/// convolution and matrix multiplication kernels. This must match
+/// FusedActivationKind in the CPU backend.
+enum libjit_activation {
+  libjit_activation_none = 0,
+  libjit_activation_relu = 1,
+  libjit_activation_sigmoid = 2,
+  libjit_activation_tanh = 3,
+};
+
+/// Apply the libjit_activation \p activation in place to the \p n floats at
+/// \p p. This is the epilogue of the kernels that have a fused activation, so
+/// it runs while the results are still in the cache. Sigmoid and tanh use the
+/// same approximations as the data-parallel kernels.
+inline void libjit_activation_inplace(float *p, size_t n,
+                                      unsigned activation) {
+  switch (activation) {
+  case libjit_activation_relu:
+    for (size_t i = 0; i < n; i++) {
+      p[i] = MAX(p[i], 0.0f);
+    }
+    break;
+  case libjit_activation_sigmoid:
+    for (size_t i = 0; i < n; i++) {
+      p[i] = libjit_sigmoidf(p[i]);
+    }
+    break;
+  case libjit_activation_tanh:
+    for (size_t i = 0; i < n; i++) {
+      p[i] = libjit_tanhf(p[i]);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
 /// \returns the index of the element at x,y,z,w,q,r.
 inline size_t libjit_getXYZWQR(const size_t *dims, size_t x, size_t y, size_t z,
                                size_t w, size_t q, size_t r) {
@@ -97,6 +307,18 @@ inline int8_t libjit_clip(int32_t val) {
   return (int8_t)MIN(MAX(val, -128), 127);
 }
 
+/// \returns \p val rounded to the nearest integer and clipped to the range of
+/// the 8-bit quantized values.
+inline int8_t libjit_round_clip_i8(float val) {
+  return (int8_t)nearbyintf(MIN(MAX(val, -128.0f), 127.0f));
+}
+
+/// \returns \p val rounded to the nearest integer and clipped to the range of
+/// the 16-bit quantized values.
+inline int16_t libjit_round_clip_i16(float val) {
+  return (int16_t)nearbyintf(MIN(MAX(val, -32768.0f), 32767.0f));
+}
+
 /// Scales a 32-bit integer using the integer shift-mult-shift method.
 /// See QuantizationTransform32To8 for more details.
 inline int32_t libjit_scale_i32i8(int32_t input, int32_t pre, int32_t post,
@@ -114,4 +336,43 @@ inline int32_t libjit_scale_i32i8(int32_t input, int32_t pre, int32_t post,
   return ((((input >> pre) * scale) + rtn) >> post) + offset;
 }
 
+/// Loads 8 int8 values from \p p, which need not be aligned, as 32-bit
+/// integers.
+inline int32x8 libjit_load_i8x8(const int8_t *p) {
+  char8 v;
+  memcpy(&v, p, sizeof(v));
+  return __builtin_convertvector(v, int32x8);
+}
+
+/// Saturates the 32-bit integers of \p v to int8 and stores them at \p p,
+/// which need not be aligned. The clamp and the truncation are selected as
+/// the saturating packs of the target.
+inline void libjit_store_i8x8(int8_t *p, int32x8 v) {
+  int32x8 low = v < -128;
+  int32x8 high = v > 127;
+  v = (v & ~(low | high)) | (low & -128) | (high & 127);
+  char8 r = __builtin_convertvector(v, char8);
+  memcpy(p, &r, sizeof(r));
+}
+
+/// \returns the larger of \p a and \p b in every lane.
+inline int32x8 libjit_max_i32x8(int32x8 a, int32x8 b) {
+  int32x8 m = a > b;
+  return (a & m) | (b & ~m);
+}
+
+/// \returns the smaller of \p a and \p b in every lane.
+inline int32x8 libjit_min_i32x8(int32x8 a, int32x8 b) {
+  int32x8 m = a < b;
+  return (a & m) | (b & ~m);
+}
+
+/// Scales 8 32-bit integers like libjit_scale_i32i8, in the 32-bit lanes of
+/// SIMD registers.
+inline int32x8 libjit_scale_i32i8x8(int32x8 input, int32_t pre, int32_t post,
+                                    int32_t scale, int32_t offset) {
+  int rtn = (post > 0) ? (1 << (post - 1)) : 0;
+  return ((((input >> pre) * scale) + rtn) >> post) + offset;
+}
+
 #endif // GLOW_BACKENDS_CPU_LIBJIT_LIBJIT_DEFS_H
@@ -15,12 +15,20 @@
  */
 #include "libjit_defs.h"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 namespace {
 
 /// Macros for accessing submatrices of a matmul using the leading dimension.
 #define A(i, j) a[(j)*lda + (i)]
 #define B(i, j) b[(j)*ldb + (i)]
 #define C(i, j) c[(j)*ldc + (i)]
+/// Access to the element (i, j) of a matrix A that is stored transposed.
+#define TA(i, j) a[(i)*lda + (j)]
+/// Access to the element (i, j) of a matrix B that is stored transposed.
+#define TB(i, j) b[(i)*ldb + (j)]
 
 /// Naive gemm helper to handle oddly-sized matrices.
 void libjit_matmul_odd(int m, int n, int k, const float *a, int lda,
@@ -35,95 +43,203 @@ void libjit_matmul_odd(int m, int n, int k, const float *a, int lda,
   }
 }
 
-/// Number of registers to use for rows of A in the dot-product kernel.
-constexpr int regsA = 4;
-/// Number of registers to use for columns of B in the dot-product kernel.
-constexpr int regsB = 3;
+/// Same as libjit_matmul_odd, but \p a is stored transposed.
+void libjit_matmul_odd_trans(int m, int n, int k, const float *a, int lda,
+                             const float *b, int ldb, float *c, int ldc) {
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < m; i++) {
+      float sum = 0;
+      for (int p = 0; p < k; p++) {
+        sum += TA(i, p) * B(p, j);
+      }
+      C(i, j) += sum;
+    }
+  }
+}
+
+/// Same as libjit_matmul_odd, but \p b is stored transposed.
+void libjit_matmul_odd_transb(int m, int n, int k, const float *a, int lda,
+                              const float *b, int ldb, float *c, int ldc) {
+  for (int p = 0; p < k; p++) {
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < m; i++) {
+        C(i, j) += A(i, p) * TB(p, j);
+      }
+    }
+  }
+}
+
+/// Perform an unaligned load of a vector of type \p VecTy from \p p.
+template <typename VecTy> inline VecTy loaduVec(const float *p) {
+  VecTy res;
+  memcpy(&res, p, sizeof(VecTy));
+  return res;
+}
+
+/// Perform an unaligned store of the vector \p v to \p p.
+template <typename VecTy> inline void storeuVec(float *p, VecTy v) {
+  memcpy(p, &v, sizeof(VecTy));
+}
+
+/// Perform an unaligned addition of the vector \p v to \p p.
+template <typename VecTy> inline void adduVec(float *p, VecTy v) {
+  storeuVec<VecTy>(p, loaduVec<VecTy>(p) + v);
+}
+
+/// Describes a register-blocked microkernel and the cache blocking used around
+/// it. The kernel computes an mr x nr block of C in registers, where mr is
+/// \p RegsA vectors of type \p VecTy loaded from A and nr is \p RegsB values
+/// broadcast from B. \p KC is chosen so that a kc x nr sliver of B stays in L1,
+/// \p MC so that an mc x kc block of A stays in L2 and \p NC so that a kc x nc
+/// panel of B stays in L3.
+template <typename VecTy, int RegsA, int RegsB, int MC, int KC, int NC>
+struct GemmKernel {
+  typedef VecTy vec;
+  /// Number of floats in a vector register.
+  static constexpr int width = sizeof(VecTy) / sizeof(float);
+  /// Number of registers to use for rows of A in the dot-product kernel.
+  static constexpr int regsA = RegsA;
+  /// Number of registers to use for columns of B in the dot-product kernel.
+  static constexpr int regsB = RegsB;
+  /// Number of rows of A to process in the kernel.  Vector loads are used for
+  /// A, so we load `width` times as many floats as we use registers.
+  static constexpr int mr = regsA * width;
+  /// Number of columns of B to process in the kernel.
+  static constexpr int nr = regsB;
+  /// Blocking parameters for the outer kernel.  We multiply mc x kc blocks of
+  /// A with kc x nc panels of B (this approach is referred to as `gebp` in the
+  /// literature).
+  static constexpr int mc = MC;
+  static constexpr int kc = KC;
+  static constexpr int nc = NC;
+};
+
+/// The default kernel, which only relies on 128-bit vectors being available.
+/// A 32 x 3 block of C is computed with 4 x 3 float8 accumulators.
+typedef GemmKernel<float8, 4, 3, 256, 128, 4096> GenericKernel;
+
+/// AVX2 kernel: a 16 x 6 block of C (6 x 16 in the row-major output) uses 12
+/// of the 16 ymm registers for accumulators, leaving room for two A vectors
+/// and one broadcast of B. A 256 x 6 sliver of B is 6KB and a 128 x 256 block
+/// of A is 128KB, which leaves half of a 256KB L2 for C and prefetching.
+typedef GemmKernel<float8, 2, 6, 128, 256, 2048> AVX2Kernel;
 
-/// Number of rows of A to process in the kernel.  Vector loads are used for A,
-/// so we load eight times as many floats as we use registers.
-constexpr int mr = regsA * 8;
-/// Number of columns of B to process in the kernel.
-constexpr int nr = regsB;
+/// AVX-512 kernel: a 32 x 14 block of C (14 x 32 in the row-major output)
+/// uses 28 of the 32 zmm registers for accumulators. A 256 x 14 sliver of B is
+/// 14KB and a 256 x 256 block of A is 256KB, a quarter of the 1MB L2 of
+/// server parts.
+typedef GemmKernel<float16, 2, 14, 256, 256, 2048> AVX512Kernel;
 
-/// Blocking parameters for the outer kernel.  We multiply mc x kc blocks of A
-/// with kc x nc panels of B (this approach is referred to as `gebp` in the
-/// literature).  TODO: Generalize these parameters for other cache sizes.
-constexpr int mc = 256;
-constexpr int kc = 128;
-constexpr int nc = 4096;
+/// AArch64 NEON kernel: a 12 x 8 block of C (8 x 12 in the row-major output)
+/// uses 24 of the 32 q registers for accumulators, and 128-bit vectors rather
+/// than the float8 pairs of the generic kernel. A 256 x 8 sliver of B is 8KB,
+/// a quarter of the smallest L1 of the Cortex-A cores.
+typedef GemmKernel<float4, 3, 8, 128, 256, 2048> NEONKernel;
+
+/// ARMv7 NEON kernel: a 8 x 6 block of C uses 12 of the 16 q registers for
+/// accumulators. The A block is 64KB for the small L2 of 32-bit parts.
+typedef GemmKernel<float4, 2, 6, 64, 256, 1024> NEON32Kernel;
 
 /// Only pack matrices if dimension is above this threshold.  Packing is
 /// primarily helpful for avoiding TLB pressure and cache set conflicts, so this
 /// can be fairly large.
 constexpr size_t pack_threshold = 1024;
 
-/// Compute a RAxRB block of C using a vectorized dot product, where RA is the
-/// number of registers to load from matrix A, and RB is the number of registers
-/// to load from matrix B.
-template <size_t regsA, size_t regsB>
+/// Compute a mr x nr block of C using a vectorized dot product, where mr is
+/// given by the number of registers to load from matrix A, and nr by the
+/// number of registers to load from matrix B.
+template <typename K>
 void libjit_matmul_dot(size_t k, const float *a, size_t lda, const float *b,
                        size_t ldb, float *c, size_t ldc) {
-  float8 csum[regsA][regsB] = {{0.0}};
+  typedef typename K::vec vec;
+  vec csum[K::regsA][K::regsB] = {{0.0}};
   for (size_t p = 0; p < k; p++) {
     // Perform the DOT product.
-    for (size_t ai = 0; ai < regsA; ai++) {
-      float8 aa = LoaduFloat8(&A(ai * 8, p));
-      for (size_t bi = 0; bi < regsB; bi++) {
-        float8 bb = BroadcastFloat8(B(p, bi));
+    for (size_t ai = 0; ai < K::regsA; ai++) {
+      vec aa = loaduVec<vec>(&A(ai * K::width, p));
+      for (size_t bi = 0; bi < K::regsB; bi++) {
+        vec bb = (vec)(B(p, bi));
         csum[ai][bi] += aa * bb;
       }
     }
   }
 
   // Accumulate the results into C.
-  for (size_t bi = 0; bi < regsB; bi++) {
-    for (size_t ai = 0; ai < regsA; ai++) {
-      AdduFloat8(&C(ai * 8, bi), csum[ai][bi]);
+  for (size_t bi = 0; bi < K::regsB; bi++) {
+    for (size_t ai = 0; ai < K::regsA; ai++) {
+      adduVec<vec>(&C(ai * K::width, bi), csum[ai][bi]);
     }
   }
 }
 
 /// Similar to libjit_matmul_dot, but assumes that \p a and \p b have been
 /// packed using z-ordering.
-template <size_t regsA, size_t regsB>
+template <typename K>
 void libjit_matmul_zdot(size_t k, const float *a, size_t lda, const float *b,
                         size_t ldb, float *c, size_t ldc) {
-  float8 csum[regsA][regsB] = {{0.0}};
+  typedef typename K::vec vec;
+  vec csum[K::regsA][K::regsB] = {{0.0}};
 
   for (size_t p = 0; p < k; p++) {
     // Perform the DOT product.
-    float8 *aptr = (float8 *)&A(0, p);
-    for (size_t ai = 0; ai < regsA; ai++) {
-      float8 aa = *aptr++;
-      for (size_t bi = 0; bi < regsB; bi++) {
-        float8 bb = BroadcastFloat8(*(b + bi));
+    const float *aptr = &A(0, p);
+    for (size_t ai = 0; ai < K::regsA; ai++) {
+      vec aa = loaduVec<vec>(aptr + ai * K::width);
+      for (size_t bi = 0; bi < K::regsB; bi++) {
+        vec bb = (vec)(*(b + bi));
         csum[ai][bi] += aa * bb;
       }
     }
-    b += regsB;
+    b += K::regsB;
   }
 
   // Accumulate the results into C.
-  for (size_t bi = 0; bi < regsB; bi++) {
-    for (size_t ai = 0; ai < regsA; ai++) {
-      AdduFloat8(&C(ai * 8, bi), csum[ai][bi]);
+  for (size_t bi = 0; bi < K::regsB; bi++) {
+    for (size_t ai = 0; ai < K::regsA; ai++) {
+      adduVec<vec>(&C(ai * K::width, bi), csum[ai][bi]);
     }
   }
 }
 
 /// Pack matrix \p a into matrix \p a_to using a z-ordering, so that the
-/// dot-product kernel can stride sequentially through memory.
-template <size_t regsA>
-void pack_matrix_a(size_t m, size_t k, const float *a, size_t lda,
-                   float *a_to) {
-  for (size_t i = 0; i < m - mr + 1; i += mr) {
+/// dot-product kernel can stride sequentially through memory. If \p sums is
+/// not null, the sums of the packed rows of \p a are added to it, which
+/// reuses the vectors that are loaded for packing.
+template <typename K>
+void pack_matrix_a(size_t m, size_t k, const float *a, size_t lda, float *a_to,
+                   float *sums = nullptr) {
+  typedef typename K::vec vec;
+  for (size_t i = 0; i + K::mr <= m; i += K::mr) {
+    vec rowSums[K::regsA] = {0.0};
     for (size_t j = 0; j < k; j++) {
       const float *a_ij_pntr = &A(i, j);
-      for (size_t ai = 0; ai < regsA; ai++) {
-        StoreuFloat8(a_to + 8 * ai, LoaduFloat8(a_ij_pntr + 8 * ai));
+      for (size_t ai = 0; ai < K::regsA; ai++) {
+        vec aa = loaduVec<vec>(a_ij_pntr + K::width * ai);
+        storeuVec<vec>(a_to + K::width * ai, aa);
+        rowSums[ai] += aa;
+      }
+      a_to += K::mr;
+    }
+    if (sums) {
+      for (size_t ai = 0; ai < K::regsA; ai++) {
+        adduVec<vec>(sums + i + K::width * ai, rowSums[ai]);
       }
-      a_to += 8 * regsA;
+    }
+  }
+}
+
+/// Same as pack_matrix_a, but \p a is stored transposed. Gathering the
+/// columns into the packed panel is what lets the kernel read a transposed
+/// operand without materializing the transpose.
+template <typename K>
+void pack_matrix_a_trans(size_t m, size_t k, const float *a, size_t lda,
+                         float *a_to) {
+  for (size_t i = 0; i + K::mr <= m; i += K::mr) {
+    for (size_t j = 0; j < k; j++) {
+      for (size_t ai = 0; ai < K::mr; ai++) {
+        a_to[ai] = TA(i + ai, j);
+      }
+      a_to += K::mr;
     }
   }
 }
@@ -131,50 +247,69 @@ void pack_matrix_a(size_t m, size_t k, const float *a, size_t lda,
 /// Pack matrix \p b into matrix \p b_to using a z-ordering, so that the
 /// dot-product kernel can stride sequentially through memory, rather than
 /// reading from `regsB` separate columns.
-template <size_t regsB>
+template <typename K>
 void pack_matrix_b(size_t n, size_t k, const float *b, size_t ldb,
                    float *b_to) {
-  for (int j = 0; j < int(n) - nr + 1; j += nr) {
+  for (size_t j = 0; j + K::nr <= n; j += K::nr) {
     for (size_t i = 0; i < k; i++) {
-      for (size_t bi = 0; bi < regsB; bi++) {
+      for (size_t bi = 0; bi < K::regsB; bi++) {
         *b_to++ = B(i, j + bi);
       }
     }
   }
 }
 
+/// Same as pack_matrix_b, but \p b is stored transposed, so the `regsB`
+/// values of a row of the panel are consecutive in memory.
+template <typename K>
+void pack_matrix_b_trans(size_t n, size_t k, const float *b, size_t ldb,
+                         float *b_to) {
+  for (size_t j = 0; j + K::nr <= n; j += K::nr) {
+    for (size_t i = 0; i < k; i++) {
+      for (size_t bi = 0; bi < K::regsB; bi++) {
+        *b_to++ = TB(i, j + bi);
+      }
+    }
+  }
+}
+
 /// Inner kernel for packed matrices.  The order of the M and N loops matters,
 /// because packed matrices need to be more more sensitive to cache locality,
 /// and N strides over the B matrix, which is very large and will blow out the
 /// cache.
+template <typename K>
 void libjit_matmul_inner_packed(int m, int n, int k, const float *packedA,
                                 const float *packedB, float *c, int ldc) {
-  for (int j = 0; j < n - nr + 1; j += nr) {
-    for (int i = 0; i < m - mr + 1; i += mr) {
-      libjit_matmul_zdot<regsA, regsB>(k, &packedA[i * k], mr, &packedB[j * k],
-                                       k, &C(i, j), ldc);
+  for (int j = 0; j < n - K::nr + 1; j += K::nr) {
+    for (int i = 0; i < m - K::mr + 1; i += K::mr) {
+      libjit_matmul_zdot<K>(k, &packedA[i * k], K::mr, &packedB[j * k], k,
+                            &C(i, j), ldc);
     }
   }
 }
 
 /// Inner kernel for non-packed matrices.  In these cases N is small, so it
 /// tends to be beneficial to retain locality in the A matrix.
+template <typename K>
 void libjit_matmul_inner_unpacked(int m, int n, int k, const float *a, int lda,
                                   const float *b, int ldb, float *c, int ldc) {
-  for (int i = 0; i < m - mr + 1; i += mr) {
-    for (int j = 0; j < n - nr + 1; j += nr) {
-      libjit_matmul_dot<regsA, regsB>(k, &A(i, 0), lda, &B(0, j), ldb, &C(i, j),
-                                      ldc);
+  for (int i = 0; i < m - K::mr + 1; i += K::mr) {
+    for (int j = 0; j < n - K::nr + 1; j += K::nr) {
+      libjit_matmul_dot<K>(k, &A(i, 0), lda, &B(0, j), ldb, &C(i, j), ldc);
     }
   }
 }
 
 /// Compute a portion of C one block at a time.  Handle ragged edges with calls
-/// to a slow but general helper.
-template <bool pack>
+/// to a slow but general helper. If \p transA, \p a is stored transposed and
+/// is always packed. If \p transB, \p b is stored transposed and \p a is
+/// always packed. If \p aRowSums is not null, the sums of the rows of \p a
+/// are added to it.
+template <typename K, bool pack, bool transA, bool transB>
 void libjit_matmul_inner(int m, int n, int k, const float *a, int lda,
                          const float *b, int ldb, float *c, int ldc,
-                         float *packedB) {
+                         float *packedB, float *aRowSums) {
+  static_assert(!transA || !transB, "Only one operand may be transposed");
   // The tiling scheme naturally divides the input matrices into 2 parts each;
   // one tiled section, and three "ragged" edges.
   //
@@ -185,22 +320,62 @@ void libjit_matmul_inner(int m, int n, int k, const float *a, int lda,
   // --------------------    -------
   //
   // We can process this as 4 separate matrix multiplications.  A00*B00 is the
-  // perfectly-tiled portion, which we handly with a 4x16 dot-product kernel.
-  // The ragged edges are (ideally) less critical, so we handle them with a call
-  // to a general matrix-multiplication for odd sizes.
+  // perfectly-tiled portion, which we handly with the mr x nr dot-product
+  // kernel. The ragged edges are (ideally) less critical, so we handle them
+  // with a call to a general matrix-multiplication for odd sizes.
   float packedA[m * k] __attribute__((aligned(64)));
-  if (pack) {
-    pack_matrix_a<regsA>(m, k, &A(0, 0), lda, packedA);
+  if (transA) {
+    pack_matrix_a_trans<K>(m, k, a, lda, packedA);
+  } else if (pack || transB) {
+    pack_matrix_a<K>(m, k, &A(0, 0), lda, packedA, aRowSums);
   }
 
-  if (pack) {
-    libjit_matmul_inner_packed(m, n, k, packedA, packedB, c, ldc);
+  if (pack || transA || transB) {
+    libjit_matmul_inner_packed<K>(m, n, k, packedA, packedB, c, ldc);
   } else {
-    libjit_matmul_inner_unpacked(m, n, k, a, lda, b, ldb, c, ldc);
+    libjit_matmul_inner_unpacked<K>(m, n, k, a, lda, b, ldb, c, ldc);
   }
 
-  size_t i = (m / mr) * mr;
-  size_t j = (n / nr) * nr;
+  size_t i = (m / K::mr) * K::mr;
+  size_t j = (n / K::nr) * K::nr;
+  // The ragged rows of A are not packed, so they are summed here.
+  if (aRowSums) {
+    for (size_t p = 0; p < k; p++) {
+      for (size_t ii = i; ii < m; ii++) {
+        aRowSums[ii] += A(ii, p);
+      }
+    }
+  }
+  if (transB) {
+    if (i < m) {
+      libjit_matmul_odd_transb(m - i, j, k, &A(i, 0), lda, &TB(0, 0), ldb,
+                               &C(i, 0), ldc);
+    }
+    if (j < n) {
+      libjit_matmul_odd_transb(i, n - j, k, &A(0, 0), lda, &TB(0, j), ldb,
+                               &C(0, j), ldc);
+    }
+    if (i < m && j < n) {
+      libjit_matmul_odd_transb(m - i, n - j, k, &A(i, 0), lda, &TB(0, j), ldb,
+                               &C(i, j), ldc);
+    }
+    return;
+  }
+  if (transA) {
+    if (i < m) {
+      libjit_matmul_odd_trans(m - i, j, k, &TA(i, 0), lda, &B(0, 0), ldb,
+                              &C(i, 0), ldc);
+    }
+    if (j < n) {
+      libjit_matmul_odd_trans(i, n - j, k, &TA(0, 0), lda, &B(0, j), ldb,
+                              &C(0, j), ldc);
+    }
+    if (i < m && j < n) {
+      libjit_matmul_odd_trans(m - i, n - j, k, &TA(i, 0), lda, &B(0, j), ldb,
+                              &C(i, j), ldc);
+    }
+    return;
+  }
   if (i < m) {
     libjit_matmul_odd(m - i, j, k, &A(i, 0), lda, &B(0, 0), ldb, &C(i, 0), ldc);
   }
@@ -213,53 +388,202 @@ void libjit_matmul_inner(int m, int n, int k, const float *a, int lda,
   }
 }
 
-/// Tile A into mc * kc blocks, where mc and kc are chosen to approximately fit
-/// the L2 cache on recent Intel processors (e.g., 256 KB for Skylake).  Stream
-/// kc * n panels of B through memory to compute each mc * n block of C.
+/// Tile A into mc * kc blocks, where mc and kc are chosen by the kernel \p K
+/// to approximately fit the L2 cache of the target.  Stream kc * n panels of B
+/// through memory to compute each mc * n block of C.
 /// \p a is an \p m x \p k column-major matrix;
 /// \p b is a \p k x \p n column-major matrix;
 /// \p c is a \p m x \p n column-major matrix.
 /// \p lda, \p ldb, and \p ldc are the leading dimensions of A, B, and C,
-/// respectively.
-template <bool pack>
+/// respectively. If \p transA, \p a is stored as a \p k x \p m matrix
+/// instead, and both matrices are packed. If \p transB, \p b is stored as a
+/// \p n x \p k matrix instead, and both matrices are packed. If \p aRowSums
+/// is not null, the sums of the \p m rows of A are added to it while the
+/// first panel of B is multiplied, so that A is only read once for both.
+template <typename K, bool pack, bool transA, bool transB = false>
 void __attribute__((noinline))
 libjit_matmul_outer(size_t m, size_t n, size_t k, const float *a, size_t lda,
-                    const float *b, size_t ldb, float *c, size_t ldc) {
-  float packedB[kc * nc] __attribute__((aligned(64)));
+                    const float *b, size_t ldb, float *c, size_t ldc,
+                    float *aRowSums = nullptr) {
+  float packedB[K::kc * K::nc] __attribute__((aligned(64)));
 
-  for (size_t p = 0; p < k; p += kc) {
-    size_t pb = MIN(k - p, kc);
-    for (size_t j = 0; j < n; j += nc) {
-      size_t jb = MIN(n - j, nc);
-      if (pack) {
-        pack_matrix_b<regsB>(jb, pb, &B(p, j), ldb, packedB);
+  for (size_t p = 0; p < k; p += K::kc) {
+    size_t pb = MIN(k - p, K::kc);
+    for (size_t j = 0; j < n; j += K::nc) {
+      size_t jb = MIN(n - j, K::nc);
+      if (transB) {
+        pack_matrix_b_trans<K>(jb, pb, &TB(p, j), ldb, packedB);
+      } else if (pack || transA) {
+        pack_matrix_b<K>(jb, pb, &B(p, j), ldb, packedB);
       }
-      for (size_t i = 0; i < m; i += mc) {
-        size_t ib = MIN(m - i, mc);
-        libjit_matmul_inner<pack>(ib, jb, pb, &A(i, p), lda, &B(p, j), ldb,
-                                  &C(i, j), ldc, packedB);
+      for (size_t i = 0; i < m; i += K::mc) {
+        size_t ib = MIN(m - i, K::mc);
+        libjit_matmul_inner<K, pack, transA, transB>(
+            ib, jb, pb, transA ? &TA(i, p) : &A(i, p), lda,
+            transB ? &TB(p, j) : &B(p, j), ldb, &C(i, j), ldc, packedB,
+            aRowSums && j == 0 ? aRowSums + i : nullptr);
       }
     }
   }
 }
 
+#undef TB
+#undef TA
 #undef C
 #undef B
 #undef A
 
-} // namespace
+/// Number of columns of the result in each panel of a pre-packed weight
+/// matrix. This must match the layout that the CPU backend produces for
+/// CPUPackedMatMul, [ceil(N/16), K, 16].
+constexpr size_t packed_panel_width = 16;
 
-extern "C" {
+/// Load a vector of type \p VecTy of pre-packed weights from \p p.
+template <typename VecTy> inline VecTy loadPackedWeights(const float *p) {
+  return loaduVec<VecTy>(p);
+}
 
-/// Performs the matrix multiplication c = a * b, where c, a, and b are
-/// row-major matrices.
-/// \p c is a m x n matrix, so \p cDims = {m, n}
-/// \p a is a m x k matrix, so \p aDims = {m, k}
-/// \p b is a k x n matrix, so \p bDims = {k, n}
-void libjit_matmul_f(float *c, const float *a, const float *b,
-                     const size_t *cDims, const size_t *aDims,
-                     const size_t *bDims) {
-  memset(c, 0, cDims[0] * cDims[1] * sizeof(float));
+/// Load a vector of type \p VecTy of pre-packed half-precision weights from
+/// \p p. The weights are expanded to floats in registers, so they only take
+/// half of the memory bandwidth.
+template <typename VecTy> inline VecTy loadPackedWeights(const uint16_t *p) {
+  constexpr int vecWidth = sizeof(VecTy) / sizeof(float);
+  float tmp[vecWidth];
+  for (int i = 0; i < vecWidth; i++) {
+    tmp[i] = libjit_fp16_to_fp32(p[i]);
+  }
+  return loaduVec<VecTy>(tmp);
+}
+
+#if defined(__x86_64__)
+/// A half-precision value that is expanded with the F16C instructions. The
+/// AVX2 and AVX-512 kernels take their half-precision weights as this type,
+/// and the CPU backend only selects them for hosts with F16C.
+struct libjit_f16c {
+  uint16_t bits;
+};
+
+/// Expand the 8 half-precision values at \p p to floats in \p dest.
+__attribute__((target("f16c"))) inline void
+libjit_f16c_expand8(float *dest, const libjit_f16c *p) {
+  _mm256_storeu_ps(dest,
+                   _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p)));
+}
+
+/// Load a vector of type \p VecTy of pre-packed half-precision weights from
+/// \p p, 8 values per vcvtph2ps.
+template <typename VecTy>
+inline VecTy loadPackedWeights(const libjit_f16c *p) {
+  constexpr int vecWidth = sizeof(VecTy) / sizeof(float);
+  static_assert(vecWidth % 8 == 0, "F16C expands 8 values at a time");
+  float tmp[vecWidth];
+  for (int i = 0; i < vecWidth; i += 8) {
+    libjit_f16c_expand8(tmp + i, p + i);
+  }
+  return loaduVec<VecTy>(tmp);
+}
+#endif // defined(__x86_64__)
+
+/// Load a vector of type \p VecTy of pre-packed bfloat16 weights from \p p.
+/// The weights are widened to floats in registers by a shift.
+template <typename VecTy>
+inline VecTy loadPackedWeights(const libjit_bf16 *p) {
+  constexpr int vecWidth = sizeof(VecTy) / sizeof(float);
+  float tmp[vecWidth];
+  for (int i = 0; i < vecWidth; i++) {
+    tmp[i] = libjit_bf16_to_fp32(p[i]);
+  }
+  return loaduVec<VecTy>(tmp);
+}
+
+/// Compute \p R rows of a panel of \p c from \p R rows of \p a and the
+/// pre-packed \p panel of b, whose elements have the type \p WTy (float,
+/// half-precision uint16_t or libjit_bf16). \p a and \p c are row-major with
+/// the leading dimensions \p lda and \p ldc. Only the first \p width columns
+/// of the panel are stored, which handles the zero-padded last panel. The
+/// libjit_activation \p activation is applied to the stored rows.
+template <typename VecTy, int R, typename WTy>
+void libjit_matmul_packed_block(size_t k, const float *a, size_t lda,
+                                const WTy *panel, float *c, size_t ldc,
+                                size_t width, unsigned activation) {
+  constexpr int vecWidth = sizeof(VecTy) / sizeof(float);
+  constexpr int regs = packed_panel_width / vecWidth;
+  VecTy csum[R][regs] = {{0.0}};
+  for (size_t p = 0; p < k; p++) {
+    // The panel is consecutive in memory, so the weights are streamed
+    // sequentially and loaded once for all of the rows of the block.
+    VecTy bb[regs];
+    for (size_t bi = 0; bi < regs; bi++) {
+      bb[bi] = loadPackedWeights<VecTy>(panel + p * packed_panel_width +
+                                        bi * vecWidth);
+    }
+    for (size_t ai = 0; ai < R; ai++) {
+      VecTy aa = (VecTy)(a[ai * lda + p]);
+      for (size_t bi = 0; bi < regs; bi++) {
+        csum[ai][bi] += aa * bb[bi];
+      }
+    }
+  }
+
+  for (size_t ai = 0; ai < R; ai++) {
+    if (width == packed_panel_width) {
+      for (size_t bi = 0; bi < regs; bi++) {
+        storeuVec<VecTy>(c + ai * ldc + bi * vecWidth, csum[ai][bi]);
+      }
+    } else {
+      float tmp[packed_panel_width];
+      for (size_t bi = 0; bi < regs; bi++) {
+        storeuVec<VecTy>(tmp + bi * vecWidth, csum[ai][bi]);
+      }
+      memcpy(c + ai * ldc, tmp, width * sizeof(float));
+    }
+    libjit_activation_inplace(c + ai * ldc, width, activation);
+  }
+}
+
+/// Performs the matrix multiplication c = a * b for the panels
+/// [\p panelBegin, \p panelEnd) of c, where b is pre-packed into panels of
+/// 16 columns of elements of type \p WTy. Rows are processed in blocks of
+/// \p R, and the remaining rows one at a time. The libjit_activation
+/// \p activation is applied to the result.
+template <typename VecTy, int R, typename WTy>
+void libjit_matmul_packed_panels(float *c, const float *a, const WTy *b,
+                                 const size_t *cDims, const size_t *aDims,
+                                 const size_t *bDims, unsigned activation,
+                                 size_t panelBegin, size_t panelEnd) {
+  size_t m = cDims[0];
+  size_t n = cDims[1];
+  size_t k = aDims[1];
+  for (size_t panel = panelBegin; panel < panelEnd; panel++) {
+    const WTy *panelB = b + panel * bDims[1] * bDims[2];
+    size_t col = panel * packed_panel_width;
+    size_t width = MIN(n - col, packed_panel_width);
+    size_t row = 0;
+    for (; row + R <= m; row += R) {
+      libjit_matmul_packed_block<VecTy, R>(k, a + row * k, k, panelB,
+                                           c + row * n + col, n, width,
+                                           activation);
+    }
+    for (; row < m; row++) {
+      libjit_matmul_packed_block<VecTy, 1>(k, a + row * k, k, panelB,
+                                           c + row * n + col, n, width,
+                                           activation);
+    }
+  }
+}
+
+/// Performs the matrix multiplication c = a * b for the rows [\p rowBegin,
+/// \p rowEnd) of c using the kernel \p K. See libjit_matmul_rows_f. If
+/// \p transB, b is stored as a n x k matrix, see libjit_matmul_trans_rows_f.
+template <typename K, bool transB = false>
+void libjit_matmul_rows(float *c, const float *a, const float *b,
+                        const size_t *cDims, const size_t *aDims,
+                        const size_t *bDims, size_t rowBegin, size_t rowEnd) {
+  // The rows of a row-major matrix are consecutive in memory, so the slices
+  // of c and a are just row-major matrices with fewer rows.
+  float *cSlice = c + rowBegin * cDims[1];
+  const float *aSlice = a + rowBegin * aDims[1];
+  memset(cSlice, 0, (rowEnd - rowBegin) * cDims[1] * sizeof(float));
   // Call the matrix multiplication routine with appropriate dimensions and
   // leading dimensions. The "leading dimension" for a row-major matrix is equal
   // to the number of columns in the matrix.  For a, this is k; for b and c,
@@ -271,17 +595,783 @@ void libjit_matmul_f(float *c, const float *a, const float *b,
   //
   // The matrix multiplication routine is heavily inspired by:
   // https://github.com/flame/how-to-optimize-gemm
+  //
+  // A transposed b is a k x n column-major matrix, i.e. the transposed left
+  // operand of the column-major helper, and its leading dimension is still k.
   int m = cDims[1];
-  int n = cDims[0];
+  int n = rowEnd - rowBegin;
   int k = aDims[1];
   bool pack = m >= pack_threshold;
-  if (pack) {
-    libjit_matmul_outer<true>(m, n, k, b, bDims[1], a, aDims[1], c, cDims[1]);
+  if (transB) {
+    libjit_matmul_outer<K, true, true>(m, n, k, b, bDims[1], aSlice, aDims[1],
+                                       cSlice, cDims[1]);
+  } else if (pack) {
+    libjit_matmul_outer<K, true, false>(m, n, k, b, bDims[1], aSlice,
+                                        aDims[1], cSlice, cDims[1]);
+  } else {
+    libjit_matmul_outer<K, false, false>(m, n, k, b, bDims[1], aSlice,
+                                         aDims[1], cSlice, cDims[1]);
+  }
+}
+
+/// Performs the matrix multiplication c = transpose(a) * b for the rows
+/// [\p rowBegin, \p rowEnd) of c using the kernel \p K, and stores the sums
+/// of the columns of b in \p colSums if \p rowBegin is 0. See
+/// libjit_matmul_trans_lhs_rows_f.
+template <typename K>
+void libjit_matmul_trans_lhs_rows(float *c, float *colSums, const float *a,
+                                  const float *b, const size_t *cDims,
+                                  const size_t *aDims, const size_t *bDims,
+                                  size_t rowBegin, size_t rowEnd) {
+  // The rows of c are the columns of a, so the slice of a is a transposed
+  // matrix with fewer columns and the same leading dimension.
+  float *cSlice = c + rowBegin * cDims[1];
+  const float *aSlice = a + rowBegin;
+  memset(cSlice, 0, (rowEnd - rowBegin) * cDims[1] * sizeof(float));
+  // As in libjit_matmul_rows, the column-major helper computes C += B * A.
+  // Then a is the right operand, stored transposed, and b is the left one,
+  // whose rows in column-major order are the columns of b. Every slice packs
+  // all of b, so the first one sums its columns.
+  float *bRowSums = rowBegin == 0 ? colSums : nullptr;
+  if (bRowSums) {
+    memset(bRowSums, 0, cDims[1] * sizeof(float));
+  }
+  libjit_matmul_outer<K, true, false, true>(cDims[1], rowEnd - rowBegin,
+                                            aDims[0], b, bDims[1], aSlice,
+                                            aDims[1], cSlice, cDims[1],
+                                            bRowSums);
+}
+
+/// Performs the batched matrix multiplication c[i] = a[i] * b[i] for the rows
+/// [\p rowBegin, \p rowEnd) of the rows of all the batch entries of c, using
+/// the kernel \p K. See libjit_batched_matmul_rows_f.
+template <typename K>
+void libjit_batched_matmul_rows(float *c, const float *a, const float *b,
+                                const size_t *cDims, const size_t *aDims,
+                                const size_t *bDims, size_t rowBegin,
+                                size_t rowEnd) {
+  size_t m = cDims[1];
+  size_t cSize = cDims[1] * cDims[2];
+  size_t aSize = aDims[1] * aDims[2];
+  size_t bSize = bDims[1] * bDims[2];
+  // Multiply the part of every batch entry that falls in the range with the
+  // same blocked routine as a single matrix multiplication.
+  while (rowBegin < rowEnd) {
+    size_t batch = rowBegin / m;
+    size_t first = rowBegin % m;
+    size_t last = MIN(m, first + (rowEnd - rowBegin));
+    libjit_matmul_rows<K>(c + batch * cSize, a + batch * aSize,
+                          b + batch * bSize, cDims + 1, aDims + 1, bDims + 1,
+                          first, last);
+    rowBegin += last - first;
+  }
+}
+
+/// Computes the columns [\p colBegin, \p colEnd) of the gates {batch,
+/// gatesSize} of the hidden state \p h {batch, hidden} of a recurrent layer,
+/// \p gates = \p h * \p weights + \p bias, using the kernel \p K. See
+/// libjit_recurrent_gates_cols_f.
+template <typename K>
+void libjit_recurrent_gates_cols(float *gates, const float *h,
+                                 const float *weights, const float *bias,
+                                 size_t batch, size_t hidden, size_t gatesSize,
+                                 size_t colBegin, size_t colEnd) {
+  size_t width = colEnd - colBegin;
+  for (size_t n = 0; n < batch; n++) {
+    memcpy(gates + n * gatesSize + colBegin, bias + colBegin,
+           width * sizeof(float));
+  }
+  // As in libjit_matmul_rows, the column-major helper computes C += B * A.
+  // The columns of the row-major weights and gates are its rows, so a range
+  // of columns keeps the leading dimension.
+  if (width >= pack_threshold) {
+    libjit_matmul_outer<K, true, false>(width, batch, hidden,
+                                        weights + colBegin, gatesSize, h,
+                                        hidden, gates + colBegin, gatesSize);
   } else {
-    libjit_matmul_outer<false>(m, n, k, b, bDims[1], a, aDims[1], c, cDims[1]);
+    libjit_matmul_outer<K, false, false>(width, batch, hidden,
+                                         weights + colBegin, gatesSize, h,
+                                         hidden, gates + colBegin, gatesSize);
   }
 }
 
+/// Number of columns of the result in each panel of a pre-packed int8 weight
+/// matrix, and the number of consecutive k that are interleaved for each
+/// column. This must match the layout that the CPU backend produces for
+/// CPUQuantizedPackedMatMul, [ceil(N/16), ceil(K/4), 16 * 4].
+constexpr size_t packed_i8_panel_width = 16;
+constexpr size_t packed_i8_depth = 4;
+
+/// The portable int8 dot-product kernel. dot<R> computes the raw products
+/// acc[r][j] = sum_k (a[r][k] + aBias) * b[k][j] of \p R rows of \p a with a
+/// pre-packed \p panel, in int32. \p a holds R rows of \p k4 * 4 values,
+/// zero-padded past k, and \p panel holds \p k4 groups of 16 columns of 4
+/// consecutive values of b.
+struct GenericI8Dot {
+  static constexpr int32_t aBias = 0;
+
+  template <int R>
+  static void dot(size_t k4, const int8_t *a, const int8_t *panel,
+                  int32_t acc[][packed_i8_panel_width]) {
+    for (int r = 0; r < R; r++) {
+      for (size_t j = 0; j < packed_i8_panel_width; j++) {
+        acc[r][j] = 0;
+      }
+    }
+    for (size_t q = 0; q < k4; q++) {
+      const int8_t *bq = panel + q * packed_i8_panel_width * packed_i8_depth;
+      for (int r = 0; r < R; r++) {
+        const int8_t *aq = a + (r * k4 + q) * packed_i8_depth;
+        for (size_t j = 0; j < packed_i8_panel_width; j++) {
+          int32_t sum = 0;
+          for (size_t t = 0; t < packed_i8_depth; t++) {
+            sum += aq[t] * bq[j * packed_i8_depth + t];
+          }
+          acc[r][j] += sum;
+        }
+      }
+    }
+  }
+};
+
+#if defined(__x86_64__)
+/// The AVX2 int8 dot-product kernel, see GenericI8Dot. The values are
+/// sign-extended to int16 and multiplied with vpmaddwd, which adds pairs of
+/// products into int32 lanes. vpmaddubsw is not used because its int16 sums
+/// of two products of 8-bit values saturate.
+struct AVX2I8Dot {
+  static constexpr int32_t aBias = 0;
+
+  template <int R>
+  __attribute__((target("avx2"))) static void
+  dot(size_t k4, const int8_t *a, const int8_t *panel,
+      int32_t acc[][packed_i8_panel_width]) {
+    // Every accumulator holds two partial sums for each of 4 columns.
+    __m256i sums[R][4];
+    for (int r = 0; r < R; r++) {
+      for (int c = 0; c < 4; c++) {
+        sums[r][c] = _mm256_setzero_si256();
+      }
+    }
+    for (size_t q = 0; q < k4; q++) {
+      const int8_t *bq = panel + q * packed_i8_panel_width * packed_i8_depth;
+      __m256i bb[4];
+      for (int c = 0; c < 4; c++) {
+        bb[c] = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128((const __m128i *)(bq + c * 16)));
+      }
+      for (int r = 0; r < R; r++) {
+        // Broadcast the 4 values of a to the 4 columns of each register.
+        int32_t word;
+        memcpy(&word, a + (r * k4 + q) * packed_i8_depth, sizeof(word));
+        __m256i aa = _mm256_cvtepi8_epi16(_mm_set1_epi32(word));
+        for (int c = 0; c < 4; c++) {
+          sums[r][c] =
+              _mm256_add_epi32(sums[r][c], _mm256_madd_epi16(bb[c], aa));
+        }
+      }
+    }
+    for (int r = 0; r < R; r++) {
+      for (int c = 0; c < 4; c++) {
+        int32_t tmp[8];
+        _mm256_storeu_si256((__m256i *)tmp, sums[r][c]);
+        for (int j = 0; j < 4; j++) {
+          acc[r][c * 4 + j] = tmp[2 * j] + tmp[2 * j + 1];
+        }
+      }
+    }
+  }
+};
+
+/// The AVX-512 VNNI int8 dot-product kernel, see GenericI8Dot. vpdpbusd
+/// multiplies unsigned by signed bytes and adds groups of 4 products into
+/// int32 lanes without saturation, so a is shifted by 128 into the unsigned
+/// range.
+struct VNNII8Dot {
+  static constexpr int32_t aBias = 128;
+
+  template <int R>
+  __attribute__((target("avx512f,avx512vnni"))) static void
+  dot(size_t k4, const int8_t *a, const int8_t *panel,
+      int32_t acc[][packed_i8_panel_width]) {
+    __m512i sums[R];
+    for (int r = 0; r < R; r++) {
+      sums[r] = _mm512_setzero_si512();
+    }
+    const __m512i flip = _mm512_set1_epi32((int32_t)0x80808080u);
+    for (size_t q = 0; q < k4; q++) {
+      __m512i bb = _mm512_loadu_si512(
+          panel + q * packed_i8_panel_width * packed_i8_depth);
+      for (int r = 0; r < R; r++) {
+        int32_t word;
+        memcpy(&word, a + (r * k4 + q) * packed_i8_depth, sizeof(word));
+        __m512i aa = _mm512_xor_si512(_mm512_set1_epi32(word), flip);
+        sums[r] = _mm512_dpbusd_epi32(sums[r], aa, bb);
+      }
+    }
+    for (int r = 0; r < R; r++) {
+      _mm512_storeu_si512(acc[r], sums[r]);
+    }
+  }
+};
+#endif // defined(__x86_64__)
+
+/// Performs the quantized matrix multiplication c = a * b for the panels
+/// [\p panelBegin, \p panelEnd) of c, where b is pre-packed into panels of
+/// 16 columns and \p colSums holds the sums of the columns of b. Rows of a
+/// are processed in blocks of \p R with the dot-product kernel \p D. The
+/// products are computed on the raw int8 values and the offsets are applied
+/// afterwards:
+///   sum_k (a - aOff) * (b - bOff) = sum_k a * b - aOff * colSum
+///                                   - bOff * rowSum + k * aOff * bOff
+/// If \p bias is not null, it holds an int32 value for each column of the
+/// panels, in the scale of the products, which is added before the results
+/// are scaled to the output type.
+template <typename D, int R>
+void libjit_quantized_matmul_packed_panels(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const int32_t *bias, const size_t *cDims, const size_t *aDims,
+    const size_t *bDims, int32_t outOffset, int32_t lhsOffset,
+    int32_t rhsOffset, int32_t outPre, int32_t outPost, int32_t outScale,
+    size_t panelBegin, size_t panelEnd) {
+  size_t m = cDims[0];
+  size_t n = cDims[1];
+  size_t k = aDims[1];
+  size_t k4 = bDims[1];
+  size_t rowSize = k4 * packed_i8_depth;
+  size_t panelSize = k4 * packed_i8_panel_width * packed_i8_depth;
+  int32_t kOffsets = (int32_t)k * lhsOffset * rhsOffset;
+
+  // A block of R rows of a, zero-padded to a multiple of 4 values.
+  int8_t aBlock[R * rowSize];
+  int32_t rowSums[R];
+  int32_t acc[R][packed_i8_panel_width];
+  for (size_t row = 0; row < m; row += R) {
+    size_t rows = MIN((size_t)R, m - row);
+    memset(aBlock, 0, R * rowSize);
+    for (size_t r = 0; r < rows; r++) {
+      const int8_t *aRow = a + (row + r) * k;
+      memcpy(aBlock + r * rowSize, aRow, k);
+      rowSums[r] = 0;
+      for (size_t p = 0; p < k; p++) {
+        rowSums[r] += aRow[p];
+      }
+    }
+
+    for (size_t panel = panelBegin; panel < panelEnd; panel++) {
+      D::template dot<R>(k4, aBlock, b + panel * panelSize, acc);
+
+      // Apply the offsets and the bias, and scale the results to the output
+      // type, 8 columns at a time.
+      size_t col = panel * packed_i8_panel_width;
+      size_t width = MIN(n - col, packed_i8_panel_width);
+      int32_t colScale = D::aBias + lhsOffset;
+      int32_t colOffsets[packed_i8_panel_width];
+      for (size_t j = 0; j < packed_i8_panel_width; j++) {
+        colOffsets[j] =
+            (bias ? bias[col + j] : 0) - colScale * colSums[col + j];
+      }
+      for (size_t r = 0; r < rows; r++) {
+        int8_t *cRow = c + (row + r) * n + col;
+        int32_t rowOffset = kOffsets - rhsOffset * rowSums[r];
+        size_t j = 0;
+        for (; j + 8 <= width; j += 8) {
+          int32x8 sum, offsets;
+          memcpy(&sum, &acc[r][j], sizeof(sum));
+          memcpy(&offsets, &colOffsets[j], sizeof(offsets));
+          sum += offsets + rowOffset;
+          libjit_store_i8x8(cRow + j,
+                            libjit_scale_i32i8x8(sum, outPre, outPost,
+                                                 outScale, outOffset));
+        }
+        for (; j < width; j++) {
+          int32_t sum = acc[r][j] + colOffsets[j] + rowOffset;
+          cRow[j] = libjit_clip(
+              libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset));
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
+extern "C" {
+
+/// Performs the matrix multiplication c = a * b for the rows [\p rowBegin,
+/// \p rowEnd) of c, where c, a, and b are row-major matrices. Disjoint row
+/// ranges can be computed independently, e.g. by different threads.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// \p b is a k x n matrix, so \p bDims = {k, n}
+void libjit_matmul_rows_f(float *c, const float *a, const float *b,
+                          const size_t *cDims, const size_t *aDims,
+                          const size_t *bDims, size_t rowBegin,
+                          size_t rowEnd) {
+  libjit_matmul_rows<GenericKernel>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                    rowEnd);
+}
+
+/// Same as libjit_matmul_rows_f, but blocked for targets with AVX2 and FMA.
+void libjit_matmul_rows_avx2_f(float *c, const float *a, const float *b,
+                               const size_t *cDims, const size_t *aDims,
+                               const size_t *bDims, size_t rowBegin,
+                               size_t rowEnd) {
+  libjit_matmul_rows<AVX2Kernel>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                 rowEnd);
+}
+
+/// Same as libjit_matmul_rows_f, but blocked for targets with AVX-512F.
+void libjit_matmul_rows_avx512_f(float *c, const float *a, const float *b,
+                                 const size_t *cDims, const size_t *aDims,
+                                 const size_t *bDims, size_t rowBegin,
+                                 size_t rowEnd) {
+  libjit_matmul_rows<AVX512Kernel>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                   rowEnd);
+}
+
+/// Same as libjit_matmul_rows_f, but blocked for AArch64 NEON.
+void libjit_matmul_rows_neon_f(float *c, const float *a, const float *b,
+                               const size_t *cDims, const size_t *aDims,
+                               const size_t *bDims, size_t rowBegin,
+                               size_t rowEnd) {
+  libjit_matmul_rows<NEONKernel>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                 rowEnd);
+}
+
+/// Same as libjit_matmul_rows_f, but blocked for ARMv7 NEON.
+void libjit_matmul_rows_neon32_f(float *c, const float *a, const float *b,
+                                 const size_t *cDims, const size_t *aDims,
+                                 const size_t *bDims, size_t rowBegin,
+                                 size_t rowEnd) {
+  libjit_matmul_rows<NEON32Kernel>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                   rowEnd);
+}
+
+/// Performs the matrix multiplication c = a * transpose(b) for the rows
+/// [\p rowBegin, \p rowEnd) of c, where c, a, and b are row-major matrices.
+/// This reads b in place instead of transposing it first.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// \p b is a n x k matrix, so \p bDims = {n, k}
+void libjit_matmul_trans_rows_f(float *c, const float *a, const float *b,
+                                const size_t *cDims, const size_t *aDims,
+                                const size_t *bDims, size_t rowBegin,
+                                size_t rowEnd) {
+  libjit_matmul_rows<GenericKernel, true>(c, a, b, cDims, aDims, bDims,
+                                          rowBegin, rowEnd);
+}
+
+/// Same as libjit_matmul_trans_rows_f, but blocked for targets with AVX2 and
+/// FMA.
+void libjit_matmul_trans_rows_avx2_f(float *c, const float *a, const float *b,
+                                     const size_t *cDims, const size_t *aDims,
+                                     const size_t *bDims, size_t rowBegin,
+                                     size_t rowEnd) {
+  libjit_matmul_rows<AVX2Kernel, true>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                       rowEnd);
+}
+
+/// Same as libjit_matmul_trans_rows_f, but blocked for targets with AVX-512F.
+void libjit_matmul_trans_rows_avx512_f(float *c, const float *a,
+                                       const float *b, const size_t *cDims,
+                                       const size_t *aDims,
+                                       const size_t *bDims, size_t rowBegin,
+                                       size_t rowEnd) {
+  libjit_matmul_rows<AVX512Kernel, true>(c, a, b, cDims, aDims, bDims,
+                                         rowBegin, rowEnd);
+}
+
+/// Same as libjit_matmul_trans_rows_f, but blocked for AArch64 NEON.
+void libjit_matmul_trans_rows_neon_f(float *c, const float *a, const float *b,
+                                     const size_t *cDims, const size_t *aDims,
+                                     const size_t *bDims, size_t rowBegin,
+                                     size_t rowEnd) {
+  libjit_matmul_rows<NEONKernel, true>(c, a, b, cDims, aDims, bDims, rowBegin,
+                                       rowEnd);
+}
+
+/// Same as libjit_matmul_trans_rows_f, but blocked for ARMv7 NEON.
+void libjit_matmul_trans_rows_neon32_f(float *c, const float *a,
+                                       const float *b, const size_t *cDims,
+                                       const size_t *aDims,
+                                       const size_t *bDims, size_t rowBegin,
+                                       size_t rowEnd) {
+  libjit_matmul_rows<NEON32Kernel, true>(c, a, b, cDims, aDims, bDims,
+                                         rowBegin, rowEnd);
+}
+
+/// Performs the matrix multiplication c = transpose(a) * b for the rows
+/// [\p rowBegin, \p rowEnd) of c, where c, a, and b are row-major matrices.
+/// This reads a in place instead of transposing it first. The call with
+/// \p rowBegin 0 also stores the sums of the columns of b in \p colSums,
+/// while b is packed, which is the bias gradient of a FullyConnected whose
+/// output gradient is b.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a k x m matrix, so \p aDims = {k, m}
+/// \p b is a k x n matrix, so \p bDims = {k, n}
+/// \p colSums is a vector of n elements.
+void libjit_matmul_trans_lhs_rows_f(float *c, float *colSums, const float *a,
+                                    const float *b, const size_t *cDims,
+                                    const size_t *aDims, const size_t *bDims,
+                                    size_t rowBegin, size_t rowEnd) {
+  libjit_matmul_trans_lhs_rows<GenericKernel>(c, colSums, a, b, cDims, aDims,
+                                              bDims, rowBegin, rowEnd);
+}
+
+/// Same as libjit_matmul_trans_lhs_rows_f, but blocked for targets with AVX2
+/// and FMA.
+void libjit_matmul_trans_lhs_rows_avx2_f(float *c, float *colSums,
+                                         const float *a, const float *b,
+                                         const size_t *cDims,
+                                         const size_t *aDims,
+                                         const size_t *bDims, size_t rowBegin,
+                                         size_t rowEnd) {
+  libjit_matmul_trans_lhs_rows<AVX2Kernel>(c, colSums, a, b, cDims, aDims,
+                                           bDims, rowBegin, rowEnd);
+}
+
+/// Same as libjit_matmul_trans_lhs_rows_f, but blocked for targets with
+/// AVX-512F.
+void libjit_matmul_trans_lhs_rows_avx512_f(float *c, float *colSums,
+                                           const float *a, const float *b,
+                                           const size_t *cDims,
+                                           const size_t *aDims,
+                                           const size_t *bDims,
+                                           size_t rowBegin, size_t rowEnd) {
+  libjit_matmul_trans_lhs_rows<AVX512Kernel>(c, colSums, a, b, cDims, aDims,
+                                             bDims, rowBegin, rowEnd);
+}
+
+/// Same as libjit_matmul_trans_lhs_rows_f, but blocked for AArch64 NEON.
+void libjit_matmul_trans_lhs_rows_neon_f(float *c, float *colSums,
+                                         const float *a, const float *b,
+                                         const size_t *cDims,
+                                         const size_t *aDims,
+                                         const size_t *bDims, size_t rowBegin,
+                                         size_t rowEnd) {
+  libjit_matmul_trans_lhs_rows<NEONKernel>(c, colSums, a, b, cDims, aDims,
+                                           bDims, rowBegin, rowEnd);
+}
+
+/// Same as libjit_matmul_trans_lhs_rows_f, but blocked for ARMv7 NEON.
+void libjit_matmul_trans_lhs_rows_neon32_f(float *c, float *colSums,
+                                           const float *a, const float *b,
+                                           const size_t *cDims,
+                                           const size_t *aDims,
+                                           const size_t *bDims,
+                                           size_t rowBegin, size_t rowEnd) {
+  libjit_matmul_trans_lhs_rows<NEON32Kernel>(c, colSums, a, b, cDims, aDims,
+                                             bDims, rowBegin, rowEnd);
+}
+
+/// Performs the matrix multiplication c[i] = a[i] * b[i] for every batch entry
+/// i, where c[i], a[i] and b[i] are row-major matrices. The work is split by
+/// the rows of all the batch entries: this computes the rows [\p rowBegin,
+/// \p rowEnd) of the {batches * m, n} matrix that c forms.
+/// \p c has the shape \p cDims = {batches, m, n}
+/// \p a has the shape \p aDims = {batches, m, k}
+/// \p b has the shape \p bDims = {batches, k, n}
+void libjit_batched_matmul_rows_f(float *c, const float *a, const float *b,
+                                  const size_t *cDims, const size_t *aDims,
+                                  const size_t *bDims, size_t rowBegin,
+                                  size_t rowEnd) {
+  libjit_batched_matmul_rows<GenericKernel>(c, a, b, cDims, aDims, bDims,
+                                            rowBegin, rowEnd);
+}
+
+/// Same as libjit_batched_matmul_rows_f, but blocked for AVX2 and FMA.
+void libjit_batched_matmul_rows_avx2_f(float *c, const float *a,
+                                       const float *b, const size_t *cDims,
+                                       const size_t *aDims,
+                                       const size_t *bDims, size_t rowBegin,
+                                       size_t rowEnd) {
+  libjit_batched_matmul_rows<AVX2Kernel>(c, a, b, cDims, aDims, bDims,
+                                         rowBegin, rowEnd);
+}
+
+/// Same as libjit_batched_matmul_rows_f, but blocked for AVX-512F.
+void libjit_batched_matmul_rows_avx512_f(float *c, const float *a,
+                                         const float *b, const size_t *cDims,
+                                         const size_t *aDims,
+                                         const size_t *bDims, size_t rowBegin,
+                                         size_t rowEnd) {
+  libjit_batched_matmul_rows<AVX512Kernel>(c, a, b, cDims, aDims, bDims,
+                                           rowBegin, rowEnd);
+}
+
+/// Same as libjit_batched_matmul_rows_f, but blocked for AArch64 NEON.
+void libjit_batched_matmul_rows_neon_f(float *c, const float *a,
+                                       const float *b, const size_t *cDims,
+                                       const size_t *aDims,
+                                       const size_t *bDims, size_t rowBegin,
+                                       size_t rowEnd) {
+  libjit_batched_matmul_rows<NEONKernel>(c, a, b, cDims, aDims, bDims,
+                                         rowBegin, rowEnd);
+}
+
+/// Same as libjit_batched_matmul_rows_f, but blocked for ARMv7 NEON.
+void libjit_batched_matmul_rows_neon32_f(float *c, const float *a,
+                                         const float *b, const size_t *cDims,
+                                         const size_t *aDims,
+                                         const size_t *bDims, size_t rowBegin,
+                                         size_t rowEnd) {
+  libjit_batched_matmul_rows<NEON32Kernel>(c, a, b, cDims, aDims, bDims,
+                                           rowBegin, rowEnd);
+}
+
+/// Computes the columns [\p colBegin, \p colEnd) of the gates {batch,
+/// gatesSize} of the hidden state \p h {batch, hidden} of the time step of a
+/// recurrent sequence: \p gates = \p h * \p weights + \p bias, where
+/// \p weights is {hidden, gatesSize}. Disjoint column ranges can be computed
+/// by different threads, which keeps every thread busy for the small batches
+/// of the recurrent layers.
+void libjit_recurrent_gates_cols_f(float *gates, const float *h,
+                                   const float *weights, const float *bias,
+                                   size_t batch, size_t hidden,
+                                   size_t gatesSize, size_t colBegin,
+                                   size_t colEnd) {
+  libjit_recurrent_gates_cols<GenericKernel>(gates, h, weights, bias, batch,
+                                             hidden, gatesSize, colBegin,
+                                             colEnd);
+}
+
+/// Same as libjit_recurrent_gates_cols_f, but blocked for AVX2 and FMA.
+void libjit_recurrent_gates_cols_avx2_f(float *gates, const float *h,
+                                        const float *weights,
+                                        const float *bias, size_t batch,
+                                        size_t hidden, size_t gatesSize,
+                                        size_t colBegin, size_t colEnd) {
+  libjit_recurrent_gates_cols<AVX2Kernel>(gates, h, weights, bias, batch,
+                                          hidden, gatesSize, colBegin, colEnd);
+}
+
+/// Same as libjit_recurrent_gates_cols_f, but blocked for AVX-512F.
+void libjit_recurrent_gates_cols_avx512_f(float *gates, const float *h,
+                                          const float *weights,
+                                          const float *bias, size_t batch,
+                                          size_t hidden, size_t gatesSize,
+                                          size_t colBegin, size_t colEnd) {
+  libjit_recurrent_gates_cols<AVX512Kernel>(gates, h, weights, bias, batch,
+                                            hidden, gatesSize, colBegin,
+                                            colEnd);
+}
+
+/// Same as libjit_recurrent_gates_cols_f, but blocked for AArch64 NEON.
+void libjit_recurrent_gates_cols_neon_f(float *gates, const float *h,
+                                        const float *weights,
+                                        const float *bias, size_t batch,
+                                        size_t hidden, size_t gatesSize,
+                                        size_t colBegin, size_t colEnd) {
+  libjit_recurrent_gates_cols<NEONKernel>(gates, h, weights, bias, batch,
+                                          hidden, gatesSize, colBegin, colEnd);
+}
+
+/// Same as libjit_recurrent_gates_cols_f, but blocked for ARMv7 NEON.
+void libjit_recurrent_gates_cols_neon32_f(float *gates, const float *h,
+                                          const float *weights,
+                                          const float *bias, size_t batch,
+                                          size_t hidden, size_t gatesSize,
+                                          size_t colBegin, size_t colEnd) {
+  libjit_recurrent_gates_cols<NEON32Kernel>(gates, h, weights, bias, batch,
+                                            hidden, gatesSize, colBegin,
+                                            colEnd);
+}
+
+/// Performs the matrix multiplication c = a * b for the panels
+/// [\p panelBegin, \p panelEnd) of c. c and a are row-major matrices and b is
+/// a k x n matrix that is pre-packed into panels of 16 columns.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// \p b has the shape \p bDims = {ceil(n / 16), k, 16}; the columns past n in
+/// the last panel are zero. The libjit_activation \p activation is applied to
+/// the result.
+void libjit_matmul_packed_panels_f(float *c, const float *a, const float *b,
+                                   const size_t *cDims, const size_t *aDims,
+                                   const size_t *bDims, unsigned activation,
+                                   size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float8, 3>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f, but blocked for AVX2 and FMA.
+void libjit_matmul_packed_panels_avx2_f(float *c, const float *a,
+                                        const float *b, const size_t *cDims,
+                                        const size_t *aDims,
+                                        const size_t *bDims,
+                                        unsigned activation, size_t panelBegin,
+                                        size_t panelEnd) {
+  libjit_matmul_packed_panels<float8, 6>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f, but blocked for AVX-512F.
+void libjit_matmul_packed_panels_avx512_f(float *c, const float *a,
+                                          const float *b, const size_t *cDims,
+                                          const size_t *aDims,
+                                          const size_t *bDims,
+                                          unsigned activation,
+                                          size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float16, 14>(c, a, b, cDims, aDims, bDims,
+                                           activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f, but blocked for the 32 q registers
+/// of AArch64 NEON: 6 rows of 4 float4 accumulators.
+void libjit_matmul_packed_panels_neon_f(float *c, const float *a,
+                                        const float *b, const size_t *cDims,
+                                        const size_t *aDims,
+                                        const size_t *bDims,
+                                        unsigned activation, size_t panelBegin,
+                                        size_t panelEnd) {
+  libjit_matmul_packed_panels<float4, 6>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f, but blocked for the 16 q registers
+/// of ARMv7 NEON.
+void libjit_matmul_packed_panels_neon32_f(float *c, const float *a,
+                                          const float *b, const size_t *cDims,
+                                          const size_t *aDims,
+                                          const size_t *bDims,
+                                          unsigned activation,
+                                          size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float4, 2>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f, but b holds IEEE half-precision
+/// values, which are expanded to floats in registers.
+void libjit_matmul_packed_panels_f16w_f(float *c, const float *a,
+                                        const uint16_t *b, const size_t *cDims,
+                                        const size_t *aDims,
+                                        const size_t *bDims,
+                                        unsigned activation, size_t panelBegin,
+                                        size_t panelEnd) {
+  libjit_matmul_packed_panels<float8, 3>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+#if defined(__x86_64__)
+/// Same as libjit_matmul_packed_panels_f16w_f, but blocked for AVX2 and FMA,
+/// and the weights are expanded with F16C.
+void libjit_matmul_packed_panels_avx2_f16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float8, 6>(c, a, (const libjit_f16c *)b, cDims,
+                                         aDims, bDims, activation, panelBegin,
+                                         panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f16w_f, but blocked for AVX-512F, and
+/// the weights are expanded with F16C.
+void libjit_matmul_packed_panels_avx512_f16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float16, 14>(c, a, (const libjit_f16c *)b, cDims,
+                                           aDims, bDims, activation,
+                                           panelBegin, panelEnd);
+}
+#endif // defined(__x86_64__)
+
+/// Same as libjit_matmul_packed_panels_f16w_f, but blocked for AArch64 NEON.
+void libjit_matmul_packed_panels_neon_f16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float4, 6>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f16w_f, but blocked for ARMv7 NEON.
+void libjit_matmul_packed_panels_neon32_f16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float4, 2>(c, a, b, cDims, aDims, bDims,
+                                         activation, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_f, but b holds bfloat16 values, which
+/// are widened to floats in registers.
+void libjit_matmul_packed_panels_bf16w_f(float *c, const float *a,
+                                         const uint16_t *b, const size_t *cDims,
+                                         const size_t *aDims,
+                                         const size_t *bDims,
+                                         unsigned activation, size_t panelBegin,
+                                         size_t panelEnd) {
+  libjit_matmul_packed_panels<float8, 3>(c, a, (const libjit_bf16 *)b, cDims,
+                                         aDims, bDims, activation, panelBegin,
+                                         panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_bf16w_f, but blocked for AVX2 and FMA.
+void libjit_matmul_packed_panels_avx2_bf16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float8, 6>(c, a, (const libjit_bf16 *)b, cDims,
+                                         aDims, bDims, activation, panelBegin,
+                                         panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_bf16w_f, but blocked for AVX-512F.
+void libjit_matmul_packed_panels_avx512_bf16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float16, 14>(c, a, (const libjit_bf16 *)b, cDims,
+                                           aDims, bDims, activation,
+                                           panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_bf16w_f, but blocked for AArch64 NEON.
+void libjit_matmul_packed_panels_neon_bf16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float4, 6>(c, a, (const libjit_bf16 *)b, cDims,
+                                         aDims, bDims, activation, panelBegin,
+                                         panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_bf16w_f, but blocked for ARMv7 NEON.
+void libjit_matmul_packed_panels_neon32_bf16w_f(
+    float *c, const float *a, const uint16_t *b, const size_t *cDims,
+    const size_t *aDims, const size_t *bDims, unsigned activation,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_matmul_packed_panels<float4, 2>(c, a, (const libjit_bf16 *)b, cDims,
+                                         aDims, bDims, activation, panelBegin,
+                                         panelEnd);
+}
+
+/// Performs the matrix multiplication c = a * b, where c, a, and b are
+/// row-major matrices.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// \p b is a k x n matrix, so \p bDims = {k, n}
+void libjit_matmul_f(float *c, const float *a, const float *b,
+                     const size_t *cDims, const size_t *aDims,
+                     const size_t *bDims) {
+  libjit_matmul_rows_f(c, a, b, cDims, aDims, bDims, 0, cDims[0]);
+}
+
+/// AVX2 variant of libjit_matmul_f.
+void libjit_matmul_avx2_f(float *c, const float *a, const float *b,
+                          const size_t *cDims, const size_t *aDims,
+                          const size_t *bDims) {
+  libjit_matmul_rows_avx2_f(c, a, b, cDims, aDims, bDims, 0, cDims[0]);
+}
+
+/// AVX-512 variant of libjit_matmul_f.
+void libjit_matmul_avx512_f(float *c, const float *a, const float *b,
+                            const size_t *cDims, const size_t *aDims,
+                            const size_t *bDims) {
+  libjit_matmul_rows_avx512_f(c, a, b, cDims, aDims, bDims, 0, cDims[0]);
+}
+
 void libjit_matmul_i8(int8_t *outW, const int8_t *lhsW, const int8_t *rhsW,
                       const size_t *outWdims, const size_t *lhsWdims,
                       const size_t *rhsWdims, int32_t outOffset,
@@ -300,4 +1390,271 @@ void libjit_matmul_i8(int8_t *outW, const int8_t *lhsW, const int8_t *rhsW,
     }
   }
 }
+
+/// Same as libjit_matmul_i8, but \p rhsW is stored transposed, so
+/// \p rhsWdims = {n, k}.
+void libjit_matmul_trans_i8(int8_t *outW, const int8_t *lhsW,
+                            const int8_t *rhsW, const size_t *outWdims,
+                            const size_t *lhsWdims, const size_t *rhsWdims,
+                            int32_t outOffset, int32_t lhsOffset,
+                            int32_t rhsOffset, int32_t outPre, int32_t outPost,
+                            int32_t outScale) {
+  for (size_t x = 0; x < outWdims[0]; x++) {
+    for (size_t y = 0; y < outWdims[1]; y++) {
+      int32_t sum = 0;
+      for (size_t i = 0; i < lhsWdims[1]; i++) {
+        int32_t lhs = lhsW[libjit_getXY(lhsWdims, x, i)] - lhsOffset;
+        int32_t rhs = rhsW[libjit_getXY(rhsWdims, y, i)] - rhsOffset;
+        sum += lhs * rhs;
+      }
+      int32_t s = libjit_scale_i32i8(sum, outPre, outPost, outScale, outOffset);
+      outW[libjit_getXY(outWdims, x, y)] = libjit_clip(s);
+    }
+  }
+}
+
+/// Computes the rows [\p rowBegin, \p rowEnd) of the 16-bit quantized matrix
+/// multiplication outW = lhsW * rhsW. The products of 16-bit operands overflow
+/// 32-bit sums, so they are accumulated in 64 bits, and the sums are scaled by
+/// \p outScale = s_l * s_r / s_d in floating point. The sums of a block of
+/// columns are kept together, so that the rows of \p rhsW are read in order.
+void libjit_matmul_rows_i16(int16_t *outW, const int16_t *lhsW,
+                            const int16_t *rhsW, const size_t *outWdims,
+                            const size_t *lhsWdims, const size_t *rhsWdims,
+                            int32_t outOffset, int32_t lhsOffset,
+                            int32_t rhsOffset, float outScale, size_t rowBegin,
+                            size_t rowEnd) {
+  constexpr size_t colBlock = 64;
+  size_t n = outWdims[1];
+  size_t k = lhsWdims[1];
+  int64_t sums[colBlock];
+  for (size_t x = rowBegin; x < rowEnd; x++) {
+    for (size_t y0 = 0; y0 < n; y0 += colBlock) {
+      size_t cols = MIN(colBlock, n - y0);
+      for (size_t y = 0; y < cols; y++) {
+        sums[y] = 0;
+      }
+      for (size_t i = 0; i < k; i++) {
+        int64_t lhs = lhsW[libjit_getXY(lhsWdims, x, i)] - lhsOffset;
+        const int16_t *rhsRow = rhsW + libjit_getXY(rhsWdims, i, y0);
+        for (size_t y = 0; y < cols; y++) {
+          sums[y] += lhs * (rhsRow[y] - rhsOffset);
+        }
+      }
+      for (size_t y = 0; y < cols; y++) {
+        outW[libjit_getXY(outWdims, x, y0 + y)] =
+            libjit_round_clip_i16(outScale * sums[y] + outOffset);
+      }
+    }
+  }
+}
+
+/// Same as libjit_matmul_rows_i16, but \p rhsW is stored transposed, so
+/// \p rhsWdims = {n, k}.
+void libjit_matmul_trans_rows_i16(int16_t *outW, const int16_t *lhsW,
+                                  const int16_t *rhsW, const size_t *outWdims,
+                                  const size_t *lhsWdims,
+                                  const size_t *rhsWdims, int32_t outOffset,
+                                  int32_t lhsOffset, int32_t rhsOffset,
+                                  float outScale, size_t rowBegin,
+                                  size_t rowEnd) {
+  size_t k = lhsWdims[1];
+  for (size_t x = rowBegin; x < rowEnd; x++) {
+    const int16_t *lhsRow = lhsW + libjit_getXY(lhsWdims, x, 0);
+    for (size_t y = 0; y < outWdims[1]; y++) {
+      const int16_t *rhsRow = rhsW + libjit_getXY(rhsWdims, y, 0);
+      int64_t sum = 0;
+      for (size_t i = 0; i < k; i++) {
+        sum += (int64_t)(lhsRow[i] - lhsOffset) * (rhsRow[i] - rhsOffset);
+      }
+      outW[libjit_getXY(outWdims, x, y)] =
+          libjit_round_clip_i16(outScale * sum + outOffset);
+    }
+  }
+}
+
+/// Performs the matrix multiplication c = a * b for the columns
+/// [\p colBegin, \p colEnd) of c, where c and a are row-major matrices and b
+/// is a sparse k x n matrix in the compressed sparse column format. The
+/// non-zero values of the column j of b are \p values[colOffsets[j] ..
+/// colOffsets[j + 1]), and their rows are given by the same entries of
+/// \p rowIndices.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// The libjit_activation \p activation is applied to the result.
+void libjit_matmul_sparse_cols_f(float *c, const float *a, const float *values,
+                                 const int32_t *rowIndices,
+                                 const int32_t *colOffsets, const size_t *cDims,
+                                 const size_t *aDims, unsigned activation,
+                                 size_t colBegin, size_t colEnd) {
+  size_t m = cDims[0];
+  size_t n = cDims[1];
+  size_t k = aDims[1];
+  // Every non-zero weight is loaded once for a block of rows of a.
+  constexpr size_t R = 4;
+  for (size_t row = 0; row < m; row += R) {
+    size_t rows = MIN(R, m - row);
+    const float *aBlock = a + row * k;
+    for (size_t col = colBegin; col < colEnd; col++) {
+      float acc[R] = {0};
+      for (int32_t j = colOffsets[col], e = colOffsets[col + 1]; j < e; j++) {
+        float v = values[j];
+        const float *aCol = aBlock + rowIndices[j];
+        for (size_t r = 0; r < rows; r++) {
+          acc[r] += v * aCol[r * k];
+        }
+      }
+      for (size_t r = 0; r < rows; r++) {
+        c[(row + r) * n + col] = acc[r];
+      }
+    }
+    for (size_t r = 0; r < rows; r++) {
+      libjit_activation_inplace(c + (row + r) * n + colBegin,
+                                colEnd - colBegin, activation);
+    }
+  }
+}
+
+/// Performs the matrix multiplication c = a * b for the columns
+/// [\p colBegin, \p colEnd) of c, where c and a are row-major matrices and b
+/// is a k x n matrix whose weights are clustered into the centroids of
+/// \p codebook. Row j of \p codes holds the indices of the \p codeBits bits
+/// of the centroids of the column j of b, see libjit_decode_clustered_row().
+/// The columns are decoded a chunk at a time into a buffer on the stack, which
+/// every row of a then reads from the cache, so the memory only streams the
+/// indices.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// The libjit_activation \p activation is applied to the result.
+void libjit_matmul_clustered_cols_f(float *c, const float *a,
+                                    const float *codebook,
+                                    const uint8_t *codes, const size_t *cDims,
+                                    const size_t *aDims, unsigned codeBits,
+                                    unsigned activation, size_t colBegin,
+                                    size_t colEnd) {
+  size_t m = cDims[0];
+  size_t n = cDims[1];
+  size_t k = aDims[1];
+  size_t rowBytes = (k * codeBits + 7) / 8;
+  constexpr size_t width = sizeof(float8) / sizeof(float);
+  // An even number of weights, so that the chunks start on a byte.
+  constexpr size_t chunk = 512;
+  float w[chunk];
+  for (size_t col = colBegin; col < colEnd; col++) {
+    const uint8_t *colCodes = codes + col * rowBytes;
+    if (col + 1 < colEnd) {
+      libjit_prefetch_row(colCodes + rowBytes, rowBytes);
+    }
+    for (size_t r = 0; r < m; r++) {
+      c[r * n + col] = 0;
+    }
+    for (size_t k0 = 0; k0 < k; k0 += chunk) {
+      size_t len = MIN(chunk, k - k0);
+      libjit_decode_clustered_row(w, colCodes, codebook, k0, len, codeBits);
+      for (size_t r = 0; r < m; r++) {
+        const float *x = a + r * k + k0;
+        float8 sum8 = BroadcastFloat8(0);
+        size_t i = 0;
+        for (; i + width <= len; i += width) {
+          sum8 += LoaduFloat8(x + i) * LoaduFloat8(w + i);
+        }
+        float sum = 0;
+        for (size_t j = 0; j < width; j++) {
+          sum += sum8[j];
+        }
+        for (; i < len; i++) {
+          sum += x[i] * w[i];
+        }
+        c[r * n + col] += sum;
+      }
+    }
+  }
+  for (size_t r = 0; r < m; r++) {
+    libjit_activation_inplace(c + r * n + colBegin, colEnd - colBegin,
+                              activation);
+  }
+}
+
+/// Performs the quantized matrix multiplication c = a * b for the panels
+/// [\p panelBegin, \p panelEnd) of c. c and a are row-major int8 matrices and
+/// b is a k x n int8 matrix that is pre-packed into panels of 16 columns.
+/// \p c is a m x n matrix, so \p cDims = {m, n}
+/// \p a is a m x k matrix, so \p aDims = {m, k}
+/// \p b has the shape \p bDims = {ceil(n / 16), ceil(k / 4), 64}, where the
+/// values b[4q..4q+3][16p + j] are at b[p][q][4j..4j+3]; the padding is zero.
+/// \p colSums holds the sums of the ceil(n / 16) * 16 columns of b.
+void libjit_matmul_packed_panels_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const size_t *cDims, const size_t *aDims, const size_t *bDims,
+    int32_t outOffset, int32_t lhsOffset, int32_t rhsOffset, int32_t outPre,
+    int32_t outPost, int32_t outScale, size_t panelBegin, size_t panelEnd) {
+  libjit_quantized_matmul_packed_panels<GenericI8Dot, 4>(
+      c, a, b, colSums, nullptr, cDims, aDims, bDims, outOffset, lhsOffset,
+      rhsOffset, outPre, outPost, outScale, panelBegin, panelEnd);
+}
+
+#if defined(__x86_64__)
+/// Same as libjit_matmul_packed_panels_i8, but uses AVX2.
+void libjit_matmul_packed_panels_avx2_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const size_t *cDims, const size_t *aDims, const size_t *bDims,
+    int32_t outOffset, int32_t lhsOffset, int32_t rhsOffset, int32_t outPre,
+    int32_t outPost, int32_t outScale, size_t panelBegin, size_t panelEnd) {
+  libjit_quantized_matmul_packed_panels<AVX2I8Dot, 2>(
+      c, a, b, colSums, nullptr, cDims, aDims, bDims, outOffset, lhsOffset,
+      rhsOffset, outPre, outPost, outScale, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_packed_panels_i8, but uses AVX-512 VNNI.
+void libjit_matmul_packed_panels_vnni_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const size_t *cDims, const size_t *aDims, const size_t *bDims,
+    int32_t outOffset, int32_t lhsOffset, int32_t rhsOffset, int32_t outPre,
+    int32_t outPost, int32_t outScale, size_t panelBegin, size_t panelEnd) {
+  libjit_quantized_matmul_packed_panels<VNNII8Dot, 8>(
+      c, a, b, colSums, nullptr, cDims, aDims, bDims, outOffset, lhsOffset,
+      rhsOffset, outPre, outPost, outScale, panelBegin, panelEnd);
+}
+#endif // defined(__x86_64__)
+
+/// Same as libjit_matmul_packed_panels_i8, but adds \p bias, which holds an
+/// int32 value in the scale of the products for each of the ceil(n / 16) * 16
+/// columns of b, to the products. This is the matrix multiplication of a
+/// quantized im2col convolution.
+void libjit_matmul_bias_packed_panels_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const int32_t *bias, const size_t *cDims, const size_t *aDims,
+    const size_t *bDims, int32_t outOffset, int32_t lhsOffset,
+    int32_t rhsOffset, int32_t outPre, int32_t outPost, int32_t outScale,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_quantized_matmul_packed_panels<GenericI8Dot, 4>(
+      c, a, b, colSums, bias, cDims, aDims, bDims, outOffset, lhsOffset,
+      rhsOffset, outPre, outPost, outScale, panelBegin, panelEnd);
+}
+
+#if defined(__x86_64__)
+/// Same as libjit_matmul_bias_packed_panels_i8, but uses AVX2.
+void libjit_matmul_bias_packed_panels_avx2_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const int32_t *bias, const size_t *cDims, const size_t *aDims,
+    const size_t *bDims, int32_t outOffset, int32_t lhsOffset,
+    int32_t rhsOffset, int32_t outPre, int32_t outPost, int32_t outScale,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_quantized_matmul_packed_panels<AVX2I8Dot, 2>(
+      c, a, b, colSums, bias, cDims, aDims, bDims, outOffset, lhsOffset,
+      rhsOffset, outPre, outPost, outScale, panelBegin, panelEnd);
+}
+
+/// Same as libjit_matmul_bias_packed_panels_i8, but uses AVX-512 VNNI.
+void libjit_matmul_bias_packed_panels_vnni_i8(
+    int8_t *c, const int8_t *a, const int8_t *b, const int32_t *colSums,
+    const int32_t *bias, const size_t *cDims, const size_t *aDims,
+    const size_t *bDims, int32_t outOffset, int32_t lhsOffset,
+    int32_t rhsOffset, int32_t outPre, int32_t outPost, int32_t outScale,
+    size_t panelBegin, size_t panelEnd) {
+  libjit_quantized_matmul_packed_panels<VNNII8Dot, 8>(
+      c, a, b, colSums, bias, cDims, aDims, bDims, outOffset, lhsOffset,
+      rhsOffset, outPre, outPost, outScale, panelBegin, panelEnd);
+}
+#endif // defined(__x86_64__)
 }
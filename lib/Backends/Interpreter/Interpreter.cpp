@@ -21,18 +21,35 @@
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/IR.h"
 
+#include "llvm/Support/CommandLine.h"
+
 using namespace glow;
 
+static llvm::cl::OptionCategory
+    InterpreterBackendCat("Glow Interpreter Backend Options");
+
+static llvm::cl::opt<unsigned> interpreterNumThreads(
+    "interpreter-num-threads",
+    llvm::cl::desc("Number of threads used to execute the convolutions, the "
+                   "matrix multiplications, the sparse lengths sums and the "
+                   "element-wise instructions of each interpreted function "
+                   "(1 means single-threaded)"),
+    llvm::cl::init(1), llvm::cl::cat(InterpreterBackendCat));
+
+Interpreter::Interpreter() : numThreads_(interpreterNumThreads) {}
+
 std::unique_ptr<CompiledFunction>
 Interpreter::compile(Function *F, const Context &ctx) const {
-  auto IR = generateAndOptimizeIR(F, shouldShareBuffers());
+  auto IR = generateAndOptimizeIR(F, shouldShareBuffers(),
+                                  getCompileSchedulerKind());
   return compileIR(std::move(IR), ctx);
 }
 
 std::unique_ptr<CompiledFunction>
 Interpreter::compileIR(std::unique_ptr<IRFunction> IR,
                        const Context &ctx) const {
-  return llvm::make_unique<InterpreterFunction>(std::move(IR), ctx);
+  return llvm::make_unique<InterpreterFunction>(std::move(IR), ctx,
+                                                numThreads_);
 }
 
 bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
@@ -41,7 +58,10 @@ bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     switch (opKind) {
     case Kinded::Kind::AddNodeKind:
     case Kinded::Kind::BatchedAddNodeKind:
+    case Kinded::Kind::BatchedMatMulNodeKind:
+    case Kinded::Kind::BroadcastNodeKind:
     case Kinded::Kind::BatchedReduceAddNodeKind:
+    case Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind:
     case Kinded::Kind::CmpLTENodeKind:
     case Kinded::Kind::ConcatNodeKind:
     case Kinded::Kind::ConvolutionNodeKind:
@@ -49,12 +69,14 @@ bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::DivNodeKind:
     case Kinded::Kind::FullyConnectedNodeKind:
     case Kinded::Kind::GatherNodeKind:
+    case Kinded::Kind::LogNodeKind:
     case Kinded::Kind::MatMulNodeKind:
     case Kinded::Kind::MaxNodeKind:
     case Kinded::Kind::MinNodeKind:
     case Kinded::Kind::MulNodeKind:
     case Kinded::Kind::AvgPoolNodeKind:
     case Kinded::Kind::MaxPoolNodeKind:
+    case Kinded::Kind::PowNodeKind:
     case Kinded::Kind::QuantizeNodeKind:
     case Kinded::Kind::ReluNodeKind:
     case Kinded::Kind::RescaleQuantizedNodeKind:
@@ -62,6 +84,7 @@ bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     case Kinded::Kind::SelectNodeKind:
     case Kinded::Kind::SigmoidNodeKind:
     case Kinded::Kind::SliceNodeKind:
+    case Kinded::Kind::SoftMaxNodeKind:
     case Kinded::Kind::SubNodeKind:
     case Kinded::Kind::TanhNodeKind:
     case Kinded::Kind::TopKNodeKind:
@@ -72,13 +95,72 @@ bool Interpreter::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const {
     }
   }
 
+  // The 16-bit quantization covers the arithmetic used by fully connected
+  // and recurrent layers, and the data movement around them.
+  if (elementTy == ElemKind::Int16QTy) {
+    switch (opKind) {
+    case Kinded::Kind::AddNodeKind:
+    case Kinded::Kind::BatchedAddNodeKind:
+    case Kinded::Kind::BatchedMatMulNodeKind:
+    case Kinded::Kind::BroadcastNodeKind:
+    case Kinded::Kind::ConcatNodeKind:
+    case Kinded::Kind::DequantizeNodeKind:
+    case Kinded::Kind::FullyConnectedNodeKind:
+    case Kinded::Kind::MatMulNodeKind:
+    case Kinded::Kind::MulNodeKind:
+    case Kinded::Kind::QuantizeNodeKind:
+    case Kinded::Kind::RescaleQuantizedNodeKind:
+    case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::SliceNodeKind:
+    case Kinded::Kind::SubNodeKind:
+    case Kinded::Kind::TransposeNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // Half precision and bfloat16 tensors are converted to float for
+  // computation.
+  if (elementTy == ElemKind::Float16Ty || elementTy == ElemKind::BFloat16Ty) {
+    switch (opKind) {
+    case Kinded::Kind::ConcatNodeKind:
+    case Kinded::Kind::ConvertToNodeKind:
+    case Kinded::Kind::ReshapeNodeKind:
+    case Kinded::Kind::SliceNodeKind:
+    case Kinded::Kind::SparseLengthsWeightedSumNodeKind:
+    case Kinded::Kind::SplatNodeKind:
+    case Kinded::Kind::TransposeNodeKind:
+      return true;
+    default:
+      return false;
+    }
+  }
+
   return true;
 }
 
 bool Interpreter::shouldLower(const Node *N) const {
-  if (N->getKind() == Kinded::Kind::ConvolutionNodeKind)
+  switch (N->getKind()) {
+  case Kinded::Kind::ConvolutionNodeKind:
+  case Kinded::Kind::BatchedMatMulNodeKind:
+  case Kinded::Kind::LSTMUnitNodeKind:
+  case Kinded::Kind::GRUUnitNodeKind:
+  case Kinded::Kind::RNNSequenceNodeKind:
+  case Kinded::Kind::LSTMSequenceNodeKind:
+  case Kinded::Kind::GRUSequenceNodeKind:
+  case Kinded::Kind::SGDNodeKind:
+  case Kinded::Kind::SigmoidCrossEntropyWithLogitsNodeKind:
+  case Kinded::Kind::BatchNormalizationNodeKind:
+  case Kinded::Kind::BatchNormalizationGradNodeKind:
+  case Kinded::Kind::MeanVarNormalizationNodeKind:
     return false;
-  return true;
+  case Kinded::Kind::BroadcastNodeKind:
+    // The arithmetic reads the broadcast operands in place.
+    return !llvm::cast<BroadcastNode>(N)->hasOnlyArithmeticUsers();
+  default:
+    return true;
+  }
 }
 
 namespace glow {
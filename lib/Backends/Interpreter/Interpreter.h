@@ -25,9 +25,24 @@ namespace glow {
 /// This is the IR-interpreter. It owns the IR, and the heap, and is able to
 /// execute the instructions one at a time.
 class Interpreter final : public BackendUsingGlowIR {
+  /// The number of threads used by each function compiled by this backend.
+  unsigned numThreads_;
+
 public:
-  /// Ctor.
-  Interpreter() = default;
+  /// Ctor. The number of threads is initialized from the
+  /// -interpreter-num-threads command line option.
+  Interpreter();
+
+  /// Set the number of threads used to execute the convolutions, the matrix
+  /// multiplications, the sparse lengths sums and the element-wise
+  /// instructions of the functions compiled after this call. Each compiled
+  /// function owns its own pool of \p numThreads threads, unless
+  /// -shared-thread-pool makes them share the pool of the process. A value of
+  /// 1 executes everything on the calling thread.
+  void setNumThreads(unsigned numThreads) { numThreads_ = numThreads; }
+
+  /// \returns the number of threads used by the compiled functions.
+  unsigned getNumThreads() const { return numThreads_; }
 
   /// @name Backend methods.
   /// This is the implementation of the Backend interface.
@@ -16,98 +16,233 @@
 
 #include "InterpreterFunction.h"
 
+#include "glow/CodeGen/MemoryAllocator.h"
 #include "glow/IR/IR.h"
 #include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
+#include "glow/Support/Cancellation.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/Compiler.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/Trace.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Casting.h"
 
 using namespace glow;
 
 InterpreterFunction::InterpreterFunction(std::unique_ptr<IRFunction> F,
-                                         const Context &ctx)
-    : F_(std::move(F)) {
+                                         const Context &ctx,
+                                         unsigned numThreads)
+    : F_(std::move(F)),
+      ownedThreadPool_(ThreadPool::isSharedPoolEnabled()
+                           ? nullptr
+                           : llvm::make_unique<ThreadPool>(numThreads)),
+      threadPool_(ownedThreadPool_ ? ownedThreadPool_.get()
+                                   : &ThreadPool::getShared()) {
+  assignSlots();
+  allocateActivations();
 
   // Register the concrete tensors that back the placeholder tensors.
   for (auto &ph : ctx.pairs()) {
     auto *w = F_->getWeightForNode(ph.first);
-    assert(!externalTensors_.count(w) && "The tensor is already registered");
-    externalTensors_[w] = ph.second;
+    placeholderTensors_.emplace_back(getSlot(w), ph.second);
   }
 
+  variableTensors_.resize(numWeights_, nullptr);
   for (auto &v : F_->getGraph()->getParent()->getVars()) {
-    auto *w = F_->getWeightForNode(v);
-    assert(!externalTensors_.count(w) && "The tensor is already registered");
-    externalTensors_[w] = &v->getPayload();
+    auto slot = getSlot(F_->getWeightForNode(v));
+    assert(!variableTensors_[slot] && "The tensor is already registered");
+    variableTensors_[slot] = &v->getPayload();
   }
 }
 
-InterpreterFunction::~InterpreterFunction() {
-  // Delete the tensors that are owned by this backend.
-  for (auto p : tensors_) {
-    delete p.second;
+InterpreterFunction::~InterpreterFunction() = default;
+
+MemoryUsage InterpreterFunction::getMemoryUsage() const {
+  // The kernels read and write the payloads of the variables in place.
+  MemoryUsage usage;
+  for (unsigned slot = 0; slot < numWeights_; slot++) {
+    const Tensor *T = variableTensors_[slot];
+    if (!T) {
+      continue;
+    }
+    auto *W = llvm::cast<WeightVar>(slotValues_[slot]);
+    if (W->getMutability() == WeightVar::MutabilityKind::Constant) {
+      usage.constantWeights += T->getType().getSizeInBytes();
+    } else {
+      usage.mutableWeights += T->getType().getSizeInBytes();
+    }
+  }
+  usage.activations = arenaSize_;
+  return usage;
+}
+
+void InterpreterFunction::assignSlots() {
+  auto addSlot = [&](const Value *v) {
+    assert(!slots_.count(v) && "The value already has a slot");
+    slots_[v] = slotValues_.size();
+    slotValues_.push_back(v);
+  };
+
+  for (const auto *W : F_->getWeights()) {
+    addSlot(W);
+  }
+  numWeights_ = slotValues_.size();
+
+  for (const auto &I : F_->getInstrs()) {
+    if (llvm::isa<AllocActivationInst>(&I) || llvm::isa<TensorViewInst>(&I)) {
+      addSlot(&I);
+    }
+  }
+
+  // Resolve the operands now that every value has a slot.
+  for (const auto &I : F_->getInstrs()) {
+    firstOperandSlot_.push_back(operandSlots_.size());
+    for (const auto &op : I.getOperands()) {
+      operandSlots_.push_back(getSlot(op.first));
+    }
   }
-  tensors_.clear();
-  externalTensors_.clear();
 }
 
-Tensor *InterpreterFunction::getTensor(const Value *v) const {
-  auto it = tensors_.find(v);
-  if (it != tensors_.end()) {
-    return it->second;
+void InterpreterFunction::allocateActivations() {
+  // Use a memory allocator with no upper bound on how much memory we can
+  // allocate.
+  MemoryAllocator activationsAllocator("Activations", 0);
+
+  // Collect the lifetimes of the activations, and place all of them at once.
+  std::vector<MemoryAllocator::Allocation> allocList;
+  for (const auto &I : F_->getInstrs()) {
+    if (auto *A = llvm::dyn_cast<AllocActivationInst>(&I)) {
+      allocList.emplace_back(A, true, I.getSizeInBytes());
+      continue;
+    }
+
+    if (auto *D = llvm::dyn_cast<DeallocActivationInst>(&I)) {
+      allocList.emplace_back(D->getAlloc(), false, 0);
+    }
   }
+  arenaSize_ = activationsAllocator.allocateAll(allocList);
+  GLOW_ASSERT(arenaSize_ != MemoryAllocator::npos &&
+              "Could not allocate the activations");
 
-  auto ie = externalTensors_.find(v);
-  assert(ie != externalTensors_.end() && "Unknown key Value.");
-  return ie->second;
+  activationOffsets_.resize(slotValues_.size(), 0);
+  for (auto &A : allocList) {
+    if (A.alloc) {
+      auto *V = static_cast<const Value *>(A.handle);
+      activationOffsets_[getSlot(V)] = activationsAllocator.getAddress(V);
+    }
+  }
+  if (auto *report = getCurrentCompileReport()) {
+    report->addMemoryUsage("activations", arenaSize_);
+  }
 }
 
-Tensor *InterpreterFunction::getOrCreateTensor(const Value *v) {
-  auto ie = externalTensors_.find(v);
-  if (ie != externalTensors_.end()) {
-    return ie->second;
+std::unique_ptr<BoundInterpreterFunction> InterpreterFunction::acquireState() {
+  {
+    std::lock_guard<std::mutex> lock(idleStatesMutex_);
+    if (!idleStates_.empty()) {
+      auto state = std::move(idleStates_.back());
+      idleStates_.pop_back();
+      return state;
+    }
   }
+  return llvm::make_unique<BoundInterpreterFunction>(*this);
+}
+
+void InterpreterFunction::releaseState(
+    std::unique_ptr<BoundInterpreterFunction> state) {
+  std::lock_guard<std::mutex> lock(idleStatesMutex_);
+  idleStates_.push_back(std::move(state));
+}
 
-  // Pick the tensor.
-  auto it = tensors_.find(v);
-  if (it == tensors_.end()) {
-    auto *T = new Tensor(v->getType());
-    tensors_[v] = T;
-    return T;
+void InterpreterFunction::execute() {
+  ScopedTraceEvent trace(F_->getGraph()->getName(), "execute");
+  auto state = acquireState();
+  for (unsigned slot = 0; slot < numWeights_; slot++) {
+    state->bindWeight(slot, variableTensors_[slot]);
+  }
+  for (auto &ph : placeholderTensors_) {
+    state->bindWeight(ph.first, ph.second);
   }
-  return it->second;
+  state->execute();
+  releaseState(std::move(state));
 }
 
-Tensor *
-InterpreterFunction::getOrCreateUnownedTensor(const Value *v, const Value *src,
-                                              llvm::ArrayRef<size_t> offsets) {
-  assert(llvm::isa<TensorViewInst>(v) && "Expected a tensor view");
+void InterpreterFunction::execute(Context &ctx) {
+  ScopedTraceEvent trace(F_->getGraph()->getName(), "execute");
+  auto state = acquireState();
+  for (unsigned slot = 0; slot < numWeights_; slot++) {
+    state->bindWeight(slot, variableTensors_[slot]);
+  }
+  for (auto &ph : ctx.pairs()) {
+    auto *w = F_->getWeightForNode(ph.first);
+    if (!w) {
+      // The placeholder is not used by this function.
+      continue;
+    }
+    GLOW_ASSERT(ph.second->getType().isEqual(*w->getType()) &&
+                "The tensor does not match the type of the placeholder");
+    state->bindWeight(getSlot(w), ph.second);
+  }
+  for (auto &ph : placeholderTensors_) {
+    GLOW_ASSERT(state->getBoundWeight(ph.first) &&
+                "The context does not provide a tensor for a placeholder");
+  }
+  state->execute();
+  releaseState(std::move(state));
+}
 
-  // Pick the tensor.
-  auto it = tensors_.find(v);
+BoundInterpreterFunction::BoundInterpreterFunction(
+    const InterpreterFunction &function)
+    : function_(function), tensors_(function.slotValues_.size(), nullptr) {
+  if (function.arenaSize_) {
+    arena_ = alignedAlloc(function.arenaSize_, TensorAlignment);
+  }
 
-  // Release unowned tensors before re-creating them.
-  if (it != tensors_.end()) {
-    deleteTensor(v);
+  // The activations always live at the same place in the arena. The tensor
+  // views are rebuilt by every execution.
+  auto numWeights = function.numWeights_;
+  ownedTensors_.resize(tensors_.size() - numWeights);
+  for (size_t slot = numWeights, e = tensors_.size(); slot < e; slot++) {
+    auto *V = function.slotValues_[slot];
+    auto &T = ownedTensors_[slot - numWeights];
+    if (llvm::isa<AllocActivationInst>(V)) {
+      T = Tensor(static_cast<char *>(arena_) +
+                     function.activationOffsets_[slot],
+                 V->getType());
+    }
+    tensors_[slot] = &T;
   }
+}
 
-  auto *T = new Tensor();
-  *T = getTensor(src)->getUnowned(v->dims(), offsets);
-  tensors_[v] = T;
-  return T;
+BoundInterpreterFunction::~BoundInterpreterFunction() {
+  // The tensors of the activations are unowned, so nothing else refers to the
+  // arena once they are gone.
+  ownedTensors_.clear();
+  if (arena_) {
+    alignedFree(arena_);
+  }
 }
 
-void InterpreterFunction::deleteTensor(const Value *v) {
-  auto it = tensors_.find(v);
-  if (it == tensors_.end()) {
-    return;
+unsigned BoundInterpreterFunction::getSlot(const Value *v) const {
+  if (currentInstr_) {
+    for (unsigned i = 0, e = currentInstr_->getNumOperands(); i < e; i++) {
+      if (currentInstr_->getOperand(i).first == v) {
+        return currentSlots_[i];
+      }
+    }
   }
+  return function_.getSlot(v);
+}
 
-  delete it->second;
-  tensors_.erase(it);
+Tensor *BoundInterpreterFunction::getTensor(const Value *v) const {
+  auto *T = tensors_[getSlot(v)];
+  assert(T && "The tensor is not bound.");
+  return T;
 }
 
-void InterpreterFunction::execute() {
+void BoundInterpreterFunction::execute() {
 // Do the forward pass.
 #define DEF_VALUE(CLASS, NAME)
 #define DEF_INSTR(CLASS, NAME)                                                 \
@@ -117,12 +252,31 @@ void InterpreterFunction::execute() {
   }
 #define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME)
   // Dispatch the interpreter on each instruction in the program:
-  for (const auto &I : F_->getInstrs()) {
+  bool trace = isTracingEnabled();
+  const auto *operandSlots = function_.operandSlots_.data();
+  const auto &firstOperandSlot = function_.firstOperandSlot_;
+  size_t idx = 0;
+  for (const auto &I : function_.F_->getInstrs()) {
+    currentInstr_ = &I;
+    currentSlots_ = operandSlots + firstOperandSlot[idx++];
+    bool isMemoryInstr = llvm::isa<AllocActivationInst>(&I) ||
+                         llvm::isa<DeallocActivationInst>(&I) ||
+                         llvm::isa<TensorViewInst>(&I);
+    // Drop the rest of a run that was cancelled or missed its deadline. The
+    // activations live in the arena, so there is nothing to release.
+    if (!isMemoryInstr && shouldStopRun()) {
+      break;
+    }
+    uint64_t begin = trace ? getTraceTimestamp() : 0;
     switch (I.getKind()) {
 #include "glow/AutoGenInstr.def"
 
     default:
       llvm_unreachable("Invalid instruction.");
     }
+    if (trace && !isMemoryInstr) {
+      addTraceEvent(I.getName(), "instruction", begin, getTraceTimestamp());
+    }
   }
+  currentInstr_ = nullptr;
 }
@@ -19,16 +19,21 @@
 #include "glow/Backends/CompiledFunction.h"
 #include "glow/Base/Tensor.h"
 #include "glow/Graph/Context.h"
+#include "glow/Support/ThreadPool.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <vector>
 
 namespace glow {
 
+class BoundInterpreterFunction;
 class Context;
 class IRFunction;
+class Instruction;
 class Value;
 class Tensor;
 class Variable;
@@ -39,42 +44,140 @@ class Variable;
 #define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME)
 #include "glow/AutoGenInstr.def"
 
-/// Function "compiled" for execution by the interpreter.
+/// Function "compiled" for execution by the interpreter. The compilation
+/// assigns a slot of the tensor table of the executions to every weight,
+/// activation and tensor view, resolves the operands of every instruction to
+/// their slots, and places the activations into a single arena.
 class InterpreterFunction final : public CompiledFunction {
+  friend class BoundInterpreterFunction;
+
   /// The IR to be executed.
   std::unique_ptr<IRFunction> F_;
-  /// Maps values to Tensors, that are owned by this class.
-  std::unordered_map<const Value *, Tensor *> tensors_;
-  /// Maps values to Tensors, that are *not* owned by this class.
-  std::unordered_map<const Value *, Tensor *> externalTensors_;
+  /// Maps the weights, the activations and the tensor views to their slots.
+  /// The weights come first.
+  llvm::DenseMap<const Value *, unsigned> slots_;
+  /// The value of every slot.
+  std::vector<const Value *> slotValues_;
+  /// The number of weights, i.e. the index of the first non-weight slot.
+  unsigned numWeights_{0};
+  /// The offset in the arena of every activation, indexed by slot. It is
+  /// unused for the weights and the tensor views.
+  std::vector<uint64_t> activationOffsets_;
+  /// The size of the arena of the activations in bytes.
+  uint64_t arenaSize_{0};
+  /// The slots of the operands of the instructions, in the order of the
+  /// instructions and of their operands.
+  std::vector<unsigned> operandSlots_;
+  /// The index in operandSlots_ of the first operand of every instruction.
+  std::vector<size_t> firstOperandSlot_;
+  /// The payloads of the variables of the module, indexed by slot. The slots
+  /// of the placeholders are null.
+  std::vector<Tensor *> variableTensors_;
+  /// The slots of the placeholders and the tensors of the context the
+  /// function was compiled with.
+  std::vector<std::pair<unsigned, Tensor *>> placeholderTensors_;
+  /// The execution states that are not in use, which are kept to reuse
+  /// their arenas.
+  std::vector<std::unique_ptr<BoundInterpreterFunction>> idleStates_;
+  /// Protects idleStates_.
+  std::mutex idleStatesMutex_;
+  /// The threads executing the heavy kernels, if the function does not share
+  /// the pool of the process.
+  std::unique_ptr<ThreadPool> ownedThreadPool_;
+  /// The threads executing the heavy kernels, either ownedThreadPool_ or the
+  /// shared pool of the process.
+  ThreadPool *threadPool_;
+
+  /// Assign the slots and compute the operand table.
+  void assignSlots();
+
+  /// Place the activations into the arena.
+  void allocateActivations();
+
+  /// \returns the slot of the value \p v.
+  unsigned getSlot(const Value *v) const {
+    auto it = slots_.find(v);
+    assert(it != slots_.end() && "Unknown key Value.");
+    return it->second;
+  }
+
+  /// \returns an idle execution state, or a new one if there is none.
+  std::unique_ptr<BoundInterpreterFunction> acquireState();
+
+  /// Make the execution state \p state available to the next executions.
+  void releaseState(std::unique_ptr<BoundInterpreterFunction> state);
 
 public:
-  InterpreterFunction(std::unique_ptr<IRFunction> F, const Context &ctx);
+  /// Ctor. The heavy kernels of \p F are split between \p numThreads
+  /// threads, or between the threads of the shared pool of the process with
+  /// -shared-thread-pool.
+  InterpreterFunction(std::unique_ptr<IRFunction> F, const Context &ctx,
+                      unsigned numThreads = 1);
 
   /// \name CompiledFunction interface
   ///@{
   ~InterpreterFunction() override;
 
   void execute() override;
+
+  void execute(Context &ctx) override;
+
+  MemoryUsage getMemoryUsage() const override;
   ///@}
+};
+
+/// The state of a single execution of an InterpreterFunction. It binds the
+/// weights of the function to concrete tensors and owns the arena backing the
+/// activations. The states are reused by the following executions, and each
+/// concurrent execution of the same function has its own state.
+class BoundInterpreterFunction {
+  /// The function to be executed.
+  const InterpreterFunction &function_;
+  /// The tensor of every slot of the function.
+  std::vector<Tensor *> tensors_;
+  /// The unowned tensors of the activations and of the tensor views, indexed
+  /// by slot minus the number of weights.
+  std::vector<Tensor> ownedTensors_;
+  /// The memory of the activations.
+  void *arena_{nullptr};
+  /// The instruction being executed.
+  const Instruction *currentInstr_{nullptr};
+  /// The slots of the operands of currentInstr_.
+  const unsigned *currentSlots_{nullptr};
+
+public:
+  /// Ctor. Allocate the arena of \p function.
+  explicit BoundInterpreterFunction(const InterpreterFunction &function);
+
+  ~BoundInterpreterFunction();
+
+  /// Bind the weight of slot \p slot to the tensor \p T.
+  void bindWeight(unsigned slot, Tensor *T) { tensors_[slot] = T; }
+
+  /// \returns the tensor bound to the weight of slot \p slot, or nullptr.
+  Tensor *getBoundWeight(unsigned slot) const { return tensors_[slot]; }
+
+  /// Execute the function.
+  void execute();
 
 private:
-  /// \returns a pointer to the tensor that is saved under \p v.
+  /// \returns a pointer to the tensor that is saved under \p v. The operands
+  /// of the instruction being executed are found without a lookup.
   Tensor *getTensor(const Value *v) const;
 
-  /// Allocate a tensor to back the value \p v. Do not allocate anything if a
-  /// tensor is already allocated for \p v.
-  /// \returns a tensor for \p v.
-  Tensor *getOrCreateTensor(const Value *v);
+  /// \returns the slot of the value \p v.
+  unsigned getSlot(const Value *v) const;
 
-  /// Allocate an unowned tensor to back the value \p v. The source tensor of
-  /// the unowned tensor is provided by \p src.
-  /// \returns a tensor for \p v.
-  Tensor *getOrCreateUnownedTensor(const Value *v, const Value *src,
-                                   llvm::ArrayRef<size_t> offsets);
+  /// Split the iterations [0, \p numIterations) into chunks of at least
+  /// \p minChunkSize iterations, except the last one, and invoke \p fn on
+  /// them in parallel on the threads of the function.
+  void parallelFor(size_t numIterations, size_t minChunkSize,
+                   const ThreadPool::RangeFn &fn) const {
+    getThreadPool().parallelFor(numIterations, minChunkSize, fn);
+  }
 
-  /// If a tensor is allocated for \p v then delete it.
-  void deleteTensor(const Value *v);
+  /// \returns the threads of the function.
+  ThreadPool &getThreadPool() const { return *function_.threadPool_; }
 
   /// \returns a typed handle to the tensor that is stored at \p v.
   template <class ElemTy = float>
@@ -102,6 +205,22 @@ private:
                                     llvm::ArrayRef<unsigned_t> strides,
                                     llvm::ArrayRef<unsigned_t> pads,
                                     size_t group);
+
+  void fwdElementAddInst_I16Impl(const ElementAddInst *I);
+  template <typename ElemTy>
+  void fwdElementSubInst_QuantizedImpl(const ElementSubInst *I);
+  template <typename ElemTy, typename AccumulatorTy>
+  void fwdElementMulInst_QuantizedImpl(const ElementMulInst *I);
+  template <typename ElemTy, typename AccumulatorTy>
+  void fwdMatMulInst_QuantizedImpl(const MatMulInst *I);
+  template <typename ElemTy, typename AccumulatorTy>
+  void fwdBatchedMatMulInst_QuantizedImpl(const BatchedMatMulInst *I);
+  void fwdBatchedAddInst_I16Impl(const BatchedAddInst *I);
+  template <typename ElemTy> void fwdQuantizeInst_Impl(const QuantizeInst *I);
+  template <typename ElemTy>
+  void fwdDequantizeInst_Impl(const DequantizeInst *I);
+  template <typename SrcTy, typename DestTy>
+  void fwdRescaleQuantizedInst_Impl(const RescaleQuantizedInst *I);
   ///@}
 };
 
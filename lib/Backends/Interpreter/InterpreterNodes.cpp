@@ -16,6 +16,7 @@
 
 #include "Interpreter.h"
 
+#include "glow/IR/IRUtils.h"
 #include "glow/IR/Instrs.h"
 #include "glow/Quantization/Base/Base.h"
 #include "glow/Quantization/Base/Profile.h"
@@ -26,12 +27,28 @@
 
 using namespace glow;
 
+/// The minimal number of elements processed by an element-wise kernel on a
+/// single thread. Smaller kernels are not worth the synchronization overhead.
+static constexpr size_t dataParallelMinChunkSize = 4096;
+
+/// The minimal number of multiply-accumulate operations performed by a single
+/// thread when a convolution, a matrix multiplication or a sparse lengths sum
+/// is split between threads.
+static constexpr size_t minChunkWork = 1 << 16;
+
+/// \returns the minimal number of iterations of a loop whose iterations
+/// perform \p iterationWork multiply-accumulate operations each, that is
+/// worth running on a thread.
+static size_t getMinChunkSize(size_t iterationWork) {
+  return std::max<size_t>(1, minChunkWork / std::max<size_t>(1, iterationWork));
+}
+
 //===----------------------------------------------------------------------===//
 //                       Convolution
 //===----------------------------------------------------------------------===//
 
 // This is the floating point implementation of Convolution.
-void InterpreterFunction::fwdConvolutionInst_FloatImpl(
+void BoundInterpreterFunction::fwdConvolutionInst_FloatImpl(
     Value *inV, Value *outV, Value *filterV, Value *biasV,
     llvm::ArrayRef<unsigned_t> kernelSizes, llvm::ArrayRef<unsigned_t> strides,
     llvm::ArrayRef<unsigned_t> pads, size_t group) {
@@ -53,51 +70,52 @@ void InterpreterFunction::fwdConvolutionInst_FloatImpl(
 
   PaddingTLBR pdim(pads);
 
-  // For each input in the batch:
-  for (size_t n = 0; n < idim.n; n++) {
-
-    // For each group of input channels:
-    for (size_t g = 0; g < group; g++) {
-
-      // For each output channel in the group:
-      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
-
-        // For each convolution 'jump' in the input tensor:
-        ssize_t x = -ssize_t(pdim.top);
-        for (size_t ax = 0; ax < odim.h; x += sdim.height, ax++) {
-          ssize_t y = -ssize_t(pdim.left);
-          for (size_t ay = 0; ay < odim.w; y += sdim.width, ay++) {
-
-            // For each element in the convolution-filter:
-            float sum = 0;
-            for (size_t fx = 0; fx < kdim.height; fx++) {
-              for (size_t fy = 0; fy < kdim.width; fy++) {
-                ssize_t ox = x + fx;
-                ssize_t oy = y + fy;
-
-                // Ignore index access below zero (this is due to padding).
-                if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
-                    oy >= ssize_t(idim.w)) {
-                  continue;
-                }
-                for (size_t fd = 0; fd < inCperG; fd++) {
-                  sum += filterW.at({d, fx, fy, fd}) *
-                         inW.at({n, (size_t)ox, (size_t)oy, g * inCperG + fd});
+  // The output channels of every input in the batch are computed in parallel.
+  size_t channelWork = odim.h * odim.w * kdim.height * kdim.width * inCperG;
+  parallelFor(
+      idim.n * odim.c, getMinChunkSize(channelWork),
+      [&](size_t begin, size_t end) {
+        for (size_t nd = begin; nd < end; nd++) {
+          size_t n = nd / odim.c;
+          size_t d = nd % odim.c;
+          size_t g = d / outCperG;
+
+          // For each convolution 'jump' in the input tensor:
+          ssize_t x = -ssize_t(pdim.top);
+          for (size_t ax = 0; ax < odim.h; x += sdim.height, ax++) {
+            ssize_t y = -ssize_t(pdim.left);
+            for (size_t ay = 0; ay < odim.w; y += sdim.width, ay++) {
+
+              // For each element in the convolution-filter:
+              float sum = 0;
+              for (size_t fx = 0; fx < kdim.height; fx++) {
+                for (size_t fy = 0; fy < kdim.width; fy++) {
+                  ssize_t ox = x + fx;
+                  ssize_t oy = y + fy;
+
+                  // Ignore index access below zero (this is due to padding).
+                  if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                      oy >= ssize_t(idim.w)) {
+                    continue;
+                  }
+                  for (size_t fd = 0; fd < inCperG; fd++) {
+                    sum += filterW.at({d, fx, fy, fd}) *
+                           inW.at({n, (size_t)ox, (size_t)oy,
+                                   g * inCperG + fd});
+                  }
                 }
               }
-            }
 
-            sum += biasW.at({d});
-            outW.at({n, ax, ay, d}) = sum;
-          } // W
-        }   // H
-      }     // C
-    }       // G
-  }         // N
+              sum += biasW.at({d});
+              outW.at({n, ax, ay, d}) = sum;
+            } // W
+          }   // H
+        }     // N, C
+      });
 }
 
 // This is the quantized i8 implementation of Convolution.
-void InterpreterFunction::fwdConvolutionInst_I8Impl(
+void BoundInterpreterFunction::fwdConvolutionInst_I8Impl(
     Value *inV, Value *outV, Value *filterV, Value *biasV,
     llvm::ArrayRef<unsigned_t> kernelSizes, llvm::ArrayRef<unsigned_t> strides,
     llvm::ArrayRef<unsigned_t> pads, size_t group) {
@@ -191,7 +209,7 @@ void InterpreterFunction::fwdConvolutionInst_I8Impl(
   }         // N
 }
 
-void InterpreterFunction::fwdConvolutionInst(const ConvolutionInst *I) {
+void BoundInterpreterFunction::fwdConvolutionInst(const ConvolutionInst *I) {
   auto kernelSizes = I->getKernels();
   auto pads = I->getPads();
   auto strides = I->getStrides();
@@ -207,7 +225,84 @@ void InterpreterFunction::fwdConvolutionInst(const ConvolutionInst *I) {
                                I->getBias(), kernelSizes, strides, pads, group);
 }
 
-void InterpreterFunction::fwdConvolutionGradInst(const ConvolutionGradInst *I) {
+void BoundInterpreterFunction::fwdChannelwiseQuantizedConvolutionInst(
+    const ChannelwiseQuantizedConvolutionInst *I) {
+  auto inW = getWeightHandle<int8_t>(I->getSrc());
+  auto outW = getWeightHandle<int8_t>(I->getDest());
+  auto filterW = getWeightHandle<int8_t>(I->getFilter());
+  auto biasW = getWeightHandle<int32_t>(I->getBias());
+  auto scalesW = getWeightHandle<float>(I->getScales());
+  auto offsetsW = getWeightHandle<int32_t>(I->getOffsets());
+
+  ShapeNHWC odim(outW.dims());
+  ShapeNHWC idim(inW.dims());
+  ShapeHW kdim(I->getKernels());
+  ShapeHW sdim(I->getStrides());
+  PaddingTLBR pdim(I->getPads());
+  size_t group = I->getGroup();
+
+  assert(idim.c % group == 0 && "Input channels must be divisible by group.");
+  assert(odim.c % group == 0 && "Output channels must be divisible by group.");
+  size_t inCperG = idim.c / group;
+  size_t outCperG = odim.c / group;
+
+  auto *outTy = I->getDest()->getType();
+  auto *inTy = I->getSrc()->getType();
+  int32_t outOffset = outTy->getOffset();
+  int32_t inOffset = inTy->getOffset();
+  float outScale = outTy->getScale();
+  float inScale = inTy->getScale();
+
+  // For each input in the batch:
+  for (size_t n = 0; n < idim.n; n++) {
+    // For each group of input channels:
+    for (size_t g = 0; g < group; g++) {
+
+      // For each output channel in the group:
+      for (size_t d = g * outCperG; d < (g + 1) * outCperG; d++) {
+        // Every output channel has its own filter scale and offset.
+        int32_t filterOffset = offsetsW.at({d});
+        float matMulScale = inScale * scalesW.at({d});
+
+        // For each convolution 'jump' in the input tensor:
+        ssize_t x = -ssize_t(pdim.top);
+        for (size_t ax = 0; ax < odim.h; x += sdim.height, ax++) {
+          ssize_t y = -ssize_t(pdim.left);
+          for (size_t ay = 0; ay < odim.w; y += sdim.width, ay++) {
+
+            // The bias is already in the scale of the matrix multiplication.
+            int32_t sum = biasW.at({d});
+            for (size_t fx = 0; fx < kdim.height; fx++) {
+              for (size_t fy = 0; fy < kdim.width; fy++) {
+                ssize_t ox = x + fx;
+                ssize_t oy = y + fy;
+
+                // Ignore index access below zero (this is due to padding).
+                if (ox < 0 || oy < 0 || ox >= ssize_t(idim.h) ||
+                    oy >= ssize_t(idim.w)) {
+                  continue;
+                }
+                for (size_t fd = 0; fd < inCperG; fd++) {
+                  int32_t F = filterW.at({d, fx, fy, fd});
+                  int32_t In =
+                      inW.at({n, (size_t)ox, (size_t)oy, g * inCperG + fd});
+                  sum += (F - filterOffset) * (In - inOffset);
+                }
+              }
+            }
+
+            // Scale the result back to the expected destination scale.
+            outW.at({n, ax, ay, d}) = quantization::clip<int32_t, int8_t>(
+                std::round(float(sum) * (matMulScale / outScale) + outOffset));
+          } // W
+        }   // H
+      }     // C
+    }       // G
+  }         // N
+}
+
+void BoundInterpreterFunction::fwdConvolutionGradInst(
+    const ConvolutionGradInst *I) {
   auto inW = getWeightHandle(I->getSrc());
   auto inG = getWeightHandle(I->getSrcGrad());
   auto outG = getWeightHandle(I->getDestGrad());
@@ -345,7 +440,7 @@ static void fwdMaxPool(Tensor *inW, Tensor *outW, Handle<int64_t> *SXY,
   }       // N
 }
 
-void InterpreterFunction::fwdMaxPoolInst(const MaxPoolInst *I) {
+void BoundInterpreterFunction::fwdMaxPoolInst(const MaxPoolInst *I) {
   auto inW = getTensor(I->getSrc());
   auto outW = getTensor(I->getDest());
 
@@ -358,7 +453,8 @@ void InterpreterFunction::fwdMaxPoolInst(const MaxPoolInst *I) {
   }
 }
 
-void InterpreterFunction::fwdMaxPoolWithXYInst(const MaxPoolWithXYInst *I) {
+void BoundInterpreterFunction::fwdMaxPoolWithXYInst(
+    const MaxPoolWithXYInst *I) {
   auto inW = getTensor(I->getSrc());
   auto outW = getTensor(I->getDest());
   auto SXY = getWeightHandle<int64_t>(I->getSrcXY());
@@ -372,7 +468,7 @@ void InterpreterFunction::fwdMaxPoolWithXYInst(const MaxPoolWithXYInst *I) {
   }
 }
 
-void InterpreterFunction::fwdAvgPoolInst(const AvgPoolInst *I) {
+void BoundInterpreterFunction::fwdAvgPoolInst(const AvgPoolInst *I) {
   ShapeNHWC odim(I->getDest()->dims());
   ShapeNHWC idim(I->getSrc()->dims());
 
@@ -464,7 +560,7 @@ void InterpreterFunction::fwdAvgPoolInst(const AvgPoolInst *I) {
   }       // N
 }
 
-void InterpreterFunction::fwdMaxPoolWithXYGradInst(
+void BoundInterpreterFunction::fwdMaxPoolWithXYGradInst(
     const MaxPoolWithXYGradInst *I) {
   auto inG = getWeightHandle(I->getSrcGrad());
   auto outW = getWeightHandle(I->getDest());
@@ -498,7 +594,7 @@ void InterpreterFunction::fwdMaxPoolWithXYGradInst(
   }       // N
 }
 
-void InterpreterFunction::fwdAvgPoolGradInst(const AvgPoolGradInst *I) {
+void BoundInterpreterFunction::fwdAvgPoolGradInst(const AvgPoolGradInst *I) {
   auto inG = getWeightHandle(I->getSrcGrad());
   auto outW = getWeightHandle(I->getDest());
   auto outG = getWeightHandle(I->getDestGrad());
@@ -550,31 +646,66 @@ void InterpreterFunction::fwdAvgPoolGradInst(const AvgPoolGradInst *I) {
 //                       Activation functions
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdSigmoidInst(const SigmoidInst *I) {
+void BoundInterpreterFunction::fwdSigmoidInst(const SigmoidInst *I) {
   auto inW = getWeightHandle(I->getSrc());
   auto outW = getWeightHandle(I->getDest());
 
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    float val = inW.raw(i);
-    outW.raw(i) = 1 / (1 + std::exp(-val));
-  }
+  parallelFor(outW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  float val = inW.raw(i);
+                  outW.raw(i) = 1 / (1 + std::exp(-val));
+                }
+              });
 }
 
-void InterpreterFunction::fwdTanhInst(const TanhInst *I) {
+void BoundInterpreterFunction::fwdTanhInst(const TanhInst *I) {
   auto inW = getWeightHandle(I->getSrc());
   auto outW = getWeightHandle(I->getDest());
 
-  for (size_t i = 0, e = inW.size(); i < e; i++) {
-    float val = inW.raw(i);
-    outW.raw(i) = std::tanh(val);
-  }
+  parallelFor(inW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  float val = inW.raw(i);
+                  outW.raw(i) = std::tanh(val);
+                }
+              });
 }
 
 //===----------------------------------------------------------------------===//
 //                        Loss Functions (Softmax/regression/...)
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdSoftMaxInst(const SoftMaxInst *I) {
+void BoundInterpreterFunction::fwdSoftMaxInst(const SoftMaxInst *I) {
+  if (I->getSrc()->getType()->isQuantizedType()) {
+    auto inW = getWeightHandle<int8_t>(I->getSrc());
+    auto outW = getWeightHandle<int8_t>(I->getDest());
+    auto idim = inW.dims();
+    float inScale = I->getSrc()->getType()->getScale();
+    auto *destTy = I->getDest()->getType();
+    TensorQuantizationParams outTQP{destTy->getScale(), destTy->getOffset()};
+
+    for (size_t n = 0; n < idim[0]; n++) {
+      // The input offset cancels out, only the distance to the max matters.
+      int8_t max = inW.at({n, 0});
+      for (size_t i = 1; i < idim[1]; i++) {
+        max = std::max(max, inW.at({n, i}));
+      }
+
+      std::vector<float> e(idim[1]);
+      float sum = 0;
+      for (size_t i = 0; i < idim[1]; i++) {
+        e[i] = std::exp(inScale * (inW.at({n, i}) - max));
+        sum += e[i];
+      }
+
+      for (size_t i = 0; i < idim[1]; i++) {
+        outW.at({n, i}) = quantization::quantize(e[i] / sum, outTQP);
+      }
+    }
+    return;
+  }
+
   auto inW = getWeightHandle(I->getSrc());
   auto outW = getWeightHandle(I->getDest());
   auto idim = inW.dims();
@@ -601,7 +732,7 @@ void InterpreterFunction::fwdSoftMaxInst(const SoftMaxInst *I) {
   } // N
 }
 
-void InterpreterFunction::fwdSoftMaxGradInst(const SoftMaxGradInst *I) {
+void BoundInterpreterFunction::fwdSoftMaxGradInst(const SoftMaxGradInst *I) {
   auto inG = getWeightHandle(I->getSrcGrad());
   auto idim = inG.dims();
   auto outW = getWeightHandle(I->getOrigDest());
@@ -619,7 +750,7 @@ void InterpreterFunction::fwdSoftMaxGradInst(const SoftMaxGradInst *I) {
   }
 }
 
-void InterpreterFunction::fwdCrossEntropyLossInst(
+void BoundInterpreterFunction::fwdCrossEntropyLossInst(
     const CrossEntropyLossInst *I) {
   auto P = getWeightHandle(I->getP());
   auto labels = getWeightHandle<int64_t>(I->getLabels());
@@ -633,7 +764,7 @@ void InterpreterFunction::fwdCrossEntropyLossInst(
   }
 }
 
-void InterpreterFunction::fwdCrossEntropyLossGradInst(
+void BoundInterpreterFunction::fwdCrossEntropyLossGradInst(
     const CrossEntropyLossGradInst *I) {
   auto P = getWeightHandle(I->getP());
   auto Labels = getWeightHandle<int64_t>(I->getLabels());
@@ -647,17 +778,83 @@ void InterpreterFunction::fwdCrossEntropyLossGradInst(
   }
 }
 
+void BoundInterpreterFunction::fwdSoftMaxCrossEntropyLossInst(
+    const SoftMaxCrossEntropyLossInst *I) {
+  auto logits = getWeightHandle(I->getLogits());
+  auto labels = getWeightHandle<int64_t>(I->getLabels());
+  auto CE = getWeightHandle(I->getDest());
+  auto dims = logits.dims();
+  // -log(softmax(x)[y]) = log(sum(exp(x - max))) + max - x[y].
+  float loss = 0;
+  for (size_t n = 0; n < dims[0]; n++) {
+    float max = logits.at({n, 0});
+    for (size_t i = 1; i < dims[1]; i++) {
+      max = std::max(max, logits.at({n, i}));
+    }
+    float sum = 0;
+    for (size_t i = 0; i < dims[1]; i++) {
+      sum += std::exp(logits.at({n, i}) - max);
+    }
+    assert(labels.raw(n) >= 0 && "Cannot use negative index.");
+    size_t y = labels.raw(n);
+    loss += std::log(sum) + max - logits.at({n, y});
+  }
+  CE.raw(0) = loss;
+}
+
+void BoundInterpreterFunction::fwdSoftMaxCrossEntropyLossGradInst(
+    const SoftMaxCrossEntropyLossGradInst *I) {
+  auto logits = getWeightHandle(I->getLogits());
+  auto labels = getWeightHandle<int64_t>(I->getLabels());
+  auto logitsG = getWeightHandle(I->getLogitsGrad());
+  auto dims = logits.dims();
+  for (size_t n = 0; n < dims[0]; n++) {
+    float max = logits.at({n, 0});
+    for (size_t i = 1; i < dims[1]; i++) {
+      max = std::max(max, logits.at({n, i}));
+    }
+    float sum = 0;
+    for (size_t i = 0; i < dims[1]; i++) {
+      float e = std::exp(logits.at({n, i}) - max);
+      sum += e;
+      logitsG.at({n, i}) = e;
+    }
+    size_t y = labels.raw(n);
+    for (size_t i = 0; i < dims[1]; i++) {
+      logitsG.at({n, i}) = logitsG.at({n, i}) / sum - (i == y);
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdSigmoidCrossEntropyWithLogitsInst(
+    const SigmoidCrossEntropyWithLogitsInst *I) {
+  auto logits = getWeightHandle(I->getLogits());
+  auto targets = getWeightHandle(I->getTargets());
+  auto dest = getWeightHandle(I->getDest());
+  size_t inner = logits.dims().back();
+  for (size_t n = 0, e = dest.size(); n < e; n++) {
+    // max(x, 0) - x * t + log(1 + exp(-|x|)), which does not overflow.
+    float sum = 0;
+    for (size_t i = 0; i < inner; i++) {
+      float x = logits.raw(n * inner + i);
+      float t = targets.raw(n * inner + i);
+      sum += std::max(x, 0.0f) - x * t + std::log1p(std::exp(-std::abs(x)));
+    }
+    dest.raw(n) = sum / inner;
+  }
+}
+
 //===----------------------------------------------------------------------===//
 //                       Tensor shape (copy/transpose/concat/...)
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdCopyInst(const CopyInst *I) {
+void BoundInterpreterFunction::fwdCopyInst(const CopyInst *I) {
   auto inT = getTensor(I->getSrc());
   auto outT = getTensor(I->getDest());
   outT->copyRawFrom(inT);
 }
 
-void InterpreterFunction::fwdTransposeInst(const TransposeInst *I) {
+void BoundInterpreterFunction::fwdTransposeInst(const TransposeInst *I) {
   auto inT = getTensor(I->getSrc());
   (void)inT;
   auto outT = getTensor(I->getDest());
@@ -671,11 +868,31 @@ void InterpreterFunction::fwdTransposeInst(const TransposeInst *I) {
   }
 }
 
-void InterpreterFunction::fwdTensorViewInst(const TensorViewInst *I) {
-  getOrCreateUnownedTensor(I, I->getSrc(), I->getOffsets());
+void BoundInterpreterFunction::fwdTensorViewInst(const TensorViewInst *I) {
+  // The view keeps its own type, which may differ from the type of the source
+  // in the quantization parameters when the buffers of quantized values of
+  // different scales are shared.
+  if (isBroadcastView(I)) {
+    // The interpreter expands the broadcast views into tensors of their own.
+    // The source is not written between the view and its readers.
+    auto *src = getTensor(I->getSrc());
+    Tensor view(I->getType());
+    auto dims = getBroadcastDims(I);
+    size_t elemSize = I->getType()->getElementSize();
+    const char *srcPtr = src->getUnsafePtr();
+    char *viewPtr = view.getUnsafePtr();
+    for (size_t i = 0, e = view.size(); i < e; i++) {
+      memcpy(viewPtr + i * elemSize,
+             srcPtr + getBroadcastSourceIndex(dims, i) * elemSize, elemSize);
+    }
+    *getTensor(I) = std::move(view);
+    return;
+  }
+  Tensor view = getTensor(I->getSrc())->getUnowned(I->dims(), I->getOffsets());
+  *getTensor(I) = Tensor(view.getUnsafePtr(), I->getType());
 }
 
-void InterpreterFunction::fwdSplatInst(const glow::SplatInst *I) {
+void BoundInterpreterFunction::fwdSplatInst(const glow::SplatInst *I) {
   auto *T = getTensor(I->getDest());
   ElemKind k = T->getElementType();
 
@@ -687,6 +904,14 @@ void InterpreterFunction::fwdSplatInst(const glow::SplatInst *I) {
     return T->getHandle<float>().clear(I->getValue());
   }
 
+  if (k == ElemKind::Float16Ty) {
+    return T->getHandle<float16_t>().clear(I->getValue());
+  }
+
+  if (k == ElemKind::BFloat16Ty) {
+    return T->getHandle<bfloat16_t>().clear(I->getValue());
+  }
+
   if (k == ElemKind::Int8QTy) {
     // Quantize the requested floating point splat value into the correct
     // integer representation.
@@ -696,10 +921,19 @@ void InterpreterFunction::fwdSplatInst(const glow::SplatInst *I) {
     return T->getHandle<int8_t>().clear(quantization::quantize(val, destQ));
   }
 
+  if (k == ElemKind::Int16QTy) {
+    auto destTy = I->getDest()->getType();
+    TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
+    float val = I->getValue();
+    return T->getHandle<int16_t>().clear(
+        quantization::quantize<int16_t>(val, destQ));
+  }
+
   llvm_unreachable("Unsupported tensor type");
 }
 
-void InterpreterFunction::fwdInsertTensorInst(const glow::InsertTensorInst *I) {
+void BoundInterpreterFunction::fwdInsertTensorInst(
+    const glow::InsertTensorInst *I) {
   Tensor *outT = getTensor(I->getDest());
   Tensor *inT = getTensor(I->getSrc());
   ElemKind k = outT->getElementType();
@@ -712,13 +946,16 @@ void InterpreterFunction::fwdInsertTensorInst(const glow::InsertTensorInst *I) {
 
   TYPED_INSERT(int64_t, ElemKind::Int64ITy);
   TYPED_INSERT(float, ElemKind::FloatTy);
+  TYPED_INSERT(float16_t, ElemKind::Float16Ty);
+  TYPED_INSERT(bfloat16_t, ElemKind::BFloat16Ty);
   TYPED_INSERT(int8_t, ElemKind::Int8QTy);
+  TYPED_INSERT(int16_t, ElemKind::Int16QTy);
 #undef TYPED_INSERT
 
   llvm_unreachable("Unsupported tensor type");
 }
 
-void InterpreterFunction::fwdExtractTensorInst(
+void BoundInterpreterFunction::fwdExtractTensorInst(
     const glow::ExtractTensorInst *I) {
   Tensor *outT = getTensor(I->getDest());
   Tensor *inT = getTensor(I->getSrc());
@@ -732,13 +969,16 @@ void InterpreterFunction::fwdExtractTensorInst(
 
   TYPED_INSERT(int64_t, ElemKind::Int64ITy);
   TYPED_INSERT(float, ElemKind::FloatTy);
+  TYPED_INSERT(float16_t, ElemKind::Float16Ty)
+  TYPED_INSERT(bfloat16_t, ElemKind::BFloat16Ty)
   TYPED_INSERT(int8_t, ElemKind::Int8QTy)
+  TYPED_INSERT(int16_t, ElemKind::Int16QTy)
 #undef TYPED_INSERT
 
   llvm_unreachable("Unsupported tensor type");
 }
 
-void InterpreterFunction::fwdGatherInst(const glow::GatherInst *I) {
+void BoundInterpreterFunction::fwdGatherInst(const glow::GatherInst *I) {
   Tensor *dataT = getTensor(I->getData());
   auto &dataTy = dataT->getType();
   Tensor *indicesT = getTensor(I->getIndices());
@@ -776,7 +1016,7 @@ void InterpreterFunction::fwdGatherInst(const glow::GatherInst *I) {
   }
 }
 
-void InterpreterFunction::fwdScatterAssignInst(
+void BoundInterpreterFunction::fwdScatterAssignInst(
     const glow::ScatterAssignInst *I) {
   Tensor *dataT = getTensor(I->getData());
   Tensor *indicesT = getTensor(I->getIndices());
@@ -795,11 +1035,44 @@ void InterpreterFunction::fwdScatterAssignInst(
   }
 }
 
+/// Convert the elements of \p src to the element type of \p dest.
+template <typename SrcTy, typename DestTy>
+static void fwdConvertTo(Tensor *dest, Tensor *src) {
+  auto srcH = src->getHandle<SrcTy>();
+  auto destH = dest->getHandle<DestTy>();
+  for (size_t i = 0, e = destH.size(); i < e; i++) {
+    destH.raw(i) = float(srcH.raw(i));
+  }
+}
+
+void BoundInterpreterFunction::fwdConvertToInst(const glow::ConvertToInst *I) {
+  Tensor *src = getTensor(I->getSrc());
+  Tensor *dest = getTensor(I->getDest());
+  ElemKind srcTy = src->getElementType();
+  ElemKind destTy = dest->getElementType();
+  if (srcTy == destTy) {
+    return dest->copyRawFrom(src);
+  }
+  if (srcTy == ElemKind::FloatTy && destTy == ElemKind::Float16Ty) {
+    return fwdConvertTo<float, float16_t>(dest, src);
+  }
+  if (srcTy == ElemKind::Float16Ty && destTy == ElemKind::FloatTy) {
+    return fwdConvertTo<float16_t, float>(dest, src);
+  }
+  if (srcTy == ElemKind::FloatTy && destTy == ElemKind::BFloat16Ty) {
+    return fwdConvertTo<float, bfloat16_t>(dest, src);
+  }
+  if (srcTy == ElemKind::BFloat16Ty && destTy == ElemKind::FloatTy) {
+    return fwdConvertTo<bfloat16_t, float>(dest, src);
+  }
+  llvm_unreachable("Unsupported conversion");
+}
+
 //===----------------------------------------------------------------------===//
 //                      Local Response Normalization
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdLocalResponseNormalizationInst(
+void BoundInterpreterFunction::fwdLocalResponseNormalizationInst(
     const glow::LocalResponseNormalizationInst *I) {
   auto inW = getWeightHandle(I->getSrc());
   auto outW = getWeightHandle(I->getDest());
@@ -854,7 +1127,7 @@ void InterpreterFunction::fwdLocalResponseNormalizationInst(
   }
 }
 
-void InterpreterFunction::fwdLocalResponseNormalizationGradInst(
+void BoundInterpreterFunction::fwdLocalResponseNormalizationGradInst(
     const glow::LocalResponseNormalizationGradInst *I) {
   auto inW = getWeightHandle(I->getSrc());
   auto inG = getWeightHandle(I->getSrcGrad());
@@ -924,12 +1197,152 @@ void InterpreterFunction::fwdLocalResponseNormalizationGradInst(
   }
 }
 
+//===----------------------------------------------------------------------===//
+//                       Batch Normalization
+//===----------------------------------------------------------------------===//
+
+/// The batch normalization sees the tensors as {outer, numChannels, inner},
+/// where outer and inner are the products of the dimensions before and after
+/// the channel.
+void BoundInterpreterFunction::fwdBatchNormalizationInst(
+    const BatchNormalizationInst *I) {
+  auto src = getWeightHandle(I->getSrc());
+  auto dest = getWeightHandle(I->getDest());
+  auto scale = getWeightHandle(I->getScale());
+  auto bias = getWeightHandle(I->getBias());
+  auto mean = getWeightHandle(I->getMean());
+  auto var = getWeightHandle(I->getVar());
+  size_t numChannels = src.dims()[I->getChannelIdx()];
+  size_t inner = flattenCdr(src.dims(), I->getChannelIdx() + 1).second;
+  size_t outer = src.size() / (numChannels * inner);
+  for (size_t c = 0; c < numChannels; c++) {
+    float coef = scale.raw(c) / std::sqrt(var.raw(c) + I->getEpsilon());
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        dest.raw(base + i) = (src.raw(base + i) - mean.raw(c)) * coef +
+                             bias.raw(c);
+      }
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdBatchNormalizationGradInst(
+    const BatchNormalizationGradInst *I) {
+  auto src = getWeightHandle(I->getSrc());
+  auto scale = getWeightHandle(I->getScale());
+  auto mean = getWeightHandle(I->getMean());
+  auto var = getWeightHandle(I->getVar());
+  auto destG = getWeightHandle(I->getDestGrad());
+  auto srcG = getWeightHandle(I->getSrcGrad());
+  auto scaleG = getWeightHandle(I->getScaleGrad());
+  auto biasG = getWeightHandle(I->getBiasGrad());
+  size_t numChannels = src.dims()[I->getChannelIdx()];
+  size_t inner = flattenCdr(src.dims(), I->getChannelIdx() + 1).second;
+  size_t outer = src.size() / (numChannels * inner);
+  float N = outer * inner;
+  // http://cthorey.github.io./backpropagation/
+  //
+  // dbeta = sum(dy)
+  // dgamma = sum((h - mu) * (var + eps)^(-1/2) * dy)
+  // dh = 1/N * gamma * (var + eps)^(-1/2) *
+  //      (N * dy - sum(dy) - (h - mu) / (var + eps) * sum(dy * (h - mu)))
+  for (size_t c = 0; c < numChannels; c++) {
+    float mu = mean.raw(c);
+    float sumDy = 0, sumDyhmu = 0;
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        float dy = destG.raw(base + i);
+        sumDy += dy;
+        sumDyhmu += dy * (src.raw(base + i) - mu);
+      }
+    }
+    float invVar = 1 / (var.raw(c) + I->getEpsilon());
+    float invVarSqrt = std::sqrt(invVar);
+    float coef1 = scale.raw(c) * invVarSqrt / N;
+    float coef2 = invVar * sumDyhmu;
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        srcG.raw(base + i) =
+            coef1 * (N * destG.raw(base + i) - sumDy -
+                     (src.raw(base + i) - mu) * coef2);
+      }
+    }
+    biasG.raw(c) = sumDy;
+    scaleG.raw(c) = sumDyhmu * invVarSqrt;
+  }
+}
+
+void BoundInterpreterFunction::fwdMeanVarNormalizationInst(
+    const MeanVarNormalizationInst *I) {
+  auto src = getWeightHandle(I->getSrc());
+  auto mean = getWeightHandle(I->getMean());
+  auto var = getWeightHandle(I->getVar());
+  auto newMean = getWeightHandle(I->getNewMean());
+  auto newVar = getWeightHandle(I->getNewVar());
+  float momentum = I->getMomentum();
+  size_t numChannels = src.dims()[I->getChannelIdx()];
+  size_t inner = flattenCdr(src.dims(), I->getChannelIdx() + 1).second;
+  size_t outer = src.size() / (numChannels * inner);
+  float N = outer * inner;
+  for (size_t c = 0; c < numChannels; c++) {
+    // The variance is computed around the mean, in a second pass.
+    float sum = 0;
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        sum += src.raw(base + i);
+      }
+    }
+    float localMean = sum / N;
+    float sumSq = 0;
+    for (size_t o = 0; o < outer; o++) {
+      size_t base = (o * numChannels + c) * inner;
+      for (size_t i = 0; i < inner; i++) {
+        float d = src.raw(base + i) - localMean;
+        sumSq += d * d;
+      }
+    }
+    float localVar = sumSq / N;
+    newMean.raw(c) = momentum * localMean + (1 - momentum) * mean.raw(c);
+    newVar.raw(c) = momentum * localVar + (1 - momentum) * var.raw(c);
+  }
+}
+
 //===----------------------------------------------------------------------===//
 //                       Arithmetic operations
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdElementAddInst(const ElementAddInst *I) {
+void BoundInterpreterFunction::fwdElementAddInst_I16Impl(
+    const ElementAddInst *I) {
+  auto lhsTy = I->getLHS()->getType();
+  auto rhsTy = I->getRHS()->getType();
+  auto destTy = I->getDest()->getType();
+
+  TensorQuantizationParams lhsQ{lhsTy->getScale(), lhsTy->getOffset()};
+  TensorQuantizationParams rhsQ{rhsTy->getScale(), rhsTy->getOffset()};
+  TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
+
+  auto outW = getWeightHandle<int16_t>(I->getDest());
+  auto lhsW = getWeightHandle<int16_t>(I->getLHS());
+  auto rhsW = getWeightHandle<int16_t>(I->getRHS());
+  for (size_t i = 0, e = outW.size(); i < e; i++) {
+    // 16-bit operands do not fit the fixed 16-bit intermediate scale used by
+    // the 8-bit kernel, so add the values in floating point.
+    float sum = quantization::dequantize(lhsW.raw(i), lhsQ) +
+                quantization::dequantize(rhsW.raw(i), rhsQ);
+    outW.raw(i) = quantization::quantize<int16_t>(sum, destQ);
+  }
+}
+
+void BoundInterpreterFunction::fwdElementAddInst(const ElementAddInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
+    if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+      return fwdElementAddInst_I16Impl(I);
+    }
+
     auto lhsTy = I->getLHS()->getType();
     auto rhsTy = I->getRHS()->getType();
     auto destTy = I->getDest()->getType();
@@ -964,78 +1377,104 @@ void InterpreterFunction::fwdElementAddInst(const ElementAddInst *I) {
   auto outW = getWeightHandle(I->getDest());
   auto lhsW = getWeightHandle(I->getLHS());
   auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) + rhsW.raw(i);
-  }
+  parallelFor(outW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  outW.raw(i) = lhsW.raw(i) + rhsW.raw(i);
+                }
+              });
 }
 
-void InterpreterFunction::fwdElementSubInst(const ElementSubInst *I) {
-  if (getTensor(I->getLHS())->getType().isQuantizedType()) {
-    auto destTy = I->getDest()->getType();
-    auto lhsTy = I->getLHS()->getType();
-    auto rhsTy = I->getRHS()->getType();
+template <typename ElemTy>
+void BoundInterpreterFunction::fwdElementSubInst_QuantizedImpl(
+    const ElementSubInst *I) {
+  auto destTy = I->getDest()->getType();
+  auto lhsTy = I->getLHS()->getType();
+  auto rhsTy = I->getRHS()->getType();
 
-    float destScale = destTy->getScale();
-    float lhsScale = lhsTy->getScale();
-    float rhsScale = rhsTy->getScale();
+  float destScale = destTy->getScale();
+  float lhsScale = lhsTy->getScale();
+  float rhsScale = rhsTy->getScale();
 
-    int32_t destOffset = destTy->getOffset();
-    int32_t lhsOffset = lhsTy->getOffset();
-    int32_t rhsOffset = rhsTy->getOffset();
+  int32_t destOffset = destTy->getOffset();
+  int32_t lhsOffset = lhsTy->getOffset();
+  int32_t rhsOffset = rhsTy->getOffset();
 
-    auto outW = getWeightHandle<int8_t>(I->getDest());
-    auto lhsW = getWeightHandle<int8_t>(I->getLHS());
-    auto rhsW = getWeightHandle<int8_t>(I->getRHS());
-    for (size_t i = 0, e = outW.size(); i < e; i++) {
-      //    s_d * (i_d - o_d) = s_l * (i_l - o_l) - s_r * (i_r - o_r)
-      // => i_d = (s_l / s_d) * (i_l - o_l) - (s_r / s_d) * (i_r - o_r) + o_d
-      float l = (lhsScale / destScale) * float(lhsW.raw(i) - lhsOffset);
-      float r = (rhsScale / destScale) * float(rhsW.raw(i) - rhsOffset);
-      int32_t q = std::round(l - r + destOffset);
-      outW.raw(i) = quantization::clip<int32_t, int8_t>(q);
+  auto outW = getWeightHandle<ElemTy>(I->getDest());
+  auto lhsW = getWeightHandle<ElemTy>(I->getLHS());
+  auto rhsW = getWeightHandle<ElemTy>(I->getRHS());
+  for (size_t i = 0, e = outW.size(); i < e; i++) {
+    //    s_d * (i_d - o_d) = s_l * (i_l - o_l) - s_r * (i_r - o_r)
+    // => i_d = (s_l / s_d) * (i_l - o_l) - (s_r / s_d) * (i_r - o_r) + o_d
+    float l = (lhsScale / destScale) * float(lhsW.raw(i) - lhsOffset);
+    float r = (rhsScale / destScale) * float(rhsW.raw(i) - rhsOffset);
+    int32_t q = std::round(l - r + destOffset);
+    outW.raw(i) = quantization::clip<int32_t, ElemTy>(q);
+  }
+}
+
+void BoundInterpreterFunction::fwdElementSubInst(const ElementSubInst *I) {
+  if (getTensor(I->getLHS())->getType().isQuantizedType()) {
+    if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+      return fwdElementSubInst_QuantizedImpl<int16_t>(I);
     }
-    return;
+    return fwdElementSubInst_QuantizedImpl<int8_t>(I);
   }
 
   auto outW = getWeightHandle(I->getDest());
   auto lhsW = getWeightHandle(I->getLHS());
   auto rhsW = getWeightHandle(I->getRHS());
+  parallelFor(outW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  outW.raw(i) = lhsW.raw(i) - rhsW.raw(i);
+                }
+              });
+}
+
+template <typename ElemTy, typename AccumulatorTy>
+void BoundInterpreterFunction::fwdElementMulInst_QuantizedImpl(
+    const ElementMulInst *I) {
+  auto lhsTy = I->getLHS()->getType();
+  auto rhsTy = I->getRHS()->getType();
+  auto destTy = I->getDest()->getType();
+
+  TensorQuantizationParams lhsQ{lhsTy->getScale(), lhsTy->getOffset()};
+  TensorQuantizationParams rhsQ{rhsTy->getScale(), rhsTy->getOffset()};
+  TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
+
+  auto outW = getWeightHandle<ElemTy>(I->getDest());
+  auto lhsW = getWeightHandle<ElemTy>(I->getLHS());
+  auto rhsW = getWeightHandle<ElemTy>(I->getRHS());
+  float scale = lhsQ.scale * rhsQ.scale / destQ.scale;
   for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) - rhsW.raw(i);
+    AccumulatorTy mul = AccumulatorTy(lhsW.raw(i) - lhsQ.offset) *
+                        AccumulatorTy(rhsW.raw(i) - rhsQ.offset);
+    outW.raw(i) = quantization::clip<int32_t, ElemTy>(
+        std::round(mul * scale) + destQ.offset);
   }
 }
 
-void InterpreterFunction::fwdElementMulInst(const ElementMulInst *I) {
+void BoundInterpreterFunction::fwdElementMulInst(const ElementMulInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
-    auto lhsTy = I->getLHS()->getType();
-    auto rhsTy = I->getRHS()->getType();
-    auto destTy = I->getDest()->getType();
-
-    TensorQuantizationParams lhsQ{lhsTy->getScale(), lhsTy->getOffset()};
-    TensorQuantizationParams rhsQ{rhsTy->getScale(), rhsTy->getOffset()};
-    TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
-
-    auto outW = getWeightHandle<int8_t>(I->getDest());
-    auto lhsW = getWeightHandle<int8_t>(I->getLHS());
-    auto rhsW = getWeightHandle<int8_t>(I->getRHS());
-    float scale = lhsQ.scale * rhsQ.scale / destQ.scale;
-    for (size_t i = 0, e = outW.size(); i < e; i++) {
-      int32_t mul = (lhsW.raw(i) - lhsQ.offset) * (rhsW.raw(i) - rhsQ.offset);
-      outW.raw(i) = quantization::clip<int32_t, int8_t>(
-          std::round(mul * scale) + destQ.offset);
+    if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+      return fwdElementMulInst_QuantizedImpl<int16_t, int64_t>(I);
     }
-    return;
+    return fwdElementMulInst_QuantizedImpl<int8_t, int32_t>(I);
   }
 
   auto outW = getWeightHandle(I->getDest());
   auto lhsW = getWeightHandle(I->getLHS());
   auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = lhsW.raw(i) * rhsW.raw(i);
-  }
+  parallelFor(outW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  outW.raw(i) = lhsW.raw(i) * rhsW.raw(i);
+                }
+              });
 }
 
-void InterpreterFunction::fwdElementDivInst(const ElementDivInst *I) {
+void BoundInterpreterFunction::fwdElementDivInst(const ElementDivInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto destTy = I->getDest()->getType();
     auto lhsTy = I->getLHS()->getType();
@@ -1067,9 +1506,12 @@ void InterpreterFunction::fwdElementDivInst(const ElementDivInst *I) {
   auto outW = getWeightHandle<TYPE_>(I->getDest());                            \
   auto lhsW = getWeightHandle<TYPE_>(I->getLHS());                             \
   auto rhsW = getWeightHandle<TYPE_>(I->getRHS());                             \
-  for (size_t i = 0, e = outW.size(); i < e; i++) {                            \
-    outW.raw(i) = lhsW.raw(i) / rhsW.raw(i);                                   \
-  }
+  parallelFor(outW.size(), dataParallelMinChunkSize,                           \
+              [&](size_t begin, size_t end) {                                  \
+                for (size_t i = begin; i < end; i++) {                         \
+                  outW.raw(i) = lhsW.raw(i) / rhsW.raw(i);                     \
+                }                                                              \
+              });
 
   auto *T = getTensor(I->getDest());
   switch (T->getElementType()) {
@@ -1086,7 +1528,7 @@ void InterpreterFunction::fwdElementDivInst(const ElementDivInst *I) {
   }
 }
 
-void InterpreterFunction::fwdElementMaxInst(const ElementMaxInst *I) {
+void BoundInterpreterFunction::fwdElementMaxInst(const ElementMaxInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto lhsTy = I->getLHS()->getType();
     auto rhsTy = I->getRHS()->getType();
@@ -1117,12 +1559,15 @@ void InterpreterFunction::fwdElementMaxInst(const ElementMaxInst *I) {
   auto outW = out->getHandle();
   auto lhsW = lhs->getHandle();
   auto rhsW = rhs->getHandle();
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = std::max(lhsW.raw(i), rhsW.raw(i));
-  }
+  parallelFor(outW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  outW.raw(i) = std::max(lhsW.raw(i), rhsW.raw(i));
+                }
+              });
 }
 
-void InterpreterFunction::fwdElementMinInst(const ElementMinInst *I) {
+void BoundInterpreterFunction::fwdElementMinInst(const ElementMinInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto lhsTy = I->getLHS()->getType();
     auto rhsTy = I->getRHS()->getType();
@@ -1150,14 +1595,18 @@ void InterpreterFunction::fwdElementMinInst(const ElementMinInst *I) {
   auto outW = getWeightHandle(I->getDest());
   auto lhsW = getWeightHandle(I->getLHS());
   auto rhsW = getWeightHandle(I->getRHS());
-  for (size_t i = 0, e = outW.size(); i < e; i++) {
-    outW.raw(i) = std::min(lhsW.raw(i), rhsW.raw(i));
-  }
+  parallelFor(outW.size(), dataParallelMinChunkSize,
+              [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                  outW.raw(i) = std::min(lhsW.raw(i), rhsW.raw(i));
+                }
+              });
 }
 
 // For both quantized and non-quantized CmpLTE, we set the result to 1.0/0.0.
 // In the quantized case, we assume that the scale params are (1.0, 0).
-void InterpreterFunction::fwdElementCmpLTEInst(const ElementCmpLTEInst *I) {
+void BoundInterpreterFunction::fwdElementCmpLTEInst(
+    const ElementCmpLTEInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto lhsTy = I->getLHS()->getType();
     auto rhsTy = I->getRHS()->getType();
@@ -1188,7 +1637,7 @@ void InterpreterFunction::fwdElementCmpLTEInst(const ElementCmpLTEInst *I) {
   }
 }
 
-void InterpreterFunction::fwdElementCmpEQInst(const ElementCmpEQInst *I) {
+void BoundInterpreterFunction::fwdElementCmpEQInst(const ElementCmpEQInst *I) {
   auto outW = getWeightHandle<int64_t>(I->getDest());
   auto lhsW = getWeightHandle<int64_t>(I->getLHS());
   auto rhsW = getWeightHandle<int64_t>(I->getRHS());
@@ -1197,7 +1646,8 @@ void InterpreterFunction::fwdElementCmpEQInst(const ElementCmpEQInst *I) {
   }
 }
 
-void InterpreterFunction::fwdElementPowInst(const glow::ElementPowInst *I) {
+void BoundInterpreterFunction::fwdElementPowInst(
+    const glow::ElementPowInst *I) {
   auto baseW = getWeightHandle(I->getLHS());
   auto expW = getWeightHandle(I->getRHS());
   auto outW = getWeightHandle(I->getDest());
@@ -1206,7 +1656,7 @@ void InterpreterFunction::fwdElementPowInst(const glow::ElementPowInst *I) {
   }
 }
 
-void InterpreterFunction::fwdElementLogInst(const ElementLogInst *I) {
+void BoundInterpreterFunction::fwdElementLogInst(const ElementLogInst *I) {
   auto inW = getWeightHandle(I->getSrc());
   auto outW = getWeightHandle(I->getDest());
   for (size_t i = 0, e = inW.size(); i < e; i++) {
@@ -1215,7 +1665,7 @@ void InterpreterFunction::fwdElementLogInst(const ElementLogInst *I) {
   }
 }
 
-void InterpreterFunction::fwdElementSelectInst(
+void BoundInterpreterFunction::fwdElementSelectInst(
     const glow::ElementSelectInst *I) {
   if (getTensor(I->getLHS())->getType().isQuantizedType()) {
     auto destTy = I->getDest()->getType();
@@ -1256,49 +1706,59 @@ void InterpreterFunction::fwdElementSelectInst(
 //                       Mat Mul
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdMatMulInst(const glow::MatMulInst *I) {
-  if (getTensor(I->getLHS())->getType().isQuantizedType()) {
-    auto lhs = getWeightHandle<int8_t>(I->getLHS());
-    auto rhs = getWeightHandle<int8_t>(I->getRHS());
+template <typename ElemTy, typename AccumulatorTy>
+void BoundInterpreterFunction::fwdMatMulInst_QuantizedImpl(
+    const glow::MatMulInst *I) {
+  auto lhs = getWeightHandle<ElemTy>(I->getLHS());
+  auto rhs = getWeightHandle<ElemTy>(I->getRHS());
 
-    auto dest = getWeightHandle<int8_t>(I->getDest());
+  auto dest = getWeightHandle<ElemTy>(I->getDest());
 
-    auto destDim = dest.dims();
-    auto lhsDim = lhs.dims();
+  auto destDim = dest.dims();
+  auto lhsDim = lhs.dims();
 
-    auto destTy = I->getDest()->getType();
-    auto lhsTy = I->getLHS()->getType();
-    auto rhsTy = I->getRHS()->getType();
+  auto destTy = I->getDest()->getType();
+  auto lhsTy = I->getLHS()->getType();
+  auto rhsTy = I->getRHS()->getType();
 
-    dest.clear(0);
+  dest.clear(0);
 
-    // For matrix multiplication, if the offset is equal to zero the scale
-    // is defined as the formula (L.scale * R.scale / D.scale).
-    // In here we assume that the offset for all buffers is zero.
-    float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
-    int32_t lhsOffset = lhsTy->getOffset();
-    int32_t rhsOffset = rhsTy->getOffset();
-    int32_t destOffset = destTy->getOffset();
+  // For matrix multiplication, if the offset is equal to zero the scale
+  // is defined as the formula (L.scale * R.scale / D.scale).
+  // In here we assume that the offset for all buffers is zero.
+  float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
+  int32_t lhsOffset = lhsTy->getOffset();
+  int32_t rhsOffset = rhsTy->getOffset();
+  int32_t destOffset = destTy->getOffset();
+  bool transposeRHS = I->getTransposeRHS();
 
-    // For each (x,y) in the destination matrix:
-    for (size_t x = 0; x < destDim[0]; x++) {
-      for (size_t y = 0; y < destDim[1]; y++) {
-
-        // Perform DOT on the row an column.
-        int32_t sum = 0;
-        for (size_t i = 0; i < lhsDim[1]; i++) {
-          int32_t L = lhs.at({x, i});
-          int32_t R = rhs.at({i, y});
-          // We represent the element multiplication with offset as
-          // (value - offset).
-          sum += (L - lhsOffset) * (R - rhsOffset);
-        }
+  // For each (x,y) in the destination matrix:
+  for (size_t x = 0; x < destDim[0]; x++) {
+    for (size_t y = 0; y < destDim[1]; y++) {
 
-        dest.at({x, y}) = quantization::clip<int32_t, int8_t>(
-            std::round(scale * sum + destOffset));
+      // Perform DOT on the row an column.
+      AccumulatorTy sum = 0;
+      for (size_t i = 0; i < lhsDim[1]; i++) {
+        AccumulatorTy L = lhs.at({x, i});
+        AccumulatorTy R = transposeRHS ? rhs.at({y, i}) : rhs.at({i, y});
+        // We represent the element multiplication with offset as
+        // (value - offset).
+        sum += (L - lhsOffset) * (R - rhsOffset);
       }
+
+      dest.at({x, y}) = quantization::clip<int64_t, ElemTy>(
+          std::round(scale * sum + destOffset));
     }
-    return;
+  }
+}
+
+void BoundInterpreterFunction::fwdMatMulInst(const glow::MatMulInst *I) {
+  if (getTensor(I->getLHS())->getType().isQuantizedType()) {
+    // The products of 16-bit operands overflow a 32-bit accumulator.
+    if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+      return fwdMatMulInst_QuantizedImpl<int16_t, int64_t>(I);
+    }
+    return fwdMatMulInst_QuantizedImpl<int8_t, int32_t>(I);
   }
 
   auto lhs = getWeightHandle(I->getLHS());
@@ -1307,29 +1767,216 @@ void InterpreterFunction::fwdMatMulInst(const glow::MatMulInst *I) {
 
   auto destDim = dest.dims();
   auto lhsDim = lhs.dims();
+  bool transposeRHS = I->getTransposeRHS();
+
+  // For each (x,y) in the destination matrix, the rows being computed in
+  // parallel:
+  size_t rowWork = destDim[1] * lhsDim[1];
+  parallelFor(destDim[0], getMinChunkSize(rowWork),
+              [&](size_t begin, size_t end) {
+                for (size_t x = begin; x < end; x++) {
+                  for (size_t y = 0; y < destDim[1]; y++) {
+
+                    // Perform DOT on the row an column.
+                    float sum = 0;
+                    for (size_t i = 0; i < lhsDim[1]; i++) {
+                      sum += lhs.at({x, i}) * (transposeRHS ? rhs.at({y, i})
+                                                            : rhs.at({i, y}));
+                    }
+                    dest.at({x, y}) = sum;
+                  }
+                }
+              });
+}
 
-  dest.clear(0);
+void BoundInterpreterFunction::fwdRowwiseQuantizedFullyConnectedInst(
+    const RowwiseQuantizedFullyConnectedInst *I) {
+  auto *src = getTensor(I->getSrc());
+  auto srcH = src->getHandle();
+  auto weights = getWeightHandle<int8_t>(I->getWeights());
+  auto scales = getWeightHandle(I->getScales());
+  auto offsets = getWeightHandle<int32_t>(I->getOffsets());
+  auto bias = getWeightHandle(I->getBias());
+  auto dest = getWeightHandle(I->getDest());
 
-  // For each (x,y) in the destination matrix:
-  for (size_t x = 0; x < destDim[0]; x++) {
-    for (size_t y = 0; y < destDim[1]; y++) {
+  // The input is flattened to a matrix with a row per batch entry.
+  size_t batch = dest.dims()[0];
+  size_t outSize = dest.dims()[1];
+  size_t inSize = weights.dims()[1];
+
+  size_t rowWork = outSize * inSize;
+  parallelFor(batch, getMinChunkSize(rowWork), [&](size_t begin, size_t end) {
+    for (size_t x = begin; x < end; x++) {
+      for (size_t y = 0; y < outSize; y++) {
+        // Dequantize the row of the weights of the output column y.
+        float sum = 0;
+        int32_t offset = offsets.raw(y);
+        for (size_t i = 0; i < inSize; i++) {
+          sum += srcH.raw(x * inSize + i) *
+                 float(weights.at({y, i}) - offset);
+        }
+        dest.at({x, y}) = sum * scales.raw(y) + bias.raw(y);
+      }
+    }
+  });
+}
 
-      // Perform DOT on the row an column.
-      float sum = 0;
-      for (size_t i = 0; i < lhsDim[1]; i++) {
-        sum += lhs.at({x, i}) * rhs.at({i, y});
+void BoundInterpreterFunction::fwdDynamicQuantizedFullyConnectedInst(
+    const DynamicQuantizedFullyConnectedInst *I) {
+  auto *src = getTensor(I->getSrc());
+  auto srcH = src->getHandle();
+  auto weights = getWeightHandle<int8_t>(I->getWeights());
+  auto scales = getWeightHandle(I->getScales());
+  auto offsets = getWeightHandle<int32_t>(I->getOffsets());
+  auto bias = getWeightHandle(I->getBias());
+  auto dest = getWeightHandle(I->getDest());
+
+  size_t batch = dest.dims()[0];
+  size_t outSize = dest.dims()[1];
+  size_t inSize = weights.dims()[1];
+
+  // The rows are quantized into a local buffer; the scratch is only used by
+  // the CPU kernels.
+  std::vector<int8_t> row(inSize);
+  for (size_t x = 0; x < batch; x++) {
+    // Pick the range of the row from its actual values.
+    float min = srcH.raw(x * inSize);
+    float max = min;
+    for (size_t i = 0; i < inSize; i++) {
+      min = std::min(min, srcH.raw(x * inSize + i));
+      max = std::max(max, srcH.raw(x * inSize + i));
+    }
+    auto TQP = quantization::chooseQuantizationParams(min, max);
+    for (size_t i = 0; i < inSize; i++) {
+      row[i] = quantization::quantize(srcH.raw(x * inSize + i), TQP);
+    }
+
+    for (size_t y = 0; y < outSize; y++) {
+      int32_t sum = 0;
+      int32_t offset = offsets.raw(y);
+      for (size_t i = 0; i < inSize; i++) {
+        sum += (int32_t(row[i]) - TQP.offset) *
+               (int32_t(weights.at({y, i})) - offset);
       }
-      dest.at({x, y}) = sum;
+      dest.at({x, y}) = sum * TQP.scale * scales.raw(y) + bias.raw(y);
     }
   }
 }
 
+template <typename ElemTy, typename AccumulatorTy>
+void BoundInterpreterFunction::fwdBatchedMatMulInst_QuantizedImpl(
+    const glow::BatchedMatMulInst *I) {
+  auto lhs = getWeightHandle<ElemTy>(I->getLHS());
+  auto rhs = getWeightHandle<ElemTy>(I->getRHS());
+  auto dest = getWeightHandle<ElemTy>(I->getDest());
+
+  auto destDim = dest.dims();
+  auto lhsDim = lhs.dims();
+
+  auto destTy = I->getDest()->getType();
+  auto lhsTy = I->getLHS()->getType();
+  auto rhsTy = I->getRHS()->getType();
+
+  float scale = lhsTy->getScale() * rhsTy->getScale() / destTy->getScale();
+  int32_t lhsOffset = lhsTy->getOffset();
+  int32_t rhsOffset = rhsTy->getOffset();
+  int32_t destOffset = destTy->getOffset();
+
+  // For each (x,y) in the destination matrix of every batch entry:
+  for (size_t b = 0; b < destDim[0]; b++) {
+    for (size_t x = 0; x < destDim[1]; x++) {
+      for (size_t y = 0; y < destDim[2]; y++) {
+        AccumulatorTy sum = 0;
+        for (size_t i = 0; i < lhsDim[2]; i++) {
+          AccumulatorTy L = lhs.at({b, x, i});
+          AccumulatorTy R = rhs.at({b, i, y});
+          sum += (L - lhsOffset) * (R - rhsOffset);
+        }
+        dest.at({b, x, y}) = quantization::clip<int64_t, ElemTy>(
+            std::round(scale * sum + destOffset));
+      }
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdBatchedMatMulInst(
+    const glow::BatchedMatMulInst *I) {
+  if (getTensor(I->getLHS())->getType().isQuantizedType()) {
+    if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+      return fwdBatchedMatMulInst_QuantizedImpl<int16_t, int64_t>(I);
+    }
+    return fwdBatchedMatMulInst_QuantizedImpl<int8_t, int32_t>(I);
+  }
+
+  auto lhs = getWeightHandle(I->getLHS());
+  auto rhs = getWeightHandle(I->getRHS());
+  auto dest = getWeightHandle(I->getDest());
+
+  auto destDim = dest.dims();
+  auto lhsDim = lhs.dims();
+
+  // For each (x,y) in the destination matrix of every batch entry, the rows
+  // of all of the entries being computed in parallel:
+  size_t rowWork = destDim[2] * lhsDim[2];
+  parallelFor(destDim[0] * destDim[1], getMinChunkSize(rowWork),
+              [&](size_t begin, size_t end) {
+                for (size_t bx = begin; bx < end; bx++) {
+                  size_t b = bx / destDim[1];
+                  size_t x = bx % destDim[1];
+                  for (size_t y = 0; y < destDim[2]; y++) {
+                    float sum = 0;
+                    for (size_t i = 0; i < lhsDim[2]; i++) {
+                      sum += lhs.at({b, x, i}) * rhs.at({b, i, y});
+                    }
+                    dest.at({b, x, y}) = sum;
+                  }
+                }
+              });
+}
+
 //===----------------------------------------------------------------------===//
 //                       Batched operations
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdBatchedAddInst(const glow::BatchedAddInst *I) {
+void BoundInterpreterFunction::fwdBatchedAddInst_I16Impl(
+    const glow::BatchedAddInst *I) {
+  auto batch = getWeightHandle<int16_t>(I->getBatch());
+  auto slice = getWeightHandle<int16_t>(I->getSlice());
+  auto dest = getWeightHandle<int16_t>(I->getDest());
+
+  auto batchTy = I->getBatch()->getType();
+  auto sliceTy = I->getSlice()->getType();
+  auto destTy = I->getDest()->getType();
+
+  TensorQuantizationParams batchQ{batchTy->getScale(), batchTy->getOffset()};
+  TensorQuantizationParams sliceQ{sliceTy->getScale(), sliceTy->getOffset()};
+  TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
+
+  auto bdim = flattenCdr(batch.dims());
+  assert(slice.size() == bdim.second && "Invalid slice size");
+  assert(batch.dims().drop_front() == slice.dims() && "Invalid batch size");
+
+  // For each layer in the batch:
+  for (size_t n = 0; n < bdim.first; n++) {
+    size_t base = batch.getElementPtr({n});
+
+    // For each element in the slice. The values are added in floating point,
+    // see fwdElementAddInst_I16Impl.
+    for (size_t i = 0; i < bdim.second; i++) {
+      float sum = quantization::dequantize(batch.raw(base + i), batchQ) +
+                  quantization::dequantize(slice.raw(i), sliceQ);
+      dest.raw(base + i) = quantization::quantize<int16_t>(sum, destQ);
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdBatchedAddInst(
+    const glow::BatchedAddInst *I) {
   if (getTensor(I->getBatch())->getType().isQuantizedType()) {
+    if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+      return fwdBatchedAddInst_I16Impl(I);
+    }
+
     auto batch = getWeightHandle<int8_t>(I->getBatch());
     auto slice = getWeightHandle<int8_t>(I->getSlice());
     auto dest = getWeightHandle<int8_t>(I->getDest());
@@ -1393,7 +2040,7 @@ void InterpreterFunction::fwdBatchedAddInst(const glow::BatchedAddInst *I) {
   }
 }
 
-void InterpreterFunction::fwdBatchedReduceAddInst(
+void BoundInterpreterFunction::fwdBatchedReduceAddInst(
     const glow::BatchedReduceAddInst *I) {
   static_assert(max_tensor_dimensions == 6,
                 "Loops below assume max_tensor_dimensions = 6.");
@@ -1492,22 +2139,29 @@ void InterpreterFunction::fwdBatchedReduceAddInst(
   }
 }
 
-void InterpreterFunction::fwdSparseLengthsWeightedSumInst(
-    const SparseLengthsWeightedSumInst *I) {
-  auto out = getTensor(I->getDest());
-  auto data = getTensor(I->getData());
-  auto weights = getTensor(I->getWeights());
-  auto indices = getTensor(I->getIndices());
-  auto lengths = getTensor(I->getLengths());
-
+/// Accumulates the rows of the table \p data selected by \p indices into the
+/// segments of \p out given by \p lengths. Row i of \p data is scaled by
+/// weights[i], and then by \p scales[i] after subtracting \p offsets[i] if
+/// the table is row-wise quantized.
+/// Compute the sparse lengths weighted sum of \p data into \p out, the
+/// segments being split between the threads of \p pool.
+template <typename DataTy>
+static void fwdSparseLengthsWeightedSum(ThreadPool &pool, Tensor *out,
+                                        Tensor *data, Tensor *weights,
+                                        Tensor *indices, Tensor *lengths,
+                                        Tensor *scales = nullptr,
+                                        Tensor *offsets = nullptr) {
   out->zero();
 
   auto IH = indices->getHandle<int64_t>();
   auto LH = lengths->getHandle<int64_t>();
 
+  // Find where the indices of every segment start.
   size_t segments = lengths->dims()[0];
+  std::vector<size_t> segmentStart(segments);
   size_t totalLength = 0;
   for (size_t i = 0; i < segments; i++) {
+    segmentStart[i] = totalLength;
     totalLength += LH.raw(i);
   }
   assert(totalLength == indices->dims()[0] &&
@@ -1515,23 +2169,64 @@ void InterpreterFunction::fwdSparseLengthsWeightedSumInst(
 
   size_t lineSize = data->size() / data->dims()[0];
 
-  assert(!data->getType().isQuantizedType() &&
-         "Quantization is not yet supported for SparseLengthsWeightedSum.");
-
-  auto DH = data->getHandle<float>();
+  auto DH = data->getHandle<DataTy>();
   auto WH = weights->getHandle<float>();
   auto OH = out->getHandle<float>();
 
-  size_t curIdx = 0;
-  for (size_t i = 0; i < segments; i++) {
-    for (size_t j = 0, e = LH.raw(i); j < e; j++) {
-      float weight = WH.raw(curIdx);
-      size_t offsetIn = IH.raw(curIdx++) * lineSize;
-      size_t offsetOut = i * lineSize;
-      for (size_t k = 0; k < lineSize; k++)
-        OH.raw(offsetOut++) += DH.raw(offsetIn++) * weight;
-    }
+  size_t segmentWork = segments ? totalLength * lineSize / segments : 0;
+  pool.parallelFor(
+      segments, getMinChunkSize(segmentWork), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          size_t curIdx = segmentStart[i];
+          for (size_t j = 0, e = LH.raw(i); j < e; j++) {
+            size_t row = IH.raw(curIdx);
+            float weight = WH.raw(curIdx++);
+            float offset = 0;
+            if (scales) {
+              offset = offsets->getHandle<int32_t>().raw(row);
+              weight *= scales->getHandle<float>().raw(row);
+            }
+            size_t offsetIn = row * lineSize;
+            size_t offsetOut = i * lineSize;
+            for (size_t k = 0; k < lineSize; k++)
+              OH.raw(offsetOut++) += (DH.raw(offsetIn++) - offset) * weight;
+          }
+        }
+      });
+}
+
+void BoundInterpreterFunction::fwdSparseLengthsWeightedSumInst(
+    const SparseLengthsWeightedSumInst *I) {
+  auto out = getTensor(I->getDest());
+  auto data = getTensor(I->getData());
+  auto weights = getTensor(I->getWeights());
+  auto indices = getTensor(I->getIndices());
+  auto lengths = getTensor(I->getLengths());
+
+  assert(!data->getType().isQuantizedType() &&
+         "Quantization is not yet supported for SparseLengthsWeightedSum.");
+
+  if (data->getElementType() == ElemKind::Float16Ty) {
+    fwdSparseLengthsWeightedSum<float16_t>(getThreadPool(), out, data, weights,
+                                           indices, lengths);
+    return;
   }
+  if (data->getElementType() == ElemKind::BFloat16Ty) {
+    fwdSparseLengthsWeightedSum<bfloat16_t>(getThreadPool(), out, data,
+                                            weights, indices, lengths);
+    return;
+  }
+  fwdSparseLengthsWeightedSum<float>(getThreadPool(), out, data, weights,
+                                     indices, lengths);
+}
+
+void BoundInterpreterFunction::fwdRowwiseQuantizedSparseLengthsWeightedSumInst(
+    const RowwiseQuantizedSparseLengthsWeightedSumInst *I) {
+  fwdSparseLengthsWeightedSum<int8_t>(
+      getThreadPool(), getTensor(I->getDest()), getTensor(I->getData()),
+      getTensor(I->getWeights()), getTensor(I->getIndices()),
+      getTensor(I->getLengths()), getTensor(I->getScales()),
+      getTensor(I->getOffsets()));
 }
 
 //===----------------------------------------------------------------------===//
@@ -1554,12 +2249,13 @@ static void fwdTopK(Tensor *outW, Tensor *indW, Tensor *inW, size_t k) {
       buf[i].first = in.raw(in_p++);
       buf[i].second = i;
     }
-    // NOTE: it's possible to do N + KlogK, while this version is NlogN
-    std::sort(buf.begin(), buf.end(), [](const pairType &a, const pairType &b) {
-      if (a.first != b.first)
-        return a.first > b.first;
-      return a.second < b.second;
-    });
+    // Only the first k elements need to be in order, which takes N log K.
+    std::partial_sort(buf.begin(), buf.begin() + k, buf.end(),
+                      [](const pairType &a, const pairType &b) {
+                        if (a.first != b.first)
+                          return a.first > b.first;
+                        return a.second < b.second;
+                      });
     for (size_t i = 0; i < k; i++) {
       values.raw(out_p) = buf[i].first;
       indices.raw(out_p) = buf[i].second;
@@ -1568,11 +2264,161 @@ static void fwdTopK(Tensor *outW, Tensor *indW, Tensor *inW, size_t k) {
   }
 }
 
+static float sigmoid(float x) { return 1 / (1 + std::exp(-x)); }
+
+void BoundInterpreterFunction::fwdLSTMUnitInst(const LSTMUnitInst *I) {
+  auto inputGates = getWeightHandle(I->getInputGates());
+  auto hiddenGates = getWeightHandle(I->getHiddenGates());
+  auto C = getWeightHandle(I->getC());
+  auto newH = getWeightHandle(I->getNewH());
+  auto newC = getWeightHandle(I->getNewC());
+  size_t batch = C.dims()[0];
+  size_t hidden = C.dims()[1];
+
+  // The gates are in the order input, forget, cell, output.
+  for (size_t n = 0; n < batch; n++) {
+    for (size_t j = 0; j < hidden; j++) {
+      float g[4];
+      for (size_t k = 0; k < 4; k++) {
+        g[k] = inputGates.at({n, k * hidden + j}) +
+               hiddenGates.at({n, k * hidden + j});
+      }
+      float c = sigmoid(g[1]) * C.at({n, j}) + sigmoid(g[0]) * std::tanh(g[2]);
+      newC.at({n, j}) = c;
+      newH.at({n, j}) = sigmoid(g[3]) * std::tanh(c);
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdGRUUnitInst(const GRUUnitInst *I) {
+  auto inputGates = getWeightHandle(I->getInputGates());
+  auto hiddenGates = getWeightHandle(I->getHiddenGates());
+  auto H = getWeightHandle(I->getH());
+  auto dest = getWeightHandle(I->getDest());
+  size_t batch = H.dims()[0];
+  size_t hidden = H.dims()[1];
+
+  // The gates are in the order reset, update, new.
+  for (size_t n = 0; n < batch; n++) {
+    for (size_t j = 0; j < hidden; j++) {
+      float r = sigmoid(inputGates.at({n, j}) + hiddenGates.at({n, j}));
+      float z = sigmoid(inputGates.at({n, hidden + j}) +
+                        hiddenGates.at({n, hidden + j}));
+      float g = std::tanh(inputGates.at({n, 2 * hidden + j}) +
+                          r * hiddenGates.at({n, 2 * hidden + j}));
+      float h = H.at({n, j});
+      dest.at({n, j}) = g + z * (h - g);
+    }
+  }
+}
+
+/// Run a recurrent layer over the time steps of \p inputGates {T, B, G}, from
+/// the hidden state \p initH {B, H}, into \p dest {T, B, H}. Every step
+/// computes the gates of the hidden state with \p weights and \p bias, and
+/// \p unit(n, inputGates, hiddenGates, h) updates the hidden state h of the
+/// batch entry n in place. The batch entry n runs \p lengths[n] steps, and
+/// its later states repeat the last one.
+template <typename UnitTy>
+static void fwdRecurrentSequence(Handle<float> inputGates,
+                                 Handle<float> initH, Handle<float> weights,
+                                 Handle<float> bias, Handle<int64_t> lengths,
+                                 Handle<float> dest, UnitTy unit) {
+  size_t steps = dest.dims()[0];
+  size_t batch = dest.dims()[1];
+  size_t hidden = dest.dims()[2];
+  size_t gatesSize = bias.size();
+  std::vector<float> h(initH.size());
+  for (size_t i = 0, e = h.size(); i < e; i++) {
+    h[i] = initH.raw(i);
+  }
+  std::vector<float> xg(gatesSize), hg(gatesSize);
+  for (size_t t = 0; t < steps; t++) {
+    for (size_t n = 0; n < batch; n++) {
+      float *hn = &h[n * hidden];
+      if (size_t(lengths.at({n})) > t) {
+        for (size_t j = 0; j < gatesSize; j++) {
+          xg[j] = inputGates.at({t, n, j});
+          hg[j] = bias.at({j});
+          for (size_t k = 0; k < hidden; k++) {
+            hg[j] += hn[k] * weights.at({k, j});
+          }
+        }
+        unit(n, xg, hg, hn);
+      }
+      for (size_t j = 0; j < hidden; j++) {
+        dest.at({t, n, j}) = hn[j];
+      }
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdRNNSequenceInst(const RNNSequenceInst *I) {
+  fwdRecurrentSequence(
+      getWeightHandle(I->getInputGates()), getWeightHandle(I->getInitH()),
+      getWeightHandle(I->getHiddenWeights()),
+      getWeightHandle(I->getHiddenBias()),
+      getWeightHandle<int64_t>(I->getLengths()), getWeightHandle(I->getDest()),
+      [](size_t, const std::vector<float> &xg, const std::vector<float> &hg,
+         float *h) {
+        for (size_t j = 0, e = xg.size(); j < e; j++) {
+          h[j] = std::tanh(xg[j] + hg[j]);
+        }
+      });
+}
+
+void BoundInterpreterFunction::fwdLSTMSequenceInst(const LSTMSequenceInst *I) {
+  auto initC = getWeightHandle(I->getInitC());
+  size_t hidden = initC.dims()[1];
+  std::vector<float> c(initC.size());
+  for (size_t i = 0, e = c.size(); i < e; i++) {
+    c[i] = initC.raw(i);
+  }
+
+  // The gates are in the order input, forget, cell, output.
+  fwdRecurrentSequence(
+      getWeightHandle(I->getInputGates()), getWeightHandle(I->getInitH()),
+      getWeightHandle(I->getHiddenWeights()),
+      getWeightHandle(I->getHiddenBias()),
+      getWeightHandle<int64_t>(I->getLengths()), getWeightHandle(I->getDest()),
+      [&](size_t n, const std::vector<float> &xg, const std::vector<float> &hg,
+          float *h) {
+        for (size_t j = 0; j < hidden; j++) {
+          float g[4];
+          for (size_t k = 0; k < 4; k++) {
+            g[k] = xg[k * hidden + j] + hg[k * hidden + j];
+          }
+          float &cj = c[n * hidden + j];
+          cj = sigmoid(g[1]) * cj + sigmoid(g[0]) * std::tanh(g[2]);
+          h[j] = sigmoid(g[3]) * std::tanh(cj);
+        }
+      });
+}
+
+void BoundInterpreterFunction::fwdGRUSequenceInst(const GRUSequenceInst *I) {
+  size_t hidden = I->getInitH()->dims()[1];
+
+  // The gates are in the order reset, update, new.
+  fwdRecurrentSequence(
+      getWeightHandle(I->getInputGates()), getWeightHandle(I->getInitH()),
+      getWeightHandle(I->getHiddenWeights()),
+      getWeightHandle(I->getHiddenBias()),
+      getWeightHandle<int64_t>(I->getLengths()), getWeightHandle(I->getDest()),
+      [&](size_t, const std::vector<float> &xg, const std::vector<float> &hg,
+          float *h) {
+        for (size_t j = 0; j < hidden; j++) {
+          float r = sigmoid(xg[j] + hg[j]);
+          float z = sigmoid(xg[hidden + j] + hg[hidden + j]);
+          float g = std::tanh(xg[2 * hidden + j] + r * hg[2 * hidden + j]);
+          h[j] = g + z * (h[j] - g);
+        }
+      });
+}
+
 //===----------------------------------------------------------------------===//
 //                       Sorting operators
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdTopKInst(const TopKInst *I) {
+void BoundInterpreterFunction::fwdTopKInst(const TopKInst *I) {
   auto outW = getTensor(I->getValues());
   auto indW = getTensor(I->getIndices());
   auto inW = getTensor(I->getInput());
@@ -1585,17 +2431,192 @@ void InterpreterFunction::fwdTopKInst(const TopKInst *I) {
   }
 }
 
+//===----------------------------------------------------------------------===//
+//                       Training
+//===----------------------------------------------------------------------===//
+
+/// \returns the gradient \p g of the weight \p w, with the decays applied and
+/// averaged over the batch. This is the same computation as the lowered SGD
+/// node.
+static float getRegularizedGradient(float w, float g, float L1Decay,
+                                    float L2Decay, unsigned batchSize) {
+  float gij = g + L1Decay * (w >= 0 ? 1 : -1) + L2Decay * w;
+  if (batchSize > 1) {
+    gij /= batchSize;
+  }
+  return gij;
+}
+
+/// \returns the step of the SGD update of the weight \p w with the gradient
+/// \p g, before the momentum is applied.
+static float getSGDStep(float w, float g, float L1Decay, float L2Decay,
+                        float learningRate, unsigned batchSize) {
+  return -learningRate *
+         getRegularizedGradient(w, g, L1Decay, L2Decay, batchSize);
+}
+
+void BoundInterpreterFunction::fwdSGDInst(const SGDInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto newW = getWeightHandle(I->getUpdatedWeight());
+  for (size_t i = 0, e = W.size(); i < e; i++) {
+    float w = W.raw(i);
+    newW.raw(i) = w + getSGDStep(w, G.raw(i), I->getL1Decay(),
+                                 I->getL2Decay(), I->getLearningRate(),
+                                 I->getBatchSize());
+  }
+}
+
+void BoundInterpreterFunction::fwdMomentumSGDInst(const MomentumSGDInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto Gsum = getWeightHandle(I->getGsum());
+  auto newW = getWeightHandle(I->getUpdatedWeight());
+  float momentum = I->getMomentum();
+  for (size_t i = 0, e = W.size(); i < e; i++) {
+    float w = W.raw(i);
+    float dx = momentum * Gsum.raw(i) +
+               getSGDStep(w, G.raw(i), I->getL1Decay(), I->getL2Decay(),
+                          I->getLearningRate(), I->getBatchSize());
+    Gsum.raw(i) = dx;
+    newW.raw(i) = w + dx;
+  }
+}
+
+void BoundInterpreterFunction::fwdAdagradInst(const AdagradInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto sumSq = getWeightHandle(I->getSumSq());
+  auto newW = getWeightHandle(I->getUpdatedWeight());
+  for (size_t i = 0, e = W.size(); i < e; i++) {
+    float w = W.raw(i);
+    float g = getRegularizedGradient(w, G.raw(i), I->getL1Decay(),
+                                     I->getL2Decay(), I->getBatchSize());
+    float s = sumSq.raw(i) + g * g;
+    sumSq.raw(i) = s;
+    newW.raw(i) =
+        w - I->getLearningRate() * g / (std::sqrt(s) + I->getEpsilon());
+  }
+}
+
+void BoundInterpreterFunction::fwdRMSPropInst(const RMSPropInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto meanSq = getWeightHandle(I->getMeanSq());
+  auto newW = getWeightHandle(I->getUpdatedWeight());
+  float decay = I->getDecay();
+  for (size_t i = 0, e = W.size(); i < e; i++) {
+    float w = W.raw(i);
+    float g = getRegularizedGradient(w, G.raw(i), I->getL1Decay(),
+                                     I->getL2Decay(), I->getBatchSize());
+    float s = decay * meanSq.raw(i) + (1 - decay) * g * g;
+    meanSq.raw(i) = s;
+    newW.raw(i) =
+        w - I->getLearningRate() * g / (std::sqrt(s) + I->getEpsilon());
+  }
+}
+
+void BoundInterpreterFunction::fwdAdamInst(const AdamInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto M = getWeightHandle(I->getFirstMoment());
+  auto V = getWeightHandle(I->getSecondMoment());
+  auto step = getWeightHandle(I->getStep());
+  auto newW = getWeightHandle(I->getUpdatedWeight());
+  float beta1 = I->getBeta1();
+  float beta2 = I->getBeta2();
+  // The corrections of the bias of the moments towards their initial zeros.
+  float t = step.raw(0) + 1;
+  float correction1 = 1 - std::pow(beta1, t);
+  float correction2 = 1 - std::pow(beta2, t);
+  for (size_t i = 0, e = W.size(); i < e; i++) {
+    float w = W.raw(i);
+    float g = getRegularizedGradient(w, G.raw(i), I->getL1Decay(),
+                                     I->getL2Decay(), I->getBatchSize());
+    float m = beta1 * M.raw(i) + (1 - beta1) * g;
+    float v = beta2 * V.raw(i) + (1 - beta2) * g * g;
+    M.raw(i) = m;
+    V.raw(i) = v;
+    newW.raw(i) = w - I->getLearningRate() * (m / correction1) /
+                          (std::sqrt(v / correction2) + I->getEpsilon());
+  }
+  step.raw(0) = t;
+}
+
+void BoundInterpreterFunction::fwdSparseLengthsWeightedSumRowGradInst(
+    const SparseLengthsWeightedSumRowGradInst *I) {
+  auto rows = getWeightHandle(I->getDest());
+  auto outG = getWeightHandle(I->getOutputGrad());
+  auto weights = getWeightHandle(I->getWeights());
+  auto lengths = getWeightHandle<int64_t>(I->getLengths());
+  size_t lineSize = outG.size() / outG.dims()[0];
+
+  // Row i of the result is the gradient of the segment of index i, scaled by
+  // the weight of the index.
+  size_t i = 0;
+  for (size_t n = 0, e = lengths.size(); n < e; n++) {
+    for (int64_t j = 0; j < lengths.raw(n); j++, i++) {
+      float w = weights.raw(i);
+      for (size_t k = 0; k < lineSize; k++) {
+        rows.raw(i * lineSize + k) = w * outG.raw(n * lineSize + k);
+      }
+    }
+  }
+  assert(i == rows.dims()[0] && "The lengths do not add up to the indices");
+}
+
+void BoundInterpreterFunction::fwdSparseSGDInst(const SparseSGDInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto indices = getWeightHandle<int64_t>(I->getIndices());
+  size_t lineSize = W.size() / W.dims()[0];
+  for (size_t i = 0, e = indices.size(); i < e; i++) {
+    size_t row = indices.raw(i);
+    for (size_t k = 0; k < lineSize; k++) {
+      float &w = W.raw(row * lineSize + k);
+      w += getSGDStep(w, G.raw(i * lineSize + k), I->getL1Decay(),
+                      I->getL2Decay(), I->getLearningRate(),
+                      I->getBatchSize());
+    }
+  }
+}
+
+void BoundInterpreterFunction::fwdSparseAdagradInst(
+    const SparseAdagradInst *I) {
+  auto W = getWeightHandle(I->getWeight());
+  auto G = getWeightHandle(I->getGradient());
+  auto sumSq = getWeightHandle(I->getSumSq());
+  auto indices = getWeightHandle<int64_t>(I->getIndices());
+  size_t lineSize = W.size() / W.dims()[0];
+  for (size_t i = 0, e = indices.size(); i < e; i++) {
+    size_t row = indices.raw(i);
+    for (size_t k = 0; k < lineSize; k++) {
+      size_t idx = row * lineSize + k;
+      float w = W.raw(idx);
+      float g = getRegularizedGradient(w, G.raw(i * lineSize + k),
+                                       I->getL1Decay(), I->getL2Decay(),
+                                       I->getBatchSize());
+      float s = sumSq.raw(idx) + g * g;
+      sumSq.raw(idx) = s;
+      W.raw(idx) =
+          w - I->getLearningRate() * g / (std::sqrt(s) + I->getEpsilon());
+    }
+  }
+}
+
 //===----------------------------------------------------------------------===//
 //                  Tensor allocation operations
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdAllocActivationInst(const AllocActivationInst *I) {
-  getOrCreateTensor(I);
+void BoundInterpreterFunction::fwdAllocActivationInst(
+    const AllocActivationInst *I) {
+  // The activation lives in the arena. Clear it like a new tensor.
+  getTensor(I)->zero();
 }
 
-void InterpreterFunction::fwdDeallocActivationInst(
+void BoundInterpreterFunction::fwdDeallocActivationInst(
     const DeallocActivationInst *I) {
-  deleteTensor(I->getSrc());
+  // The memory of the activation is reused by the following ones.
 }
 
 //===----------------------------------------------------------------------===//
@@ -1605,7 +2626,7 @@ void InterpreterFunction::fwdDeallocActivationInst(
 /// Prints a value of the instruction's operand.
 /// In most cases it will be the name of the variable and the value of the
 /// tensor.
-void InterpreterFunction::fwdDebugPrintInst(const DebugPrintInst *I) {
+void BoundInterpreterFunction::fwdDebugPrintInst(const DebugPrintInst *I) {
   auto *V = I->getSrc();
   llvm::outs() << I->getName() << ": ";
   // Dump the content of a value.
@@ -1619,7 +2640,7 @@ void InterpreterFunction::fwdDebugPrintInst(const DebugPrintInst *I) {
 //                Instructions used by Quantization
 //===----------------------------------------------------------------------===//
 
-void InterpreterFunction::fwdQuantizationProfileInst(
+void BoundInterpreterFunction::fwdQuantizationProfileInst(
     const glow::QuantizationProfileInst *I) {
   auto inputTensor = getWeightHandle(I->getInputTensor());
   auto currentHistogram = getWeightHandle(I->getHistogram());
@@ -1634,34 +2655,56 @@ void InterpreterFunction::fwdQuantizationProfileInst(
 }
 /// Quantize floating point tensor. Scale and Offset are based on return type
 /// of the instruction \p I.
-void InterpreterFunction::fwdQuantizeInst(const glow::QuantizeInst *I) {
+template <typename ElemTy>
+void BoundInterpreterFunction::fwdQuantizeInst_Impl(
+    const glow::QuantizeInst *I) {
   auto srcHandle = getWeightHandle(I->getSrc());
   auto *destTensor = getTensor(I->getDest());
 
   TensorQuantizationParams params{destTensor->getType().getScale(),
                                   destTensor->getType().getOffset()};
 
-  auto destHandle = destTensor->getHandle<int8_t>();
+  auto destHandle = destTensor->getHandle<ElemTy>();
   for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
-    destHandle.raw(i) = quantization::quantize(srcHandle.raw(i), params);
+    destHandle.raw(i) =
+        quantization::quantize<ElemTy>(srcHandle.raw(i), params);
+  }
+}
+
+void BoundInterpreterFunction::fwdQuantizeInst(const glow::QuantizeInst *I) {
+  if (I->getDest()->getElementType() == ElemKind::Int16QTy) {
+    return fwdQuantizeInst_Impl<int16_t>(I);
   }
+  fwdQuantizeInst_Impl<int8_t>(I);
 }
+
 /// Dequantize integer tensor. Scale and Offset are based
 /// on the source tensor type.
-void InterpreterFunction::fwdDequantizeInst(const glow::DequantizeInst *I) {
+template <typename ElemTy>
+void BoundInterpreterFunction::fwdDequantizeInst_Impl(
+    const glow::DequantizeInst *I) {
   auto *srcTensor = getTensor(I->getSrc());
   auto destHandle = getWeightHandle(I->getDest());
 
   TensorQuantizationParams params{srcTensor->getType().getScale(),
                                   srcTensor->getType().getOffset()};
 
-  auto srcHandle = srcTensor->getHandle<int8_t>();
+  auto srcHandle = srcTensor->getHandle<ElemTy>();
   for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
     destHandle.raw(i) = quantization::dequantize(srcHandle.raw(i), params);
   }
 }
 
-void InterpreterFunction::fwdRescaleQuantizedInst(
+void BoundInterpreterFunction::fwdDequantizeInst(
+    const glow::DequantizeInst *I) {
+  if (I->getSrc()->getElementType() == ElemKind::Int16QTy) {
+    return fwdDequantizeInst_Impl<int16_t>(I);
+  }
+  fwdDequantizeInst_Impl<int8_t>(I);
+}
+
+template <typename SrcTy, typename DestTy>
+void BoundInterpreterFunction::fwdRescaleQuantizedInst_Impl(
     const glow::RescaleQuantizedInst *I) {
   auto src = I->getSrc();
   auto dest = I->getDest();
@@ -1671,16 +2714,35 @@ void InterpreterFunction::fwdRescaleQuantizedInst(
   TensorQuantizationParams srcQ{srcTy->getScale(), srcTy->getOffset()};
   TensorQuantizationParams destQ{destTy->getScale(), destTy->getOffset()};
 
-  auto srcH = getWeightHandle<int8_t>(src);
-  auto destH = getWeightHandle<int8_t>(dest);
+  auto srcH = getWeightHandle<SrcTy>(src);
+  auto destH = getWeightHandle<DestTy>(dest);
 
   for (size_t i = 0, e = destH.size(); i < e; ++i) {
     float val = quantization::dequantize(srcH.raw(i), srcQ);
-    destH.raw(i) = quantization::quantize(val, destQ);
+    destH.raw(i) = quantization::quantize<DestTy>(val, destQ);
+  }
+}
+
+void BoundInterpreterFunction::fwdRescaleQuantizedInst(
+    const glow::RescaleQuantizedInst *I) {
+  // The rescale also converts between the 8-bit and the 16-bit precision at
+  // the boundaries of mixed-precision graphs.
+  bool srcI16 = I->getSrc()->getElementType() == ElemKind::Int16QTy;
+  bool destI16 = I->getDest()->getElementType() == ElemKind::Int16QTy;
+  if (srcI16 && destI16) {
+    return fwdRescaleQuantizedInst_Impl<int16_t, int16_t>(I);
+  }
+  if (srcI16) {
+    return fwdRescaleQuantizedInst_Impl<int16_t, int8_t>(I);
+  }
+  if (destI16) {
+    return fwdRescaleQuantizedInst_Impl<int8_t, int16_t>(I);
   }
+  fwdRescaleQuantizedInst_Impl<int8_t, int8_t>(I);
 }
 
-void InterpreterFunction::fwdIntLookupTableInst(const IntLookupTableInst *I) {
+void BoundInterpreterFunction::fwdIntLookupTableInst(
+    const IntLookupTableInst *I) {
   auto srcH = getWeightHandle<int8_t>(I->getSrc());
   auto destH = getWeightHandle<int8_t>(I->getDest());
   auto mappingH = getWeightHandle<int8_t>(I->getMapping());
@@ -24,14 +24,30 @@
 #include "glow/IR/Instrs.h"
 #include "glow/Quantization/Base/Base.h"
 #include "glow/Support/Debug.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/Trace.h"
 
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <thread>
+
 using namespace glow;
 using llvm::format;
 
@@ -61,12 +77,230 @@ static llvm::cl::opt<bool> doProfile("opencl-profile",
                                      llvm::cl::desc("Profile OpenCL kernels"),
                                      llvm::cl::init(false),
                                      llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<bool> outOfOrderQueue(
+    "opencl-out-of-order-queue",
+    llvm::cl::desc("Let the OpenCL device reorder the commands that do not "
+                   "depend on each other"),
+    llvm::cl::init(false), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<std::string> programCacheDir(
+    "opencl-program-cache-dir",
+    llvm::cl::desc("Directory of the persistent cache of the OpenCL program "
+                   "binaries (the cache is disabled if empty)"),
+    llvm::cl::init(""), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<bool> autotune(
+    "opencl-autotune",
+    llvm::cl::desc("Benchmark the workgroup and tile sizes of the convolution "
+                   "and matrix multiplication kernels for the shapes that "
+                   "have not been tuned yet"),
+    llvm::cl::init(false), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> autotuneRuns(
+    "opencl-autotune-runs",
+    llvm::cl::desc("Number of timed runs of every candidate of the autotuner"),
+    llvm::cl::init(5), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<std::string> tuningFile(
+    "opencl-tuning-file",
+    llvm::cl::desc("File holding the tuned kernel parameters, which is read "
+                   "on first use and updated by -opencl-autotune"),
+    llvm::cl::init(""), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<bool> zeroCopy(
+    "opencl-zero-copy",
+    llvm::cl::desc("On devices that share memory with the host, allocate the "
+                   "device buffer in host memory and map it instead of "
+                   "copying the tensors to and from the device. The tensors "
+                   "of OpenCLFunction::getMappedTensor are used in place"),
+    llvm::cl::init(false), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<bool> fuseDataParallel(
+    "opencl-fuse-data-parallel",
+    llvm::cl::desc("Run every sequence of adjacent element-wise instructions "
+                   "as a single generated kernel"),
+    llvm::cl::init(true), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> deviceMemoryLimit(
+    "opencl-device-memory-limit",
+    llvm::cl::desc("Limit the device memory used by the OpenCL functions to "
+                   "this many MiB, streaming the constant weights that do not "
+                   "fit (0 for the largest buffer the device can allocate)"),
+    llvm::cl::init(0), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> prefetchDistance(
+    "opencl-prefetch-distance",
+    llvm::cl::desc("Number of instructions ahead of their use at which the "
+                   "streamed weights are uploaded"),
+    llvm::cl::init(4), llvm::cl::cat(OpenCLBackendCat));
+static llvm::cl::opt<unsigned> numStagingBuffers(
+    "opencl-staging-buffers",
+    llvm::cl::desc("Number of pinned host buffers per function through which "
+                   "the runs transfer the mutable weights, so that the host "
+                   "copies and the uploads of a run overlap with the device "
+                   "work of another (0 transfers the tensors directly)"),
+    llvm::cl::init(2), llvm::cl::cat(OpenCLBackendCat));
+
+/// \returns true if the commands are profiled, to print the profile or to add
+/// them to the trace.
+static bool shouldProfile() { return doProfile || isTracingEnabled(); }
+
+/// The kernel parameters found by the autotuner, keyed by the device, the
+/// kernel and the shape they were tuned for. The table is shared by all the
+/// functions of the process and mirrored in -opencl-tuning-file.
+class TuningTable {
+  /// The parameters of every key.
+  llvm::StringMap<std::vector<size_t>> entries_;
+  /// Set once the tuning file has been read.
+  bool loaded_{false};
+  /// Protects the fields above.
+  std::mutex mutex_;
+
+  /// Read the entries of the tuning file, if any. Every line of the file holds
+  /// a key followed by its parameters, separated by spaces.
+  void load() {
+    loaded_ = true;
+    if (tuningFile.empty()) {
+      return;
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(tuningFile);
+    if (!buffer) {
+      return;
+    }
+    llvm::SmallVector<llvm::StringRef, 16> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+    for (auto line : lines) {
+      llvm::SmallVector<llvm::StringRef, 8> fields;
+      line.split(fields, ' ', -1, false);
+      if (fields.size() < 2) {
+        continue;
+      }
+      std::vector<size_t> params;
+      for (auto field : llvm::makeArrayRef(fields).drop_front()) {
+        size_t param;
+        if (field.getAsInteger(10, param)) {
+          params.clear();
+          break;
+        }
+        params.push_back(param);
+      }
+      if (!params.empty()) {
+        entries_[fields[0]] = params;
+      }
+    }
+  }
+
+  /// Write all entries to the tuning file. Failing to update the file is not
+  /// fatal, the shapes just get tuned again next time.
+  void store() {
+    if (tuningFile.empty()) {
+      return;
+    }
+    int fd;
+    llvm::SmallString<256> tmpPath;
+    if (llvm::sys::fs::createUniqueFile(tuningFile + "-%%%%%%.tmp", fd,
+                                        tmpPath)) {
+      return;
+    }
+    {
+      llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+      for (auto &entry : entries_) {
+        os << entry.getKey();
+        for (auto param : entry.getValue()) {
+          os << ' ' << param;
+        }
+        os << '\n';
+      }
+    }
+    if (llvm::sys::fs::rename(tmpPath, tuningFile)) {
+      llvm::sys::fs::remove(tmpPath);
+    }
+  }
+
+public:
+  static TuningTable &get() {
+    static TuningTable table;
+    return table;
+  }
+
+  /// Fill \p params with the parameters of \p key. \returns false if \p key
+  /// has not been tuned.
+  bool lookup(llvm::StringRef key, std::vector<size_t> &params) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!loaded_) {
+      load();
+    }
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return false;
+    }
+    params = it->getValue();
+    return true;
+  }
+
+  /// Record the parameters \p params of \p key in the table and the file.
+  void insert(llvm::StringRef key, llvm::ArrayRef<size_t> params) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[key] = params;
+    store();
+  }
+};
 } // namespace
 
+/// \returns the devices of the OpenCL platform selected by -platform.
+static std::vector<cl_device_id> getPlatformDevices() {
+  cl_uint numPlatforms{0};
+  cl_int err = clGetPlatformIDs(0, NULL, &numPlatforms);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetPlatformIDs Failed.");
+  GLOW_ASSERT(numPlatforms > platformId &&
+              "Should have at least one platform for running OpenCL");
+  std::vector<cl_platform_id> platform_ids(numPlatforms);
+  err = clGetPlatformIDs(numPlatforms, platform_ids.data(), NULL);
+  cl_platform_id platform_id_used = platform_ids[platformId];
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetPlatformIDs Failed.");
+
+  cl_uint num{0};
+  err = clGetDeviceIDs(platform_id_used, CL_DEVICE_TYPE_ALL, 0, nullptr, &num);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceIDs Failed.");
+  std::vector<cl_device_id> devices(num);
+  err = clGetDeviceIDs(platform_id_used, CL_DEVICE_TYPE_ALL, num,
+                       devices.data(), nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceIDs Failed.");
+  return devices;
+}
+
 namespace glow {
 Backend *createOCLBackend() { return new OCLBackend(); }
+Backend *createOCLBackend(unsigned deviceIdx) {
+  return new OCLBackend(deviceIdx);
+}
+unsigned getNumOCLDevices() { return getPlatformDevices().size(); }
 } // namespace glow
 
+/// \returns the string property \p param of the device \p dev.
+static std::string getDeviceInfoString(cl_device_id dev,
+                                       cl_device_info param) {
+  size_t size;
+  cl_int err = clGetDeviceInfo(dev, param, 0, nullptr, &size);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceInfo Failed.");
+  std::string value(size, '\0');
+  err = clGetDeviceInfo(dev, param, size, &value[0], nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceInfo Failed.");
+  return value;
+}
+
+/// \returns true if the device \p deviceIdx of the selected platform has the
+/// extension \p extension.
+static bool deviceHasExtension(unsigned deviceIdx, llvm::StringRef extension) {
+  auto devices = getPlatformDevices();
+  GLOW_ASSERT(devices.size() > deviceIdx && "Invalid OpenCL device index");
+  // The list is separated by spaces, and ends with a null character.
+  std::string list =
+      getDeviceInfoString(devices[deviceIdx], CL_DEVICE_EXTENSIONS);
+  llvm::SmallVector<llvm::StringRef, 32> extensions;
+  llvm::StringRef(list.c_str()).split(extensions, ' ', -1, false);
+  return std::find(extensions.begin(), extensions.end(), extension) !=
+         extensions.end();
+}
+
+OCLBackend::OCLBackend() : OCLBackend(deviceId) {}
+
+OCLBackend::OCLBackend(unsigned deviceIdx)
+    : deviceIdx_(deviceIdx),
+      hasFP16_(deviceHasExtension(deviceIdx, "cl_khr_fp16")) {}
+
 static void dumpCompileLog(cl_device_id dev, cl_program prog) {
 #ifndef NDEBUG
   // Determine the size of the log.
@@ -85,6 +319,97 @@ static void dumpCompileLog(cl_device_id dev, cl_program prog) {
 #endif
 }
 
+/// Add the device \p dev and the version of its driver to \p hash.
+static void hashDevice(llvm::MD5 &hash, cl_device_id dev) {
+  for (auto param : {CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DEVICE_VERSION,
+                     CL_DRIVER_VERSION}) {
+    hash.update(getDeviceInfoString(dev, param));
+  }
+}
+
+/// \returns the path of the binary of the program built from \p source with
+/// \p options for the device \p dev in the persistent program cache. The
+/// name of the file is a hash of everything the binary depends on: the
+/// source, the options, the device and the version of its driver.
+static std::string getProgramCachePath(const std::string &source,
+                                       const std::string &options,
+                                       cl_device_id dev) {
+  llvm::MD5 hash;
+  hash.update(source);
+  hash.update(options);
+  hashDevice(hash, dev);
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> key;
+  llvm::MD5::stringifyResult(result, key);
+  llvm::SmallString<256> path(programCacheDir);
+  llvm::sys::path::append(path, key + ".clbin");
+  return path.str();
+}
+
+/// Create a program for the device \p dev in the context \p ctx from the
+/// binary stored at \p path, and build it with \p options. \returns null if
+/// there is no such binary or if the device rejects it.
+static cl_program loadCachedProgram(const std::string &path, cl_context ctx,
+                                    cl_device_id dev,
+                                    const std::string &options) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    return nullptr;
+  }
+  size_t size = (*buffer)->getBufferSize();
+  auto *binary =
+      reinterpret_cast<const unsigned char *>((*buffer)->getBufferStart());
+  cl_int binaryStatus;
+  cl_int err;
+  cl_program program = clCreateProgramWithBinary(ctx, 1, &dev, &size, &binary,
+                                                 &binaryStatus, &err);
+  if (!program) {
+    return nullptr;
+  }
+  if (err != CL_SUCCESS || binaryStatus != CL_SUCCESS ||
+      clBuildProgram(program, 0, nullptr, options.c_str(), nullptr,
+                     nullptr) != CL_SUCCESS) {
+    clReleaseProgram(program);
+    return nullptr;
+  }
+  return program;
+}
+
+/// Store the binary of the built \p program at \p path. Failing to update
+/// the cache is not fatal, the program just gets built again next time.
+static void storeCachedProgram(const std::string &path, cl_program program) {
+  size_t size;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size,
+                       nullptr) != CL_SUCCESS ||
+      !size) {
+    return;
+  }
+  std::vector<unsigned char> binary(size);
+  unsigned char *binaryPtr = binary.data();
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaryPtr),
+                       &binaryPtr, nullptr) != CL_SUCCESS) {
+    return;
+  }
+  if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path))) {
+    return;
+  }
+  // Write to a temporary file first, so that concurrent processes never see a
+  // partially written binary.
+  int fd;
+  llvm::SmallString<256> tmpPath;
+  if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%.tmp", fd, tmpPath)) {
+    return;
+  }
+  {
+    llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+    os.write(reinterpret_cast<const char *>(binary.data()), binary.size());
+  }
+  if (llvm::sys::fs::rename(tmpPath, path)) {
+    llvm::sys::fs::remove(tmpPath);
+  }
+}
+
 /// Add an macro definition with an integer value to the set of options.
 template <typename T>
 static void addIntOption(std::vector<std::string> &options,
@@ -98,36 +423,208 @@ static void addStringOption(std::vector<std::string> &options,
   options.push_back("-D" + name + "=" + value);
 }
 
-OpenCLFunction::OpenCLFunction(std::unique_ptr<IRFunction> F,
-                               const Context &ctx)
-    : F_(std::move(F)) {
-  cl_uint numPlatforms{0};
-  cl_int err = clGetPlatformIDs(0, NULL, &numPlatforms);
-  GLOW_ASSERT(err == CL_SUCCESS && "clGetPlatformIDs Failed.");
-  GLOW_ASSERT(numPlatforms > platformId &&
-              "Should have at least one platform for running OpenCL");
-  std::vector<cl_platform_id> platform_ids(numPlatforms);
-  err = clGetPlatformIDs(numPlatforms, platform_ids.data(), NULL);
-  cl_platform_id platform_id_used = platform_ids[platformId];
-  GLOW_ASSERT(err == CL_SUCCESS && "clGetPlatformIDs Failed.");
+namespace {
+/// The memories of the modules, see OpenCLDeviceMemory::get(). The memories
+/// are owned by the functions that use them.
+struct DeviceMemoryRegistry {
+  using Key = std::pair<cl_device_id, const Module *>;
+  std::mutex mutex;
+  std::map<Key, std::weak_ptr<OpenCLDeviceMemory>> memories;
+
+  static DeviceMemoryRegistry &get() {
+    static DeviceMemoryRegistry registry;
+    return registry;
+  }
+};
+} // namespace
 
-  cl_uint num{0};
-  err = clGetDeviceIDs(platform_id_used, CL_DEVICE_TYPE_ALL, 0, nullptr, &num);
-  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceIDs Failed.");
-  GLOW_ASSERT(num > deviceId &&
-              "Should have at least one GPU/CPU/FPGA for running OpenCL");
-  std::vector<cl_device_id> devices(num);
-  err = clGetDeviceIDs(platform_id_used, CL_DEVICE_TYPE_ALL, num,
-                       devices.data(), nullptr);
-  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceIDs Failed.");
-  deviceId_ = devices[deviceId];
+OpenCLDeviceMemory::OpenCLDeviceMemory(cl_device_id deviceId,
+                                       const Module *M)
+    : deviceId_(deviceId), module_(M) {
   context_ = clCreateContext(nullptr, 1, &deviceId_, nullptr, nullptr, nullptr);
   GLOW_ASSERT(context_ && "clCreateContext Failed.");
-  commands_ = clCreateCommandQueue(
-      context_, deviceId_, (doProfile) ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+  // The kernels address the buffer with 32-bit offsets.
+  cl_ulong maxAllocSize = 0;
+  cl_int err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                               sizeof(maxAllocSize), &maxAllocSize, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceInfo Failed.");
+  limit_ = std::min<uint64_t>(maxAllocSize, allocator_.getMemorySize());
+  if (deviceMemoryLimit) {
+    limit_ = std::min<uint64_t>(limit_, uint64_t(deviceMemoryLimit) << 20);
+  }
+  if (!zeroCopy) {
+    return;
+  }
+  cl_bool unifiedMemory = CL_FALSE;
+  err = clGetDeviceInfo(deviceId_, CL_DEVICE_HOST_UNIFIED_MEMORY,
+                               sizeof(unifiedMemory), &unifiedMemory, nullptr);
+  if (err != CL_SUCCESS || !unifiedMemory) {
+    return;
+  }
+  // The drivers only use the host memory in place if it is aligned to a page
+  // and to the base address alignment of the device, which is in bits.
+  cl_uint alignBits = 0;
+  err = clGetDeviceInfo(deviceId_, CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+                        sizeof(alignBits), &alignBits, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "clGetDeviceInfo Failed.");
+  hostAlignment_ = std::max<size_t>(4096, alignBits / 8);
+}
+
+OpenCLDeviceMemory::~OpenCLDeviceMemory() {
+  assert(weights_.empty() && "A function still uses a weight");
+  {
+    // A new memory may already be registered for the module, if get() was
+    // called after the last reference to this one was dropped.
+    auto &registry = DeviceMemoryRegistry::get();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.memories.find({deviceId_, module_});
+    if (it != registry.memories.end() && it->second.expired()) {
+      registry.memories.erase(it);
+    }
+  }
+  if (buffer_) {
+    clReleaseMemObject(buffer_);
+  }
+  if (hostMemory_) {
+    alignedFree(hostMemory_);
+  }
+  clReleaseContext(context_);
+}
+
+std::shared_ptr<OpenCLDeviceMemory>
+OpenCLDeviceMemory::get(cl_device_id deviceId, const Module *M) {
+  auto &registry = DeviceMemoryRegistry::get();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto &entry = registry.memories[{deviceId, M}];
+  auto memory = entry.lock();
+  if (!memory) {
+    memory = std::make_shared<OpenCLDeviceMemory>(deviceId, M);
+    entry = memory;
+  }
+  return memory;
+}
+
+void OpenCLDeviceMemory::reserve(uint64_t size, cl_command_queue queue) {
+  if (size <= bufferSize_) {
+    return;
+  }
+  // Grow geometrically, so that compiling many functions does not copy the
+  // buffer every time.
+  const uint64_t alignment = 128;
+  uint64_t newSize = alignedSize(std::max(size, 2 * bufferSize_), alignment);
+  newSize = std::min(newSize, std::max(size, limit_));
+  void *hostMemory = nullptr;
+  cl_mem buf;
+  if (usesHostMemory()) {
+    hostMemory = alignedAlloc(newSize, hostAlignment_);
+    buf = clCreateBuffer(context_, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,
+                         newSize, hostMemory, nullptr);
+  } else {
+    buf = clCreateBuffer(context_, CL_MEM_READ_WRITE, newSize, nullptr,
+                         nullptr);
+  }
+  GLOW_ASSERT(buf && "Allocation failed!");
+  if (buffer_) {
+    // The functions address the memory relative to the beginning of the
+    // buffer, so the contents keep their addresses.
+    cl_int err = clEnqueueCopyBuffer(queue, buffer_, buf, 0, 0, bufferSize_, 0,
+                                     nullptr, nullptr);
+    GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueCopyBuffer.");
+    clFinish(queue);
+    clReleaseMemObject(buffer_);
+  }
+  if (hostMemory_) {
+    alignedFree(hostMemory_);
+  }
+  buffer_ = buf;
+  bufferSize_ = newSize;
+  hostMemory_ = hostMemory;
+}
+
+uint64_t OpenCLDeviceMemory::allocateRegion(uint64_t size, const void *owner,
+                                            cl_command_queue queue) {
+  // Empty regions get a byte, so that the owners keep distinct addresses.
+  size = std::max<uint64_t>(size, 1);
+  uint64_t address = allocator_.allocate(size, owner);
+  GLOW_ASSERT(address != MemoryAllocator::npos && address + size <= limit_ &&
+              "Not enough device memory");
+  reserve(address + size, queue);
+  return address;
+}
+
+void OpenCLDeviceMemory::freeRegion(const void *owner) {
+  allocator_.deallocate(owner);
+}
+
+uint64_t OpenCLDeviceMemory::getAvailableSize() const {
+  // The high water mark does not shrink when regions are freed. The holes
+  // left by them are not counted.
+  uint64_t top = allocator_.getMaxMemoryUsage();
+  return top < limit_ ? limit_ - top : 0;
+}
+
+OpenCLDeviceMemory::CachedWeight *
+OpenCLDeviceMemory::findWeight(const Tensor *T, size_t hash) {
+  auto range = weights_.equal_range(T);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.hash == hash) {
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
+OpenCLDeviceMemory::CachedWeight *
+OpenCLDeviceMemory::retainWeight(const Tensor *T, size_t hash,
+                                 cl_command_queue queue, bool &isNew) {
+  auto *W = findWeight(T, hash);
+  isNew = !W;
+  if (isNew) {
+    // The entries own the regions of the weights, since a payload may have
+    // several of them.
+    W = &weights_.insert({T, CachedWeight{hash, 0, 0}})->second;
+    W->address = allocateRegion(T->getType().getSizeInBytes(), W, queue);
+  }
+  W->refCount++;
+  return W;
+}
+
+void OpenCLDeviceMemory::releaseWeight(CachedWeight *W) {
+  if (--W->refCount) {
+    return;
+  }
+  freeRegion(W);
+  for (auto it = weights_.begin(), e = weights_.end(); it != e; ++it) {
+    if (&it->second == W) {
+      weights_.erase(it);
+      return;
+    }
+  }
+  llvm_unreachable("Unknown weight");
+}
+
+OpenCLFunction::OpenCLFunction(std::unique_ptr<IRFunction> F,
+                               const Context &ctx, unsigned deviceIdx)
+    : F_(std::move(F)) {
+  static std::atomic<uint64_t> numQueues{0};
+  traceQueue_ = numQueues++;
+  auto devices = getPlatformDevices();
+  GLOW_ASSERT(devices.size() > deviceIdx &&
+              "Should have at least one GPU/CPU/FPGA for running OpenCL");
+  deviceId_ = devices[deviceIdx];
+  memory_ = OpenCLDeviceMemory::get(deviceId_, F_->getGraph()->getParent());
+  context_ = memory_->getContext();
+  cl_command_queue_properties properties = 0;
+  if (shouldProfile()) {
+    properties |= CL_QUEUE_PROFILING_ENABLE;
+  }
+  if (outOfOrderQueue) {
+    properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+  }
+  cl_int err;
+  commands_ = clCreateCommandQueue(context_, deviceId_, properties, &err);
   GLOW_ASSERT(commands_ && "clCreateCommandQueue Failed.");
 
-  err = CL_SUCCESS;
   std::vector<std::string> options;
   // Configure the kernels by providing the size of size_t on the host size.
   // This is required to e.g. properly pass struct parameters of types like
@@ -135,21 +632,75 @@ OpenCLFunction::OpenCLFunction(std::unique_ptr<IRFunction> F,
   // use size_t for their members and they should be defined on the OpenCL's
   // side using integer types of the same width.
   addIntOption(options, "SIZEOF_HOST_SIZE_T", sizeof(size_t));
-  // Create the program from the source.
-  createProgram(SHADER_CODE, options, commands_);
+  // Build the program from the source on a helper thread, while this thread
+  // allocates the memory and starts the uploads of the weights. Nothing else
+  // touches the cache of programs until the build is joined, and the phase
+  // is added to the report here, which is not shared with other threads.
+  double buildSeconds = 0;
+  std::thread builder([&]() {
+    ScopedTraceEvent trace("OpenCL program build", "compile");
+    auto begin = std::chrono::steady_clock::now();
+    createProgram(SHADER_CODE, options, commands_);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    buildSeconds = elapsed.count();
+  });
+  if (autotune || !tuningFile.empty()) {
+    llvm::MD5 hash;
+    hashDevice(hash, deviceId_);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    tuningDeviceKey_ = key.str();
+  }
+  std::lock_guard<std::shared_timed_mutex> lock(memory_->mutex_);
   allocateMemory(ctx);
+  builder.join();
+  if (auto *report = getCurrentCompileReport()) {
+    report->addPhase({"OpenCL program build", buildSeconds, "", 0, 0});
+  }
+  // The kernels of the launch plan are built while the weights are uploaded.
+  buildLaunchPlan();
+  clFinish(commands_);
 }
 
 OpenCLFunction::~OpenCLFunction() {
+  clFinish(commands_);
+  releaseCommands();
+  for (auto &command : launchPlan_) {
+    if (command.kernel) {
+      clReleaseKernel(command.kernel);
+    }
+  }
   for (auto &kv : programsCache_) {
     auto prog = kv.second;
     clReleaseProgram(prog);
   }
+  for (auto &staging : stagingBuffers_) {
+    clEnqueueUnmapMemObject(transferQueue_, staging.buffer, staging.host, 0,
+                            nullptr, nullptr);
+  }
+  if (transferQueue_) {
+    clFinish(transferQueue_);
+  }
+  for (auto &staging : stagingBuffers_) {
+    clReleaseMemObject(staging.buffer);
+    clReleaseMemObject(staging.device);
+  }
   clReleaseCommandQueue(commands_);
-  clReleaseContext(context_);
-  if (deviceBuffer_) {
-    freeDeviceBuffer(deviceBuffer_);
-    deviceBuffer_ = nullptr;
+  if (copyQueue_) {
+    clReleaseCommandQueue(copyQueue_);
+  }
+  if (transferQueue_) {
+    clReleaseCommandQueue(transferQueue_);
+  }
+  {
+    std::lock_guard<std::shared_timed_mutex> lock(memory_->mutex_);
+    memory_->freeRegion(this);
+    for (auto &kv : cachedWeights_) {
+      memory_->releaseWeight(kv.second);
+    }
   }
   externalTensors_.clear();
 }
@@ -159,6 +710,8 @@ static std::string getKernelName(const char *baseName, ElemKind elemTy) {
   switch (elemTy) {
   case ElemKind::FloatTy:
     return name + "W";
+  case ElemKind::Float16Ty:
+    return name + "_f16W";
   case ElemKind::Int8QTy:
     return name + "_i8W";
   case ElemKind::Int32QTy:
@@ -171,6 +724,102 @@ static std::string getKernelName(const char *baseName, ElemKind elemTy) {
   return "";
 }
 
+/// \returns the OpenCL expression that computes the element of the
+/// destination of the element-wise instruction \p I from the registers
+/// \p ops of its operands, in which vtype is the type of the registers, or
+/// an empty string if \p I cannot be fused.
+static std::string getFusedExpression(const Instruction &I,
+                                      llvm::ArrayRef<std::string> ops) {
+  switch (I.getKind()) {
+  case Kinded::Kind::ElementAddInstKind:
+    return ops[1] + " + " + ops[2];
+  case Kinded::Kind::ElementSubInstKind:
+    return ops[1] + " - " + ops[2];
+  case Kinded::Kind::ElementMulInstKind:
+    return ops[1] + " * " + ops[2];
+  case Kinded::Kind::ElementDivInstKind:
+    return ops[1] + " / " + ops[2];
+  case Kinded::Kind::ElementMaxInstKind:
+    return "max(" + ops[1] + ", " + ops[2] + ")";
+  case Kinded::Kind::ElementMinInstKind:
+    return "min(" + ops[1] + ", " + ops[2] + ")";
+  case Kinded::Kind::ElementPowInstKind:
+    return "pow(" + ops[1] + ", " + ops[2] + ")";
+  case Kinded::Kind::ElementCmpLTEInstKind:
+    return "select((vtype)0, (vtype)1, islessequal(" + ops[1] + ", " + ops[2] +
+           "))";
+  case Kinded::Kind::ElementCmpEQInstKind:
+    return "select((vtype)0, (vtype)1, isequal(" + ops[1] + ", " + ops[2] +
+           "))";
+  case Kinded::Kind::ElementSelectInstKind:
+    return "select(" + ops[3] + ", " + ops[2] + ", isnotequal(" + ops[1] +
+           ", (vtype)0))";
+  case Kinded::Kind::ElementLogInstKind:
+    return "log(" + ops[1] + ")";
+  case Kinded::Kind::TanhInstKind:
+    return "1 - 2 / (exp(" + ops[1] + " * 2) + 1)";
+  case Kinded::Kind::SigmoidInstKind:
+    return "1 / (1 + exp(-" + ops[1] + "))";
+  case Kinded::Kind::SplatInstKind: {
+    // The bits of the value make the literal exact.
+    float value = cast<SplatInst>(&I)->getValue();
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return "(vtype)as_float(" + std::to_string(bits) + "u)";
+  }
+  default:
+    return "";
+  }
+}
+
+/// \returns true if \p I is an element-wise instruction on floats that can
+/// be part of a generated kernel.
+static bool isFusable(const Instruction &I) {
+  if (!I.isDataParallel() || isa<CopyInst>(I)) {
+    return false;
+  }
+  for (const auto &op : I.getOperands()) {
+    if (op.first->getElementType() != ElemKind::FloatTy) {
+      return false;
+    }
+  }
+  llvm::SmallVector<std::string, 4> ops(I.getNumOperands(), "x");
+  return !getFusedExpression(I, ops).empty();
+}
+
+/// \returns true if the value \p v, which is written by the bundle whose
+/// last instruction is \p last in \p F, is an activation that is deallocated
+/// before any later instruction reads it.
+static bool isDeadAfter(const IRFunction &F, const Value *v,
+                        const Instruction *last) {
+  auto *alloc = dyn_cast<AllocActivationInst>(v);
+  if (!alloc) {
+    return false;
+  }
+  // The views of the activation are read through other values.
+  for (const auto &I : F.getInstrs()) {
+    auto *TV = dyn_cast<TensorViewInst>(&I);
+    if (TV && TV->getSrc() == alloc) {
+      return false;
+    }
+  }
+  auto end = F.getInstrs().end();
+  for (auto it = std::next(last->getIterator()); it != end; ++it) {
+    if (auto *DA = dyn_cast<DeallocActivationInst>(&*it)) {
+      if (DA->getSrc() == alloc) {
+        return true;
+      }
+      continue;
+    }
+    for (const auto &op : it->getOperands()) {
+      if (op.first == alloc) {
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
 cl_kernel OpenCLFunction::createKernel(const std::string &name,
                                        cl_program program) {
   cl_int err = CL_SUCCESS;
@@ -218,6 +867,15 @@ OpenCLFunction::createProgram(const std::string &source,
   if (program) {
     return program;
   }
+  // Look up the binary in the persistent cache.
+  std::string cachePath;
+  if (!programCacheDir.empty()) {
+    cachePath = getProgramCachePath(source, combinedOptions, deviceId);
+    program = loadCachedProgram(cachePath, context_, deviceId, combinedOptions);
+    if (program) {
+      return program;
+    }
+  }
   // Create a new compiled program.
   program = clCreateProgramWithSource(context_, 1, &src, nullptr, &err);
   GLOW_ASSERT(program && "clCreateProgramWithSource Failed.");
@@ -227,6 +885,9 @@ OpenCLFunction::createProgram(const std::string &source,
     dumpCompileLog(deviceId, program);
   }
   GLOW_ASSERT(err == CL_SUCCESS && "clBuildProgram Failed.");
+  if (!cachePath.empty()) {
+    storeCachedProgram(cachePath, program);
+  }
   // Add this program to the program cache.
   return program;
 }
@@ -267,13 +928,51 @@ setKernelArgsForBuffers(cl_kernel kernel, const Instruction &I,
   return kernelArgIdx - 1;
 }
 
+/// The number of work items of the vectorized data-parallel kernels is padded
+/// to a multiple of this, so that a number of elements with few divisors does
+/// not make their workgroups small.
+static constexpr size_t dataParallelWorkItemsMultiple = 64;
+
+/// \returns the number of elements that every work item of the data-parallel
+/// kernel on \p size elements computes: 16 or 8 when they divide \p size,
+/// otherwise the largest of them not larger than \p size, in which case the
+/// last work item computes the remainder, or 1 when \p size is smaller than
+/// a vector. Only the 16-wide kernel is used when \p has8 is false.
+static size_t getDataParallelWidth(size_t size, bool has8) {
+  if (size && size % 16 == 0) {
+    return 16;
+  }
+  if (has8 && size && size % 8 == 0) {
+    return 8;
+  }
+  if (size >= 16) {
+    return 16;
+  }
+  return has8 && size >= 8 ? 8 : 1;
+}
+
+/// \returns the number of work items of the data-parallel kernel on \p size
+/// elements, every work item computing \p width of them.
+static size_t getDataParallelWorkItems(size_t size, size_t width) {
+  size_t workItems = (size + width - 1) / width;
+  if (width == 1 || workItems <= dataParallelWorkItemsMultiple) {
+    return workItems;
+  }
+  return alignedSize(workItems, dataParallelWorkItemsMultiple);
+}
+
 void OpenCLFunction::fillBuffer(cl_mem buffer, uint64_t start, uint64_t len,
                                 float value, ElemKind elemKind) {
-  auto kernel = createKernel(getKernelName("splat", elemKind));
+  size_t width = getDataParallelWidth(len, true);
+  std::string name = getKernelName("splat", elemKind);
+  auto kernel = createKernel(width > 1 ? name + std::to_string(width) : name);
   setKernelArg(kernel, 0, buffer);
   setKernelArg<cl_uint>(kernel, 1, start);
   setKernelArg(kernel, 2, value);
-  enqueueKernel(commands_, kernel, deviceId_, {(size_t)len}, kernelLaunches_);
+  if (width > 1) {
+    setKernelArg<cl_uint>(kernel, 3, len);
+  }
+  planKernel(kernel, {getDataParallelWorkItems(len, width)});
 }
 
 /// \returns the max local workgroup size for each dimension, under the
@@ -318,46 +1017,137 @@ void getMaxLocalWorkgroupSize(cl_kernel kernel, cl_device_id device,
   }
 }
 
-void OpenCLFunction::enqueueKernel(cl_command_queue commands, cl_kernel kernel,
-                                   cl_device_id device,
-                                   llvm::ArrayRef<size_t> global,
-                                   llvm::ArrayRef<size_t> local,
-                                   std::vector<KernelLaunch> &kernelLaunches) {
+void OpenCLFunction::planKernel(cl_kernel kernel, llvm::ArrayRef<size_t> global,
+                                llvm::ArrayRef<size_t> local) {
   char kernelName[128];
   size_t retSize;
   cl_int err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME,
                                sizeof(kernelName), &kernelName, &retSize);
   GLOW_ASSERT(err == CL_SUCCESS && "Error in clGetKernelInfo.");
+  PlannedCommand command;
+  command.step = planStep_;
+  command.kernel = kernel;
+  command.name = kernelName;
+  command.global.assign(global.begin(), global.end());
+  command.local.assign(local.begin(), local.end());
+  launchPlan_.push_back(std::move(command));
+}
 
-  cl_event event{nullptr};
-  err = clEnqueueNDRangeKernel(commands, kernel, global.size(), nullptr,
-                               &global[0], &local[0], 0, nullptr,
-                               doProfile ? &event : nullptr);
-  GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueNDRangeKernel.");
-  kernelLaunches.push_back(KernelLaunch(kernel, kernelName, event));
-}
-
-/// Enqueue a \p kernel for execution on the command queue \p commands on a
-/// given \p device. The information about the launched kernel will be added to
-/// \p kernelLaunches list.
-void OpenCLFunction::enqueueKernel(cl_command_queue commands, cl_kernel kernel,
-                                   cl_device_id device,
-                                   llvm::ArrayRef<size_t> global,
-                                   std::vector<KernelLaunch> &kernelLaunches) {
+void OpenCLFunction::planKernel(cl_kernel kernel,
+                                llvm::ArrayRef<size_t> global) {
   llvm::SmallVector<size_t, 4> local(global.size(), 0);
-  getMaxLocalWorkgroupSize(kernel, device, global, local);
-  char kernelName[128];
-  size_t retSize;
-  cl_int err = clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME,
-                               sizeof(kernelName), &kernelName, &retSize);
-  GLOW_ASSERT(err == CL_SUCCESS && "Error in clGetKernelInfo.");
+  getMaxLocalWorkgroupSize(kernel, deviceId_, global, local);
+  planKernel(kernel, global, local);
+}
 
+void OpenCLFunction::enqueuePlannedCommand(const PlannedCommand &command) {
   cl_event event{nullptr};
-  err = clEnqueueNDRangeKernel(commands, kernel, global.size(), nullptr,
-                               &global[0], &local[0], 0, nullptr,
-                               doProfile ? &event : nullptr);
-  GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueNDRangeKernel.");
-  kernelLaunches.push_back(KernelLaunch(kernel, kernelName, event));
+  cl_uint numWaitEvents;
+  const cl_event *waitList = getWaitList(numWaitEvents);
+  if (command.kernel) {
+    cl_int err = clEnqueueNDRangeKernel(
+        commands_, command.kernel, command.global.size(), nullptr,
+        command.global.data(), command.local.data(), numWaitEvents, waitList,
+        &event);
+    GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueNDRangeKernel.");
+    addEvent(event);
+    kernelLaunches_.push_back(
+        KernelLaunch(command.kernel, command.name, event));
+    return;
+  }
+
+  if (command.print) {
+    // The value is printed on the host, once the commands that produce it
+    // are finished.
+    clFinish(commands_);
+    auto *V = command.print->getSrc();
+    // Allocate a temporary tensor to hold the value.
+    Tensor T(V->getType());
+    // Load the current value of the variable into host memory.
+    uint64_t address = tensors_[V];
+    tensors_[V] = command.srcOffset;
+    copyValueFromDevice(V, T.getUnsafePtr());
+    clFinish(commands_);
+    tensors_[V] = address;
+    llvm::outs() << command.print->getName() << ": ";
+    // Dump the content of a value.
+    V->dump();
+    llvm::outs() << "\n";
+    dumpImpl(&T);
+    llvm::outs() << "\n";
+    llvm::outs().flush();
+    return;
+  }
+
+  if (command.upload) {
+    // The upload runs on its own queue, so it overlaps with the kernels that
+    // do not use the memory it writes.
+    Tensor *T = externalTensors_[command.upload];
+    cl_int err = clEnqueueWriteBuffer(
+        copyQueue_, deviceBuffer_, /* blocking_write */ CL_FALSE,
+        command.destOffset, command.sizeInBytes, T->getUnsafePtr(),
+        numWaitEvents, waitList, &event);
+    GLOW_ASSERT(err == CL_SUCCESS && "Unable to stream a weight");
+    // The kernels of the other queue may only wait for the upload once it
+    // is submitted.
+    clFlush(copyQueue_);
+    addEvent(event);
+    if (shouldProfile()) {
+      kernelLaunches_.emplace_back(KernelLaunch("streamWeight", event));
+    }
+    return;
+  }
+
+  cl_int err = clEnqueueCopyBuffer(commands_, deviceBuffer_, deviceBuffer_,
+                                   command.srcOffset, command.destOffset,
+                                   command.sizeInBytes, numWaitEvents,
+                                   waitList, &event);
+  GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueCopyBuffer.");
+  addEvent(event);
+  if (shouldProfile()) {
+    kernelLaunches_.emplace_back(KernelLaunch("copy", event));
+  }
+}
+
+/// Add the kernels and the copies of \p kernelLaunches to the trace, on the
+/// thread \p queue of the device timeline. The clock of the device is aligned
+/// with the clock of the trace by assuming that the first command was queued
+/// at \p hostBegin.
+static void traceKernelLaunches(const std::vector<KernelLaunch> &kernelLaunches,
+                                uint64_t hostBegin, uint64_t queue) {
+  if (!isTracingEnabled() || kernelLaunches.empty()) {
+    return;
+  }
+  std::vector<std::pair<cl_ulong, cl_ulong>> intervals;
+  cl_ulong firstQueued = std::numeric_limits<cl_ulong>::max();
+  for (auto &kl : kernelLaunches) {
+    auto &event = kl.event_;
+    clWaitForEvents(1, &event);
+    cl_ulong queued;
+    cl_ulong start;
+    cl_ulong end;
+    // The information is missing if the queue was created before the tracing
+    // was enabled.
+    if (clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED,
+                                sizeof(queued), &queued,
+                                nullptr) != CL_SUCCESS) {
+      return;
+    }
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start),
+                            &start, nullptr);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end,
+                            nullptr);
+    firstQueued = std::min(firstQueued, queued);
+    intervals.emplace_back(start, end);
+  }
+  for (size_t i = 0, e = kernelLaunches.size(); i < e; i++) {
+    llvm::StringRef name = kernelLaunches[i].name_;
+    // The times of the device are in nanoseconds.
+    uint64_t begin = hostBegin + (intervals[i].first - firstQueued) / 1000;
+    uint64_t end = hostBegin + (intervals[i].second - firstQueued) / 1000;
+    addTraceEvent(name, name.startswith("copy") ? "copy" : "kernel", begin,
+                  end, TraceProcess::Device, queue);
+  }
 }
 
 /// Analyze and dump the collected profiling information about the execution of
@@ -409,7 +1199,48 @@ static void dumpProfileInfo(const std::vector<KernelLaunch> &kernelLaunches) {
   }
 }
 
-void OpenCLFunction::executeConvolution(const OCLConvolutionInst *CC) {
+/// \returns the maximum workgroup size of \p kernel on the device \p dev.
+static size_t getKernelWorkGroupSize(cl_kernel kernel, cl_device_id dev) {
+  size_t L;
+  cl_int err = clGetKernelWorkGroupInfo(kernel, dev, CL_KERNEL_WORK_GROUP_SIZE,
+                                        sizeof(L), &L, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "Error in clGetKernelWorkGroupInfo.");
+  return L;
+}
+
+std::string OpenCLFunction::getTuningKey(llvm::StringRef name,
+                                         llvm::ArrayRef<size_t> shape) const {
+  std::string key = tuningDeviceKey_ + ":" + name.str();
+  for (auto dim : shape) {
+    key += ":" + std::to_string(dim);
+  }
+  return key;
+}
+
+double OpenCLFunction::benchmarkKernel(cl_kernel kernel,
+                                       llvm::ArrayRef<size_t> global,
+                                       llvm::ArrayRef<size_t> local) {
+  double best = std::numeric_limits<double>::infinity();
+  // The first run is a warm-up.
+  for (unsigned i = 0; i <= autotuneRuns; i++) {
+    auto start = std::chrono::steady_clock::now();
+    cl_int err =
+        clEnqueueNDRangeKernel(commands_, kernel, global.size(), nullptr,
+                               &global[0], &local[0], 0, nullptr, nullptr);
+    GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueNDRangeKernel.");
+    clFinish(commands_);
+    std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    if (i) {
+      best = std::min(best, time.count());
+    }
+  }
+  return best;
+}
+
+cl_kernel OpenCLFunction::createConvolutionKernel(
+    const OCLConvolutionInst *CC, const ConvolutionConfig &config,
+    std::vector<size_t> &global, std::vector<size_t> &local) {
   auto input = CC->getSrc();
   auto output = CC->getDest();
   auto bias = CC->getBias();
@@ -468,37 +1299,19 @@ void OpenCLFunction::executeConvolution(const OCLConvolutionInst *CC) {
   addStringOption(options, "v_pad_A", "0");
   addStringOption(options, "v_pad_B", "0");
 
-  // Determine the work groups sizes along h and w.
-  size_t WIS[3];
-  cl_int err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_ITEM_SIZES,
-                               sizeof(WIS), &WIS, nullptr);
-  GLOW_ASSERT(err == CL_SUCCESS && "Could not execute clGetDeviceInfo");
-  size_t wg_size[3];
-  for (int id = 0; id < 2; ++id) {
-    size_t defaultVal = 16;
-    // Special case on CPUs devices, where a workgroup size could be 1,
-    // e.g. in case of Apple's OpenCL driver for CPUs.
-    if (WIS[id] < defaultVal || (id == 0 && WIS[1] < defaultVal)) {
-      defaultVal = WIS[1];
-    }
-    addIntOption(options, "workgroup_size_" + std::to_string(id), defaultVal);
-    wg_size[id] = defaultVal;
-  }
+  // The work groups sizes along h and w.
+  addIntOption(options, "workgroup_size_0", config.wgs0);
+  addIntOption(options, "workgroup_size_1", config.wgs1);
   // The tile-size in dimension K.
-  // Should be tunable.
-  addStringOption(options, "TSK", "4");
+  addIntOption(options, "TSK", config.tsk);
   addIntOption(options, "TSK_UNROLL", 1);
-
-  // WPTN and WPTM should be tunable.
-  size_t WPTN = 4;
-  size_t WPTM = 4;
   // The work-per-thread in dimension N.
-  addIntOption(options, "WPTN", WPTN);
+  addIntOption(options, "WPTN", config.wptn);
   // The work-per-thread in dimension M.
-  addIntOption(options, "WPTM", WPTM);
+  addIntOption(options, "WPTM", config.wptm);
 
-  // Vector width in dimensions M and M.
-  // VWN and VWM should be tunable.
+  // Vector width in dimensions M and M. The kernels use vectors of 4
+  // elements.
   addStringOption(options, "VWM", "4");
   addStringOption(options, "VWN", "4");
 
@@ -531,70 +1344,615 @@ void OpenCLFunction::executeConvolution(const OCLConvolutionInst *CC) {
   }
 
   // Compute proper parameters for global work and workgroups.
-  auto fw_wgs0 = wg_size[0];
-  auto fw_wgs1 = wg_size[1];
-  int fw_wptn = WPTN;
-  int fw_wptm = WPTM;
-  int fw_div_N = fw_wptn * fw_wgs0;
-  int fw_div_M = fw_wptm * fw_wgs1;
+  auto fw_wgs0 = config.wgs0;
+  auto fw_wgs1 = config.wgs1;
+  int fw_div_N = config.wptn * fw_wgs0;
+  int fw_div_M = config.wptm * fw_wgs1;
   int N_FW_ = odim.h * odim.w;
   int M_FW_ = odim.c / group;
-  size_t L;
-  clGetKernelWorkGroupInfo(kernel, deviceId_, CL_KERNEL_WORK_GROUP_SIZE,
-                           sizeof(L), &L, nullptr);
-  GLOW_ASSERT(fw_wgs0 * fw_wgs1 <= L && "Bad workgroup size");
 
   // Set the size of a workgroup.
-  std::vector<size_t> local = {fw_wgs0, fw_wgs1, 1};
+  local = {fw_wgs0, fw_wgs1, 1};
 
   // Set the global work size.
-  std::vector<size_t> global = {((N_FW_ - 1) / fw_div_N + 1) * fw_wgs0,
-                                ((M_FW_ - 1) / fw_div_M + 1) * fw_wgs1,
-                                idim.n * group};
+  global = {((N_FW_ - 1) / fw_div_N + 1) * fw_wgs0,
+            ((M_FW_ - 1) / fw_div_M + 1) * fw_wgs1, idim.n * group};
+  return kernel;
+}
+
+OpenCLFunction::ConvolutionConfig
+OpenCLFunction::tuneConvolution(const OCLConvolutionInst *CC,
+                                const ConvolutionConfig &defaultConfig) {
+  size_t WIS[3];
+  cl_int err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                               sizeof(WIS), &WIS, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "Could not execute clGetDeviceInfo");
+  // The candidates overwrite the output of the convolution, so let the
+  // commands that use it finish first.
+  clFinish(commands_);
 
-  enqueueKernel(commands_, kernel, deviceId_, global, local, kernelLaunches_);
+  std::vector<ConvolutionConfig> candidates{defaultConfig};
+  for (size_t wgs0 : {8, 16}) {
+    for (size_t wgs1 : {8, 16}) {
+      for (size_t wptn : {4, 8}) {
+        for (size_t wptm : {4, 8}) {
+          for (size_t tsk : {4, 8}) {
+            // Every thread must load the same number of elements of the
+            // tiles of both operands.
+            if (wgs0 > WIS[0] || wgs1 > WIS[1] || (tsk * wptm) % wgs0 ||
+                (tsk * wptn) % wgs1) {
+              continue;
+            }
+            candidates.push_back({wgs0, wgs1, wptn, wptm, tsk});
+          }
+        }
+      }
+    }
+  }
+
+  ConvolutionConfig best = defaultConfig;
+  double bestTime = std::numeric_limits<double>::infinity();
+  for (auto &config : candidates) {
+    std::vector<size_t> global;
+    std::vector<size_t> local;
+    auto kernel = createConvolutionKernel(CC, config, global, local);
+    size_t workGroupSize = config.wgs0 * config.wgs1;
+    if (workGroupSize <= getKernelWorkGroupSize(kernel, deviceId_)) {
+      double time = benchmarkKernel(kernel, global, local);
+      if (time < bestTime) {
+        bestTime = time;
+        best = config;
+      }
+    }
+    clReleaseKernel(kernel);
+  }
+  return best;
 }
 
-/// This method is copied from InterpreterNodes.cpp. Please be aware that
-/// they should be in sync.
-template <typename T>
-static void topK(Tensor &outW, Tensor &indW, Tensor &inW, size_t k) {
-  auto values = outW.getHandle<T>();
-  auto indices = indW.getHandle<int64_t>();
-  auto in = inW.getHandle<T>();
-  size_t n = in.dims().back();
+void OpenCLFunction::planConvolution(const OCLConvolutionInst *CC) {
+  // Determine the default work groups sizes along h and w.
+  size_t WIS[3];
+  cl_int err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                               sizeof(WIS), &WIS, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "Could not execute clGetDeviceInfo");
+  size_t wg_size[3];
+  for (int id = 0; id < 2; ++id) {
+    size_t defaultVal = 16;
+    // Special case on CPUs devices, where a workgroup size could be 1,
+    // e.g. in case of Apple's OpenCL driver for CPUs.
+    if (WIS[id] < defaultVal || (id == 0 && WIS[1] < defaultVal)) {
+      defaultVal = WIS[1];
+    }
+    wg_size[id] = defaultVal;
+  }
+  ConvolutionConfig config{wg_size[0], wg_size[1], 4, 4, 4};
+
+  // Use the tuned parameters of this shape, if any.
+  if (!tuningDeviceKey_.empty()) {
+    auto odim = ShapeNCHW(CC->getDest()->getType()->dims());
+    auto idim = ShapeNCHW(CC->getSrc()->getType()->dims());
+    PaddingTLBR pads(CC->getPads());
+    ShapeHW kdim(CC->getKernels());
+    ShapeHW sdim(CC->getStrides());
+    bool isQuantized = CC->getDest()->getType()->isQuantizedType();
+    auto key = getTuningKey(isQuantized ? "conv_i8" : "conv",
+                            {idim.n, idim.c, idim.h, idim.w, odim.c, odim.h,
+                             odim.w, kdim.height, kdim.width, sdim.height,
+                             sdim.width, pads.top, pads.left});
+    std::vector<size_t> params;
+    if (TuningTable::get().lookup(key, params) && params.size() == 5) {
+      config = {params[0], params[1], params[2], params[3], params[4]};
+    } else if (autotune) {
+      config = tuneConvolution(CC, config);
+      TuningTable::get().insert(key, {config.wgs0, config.wgs1, config.wptn,
+                                      config.wptm, config.tsk});
+    }
+  }
+
+  std::vector<size_t> global;
+  std::vector<size_t> local;
+  auto kernel = createConvolutionKernel(CC, config, global, local);
+  GLOW_ASSERT(config.wgs0 * config.wgs1 <=
+                  getKernelWorkGroupSize(kernel, deviceId_) &&
+              "Bad workgroup size");
+  planKernel(kernel, global, local);
+}
+
+/// Size of the tile used by the matrix multiplication kernel, unless it is
+/// tuned.
+static constexpr size_t defaultMatMulTile = 8;
+/// The tile size that selects the register blocked matrix multiplication
+/// kernel, which computes blocks of this size of the result.
+static constexpr size_t blockedMatMulTile = 32;
+/// Number of threads along each dimension of the workgroups of the register
+/// blocked kernel. This must match BLOCK_THREADS in kernels.cl.
+static constexpr size_t blockedMatMulThreads = 8;
+
+/// The number of threads of the workgroups of TopK, which select the elements
+/// of one row each. This must match TOPK_THREADS in kernels.cl.
+static constexpr size_t topKThreads = 64;
+
+/// \returns the number of threads along each dimension of the workgroups of
+/// the matrix multiplication kernel for the tile size \p tile.
+static size_t getMatMulThreads(size_t tile) {
+  return tile == blockedMatMulTile ? blockedMatMulThreads : tile;
+}
+
+cl_kernel OpenCLFunction::createMatMulKernel(const MatMulInst *MM, size_t tile,
+                                             std::vector<size_t> &global,
+                                             std::vector<size_t> &local) {
+  bool isQuantized = MM->getDest()->getType()->isQuantizedType();
+  cl_kernel kernel;
+  if (tile == blockedMatMulTile) {
+    assert(!isQuantized && "The blocked kernel only supports floats");
+    kernel = createKernel("matmul_blocked");
+  } else if (tile) {
+    // The tiles of other sizes come from a build of the kernels with a
+    // different tile size.
+    std::vector<std::string> options;
+    addIntOption(options, "SIZEOF_HOST_SIZE_T", sizeof(size_t));
+    if (tile != defaultMatMulTile) {
+      addIntOption(options, "TILE_SIZE", tile);
+    }
+    auto prog = createProgram(SHADER_CODE, options, commands_);
+    kernel = createKernel(isQuantized ? "matmul_tiled_i8" : "matmul_tiled",
+                          prog);
+  } else {
+    kernel = createKernel(
+        getKernelName(MM->getKindName(), MM->getDest()->getElementType()));
+  }
+  setKernelArg(kernel, 0, deviceBuffer_);
+  auto numArgs = setKernelArgsForBuffers(kernel, *MM, 1, tensors_);
+
+  auto ddim = ShapeNHWC::fromXY(MM->getDest()->getType()->dims());
+  auto ldim = ShapeNHWC::fromXY(MM->getLHS()->getType()->dims());
+  auto rdim = ShapeNHWC::fromXY(MM->getRHS()->getType()->dims());
+
+  setKernelArg(kernel, numArgs + 1, ddim);
+  setKernelArg(kernel, numArgs + 2, ldim);
+  setKernelArg(kernel, numArgs + 3, rdim);
+  if (isQuantized) {
+    auto lhsTy = MM->getLHS()->getType();
+    auto rhsTy = MM->getRHS()->getType();
+    auto destTy = MM->getDest()->getType();
+    auto destScaleParams = quantization::quantizeScaleOffset32To8(
+        lhsTy->getScale() * rhsTy->getScale() / destTy->getScale(), 0);
+    setKernelArg(kernel, numArgs + 4, lhsTy->getOffset());
+    setKernelArg(kernel, numArgs + 5, rhsTy->getOffset());
+    setKernelArg(kernel, numArgs + 6, destTy->getOffset());
+    setKernelArg(kernel, numArgs + 7, destScaleParams);
+    setKernelArg<cl_uint>(kernel, numArgs + 8, MM->getTransposeRHS());
+  } else if (tile != blockedMatMulTile) {
+    setKernelArg<cl_uint>(kernel, numArgs + 4, MM->getTransposeRHS());
+  }
+
+  if (tile == blockedMatMulTile) {
+    // A single multiplication: the strides between the batches don't matter.
+    setKernelArg<cl_uint>(kernel, numArgs + 4, 0);
+    setKernelArg<cl_uint>(kernel, numArgs + 5, 0);
+    setKernelArg<cl_uint>(kernel, numArgs + 6, 0);
+    setKernelArg<cl_uint>(kernel, numArgs + 7, MM->getTransposeRHS());
+    size_t threads = blockedMatMulThreads;
+    local = {threads, threads, 1};
+    global = {(ddim.n + tile - 1) / tile * threads,
+              (ddim.h + tile - 1) / tile * threads, 1};
+  } else if (tile) {
+    local = {tile, tile};
+    global = {(ddim.n / tile + 1) * tile, (ddim.h / tile + 1) * tile};
+  } else {
+    global = {ddim.n, ddim.h, ddim.w};
+    local.assign(global.size(), 0);
+    getMaxLocalWorkgroupSize(kernel, deviceId_, global, local);
+  }
+  return kernel;
+}
+
+size_t OpenCLFunction::selectMatMulTile(const MatMulInst *MM) {
+  // Determine max work groups sizes.
+  size_t WIS[3];
+  cl_int err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                               sizeof(WIS), &WIS, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "Could not execute clGetDeviceInfo");
+  size_t WGS;
+  err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(WGS),
+                        &WGS, nullptr);
+  GLOW_ASSERT(err == CL_SUCCESS && "Could not execute clGetDeviceInfo");
+  bool isQuantized = MM->getDest()->getType()->isQuantizedType();
+  auto ddim = MM->getDest()->getType()->dims();
+  auto ldim = MM->getLHS()->getType()->dims();
+  // The tiled matrix multiplication kernels can be used only if the device
+  // allows workgroups with sizes which are at least as big as a tile.
+  auto fitsDevice = [&](size_t tile) {
+    if (tile == blockedMatMulTile && isQuantized) {
+      return false;
+    }
+    size_t threads = getMatMulThreads(tile);
+    return WIS[0] >= threads && WIS[1] >= threads && threads * threads <= WGS;
+  };
+  // The register blocked kernel pays off once the result holds several
+  // blocks. Smaller results use the simple tiled kernel.
+  size_t tile = 0;
+  if (ddim[0] >= blockedMatMulTile && ddim[1] >= blockedMatMulTile &&
+      fitsDevice(blockedMatMulTile)) {
+    tile = blockedMatMulTile;
+  } else if (fitsDevice(defaultMatMulTile)) {
+    tile = defaultMatMulTile;
+  }
+  if (tuningDeviceKey_.empty()) {
+    return tile;
+  }
 
-  size_t in_p = 0, out_p = 0;
-  size_t tensor_end = in.size();
-  using pairType = std::pair<float, size_t>;
-  std::vector<pairType> buf(n);
+  // Use the tuned tile size of this shape, if any.
+  std::string name = isQuantized ? "matmul_i8" : "matmul";
+  if (MM->getTransposeRHS()) {
+    name += "_trans";
+  }
+  auto key = getTuningKey(name, {ddim[0], ddim[1], ldim[1]});
+  std::vector<size_t> params;
+  if (TuningTable::get().lookup(key, params) && params.size() == 1) {
+    return params[0];
+  }
+  if (!autotune) {
+    return tile;
+  }
 
-  while (in_p < tensor_end) {
-    for (size_t i = 0; i < n; i++) {
-      buf[i].first = in.raw(in_p++);
-      buf[i].second = i;
+  // The candidates overwrite the result of the multiplication, so let the
+  // commands that use it finish first.
+  clFinish(commands_);
+  double bestTime = std::numeric_limits<double>::infinity();
+  for (size_t candidate : {size_t(0), size_t(4), size_t(8), size_t(16),
+                           blockedMatMulTile}) {
+    if (!fitsDevice(candidate)) {
+      continue;
     }
-    // NOTE: it's possible to do N + KlogK, while this version is NlogN
-    std::sort(buf.begin(), buf.end(), [](const pairType &a, const pairType &b) {
-      if (a.first != b.first)
-        return a.first > b.first;
-      return a.second < b.second;
-    });
-    for (size_t i = 0; i < k; i++) {
-      values.raw(out_p) = buf[i].first;
-      indices.raw(out_p) = buf[i].second;
-      out_p++;
+    std::vector<size_t> global;
+    std::vector<size_t> local;
+    auto kernel = createMatMulKernel(MM, candidate, global, local);
+    size_t threads = getMatMulThreads(candidate);
+    if (threads * threads <= getKernelWorkGroupSize(kernel, deviceId_)) {
+      double time = benchmarkKernel(kernel, global, local);
+      if (time < bestTime) {
+        bestTime = time;
+        tile = candidate;
+      }
     }
+    clReleaseKernel(kernel);
   }
+  TuningTable::get().insert(key, {tile});
+  return tile;
 }
 
 void OpenCLFunction::execute() {
-  auto copiedToDeviceBytes = copyMutableWeightsToDevice();
-  (void)copiedToDeviceBytes;
-  DEBUG_GLOW(llvm::dbgs() << "Copied " << copiedToDeviceBytes
-                          << " bytes to OpenCL device\n");
+  if (transferQueue_) {
+    executeStaged(mutableTensors_);
+    return;
+  }
+  // The functions of the module run concurrently, each in its own region.
+  std::lock_guard<std::mutex> lock(executeMutex_);
+  std::shared_lock<std::shared_timed_mutex> memoryLock(memory_->mutex_);
+  executeImpl();
+}
+
+void OpenCLFunction::execute(Context &ctx) {
+  if (transferQueue_) {
+    // The placeholders are bound to the staging buffer, not to the function.
+    std::vector<Tensor *> tensors = mutableTensors_;
+    for (auto PH : ctx.pairs()) {
+      auto *w = F_->getWeightForNode(PH.first);
+      if (!w) {
+        // The placeholder is not used by this function.
+        continue;
+      }
+      auto it = std::find(mutableWeights_.begin(), mutableWeights_.end(), w);
+      GLOW_ASSERT(it != mutableWeights_.end() &&
+                  "The placeholder was not bound at compile time");
+      size_t idx = it - mutableWeights_.begin();
+      GLOW_ASSERT(PH.second->getType().isEqual(tensors[idx]->getType()) &&
+                  "The tensor does not match the type of the placeholder");
+      tensors[idx] = PH.second;
+    }
+    executeStaged(tensors);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(executeMutex_);
+  std::shared_lock<std::shared_timed_mutex> memoryLock(memory_->mutex_);
+
+  // Temporarily bind the placeholders to the tensors of \p ctx.
+  std::vector<std::pair<const Value *, Tensor *>> savedTensors;
+  for (auto PH : ctx.pairs()) {
+    auto *w = F_->getWeightForNode(PH.first);
+    if (!w) {
+      // The placeholder is not used by this function.
+      continue;
+    }
+    auto it = externalTensors_.find(w);
+    GLOW_ASSERT(it != externalTensors_.end() &&
+                "The placeholder was not bound at compile time");
+    GLOW_ASSERT(PH.second->getType().isEqual(it->second->getType()) &&
+                "The tensor does not match the type of the placeholder");
+    savedTensors.emplace_back(w, it->second);
+    it->second = PH.second;
+  }
+
+  executeImpl();
+
+  for (auto &saved : savedTensors) {
+    externalTensors_[saved.first] = saved.second;
+  }
+}
+
+Tensor OpenCLFunction::getMappedTensor(const Placeholder *PH) {
+  std::shared_lock<std::shared_timed_mutex> memoryLock(memory_->mutex_);
+  auto *hostMemory = static_cast<char *>(memory_->getHostMemory());
+  if (!hostMemory) {
+    return Tensor();
+  }
+  auto *w = F_->getWeightForNode(PH);
+  GLOW_ASSERT(w && externalTensors_.count(w) &&
+              "The placeholder was not bound at compile time");
+  return Tensor(hostMemory + tensors_[w], w->getType());
+}
+
+void OpenCLFunction::formFusedBundles() {
+  fusedBundles_.clear();
+  fusedBundleOf_.clear();
+  if (!fuseDataParallel) {
+    return;
+  }
+  std::vector<const Instruction *> bundle;
+  auto endBundle = [&]() {
+    if (bundle.size() > 1) {
+      fusedBundles_.push_back(bundle);
+    }
+    bundle.clear();
+  };
+  // \returns true if the memory of \p v partially overlaps the memory of an
+  // operand of the bundle, or only of a written operand if \p onlyWritten.
+  // The streamed weights have no address yet. They are constant, and the
+  // weights used by the same kernel are never at the same address.
+  auto overlapsPartially = [&](const Value *v, bool onlyWritten) {
+    if (isStreamed_.count(v)) {
+      return false;
+    }
+    uint64_t begin = tensors_[v];
+    uint64_t end = begin + v->getSizeInBytes();
+    for (auto *BI : bundle) {
+      for (const auto &op : BI->getOperands()) {
+        if ((onlyWritten && op.second == OperandKind::In) ||
+            isStreamed_.count(op.first)) {
+          continue;
+        }
+        uint64_t opBegin = tensors_[op.first];
+        uint64_t opEnd = opBegin + op.first->getSizeInBytes();
+        if (begin < opEnd && opBegin < end &&
+            (begin != opBegin || end != opEnd)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
 
   for (const auto &I : F_->getInstrs()) {
+    // The memory management instructions do not launch anything.
+    if (isa<AllocActivationInst>(I) || isa<DeallocActivationInst>(I) ||
+        isa<TensorViewInst>(I)) {
+      continue;
+    }
+    if (!isFusable(I)) {
+      endBundle();
+      continue;
+    }
+    // The element i of every operand is computed by the work item i, so the
+    // operands must have the same number of elements, and an element must
+    // not be written under another index than it is read.
+    bool isCompatible =
+        bundle.empty() || I.getOperand(0).first->size() ==
+                              bundle.back()->getOperand(0).first->size();
+    for (const auto &op : I.getOperands()) {
+      if (overlapsPartially(op.first, op.second == OperandKind::In)) {
+        isCompatible = false;
+      }
+    }
+    if (!isCompatible) {
+      endBundle();
+    }
+    bundle.push_back(&I);
+  }
+  endBundle();
+
+  for (size_t i = 0, e = fusedBundles_.size(); i < e; i++) {
+    for (auto *I : fusedBundles_[i]) {
+      fusedBundleOf_[I] = i;
+    }
+  }
+}
+
+std::string
+OpenCLFunction::getFusedKernelSource(llvm::StringRef name, size_t bundleIdx,
+                                     size_t width,
+                                     std::vector<uint64_t> &addresses) {
+  const auto &bundle = fusedBundles_[bundleIdx];
+  // The register of every buffer, indexed by the buffer address. The buffers
+  // overlap exactly or not at all.
+  struct Register {
+    /// The index of the register and of the kernel argument of the buffer.
+    size_t index;
+    /// Whether the register is declared in the source so far.
+    bool isDeclared;
+    /// Whether the bundle writes the buffer.
+    bool isWritten;
+    /// Whether the buffer must be stored, because a value in it is read
+    /// after the bundle.
+    bool isLive;
+  };
+  auto getBuffer = [](size_t index) { return "b" + std::to_string(index); };
+  auto getRegister = [](size_t index) { return "r" + std::to_string(index); };
+
+  // \returns the statements, indented by \p indent, that compute the
+  // elements of the bundle from i on, \p w at a time. The buffers are
+  // numbered in the order of their first use, which does not depend on \p w.
+  auto getBody = [&](size_t w, const std::string &indent) {
+    std::map<uint64_t, Register> registers;
+    std::string body;
+    auto load = [&](size_t index) {
+      return w == 1 ? getBuffer(index) + "[i]"
+                    : "vload" + std::to_string(w) + "(i, " +
+                          getBuffer(index) + ")";
+    };
+
+    // \returns the register of the buffer of \p v. The buffer is loaded the
+    // first time it is read before being written.
+    auto getOperandRegister = [&](const Value *v, bool isRead) -> Register & {
+      uint64_t address = tensors_[v];
+      auto it = registers.find(address);
+      if (it == registers.end()) {
+        size_t index = registers.size();
+        if (index == addresses.size()) {
+          addresses.push_back(address);
+        }
+        it = registers.insert({address, {index, false, false, false}}).first;
+      }
+      auto &reg = it->second;
+      if (isRead && !reg.isDeclared) {
+        body += indent + "vtype " + getRegister(reg.index) + " = " +
+                load(reg.index) + ";\n";
+        reg.isDeclared = true;
+      }
+      return reg;
+    };
+
+    for (auto *I : bundle) {
+      // The operands that are read come first, since the destination may be
+      // one of them.
+      llvm::SmallVector<std::string, 4> ops(I->getNumOperands());
+      for (size_t i = 0, e = I->getNumOperands(); i < e; i++) {
+        auto op = I->getOperand(i);
+        if (op.second == OperandKind::In) {
+          ops[i] = getRegister(getOperandRegister(op.first, true).index);
+        }
+      }
+      auto *destValue = I->getOperand(0).first;
+      auto &dest = getOperandRegister(destValue, false);
+      dest.isWritten = true;
+      dest.isLive |= !isDeadAfter(*F_, destValue, bundle.back());
+      ops[0] = getRegister(dest.index);
+      body += indent + std::string(dest.isDeclared ? "" : "vtype ") + ops[0] +
+              " = " + getFusedExpression(*I, ops) + ";\n";
+      dest.isDeclared = true;
+    }
+    for (const auto &kv : registers) {
+      const auto &reg = kv.second;
+      if (!reg.isWritten || !reg.isLive) {
+        continue;
+      }
+      if (w == 1) {
+        body += indent + getBuffer(reg.index) + "[i] = " +
+                getRegister(reg.index) + ";\n";
+      } else {
+        body += indent + "vstore" + std::to_string(w) + "(" +
+                getRegister(reg.index) + ", i, " + getBuffer(reg.index) +
+                ");\n";
+      }
+    }
+    return body;
+  };
+
+  addresses.clear();
+  std::string body;
+  if (width == 1) {
+    body = "  typedef float vtype;\n" + getBody(1, "  ");
+  } else {
+    // Like the vectorized data-parallel kernels, the work item that has
+    // fewer than width elements left computes them one by one.
+    std::string w = std::to_string(width);
+    body = "  if (i * " + w + " + " + w + " > n) {\n" +
+           "    typedef float vtype;\n" + "    for (i *= " + w +
+           "; i < n; i++) {\n" + getBody(1, "      ") + "    }\n" +
+           "    return;\n  }\n" + "  typedef float" + w + " vtype;\n" +
+           getBody(width, "  ");
+  }
+
+  std::string source = "__kernel void " + name.str() + "(__global void *mem";
+  std::string buffers;
+  for (size_t i = 0, e = addresses.size(); i < e; i++) {
+    source += ", cl_uint32_t a" + std::to_string(i);
+    buffers += "  __global float *" + getBuffer(i) + " = &mem[a" +
+               std::to_string(i) + "];\n";
+  }
+  source += width == 1 ? ") {\n" : ", cl_uint32_t n) {\n";
+  source += "  size_t i = get_global_id(0);\n";
+  return source + buffers + body + "}\n\n";
+}
+
+void OpenCLFunction::buildLaunchPlan() {
+  // The kernels of all fused bundles are generated into one program.
+  std::string fusedSource = "typedef unsigned cl_uint32_t;\n\n";
+  std::vector<std::vector<uint64_t>> fusedAddresses(fusedBundles_.size());
+  std::vector<size_t> fusedWidths(fusedBundles_.size());
+  std::unordered_map<const Instruction *, size_t> positions;
+  for (const auto &I : F_->getInstrs()) {
+    positions.insert({&I, positions.size()});
+  }
+  for (size_t i = 0, e = fusedBundles_.size(); i < e; i++) {
+    useStreamedAddresses(positions[fusedBundles_[i].back()]);
+    size_t size = fusedBundles_[i].front()->getOperand(0).first->size();
+    // Every work item computes a vector of elements if possible.
+    fusedWidths[i] = size >= 8 ? 8 : 1;
+    fusedSource += getFusedKernelSource("fused" + std::to_string(i), i,
+                                        fusedWidths[i], fusedAddresses[i]);
+  }
+  cl_program fusedProgram =
+      fusedBundles_.empty() ? nullptr
+                            : createProgram(fusedSource, {}, commands_);
+
+  size_t position = 0;
+  auto nextUpload = streamedWeights_.begin();
+  for (const auto &I : F_->getInstrs()) {
+    // The streamed weights are uploaded in the steps before the instruction.
+    for (; nextUpload != streamedWeights_.end() &&
+           nextUpload->loadPosition == position;
+         ++nextUpload) {
+      PlannedCommand command;
+      command.step = nextUpload->uploadStep;
+      command.upload = nextUpload->weight;
+      command.destOffset = nextUpload->address;
+      command.sizeInBytes = nextUpload->weight->getSizeInBytes();
+      launchPlan_.push_back(std::move(command));
+    }
+    useStreamedAddresses(position++);
+    planStep_ = instrSteps_[&I];
+
+    // A fused bundle runs as a single kernel in the step of its last
+    // instruction.
+    auto fused = fusedBundleOf_.find(&I);
+    if (fused != fusedBundleOf_.end()) {
+      size_t idx = fused->second;
+      const auto &bundle = fusedBundles_[idx];
+      if (&I != bundle.back()) {
+        continue;
+      }
+      cl_kernel kernel =
+          createKernel("fused" + std::to_string(idx), fusedProgram);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      size_t numAddresses = fusedAddresses[idx].size();
+      for (size_t i = 0; i < numAddresses; i++) {
+        setKernelArg<cl_uint>(kernel, i + 1, fusedAddresses[idx][i]);
+      }
+      size_t size = I.getOperand(0).first->size();
+      if (fusedWidths[idx] > 1) {
+        setKernelArg<cl_uint>(kernel, numAddresses + 1, size);
+      }
+      planKernel(kernel, {getDataParallelWorkItems(size, fusedWidths[idx])});
+      // Name the kernel after the instructions in the profiles.
+      std::string name = "fused";
+      for (auto *BI : bundle) {
+        name += std::string(name == "fused" ? "(" : ",") + BI->getKindName();
+      }
+      launchPlan_.back().name = name + ")";
+      continue;
+    }
+
     // The kernels are named after the name of the instruction, plus the "W"
     // suffix to prevent name colissions for functions like 'tanh' that are also
     // a part of the OpenCL runtime.
@@ -614,27 +1972,20 @@ void OpenCLFunction::execute() {
 
     // Element-wise operations, except the copy instruction.
     if (I.isDataParallel() && !isa<CopyInst>(I)) {
-      // Figure out how many element-wise elements are there to process:
-      size_t global;
-      if (I.isDataParallel()) {
-        global = I.getOperand(0).first->getType()->size();
-        // The check for quantization below is a temporary workaround until the
-        // corresponding kernels are implemented for the quantized operations.
-        if (!isQuantized) {
-          if (global % 16 == 0) {
-            // Start less kernels and let each kernel do more work using vector
-            // instructions.
-            global /= 16;
-            kernelName += "16";
-          } else if (global % 8 == 0) {
-            // Start less kernels and let each kernel do more work using vector
-            // instructions.
-            global /= 8;
-            kernelName += "8";
-          }
-        }
-      } else {
-        GLOW_UNREACHABLE("Invalid instruction.");
+      // Figure out how many element-wise elements are there to process, and
+      // start less kernels that do more work using vector instructions when
+      // there are vectorized kernels for the instruction.
+      size_t global = I.getOperand(0).first->getType()->size();
+      size_t width = 1;
+      if (!isQuantized || isa<SplatInst>(I)) {
+        width = getDataParallelWidth(global, true);
+      } else if (isa<ElementAddInst>(I) || isa<ElementSubInst>(I) ||
+                 isa<ElementMulInst>(I) || isa<ElementDivInst>(I) ||
+                 isa<ElementMinInst>(I) || isa<ElementMaxInst>(I)) {
+        width = getDataParallelWidth(global, false);
+      }
+      if (width > 1) {
+        kernelName += std::to_string(width);
       }
 
       cl_kernel kernel = createKernel(kernelName);
@@ -683,7 +2034,10 @@ void OpenCLFunction::execute() {
           }
         }
       }
-      enqueueKernel(commands_, kernel, deviceId_, {global}, kernelLaunches_);
+      if (width > 1) {
+        setKernelArg<cl_uint>(kernel, ++numArgs, global);
+      }
+      planKernel(kernel, {getDataParallelWorkItems(global, width)});
       continue;
     }
 
@@ -700,7 +2054,7 @@ void OpenCLFunction::execute() {
       auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
       setKernelArg(kernel, ++numArgs, destTensorQuantizationScale);
       setKernelArg(kernel, ++numArgs, destTensorQuantizationOffset);
-      enqueueKernel(commands_, kernel, deviceId_, {global}, kernelLaunches_);
+      planKernel(kernel, {global});
       continue;
     }
 
@@ -722,7 +2076,7 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, ++numArgs, destType->getOffset());
       setKernelArg(kernel, ++numArgs, srcType->getOffset());
       setKernelArg(kernel, ++numArgs, rescaleParams);
-      enqueueKernel(commands_, kernel, deviceId_, {global}, kernelLaunches_);
+      planKernel(kernel, {global});
       continue;
     }
 
@@ -737,28 +2091,95 @@ void OpenCLFunction::execute() {
       cl_kernel kernel = createKernel(kernelName);
       setKernelArg(kernel, 0, deviceBuffer_);
       auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
-      setKernelArg(kernel, ++numArgs, srcTensorQuantizationScale);
-      setKernelArg(kernel, ++numArgs, srcTensorQuantizationOffset);
-      enqueueKernel(commands_, kernel, deviceId_, {global}, kernelLaunches_);
+      setKernelArg(kernel, ++numArgs, srcTensorQuantizationScale);
+      setKernelArg(kernel, ++numArgs, srcTensorQuantizationOffset);
+      planKernel(kernel, {global});
+      continue;
+    }
+
+    // Convert between float and half precision. The kernel is named after the
+    // destination type.
+    if (auto *CT = dyn_cast<ConvertToInst>(&I)) {
+      GLOW_ASSERT(CT->getSrc()->getElementType() !=
+                      CT->getDest()->getElementType() &&
+                  "ConvertTo must change the element type");
+      size_t global = CT->getDest()->getType()->size();
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      setKernelArgsForBuffers(kernel, I, 1, tensors_);
+      planKernel(kernel, {global});
+      continue;
+    }
+
+    if (auto *SM = dyn_cast<SoftMaxInst>(&I)) {
+      // Implement Softmax by parallelizing the batch dimension. Each sample in
+      // the batch is processed by a different parallel 'thread'.
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
+
+      // This is the number of elements for each slice. There are N slices in
+      // our batch.
+      auto inputDims = SM->getSrc()->getType()->dims();
+      size_t numSlices = inputDims[0];
+
+      // Pass the slice size (size of each sample in the batch) as a parameter.
+      setKernelArg<cl_uint>(kernel, numArgs + 1, flattenCdr(inputDims).second);
+
+      planKernel(kernel, {numSlices});
+      continue;
+    }
+
+    if (auto *AG = dyn_cast<AdagradInst>(&I)) {
+      // The whole update of the weight is a single element-wise kernel.
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
+      setKernelArg(kernel, ++numArgs, AG->getL1Decay());
+      setKernelArg(kernel, ++numArgs, AG->getL2Decay());
+      setKernelArg(kernel, ++numArgs,
+                   1.0f / std::max(1u, AG->getBatchSize()));
+      setKernelArg(kernel, ++numArgs, AG->getLearningRate());
+      setKernelArg(kernel, ++numArgs, AG->getEpsilon());
+      planKernel(kernel, {AG->getWeight()->getType()->size()});
+      continue;
+    }
+
+    if (auto *RP = dyn_cast<RMSPropInst>(&I)) {
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
+      setKernelArg(kernel, ++numArgs, RP->getL1Decay());
+      setKernelArg(kernel, ++numArgs, RP->getL2Decay());
+      setKernelArg(kernel, ++numArgs,
+                   1.0f / std::max(1u, RP->getBatchSize()));
+      setKernelArg(kernel, ++numArgs, RP->getLearningRate());
+      setKernelArg(kernel, ++numArgs, RP->getDecay());
+      setKernelArg(kernel, ++numArgs, RP->getEpsilon());
+      planKernel(kernel, {RP->getWeight()->getType()->size()});
       continue;
     }
 
-    if (auto *SM = dyn_cast<SoftMaxInst>(&I)) {
-      // Implement Softmax by parallelizing the batch dimension. Each sample in
-      // the batch is processed by a different parallel 'thread'.
+    if (auto *AD = dyn_cast<AdamInst>(&I)) {
       cl_kernel kernel = createKernel(kernelName);
       setKernelArg(kernel, 0, deviceBuffer_);
       auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
-
-      // This is the number of elements for each slice. There are N slices in
-      // our batch.
-      auto inputDims = SM->getSrc()->getType()->dims();
-      size_t numSlices = inputDims[0];
-
-      // Pass the slice size (size of each sample in the batch) as a parameter.
-      setKernelArg<cl_uint>(kernel, numArgs + 1, flattenCdr(inputDims).second);
-
-      enqueueKernel(commands_, kernel, deviceId_, {numSlices}, kernelLaunches_);
+      setKernelArg(kernel, ++numArgs, AD->getL1Decay());
+      setKernelArg(kernel, ++numArgs, AD->getL2Decay());
+      setKernelArg(kernel, ++numArgs,
+                   1.0f / std::max(1u, AD->getBatchSize()));
+      setKernelArg(kernel, ++numArgs, AD->getLearningRate());
+      setKernelArg(kernel, ++numArgs, AD->getBeta1());
+      setKernelArg(kernel, ++numArgs, AD->getBeta2());
+      setKernelArg(kernel, ++numArgs, AD->getEpsilon());
+      planKernel(kernel, {AD->getWeight()->getType()->size()});
+
+      // The number of updates is incremented once every element has read it.
+      // The kernels of the same step run in order.
+      cl_kernel stepKernel = createKernel("adam_stepW");
+      setKernelArg(stepKernel, 0, deviceBuffer_);
+      setKernelArg<cl_uint>(stepKernel, 1, tensors_[AD->getStep()]);
+      planKernel(stepKernel, {1});
       continue;
     }
 
@@ -777,7 +2198,53 @@ void OpenCLFunction::execute() {
       // Pass the slice size (size of each sample in the batch) as a parameter.
       setKernelArg<cl_uint>(kernel, numArgs + 1, flattenCdr(inputDims).second);
 
-      enqueueKernel(commands_, kernel, deviceId_, {numSlices}, kernelLaunches_);
+      planKernel(kernel, {numSlices});
+      continue;
+    }
+
+    if (auto *BN = dyn_cast<BatchNormalizationInst>(&I)) {
+      // The normalization is elementwise once the statistics are known.
+      auto dims = BN->getDest()->dims();
+      unsigned channelIdx = BN->getChannelIdx();
+      size_t inner = flattenCdr(dims, channelIdx + 1).second;
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
+      setKernelArg<cl_uint>(kernel, ++numArgs, dims[channelIdx]);
+      setKernelArg<cl_uint>(kernel, ++numArgs, inner);
+      setKernelArg(kernel, ++numArgs, BN->getEpsilon());
+      planKernel(kernel, {BN->getDest()->size()});
+      continue;
+    }
+
+    if (isa<BatchNormalizationGradInst>(&I) ||
+        isa<MeanVarNormalizationInst>(&I)) {
+      // The statistics are reduced by a work item per channel.
+      Value *src;
+      unsigned channelIdx;
+      float param;
+      if (auto *BNG = dyn_cast<BatchNormalizationGradInst>(&I)) {
+        src = BNG->getSrc();
+        channelIdx = BNG->getChannelIdx();
+        param = BNG->getEpsilon();
+      } else {
+        auto *MVN = cast<MeanVarNormalizationInst>(&I);
+        src = MVN->getSrc();
+        channelIdx = MVN->getChannelIdx();
+        param = MVN->getMomentum();
+      }
+      auto dims = src->dims();
+      size_t numChannels = dims[channelIdx];
+      size_t inner = flattenCdr(dims, channelIdx + 1).second;
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
+      setKernelArg<cl_uint>(kernel, ++numArgs,
+                            src->size() / (numChannels * inner));
+      setKernelArg<cl_uint>(kernel, ++numArgs, numChannels);
+      setKernelArg<cl_uint>(kernel, ++numArgs, inner);
+      setKernelArg(kernel, ++numArgs, param);
+      planKernel(kernel, {numChannels});
       continue;
     }
 
@@ -816,8 +2283,7 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, numArgs + 1, odim);
       setKernelArg(kernel, numArgs + 2, idim);
       setKernelArg(kernel, numArgs + 3, offset);
-      enqueueKernel(commands_, kernel, deviceId_, {odim.n, odim.h},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.n, odim.h});
       continue;
     }
 
@@ -857,60 +2323,47 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, numArgs + 3, offset);
       setKernelArg<cl_uint>(kernel, numArgs + 4, IT->getCount());
       setKernelArg<cl_uint>(kernel, numArgs + 5, IT->getAxis());
-      enqueueKernel(commands_, kernel, deviceId_, {idim.n, idim.h},
-                    kernelLaunches_);
+      planKernel(kernel, {idim.n, idim.h});
       continue;
     }
 
     if (auto *BMM = dyn_cast<MatMulInst>(&I)) {
-// Size of the tile to be used for matrix multiplication.
-#define TILE_DIM ((size_t)8)
-      // Determine max work groups sizes.
-      size_t WIS[3];
-      cl_int err = clGetDeviceInfo(deviceId_, CL_DEVICE_MAX_WORK_ITEM_SIZES,
-                                   sizeof(WIS), &WIS, nullptr);
-      GLOW_ASSERT(err == CL_SUCCESS && "Could not execute clGetDeviceInfo");
-      // True if the tiled matrix multiplication kernel can be used. This is
-      // only possible if the device allows workgroups with sizes which are at
-      // least as big as a tile.
-      bool useTiledMatMul = (WIS[0] >= TILE_DIM && WIS[1] >= TILE_DIM);
-      auto tiledKernelName = isQuantized ? "matmul_tiled_i8" : "matmul_tiled";
+      std::vector<size_t> global;
+      std::vector<size_t> local;
       cl_kernel kernel =
-          createKernel(useTiledMatMul ? tiledKernelName : kernelName);
+          createMatMulKernel(BMM, selectMatMulTile(BMM), global, local);
+      planKernel(kernel, global, local);
+      continue;
+    }
+
+    if (auto *BMM = dyn_cast<BatchedMatMulInst>(&I)) {
+      // The register blocked kernel multiplies all the batch entries in a
+      // single launch, along the third dimension of the global work size.
+      assert(!isQuantized && "Quantized batched matmuls are lowered");
+      cl_kernel kernel = createKernel("matmul_blocked");
       setKernelArg(kernel, 0, deviceBuffer_);
       auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
 
-      auto ddim = ShapeNHWC::fromXY(BMM->getDest()->getType()->dims());
-      auto ldim = ShapeNHWC::fromXY(BMM->getLHS()->getType()->dims());
-      auto rdim = ShapeNHWC::fromXY(BMM->getRHS()->getType()->dims());
-
+      auto ddims = BMM->getDest()->dims();
+      auto ldims = BMM->getLHS()->dims();
+      auto rdims = BMM->getRHS()->dims();
+      auto ddim = ShapeNHWC::fromXY({ddims[1], ddims[2]});
+      auto ldim = ShapeNHWC::fromXY({ldims[1], ldims[2]});
+      auto rdim = ShapeNHWC::fromXY({rdims[1], rdims[2]});
       setKernelArg(kernel, numArgs + 1, ddim);
       setKernelArg(kernel, numArgs + 2, ldim);
       setKernelArg(kernel, numArgs + 3, rdim);
-      if (isQuantized) {
-        auto lhsTy = BMM->getLHS()->getType();
-        auto rhsTy = BMM->getRHS()->getType();
-        auto destTy = BMM->getDest()->getType();
-        auto destScaleParams = quantization::quantizeScaleOffset32To8(
-            lhsTy->getScale() * rhsTy->getScale() / destTy->getScale(), 0);
-        setKernelArg(kernel, numArgs + 4, lhsTy->getOffset());
-        setKernelArg(kernel, numArgs + 5, rhsTy->getOffset());
-        setKernelArg(kernel, numArgs + 6, destTy->getOffset());
-        setKernelArg(kernel, numArgs + 7, destScaleParams);
-      }
-
-      if (useTiledMatMul) {
-        std::vector<size_t> local{TILE_DIM, TILE_DIM};
-        std::vector<size_t> global{(ddim.n / local[0] + 1) * local[0],
-                                   (ddim.h / local[1] + 1) * local[1]};
-
-        enqueueKernel(commands_, kernel, deviceId_, global, local,
-                      kernelLaunches_);
-      } else {
-        enqueueKernel(commands_, kernel, deviceId_, {ddim.n, ddim.h, ddim.w},
-                      kernelLaunches_);
-      }
-#undef TILE_DIM
+      setKernelArg<cl_uint>(kernel, numArgs + 4, ddims[1] * ddims[2]);
+      setKernelArg<cl_uint>(kernel, numArgs + 5, ldims[1] * ldims[2]);
+      setKernelArg<cl_uint>(kernel, numArgs + 6, rdims[1] * rdims[2]);
+      setKernelArg<cl_uint>(kernel, numArgs + 7, 0);
+
+      size_t tile = blockedMatMulTile;
+      size_t threads = blockedMatMulThreads;
+      planKernel(kernel,
+                 {(ddim.n + tile - 1) / tile * threads,
+                  (ddim.h + tile - 1) / tile * threads, ddims[0]},
+                 {threads, threads, 1});
       continue;
     }
 
@@ -941,8 +2394,7 @@ void OpenCLFunction::execute() {
       }
 
       // Parallelize on each element in the slice.
-      enqueueKernel(commands_, kernel, deviceId_, {bdim.second},
-                    kernelLaunches_);
+      planKernel(kernel, {bdim.second});
       continue;
     }
 
@@ -957,14 +2409,22 @@ void OpenCLFunction::execute() {
       setKernelArg<cl_uint>(kernel, numArgs + 1, bdim.first);
       setKernelArg<cl_uint>(kernel, numArgs + 2, bdim.second);
 
+      if (isQuantized) {
+        auto *destTy = BRA->getDest()->getType();
+        auto *batchTy = BRA->getBatch()->getType();
+        setKernelArg(kernel, numArgs + 3, destTy->getOffset());
+        auto batchScaleParams = quantization::quantizeScaleOffset32To8(
+            batchTy->getScale() / destTy->getScale(), batchTy->getOffset());
+        setKernelArg(kernel, numArgs + 4, batchScaleParams);
+      }
+
       // Parallelize on each element in the slice.
-      enqueueKernel(commands_, kernel, deviceId_, {bdim.second},
-                    kernelLaunches_);
+      planKernel(kernel, {bdim.second});
       continue;
     }
 
     if (auto *CC = dyn_cast<OCLConvolutionInst>(&I)) {
-      executeConvolution(CC);
+      planConvolution(CC);
       continue;
     }
 
@@ -1004,8 +2464,7 @@ void OpenCLFunction::execute() {
 
       // Use a 3D grid where the first dimension is the depth and the second
       // dimension is the slice index in the batch.
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
@@ -1045,9 +2504,7 @@ void OpenCLFunction::execute() {
       assert(filter->dims() == filterGrad->dims() && "Dims should be the same");
       assert(src->dims() == srcGrad->dims() && "Dims should be the same");
 
-      enqueueKernel(commands_, kernel, deviceId_,
-                    {destGradDim.h, destGradDim.w, destGradDim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {destGradDim.h, destGradDim.w, destGradDim.c});
       continue;
     }
 
@@ -1071,8 +2528,7 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, numArgs + 4, odim);
       setKernelArg(kernel, numArgs + 5, idim);
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
@@ -1096,8 +2552,7 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, numArgs + 4, odim);
       setKernelArg(kernel, numArgs + 5, idim);
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
@@ -1122,8 +2577,7 @@ void OpenCLFunction::execute() {
       assert(srcGradDim.n == destGradDim.n && "batch size is wrong");
       assert(srcGradDim.c == destGradDim.c && "depth size is wrong");
 
-      enqueueKernel(commands_, kernel, deviceId_, {srcGradDim.n},
-                    kernelLaunches_);
+      planKernel(kernel, {srcGradDim.n});
       continue;
     }
 
@@ -1147,8 +2601,7 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, numArgs + 4, odim);
       setKernelArg(kernel, numArgs + 5, idim);
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
@@ -1182,8 +2635,7 @@ void OpenCLFunction::execute() {
 
       ShapeNHWC shuff(mask[0], mask[1], mask[2], mask[3]);
       setKernelArg(kernel, numArgs + 3, shuff);
-      enqueueKernel(commands_, kernel, deviceId_, {idim.n, idim.h},
-                    kernelLaunches_);
+      planKernel(kernel, {idim.n, idim.h});
       continue;
     }
 
@@ -1191,20 +2643,16 @@ void OpenCLFunction::execute() {
       Value *dest, *src;
       dest = C->getDest();
       src = C->getSrc();
-      if (src == dest) {
+      // The destination may share the memory of the source.
+      if (src == dest || copyAliases_.count(dest)) {
         continue;
       }
-      size_t destOff = tensors_[dest];
-      size_t srcOff = tensors_[src];
-      size_t sizeInBytes = dest->getSizeInBytes();
-      cl_event event{nullptr};
-      cl_int err = clEnqueueCopyBuffer(commands_, deviceBuffer_, deviceBuffer_,
-                                       srcOff, destOff, sizeInBytes, 0, nullptr,
-                                       doProfile ? &event : nullptr);
-      if (doProfile) {
-        kernelLaunches_.emplace_back(KernelLaunch("copy", event));
-      }
-      GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueCopyBuffer.");
+      PlannedCommand command;
+      command.step = planStep_;
+      command.srcOffset = tensors_[src];
+      command.destOffset = tensors_[dest];
+      command.sizeInBytes = dest->getSizeInBytes();
+      launchPlan_.push_back(std::move(command));
       continue;
     }
 
@@ -1239,8 +2687,7 @@ void OpenCLFunction::execute() {
       setKernelArg<cl_uint>(kernel, numArgs + 4, destSampleSize);
       setKernelArg<cl_uint>(kernel, numArgs + 5, srcSampleSize);
 
-      enqueueKernel(commands_, kernel, deviceId_, {numIndices},
-                    kernelLaunches_);
+      planKernel(kernel, {numIndices});
       continue;
     }
 
@@ -1254,54 +2701,33 @@ void OpenCLFunction::execute() {
       size_t numIndices = SAI->getIndices()->size();
       setKernelArg<cl_uint>(kernel, numArgs + 1, dataSliceSize);
 
-      enqueueKernel(commands_, kernel, deviceId_, {numIndices},
-                    kernelLaunches_);
+      planKernel(kernel, {numIndices});
       continue;
     }
 
     if (auto *DP = dyn_cast<DebugPrintInst>(&I)) {
-      clFinish(commands_);
-      auto *V = DP->getSrc();
-      // Allocate a temporary tensor to hold the value.
-      Tensor T(V->getType());
-      // Load the current value of the variable into host memory.
-      copyValueFromDevice(V, T.getUnsafePtr());
-      clFinish(commands_);
-      llvm::outs() << I.getName() << ": ";
-      // Dump the content of a value.
-      V->dump();
-      llvm::outs() << "\n";
-      dumpImpl(&T);
-      llvm::outs() << "\n";
-      llvm::outs().flush();
+      PlannedCommand command;
+      command.step = planStep_;
+      command.print = DP;
+      // A streamed weight is printed from where it is at this step.
+      command.srcOffset = tensors_[DP->getSrc()];
+      launchPlan_.push_back(std::move(command));
       continue;
     }
 
-    // For TopKInst, we perform the computation on the host side, as sorting on
-    // GPU is complex and we may not get too much benefit from it. We copy the
-    // tensor from GPU memory to host memory, perform the computation, and then
-    // copy the results back to GPU memory.
     if (auto *TK = dyn_cast<TopKInst>(&I)) {
-      clFinish(commands_);
-      auto *destDev = TK->getValues();
-      auto *indDev = TK->getIndices();
-      auto *srcDev = TK->getInput();
-      Tensor destT(destDev->getType());
-      Tensor indT(indDev->getType());
-      Tensor srcT(srcDev->getType());
-      size_t k = TK->getK();
-
-      copyValueFromDevice(srcDev, srcT.getUnsafePtr());
-      clFinish(commands_);
+      cl_kernel kernel = createKernel(kernelName);
+      setKernelArg(kernel, 0, deviceBuffer_);
+      auto numArgs = setKernelArgsForBuffers(kernel, I, 1, tensors_);
 
-      if (isQuantized) {
-        topK<int8_t>(destT, indT, srcT, k);
-      } else {
-        topK<float>(destT, indT, srcT, k);
-      }
-      copyValueToDevice(destDev, destT.getUnsafePtr());
-      copyValueToDevice(indDev, indT.getUnsafePtr());
-      clFinish(commands_);
+      auto *input = TK->getInput();
+      size_t n = input->dims().back();
+      size_t numRows = input->size() / n;
+      setKernelArg<cl_uint>(kernel, numArgs + 1, n);
+      setKernelArg<cl_uint>(kernel, numArgs + 2, TK->getK());
+
+      // One workgroup selects the elements of every row.
+      planKernel(kernel, {numRows * topKThreads}, {topKThreads});
       continue;
     }
 
@@ -1330,8 +2756,7 @@ void OpenCLFunction::execute() {
         setKernelArg(kernel, numArgs + 7, destScaleParam);
       }
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
@@ -1350,29 +2775,223 @@ void OpenCLFunction::execute() {
       setKernelArg(kernel, numArgs + 4, odim);
       setKernelArg(kernel, numArgs + 5, idim);
 
-      enqueueKernel(commands_, kernel, deviceId_, {odim.h, odim.w, odim.c},
-                    kernelLaunches_);
+      planKernel(kernel, {odim.h, odim.w, odim.c});
       continue;
     }
 
     llvm::errs() << "Cannot select: " << I.getKindName() << "\n";
     GLOW_UNREACHABLE("compilation failed");
   }
+}
 
-  clFinish(commands_);
+void OpenCLFunction::bindDeviceBuffer() {
+  cl_mem buffer = memory_->getBuffer();
+  if (buffer == deviceBuffer_) {
+    return;
+  }
+  deviceBuffer_ = buffer;
+  for (auto &command : launchPlan_) {
+    if (command.kernel) {
+      setKernelArg(command.kernel, 0, deviceBuffer_);
+    }
+  }
+}
 
-  // Output profiling information.
-  dumpProfileInfo(kernelLaunches_);
+void OpenCLFunction::updateWeights(llvm::ArrayRef<Variable *> vars) {
+  std::lock_guard<std::shared_timed_mutex> lock(memory_->mutex_);
+  bindDeviceBuffer();
+  // The other weights, as well as the streamed ones, are copied to the device
+  // by every run. The constant weights are shared with the other functions
+  // of the module, which see the new payloads as well.
+  std::vector<const Value *> weights;
+  for (auto *V : vars) {
+    auto *W = llvm::dyn_cast_or_null<WeightVar>(F_->getWeightForNode(V));
+    if (W && W->getMutability() == WeightVar::MutabilityKind::Constant &&
+        tensors_.count(W) && !isStreamed_.count(W)) {
+      weights.push_back(W);
+    }
+  }
+  copyConstantWeightsToDevice(weights);
+  // The functions compiled later find the device copies of the new payloads.
+  for (auto *W : weights) {
+    cachedWeights_[W]->hash = externalTensors_[W]->getContentHash();
+  }
+}
 
-  for (auto &kl : kernelLaunches_) {
-    clReleaseKernel(kl.kernel_);
+void OpenCLFunction::executeStaged(llvm::ArrayRef<Tensor *> tensors) {
+  StagingBuffer staging;
+  {
+    std::unique_lock<std::mutex> lock(stagingMutex_);
+    stagingAvailable_.wait(lock,
+                           [&]() { return !freeStagingBuffers_.empty(); });
+    staging = freeStagingBuffers_.back();
+    freeStagingBuffers_.pop_back();
   }
-  kernelLaunches_.clear();
+  // The host copies run while the device may be busy with another run, and
+  // the transfers from pinned memory run at the full speed of the bus.
+  for (size_t i = 0, e = mutableWeights_.size(); i < e; i++) {
+    memcpy(staging.host + stagingOffsets_[i], tensors[i]->getUnsafePtr(),
+           mutableWeights_[i]->getSizeInBytes());
+  }
+  // The upload writes only to the device buffer of the staging buffer, which
+  // no other run uses, so it does not wait for the run that holds the lock.
+  cl_int err = clEnqueueWriteBuffer(
+      transferQueue_, staging.device, /* blocking_write */ CL_FALSE, 0,
+      stagingSize_, staging.host, 0, nullptr, &staging.uploaded);
+  GLOW_ASSERT(err == CL_SUCCESS && "Unable to upload a staging buffer");
+  clFlush(transferQueue_);
+  {
+    std::lock_guard<std::mutex> lock(executeMutex_);
+    std::shared_lock<std::shared_timed_mutex> memoryLock(memory_->mutex_);
+    executeImpl(&staging);
+  }
+  for (size_t i = 0, e = mutableWeights_.size(); i < e; i++) {
+    memcpy(tensors[i]->getUnsafePtr(), staging.host + stagingOffsets_[i],
+           mutableWeights_[i]->getSizeInBytes());
+  }
+  {
+    std::lock_guard<std::mutex> lock(stagingMutex_);
+    freeStagingBuffers_.push_back(staging);
+  }
+  stagingAvailable_.notify_one();
+}
+
+void OpenCLFunction::createStagingBuffers() {
+  stagingOffsets_.clear();
+  uint64_t stagingSize = 0;
+  for (auto *v : mutableWeights_) {
+    stagingOffsets_.push_back(stagingSize);
+    stagingSize += alignedSize(v->getSizeInBytes(), TensorAlignment);
+  }
+  stagingSize_ = stagingSize;
+  // The device reads the host memory in place if it shares it.
+  if (!numStagingBuffers || !stagingSize || memory_->usesHostMemory()) {
+    return;
+  }
+  cl_command_queue_properties properties = 0;
+  if (shouldProfile()) {
+    properties |= CL_QUEUE_PROFILING_ENABLE;
+  }
+  cl_int err;
+  transferQueue_ = clCreateCommandQueue(context_, deviceId_, properties, &err);
+  GLOW_ASSERT(transferQueue_ && "clCreateCommandQueue Failed.");
+  for (unsigned i = 0; i < numStagingBuffers; i++) {
+    StagingBuffer staging;
+    staging.buffer = clCreateBuffer(
+        context_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, stagingSize,
+        nullptr, &err);
+    GLOW_ASSERT(err == CL_SUCCESS && "Unable to allocate a staging buffer");
+    staging.host = static_cast<char *>(clEnqueueMapBuffer(
+        transferQueue_, staging.buffer, /* blocking_map */ CL_TRUE,
+        CL_MAP_READ | CL_MAP_WRITE, 0, stagingSize, 0, nullptr, nullptr,
+        &err));
+    GLOW_ASSERT(err == CL_SUCCESS && "Unable to map a staging buffer");
+    staging.device = clCreateBuffer(context_, CL_MEM_READ_ONLY, stagingSize,
+                                    nullptr, &err);
+    GLOW_ASSERT(err == CL_SUCCESS && "Unable to allocate a staging buffer");
+    stagingBuffers_.push_back(staging);
+  }
+  freeStagingBuffers_ = stagingBuffers_;
+  if (auto *report = getCurrentCompileReport()) {
+    report->addMemoryUsage("pinned staging buffers",
+                           stagingSize * numStagingBuffers);
+    report->addMemoryUsage("device staging buffers",
+                           stagingSize * numStagingBuffers);
+  }
+}
+
+void OpenCLFunction::executeImpl(const StagingBuffer *staging) {
+  ScopedTraceEvent trace(F_->getGraph()->getName(), "execute");
+  uint64_t traceBegin = isTracingEnabled() ? getTraceTimestamp() : 0;
+  bindDeviceBuffer();
+
+  // Every step waits for the last commands of the steps it depends on. A step
+  // that enqueues no commands passes its dependencies on to its users.
+  std::vector<std::vector<cl_event>> stepEvents(stepDependencies_.size());
+  size_t step = 0;
+  auto beginStep = [&]() {
+    waitList_.clear();
+    for (auto dep : stepDependencies_[step]) {
+      waitList_.insert(waitList_.end(), stepEvents[dep].begin(),
+                       stepEvents[dep].end());
+    }
+  };
+  auto endStep = [&]() { stepEvents[step++] = waitList_; };
+
+  // The uploads do not block, so they overlap with the kernels that do not
+  // need them.
+  // The staging buffer was uploaded before the run took the lock, so only
+  // copies within the device remain.
+  if (staging) {
+    events_.push_back(staging->uploaded);
+    if (shouldProfile()) {
+      kernelLaunches_.emplace_back(
+          KernelLaunch("copyToDevice", staging->uploaded));
+    }
+  }
+  uint64_t copiedToDeviceBytes = 0;
+  for (size_t i = 0, e = mutableWeights_.size(); i < e; i++) {
+    beginStep();
+    if (staging) {
+      copiedToDeviceBytes += copyStagedValueToDevice(
+          mutableWeights_[i], *staging, stagingOffsets_[i]);
+    } else {
+      copiedToDeviceBytes += copyValueToDevice(mutableWeights_[i]);
+    }
+    endStep();
+  }
+  (void)copiedToDeviceBytes;
+  DEBUG_GLOW(llvm::dbgs() << "Copied " << copiedToDeviceBytes
+                          << " bytes to OpenCL device\n");
 
-  auto copiedFromDeviceBytes = copyMutableWeightsFromDevice();
+  // Replay the launch plan. The steps of the instructions that launch nothing
+  // still pass their dependencies on.
+  size_t instrStepsEnd = stepDependencies_.size() - mutableWeights_.size();
+  auto command = launchPlan_.begin();
+  while (step < instrStepsEnd) {
+    beginStep();
+    for (; command != launchPlan_.end() && command->step == step; ++command) {
+      enqueuePlannedCommand(*command);
+    }
+    endStep();
+  }
+  assert(command == launchPlan_.end() && "Unplanned commands");
+
+  // Every download starts as soon as the value is final.
+  uint64_t copiedFromDeviceBytes = 0;
+  for (size_t i = 0, e = mutableWeights_.size(); i < e; i++) {
+    beginStep();
+    if (staging) {
+      copiedFromDeviceBytes +=
+          copyValueFromDevice(mutableWeights_[i],
+                              staging->host + stagingOffsets_[i],
+                              transferQueue_);
+    } else {
+      copiedFromDeviceBytes += copyValueFromDevice(mutableWeights_[i]);
+    }
+    endStep();
+  }
   (void)copiedFromDeviceBytes;
   DEBUG_GLOW(llvm::dbgs() << "Copied " << copiedFromDeviceBytes
                           << " bytes from OpenCL device\n");
+  assert(step == stepDependencies_.size() && "Wrong number of steps");
+
+  // This is the only point where the host waits for the device.
+  clFinish(commands_);
+  if (copyQueue_) {
+    clFinish(copyQueue_);
+  }
+  // The transfer queue also holds the upload of the next run, which this run
+  // does not wait for.
+  if (staging && !events_.empty()) {
+    clWaitForEvents(events_.size(), events_.data());
+  }
+
+  // Output profiling information.
+  traceKernelLaunches(kernelLaunches_, traceBegin, traceQueue_);
+  dumpProfileInfo(kernelLaunches_);
+
+  releaseCommands();
 }
 
 uint64_t OpenCLFunction::copyValueToDevice(const Value *v, void *buf) {
@@ -1389,12 +3008,35 @@ uint64_t OpenCLFunction::copyValueToDevice(const Value *v, void *buf) {
     }
     size_t valueOffset = it->second;
     cl_event event{nullptr};
-    cl_int err = clEnqueueWriteBuffer(
-        commands_, deviceBuffer_, /* blocking_read */ CL_FALSE, valueOffset,
-        sizeInBytes, buf, /* num_events_in_wait_list */ 0,
-        /* event_list */ nullptr, /* event */ doProfile ? &event : nullptr);
-    GLOW_ASSERT(err == CL_SUCCESS && "Unable to copy data to the device");
-    if (doProfile) {
+    cl_uint numWaitEvents;
+    const cl_event *waitList = getWaitList(numWaitEvents);
+    if (memory_->usesHostMemory()) {
+      // The device reads the host memory in place, so the value is written to
+      // it directly. The mapping waits for the commands that use the region.
+      // A tensor of getMappedTensor() is the region itself, whose contents
+      // the mapping keeps and only makes visible to the device.
+      bool inPlace = buf == static_cast<char *>(memory_->getHostMemory()) +
+                               valueOffset;
+      cl_int err;
+      void *ptr = clEnqueueMapBuffer(
+          commands_, deviceBuffer_, /* blocking_map */ CL_TRUE,
+          inPlace ? CL_MAP_WRITE : CL_MAP_WRITE_INVALIDATE_REGION, valueOffset,
+          sizeInBytes, numWaitEvents, waitList, nullptr, &err);
+      GLOW_ASSERT(err == CL_SUCCESS && "Unable to map the device buffer");
+      if (ptr != buf) {
+        memcpy(ptr, buf, sizeInBytes);
+      }
+      err = clEnqueueUnmapMemObject(commands_, deviceBuffer_, ptr, 0, nullptr,
+                                    &event);
+      GLOW_ASSERT(err == CL_SUCCESS && "Unable to unmap the device buffer");
+    } else {
+      cl_int err = clEnqueueWriteBuffer(
+          commands_, deviceBuffer_, /* blocking_write */ CL_FALSE, valueOffset,
+          sizeInBytes, buf, numWaitEvents, waitList, &event);
+      GLOW_ASSERT(err == CL_SUCCESS && "Unable to copy data to the device");
+    }
+    addEvent(event);
+    if (shouldProfile()) {
       kernelLaunches_.emplace_back(KernelLaunch("copyToDevice", event));
     }
     copiedBytes += sizeInBytes;
@@ -1402,7 +3044,32 @@ uint64_t OpenCLFunction::copyValueToDevice(const Value *v, void *buf) {
   return copiedBytes;
 }
 
-uint64_t OpenCLFunction::copyValueFromDevice(const Value *v, void *buf) {
+uint64_t OpenCLFunction::copyStagedValueToDevice(const Value *v,
+                                                 const StagingBuffer &staging,
+                                                 uint64_t stagingOffset) {
+  auto it = tensors_.find(v);
+  assert(it != tensors_.end() && "Unknown value");
+  size_t sizeInBytes = v->getType()->getSizeInBytes();
+  if (!sizeInBytes) {
+    return 0;
+  }
+  waitList_.push_back(staging.uploaded);
+  cl_event event{nullptr};
+  cl_uint numWaitEvents;
+  const cl_event *waitList = getWaitList(numWaitEvents);
+  cl_int err = clEnqueueCopyBuffer(commands_, staging.device, deviceBuffer_,
+                                   stagingOffset, it->second, sizeInBytes,
+                                   numWaitEvents, waitList, &event);
+  GLOW_ASSERT(err == CL_SUCCESS && "Error in clEnqueueCopyBuffer.");
+  addEvent(event);
+  if (shouldProfile()) {
+    kernelLaunches_.emplace_back(KernelLaunch("copy", event));
+  }
+  return sizeInBytes;
+}
+
+uint64_t OpenCLFunction::copyValueFromDevice(const Value *v, void *buf,
+                                             cl_command_queue queue) {
   uint64_t copiedBytes = 0;
   auto it = tensors_.find(v);
   assert(it != tensors_.end() && "Unknown value");
@@ -1416,14 +3083,38 @@ uint64_t OpenCLFunction::copyValueFromDevice(const Value *v, void *buf) {
     }
     size_t valueOffset = it->second;
     cl_event event{nullptr};
-    cl_int err = clEnqueueReadBuffer(
-        commands_, deviceBuffer_, /* blocking_read */ CL_FALSE, valueOffset,
-        sizeInBytes, buf, /* num_events_in_wait_list */ 0,
-        /* event_list */ nullptr, /* event */ doProfile ? &event : nullptr);
-    GLOW_ASSERT(err == CL_SUCCESS && "Unable to copy from the device");
+    cl_uint numWaitEvents;
+    const cl_event *waitList = getWaitList(numWaitEvents);
+    if (memory_->usesHostMemory()) {
+      // The mapping waits for the commands that produce the value, after
+      // which the value is read from the host memory directly. A tensor of
+      // getMappedTensor() already holds it.
+      cl_int err;
+      void *ptr = clEnqueueMapBuffer(commands_, deviceBuffer_,
+                                     /* blocking_map */ CL_TRUE, CL_MAP_READ,
+                                     valueOffset, sizeInBytes, numWaitEvents,
+                                     waitList, nullptr, &err);
+      GLOW_ASSERT(err == CL_SUCCESS && "Unable to map the device buffer");
+      if (ptr != buf) {
+        memcpy(buf, ptr, sizeInBytes);
+      }
+      err = clEnqueueUnmapMemObject(commands_, deviceBuffer_, ptr, 0, nullptr,
+                                    &event);
+      GLOW_ASSERT(err == CL_SUCCESS && "Unable to unmap the device buffer");
+    } else {
+      cl_int err = clEnqueueReadBuffer(
+          queue ? queue : commands_, deviceBuffer_,
+          /* blocking_read */ CL_FALSE, valueOffset, sizeInBytes, buf,
+          numWaitEvents, waitList, &event);
+      GLOW_ASSERT(err == CL_SUCCESS && "Unable to copy from the device");
+      if (queue) {
+        clFlush(queue);
+      }
+    }
+    addEvent(event);
     DEBUG_GLOW(llvm::dbgs() << "Copied the value from device: "
                             << it->first->getName() << "\n");
-    if (doProfile) {
+    if (shouldProfile()) {
       kernelLaunches_.emplace_back(KernelLaunch("copyFromDevice", event));
     }
     copiedBytes += sizeInBytes;
@@ -1431,56 +3122,234 @@ uint64_t OpenCLFunction::copyValueFromDevice(const Value *v, void *buf) {
   return copiedBytes;
 }
 
-uint64_t OpenCLFunction::copyMutableWeightsToDevice() {
+uint64_t OpenCLFunction::copyConstantWeightsToDevice(
+    llvm::ArrayRef<const Value *> weights, bool wait) {
   uint64_t copiedBytes = 0;
-  for (auto it : tensors_) {
-    if (!externalTensors_.count(it.first)) {
-      continue;
-    }
-    if (auto *W = dyn_cast<WeightVar>(it.first)) {
-      if (W->getMutability() == WeightVar::MutabilityKind::Constant)
-        continue;
-    }
-    copiedBytes += copyValueToDevice(it.first);
+  for (auto *w : weights) {
+    // The weights do not overlap, so the copies do not wait for each other.
+    waitList_.clear();
+    copiedBytes += copyValueToDevice(w);
   }
   // Do it!
-  clFinish(commands_);
+  if (wait) {
+    clFinish(commands_);
+  } else {
+    clFlush(commands_);
+  }
   return copiedBytes;
 }
 
-uint64_t OpenCLFunction::copyConstantWeightsToDevice() {
-  uint64_t copiedBytes = 0;
-  for (auto it : tensors_) {
-    if (!externalTensors_.count(it.first)) {
+const cl_event *OpenCLFunction::getWaitList(cl_uint &num) const {
+  num = waitList_.size();
+  return waitList_.empty() ? nullptr : waitList_.data();
+}
+
+void OpenCLFunction::addEvent(cl_event event) {
+  events_.push_back(event);
+  waitList_.assign(1, event);
+}
+
+void OpenCLFunction::releaseCommands() {
+  kernelLaunches_.clear();
+  for (auto event : events_) {
+    clReleaseEvent(event);
+  }
+  events_.clear();
+  waitList_.clear();
+}
+
+void OpenCLFunction::computeStepDependencies() {
+  // The device memory accessed by a step.
+  struct Access {
+    uint64_t begin;
+    uint64_t end;
+    bool isWrite;
+  };
+  std::vector<std::vector<Access>> steps;
+  auto addAccess = [&](const Value *v, bool isWrite) {
+    uint64_t begin = tensors_[v];
+    steps.back().push_back({begin, begin + v->getSizeInBytes(), isWrite});
+  };
+
+  mutableWeights_.clear();
+  mutableTensors_.clear();
+  for (auto it : externalTensors_) {
+    auto *W = dyn_cast<WeightVar>(it.first);
+    if (W && W->getMutability() == WeightVar::MutabilityKind::Constant) {
       continue;
     }
-    if (auto *W = dyn_cast<WeightVar>(it.first)) {
-      if (W->getMutability() != WeightVar::MutabilityKind::Constant)
-        continue;
+    mutableWeights_.push_back(it.first);
+    mutableTensors_.push_back(it.second);
+  }
+  for (auto *v : mutableWeights_) {
+    steps.emplace_back();
+    addAccess(v, true);
+  }
+  instrSteps_.clear();
+  size_t position = 0;
+  auto nextUpload = streamedWeights_.begin();
+  for (const auto &I : F_->getInstrs()) {
+    for (; nextUpload != streamedWeights_.end() &&
+           nextUpload->loadPosition == position;
+         ++nextUpload) {
+      nextUpload->uploadStep = steps.size();
+      uint64_t begin = nextUpload->address;
+      steps.push_back(
+          {{begin, begin + nextUpload->weight->getSizeInBytes(), true}});
+    }
+    useStreamedAddresses(position++);
+    instrSteps_[&I] = steps.size();
+    steps.emplace_back();
+    if (isa<AllocActivationInst>(I) || isa<DeallocActivationInst>(I) ||
+        isa<TensorViewInst>(I)) {
+      continue;
+    }
+    // The kernel of a fused bundle accesses the memory of all its
+    // instructions in the step of the last one.
+    auto fused = fusedBundleOf_.find(&I);
+    if (fused != fusedBundleOf_.end()) {
+      const auto &bundle = fusedBundles_[fused->second];
+      if (&I == bundle.back()) {
+        for (auto *BI : bundle) {
+          for (const auto &op : BI->getOperands()) {
+            addAccess(op.first, op.second != OperandKind::In);
+          }
+        }
+      }
+      continue;
+    }
+    for (const auto &op : I.getOperands()) {
+      addAccess(op.first, op.second != OperandKind::In);
+    }
+  }
+  for (auto *v : mutableWeights_) {
+    steps.emplace_back();
+    addAccess(v, false);
+  }
+
+  auto conflict = [](const std::vector<Access> &A,
+                     const std::vector<Access> &B) {
+    for (const auto &a : A) {
+      for (const auto &b : B) {
+        if ((a.isWrite || b.isWrite) && a.begin < b.end && b.begin < a.end) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+  stepDependencies_.assign(steps.size(), {});
+  for (size_t i = 0, e = steps.size(); i < e; i++) {
+    std::vector<size_t> deps;
+    for (size_t j = 0; j < i; j++) {
+      if (conflict(steps[i], steps[j])) {
+        deps.push_back(j);
+      }
+    }
+    // Drop the dependencies that another dependency already waits for.
+    std::vector<bool> implied(i, false);
+    for (auto dep : deps) {
+      for (auto indirect : stepDependencies_[dep]) {
+        implied[indirect] = true;
+      }
+    }
+    for (auto dep : deps) {
+      if (!implied[dep]) {
+        stepDependencies_[i].push_back(dep);
+      }
     }
-    copiedBytes += copyValueToDevice(it.first);
   }
-  // Do it!
-  clFinish(commands_);
-  return copiedBytes;
 }
 
-uint64_t OpenCLFunction::copyMutableWeightsFromDevice() {
-  size_t copiedBytes = 0;
-  clFinish(commands_);
+void OpenCLFunction::aliasCopiedActivations() {
+  std::unordered_map<const Instruction *, size_t> positions;
+  std::vector<const Instruction *> instrs;
+  for (const auto &I : F_->getInstrs()) {
+    positions[&I] = instrs.size();
+    instrs.push_back(&I);
+  }
+  // \returns the value whose memory \p v ends up in.
+  auto getRoot = [&](const Value *v) {
+    for (;;) {
+      v = getOrigin(v);
+      auto it = copyAliases_.find(v);
+      if (it == copyAliases_.end()) {
+        return v;
+      }
+      v = it->second;
+    }
+  };
 
-  for (auto it : tensors_) {
-    if (!externalTensors_.count(it.first)) {
+  for (size_t copyPos = 0, e = instrs.size(); copyPos < e; copyPos++) {
+    auto *C = dyn_cast<CopyInst>(instrs[copyPos]);
+    if (!C) {
+      continue;
+    }
+    auto *dest = dyn_cast<AllocActivationInst>(C->getDest());
+    const Value *root = getRoot(C->getSrc());
+    // The constant weights may be streamed, so their memory is not stable.
+    auto *W = dyn_cast<WeightVar>(root);
+    if (!dest || root == dest ||
+        (W && W->getMutability() == WeightVar::MutabilityKind::Constant) ||
+        (!W && !isa<AllocActivationInst>(root))) {
+      continue;
+    }
+    // The copy must be the only writer of the destination, and come before
+    // all the other accesses to it, either directly or through its views.
+    size_t end = 0;
+    bool isReadOnly = true;
+    std::vector<const Value *> worklist{dest};
+    while (!worklist.empty() && isReadOnly) {
+      const Value *v = worklist.back();
+      worklist.pop_back();
+      for (const auto &U : v->getUsers()) {
+        const Instruction *I = U.get();
+        if (I == C) {
+          continue;
+        }
+        if (isa<DeallocActivationInst>(I)) {
+          end = positions[I];
+          continue;
+        }
+        if (positions[I] < copyPos) {
+          isReadOnly = false;
+          break;
+        }
+        if (isa<TensorViewInst>(I)) {
+          worklist.push_back(I);
+          continue;
+        }
+        for (const auto &op : I->getOperands()) {
+          if (op.first == v && op.second != OperandKind::In) {
+            isReadOnly = false;
+          }
+        }
+      }
+    }
+    if (!isReadOnly || end <= copyPos) {
       continue;
     }
-    if (auto *W = dyn_cast<WeightVar>(it.first)) {
-      if (W->getMutability() == WeightVar::MutabilityKind::Constant)
+    // The source must keep the copied value, and its memory, while the
+    // destination is alive. The deallocations of the other aliases of the
+    // source do not release its memory.
+    bool isStable = true;
+    for (size_t pos = copyPos + 1; pos < end && isStable; pos++) {
+      auto *DA = dyn_cast<DeallocActivationInst>(instrs[pos]);
+      if (DA && copyAliases_.count(DA->getAlloc())) {
         continue;
+      }
+      for (const auto &op : instrs[pos]->getOperands()) {
+        if (op.second != OperandKind::In && getRoot(op.first) == root) {
+          isStable = false;
+        }
+      }
+    }
+    if (isStable) {
+      copyAliases_[dest] = C->getSrc();
     }
-    copiedBytes += copyValueFromDevice(it.first);
   }
-  clFinish(commands_);
-  return copiedBytes;
+  DEBUG_GLOW(llvm::dbgs() << "Eliminated " << copyAliases_.size()
+                          << " device copies\n");
 }
 
 void OpenCLFunction::allocateMemory(const Context &ctx) {
@@ -1501,22 +3370,130 @@ void OpenCLFunction::allocateMemory(const Context &ctx) {
     externalTensors_[w] = PH.second;
   }
 
-  // Assign device-space addresses to the weights.
+  // Collect the weights that are not constant, which live during the whole
+  // program, and the lifetimes of the activations, and assign addresses in
+  // the region of the function to all of them at once.
+  std::vector<const Value *> constantWeights;
+  std::unordered_map<const Value *, size_t> hashes;
+  uint64_t newWeightsSize = 0;
+  std::vector<MemoryAllocator::Allocation> allocList;
   for (auto it : externalTensors_) {
+    auto *W = dyn_cast<WeightVar>(it.first);
     Tensor *T = it.second;
-    size_t sizeInBytes = T->getType().getSizeInBytes();
-    size_t addr = allocator.allocate(sizeInBytes, it.first);
-    // Associate the new buffer with the weight value.
-    tensors_[it.first] = addr;
+    if (W && W->getMutability() == WeightVar::MutabilityKind::Constant) {
+      constantWeights.push_back(W);
+      size_t hash = T->getContentHash();
+      hashes[W] = hash;
+      if (!memory_->findWeight(T, hash)) {
+        newWeightsSize += alignedSize(T->getType().getSizeInBytes(),
+                                      TensorAlignment);
+      }
+      continue;
+    }
+    allocList.emplace_back(it.first, true, T->getType().getSizeInBytes());
+  }
+  // The activations that share the memory of a copied value need none.
+  aliasCopiedActivations();
+  for (const auto &I : F_->getInstrs()) {
+    if (auto *A = llvm::dyn_cast<AllocActivationInst>(&I)) {
+      if (!copyAliases_.count(A)) {
+        allocList.emplace_back(A, true, I.getSizeInBytes());
+      }
+    } else if (auto *D = llvm::dyn_cast<DeallocActivationInst>(&I)) {
+      if (!copyAliases_.count(D->getAlloc())) {
+        allocList.emplace_back(D->getAlloc(), false, 0);
+      }
+    }
+  }
+  GLOW_ASSERT(allocator.allocateAll(allocList) != MemoryAllocator::npos &&
+              "Not enough device memory");
+
+  // Ask the memory allocator how much memory is required. What was the high
+  // watermark for this program.
+  uint64_t requiredSpace = allocator.getMaxMemoryUsage();
+  if (auto *report = getCurrentCompileReport()) {
+    report->addMemoryUsage("device buffer", requiredSpace);
+  }
+  DEBUG_GLOW(llvm::dbgs() << "Allocated GPU memory block of size: "
+                          << requiredSpace << "\n");
+
+  // The constant weights are stored in the shared memory. The other
+  // functions of the module may have uploaded them already. If the new ones
+  // do not fit next to the region of the function, they are streamed through
+  // the rest of the device memory instead, which becomes part of the region.
+  uint64_t activationsSize = alignedSize(requiredSpace, TensorAlignment);
+  uint64_t available = memory_->getAvailableSize();
+  bool stream = activationsSize + newWeightsSize > available;
+  uint64_t poolSize = 0;
+  if (stream) {
+    GLOW_ASSERT(activationsSize < available && "Not enough device memory");
+    poolSize = available - activationsSize;
+    DEBUG_GLOW(llvm::dbgs() << "Streaming " << newWeightsSize
+                            << " bytes of weights through a pool of "
+                            << poolSize << " bytes\n");
+    if (auto *report = getCurrentCompileReport()) {
+      report->addMemoryUsage("streamed weights pool", poolSize);
+    }
+  }
+  // The device copies of the placeholders count with the activations. The
+  // programs are owned by the OpenCL runtime, which does not tell their size.
+  memoryUsage_ = MemoryUsage();
+  for (auto &v : F_->getGraph()->getParent()->getVars()) {
+    auto *W = dyn_cast_or_null<WeightVar>(F_->getWeightForNode(v));
+    if (W && W->getMutability() != WeightVar::MutabilityKind::Constant) {
+      memoryUsage_.mutableWeights += v->getType()->getSizeInBytes();
+    }
+  }
+  memoryUsage_.activations =
+      requiredSpace - std::min(requiredSpace, memoryUsage_.mutableWeights);
+  memoryUsage_.scratch = poolSize;
+
+  deviceBuffer_ = nullptr;
+  std::vector<const Value *> newWeights;
+  for (auto *W : constantWeights) {
+    Tensor *T = externalTensors_[W];
+    size_t hash = hashes[W];
+    if (stream && !memory_->findWeight(T, hash)) {
+      isStreamed_.insert(W);
+      continue;
+    }
+    memoryUsage_.constantWeights += T->getType().getSizeInBytes();
+    bool isNew;
+    auto *cached = memory_->retainWeight(T, hash, commands_, isNew);
+    tensors_[W] = cached->address;
+    cachedWeights_[W] = cached;
+    if (isNew) {
+      newWeights.push_back(W);
+    }
+  }
+  uint64_t regionAddress = memory_->allocateRegion(
+      stream ? activationsSize + poolSize : requiredSpace, this, commands_);
+
+  // Associate the new buffers with the weight values.
+  for (auto it : externalTensors_) {
+    if (!tensors_.count(it.first)) {
+      tensors_[it.first] = regionAddress + allocator.getAddress(it.first);
+    }
   }
 
-  // Assign device-space addresses to the activations.
   for (const auto &I : F_->getInstrs()) {
     if (auto *A = llvm::dyn_cast<AllocActivationInst>(&I)) {
-      auto numBytes = I.getSizeInBytes();
-      size_t addr = allocator.allocate(numBytes, A);
+      if (copyAliases_.count(A)) {
+        continue;
+      }
       assert(!tensors_.count(A) && "Allocation already made!");
-      tensors_[A] = addr;
+      tensors_[A] = regionAddress + allocator.getAddress(A);
+      continue;
+    }
+
+    // The aliases of the copied values get their addresses at the copy,
+    // before any of their views.
+    if (auto *C = llvm::dyn_cast<CopyInst>(&I)) {
+      auto it = copyAliases_.find(C->getDest());
+      if (it != copyAliases_.end()) {
+        assert(tensors_.count(it->second) && "Source allocation not found!");
+        tensors_[C->getDest()] = tensors_[it->second];
+      }
       continue;
     }
 
@@ -1524,42 +3501,121 @@ void OpenCLFunction::allocateMemory(const Context &ctx) {
       // Calculate and store the length of the offset into the base, using the
       // source of the tensorview.
       assert(!tensors_.count(TV) && "Allocation already made!");
-      size_t offsetLength = TV->getOffsets().empty() ? 0 : TV->getOffsets()[0];
+      size_t offsetLength = getTensorViewOffset(TV);
       auto *tvSource = TV->getSrc();
-      if (tvSource->dims().size() > 1) {
-        for (size_t i = 1; i < tvSource->dims().size(); ++i) {
-          offsetLength *= tvSource->dims()[i];
-        }
-      }
       assert(tensors_.count(tvSource) && "Source allocation not found!");
       tensors_[TV] =
           tensors_[tvSource] + (offsetLength * TV->getType()->getElementSize());
-      continue;
     }
+  }
 
-    if (auto *D = llvm::dyn_cast<DeallocActivationInst>(&I)) {
-      auto *A = D->getAlloc();
-      assert(tensors_.count(A) && "Invalid deallocation!");
-      allocator.deallocate(A);
-      continue;
+  deviceBuffer_ = memory_->getBuffer();
+  formFusedBundles();
+  if (stream) {
+    cl_command_queue_properties properties = 0;
+    if (shouldProfile()) {
+      properties |= CL_QUEUE_PROFILING_ENABLE;
     }
+    cl_int err;
+    copyQueue_ = clCreateCommandQueue(context_, deviceId_, properties, &err);
+    GLOW_ASSERT(copyQueue_ && "clCreateCommandQueue Failed.");
+    planWeightStreaming(regionAddress + activationsSize, poolSize);
   }
+  computeStepDependencies();
+  createStagingBuffers();
+  // Start copying the constant weights that are not on the device yet. The
+  // constructor waits for them after building the launch plan.
+  copyConstantWeightsToDevice(newWeights, /* wait */ false);
+}
 
-  // Ask the memory allocator how much memory is required. What was the high
-  // watermark for this program.
-  uint64_t requiredSpace = allocator.getMaxMemoryUsage();
-  DEBUG_GLOW(llvm::dbgs() << "Allocated GPU memory block of size: "
-                          << requiredSpace << "\n");
+void OpenCLFunction::planWeightStreaming(uint64_t poolAddress,
+                                         uint64_t poolSize) {
+  // The kernel of a fused bundle uses the weights of all its instructions at
+  // the position of the last one.
+  std::vector<const Instruction *> instrs;
+  for (const auto &I : F_->getInstrs()) {
+    instrs.push_back(&I);
+  }
+  std::unordered_map<const Instruction *, size_t> positions;
+  for (size_t i = 0, e = instrs.size(); i < e; i++) {
+    positions[instrs[i]] = i;
+  }
+  std::vector<std::vector<const Value *>> uses(instrs.size());
+  std::unordered_map<const Value *, size_t> lastUses;
+  for (size_t i = 0, e = instrs.size(); i < e; i++) {
+    size_t position = i;
+    auto fused = fusedBundleOf_.find(instrs[i]);
+    if (fused != fusedBundleOf_.end()) {
+      position = positions[fusedBundles_[fused->second].back()];
+    }
+    for (const auto &op : instrs[i]->getOperands()) {
+      auto &posUses = uses[position];
+      if (isStreamed_.count(op.first) &&
+          std::find(posUses.begin(), posUses.end(), op.first) ==
+              posUses.end()) {
+        posUses.push_back(op.first);
+        lastUses[op.first] = position;
+      }
+    }
+  }
 
-  // Release the memory from the previous run.
-  if (deviceBuffer_) {
-    freeDeviceBuffer(deviceBuffer_);
-    deviceBuffer_ = nullptr;
+  // Replay the uses in order. The weights used by the next few instructions
+  // are uploaded ahead of time, nearest uses first. The pool evicts the
+  // weights that are not about to be used when it is full, and a weight that
+  // is not used anymore is freed right after its last use.
+  MemoryAllocator pool("GPU streamed weights", poolSize);
+  std::unordered_map<const Value *, size_t> stays;
+  streamedWeights_.clear();
+  for (size_t pos = 0, e = instrs.size(); pos < e; pos++) {
+    size_t windowEnd = std::min<size_t>(e, pos + prefetchDistance + 1);
+    std::set<MemoryAllocator::Handle> mustNotEvict;
+    for (size_t next = pos; next < windowEnd; next++) {
+      for (auto *W : uses[next]) {
+        mustNotEvict.insert(W);
+      }
+    }
+    for (size_t next = pos; next < windowEnd; next++) {
+      for (auto *W : uses[next]) {
+        if (stays.count(W)) {
+          continue;
+        }
+        std::vector<MemoryAllocator::Handle> evicted;
+        uint64_t address =
+            pool.allocate(W->getSizeInBytes(), W, mustNotEvict, evicted);
+        for (auto handle : evicted) {
+          stays.erase(static_cast<const Value *>(handle));
+        }
+        if (address == MemoryAllocator::npos) {
+          // Prefetching is only an optimization: the upload is retried at
+          // the next position, until the weight is needed.
+          GLOW_ASSERT(next != pos &&
+                      "Not enough device memory to stream the weights");
+          continue;
+        }
+        stays[W] = streamedWeights_.size();
+        streamedWeights_.push_back(
+            {W, poolAddress + address, pos, next, next, 0});
+      }
+    }
+    for (auto *W : uses[pos]) {
+      streamedWeights_[stays[W]].lastUse = pos;
+      if (lastUses[W] == pos) {
+        pool.deallocate(W);
+        stays.erase(W);
+      }
+    }
   }
+  DEBUG_GLOW(llvm::dbgs() << "Planned " << streamedWeights_.size()
+                          << " uploads of " << isStreamed_.size()
+                          << " streamed weights\n");
+}
 
-  deviceBuffer_ = allocDeviceBuffer(requiredSpace);
-  // Copy constant weights just once.
-  copyConstantWeightsToDevice();
+void OpenCLFunction::useStreamedAddresses(size_t position) {
+  for (const auto &SW : streamedWeights_) {
+    if (SW.firstUse <= position && position <= SW.lastUse) {
+      tensors_[SW.weight] = SW.address;
+    }
+  }
 }
 
 Tensor *OpenCLFunction::getTensor(const Value *v) const {
@@ -1568,26 +3624,15 @@ Tensor *OpenCLFunction::getTensor(const Value *v) const {
   return ie->second;
 }
 
-cl_mem OpenCLFunction::allocDeviceBuffer(uint64_t size) {
-  const uint64_t alignment = 128;
-  // Always allocate buffers properly aligned to hold values of any type.
-  size = alignedSize(size, alignment);
-  auto buf =
-      clCreateBuffer(context_, CL_MEM_READ_WRITE, size, nullptr, nullptr);
-  GLOW_ASSERT(buf && "Allocation failed!");
-  return buf;
-}
-
-void OpenCLFunction::freeDeviceBuffer(cl_mem buf) { clReleaseMemObject(buf); }
-
 std::unique_ptr<CompiledFunction>
 OCLBackend::compileIR(std::unique_ptr<IRFunction> IR,
                       const Context &ctx) const {
-  return llvm::make_unique<OpenCLFunction>(std::move(IR), ctx);
+  return llvm::make_unique<OpenCLFunction>(std::move(IR), ctx, deviceIdx_);
 }
 
 std::unique_ptr<CompiledFunction>
 OCLBackend::compile(Function *F, const Context &ctx) const {
-  auto IR = generateAndOptimizeIR(F, shouldShareBuffers());
+  auto IR = generateAndOptimizeIR(F, shouldShareBuffers(),
+                                  getCompileSchedulerKind());
   return compileIR(std::move(IR), ctx);
 }
@@ -20,11 +20,18 @@
 #include "glow/Backends/CompiledFunction.h"
 #include "glow/Base/Tensor.h"
 #include "glow/Base/Traits.h"
+#include "glow/CodeGen/MemoryAllocator.h"
 #include "glow/Graph/Context.h"
 #include "glow/Graph/Node.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #if defined(__APPLE__) || defined(__MACOSX)
 #include "OpenCL/opencl.h"
@@ -35,12 +42,16 @@
 namespace glow {
 
 class IRFunction;
+class DebugPrintInst;
+class Instruction;
+class Module;
+class MatMulInst;
 class OCLConvolutionInst;
 class Value;
 
 /// A helper struct with information about kernels launches.
 struct KernelLaunch {
-  /// Kernel that was launched.
+  /// Kernel that was launched. It is owned by the launch plan.
   cl_kernel kernel_;
   /// The name of the kernel that was launched.
   std::string name_;
@@ -56,6 +67,123 @@ struct KernelLaunch {
       : kernel_(nullptr), name_(name), event_(event) {}
 };
 
+/// The device memory shared by the OpenCL functions that are compiled from
+/// the same module for the same device. All of them use one context and one
+/// device buffer, in which every function allocates a region for its
+/// activations and mutable weights. The constant weights are stored in the
+/// buffer once: the first function that uses a weight uploads it and the
+/// following ones reference it. A stored weight is identified by its payload
+/// and by the content hash of the payload, so a function compiled after the
+/// payload changed, or from a new payload at the address of a freed one,
+/// uploads its own copy. A weight is freed when the last function that uses
+/// it is destroyed. On devices that share memory with the host, the
+/// buffer may be allocated in host memory, in which case the transfers map
+/// it in place instead of copying it through the driver. The buffer never
+/// grows beyond the memory limit of the device: a function whose constant
+/// weights do not fit streams them through a pool in its region instead.
+class OpenCLDeviceMemory final {
+public:
+  /// A constant weight stored in the buffer.
+  struct CachedWeight {
+    /// The content hash of the payload that is stored.
+    size_t hash;
+    /// The address of the weight in the buffer.
+    uint64_t address;
+    /// The number of functions that use the weight.
+    unsigned refCount;
+  };
+
+private:
+  /// The device.
+  cl_device_id deviceId_;
+  /// The module whose functions use the memory.
+  const Module *module_;
+  /// The context shared by the functions.
+  cl_context context_;
+  /// The device buffer, or null if nothing is allocated yet.
+  cl_mem buffer_{nullptr};
+  /// The size of buffer_.
+  uint64_t bufferSize_{0};
+  /// The largest size of buffer_.
+  uint64_t limit_;
+  /// The host memory backing buffer_, or null if the buffer is allocated by
+  /// the driver.
+  void *hostMemory_{nullptr};
+  /// The alignment of hostMemory_, or 0 if the buffer is allocated by the
+  /// driver.
+  size_t hostAlignment_{0};
+  /// Assigns addresses in the buffer to the regions and to the weights.
+  MemoryAllocator allocator_{"GPU", 0xFFFFFFFF};
+  /// The constant weights, indexed by their payloads on the host. A payload
+  /// has several entries if functions were compiled with several of its
+  /// contents. The entries do not move, so the functions refer to them.
+  std::unordered_multimap<const Tensor *, CachedWeight> weights_;
+
+  /// Make the buffer at least \p size bytes large. The contents are copied
+  /// to the new buffer through \p queue.
+  void reserve(uint64_t size, cl_command_queue queue);
+
+public:
+  /// Held shared by the executions of the functions that use the memory, and
+  /// exclusively by the allocations, which may replace the buffer that their
+  /// commands address, and by the updates of the constant weights. The
+  /// executions of a function are serialized by the function.
+  std::shared_timed_mutex mutex_;
+
+  OpenCLDeviceMemory(cl_device_id deviceId, const Module *M);
+
+  /// Frees the buffer and removes the memory from the registry of get().
+  ~OpenCLDeviceMemory();
+
+  /// \returns the memory shared by the functions compiled from \p M for the
+  /// device \p deviceId. The memory is created by the first such function
+  /// and forgotten once the last one is destroyed, so that a module created
+  /// later at the same address gets a memory of its own.
+  static std::shared_ptr<OpenCLDeviceMemory> get(cl_device_id deviceId,
+                                                 const Module *M);
+
+  /// \returns the context shared by the functions.
+  cl_context getContext() const { return context_; }
+
+  /// \returns the device buffer. It may be replaced by a larger buffer when
+  /// memory is allocated.
+  cl_mem getBuffer() const { return buffer_; }
+
+  /// \returns true if the buffer is backed by host memory, so that mapping it
+  /// does not copy its contents.
+  bool usesHostMemory() const { return hostAlignment_ != 0; }
+
+  /// \returns the host memory backing the buffer, or null if the buffer is
+  /// allocated by the driver. It moves when the buffer grows.
+  void *getHostMemory() const { return hostMemory_; }
+
+  /// Allocate a region of \p size bytes owned by \p owner. \p queue is used
+  /// to copy the contents if the buffer grows. \returns the address of the
+  /// region.
+  uint64_t allocateRegion(uint64_t size, const void *owner,
+                          cl_command_queue queue);
+
+  /// Free the region owned by \p owner.
+  void freeRegion(const void *owner);
+
+  /// \returns the number of bytes that can still be allocated after the
+  /// highest allocated address without exceeding the memory limit.
+  uint64_t getAvailableSize() const;
+
+  /// \returns the constant weight whose payload is \p T with the content hash
+  /// \p hash, or null if it is not stored.
+  CachedWeight *findWeight(const Tensor *T, size_t hash);
+
+  /// Take a reference to the constant weight whose payload is \p T with the
+  /// content hash \p hash, allocating it if it is not stored yet. \p isNew is
+  /// set if the caller must upload the payload. \returns the weight.
+  CachedWeight *retainWeight(const Tensor *T, size_t hash,
+                             cl_command_queue queue, bool &isNew);
+
+  /// Drop a reference to the constant weight \p W.
+  void releaseWeight(CachedWeight *W);
+};
+
 /// A Glow IR function compiled for OpenCL.
 class OpenCLFunction final : public CompiledFunction {
   /// A helper type representing a key for the program's cache.
@@ -77,64 +205,300 @@ class OpenCLFunction final : public CompiledFunction {
   std::unordered_map<const Value *, Tensor *> externalTensors_;
   /// CL compute device id.
   cl_device_id deviceId_;
-  /// CL compute context.
+  /// The device memory shared with the other functions of the module.
+  std::shared_ptr<OpenCLDeviceMemory> memory_;
+  /// CL compute context, which is owned by memory_.
   cl_context context_;
   /// CL compute command queue.
   cl_command_queue commands_;
+  /// The command queue that uploads the streamed weights while the kernels
+  /// run, or null if no weight is streamed.
+  cl_command_queue copyQueue_{nullptr};
   /// Cache of compiled programs.
   /// The same source code can be compile with different options (e.g. with
   /// different set of macro definitions) and/or for a different device and
   /// would result in different programs.
   std::unordered_map<ProgramKey, cl_program, ProgramKeyHash> programsCache_;
-  /// A pointer to the on-device memory buffer.
+  /// A pointer to the on-device memory buffer, which is owned by memory_.
   cl_mem deviceBuffer_{0};
+  /// The constant weights of the function that are stored in memory_.
+  std::unordered_map<const Value *, OpenCLDeviceMemory::CachedWeight *>
+      cachedWeights_;
+  /// Serializes the runs of the function, which share its region of the
+  /// device memory and its launch plan.
+  std::mutex executeMutex_;
+  /// The device memory used by the function, computed by allocateMemory().
+  MemoryUsage memoryUsage_;
   /// Information about kernel launches.
   std::vector<KernelLaunch> kernelLaunches_;
 
+  /// A command of the launch plan.
+  struct PlannedCommand {
+    /// The step of the instruction that enqueues the command.
+    size_t step{0};
+    /// The kernel to launch, with all its arguments set, or null if the
+    /// command is a copy or a print.
+    cl_kernel kernel{nullptr};
+    /// The name of the kernel.
+    std::string name;
+    /// The work sizes of the kernel.
+    llvm::SmallVector<size_t, 3> global;
+    llvm::SmallVector<size_t, 3> local;
+    /// The instruction whose value is printed, if the command is a print.
+    const DebugPrintInst *print{nullptr};
+    /// The streamed weight that is uploaded, if the command is an upload.
+    const Value *upload{nullptr};
+    /// The source, destination and size of the copy within the device buffer.
+    uint64_t srcOffset{0};
+    uint64_t destOffset{0};
+    uint64_t sizeInBytes{0};
+  };
+  /// The commands of the instructions, in order. The kernels are created,
+  /// their arguments are set and their work sizes are computed once at
+  /// compile time, so a run only enqueues them.
+  std::vector<PlannedCommand> launchPlan_;
+  /// The step of the instruction being planned.
+  size_t planStep_{0};
+  /// Maps the instructions to their steps.
+  std::unordered_map<const Instruction *, size_t> instrSteps_;
+
+  /// A stay of a streamed weight in the streaming pool. The weight is
+  /// uploaded to \p address in its own step, before the instruction at the
+  /// position \p loadPosition, and is used by the instructions from the
+  /// position \p firstUse to \p lastUse. The positions index the
+  /// instructions of the function.
+  struct StreamedWeight {
+    const Value *weight;
+    uint64_t address;
+    size_t loadPosition;
+    size_t firstUse;
+    size_t lastUse;
+    /// The step of the upload.
+    size_t uploadStep;
+  };
+  /// The stays of the constant weights that do not fit into the device
+  /// memory, ordered by their uploads. A weight may be uploaded more than
+  /// once per run, if it is evicted between two of its uses.
+  std::vector<StreamedWeight> streamedWeights_;
+  /// The constant weights that are streamed.
+  std::unordered_set<const Value *> isStreamed_;
+  /// Maps the activations that are written only by a copy to the source of
+  /// the copy. They are not allocated: they share the memory of the source,
+  /// which keeps its value while they are alive, and the copy is skipped.
+  std::unordered_map<const Value *, const Value *> copyAliases_;
+  /// The maximal sequences of adjacent element-wise instructions that run as
+  /// a single generated kernel, which keeps the intermediate values in
+  /// registers. Every bundle has at least two instructions.
+  std::vector<std::vector<const Instruction *>> fusedBundles_;
+  /// Maps the instructions of fusedBundles_ to the index of their bundle.
+  std::unordered_map<const Instruction *, size_t> fusedBundleOf_;
+  /// The thread of the command queue on the device timeline of the trace.
+  uint64_t traceQueue_;
+  /// The mutable weights, which are uploaded before every run and downloaded
+  /// after it.
+  std::vector<const Value *> mutableWeights_;
+  /// The tensors bound to mutableWeights_ at compile time.
+  std::vector<Tensor *> mutableTensors_;
+
+  /// A pinned host buffer through which a run uploads and downloads the
+  /// mutable weights, each at its offset of stagingOffsets_.
+  struct StagingBuffer {
+    cl_mem buffer{nullptr};
+    /// The host address of the buffer, which stays mapped.
+    char *host{nullptr};
+    /// The device buffer to which a run uploads the mutable weights before it
+    /// waits for the other runs. The run then copies them within the device
+    /// to the region of the function.
+    cl_mem device{nullptr};
+    /// The event of the upload to \p device of the run using the buffer.
+    cl_event uploaded{nullptr};
+  };
+  /// The offsets of mutableWeights_ in the staging buffers.
+  std::vector<uint64_t> stagingOffsets_;
+  /// The size of every staging buffer.
+  uint64_t stagingSize_{0};
+  /// The staging buffers that no run is using.
+  std::vector<StagingBuffer> freeStagingBuffers_;
+  /// All the staging buffers.
+  std::vector<StagingBuffer> stagingBuffers_;
+  /// Guards freeStagingBuffers_. The runs fill and drain their staging
+  /// buffers without holding the mutex of memory_.
+  std::mutex stagingMutex_;
+  /// Signaled when a staging buffer is released.
+  std::condition_variable stagingAvailable_;
+  /// The command queue of the transfers between the staging buffers and the
+  /// device, or null if the runs do not stage the mutable weights.
+  cl_command_queue transferQueue_{nullptr};
+  /// The commands of a run are grouped into steps: the upload of every mutable
+  /// weight, every instruction, preceded by the uploads of the streamed
+  /// weights that start before it, and the download of every mutable weight,
+  /// in this order. This holds for every step the earlier steps that access
+  /// overlapping device memory, at least one of them writing to it. The
+  /// commands of a step wait only for the commands of these steps.
+  std::vector<std::vector<size_t>> stepDependencies_;
+  /// The events that the next enqueued command waits for.
+  std::vector<cl_event> waitList_;
+  /// The events of all commands enqueued since the last release.
+  std::vector<cl_event> events_;
+  /// Identifies the device and its driver in the keys of the tuned kernel
+  /// parameters. Empty if the parameters are not tuned.
+  std::string tuningDeviceKey_;
+
+  /// The tunable parameters of the fast convolution kernel.
+  struct ConvolutionConfig {
+    /// The workgroup size along the output pixels.
+    size_t wgs0;
+    /// The workgroup size along the output channels.
+    size_t wgs1;
+    /// The work per thread along the output pixels.
+    size_t wptn;
+    /// The work per thread along the output channels.
+    size_t wptm;
+    /// The tile size along the reduction dimension.
+    size_t tsk;
+  };
+
 public:
-  /// Ctor.
-  explicit OpenCLFunction(std::unique_ptr<IRFunction> F, const Context &ctx);
+  /// Ctor. The function runs on the device \p deviceIdx of the selected
+  /// platform.
+  OpenCLFunction(std::unique_ptr<IRFunction> F, const Context &ctx,
+                 unsigned deviceIdx);
 
   /// @name CompiledFunction interface
   ///@{
   ~OpenCLFunction() override;
 
   void execute() override;
+
+  void execute(Context &ctx) override;
+
+  void updateWeights(llvm::ArrayRef<Variable *> vars) override;
+
+  MemoryUsage getMemoryUsage() const override { return memoryUsage_; }
   ///@}
 
+  /// \returns an unowned tensor of the type of the placeholder \p PH whose
+  /// payload is the region of \p PH in the device buffer, or an empty tensor
+  /// if the buffer is not in host memory (see -opencl-zero-copy). The runs of
+  /// a context that binds \p PH to the tensor read their input from it and
+  /// write their output to it in place. The tensor is valid until the buffer
+  /// grows, which compiling another function of the module or updating the
+  /// constant weights may do.
+  Tensor getMappedTensor(const Placeholder *PH);
+
 private:
+  /// Bind the planned kernels to the shared device buffer, which another
+  /// function may have grown since they were last bound.
+  void bindDeviceBuffer();
+  /// Run the function on the tensors registered in externalTensors_, or on
+  /// the mutable weights uploaded to \p staging if it is not null. The caller
+  /// must hold the mutex of memory_.
+  void executeImpl(const StagingBuffer *staging = nullptr);
+  /// Run the function on the mutable weights \p tensors, which are ordered
+  /// like mutableWeights_, through a staging buffer. The upload overlaps with
+  /// the run that holds executeMutex_.
+  void executeStaged(llvm::ArrayRef<Tensor *> tensors);
+  /// Create the staging buffers of the mutable weights, if the runs use them.
+  void createStagingBuffers();
+  /// Build launchPlan_ from the instructions of the function.
+  void buildLaunchPlan();
+  /// Compute fusedBundles_ from the instructions and their device addresses.
+  void formFusedBundles();
+  /// \returns the source of the kernel \p name that runs the fused bundle
+  /// \p bundleIdx, every work item computing \p width elements. \p addresses
+  /// receives the device addresses of the buffers, which are the arguments of
+  /// the kernel after the device buffer. When \p width is larger than 1, the
+  /// number of elements is the last argument.
+  std::string getFusedKernelSource(llvm::StringRef name, size_t bundleIdx,
+                                   size_t width,
+                                   std::vector<uint64_t> &addresses);
+  /// Enqueue the planned \p command on the command queue.
+  void enqueuePlannedCommand(const PlannedCommand &command);
+  /// Compute copyAliases_ from the instructions of the function.
+  void aliasCopiedActivations();
   /// Allocate memory for the tensors.
   void allocateMemory(const Context &ctx);
+  /// Compute streamedWeights_ for the weights of isStreamed_, which are
+  /// streamed through the pool of \p poolSize bytes at the device address
+  /// \p poolAddress. Every weight is uploaded up to -opencl-prefetch-distance
+  /// instructions ahead of its use, and is evicted once it is not used
+  /// anymore or when the pool is full.
+  void planWeightStreaming(uint64_t poolAddress, uint64_t poolSize);
+  /// Point tensors_ at the addresses of the streamed weights used by the
+  /// instruction at the position \p position.
+  void useStreamedAddresses(size_t position);
+  /// Compute stepDependencies_ from the device addresses of the values.
+  void computeStepDependencies();
+  /// \returns the wait list of the next enqueued command and fills \p num
+  /// with its length.
+  const cl_event *getWaitList(cl_uint &num) const;
+  /// Record the \p event of an enqueued command. The following commands of
+  /// the same step wait for it.
+  void addEvent(cl_event event);
+  /// Release the events of the finished commands.
+  void releaseCommands();
   /// Copy the value from a device to a provided buffer.
   /// If \p buf is nullptr, the payload of the underlying tensor is used.
+  /// The copy is enqueued on \p queue, or on commands_ if it is null.
   /// \returns number of copied bytes.
-  uint64_t copyValueFromDevice(const Value *v, void *buf = nullptr);
+  uint64_t copyValueFromDevice(const Value *v, void *buf = nullptr,
+                               cl_command_queue queue = nullptr);
   /// Copy value from the provided buffer to the device.
   /// If \p buf is nullptr, the payload of the underlying tensor is used.
   /// \returns number of copied bytes.
   uint64_t copyValueToDevice(const Value *v, void *buf = nullptr);
-  /// Copy mutable weights to the device.
-  /// \returns number of copied bytes.
-  uint64_t copyMutableWeightsToDevice();
-  /// Copy constant weights to the device.
+  /// Copy the mutable weight \p v from the offset \p stagingOffset of the
+  /// device buffer of \p staging to its region, once the upload of \p staging
+  /// is finished. \returns number of copied bytes.
+  uint64_t copyStagedValueToDevice(const Value *v,
+                                   const StagingBuffer &staging,
+                                   uint64_t stagingOffset);
+  /// Copy the constant weights \p weights to the device. If \p wait is false,
+  /// the copies are only submitted, and the commands enqueued on commands_
+  /// afterwards, or clFinish, wait for them.
   /// \returns number of copied bytes.
-  uint64_t copyConstantWeightsToDevice();
-  /// Copy mutable weights from the device.
-  /// \returns number of copied bytes.
-  uint64_t copyMutableWeightsFromDevice();
+  uint64_t copyConstantWeightsToDevice(llvm::ArrayRef<const Value *> weights,
+                                       bool wait = true);
 
-  /// Fill the device \p buffer with a given \p value.
+  /// Plan the filling of the device \p buffer with a given \p value.
   /// \param len number of buffer elements to be filled by the \p value.
   /// Elements are considered to be of the type described by \p elemKind.
   void fillBuffer(cl_mem buffer, uint64_t start, uint64_t len, float value,
                   ElemKind elemKind);
 
-  /// Execution a convolution instruction which uses NCHW format.
-  void executeConvolution(const OCLConvolutionInst *CC);
-  /// Allocate a device buffer of required \p size.
-  cl_mem allocDeviceBuffer(uint64_t size);
-  /// Frees a device buffer.
-  void freeDeviceBuffer(cl_mem buf);
+  /// Plan a convolution instruction which uses NCHW format.
+  void planConvolution(const OCLConvolutionInst *CC);
+  /// Create the fast convolution kernel of \p CC for the parameters \p config
+  /// and set its arguments. \p global and \p local receive its work sizes.
+  cl_kernel createConvolutionKernel(const OCLConvolutionInst *CC,
+                                    const ConvolutionConfig &config,
+                                    std::vector<size_t> &global,
+                                    std::vector<size_t> &local);
+  /// \returns the fastest on this device of the convolution parameters that
+  /// are valid for \p CC, starting from \p defaultConfig.
+  ConvolutionConfig tuneConvolution(const OCLConvolutionInst *CC,
+                                    const ConvolutionConfig &defaultConfig);
+
+  /// Create the kernel of the matrix multiplication \p MM using tiles of size
+  /// \p tile, or the untiled kernel if \p tile is 0, and set its arguments.
+  /// The largest tile size selects the register blocked kernel. \p global and
+  /// \p local receive its work sizes.
+  cl_kernel createMatMulKernel(const MatMulInst *MM, size_t tile,
+                               std::vector<size_t> &global,
+                               std::vector<size_t> &local);
+  /// \returns the tile size, or 0 for the untiled kernel, to be used for the
+  /// matrix multiplication \p MM.
+  size_t selectMatMulTile(const MatMulInst *MM);
+
+  /// \returns the key of the tuned parameters of the kernel \p name for
+  /// the shape \p shape on this device.
+  std::string getTuningKey(llvm::StringRef name,
+                           llvm::ArrayRef<size_t> shape) const;
+  /// \returns the best time in seconds of a few runs of \p kernel with the
+  /// work sizes \p global and \p local. The caller must make sure that no
+  /// other command of the queue is running.
+  double benchmarkKernel(cl_kernel kernel, llvm::ArrayRef<size_t> global,
+                         llvm::ArrayRef<size_t> local);
 
   /// Create kernel with a given \p name from a \p program.
   /// If \p program is nullptr, try to find the kernel with a given \p name
@@ -145,16 +509,13 @@ private:
   cl_program createProgram(const std::string &source,
                            const std::vector<std::string> &options,
                            cl_command_queue queue);
-  /// Enqueue a \p kernel on a provided \p commands queue.
-  void enqueueKernel(cl_command_queue commands, cl_kernel kernel,
-                     cl_device_id device, llvm::ArrayRef<size_t> global,
-                     std::vector<KernelLaunch> &kernelLaunches);
-  /// Enqueue a \p kernel on a provided \p commands queue using specified \p
-  /// global and \p local work sizes.
-  void enqueueKernel(cl_command_queue commands, cl_kernel kernel,
-                     cl_device_id device, llvm::ArrayRef<size_t> global,
-                     llvm::ArrayRef<size_t> local,
-                     std::vector<KernelLaunch> &kernelLaunches);
+  /// Add the launch of \p kernel to the launch plan, with the global work
+  /// size \p global and the largest local work size that divides it.
+  void planKernel(cl_kernel kernel, llvm::ArrayRef<size_t> global);
+  /// Add the launch of \p kernel to the launch plan, with the global and
+  /// local work sizes \p global and \p local.
+  void planKernel(cl_kernel kernel, llvm::ArrayRef<size_t> global,
+                  llvm::ArrayRef<size_t> local);
 
   /// \returns a pointer to the tensor that is saved under \p v.
   Tensor *getTensor(const Value *v) const;
@@ -162,9 +523,19 @@ private:
 
 /// This is the OpenCL backend.
 class OCLBackend final : public BackendUsingGlowIR {
+  /// The index of the device of the selected platform that runs the compiled
+  /// functions.
+  unsigned deviceIdx_;
+  /// Whether the device has cl_khr_fp16, without which the kernels that
+  /// compute with half precision values are not compiled.
+  bool hasFP16_;
+
 public:
-  /// Ctor.
-  OCLBackend() = default;
+  /// Ctor. The functions run on the device selected by -device.
+  OCLBackend();
+
+  /// Ctor. The functions run on the device \p deviceIdx.
+  explicit OCLBackend(unsigned deviceIdx);
 
   /// @name Backend methods.
   /// This is the implementation of the Backend interface.
@@ -184,38 +555,94 @@ public:
     if (elementTy == ElemKind::Int8QTy) {
       switch (opKind) {
       case Kinded::Kind::AddNodeKind:
+      case Kinded::Kind::BatchedAddNodeKind:
+      case Kinded::Kind::BatchedMatMulNodeKind:
+      case Kinded::Kind::BatchedReduceAddNodeKind:
       case Kinded::Kind::ConcatNodeKind:
       case Kinded::Kind::ConvolutionNodeKind:
       case Kinded::Kind::DequantizeNodeKind:
       case Kinded::Kind::DivNodeKind:
       case Kinded::Kind::FullyConnectedNodeKind:
+      case Kinded::Kind::IntLookupTableNodeKind:
+      case Kinded::Kind::LogNodeKind:
+      case Kinded::Kind::MatMulNodeKind:
       case Kinded::Kind::MaxNodeKind:
       case Kinded::Kind::MinNodeKind:
       case Kinded::Kind::MulNodeKind:
       case Kinded::Kind::MaxPoolNodeKind:
       case Kinded::Kind::AvgPoolNodeKind:
+      case Kinded::Kind::PowNodeKind:
       case Kinded::Kind::QuantizeNodeKind:
       case Kinded::Kind::ReluNodeKind:
       case Kinded::Kind::RescaleQuantizedNodeKind:
       case Kinded::Kind::ReshapeNodeKind:
+      case Kinded::Kind::SigmoidNodeKind:
       case Kinded::Kind::SliceNodeKind:
       case Kinded::Kind::SplatNodeKind:
       case Kinded::Kind::SubNodeKind:
-      case Kinded::Kind::TopKInstKind:
+      case Kinded::Kind::TanhNodeKind:
+      case Kinded::Kind::TopKNodeKind:
       case Kinded::Kind::TransposeNodeKind:
         return true;
       default:
         return false;
       }
     }
+    // 16-bit quantized kernels are not implemented yet.
+    if (elementTy == ElemKind::Int16QTy) {
+      return false;
+    }
+    if (elementTy == ElemKind::Float16Ty) {
+      switch (opKind) {
+      // Moving and converting half precision values only needs the core
+      // vload_half and vstore_half.
+      case Kinded::Kind::ConcatNodeKind:
+      case Kinded::Kind::ConvertToNodeKind:
+      case Kinded::Kind::ReshapeNodeKind:
+      case Kinded::Kind::SliceNodeKind:
+      case Kinded::Kind::TransposeNodeKind:
+        return true;
+      // Half precision arithmetic requires a device with cl_khr_fp16.
+      case Kinded::Kind::AddNodeKind:
+      case Kinded::Kind::DivNodeKind:
+      case Kinded::Kind::MaxNodeKind:
+      case Kinded::Kind::MinNodeKind:
+      case Kinded::Kind::MulNodeKind:
+      case Kinded::Kind::SplatNodeKind:
+      case Kinded::Kind::SubNodeKind:
+        return hasFP16_;
+      default:
+        return false;
+      }
+    }
+    // There are no OpenCL kernels for bfloat16 tensors.
+    if (elementTy == ElemKind::BFloat16Ty) {
+      return false;
+    }
+    // There are no OpenCL kernels for row-wise quantized weights.
+    if (opKind == Kinded::Kind::RowwiseQuantizedFullyConnectedNodeKind ||
+        opKind == Kinded::Kind::DynamicQuantizedFullyConnectedNodeKind) {
+      return false;
+    }
     return true;
   };
 
   bool shouldLower(const Node *N) const override {
-    // The group convolution is supported in OpenCL slow convolution kernel.
-    if (N->getKind() == Kinded::Kind::ConvolutionNodeKind)
+    switch (N->getKind()) {
+    case Kinded::Kind::ConvolutionNodeKind:
+      // The group convolution is supported in OpenCL slow convolution kernel.
       return false;
-    return true;
+    case Kinded::Kind::BatchedMatMulNodeKind:
+      // The batched kernel only supports floats.
+      return N->getType(0)->getElementType() != ElemKind::FloatTy;
+    case Kinded::Kind::BatchNormalizationNodeKind:
+    case Kinded::Kind::BatchNormalizationGradNodeKind:
+    case Kinded::Kind::MeanVarNormalizationNodeKind:
+      // The batch normalization kernels only support floats.
+      return N->getType(0)->getElementType() != ElemKind::FloatTy;
+    default:
+      return true;
+    }
   }
 
   /// @}
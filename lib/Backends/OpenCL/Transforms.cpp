@@ -18,13 +18,36 @@
 
 #include "glow/Backends/LayoutConverter.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Optimizer/RewriteRules.h"
 
 #include "llvm/Support/Casting.h"
 
-using llvm::dyn_cast;
+using llvm::cast;
 
 using namespace glow;
 
+/// \returns the rules that convert the convolutions and the poolings to the
+/// NCHW OpenCL nodes.
+static const RewriteRuleSet &getOCLRewriteRules() {
+  static const RewriteRuleSet rules = [] {
+    RewriteRuleSet rules;
+    // TODO: OpenCL fast convolution kernel itself has some issue with group >
+    // 1, which will be investigated later. So far, if the group > 1, we just
+    // call the slow convolution kernel.
+    rules.add<ConvolutionNode>(
+        Kinded::Kind::ConvolutionNodeKind, "ocl-nchw-convolution",
+        convertConvToNCHWConv<OCLConvolutionNode>, [](const Node *N) {
+          return cast<ConvolutionNode>(N)->getGroup() == 1;
+        });
+    rules.add<MaxPoolNode>(Kinded::Kind::MaxPoolNodeKind, "ocl-nchw-maxpool",
+                           convertPoolToNCHWPool<MaxPoolNode, OCLMaxPoolNode>);
+    rules.add<AvgPoolNode>(Kinded::Kind::AvgPoolNodeKind, "ocl-nchw-avgpool",
+                           convertPoolToNCHWPool<AvgPoolNode, OCLAvgPoolNode>);
+    return rules;
+  }();
+  return rules;
+}
+
 /// Perform OpenCL specific post-lowering graph transformation.
 bool OCLBackend::transformPostLowering(Function *F,
                                        CompilationMode mode) const {
@@ -33,31 +56,5 @@ bool OCLBackend::transformPostLowering(Function *F,
   if (mode == CompilationMode::Train)
     return false;
 
-  bool changed = false;
-  for (auto &node : F->getNodes()) {
-    if (auto *CN = dyn_cast<ConvolutionNode>(&node)) {
-      // TODO: OpenCL fast convolution kernel itself has some issue with group >
-      // 1, which will be investigated later. So far, if the group > 1, we just
-      // call the slow convolution kernel.
-      if (CN->getGroup() > 1)
-        continue;
-      auto *NR = convertConvToNCHWConv<OCLConvolutionNode>(CN, F);
-      NodeValue(&node, 0).replaceAllUsesOfWith(NR);
-      changed = true;
-      continue;
-    }
-    if (auto *PMN = dyn_cast<MaxPoolNode>(&node)) {
-      auto *NR = convertPoolToNCHWPool<MaxPoolNode, OCLMaxPoolNode>(PMN, F);
-      NodeValue(&node, 0).replaceAllUsesOfWith(NR);
-      changed = true;
-      continue;
-    }
-    if (auto *PAN = dyn_cast<AvgPoolNode>(&node)) {
-      auto *NR = convertPoolToNCHWPool<AvgPoolNode, OCLAvgPoolNode>(PAN, F);
-      NodeValue(&node, 0).replaceAllUsesOfWith(NR);
-      changed = true;
-      continue;
-    }
-  }
-  return changed;
+  return getOCLRewriteRules().apply(F);
 }
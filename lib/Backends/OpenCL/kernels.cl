@@ -61,6 +61,13 @@ typedef struct {
   cl_host_size_t right;
 } PaddingTLBR;
 
+// Native half precision arithmetic needs cl_khr_fp16. Loading and storing
+// half precision values with vload_half/vstore_half is a core feature.
+#if defined(cl_khr_fp16)
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#define FP16_AVAILABLE
+#endif
+
 #if defined(cl_khr_int32_base_atomics)
 #pragma OPENCL EXTENSION cl_khr_int32_base_atomics : enable
 #define ATOMICS_32_AVAILABLE
@@ -107,6 +114,13 @@ cl_int32_t scale_i32i8(cl_int32_t input, cl_int32_t pre, cl_int32_t post,
   return ((((input >> pre) * scale) + rtn) >> post) + offset;
 }
 
+/// Scales 16 32-bit integers like scale_i32i8.
+int16 scale_i32i8x16(int16 input, cl_int32_t pre, cl_int32_t post,
+                     cl_int32_t scale, cl_int32_t offset) {
+  int rtn = (post > 0) ? (1 << (post - 1)) : 0;
+  return ((((input >> pre) * scale) + rtn) >> post) + offset;
+}
+
 /// Clips int32_t into int8_t.
 cl_int8_t clip(cl_int32_t val) { return (cl_int8_t)min(max(val, -128), 127); }
 
@@ -153,6 +167,20 @@ __kernel void rescalequantized_i8W(__global void *mem, cl_uint32_t dest,
                        rescaleParams.scale);
 }
 
+/// Maps every element of \p src through the table \p mapping, which holds
+/// the result of every int8 value, from -128 to 127.
+__kernel void intlookuptable_i8K(__global cl_int8_t *dest,
+                                 __global cl_int8_t *src,
+                                 __global cl_int8_t *mapping) {
+  size_t i = get_global_id(0);
+  dest[i] = mapping[(int)src[i] + 128];
+}
+
+__kernel void intlookuptable_i8W(__global void *mem, cl_uint32_t dest,
+                                 cl_uint32_t src, cl_uint32_t mapping) {
+  intlookuptable_i8K(&mem[dest], &mem[src], &mem[mapping]);
+}
+
 __kernel void dequantizeK(__global float *dest, __global cl_int8_t *src,
                           float scale, cl_int32_t offset) {
   size_t i = get_global_id(0);
@@ -164,6 +192,36 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
   dequantizeK(&mem[dest], &mem[src], scale, offset);
 }
 
+/// Expands half precision values to floats.
+__kernel void converttoK(__global float *dest, __global half *src) {
+  size_t i = get_global_id(0);
+  dest[i] = vload_half(i, src);
+}
+
+__kernel void converttoW(__global void *mem, cl_uint32_t dest,
+                         cl_uint32_t src) {
+  converttoK(&mem[dest], &mem[src]);
+}
+
+/// Rounds floats to the nearest half precision values.
+__kernel void convertto_f16K(__global half *dest, __global float *src) {
+  size_t i = get_global_id(0);
+  vstore_half_rte(src[i], i, dest);
+}
+
+__kernel void convertto_f16W(__global void *mem, cl_uint32_t dest,
+                             cl_uint32_t src) {
+  convertto_f16K(&mem[dest], &mem[src]);
+}
+
+/// The vectorized data-parallel kernels, whose names end with their vector
+/// size, take the number of elements \p n as their last argument. The work
+/// item i computes the vector of the elements from i times the vector size
+/// on, except when fewer elements are left: the last work item then computes
+/// the remaining elements one by one, and the work items past the end do
+/// nothing. Tensors of any size can use them, and the number of work items
+/// may be padded to a multiple of a workgroup size.
+
 /// Macro to define a kernel for data-parallel ternay operations. The body of
 /// the kernel is auto-generated by the macro.
 /// Defines vectorized kernels for vector sizes 1, 8 and 16.
@@ -171,10 +229,25 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
 /// \p type the type of the tensor elements and of the return value
 /// \p body the operation to be performed
 #define DEFINE_OPENCL_TERNARY_DATA_PARALLEL_KERNEL(name, type, body)           \
+  void name##E(__global type *dest, __global type *cond, __global type *lhs,   \
+               __global type *rhs, size_t i) {                                 \
+    typedef float vtype;                                                       \
+    vtype COND = cond[i];                                                      \
+    vtype RHS = rhs[i];                                                        \
+    vtype LHS = lhs[i];                                                        \
+    dest[i] = body;                                                            \
+  }                                                                            \
   __kernel void name##K##16(__global type * dest, __global type * cond,        \
-                            __global type * lhs, __global type * rhs) {        \
+                            __global type * lhs, __global type * rhs,          \
+                            cl_uint32_t n) {                                   \
     typedef float8 vtype;                                                      \
     size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##E(dest, cond, lhs, rhs, i);                                      \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     {                                                                          \
       vtype COND = vload8(i * 2, cond);                                        \
       vtype LHS = vload8(i * 2, lhs);                                          \
@@ -183,7 +256,7 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
       vstore8(VAL, i * 2, dest);                                               \
     }                                                                          \
     {                                                                          \
-      vtype COND = vload8(i * 2, cond);                                        \
+      vtype COND = vload8(i * 2 + 1, cond);                                    \
       vtype LHS = vload8(i * 2 + 1, lhs);                                      \
       vtype RHS = vload8(i * 2 + 1, rhs);                                      \
       vtype VAL = body;                                                        \
@@ -192,13 +265,20 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
   }                                                                            \
   __kernel void name##W##16(__global void *mem, cl_uint32_t dest,              \
                             cl_uint32_t cond, cl_uint32_t lhs,                 \
-                            cl_uint32_t rhs) {                                 \
-    name##K##16(&mem[dest], &mem[cond], &mem[lhs], &mem[rhs]);                 \
+                            cl_uint32_t rhs, cl_uint32_t n) {                  \
+    name##K##16(&mem[dest], &mem[cond], &mem[lhs], &mem[rhs], n);              \
   }                                                                            \
   __kernel void name##K##8(__global type * dest, __global type * cond,         \
-                           __global type * lhs, __global type * rhs) {         \
+                           __global type * lhs, __global type * rhs,           \
+                           cl_uint32_t n) {                                    \
     typedef float8 vtype;                                                      \
     size_t i = get_global_id(0);                                               \
+    if (i * 8 + 8 > n) {                                                       \
+      for (i *= 8; i < n; i++) {                                               \
+        name##E(dest, cond, lhs, rhs, i);                                      \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     vtype COND = vload8(i, cond);                                              \
     vtype LHS = vload8(i, lhs);                                                \
     vtype RHS = vload8(i, rhs);                                                \
@@ -207,17 +287,12 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
   }                                                                            \
   __kernel void name##W##8(__global void *mem, cl_uint32_t dest,               \
                            cl_uint32_t cond, cl_uint32_t lhs,                  \
-                           cl_uint32_t rhs) {                                  \
-    name##K##8(&mem[dest], &mem[cond], &mem[lhs], &mem[rhs]);                  \
+                           cl_uint32_t rhs, cl_uint32_t n) {                   \
+    name##K##8(&mem[dest], &mem[cond], &mem[lhs], &mem[rhs], n);               \
   }                                                                            \
   __kernel void name##K(__global type *dest, __global type *cond,              \
                         __global type *lhs, __global type *rhs) {              \
-    typedef float vtype;                                                       \
-    size_t i = get_global_id(0);                                               \
-    vtype COND = cond[i];                                                      \
-    vtype RHS = rhs[i];                                                        \
-    vtype LHS = lhs[i];                                                        \
-    dest[i] = body;                                                            \
+    name##E(dest, cond, lhs, rhs, get_global_id(0));                           \
   }                                                                            \
   __kernel void name##W(__global void *mem, cl_uint32_t dest,                  \
                         cl_uint32_t cond, cl_uint32_t lhs, cl_uint32_t rhs) {  \
@@ -231,10 +306,23 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
 /// \p type the type of the tensor elements and of the return value
 /// \p body the operation to be performed
 #define DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL(name, type, body)            \
+  void name##E(__global type *dest, __global type *lhs, __global type *rhs,    \
+               size_t i) {                                                     \
+    typedef float vtype;                                                       \
+    vtype RHS = rhs[i];                                                        \
+    vtype LHS = lhs[i];                                                        \
+    dest[i] = body;                                                            \
+  }                                                                            \
   __kernel void name##K##16(__global type * dest, __global type * lhs,         \
-                            __global type * rhs) {                             \
+                            __global type * rhs, cl_uint32_t n) {              \
     typedef float8 vtype;                                                      \
     size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##E(dest, lhs, rhs, i);                                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     {                                                                          \
       vtype LHS = vload8(i * 2, lhs);                                          \
       vtype RHS = vload8(i * 2, rhs);                                          \
@@ -249,29 +337,32 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
     }                                                                          \
   }                                                                            \
   __kernel void name##W##16(__global void *mem, cl_uint32_t dest,              \
-                            cl_uint32_t lhs, cl_uint32_t rhs) {                \
-    name##K##16(&mem[dest], &mem[lhs], &mem[rhs]);                             \
+                            cl_uint32_t lhs, cl_uint32_t rhs,                  \
+                            cl_uint32_t n) {                                   \
+    name##K##16(&mem[dest], &mem[lhs], &mem[rhs], n);                          \
   }                                                                            \
   __kernel void name##K##8(__global type * dest, __global type * lhs,          \
-                           __global type * rhs) {                              \
+                           __global type * rhs, cl_uint32_t n) {               \
     typedef float8 vtype;                                                      \
     size_t i = get_global_id(0);                                               \
+    if (i * 8 + 8 > n) {                                                       \
+      for (i *= 8; i < n; i++) {                                               \
+        name##E(dest, lhs, rhs, i);                                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     vtype LHS = vload8(i, lhs);                                                \
     vtype RHS = vload8(i, rhs);                                                \
     vtype VAL = body;                                                          \
     vstore8(VAL, i, dest);                                                     \
   }                                                                            \
   __kernel void name##W##8(__global void *mem, cl_uint32_t dest,               \
-                           cl_uint32_t lhs, cl_uint32_t rhs) {                 \
-    name##K##8(&mem[dest], &mem[lhs], &mem[rhs]);                              \
+                           cl_uint32_t lhs, cl_uint32_t rhs, cl_uint32_t n) {  \
+    name##K##8(&mem[dest], &mem[lhs], &mem[rhs], n);                           \
   }                                                                            \
   __kernel void name##K(__global type *dest, __global type *lhs,               \
                         __global type *rhs) {                                  \
-    typedef float vtype;                                                       \
-    size_t i = get_global_id(0);                                               \
-    vtype RHS = rhs[i];                                                        \
-    vtype LHS = lhs[i];                                                        \
-    dest[i] = body;                                                            \
+    name##E(dest, lhs, rhs, get_global_id(0));                                 \
   }                                                                            \
   __kernel void name##W(__global void *mem, cl_uint32_t dest, cl_uint32_t lhs, \
                         cl_uint32_t rhs) {                                     \
@@ -280,23 +371,64 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
 
 /// Macro to define a kernel for data-parallel binary quantized operations. The
 /// body of the kernel is auto-generated by the macro.
+/// Defines vectorized kernels for vector sizes 1 and 16, in which the operands
+/// are computed as 32-bit integers and saturated to int8.
 /// \p name the name of the kernel
 /// \p body the operation to be performed
 /// The naming follows the convention of its corresponding implementation in CPU
 /// baclend.
 #define DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(name, body)        \
+  void name##_i8E(__global cl_int8_t *dest, __global cl_int8_t *lhs,           \
+                  __global cl_int8_t *rhs, cl_int32_t destOffset,              \
+                  cl_int32_t lhsOffset, cl_int32_t rhsOffset,                  \
+                  cl_int32_t lhsPre, cl_int32_t lhsPost, cl_int32_t lhsScale,  \
+                  cl_int32_t rhsPre, cl_int32_t rhsPost, cl_int32_t rhsScale,  \
+                  size_t i) {                                                  \
+    cl_int32_t LHS =                                                           \
+        scale_i32i8(lhs[i] - lhsOffset, lhsPre, lhsPost, lhsScale, 0);         \
+    cl_int32_t RHS =                                                           \
+        scale_i32i8(rhs[i] - rhsOffset, rhsPre, rhsPost, rhsScale, 0);         \
+    dest[i] = clip((body) + destOffset);                                       \
+  }                                                                            \
+  __kernel void name##_i8K16(                                                  \
+      __global cl_int8_t *dest, __global cl_int8_t *lhs,                       \
+      __global cl_int8_t *rhs, cl_int32_t destOffset, cl_int32_t lhsOffset,    \
+      cl_int32_t rhsOffset, cl_int32_t lhsPre, cl_int32_t lhsPost,             \
+      cl_int32_t lhsScale, cl_int32_t rhsPre, cl_int32_t rhsPost,              \
+      cl_int32_t rhsScale, cl_uint32_t n) {                                    \
+    size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##_i8E(dest, lhs, rhs, destOffset, lhsOffset, rhsOffset, lhsPre,   \
+                   lhsPost, lhsScale, rhsPre, rhsPost, rhsScale, i);           \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+    int16 LHS = scale_i32i8x16(convert_int16(vload16(i, lhs)) - lhsOffset,     \
+                               lhsPre, lhsPost, lhsScale, 0);                  \
+    int16 RHS = scale_i32i8x16(convert_int16(vload16(i, rhs)) - rhsOffset,     \
+                               rhsPre, rhsPost, rhsScale, 0);                  \
+    vstore16(convert_char16_sat((body) + destOffset), i, dest);                \
+  }                                                                            \
+  __kernel void name##_i8W16(                                                  \
+      __global void *mem, cl_uint32_t dest, cl_uint32_t lhs, cl_uint32_t rhs,  \
+      cl_int32_t destOffset, QuantizationTransform32To8 lhsScaleParams,        \
+      QuantizationTransform32To8 rhsScaleParams, cl_uint32_t n) {              \
+    name##_i8K16(&mem[dest], &mem[lhs], &mem[rhs], destOffset,                 \
+                 lhsScaleParams.offset, rhsScaleParams.offset,                 \
+                 lhsScaleParams.pre, lhsScaleParams.post,                      \
+                 lhsScaleParams.scale, rhsScaleParams.pre,                     \
+                 rhsScaleParams.post, rhsScaleParams.scale, n);                \
+  }                                                                            \
   __kernel void name##_i8K(__global cl_int8_t *dest, __global cl_int8_t *lhs,  \
                            __global cl_int8_t *rhs, cl_int32_t destOffset,     \
                            cl_int32_t lhsOffset, cl_int32_t rhsOffset,         \
                            cl_int32_t lhsPre, cl_int32_t lhsPost,              \
                            cl_int32_t lhsScale, cl_int32_t rhsPre,             \
                            cl_int32_t rhsPost, cl_int32_t rhsScale) {          \
-    size_t i = get_global_id(0);                                               \
-    cl_int32_t LHS =                                                           \
-        scale_i32i8(lhs[i] - lhsOffset, lhsPre, lhsPost, lhsScale, 0);         \
-    cl_int32_t RHS =                                                           \
-        scale_i32i8(rhs[i] - rhsOffset, rhsPre, rhsPost, rhsScale, 0);         \
-    dest[i] = clip((body) + destOffset);                                       \
+    name##_i8E(dest, lhs, rhs, destOffset, lhsOffset, rhsOffset, lhsPre,       \
+               lhsPost, lhsScale, rhsPre, rhsPost, rhsScale,                   \
+               get_global_id(0));                                              \
   }                                                                            \
   __kernel void name##_i8W(                                                    \
       __global void *mem, cl_uint32_t dest, cl_uint32_t lhs, cl_uint32_t rhs,  \
@@ -310,20 +442,57 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
 
 /// Macro to define a mini-kernel for data-parallel multiplicative quantized
 /// operations. The body of the kernel is auto-generated by the macro.
+/// Defines vectorized kernels for vector sizes 1 and 16.
 /// \p name the name of the kernel
 /// \p body the operation to be performed
 /// The naming follows the convention of its corresponding implementation in CPU
 /// baclend.
 #define DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M(name, body)      \
+  void name##_i8E(__global cl_int8_t *dest, __global cl_int8_t *lhs,           \
+                  __global cl_int8_t *rhs, cl_int32_t destOffset,              \
+                  cl_int32_t lhsOffset, cl_int32_t rhsOffset, cl_int32_t pre,  \
+                  cl_int32_t post, cl_int32_t scale, size_t i) {               \
+    cl_int32_t LHS = lhs[i] - lhsOffset;                                       \
+    cl_int32_t RHS = rhs[i] - rhsOffset;                                       \
+    dest[i] = clip(scale_i32i8((body), pre, post, scale, destOffset));         \
+  }                                                                            \
+  __kernel void name##_i8K16(__global cl_int8_t *dest,                         \
+                             __global cl_int8_t *lhs, __global cl_int8_t *rhs, \
+                             cl_int32_t destOffset, cl_int32_t lhsOffset,      \
+                             cl_int32_t rhsOffset, cl_int32_t pre,             \
+                             cl_int32_t post, cl_int32_t scale,                \
+                             cl_uint32_t n) {                                  \
+    size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##_i8E(dest, lhs, rhs, destOffset, lhsOffset, rhsOffset, pre,      \
+                   post, scale, i);                                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+    int16 LHS = convert_int16(vload16(i, lhs)) - lhsOffset;                    \
+    int16 RHS = convert_int16(vload16(i, rhs)) - rhsOffset;                    \
+    vstore16(convert_char16_sat(                                               \
+                 scale_i32i8x16((body), pre, post, scale, destOffset)),        \
+             i, dest);                                                         \
+  }                                                                            \
+  __kernel void name##_i8W16(                                                  \
+      __global void *mem, cl_uint32_t dest, cl_uint32_t lhs, cl_uint32_t rhs,  \
+      cl_int32_t destOffset, QuantizationTransform32To8 lhsScaleParams,        \
+      QuantizationTransform32To8 rhsScaleParams,                               \
+      QuantizationTransform32To8 resultScaleParams, cl_uint32_t n) {           \
+    name##_i8K16(&mem[dest], &mem[lhs], &mem[rhs], destOffset,                 \
+                 lhsScaleParams.offset, rhsScaleParams.offset,                 \
+                 resultScaleParams.pre, resultScaleParams.post,                \
+                 resultScaleParams.scale, n);                                  \
+  }                                                                            \
   __kernel void name##_i8K(__global cl_int8_t *dest, __global cl_int8_t *lhs,  \
                            __global cl_int8_t *rhs, cl_int32_t destOffset,     \
                            cl_int32_t lhsOffset, cl_int32_t rhsOffset,         \
-                           cl_int32_t pre, cl_int32_t post, cl_int32_t scale) {\
-    size_t i = get_global_id(0);                                               \
-    cl_int32_t LHS = lhs[i] - lhsOffset;                                       \
-    cl_int32_t RHS = rhs[i] - rhsOffset;                                       \
-    dest[i] =                                                                  \
-        clip(scale_i32i8((body), pre, post, scale, destOffset));               \
+                           cl_int32_t pre, cl_int32_t post,                    \
+                           cl_int32_t scale) {                                 \
+    name##_i8E(dest, lhs, rhs, destOffset, lhsOffset, rhsOffset, pre, post,    \
+               scale, get_global_id(0));                                       \
   }                                                                            \
   __kernel void name##_i8W(                                                    \
       __global void *mem, cl_uint32_t dest, cl_uint32_t lhs, cl_uint32_t rhs,  \
@@ -343,9 +512,21 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
 /// \p type the type of the tensor elements and of the return value
 /// \p body the operation to be performed
 #define DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL(name, type, body)             \
-  __kernel void name##K##16(__global type * dest, __global type * src) {       \
+  void name##E(__global type *dest, __global type *src, size_t i) {            \
+    typedef float vtype;                                                       \
+    vtype SRC = src[i];                                                        \
+    dest[i] = body;                                                            \
+  }                                                                            \
+  __kernel void name##K##16(__global type * dest, __global type * src,         \
+                            cl_uint32_t n) {                                   \
     typedef float8 vtype;                                                      \
     size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##E(dest, src, i);                                                 \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     {                                                                          \
       vtype SRC = vload8(i * 2, src);                                          \
       vtype VAL = body;                                                        \
@@ -358,25 +539,29 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
     }                                                                          \
   }                                                                            \
   __kernel void name##W##16(__global void *mem, cl_uint32_t dest,              \
-                            cl_uint32_t src) {                                 \
-    name##K##16(&mem[dest], &mem[src]);                                        \
+                            cl_uint32_t src, cl_uint32_t n) {                  \
+    name##K##16(&mem[dest], &mem[src], n);                                     \
   }                                                                            \
-  __kernel void name##K##8(__global type * dest, __global type * src) {        \
+  __kernel void name##K##8(__global type * dest, __global type * src,          \
+                           cl_uint32_t n) {                                    \
     typedef float8 vtype;                                                      \
     size_t i = get_global_id(0);                                               \
+    if (i * 8 + 8 > n) {                                                       \
+      for (i *= 8; i < n; i++) {                                               \
+        name##E(dest, src, i);                                                 \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     vtype SRC = vload8(i, src);                                                \
     vtype VAL = body;                                                          \
     vstore8(VAL, i, dest);                                                     \
   }                                                                            \
   __kernel void name##W##8(__global void *mem, cl_uint32_t dest,               \
-                           cl_uint32_t src) {                                  \
-    name##K##8(&mem[dest], &mem[src]);                                         \
+                           cl_uint32_t src, cl_uint32_t n) {                   \
+    name##K##8(&mem[dest], &mem[src], n);                                      \
   }                                                                            \
   __kernel void name##K(__global type *dest, __global type *src) {             \
-    typedef float vtype;                                                       \
-    size_t i = get_global_id(0);                                               \
-    vtype SRC = src[i];                                                        \
-    dest[i] = body;                                                            \
+    name##E(dest, src, get_global_id(0));                                      \
   }                                                                            \
   __kernel void name##W(__global void *mem, cl_uint32_t dest,                  \
                         cl_uint32_t src) {                                     \
@@ -391,9 +576,20 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
 /// \p body the operation to be performed
 #define DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(name, type,  \
                                                                   body)        \
-  __kernel void name##K##16(__global type * dest, type val) {                  \
+  void name##E(__global type *dest, type val, size_t i) {                      \
+    typedef type vtype;                                                        \
+    vtype SRC = (vtype)val;                                                    \
+    dest[i] = body;                                                            \
+  }                                                                            \
+  __kernel void name##K##16(__global type * dest, type val, cl_uint32_t n) {   \
     typedef type##8 vtype;                                                     \
     size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##E(dest, val, i);                                                 \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     {                                                                          \
       vtype SRC = (vtype)val;                                                  \
       vtype VAL = body;                                                        \
@@ -405,24 +601,29 @@ __kernel void dequantizeW(__global void *mem, cl_uint32_t dest, cl_uint32_t src,
       vstore8(VAL, i * 2 + 1, dest);                                           \
     }                                                                          \
   }                                                                            \
-  __kernel void name##W##16(__global void *mem, cl_uint32_t dest, float val) { \
-    name##K##16(&mem[dest], (type)val);                                        \
+  __kernel void name##W##16(__global void *mem, cl_uint32_t dest, float val,   \
+                            cl_uint32_t n) {                                   \
+    name##K##16(&mem[dest], (type)val, n);                                     \
   }                                                                            \
-  __kernel void name##K##8(__global type * dest, type val) {                   \
+  __kernel void name##K##8(__global type * dest, type val, cl_uint32_t n) {    \
     typedef type##8 vtype;                                                     \
     size_t i = get_global_id(0);                                               \
+    if (i * 8 + 8 > n) {                                                       \
+      for (i *= 8; i < n; i++) {                                               \
+        name##E(dest, val, i);                                                 \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
     vtype SRC = (vtype)val;                                                    \
     vtype VAL = body;                                                          \
     vstore8(VAL, i, dest);                                                     \
   }                                                                            \
-  __kernel void name##W##8(__global void *mem, cl_uint32_t dest, float val) {  \
-    name##K##8(&mem[dest], (type)val);                                         \
+  __kernel void name##W##8(__global void *mem, cl_uint32_t dest, float val,    \
+                           cl_uint32_t n) {                                    \
+    name##K##8(&mem[dest], (type)val, n);                                      \
   }                                                                            \
   __kernel void name##K(__global type *dest, type val) {                       \
-    typedef type vtype;                                                        \
-    size_t i = get_global_id(0);                                               \
-    vtype SRC = (vtype)val;                                                    \
-    dest[i] = body;                                                            \
+    name##E(dest, val, get_global_id(0));                                      \
   }                                                                            \
   __kernel void name##W(__global void *mem, cl_uint32_t dest, float val) {     \
     name##K(&mem[dest], (type)val);                                            \
@@ -443,6 +644,9 @@ DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED(elementmin, min(LHS, RHS))
 DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M(elementmul, LHS *RHS)
 DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M(elementdiv, LHS / RHS)
 
+// The exp of OpenCL is within 3 ulp unless the program is built with
+// -cl-fast-relaxed-math, so tanh and sigmoid stay within the absolute errors
+// of libjit_tanhf (3e-7) and libjit_sigmoidf (2e-7) of the CPU backend.
 DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL(tanh, float,
                                          1 - 2 / (exp(SRC * 2) + 1))
 DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL(sigmoid, float, 1 / (1 + exp(-SRC)))
@@ -454,40 +658,139 @@ DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(splat, float, SRC)
 DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(splat_u, ulong, SRC)
 DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(splat_i8, char, SRC)
 
+#ifdef FP16_AVAILABLE
+/// Macro to define a kernel for data-parallel binary operations on half
+/// precision values, which are computed with native half arithmetic.
+/// Defines vectorized kernels for vector sizes 1, 8 and 16.
+/// \p name the name of the kernel
+/// \p body the operation to be performed
+#define DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(name, body)              \
+  void name##E(__global half *dest, __global half *lhs, __global half *rhs,    \
+               size_t i) {                                                     \
+    typedef half vtype;                                                        \
+    vtype RHS = rhs[i];                                                        \
+    vtype LHS = lhs[i];                                                        \
+    dest[i] = body;                                                            \
+  }                                                                            \
+  __kernel void name##K##16(__global half * dest, __global half * lhs,         \
+                            __global half * rhs, cl_uint32_t n) {              \
+    typedef half16 vtype;                                                      \
+    size_t i = get_global_id(0);                                               \
+    if (i * 16 + 16 > n) {                                                     \
+      for (i *= 16; i < n; i++) {                                              \
+        name##E(dest, lhs, rhs, i);                                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+    vtype LHS = vload16(i, lhs);                                               \
+    vtype RHS = vload16(i, rhs);                                               \
+    vtype VAL = body;                                                          \
+    vstore16(VAL, i, dest);                                                    \
+  }                                                                            \
+  __kernel void name##W##16(__global void *mem, cl_uint32_t dest,              \
+                            cl_uint32_t lhs, cl_uint32_t rhs,                  \
+                            cl_uint32_t n) {                                   \
+    name##K##16(&mem[dest], &mem[lhs], &mem[rhs], n);                          \
+  }                                                                            \
+  __kernel void name##K##8(__global half * dest, __global half * lhs,          \
+                           __global half * rhs, cl_uint32_t n) {               \
+    typedef half8 vtype;                                                       \
+    size_t i = get_global_id(0);                                               \
+    if (i * 8 + 8 > n) {                                                       \
+      for (i *= 8; i < n; i++) {                                               \
+        name##E(dest, lhs, rhs, i);                                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+    vtype LHS = vload8(i, lhs);                                                \
+    vtype RHS = vload8(i, rhs);                                                \
+    vtype VAL = body;                                                          \
+    vstore8(VAL, i, dest);                                                     \
+  }                                                                            \
+  __kernel void name##W##8(__global void *mem, cl_uint32_t dest,               \
+                           cl_uint32_t lhs, cl_uint32_t rhs, cl_uint32_t n) {  \
+    name##K##8(&mem[dest], &mem[lhs], &mem[rhs], n);                           \
+  }                                                                            \
+  __kernel void name##K(__global half *dest, __global half *lhs,               \
+                        __global half *rhs) {                                  \
+    name##E(dest, lhs, rhs, get_global_id(0));                                 \
+  }                                                                            \
+  __kernel void name##W(__global void *mem, cl_uint32_t dest, cl_uint32_t lhs, \
+                        cl_uint32_t rhs) {                                     \
+    name##K(&mem[dest], &mem[lhs], &mem[rhs]);                                 \
+  }
+
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(elementadd_f16, LHS + RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(elementsub_f16, LHS - RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(elementmul_f16, LHS *RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(elementdiv_f16, LHS / RHS)
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(elementmax_f16, max(LHS, RHS))
+DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16(elementmin_f16, min(LHS, RHS))
+
+DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND(splat_f16, half, SRC)
+
+#undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_F16
+#endif // FP16_AVAILABLE
+
 #undef DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL_WITH_IMM_OPERAND
 #undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL
 #undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED
 #undef DEFINE_OPENCL_BINARY_DATA_PARALLEL_KERNEL_QUANTIZED_M
 #undef DEFINE_OPENCL_UNARY_DATA_PARALLEL_KERNEL
 
+/// Computes the element \p i of elementcmplte.
+void elementcmplteE(__global float *dest, __global float *LHS,
+                    __global float *RHS, size_t i) {
+  dest[i] = LHS[i] <= RHS[i];
+}
+
 __kernel void elementcmplteK16(__global float *dest, __global float *LHS,
-                               __global float *RHS) {
+                               __global float *RHS, cl_uint32_t n) {
   size_t i = get_global_id(0);
-  vstore8(convert_float8(islessequal(vload8(i, LHS), vload8(i, RHS))), i, dest);
-  vstore8(convert_float8(islessequal(vload8(i + 1, LHS), vload8(i + 1, RHS))),
-          i + 1, dest);
+  if (i * 16 + 16 > n) {
+    for (i *= 16; i < n; i++) {
+      elementcmplteE(dest, LHS, RHS, i);
+    }
+    return;
+  }
+  // The vector comparisons are -1 when true.
+  vstore8(select((float8)0, (float8)1,
+                 islessequal(vload8(i * 2, LHS), vload8(i * 2, RHS))),
+          i * 2, dest);
+  vstore8(select((float8)0, (float8)1,
+                 islessequal(vload8(i * 2 + 1, LHS), vload8(i * 2 + 1, RHS))),
+          i * 2 + 1, dest);
 }
 
 __kernel void elementcmplteW16(__global void *mem, cl_uint32_t dest,
-                               cl_uint32_t LHS, cl_uint32_t RHS) {
-  elementcmplteK16(&mem[dest], &mem[LHS], &mem[RHS]);
+                               cl_uint32_t LHS, cl_uint32_t RHS,
+                               cl_uint32_t n) {
+  elementcmplteK16(&mem[dest], &mem[LHS], &mem[RHS], n);
 }
 
 __kernel void elementcmplteK8(__global float *dest, __global float *LHS,
-                              __global float *RHS) {
+                              __global float *RHS, cl_uint32_t n) {
   size_t i = get_global_id(0);
-  vstore8(convert_float8(islessequal(vload8(i, LHS), vload8(i, RHS))), i, dest);
+  if (i * 8 + 8 > n) {
+    for (i *= 8; i < n; i++) {
+      elementcmplteE(dest, LHS, RHS, i);
+    }
+    return;
+  }
+  vstore8(select((float8)0, (float8)1,
+                 islessequal(vload8(i, LHS), vload8(i, RHS))),
+          i, dest);
 }
 
 __kernel void elementcmplteW8(__global void *mem, cl_uint32_t dest,
-                              cl_uint32_t LHS, cl_uint32_t RHS) {
-  elementcmplteK8(&mem[dest], &mem[LHS], &mem[RHS]);
+                              cl_uint32_t LHS, cl_uint32_t RHS,
+                              cl_uint32_t n) {
+  elementcmplteK8(&mem[dest], &mem[LHS], &mem[RHS], n);
 }
 
 __kernel void elementcmplteK(__global float *dest, __global float *LHS,
                              __global float *RHS) {
-  size_t i = get_global_id(0);
-  dest[i] = LHS[i] <= RHS[i];
+  elementcmplteE(dest, LHS, RHS, get_global_id(0));
 }
 
 __kernel void elementcmplteW(__global void *mem, cl_uint32_t dest,
@@ -510,6 +813,31 @@ __kernel void batchedreduceaddW(__global void *mem, cl_uint32_t dest,
   batchedreduceaddK(&mem[dest], &mem[batch], numSlice, sliceSize);
 }
 
+__kernel void batchedreduceadd_i8K(__global cl_int8_t *dest,
+                                   __global cl_int8_t *batch,
+                                   cl_uint32_t numSlice, cl_uint32_t sliceSize,
+                                   cl_int32_t destOffset,
+                                   cl_int32_t batchOffset, cl_int32_t batchPre,
+                                   cl_int32_t batchPost,
+                                   cl_int32_t batchScale) {
+  size_t s = get_global_id(0);
+  // Accumulate in 32 bits and rescale the sum once.
+  cl_int32_t sum = 0;
+  for (size_t n = 0; n < numSlice; n++) {
+    sum += batch[n * sliceSize + s] - batchOffset;
+  }
+  dest[s] = clip(scale_i32i8(sum, batchPre, batchPost, batchScale, destOffset));
+}
+
+__kernel void batchedreduceadd_i8W(__global void *mem, cl_uint32_t dest,
+                                   cl_uint32_t batch, cl_uint32_t numSlice,
+                                   cl_uint32_t sliceSize, cl_int32_t destOffset,
+                                   QuantizationTransform32To8 scaleParams) {
+  batchedreduceadd_i8K(&mem[dest], &mem[batch], numSlice, sliceSize,
+                       destOffset, scaleParams.offset, scaleParams.pre,
+                       scaleParams.post, scaleParams.scale);
+}
+
 __kernel void batchedaddK(__global float *dest, __global float *batch,
                           __global float *slice, cl_uint32_t numSlice,
                           cl_uint32_t sliceSize) {
@@ -556,20 +884,26 @@ __kernel void batchedadd_i8W(__global void *mem, cl_uint32_t dest,
                  sliceScaleParams.post, sliceScaleParams.scale);
 }
 
-/// Size of the tile to be used for matrix multiplication.
+/// Size of the tile to be used for matrix multiplication. It can be overridden
+/// when the program is built, e.g. by the autotuner of the backend.
 /// The kernel can only be executed by the OpenCL backends that allow
 /// workgroups with sizes which are at least as big as a tile.
+/// All the matrix multiplication kernels read the RHS transposed, with the
+/// shape N x K, if \p transRHS is set.
+#ifndef TILE_SIZE
 #define TILE_SIZE 8
+#endif
 
 __kernel void matmul_tiled(__global void *mem, cl_uint32_t C_off,
                            cl_uint32_t A_off, cl_uint32_t B_off, ShapeNHWC ddim,
-                           ShapeNHWC ldim, ShapeNHWC rdim) {
+                           ShapeNHWC ldim, ShapeNHWC rdim,
+                           cl_uint32_t transRHS) {
   __global float *C = &mem[C_off];
   __global float *A = &mem[A_off];
   __global float *B = &mem[B_off];
 
   int M = ldim.n;
-  int N = rdim.h;
+  int N = ddim.h;
   int K = ldim.h;
 
   int tx = get_local_id(1);
@@ -593,7 +927,8 @@ __kernel void matmul_tiled(__global void *mem, cl_uint32_t C_off,
 
     // Load RHS tile and store it transposed.
     if (t * TILE_SIZE + ty < K && col < N) {
-      sB[tx][ty] = B[(t * TILE_SIZE + ty) * N + col];
+      sB[tx][ty] = transRHS ? B[col * K + (t * TILE_SIZE + ty)]
+                            : B[(t * TILE_SIZE + ty) * N + col];
     } else {
       sB[tx][ty] = 0;
     }
@@ -616,13 +951,14 @@ __kernel void matmul_tiled_i8(__global void *mem, cl_uint32_t C_off,
                               ShapeNHWC ddim, ShapeNHWC ldim, ShapeNHWC rdim,
                               cl_int32_t aOffset, cl_int32_t bOffset,
                               cl_int32_t cOffset,
-                              QuantizationTransform32To8 destScaleParams) {
+                              QuantizationTransform32To8 destScaleParams,
+                              cl_uint32_t transRHS) {
   __global cl_int8_t *C = &mem[C_off];
   __global cl_int8_t *A = &mem[A_off];
   __global cl_int8_t *B = &mem[B_off];
 
   int M = ldim.n;
-  int N = rdim.h;
+  int N = ddim.h;
   int K = ldim.h;
 
   int tx = get_local_id(1);
@@ -646,7 +982,9 @@ __kernel void matmul_tiled_i8(__global void *mem, cl_uint32_t C_off,
 
     // Load RHS tile and store it transposed.
     if (t * TILE_SIZE + ty < K && col < N) {
-      sB[tx][ty] = B[(t * TILE_SIZE + ty) * N + col] - bOffset;
+      cl_int32_t b = transRHS ? B[col * K + (t * TILE_SIZE + ty)]
+                              : B[(t * TILE_SIZE + ty) * N + col];
+      sB[tx][ty] = b - bOffset;
     } else {
       sB[tx][ty] = bOffset;
     }
@@ -667,9 +1005,113 @@ __kernel void matmul_tiled_i8(__global void *mem, cl_uint32_t C_off,
 }
 #undef TILE_SIZE
 
+/// Number of threads along each dimension of the workgroups of the register
+/// blocked matrix multiplication.
+#define BLOCK_THREADS 8
+/// Number of rows and of columns of the result computed by every thread. The
+/// kernel keeps every row in a float4.
+#define BLOCK_WPT 4
+/// Number of rows and of columns of the result computed by every workgroup.
+#define BLOCK_TS (BLOCK_THREADS * BLOCK_WPT)
+/// Size of the tiles along the reduction dimension.
+#define BLOCK_TSK 16
+
+/// Register blocked matrix multiplication. Every workgroup computes a
+/// BLOCK_TS x BLOCK_TS block of the result from tiles of the operands staged
+/// in local memory, and every thread accumulates a BLOCK_WPT x BLOCK_WPT
+/// sub-block in vector registers. The third dimension of the global work size
+/// iterates over a batch of independent multiplications, whose operands and
+/// results are \p lhsStride, \p rhsStride and \p destStride elements apart.
+__kernel __attribute__((reqd_work_group_size(BLOCK_THREADS, BLOCK_THREADS, 1)))
+void matmul_blocked(__global void *mem, cl_uint32_t C_off, cl_uint32_t A_off,
+                    cl_uint32_t B_off, ShapeNHWC ddim, ShapeNHWC ldim,
+                    ShapeNHWC rdim, cl_uint32_t destStride,
+                    cl_uint32_t lhsStride, cl_uint32_t rhsStride,
+                    cl_uint32_t transRHS) {
+  size_t batch = get_global_id(2);
+  __global float *C = (__global float *)&mem[C_off] + batch * destStride;
+  __global float *A = (__global float *)&mem[A_off] + batch * lhsStride;
+  __global float *B = (__global float *)&mem[B_off] + batch * rhsStride;
+
+  int M = ldim.n;
+  int N = ddim.h;
+  int K = ldim.h;
+
+  int tr = get_local_id(0);
+  int tc = get_local_id(1);
+  int tid = tr * BLOCK_THREADS + tc;
+  int offM = get_group_id(0) * BLOCK_TS;
+  int offN = get_group_id(1) * BLOCK_TS;
+
+  // Tile of LHS, stored transposed.
+  __local float sA[BLOCK_TSK][BLOCK_TS];
+  // Tile of RHS.
+  __local float sB[BLOCK_TSK][BLOCK_TS];
+
+  // The accumulators of the rows tr * BLOCK_WPT + i of the block.
+  float4 acc[BLOCK_WPT];
+  for (int i = 0; i < BLOCK_WPT; i++) {
+    acc[i] = (float4)(0);
+  }
+
+  for (int t = 0; t < K; t += BLOCK_TSK) {
+    // Load both tiles. Consecutive threads read consecutive elements.
+    for (int id = tid; id < BLOCK_TSK * BLOCK_TS;
+         id += BLOCK_THREADS * BLOCK_THREADS) {
+      int m = id / BLOCK_TSK;
+      int k = id % BLOCK_TSK;
+      sA[k][m] = (offM + m < M && t + k < K) ? A[(offM + m) * K + t + k] : 0;
+      // A transposed RHS is read along K, like the LHS.
+      int n;
+      if (transRHS) {
+        n = id / BLOCK_TSK;
+        k = id % BLOCK_TSK;
+      } else {
+        k = id / BLOCK_TS;
+        n = id % BLOCK_TS;
+      }
+      int idx = transRHS ? (offN + n) * K + t + k : (t + k) * N + offN + n;
+      sB[k][n] = (t + k < K && offN + n < N) ? B[idx] : 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+#pragma unroll
+    for (int k = 0; k < BLOCK_TSK; k++) {
+      float4 a = vload4(tr, &sA[k][0]);
+      float4 b = vload4(tc, &sB[k][0]);
+      acc[0] += a.x * b;
+      acc[1] += a.y * b;
+      acc[2] += a.z * b;
+      acc[3] += a.w * b;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  int col = offN + tc * BLOCK_WPT;
+  for (int i = 0; i < BLOCK_WPT; i++) {
+    int row = offM + tr * BLOCK_WPT + i;
+    if (row >= M) {
+      break;
+    }
+    if (col + BLOCK_WPT <= N) {
+      vstore4(acc[i], 0, &C[row * N + col]);
+      continue;
+    }
+    float res[BLOCK_WPT];
+    vstore4(acc[i], 0, res);
+    for (int j = 0; j < BLOCK_WPT && col + j < N; j++) {
+      C[row * N + col + j] = res[j];
+    }
+  }
+}
+#undef BLOCK_THREADS
+#undef BLOCK_WPT
+#undef BLOCK_TS
+#undef BLOCK_TSK
+
 __kernel void matmulK(__global float *dest, __global float *lhs,
                       __global float *rhs, ShapeNHWC ddim, ShapeNHWC ldim,
-                      ShapeNHWC rdim) {
+                      ShapeNHWC rdim, cl_uint32_t transRHS) {
   // For each X in the destination matrix.
   size_t x = get_global_id(0);
   // For each Y in the destination matrix.
@@ -678,7 +1120,8 @@ __kernel void matmulK(__global float *dest, __global float *lhs,
   // Perform DOT on the row an column.
   float sum = 0;
   for (size_t i = 0; i < ldim.h; i++) {
-    sum += lhs[getNHWC(ldim, x, i, 0, 0)] * rhs[getNHWC(rdim, i, y, 0, 0)];
+    size_t r = transRHS ? getNHWC(rdim, y, i, 0, 0) : getNHWC(rdim, i, y, 0, 0);
+    sum += lhs[getNHWC(ldim, x, i, 0, 0)] * rhs[r];
   }
 
   dest[getNHWC(ddim, x, y, 0, 0)] = sum;
@@ -686,8 +1129,8 @@ __kernel void matmulK(__global float *dest, __global float *lhs,
 
 __kernel void matmulW(__global void *mem, cl_uint32_t dest, cl_uint32_t lhs,
                       cl_uint32_t rhs, ShapeNHWC ddim, ShapeNHWC ldim,
-                      ShapeNHWC rdim) {
-  matmulK(&mem[dest], &mem[lhs], &mem[rhs], ddim, ldim, rdim);
+                      ShapeNHWC rdim, cl_uint32_t transRHS) {
+  matmulK(&mem[dest], &mem[lhs], &mem[rhs], ddim, ldim, rdim, transRHS);
 }
 
 __kernel void matmul_i8K(__global cl_int8_t *dest, __global cl_int8_t *lhs,
@@ -695,7 +1138,7 @@ __kernel void matmul_i8K(__global cl_int8_t *dest, __global cl_int8_t *lhs,
                          ShapeNHWC ldim, ShapeNHWC rdim, cl_int32_t lhsOffset,
                          cl_int32_t rhsOffset, cl_int32_t destOffset,
                          cl_int32_t destPre, cl_int32_t destPost,
-                         cl_int32_t destScale) {
+                         cl_int32_t destScale, cl_uint32_t transRHS) {
   // For each X in the destination matrix.
   size_t x = get_global_id(0);
   // For each Y in the destination matrix.
@@ -704,8 +1147,8 @@ __kernel void matmul_i8K(__global cl_int8_t *dest, __global cl_int8_t *lhs,
   // Perform DOT on the row an column.
   cl_int32_t sum = 0;
   for (size_t i = 0; i < ldim.h; i++) {
-    sum += (lhs[getNHWC(ldim, x, i, 0, 0)] - lhsOffset) *
-           (rhs[getNHWC(rdim, i, y, 0, 0)] - rhsOffset);
+    size_t r = transRHS ? getNHWC(rdim, y, i, 0, 0) : getNHWC(rdim, i, y, 0, 0);
+    sum += (lhs[getNHWC(ldim, x, i, 0, 0)] - lhsOffset) * (rhs[r] - rhsOffset);
   }
 
   dest[getNHWC(ddim, x, y, 0, 0)] =
@@ -716,10 +1159,11 @@ __kernel void matmul_i8W(__global void *mem, cl_uint32_t dest, cl_uint32_t lhs,
                          cl_uint32_t rhs, ShapeNHWC ddim, ShapeNHWC ldim,
                          ShapeNHWC rdim, cl_int32_t lhsOffset,
                          cl_int32_t rhsOffset, cl_int32_t destOffset,
-                         QuantizationTransform32To8 destScaleParams) {
+                         QuantizationTransform32To8 destScaleParams,
+                         cl_uint32_t transRHS) {
   matmul_i8K(&mem[dest], &mem[lhs], &mem[rhs], ddim, ldim, rdim, lhsOffset,
              rhsOffset, destOffset, destScaleParams.pre, destScaleParams.post,
-             destScaleParams.scale);
+             destScaleParams.scale, transRHS);
 }
 
 __kernel void softmaxK(__global float *dest, __global float *src,
@@ -1306,6 +1750,7 @@ __kernel void oclavgpool_i8W(__global void *mem, cl_uint32_t dest,
 DEFINE_OPENCL_TRANSPOSE_KERNEL(transpose_i8, cl_int8_t)
 DEFINE_OPENCL_TRANSPOSE_KERNEL(transpose_u, cl_uint64_t)
 DEFINE_OPENCL_TRANSPOSE_KERNEL(transpose, float)
+DEFINE_OPENCL_TRANSPOSE_KERNEL(transpose_f16, ushort)
 
 #undef DEFINE_OPENCL_TRANSPOSE_KERNEL
 
@@ -1348,6 +1793,7 @@ DEFINE_OPENCL_TRANSPOSE_KERNEL(transpose, float)
   }
 DEFINE_OPENCL_INSERT_TENSOR_KERNEL(inserttensor, float)
 DEFINE_OPENCL_INSERT_TENSOR_KERNEL(inserttensor_i8, char)
+DEFINE_OPENCL_INSERT_TENSOR_KERNEL(inserttensor_f16, ushort)
 #undef DEFINE_OPENCL_INSERT_TENSOR_KERNEL
 
 /// Macro to define a kernel to extract tensors. The body of
@@ -1379,6 +1825,7 @@ DEFINE_OPENCL_INSERT_TENSOR_KERNEL(inserttensor_i8, char)
   }
 DEFINE_OPENCL_EXTRACT_TENSOR_KERNEL(extracttensor, float)
 DEFINE_OPENCL_EXTRACT_TENSOR_KERNEL(extracttensor_i8, char)
+DEFINE_OPENCL_EXTRACT_TENSOR_KERNEL(extracttensor_f16, ushort)
 #undef DEFINE_OPENCL_EXTRACT_TENSOR_KERNEL
 
 void memcpy_float(__global float *dest, const __global float *src, int len) {
@@ -1426,4 +1873,262 @@ __kernel void scatterassignW(__global void *mem, cl_uint32_t data,
   scatterassignK(&mem[data], &mem[indices], &mem[slices], sliceSize);
 }
 
+/// Number of threads of the workgroups of TopK. This must match topKThreads in
+/// OpenCL.cpp.
+#define TOPK_THREADS 64
+
+/// Computes the top \p k elements of every row of \p n elements of \p input,
+/// one row per workgroup. The elements are selected one at a time: every
+/// selection picks the largest element that comes after the previous one in
+/// the order of decreasing values and, for equal values, increasing indices.
+/// This needs no scratch memory and keeps the order of the host sort. The
+/// threads search strided parts of the row, and reduce their candidates in
+/// local memory.
+#define DEFINE_TOPK(name, type)                                                \
+  __kernel __attribute__((reqd_work_group_size(TOPK_THREADS, 1, 1))) void      \
+      name##K(__global type *values, __global cl_uint64_t *indices,            \
+              __global const type *input, cl_uint32_t n, cl_uint32_t k) {      \
+    __local type bestValues[TOPK_THREADS];                                     \
+    __local cl_uint32_t bestIndices[TOPK_THREADS];                             \
+    size_t row = get_group_id(0);                                              \
+    cl_uint32_t tid = get_local_id(0);                                         \
+    __global const type *src = input + row * n;                                \
+    type prevValue = 0;                                                        \
+    cl_uint32_t prevIdx = 0;                                                   \
+    for (cl_uint32_t j = 0; j < k; j++) {                                      \
+      cl_uint32_t best = n;                                                    \
+      for (cl_uint32_t i = tid; i < n; i += TOPK_THREADS) {                    \
+        /* Skip the elements selected so far. */                               \
+        if (j && (src[i] > prevValue ||                                        \
+                  (src[i] == prevValue && i <= prevIdx))) {                    \
+          continue;                                                            \
+        }                                                                      \
+        if (best == n || src[i] > src[best]) {                                 \
+          best = i;                                                            \
+        }                                                                      \
+      }                                                                        \
+      bestIndices[tid] = best;                                                 \
+      bestValues[tid] = best == n ? 0 : src[best];                             \
+      barrier(CLK_LOCAL_MEM_FENCE);                                            \
+      for (cl_uint32_t s = TOPK_THREADS / 2; s > 0; s >>= 1) {                 \
+        if (tid < s) {                                                         \
+          cl_uint32_t other = bestIndices[tid + s];                            \
+          type otherValue = bestValues[tid + s];                               \
+          if (other != n &&                                                    \
+              (bestIndices[tid] == n || otherValue > bestValues[tid] ||        \
+               (otherValue == bestValues[tid] && other < bestIndices[tid]))) { \
+            bestIndices[tid] = other;                                          \
+            bestValues[tid] = otherValue;                                      \
+          }                                                                    \
+        }                                                                      \
+        barrier(CLK_LOCAL_MEM_FENCE);                                          \
+      }                                                                        \
+      prevValue = bestValues[0];                                               \
+      prevIdx = bestIndices[0];                                                \
+      if (tid == 0) {                                                          \
+        values[row * k + j] = prevValue;                                       \
+        indices[row * k + j] = prevIdx;                                        \
+      }                                                                        \
+      /* Wait for all the threads to read the result before the next pass. */  \
+      barrier(CLK_LOCAL_MEM_FENCE);                                            \
+    }                                                                          \
+  }                                                                            \
+  __kernel void name##W(__global void *mem, cl_uint32_t values,                \
+                        cl_uint32_t indices, cl_uint32_t input,                \
+                        cl_uint32_t scratch, cl_uint32_t n, cl_uint32_t k) {   \
+    name##K(&mem[values], &mem[indices], &mem[input], n, k);                   \
+  }
+
+DEFINE_TOPK(topk, float)
+DEFINE_TOPK(topk_i8, cl_int8_t)
+#undef DEFINE_TOPK
+
+/// \returns the gradient \p g of the weight \p w with the decays applied,
+/// scaled by the inverse of the batch size \p gradScale.
+inline float regularizedGradient(float w, float g, float L1Decay,
+                                 float L2Decay, float gradScale) {
+  return (g + L1Decay * (w >= 0 ? 1.0f : -1.0f) + L2Decay * w) * gradScale;
+}
+
+__kernel void adagradK(__global float *newW, __global float *W,
+                       __global float *G, __global float *sumSq, float L1Decay,
+                       float L2Decay, float gradScale, float learningRate,
+                       float epsilon) {
+  size_t i = get_global_id(0);
+  float w = W[i];
+  float g = regularizedGradient(w, G[i], L1Decay, L2Decay, gradScale);
+  float s = sumSq[i] + g * g;
+  sumSq[i] = s;
+  newW[i] = w - learningRate * g / (sqrt(s) + epsilon);
+}
+
+__kernel void adagradW(__global void *mem, cl_uint32_t newW, cl_uint32_t W,
+                       cl_uint32_t G, cl_uint32_t sumSq, float L1Decay,
+                       float L2Decay, float gradScale, float learningRate,
+                       float epsilon) {
+  adagradK(&mem[newW], &mem[W], &mem[G], &mem[sumSq], L1Decay, L2Decay,
+           gradScale, learningRate, epsilon);
+}
+
+__kernel void rmspropK(__global float *newW, __global float *W,
+                       __global float *G, __global float *meanSq, float L1Decay,
+                       float L2Decay, float gradScale, float learningRate,
+                       float decay, float epsilon) {
+  size_t i = get_global_id(0);
+  float w = W[i];
+  float g = regularizedGradient(w, G[i], L1Decay, L2Decay, gradScale);
+  float s = decay * meanSq[i] + (1 - decay) * g * g;
+  meanSq[i] = s;
+  newW[i] = w - learningRate * g / (sqrt(s) + epsilon);
+}
+
+__kernel void rmspropW(__global void *mem, cl_uint32_t newW, cl_uint32_t W,
+                       cl_uint32_t G, cl_uint32_t meanSq, float L1Decay,
+                       float L2Decay, float gradScale, float learningRate,
+                       float decay, float epsilon) {
+  rmspropK(&mem[newW], &mem[W], &mem[G], &mem[meanSq], L1Decay, L2Decay,
+           gradScale, learningRate, decay, epsilon);
+}
+
+/// Adam update of a weight. \p step holds the number of previous updates,
+/// which the adam_step kernel increments afterwards.
+__kernel void adamK(__global float *newW, __global float *W, __global float *G,
+                    __global float *M, __global float *V,
+                    __global float *step, float L1Decay, float L2Decay,
+                    float gradScale, float learningRate, float beta1,
+                    float beta2, float epsilon) {
+  size_t i = get_global_id(0);
+  float t = step[0] + 1;
+  float stepSize = learningRate / (1 - pow(beta1, t));
+  float invCorrection2 = 1 / (1 - pow(beta2, t));
+  float w = W[i];
+  float g = regularizedGradient(w, G[i], L1Decay, L2Decay, gradScale);
+  float m = beta1 * M[i] + (1 - beta1) * g;
+  float v = beta2 * V[i] + (1 - beta2) * g * g;
+  M[i] = m;
+  V[i] = v;
+  newW[i] = w - stepSize * m / (sqrt(v * invCorrection2) + epsilon);
+}
+
+__kernel void adamW(__global void *mem, cl_uint32_t newW, cl_uint32_t W,
+                    cl_uint32_t G, cl_uint32_t M, cl_uint32_t V,
+                    cl_uint32_t step, float L1Decay, float L2Decay,
+                    float gradScale, float learningRate, float beta1,
+                    float beta2, float epsilon) {
+  adamK(&mem[newW], &mem[W], &mem[G], &mem[M], &mem[V], &mem[step], L1Decay,
+        L2Decay, gradScale, learningRate, beta1, beta2, epsilon);
+}
+
+__kernel void adam_stepW(__global void *mem, cl_uint32_t step) {
+  __global float *s = (__global float *)&mem[step];
+  s[0] += 1;
+}
+
+/// The batch normalization kernels see the tensors as {outer, numChannels,
+/// inner}, where outer and inner are the products of the dimensions before
+/// and after the channel.
+__kernel void batchnormalizationK(__global float *dest, __global float *src,
+                                  __global float *scale, __global float *bias,
+                                  __global float *mean, __global float *var,
+                                  cl_uint32_t numChannels, cl_uint32_t inner,
+                                  float epsilon) {
+  size_t i = get_global_id(0);
+  size_t c = (i / inner) % numChannels;
+  float coef = scale[c] / sqrt(var[c] + epsilon);
+  dest[i] = (src[i] - mean[c]) * coef + bias[c];
+}
+
+__kernel void batchnormalizationW(__global void *mem, cl_uint32_t dest,
+                                  cl_uint32_t src, cl_uint32_t scale,
+                                  cl_uint32_t bias, cl_uint32_t mean,
+                                  cl_uint32_t var, cl_uint32_t numChannels,
+                                  cl_uint32_t inner, float epsilon) {
+  batchnormalizationK(&mem[dest], &mem[src], &mem[scale], &mem[bias],
+                      &mem[mean], &mem[var], numChannels, inner, epsilon);
+}
+
+/// Each work item computes the gradients of one channel, with a reduction
+/// pass and an elementwise pass.
+__kernel void batchnormalizationgradK(
+    __global float *src, __global float *scale, __global float *mean,
+    __global float *var, __global float *destG, __global float *srcG,
+    __global float *scaleG, __global float *biasG, cl_uint32_t outer,
+    cl_uint32_t numChannels, cl_uint32_t inner, float epsilon) {
+  size_t c = get_global_id(0);
+  float N = outer * inner;
+  float mu = mean[c];
+  float sumDy = 0;
+  float sumDyhmu = 0;
+  for (size_t o = 0; o < outer; o++) {
+    size_t base = (o * numChannels + c) * inner;
+    for (size_t i = 0; i < inner; i++) {
+      float dy = destG[base + i];
+      sumDy += dy;
+      sumDyhmu += dy * (src[base + i] - mu);
+    }
+  }
+  float invVar = 1 / (var[c] + epsilon);
+  float invVarSqrt = sqrt(invVar);
+  float coef1 = scale[c] * invVarSqrt / N;
+  float coef2 = invVar * sumDyhmu;
+  for (size_t o = 0; o < outer; o++) {
+    size_t base = (o * numChannels + c) * inner;
+    for (size_t i = 0; i < inner; i++) {
+      srcG[base + i] =
+          coef1 * (N * destG[base + i] - sumDy - (src[base + i] - mu) * coef2);
+    }
+  }
+  biasG[c] = sumDy;
+  scaleG[c] = sumDyhmu * invVarSqrt;
+}
+
+__kernel void batchnormalizationgradW(
+    __global void *mem, cl_uint32_t src, cl_uint32_t scale, cl_uint32_t mean,
+    cl_uint32_t var, cl_uint32_t destG, cl_uint32_t srcG, cl_uint32_t scaleG,
+    cl_uint32_t biasG, cl_uint32_t outer, cl_uint32_t numChannels,
+    cl_uint32_t inner, float epsilon) {
+  batchnormalizationgradK(&mem[src], &mem[scale], &mem[mean], &mem[var],
+                          &mem[destG], &mem[srcG], &mem[scaleG], &mem[biasG],
+                          outer, numChannels, inner, epsilon);
+}
+
+/// Each work item computes the mean and the variance of one channel in two
+/// passes, and blends them with the running statistics.
+__kernel void meanvarnormalizationK(__global float *newMean,
+                                    __global float *newVar,
+                                    __global float *src, __global float *mean,
+                                    __global float *var, cl_uint32_t outer,
+                                    cl_uint32_t numChannels, cl_uint32_t inner,
+                                    float momentum) {
+  size_t c = get_global_id(0);
+  float N = outer * inner;
+  float sum = 0;
+  for (size_t o = 0; o < outer; o++) {
+    size_t base = (o * numChannels + c) * inner;
+    for (size_t i = 0; i < inner; i++) {
+      sum += src[base + i];
+    }
+  }
+  float localMean = sum / N;
+  float sumSq = 0;
+  for (size_t o = 0; o < outer; o++) {
+    size_t base = (o * numChannels + c) * inner;
+    for (size_t i = 0; i < inner; i++) {
+      float d = src[base + i] - localMean;
+      sumSq += d * d;
+    }
+  }
+  newMean[c] = momentum * localMean + (1 - momentum) * mean[c];
+  newVar[c] = momentum * (sumSq / N) + (1 - momentum) * var[c];
+}
+
+__kernel void meanvarnormalizationW(__global void *mem, cl_uint32_t newMean,
+                                    cl_uint32_t newVar, cl_uint32_t src,
+                                    cl_uint32_t mean, cl_uint32_t var,
+                                    cl_uint32_t outer, cl_uint32_t numChannels,
+                                    cl_uint32_t inner, float momentum) {
+  meanvarnormalizationK(&mem[newMean], &mem[newVar], &mem[src], &mem[mean],
+                        &mem[var], outer, numChannels, inner, momentum);
+}
+
 )";
@@ -18,8 +18,24 @@
 #include "glow/Base/Tensor.h"
 #include "glow/Support/Support.h"
 
+#include <vector>
+
 using namespace glow;
 
+std::pair<float, float> glow::normModeToRange(ImageNormalizationMode mode) {
+  switch (mode) {
+  case ImageNormalizationMode::kneg1to1:
+    return {-1., 1.};
+  case ImageNormalizationMode::k0to1:
+    return {0., 1.0};
+  case ImageNormalizationMode::k0to256:
+    return {0., 256.0};
+  case ImageNormalizationMode::kneg128to127:
+    return {-128., 127.};
+  }
+  GLOW_UNREACHABLE("Image format not defined.");
+}
+
 #if WITH_PNG
 #include <png.h>
 
@@ -60,8 +76,26 @@ std::tuple<size_t, size_t, bool> glow::getPngInfo(const char *filename) {
   return std::make_tuple(height, width, isGray);
 }
 
-bool glow::readPngImage(Tensor *T, const char *filename,
-                        std::pair<float, float> range) {
+namespace {
+/// A decoded png image with 8 bits per channel.
+struct PngImage {
+  size_t height;
+  size_t width;
+  /// The number of color channels: 1 for gray images, 3 otherwise.
+  size_t numChannels;
+  /// The distance between two pixels in bytes, which includes the alpha
+  /// channel.
+  size_t pixelBytes;
+  /// The rows of pixels, one after the other.
+  std::vector<png_byte> data;
+  /// The beginning of each row in data.
+  std::vector<png_bytep> rows;
+};
+} // namespace
+
+/// Decodes the png image \p filename into \p image. \returns True if an
+/// error occurred.
+static bool decodePng(const char *filename, PngImage &image) {
   unsigned char header[8];
   // open file and test for it being a png.
   FILE *fp = fopen(filename, "rb");
@@ -125,42 +159,121 @@ bool glow::readPngImage(Tensor *T, const char *filename,
     return true;
   }
 
-  auto *row_pointers = (png_bytep *)malloc(sizeof(png_bytep) * height);
+  size_t rowBytes = png_get_rowbytes(png_ptr, info_ptr);
+  image.height = height;
+  image.width = width;
+  image.numChannels = numChannels;
+  image.pixelBytes = hasAlpha ? numChannels + 1 : numChannels;
+  image.data.resize(rowBytes * height);
+  image.rows.resize(height);
   for (size_t y = 0; y < height; y++) {
-    row_pointers[y] = (png_byte *)malloc(png_get_rowbytes(png_ptr, info_ptr));
+    image.rows[y] = &image.data[y * rowBytes];
   }
 
-  png_read_image(png_ptr, row_pointers);
+  png_read_image(png_ptr, image.rows.data());
   png_read_end(png_ptr, info_ptr);
+  png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+  fclose(fp);
 
-  T->reset(ElemKind::FloatTy, {width, height, numChannels});
-  auto H = T->getHandle<>();
+  return false;
+}
 
+/// Normalize the \p width pixels of \p src, which are \p PixelBytes bytes
+/// apart, with \p scale and \p bias. The channel z of the pixels is written
+/// to \p dest[z], with \p DestStride floats between two pixels. The strides
+/// are constants so that the compiler vectorizes the loops.
+template <size_t PixelBytes, size_t DestStride>
+static void normalizeRow(const png_byte *src, size_t width,
+                         size_t numChannels, float scale, float bias,
+                         float *const *dest) {
+  for (size_t z = 0; z < numChannels; z++) {
+    const png_byte *channel = src + z;
+    float *out = dest[z];
+    for (size_t x = 0; x < width; x++) {
+      out[x * DestStride] = float(channel[x * PixelBytes]) * scale + bias;
+    }
+  }
+}
+
+/// Normalize the row \p y of \p image to the range \p range into \p dest,
+/// see above.
+static void normalizeRow(const PngImage &image, size_t y,
+                         std::pair<float, float> range, size_t destStride,
+                         float *const *dest) {
   float scale = ((range.second - range.first) / 255.0);
   float bias = range.first;
+  const png_byte *src = image.rows[y];
+#define NORMALIZE_ROW(PIXEL_BYTES, DEST_STRIDE)                                \
+  if (image.pixelBytes == PIXEL_BYTES && destStride == DEST_STRIDE) {          \
+    normalizeRow<PIXEL_BYTES, DEST_STRIDE>(src, image.width,                   \
+                                           image.numChannels, scale, bias,     \
+                                           dest);                              \
+    return;                                                                    \
+  }
+  // Gray, RGB and RGBA pixels, into planes or into interleaved channels.
+  NORMALIZE_ROW(1, 1);
+  NORMALIZE_ROW(3, 1);
+  NORMALIZE_ROW(4, 1);
+  NORMALIZE_ROW(3, 3);
+  NORMALIZE_ROW(4, 3);
+#undef NORMALIZE_ROW
+  GLOW_UNREACHABLE("Unsupported pixel format.");
+}
 
-  for (size_t row_n = 0; row_n < height; row_n++) {
-    png_byte *row = row_pointers[row_n];
-    for (size_t col_n = 0; col_n < width; col_n++) {
-      png_byte *ptr =
-          &(row[col_n * (hasAlpha ? (numChannels + 1) : numChannels)]);
-      if (isGray) {
-        H.at({row_n, col_n, 0}) = float(ptr[0]) * scale + bias;
-      } else {
-        H.at({row_n, col_n, 0}) = float(ptr[0]) * scale + bias;
-        H.at({row_n, col_n, 1}) = float(ptr[1]) * scale + bias;
-        H.at({row_n, col_n, 2}) = float(ptr[2]) * scale + bias;
-      }
-    }
+bool glow::readPngImage(Tensor *T, const char *filename,
+                        std::pair<float, float> range) {
+  PngImage image;
+  if (decodePng(filename, image)) {
+    return true;
   }
 
+  size_t height = image.height;
+  size_t width = image.width;
+  size_t numChannels = image.numChannels;
+  T->reset(ElemKind::FloatTy, {height, width, numChannels});
+  float *data = reinterpret_cast<float *>(T->getUnsafePtr());
   for (size_t y = 0; y < height; y++) {
-    free(row_pointers[y]);
+    float *dest[3];
+    for (size_t z = 0; z < numChannels; z++) {
+      dest[z] = data + y * width * numChannels + z;
+    }
+    normalizeRow(image, y, range, numChannels, dest);
   }
-  free(row_pointers);
-  png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-  fclose(fp);
+  return false;
+}
 
+bool glow::readPngImageIntoBatch(Tensor *batch, size_t n, const char *filename,
+                                 std::pair<float, float> range,
+                                 ImageChannelOrder order, ImageLayout layout) {
+  PngImage image;
+  if (decodePng(filename, image)) {
+    return true;
+  }
+
+  size_t height = image.height;
+  size_t width = image.width;
+  size_t numChannels = image.numChannels;
+  auto dims = batch->dims();
+  bool isNCHW = layout == ImageLayout::NCHW;
+  if (batch->getElementType() != ElemKind::FloatTy || dims.size() != 4 ||
+      n >= dims[0] || (isNCHW ? dims[1] : dims[3]) != numChannels ||
+      (isNCHW ? dims[2] : dims[1]) != height ||
+      (isNCHW ? dims[3] : dims[2]) != width) {
+    return true;
+  }
+
+  float *data = reinterpret_cast<float *>(batch->getUnsafePtr()) +
+                n * height * width * numChannels;
+  for (size_t y = 0; y < height; y++) {
+    // The first float of channel z of the row in the batch.
+    float *dest[3];
+    for (size_t z = 0; z < numChannels; z++) {
+      size_t c = order == ImageChannelOrder::BGR ? numChannels - 1 - z : z;
+      dest[z] = isNCHW ? data + (c * height + y) * width
+                       : data + y * width * numChannels + c;
+    }
+    normalizeRow(image, y, range, isNCHW ? 1 : numChannels, dest);
+  }
   return false;
 }
 
@@ -258,6 +371,12 @@ bool glow::readPngImage(Tensor *T, const char *filename,
   GLOW_ASSERT(false && "Not configured with libpng");
 }
 
+bool glow::readPngImageIntoBatch(Tensor *batch, size_t n, const char *filename,
+                                 std::pair<float, float> range,
+                                 ImageChannelOrder order, ImageLayout layout) {
+  GLOW_ASSERT(false && "Not configured with libpng");
+}
+
 bool glow::writePngImage(Tensor *T, const char *filename,
                          std::pair<float, float> range) {
   GLOW_ASSERT(false && "Not configured with libpng");
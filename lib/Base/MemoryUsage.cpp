@@ -0,0 +1,37 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Base/MemoryUsage.h"
+
+#include "llvm/Support/Format.h"
+
+using namespace glow;
+
+void MemoryUsage::dump(llvm::raw_ostream &os) const {
+  auto dumpArea = [&os](llvm::StringRef name, uint64_t bytes) {
+    os << llvm::format("  %-18s %14llu bytes %10.2f MB\n", name.data(),
+                       (unsigned long long)bytes, bytes / 1048576.);
+  };
+  os << "Memory usage:\n";
+  dumpArea("constant weights", constantWeights);
+  dumpArea("mutable weights", mutableWeights);
+  dumpArea("activations", activations);
+  dumpArea("code", code);
+  dumpArea("scratch", scratch);
+  dumpArea("total", getTotal());
+}
+
+void MemoryUsage::dump() const { dump(llvm::outs()); }
@@ -15,10 +15,14 @@
  */
 
 #include "glow/Base/Tensor.h"
+#include "glow/Support/ThreadPool.h"
 
 #include "llvm/Support/NativeFormatting.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace glow;
 
 namespace {
@@ -189,79 +193,122 @@ static void dumpAsciiGenericImpl(Handle<ElemTy> handle, llvm::raw_ostream &os) {
   }
 }
 
-/// This is a slow generic transpose. This method performs a single for loop
-/// over a single dimension, or if we've reached the last dimension perform a
-/// single copy of a single element.
+/// A dimension of a strided copy: its size and the distances, in elements,
+/// between its consecutive coordinates in the destination and in the source.
+struct StridedDim {
+  size_t size;
+  size_t destStride;
+  size_t srcStride;
+};
+
+/// The side, in bytes, of the tiles that transposed copies are split into. A
+/// tile of the destination and the matching tile of the source fit in L1.
+constexpr size_t copyTileBytes = 64;
+
+/// Copy the rows \p R by the columns \p C of \p src to \p dest, one tile at a
+/// time. The copy is recursively split along its longer side until it fits in
+/// a tile, which keeps the accesses of both sides local at every level of the
+/// cache hierarchy.
 template <class ElemTy>
-static void transposeGenericImpl(Handle<ElemTy> &src, Handle<ElemTy> &dest,
-                                 size_t *srcCoor, size_t *destCoor,
-                                 llvm::ArrayRef<unsigned_t> shuffle,
-                                 unsigned depth = 0) {
-  if (depth == shuffle.size()) {
-    auto srcIdx = llvm::ArrayRef<size_t>(srcCoor, depth);
-    auto destIdx = llvm::ArrayRef<size_t>(destCoor, depth);
-    dest.at(destIdx) = src.at(srcIdx);
+static void copyTiled(ElemTy *dest, const ElemTy *src, const StridedDim &R,
+                      const StridedDim &C, size_t rows, size_t cols) {
+  constexpr size_t tile = copyTileBytes / sizeof(ElemTy);
+  if (rows <= tile && cols <= tile) {
+    for (size_t r = 0; r < rows; r++) {
+      for (size_t c = 0; c < cols; c++) {
+        dest[r * R.destStride + c * C.destStride] =
+            src[r * R.srcStride + c * C.srcStride];
+      }
+    }
     return;
   }
-
-  // Iterate over one dimension and continue recursively to the next dim.
-  for (size_t x = 0, e = dest.dims()[depth]; x < e; x++) {
-    unsigned_t swizzledDepth = shuffle[depth];
-    srcCoor[swizzledDepth] = x;
-    destCoor[depth] = x;
-    transposeGenericImpl(src, dest, srcCoor, destCoor, shuffle, depth + 1);
+  if (rows >= cols) {
+    size_t half = rows / 2;
+    copyTiled(dest, src, R, C, half, cols);
+    copyTiled(dest + half * R.destStride, src + half * R.srcStride, R, C,
+              rows - half, cols);
+  } else {
+    size_t half = cols / 2;
+    copyTiled(dest, src, R, C, rows, half);
+    copyTiled(dest + half * C.destStride, src + half * C.srcStride, R, C, rows,
+              cols - half);
   }
 }
 
-/// Faster function for transposing a tensor for important/common tensor
-/// shapes. If a transpose successfully occurs, the function \returns true;
-/// otherwise it \returns false, representing no transpose occurred and some
-/// other transpose function (e.g. transposeGenericImpl) must be called. \p
-/// dest is the tensor to transpose, and \p shuffle defines how to transpose.
+/// Copy the region of the \p numDims dimensions \p dims from \p src to
+/// \p dest. The dimensions must have been normalized by
+/// normalizeStridedDims().
 template <class ElemTy>
-static bool tryTransposeFastImpl(Handle<ElemTy> &src, Handle<ElemTy> &dest,
-                                 llvm::ArrayRef<unsigned_t> shuffle) {
-  const size_t numDims = dest.dims().size();
-  size_t srcCoorArr[max_tensor_dimensions];
-  size_t destCoorArr[max_tensor_dimensions] = {0};
-  auto srcCoor = llvm::ArrayRef<size_t>(srcCoorArr, numDims);
-  auto destCoor = llvm::ArrayRef<size_t>(destCoorArr, numDims);
-
-  /// This defines a single depth of the for loop used to iterate over the
-  /// source and destination tensors for transposing.
-#define TRANSPOSE_LOOP_LEVEL(DEPTH_)                                           \
-  for (srcCoorArr[shuffle[DEPTH_]] = 0, destCoorArr[DEPTH_] = 0;               \
-       destCoorArr[DEPTH_] < dest.dims()[DEPTH_];                              \
-       srcCoorArr[shuffle[DEPTH_]]++, destCoorArr[DEPTH_]++)
-
-  switch (numDims) {
-  case 2:
-    TRANSPOSE_LOOP_LEVEL(1) {
-      TRANSPOSE_LOOP_LEVEL(0) { dest.at(destCoor) = src.at(srcCoor); }
+static void copyStridedImpl(ElemTy *dest, const ElemTy *src,
+                            const StridedDim *dims, size_t numDims) {
+  const StridedDim &D = dims[0];
+  if (numDims == 1) {
+    if (D.destStride == 1 && D.srcStride == 1) {
+      memcpy(dest, src, D.size * sizeof(ElemTy));
+      return;
     }
-    return true;
-  case 4:
-    TRANSPOSE_LOOP_LEVEL(1) {
-      TRANSPOSE_LOOP_LEVEL(2) {
-        TRANSPOSE_LOOP_LEVEL(0) {
-          TRANSPOSE_LOOP_LEVEL(3) { dest.at(destCoor) = src.at(srcCoor); }
-        }
-      }
+    for (size_t i = 0; i < D.size; i++) {
+      dest[i * D.destStride] = src[i * D.srcStride];
     }
-    return true;
+    return;
+  }
+  const StridedDim &inner = dims[1];
+  if (numDims == 2 && (inner.destStride != 1 || inner.srcStride != 1)) {
+    copyTiled(dest, src, D, inner, D.size, inner.size);
+    return;
+  }
+  for (size_t i = 0; i < D.size; i++) {
+    copyStridedImpl(dest + i * D.destStride, src + i * D.srcStride, dims + 1,
+                    numDims - 1);
   }
-  return false;
 }
 
-template <class ElemTy>
-static void transposeSelectImpl(Handle<ElemTy> &src, Handle<ElemTy> &dest,
-                                llvm::ArrayRef<unsigned_t> shuffle) {
-  bool transposeOccurred = tryTransposeFastImpl(src, dest, shuffle);
-  if (!transposeOccurred) {
-    size_t srcCoor[max_tensor_dimensions];
-    size_t destCoor[max_tensor_dimensions];
-    transposeGenericImpl(src, dest, srcCoor, destCoor, shuffle);
+/// Drop the dimensions of size one of the \p numDims dimensions \p dims and
+/// merge the dimensions that are contiguous in both buffers, so that the inner
+/// copies are as long as possible. If the innermost dimension is contiguous in
+/// only one of the buffers, the dimension with the smallest stride in the other
+/// buffer is moved just outside of it, which turns the two inner dimensions
+/// into a transpose. A copy does not depend on the order of its dimensions.
+/// \returns the new number of dimensions.
+static size_t normalizeStridedDims(StridedDim *dims, size_t numDims) {
+  size_t n = 0;
+  for (size_t i = 0; i < numDims; i++) {
+    const StridedDim &D = dims[i];
+    if (D.size == 1) {
+      continue;
+    }
+    if (n && dims[n - 1].destStride == D.destStride * D.size &&
+        dims[n - 1].srcStride == D.srcStride * D.size) {
+      dims[n - 1].size *= D.size;
+      dims[n - 1].destStride = D.destStride;
+      dims[n - 1].srcStride = D.srcStride;
+      continue;
+    }
+    dims[n++] = D;
+  }
+  if (n < 3) {
+    return n;
+  }
+
+  const StridedDim &inner = dims[n - 1];
+  if (inner.destStride != 1 && inner.srcStride != 1) {
+    return n;
+  }
+  if (inner.destStride == 1 && inner.srcStride == 1) {
+    return n;
+  }
+  bool destContiguous = inner.destStride == 1;
+  size_t best = n - 2;
+  for (size_t i = 0; i < n - 1; i++) {
+    size_t stride = destContiguous ? dims[i].srcStride : dims[i].destStride;
+    size_t bestStride =
+        destContiguous ? dims[best].srcStride : dims[best].destStride;
+    if (stride < bestStride) {
+      best = i;
+    }
   }
+  std::rotate(dims + best, dims + best + 1, dims + n - 1);
+  return n;
 }
 } // namespace
 
@@ -269,6 +316,10 @@ void glow::dumpAsciiImpl(Tensor *T, llvm::raw_ostream &os) {
   switch (T->getElementType()) {
   case ElemKind::FloatTy:
     return dumpAsciiGenericImpl(T->getHandle<float>(), os);
+  case ElemKind::Float16Ty:
+    return dumpAsciiGenericImpl(T->getHandle<float16_t>(), os);
+  case ElemKind::BFloat16Ty:
+    return dumpAsciiGenericImpl(T->getHandle<bfloat16_t>(), os);
   case ElemKind::Int8QTy:
     return dumpAsciiGenericImpl(T->getHandle<int8_t>(), os);
   case ElemKind::Int16QTy:
@@ -286,6 +337,10 @@ void glow::dumpImpl(Tensor *T, llvm::raw_ostream &os) {
   switch (T->getElementType()) {
   case ElemKind::FloatTy:
     return dumpGenericImpl(T->getHandle<float>(), os);
+  case ElemKind::Float16Ty:
+    return dumpGenericImpl(T->getHandle<float16_t>(), os);
+  case ElemKind::BFloat16Ty:
+    return dumpGenericImpl(T->getHandle<bfloat16_t>(), os);
   case ElemKind::Int8QTy:
     return dumpGenericImpl(T->getHandle<int8_t>(), os);
   case ElemKind::Int16QTy:
@@ -315,37 +370,67 @@ void glow::genericTranspose(Tensor *src, Tensor *dest,
   auto destType = Type::newShape(src->getType(), {newSizes, origDims.size()});
   dest->reset(destType);
 
-  switch (src->getElementType()) {
-  case ElemKind::FloatTy: {
-    auto srcH = src->getHandle<float>();
-    auto destH = dest->getHandle<float>();
-    transposeSelectImpl(srcH, destH, shuffle);
-    return;
-  }
-  case ElemKind::Int8QTy: {
-    auto srcH = src->getHandle<int8_t>();
-    auto destH = dest->getHandle<int8_t>();
-    transposeSelectImpl(srcH, destH, shuffle);
-    return;
+  // Coordinate i of the destination is coordinate shuffle[i] of the source.
+  size_t srcStrides[max_tensor_dimensions];
+  size_t destStrides[max_tensor_dimensions];
+  size_t shuffledStrides[max_tensor_dimensions];
+  size_t numDims = origDims.size();
+  for (size_t i = numDims, srcStride = 1, destStride = 1; i > 0; i--) {
+    srcStrides[i - 1] = srcStride;
+    destStrides[i - 1] = destStride;
+    srcStride *= origDims[i - 1];
+    destStride *= newSizes[i - 1];
   }
-  case ElemKind::Int16QTy: {
-    auto srcH = src->getHandle<int16_t>();
-    auto destH = dest->getHandle<int16_t>();
-    transposeSelectImpl(srcH, destH, shuffle);
-    return;
+  for (size_t i = 0; i < numDims; i++) {
+    shuffledStrides[i] = srcStrides[shuffle[i]];
   }
-  case ElemKind::Int32QTy: {
-    auto srcH = src->getHandle<int32_t>();
-    auto destH = dest->getHandle<int32_t>();
-    transposeSelectImpl(srcH, destH, shuffle);
-    return;
+
+  copyStrided(dest->getUnsafePtr(), src->getUnsafePtr(), {newSizes, numDims},
+              {destStrides, numDims}, {shuffledStrides, numDims},
+              src->getType().getElementSize());
+}
+
+void glow::copyStrided(char *dest, const char *src,
+                       llvm::ArrayRef<size_t> dims,
+                       llvm::ArrayRef<size_t> destStrides,
+                       llvm::ArrayRef<size_t> srcStrides, size_t elemSize) {
+  assert(dims.size() == destStrides.size() &&
+         dims.size() == srcStrides.size() && "Invalid strides");
+  assert(dims.size() <= max_tensor_dimensions && "Too many dimensions");
+
+  StridedDim strided[max_tensor_dimensions];
+  for (size_t i = 0, e = dims.size(); i < e; i++) {
+    if (!dims[i]) {
+      return;
+    }
+    strided[i] = {dims[i], destStrides[i], srcStrides[i]};
   }
-  case ElemKind::Int64ITy: {
-    auto srcH = src->getHandle<int64_t>();
-    auto destH = dest->getHandle<int64_t>();
-    transposeSelectImpl(srcH, destH, shuffle);
+  size_t numDims = normalizeStridedDims(strided, dims.size());
+  if (!numDims) {
+    memcpy(dest, src, elemSize);
     return;
   }
+
+  // The elements are copied as integers of their size.
+  switch (elemSize) {
+  case 1:
+    return copyStridedImpl(reinterpret_cast<uint8_t *>(dest),
+                           reinterpret_cast<const uint8_t *>(src), strided,
+                           numDims);
+  case 2:
+    return copyStridedImpl(reinterpret_cast<uint16_t *>(dest),
+                           reinterpret_cast<const uint16_t *>(src), strided,
+                           numDims);
+  case 4:
+    return copyStridedImpl(reinterpret_cast<uint32_t *>(dest),
+                           reinterpret_cast<const uint32_t *>(src), strided,
+                           numDims);
+  case 8:
+    return copyStridedImpl(reinterpret_cast<uint64_t *>(dest),
+                           reinterpret_cast<const uint64_t *>(src), strided,
+                           numDims);
+  default:
+    llvm_unreachable("Unsupported element size");
   }
 }
 
@@ -357,6 +442,19 @@ ShapeVector glow::expandDimsToMax(llvm::ArrayRef<size_t> currDims) {
   return newDims;
 }
 
+/// The smallest range that forEachBlock() splits among the threads, below
+/// which waking up the workers costs more than filling the range.
+static constexpr size_t parallelBlockSize = 1 << 16;
+
+void glow::forEachBlock(
+    size_t size, const std::function<void(size_t begin, size_t end)> &fn) {
+  if (size < 2 * parallelBlockSize) {
+    fn(0, size);
+    return;
+  }
+  ThreadPool::getShared().parallelFor(size, parallelBlockSize, fn);
+}
+
 void Tensor::init(InitKind init, float val, PseudoRNG &PRNG) {
   switch (init) {
   case InitKind::Zero:
@@ -369,6 +467,14 @@ void Tensor::init(InitKind init, float val, PseudoRNG &PRNG) {
       getHandle<float>().clear(val);
       break;
     }
+    case ElemKind::Float16Ty: {
+      getHandle<float16_t>().clear(val);
+      break;
+    }
+    case ElemKind::BFloat16Ty: {
+      getHandle<bfloat16_t>().clear(val);
+      break;
+    }
     case ElemKind::Int8QTy: {
       getHandle<int8_t>().clear(val);
       break;
@@ -395,6 +501,14 @@ void Tensor::init(InitKind init, float val, PseudoRNG &PRNG) {
       getHandle<float>().initXavier(val, PRNG);
       break;
     }
+    case ElemKind::Float16Ty: {
+      getHandle<float16_t>().initXavier(val, PRNG);
+      break;
+    }
+    case ElemKind::BFloat16Ty: {
+      getHandle<bfloat16_t>().initXavier(val, PRNG);
+      break;
+    }
     case ElemKind::Int8QTy: {
       getHandle<int8_t>().initXavier(val, PRNG);
       break;
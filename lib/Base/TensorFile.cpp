@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Base/TensorFile.h"
+
+#include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+
+using namespace glow;
+
+namespace {
+/// The magic string that NPY files start with.
+constexpr char npyMagic[] = "\x93NUMPY";
+constexpr size_t npyMagicSize = sizeof(npyMagic) - 1;
+
+/// \returns the value of the key \p key of the Python dict literal \p header,
+/// e.g. '<f4' for 'descr', or an empty string if it is missing.
+llvm::StringRef getHeaderValue(llvm::StringRef header, llvm::StringRef key) {
+  size_t pos = header.find(("'" + key + "'").str());
+  if (pos == llvm::StringRef::npos) {
+    return "";
+  }
+  llvm::StringRef value = header.drop_front(pos + key.size() + 2).ltrim();
+  if (!value.consume_front(":")) {
+    return "";
+  }
+  value = value.ltrim();
+  if (value.startswith("(")) {
+    return value.take_until([](char c) { return c == ')'; }).drop_front();
+  }
+  if (value.startswith("'")) {
+    return value.drop_front().take_until([](char c) { return c == '\''; });
+  }
+  return value.take_until([](char c) { return c == ',' || c == '}'; }).rtrim();
+}
+
+/// \returns the size of the elements of the kind \p kind.
+size_t getElementSize(NpyFile::Kind kind) {
+  switch (kind) {
+  case NpyFile::Kind::Float32:
+    return sizeof(float);
+  case NpyFile::Kind::Int64:
+    return sizeof(int64_t);
+  case NpyFile::Kind::UInt8:
+    return sizeof(uint8_t);
+  }
+  llvm_unreachable("Unknown element kind");
+}
+} // namespace
+
+std::unique_ptr<NpyFile> NpyFile::open(llvm::StringRef filename) {
+  auto fail = [&](llvm::StringRef reason) {
+    llvm::errs() << filename << ": " << reason << "\n";
+    return nullptr;
+  };
+  // Large files are mapped rather than read.
+  auto buffer = llvm::MemoryBuffer::getFile(filename, /* FileSize */ -1,
+                                            /* RequiresNullTerminator */ false);
+  if (!buffer) {
+    return fail(buffer.getError().message());
+  }
+  llvm::StringRef contents = (*buffer)->getBuffer();
+  if (contents.size() < npyMagicSize + 4 ||
+      !contents.startswith(llvm::StringRef(npyMagic, npyMagicSize))) {
+    return fail("not an NPY file");
+  }
+
+  // Version 1 has a 16-bit header length, the later ones a 32-bit one.
+  auto *bytes = reinterpret_cast<const uint8_t *>(contents.data());
+  unsigned major = bytes[npyMagicSize];
+  size_t headerLenPos = npyMagicSize + 2;
+  size_t headerLen = bytes[headerLenPos] | (bytes[headerLenPos + 1] << 8);
+  size_t headerPos = headerLenPos + 2;
+  if (major >= 2) {
+    if (contents.size() < headerPos + 2) {
+      return fail("truncated header");
+    }
+    headerLen |= (size_t(bytes[headerLenPos + 2]) << 16) |
+                 (size_t(bytes[headerLenPos + 3]) << 24);
+    headerPos += 2;
+  }
+  if (contents.size() < headerPos + headerLen) {
+    return fail("truncated header");
+  }
+  llvm::StringRef header = contents.substr(headerPos, headerLen);
+
+  std::unique_ptr<NpyFile> file(new NpyFile());
+  llvm::StringRef descr = getHeaderValue(header, "descr");
+  // The elements must be in the byte order of the host.
+  char order = descr.empty() ? 0 : descr[0];
+  bool hostOrder = order == '|' || order == '=' ||
+                   order == (llvm::sys::IsLittleEndianHost ? '<' : '>');
+  descr = descr.drop_front();
+  if (hostOrder && descr == "f4") {
+    file->kind_ = Kind::Float32;
+  } else if (hostOrder && descr == "i8") {
+    file->kind_ = Kind::Int64;
+  } else if (hostOrder && descr == "u1") {
+    file->kind_ = Kind::UInt8;
+  } else {
+    return fail("only float32, int64 and uint8 arrays in the byte order of "
+                "the host are supported");
+  }
+  if (getHeaderValue(header, "fortran_order") != "False") {
+    return fail("only arrays in row-major order are supported");
+  }
+  llvm::SmallVector<llvm::StringRef, max_tensor_dimensions> dimStrs;
+  getHeaderValue(header, "shape").split(dimStrs, ',', -1, false);
+  for (auto dimStr : dimStrs) {
+    size_t dim;
+    if (dimStr.trim().getAsInteger(10, dim)) {
+      return fail("invalid shape");
+    }
+    file->dims_.push_back(dim);
+  }
+  if (file->dims_.empty() || file->dims_.size() > max_tensor_dimensions) {
+    return fail("the array must have between 1 and 6 dimensions");
+  }
+
+  file->data_ = contents.data() + headerPos + headerLen;
+  if (contents.size() - headerPos - headerLen <
+      file->getSampleSize() * file->getNumSamples()) {
+    return fail("truncated array");
+  }
+  file->buffer_ = std::move(*buffer);
+  return file;
+}
+
+size_t NpyFile::getSampleSize() const {
+  size_t size = getElementSize(kind_);
+  for (auto d : getSampleDims()) {
+    size *= d;
+  }
+  return size;
+}
+
+Tensor NpyFile::getSamples(size_t first, size_t count) const {
+  assert(kind_ != Kind::UInt8 && "The samples must be converted");
+  assert(first + count <= getNumSamples() && "Out of range samples");
+  std::vector<size_t> dims(dims_);
+  dims[0] = count;
+  Type ty(kind_ == Kind::Float32 ? glow::ElemKind::FloatTy
+                                 : glow::ElemKind::Int64ITy,
+          dims);
+  return Tensor(const_cast<char *>(data_ + first * getSampleSize()), &ty);
+}
+
+void NpyFile::copySamples(size_t first, size_t count, Tensor *batch,
+                          std::pair<float, float> range) const {
+  assert(first + count <= getNumSamples() && "Out of range samples");
+  assert(count <= batch->dims()[0] && "The batch is too small");
+  assert(batch->dims().drop_front() == getSampleDims() &&
+         "The samples of the batch do not match");
+  size_t numElements = count * (getSampleSize() / getElementSize(kind_));
+  if (kind_ != Kind::UInt8) {
+    assert(batch->getElementType() == (kind_ == Kind::Float32
+                                           ? glow::ElemKind::FloatTy
+                                           : glow::ElemKind::Int64ITy) &&
+           "The elements of the batch do not match");
+    memcpy(batch->getUnsafePtr(), data_ + first * getSampleSize(),
+           count * getSampleSize());
+    return;
+  }
+  assert(batch->getElementType() == glow::ElemKind::FloatTy &&
+         "The uint8 samples are converted to float");
+  float scale = (range.second - range.first) / 255.0;
+  float bias = range.first;
+  auto *src =
+      reinterpret_cast<const uint8_t *>(data_) + first * getSampleSize();
+  auto *dest = reinterpret_cast<float *>(batch->getUnsafePtr());
+  for (size_t i = 0; i < numElements; i++) {
+    dest[i] = float(src[i]) * scale + bias;
+  }
+}
@@ -26,6 +26,8 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 using namespace glow;
 
 namespace glow {
@@ -44,31 +46,301 @@ static_assert(std::is_unsigned<decltype(MemoryAllocator::npos)>{},
 
 const uint64_t MemoryAllocator::npos = -1;
 
+void FreeSegmentTree::update(int t) {
+  Node &node = nodes_[t];
+  node.maxSize = node.segment.size();
+  if (node.left != -1) {
+    node.maxSize = std::max(node.maxSize, nodes_[node.left].maxSize);
+  }
+  if (node.right != -1) {
+    node.maxSize = std::max(node.maxSize, nodes_[node.right].maxSize);
+  }
+}
+
+void FreeSegmentTree::split(int t, uint64_t key, int &left, int &right) {
+  if (t == -1) {
+    left = right = -1;
+    return;
+  }
+  if (nodes_[t].segment.begin_ < key) {
+    split(nodes_[t].right, key, nodes_[t].right, right);
+    left = t;
+  } else {
+    split(nodes_[t].left, key, left, nodes_[t].left);
+    right = t;
+  }
+  update(t);
+}
+
+int FreeSegmentTree::merge(int left, int right) {
+  if (left == -1 || right == -1) {
+    return left == -1 ? right : left;
+  }
+  if (nodes_[left].priority > nodes_[right].priority) {
+    nodes_[left].right = merge(nodes_[left].right, right);
+    update(left);
+    return left;
+  }
+  nodes_[right].left = merge(left, nodes_[right].left);
+  update(right);
+  return right;
+}
+
+void FreeSegmentTree::insert(uint64_t begin, uint64_t end) {
+  assert(begin < end && "Empty free segment");
+  // Draw the priority of the new node from a xorshift generator.
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  Node node{Segment(begin, end), end - begin, seed_, -1, -1};
+  int t;
+  if (freeNodes_.empty()) {
+    t = nodes_.size();
+    nodes_.push_back(node);
+  } else {
+    t = freeNodes_.back();
+    freeNodes_.pop_back();
+    nodes_[t] = node;
+  }
+  int left, right;
+  split(root_, begin, left, right);
+  root_ = merge(merge(left, t), right);
+}
+
+void FreeSegmentTree::erase(uint64_t begin) {
+  int left, mid, right;
+  split(root_, begin, left, mid);
+  split(mid, begin + 1, mid, right);
+  assert(mid != -1 && nodes_[mid].left == -1 && nodes_[mid].right == -1 &&
+         "Unknown free segment");
+  freeNodes_.push_back(mid);
+  root_ = merge(left, right);
+}
+
+const Segment *FreeSegmentTree::findFirstFit(uint64_t size) const {
+  int t = root_;
+  if (t == -1 || nodes_[t].maxSize < size) {
+    return nullptr;
+  }
+  // The subtree of t always contains a segment that is large enough. Prefer
+  // the segments with lower addresses.
+  while (true) {
+    const Node &node = nodes_[t];
+    if (node.left != -1 && nodes_[node.left].maxSize >= size) {
+      t = node.left;
+    } else if (node.segment.size() >= size) {
+      return &node.segment;
+    } else {
+      t = node.right;
+    }
+  }
+}
+
+void FreeSegmentTree::clear() {
+  nodes_.clear();
+  freeNodes_.clear();
+  root_ = -1;
+}
+
 uint64_t MemoryAllocator::allocate(uint64_t size, Handle handle) {
   // Always allocate buffers properly aligned to hold values of any type.
   uint64_t segmentSize = alignedSize(size, TensorAlignment);
-  uint64_t prev = 0;
-  for (auto it = allocations_.begin(), e = allocations_.end(); it != e; it++) {
-    if (it->begin_ - prev >= segmentSize) {
-      allocations_.emplace(it, prev, prev + segmentSize);
-      maxMemoryAllocated_ = std::max(maxMemoryAllocated_, prev + segmentSize);
-      setHandle(prev, size, handle);
-      return prev;
+  uint64_t begin;
+  if (const Segment *hole = freeSegments_.findFirstFit(segmentSize)) {
+    // Use the lowest hole between the live buffers that is large enough, and
+    // keep the rest of it free.
+    begin = hole->begin_;
+    uint64_t holeEnd = hole->end_;
+    freeSegments_.erase(begin);
+    if (holeEnd > begin + segmentSize) {
+      freeSegments_.insert(begin + segmentSize, holeEnd);
+    }
+  } else {
+    // Could not find a place for the new buffer in the middle of the live
+    // buffers. Push the new allocation to the end of the stack.
+    begin = allocations_.empty() ? 0 : allocations_.rbegin()->second;
+
+    // Check that we are not allocating memory beyond the pool size.
+    if (poolSize_ && (begin + segmentSize) > poolSize_) {
+      return npos;
     }
-    prev = it->end_;
   }
-  // Could not find a place for the new buffer in the middle of the list. Push
-  // the new allocation to the end of the stack.
 
-  // Check that we are not allocating memory beyond the pool size.
-  if (poolSize_ && (prev + segmentSize) > poolSize_) {
-    return npos;
+  allocations_.emplace(begin, begin + segmentSize);
+  maxMemoryAllocated_ = std::max(maxMemoryAllocated_, begin + segmentSize);
+  setHandle(begin, size, handle);
+  return begin;
+}
+
+namespace {
+/// A buffer of a sequence of allocations, which lives during the steps
+/// [start .. end) of the sequence.
+struct PlannedBuffer {
+  MemoryAllocator::Handle handle;
+  uint64_t size;
+  uint64_t segmentSize;
+  size_t start;
+  size_t end;
+};
+} // namespace
+
+/// Assigns \p addresses to the \p buffers, in the order given by \p order.
+/// Every buffer goes into the smallest hole left by the already placed buffers
+/// whose lifetimes overlap with its own, or after all of them if no hole is
+/// large enough. \returns the high water mark of the assignment.
+static uint64_t placeBuffers(const std::vector<PlannedBuffer> &buffers,
+                             const std::vector<size_t> &order,
+                             std::vector<uint64_t> &addresses) {
+  addresses.assign(buffers.size(), 0);
+  uint64_t maxMemory = 0;
+  std::vector<size_t> placed;
+  // The address ranges of the placed buffers that are live at the same time
+  // as the current one.
+  std::vector<std::pair<uint64_t, uint64_t>> overlapping;
+  for (size_t idx : order) {
+    const PlannedBuffer &B = buffers[idx];
+    overlapping.clear();
+    for (size_t p : placed) {
+      const PlannedBuffer &P = buffers[p];
+      if (P.start < B.end && B.start < P.end) {
+        overlapping.emplace_back(addresses[p], addresses[p] + P.segmentSize);
+      }
+    }
+    std::sort(overlapping.begin(), overlapping.end());
+    uint64_t bestAddress = 0;
+    uint64_t bestHoleSize = MemoryAllocator::npos;
+    uint64_t holeBegin = 0;
+    for (auto &range : overlapping) {
+      if (range.first >= holeBegin + B.segmentSize &&
+          range.first - holeBegin < bestHoleSize) {
+        bestAddress = holeBegin;
+        bestHoleSize = range.first - holeBegin;
+      }
+      holeBegin = std::max(holeBegin, range.second);
+    }
+    addresses[idx] =
+        bestHoleSize == MemoryAllocator::npos ? holeBegin : bestAddress;
+    maxMemory = std::max(maxMemory, addresses[idx] + B.segmentSize);
+    placed.push_back(idx);
   }
+  return maxMemory;
+}
 
-  allocations_.emplace_back(prev, prev + segmentSize);
-  maxMemoryAllocated_ = std::max(maxMemoryAllocated_, prev + segmentSize);
-  setHandle(prev, size, handle);
-  return prev;
+uint64_t
+MemoryAllocator::allocateAll(const std::vector<Allocation> &allocList) {
+  assert(allocations_.empty() && handleToAllocInfo_.empty() &&
+         "The allocator must be empty");
+
+  std::vector<PlannedBuffer> buffers;
+  std::unordered_map<Handle, size_t> bufferIndex;
+  for (size_t i = 0, e = allocList.size(); i < e; i++) {
+    const Allocation &A = allocList[i];
+    if (A.alloc) {
+      assert(!bufferIndex.count(A.handle) && "The handle is allocated twice");
+      bufferIndex[A.handle] = buffers.size();
+      buffers.push_back(
+          {A.handle, A.size, alignedSize(A.size, TensorAlignment), i, e});
+      continue;
+    }
+    assert(bufferIndex.count(A.handle) && "Unknown buffer to deallocate");
+    buffers[bufferIndex[A.handle]].end = i;
+  }
+
+  // The breadth of a step is the total size of the buffers that are live
+  // during it. No assignment needs less memory than the largest breadth.
+  std::vector<uint64_t> breadth(allocList.size() + 1, 0);
+  for (auto &B : buffers) {
+    breadth[B.start] += B.segmentSize;
+    breadth[B.end] -= B.segmentSize;
+  }
+  lowerBoundMemoryUsage_ = 0;
+  for (size_t i = 0, e = allocList.size(); i < e; i++) {
+    breadth[i + 1] += breadth[i];
+    lowerBoundMemoryUsage_ = std::max(lowerBoundMemoryUsage_, breadth[i]);
+  }
+
+  std::vector<size_t> order(buffers.size());
+  for (size_t i = 0, e = order.size(); i < e; i++) {
+    order[i] = i;
+  }
+  auto comesFirst = [&](size_t a, size_t b) {
+    const PlannedBuffer &A = buffers[a];
+    const PlannedBuffer &B = buffers[b];
+    if (A.segmentSize != B.segmentSize) {
+      return A.segmentSize > B.segmentSize;
+    }
+    return A.end - A.start > B.end - B.start;
+  };
+
+  // Greedy by size: place the largest buffers first, and the ones that live
+  // longer among those of the same size.
+  std::stable_sort(order.begin(), order.end(), comesFirst);
+  std::vector<uint64_t> bySizeAddress;
+  uint64_t bySizeMemory = placeBuffers(buffers, order, bySizeAddress);
+
+  // Greedy by breadth: place the buffers of the broadest steps first, which
+  // are the ones that decide the high water mark.
+  std::vector<uint64_t> maxBreadth(buffers.size(), 0);
+  for (size_t i = 0, e = buffers.size(); i < e; i++) {
+    for (size_t t = buffers[i].start; t < buffers[i].end; t++) {
+      maxBreadth[i] = std::max(maxBreadth[i], breadth[t]);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (maxBreadth[a] != maxBreadth[b]) {
+      return maxBreadth[a] > maxBreadth[b];
+    }
+    return comesFirst(a, b);
+  });
+  std::vector<uint64_t> byBreadthAddress;
+  uint64_t byBreadthMemory = placeBuffers(buffers, order, byBreadthAddress);
+
+  // Replay the sequence with the online first-fit allocator.
+  MemoryAllocator online(name_, poolSize_);
+  std::vector<uint64_t> onlineAddress(buffers.size());
+  uint64_t onlineMemory = 0;
+  for (const Allocation &A : allocList) {
+    if (!A.alloc) {
+      online.deallocate(A.handle);
+      continue;
+    }
+    uint64_t address = online.allocate(A.size, A.handle);
+    if (address == npos) {
+      onlineMemory = npos;
+      break;
+    }
+    onlineAddress[bufferIndex[A.handle]] = address;
+    onlineMemory = online.getMaxMemoryUsage();
+  }
+
+  // Keep the assignment that needs the least memory.
+  std::vector<uint64_t> *addresses = &bySizeAddress;
+  maxMemoryAllocated_ = bySizeMemory;
+  if (byBreadthMemory < maxMemoryAllocated_) {
+    addresses = &byBreadthAddress;
+    maxMemoryAllocated_ = byBreadthMemory;
+  }
+  if (onlineMemory < maxMemoryAllocated_) {
+    addresses = &onlineAddress;
+    maxMemoryAllocated_ = onlineMemory;
+  }
+
+  DEBUG_GLOW(llvm::dbgs() << "Planned " << buffers.size() << " buffers of '"
+                          << name_ << "': greedy by size needs "
+                          << bySizeMemory << " bytes, greedy by breadth "
+                          << byBreadthMemory << ", first-fit "
+                          << onlineMemory << ", lower bound "
+                          << lowerBoundMemoryUsage_ << "\n");
+
+  if (poolSize_ && maxMemoryAllocated_ > poolSize_) {
+    return npos;
+  }
+  for (size_t i = 0, e = buffers.size(); i < e; i++) {
+    uint64_t address = (*addresses)[i];
+    handleToAllocInfo_.insert(std::make_pair(
+        buffers[i].handle, Segment(address, address + buffers[i].size)));
+  }
+  return maxMemoryAllocated_;
 }
 
 void MemoryAllocator::evictFirstFit(uint64_t size,
@@ -80,26 +352,28 @@ void MemoryAllocator::evictFirstFit(uint64_t size,
   uint64_t startAddress = 0;
   uint64_t begin = 0;
   llvm::SmallVector<std::pair<Segment, Handle>, 16> evictionCandidates;
-  for (auto it = allocations_.begin(), e = allocations_.end(); it != e; it++) {
+  for (auto &allocation : allocations_) {
+    Segment segment(allocation.first, allocation.second);
     // Skip any allocations below the start address.
-    if (it->begin_ < startAddress) {
+    if (segment.begin_ < startAddress) {
       continue;
     }
-    auto curHandle = getHandle(it->begin_);
+    auto curHandle = getHandle(segment.begin_);
     if (mustNotEvict.count(curHandle)) {
       DEBUG_GLOW(llvm::dbgs()
                  << "Cannot evict a buffer from '" << name_ << "' : "
-                 << "address: " << it->begin_ << " size: " << size << "\n");
+                 << "address: " << segment.begin_ << " size: " << size
+                 << "\n");
       // The block cannot be evicted. Start looking after it.
-      begin = it->end_;
+      begin = segment.end_;
       evictionCandidates.clear();
       hasSeenNonEvicted = true;
       continue;
     }
     // Remember current block as a candidate.
-    evictionCandidates.emplace_back(std::make_pair(*it, curHandle));
+    evictionCandidates.emplace_back(std::make_pair(segment, curHandle));
     // If the total to be evicted size is enough, no need to look any further.
-    if (it->end_ - begin >= size) {
+    if (segment.end_ - begin >= size) {
       break;
     }
   }
@@ -140,15 +414,33 @@ uint64_t MemoryAllocator::allocate(uint64_t size, Handle handle,
 
 void MemoryAllocator::deallocate(Handle handle) {
   auto ptr = getAddress(handle);
-  for (auto it = allocations_.begin(), e = allocations_.end(); it != e; it++) {
-    if (it->begin_ == ptr) {
-      allocations_.erase(it);
-      addrToHandle_.erase(ptr);
-      handleToAllocInfo_.erase(handle);
-      return;
+  auto it = allocations_.find(ptr);
+  if (it == allocations_.end()) {
+    llvm_unreachable("Unknown buffer to deallocate");
+  }
+
+  // Merge the buffer with the free segments around it.
+  uint64_t freeBegin = it->first;
+  uint64_t freeEnd = it->second;
+  uint64_t prevEnd = it == allocations_.begin() ? 0 : std::prev(it)->second;
+  if (prevEnd < freeBegin) {
+    freeSegments_.erase(prevEnd);
+    freeBegin = prevEnd;
+  }
+  auto next = std::next(it);
+  if (next != allocations_.end()) {
+    if (freeEnd < next->first) {
+      freeSegments_.erase(freeEnd);
+      freeEnd = next->first;
     }
+    freeSegments_.insert(freeBegin, freeEnd);
   }
-  llvm_unreachable("Unknown buffer to deallocate");
+  // Otherwise this was the last buffer, and the memory after the previous
+  // one is not part of the free segments anymore.
+
+  allocations_.erase(it);
+  addrToHandle_.erase(ptr);
+  handleToAllocInfo_.erase(handle);
 }
 
 bool MemoryAllocator::hasHandle(uint64_t address) const {
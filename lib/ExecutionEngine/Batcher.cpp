@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/Batcher.h"
+#include "glow/Graph/Nodes.h"
+
+#include <algorithm>
+
+using namespace glow;
+
+Batcher::Batcher(ExecutionEngine &EE, llvm::ArrayRef<Placeholder *> inputs,
+                 llvm::ArrayRef<Placeholder *> outputs,
+                 std::chrono::microseconds maxLatency, size_t maxBatchSize,
+                 ResultCache *cache, uint64_t modelVersion)
+    : EE_(EE), inputs_(inputs.begin(), inputs.end()),
+      outputs_(outputs.begin(), outputs.end()), maxLatency_(maxLatency),
+      cache_(cache), modelVersion_(modelVersion) {
+  assert(!inputs_.empty() && "No inputs");
+  size_t batchSize = inputs_[0]->getType()->dims()[0];
+  for (auto *PH : inputs_) {
+    (void)PH;
+    assert(PH->getType()->dims()[0] == batchSize &&
+           "All placeholders must have the same batch size");
+    ctx_.allocate(PH);
+  }
+  for (auto *PH : outputs_) {
+    (void)PH;
+    assert(PH->getType()->dims()[0] == batchSize &&
+           "All placeholders must have the same batch size");
+    ctx_.allocate(PH);
+  }
+  maxBatchSize_ = maxBatchSize ? std::min(maxBatchSize, batchSize) : batchSize;
+  worker_ = std::thread(&Batcher::processRequests, this);
+}
+
+Batcher::~Batcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  worker_.join();
+}
+
+std::future<void> Batcher::enqueue(llvm::ArrayRef<Tensor *> inputs,
+                                   llvm::ArrayRef<Tensor *> outputs) {
+  assert(inputs.size() == inputs_.size() && "Invalid number of inputs");
+  assert(outputs.size() == outputs_.size() && "Invalid number of outputs");
+
+  Request request;
+  if (cache_) {
+    request.hash = ResultCache::getKeyHash(modelVersion_, inputs);
+    if (cache_->lookup(request.hash, modelVersion_, inputs, outputs)) {
+      request.done.set_value();
+      return request.done.get_future();
+    }
+  }
+  for (auto *T : inputs) {
+    request.inputs.push_back(T->clone());
+  }
+  request.outputs.assign(outputs.begin(), outputs.end());
+  request.arrival = std::chrono::steady_clock::now();
+  auto result = request.done.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert(!stop_ && "The batcher is being destroyed");
+    requests_.push_back(std::move(request));
+  }
+  cv_.notify_one();
+  return result;
+}
+
+void Batcher::processRequests() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+    if (requests_.empty()) {
+      // The batcher is being destroyed and there is nothing left to do.
+      return;
+    }
+
+    // Wait for the batch to fill up, but not longer than the oldest request
+    // may wait.
+    auto deadline = requests_.front().arrival + maxLatency_;
+    cv_.wait_until(lock, deadline, [this] {
+      return stop_ || requests_.size() >= maxBatchSize_;
+    });
+
+    size_t batchSize = std::min(requests_.size(), maxBatchSize_);
+    std::vector<Request> batch;
+    for (size_t i = 0; i < batchSize; i++) {
+      batch.push_back(std::move(requests_.front()));
+      requests_.pop_front();
+    }
+    lock.unlock();
+    runBatch(batch);
+    lock.lock();
+  }
+}
+
+void Batcher::runBatch(std::vector<Request> &batch) {
+  // Pack the input samples into the batched tensors.
+  for (size_t i = 0, e = inputs_.size(); i < e; i++) {
+    Tensor *T = ctx_.get(inputs_[i]);
+    if (batch.size() < T->dims()[0]) {
+      T->zero();
+    }
+    for (size_t n = 0, ne = batch.size(); n < ne; n++) {
+      T->insertSlice(&batch[n].inputs[i], n);
+    }
+  }
+
+  EE_.run(ctx_);
+
+  // Scatter the output samples back to the callers.
+  for (size_t n = 0, ne = batch.size(); n < ne; n++) {
+    for (size_t i = 0, e = outputs_.size(); i < e; i++) {
+      batch[n].outputs[i]->copySlice(ctx_.get(outputs_[i]), n);
+    }
+    if (cache_) {
+      cache_->insert(batch[n].hash, modelVersion_, std::move(batch[n].inputs),
+                     batch[n].outputs);
+    }
+    batch[n].done.set_value();
+  }
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/BucketedFunctionCache.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Nodes.h"
+
+#include "llvm/ADT/STLExtras.h"
+
+#include <algorithm>
+
+using namespace glow;
+
+BucketedFunctionCache::BucketedFunctionCache(BatchedNetBuilderTy builder,
+                                             llvm::ArrayRef<size_t> batchSizes,
+                                             BackendKind backendKind,
+                                             CompilationMode mode)
+    : builder_(std::move(builder)), backendKind_(backendKind), mode_(mode) {
+  assert(!batchSizes.empty() && "No buckets");
+  std::vector<size_t> sizes(batchSizes.begin(), batchSizes.end());
+  std::sort(sizes.begin(), sizes.end());
+  sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+  for (auto size : sizes) {
+    assert(size && "Invalid batch size");
+    buckets_.push_back({size, nullptr, nullptr, {}, {}});
+  }
+}
+
+size_t BucketedFunctionCache::getBucketSize(size_t batchSize) const {
+  for (const auto &B : buckets_) {
+    if (B.batchSize >= batchSize) {
+      return B.batchSize;
+    }
+  }
+  return buckets_.back().batchSize;
+}
+
+size_t BucketedFunctionCache::getNumCompiledBuckets() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::count_if(buckets_.begin(), buckets_.end(),
+                       [](const Bucket &B) { return B.EE != nullptr; });
+}
+
+BucketedFunctionCache::Bucket &
+BucketedFunctionCache::getBucket(size_t batchSize) {
+  size_t bucketSize = getBucketSize(batchSize);
+  auto it = std::find_if(
+      buckets_.begin(), buckets_.end(),
+      [bucketSize](const Bucket &B) { return B.batchSize == bucketSize; });
+  assert(it != buckets_.end() && "Unknown bucket");
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!it->EE) {
+    auto EE = llvm::make_unique<ExecutionEngine>(backendKind_);
+    Function *F = EE->getModule().createFunction("main");
+    builder_(F, it->batchSize, it->inputs, it->outputs);
+    it->compileCtx = llvm::make_unique<Context>();
+    for (auto *PH : it->inputs) {
+      assert(PH->getType()->dims()[0] == it->batchSize &&
+             "Invalid batch size of an input");
+      it->compileCtx->allocate(PH);
+    }
+    for (auto *PH : it->outputs) {
+      assert(PH->getType()->dims()[0] == it->batchSize &&
+             "Invalid batch size of an output");
+      it->compileCtx->allocate(PH);
+    }
+    EE->compile(mode_, F, *it->compileCtx);
+    it->EE = std::move(EE);
+  }
+  return *it;
+}
+
+void BucketedFunctionCache::run(llvm::ArrayRef<Tensor *> inputs,
+                                llvm::ArrayRef<Tensor *> outputs) {
+  assert(!inputs.empty() && "No inputs");
+  size_t batchSize = inputs[0]->dims()[0];
+
+  // Run the batch in chunks that fit into the largest bucket.
+  for (size_t start = 0; start < batchSize;) {
+    size_t chunkSize = std::min(batchSize - start, buckets_.back().batchSize);
+    Bucket &B = getBucket(chunkSize);
+    assert(inputs.size() == B.inputs.size() && "Invalid number of inputs");
+    assert(outputs.size() == B.outputs.size() && "Invalid number of outputs");
+
+    // Copy the samples of the chunk into the tensors of the bucket. The rest
+    // of the bucket is padded by repeating the samples of the batch.
+    Context ctx;
+    for (size_t i = 0, e = inputs.size(); i < e; i++) {
+      assert(inputs[i]->dims()[0] == batchSize && "Invalid batch size");
+      ctx.allocate(B.inputs[i])->copyConsecutiveSlices(inputs[i], start);
+    }
+    for (auto *PH : B.outputs) {
+      ctx.allocate(PH);
+    }
+
+    B.EE->run(ctx);
+
+    // Copy the results of the chunk, skipping the padding.
+    for (size_t i = 0, e = outputs.size(); i < e; i++) {
+      assert(outputs[i]->dims()[0] == batchSize && "Invalid batch size");
+      Tensor *result = ctx.get(B.outputs[i]);
+      Tensor slice(
+          Type::newShape(result->getType(), result->dims().slice(1)));
+      for (size_t n = 0; n < chunkSize; n++) {
+        slice.copySlice(result, n);
+        outputs[i]->insertSlice(&slice, start + n);
+      }
+    }
+    start += chunkSize;
+  }
+}
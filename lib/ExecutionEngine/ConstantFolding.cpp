@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Backends/Backend.h"
+#include "glow/Backends/CompiledFunction.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Utils.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/Support/Casting.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace glow;
+using llvm::dyn_cast;
+using llvm::isa;
+
+/// \returns true if the variable \p V holds a constant: it is private, it is
+/// not trained, and no node writes to it.
+static bool isConstantVariable(Variable *V) {
+  if (V->getVisibilityKind() != VisibilityKind::Private || V->isTraining()) {
+    return false;
+  }
+  for (auto &U : V->getUsers()) {
+    auto *N = U.getUser();
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      if (N->isOverwrittenNthInput(i) && N->getNthInput(i).getNode() == V) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// \returns true if the node \p N can be evaluated ahead of time on the
+/// backend \p B when all its inputs are constant.
+static bool isFoldable(const Node *N, const Backend &B) {
+  if (isa<Storage>(N) || isa<SaveNode>(N) || N->hasSideEffects() ||
+      N->hasPredicate()) {
+    return false;
+  }
+  for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+    if (!B.isOpSupported(N->getKind(), N->getElementType(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool glow::constantFold(Function *F) {
+  Module *M = F->getParent();
+  std::unique_ptr<Backend> interpreter(createBackend(BackendKind::Interpreter));
+
+  // Find the nodes whose inputs are all constant, in post order, so that
+  // every node comes after its inputs.
+  std::unordered_set<const Node *> constants;
+  std::vector<Node *> constantNodes;
+  std::vector<Variable *> constantVars;
+  GraphPostOrderVisitor visitor(*F);
+  for (auto *N : visitor.getPostOrder()) {
+    if (auto *V = dyn_cast<Variable>(N)) {
+      if (isConstantVariable(V)) {
+        constants.insert(V);
+        constantVars.push_back(V);
+      }
+      continue;
+    }
+    if (!isFoldable(N, *interpreter)) {
+      continue;
+    }
+    bool hasConstantInputs = true;
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      hasConstantInputs &= constants.count(N->getNthInput(i).getNode()) != 0;
+    }
+    if (hasConstantInputs) {
+      constants.insert(N);
+      constantNodes.push_back(N);
+    }
+  }
+
+  // The results of constant nodes that are used by the rest of the graph are
+  // replaced. Splats are left alone: they are cheap, and other optimizations
+  // look for them.
+  std::vector<NodeValue> results;
+  for (auto *N : constantNodes) {
+    if (isa<SplatNode>(N)) {
+      continue;
+    }
+    for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+      for (auto &U : N->getUsers()) {
+        if (U.get()->getResNo() == i && !constants.count(U.getUser())) {
+          results.push_back(N->getNthResult(i));
+          break;
+        }
+      }
+    }
+  }
+  if (results.empty()) {
+    return false;
+  }
+
+  // Only the constant nodes that the replaced results depend on are
+  // evaluated.
+  std::unordered_set<const Node *> needed;
+  for (const auto &R : results) {
+    needed.insert(R.getNode());
+  }
+  for (auto it = constantNodes.rbegin(), e = constantNodes.rend(); it != e;
+       ++it) {
+    if (!needed.count(*it)) {
+      continue;
+    }
+    for (unsigned i = 0, e = (*it)->getNumInputs(); i < e; i++) {
+      needed.insert((*it)->getNthInput(i).getNode());
+    }
+  }
+
+  // Copy the needed subgraph into a separate function that saves the results
+  // into new variables, and run it once.
+  Function *foldF = M->createFunction("constantFolding");
+  std::unordered_map<const Node *, Node *> clones;
+  for (auto *N : constantNodes) {
+    if (!needed.count(N)) {
+      continue;
+    }
+    Node *C = foldF->addNode(N->clone());
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      NodeValue input = N->getNthInput(i);
+      auto it = clones.find(input.getNode());
+      if (it != clones.end()) {
+        C->setNthInput(i, NodeValue(it->second, input.getResNo()));
+      }
+    }
+    clones[N] = C;
+  }
+
+  // The results are recorded as derived from the variables that the
+  // subgraph reads, although the evaluation can't be replayed on new weights.
+  std::vector<Variable *> sources;
+  for (auto *V : constantVars) {
+    if (needed.count(V)) {
+      sources.push_back(V);
+    }
+  }
+
+  std::vector<Variable *> folded;
+  for (const auto &R : results) {
+    auto *V = M->createVariable(R.getType(), R.getNode()->getName(),
+                                VisibilityKind::Private, false);
+    foldF->createSave("save", NodeValue(clones[R.getNode()], R.getResNo()), V);
+    if (!sources.empty()) {
+      M->addDerivedVariable(sources, V, "constant-fold", nullptr);
+    }
+    folded.push_back(V);
+  }
+
+  // The lowering leaves the original nodes behind, which the optimizer
+  // removes.
+  ::glow::lower(foldF, *interpreter);
+  ::glow::optimize(foldF, CompilationMode::Infer);
+  {
+    Context ctx;
+    auto compiled = interpreter->compile(foldF, ctx);
+    compiled->execute();
+  }
+  M->eraseFunction(foldF);
+
+  for (size_t i = 0, e = results.size(); i < e; i++) {
+    results[i].replaceAllUsesOfWith(folded[i]);
+  }
+  return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/DataLoader.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Nodes.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace glow;
+
+DataLoader::DataLoader(DataSource &source, llvm::ArrayRef<TypeRef> types,
+                       bool shuffle, unsigned numBatches)
+    : source_(source), shuffle_(shuffle) {
+  assert(!types.empty() && "The loader needs at least one input");
+  assert(numBatches > 0 && "The loader needs at least one batch");
+  assert(source_.size() && "The dataset is empty");
+  batchSize_ = types[0]->dims()[0];
+
+  for (unsigned i = 0; i < numBatches; i++) {
+    auto batch = llvm::make_unique<Batch>();
+    batch->tensors.reserve(types.size());
+    for (auto ty : types) {
+      assert(ty->dims()[0] == batchSize_ && "The batch sizes do not match");
+      batch->tensors.emplace_back(ty);
+    }
+    for (auto &T : batch->tensors) {
+      batch->pointers.push_back(&T);
+    }
+    free_.push_back(batch.get());
+    batches_.push_back(std::move(batch));
+  }
+
+  order_.resize(source_.size());
+  startEpoch();
+  worker_ = std::thread(&DataLoader::readBatches, this);
+}
+
+/// \returns the types of \p placeholders.
+static std::vector<TypeRef>
+getTypes(llvm::ArrayRef<Placeholder *> placeholders) {
+  std::vector<TypeRef> types;
+  for (auto *P : placeholders) {
+    types.push_back(P->getType());
+  }
+  return types;
+}
+
+DataLoader::DataLoader(DataSource &source,
+                       llvm::ArrayRef<Placeholder *> placeholders, bool shuffle,
+                       unsigned numBatches)
+    : DataLoader(source, getTypes(placeholders), shuffle, numBatches) {
+  // The contexts only reference the batched tensors, which the worker keeps
+  // reading into.
+  for (auto &batch : batches_) {
+    for (size_t i = 0, e = placeholders.size(); i < e; i++) {
+      auto *T = batch->pointers[i];
+      batch->ctx.insert(placeholders[i], T->getUnowned(T->dims()));
+    }
+  }
+}
+
+DataLoader::~DataLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  worker_.join();
+}
+
+void DataLoader::startEpoch() {
+  std::iota(order_.begin(), order_.end(), 0);
+  if (shuffle_) {
+    std::shuffle(order_.begin(), order_.end(), rng_);
+  }
+  position_ = 0;
+}
+
+void DataLoader::readBatches() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !free_.empty(); });
+    if (stop_) {
+      return;
+    }
+    Batch *batch = free_.front();
+    free_.pop_front();
+
+    // Only the worker touches the order, so the samples are read without
+    // holding the lock.
+    lock.unlock();
+    for (size_t slot = 0; slot < batchSize_; slot++) {
+      if (position_ == order_.size()) {
+        startEpoch();
+        std::lock_guard<std::mutex> epochLock(mutex_);
+        epoch_++;
+      }
+      source_.read(order_[position_++], batch->pointers, slot);
+    }
+    lock.lock();
+
+    ready_.push_back(batch);
+    cv_.notify_all();
+  }
+}
+
+llvm::ArrayRef<Tensor *> DataLoader::next() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // The consumer is done with the previous batch.
+  if (current_) {
+    free_.push_back(current_);
+    cv_.notify_all();
+  }
+  cv_.wait(lock, [this] { return !ready_.empty(); });
+  current_ = ready_.front();
+  ready_.pop_front();
+  return current_->pointers;
+}
+
+Context &DataLoader::nextContext() {
+  next();
+  assert(current_->ctx.pairs().size() == current_->tensors.size() &&
+         "The loader was not constructed with placeholders");
+  return current_->ctx;
+}
+
+size_t DataLoader::getEpoch() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return epoch_;
+}
+
+void glow::runBatch(ExecutionEngine &EE, size_t iterations, DataLoader &loader,
+                    llvm::ArrayRef<Variable *> vars) {
+  for (size_t i = 0; i < iterations; i++) {
+    auto batch = loader.next();
+    assert(batch.size() == vars.size() &&
+           "The number of inputs does not match the number of variables");
+    // The variables are bound to the compiled function, so the batch is
+    // copied in as a whole.
+    for (size_t j = 0, e = vars.size(); j < e; j++) {
+      vars[j]->getPayload().copyRawFrom(batch[j]);
+    }
+    EE.run();
+  }
+}
+
+void glow::runBatch(ExecutionEngine &EE, size_t iterations,
+                    DataLoader &loader) {
+  for (size_t i = 0; i < iterations; i++) {
+    EE.run(loader.nextContext());
+  }
+}
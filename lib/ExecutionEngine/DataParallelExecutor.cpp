@@ -0,0 +1,439 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/DataParallelExecutor.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Nodes.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Casting.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+
+using namespace glow;
+
+unsigned DataParallelExecutor::selectNumDevices(BackendKind backendKind,
+                                                unsigned numDevices) {
+  if (numDevices) {
+    return numDevices;
+  }
+  unsigned available = glow::getNumDevices(backendKind);
+  assert(available && "The backend has no devices");
+  return available;
+}
+
+DataParallelExecutor::DataParallelExecutor(BatchedNetBuilderTy builder,
+                                           size_t batchSize,
+                                           BackendKind backendKind,
+                                           unsigned numDevices,
+                                           CompilationMode mode)
+    : devices_(selectNumDevices(backendKind, numDevices)),
+      batchSize_(batchSize), pool_(devices_.size()) {
+  assert(batchSize && "Invalid batch size");
+  unsigned available = glow::getNumDevices(backendKind);
+  assert(available && "The backend has no devices");
+  for (unsigned i = 0, e = devices_.size(); i < e; i++) {
+    auto &dev = devices_[i];
+    dev.EE = llvm::make_unique<ExecutionEngine>(backendKind);
+    dev.EE->setBackend(createBackend(backendKind, i % available));
+    Function *F = dev.EE->getModule().createFunction("main");
+    builder(F, batchSize, dev.inputs, dev.outputs);
+    dev.compileCtx = llvm::make_unique<Context>();
+    for (auto *PH : dev.inputs) {
+      assert(PH->getType()->dims()[0] == batchSize &&
+             "Invalid batch size of an input");
+      dev.compileCtx->allocate(PH);
+    }
+    for (auto *PH : dev.outputs) {
+      assert(PH->getType()->dims()[0] == batchSize &&
+             "Invalid batch size of an output");
+      dev.compileCtx->allocate(PH);
+    }
+    dev.EE->compile(mode, F, *dev.compileCtx);
+  }
+}
+
+std::vector<size_t> DataParallelExecutor::computeSplit(size_t batchSize) const {
+  // Weigh the devices by their throughput, or equally until every device has
+  // been measured.
+  std::vector<double> weights;
+  for (const auto &dev : devices_) {
+    weights.push_back(dev.throughput);
+  }
+  if (std::any_of(weights.begin(), weights.end(),
+                  [](double w) { return w <= 0; })) {
+    std::fill(weights.begin(), weights.end(), 1.0);
+  }
+  double total = 0;
+  for (auto w : weights) {
+    total += w;
+  }
+
+  // Round the shares down and give the remaining samples to the devices with
+  // the largest remainders.
+  std::vector<size_t> shares(devices_.size());
+  std::vector<std::pair<double, size_t>> remainders;
+  size_t assigned = 0;
+  for (size_t i = 0, e = shares.size(); i < e; i++) {
+    double exact = batchSize * weights[i] / total;
+    shares[i] = std::floor(exact);
+    assigned += shares[i];
+    remainders.emplace_back(exact - shares[i], i);
+  }
+  std::sort(remainders.begin(), remainders.end(),
+            [](const std::pair<double, size_t> &a,
+               const std::pair<double, size_t> &b) {
+              return a.first > b.first ||
+                     (a.first == b.first && a.second < b.second);
+            });
+  for (size_t i = 0; assigned < batchSize; i++, assigned++) {
+    shares[remainders[i % remainders.size()].second]++;
+  }
+  return shares;
+}
+
+std::vector<size_t> DataParallelExecutor::getSplit(size_t batchSize) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return computeSplit(batchSize);
+}
+
+void DataParallelExecutor::runShare(Device &dev,
+                                    llvm::ArrayRef<Tensor *> inputs,
+                                    llvm::ArrayRef<Tensor *> outputs,
+                                    size_t start, size_t count) {
+  assert(inputs.size() == dev.inputs.size() && "Invalid number of inputs");
+  assert(outputs.size() == dev.outputs.size() && "Invalid number of outputs");
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t end = start + count; start < end;) {
+    size_t chunkSize = std::min(end - start, batchSize_);
+
+    // Copy the samples of the chunk into the tensors of the device. The rest
+    // of the batch is padded by repeating the samples of the request.
+    Context ctx;
+    for (size_t i = 0, e = inputs.size(); i < e; i++) {
+      ctx.allocate(dev.inputs[i])->copyConsecutiveSlices(inputs[i], start);
+    }
+    for (auto *PH : dev.outputs) {
+      ctx.allocate(PH);
+    }
+
+    dev.EE->run(ctx);
+
+    // Copy the results of the chunk, skipping the padding. The devices write
+    // disjoint slices of the outputs.
+    for (size_t i = 0, e = outputs.size(); i < e; i++) {
+      Tensor *result = ctx.get(dev.outputs[i]);
+      Tensor slice(Type::newShape(result->getType(), result->dims().slice(1)));
+      for (size_t n = 0; n < chunkSize; n++) {
+        slice.copySlice(result, n);
+        outputs[i]->insertSlice(&slice, start + n);
+      }
+    }
+    start += chunkSize;
+  }
+
+  // Update the throughput of the device, smoothing out the noise of a single
+  // measurement.
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - begin;
+  if (time.count() > 0) {
+    double throughput = count / time.count();
+    dev.throughput = dev.throughput > 0 ? (dev.throughput + throughput) / 2
+                                        : throughput;
+  }
+}
+
+void DataParallelExecutor::run(llvm::ArrayRef<Tensor *> inputs,
+                               llvm::ArrayRef<Tensor *> outputs) {
+  assert(!inputs.empty() && "No inputs");
+  size_t batchSize = inputs[0]->dims()[0];
+  for (auto *T : inputs) {
+    (void)T;
+    assert(T->dims()[0] == batchSize && "Invalid batch size");
+  }
+  for (auto *T : outputs) {
+    (void)T;
+    assert(T->dims()[0] == batchSize && "Invalid batch size");
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto shares = computeSplit(batchSize);
+  std::vector<size_t> starts(shares.size());
+  for (size_t i = 1, e = shares.size(); i < e; i++) {
+    starts[i] = starts[i - 1] + shares[i - 1];
+  }
+  pool_.parallelFor(devices_.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      if (shares[i]) {
+        runShare(devices_[i], inputs, outputs, starts[i], shares[i]);
+      }
+    }
+  });
+}
+
+/// Turn the function \p G, which \p varGrads says saves the gradients of the
+/// storage nodes into variables, into a replica of the training step: the
+/// gradients of the trained weights are saved into new placeholders, which
+/// \p grads receives in the order of \p weights, and every other save is
+/// removed.
+static void makeReplica(Function *G, const VariableGradientsList &varGrads,
+                        llvm::ArrayRef<Storage *> weights,
+                        std::vector<Placeholder *> &grads) {
+  Module *M = G->getParent();
+  llvm::DenseMap<const Node *, Storage *> gradToWeight;
+  for (const auto &VG : varGrads) {
+    gradToWeight[VG.second] = VG.first;
+  }
+
+  llvm::DenseMap<Storage *, Placeholder *> weightToGrad;
+  std::vector<Node *> saves;
+  for (auto &N : G->getNodes()) {
+    if (llvm::isa<SaveNode>(&N)) {
+      saves.push_back(&N);
+    }
+  }
+  for (auto *N : saves) {
+    auto *save = llvm::cast<SaveNode>(N);
+    auto *output = save->getOutput().getNode();
+    auto it = gradToWeight.find(output);
+    if (it != gradToWeight.end() && it->second->isTraining()) {
+      auto *PH = M->createPlaceholder(output->getType(0),
+                                      output->getName(), false);
+      G->createSave(save->getName(), save->getInput(), PH);
+      weightToGrad[it->second] = PH;
+    }
+    G->eraseNode(save);
+    if (it != gradToWeight.end()) {
+      M->eraseVariable(llvm::cast<Variable>(output));
+    }
+  }
+
+  for (auto *W : weights) {
+    assert(weightToGrad.count(W) && "A weight has no gradient");
+    grads.push_back(weightToGrad[W]);
+  }
+}
+
+FunctionDAG glow::differentiateDataParallel(
+    Function *F, const TrainingConfig &conf,
+    llvm::ArrayRef<Placeholder *> inputs, unsigned numReplicas,
+    std::vector<std::vector<Placeholder *>> &replicaInputs) {
+  assert(numReplicas && "Invalid number of replicas");
+  Module *M = F->getParent();
+  FunctionList functions;
+  std::vector<std::pair<Function *, Function *>> dependencies;
+
+  // The trained weights, in the order of their gradients in the reduction.
+  std::vector<Storage *> weights;
+  // The functions that produce each list of gradients to sum, and the lists.
+  std::vector<Function *> producers;
+  std::vector<std::vector<Placeholder *>> grads;
+
+  replicaInputs.clear();
+  for (unsigned r = 0; r < numReplicas; r++) {
+    std::string name = F->getName().str() + "_replica" + std::to_string(r);
+    VariableGradientsList varGrads;
+    Function *G = differentiate(F, conf, name, &varGrads);
+    if (weights.empty()) {
+      for (const auto &VG : varGrads) {
+        if (VG.first->isTraining()) {
+          weights.push_back(VG.first);
+        }
+      }
+    }
+
+    // Every replica reads its own copy of the inputs.
+    replicaInputs.emplace_back();
+    for (auto *P : inputs) {
+      auto *copy = M->createPlaceholder(P->getType(), P->getName(), false);
+      replicaInputs.back().push_back(copy);
+      for (auto &N : G->getNodes()) {
+        for (unsigned i = 0, e = N.getNumInputs(); i < e; i++) {
+          if (N.getNthInput(i).getNode() == P) {
+            N.setNthInput(i, copy);
+          }
+        }
+      }
+    }
+
+    grads.emplace_back();
+    makeReplica(G, varGrads, weights, grads.back());
+    functions.push_back(G);
+    producers.push_back(G);
+  }
+
+  // Sum the lists of gradients pairwise until one is left.
+  unsigned numReductions = 0;
+  while (grads.size() > 1) {
+    std::vector<Function *> nextProducers;
+    std::vector<std::vector<Placeholder *>> nextGrads;
+    for (size_t i = 0, e = grads.size(); i < e; i += 2) {
+      if (i + 1 == e) {
+        nextProducers.push_back(producers[i]);
+        nextGrads.push_back(grads[i]);
+        continue;
+      }
+      Function *R = M->createFunction(F->getName().str() + "_reduce" +
+                                      std::to_string(numReductions++));
+      nextGrads.emplace_back();
+      for (size_t w = 0, we = weights.size(); w < we; w++) {
+        auto *sum = R->createAdd("sum", grads[i][w], grads[i + 1][w]);
+        auto *PH = M->createPlaceholder(sum->getResult().getType(),
+                                        grads[i][w]->getName(), false);
+        R->createSave("save", sum, PH);
+        nextGrads.back().push_back(PH);
+      }
+      functions.push_back(R);
+      dependencies.emplace_back(R, producers[i]);
+      dependencies.emplace_back(R, producers[i + 1]);
+      nextProducers.push_back(R);
+    }
+    producers = std::move(nextProducers);
+    grads = std::move(nextGrads);
+  }
+
+  Function *U = M->createFunction(F->getName().str() + "_update");
+  for (size_t w = 0, we = weights.size(); w < we; w++) {
+    createWeightUpdate(U, conf, weights[w], grads[0][w]);
+  }
+  functions.push_back(U);
+  dependencies.emplace_back(U, producers[0]);
+
+  FunctionDAG G(functions);
+  for (const auto &dep : dependencies) {
+    G.add(dep.first, dep.second);
+  }
+  return G;
+}
+
+DataParallelTrainer::DataParallelTrainer(Function *F,
+                                         llvm::ArrayRef<Placeholder *> inputs,
+                                         const TrainingConfig &conf,
+                                         unsigned numReplicas,
+                                         BackendKind backendKind)
+    : executor_(numReplicas) {
+  assert(!inputs.empty() && "No inputs");
+  shardSize_ = inputs[0]->dims()[0];
+  for (auto *P : inputs) {
+    (void)P;
+    assert(P->dims()[0] == shardSize_ && "Invalid batch size of an input");
+  }
+  auto G =
+      differentiateDataParallel(F, conf, inputs, numReplicas, replicaInputs_);
+  executor_.compile(CompilationMode::Train, G, {}, backendKind);
+}
+
+void DataParallelTrainer::train(llvm::ArrayRef<Tensor *> inputs) {
+  for (size_t r = 0, e = replicaInputs_.size(); r < e; r++) {
+    assert(inputs.size() == replicaInputs_[r].size() &&
+           "Invalid number of inputs");
+    for (size_t i = 0, ie = inputs.size(); i < ie; i++) {
+      auto *P = replicaInputs_[r][i];
+      assert(inputs[i]->dims()[0] == shardSize_ * e && "Invalid batch size");
+      Tensor *T = ctx_.count(P) ? ctx_.get(P) : ctx_.allocate(P);
+      T->copyConsecutiveSlices(inputs[i], r * shardSize_);
+    }
+  }
+  executor_.run(ctx_);
+}
+
+Function *glow::differentiateAccumulated(
+    Function *F, const TrainingConfig &conf, Function *&update,
+    std::vector<Placeholder *> &accumulators) {
+  Module *M = F->getParent();
+  VariableGradientsList varGrads;
+  Function *G =
+      differentiate(F, conf, F->getName().str() + "_accumulate", &varGrads);
+  std::vector<Storage *> weights;
+  for (const auto &VG : varGrads) {
+    if (VG.first->isTraining()) {
+      weights.push_back(VG.first);
+    }
+  }
+  accumulators.clear();
+  makeReplica(G, varGrads, weights, accumulators);
+
+  // Add the gradients of the micro-batch to the ones of the previous
+  // micro-batches instead of overwriting them.
+  llvm::DenseSet<const Node *> isAccumulator;
+  for (auto *P : accumulators) {
+    isAccumulator.insert(P);
+  }
+  std::vector<SaveNode *> saves;
+  for (auto &N : G->getNodes()) {
+    auto *save = llvm::dyn_cast<SaveNode>(&N);
+    if (save && isAccumulator.count(save->getOutput().getNode())) {
+      saves.push_back(save);
+    }
+  }
+  for (auto *save : saves) {
+    auto *acc = llvm::cast<Placeholder>(save->getOutput().getNode());
+    auto *sum = G->createAdd("accumulate", acc, save->getInput());
+    G->createSave(save->getName(), sum, acc);
+    G->eraseNode(save);
+  }
+
+  update = M->createFunction(F->getName().str() + "_update");
+  for (size_t w = 0, we = weights.size(); w < we; w++) {
+    createWeightUpdate(update, conf, weights[w], accumulators[w]);
+  }
+  return G;
+}
+
+MicroBatchTrainer::MicroBatchTrainer(Function *F,
+                                     llvm::ArrayRef<Placeholder *> inputs,
+                                     const TrainingConfig &conf,
+                                     unsigned numMicroBatches,
+                                     BackendKind backendKind)
+    : accumulate_(1), update_(1), inputs_(inputs.begin(), inputs.end()),
+      numMicroBatches_(numMicroBatches) {
+  assert(!inputs.empty() && "No inputs");
+  assert(numMicroBatches && "Invalid number of micro-batches");
+  microBatchSize_ = inputs[0]->dims()[0];
+  for (auto *P : inputs) {
+    (void)P;
+    assert(P->dims()[0] == microBatchSize_ && "Invalid batch size of an input");
+  }
+  Function *update;
+  Function *G = differentiateAccumulated(F, conf, update, accumulators_);
+  accumulate_.compile(CompilationMode::Train, FunctionDAG({G}), {},
+                      backendKind);
+  update_.compile(CompilationMode::Train, FunctionDAG({update}), {},
+                  backendKind);
+}
+
+void MicroBatchTrainer::train(llvm::ArrayRef<Tensor *> inputs) {
+  assert(inputs.size() == inputs_.size() && "Invalid number of inputs");
+  for (auto *P : accumulators_) {
+    Tensor *T = ctx_.count(P) ? ctx_.get(P) : ctx_.allocate(P);
+    T->zero();
+  }
+  for (unsigned m = 0; m < numMicroBatches_; m++) {
+    for (size_t i = 0, ie = inputs.size(); i < ie; i++) {
+      auto *P = inputs_[i];
+      assert(inputs[i]->dims()[0] == microBatchSize_ * numMicroBatches_ &&
+             "Invalid batch size");
+      Tensor *T = ctx_.count(P) ? ctx_.get(P) : ctx_.allocate(P);
+      T->copyConsecutiveSlices(inputs[i], m * microBatchSize_);
+    }
+    accumulate_.run(ctx_);
+  }
+  update_.run(ctx_);
+}
@@ -18,28 +18,70 @@
 #include "glow/Backends/Backend.h"
 #include "glow/Graph/Context.h"
 #include "glow/Graph/Graph.h"
+#include "glow/Graph/Serialization.h"
 #include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/Compiler.h"
+#include "glow/Support/Debug.h"
+#include "glow/Support/ThreadPool.h"
+#include "glow/Support/Trace.h"
 
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <chrono>
 
 using namespace glow;
 
+static llvm::cl::opt<unsigned> memoryBudgetMB(
+    "memory-budget-mb",
+    llvm::cl::desc("Fail the compilation of the functions that need more "
+                   "than this many MB of memory for their weights, "
+                   "activations and code, after trying a schedule that "
+                   "minimizes their peak memory (0 for no limit)"),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<unsigned> compileThreads(
+    "compile-threads",
+    llvm::cl::desc("Number of threads that generate the code of the functions "
+                   "compiled together (0 for one per core)"),
+    llvm::cl::init(0));
+
 ExecutionEngine::ExecutionEngine(BackendKind backendKind)
-    : backend_(createBackend(backendKind)) {}
+    : backend_(createBackend(backendKind)),
+      memoryBudget_(uint64_t(memoryBudgetMB) << 20) {}
 
 /// Set the code generator kind to \p backendKind.
 void ExecutionEngine::setBackend(BackendKind backendKind) {
+  waitForAsyncRuns();
   backend_.reset(createBackend(backendKind));
   function_.reset();
+  std::lock_guard<std::mutex> lock(functionsMutex_);
+  functions_.clear();
 }
 
 /// Set the code generator kind to \p backend.
 void ExecutionEngine::setBackend(Backend *backend) {
+  waitForAsyncRuns();
   backend_.reset(backend);
   function_.reset();
+  std::lock_guard<std::mutex> lock(functionsMutex_);
+  functions_.clear();
 }
 
-ExecutionEngine::~ExecutionEngine() = default;
+ExecutionEngine::~ExecutionEngine() {
+  // Let the worker thread finish the pending requests and exit.
+  {
+    std::lock_guard<std::mutex> lock(requestsMutex_);
+    stopWorker_ = true;
+  }
+  requestsCV_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
 
 void glow::updateVariables(llvm::ArrayRef<Variable *> vars,
                            llvm::ArrayRef<Tensor *> inputs) {
@@ -63,9 +105,161 @@ void glow::updateVariables(llvm::ArrayRef<Variable *> vars,
 
 void ExecutionEngine::run() {
   assert(function_ && "No function has been compiled");
+  std::shared_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  ScopedRunPriority priority(runPriority_);
   function_->execute();
 }
 
+void ExecutionEngine::run(Context &ctx) {
+  assert(function_ && "No function has been compiled");
+  std::shared_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  ScopedRunPriority priority(runPriority_);
+  function_->execute(ctx);
+}
+
+/// Execute \p run with the cancellation token \p token. \returns false if
+/// the token was already cancelled, in which case \p run is not called, or if
+/// the run stopped because of it.
+template <typename RunFn>
+static bool runWithToken(const CancellationToken &token, RunFn run) {
+  if (token.isCancelled()) {
+    return false;
+  }
+  ScopedCancellation scope(token);
+  run();
+  return !scope.hasStopped();
+}
+
+bool ExecutionEngine::run(const CancellationToken &token) {
+  assert(function_ && "No function has been compiled");
+  std::shared_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  ScopedRunPriority priority(runPriority_);
+  return runWithToken(token, [&]() { function_->execute(); });
+}
+
+bool ExecutionEngine::run(Context &ctx, const CancellationToken &token) {
+  assert(function_ && "No function has been compiled");
+  std::shared_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  ScopedRunPriority priority(runPriority_);
+  return runWithToken(token, [&]() { function_->execute(ctx); });
+}
+
+void ExecutionEngine::run(Function *F) {
+  auto &entry = getFunctionEntry(F);
+  std::shared_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  ScopedRunPriority priority(runPriority_);
+  entry.compiled->execute();
+}
+
+void ExecutionEngine::run(Function *F, Context &ctx) {
+  auto &entry = getFunctionEntry(F);
+  std::shared_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  ScopedRunPriority priority(runPriority_);
+  entry.compiled->execute(ctx);
+}
+
+bool ExecutionEngine::updateWeights(llvm::ArrayRef<llvm::StringRef> names,
+                                    llvm::ArrayRef<Tensor *> values) {
+  std::unique_lock<std::shared_timed_mutex> lock(weightsMutex_);
+  std::vector<Variable *> updated;
+  if (!M_.updateWeights(names, values, &updated)) {
+    return false;
+  }
+  if (function_) {
+    function_->updateWeights(updated);
+  }
+  std::lock_guard<std::mutex> functionsLock(functionsMutex_);
+  for (auto &entry : functions_) {
+    if (entry.second->compiled) {
+      entry.second->compiled->updateWeights(updated);
+    }
+  }
+  return true;
+}
+
+std::future<bool> ExecutionEngine::runAsync(CompletionCallbackTy callback) {
+  return enqueueRun(nullptr, nullptr, std::move(callback));
+}
+
+std::future<bool> ExecutionEngine::runAsync(Context &ctx,
+                                            CompletionCallbackTy callback) {
+  return enqueueRun(&ctx, nullptr, std::move(callback));
+}
+
+std::future<bool>
+ExecutionEngine::runAsync(Context &ctx,
+                          std::shared_ptr<const CancellationToken> token,
+                          CompletionCallbackTy callback) {
+  return enqueueRun(&ctx, std::move(token), std::move(callback));
+}
+
+std::future<bool>
+ExecutionEngine::enqueueRun(Context *ctx,
+                            std::shared_ptr<const CancellationToken> token,
+                            CompletionCallbackTy callback) {
+  assert(function_ && "No function has been compiled");
+  std::future<bool> result;
+  {
+    std::lock_guard<std::mutex> lock(requestsMutex_);
+    if (!worker_.joinable()) {
+      worker_ = std::thread(&ExecutionEngine::processRequests, this);
+    }
+    requests_.push_back({ctx, std::move(token), std::move(callback),
+                         std::promise<bool>()});
+    result = requests_.back().done.get_future();
+    numPendingRequests_++;
+  }
+  requestsCV_.notify_one();
+  return result;
+}
+
+void ExecutionEngine::processRequests() {
+  std::unique_lock<std::mutex> lock(requestsMutex_);
+  while (true) {
+    requestsCV_.wait(lock,
+                     [this] { return stopWorker_ || !requests_.empty(); });
+    if (requests_.empty()) {
+      // The engine is being destroyed and there is nothing left to do.
+      return;
+    }
+    RunRequest request = std::move(requests_.front());
+    requests_.pop_front();
+    lock.unlock();
+
+    bool completed;
+    {
+      std::shared_lock<std::shared_timed_mutex> weightsLock(weightsMutex_);
+      ScopedRunPriority priority(runPriority_);
+      auto execute = [&]() {
+        if (request.ctx) {
+          function_->execute(*request.ctx);
+        } else {
+          function_->execute();
+        }
+      };
+      if (request.token) {
+        completed = runWithToken(*request.token, execute);
+      } else {
+        execute();
+        completed = true;
+      }
+    }
+    if (request.callback) {
+      request.callback();
+    }
+    request.done.set_value(completed);
+
+    lock.lock();
+    numPendingRequests_--;
+    completedCV_.notify_all();
+  }
+}
+
+void ExecutionEngine::waitForAsyncRuns() {
+  std::unique_lock<std::mutex> lock(requestsMutex_);
+  completedCV_.wait(lock, [this] { return numPendingRequests_ == 0; });
+}
+
 /// Update the content of the tensors \p vars with some slices that are from \p
 /// inputs. The data starts at slice \p sampleIdx and wraps around until the
 /// data in \p v is filled. All dimensions, except for the first (batch)
@@ -108,37 +302,259 @@ void glow::runBatch(ExecutionEngine &EE, size_t iterations,
 }
 
 void ExecutionEngine::optimizeFunction(CompilationMode mode, Function *F) {
+  ScopedTraceEvent trace("optimizeFunction", "compile");
+  auto numNodes = [F]() -> size_t { return F->getNodes().size(); };
   // Verify the function pre-optimization/lowering.
-  F->verify();
+  if (VerifyLevel != VerificationLevel::None) {
+    F->verify();
+  }
 
   // Optimize the graph.
-  ::glow::optimize(F, mode);
+  {
+    ScopedCompilePhase phase("optimize", "nodes", numNodes);
+    ::glow::optimize(F, mode);
+  }
+
+  // Evaluate the computations on constant weights, such as the reshapes and
+  // transposes that importers add, once instead of in every run.
+  if (mode == CompilationMode::Infer) {
+    ScopedCompilePhase phase("constantFold", "nodes", numNodes);
+    if (constantFold(F)) {
+      ::glow::optimize(F, mode);
+    }
+  }
 
   // Allow the backend to transform the graph prior to lowering.
-  if (backend_->transformPreLowering(F, mode)) {
-    // Optimize the graph again after the backend transformation.
-    // In particular, DCE is very likely to be useful.
-    ::glow::optimize(F, mode);
+  {
+    ScopedCompilePhase phase("transformPreLowering", "nodes", numNodes);
+    if (backend_->transformPreLowering(F, mode)) {
+      // Optimize the graph again after the backend transformation.
+      // In particular, DCE is very likely to be useful.
+      ::glow::optimize(F, mode);
+    }
   }
 
   // Lower the graph into a sequence of low-level linear algebra operations.
-  ::glow::lower(F, *backend_);
+  {
+    ScopedCompilePhase phase("lower", "nodes", numNodes);
+    ::glow::lower(F, *backend_);
 
-  // Optimize the graph again.
-  ::glow::optimize(F, mode);
+    // Optimize the graph again.
+    ::glow::optimize(F, mode);
+  }
 
   // Allow the backend to transform the graph after lowering.
-  if (backend_->transformPostLowering(F, mode)) {
-    // Optimize the graph again after the backend transformation.
-    // In particular, DCE is very likely to be useful.
-    ::glow::optimize(F, mode);
+  {
+    ScopedCompilePhase phase("transformPostLowering", "nodes", numNodes);
+    if (backend_->transformPostLowering(F, mode)) {
+      // Optimize the graph again after the backend transformation.
+      // In particular, DCE is very likely to be useful.
+      ::glow::optimize(F, mode);
+    }
+  }
+}
+
+bool ExecutionEngine::weightsFitBudget(Function *F) const {
+  // No schedule reduces the weights, so the functions whose weights exceed
+  // the budget fail before their code is generated.
+  auto estimate = F->estimateMemoryUsage();
+  if (estimate.constantWeights + estimate.mutableWeights <= memoryBudget_) {
+    return true;
+  }
+  llvm::errs() << "The weights of " << F->getName()
+               << " exceed the memory budget of " << memoryBudget_
+               << " bytes\n";
+  estimate.dump(llvm::errs());
+  return false;
+}
+
+std::unique_ptr<CompiledFunction>
+ExecutionEngine::fitBudget(Function *F, const Context &ctx,
+                           std::unique_ptr<CompiledFunction> compiled) {
+  if (compiled->getMemoryUsage().getTotal() > memoryBudget_ &&
+      backend_->getSchedulerKind() != SchedulerKind::MinPeakMemory) {
+    compiled.reset();
+    backend_->setMinimizePeakMemory(true);
+    compiled = backend_->compile(F, ctx);
+    backend_->setMinimizePeakMemory(false);
+  }
+  auto usage = compiled->getMemoryUsage();
+  if (usage.getTotal() > memoryBudget_) {
+    llvm::errs() << F->getName() << " exceeds the memory budget of "
+                 << memoryBudget_ << " bytes\n";
+    usage.dump(llvm::errs());
+    return nullptr;
+  }
+  return compiled;
+}
+
+std::unique_ptr<CompiledFunction>
+ExecutionEngine::compileWithinBudget(Function *F, const Context &ctx) {
+  if (!memoryBudget_) {
+    return backend_->compile(F, ctx);
+  }
+  if (!weightsFitBudget(F)) {
+    return nullptr;
+  }
+  return fitBudget(F, ctx, backend_->compile(F, ctx));
+}
+
+bool ExecutionEngine::compile(CompilationMode mode, Function *F,
+                              const Context &ctx) {
+  waitForAsyncRuns();
+  ScopedTraceEvent trace("compile " + F->getName().str(), "compile");
+  compileReport_.clear();
+  CompileReportScope reportScope(compileReport_);
+  auto begin = std::chrono::steady_clock::now();
+  optimizeFunction(mode, F);
+  function_.reset();
+  function_ = compileWithinBudget(F, ctx);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  compileReport_.setTotalSeconds(elapsed.count());
+  return function_ != nullptr;
+}
+
+bool ExecutionEngine::compileOptimized(Function *F, const Context &ctx) {
+  waitForAsyncRuns();
+  ScopedTraceEvent trace("compile " + F->getName().str(), "compile");
+  compileReport_.clear();
+  CompileReportScope reportScope(compileReport_);
+  auto begin = std::chrono::steady_clock::now();
+  if (VerifyLevel != VerificationLevel::None) {
+    F->verify();
   }
+  function_.reset();
+  function_ = compileWithinBudget(F, ctx);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  compileReport_.setTotalSeconds(elapsed.count());
+  return function_ != nullptr;
 }
 
-void ExecutionEngine::compile(CompilationMode mode, Function *F,
+bool ExecutionEngine::compile(CompilationMode mode,
+                              llvm::ArrayRef<Function *> functions,
                               const Context &ctx) {
+  ScopedTraceEvent trace("compile functions", "compile");
+  compileReport_.clear();
+  auto begin = std::chrono::steady_clock::now();
+  {
+    CompileReportScope reportScope(compileReport_);
+    for (auto *F : functions) {
+      optimizeFunction(mode, F);
+    }
+  }
+
+  // The backend only reads the graphs and the variables, and uniques types in
+  // the module, so the code of the functions is generated in parallel. Every
+  // thread claims the next function until there are none left, and records
+  // its phases in a report of its own.
+  size_t numFunctions = functions.size();
+  std::vector<std::unique_ptr<CompiledFunction>> compiled(numFunctions);
+  std::vector<CompileReport> reports(numFunctions);
+  unsigned numThreads = compileThreads ? unsigned(compileThreads)
+                                       : std::thread::hardware_concurrency();
+  numThreads = std::max(1u, std::min<unsigned>(numThreads, numFunctions));
+  std::atomic<size_t> nextFunction{0};
+  auto compileFunctions = [&](size_t, size_t) {
+    for (size_t i = nextFunction++; i < numFunctions; i = nextFunction++) {
+      CompileReportScope reportScope(reports[i]);
+      if (!memoryBudget_ || weightsFitBudget(functions[i])) {
+        compiled[i] = backend_->compile(functions[i], ctx);
+      }
+    }
+  };
+  if (numThreads == 1) {
+    compileFunctions(0, 1);
+  } else {
+    ThreadPool pool(numThreads);
+    pool.parallelFor(numThreads, 1, compileFunctions);
+  }
+
+  bool fit = true;
+  for (size_t i = 0; i < numFunctions; i++) {
+    auto *F = functions[i];
+    // The functions that exceed the budget get a second chance with the
+    // schedule that minimizes the peak memory, which changes the backend, so
+    // it is serial.
+    if (compiled[i] && memoryBudget_) {
+      CompileReportScope reportScope(reports[i]);
+      compiled[i] = fitBudget(F, ctx, std::move(compiled[i]));
+    }
+    fit &= compiled[i] != nullptr;
+    for (const auto &phase : reports[i].getPhases()) {
+      auto prefixed = phase;
+      prefixed.name = F->getName().str() + ": " + phase.name;
+      compileReport_.addPhase(std::move(prefixed));
+    }
+    for (const auto &memory : reports[i].getMemoryUsage()) {
+      compileReport_.addMemoryUsage(F->getName().str() + ": " + memory.name,
+                                    memory.bytes);
+    }
+
+    auto entry = llvm::make_unique<FunctionEntry>();
+    entry->compiled = std::move(compiled[i]);
+    std::lock_guard<std::mutex> lock(functionsMutex_);
+    functions_[F] = std::move(entry);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  compileReport_.setTotalSeconds(elapsed.count());
+  return fit;
+}
+
+void ExecutionEngine::compileLazily(CompilationMode mode,
+                                    llvm::ArrayRef<Function *> functions,
+                                    const Context &ctx) {
+  // The optimizations change the module, which the runs of the functions
+  // compiled earlier share, so they are not deferred.
+  for (auto *F : functions) {
+    optimizeFunction(mode, F);
+    auto entry = llvm::make_unique<FunctionEntry>();
+    entry->lazyCtx = &ctx;
+    std::lock_guard<std::mutex> lock(functionsMutex_);
+    functions_[F] = std::move(entry);
+  }
+}
+
+ExecutionEngine::FunctionEntry &
+ExecutionEngine::getFunctionEntry(Function *F) {
+  FunctionEntry *entry;
+  {
+    std::lock_guard<std::mutex> lock(functionsMutex_);
+    auto it = functions_.find(F);
+    assert(it != functions_.end() && "The function has not been compiled");
+    entry = it->second.get();
+  }
+  if (entry->lazyCtx) {
+    // The runs that race with the first one wait for its compilation. The
+    // lazy compilations are serialized, as the retry for the memory budget
+    // changes the backend.
+    std::call_once(entry->compileOnce, [&] {
+      std::lock_guard<std::mutex> lock(lazyCompileMutex_);
+      ScopedTraceEvent trace("compile " + F->getName().str(), "compile");
+      entry->compiled = compileWithinBudget(F, *entry->lazyCtx);
+    });
+  }
+  GLOW_ASSERT(entry->compiled && "The function exceeds the memory budget");
+  return *entry;
+}
+
+bool ExecutionEngine::isCompiled(const Function *F) const {
+  std::lock_guard<std::mutex> lock(functionsMutex_);
+  auto it = functions_.find(F);
+  return it != functions_.end() && it->second->compiled;
+}
+
+MemoryUsage ExecutionEngine::getMemoryUsage() const {
+  assert(function_ && "No function has been compiled");
+  return function_->getMemoryUsage();
+}
+
+bool ExecutionEngine::serialize(CompilationMode mode, Function *F,
+                                llvm::StringRef filename) {
   optimizeFunction(mode, F);
-  function_ = backend_->compile(F, ctx);
+  return saveModule(M_, filename);
 }
 
 void ExecutionEngine::save(CompilationMode mode, Function *F,
@@ -147,3 +563,15 @@ void ExecutionEngine::save(CompilationMode mode, Function *F,
   optimizeFunction(mode, F);
   backend_->save(F, outputDir, networkName);
 }
+
+void ExecutionEngine::save(CompilationMode mode,
+                           llvm::ArrayRef<BundleEntry> entries,
+                           llvm::StringRef outputDir,
+                           llvm::StringRef bundleName) {
+  // The optimizations may add variables to the module, which all the entry
+  // points need to know about, so they are done before the code generation.
+  for (const auto &entry : entries) {
+    optimizeFunction(mode, entry.F);
+  }
+  backend_->save(entries, outputDir, bundleName);
+}
@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/FunctionDAGExecutor.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Graph/Nodes.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Casting.h"
+
+#include <condition_variable>
+#include <mutex>
+
+using namespace glow;
+
+/// Add the placeholders used by \p F that are not in \p seen yet to \p seen
+/// and to \p placeholders.
+static void collectPlaceholders(Function *F,
+                                llvm::DenseSet<Placeholder *> &seen,
+                                std::vector<Placeholder *> &placeholders) {
+  for (auto &N : F->getNodes()) {
+    for (unsigned i = 0, e = N.getNumInputs(); i < e; i++) {
+      auto *P = llvm::dyn_cast<Placeholder>(N.getNthInput(i).getNode());
+      if (P && seen.insert(P).second) {
+        placeholders.push_back(P);
+      }
+    }
+  }
+}
+
+/// \returns an engine holding \p F compiled in the mode \p mode for the
+/// backend that \p backends assigns to it, or for \p defaultBackend.
+static std::unique_ptr<ExecutionEngine>
+compileFunction(Function *F, CompilationMode mode,
+                const FunctionDAGExecutor::BackendAssignment &backends,
+                BackendKind defaultBackend) {
+  auto it = backends.find(F);
+  auto EE = llvm::make_unique<ExecutionEngine>(
+      it == backends.end() ? defaultBackend : it->second);
+  // The placeholders are bound when the function runs.
+  Context ctx;
+  EE->compile(mode, F, ctx);
+  return EE;
+}
+
+/// Allocate tensors in \p ctx for the \p placeholders it does not provide.
+static void allocatePlaceholders(llvm::ArrayRef<Placeholder *> placeholders,
+                                 Context &ctx) {
+  for (auto *P : placeholders) {
+    if (!ctx.count(P)) {
+      ctx.allocate(P);
+    }
+  }
+}
+
+FunctionDAGExecutor::FunctionDAGExecutor(unsigned numThreads)
+    : pool_(numThreads) {}
+
+void FunctionDAGExecutor::compile(CompilationMode mode, const FunctionDAG &G,
+                                  const BackendAssignment &backends,
+                                  BackendKind defaultBackend) {
+  assert(G.verify() && "The functions are not topologically sorted");
+  nodes_.clear();
+  placeholders_.clear();
+
+  llvm::DenseMap<Function *, size_t> index;
+  llvm::DenseSet<Placeholder *> seen;
+  for (auto *F : G.getFunctions()) {
+    index[F] = nodes_.size();
+    nodes_.emplace_back();
+    auto &node = nodes_.back();
+
+    // Record the dependencies. The DAG may list a dependency several times.
+    llvm::DenseSet<Function *> dependencies;
+    for (auto *dep : G.getDependencies(F)) {
+      if (dependencies.insert(dep).second) {
+        nodes_[index[dep]].users.push_back(index[F]);
+      }
+    }
+    node.numDependencies = dependencies.size();
+
+    collectPlaceholders(F, seen, placeholders_);
+    node.EE = compileFunction(F, mode, backends, defaultBackend);
+  }
+}
+
+void FunctionDAGExecutor::run(Context &ctx) {
+  allocatePlaceholders(placeholders_, ctx);
+
+  // The functions whose dependencies are done, and the bookkeeping of the
+  // remaining ones. The context is only read while the functions run.
+  std::vector<size_t> ready;
+  std::vector<size_t> pendingDependencies(nodes_.size());
+  for (size_t i = 0, e = nodes_.size(); i < e; i++) {
+    pendingDependencies[i] = nodes_[i].numDependencies;
+    if (!pendingDependencies[i]) {
+      ready.push_back(i);
+    }
+  }
+  size_t numRemaining = nodes_.size();
+  std::mutex mutex;
+  std::condition_variable readyCV;
+
+  // Every thread of the pool takes ready functions until all of them are
+  // done. A thread that finds no ready function waits for a running one to
+  // finish, which may make its users ready.
+  auto worker = [&](size_t, size_t) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (numRemaining) {
+      if (ready.empty()) {
+        readyCV.wait(lock);
+        continue;
+      }
+      size_t idx = ready.back();
+      ready.pop_back();
+      lock.unlock();
+
+      nodes_[idx].EE->run(ctx);
+
+      lock.lock();
+      numRemaining--;
+      for (auto user : nodes_[idx].users) {
+        if (!--pendingDependencies[user]) {
+          ready.push_back(user);
+        }
+      }
+      readyCV.notify_all();
+    }
+  };
+  pool_.parallelFor(pool_.getNumThreads(), 1, worker);
+}
+
+PipelineExecutor::RequestQueue::RequestQueue(size_t capacity)
+    : capacity_(capacity) {
+  assert(capacity && "The queue must hold at least one request");
+}
+
+void PipelineExecutor::RequestQueue::push(Request request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  notFullCV_.wait(lock, [this] { return requests_.size() < capacity_; });
+  requests_.push_back(std::move(request));
+  notEmptyCV_.notify_one();
+}
+
+bool PipelineExecutor::RequestQueue::pop(Request &request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  notEmptyCV_.wait(lock, [this] { return closed_ || !requests_.empty(); });
+  if (requests_.empty()) {
+    return false;
+  }
+  request = std::move(requests_.front());
+  requests_.pop_front();
+  notFullCV_.notify_one();
+  return true;
+}
+
+void PipelineExecutor::RequestQueue::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = true;
+  notEmptyCV_.notify_all();
+}
+
+PipelineExecutor::PipelineExecutor(size_t queueCapacity)
+    : queueCapacity_(queueCapacity) {}
+
+PipelineExecutor::~PipelineExecutor() { stop(); }
+
+void PipelineExecutor::stop() {
+  // Each stage drains its queue into the next one before its worker exits,
+  // so the stages are stopped in pipeline order.
+  for (auto &stage : stages_) {
+    stage.input->close();
+    stage.worker.join();
+  }
+  stages_.clear();
+}
+
+void PipelineExecutor::compile(CompilationMode mode, const FunctionDAG &G,
+                               const BackendAssignment &backends,
+                               BackendKind defaultBackend) {
+  assert(G.verify() && "The functions are not topologically sorted");
+  stop();
+  placeholders_.clear();
+
+  llvm::DenseSet<Placeholder *> seen;
+  for (auto *F : G.getFunctions()) {
+    stages_.emplace_back();
+    auto &stage = stages_.back();
+    collectPlaceholders(F, seen, placeholders_);
+    stage.EE = compileFunction(F, mode, backends, defaultBackend);
+    stage.input = llvm::make_unique<RequestQueue>(queueCapacity_);
+  }
+  for (size_t i = 0, e = stages_.size(); i < e; i++) {
+    stages_[i].worker = std::thread(&PipelineExecutor::processStage, this, i);
+  }
+}
+
+void PipelineExecutor::processStage(size_t idx) {
+  auto &stage = stages_[idx];
+  RequestQueue *next =
+      idx + 1 < stages_.size() ? stages_[idx + 1].input.get() : nullptr;
+  Request request;
+  while (stage.input->pop(request)) {
+    stage.EE->run(*request.ctx);
+    if (next) {
+      next->push(std::move(request));
+    } else {
+      request.done.set_value();
+    }
+  }
+}
+
+std::future<void> PipelineExecutor::submit(Context &ctx) {
+  assert(!stages_.empty() && "No pipeline has been compiled");
+  allocatePlaceholders(placeholders_, ctx);
+  Request request{&ctx, std::promise<void>()};
+  auto result = request.done.get_future();
+  stages_.front().input->push(std::move(request));
+  return result;
+}
+
+FunctionDAG
+glow::partitionForBackends(Function *F, llvm::ArrayRef<BackendKind> backends,
+                           FunctionDAGExecutor::BackendAssignment &assignment) {
+  assert(!backends.empty() && "No backends to partition for");
+  std::vector<std::unique_ptr<Backend>> instances;
+  for (auto kind : backends) {
+    instances.emplace_back(createBackend(kind));
+  }
+
+  std::function<unsigned(const Node *)> deviceOf;
+  deviceOf = [&](const Node *N) -> unsigned {
+    if (auto *SN = llvm::dyn_cast<SaveNode>(N)) {
+      auto *in = SN->getInput().getNode();
+      return llvm::isa<Storage>(in) ? 0 : deviceOf(in);
+    }
+    auto elemTy = N->getNumResults() ? N->getNthResult(0).getElementType()
+                                     : N->getNthInput(0).getElementType();
+    for (unsigned i = 0, e = instances.size(); i < e; i++) {
+      if (instances[i]->isOpSupported(N->getKind(), elemTy)) {
+        return i;
+      }
+    }
+    return instances.size() - 1;
+  };
+
+  std::vector<unsigned> devices;
+  auto G = partitionByDevice(F, deviceOf, devices);
+  assignment.clear();
+  auto deviceIt = devices.begin();
+  for (auto *partF : G.getFunctions()) {
+    assignment[partF] = backends[*deviceIt++];
+  }
+  return G;
+}
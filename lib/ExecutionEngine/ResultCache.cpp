@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/ResultCache.h"
+
+#include <cstring>
+
+using namespace glow;
+
+/// \returns true if \p LHS and \p RHS have the same type and the same bytes.
+static bool isIdentical(const Tensor &LHS, const Tensor &RHS) {
+  return LHS.getType() == RHS.getType() &&
+         !memcmp(LHS.getUnsafePtr(), RHS.getUnsafePtr(),
+                 LHS.getType().getSizeInBytes());
+}
+
+llvm::hash_code ResultCache::getKeyHash(uint64_t version,
+                                        llvm::ArrayRef<Tensor *> inputs) {
+  llvm::hash_code hash = llvm::hash_value(version);
+  for (auto *T : inputs) {
+    hash = llvm::hash_combine(hash, T->getContentHash());
+  }
+  return hash;
+}
+
+std::list<ResultCache::Entry>::iterator
+ResultCache::find(llvm::hash_code hash, uint64_t version,
+                  llvm::ArrayRef<Tensor *> inputs) {
+  auto range = index_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    Entry &E = *it->second;
+    if (E.version != version || E.inputs.size() != inputs.size()) {
+      continue;
+    }
+    bool same = true;
+    for (size_t i = 0, e = inputs.size(); same && i < e; i++) {
+      same = isIdentical(E.inputs[i], *inputs[i]);
+    }
+    if (same) {
+      return it->second;
+    }
+  }
+  return entries_.end();
+}
+
+bool ResultCache::lookup(llvm::hash_code hash, uint64_t version,
+                         llvm::ArrayRef<Tensor *> inputs,
+                         llvm::ArrayRef<Tensor *> outputs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = find(hash, version, inputs);
+  if (it == entries_.end()) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  // Move the entry to the front of the LRU order.
+  entries_.splice(entries_.begin(), entries_, it);
+  assert(outputs.size() == it->outputs.size() && "Invalid number of outputs");
+  for (size_t i = 0, e = outputs.size(); i < e; i++) {
+    outputs[i]->assign(&it->outputs[i]);
+  }
+  return true;
+}
+
+void ResultCache::insert(llvm::hash_code hash, uint64_t version,
+                         std::vector<Tensor> &&inputs,
+                         llvm::ArrayRef<Tensor *> outputs) {
+  size_t sizeInBytes = 0;
+  for (const auto &T : inputs) {
+    sizeInBytes += T.getType().getSizeInBytes();
+  }
+  for (auto *T : outputs) {
+    sizeInBytes += T->getType().getSizeInBytes();
+  }
+  if (sizeInBytes > maxBytes_) {
+    return;
+  }
+
+  std::vector<Tensor *> inputRefs;
+  for (auto &T : inputs) {
+    inputRefs.push_back(&T);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Concurrent misses on the same inputs cache the results only once.
+  if (find(hash, version, inputRefs) != entries_.end()) {
+    return;
+  }
+
+  // Evict the least recently used entries to make room.
+  while (bytes_ + sizeInBytes > maxBytes_) {
+    Entry &last = entries_.back();
+    auto range = index_.equal_range(last.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (&*it->second == &last) {
+        index_.erase(it);
+        break;
+      }
+    }
+    bytes_ -= last.sizeInBytes;
+    entries_.pop_back();
+    evictions_++;
+  }
+
+  entries_.emplace_front();
+  Entry &E = entries_.front();
+  E.hash = hash;
+  E.version = version;
+  E.inputs = std::move(inputs);
+  for (auto *T : outputs) {
+    E.outputs.push_back(T->clone());
+  }
+  E.sizeInBytes = sizeInBytes;
+  bytes_ += sizeInBytes;
+  index_.emplace(hash, entries_.begin());
+}
+
+void ResultCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  entries_.clear();
+  bytes_ = 0;
+}
+
+ResultCache::Stats ResultCache::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Stats{hits_, misses_, evictions_, entries_.size(), bytes_};
+}
@@ -25,12 +25,32 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <tuple>
+#include <unordered_set>
+
 using namespace glow;
 
 using llvm::cast;
 using llvm::isa;
 
+/// \returns the scalar \p scalar, of shape {1}, repeated to the shape
+/// \p dims, in \p F.
+static NodeValue broadcastScalar(Function *F, NodeValue scalar,
+                                 llvm::ArrayRef<size_t> dims) {
+  if (auto *SN = llvm::dyn_cast<SplatNode>(scalar)) {
+    return F->createSplat(
+        SN->getName(),
+        F->getParent()->uniqueTypeWithNewShape(scalar.getType(), dims),
+        SN->getValue());
+  }
+  return F->createBroadcast(scalar.getNode()->getName(), scalar, dims, 0);
+}
+
 void GraphGradMapper::addGradient(NodeValue activation, NodeValue grad) {
+  if (scale_.getNode() && grad.getElementType() == ElemKind::FloatTy) {
+    grad = F_->createMul("lossScale", grad,
+                         broadcastScalar(F_, scale_, grad.dims()));
+  }
   if (map_.count(activation)) {
     auto curr = map_[activation];
     auto *sum = F_->createAdd("updateGrad", curr, grad);
@@ -49,10 +69,320 @@ NodeValue GraphGradMapper::getGradient(NodeValue activation) {
   return map_[activation];
 }
 
+void GraphGradMapper::addSparseGradient(NodeValue activation,
+                                        NodeValue indices, NodeValue rows) {
+  auto it = sparseMap_.find(activation);
+  if (it != sparseMap_.end()) {
+    auto &curr = it->second;
+    curr.first =
+        F_->createConcat("updateSparseGrad.indices", {curr.first, indices}, 0);
+    curr.second =
+        F_->createConcat("updateSparseGrad.rows", {curr.second, rows}, 0);
+    return;
+  }
+
+  sparseMap_[activation] = {indices, rows};
+}
+
+std::pair<NodeValue, NodeValue>
+GraphGradMapper::getSparseGradient(NodeValue activation) {
+  return sparseMap_[activation];
+}
+
+bool GraphGradMapper::hasSparseGradient(NodeValue activation) {
+  return sparseMap_.count(activation);
+}
+
+//===----------------------------------------------------------------------===//
+//        Recomputation of forward activations in the backward pass.
+//===----------------------------------------------------------------------===//
+
+/// \returns true if the forward node \p N is cheap enough to be recomputed in
+/// the backward pass instead of keeping its results alive.
+static bool isCheaplyRecomputable(const Node *N) {
+  switch (N->getKind()) {
+  case Kinded::Kind::ReluNodeKind:
+  case Kinded::Kind::SigmoidNodeKind:
+  case Kinded::Kind::TanhNodeKind:
+  case Kinded::Kind::AddNodeKind:
+  case Kinded::Kind::SubNodeKind:
+  case Kinded::Kind::MulNodeKind:
+  case Kinded::Kind::DivNodeKind:
+  case Kinded::Kind::MaxNodeKind:
+  case Kinded::Kind::MinNodeKind:
+  case Kinded::Kind::ReshapeNodeKind:
+  case Kinded::Kind::TransposeNodeKind:
+  case Kinded::Kind::SplatNodeKind:
+    return N->getNumResults() == 1;
+  default:
+    return false;
+  }
+}
+
+namespace {
+/// Rewrites the backward pass of a differentiated function so that it keeps
+/// at most a given number of bytes of forward activations alive. The other
+/// activations are recomputed by clones of the cheap forward nodes that
+/// produce them. The clones only have backward users, so the scheduler
+/// computes them right before the gradients that need them.
+class ActivationRecomputer {
+  /// The differentiated function.
+  Function *G_;
+  /// The nodes of the forward pass, in post-order.
+  llvm::ArrayRef<Node *> order_;
+  /// The set of nodes of the forward pass.
+  std::unordered_set<Node *> forward_;
+  /// The forward activations that the backward pass reads directly.
+  std::unordered_set<NodeValue> kept_;
+  /// Maps forward activations to their recomputed values.
+  std::unordered_map<NodeValue, NodeValue> recomputed_;
+
+  /// \returns the value that the backward pass should read instead of the
+  /// forward activation \p V.
+  NodeValue recompute(NodeValue V) {
+    Node *N = V.getNode();
+    if (!forward_.count(N) || kept_.count(V)) {
+      return V;
+    }
+    auto it = recomputed_.find(V);
+    if (it != recomputed_.end()) {
+      return it->second;
+    }
+    // Expensive activations stay alive even when only cheap ones read them.
+    if (!isCheaplyRecomputable(N)) {
+      kept_.insert(V);
+      return V;
+    }
+
+    Node *clone = N->clone();
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      clone->setNthInput(i, recompute(N->getNthInput(i)));
+    }
+    clone->setRecomputation(true);
+    G_->addNode(clone);
+    NodeValue result(clone, V.getResNo());
+    recomputed_[V] = result;
+    return result;
+  }
+
+public:
+  /// Prepares the recomputation in \p G, whose forward pass consists of the
+  /// nodes \p forward in post-order.
+  ActivationRecomputer(Function *G, llvm::ArrayRef<Node *> forward)
+      : G_(G), order_(forward), forward_(forward.begin(), forward.end()) {}
+
+  /// Keeps at most \p budget bytes of the recomputable forward activations
+  /// that the backward pass reads and recomputes the others.
+  void run(size_t budget) {
+    // Find the backward operands that read forward activations.
+    std::vector<std::pair<Node *, unsigned>> uses;
+    std::unordered_set<NodeValue> used;
+    for (auto &N : G_->getNodes()) {
+      if (forward_.count(&N) || isa<Storage>(&N)) {
+        continue;
+      }
+      for (unsigned i = 0, e = N.getNumInputs(); i < e; i++) {
+        NodeValue V = N.getNthInput(i);
+        if (forward_.count(V.getNode())) {
+          uses.push_back({&N, i});
+          used.insert(V);
+        }
+      }
+    }
+
+    // Activations that cannot be recomputed are kept regardless of the
+    // budget. The recomputable ones fill the rest of it in forward order.
+    size_t keptSize = 0;
+    for (bool recomputable : {false, true}) {
+      for (auto *N : order_) {
+        if (isCheaplyRecomputable(N) != recomputable) {
+          continue;
+        }
+        for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+          NodeValue V(N, i);
+          size_t size = V.getType()->getSizeInBytes();
+          if (!used.count(V) || (recomputable && keptSize + size > budget)) {
+            continue;
+          }
+          kept_.insert(V);
+          keptSize += size;
+        }
+      }
+    }
+
+    for (auto &use : uses) {
+      Node *user = use.first;
+      user->setNthInput(use.second, recompute(user->getNthInput(use.second)));
+    }
+  }
+};
+} // namespace
+
 //===----------------------------------------------------------------------===//
 //        Code for automatically generating the back propagation code.
 //===----------------------------------------------------------------------===//
 
+/// \returns a new zero-initialized variable of type \p T named \p name for
+/// the state that the optimizer keeps across the updates of a weight.
+static Variable *createOptimizerState(Module *M, TypeRef T,
+                                      llvm::StringRef name) {
+  auto *V = M->createVariable(T, name, VisibilityKind::Private, true);
+  V->getPayload().zero();
+  return V;
+}
+
+/// \returns the node, which is not added to any function yet, that updates
+/// the weight \p W with its gradient \p grad of the function \p F, with the
+/// optimizer of the configuration \p conf.
+static Node *createOptimizerNode(Function *F, const TrainingConfig &conf,
+                                 Storage *W, NodeValue grad) {
+  Module *M = F->getParent();
+  TypeRef T = W->getType();
+  switch (conf.optimizer) {
+  case OptimizerKind::SGD:
+    return new SGDNode(W->getName(), grad, W, conf.L1Decay, conf.L2Decay,
+                       conf.learningRate, conf.momentum, conf.batchSize);
+  case OptimizerKind::Adagrad:
+    return new AdagradNode(W->getName(), grad, W,
+                           createOptimizerState(M, T, "sumsq"), conf.L1Decay,
+                           conf.L2Decay, conf.learningRate, conf.epsilon,
+                           conf.batchSize);
+  case OptimizerKind::RMSProp:
+    return new RMSPropNode(W->getName(), grad, W,
+                           createOptimizerState(M, T, "meansq"), conf.L1Decay,
+                           conf.L2Decay, conf.learningRate, conf.decay,
+                           conf.epsilon, conf.batchSize);
+  case OptimizerKind::Adam:
+    return new AdamNode(
+        W->getName(), grad, W, createOptimizerState(M, T, "moment1"),
+        createOptimizerState(M, T, "moment2"),
+        createOptimizerState(M, M->uniqueType(ElemKind::FloatTy, {1}), "step"),
+        conf.L1Decay, conf.L2Decay, conf.learningRate, conf.beta1, conf.beta2,
+        conf.epsilon, conf.batchSize);
+  }
+  llvm_unreachable("Invalid optimizer.");
+}
+
+/// Adds to \p F the node that updates in place the rows \p indices of the
+/// weight \p W with their gradients \p rows, with the optimizer of the
+/// configuration \p conf. The cost of the update is proportional to the
+/// number of rows, not to the size of the weight.
+static Node *createSparseWeightUpdate(Function *F, const TrainingConfig &conf,
+                                      Storage *W, NodeValue indices,
+                                      NodeValue rows) {
+  Module *M = F->getParent();
+  switch (conf.optimizer) {
+  case OptimizerKind::SGD:
+    return F->addNode(new SparseSGDNode(W->getName(), rows, W, indices,
+                                        conf.L1Decay, conf.L2Decay,
+                                        conf.learningRate, conf.batchSize));
+  case OptimizerKind::Adagrad:
+    return F->addNode(new SparseAdagradNode(
+        W->getName(), rows, W, indices,
+        createOptimizerState(M, W->getType(), "sumsq"), conf.L1Decay,
+        conf.L2Decay, conf.learningRate, conf.epsilon, conf.batchSize));
+  case OptimizerKind::RMSProp:
+  case OptimizerKind::Adam:
+    break;
+  }
+  llvm_unreachable("Sparse gradients only support the SGD and Adagrad "
+                   "optimizers.");
+}
+
+/// \returns a scalar of shape {1} in \p F that is 1 if all the elements of
+/// \p values are finite, and 0 if any of them is an infinity or a NaN.
+static NodeValue createIsFinite(Function *F, llvm::ArrayRef<NodeValue> values) {
+  auto *scalarTy = F->getParent()->uniqueType(ElemKind::FloatTy, {1});
+  auto *zero = F->createSplat("isFinite.zero", scalarTy, 0);
+  // Subtracting a value from itself turns infinities into NaNs, which make
+  // the sum a NaN, and finite values into zeros.
+  NodeValue sum = zero;
+  for (auto V : values) {
+    auto *diff = F->createSub("isFinite.sub", V, V);
+    auto *flat =
+        F->createReshape("isFinite.flat", diff, {1, V.getType()->size()});
+    auto *reduced = F->createBatchedReduceAdd("isFinite.sum", flat, 1);
+    sum = F->createAdd("isFinite.sum", sum, reduced);
+  }
+  return F->createCmpEQ("isFinite", sum, zero);
+}
+
+/// Add to \p F the nodes that update the dynamic loss scale \p scale after a
+/// step whose gradients are finite if \p isFinite is 1: a step that overflows
+/// halves the scale, and the growth interval of \p conf steps in a row
+/// without overflow double it.
+static void createLossScaleUpdate(Function *F, const TrainingConfig &conf,
+                                  Variable *scale, NodeValue isFinite) {
+  Module *M = F->getParent();
+  auto *scalarTy = M->uniqueType(ElemKind::FloatTy, {1});
+  // The number of steps in a row without overflow.
+  auto *steps = M->createVariable(scalarTy, "lossScaleSteps",
+                                  VisibilityKind::Private, false);
+  steps->getPayload().zero();
+  auto *one = F->createSplat("one", scalarTy, 1);
+  auto *count = F->createMul(
+      "lossScaleSteps", F->createAdd("lossScaleSteps", steps, one), isFinite);
+  auto *interval = F->createSplat("lossScaleGrowthInterval", scalarTy,
+                                  conf.lossScaleGrowthInterval);
+  auto *grow = F->createCmpLTE("lossScaleGrow", interval, count);
+  F->createSave("lossScaleSteps",
+                F->createMul("lossScaleSteps", count,
+                             F->createSub("lossScaleSteps", one, grow)),
+                steps);
+
+  // The scale is doubled when it grows, kept when the gradients are finite,
+  // and halved otherwise.
+  auto *finiteFactor = F->createMul("lossScaleFactor", isFinite,
+                                    F->createAdd("lossScaleFactor", one, grow));
+  auto *overflowFactor =
+      F->createMul("lossScaleFactor", F->createSub("overflow", one, isFinite),
+                   F->createSplat("half", scalarTy, 0.5));
+  auto *factor = F->createAdd("lossScaleFactor", finiteFactor, overflowFactor);
+  F->createSave("lossScale", F->createMul("lossScale", scale, factor), scale);
+}
+
+/// Store the floating point values that the nodes \p backward of the backward
+/// pass of \p G read, and that are not weights or constants, in half
+/// precision: every such value is converted to Float16Ty once, and widened to
+/// float again right before its backward users. These are the forward
+/// activations that stay alive until the backward pass and the gradients.
+static void
+storeBackwardInputsInFloat16(Function *G,
+                             const std::unordered_set<Node *> &backward) {
+  std::vector<Node *> users;
+  for (auto &N : G->getNodes()) {
+    if (backward.count(&N) || N.isRecomputation()) {
+      users.push_back(&N);
+    }
+  }
+  std::unordered_map<NodeValue, NodeValue> widened;
+  for (auto *N : users) {
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      NodeValue V = N->getNthInput(i);
+      if (V.getElementType() != ElemKind::FloatTy || isa<Storage>(V) ||
+          isa<SplatNode>(V) || isa<ConvertToNode>(V)) {
+        continue;
+      }
+      auto it = widened.find(V);
+      if (it == widened.end()) {
+        auto *half = G->createConvertTo("halfStorage", V, ElemKind::Float16Ty);
+        it = widened
+                 .insert({V, G->createConvertTo("widen", half,
+                                                ElemKind::FloatTy)})
+                 .first;
+      }
+      N->setNthInput(i, it->second);
+    }
+  }
+}
+
+SaveNode *glow::createWeightUpdate(Function *F, const TrainingConfig &conf,
+                                   Storage *W, NodeValue grad) {
+  auto *X = F->addNode(createOptimizerNode(F, conf, W, grad));
+  // Update the weight with the value computed by the optimizer.
+  return F->addNode(new SaveNode(W->getName().str() + ".saveGrad", {X, 0}, W));
+}
+
 Function *glow::differentiate(Function *F, const TrainingConfig &conf,
                               llvm::StringRef newFuncName,
                               VariableGradientsList *varGrads) {
@@ -66,6 +396,20 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
   // Clone the function.
   Function *G = F->clone(newFuncName);
 
+  // Recurrent cells don't have gradient nodes of their own; differentiate the
+  // nodes that compute them instead. Expanding a cell creates a unit node,
+  // which is expanded by the next iteration.
+  for (bool expanded = true; expanded;) {
+    expanded = false;
+    for (auto it = G->getNodes().begin(), e = G->getNodes().end(); it != e;) {
+      Node *N = &*(it++);
+      if (G->expandRecurrentNode(N)) {
+        G->eraseNode(N);
+        expanded = true;
+      }
+    }
+  }
+
   using Kind = glow::Kinded::Kind;
   GraphGradMapper map(G);
 
@@ -81,6 +425,21 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
 
   auto nodes = pov.getPostOrder();
 
+  // The losses multiply their gradients by the loss scale, which is a
+  // variable when it changes while training.
+  Module *M = G->getParent();
+  Variable *dynamicScale = nullptr;
+  NodeValue lossScale;
+  if (conf.dynamicLossScaling) {
+    dynamicScale = M->createVariable(ElemKind::FloatTy, {1}, "lossScale",
+                                     VisibilityKind::Private, false);
+    dynamicScale->getPayload().getHandle().clear(conf.lossScale);
+    lossScale = dynamicScale;
+  } else if (conf.lossScale != 1) {
+    lossScale = G->createSplat(
+        "lossScale", M->uniqueType(ElemKind::FloatTy, {1}), conf.lossScale);
+  }
+
   for (auto it = nodes.rbegin(), e = nodes.rend(); it != e; it++) {
     Node *N = *it;
     if (isa<Storage>(N)) {
@@ -93,14 +452,25 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
     continue;                                                                  \
   }
 
+// The gradients of the losses start the backward pass, so scaling them
+// scales all the gradients.
+#define CONVERT_LOSS_TO_GRAD_NODE(NodeKind)                                    \
+  if (N->getKind() == Kind::NodeKind##Kind) {                                  \
+    map.setGradientScale(lossScale);                                           \
+    toAppend.push_back(cast<NodeKind>(N)->getGrad(map));                       \
+    map.setGradientScale(NodeValue());                                         \
+    continue;                                                                  \
+  }
+
     CONVERT_TO_GRAD_NODE(ConvolutionNode)
     CONVERT_TO_GRAD_NODE(MaxPoolNode)
     CONVERT_TO_GRAD_NODE(AvgPoolNode)
     CONVERT_TO_GRAD_NODE(FullyConnectedNode)
     CONVERT_TO_GRAD_NODE(LocalResponseNormalizationNode)
-    CONVERT_TO_GRAD_NODE(SoftMaxNode)
-    CONVERT_TO_GRAD_NODE(CrossEntropyLossNode)
-    CONVERT_TO_GRAD_NODE(RegressionNode)
+    CONVERT_LOSS_TO_GRAD_NODE(SoftMaxNode)
+    CONVERT_LOSS_TO_GRAD_NODE(CrossEntropyLossNode)
+    CONVERT_LOSS_TO_GRAD_NODE(SoftMaxCrossEntropyLossNode)
+    CONVERT_LOSS_TO_GRAD_NODE(RegressionNode)
     CONVERT_TO_GRAD_NODE(AddNode)
     CONVERT_TO_GRAD_NODE(MulNode)
     CONVERT_TO_GRAD_NODE(SubNode)
@@ -109,6 +479,56 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
     CONVERT_TO_GRAD_NODE(SigmoidNode)
     CONVERT_TO_GRAD_NODE(TanhNode)
 
+    if (N->getKind() == Kind::SparseLengthsWeightedSumNodeKind) {
+      // The gradient of the table has a row per index, instead of the size
+      // of the whole table. The weights, the indices and the lengths have no
+      // gradient.
+      auto *SLWS = cast<SparseLengthsWeightedSumNode>(N);
+      NodeValue data = SLWS->getData();
+      NodeValue indices = SLWS->getIndices();
+      assert(isa<Storage>(data) &&
+             "Only the tables of storage nodes are differentiable");
+      ShapeVector rowDims(data.dims().begin(), data.dims().end());
+      rowDims[0] = indices.dims()[0];
+      NodeValue outputG = map.getGradient(SLWS->getResult());
+      auto *rows = new SparseLengthsWeightedSumRowGradNode(
+          N->getName(),
+          G->getParent()->uniqueTypeWithNewShape(outputG.getType(), rowDims),
+          outputG, SLWS->getWeights(), SLWS->getLengths());
+      toAppend.push_back(rows);
+      map.addSparseGradient(data, indices, rows);
+      continue;
+    }
+
+    if (N->getKind() == Kind::GatherNodeKind) {
+      // The gradient of the data has a row per index: the gradient of the
+      // result, with the indices flattened.
+      auto *GN = cast<GatherNode>(N);
+      NodeValue data = GN->getData();
+      NodeValue indices = GN->getIndices();
+      assert(GN->getBatchDims() == 0 &&
+             "Only the gathers without batch dimensions are differentiable");
+      assert(isa<Storage>(data) &&
+             "Only the data of storage nodes is differentiable");
+      size_t numIndices = indices.getType()->size();
+      std::vector<size_t> rowDims(data.dims().begin(), data.dims().end());
+      rowDims[0] = numIndices;
+      NodeValue outputG = map.getGradient(GN->getResult());
+      auto *flatIndices = new ReshapeNode(
+          "gather.indices",
+          G->getParent()->uniqueTypeWithNewShape(indices.getType(),
+                                                 {numIndices}),
+          indices, {numIndices});
+      auto *rows = new ReshapeNode(
+          "gather.rows",
+          G->getParent()->uniqueTypeWithNewShape(outputG.getType(), rowDims),
+          outputG, rowDims);
+      toAppend.push_back(flatIndices);
+      toAppend.push_back(rows);
+      map.addSparseGradient(data, flatIndices, rows);
+      continue;
+    }
+
     if (N->getKind() == Kind::SaveNodeKind) {
       // Swap the src and dest. Send the Zero value as gradient for both sides.
       auto *X = new SplatNode(N->getName(),
@@ -227,6 +647,19 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
     llvm_unreachable("Invalid instruction type.");
   } // End of the for-each instr loop.
 
+  // The gradients of the weights are divided by the loss scale.
+  auto unscale = [&](NodeValue grad) -> NodeValue {
+    if (!lossScale.getNode()) {
+      return grad;
+    }
+    return G->createDiv("lossUnscale", grad,
+                        broadcastScalar(G, lossScale, grad.dims()));
+  };
+
+  // The dense gradients and the sparse indices and rows of the weights to
+  // update.
+  std::vector<std::pair<Storage *, NodeValue>> denseUpdates;
+  std::vector<std::tuple<Storage *, NodeValue, NodeValue>> sparseUpdates;
   for (auto N : nodes) {
     // Iterate only through Variables/Placeholders used by the Function.
     // These are inserted during the post-order walk.
@@ -240,7 +673,7 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
       if (map.hasGradient(V)) {
         std::string nodeName = "_grad_" + V->getName().str();
         // Save the gradient and return the destination variable.
-        auto *saveNode = G->createSave(nodeName, map.getGradient(V));
+        auto *saveNode = G->createSave(nodeName, unscale(map.getGradient(V)));
         auto *GradV = llvm::dyn_cast<Storage>(saveNode->getOutput().getNode());
         varGrads->push_back({V, GradV});
       }
@@ -252,19 +685,70 @@ Function *glow::differentiate(Function *F, const TrainingConfig &conf,
       continue;
     }
 
-    auto X = new SGDNode(V->getName(), map.getGradient(V), V, conf.L1Decay,
-                         conf.L2Decay, conf.learningRate, conf.momentum,
-                         conf.batchSize);
-    toAppend.push_back(X);
-    // Now update the weight with the value computed by SGD.
-    auto *save = new SaveNode(V->getName().str() + ".saveGrad", {X, 0}, V);
-    toAppend.push_back(save);
+    if (map.hasSparseGradient(V)) {
+      assert(!map.hasGradient(V) &&
+             "A weight can't have both a dense and a sparse gradient");
+      auto sparseGrad = map.getSparseGradient(V);
+      sparseUpdates.emplace_back(V, sparseGrad.first,
+                                 unscale(sparseGrad.second));
+      continue;
+    }
+
+    denseUpdates.emplace_back(V, unscale(map.getGradient(V)));
+  }
+
+  // With a dynamic loss scale, a step whose gradients overflow updates the
+  // weights with zero gradients.
+  if (dynamicScale && (!denseUpdates.empty() || !sparseUpdates.empty())) {
+    std::vector<NodeValue> grads;
+    for (const auto &update : denseUpdates) {
+      grads.push_back(update.second);
+    }
+    for (const auto &update : sparseUpdates) {
+      grads.push_back(std::get<2>(update));
+    }
+    NodeValue isFinite = createIsFinite(G, grads);
+    auto selectFinite = [&](NodeValue grad) -> NodeValue {
+      return G->createSelect("selectFinite",
+                             broadcastScalar(G, isFinite, grad.dims()), grad,
+                             G->createSplat("zero", grad.getType(), 0));
+    };
+    for (auto &update : denseUpdates) {
+      update.second = selectFinite(update.second);
+    }
+    for (auto &update : sparseUpdates) {
+      std::get<2>(update) = selectFinite(std::get<2>(update));
+    }
+    createLossScaleUpdate(G, conf, dynamicScale, isFinite);
+  }
+
+  for (const auto &update : denseUpdates) {
+    createWeightUpdate(G, conf, update.first, update.second);
+  }
+  for (const auto &update : sparseUpdates) {
+    createSparseWeightUpdate(G, conf, std::get<0>(update), std::get<1>(update),
+                             std::get<2>(update));
   }
 
   // Add all of the new variables and instructions.
+  std::unordered_set<Node *> backward(toAppend.begin(), toAppend.end());
   for (auto &I : toAppend) {
     G->addNode(I);
   }
 
+  if (conf.activationMemoryBudget) {
+    std::vector<Node *> forward;
+    for (auto *N : nodes) {
+      if (!isa<Storage>(N)) {
+        forward.push_back(N);
+      }
+    }
+    ActivationRecomputer(G, forward).run(conf.activationMemoryBudget);
+  }
+
+  if (conf.float16Gradients) {
+    storeBackwardInputsInFloat16(G, backward);
+  }
+
   return G;
 }
@@ -16,16 +16,26 @@
 
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Quantization/Base/Base.h"
 #include "glow/Support/Support.h"
 
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <new>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
 
 using namespace glow;
@@ -306,13 +316,18 @@ TypeRef Module::uniqueTypeWithNewShape(TypeRef T, llvm::ArrayRef<size_t> dims) {
 }
 
 TypeRef Module::uniqueType(const Type &T) {
-  for (auto &tp : types_) {
-    if (T.isEqual(tp)) {
-      return &tp;
-    }
+  std::lock_guard<std::mutex> lock(*typesMutex_);
+  auto it = types_.find(&T);
+  if (it != types_.end()) {
+    return *it;
   }
 
-  return &*types_.insert(types_.begin(), T);
+  // Types are never destroyed, their memory is released with the arena.
+  static_assert(std::is_trivially_destructible<Type>::value,
+                "Types must not need to be destroyed");
+  auto *newTy = new (arena_->allocate(sizeof(Type), alignof(Type))) Type(T);
+  types_.insert(newTy);
+  return newTy;
 }
 
 TypeRef Module::getVoidTy() { return uniqueType(Type()); }
@@ -344,9 +359,22 @@ Placeholder *Module::createPlaceholder(ElemKind T, llvm::ArrayRef<size_t> dims,
   return createPlaceholder(FT, name, isTrainable);
 }
 
+/// Variable payloads up to this size are allocated from the arena of the
+/// module, when the variable is created in an ArenaScope of it.
+static constexpr size_t maxArenaPayloadSize = 4096;
+
 Variable *Module::createVariable(TypeRef T, llvm::StringRef name,
                                  VisibilityKind visibility, bool isTrainable) {
   auto FT = uniqueType(*T);
+  size_t size = FT->getSizeInBytes();
+  if (ArenaScope::getCurrent() == arena_.get() &&
+      size <= maxArenaPayloadSize) {
+    // The payload does not own the memory, which lives as long as the module.
+    void *data = arena_->allocate(size, TensorAlignment);
+    memset(data, 0, size);
+    return addVar(new Variable(name, FT, visibility, isTrainable,
+                               Tensor(data, FT)));
+  }
   return addVar(new Variable(name, FT, visibility, isTrainable));
 }
 
@@ -525,6 +553,18 @@ ConvolutionNode *Function::createConv(llvm::StringRef name, NodeValue input,
   return createConv(name, input, depth, kernels, strides, pads, group);
 }
 
+ChannelwiseQuantizedConvolutionNode *Function::createChannelwiseQuantizedConv(
+    llvm::StringRef name, NodeValue input, NodeValue filter, NodeValue bias,
+    NodeValue scales, NodeValue offsets, TypeRef outTy,
+    llvm::ArrayRef<unsigned_t> kernels, llvm::ArrayRef<unsigned_t> strides,
+    llvm::ArrayRef<unsigned_t> pads, unsigned_t group) {
+  assertConvDims(input, filter, bias, kernels, strides, pads, group);
+  auto OT = getParent()->uniqueType(*outTy);
+  return addNode(new ChannelwiseQuantizedConvolutionNode(
+      name, OT, input, filter, bias, scales, offsets, kernels, strides, pads,
+      group));
+}
+
 MaxPoolNode *Function::createMaxPool(llvm::StringRef name, NodeValue input,
                                      llvm::ArrayRef<unsigned_t> kernels,
                                      llvm::ArrayRef<unsigned_t> strides,
@@ -661,6 +701,13 @@ CrossEntropyLossNode *Function::createCrossEntropyLoss(llvm::StringRef name,
   return addNode(new CrossEntropyLossNode(name, ty, input, labels));
 }
 
+SoftMaxCrossEntropyLossNode *
+Function::createSoftMaxCrossEntropyLoss(llvm::StringRef name, NodeValue logits,
+                                        NodeValue labels) {
+  auto ty = getParent()->uniqueTypeWithNewShape(logits.getType(), {1});
+  return addNode(new SoftMaxCrossEntropyLossNode(name, ty, logits, labels));
+}
+
 RegressionNode *Function::createRegression(llvm::StringRef name,
                                            NodeValue input,
                                            NodeValue expected) {
@@ -736,17 +783,14 @@ Node *Function::createBroadcast(llvm::StringRef name, NodeValue input,
   Node *currNode =
       createReshape(name.str() + ".reshape", input,
                     llvm::ArrayRef<size_t>(reshapeDims, newShape.size()));
-
-  // Create a Tile (which is really a Concat) in each direction that needs to be
-  // broadcasted.
-  for (size_t i = 0; i < newShape.size(); i++) {
-    if (reshapeDims[i] == 1 && newShape[i] != 1) {
-      currNode = createTile(name.str() + ".tile" + std::to_string(i), currNode,
-                            newShape[i], i);
-    }
+  if (currNode->getType(0)->dims() == newShape) {
+    return currNode;
   }
 
-  return currNode;
+  // The elements are repeated by the backends that read the input in place,
+  // and by Tiles for the others, which lower the node.
+  auto OT = getParent()->uniqueTypeWithNewShape(input.getType(), newShape);
+  return addNode(new BroadcastNode(name, OT, currNode));
 }
 
 /// \returns true if \p T1 and T2 has the exact same type except for dimension
@@ -819,6 +863,13 @@ ConcatNode *Function::createConcat(llvm::StringRef name,
   return addNode(new ConcatNode(name, OT, ops, dimension));
 }
 
+SumNode *Function::createSum(llvm::StringRef name,
+                             llvm::ArrayRef<NodeValue> inputs) {
+  assert(!inputs.empty() && "Empty sum?!");
+  std::vector<NodeValue> ops(inputs.begin(), inputs.end());
+  return addNode(new SumNode(name, inputs[0].getType(), ops));
+}
+
 InsertTensorNode *Function::createTile(llvm::StringRef name, NodeValue input,
                                        unsigned_t tiles, unsigned_t axis) {
   assert(tiles > 0 && "Tiles must be non-zero.");
@@ -1111,8 +1162,9 @@ PowNode *Function::createPow(llvm::StringRef name, NodeValue base, float exp) {
   return createPow(name, base, SP);
 }
 
-LogNode *Function::createLog(llvm::StringRef name, NodeValue input) {
-  return addNode(new LogNode(name, input.getType(), input));
+LogNode *Function::createLog(llvm::StringRef name, NodeValue input,
+                             TypeRef outTy) {
+  return addNode(new LogNode(name, outTy ? outTy : input.getType(), input));
 }
 
 SelectNode *Function::createSelect(llvm::StringRef name, TypeRef outTy,
@@ -1140,22 +1192,23 @@ SplatNode *Function::createSplat(llvm::StringRef name, TypeRef ty,
 }
 
 MatMulNode *Function::createMatMul(llvm::StringRef name, TypeRef outTy,
-                                   NodeValue lhs, NodeValue rhs) {
-  return addNode(
-      new MatMulNode(name, getParent()->uniqueType(*outTy), lhs, rhs));
+                                   NodeValue lhs, NodeValue rhs,
+                                   bool transposeRHS) {
+  return addNode(new MatMulNode(name, getParent()->uniqueType(*outTy), lhs,
+                                rhs, transposeRHS));
 }
 
 MatMulNode *Function::createMatMul(llvm::StringRef name, NodeValue lhs,
-                                   NodeValue rhs) {
+                                   NodeValue rhs, bool transposeRHS) {
   auto LT = lhs.getType();
   auto RT = rhs.getType();
   auto LDims = LT->dims();
   auto RDims = RT->dims();
   assert(lhs.getType()->getElementType() == rhs.getType()->getElementType());
 
-  auto ty =
-      getParent()->uniqueTypeWithNewShape(lhs.getType(), {LDims[0], RDims[1]});
-  return createMatMul(name, ty, lhs, rhs);
+  auto ty = getParent()->uniqueTypeWithNewShape(
+      lhs.getType(), {LDims[0], RDims[transposeRHS ? 0 : 1]});
+  return createMatMul(name, ty, lhs, rhs, transposeRHS);
 }
 
 Node *Function::createBroadcastedBatchMatMul(llvm::StringRef name,
@@ -1195,37 +1248,33 @@ Node *Function::createParallelBatchMatMul(llvm::StringRef name, NodeValue lhs,
                                           NodeValue rhs) {
   assert(lhs.dims().size() == 3 && rhs.dims().size() == 3 &&
          "Only supporting lhs 3d, rhs 3d for Parallel BatchMatMul.");
+  return createBatchedMatMul(name, lhs, rhs);
+}
 
+BatchedMatMulNode *Function::createBatchedMatMul(llvm::StringRef name,
+                                                 TypeRef outTy, NodeValue lhs,
+                                                 NodeValue rhs) {
+  return addNode(
+      new BatchedMatMulNode(name, getParent()->uniqueType(*outTy), lhs, rhs));
+}
+
+BatchedMatMulNode *Function::createBatchedMatMul(llvm::StringRef name,
+                                                 NodeValue lhs,
+                                                 NodeValue rhs) {
   // LHS = {numBatches, N, M}
   // RHS = {numBatches, M, P}
-  // Multiply i-th LHS matrix {N, M} by i-th RHS matrix {M, P} to get final
-  // matrix
-  // {numBatches, N, P}
-  const auto numBatches = lhs.dims()[0];
-  const auto N = lhs.dims()[1];
-  const auto M = lhs.dims()[2];
-  const auto P = rhs.dims()[2];
-  assert((rhs.dims()[0] == numBatches) &&
-         "Batch matmul dimensions are invalid.");
-  assert((rhs.dims()[1] == M) && "Batch matmul dimensions are invalid.");
-
-  std::vector<NodeValue> MMS(numBatches);
-  for (size_t i = 0; i < numBatches; i++) {
-    auto *sliceA = createSlice(name.str() + ".sliceA." + std::to_string(i), lhs,
-                               {i, 0, 0}, {i + 1, N, M});
-    auto *sliceB = createSlice(name.str() + ".sliceB." + std::to_string(i), rhs,
-                               {i, 0, 0}, {i + 1, M, P});
-    auto *reshapeA =
-        createReshape(sliceA->getName().str() + ".reshape", sliceA, {N, M});
-    auto *reshapeB =
-        createReshape(sliceB->getName().str() + ".reshape", sliceB, {M, P});
-    MMS[i] = createMatMul(name.str() + ".MatMul." + std::to_string(i), reshapeA,
-                          reshapeB);
-  }
-
-  auto *concat = createConcat(name.str() + ".concat", MMS, 0);
-  return createReshape(name.str() + ".FinalReshape", concat,
-                       {numBatches, N, P});
+  // Result = {numBatches, N, P}
+  auto LDims = lhs.dims();
+  auto RDims = rhs.dims();
+  assert(LDims.size() == 3 && RDims.size() == 3 &&
+         "Batched matmul operands must be 3d");
+  assert(LDims[0] == RDims[0] && "Batch matmul dimensions are invalid.");
+  assert(LDims[2] == RDims[1] && "Batch matmul dimensions are invalid.");
+  assert(lhs.getType()->getElementType() == rhs.getType()->getElementType());
+
+  auto ty = getParent()->uniqueTypeWithNewShape(lhs.getType(),
+                                                {LDims[0], LDims[1], RDims[2]});
+  return createBatchedMatMul(name, ty, lhs, rhs);
 }
 
 BatchedReduceAddNode *Function::createBatchedReduceAdd(llvm::StringRef name,
@@ -1289,8 +1338,13 @@ BatchedAddNode *Function::createBatchedAdd(llvm::StringRef name, TypeRef outTy,
 SparseLengthsWeightedSumNode *
 Function::createSparseLengthsSum(llvm::StringRef name, NodeValue data,
                                  NodeValue indices, NodeValue lengths) {
-  auto ty =
-      getParent()->uniqueTypeWithNewShape(data.getType(), {indices.dims()[0]});
+  // Half precision and bfloat16 tables are accumulated in float.
+  size_t numIndices = indices.dims()[0];
+  auto ty = data.getElementType() == ElemKind::Float16Ty ||
+                    data.getElementType() == ElemKind::BFloat16Ty
+                ? getParent()->uniqueType(ElemKind::FloatTy, {numIndices})
+                : getParent()->uniqueTypeWithNewShape(data.getType(),
+                                                      {numIndices});
   auto ones = createSplat(name.str() + ".ones", ty, 1.0);
   return createSparseLengthsWeightedSum(name, data, ones, indices, lengths);
 }
@@ -1302,11 +1356,137 @@ Function::createSparseLengthsWeightedSum(llvm::StringRef name, NodeValue data,
   auto inDims = data.dims();
   ShapeVector outDims(inDims.begin(), inDims.end());
   outDims[0] = lengths.dims()[0];
-  auto outTy = getParent()->uniqueTypeWithNewShape(data.getType(), outDims);
+  auto outTy = data.getElementType() == ElemKind::Float16Ty ||
+                       data.getElementType() == ElemKind::BFloat16Ty
+                   ? getParent()->uniqueType(ElemKind::FloatTy, outDims)
+                   : getParent()->uniqueTypeWithNewShape(data.getType(),
+                                                         outDims);
   return addNode(new SparseLengthsWeightedSumNode(name, outTy, data, weights,
                                                   indices, lengths));
 }
 
+RowwiseQuantizedSparseLengthsWeightedSumNode *
+Function::createRowwiseQuantizedSparseLengthsWeightedSum(
+    llvm::StringRef name, NodeValue data, NodeValue scales, NodeValue offsets,
+    NodeValue weights, NodeValue indices, NodeValue lengths) {
+  auto inDims = data.dims();
+  ShapeVector outDims(inDims.begin(), inDims.end());
+  outDims[0] = lengths.dims()[0];
+  auto outTy = getParent()->uniqueType(ElemKind::FloatTy, outDims);
+  return addNode(new RowwiseQuantizedSparseLengthsWeightedSumNode(
+      name, outTy, data, scales, offsets, weights, indices, lengths));
+}
+
+/// Quantize every row of the 2-D float tensor \p data to int8 with its own
+/// range. The quantized rows, their float scales and their int32 offsets are
+/// stored in the new private variables \p QD, \p scales and \p offsets of
+/// \p M, whose names start with \p name.
+static void quantizeRowwise(Module *M, Tensor &data, llvm::StringRef name,
+                            Variable *&QD, Variable *&scales,
+                            Variable *&offsets) {
+  assert(data.getElementType() == ElemKind::FloatTy &&
+         "Only float tensors can be quantized");
+  size_t numRows = data.dims()[0];
+  size_t rowSize = data.size() / numRows;
+
+  QD = M->createVariable(ElemKind::Int8QTy, data.dims(), 1.0, 0,
+                         name.str() + ".data", VisibilityKind::Private, false);
+  scales = M->createVariable(ElemKind::FloatTy, {numRows},
+                             name.str() + ".scales", VisibilityKind::Private,
+                             false);
+  offsets = M->createVariable(ElemKind::Int32QTy, {numRows}, 1.0, 0,
+                              name.str() + ".offsets", VisibilityKind::Private,
+                              false);
+
+  auto DH = data.getHandle<float>();
+  auto QDH = QD->getHandle<int8_t>();
+  auto SH = scales->getHandle<float>();
+  auto OH = offsets->getHandle<int32_t>();
+  for (size_t r = 0; r < numRows; r++) {
+    // Pick the range of every row separately.
+    float min = DH.raw(r * rowSize);
+    float max = min;
+    for (size_t i = r * rowSize, e = i + rowSize; i < e; i++) {
+      min = std::min(min, DH.raw(i));
+      max = std::max(max, DH.raw(i));
+    }
+    auto TQP = quantization::chooseQuantizationParams(min, max);
+    for (size_t i = r * rowSize, e = i + rowSize; i < e; i++) {
+      QDH.raw(i) = quantization::quantize(DH.raw(i), TQP);
+    }
+    SH.raw(r) = TQP.scale;
+    OH.raw(r) = TQP.offset;
+  }
+}
+
+RowwiseQuantizedSparseLengthsWeightedSumNode *
+Function::createRowwiseQuantizedSparseLengthsWeightedSum(
+    llvm::StringRef name, Tensor &data, NodeValue weights,
+    NodeValue indices, NodeValue lengths) {
+  Variable *QD, *scales, *offsets;
+  quantizeRowwise(getParent(), data, name, QD, scales, offsets);
+  return createRowwiseQuantizedSparseLengthsWeightedSum(
+      name, QD, scales, offsets, weights, indices, lengths);
+}
+
+RowwiseQuantizedFullyConnectedNode *
+Function::createRowwiseQuantizedFullyConnected(llvm::StringRef name,
+                                               NodeValue input,
+                                               NodeValue weights,
+                                               NodeValue scales,
+                                               NodeValue offsets,
+                                               NodeValue bias) {
+  auto outTy = getParent()->uniqueType(
+      ElemKind::FloatTy, {input.dims()[0], weights.dims()[0]});
+  return addNode(new RowwiseQuantizedFullyConnectedNode(
+      name, outTy, input, weights, scales, offsets, bias));
+}
+
+/// Quantize every column of the float K x N weight matrix \p W to int8 with
+/// its own range. The result is stored transposed, with a row for every
+/// column, as described by quantizeRowwise.
+static void quantizeColumnwise(Module *M, Tensor &W, llvm::StringRef name,
+                               Variable *&QW, Variable *&scales,
+                               Variable *&offsets) {
+  assert(W.dims().size() == 2 && "Weights must be a matrix");
+  Tensor WT;
+  W.transpose(&WT, {1, 0});
+  quantizeRowwise(M, WT, name, QW, scales, offsets);
+}
+
+RowwiseQuantizedFullyConnectedNode *
+Function::createRowwiseQuantizedFullyConnected(llvm::StringRef name,
+                                               NodeValue input, Tensor &W,
+                                               NodeValue bias) {
+  Variable *QW, *scales, *offsets;
+  quantizeColumnwise(getParent(), W, name, QW, scales, offsets);
+  return createRowwiseQuantizedFullyConnected(name, input, QW, scales, offsets,
+                                              bias);
+}
+
+DynamicQuantizedFullyConnectedNode *
+Function::createDynamicQuantizedFullyConnected(llvm::StringRef name,
+                                               NodeValue input,
+                                               NodeValue weights,
+                                               NodeValue scales,
+                                               NodeValue offsets,
+                                               NodeValue bias) {
+  auto outTy = getParent()->uniqueType(
+      ElemKind::FloatTy, {input.dims()[0], weights.dims()[0]});
+  return addNode(new DynamicQuantizedFullyConnectedNode(
+      name, outTy, input, weights, scales, offsets, bias));
+}
+
+DynamicQuantizedFullyConnectedNode *
+Function::createDynamicQuantizedFullyConnected(llvm::StringRef name,
+                                               NodeValue input, Tensor &W,
+                                               NodeValue bias) {
+  Variable *QW, *scales, *offsets;
+  quantizeColumnwise(getParent(), W, name, QW, scales, offsets);
+  return createDynamicQuantizedFullyConnected(name, input, QW, scales,
+                                              offsets, bias);
+}
+
 SaveNode *Function::createSave(llvm::StringRef name, NodeValue input) {
   auto *dest = getParent()->createVariable(input.getType(), name,
                                            VisibilityKind::Public, false);
@@ -1319,6 +1499,11 @@ SaveNode *Function::createSave(llvm::StringRef name, NodeValue input,
   return addNode(new SaveNode(name, input, output));
 }
 
+SaveNode *Function::createSave(llvm::StringRef name, NodeValue input,
+                               Placeholder *output) {
+  return addNode(new SaveNode(name, input, output));
+}
+
 QuantizationProfileNode *
 Function::createQuantizationProfile(llvm::StringRef name, NodeValue input) {
   // TODO: this size is going to be refined. Just a placeholder now.
@@ -1421,6 +1606,309 @@ TopKNode *Function::createTopK(llvm::StringRef name, NodeValue input,
       k));
 }
 
+LSTMCellNode *Function::createLSTMCell(llvm::StringRef name, NodeValue input,
+                                       NodeValue H, NodeValue C,
+                                       NodeValue inputWeights,
+                                       NodeValue inputBias,
+                                       NodeValue hiddenWeights,
+                                       NodeValue hiddenBias) {
+  return addNode(new LSTMCellNode(name, H.getType(), C.getType(), input, H, C,
+                                  inputWeights, inputBias, hiddenWeights,
+                                  hiddenBias));
+}
+
+LSTMUnitNode *Function::createLSTMUnit(llvm::StringRef name,
+                                       NodeValue inputGates,
+                                       NodeValue hiddenGates, NodeValue C) {
+  return addNode(new LSTMUnitNode(name, C.getType(), C.getType(), inputGates,
+                                  hiddenGates, C));
+}
+
+GRUCellNode *Function::createGRUCell(llvm::StringRef name, NodeValue input,
+                                     NodeValue H, NodeValue inputWeights,
+                                     NodeValue inputBias,
+                                     NodeValue hiddenWeights,
+                                     NodeValue hiddenBias) {
+  return addNode(new GRUCellNode(name, H.getType(), input, H, inputWeights,
+                                 inputBias, hiddenWeights, hiddenBias));
+}
+
+GRUUnitNode *Function::createGRUUnit(llvm::StringRef name,
+                                     NodeValue inputGates,
+                                     NodeValue hiddenGates, NodeValue H) {
+  return addNode(
+      new GRUUnitNode(name, H.getType(), inputGates, hiddenGates, H));
+}
+
+/// \returns \p lengths, or if it is empty a constant variable of the module
+/// of \p F in which all the \p batch entries run the \p steps steps.
+static NodeValue getSequenceLengths(Function *F, llvm::StringRef name,
+                                    NodeValue lengths, size_t steps,
+                                    size_t batch) {
+  if (lengths.getNode()) {
+    return lengths;
+  }
+  auto *V = F->getParent()->createVariable(ElemKind::Int64ITy, {batch}, name,
+                                           VisibilityKind::Private,
+                                           /* isTrainable */ false);
+  V->getPayload().getHandle<int64_t>().clear(steps);
+  return V;
+}
+
+RNNSequenceNode *Function::createRNNSequence(llvm::StringRef name,
+                                             NodeValue inputGates,
+                                             NodeValue initH,
+                                             NodeValue hiddenWeights,
+                                             NodeValue hiddenBias,
+                                             NodeValue lengths) {
+  auto dims = inputGates.dims();
+  lengths = getSequenceLengths(this, name.str() + ".lengths", lengths,
+                               dims[0], dims[1]);
+  return addNode(new RNNSequenceNode(name, inputGates.getType(), inputGates,
+                                     initH, hiddenWeights, hiddenBias,
+                                     lengths));
+}
+
+LSTMSequenceNode *Function::createLSTMSequence(
+    llvm::StringRef name, NodeValue inputGates, NodeValue initH,
+    NodeValue initC, NodeValue hiddenWeights, NodeValue hiddenBias,
+    NodeValue lengths) {
+  auto dims = inputGates.dims();
+  auto OT = getParent()->uniqueTypeWithNewShape(
+      inputGates.getType(), {dims[0], dims[1], initH.dims()[1]});
+  lengths = getSequenceLengths(this, name.str() + ".lengths", lengths,
+                               dims[0], dims[1]);
+  return addNode(new LSTMSequenceNode(name, OT, inputGates, initH, initC,
+                                      hiddenWeights, hiddenBias, lengths));
+}
+
+GRUSequenceNode *Function::createGRUSequence(llvm::StringRef name,
+                                             NodeValue inputGates,
+                                             NodeValue initH,
+                                             NodeValue hiddenWeights,
+                                             NodeValue hiddenBias,
+                                             NodeValue lengths) {
+  auto dims = inputGates.dims();
+  auto OT = getParent()->uniqueTypeWithNewShape(
+      inputGates.getType(), {dims[0], dims[1], initH.dims()[1]});
+  lengths = getSequenceLengths(this, name.str() + ".lengths", lengths,
+                               dims[0], dims[1]);
+  return addNode(new GRUSequenceNode(name, OT, inputGates, initH,
+                                     hiddenWeights, hiddenBias, lengths));
+}
+
+bool Function::expandRecurrentNode(Node *N) {
+  std::string name = N->getName();
+
+  // Computes the contribution of \p input to all the gates at once.
+  auto createGates = [&](llvm::StringRef gatesName, NodeValue input,
+                         NodeValue weights, NodeValue bias) -> NodeValue {
+    auto OT = getParent()->uniqueTypeWithNewShape(
+        input.getType(), {input.dims()[0], bias.dims()[0]});
+    return addNode(
+        new FullyConnectedNode(gatesName, OT, input, weights, bias));
+  };
+
+  // \returns the gate number \p idx of the \p gates that update the state
+  // \p state.
+  auto getGate = [&](NodeValue gates, NodeValue state, size_t idx) {
+    return createSlice(name + ".gate", gates, {0, idx * state.dims()[1]},
+                       state.getType());
+  };
+
+  if (auto *LC = dyn_cast<LSTMCellNode>(N)) {
+    auto inputGates = createGates(name + ".input_gates", LC->getInput(),
+                                  LC->getInputWeights(), LC->getInputBias());
+    auto hiddenGates = createGates(name + ".hidden_gates", LC->getH(),
+                                   LC->getHiddenWeights(), LC->getHiddenBias());
+    auto *LU = createLSTMUnit(name, inputGates, hiddenGates, LC->getC());
+    LC->getNewH().replaceAllUsesOfWith(LU->getNewH());
+    LC->getNewC().replaceAllUsesOfWith(LU->getNewC());
+    return true;
+  }
+
+  if (auto *LU = dyn_cast<LSTMUnitNode>(N)) {
+    NodeValue C = LU->getC();
+    NodeValue gates =
+        createAdd(name + ".gates", LU->getInputGates(), LU->getHiddenGates());
+    // C <- F . C + I . tanh(G)
+    // H <- O . tanh(C)
+    auto *I = createSigmoid(name + ".i", getGate(gates, C, 0));
+    auto *F = createSigmoid(name + ".f", getGate(gates, C, 1));
+    auto *G = createTanh(name + ".g", getGate(gates, C, 2));
+    auto *O = createSigmoid(name + ".o", getGate(gates, C, 3));
+    auto *newC = createAdd(name + ".c", createMul(name + ".fc", F, C),
+                           createMul(name + ".ig", I, G));
+    auto *newH =
+        createMul(name + ".h", O, createTanh(name + ".tanh_c", newC));
+    LU->getNewH().replaceAllUsesOfWith(newH);
+    LU->getNewC().replaceAllUsesOfWith(newC);
+    return true;
+  }
+
+  if (auto *GC = dyn_cast<GRUCellNode>(N)) {
+    auto inputGates = createGates(name + ".input_gates", GC->getInput(),
+                                  GC->getInputWeights(), GC->getInputBias());
+    auto hiddenGates = createGates(name + ".hidden_gates", GC->getH(),
+                                   GC->getHiddenWeights(), GC->getHiddenBias());
+    auto *GU = createGRUUnit(name, inputGates, hiddenGates, GC->getH());
+    GC->getResult().replaceAllUsesOfWith(GU);
+    return true;
+  }
+
+  if (auto *GU = dyn_cast<GRUUnitNode>(N)) {
+    NodeValue H = GU->getH();
+    NodeValue inputGates = GU->getInputGates();
+    NodeValue hiddenGates = GU->getHiddenGates();
+    // R <- sigmoid(Ir + Hr)
+    // Z <- sigmoid(Iz + Hz)
+    // N <- tanh(In + R . Hn)
+    // H <- N + Z . (H - N)
+    auto *R = createSigmoid(
+        name + ".r", createAdd(name + ".r.add", getGate(inputGates, H, 0),
+                               getGate(hiddenGates, H, 0)));
+    auto *Z = createSigmoid(
+        name + ".z", createAdd(name + ".z.add", getGate(inputGates, H, 1),
+                               getGate(hiddenGates, H, 1)));
+    auto *newGate = createTanh(
+        name + ".n",
+        createAdd(name + ".n.add", getGate(inputGates, H, 2),
+                  createMul(name + ".rh", R, getGate(hiddenGates, H, 2))));
+    auto *newH =
+        createAdd(name + ".h", newGate,
+                  createMul(name + ".zh", Z,
+                            createSub(name + ".h.sub", H, newGate)));
+    GU->getResult().replaceAllUsesOfWith(newH);
+    return true;
+  }
+
+  // Unroll a sequence into one step per time step, which computes the gates
+  // of the hidden state and combines them with the gates of the input.
+  NodeValue inputGates, initH, initC, hiddenWeights, hiddenBias, lengths;
+  if (auto *RS = dyn_cast<RNNSequenceNode>(N)) {
+    inputGates = RS->getInputGates();
+    initH = RS->getInitH();
+    hiddenWeights = RS->getHiddenWeights();
+    hiddenBias = RS->getHiddenBias();
+    lengths = RS->getLengths();
+  } else if (auto *LS = dyn_cast<LSTMSequenceNode>(N)) {
+    inputGates = LS->getInputGates();
+    initH = LS->getInitH();
+    initC = LS->getInitC();
+    hiddenWeights = LS->getHiddenWeights();
+    hiddenBias = LS->getHiddenBias();
+    lengths = LS->getLengths();
+  } else if (auto *GS = dyn_cast<GRUSequenceNode>(N)) {
+    inputGates = GS->getInputGates();
+    initH = GS->getInitH();
+    hiddenWeights = GS->getHiddenWeights();
+    hiddenBias = GS->getHiddenBias();
+    lengths = GS->getLengths();
+  } else {
+    return false;
+  }
+
+  size_t steps = inputGates.dims()[0];
+  size_t batch = inputGates.dims()[1];
+  size_t gatesSize = inputGates.dims()[2];
+  size_t hidden = initH.dims()[1];
+  auto *lengthsVar = dyn_cast<Variable>(lengths.getNode());
+  assert(lengthsVar &&
+         lengthsVar->getVisibilityKind() == VisibilityKind::Private &&
+         "Only the sequences of constant lengths can be unrolled");
+  auto lengthsH = lengthsVar->getPayload().getHandle<int64_t>();
+
+  // Keeps the states of the batch entries that are past their length: the
+  // new state \p newS of the step \p t replaces \p S only where the mask is
+  // one.
+  auto maskState = [&](llvm::StringRef maskName, NodeValue S, NodeValue newS,
+                       size_t t) -> NodeValue {
+    auto *mask = getParent()->createVariable(
+        ElemKind::FloatTy, {batch, hidden}, maskName, VisibilityKind::Private,
+        /* isTrainable */ false);
+    auto maskH = mask->getPayload().getHandle<float>();
+    for (size_t n = 0; n < batch; n++) {
+      for (size_t j = 0; j < hidden; j++) {
+        maskH.at({n, j}) = size_t(lengthsH.at({n})) > t ? 1 : 0;
+      }
+    }
+    return createAdd(maskName.str() + ".add", S,
+                     createMul(maskName.str() + ".mul", mask,
+                               createSub(maskName.str() + ".sub", newS, S)));
+  };
+
+  NodeValue H = initH;
+  NodeValue C = initC;
+  std::vector<NodeValue> states;
+  for (size_t t = 0; t < steps; t++) {
+    auto stepName = name + "." + std::to_string(t);
+    size_t numActive = 0;
+    for (size_t n = 0; n < batch; n++) {
+      numActive += size_t(lengthsH.at({n})) > t;
+    }
+    // The steps past the longest sequence repeat the last states.
+    if (numActive == 0) {
+      states.push_back(states.empty()
+                           ? NodeValue(createReshape(stepName + ".h", initH,
+                                                     {1, batch, hidden}))
+                           : states.back());
+      continue;
+    }
+    NodeValue prevH = H;
+    NodeValue prevC = C;
+    auto *slice = createSlice(stepName + ".input_gates", inputGates, {t, 0, 0},
+                              {t + 1, batch, gatesSize});
+    NodeValue stepInputGates =
+        createReshape(stepName + ".input_gates", slice, {batch, gatesSize});
+    NodeValue stepHiddenGates =
+        createGates(stepName + ".hidden_gates", H, hiddenWeights, hiddenBias);
+    if (isa<RNNSequenceNode>(N)) {
+      H = createTanh(stepName,
+                     createAdd(stepName + ".add", stepInputGates,
+                               stepHiddenGates));
+    } else if (isa<LSTMSequenceNode>(N)) {
+      auto *LU = createLSTMUnit(stepName, stepInputGates, stepHiddenGates, C);
+      H = LU->getNewH();
+      C = LU->getNewC();
+    } else {
+      H = createGRUUnit(stepName, stepInputGates, stepHiddenGates, H);
+    }
+    if (numActive < batch) {
+      H = maskState(stepName + ".mask.h", prevH, H, t);
+      if (C.getNode()) {
+        C = maskState(stepName + ".mask.c", prevC, C, t);
+      }
+    }
+    states.push_back(createReshape(stepName + ".h", H, {1, batch, hidden}));
+  }
+  auto *result = createConcat(name + ".h", states, 0);
+  N->getNthResult(0).replaceAllUsesOfWith(result);
+  return true;
+}
+
+unsigned Function::expandRecurrentCells(
+    const std::function<bool(const Node *)> &shouldExpand, bool keepExpanded) {
+  unsigned numExpanded = 0;
+  for (bool units : {false, true}) {
+    std::vector<Node *> expanded;
+    for (auto &N : getNodes()) {
+      bool isUnit = isa<LSTMUnitNode>(&N) || isa<GRUUnitNode>(&N);
+      bool isCell = isa<LSTMCellNode>(&N) || isa<GRUCellNode>(&N);
+      if ((units ? isUnit : isCell) && shouldExpand(&N)) {
+        expanded.push_back(&N);
+      }
+    }
+    for (auto *N : expanded) {
+      expandRecurrentNode(N);
+      if (!keepExpanded) {
+        eraseNode(N);
+      }
+    }
+    numExpanded += expanded.size();
+  }
+  return numExpanded;
+}
+
 GatherNode *Function::createGather(llvm::StringRef name, NodeValue data,
                                    NodeValue indices, unsigned_t batchDims) {
 
@@ -1443,11 +1931,25 @@ ScatterAssignNode *Function::createScatterAssign(llvm::StringRef name,
   return addNode(new ScatterAssignNode(name, data, indices, slices));
 }
 
+ConvertToNode *Function::createConvertTo(llvm::StringRef name,
+                                         NodeValue input, ElemKind k) {
+  assert((input.getElementType() == ElemKind::FloatTy ||
+          input.getElementType() == ElemKind::Float16Ty ||
+          input.getElementType() == ElemKind::BFloat16Ty) &&
+         "Input must be a floating point type");
+  assert((k == ElemKind::FloatTy || k == ElemKind::Float16Ty ||
+          k == ElemKind::BFloat16Ty) &&
+         "Output must be a floating point type");
+  TypeRef outTy = getParent()->uniqueType(Type(k, input.dims()));
+  return addNode(new ConvertToNode(name, outTy, input));
+}
+
 QuantizeNode *Function::createQuantize(llvm::StringRef name, NodeValue input,
                                        TypeRef outTy) {
   assert(input.getElementType() == ElemKind::FloatTy &&
          "Input must be a floating type");
-  assert(outTy->getElementType() == ElemKind::Int8QTy &&
+  assert((outTy->getElementType() == ElemKind::Int8QTy ||
+          outTy->getElementType() == ElemKind::Int16QTy) &&
          "Output must be a quantized type");
   assert(input.dims().equals(outTy->dims()) &&
          "Different dimensions for input and output");
@@ -1458,7 +1960,8 @@ QuantizeNode *Function::createQuantize(llvm::StringRef name, NodeValue input,
 
 DequantizeNode *Function::createDequantize(llvm::StringRef name,
                                            NodeValue input) {
-  assert(input.getElementType() == ElemKind::Int8QTy &&
+  assert((input.getElementType() == ElemKind::Int8QTy ||
+          input.getElementType() == ElemKind::Int16QTy) &&
          "Input must be a quantized type");
   TypeRef outTy =
       getParent()->uniqueType(Type(ElemKind::FloatTy, input.dims()));
@@ -1468,9 +1971,11 @@ DequantizeNode *Function::createDequantize(llvm::StringRef name,
 RescaleQuantizedNode *Function::createRescaleQuantized(llvm::StringRef name,
                                                        NodeValue input,
                                                        TypeRef outTy) {
-  assert(input.getElementType() == ElemKind::Int8QTy &&
+  assert((input.getElementType() == ElemKind::Int8QTy ||
+          input.getElementType() == ElemKind::Int16QTy) &&
          "Input must be a quantized type");
-  assert(outTy->getElementType() == ElemKind::Int8QTy &&
+  assert((outTy->getElementType() == ElemKind::Int8QTy ||
+          outTy->getElementType() == ElemKind::Int16QTy) &&
          "Output must be a quantized type");
   assert(input.dims().equals(outTy->dims()) &&
          "Different dimensions for input and output");
@@ -1515,14 +2020,54 @@ Node *Function::createWeightedSum(llvm::StringRef name,
   return currAdd;
 }
 
+/// \returns the contributions {T, B, G} of the \p inputs of the T time steps
+/// to the G gates of a recurrent layer. A single fully connected layer with
+/// \p weights and \p bias computes them for all the time steps.
+static NodeValue createSequenceInputGates(Function *F, llvm::StringRef name,
+                                          llvm::ArrayRef<Node *> inputs,
+                                          Variable *weights, Variable *bias) {
+  size_t steps = inputs.size();
+  size_t batch = inputs.front()->dims(0)[0];
+  size_t inputSize = flattenCdr(inputs.front()->dims(0)).second;
+  size_t gatesSize = bias->dims()[0];
+  std::vector<NodeValue> stepInputs;
+  for (auto *input : inputs) {
+    stepInputs.push_back(
+        F->createReshape(name, input, {1, batch, inputSize}));
+  }
+  auto *sequence = F->createConcat(name, stepInputs, 0);
+  auto *flat = F->createReshape(name, sequence, {steps * batch, inputSize});
+  auto *gates = F->createFullyConnected(name, flat, weights, bias);
+  return F->createReshape(name, gates, {steps, batch, gatesSize});
+}
+
+/// Apply the output layer with \p weights and \p bias to the hidden states
+/// \p states {T, B, H} of a recurrent layer, and append the output of every
+/// time step to \p outputs.
+static void createSequenceOutputs(Function *F, llvm::StringRef name,
+                                  NodeValue states, Variable *weights,
+                                  Variable *bias,
+                                  std::vector<NodeValue> &outputs) {
+  size_t steps = states.dims()[0];
+  size_t batch = states.dims()[1];
+  size_t outputSize = bias->dims()[0];
+  auto *flat =
+      F->createReshape(name, states, {steps * batch, states.dims()[2]});
+  auto *O = F->createFullyConnected(name, flat, weights, bias);
+  for (size_t t = 0; t < steps; t++) {
+    outputs.push_back(F->createSlice(name.str() + "." + std::to_string(t),
+                                     O, {t * batch, 0},
+                                     {(t + 1) * batch, outputSize}));
+  }
+}
+
 void Function::createSimpleRNN(llvm::StringRef namePrefix,
                                llvm::ArrayRef<Node *> inputs,
                                unsigned batchSize, unsigned hiddenSize,
                                unsigned outputSize,
                                std::vector<NodeValue> &outputs) {
   std::string nameBase = namePrefix;
-  const unsigned timeSteps = inputs.size();
-  assert(timeSteps > 0 && "empty input");
+  assert(!inputs.empty() && "empty input");
   const unsigned inputSize = inputs.front()->dims(0).back();
   assert(inputSize > 0 && "input dimensionality is zero");
 
@@ -1561,22 +2106,23 @@ void Function::createSimpleRNN(llvm::StringRef namePrefix,
   Why->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
   Bhy->getPayload().init(glow::Tensor::InitKind::Broadcast, b, getPRNG());
 
-  // Un-roll backpropogation through time as a loop with the shared parameters.
-  for (unsigned t = 0; t < timeSteps; t++) {
-    auto fc1Name = nameBase + ".fc1." + std::to_string(t);
-    auto *FC1 = createFullyConnected(fc1Name, Ht, Whh, Bhh);
-    auto fc2Name = nameBase + ".fc2." + std::to_string(t);
-    auto *FC2 = createFullyConnected(fc2Name, inputs[t], Wxh, Bxh);
-    auto aName = nameBase + ".add." + std::to_string(t);
-    auto *A = createAdd(aName, FC1, FC2);
-    auto tanhName = nameBase + ".tanh." + std::to_string(t);
-    auto *H = createTanh(tanhName, A);
-    auto outName = nameBase + ".out." + std::to_string(t);
-    auto *O = createFullyConnected(outName, H, Why, Bhy);
-    outputs.push_back(O);
-
-    Ht = H;
-  };
+  // The contributions of the inputs are computed for all the time steps at
+  // once, and a single node runs the recurrence over them.
+  auto inputGates =
+      createSequenceInputGates(this, nameBase + ".input_gates", inputs, Wxh,
+                               Bxh);
+  auto *states = createRNNSequence(nameBase + ".rnn", inputGates, Ht, Whh, Bhh);
+  createSequenceOutputs(this, nameBase + ".out", states, Why, Bhy, outputs);
+}
+
+/// Initialize the \p bias of a recurrent cell, which holds the biases of all
+/// the gates, with the bias \p gateBiases[i] for the gate number i.
+static void initGateBiases(Tensor &bias, llvm::ArrayRef<float> gateBiases) {
+  auto H = bias.getHandle();
+  size_t gateSize = H.size() / gateBiases.size();
+  for (size_t i = 0, e = H.size(); i < e; i++) {
+    H.raw(i) = gateBiases[i / gateSize];
+  }
 }
 
 void Function::createGRU(llvm::StringRef namePrefix,
@@ -1584,8 +2130,7 @@ void Function::createGRU(llvm::StringRef namePrefix,
                          unsigned hiddenSize, unsigned outputSize,
                          std::vector<NodeValue> &outputs) {
   std::string nameBase = namePrefix;
-  const unsigned timeSteps = inputs.size();
-  assert(timeSteps > 0 && "empty input");
+  assert(!inputs.empty() && "empty input");
   const unsigned inputSize = inputs.front()->dims(0).back();
   assert(inputSize > 0 && "input dimensionality is zero");
 
@@ -1597,72 +2142,37 @@ void Function::createGRU(llvm::StringRef namePrefix,
   HInit->getPayload().zero();
   Node *Ht = HInit;
 
-  // Update gate:
-  //    Z <- sigmoid(Wxz * x + Whz * h + bz)
   // Reset gate:
-  //    R <- sigmoid(Wxr * x + Whr * h + br)
+  //    R <- sigmoid(Wxr * x + bxr + Whr * h + bhr)
+  // Update gate:
+  //    Z <- sigmoid(Wxz * x + bxz + Whz * h + bhz)
+  // New gate:
+  //    N <- tanh(Wxn * x + bxn + R . (Whn * h + bhn))
   // Hidden state:
-  //    h <- Z . h + (1 - Z) tanh (Wxh * x + Whh * (R . h) + bh)
-
-  // update gate
-  float bUpdate = 0.1;
-  auto *Wxz = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxz",
+  //    h <- Z . h + (1 - Z) . N
+  // The weights of the three gates are stored side by side, so that a single
+  // matrix multiplication computes all the gates.
+  const unsigned gatesSize = 3 * hiddenSize;
+  auto *Wx = getParent()->createVariable(
+      ElemKind::FloatTy, {inputSize, gatesSize}, nameBase + ".Wx",
       VisibilityKind::Private, true);
-  auto *Whz = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whz",
+  auto *Wh = getParent()->createVariable(
+      ElemKind::FloatTy, {hiddenSize, gatesSize}, nameBase + ".Wh",
       VisibilityKind::Private, true);
-  auto *Bz1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bz1",
-                                          VisibilityKind::Private, true);
-  auto *Bz2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bz2",
-                                          VisibilityKind::Private, true);
-
-  Wxz->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Whz->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Bz1->getPayload().init(glow::Tensor::InitKind::Broadcast, bUpdate, getPRNG());
-  Bz2->getPayload().init(glow::Tensor::InitKind::Broadcast, bUpdate, getPRNG());
+  auto *Bx = getParent()->createVariable(ElemKind::FloatTy, {gatesSize},
+                                         nameBase + ".bx",
+                                         VisibilityKind::Private, true);
+  auto *Bh = getParent()->createVariable(ElemKind::FloatTy, {gatesSize},
+                                         nameBase + ".bh",
+                                         VisibilityKind::Private, true);
 
-  // Reset gate.
   float bReset = -1.0;
-  auto *Wxr = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxr",
-      VisibilityKind::Private, true);
-  auto *Whr = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whr",
-      VisibilityKind::Private, true);
-  auto *Br1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".br1",
-                                          VisibilityKind::Private, true);
-  auto *Br2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".br2",
-                                          VisibilityKind::Private, true);
-
-  Wxr->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Whr->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Br1->getPayload().init(glow::Tensor::InitKind::Broadcast, bReset, getPRNG());
-  Br2->getPayload().init(glow::Tensor::InitKind::Broadcast, bReset, getPRNG());
-
-  // hidden state
+  float bUpdate = 0.1;
   float b = 0.1;
-  auto *Wxh = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxh",
-      VisibilityKind::Private, true);
-  auto *Whh = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whh",
-      VisibilityKind::Private, true);
-  auto *Bh1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bh1",
-                                          VisibilityKind::Private, true);
-  auto *Bh2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bh2",
-                                          VisibilityKind::Private, true);
-
-  Wxh->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Whh->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Bh1->getPayload().init(glow::Tensor::InitKind::Broadcast, b, getPRNG());
-  Bh2->getPayload().init(glow::Tensor::InitKind::Broadcast, b, getPRNG());
+  Wx->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
+  Wh->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
+  initGateBiases(Bx->getPayload(), {bReset, bUpdate, b});
+  initGateBiases(Bh->getPayload(), {bReset, bUpdate, b});
 
   // Output Layer.
   auto *Why = getParent()->createVariable(
@@ -1675,60 +2185,10 @@ void Function::createGRU(llvm::StringRef namePrefix,
   Why->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
   By->getPayload().init(glow::Tensor::InitKind::Broadcast, b, getPRNG());
 
-  auto ty = getParent()->uniqueType(ElemKind::FloatTy, {batchSize, hiddenSize});
-  auto *Ones = createSplat(nameBase + ".ones", ty, 1.0);
-
-  std::vector<Node *> outputNodes;
-  for (unsigned t = 0; t < timeSteps; t++) {
-    auto fc1Name = nameBase + ".fc1." + std::to_string(t);
-    auto fc2Name = nameBase + ".fc2." + std::to_string(t);
-    auto add1Name = nameBase + ".add1." + std::to_string(t);
-    auto sigmoid1Name = nameBase + ".sigmoid1." + std::to_string(t);
-
-    auto *Zt = createSigmoid(
-        sigmoid1Name,
-        createAdd(add1Name, createFullyConnected(fc1Name, Ht, Whz, Bz1),
-                  createFullyConnected(fc2Name, inputs[t], Wxz, Bz2)));
-
-    auto fc3Name = nameBase + ".fc3." + std::to_string(t);
-    auto fc4Name = nameBase + ".fc4." + std::to_string(t);
-    auto add2Name = nameBase + ".add2." + std::to_string(t);
-    auto sigmoid2Name = nameBase + ".sigmoid2." + std::to_string(t);
-
-    auto *Rt = createSigmoid(
-        sigmoid2Name,
-        createAdd(add2Name, createFullyConnected(fc3Name, Ht, Whr, Br1),
-                  createFullyConnected(fc4Name, inputs[t], Wxr, Br2)));
-
-    auto zhtName = nameBase + ".zh." + std::to_string(t);
-    auto *ZHt = createMul(zhtName, Zt, Ht);
-
-    auto oneMinusZtName = nameBase + ".1-z." + std::to_string(t);
-    auto *OneMinusZt = createSub(oneMinusZtName, Ones, Zt);
-
-    auto rhtName = nameBase + ".rh." + std::to_string(t);
-    auto *RHt = createMul(rhtName, Rt, Ht);
-
-    auto fc5Name = nameBase + ".fc5." + std::to_string(t);
-    auto fc6Name = nameBase + ".fc6." + std::to_string(t);
-    auto add3Name = nameBase + ".add3." + std::to_string(t);
-    auto tanh1Name = nameBase + ".tanh1." + std::to_string(t);
-
-    auto *Ut = createTanh(
-        tanh1Name,
-        createAdd(add3Name, createFullyConnected(fc5Name, RHt, Whh, Bh1),
-                  createFullyConnected(fc6Name, inputs[t], Wxh, Bh2)));
-
-    auto oneMinusZtUtName = nameBase + "1.-zu." + std::to_string(t);
-    auto *OneMinusZtUt = createMul(oneMinusZtUtName, OneMinusZt, Ut);
-
-    auto htName = nameBase + ".H." + std::to_string(t);
-    Ht = createAdd(htName, ZHt, OneMinusZtUt);
-
-    auto outName = nameBase + ".out." + std::to_string(t);
-    auto *O = createFullyConnected(outName, Ht, Why, By);
-    outputs.push_back(O);
-  }
+  auto inputGates =
+      createSequenceInputGates(this, nameBase + ".input_gates", inputs, Wx, Bx);
+  auto *states = createGRUSequence(nameBase + ".gru", inputGates, Ht, Wh, Bh);
+  createSequenceOutputs(this, nameBase + ".out", states, Why, By, outputs);
 };
 
 void Function::createLSTM(llvm::StringRef namePrefix,
@@ -1736,8 +2196,7 @@ void Function::createLSTM(llvm::StringRef namePrefix,
                           unsigned hiddenSize, unsigned outputSize,
                           std::vector<NodeValue> &outputs) {
   std::string nameBase = namePrefix;
-  const unsigned timeSteps = inputs.size();
-  assert(timeSteps > 0 && "empty input");
+  assert(!inputs.empty() && "empty input");
   const unsigned inputSize = inputs.front()->dims(0).back();
   assert(inputSize > 0 && "input dimensionality is zero");
 
@@ -1746,104 +2205,50 @@ void Function::createLSTM(llvm::StringRef namePrefix,
       ElemKind::FloatTy, {batchSize, hiddenSize}, "initial_hidden_state",
       VisibilityKind::Public, false);
   HInit->getPayload().zero();
-  Node *Ht = HInit;
+  NodeValue Ht = HInit;
 
   auto *CInit = getParent()->createVariable(
       ElemKind::FloatTy, {batchSize, hiddenSize}, "initial_cell_state",
       VisibilityKind::Public, false);
   CInit->getPayload().zero();
-  Node *Ct = CInit;
+  NodeValue Ct = CInit;
 
-  // Forget gate:
-  //    F <- sigmoid(Wxf * x + Whf * h + bf)
   // Input gate:
   //    I <- sigmoid(Wxi * x + Whi * h + bi)
+  // Forget gate:
+  //    F <- sigmoid(Wxf * x + Whf * h + bf)
+  // Cell gate:
+  //    G <- tanh(Wxg * x + Whg * h + bg)
   // Output gate:
-  //    O <- sigmoid(Wxo * x + Who * h + bi)
+  //    O <- sigmoid(Wxo * x + Who * h + bo)
   // Cell state:
-  //    C <- F . C + I . tanh(Wxc  * x + Whc * h + bc)
+  //    C <- F . C + I . G
   // Hidden state:
   //    h <- O . tanh(C)
-
-  // forget gate
-  float bForget = 1.0;
-  auto *Wxf = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxf",
+  // The weights of the four gates are stored side by side, so that a single
+  // matrix multiplication computes all the gates.
+  const unsigned gatesSize = 4 * hiddenSize;
+  auto *Wx = getParent()->createVariable(
+      ElemKind::FloatTy, {inputSize, gatesSize}, nameBase + ".Wx",
       VisibilityKind::Private, true);
-  auto *Whf = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whf",
+  auto *Wh = getParent()->createVariable(
+      ElemKind::FloatTy, {hiddenSize, gatesSize}, nameBase + ".Wh",
       VisibilityKind::Private, true);
-  auto *Bf1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bf1",
-                                          VisibilityKind::Private, true);
-  auto *Bf2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bf2",
-                                          VisibilityKind::Private, true);
-
-  Wxf->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Whf->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Bf1->getPayload().init(glow::Tensor::InitKind::Broadcast, bForget, getPRNG());
-  Bf2->getPayload().init(glow::Tensor::InitKind::Broadcast, bForget, getPRNG());
+  auto *Bx = getParent()->createVariable(ElemKind::FloatTy, {gatesSize},
+                                         nameBase + ".bx",
+                                         VisibilityKind::Private, true);
+  auto *Bh = getParent()->createVariable(ElemKind::FloatTy, {gatesSize},
+                                         nameBase + ".bh",
+                                         VisibilityKind::Private, true);
 
-  // input gate
   float bInput = 0.1;
-  auto *Wxi = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxi",
-      VisibilityKind::Private, true);
-  auto *Whi = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whi",
-      VisibilityKind::Private, true);
-  auto *Bi1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bi1",
-                                          VisibilityKind::Private, true);
-  auto *Bi2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bi2",
-                                          VisibilityKind::Private, true);
-
-  Wxi->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Whi->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Bi1->getPayload().init(glow::Tensor::InitKind::Broadcast, bInput, getPRNG());
-  Bi2->getPayload().init(glow::Tensor::InitKind::Broadcast, bInput, getPRNG());
-
-  // output gate
-  float bOutput = 0.1;
-  auto *Wxo = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxo",
-      VisibilityKind::Private, true);
-  auto *Who = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Who",
-      VisibilityKind::Private, true);
-  auto *Bo1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bo1",
-                                          VisibilityKind::Private, true);
-  auto *Bo2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bo2",
-                                          VisibilityKind::Private, true);
-
-  Wxo->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Who->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Bo1->getPayload().init(glow::Tensor::InitKind::Broadcast, bOutput, getPRNG());
-  Bo2->getPayload().init(glow::Tensor::InitKind::Broadcast, bOutput, getPRNG());
-
-  // cell state
+  float bForget = 1.0;
   float bCell = 0.1;
-  auto *Wxc = getParent()->createVariable(
-      ElemKind::FloatTy, {inputSize, hiddenSize}, nameBase + ".Wxc",
-      VisibilityKind::Private, true);
-  auto *Whc = getParent()->createVariable(
-      ElemKind::FloatTy, {hiddenSize, hiddenSize}, nameBase + ".Whc",
-      VisibilityKind::Private, true);
-  auto *Bc1 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bc1",
-                                          VisibilityKind::Private, true);
-  auto *Bc2 = getParent()->createVariable(ElemKind::FloatTy, {hiddenSize},
-                                          nameBase + ".bc2",
-                                          VisibilityKind::Private, true);
-
-  Wxc->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
-  Whc->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
-  Bc1->getPayload().init(glow::Tensor::InitKind::Broadcast, bCell, getPRNG());
-  Bc2->getPayload().init(glow::Tensor::InitKind::Broadcast, bCell, getPRNG());
+  float bOutput = 0.1;
+  Wx->getPayload().init(glow::Tensor::InitKind::Xavier, inputSize, getPRNG());
+  Wh->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
+  initGateBiases(Bx->getPayload(), {bInput, bForget, bCell, bOutput});
+  initGateBiases(Bh->getPayload(), {bInput, bForget, bCell, bOutput});
 
   // output layer
   float b = 0.1;
@@ -1857,63 +2262,79 @@ void Function::createLSTM(llvm::StringRef namePrefix,
   Why->getPayload().init(glow::Tensor::InitKind::Xavier, hiddenSize, getPRNG());
   By->getPayload().init(glow::Tensor::InitKind::Broadcast, b, getPRNG());
 
-  std::vector<Node *> outputNodes;
-  for (unsigned t = 0; t < timeSteps; t++) {
-    auto fc1Name = nameBase + ".fc1." + std::to_string(t);
-    auto fc2Name = nameBase + ".fc2." + std::to_string(t);
-    auto add1Name = nameBase + ".add1." + std::to_string(t);
-    auto sigmoid1Name = nameBase + ".sigmoid1." + std::to_string(t);
-
-    auto *Ft = createSigmoid(
-        sigmoid1Name,
-        createAdd(add1Name, createFullyConnected(fc1Name, Ht, Whf, Bf1),
-                  createFullyConnected(fc2Name, inputs[t], Wxf, Bf2)));
-
-    auto fc3Name = nameBase + ".fc3." + std::to_string(t);
-    auto fc4Name = nameBase + ".fc4." + std::to_string(t);
-    auto add2Name = nameBase + ".add2." + std::to_string(t);
-    auto sigmoid2Name = nameBase + ".sigmoid2." + std::to_string(t);
-
-    auto *It = createSigmoid(
-        sigmoid2Name,
-        createAdd(add2Name, createFullyConnected(fc3Name, Ht, Whi, Bi1),
-                  createFullyConnected(fc4Name, inputs[t], Wxi, Bi2)));
-
-    auto fc5Name = nameBase + ".fc5." + std::to_string(t);
-    auto fc6Name = nameBase + ".fc6." + std::to_string(t);
-    auto add3Name = nameBase + ".add3." + std::to_string(t);
-    auto sigmoid3Name = nameBase + ".sigmoid3." + std::to_string(t);
-
-    auto *Ot = createSigmoid(
-        sigmoid3Name,
-        createAdd(add3Name, createFullyConnected(fc5Name, Ht, Who, Bo1),
-                  createFullyConnected(fc6Name, inputs[t], Wxo, Bo2)));
-
-    auto fc7Name = nameBase + ".fc7." + std::to_string(t);
-    auto fc8Name = nameBase + ".fc8." + std::to_string(t);
-    auto add4Name = nameBase + ".add4." + std::to_string(t);
-    auto tanh1Name = nameBase + ".tanh1." + std::to_string(t);
-
-    auto *CRt = createTanh(
-        tanh1Name,
-        createAdd(add4Name, createFullyConnected(fc7Name, Ht, Whc, Bc1),
-                  createFullyConnected(fc8Name, inputs[t], Wxc, Bc2)));
-
-    auto mul1Name = nameBase + ".mul1." + std::to_string(t);
-    auto mul2Name = nameBase + ".mul2." + std::to_string(t);
-    Ct = createAdd(nameBase + ".C." + std::to_string(t),
-                   createMul(mul1Name, Ft, Ct), createMul(mul2Name, It, CRt));
-
-    auto htName = nameBase + ".H." + std::to_string(t);
-    auto tanh2Name = nameBase + ".tanh2." + std::to_string(t);
-    Ht = createMul(htName, Ot, createTanh(tanh2Name, Ct));
-
-    auto outName = nameBase + ".out." + std::to_string(t);
-    auto *O = createFullyConnected(outName, Ht, Why, By);
-    outputs.push_back(O);
-  }
+  auto inputGates =
+      createSequenceInputGates(this, nameBase + ".input_gates", inputs, Wx, Bx);
+  auto *states =
+      createLSTMSequence(nameBase + ".lstm", inputGates, Ht, Ct, Wh, Bh);
+  createSequenceOutputs(this, nameBase + ".out", states, Why, By, outputs);
 };
 
+/// \returns the variable of the recurrent layer with the prefix \p namePrefix
+/// whose name ends with \p suffix.
+static Variable *getRecurrentVariable(Module *M, llvm::StringRef namePrefix,
+                                      llvm::StringRef suffix) {
+  auto *V = M->getVariableByName(namePrefix.str() + suffix.str());
+  assert(V && "The recurrent layer does not exist");
+  return V;
+}
+
+NodeValue Function::createSimpleRNNStep(llvm::StringRef namePrefix,
+                                        NodeValue input, Variable *H) {
+  std::string nameBase = namePrefix;
+  auto *M = getParent();
+  size_t batch = input.dims()[0];
+  size_t hiddenSize = H->dims()[1];
+
+  // A sequence of a single step computes the recurrence of the layer.
+  auto *inputGates = createFullyConnected(
+      nameBase + ".step.input_gates", input,
+      getRecurrentVariable(M, nameBase, ".Wxh"),
+      getRecurrentVariable(M, nameBase, ".Bxh"));
+  auto *sequence = createRNNSequence(
+      nameBase + ".step.rnn",
+      createReshape(nameBase + ".step.input_gates", inputGates,
+                    {1, batch, hiddenSize}),
+      H, getRecurrentVariable(M, nameBase, ".Whh"),
+      getRecurrentVariable(M, nameBase, ".Bhh"));
+  NodeValue newH =
+      createReshape(nameBase + ".step.h", sequence, {batch, hiddenSize});
+  createSave(nameBase + ".step.save_h", newH, H);
+  return createFullyConnected(nameBase + ".step.out", newH,
+                              getRecurrentVariable(M, nameBase, ".Why"),
+                              getRecurrentVariable(M, nameBase, ".Bhy"));
+}
+
+NodeValue Function::createGRUStep(llvm::StringRef namePrefix, NodeValue input,
+                                  Variable *H) {
+  std::string nameBase = namePrefix;
+  auto *M = getParent();
+  auto *cell = createGRUCell(nameBase + ".step.gru", input, H,
+                             getRecurrentVariable(M, nameBase, ".Wx"),
+                             getRecurrentVariable(M, nameBase, ".bx"),
+                             getRecurrentVariable(M, nameBase, ".Wh"),
+                             getRecurrentVariable(M, nameBase, ".bh"));
+  createSave(nameBase + ".step.save_h", cell, H);
+  return createFullyConnected(nameBase + ".step.out", cell,
+                              getRecurrentVariable(M, nameBase, ".Why"),
+                              getRecurrentVariable(M, nameBase, ".by"));
+}
+
+NodeValue Function::createLSTMStep(llvm::StringRef namePrefix, NodeValue input,
+                                   Variable *H, Variable *C) {
+  std::string nameBase = namePrefix;
+  auto *M = getParent();
+  auto *cell = createLSTMCell(nameBase + ".step.lstm", input, H, C,
+                              getRecurrentVariable(M, nameBase, ".Wx"),
+                              getRecurrentVariable(M, nameBase, ".bx"),
+                              getRecurrentVariable(M, nameBase, ".Wh"),
+                              getRecurrentVariable(M, nameBase, ".bh"));
+  createSave(nameBase + ".step.save_h", cell->getNewH(), H);
+  createSave(nameBase + ".step.save_c", cell->getNewC(), C);
+  return createFullyConnected(nameBase + ".step.out", cell->getNewH(),
+                              getRecurrentVariable(M, nameBase, ".Why"),
+                              getRecurrentVariable(M, nameBase, ".by"));
+}
+
 //===----------------------------------------------------------------------===//
 //                   Graph dumping and printing
 //===----------------------------------------------------------------------===//
@@ -1925,6 +2346,133 @@ void Function::dump() const {
   }
 }
 
+Cost Function::getCost() const {
+  Cost cost;
+  for (auto &n : nodes_) {
+    cost += n.getCost();
+  }
+  return cost;
+}
+
+void Function::dumpCost(llvm::raw_ostream &os) const {
+  auto total = getCost();
+  os << "Cost of " << getName() << ":\n";
+  os << "           flops        bytes read     bytes written  flops/byte  "
+        "node\n";
+  for (auto &n : nodes_) {
+    auto cost = n.getCost();
+    if (!cost.flops) {
+      continue;
+    }
+    os << llvm::format("%16llu  %16llu  %16llu  %10.2f  ",
+                       (unsigned long long)cost.flops,
+                       (unsigned long long)cost.bytesRead,
+                       (unsigned long long)cost.bytesWritten,
+                       cost.getArithmeticIntensity())
+       << n.getKindName() << " " << n.getName() << "\n";
+  }
+  os << llvm::format("%16llu  %16llu  %16llu  %10.2f  ",
+                     (unsigned long long)total.flops,
+                     (unsigned long long)total.bytesRead,
+                     (unsigned long long)total.bytesWritten,
+                     total.getArithmeticIntensity())
+     << "total\n";
+}
+
+MemoryUsage Function::estimateMemoryUsage() const {
+  MemoryUsage usage;
+
+  // The variables that the function saves to are mutable, and the other ones
+  // that it reads are constant.
+  std::unordered_set<const Variable *> mutableVars;
+  for (auto &n : nodes_) {
+    if (auto *SN = llvm::dyn_cast<SaveNode>(&n)) {
+      if (auto *V = llvm::dyn_cast<Variable>(SN->getOutput().getNode())) {
+        mutableVars.insert(V);
+      }
+    }
+  }
+  std::unordered_set<const Variable *> usedVars;
+  for (auto &n : nodes_) {
+    for (unsigned i = 0, e = n.getNumInputs(); i < e; i++) {
+      auto *V = llvm::dyn_cast<Variable>(n.getNthInput(i).getNode());
+      if (V && usedVars.insert(V).second) {
+        auto size = V->getType()->getSizeInBytes();
+        if (mutableVars.count(V)) {
+          usage.mutableWeights += size;
+        } else {
+          usage.constantWeights += size;
+        }
+      }
+    }
+  }
+
+  // Order the nodes depth first, so that the inputs of every node come before
+  // it, starting from the nodes whose results are not used in the function.
+  std::vector<const Node *> schedule;
+  std::unordered_set<const Node *> scheduled;
+  std::vector<std::pair<const Node *, unsigned>> stack;
+  for (auto &root : nodes_) {
+    if (root.hasUsers() && !llvm::isa<SaveNode>(&root)) {
+      continue;
+    }
+    stack.emplace_back(&root, 0);
+    while (!stack.empty()) {
+      auto &top = stack.back();
+      const Node *N = top.first;
+      if (top.second < N->getNumInputs()) {
+        const Node *input = N->getNthInput(top.second++).getNode();
+        if (!llvm::isa<Storage>(input) && !scheduled.count(input)) {
+          stack.emplace_back(input, 0);
+        }
+        continue;
+      }
+      stack.pop_back();
+      if (scheduled.insert(N).second) {
+        schedule.push_back(N);
+      }
+    }
+  }
+
+  // The results of a node are alive from the node to the last one that uses
+  // them.
+  std::unordered_map<const Node *, size_t> lastUse;
+  for (size_t i = 0, e = schedule.size(); i < e; i++) {
+    for (unsigned j = 0, ne = schedule[i]->getNumInputs(); j < ne; j++) {
+      lastUse[schedule[i]->getNthInput(j).getNode()] = i;
+    }
+  }
+  std::vector<std::vector<const Node *>> freedAfter(schedule.size());
+  for (auto &use : lastUse) {
+    if (scheduled.count(use.first)) {
+      freedAfter[use.second].push_back(use.first);
+    }
+  }
+  auto resultsSize = [](const Node *N) {
+    uint64_t size = 0;
+    // A save writes to its variable, which is counted with the weights.
+    if (!llvm::isa<SaveNode>(N)) {
+      for (unsigned i = 0, e = N->getNumResults(); i < e; i++) {
+        size += N->getType(i)->getSizeInBytes();
+      }
+    }
+    return size;
+  };
+  uint64_t live = 0;
+  for (size_t i = 0, e = schedule.size(); i < e; i++) {
+    live += resultsSize(schedule[i]);
+    usage.activations = std::max(usage.activations, live);
+    if (!lastUse.count(schedule[i])) {
+      // The results that are not used are dead right away.
+      live -= resultsSize(schedule[i]);
+    }
+    for (const Node *N : freedAfter[i]) {
+      live -= resultsSize(N);
+    }
+  }
+  return usage;
+}
+
 /// We can't use NodeWalker here, because it ignores result indices, which
 /// are critical in generating detailed debug output.
 class FunctionDottyPrinter : public AbstractDottyPrinter {
@@ -2014,6 +2562,7 @@ Node *Function::getNodeByName(llvm::StringRef name) {
 void Module::eraseVariable(VariablesList::iterator I) {
   if (I == vars_.end())
     return;
+  forgetDerivedVariable(*I);
   delete *I;
   vars_.erase(I);
 }
@@ -2028,6 +2577,208 @@ Variable *Module::getVariableByName(llvm::StringRef name) {
   return nullptr;
 }
 
+size_t Module::getSourceHash(llvm::ArrayRef<Tensor *> srcs) {
+  size_t hash = 0;
+  for (const auto *T : srcs) {
+    hash = llvm::hash_combine(hash, T->getContentHash());
+  }
+  return hash;
+}
+
+Variable *Module::getDerivedVariable(llvm::ArrayRef<Variable *> srcs,
+                                     TypeRef T, llvm::StringRef recipe,
+                                     DeriveFn derive) {
+  assert(!srcs.empty() && "A derived variable needs a source");
+  llvm::SmallVector<Tensor *, 4> payloads;
+  bool isTraining = false;
+  for (auto *src : srcs) {
+    assert(src->isPrivate() && "Only private variables can be transformed");
+    payloads.push_back(&src->getPayload());
+    isTraining |= src->isTraining();
+  }
+
+  // Training updates the payload of trainable variables, so their
+  // transformations are not shared.
+  size_t sourceHash = 0;
+  if (!isTraining) {
+    sourceHash = getSourceHash(payloads);
+    auto it = derivedFrom_.find(srcs[0]->getName());
+    if (it != derivedFrom_.end()) {
+      for (auto *D : it->second) {
+        if (D->var && D->isShared && D->type == T && D->recipe == recipe &&
+            D->sourceHash == sourceHash && D->sources.size() == srcs.size() &&
+            std::equal(srcs.begin(), srcs.end(), D->sources.begin(),
+                       [](const Variable *src, const std::string &name) {
+                         return src->getName() == name;
+                       })) {
+          return D->var;
+        }
+      }
+    }
+  }
+
+  auto *V = createVariable(T, srcs[0]->getName(), VisibilityKind::Private,
+                           isTraining);
+  bool derived = derive(payloads, V->getPayload());
+  (void)derived;
+  assert(derived && "Unable to derive the variable");
+  addDerivedVariable(srcs, V, recipe, std::move(derive));
+  derivationOf_[V]->sourceHash = sourceHash;
+  derivationOf_[V]->isShared = !isTraining;
+  return V;
+}
+
+void Module::addDerivedVariable(llvm::ArrayRef<Variable *> srcs, Variable *V,
+                                llvm::StringRef recipe, DeriveFn derive) {
+  assert(V->isPrivate() && "Only private variables can be derived");
+  derivations_.push_back({{}, {}, V->getType(), recipe, 0, false,
+                          V->getName(), V, std::move(derive)});
+  auto *D = &derivations_.back();
+  for (auto *src : srcs) {
+    D->sources.push_back(src->getName());
+    D->sourceTypes.push_back(src->getType());
+    derivationSources_[src->getName()] = src->getType();
+  }
+  derivedFrom_[D->sources[0]].push_back(D);
+  derivationOf_[V] = D;
+}
+
+bool Module::isDerivationOperand(const Variable *V) const {
+  return derivationOf_.count(V) || derivationSources_.count(V->getName());
+}
+
+void Module::forgetDerivedVariable(Variable *V) {
+  // The derivation is kept, as the variables derived from V may be updated
+  // again from the sources of V.
+  auto it = derivationOf_.find(V);
+  if (it != derivationOf_.end()) {
+    it->second->var = nullptr;
+    derivationOf_.erase(it);
+  }
+}
+
+bool Module::isPayloadReadOnly(const Variable *V) const {
+  const char *data = V->getPayload().getUnsafePtr();
+  for (const auto *region : readOnlyMappings_) {
+    if (data >= region->const_data() &&
+        data < region->const_data() + region->size()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Module::updateWeights(llvm::ArrayRef<llvm::StringRef> names,
+                           llvm::ArrayRef<Tensor *> values,
+                           std::vector<Variable *> *updated) {
+  assert(names.size() == values.size() &&
+         "The number of values does not match the number of names");
+  llvm::StringMap<Variable *> varsByName;
+  for (auto *V : vars_) {
+    varsByName[V->getName()] = V;
+  }
+
+  // The new payload of each variable, by name, including the derived ones,
+  // which are computed before anything is changed.
+  llvm::StringMap<Tensor *> newPayloads;
+  for (size_t i = 0, e = names.size(); i < e; i++) {
+    TypeRef T;
+    auto V = varsByName.find(names[i]);
+    if (V != varsByName.end()) {
+      if (!V->second->isPrivate() || derivationOf_.count(V->second)) {
+        return false;
+      }
+      T = V->second->getType();
+    } else {
+      auto src = derivationSources_.find(names[i]);
+      if (src == derivationSources_.end()) {
+        return false;
+      }
+      T = src->second;
+    }
+    if (!values[i]->getType().isEqual(*T)) {
+      return false;
+    }
+    newPayloads[names[i]] = values[i];
+  }
+
+  // Only the derivations whose variables are alive, or that others depend
+  // on, are replayed.
+  llvm::StringSet<> neededSources;
+  std::vector<DerivedVariable *> needed;
+  for (auto it = derivations_.rbegin(), e = derivations_.rend(); it != e;
+       ++it) {
+    if (!it->var && !neededSources.count(it->name)) {
+      continue;
+    }
+    for (const auto &src : it->sources) {
+      neededSources.insert(src);
+    }
+    needed.push_back(&*it);
+  }
+
+  std::list<Tensor> derivedPayloads;
+  std::vector<std::pair<DerivedVariable *, size_t>> sourceHashes;
+  for (auto it = needed.rbegin(), e = needed.rend(); it != e; ++it) {
+    DerivedVariable &D = **it;
+    bool isAffected = false;
+    for (const auto &src : D.sources) {
+      isAffected |= newPayloads.count(src) != 0;
+    }
+    if (!isAffected) {
+      continue;
+    }
+    if (!D.derive) {
+      return false;
+    }
+
+    llvm::SmallVector<Tensor *, 4> payloads;
+    for (const auto &src : D.sources) {
+      auto P = newPayloads.find(src);
+      if (P != newPayloads.end()) {
+        payloads.push_back(P->second);
+        continue;
+      }
+      auto V = varsByName.find(src);
+      if (V == varsByName.end()) {
+        return false;
+      }
+      payloads.push_back(&V->second->getPayload());
+    }
+    derivedPayloads.emplace_back(D.type);
+    if (!D.derive(payloads, derivedPayloads.back())) {
+      return false;
+    }
+    sourceHashes.push_back({&D, getSourceHash(payloads)});
+    newPayloads[D.name] = &derivedPayloads.back();
+  }
+
+  // The pages of a read-only mapping are shared with other processes, which
+  // keep using the old weights.
+  for (auto *V : vars_) {
+    if (newPayloads.count(V->getName()) && isPayloadReadOnly(V)) {
+      return false;
+    }
+  }
+
+  // Everything could be computed, so the payloads are replaced, in place.
+  for (auto *V : vars_) {
+    auto P = newPayloads.find(V->getName());
+    if (P == newPayloads.end()) {
+      continue;
+    }
+    V->getPayload().assign(P->second);
+    if (updated) {
+      updated->push_back(V);
+    }
+  }
+  // The derived variables are now the ones of the new sources.
+  for (auto &H : sourceHashes) {
+    H.first->sourceHash = H.second;
+  }
+  return true;
+}
+
 void Module::eraseVariable(Variable *N) {
   auto &vars = getVars();
   auto I = std::find(vars.begin(), vars.end(), N);
@@ -2038,34 +2789,33 @@ void Function::eraseNode(Node *N) {
   if (Variable *V = dyn_cast<Variable>(N)) {
     return getParent()->eraseVariable(V);
   }
-  auto I = std::find(nodes_.begin(), nodes_.end(), *N);
-  assert(I != nodes_.end() && "Could not find node to delete!");
-  eraseNode(I);
+  assert(N->getParent() == this && "Could not find node to delete!");
+  eraseNode(N->getIterator());
 }
 
-Function *Function::clone(llvm::StringRef newName,
-                          llvm::DenseMap<Node *, Node *> *map) {
-  Module *M = getParent();
-  auto *newF = M->createFunction(newName);
-
-  // Maps current nodes to new nodes.
-  llvm::DenseMap<Node *, Node *> currToNew;
+/// Append copies of the nodes of \p src to \p dest, and record the mapping
+/// between the old nodes and their copies in \p currToNew.
+static void cloneNodesInto(Function *src, Function *dest,
+                           llvm::DenseMap<Node *, Node *> &currToNew) {
+  ArenaScope arenaScope(&dest->getParent()->getArena());
+  currToNew.reserve(currToNew.size() + src->getNodes().size());
 
   // Clone all of the nodes in the function.
-  for (auto &N : getNodes()) {
+  llvm::SmallVector<Node *, 64> copies;
+  for (auto &N : src->getNodes()) {
     Node *copy = N.clone();
     // Record the copy relationship between the graphs.
     currToNew[&N] = copy;
-    newF->addNode(copy);
+    dest->addNode(copy);
+    copies.push_back(copy);
   }
 
-  // At this point we have a new invalid function that points into nodes in the
-  // original function. Here we update the links between the nodes in the new
-  // function.
-  for (auto &N : newF->getNodes()) {
+  // At this point the copies point into nodes in the original function. Here
+  // we update the links between the copies.
+  for (auto *N : copies) {
     // Fix each one of the inputs of this node.
-    for (unsigned inp = 0, e = N.getNumInputs(); inp < e; inp++) {
-      auto input = N.getNthInput(inp);
+    for (unsigned inp = 0, e = N->getNumInputs(); inp < e; inp++) {
+      auto input = N->getNthInput(inp);
 
       auto it = currToNew.find(input.getNode());
       if (it == currToNew.end()) {
@@ -2075,56 +2825,54 @@ Function *Function::clone(llvm::StringRef newName,
       }
 
       // Update the node with the edge to the current graph.
-      N.setNthInput(inp, NodeValue(it->second, input.getResNo()));
+      N->setNthInput(inp, NodeValue(it->second, input.getResNo()));
     }
   }
+}
 
-  // Record the node mapping into the external map.
-  if (map) {
-    assert(map->empty() && "The external map must be empty");
-    for (auto it : currToNew) {
-      map->insert(it);
-    }
-  }
+Function *Function::clone(llvm::StringRef newName,
+                          llvm::DenseMap<Node *, Node *> *map) {
+  auto *newF = getParent()->createFunction(newName);
+
+  // Maps current nodes to new nodes. The external map is filled directly.
+  llvm::DenseMap<Node *, Node *> localMap;
+  assert((!map || map->empty()) && "The external map must be empty");
+  cloneNodesInto(this, newF, map ? *map : localMap);
 
   assert(newF->getNodes().size() == getNodes().size() && "Invalid func size");
   return newF;
 }
 
+Function *Module::createEnsemble(llvm::StringRef name,
+                                 llvm::ArrayRef<Function *> members) {
+  auto *ensemble = createFunction(name);
+  for (auto *member : members) {
+    assert(member->getParent() == this &&
+           "The members must belong to the module");
+    llvm::DenseMap<Node *, Node *> currToNew;
+    cloneNodesInto(member, ensemble, currToNew);
+  }
+  return ensemble;
+}
+
+/// The uses of nodes by the nodes of a function, as (user, used node, result
+/// number) triples, collected from the use-lists of the used nodes.
+using NodeUseSet = std::set<std::tuple<const Node *, const Node *, unsigned>>;
+
 /// Verify the input \p idx of a node \p N. Check that the node \p N is in the
-/// use-list of the corresponding input node.
-static void verifyNodeInput(const Node &N, size_t idx) {
+/// use-list of the corresponding input node, given the set \p uses of the
+/// uses in the use-lists of all the inputs of the function.
+static void verifyNodeInput(const Node &N, size_t idx, const NodeUseSet &uses) {
   auto input = N.getNthInput(idx);
-  auto *refN = input.getNode();
   // Check that N is in the use-list of the input node and there is a proper
   // entry for it.
-  for (auto &U : refN->getUsers()) {
-    if (U.getUser() == &N && *U.get() == input) {
-      return;
-    }
+  if (uses.count(std::make_tuple(&N, input.getNode(), input.getResNo()))) {
+    return;
   }
   llvm_unreachable(
       "Any node referencing another node N be in the use-list of the node N");
 }
 
-/// \returns True if \p n is a storage node (variable or placeholder) of the
-/// function \p F.
-static bool isGraphStorageNode(Node *n, const Function *F) {
-  auto &vars = F->getParent()->getVars();
-  auto &placeholders = F->getParent()->getPlaceholders();
-
-  if (Variable *V = dyn_cast<Variable>(n)) {
-    return std::find(vars.begin(), vars.end(), V) != vars.end();
-  }
-
-  if (Placeholder *P = dyn_cast<Placeholder>(n)) {
-    return std::find(placeholders.begin(), placeholders.end(), P) !=
-           placeholders.end();
-  }
-
-  return false;
-}
-
 void Function::verify() const {
   std::unordered_map<std::string, const Node *> NameToNode;
 
@@ -2156,8 +2904,33 @@ void Function::verify() const {
     llvm_unreachable("Multiple nodes with the same name");
   }
 
-  const auto &vars = getParent()->getVars();
-  (void)vars;
+  // The lookups below use sets instead of scanning the lists of nodes, so
+  // that the verification of large graphs takes linear time. Every use-list
+  // is only scanned once, even if the node has many inputs that use it.
+  std::unordered_set<const Node *> graphNodes;
+  for (const auto &N : nodes_) {
+    graphNodes.insert(&N);
+  }
+  for (const auto *V : getParent()->getVars()) {
+    graphNodes.insert(V);
+  }
+  for (const auto *P : getParent()->getPlaceholders()) {
+    graphNodes.insert(P);
+  }
+  NodeUseSet uses;
+  std::unordered_set<const Node *> scannedUseLists;
+  for (const auto &N : nodes_) {
+    for (size_t idx = 0, e = N.getNumInputs(); idx < e; ++idx) {
+      const Node *input = N.getNthInput(idx).getNode();
+      if (!scannedUseLists.insert(input).second) {
+        continue;
+      }
+      for (const auto &U : input->getUsers()) {
+        uses.insert(std::make_tuple(U.getUser(), U.get()->getNode(),
+                                    U.get()->getResNo()));
+      }
+    }
+  }
 
   // Any node referenced by one of the graph nodes should be part of the Graph.
   for (const auto &N : nodes_) {
@@ -2165,12 +2938,8 @@ void Function::verify() const {
       auto &input = N.getNthInput(idx);
       (void)input;
       // Verify each input of N.
-      verifyNodeInput(N, idx);
-      bool foundNode =
-          std::find(nodes_.begin(), nodes_.end(), *input) != nodes_.end();
-      (void)foundNode;
-      (void)isGraphStorageNode;
-      assert((foundNode || isGraphStorageNode(input, this)) &&
+      verifyNodeInput(N, idx, uses);
+      assert(graphNodes.count(input.getNode()) &&
              "Every node referenced by one of the graph nodes should be part of"
              "the graph");
     }
@@ -17,6 +17,7 @@
 #include "glow/Base/Type.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Support/Arena.h"
 #include "glow/Support/Support.h"
 
 using namespace glow;
@@ -287,6 +288,29 @@ bool Node::hasSideEffects() const {
   }
 }
 
+uint64_t Node::getFlops() const {
+  switch (getKind()) {
+#define DEF_NODE(CLASS, NAME)                                                  \
+  case glow::Kinded::Kind::CLASS##Kind:                                        \
+    return static_cast<const CLASS *>(this)->getFlops();
+#include "glow/AutoGenNodes.def"
+  default:
+    llvm_unreachable("Unhandled node");
+  }
+}
+
+Cost Node::getCost() const {
+  Cost cost;
+  cost.flops = getFlops();
+  for (unsigned i = 0, e = getNumInputs(); i < e; i++) {
+    cost.bytesRead += getNthInput(i).getType()->getSizeInBytes();
+  }
+  for (unsigned i = 0, e = getNumResults(); i < e; i++) {
+    cost.bytesWritten += getType(i)->getSizeInBytes();
+  }
+  return cost;
+}
+
 // NOTE: This is used in conjunction with assuming the 1st input is LHS, and 2nd
 // input is RHS. If adding a new Arithmetic inst, ensure this is the case.
 bool Node::isArithmetic() const {
@@ -339,6 +363,41 @@ Node *Node::clone() const {
   }
 }
 
+namespace {
+/// The header that is allocated in front of every node.
+struct alignas(Arena::blockAlignment) NodeAllocHeader {
+  /// The arena that the node was allocated from, or nullptr for the heap.
+  Arena *arena;
+  /// The size of the allocation, header included.
+  size_t size;
+};
+} // namespace
+
+static_assert(alignof(Node) <= alignof(NodeAllocHeader),
+              "The header breaks the alignment of the nodes");
+
+void *Node::operator new(size_t size) {
+  Arena *arena = ArenaScope::getCurrent();
+  size += sizeof(NodeAllocHeader);
+  void *block = arena ? arena->allocate(size) : ::operator new(size);
+  auto *header = static_cast<NodeAllocHeader *>(block);
+  header->arena = arena;
+  header->size = size;
+  return header + 1;
+}
+
+void Node::operator delete(void *p) {
+  if (!p) {
+    return;
+  }
+  auto *header = static_cast<NodeAllocHeader *>(p) - 1;
+  if (header->arena) {
+    header->arena->deallocate(header, header->size);
+  } else {
+    ::operator delete(header);
+  }
+}
+
 void Node::destroyNode(Node *N) {
   switch (N->getKind()) {
 #define DEF_NODE(CLASS, NAME)                                                  \
@@ -77,6 +77,14 @@ bool Storage::hasSideEffects() const { return false; }
 
 Node *Storage::clone() const { llvm_unreachable("variables can't be cloned."); }
 
+void Storage::serialize(ModuleWriter &W) const {
+  llvm_unreachable("variables are serialized by the module.");
+}
+
+Node *Storage::deserialize(llvm::StringRef name, ModuleReader &R) {
+  llvm_unreachable("variables are deserialized by the module.");
+}
+
 //===----------------------------------------------------------------------===//
 //                     Debug description methods
 //===----------------------------------------------------------------------===//
@@ -127,6 +135,23 @@ static void checkType(NodeValue A, ElemKind expectedType) {
   assert(A.getElementType() == expectedType && "Invalid type");
 }
 
+/// Check that the type of \p A is one of the quantized types that values can
+/// be quantized to, i.e. Int8QTy or Int16QTy.
+static void checkQuantizedValueType(NodeValue A) {
+  assert((A.getElementType() == ElemKind::Int8QTy ||
+          A.getElementType() == ElemKind::Int16QTy) &&
+         "Invalid type");
+}
+
+/// Check that the type of \p A is one of the floating point types, i.e.
+/// FloatTy, Float16Ty or BFloat16Ty.
+static void checkFloatingPointType(NodeValue A) {
+  assert((A.getElementType() == ElemKind::FloatTy ||
+          A.getElementType() == ElemKind::Float16Ty ||
+          A.getElementType() == ElemKind::BFloat16Ty) &&
+         "Invalid type");
+}
+
 /// Check that the type of the first operand \p A matches the type of the second
 /// operand \p B but ignore the actual shape. Use only element type and
 /// quantization parameters in comparison.
@@ -252,6 +277,17 @@ static void verifyCrossEntropyLoss(NodeValue P, NodeValue CE,
   assert(P.dims()[0] == labels.dims()[0] && "Invalid shape");
 }
 
+static void verifySoftMaxCrossEntropyLoss(NodeValue logits, NodeValue labels,
+                                          NodeValue CE) {
+  assert(logits.dims().size() == 2 && "Logits must be 2D");
+  assert(labels.getElementType() == ElemKind::Int64ITy &&
+         "Labels must be int64");
+  assert(labels.getType()->size() == logits.dims()[0] &&
+         "There must be a label per row of the logits");
+  assert(CE.getElementType() == logits.getElementType());
+  assert(CE.getType()->size() == 1 && "The loss must be a scalar");
+}
+
 static void verifyLocalResponseNormalization(NodeValue src, NodeValue dest) {
   checkSameType(src, dest);
 }
@@ -283,6 +319,43 @@ void ConvolutionNode::verify() const {
                     Strides_, Pads_, Group_);
 }
 
+void ChannelwiseQuantizedConvolutionNode::verify() const {
+  NodeValue src = getInput();
+  NodeValue dest = getResult();
+  assert(src.getElementType() == ElemKind::Int8QTy &&
+         dest.getElementType() == ElemKind::Int8QTy &&
+         getFilter().getElementType() == ElemKind::Int8QTy &&
+         "Input, Filter and Result must be int8");
+  assert(getBias().getElementType() == ElemKind::Int32QTy &&
+         "Bias must be int32");
+  assert(getScales().getElementType() == ElemKind::FloatTy &&
+         getOffsets().getElementType() == ElemKind::Int32QTy &&
+         "Invalid channel quantization parameter types");
+
+  ShapeNHWC idim(src.getType()->dims());
+  ShapeNHWC odim(dest.getType()->dims());
+  ShapeHW kdim(getKernels());
+  assert(idim.c % Group_ == 0 && "channels number must be divisible by groups");
+
+  auto outSz =
+      calculateConvPoolOutputDims(idim.h, idim.w, getKernels(), getStrides(),
+                                  getPads());
+  (void)outSz;
+  assert(odim.n == idim.n && odim.h == outSz.first && odim.w == outSz.second &&
+         odim.c % Group_ == 0 && "Invalid output dimensions");
+
+  auto filterDims = {odim.c, kdim.height, kdim.width, idim.c / (size_t)Group_};
+  assert(getFilter().dims().equals(filterDims) && "Invalid filter dims");
+  (void)filterDims;
+
+  auto channelDims = {odim.c};
+  assert(getBias().dims().equals(channelDims) &&
+         getScales().dims().equals(channelDims) &&
+         getOffsets().dims().equals(channelDims) &&
+         "Invalid per-channel dims");
+  (void)channelDims;
+}
+
 /// Verify that types of an input and its gradient are the same.
 static void verifyInputAndGradInputTypes(NodeValue input, NodeValue gradInput) {
   assert(input.getType() == gradInput.getType() &&
@@ -350,7 +423,32 @@ void MatMulNode::verify() const {
   assert(rhs.getType()->getElementType() == elem);
 
   assert(LDims[0] == DDims[0] && "Invalid matrix dims");
-  assert(RDims[1] == DDims[1] && "Invalid matrix dims");
+  // A transposed RHS is stored as (B, Z) instead of (Z, B).
+  unsigned_t colDim = getTransposeRHS() ? 0 : 1;
+  (void)colDim;
+  assert(RDims[colDim] == DDims[1] && "Invalid matrix dims");
+  assert(RDims[1 - colDim] == LDims[1] && "Invalid matrix dims");
+}
+
+void BatchedMatMulNode::verify() const {
+  auto LDims = getLHS().dims();
+  auto RDims = getRHS().dims();
+  auto DDims = getResult().dims();
+  (void)LDims;
+  (void)RDims;
+  (void)DDims;
+  assert(LDims.size() == 3 && RDims.size() == 3 && DDims.size() == 3 &&
+         "Invalid batched matrix dims");
+  auto elem = getResult().getType()->getElementType();
+  (void)elem;
+  assert(getLHS().getType()->getElementType() == elem);
+  assert(getRHS().getType()->getElementType() == elem);
+
+  assert(LDims[0] == DDims[0] && RDims[0] == DDims[0] &&
+         "Invalid batch size");
+  assert(LDims[2] == RDims[1] && "Invalid matrix dims");
+  assert(LDims[1] == DDims[1] && "Invalid matrix dims");
+  assert(RDims[2] == DDims[2] && "Invalid matrix dims");
 }
 
 void SigmoidNode::verify() const { verifySigmoid(getInput(), getResult()); }
@@ -397,6 +495,19 @@ void CrossEntropyLossGradNode::verify() const {
                          getGradOfInputNamedLabels());
 }
 
+void SoftMaxCrossEntropyLossNode::verify() const {
+  verifySoftMaxCrossEntropyLoss(getLogits(), getLabels(), getResult());
+}
+
+void SoftMaxCrossEntropyLossGradNode::verify() const {
+  verifyInputAndGradInputTypes(getLogits(), getGradOfInputNamedLogits());
+  verifyInputAndGradInputTypes(getLabels(), getGradOfInputNamedLabels());
+  verifyOutputAndGradOutputTypes(getOriginalOutputForResult(),
+                                 getGradOfOriginalOutputNamedResult());
+  verifySoftMaxCrossEntropyLoss(getLogits(), getLabels(),
+                                getOriginalOutputForResult());
+}
+
 void ReshapeNode::verify() const {
   assert(getResult().getType()->size() == getInput().getType()->size() &&
          "Reshape into a different size");
@@ -435,6 +546,19 @@ void InsertTensorNode::verify() const {
   }
 }
 
+void BroadcastNode::verify() const {
+  auto dest = getResult().dims();
+  auto src = getInput().dims();
+  (void)dest;
+  (void)src;
+  assert(dest.size() == src.size() && "Invalid number of dimensions");
+  for (size_t i = 0, e = dest.size(); i < e; i++) {
+    assert((src[i] == dest[i] || src[i] == 1) && "Invalid broadcast dimension");
+  }
+  assert(getResult().getElementType() == getInput().getElementType() &&
+         "Broadcast must keep the element type");
+}
+
 void SliceNode::verify() const {
   auto dest = getResult();
   auto src = getInput();
@@ -545,9 +669,15 @@ void BatchedReduceAddNode::verify() const {
 }
 
 void SparseLengthsWeightedSumNode::verify() const {
-  assert(getResult().getElementType() == getData().getElementType() &&
+  // Half precision and bfloat16 tables are accumulated in float.
+  bool isHalfTable = (getData().getElementType() == ElemKind::Float16Ty ||
+                      getData().getElementType() == ElemKind::BFloat16Ty) &&
+                     getResult().getElementType() == ElemKind::FloatTy;
+  assert((isHalfTable ||
+          getResult().getElementType() == getData().getElementType()) &&
          "Mismatched element types");
-  assert(getWeights().getElementType() == getData().getElementType() &&
+  (void)isHalfTable;
+  assert(getWeights().getElementType() == getResult().getElementType() &&
          "Mismatched element types");
   assert(getIndices().getElementType() == ElemKind::Int64ITy &&
          "Indices must have index type");
@@ -560,11 +690,111 @@ void SparseLengthsWeightedSumNode::verify() const {
          "Weights and Indices must have the same size");
 }
 
+void RowwiseQuantizedSparseLengthsWeightedSumNode::verify() const {
+  assert(getResult().getElementType() == ElemKind::FloatTy &&
+         "The result must be float");
+  assert(getWeights().getElementType() == ElemKind::FloatTy &&
+         "The weights must be float");
+  assert(getData().getElementType() == ElemKind::Int8QTy &&
+         "The table must be an int8 tensor");
+  assert(getScales().getElementType() == ElemKind::FloatTy &&
+         "Scales must be float");
+  assert(getOffsets().getElementType() == ElemKind::Int32QTy &&
+         "Offsets must be int32");
+  assert(getIndices().getElementType() == ElemKind::Int64ITy &&
+         "Indices must have index type");
+  assert(getLengths().getElementType() == ElemKind::Int64ITy &&
+         "Lengths must have index type");
+  assert(getIndices().dims().size() == 1 && "Indices must be 1D vector");
+  assert(getLengths().dims().size() == 1 && "Lengths must be 1D vector");
+  assert(getWeights().dims().size() == 1 && "Weights must be 1D vector");
+  assert(getWeights().dims()[0] == getIndices().dims()[0] &&
+         "Weights and Indices must have the same size");
+  assert(getScales().dims().size() == 1 &&
+         getScales().dims()[0] == getData().dims()[0] &&
+         "There must be a scale for every row");
+  assert(getOffsets().dims() == getScales().dims() &&
+         "There must be an offset for every row");
+}
+
 void SGDNode::verify() const {
   assert(getGradient().getType() == getWeight().getType() &&
          "Invalid weight or gradient type");
 }
 
+void MomentumSGDNode::verify() const {
+  assert(getGradient().getType() == getWeight().getType() &&
+         "Invalid weight or gradient type");
+  assert(getGsum().getType() == getWeight().getType() &&
+         "Invalid gradient sum type");
+  assert(getMomentum() > 0 && "Expected a momentum");
+}
+
+void AdagradNode::verify() const {
+  assert(getGradient().getType() == getWeight().getType() &&
+         "Invalid weight or gradient type");
+  assert(getSumSq().getType() == getWeight().getType() &&
+         "Invalid sum of squares type");
+}
+
+void RMSPropNode::verify() const {
+  assert(getGradient().getType() == getWeight().getType() &&
+         "Invalid weight or gradient type");
+  assert(getMeanSq().getType() == getWeight().getType() &&
+         "Invalid mean square type");
+  assert(getDecay() >= 0 && getDecay() < 1 && "Invalid decay");
+}
+
+void AdamNode::verify() const {
+  assert(getGradient().getType() == getWeight().getType() &&
+         "Invalid weight or gradient type");
+  assert(getFirstMoment().getType() == getWeight().getType() &&
+         getSecondMoment().getType() == getWeight().getType() &&
+         "Invalid moment type");
+  assert(getStep().getElementType() == ElemKind::FloatTy &&
+         getStep().getType()->size() == 1 && "Invalid step type");
+  assert(getBeta1() >= 0 && getBeta1() < 1 && getBeta2() >= 0 &&
+         getBeta2() < 1 && "Invalid decay rates");
+}
+
+void SparseLengthsWeightedSumRowGradNode::verify() const {
+  assert(getWeights().dims().size() == 1 && "Weights must be 1D vector");
+  assert(getLengths().dims().size() == 1 && "Lengths must be 1D vector");
+  assert(getResult().dims()[0] == getWeights().dims()[0] &&
+         "There must be a row for every weight");
+  assert(getOutputGrad().dims()[0] == getLengths().dims()[0] &&
+         "There must be a segment for every length");
+  assert(getResult().dims().drop_front() ==
+             getOutputGrad().dims().drop_front() &&
+         "The rows and the segments must have the same shape");
+  assert(getResult().getElementType() == getOutputGrad().getElementType() &&
+         "Invalid gradient type");
+}
+
+/// Check that the rows \p indices of \p weight can be updated with the
+/// gradients \p gradient.
+static void checkSparseUpdate(NodeValue gradient, NodeValue weight,
+                              NodeValue indices) {
+  assert(indices.dims().size() == 1 &&
+         indices.getElementType() == ElemKind::Int64ITy &&
+         "Indices must be a 1D vector of int64");
+  assert(gradient.dims()[0] == indices.dims()[0] &&
+         "There must be a gradient row for every index");
+  assert(gradient.dims().drop_front() == weight.dims().drop_front() &&
+         gradient.getElementType() == weight.getElementType() &&
+         "Invalid weight or gradient type");
+}
+
+void SparseSGDNode::verify() const {
+  checkSparseUpdate(getGradient(), getWeight(), getIndices());
+}
+
+void SparseAdagradNode::verify() const {
+  checkSparseUpdate(getGradient(), getWeight(), getIndices());
+  assert(getSumSq().getType() == getWeight().getType() &&
+         "Invalid sum of squares type");
+}
+
 void QuantizationProfileNode::verify() const {
   // Make sure that input tensor is a floating point type.
   assert(getInput().getElementType() == ElemKind::FloatTy &&
@@ -590,7 +820,7 @@ void IntLookupTableNode::verify() const {
 
 void QuantizeNode::verify() const {
   // Dest must be quantized.
-  checkType(getResult(), ElemKind::Int8QTy);
+  checkQuantizedValueType(getResult());
   // Src must be float.
   checkType(getInput(), ElemKind::FloatTy);
   checkSameShape(getResult(), getInput());
@@ -600,15 +830,15 @@ void DequantizeNode::verify() const {
   // Dest must be float.
   checkType(getResult(), ElemKind::FloatTy);
   // Src must be quantized.
-  checkType(getInput(), ElemKind::Int8QTy);
+  checkQuantizedValueType(getInput());
   checkSameShape(getResult(), getInput());
 }
 
 void RescaleQuantizedNode::verify() const {
-  // Dest must be quantized.
-  checkType(getResult(), ElemKind::Int8QTy);
+  // Dest must be quantized. Src and Dest may use different integer widths.
+  checkQuantizedValueType(getResult());
   // Src must be quantized.
-  checkType(getInput(), ElemKind::Int8QTy);
+  checkQuantizedValueType(getInput());
   checkSameShape(getResult(), getInput());
 }
 
@@ -623,6 +853,107 @@ void TopKNode::verify() const {
   }
 }
 
+/// Verify the inputs of a recurrent cell with \p numGates gates: \p input is
+/// {B, X}, or is flattened to it like the input of a fully connected node, \p H
+/// is {B, H} and the weights and biases compute all the gates at once.
+static void verifyRecurrentCell(NodeValue input, NodeValue H,
+                                NodeValue inputWeights, NodeValue inputBias,
+                                NodeValue hiddenWeights, NodeValue hiddenBias,
+                                size_t numGates) {
+  assert(H.dims().size() == 2 && "Invalid hidden state dims");
+  assert(input.dims()[0] == H.dims()[0] && "Invalid batch size");
+  size_t gatesSize = numGates * H.dims()[1];
+  (void)gatesSize;
+  assert(inputWeights.dims().equals(
+             {flattenCdr(input.dims()).second, gatesSize}) &&
+         "Invalid input weights dims");
+  assert(hiddenWeights.dims().equals({H.dims()[1], gatesSize}) &&
+         "Invalid hidden weights dims");
+  assert(inputBias.dims().equals({gatesSize}) &&
+         hiddenBias.dims().equals({gatesSize}) && "Invalid bias dims");
+}
+
+/// Verify the gates of a recurrent unit with \p numGates gates that updates
+/// the state \p state.
+static void verifyRecurrentUnit(NodeValue inputGates, NodeValue hiddenGates,
+                                NodeValue state, size_t numGates) {
+  checkSameType(inputGates, hiddenGates);
+  assert(state.dims().size() == 2 && "Invalid state dims");
+  assert(inputGates.dims().equals({state.dims()[0],
+                                   numGates * state.dims()[1]}) &&
+         "Invalid gates dims");
+}
+
+void LSTMCellNode::verify() const {
+  verifyRecurrentCell(getInput(), getH(), getInputWeights(), getInputBias(),
+                      getHiddenWeights(), getHiddenBias(), 4);
+  checkSameType(getH(), getC());
+  checkSameType(getH(), getNewH());
+  checkSameType(getC(), getNewC());
+}
+
+void LSTMUnitNode::verify() const {
+  verifyRecurrentUnit(getInputGates(), getHiddenGates(), getC(), 4);
+  checkSameType(getC(), getNewH());
+  checkSameType(getC(), getNewC());
+}
+
+void GRUCellNode::verify() const {
+  verifyRecurrentCell(getInput(), getH(), getInputWeights(), getInputBias(),
+                      getHiddenWeights(), getHiddenBias(), 3);
+  checkSameType(getH(), getResult());
+}
+
+void GRUUnitNode::verify() const {
+  verifyRecurrentUnit(getInputGates(), getHiddenGates(), getH(), 3);
+  checkSameType(getH(), getResult());
+}
+
+/// Verify a recurrent layer with \p numGates gates that runs over the
+/// sequence of the contributions of the input \p inputGates {T, B, numGates *
+/// H}, from the hidden state \p initH {B, H}, into \p result {T, B, H}, for
+/// the \p lengths {B} of the batch entries.
+static void verifyRecurrentSequence(NodeValue inputGates, NodeValue initH,
+                                    NodeValue hiddenWeights,
+                                    NodeValue hiddenBias, NodeValue lengths,
+                                    NodeValue result, size_t numGates) {
+  assert(initH.dims().size() == 2 && "Invalid hidden state dims");
+  size_t batch = initH.dims()[0];
+  size_t hidden = initH.dims()[1];
+  size_t steps = result.dims()[0];
+  (void)batch;
+  (void)hidden;
+  (void)steps;
+  assert(result.dims().equals({steps, batch, hidden}) && "Invalid result dims");
+  assert(inputGates.dims().equals({steps, batch, numGates * hidden}) &&
+         "Invalid gates dims");
+  assert(hiddenWeights.dims().equals({hidden, numGates * hidden}) &&
+         "Invalid hidden weights dims");
+  assert(hiddenBias.dims().equals({numGates * hidden}) && "Invalid bias dims");
+  assert(lengths.dims().equals({batch}) &&
+         lengths.getElementType() == ElemKind::Int64ITy &&
+         "Invalid lengths");
+  assert(result.getElementType() == inputGates.getElementType() &&
+         result.getElementType() == initH.getElementType() &&
+         "Invalid element type");
+}
+
+void RNNSequenceNode::verify() const {
+  verifyRecurrentSequence(getInputGates(), getInitH(), getHiddenWeights(),
+                          getHiddenBias(), getLengths(), getResult(), 1);
+}
+
+void LSTMSequenceNode::verify() const {
+  verifyRecurrentSequence(getInputGates(), getInitH(), getHiddenWeights(),
+                          getHiddenBias(), getLengths(), getResult(), 4);
+  checkSameType(getInitH(), getInitC());
+}
+
+void GRUSequenceNode::verify() const {
+  verifyRecurrentSequence(getInputGates(), getInitH(), getHiddenWeights(),
+                          getHiddenBias(), getLengths(), getResult(), 3);
+}
+
 void GatherNode::verify() const {
   assert(getResult().getElementType() == getData().getElementType());
   assert(getIndices().getElementType() == ElemKind::Int64ITy);
@@ -637,6 +968,12 @@ void GatherNode::verify() const {
   }
 }
 
+void ConvertToNode::verify() const {
+  checkFloatingPointType(getInput());
+  checkFloatingPointType(getResult());
+  checkSameShape(getResult(), getInput());
+}
+
 void ScatterAssignNode::verify() const {
   const auto &slicesDims = getSlices().dims();
   const auto &dataDims = getData().dims();
@@ -662,7 +999,15 @@ void ScatterAssignNode::verify() const {
 
 void SaveNode::verify() const { checkSameType(getInput(), getOutput()); }
 
-void LogNode::verify() const { checkSameType(getInput(), getResult()); }
+void LogNode::verify() const {
+  if (getResult().getType()->isQuantizedType()) {
+    // The quantized log works on a table, so the output may be rescaled.
+    assert(getResult().getElementType() == getInput().getElementType());
+    checkSameShape(getInput(), getResult());
+  } else {
+    checkSameType(getInput(), getResult());
+  }
+}
 
 void SelectNode::verify() const {
   assert(getResult().getElementType() == getCond().getElementType());
@@ -705,6 +1050,51 @@ void FullyConnectedNode::verify() const {
   verifyFullyConnected(getInput(), getWeights(), getBias(), getResult());
 }
 
+/// Verify a fully connected layer with float \p input, \p bias and \p dest
+/// whose int8 \p weights have a row, a scale and an offset for every output
+/// column.
+static void verifyRowwiseQuantizedFullyConnected(NodeValue input,
+                                                 NodeValue weights,
+                                                 NodeValue scales,
+                                                 NodeValue offsets,
+                                                 NodeValue bias,
+                                                 NodeValue dest) {
+  auto wdims = weights.dims();
+  (void)wdims;
+  assert(input.getElementType() == ElemKind::FloatTy &&
+         bias.getElementType() == ElemKind::FloatTy &&
+         dest.getElementType() == ElemKind::FloatTy &&
+         "The input, the bias and the result must be float");
+  assert(weights.getElementType() == ElemKind::Int8QTy &&
+         "The weights must be an int8 tensor");
+  assert(scales.getElementType() == ElemKind::FloatTy &&
+         "Scales must be float");
+  assert(offsets.getElementType() == ElemKind::Int32QTy &&
+         "Offsets must be int32");
+  assert(wdims.size() == 2 && dest.dims().size() == 2 &&
+         "Invalid weights or result shape");
+  assert(input.dims()[0] == dest.dims()[0] &&
+         flattenCdr(input.dims()).second == wdims[1] &&
+         "Mismatch on expected source dimensions");
+  assert(bias.dims().size() == 1 && bias.dims()[0] == wdims[0] &&
+         dest.dims()[1] == wdims[0] &&
+         "Inconsistent bias/weights/dest sizes.");
+  assert(scales.dims().size() == 1 && scales.dims()[0] == wdims[0] &&
+         "There must be a scale for every row");
+  assert(offsets.dims() == scales.dims() &&
+         "There must be an offset for every row");
+}
+
+void RowwiseQuantizedFullyConnectedNode::verify() const {
+  verifyRowwiseQuantizedFullyConnected(getInput(), getWeights(), getScales(),
+                                       getOffsets(), getBias(), getResult());
+}
+
+void DynamicQuantizedFullyConnectedNode::verify() const {
+  verifyRowwiseQuantizedFullyConnected(getInput(), getWeights(), getScales(),
+                                       getOffsets(), getBias(), getResult());
+}
+
 void FullyConnectedGradNode::verify() const {
   verifyInputAndGradInputTypes(getBias(), getGradOfInputNamedBias());
   verifyInputAndGradInputTypes(getInput(), getGradOfInputNamedInput());
@@ -716,6 +1106,17 @@ void FullyConnectedGradNode::verify() const {
                        getGradOfOriginalOutputNamedResult());
 }
 
+void SumNode::verify() const {
+  auto inputs = getInputs();
+  (void)inputs;
+  assert(!inputs.empty() && "Empty sum?!");
+  for (const auto &in : inputs) {
+    (void)in;
+    assert(in.getType() == getResult().getType() &&
+           "All of the inputs must have the type of the result");
+  }
+}
+
 void ConcatNode::verify() const {
   auto inputs = getInputs();
   auto dimension = getDim();
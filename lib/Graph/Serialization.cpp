@@ -0,0 +1,504 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Graph/Serialization.h"
+#include "glow/Graph/Utils.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/Support.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstring>
+
+using namespace glow;
+using llvm::isa;
+
+namespace {
+
+/// Identifies the files written by saveModule().
+constexpr char moduleMagic[8] = {'G', 'L', 'O', 'W', 'M', 'O', 'D', 'L'};
+
+/// The version of the format. It must be bumped whenever the layout of the
+/// file, the fields of a node or the numbering of the element kinds change.
+constexpr uint32_t moduleVersion = 2;
+
+/// The fixed-size header at the start of the file.
+struct ModuleFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  /// The size of the description, which follows the header.
+  uint64_t descriptionSize;
+  /// The offset of the payload section in the file.
+  uint64_t payloadsOffset;
+  /// The size of the payload section, which ends the file.
+  uint64_t payloadsSize;
+};
+
+} // namespace
+
+//===----------------------------------------------------------------------===//
+//                              ModuleWriter
+//===----------------------------------------------------------------------===//
+
+void ModuleWriter::writeBytes(const void *data, size_t size) {
+  buffer_.append(reinterpret_cast<const char *>(data), size);
+}
+
+void ModuleWriter::write(uint64_t v) { writeBytes(&v, sizeof(v)); }
+
+void ModuleWriter::write(unsigned_t v) { writeBytes(&v, sizeof(v)); }
+
+void ModuleWriter::write(float v) { writeBytes(&v, sizeof(v)); }
+
+void ModuleWriter::write(bool v) { write(unsigned_t(v)); }
+
+void ModuleWriter::write(llvm::StringRef v) {
+  write(uint64_t(v.size()));
+  writeBytes(v.data(), v.size());
+}
+
+void ModuleWriter::write(TypeRef v) {
+  write(unsigned_t(v->getElementType()));
+  write(v->dims());
+  bool isQuantized = v->isQuantizedType();
+  write(isQuantized);
+  if (isQuantized) {
+    write(v->getScale());
+    int32_t offset = v->getOffset();
+    writeBytes(&offset, sizeof(offset));
+  }
+}
+
+void ModuleWriter::writeId(const Node *N) {
+  auto it = ids_.find(N);
+  assert(it != ids_.end() && "The node is written before its operands");
+  write(it->second);
+}
+
+void ModuleWriter::write(const NodeValue &v) {
+  writeId(v.getNode());
+  write(unsigned_t(v.getResNo()));
+}
+
+void ModuleWriter::write(llvm::ArrayRef<float> v) {
+  write(uint64_t(v.size()));
+  writeBytes(v.data(), v.size() * sizeof(float));
+}
+
+void ModuleWriter::write(llvm::ArrayRef<unsigned_t> v) {
+  write(uint64_t(v.size()));
+  writeBytes(v.data(), v.size() * sizeof(unsigned_t));
+}
+
+void ModuleWriter::write(llvm::ArrayRef<size_t> v) {
+  write(uint64_t(v.size()));
+  for (auto e : v) {
+    write(uint64_t(e));
+  }
+}
+
+void ModuleWriter::write(NodeValueArrayRef v) {
+  write(uint64_t(v.size()));
+  for (size_t i = 0, e = v.size(); i < e; i++) {
+    write(v[i]);
+  }
+}
+
+void ModuleWriter::writeStorage(const Storage *S, uint64_t offset) {
+  write(S->getName());
+  write(S->getType());
+  write(S->isTraining());
+  if (auto *V = llvm::dyn_cast<Variable>(S)) {
+    write(unsigned_t(V->getVisibilityKind()));
+    write(offset);
+  }
+  uint32_t id = ids_.size();
+  ids_[S] = id;
+}
+
+void ModuleWriter::writeNode(const Node *N) {
+  write(llvm::StringRef(N->getKindName()));
+  write(N->getName());
+  switch (N->getKind()) {
+#define DEF_NODE(CLASS, NAME)                                                  \
+  case glow::Kinded::Kind::CLASS##Kind:                                        \
+    static_cast<const CLASS *>(N)->serialize(*this);                           \
+    break;
+#include "glow/AutoGenNodes.def"
+  default:
+    llvm_unreachable("Unhandled node");
+  }
+
+  write(N->hasPredicate());
+  if (N->hasPredicate()) {
+    write(N->getPredicate());
+  }
+  write(N->isRecomputation());
+
+  uint32_t id = ids_.size();
+  ids_[N] = id;
+}
+
+void ModuleWriter::writeModule(Module &M,
+                               llvm::ArrayRef<uint64_t> payloadOffsets) {
+  assert(payloadOffsets.size() == M.getVars().size() &&
+         "Every variable needs a payload offset");
+  write(uint64_t(M.getVars().size()));
+  size_t varIdx = 0;
+  for (const auto *V : M.getVars()) {
+    writeStorage(V, payloadOffsets[varIdx++]);
+  }
+  write(uint64_t(M.getPlaceholders().size()));
+  for (const auto *P : M.getPlaceholders()) {
+    writeStorage(P, 0);
+  }
+
+  write(uint64_t(M.getFunctions().size()));
+  for (auto *F : M.getFunctions()) {
+    // The nodes are written in post order, so that the readers can create
+    // every node after the nodes it uses.
+    std::vector<const Node *> order;
+    GraphPostOrderVisitor visitor(*F);
+    for (const auto *N : visitor.getPostOrder()) {
+      if (!isa<Storage>(N)) {
+        order.push_back(N);
+      }
+    }
+    assert(order.size() == F->getNodes().size() &&
+           "Some nodes of the function are not reachable from its roots");
+
+    write(F->getName());
+    write(uint64_t(order.size()));
+    for (const auto *N : order) {
+      writeNode(N);
+    }
+
+    // The ids of the nodes are local to their function.
+    for (const auto *N : order) {
+      ids_.erase(N);
+    }
+  }
+}
+
+//===----------------------------------------------------------------------===//
+//                              ModuleReader
+//===----------------------------------------------------------------------===//
+
+void ModuleReader::readBytes(void *data, size_t size) {
+  GLOW_ASSERT(size_t(end_ - cur_) >= size &&
+              "The serialized module is truncated");
+  memcpy(data, cur_, size);
+  cur_ += size;
+}
+
+void ModuleReader::read(uint64_t &v) { readBytes(&v, sizeof(v)); }
+
+void ModuleReader::read(unsigned_t &v) { readBytes(&v, sizeof(v)); }
+
+void ModuleReader::read(float &v) { readBytes(&v, sizeof(v)); }
+
+void ModuleReader::read(bool &v) {
+  unsigned_t b;
+  read(b);
+  v = b;
+}
+
+void ModuleReader::read(std::string &v) {
+  uint64_t size;
+  read(size);
+  GLOW_ASSERT(uint64_t(end_ - cur_) >= size &&
+              "The serialized module is truncated");
+  v.assign(cur_, size);
+  cur_ += size;
+}
+
+void ModuleReader::read(TypeRef &v) {
+  unsigned_t elemKind;
+  std::vector<size_t> dims;
+  bool isQuantized;
+  read(elemKind);
+  read(dims);
+  read(isQuantized);
+  if (!isQuantized) {
+    v = M_.uniqueType(ElemKind(elemKind), dims);
+    return;
+  }
+  float scale;
+  int32_t offset;
+  read(scale);
+  readBytes(&offset, sizeof(offset));
+  v = M_.uniqueType(ElemKind(elemKind), dims, scale, offset);
+}
+
+Node *ModuleReader::readNodeRef() {
+  unsigned_t id;
+  read(id);
+  GLOW_ASSERT(id < nodes_.size() && "Invalid node id in serialized module");
+  return nodes_[id];
+}
+
+void ModuleReader::read(NodeValue &v) {
+  Node *N = readNodeRef();
+  unsigned_t resNo;
+  read(resNo);
+  GLOW_ASSERT(resNo < N->getNumResults() &&
+              "Invalid result number in serialized module");
+  v = N->getNthResult(resNo);
+}
+
+void ModuleReader::read(std::vector<float> &v) {
+  uint64_t size;
+  read(size);
+  v.resize(size);
+  readBytes(v.data(), size * sizeof(float));
+}
+
+void ModuleReader::read(std::vector<unsigned_t> &v) {
+  uint64_t size;
+  read(size);
+  v.resize(size);
+  readBytes(v.data(), size * sizeof(unsigned_t));
+}
+
+void ModuleReader::read(std::vector<size_t> &v) {
+  uint64_t size;
+  read(size);
+  v.clear();
+  for (uint64_t i = 0; i < size; i++) {
+    uint64_t e;
+    read(e);
+    v.push_back(e);
+  }
+}
+
+void ModuleReader::read(std::vector<NodeValue> &v) {
+  uint64_t size;
+  read(size);
+  v.resize(size);
+  for (auto &e : v) {
+    read(e);
+  }
+}
+
+void ModuleReader::readVariable() {
+  std::string name;
+  TypeRef type;
+  bool isTraining;
+  unsigned_t visibility;
+  uint64_t offset;
+  read(name);
+  read(type);
+  read(isTraining);
+  read(visibility);
+  read(offset);
+  GLOW_ASSERT(offset <= payloadsSize_ &&
+              type->getSizeInBytes() <= payloadsSize_ - offset &&
+              "The payload of a variable is out of the serialized module");
+  Tensor payload(payloads_ + offset, type);
+  if (copyPublicPayloads_ &&
+      VisibilityKind(visibility) == VisibilityKind::Public) {
+    payload = payload.clone();
+  }
+  auto *V = new Variable(name, type, VisibilityKind(visibility), isTraining,
+                         std::move(payload));
+  nodes_.push_back(M_.addVar(V));
+}
+
+void ModuleReader::readPlaceholder() {
+  std::string name;
+  TypeRef type;
+  bool isTraining;
+  read(name);
+  read(type);
+  read(isTraining);
+  nodes_.push_back(M_.createPlaceholder(type, name, isTraining));
+}
+
+void ModuleReader::readNode(Function *F) {
+  std::string kindName;
+  std::string name;
+  read(kindName);
+  read(name);
+
+  Node *N = nullptr;
+#define DEF_NODE(CLASS, NAME)                                                  \
+  if (!N && kindName == #NAME) {                                               \
+    N = CLASS::deserialize(name, *this);                                       \
+  }
+#include "glow/AutoGenNodes.def"
+  GLOW_ASSERT(N && "Unknown node kind in serialized module");
+
+  bool hasPredicate;
+  read(hasPredicate);
+  if (hasPredicate) {
+    NodeValue predicate;
+    read(predicate);
+    N->setPredicate(predicate);
+  }
+  bool isRecomputation;
+  read(isRecomputation);
+  N->setRecomputation(isRecomputation);
+
+  nodes_.push_back(F->addNode(N));
+}
+
+void ModuleReader::readModule() {
+  ArenaScope arenaScope(&M_.getArena());
+  uint64_t numVars;
+  read(numVars);
+  for (uint64_t i = 0; i < numVars; i++) {
+    readVariable();
+  }
+  uint64_t numPlaceholders;
+  read(numPlaceholders);
+  for (uint64_t i = 0; i < numPlaceholders; i++) {
+    readPlaceholder();
+  }
+
+  size_t numStorage = nodes_.size();
+  uint64_t numFunctions;
+  read(numFunctions);
+  for (uint64_t i = 0; i < numFunctions; i++) {
+    std::string name;
+    uint64_t numNodes;
+    read(name);
+    read(numNodes);
+    Function *F = M_.createFunction(name);
+    for (uint64_t j = 0; j < numNodes; j++) {
+      readNode(F);
+    }
+    nodes_.resize(numStorage);
+  }
+  GLOW_ASSERT(cur_ == end_ && "Trailing data in serialized module");
+}
+
+//===----------------------------------------------------------------------===//
+//                          Saving and loading
+//===----------------------------------------------------------------------===//
+
+bool glow::saveModule(Module &M, llvm::StringRef filename) {
+  // Lay out the payloads of the variables, each aligned for the tensors.
+  std::vector<uint64_t> payloadOffsets;
+  uint64_t payloadsSize = 0;
+  for (const auto *V : M.getVars()) {
+    payloadsSize = llvm::alignTo(payloadsSize, TensorAlignment);
+    payloadOffsets.push_back(payloadsSize);
+    payloadsSize += V->getPayload().getType().getSizeInBytes();
+  }
+
+  ModuleWriter writer;
+  writer.writeModule(M, payloadOffsets);
+  const std::string &description = writer.getBuffer();
+
+  ModuleFileHeader header;
+  memcpy(header.magic, moduleMagic, sizeof(moduleMagic));
+  header.version = moduleVersion;
+  header.reserved = 0;
+  header.descriptionSize = description.size();
+  header.payloadsOffset =
+      llvm::alignTo(sizeof(header) + description.size(), TensorAlignment);
+  header.payloadsSize = payloadsSize;
+
+  // Processes may be mapping the file while it is written, so the new module
+  // only replaces it once it is complete.
+  int fd;
+  llvm::SmallString<256> tmpPath;
+  if (llvm::sys::fs::createUniqueFile(filename + "-%%%%%%.tmp", fd, tmpPath)) {
+    return false;
+  }
+  llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  os << description;
+  uint64_t pos = sizeof(header) + description.size();
+  size_t varIdx = 0;
+  for (const auto *V : M.getVars()) {
+    uint64_t start = header.payloadsOffset + payloadOffsets[varIdx++];
+    for (; pos < start; pos++) {
+      os << '\0';
+    }
+    const Tensor &payload = V->getPayload();
+    size_t size = payload.getType().getSizeInBytes();
+    os.write(payload.getUnsafePtr(), size);
+    pos += size;
+  }
+  os.close();
+  if (os.has_error()) {
+    os.clear_error();
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  if (llvm::sys::fs::rename(tmpPath, filename)) {
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+bool glow::loadModule(llvm::StringRef filename, Module &M,
+                      ModuleMapping mapping) {
+  assert(M.getFunctions().empty() && M.getVars().empty() &&
+         M.getPlaceholders().empty() && "The module must be empty");
+  uint64_t fileSize;
+  if (llvm::sys::fs::file_size(filename, fileSize) ||
+      fileSize < sizeof(ModuleFileHeader)) {
+    return false;
+  }
+
+  // A copy-on-write mapping is private, so that the variables that are
+  // written, such as trained weights or saved outputs, do not modify the
+  // file. A read-only one shares its pages with the other processes.
+  bool isShared = mapping == ModuleMapping::SharedReadOnly;
+  int fd;
+  if (llvm::sys::fs::openFileForRead(filename, fd)) {
+    return false;
+  }
+  std::error_code EC;
+  auto region = llvm::make_unique<llvm::sys::fs::mapped_file_region>(
+      fd,
+      isShared ? llvm::sys::fs::mapped_file_region::readonly
+               : llvm::sys::fs::mapped_file_region::priv,
+      fileSize, 0, EC);
+  llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+  if (EC) {
+    return false;
+  }
+
+  // The payloads of the read-only mapping are only read, through the private
+  // variables.
+  char *data = const_cast<char *>(region->const_data());
+  ModuleFileHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, moduleMagic, sizeof(moduleMagic)) ||
+      header.version != moduleVersion ||
+      header.descriptionSize > fileSize - sizeof(header) ||
+      header.payloadsOffset > fileSize ||
+      header.payloadsSize > fileSize - header.payloadsOffset) {
+    return false;
+  }
+
+  const char *description = data + sizeof(header);
+  ModuleReader reader(M, description, description + header.descriptionSize,
+                      data + header.payloadsOffset, header.payloadsSize,
+                      isShared);
+  reader.readModule();
+  M.addMappedFile(std::move(region), isShared);
+  return true;
+}
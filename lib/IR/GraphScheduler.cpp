@@ -21,18 +21,163 @@
 #include "glow/Graph/Nodes.h"
 #include "glow/Graph/Utils.h"
 #include "glow/IR/IR.h"
+#include "glow/Support/Compiler.h"
 #include "glow/Support/Debug.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <limits>
+
 using namespace glow;
 
 using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
 
+/// Appends to \p inputs the nodes whose results are read by the node \p N.
+static void getDataInputs(Node *N, llvm::SmallVectorImpl<Node *> &inputs) {
+  for (int idx = 0, e = N->getNumInputs(); idx < e; ++idx) {
+    inputs.push_back(N->getNthInput(idx));
+  }
+
+  if (N->hasPredicate()) {
+    inputs.push_back(N->getPredicate());
+  }
+}
+
+/// Appends to \p deps the nodes that have to be scheduled before the node \p N
+/// of the function \p G.
+static void getScheduleDependencies(Function &G, Node *N,
+                                    llvm::SmallVectorImpl<Node *> &deps) {
+  getDataInputs(N, deps);
+
+  // SaveNode hack:
+  // We don't model memory dependencies, but we still need to honor them.
+  // Make sure the SaveNode happens after the last use of the output variable.
+  if (auto *save = dyn_cast<SaveNode>(N)) {
+    auto *destination = save->getOutput().getNode();
+    for (NodeUse &use : destination->getUsers()) {
+      Node *user = use.getUser();
+      if (user == save) {
+        continue;
+      }
+      // Variables may have users scattered across different functions.
+      // Only accounts for the ones in that function.
+      if (&G != user->getParent()) {
+        continue;
+      }
+      assert(!isa<SaveNode>(user) &&
+             "Variables must be saved at most once in each function");
+      deps.push_back(user);
+    }
+  }
+
+  // Likewise, the nodes that update storage in place, e.g. the sparse weight
+  // updates, happen after the other uses of the storage.
+  for (unsigned idx = 0, e = N->getNumInputs(); idx < e; ++idx) {
+    if (!N->isOverwrittenNthInput(idx)) {
+      continue;
+    }
+    auto *storage = dyn_cast<Storage>(N->getNthInput(idx).getNode());
+    if (!storage) {
+      continue;
+    }
+    for (NodeUse &use : storage->getUsers()) {
+      Node *user = use.getUser();
+      if (user == N || &G != user->getParent()) {
+        continue;
+      }
+      deps.push_back(user);
+    }
+  }
+}
+
+/// \returns the number of bytes required to hold the results of \p N.
+static int64_t getResultSize(const Node *N) {
+  // Storage nodes do not require memory allocations for their results.
+  if (isa<Storage>(N)) {
+    return 0;
+  }
+  int64_t resultSize = 0;
+  for (size_t idx = 0, e = N->getNumResults(); idx < e; ++idx) {
+    resultSize += N->getType(idx)->getSizeInBytes();
+  }
+  return resultSize;
+}
+
+/// \returns true if the instructions generated for \p N are data parallel.
+static bool isDataParallelNode(const Node *N) {
+  switch (N->getKind()) {
+  case Kinded::Kind::AddNodeKind:
+  case Kinded::Kind::SubNodeKind:
+  case Kinded::Kind::MulNodeKind:
+  case Kinded::Kind::DivNodeKind:
+  case Kinded::Kind::MaxNodeKind:
+  case Kinded::Kind::MinNodeKind:
+  case Kinded::Kind::CmpLTENodeKind:
+  case Kinded::Kind::CmpEQNodeKind:
+  case Kinded::Kind::PowNodeKind:
+  case Kinded::Kind::LogNodeKind:
+  case Kinded::Kind::SelectNodeKind:
+  case Kinded::Kind::SigmoidNodeKind:
+  case Kinded::Kind::TanhNodeKind:
+  case Kinded::Kind::SplatNodeKind:
+  case Kinded::Kind::IntLookupTableNodeKind:
+  case Kinded::Kind::SaveNodeKind:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// \returns the number of elements processed by the data parallel node \p N.
+static size_t getDataParallelSize(const Node *N) {
+  if (N->getNumResults()) {
+    return N->getType(0)->size();
+  }
+  return N->getNthInput(0).getType()->size();
+}
+
+int64_t glow::getSchedulePeakMemory(Function &G,
+                                    const NodesPtrList &Schedule) {
+  // Number of users of each node that have not been executed yet.
+  std::unordered_map<const Node *, size_t> remainingUsers;
+  llvm::SmallVector<Node *, 8> inputs;
+  for (auto &N : G.getNodes()) {
+    inputs.clear();
+    getDataInputs(&N, inputs);
+    for (auto *input : inputs) {
+      remainingUsers[input]++;
+    }
+  }
+
+  int64_t liveSize = 0;
+  int64_t peakSize = 0;
+  for (auto *N : Schedule) {
+    if (isa<Storage>(N)) {
+      continue;
+    }
+    // The inputs are alive while the result is computed.
+    liveSize += getResultSize(N);
+    peakSize = std::max(peakSize, liveSize);
+    inputs.clear();
+    getDataInputs(N, inputs);
+    for (auto *input : inputs) {
+      if (--remainingUsers[input] == 0) {
+        liveSize -= getResultSize(input);
+      }
+    }
+    if (remainingUsers[N] == 0) {
+      liveSize -= getResultSize(N);
+    }
+  }
+  return peakSize;
+}
+
 /// \returns true if a node \p N is scheduled already.
 bool ChildMemSizeBasedScheduler::isScheduled(const Node *N) const {
   return std::find(scheduled_.begin(), scheduled_.end(), N) != scheduled_.end();
@@ -93,34 +238,7 @@ void ChildMemSizeBasedScheduler::orderChildNodesAndSchedule(Node *N) {
     return;
   // A set of node's sorted children.
   llvm::SmallVector<Node *, 8> orderedChildren;
-  for (int idx = 0, e = N->getNumInputs(); idx < e; ++idx) {
-    orderedChildren.push_back(N->getNthInput(idx));
-  }
-
-  if (N->hasPredicate()) {
-    orderedChildren.push_back(N->getPredicate());
-  }
-
-  // SaveNode hack:
-  // We don't model memory dependencies, but we still need to honor them.
-  // Make sure the SaveNode happens after the last use of the output variable.
-  if (auto *save = dyn_cast<SaveNode>(N)) {
-    auto *destination = save->getOutput().getNode();
-    for (NodeUse &use : destination->getUsers()) {
-      Node *user = use.getUser();
-      if (user == save) {
-        continue;
-      }
-      // Variables may have users scattered across different functions.
-      // Only accounts for the ones in that function.
-      if (&G_ != user->getParent()) {
-        continue;
-      }
-      assert(!isa<SaveNode>(user) &&
-             "Variables must be saved at most once in each function");
-      orderedChildren.push_back(user);
-    }
-  }
+  getScheduleDependencies(G_, N, orderedChildren);
 
   // Order children by (maxSize - resultSize). It gives more
   // priority to the nodes that free more memory after
@@ -169,7 +287,268 @@ void ChildMemSizeBasedScheduler::schedule() {
   scheduleNodes();
 }
 
-void IRFunction::scheduleGraph(NodesPtrList &Schedule) {
+void MinPeakMemoryScheduler::scheduleWindow(std::vector<Node *> &order,
+                                            size_t begin, size_t end) {
+  size_t numNodes = end - begin;
+  if (numNodes < 2) {
+    return;
+  }
+  assert(numNodes <= windowSize && "The window is too large");
+  std::unordered_map<const Node *, size_t> windowIndex;
+  for (size_t i = 0; i < numNodes; ++i) {
+    windowIndex[order[begin + i]] = i;
+  }
+
+  // A value that is alive inside of the window. It is either the result of a
+  // node of the window or the result of an earlier node used by the window.
+  struct WindowValue {
+    /// Number of bytes of the value.
+    int64_t size;
+    /// The users of the value inside of the window.
+    unsigned users{0};
+    /// True if the value is used after the window.
+    bool usedLater{false};
+    /// The bit of the producer in the window or zero for earlier values.
+    unsigned producer{0};
+  };
+  std::vector<WindowValue> values;
+  std::unordered_map<const Node *, size_t> valueIndex;
+  auto getValue = [&](Node *N) -> WindowValue & {
+    auto it = valueIndex.find(N);
+    if (it != valueIndex.end()) {
+      return values[it->second];
+    }
+    valueIndex[N] = values.size();
+    values.push_back({getResultSize(N)});
+    return values.back();
+  };
+
+  // The window nodes that each window node depends on.
+  llvm::SmallVector<unsigned, windowSize> deps(numNodes, 0);
+  llvm::SmallVector<int64_t, windowSize> sizes(numNodes, 0);
+  llvm::SmallVector<Node *, 8> inputs;
+  for (size_t i = 0; i < numNodes; ++i) {
+    Node *N = order[begin + i];
+    sizes[i] = getResultSize(N);
+    getValue(N).producer = 1u << i;
+    inputs.clear();
+    getScheduleDependencies(G_, N, inputs);
+    for (auto *input : inputs) {
+      auto it = windowIndex.find(input);
+      if (it != windowIndex.end()) {
+        deps[i] |= 1u << it->second;
+      }
+    }
+    inputs.clear();
+    getDataInputs(N, inputs);
+    for (auto *input : inputs) {
+      if (!isa<Storage>(input)) {
+        getValue(input).users |= 1u << i;
+      }
+    }
+  }
+  // Find the window values that stay alive after the window.
+  for (size_t i = 0; i < numNodes; ++i) {
+    for (auto &use : order[begin + i]->getUsers()) {
+      auto *user = use.getUser();
+      if (user->getParent() == &G_ && !windowIndex.count(user)) {
+        getValue(order[begin + i]).usedLater = true;
+      }
+    }
+  }
+  for (auto &entry : valueIndex) {
+    auto &value = values[entry.second];
+    if (value.producer) {
+      continue;
+    }
+    // An earlier value is used later if it has users after the window.
+    for (auto &use : entry.first->getUsers()) {
+      auto *user = use.getUser();
+      if (user->getParent() == &G_ && !windowIndex.count(user) &&
+          position_[user] >= end) {
+        value.usedLater = true;
+      }
+    }
+  }
+
+  // \returns the number of bytes of the window values which are alive once
+  // the window nodes in \p scheduled are executed.
+  auto getLiveSize = [&](unsigned scheduled) {
+    int64_t liveSize = 0;
+    for (auto &value : values) {
+      bool isComputed = !value.producer || (value.producer & scheduled);
+      bool isUsed = value.usedLater || (value.users & ~scheduled);
+      if (isComputed && isUsed) {
+        liveSize += value.size;
+      }
+    }
+    return liveSize;
+  };
+
+  // peak[S] is the smallest peak memory usage of the orders of the subset S
+  // of the window nodes and last[S] is the last node of such an order.
+  unsigned fullSet = (1u << numNodes) - 1;
+  std::vector<int64_t> peak(fullSet + 1, std::numeric_limits<int64_t>::max());
+  std::vector<uint8_t> last(fullSet + 1, 0);
+  peak[0] = 0;
+  for (unsigned scheduled = 0; scheduled < fullSet; ++scheduled) {
+    if (peak[scheduled] == std::numeric_limits<int64_t>::max()) {
+      continue;
+    }
+    int64_t liveSize = getLiveSize(scheduled);
+    for (size_t i = 0; i < numNodes; ++i) {
+      unsigned bit = 1u << i;
+      if ((scheduled & bit) || (deps[i] & ~scheduled)) {
+        continue;
+      }
+      int64_t newPeak = std::max(peak[scheduled], liveSize + sizes[i]);
+      if (newPeak < peak[scheduled | bit]) {
+        peak[scheduled | bit] = newPeak;
+        last[scheduled | bit] = i;
+      }
+    }
+  }
+
+  // Rebuild the best order from its last node.
+  std::vector<Node *> window(order.begin() + begin, order.begin() + end);
+  size_t idx = end;
+  for (unsigned scheduled = fullSet; scheduled;) {
+    unsigned i = last[scheduled];
+    order[--idx] = window[i];
+    scheduled &= ~(1u << i);
+  }
+}
+
+void MinPeakMemoryScheduler::schedule() {
+  NodesPtrList base;
+  ChildMemSizeBasedScheduler baseScheduler(G_, base);
+  baseScheduler.schedule();
+
+  std::vector<Node *> order(base.begin(), base.end());
+  for (size_t i = 0, e = order.size(); i < e; ++i) {
+    position_[order[i]] = i;
+  }
+  // The windows do not overlap, thus the set of nodes executed before a
+  // window does not depend on the order inside of the other windows.
+  for (size_t begin = 0, e = order.size(); begin < e; begin += windowSize) {
+    scheduleWindow(order, begin, std::min(begin + windowSize, e));
+  }
+  scheduled_.insert(scheduled_.end(), order.begin(), order.end());
+}
+
+void ListScheduler::schedule() {
+  NodesPtrList base;
+  ChildMemSizeBasedScheduler baseScheduler(G_, base);
+  baseScheduler.schedule();
+
+  // Number of dependencies of each node which are not scheduled yet.
+  std::unordered_map<const Node *, size_t> numPendingDeps;
+  // The nodes that depend on each node.
+  std::unordered_map<const Node *, llvm::SmallVector<Node *, 4>> dependents;
+  std::vector<Node *> ready;
+  llvm::SmallVector<Node *, 8> deps;
+  size_t position = 0;
+  for (auto *N : base) {
+    basePosition_[N] = position++;
+    deps.clear();
+    getScheduleDependencies(G_, N, deps);
+    std::sort(deps.begin(), deps.end());
+    auto depsEnd = std::unique(deps.begin(), deps.end());
+    size_t numDeps = 0;
+    for (auto it = deps.begin(); it != depsEnd; ++it) {
+      if (isa<Storage>(*it)) {
+        continue;
+      }
+      dependents[*it].push_back(N);
+      numDeps++;
+    }
+    numPendingDeps[N] = numDeps;
+    if (!numDeps) {
+      ready.push_back(N);
+    }
+  }
+
+  const Node *last = nullptr;
+  while (!ready.empty()) {
+    // Pick the ready node with the highest priority. Prefer the earlier nodes
+    // of the base schedule among the nodes of the same priority.
+    size_t best = 0;
+    int64_t bestPriority = getPriority(ready[0], last);
+    for (size_t i = 1, e = ready.size(); i < e; ++i) {
+      int64_t priority = getPriority(ready[i], last);
+      if (priority > bestPriority ||
+          (priority == bestPriority &&
+           basePosition_[ready[i]] < basePosition_[ready[best]])) {
+        best = i;
+        bestPriority = priority;
+      }
+    }
+    Node *N = ready[best];
+    ready.erase(ready.begin() + best);
+
+    DEBUG_GLOW(llvm::outs() << "Scheduled node: " << N->getName() << "\n");
+    scheduled_.push_back(N);
+    onScheduled(N);
+    last = N;
+    for (auto *dependent : dependents[N]) {
+      if (--numPendingDeps[dependent] == 0) {
+        ready.push_back(dependent);
+      }
+    }
+  }
+}
+
+int64_t DataParallelScheduler::getPriority(const Node *N, const Node *last) {
+  // Schedule the other nodes before starting a new data parallel kernel, so
+  // that more of the data parallel nodes become ready to join it.
+  if (!isDataParallelNode(N)) {
+    return 1;
+  }
+  // A node can join the kernel of the previous node if they process the same
+  // number of elements.
+  if (last && isDataParallelNode(last) &&
+      getDataParallelSize(N) == getDataParallelSize(last)) {
+    return 2;
+  }
+  return 0;
+}
+
+int64_t CacheLocalityScheduler::getPriority(const Node *N, const Node *last) {
+  // Prefer the consumers of the most recently computed values.
+  int64_t priority = 0;
+  llvm::SmallVector<Node *, 8> inputs;
+  getDataInputs(const_cast<Node *>(N), inputs);
+  for (auto *input : inputs) {
+    auto it = step_.find(input);
+    if (it != step_.end()) {
+      priority = std::max(priority, it->second + 1);
+    }
+  }
+  return priority;
+}
+
+void CacheLocalityScheduler::onScheduled(const Node *N) {
+  int64_t step = step_.size();
+  step_[N] = step;
+}
+
+std::unique_ptr<Scheduler> glow::createScheduler(SchedulerKind kind,
+                                                 Function &G,
+                                                 NodesPtrList &Schedule) {
+  switch (kind) {
+  case SchedulerKind::ChildMemSize:
+    return llvm::make_unique<ChildMemSizeBasedScheduler>(G, Schedule);
+  case SchedulerKind::MinPeakMemory:
+    return llvm::make_unique<MinPeakMemoryScheduler>(G, Schedule);
+  case SchedulerKind::DataParallel:
+    return llvm::make_unique<DataParallelScheduler>(G, Schedule);
+  case SchedulerKind::CacheLocality:
+    return llvm::make_unique<CacheLocalityScheduler>(G, Schedule);
+  }
+  GLOW_UNREACHABLE("Unknown scheduler kind");
+}
+
+void IRFunction::scheduleGraph(NodesPtrList &Schedule, SchedulerKind kind) {
   Schedule.clear();
   for (auto &N : G_->getParent()->getVars()) {
     Schedule.push_back(N);
@@ -177,13 +556,13 @@ void IRFunction::scheduleGraph(NodesPtrList &Schedule) {
   for (auto &N : G_->getParent()->getPlaceholders()) {
     Schedule.push_back(N);
   }
-  ChildMemSizeBasedScheduler CMSBScheduler(*G_, Schedule);
-  CMSBScheduler.schedule();
+  auto scheduler = createScheduler(kind, *G_, Schedule);
+  scheduler->schedule();
   auto numVars = G_->getParent()->getVars().size();
   auto numPlaceholders = G_->getParent()->getPlaceholders().size();
   (void)numVars;
   (void)numPlaceholders;
-  assert(CMSBScheduler.getSchedule().size() ==
+  assert(scheduler->getSchedule().size() ==
              G_->getNodes().size() + numPlaceholders + numVars &&
          "All graph nodes have to be scheduled");
 }
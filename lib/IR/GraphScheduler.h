@@ -18,7 +18,12 @@
 
 #include "glow/IR/IR.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace glow {
 class Scheduler {
@@ -80,6 +85,96 @@ public:
   void schedule() override;
 };
 
+/// This scheduler minimizes the peak memory usage of the schedule produced by
+/// ChildMemSizeBasedScheduler. The schedule is split into windows of a few
+/// consecutive nodes and the nodes of each window are reordered by a dynamic
+/// programming over the subsets of the window, which finds the order with the
+/// smallest peak memory usage inside the window.
+class MinPeakMemoryScheduler : public Scheduler {
+  /// Position of each node in the schedule of ChildMemSizeBasedScheduler.
+  std::unordered_map<const Node *, size_t> position_;
+
+  /// Reorders the window [\p begin, \p end) of \p order to minimize its peak
+  /// memory usage.
+  void scheduleWindow(std::vector<Node *> &order, size_t begin, size_t end);
+
+public:
+  /// The maximal number of nodes reordered together.
+  static constexpr size_t windowSize = 12;
+
+  MinPeakMemoryScheduler(Function &G, NodesPtrList &Schedule)
+      : Scheduler(G, Schedule) {}
+
+  ~MinPeakMemoryScheduler() override = default;
+
+  void schedule() override;
+};
+
+/// A list scheduler that repeatedly picks one of the nodes whose dependencies
+/// are scheduled already. The node with the highest priority is picked and
+/// ties are broken by the order of ChildMemSizeBasedScheduler, which keeps the
+/// memory usage low.
+class ListScheduler : public Scheduler {
+  /// Position of each node in the schedule of ChildMemSizeBasedScheduler.
+  std::unordered_map<const Node *, size_t> basePosition_;
+
+protected:
+  /// \returns the priority of the ready node \p N. \p last is the last
+  /// scheduled node or nullptr if no node has been scheduled yet.
+  virtual int64_t getPriority(const Node *N, const Node *last) = 0;
+
+  /// Called after the node \p N has been scheduled.
+  virtual void onScheduled(const Node *N) {}
+
+public:
+  ListScheduler(Function &G, NodesPtrList &Schedule)
+      : Scheduler(G, Schedule) {}
+
+  ~ListScheduler() override = default;
+
+  void schedule() override;
+};
+
+/// This scheduler keeps shape compatible data parallel nodes next to each
+/// other, so that backends can fuse their instructions into a single kernel,
+/// e.g. the data parallel kernels emitted by the CPU backend. A node that
+/// continues the current kernel goes first, then the nodes that are not data
+/// parallel and only then the nodes that start a new kernel.
+class DataParallelScheduler : public ListScheduler {
+protected:
+  int64_t getPriority(const Node *N, const Node *last) override;
+
+public:
+  DataParallelScheduler(Function &G, NodesPtrList &Schedule)
+      : ListScheduler(G, Schedule) {}
+};
+
+/// This scheduler schedules the consumers of a value as soon as possible after
+/// its producer, while the value is still in the cache.
+class CacheLocalityScheduler : public ListScheduler {
+  /// The step at which each node was scheduled.
+  std::unordered_map<const Node *, int64_t> step_;
+
+protected:
+  int64_t getPriority(const Node *N, const Node *last) override;
+  void onScheduled(const Node *N) override;
+
+public:
+  CacheLocalityScheduler(Function &G, NodesPtrList &Schedule)
+      : ListScheduler(G, Schedule) {}
+};
+
+/// \returns a scheduler of kind \p kind for the graph \p G, which appends the
+/// scheduled nodes to \p Schedule.
+std::unique_ptr<Scheduler> createScheduler(SchedulerKind kind, Function &G,
+                                           NodesPtrList &Schedule);
+
+/// \returns the peak number of bytes of node results that are alive at the
+/// same time when the nodes of \p G are executed in the order \p Schedule.
+/// The result of a node is alive from its computation until the computation
+/// of its last user.
+int64_t getSchedulePeakMemory(Function &G, const NodesPtrList &Schedule);
+
 } // namespace glow
 
 #endif // GLOW_IR_GRAPH_SCHEDULER_H
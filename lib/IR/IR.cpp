@@ -26,6 +26,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <unordered_set>
 
@@ -292,8 +293,24 @@ static void verifyLiveness(const IRFunction &M) {
 void IRFunction::verify() const {
   InstructionNumbering InstrNumbering(*this);
   assert(!instrs_.empty() && "Instruction list is empty!");
+  // The use-list of every value is verified once, instead of once per
+  // operand that refers to it, and the (value, user) pairs of the use-lists
+  // are collected in a set, so that the verification of functions whose
+  // values have many users takes linear time.
+  std::unordered_set<const Value *> verifiedValues;
+  std::set<std::pair<const Value *, const Instruction *>> uses;
   for (const auto &I : instrs_) {
-    I.verifyUseList(InstrNumbering);
+    for (const auto &op : I.getOperands()) {
+      auto *v = op.first;
+      assert(v && "Instruction operand must be a real value");
+      if (verifiedValues.insert(v).second) {
+        v->verifyUseList(InstrNumbering);
+        for (const auto &use : v->getUsers()) {
+          uses.insert({v, use.get()});
+        }
+      }
+      assert(uses.count({v, &I}) && "Invalid use-list");
+    }
     verifyOperandsAccess(&I);
     I.verify();
   }
@@ -336,6 +353,39 @@ bool Instruction::isDataParallel() const {
   return false;
 }
 
+uint64_t Instruction::getFlops() const {
+  switch (getKind()) {
+  default:
+    llvm_unreachable("Unknown value kind");
+    break;
+#define DEF_INSTR(CLASS, NAME)                                                 \
+  case Kinded::Kind::CLASS##Kind: {                                            \
+    auto *X = llvm::cast<const CLASS>(this);                                   \
+    return X->getFlops();                                                      \
+    break;                                                                     \
+  }
+#define DEF_BACKEND_SPECIFIC_INSTR(CLASS, NAME) DEF_INSTR(CLASS, NAME)
+#define DEF_VALUE(CLASS, NAME)
+#include "glow/AutoGenInstr.def"
+  }
+  return 0;
+}
+
+Cost Instruction::getCost() const {
+  Cost cost;
+  cost.flops = getFlops();
+  for (const auto &op : getOperands()) {
+    auto bytes = op.first->getSizeInBytes();
+    if (op.second != OperandKind::Out) {
+      cost.bytesRead += bytes;
+    }
+    if (op.second != OperandKind::In) {
+      cost.bytesWritten += bytes;
+    }
+  }
+  return cost;
+}
+
 //===----------------------------------------------------------------------===//
 //                    Instruction numbering
 //===----------------------------------------------------------------------===//
@@ -18,6 +18,7 @@
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/IR.h"
 #include "glow/IR/IRBuilder.h"
+#include "glow/Support/Debug.h"
 
 #include "llvm/Support/Casting.h"
 
@@ -127,6 +128,21 @@ public:
       registerIR(N, dest);
       break;
     }
+    case glow::Kinded::Kind::BroadcastNodeKind: {
+      auto *BN = cast<BroadcastNode>(N);
+
+      // The copy is removed by the IR optimizer if the readers of the result
+      // can read the broadcast view instead.
+      auto *inVal = valueForNode(BN->getInput());
+      std::vector<size_t> offsets(inVal->getType()->dims().size(), 0);
+      auto *TVI = builder_.createTensorViewInst(
+          "tensorview.broadcast", inVal, BN->getResult().getType(), offsets);
+      auto *dest = builder_.createAllocActivationInst(
+          "copy.broadcast.res", BN->getResult().getType());
+      builder_.createCopyInst("copy.broadcast", dest, TVI);
+      registerIR(N, dest);
+      break;
+    }
     case glow::Kinded::Kind::ConvolutionGradNodeKind: {
       auto *CG = cast<ConvolutionGradNode>(N);
 
@@ -218,6 +234,67 @@ public:
       registerIR(SMG->getGradOfInputNamedInput(), SMGI->getSrcGrad());
       break;
     }
+    case glow::Kinded::Kind::BatchNormalizationGradNodeKind: {
+      auto *BNG = cast<BatchNormalizationGradNode>(N);
+      auto *src = valueForNode(BNG->getInput());
+      auto *scale = valueForNode(BNG->getScale());
+      auto *mean = valueForNode(BNG->getMean());
+      auto *var = valueForNode(BNG->getVar());
+      auto *destGrad =
+          valueForNode(BNG->getGradOfOriginalOutputNamedResult());
+      auto *srcGrad = builder_.createAllocActivationInst("bn.src.grad",
+                                                         src->getType());
+      auto *scaleGrad = builder_.createAllocActivationInst("bn.scale.grad",
+                                                           scale->getType());
+      auto *biasGrad = builder_.createAllocActivationInst("bn.bias.grad",
+                                                          scale->getType());
+      builder_.createBatchNormalizationGradInst(
+          N->getName(), src, scale, mean, var, destGrad, srcGrad, scaleGrad,
+          biasGrad, BNG->getChannelIdx(), BNG->getEpsilon(),
+          BNG->getMomentum());
+      registerIR(BNG->getGradOfInputNamedInput(), srcGrad);
+      registerIR(BNG->getGradOfInputNamedScale(), scaleGrad);
+      registerIR(BNG->getGradOfInputNamedBias(), biasGrad);
+
+      // The statistics are not trained: their gradients are zero, like in the
+      // lowering.
+      auto *zero =
+          builder_.createAllocActivationInst("bn.stats.grad", var->getType());
+      builder_.createSplatInst("bn.stats.grad.zero", zero, 0);
+      registerIR(BNG->getGradOfInputNamedMean(), zero);
+      registerIR(BNG->getGradOfInputNamedVar(), zero);
+      break;
+    }
+    case glow::Kinded::Kind::MeanVarNormalizationNodeKind: {
+      auto *MVN = cast<MeanVarNormalizationNode>(N);
+      auto *src = valueForNode(MVN->getInput());
+      auto *mean = valueForNode(MVN->getMean());
+      auto *var = valueForNode(MVN->getVar());
+      auto *newMean = builder_.createAllocActivationInst("mvn.mean.res",
+                                                         mean->getType());
+      auto *newVar =
+          builder_.createAllocActivationInst("mvn.var.res", var->getType());
+      auto *V = builder_.createMeanVarNormalizationInst(
+          N->getName(), newMean, newVar, src, mean, var, MVN->getChannelIdx(),
+          MVN->getMomentum());
+      registerIR(MVN->getNewMean(), newMean);
+      registerIR(MVN->getNewVar(), newVar);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::SoftMaxCrossEntropyLossGradNodeKind: {
+      auto *SCEG = cast<SoftMaxCrossEntropyLossGradNode>(N);
+      // Like SoftMaxGrad, the loss is the start of the backward pass, so the
+      // gradient of the result is not read.
+      auto *logits = valueForNode(SCEG->getLogits());
+      auto *labels = valueForNode(SCEG->getLabels());
+      auto *logitsGrad = builder_.createAllocActivationInst(
+          "softmax.xent.logits.grad", logits->getType());
+      builder_.createSoftMaxCrossEntropyLossGradInst(N->getName(), logits,
+                                                     labels, logitsGrad);
+      registerIR(SCEG->getGradOfInputNamedLogits(), logitsGrad);
+      break;
+    }
     case glow::Kinded::Kind::CrossEntropyLossNodeKind: {
       auto *CELoss = cast<CrossEntropyLossNode>(N);
       auto *P = valueForNode(CELoss->getP());
@@ -246,6 +323,28 @@ public:
                  CELossGI->getLabelsgrad());
       break;
     }
+    case glow::Kinded::Kind::SumNodeKind: {
+      auto *SN = cast<SumNode>(N);
+      auto inputs = SN->getInputs();
+      auto *dest = builder_.createAllocActivationInst(
+          SN->getName(), SN->getResult().getType());
+      // Accumulate the inputs into the result in place, so that no partial
+      // sums are allocated. The additions are data parallel, so the CPU
+      // backend fuses them into a single loop over the elements.
+      if (inputs.size() == 1) {
+        builder_.createCopyInst(SN->getName(), dest, valueForNode(inputs[0]));
+      } else {
+        builder_.createElementAddInst(SN->getName(), dest,
+                                      valueForNode(inputs[0]),
+                                      valueForNode(inputs[1]));
+      }
+      for (size_t i = 2, e = inputs.size(); i < e; i++) {
+        builder_.createElementAddInst(SN->getName(), dest, dest,
+                                      valueForNode(inputs[i]));
+      }
+      registerIR(N, dest);
+      break;
+    }
     case glow::Kinded::Kind::ConcatNodeKind: {
       auto *CC = cast<ConcatNode>(N);
 
@@ -402,17 +501,184 @@ public:
       V->setName(N->getName());
       break;
     }
+    case glow::Kinded::Kind::RNNSequenceNodeKind:
+    case glow::Kinded::Kind::LSTMSequenceNodeKind:
+    case glow::Kinded::Kind::GRUSequenceNodeKind: {
+      auto *inputGates = valueForNode(N->getNthInput(0));
+      auto *initH = valueForNode(N->getNthInput(1));
+      auto batch = initH->dims()[0];
+      auto hidden = initH->dims()[1];
+      auto *dest = builder_.createAllocActivationInst(
+          "sequence.h", N->getNthResult(0).getType());
+      // The scratch holds the gates of the hidden state of a time step, and
+      // the cell state of an LSTM.
+      size_t scratchSize = batch * inputGates->dims()[2];
+      if (isa<LSTMSequenceNode>(N)) {
+        scratchSize += batch * hidden;
+      }
+      auto *scratch = builder_.createAllocActivationInst(
+          "sequence.scratch", initH->getElementType(), {scratchSize});
+      builder_.createSplatInst("sequence.zero.scratch", scratch, 0);
+      Instruction *V;
+      if (auto *RS = dyn_cast<RNNSequenceNode>(N)) {
+        V = builder_.createRNNSequenceInst(
+            N->getName(), dest, inputGates, initH,
+            valueForNode(RS->getHiddenWeights()),
+            valueForNode(RS->getHiddenBias()),
+            valueForNode(RS->getLengths()), scratch);
+      } else if (auto *LS = dyn_cast<LSTMSequenceNode>(N)) {
+        V = builder_.createLSTMSequenceInst(
+            N->getName(), dest, inputGates, initH,
+            valueForNode(LS->getInitC()), valueForNode(LS->getHiddenWeights()),
+            valueForNode(LS->getHiddenBias()),
+            valueForNode(LS->getLengths()), scratch);
+      } else {
+        auto *GS = cast<GRUSequenceNode>(N);
+        V = builder_.createGRUSequenceInst(
+            N->getName(), dest, inputGates, initH,
+            valueForNode(GS->getHiddenWeights()),
+            valueForNode(GS->getHiddenBias()),
+            valueForNode(GS->getLengths()), scratch);
+      }
+      registerIR(N, dest);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::DynamicQuantizedFullyConnectedNodeKind: {
+      auto *FC = cast<DynamicQuantizedFullyConnectedNode>(N);
+      auto *weights = valueForNode(FC->getWeights());
+      auto *dest = builder_.createAllocActivationInst(
+          N->getName(), FC->getResult().getType());
+      // Every row of the scratch holds a 16-byte header with the scale, the
+      // offset and the sum of a quantized input row, followed by the row
+      // itself, padded to 16 bytes.
+      size_t batch = FC->getResult().dims()[0];
+      size_t rowStride = 16 + (weights->dims()[1] + 15) / 16 * 16;
+      auto *scratch = builder_.createAllocActivationInst(
+          "fc.scratch",
+          F_->getGraph()->getParent()->uniqueType(ElemKind::Int8QTy,
+                                                  {batch, rowStride}, 1.0, 0));
+      builder_.createSplatInst("fc.zero.scratch", scratch, 0);
+      auto *V = builder_.createDynamicQuantizedFullyConnectedInst(
+          N->getName(), dest, valueForNode(FC->getInput()), weights,
+          valueForNode(FC->getScales()), valueForNode(FC->getOffsets()),
+          valueForNode(FC->getBias()), scratch);
+      registerIR(N, dest);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::LSTMUnitNodeKind: {
+      auto *LU = cast<LSTMUnitNode>(N);
+      auto *inputGates = valueForNode(LU->getInputGates());
+      auto *hiddenGates = valueForNode(LU->getHiddenGates());
+      auto *C = valueForNode(LU->getC());
+      auto *newH = builder_.createAllocActivationInst("lstm.h", C->getType());
+      auto *newC = builder_.createAllocActivationInst("lstm.c", C->getType());
+      auto *V = builder_.createLSTMUnitInst(N->getName(), newH, newC,
+                                            inputGates, hiddenGates, C);
+      registerIR(LU->getNewH(), newH);
+      registerIR(LU->getNewC(), newC);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::MomentumSGDNodeKind: {
+      auto *SGD = cast<MomentumSGDNode>(N);
+      auto *weight = valueForNode(SGD->getWeight());
+      auto *gradient = valueForNode(SGD->getGradient());
+      auto *gsum = valueForNode(SGD->getGsum());
+      auto *dest = builder_.createAllocActivationInst(
+          std::string(N->getName()) + ".res", weight->getType());
+      auto *V = builder_.createMomentumSGDInst(
+          N->getName(), dest, weight, gradient, gsum, SGD->getL1Decay(),
+          SGD->getL2Decay(), SGD->getLearningRate(), SGD->getMomentum(),
+          SGD->getBatchSize());
+      registerIR(N, dest);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::AdagradNodeKind: {
+      auto *AG = cast<AdagradNode>(N);
+      auto *weight = valueForNode(AG->getWeight());
+      auto *gradient = valueForNode(AG->getGradient());
+      auto *sumSq = valueForNode(AG->getSumSq());
+      auto *dest = builder_.createAllocActivationInst(
+          std::string(N->getName()) + ".res", weight->getType());
+      auto *V = builder_.createAdagradInst(
+          N->getName(), dest, weight, gradient, sumSq, AG->getL1Decay(),
+          AG->getL2Decay(), AG->getLearningRate(), AG->getEpsilon(),
+          AG->getBatchSize());
+      registerIR(N, dest);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::RMSPropNodeKind: {
+      auto *RP = cast<RMSPropNode>(N);
+      auto *weight = valueForNode(RP->getWeight());
+      auto *gradient = valueForNode(RP->getGradient());
+      auto *meanSq = valueForNode(RP->getMeanSq());
+      auto *dest = builder_.createAllocActivationInst(
+          std::string(N->getName()) + ".res", weight->getType());
+      auto *V = builder_.createRMSPropInst(
+          N->getName(), dest, weight, gradient, meanSq, RP->getL1Decay(),
+          RP->getL2Decay(), RP->getLearningRate(), RP->getDecay(),
+          RP->getEpsilon(), RP->getBatchSize());
+      registerIR(N, dest);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::AdamNodeKind: {
+      auto *AD = cast<AdamNode>(N);
+      auto *weight = valueForNode(AD->getWeight());
+      auto *gradient = valueForNode(AD->getGradient());
+      auto *firstMoment = valueForNode(AD->getFirstMoment());
+      auto *secondMoment = valueForNode(AD->getSecondMoment());
+      auto *step = valueForNode(AD->getStep());
+      auto *dest = builder_.createAllocActivationInst(
+          std::string(N->getName()) + ".res", weight->getType());
+      auto *V = builder_.createAdamInst(
+          N->getName(), dest, weight, gradient, firstMoment, secondMoment,
+          step, AD->getL1Decay(), AD->getL2Decay(), AD->getLearningRate(),
+          AD->getBeta1(), AD->getBeta2(), AD->getEpsilon(),
+          AD->getBatchSize());
+      registerIR(N, dest);
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::SparseSGDNodeKind: {
+      // The rows are updated in place, so that the cost of the update is
+      // proportional to the number of rows, not to the size of the weight.
+      auto *SGD = cast<SparseSGDNode>(N);
+      auto *V = builder_.createSparseSGDInst(
+          N->getName(), valueForNode(SGD->getWeight()),
+          valueForNode(SGD->getGradient()), valueForNode(SGD->getIndices()),
+          SGD->getL1Decay(), SGD->getL2Decay(), SGD->getLearningRate(),
+          SGD->getBatchSize());
+      nodeToInstr_[N] = V;
+      break;
+    }
+    case glow::Kinded::Kind::SparseAdagradNodeKind: {
+      auto *AG = cast<SparseAdagradNode>(N);
+      auto *V = builder_.createSparseAdagradInst(
+          N->getName(), valueForNode(AG->getWeight()),
+          valueForNode(AG->getGradient()), valueForNode(AG->getIndices()),
+          valueForNode(AG->getSumSq()), AG->getL1Decay(), AG->getL2Decay(),
+          AG->getLearningRate(), AG->getEpsilon(), AG->getBatchSize());
+      nodeToInstr_[N] = V;
+      break;
+    }
     }
   }
 };
 
 } // namespace
 
-void IRFunction::generateIR() {
-  G_->verify();
+void IRFunction::generateIR(SchedulerKind schedulerKind) {
+  if (VerifyLevel != VerificationLevel::None) {
+    G_->verify();
+  }
   // Schedule the nodes.
   NodesPtrList ScheduledNodes;
-  scheduleGraph(ScheduledNodes);
+  scheduleGraph(ScheduledNodes, schedulerKind);
   IRGenVisitor irgen(this);
 
   for (auto &N : ScheduledNodes) {
@@ -51,3 +51,55 @@ const Value *glow::getOrigin(const Value *V) {
   }
   return V;
 }
+
+size_t glow::getTensorViewOffset(const TensorViewInst *TVI) {
+  auto offsets = TVI->getOffsets();
+  if (offsets.empty()) {
+    return 0;
+  }
+  auto srcDims = TVI->getSrc()->dims();
+  assert(offsets.size() == srcDims.size() &&
+         "The offsets must have the rank of the source");
+  size_t offset = 0;
+  for (size_t i = 0, e = srcDims.size(); i < e; i++) {
+    offset = offset * srcDims[i] + offsets[i];
+  }
+  return offset;
+}
+
+bool glow::isBroadcastView(const Value *V) {
+  auto *TVI = dyn_cast<TensorViewInst>(V);
+  return TVI && TVI->getType()->size() > TVI->getSrc()->getType()->size();
+}
+
+bool glow::canReadBroadcastViews(const Instruction *I) {
+  return isa<ElementAddInst>(I) || isa<ElementSubInst>(I) ||
+         isa<ElementMulInst>(I) || isa<ElementDivInst>(I) ||
+         isa<ElementMaxInst>(I) || isa<ElementMinInst>(I) || isa<CopyInst>(I);
+}
+
+llvm::SmallVector<BroadcastDim, 4>
+glow::getBroadcastDims(const TensorViewInst *TVI) {
+  auto viewDims = TVI->dims();
+  auto srcDims = TVI->getSrc()->dims();
+  assert(viewDims.size() == srcDims.size() &&
+         "A broadcast view has the rank of its source");
+  llvm::SmallVector<BroadcastDim, 4> dims;
+  size_t viewStride = 1;
+  size_t srcStride = 1;
+  for (size_t i = viewDims.size(); i-- > 0;) {
+    if (srcDims[i] != 1) {
+      // A dimension that directly follows the previous group extends it.
+      if (!dims.empty() &&
+          dims.back().viewStride * dims.back().size == viewStride &&
+          dims.back().srcStride * dims.back().size == srcStride) {
+        dims.back().size *= viewDims[i];
+      } else {
+        dims.push_back({viewStride, viewDims[i], srcStride});
+      }
+    }
+    viewStride *= viewDims[i];
+    srcStride *= srcDims[i];
+  }
+  return dims;
+}
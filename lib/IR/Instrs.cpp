@@ -16,6 +16,7 @@
 
 #include "glow/IR/Instrs.h"
 #include "glow/IR/IR.h"
+#include "glow/IR/IRUtils.h"
 #include "glow/Support/Support.h"
 
 #include "llvm/Support/Casting.h"
@@ -62,10 +63,31 @@ void CopyInst::verify() const {
 }
 
 void TensorViewInst::verify() const {
-  assert(getSrc()->getType()->size() >= getType()->size() &&
-         "TensorView view size should be no larger than Src size");
   assert(getSrc()->getElementType() == getType()->getElementType() &&
          "TensorView view element type should be the same as Src type");
+  if (!isBroadcastView(this)) {
+    assert(getSrc()->getType()->size() >= getType()->size() &&
+           "TensorView view size should be no larger than Src size");
+    return;
+  }
+
+  auto srcDims = getSrc()->dims();
+  auto dims = getType()->dims();
+  (void)srcDims;
+  (void)dims;
+  assert(srcDims.size() == dims.size() &&
+         "Broadcast view must have the rank of its source");
+  for (size_t i = 0, e = dims.size(); i < e; i++) {
+    assert((srcDims[i] == dims[i] || srcDims[i] == 1) &&
+           "Broadcast view dimension must match its source or repeat it");
+    assert(getOffsets()[i] == 0 && "Broadcast view must not have offsets");
+  }
+  for (const auto &U : getUsers()) {
+    assert(U.getOperand().second == OperandKind::In &&
+           canReadBroadcastViews(U.get()) &&
+           "Broadcast view is read by an instruction that cannot read it");
+    (void)U;
+  }
 }
 
 void AllocActivationInst::verify() const {
@@ -20,6 +20,7 @@
 #include "glow/Graph/Nodes.h"
 
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 #include "glow/caffe.pb.h"
 #include <google/protobuf/io/coded_stream.h>
@@ -28,7 +29,7 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -110,17 +111,21 @@ static std::vector<unsigned_t> getSizeHW(ArgumentDictionaryTy &dict,
 
 bool caffe2ModelLoader::loadProtoFile(caffe2::NetDef &net,
                                       const std::string &filename) {
-  std::ifstream ff(filename, std::ios::in | std::ios::binary);
-  GLOW_ASSERT(ff && "Can't find the model or network files.");
+  // Large files are mapped rather than read, so the parser copies the bytes
+  // straight from the page cache into the network.
+  auto fileOrErr = llvm::MemoryBuffer::getFile(
+      filename, /* FileSize */ -1, /* RequiresNullTerminator */ false);
+  GLOW_ASSERT(fileOrErr && "Can't find the model or network files.");
+  auto &file = *fileOrErr;
 
   bool parseNet = false;
   if (filename.find(".pbtxt") != std::string::npos) {
-    std::string str((std::istreambuf_iterator<char>(ff)),
-                    std::istreambuf_iterator<char>());
-    parseNet = google::protobuf::TextFormat::ParseFromString(str, &net);
+    parseNet = google::protobuf::TextFormat::ParseFromString(
+        file->getBuffer().str(), &net);
   } else {
     // Construct and configure a Coded Input Stream
-    google::protobuf::io::IstreamInputStream filestr(&ff);
+    google::protobuf::io::ArrayInputStream filestr(file->getBufferStart(),
+                                                   file->getBufferSize());
     google::protobuf::io::CodedInputStream codedstr(&filestr);
     // Don't warn about large file sizes.
     codedstr.SetTotalBytesLimit(MAX_PROTO_SIZE, MAX_PROTO_SIZE);
@@ -577,13 +582,33 @@ void caffe2ModelLoader::loadNetwork(caffe2::NetDef &net) {
 
   for (int i = 0; i < net.external_output_size(); i++) {
     auto &outputName = net.external_output(i);
-    auto r = getNodeValueByName(outputName);
+    auto r = getNodeValueOrCreateVariableByName(outputName);
     auto *SN = G_.createSave("save_" + outputName, r);
     outputVarsByName_[outputName] = SN->getVariable();
   }
 }
 
-void caffe2ModelLoader::loadWeight(const caffe2::OperatorDef &op) {
+/// Copies the serialized values of the GivenTensorFill operator \p op into
+/// \p T, which already has the type of the values.
+static void loadGivenTensorValues(const caffe2::OperatorDef &op, Tensor *T) {
+  for (const auto &arg : op.arg()) {
+    if (arg.name() != "values") {
+      continue;
+    }
+    size_t numValues = arg.floats_size() ? arg.floats_size() : arg.ints_size();
+    assert(numValues == T->size() && "The number of serialized values does "
+                                     "not match the size of the tensor.");
+    (void)numValues;
+    const void *values = arg.floats_size()
+                             ? static_cast<const void *>(arg.floats().data())
+                             : static_cast<const void *>(arg.ints().data());
+    memcpy(T->getUnsafePtr(), values, T->getType().getSizeInBytes());
+    return;
+  }
+}
+
+void caffe2ModelLoader::loadWeight(const caffe2::OperatorDef &op,
+                                   GivenTensorListTy *pendingValues) {
   ArgumentDictionaryTy dict = loadArgumentMap(op);
   const std::string &typeName = op.type();
 
@@ -613,27 +638,21 @@ void caffe2ModelLoader::loadWeight(const caffe2::OperatorDef &op) {
 
     auto dim = getShape(dict["shape"]);
 
-    size_t i = 0;
     if (dict["values"]->floats_size()) {
       assert(typeName != "GivenTensorIntFill" &&
              typeName != "GivenTensorInt64Fill");
       T->reset(ElemKind::FloatTy, dim);
-      auto TH = T->getHandle<>();
-      for (auto num : dict["values"]->floats()) {
-        TH.raw(i++) = num;
-      }
     } else if (dict["values"]->ints_size()) {
       T->reset(ElemKind::Int64ITy, dim);
-      auto TH = T->getHandle<int64_t>();
-      for (auto num : dict["values"]->ints()) {
-        TH.raw(i++) = num;
-      }
     } else {
       unexpectedNodeError(op, "Unsupported data type for GivenTensorFill.");
     }
 
-    assert(i == T->size() && "The number of serialized values does not "
-                             "match the size of the tensor.");
+    if (pendingValues) {
+      pendingValues->push_back({&op, T});
+    } else {
+      loadGivenTensorValues(op, T);
+    }
     return;
   }
 
@@ -747,8 +766,22 @@ void caffe2ModelLoader::loadWeight(const caffe2::OperatorDef &op) {
 }
 
 void caffe2ModelLoader::loadWeights(caffe2::NetDef &net) {
-  for (auto &op : net.op()) {
-    loadWeight(op);
+  // The fill operators are loaded in order, because they may depend on each
+  // other, but the values of the given tensors, which make up most of the
+  // weights, are decoded in parallel once all shapes are known.
+  GivenTensorListTy pendingValues;
+  for (const auto &op : net.op()) {
+    loadWeight(op, &pendingValues);
+  }
+
+  parallelForEachItem(pendingValues.size(), [&](size_t i) {
+    loadGivenTensorValues(*pendingValues[i].first, pendingValues[i].second);
+  });
+
+  // Free the serialized values, so that the weights are not held twice while
+  // the rest of the model loads.
+  for (auto &op : *net.mutable_op()) {
+    caffe2::OperatorDef().Swap(&op);
   }
 }
 
@@ -758,6 +791,7 @@ caffe2ModelLoader::caffe2ModelLoader(const std::string &netDescFilename,
                                      llvm::ArrayRef<Tensor *> tensors,
                                      Function &F)
     : CommonOperatorLoader(names, tensors, F) {
+  ArenaScope arenaScope(&F.getParent()->getArena());
   // The caffe2 weights that we are deserializing.
   caffe2::NetDef weightsDef;
   // The caffe2 network descriptor that we are deserializing.
@@ -19,7 +19,10 @@
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Nodes.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 
 #include "google/protobuf/io/coded_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
@@ -28,8 +31,8 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
 
@@ -56,7 +59,7 @@ bool ONNXModelLoader::getBroadcast(const ArgumentDictionaryTy &dict) {
   return dict.count("broadcast") && (loadInt(dict.at("broadcast")) == 1);
 }
 
-void ONNXModelLoader::setVersion(ONNX_NAMESPACE::ModelProto MP) {
+void ONNXModelLoader::setVersion(const ONNX_NAMESPACE::ModelProto &MP) {
   irVersion_ = MP.ir_version();
   opsetVersion_ = 0;
   GLOW_ASSERT(
@@ -80,11 +83,7 @@ bool ONNXModelLoader::loadProto(
 
   // Don't warn about large file sizes.
   codedStream.SetTotalBytesLimit(MAX_PROTO_SIZE, MAX_PROTO_SIZE);
-  ONNX_NAMESPACE::ModelProto MP;
-  bool parseNet = MP.ParseFromCodedStream(&codedStream);
-  net = MP;
-
-  return parseNet;
+  return net.ParseFromCodedStream(&codedStream);
 }
 
 bool ONNXModelLoader::loadProto(ONNX_NAMESPACE::ModelProto &net,
@@ -95,24 +94,25 @@ bool ONNXModelLoader::loadProto(ONNX_NAMESPACE::ModelProto &net,
 
 bool ONNXModelLoader::loadProto(ONNX_NAMESPACE::ModelProto &net,
                                 const std::string &filename) {
-  std::ifstream ff(filename, std::ios::in | std::ios::binary);
-  GLOW_ASSERT(ff && "Can't find the model or network files.");
-
   // TODO: intend to find a way to reuse the following function later
   // for the text format onnx model:
   // bool ONNXModelLoader::loadProto(ONNX_NAMESPACE::GraphProto &net,
   //  google::protobuf::io::ZeroCopyInputStream &iStream)
   if (filename.find(".onnxtxt") != std::string::npos) {
+    std::ifstream ff(filename, std::ios::in | std::ios::binary);
+    GLOW_ASSERT(ff && "Can't find the model or network files.");
     std::string str((std::istreambuf_iterator<char>(ff)),
                     std::istreambuf_iterator<char>());
-    ONNX_NAMESPACE::ModelProto MP;
-    bool parseNet = google::protobuf::TextFormat::ParseFromString(str, &MP);
-    net = MP;
-    return parseNet;
+    return google::protobuf::TextFormat::ParseFromString(str, &net);
   }
 
-  google::protobuf::io::IstreamInputStream fileStream(&ff);
-  return loadProto(net, fileStream);
+  // Large files are mapped rather than read, so the parser copies the bytes
+  // straight from the page cache into the model.
+  auto fileOrErr = llvm::MemoryBuffer::getFile(
+      filename, /* FileSize */ -1, /* RequiresNullTerminator */ false);
+  GLOW_ASSERT(fileOrErr && "Can't find the model or network files.");
+  auto &file = *fileOrErr;
+  return loadProto(net, file->getBufferStart(), file->getBufferSize());
 }
 
 std::vector<unsigned_t> getPads(const ArgumentDictionaryTy &dict) {
@@ -131,8 +131,58 @@ std::vector<unsigned_t> getPads(const ArgumentDictionaryTy &dict) {
   return {0, 0, 0, 0};
 }
 
-/// Loads tensor \p T from the input \p in.
-static void loadTensor(const ONNX_NAMESPACE::TensorProto &in, Tensor *T) {
+/// Reads the payload of \p T from the external data file that \p in refers
+/// to. The location of the file is relative to \p modelDir.
+static void loadExternalData(const ONNX_NAMESPACE::TensorProto &in,
+                             llvm::StringRef modelDir, Tensor *T) {
+  size_t sizeInBytes = T->getType().getSizeInBytes();
+  std::string location;
+  uint64_t offset = 0;
+  uint64_t length = sizeInBytes;
+  for (const auto &entry : in.external_data()) {
+    if (entry.key() == "location") {
+      location = entry.value();
+    } else if (entry.key() == "offset") {
+      offset = std::stoull(entry.value());
+    } else if (entry.key() == "length") {
+      length = std::stoull(entry.value());
+    }
+  }
+  GLOW_ASSERT(!location.empty() && "The external data has no location.");
+  GLOW_ASSERT(length == sizeInBytes &&
+              "The external data does not match the size of the tensor.");
+
+  // The payload is read straight into the tensor, without a staging copy.
+  llvm::SmallString<128> path(modelDir);
+  llvm::sys::path::append(path, location);
+  std::ifstream file(path.str(), std::ios::in | std::ios::binary);
+  GLOW_ASSERT(file && "Can't find the external data file.");
+  file.seekg(offset);
+  file.read(T->getUnsafePtr(), sizeInBytes);
+  GLOW_ASSERT(file && "The external data file is too short.");
+}
+
+/// Loads the payload of \p T from the raw data of \p in, or from the external
+/// data file it refers to, relative to \p modelDir.
+static void loadTensorPayload(const ONNX_NAMESPACE::TensorProto &in,
+                              llvm::StringRef modelDir, Tensor *T) {
+  if (in.has_data_location() &&
+      in.data_location() == ONNX_NAMESPACE::TensorProto::EXTERNAL) {
+    loadExternalData(in, modelDir, T);
+  } else if (in.has_raw_data()) {
+    size_t sizeInBytes = T->getType().getSizeInBytes();
+    GLOW_ASSERT(in.raw_data().size() == sizeInBytes &&
+                "The raw data does not match the size of the tensor.");
+    memcpy(T->getUnsafePtr(), in.raw_data().data(), sizeInBytes);
+  } else {
+    llvm_unreachable("Unsupported Tensor format.");
+  }
+}
+
+/// Loads tensor \p T from the input \p in. The locations of the external
+/// data files are relative to \p modelDir.
+static void loadTensor(const ONNX_NAMESPACE::TensorProto &in,
+                       llvm::StringRef modelDir, Tensor *T) {
   std::vector<size_t> dim;
   for (auto d : in.dims()) {
     dim.push_back(d);
@@ -142,31 +192,23 @@ static void loadTensor(const ONNX_NAMESPACE::TensorProto &in, Tensor *T) {
     T->reset(ElemKind::FloatTy, dim);
 
     if (in.float_data_size() > 0) {
-      auto TH = T->getHandle<>();
-      size_t i = 0;
-      for (auto f : in.float_data()) {
-        TH.raw(i++) = f;
-      }
-    } else if (in.has_raw_data()) {
-      std::istringstream inStream(in.raw_data(), std::stringstream::binary);
-      inStream.read(T->getUnsafePtr(), T->size() * sizeof(float));
+      GLOW_ASSERT(size_t(in.float_data_size()) == T->size() &&
+                  "The data does not match the size of the tensor.");
+      memcpy(T->getUnsafePtr(), in.float_data().data(),
+             T->getType().getSizeInBytes());
     } else {
-      llvm_unreachable("Unsupported Tensor format.");
+      loadTensorPayload(in, modelDir, T);
     }
   } else if (in.data_type() == ONNX_NAMESPACE::TensorProto::INT64) {
     T->reset(ElemKind::Int64ITy, dim);
 
     if (in.int64_data_size() > 0) {
-      auto TH = T->getHandle<>();
-      size_t i = 0;
-      for (auto f : in.int64_data()) {
-        TH.raw(i++) = f;
-      }
-    } else if (in.has_raw_data()) {
-      std::istringstream inStream(in.raw_data(), std::stringstream::binary);
-      inStream.read(T->getUnsafePtr(), T->size() * sizeof(int64_t));
+      GLOW_ASSERT(size_t(in.int64_data_size()) == T->size() &&
+                  "The data does not match the size of the tensor.");
+      memcpy(T->getUnsafePtr(), in.int64_data().data(),
+             T->getType().getSizeInBytes());
     } else {
-      llvm_unreachable("Unsupported Tensor format.");
+      loadTensorPayload(in, modelDir, T);
     }
   } else {
     llvm_unreachable("Only float and index tensors are supported");
@@ -222,7 +264,7 @@ bool ONNXModelLoader::loadOperator(const ONNX_NAMESPACE::NodeProto &op) {
            "Only Tensor type constants are supported.");
 
     auto *T = new Tensor();
-    loadTensor(dict["value"]->t(), T);
+    loadTensor(dict["value"]->t(), modelDir_, T);
     tensors_[name] = T;
     return true;
   }
@@ -424,10 +466,9 @@ bool ONNXModelLoader::loadOperator(const ONNX_NAMESPACE::NodeProto &op) {
 
     if (transA)
       A = G_.createTranspose(opName, A, {1, 0});
-    if (transB)
-      B = G_.createTranspose(opName, B, {1, 0});
 
-    MatMulNode *mul = G_.createMatMul(opName, A, B);
+    // The MatMul reads a transposed B directly.
+    MatMulNode *mul = G_.createMatMul(opName, A, B, transB);
     if (broadcastC) {
       int axis = mul->getResult().dims().size() - C.dims().size();
       C = G_.createBroadcast(opName, C, mul->getResult().dims(), axis);
@@ -456,12 +497,23 @@ bool ONNXModelLoader::loadOperator(const ONNX_NAMESPACE::NodeProto &op) {
 }
 
 void ONNXModelLoader::loadInitializers(ONNX_NAMESPACE::GraphProto &net) {
-  // Load the network initializaers:
-  for (const auto &in : net.initializer()) {
+  // Register the network initializers first, and then decode them in
+  // parallel: they are independent of each other and of the graph.
+  auto &initializers = *net.mutable_initializer();
+  std::vector<Tensor *> weights;
+  for (const auto &in : initializers) {
     Tensor *T = new Tensor();
-    loadTensor(in, T);
     tensors_[in.name()] = T;
+    weights.push_back(T);
   }
+
+  parallelForEachItem(weights.size(), [&](size_t i) {
+    auto &in = initializers[i];
+    loadTensor(in, modelDir_, weights[i]);
+    // Free the serialized payload right away, so that the weights are not
+    // held twice while the rest of the model loads.
+    ONNX_NAMESPACE::TensorProto().Swap(&in);
+  });
 }
 
 bool ONNXModelLoader::setOutputNodes(ONNX_NAMESPACE::GraphProto &net) {
@@ -471,7 +523,7 @@ bool ONNXModelLoader::setOutputNodes(ONNX_NAMESPACE::GraphProto &net) {
 
   for (int i = 0; i < net.output_size(); i++) {
     const auto &outputName = net.output(i).name();
-    auto r = getNodeValueByName(outputName);
+    auto r = getNodeValueOrCreateVariableByName(outputName);
     SaveNode *SN = G_.createSave("save_" + outputName, r);
     outputVarsByName_[outputName] = SN->getVariable();
   }
@@ -528,7 +580,9 @@ void ONNXModelLoader::checkInputs(ONNX_NAMESPACE::GraphProto &net,
 ONNXModelLoader::ONNXModelLoader(const std::string &modelDescFilename,
                                  llvm::ArrayRef<const char *> tensorNames,
                                  llvm::ArrayRef<Tensor *> tensors, Function &F)
-    : CommonOperatorLoader(tensorNames, tensors, F) {
+    : CommonOperatorLoader(tensorNames, tensors, F),
+      modelDir_(llvm::sys::path::parent_path(modelDescFilename)) {
+  ArenaScope arenaScope(&F.getParent()->getArena());
   // The ONNX model that we are deserializing.
   ONNX_NAMESPACE::ModelProto modelDef;
   if (!loadProto(modelDef, modelDescFilename)) {
@@ -536,7 +590,7 @@ ONNXModelLoader::ONNXModelLoader(const std::string &modelDescFilename,
   }
   setVersion(modelDef);
 
-  ONNX_NAMESPACE::GraphProto graphDef = modelDef.graph();
+  ONNX_NAMESPACE::GraphProto &graphDef = *modelDef.mutable_graph();
   checkInputs(graphDef, tensorNames, tensors);
 
   loadInitializers(graphDef);
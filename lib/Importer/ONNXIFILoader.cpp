@@ -47,12 +47,30 @@ void ModelLoader::loadInputs(ONNX_NAMESPACE::GraphProto &net) {
       continue;
     }
 
-    Tensor *T = new Tensor();
-    setTensorType(in.type(), T);
-    auto *var =
-        createAndRememberVariable(in.name(), *T, VisibilityKind::Public);
-    onnxNameToInputVars_.try_emplace(in.name(), var);
+    Tensor T;
+    setTensorType(in.type(), &T);
+    auto *PH =
+        G_.getParent()->createPlaceholder(&T.getType(), in.name(), false);
+    nodeValueByName_[in.name()] = NodeValue(PH, 0);
+    onnxNameToInputPlaceholders_.try_emplace(in.name(), PH);
+  }
+}
+
+bool ModelLoader::setOutputPlaceholders(ONNX_NAMESPACE::GraphProto &net) {
+  if (net.output_size() == 0) {
+    return false;
+  }
+
+  for (const auto &out : net.output()) {
+    const auto &outputName = out.name();
+    auto r = getNodeValueByName(outputName);
+    auto *PH =
+        G_.getParent()->createPlaceholder(r.getType(), outputName, false);
+    G_.createSave("save_" + outputName, r, PH);
+    onnxNameToOutputPlaceholders_.try_emplace(outputName, PH);
   }
+
+  return true;
 }
 
 /// Loads tensor \p T from the input \p in.
@@ -71,10 +89,7 @@ static bool loadWeight(const onnxTensorDescriptorV1 &in, Tensor *T) {
     T->reset(ElemKind::FloatTy, dims);
 
     auto TH = T->getHandle<>();
-    float *data = (float *)in.buffer;
-    for (size_t i = 0; i < TH.size(); ++i) {
-      TH.raw(i) = data[i];
-    }
+    TH = llvm::makeArrayRef((const float *)in.buffer, TH.size());
   } else if (in.dataType == ONNXIFI_DATATYPE_UINT64 ||
              in.dataType == ONNXIFI_DATATYPE_INT64) {
     const bool inDataSigned = in.dataType == ONNXIFI_DATATYPE_INT64;
@@ -121,7 +136,7 @@ std::unique_ptr<ModelLoader> ModelLoader::parse(
   }
   loader->setVersion(modelDef);
 
-  ONNX_NAMESPACE::GraphProto graphDef = modelDef.graph();
+  ONNX_NAMESPACE::GraphProto &graphDef = *modelDef.mutable_graph();
   if (!loader->loadWeights(weightsCount, weightDescriptors)) {
     return nullptr;
   }
@@ -131,7 +146,7 @@ std::unique_ptr<ModelLoader> ModelLoader::parse(
     return nullptr;
   }
 
-  if (!loader->setOutputNodes(graphDef)) {
+  if (!loader->setOutputPlaceholders(graphDef)) {
     return nullptr;
   }
 
@@ -146,7 +161,7 @@ ModelLoader::parseOperator(const void *onnxModel, size_t onnxModelSize) {
     return result;
   }
 
-  ONNX_NAMESPACE::GraphProto graph = modelDef.graph();
+  const ONNX_NAMESPACE::GraphProto &graph = modelDef.graph();
 
   // Only single operator is allowed to be in the onnxModel.
   if (graph.node_size() != 1) {
@@ -187,8 +202,10 @@ ModelLoader::parseOperator(const void *onnxModel, size_t onnxModelSize) {
     ADD_OP_MAPPING(ReshapeNodeKind, FloatTy);
   } else if (operation == "Sum") {
     ADD_OP_MAPPING(AddNodeKind, FloatTy);
+    ADD_OP_MAPPING(SumNodeKind, FloatTy);
   } else if (operation == "Gemm") {
     ADD_OP_MAPPING(ReshapeNodeKind, FloatTy);
+    // Only transA needs a Transpose, the MatMul reads a transposed B.
     ADD_OP_MAPPING(TransposeNodeKind, FloatTy);
     ADD_OP_MAPPING(MatMulNodeKind, FloatTy);
   }
@@ -197,5 +214,97 @@ ModelLoader::parseOperator(const void *onnxModel, size_t onnxModelSize) {
   return result;
 }
 
+/// Set \p dims to the dimensions of the tensor described by \p info, and
+/// \p sizeInBytes to its size. \returns false if a dimension is not known.
+static bool getKnownShape(const ONNX_NAMESPACE::ValueInfoProto &info,
+                          std::vector<size_t> &dims, uint64_t &sizeInBytes) {
+  const auto &tensorType = info.type().tensor_type();
+  dims.clear();
+  uint64_t numElements = 1;
+  for (const auto &d : tensorType.shape().dim()) {
+    if (!d.has_dim_value() || d.dim_value() <= 0) {
+      return false;
+    }
+    dims.push_back(d.dim_value());
+    numElements *= d.dim_value();
+  }
+  bool isInt64 = tensorType.elem_type() == ONNX_NAMESPACE::TensorProto::INT64;
+  sizeInBytes = numElements * (isInt64 ? sizeof(int64_t) : sizeof(float));
+  return true;
+}
+
+bool ModelLoader::estimateOperatorCost(const void *onnxModel,
+                                       size_t onnxModelSize, NodeCost &cost) {
+  ONNX_NAMESPACE::ModelProto modelDef;
+  if (!ONNXModelLoader::loadProto(modelDef, onnxModel, onnxModelSize)) {
+    return false;
+  }
+  const auto &graph = modelDef.graph();
+  if (graph.node_size() != 1) {
+    return false;
+  }
+
+  cost = NodeCost();
+  llvm::StringMap<std::vector<size_t>> dimsByName;
+  std::vector<size_t> dims;
+  uint64_t sizeInBytes;
+  for (const auto &in : graph.input()) {
+    if (!getKnownShape(in, dims, sizeInBytes)) {
+      return false;
+    }
+    cost.bytes += sizeInBytes;
+    dimsByName[in.name()] = dims;
+  }
+  uint64_t numOutputElements = 0;
+  for (const auto &out : graph.output()) {
+    if (!getKnownShape(out, dims, sizeInBytes)) {
+      return false;
+    }
+    cost.bytes += sizeInBytes;
+    uint64_t numElements = 1;
+    for (auto d : dims) {
+      numElements *= d;
+    }
+    numOutputElements += numElements;
+  }
+
+  // Every result element costs an operation, except for the operators that
+  // reduce over a dimension of their inputs.
+  const auto &node = graph.node(0);
+  const auto &operation = node.op_type();
+  uint64_t opsPerElement = 1;
+  if (operation == "Conv" && node.input_size() > 1) {
+    // The filter is laid out as [M, C / group, kH, kW].
+    auto it = dimsByName.find(node.input(1));
+    if (it == dimsByName.end() || it->second.size() < 2) {
+      return false;
+    }
+    opsPerElement = 2;
+    for (size_t i = 1, e = it->second.size(); i < e; i++) {
+      opsPerElement *= it->second[i];
+    }
+  } else if ((operation == "Gemm" || operation == "MatMul") &&
+             node.input_size() > 1) {
+    auto it = dimsByName.find(node.input(0));
+    if (it == dimsByName.end() || it->second.empty()) {
+      return false;
+    }
+    bool transA = false;
+    for (const auto &attr : node.attribute()) {
+      if (attr.name() == "transA") {
+        transA = attr.i() != 0;
+      }
+    }
+    const auto &lhsDims = it->second;
+    size_t k = lhsDims.back();
+    if (operation == "Gemm" && transA && lhsDims.size() == 2) {
+      k = lhsDims[0];
+    }
+    opsPerElement = 2 * k;
+  }
+  cost.flops = numOutputElements * opsPerElement;
+  return true;
+}
+
 } // namespace onnxifi
 } // namespace glow
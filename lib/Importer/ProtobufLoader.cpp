@@ -15,9 +15,13 @@
  */
 
 #include "glow/Importer/ProtobufLoader.h"
+#include "glow/Support/ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <string>
+#include <thread>
 
 namespace glow {
 
@@ -28,12 +32,246 @@ bool isArrayConstant(llvm::ArrayRef<size_t> a) {
   return true;
 }
 
+void parallelForEachItem(size_t numItems,
+                         llvm::function_ref<void(size_t)> fn) {
+  unsigned numThreads = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), numItems);
+  if (numThreads <= 1) {
+    for (size_t i = 0; i < numItems; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  // Every thread of the pool runs one chunk, which keeps claiming items
+  // until there are none left.
+  std::atomic<size_t> nextItem{0};
+  ThreadPool pool(numThreads);
+  pool.parallelFor(numThreads, 1, [&](size_t, size_t) {
+    for (size_t i = nextItem++; i < numItems; i = nextItem++) {
+      fn(i);
+    }
+  });
+}
+
+Tensor *foldReshape(const Tensor &T, llvm::ArrayRef<size_t> dims) {
+  auto *R = new Tensor(Type::newShape(T.getType(), dims));
+  assert(R->size() == T.size() && "Reshape changes the number of elements.");
+  const char *data = T.getUnsafePtr();
+  std::copy(data, data + T.getType().getSizeInBytes(), R->getUnsafePtr());
+  return R;
+}
+
+Tensor *foldSqueeze(const Tensor &T, llvm::ArrayRef<size_t> axes) {
+  std::vector<size_t> dims;
+  for (size_t i = 0, e = T.dims().size(); i < e; i++) {
+    if (std::find(axes.begin(), axes.end(), i) == axes.end()) {
+      dims.push_back(T.dims()[i]);
+    } else {
+      assert(T.dims()[i] == 1 && "The dimension to squeeze must be 1.");
+    }
+  }
+  return foldReshape(T, dims);
+}
+
+Tensor *foldExpandDims(const Tensor &T, llvm::ArrayRef<size_t> axes) {
+  std::vector<size_t> newAxes(axes.begin(), axes.end());
+  std::sort(newAxes.begin(), newAxes.end());
+  newAxes.erase(std::unique(newAxes.begin(), newAxes.end()), newAxes.end());
+
+  std::vector<size_t> dims;
+  auto inDims = T.dims();
+  for (size_t k = 0, i = 0, e = inDims.size() + newAxes.size(); k < e; k++) {
+    if (std::binary_search(newAxes.begin(), newAxes.end(), k)) {
+      dims.push_back(1);
+    } else {
+      assert(i < inDims.size() && "Axis expands outside of the result.");
+      dims.push_back(inDims[i++]);
+    }
+  }
+  return foldReshape(T, dims);
+}
+
+Tensor *foldGather(const Tensor &data, const Tensor &indices, size_t axis) {
+  auto dataDims = data.dims();
+  if (indices.getElementType() != ElemKind::Int64ITy ||
+      axis >= dataDims.size() || data.size() == 0) {
+    return nullptr;
+  }
+
+  // The indices replace the gathered axis in the shape of the result.
+  std::vector<size_t> dims(dataDims.begin(), dataDims.begin() + axis);
+  dims.insert(dims.end(), indices.dims().begin(), indices.dims().end());
+  dims.insert(dims.end(), dataDims.begin() + axis + 1, dataDims.end());
+  auto *R = new Tensor(Type::newShape(data.getType(), dims));
+
+  size_t numOuter = 1;
+  for (size_t i = 0; i < axis; i++) {
+    numOuter *= dataDims[i];
+  }
+  int64_t axisDim = dataDims[axis];
+  size_t sliceSize = data.getType().getSizeInBytes() / (numOuter * axisDim);
+  auto *idx = reinterpret_cast<const int64_t *>(indices.getUnsafePtr());
+  const char *src = data.getUnsafePtr();
+  char *dest = R->getUnsafePtr();
+  for (size_t n = 0; n < numOuter; n++) {
+    for (size_t i = 0, e = indices.size(); i < e; i++) {
+      int64_t k = idx[i] < 0 ? idx[i] + axisDim : idx[i];
+      assert(k >= 0 && k < axisDim && "Gather index is out of range.");
+      const char *slice = src + (n * axisDim + k) * sliceSize;
+      dest = std::copy(slice, slice + sliceSize, dest);
+    }
+  }
+  return R;
+}
+
+Tensor *foldConcat(llvm::ArrayRef<const Tensor *> inputs, size_t axis) {
+  std::vector<size_t> dims = inputs[0]->dims();
+  if (axis >= dims.size()) {
+    return nullptr;
+  }
+  dims[axis] = 0;
+  for (const Tensor *T : inputs) {
+    auto inDims = T->dims();
+    if (T->getElementType() != inputs[0]->getElementType() ||
+        inDims.size() != dims.size()) {
+      return nullptr;
+    }
+    for (size_t i = 0, e = dims.size(); i < e; i++) {
+      if (i != axis && inDims[i] != dims[i]) {
+        return nullptr;
+      }
+    }
+    dims[axis] += inDims[axis];
+  }
+  auto *R = new Tensor(Type::newShape(inputs[0]->getType(), dims));
+
+  size_t numOuter = 1;
+  for (size_t i = 0; i < axis; i++) {
+    numOuter *= dims[i];
+  }
+  if (numOuter == 0) {
+    return R;
+  }
+  char *dest = R->getUnsafePtr();
+  for (size_t n = 0; n < numOuter; n++) {
+    for (const Tensor *T : inputs) {
+      size_t blockSize = T->getType().getSizeInBytes() / numOuter;
+      const char *block = T->getUnsafePtr() + n * blockSize;
+      dest = std::copy(block, block + blockSize, dest);
+    }
+  }
+  return R;
+}
+
+/// Evaluates the arithmetic operator \p op of \p LHS and \p RHS into \p R,
+/// repeating the operand that has a single element.
+template <typename ElemTy>
+static void foldArithmeticImpl(char op, const Tensor &LHS, const Tensor &RHS,
+                               Tensor *R) {
+  auto *a = reinterpret_cast<const ElemTy *>(LHS.getUnsafePtr());
+  auto *b = reinterpret_cast<const ElemTy *>(RHS.getUnsafePtr());
+  auto *c = reinterpret_cast<ElemTy *>(R->getUnsafePtr());
+  size_t aStep = LHS.size() == 1 ? 0 : 1;
+  size_t bStep = RHS.size() == 1 ? 0 : 1;
+  for (size_t i = 0, e = R->size(); i < e; i++) {
+    ElemTy x = a[i * aStep];
+    ElemTy y = b[i * bStep];
+    switch (op) {
+    case '+':
+      c[i] = x + y;
+      break;
+    case '-':
+      c[i] = x - y;
+      break;
+    case '*':
+      c[i] = x * y;
+      break;
+    default:
+      c[i] = x / y;
+      break;
+    }
+  }
+}
+
+Tensor *foldArithmetic(llvm::StringRef typeName, const Tensor &LHS,
+                       const Tensor &RHS) {
+  ElemKind kind = LHS.getElementType();
+  if (kind != RHS.getElementType() ||
+      (kind != ElemKind::FloatTy && kind != ElemKind::Int64ITy)) {
+    return nullptr;
+  }
+
+  // Only the broadcasts that are the same in the ONNX and the Caffe2
+  // semantics are folded: that of a single element into the other operand.
+  const Tensor *shape = &LHS;
+  if (LHS.dims() != RHS.dims()) {
+    if (RHS.size() == 1 && RHS.dims().size() <= LHS.dims().size()) {
+      shape = &LHS;
+    } else if (LHS.size() == 1 && LHS.dims().size() <= RHS.dims().size()) {
+      shape = &RHS;
+    } else {
+      return nullptr;
+    }
+  }
+
+  char op = '/';
+  if (typeName == "Add") {
+    op = '+';
+  } else if (typeName == "Sub") {
+    op = '-';
+  } else if (typeName == "Mul") {
+    op = '*';
+  }
+  if (kind == ElemKind::Int64ITy && op == '/') {
+    // Leave an integer division by zero to the backends.
+    auto *b = reinterpret_cast<const int64_t *>(RHS.getUnsafePtr());
+    if (std::find(b, b + RHS.size(), 0) != b + RHS.size()) {
+      return nullptr;
+    }
+  }
+
+  auto *R = new Tensor(shape->getType());
+  if (kind == ElemKind::FloatTy) {
+    foldArithmeticImpl<float>(op, LHS, RHS, R);
+  } else {
+    foldArithmeticImpl<int64_t>(op, LHS, RHS, R);
+  }
+  return R;
+}
+
 Tensor *ProtobufLoader::getTensorByName(llvm::StringRef name) {
   assert(tensors_.count(name) &&
          "There is no tensor registered with this name.");
   return tensors_[name];
 }
 
+Tensor *ProtobufLoader::getConstantByNameOrNull(llvm::StringRef name) const {
+  auto it = tensors_.find(name);
+  if (it == tensors_.end()) {
+    return nullptr;
+  }
+  // A node registered under the same name, e.g. by an in-place operator,
+  // hides the tensor, unless it is the Variable created for the tensor.
+  auto *node = getNodeValueByNameOrNullNodeValue(name).getNode();
+  if (node) {
+    auto *V = llvm::dyn_cast<Variable>(node);
+    if (!V || !V->isPrivate()) {
+      return nullptr;
+    }
+  }
+  return it->second;
+}
+
+void ProtobufLoader::registerConstant(llvm::StringRef name, Tensor *T) {
+  auto it = tensors_.find(name);
+  if (it != tensors_.end()) {
+    delete it->second;
+  }
+  tensors_[name] = T;
+  nodeValueByName_.erase(name);
+}
+
 Variable *ProtobufLoader::getOutputByName(llvm::StringRef name) const {
   assert(outputVarsByName_.count(name) &&
          "There is no Variable registered with this name.");
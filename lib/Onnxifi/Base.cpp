@@ -16,14 +16,94 @@
 #include "Base.h"
 
 #include "glow/Importer/ONNXIFILoader.h"
+#include "glow/Support/Memory.h"
 
-#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <chrono>
+
+static llvm::cl::opt<unsigned> runTimeoutMs(
+    "onnxifi-run-timeout-ms",
+    llvm::cl::desc("Drop the inferences that are not done this many "
+                   "milliseconds after they are submitted, and signal their "
+                   "output events (0 for no deadline)"),
+    llvm::cl::init(0));
 
 namespace glow {
 namespace onnxifi {
 
+/// \returns the seconds elapsed since \p begin.
+static double secondsSince(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
 bool BackendId::isOpSupported(Kinded::Kind opKind, ElemKind elementTy) {
-  return executionEngine_.isOpSupported(opKind, elementTy);
+  return backend_->isOpSupported(opKind, elementTy);
+}
+
+namespace {
+/// A rough model of the time it takes to run an operator. The operators do
+/// max(flops, bytes * opsPerByte) operations, so that the ones that mostly
+/// move data are charged for their memory traffic.
+struct OffloadCostModel {
+  /// The fixed time of an offloaded run, in nanoseconds, which covers the
+  /// dispatch to the worker threads and the synchronization of the fences.
+  double overheadNs;
+  /// The operations per nanosecond that the backend sustains.
+  double backendOpsPerNs;
+  /// The operations per nanosecond that the framework sustains.
+  double hostOpsPerNs;
+  /// The number of operations that take as long as moving one byte.
+  double opsPerByte;
+};
+} // namespace
+
+/// Set \p model to the cost model of the backend \p kind. \returns false if
+/// the backend has none, and every operator that it supports is offloaded.
+///
+/// The estimates are deliberately coarse, and only need to put the crossover
+/// at the right order of magnitude. A vectorized core does a few float
+/// operations per nanosecond on the framework kernels, and streams about one
+/// byte per nanosecond when all cores share the memory bandwidth, hence 4
+/// operations per nanosecond and 8 operations per byte on the host.
+static bool getOffloadCostModel(BackendKind kind, OffloadCostModel &model) {
+  switch (kind) {
+  case BackendKind::CPU:
+    // A run hands the inputs over to a backend worker, the execution engine
+    // and the thread pool, and then signals the output fence: four thread
+    // wake-ups of about 5us. The JIT runs on the same cores as the framework,
+    // but splits the kernels between threads and fuses the element-wise
+    // ones, which is assumed to be worth a factor of 2. Operators of more
+    // than 160k operations are offloaded, e.g. a 64x64x20 matmul.
+    model = {20000, 8, 4, 8};
+    return true;
+  case BackendKind::OpenCL:
+    // Every run also waits for the enqueued kernels and copies to finish,
+    // about 100us with a discrete device, which sustains a few percent of its
+    // peak on single operators. Operators of more than 430k operations are
+    // offloaded.
+    model = {100000, 64, 4, 8};
+    return true;
+  case BackendKind::Interpreter:
+    // The reference implementation never beats the framework, and is only
+    // used to test the integration, which needs the operators offloaded.
+    return false;
+  }
+  llvm_unreachable("Unknown backend kind");
+}
+
+bool BackendId::isOffloadProfitable(const NodeCost &cost) const {
+  OffloadCostModel model;
+  if (!getOffloadCostModel(kind_, model)) {
+    return true;
+  }
+  double work = std::max<double>(cost.flops, cost.bytes * model.opsPerByte);
+  double backendNs = model.overheadNs + work / model.backendOpsPerNs;
+  double hostNs = work / model.hostOpsPerNs;
+  return backendNs < hostNs;
 }
 
 bool Event::signal() {
@@ -33,21 +113,90 @@ bool Event::signal() {
       return false;
     }
     fired_ = true;
+    // The listeners are called with the lock held, so that removeListeners
+    // does not return while one of them runs.
+    for (auto &listener : listeners_) {
+      listener.second();
+    }
+    listeners_.clear();
   }
   cond_.notify_all();
   return true;
 }
 
+void Event::addListener(const void *owner, std::function<void()> listener) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (fired_) {
+    listener();
+    return;
+  }
+  listeners_.emplace_back(owner, std::move(listener));
+}
+
+void Event::removeListeners(const void *owner) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto isOwned = [owner](const decltype(listeners_)::value_type &listener) {
+    return listener.first == owner;
+  };
+  listeners_.erase(
+      std::remove_if(listeners_.begin(), listeners_.end(), isOwned),
+      listeners_.end());
+}
+
 void Event::wait() {
   std::unique_lock<std::mutex> guard(mutex_);
   cond_.wait(guard, [this] { return fired_ == true; });
 }
 
+Backend::Backend(BackendIdPtr backendId) : backendIdPtr_(backendId) {
+  // The workers copy the inputs of the inferences whose fences are signalled
+  // and submit them, for the graphs of the backend in parallel.
+  unsigned numWorkers = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned i = 0; i < numWorkers; i++) {
+    workers_.emplace_back(&Backend::workerLoop, this);
+  }
+}
+
+Backend::~Backend() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  tasksCV_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void Backend::post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  tasksCV_.notify_one();
+}
+
+void Backend::workerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    tasksCV_.wait(lock, [this] { return shutdown_ || !tasks_.empty(); });
+    if (tasks_.empty()) {
+      // Shutting down, and every queued task has been taken.
+      return;
+    }
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
 onnxStatus Graph::initGraph(const void *onnxModel, size_t onnxModelSize,
                             uint32_t weightCount,
                             const onnxTensorDescriptorV1 *weightDescriptors) {
   // TODO: support multiple functions here.
-  function_ = backendPtr_->getEE().getModule().createFunction("inference");
+  function_ = executionEngine_.getModule().createFunction("inference");
 
   std::unique_ptr<ModelLoader> loader = ModelLoader::parse(
       onnxModel, onnxModelSize, weightCount, weightDescriptors, *function_);
@@ -56,48 +205,243 @@ onnxStatus Graph::initGraph(const void *onnxModel, size_t onnxModelSize,
     return ONNXIFI_STATUS_INTERNAL_ERROR;
   }
 
-  onnxNameToInputVar_ = loader->getInputVarsMapping();
-  onnxNameToOutputNode_ = loader->getOutputVarsMapping();
+  onnxNameToInputPH_ = loader->getInputPlaceholdersMapping();
+  onnxNameToOutputPH_ = loader->getOutputPlaceholdersMapping();
+  // Until setIO binds the buffers of the caller, the runs use tensors of
+  // their own.
+  io_ = std::make_shared<IOBindings>();
+  for (auto &PH : onnxNameToInputPH_) {
+    ctx_.allocate(PH.second);
+    io_->ctx.allocate(PH.second);
+  }
+  for (auto &PH : onnxNameToOutputPH_) {
+    ctx_.allocate(PH.second);
+    io_->ctx.allocate(PH.second);
+  }
 
   // Emit IR for the graph and compile it.
-  backendPtr_->getEE().compile(CompilationMode::Infer, function_, ctx_);
+  executionEngine_.compile(CompilationMode::Infer, function_, ctx_);
+
+  return ONNXIFI_STATUS_SUCCESS;
+}
+
+Graph::~Graph() {
+  // Nobody is waiting for the results of the inferences anymore.
+  releaseToken_.cancel();
+  std::deque<QueuedRun> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    releasing_ = true;
+    dropped.swap(queuedRuns_);
+  }
+  // The listeners of the input fences take mutex_, so they are removed
+  // without holding it.
+  for (auto &run : dropped) {
+    if (!run.ready) {
+      run.inputEvent->removeListeners(this);
+    }
+    run.outputEvent->signal();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  idleCV_.wait(lock, [this] {
+    return numRunsInFlight_ == 0 && numPostedTasks_ == 0;
+  });
+}
 
+void Graph::runAfter(EventPtr inputEvent, EventPtr outputEvent) {
+  uint64_t ticket;
+  {
+    // The inference uses the buffers that are set now, even if setIO is
+    // called again before its input fence is signalled.
+    std::lock_guard<std::mutex> lock(mutex_);
+    ticket = numQueuedRuns_++;
+    queuedRuns_.push_back({ticket, false, inputEvent, outputEvent, io_,
+                           std::chrono::steady_clock::now()});
+  }
+  // No thread waits for the fence. Its listener marks the inference as ready
+  // and asks a worker to submit it if it is the next one.
+  inputEvent->addListener(this, [this, ticket]() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &run : queuedRuns_) {
+      if (run.ticket == ticket) {
+        run.ready = true;
+        break;
+      }
+    }
+    scheduleSubmit();
+  });
+}
+
+onnxStatus Graph::run(EventPtr outputEvent) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queuedRuns_.push_back({numQueuedRuns_++, true, nullptr, outputEvent, io_,
+                           std::chrono::steady_clock::now()});
+  }
+  // The inference is submitted by this thread, unless it has to wait for the
+  // inferences queued before it, which a worker submits later.
+  submitReadyRuns();
   return ONNXIFI_STATUS_SUCCESS;
 }
 
-onnxStatus Graph::run() {
-  // Copy tensors from the input addresses to the Glow tensors.
-  llvm::SmallVector<Tensor *, 4> tensors;
-  llvm::SmallVector<Variable *, 4> vars;
-  for (auto inputVar : inputVarToBuffer_) {
-    auto *var = inputVar.first;
-    auto *type = var->getType();
-    void *inputBuffer = reinterpret_cast<void *>(inputVar.second);
-    tensors.push_back(new Tensor(inputBuffer, type));
-    vars.push_back(var);
+bool Graph::canSubmitNextRun() const {
+  if (releasing_ || submitting_ || queuedRuns_.empty() ||
+      !queuedRuns_.front().ready) {
+    return false;
+  }
+  // The execution engine runs the inferences one after another, so only the
+  // copies of the inputs could overwrite the tensors that an inference in
+  // flight reads.
+  const auto &io = queuedRuns_.front().io;
+  return numRunsInFlight_ == 0 || io != lastSubmittedIO_ ||
+         io->inputsToCopy.empty();
+}
+
+void Graph::scheduleSubmit() {
+  if (!canSubmitNextRun()) {
+    return;
+  }
+  numPostedTasks_++;
+  backendPtr_->post([this]() {
+    submitReadyRuns();
+    std::lock_guard<std::mutex> lock(mutex_);
+    numPostedTasks_--;
+    idleCV_.notify_all();
+  });
+}
+
+void Graph::submitReadyRuns() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (canSubmitNextRun()) {
+    QueuedRun run = std::move(queuedRuns_.front());
+    queuedRuns_.pop_front();
+    submitting_ = true;
+    numRunsInFlight_++;
+    lastSubmittedIO_ = run.io;
+    lock.unlock();
+    submitRun(run);
+    lock.lock();
+    submitting_ = false;
   }
+}
 
-  // Run inference.
-  auto &EE = backendPtr_->getEE();
-  updateVariables(vars, tensors);
-  EE.run();
+void Graph::submitRun(const QueuedRun &run) {
+  {
+    std::lock_guard<std::mutex> lock(profileMutex_);
+    runProfile_.inputFenceSeconds += secondsSince(run.queued);
+  }
 
-  // Copy outputs to the addresses specified in the outputNodeToBuffer_.
-  for (auto outputVar : outputNodeToBuffer_) {
-    void *outputAddress = reinterpret_cast<void *>(outputVar.second);
-    const Tensor &res = outputVar.first->getPayload();
+  // Copy the inputs whose buffers cannot back their placeholders.
+  auto io = run.io;
+  auto copyBegin = std::chrono::steady_clock::now();
+  for (auto input : io->inputsToCopy) {
+    Tensor *T = io->ctx.get(input.first);
+    memcpy(T->getUnsafePtr(), reinterpret_cast<void *>(input.second),
+           T->getType().getSizeInBytes());
+  }
+  double inputCopySeconds = secondsSince(copyBegin);
 
-    memcpy(outputAddress, res.getUnsafePtr(),
-           res.size() * res.getType().getElementSize());
+  // Run inference. The outputs that are not written to their buffers in place
+  // are copied to them when the execution completes.
+  auto token = std::make_shared<CancellationToken>(&releaseToken_);
+  if (runTimeoutMs) {
+    token->setTimeout(std::chrono::milliseconds(runTimeoutMs));
   }
+  auto outputEvent = run.outputEvent;
+  auto executionBegin = std::chrono::steady_clock::now();
+  executionEngine_.runAsync(
+      io->ctx, token,
+      [this, io, outputEvent, inputCopySeconds, executionBegin]() {
+        double executionSeconds = secondsSince(executionBegin);
+        auto outputCopyBegin = std::chrono::steady_clock::now();
+        for (auto output : io->outputsToCopy) {
+          const Tensor *T = io->ctx.get(output.first);
+          memcpy(reinterpret_cast<void *>(output.second), T->getUnsafePtr(),
+                 T->getType().getSizeInBytes());
+        }
+        double outputCopySeconds = secondsSince(outputCopyBegin);
+        {
+          // The profile stays locked while the fence is signalled, so that a
+          // caller reading it once the fence is signalled sees the whole
+          // inference.
+          std::lock_guard<std::mutex> lock(profileMutex_);
+          runProfile_.numRuns++;
+          runProfile_.inputCopySeconds += inputCopySeconds;
+          runProfile_.executionSeconds += executionSeconds;
+          runProfile_.outputCopySeconds += outputCopySeconds;
+          auto signalBegin = std::chrono::steady_clock::now();
+          outputEvent->signal();
+          runProfile_.outputFenceSeconds += secondsSince(signalBegin);
+        }
+        // The next inference may have waited for this one.
+        std::lock_guard<std::mutex> lock(mutex_);
+        numRunsInFlight_--;
+        scheduleSubmit();
+        idleCV_.notify_all();
+      });
+}
 
-  return ONNXIFI_STATUS_SUCCESS;
+Graph::RunProfile Graph::getRunProfile() {
+  std::lock_guard<std::mutex> lock(profileMutex_);
+  return runProfile_;
+}
+
+void Graph::resetRunProfile() {
+  std::lock_guard<std::mutex> lock(profileMutex_);
+  runProfile_ = RunProfile();
+}
+
+/// \returns true if the tensor descriptor \p desc describes a tensor of the
+/// type \p ty.
+static bool isSameType(const onnxTensorDescriptorV1 &desc, TypeRef ty) {
+  switch (ty->getElementType()) {
+  case ElemKind::FloatTy:
+    if (desc.dataType != ONNXIFI_DATATYPE_FLOAT32) {
+      return false;
+    }
+    break;
+  case ElemKind::Int64ITy:
+    if (desc.dataType != ONNXIFI_DATATYPE_INT64 &&
+        desc.dataType != ONNXIFI_DATATYPE_UINT64) {
+      return false;
+    }
+    break;
+  default:
+    return false;
+  }
+  auto dims = ty->dims();
+  if (desc.dimensions != dims.size()) {
+    return false;
+  }
+  for (size_t i = 0, e = dims.size(); i < e; i++) {
+    if (desc.shape[i] != dims[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Graph::bindBuffer(IOBindings &io, Placeholder *PH,
+                       const onnxTensorDescriptorV1 &desc) {
+  // The backends may rely on the alignment of the tensor payloads.
+  auto *buffer = reinterpret_cast<void *>(desc.buffer);
+  if (desc.memoryType == ONNXIFI_MEMORY_TYPE_CPU &&
+      desc.buffer % TensorAlignment == 0 && isSameType(desc, PH->getType())) {
+    io.ctx.insert(PH, Tensor(buffer, PH->getType()));
+    return true;
+  }
+  io.ctx.allocate(PH);
+  return false;
 }
 
 onnxStatus Graph::setIO(uint32_t inputsCount,
                         const onnxTensorDescriptorV1 *inputDescriptors,
                         uint32_t outputsCount,
                         const onnxTensorDescriptorV1 *outputDescriptors) {
+  // The inferences in flight keep the bindings they were submitted with, so
+  // the new ones are built aside and replace them at the end.
+  auto io = std::make_shared<IOBindings>();
+
   // Process inputs.
   for (unsigned i = 0; i < inputsCount; ++i) {
     const auto &in = inputDescriptors[i];
@@ -106,26 +450,45 @@ onnxStatus Graph::setIO(uint32_t inputsCount,
     // The issue needs to be fixed on the caller side first. Once it is fixed
     // we'd need to handle missing variable accordingly here, e.g., return
     // ONNXIFI_STATUS_UNIDENTIFIED_NAME.
-    if (!onnxNameToInputVar_.count(in.name)) {
+    if (!onnxNameToInputPH_.count(in.name)) {
       continue;
     }
 
-    auto *input = onnxNameToInputVar_[in.name];
-    inputVarToBuffer_.insert({input, in.buffer});
+    auto *input = onnxNameToInputPH_[in.name];
+    if (!io->ctx.count(input) && !bindBuffer(*io, input, in)) {
+      io->inputsToCopy.insert({input, in.buffer});
+    }
   }
 
   // Process outputs.
   for (unsigned i = 0; i < outputsCount; ++i) {
     const auto &out = outputDescriptors[i];
 
-    if (!onnxNameToOutputNode_.count(out.name)) {
+    if (!onnxNameToOutputPH_.count(out.name)) {
       return ONNXIFI_STATUS_UNIDENTIFIED_NAME;
     }
 
-    auto *output = onnxNameToOutputNode_[out.name];
-    outputNodeToBuffer_.insert({output, out.buffer});
+    auto *output = onnxNameToOutputPH_[out.name];
+    if (!io->ctx.count(output) && !bindBuffer(*io, output, out)) {
+      io->outputsToCopy.insert({output, out.buffer});
+    }
+  }
+
+  // The inputs and outputs that were not set get tensors of their own, since
+  // every placeholder of the function must be backed during the runs.
+  for (auto &PH : onnxNameToInputPH_) {
+    if (!io->ctx.count(PH.second)) {
+      io->ctx.allocate(PH.second);
+    }
+  }
+  for (auto &PH : onnxNameToOutputPH_) {
+    if (!io->ctx.count(PH.second)) {
+      io->ctx.allocate(PH.second);
+    }
   }
 
+  std::lock_guard<std::mutex> lock(mutex_);
+  io_ = std::move(io);
   return ONNXIFI_STATUS_SUCCESS;
 }
 
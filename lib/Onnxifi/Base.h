@@ -22,8 +22,14 @@
 #include "onnx/onnxifi.h"
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringMap.h"
@@ -37,30 +43,63 @@ public:
   /// Create Glow ONNXIFI backend identifier with the
   /// given Glow backend \p kind and \p id.
   explicit BackendId(glow::BackendKind kind, int id)
-      : id_(id), executionEngine_(kind) {}
+      : id_(id), kind_(kind), backend_(createBackend(kind)) {}
 
   /// Verify that given operation kind is supported by the backend.
   bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy);
 
-  /// \returns Execution Engine associated with the Backend.
-  glow::ExecutionEngine &getEE() { return executionEngine_; }
+  /// \returns true if an operator with the estimated cost \p cost is
+  /// expected to run faster when it is offloaded to the backend than in the
+  /// framework, taking the fixed overhead of an offloaded run into account.
+  /// Always true for the Interpreter, which is only used for testing.
+  bool isOffloadProfitable(const NodeCost &cost) const;
+
+  /// \returns the kind of the Glow backend.
+  glow::BackendKind getBackendKind() const { return kind_; }
 
 private:
   int id_;
-  glow::ExecutionEngine executionEngine_;
+  glow::BackendKind kind_;
+  /// Answers the queries about the supported operations. The graphs compile
+  /// their functions with instances of their own.
+  std::unique_ptr<glow::Backend> backend_;
 };
 
 typedef BackendId *BackendIdPtr;
 
+/// An initialized backend. It owns the worker threads that copy the inputs of
+/// the runs submitted to its graphs and start the runs, once their input
+/// fences are signalled. The workers never wait for a fence themselves.
 class Backend {
 public:
-  explicit Backend(BackendIdPtr backendId) : backendIdPtr_(backendId) {}
+  explicit Backend(BackendIdPtr backendId);
+
+  /// Finishes the queued tasks and stops the worker threads.
+  ~Backend();
+
+  /// \returns the kind of the Glow backend.
+  glow::BackendKind getBackendKind() const {
+    return backendIdPtr_->getBackendKind();
+  }
 
-  /// \returns Execution Engine associated with the Backend.
-  glow::ExecutionEngine &getEE() { return backendIdPtr_->getEE(); }
+  /// Queue \p task for execution on a worker thread.
+  void post(std::function<void()> task);
 
 private:
+  /// The main loop of a worker thread.
+  void workerLoop();
+
   BackendIdPtr backendIdPtr_;
+  /// The worker threads.
+  std::vector<std::thread> workers_;
+  /// The tasks waiting for a worker, in submission order.
+  std::deque<std::function<void()>> tasks_;
+  /// Set when the backend is being destroyed.
+  bool shutdown_{false};
+  /// Protects the fields above.
+  std::mutex mutex_;
+  /// Notifies the workers about new tasks and about the shutdown.
+  std::condition_variable tasksCV_;
 };
 
 typedef Backend *BackendPtr;
@@ -77,17 +116,56 @@ public:
   /// Check if event was signalled.
   bool isSignalled() { return fired_; }
 
+  /// Call \p listener once the event is signalled, on the thread that signals
+  /// it, or right away if it already is. \p owner identifies the listener
+  /// for removeListeners. The listeners must not wait for the event.
+  void addListener(const void *owner, std::function<void()> listener);
+
+  /// Forget the listeners of \p owner that have not been called. None of
+  /// them is running once this returns.
+  void removeListeners(const void *owner);
+
 private:
   std::atomic<bool> fired_;
   std::mutex mutex_;
   std::condition_variable cond_;
+  /// The listeners to call when the event is signalled, with their owners.
+  std::vector<std::pair<const void *, std::function<void()>>> listeners_;
 };
 
 typedef Event *EventPtr;
 
+/// A graph compiled for a backend. Every graph owns an execution engine, so
+/// the graphs of a backend are compiled separately and run concurrently.
 class Graph {
 public:
-  explicit Graph(BackendPtr backendPtr) : backendPtr_(backendPtr) {}
+  /// The time spent in the steps of the inferences of a graph, in seconds,
+  /// summed over the inferences that completed since the profile was reset.
+  struct RunProfile {
+    /// The number of inferences.
+    uint64_t numRuns{0};
+    /// From the submission of the inferences to their start on a worker of
+    /// the backend, once their input fence is signalled.
+    double inputFenceSeconds{0};
+    /// The copies of the inputs whose buffers do not back their placeholders.
+    double inputCopySeconds{0};
+    /// From the submission to the execution engine to the completion.
+    double executionSeconds{0};
+    /// The copies of the outputs that are not written in place.
+    double outputCopySeconds{0};
+    /// The signalling of the output fence, which wakes up its waiters.
+    double outputFenceSeconds{0};
+  };
+
+  explicit Graph(BackendPtr backendPtr)
+      : backendPtr_(backendPtr),
+        executionEngine_(backendPtr->getBackendKind()) {}
+
+  /// Cancels the submitted inferences of the graph, which are dropped if they
+  /// have not started and stopped at the next instruction if they have, and
+  /// blocks until they are done. The output events of the dropped inferences
+  /// are signalled.
+  ~Graph();
 
   BackendPtr backend() { return backendPtr_; }
 
@@ -100,38 +178,151 @@ public:
   /// Setup Glow graph in preparation for the inference.
   /// Set input memory addresses for inputs based on the \p inputDescriptors.
   /// Set output memory addresses for outputs based on
-  /// the \p outputDescriptors.
+  /// the \p outputDescriptors. The buffers that match the types of their
+  /// placeholders and are aligned like the tensor payloads back the
+  /// placeholders directly; the others are copied before and after each run.
   onnxStatus setIO(uint32_t inputsCount,
                    const onnxTensorDescriptorV1 *inputDescriptors,
                    uint32_t outputsCount,
                    const onnxTensorDescriptorV1 *outputDescriptors);
 
-  /// Run inference.
-  onnxStatus run();
+  /// Run inference asynchronously. \p outputEvent is signalled once the
+  /// outputs are written. The input buffers may be read until then. With
+  /// -onnxifi-run-timeout-ms, the inferences that are not done by their
+  /// deadline are dropped and their event is signalled with undefined
+  /// outputs.
+  onnxStatus run(EventPtr outputEvent);
+
+  /// Queue an inference that starts once \p inputEvent is signalled, on a
+  /// worker thread of the backend, and signals \p outputEvent when the
+  /// outputs are written. The method returns without waiting for either
+  /// event or for the inferences in flight, so several inferences may be in
+  /// flight. They use the inputs and outputs that are set when they are
+  /// queued, and they start in the order they are queued.
+  void runAfter(EventPtr inputEvent, EventPtr outputEvent);
+
+  /// \returns the profile of the inferences that completed since the last
+  /// resetRunProfile().
+  RunProfile getRunProfile();
+
+  /// Forget the inferences that completed so far.
+  void resetRunProfile();
 
 private:
+  /// The inputs and outputs set by a call to setIO. The inferences hold the
+  /// bindings that were set when they were submitted, so a later setIO does
+  /// not change the buffers of the inferences in flight.
+  struct IOBindings {
+    /// The tensors that back the inputs and outputs during the runs. They
+    /// alias the buffers of the caller where possible.
+    Context ctx;
+    /// The inputs whose buffers are copied to their tensors before each run.
+    llvm::DenseMap<Placeholder *, onnxPointer> inputsToCopy;
+    /// The outputs whose tensors are copied to their buffers after each run.
+    llvm::DenseMap<Placeholder *, onnxPointer> outputsToCopy;
+  };
+
+  /// An inference queued by run or runAfter that has not been submitted to
+  /// the execution engine yet.
+  struct QueuedRun {
+    /// Identifies the inference for the listener of its input fence.
+    uint64_t ticket;
+    /// Set once the input fence is signalled.
+    bool ready;
+    EventPtr inputEvent;
+    EventPtr outputEvent;
+    std::shared_ptr<IOBindings> io;
+    /// When the inference was queued.
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  /// Bind the placeholder \p PH to the buffer of \p desc in \p io. \returns
+  /// true if the buffer backs the placeholder directly, false if it must be
+  /// copied.
+  bool bindBuffer(IOBindings &io, Placeholder *PH,
+                  const onnxTensorDescriptorV1 &desc);
+
+  /// \returns true if the first queued inference can be submitted now. It
+  /// waits for the inferences in flight only if it copies its inputs into
+  /// the tensors they use. Called with mutex_ held.
+  bool canSubmitNextRun() const;
+
+  /// Post a task that submits the queued inferences to a worker of the
+  /// backend, if the first one can be submitted. Called with mutex_ held.
+  void scheduleSubmit();
+
+  /// Submit the queued inferences to the execution engine, in order, until
+  /// one of them cannot be submitted yet. The inputs are copied without
+  /// holding mutex_.
+  void submitReadyRuns();
+
+  /// Copy the inputs of \p run and enqueue it on the execution engine.
+  void submitRun(const QueuedRun &run);
+
   BackendPtr backendPtr_;
+
+  /// The engine holding the module and the compiled function of the graph.
+  glow::ExecutionEngine executionEngine_;
+
   Function *function_;
 
-  /// This is the compilation context that represents a single thread.
-  /// TODO: Once we finish the migration to placeholders we'll need to manage
-  /// the state properly.
+  /// Protects the bindings and the queue of the inferences below, which are
+  /// used from the threads of the callers, of the workers and of the
+  /// execution engine. It is never held while an inference runs or waits.
+  std::mutex mutex_;
+
+  /// The context the function is compiled with, which holds a tensor for
+  /// every input and output placeholder.
   Context ctx_;
 
-  /// Mapping between ONNX name for the input variable and Glow variable.
-  llvm::StringMap<Variable *> onnxNameToInputVar_;
+  /// The inputs and outputs of the inferences submitted from now on.
+  std::shared_ptr<IOBindings> io_;
+
+  /// The parent of the tokens of the inferences of the graph, cancelled when
+  /// the graph is released.
+  CancellationToken releaseToken_;
+
+  /// The inferences that have not been submitted to the execution engine, in
+  /// the order they start.
+  std::deque<QueuedRun> queuedRuns_;
+
+  /// The number of inferences queued so far, which is the ticket of the next
+  /// one.
+  uint64_t numQueuedRuns_{0};
+
+  /// Set while a thread submits queued inferences, so that they reach the
+  /// execution engine in order.
+  bool submitting_{false};
+
+  /// The number of inferences submitted to the execution engine that have
+  /// not completed.
+  size_t numRunsInFlight_{0};
+
+  /// The bindings of the last inference submitted to the execution engine.
+  std::shared_ptr<IOBindings> lastSubmittedIO_;
+
+  /// The number of tasks posted to the workers of the backend that have not
+  /// finished.
+  size_t numPostedTasks_{0};
+
+  /// Set by the destructor, to drop the inferences that are still queued.
+  bool releasing_{false};
+
+  /// Notifies the destructor when an inference or a task completes.
+  std::condition_variable idleCV_;
+
+  /// Mapping between ONNX name for the input and Glow placeholder.
+  llvm::StringMap<Placeholder *> onnxNameToInputPH_;
 
-  /// Mapping between ONNX name for the output variable and Glow output
-  /// node.
-  llvm::StringMap<Variable *> onnxNameToOutputNode_;
+  /// Mapping between ONNX name for the output and Glow placeholder.
+  llvm::StringMap<Placeholder *> onnxNameToOutputPH_;
 
-  /// Mapping between input var and the actual memory address.
-  /// Inputs will be read from these addresses.
-  llvm::DenseMap<Variable *, onnxPointer> inputVarToBuffer_;
+  /// The profile of the inferences, which the execution threads update when
+  /// the inferences complete.
+  RunProfile runProfile_;
 
-  /// Mapping between output var and the actual memory address.
-  /// Results must be written to these addresses.
-  llvm::DenseMap<Variable *, onnxPointer> outputNodeToBuffer_;
+  /// Protects runProfile_.
+  std::mutex profileMutex_;
 };
 
 typedef Graph *GraphPtr;
@@ -167,6 +167,16 @@ onnxGetBackendCompatibility(onnxBackendID backendID, size_t onnxModelSize,
     }
   }
 
+  // The operator is supported, but offloading it only pays off if it does
+  // enough work to hide the overhead of an offloaded run. Otherwise the
+  // framework is told to keep it, unless the cost cannot be estimated.
+  glow::NodeCost cost;
+  if (glow::onnxifi::ModelLoader::estimateOperatorCost(onnxModel, onnxModelSize,
+                                                       cost) &&
+      !glowBackendId->isOffloadProfitable(cost)) {
+    return ONNXIFI_STATUS_FALLBACK;
+  }
+
   return ONNXIFI_STATUS_SUCCESS;
 }
 
@@ -374,25 +384,20 @@ onnxRunGraph(onnxGraph graph, const onnxMemoryFenceV1 *inputFence,
     return ONNXIFI_STATUS_UNSUPPORTED_TAG;
   }
 
+  auto *inputEvent = static_cast<glow::onnxifi::EventPtr>(inputFence->event);
+  if (!inputEvent) {
+    return ONNXIFI_STATUS_INVALID_EVENT;
+  }
+
   auto initStatus = onnxInitEvent(glowGraph->backend(), &outputFence->event);
   if (initStatus != ONNXIFI_STATUS_SUCCESS) {
     return initStatus;
   }
 
-  // Wait for all inputs to be ready.
-  auto waitStatus = onnxWaitEvent(inputFence->event);
-  if (waitStatus != ONNXIFI_STATUS_SUCCESS) {
-    return waitStatus;
-  }
-
-  // TODO: Implement async graph run procedure. For now run that sync.
-  glowGraph->run();
-
-  auto signalStatus = onnxSignalEvent(outputFence->event);
-  if (signalStatus != ONNXIFI_STATUS_SUCCESS) {
-    return signalStatus;
-  }
-
+  // A worker of the backend starts the execution once the inputs are ready,
+  // and the execution signals the output fence once it completes.
+  glowGraph->runAfter(inputEvent, static_cast<glow::onnxifi::EventPtr>(
+                                      outputFence->event));
   return ONNXIFI_STATUS_SUCCESS;
 }
 
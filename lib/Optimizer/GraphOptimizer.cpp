@@ -14,16 +14,25 @@
  * limitations under the License.
  */
 
+#define DEBUG_TYPE "graph-optimizer"
+
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Node.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/Graph/Utils.h"
 #include "glow/Optimizer/Optimizer.h"
 #include "glow/Quantization/Base/Base.h"
+#include "glow/Support/Debug.h"
 
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <functional>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -31,14 +40,26 @@ llvm::cl::OptionCategory graphOptCat("Graph Optimizations Options");
 llvm::cl::opt<unsigned> constVarDedupSizeOpt(
     "const_var_dedup_size",
     llvm::cl::desc(
-        "Max number of elements allowed for deduplicating constant variables"),
-    llvm::cl::Optional, llvm::cl::init(256), llvm::cl::cat(graphOptCat));
+        "Max number of elements allowed for deduplicating constant variables "
+        "(0 for no limit)"),
+    llvm::cl::Optional, llvm::cl::init(0), llvm::cl::cat(graphOptCat));
 
 using namespace glow;
 using llvm::cast;
 using llvm::dyn_cast;
 using llvm::isa;
 
+STATISTIC(NumLayoutTransposesRemoved,
+          "Number of transposes removed by the layout assignment");
+STATISTIC(NumLayoutTransposesAdded,
+          "Number of transposes added by the layout assignment");
+STATISTIC(NumDeadNodesErased, "Number of dead nodes erased");
+STATISTIC(NumRewriteVisits, "Number of nodes visited by the graph rewrites");
+STATISTIC(NumTransposesSunk, "Number of transposes sunk below other nodes");
+STATISTIC(NumTransposesCancelled,
+          "Number of identity or mutually inverse transposes removed");
+STATISTIC(NumRelusSunk, "Number of RELUs sunk below concats");
+
 static bool shouldDeleteNode(Node *N) {
   // In general, nodes who have side effects are retained.
   if (N->hasSideEffects()) {
@@ -60,41 +81,103 @@ static bool shouldDeleteNode(Node *N) {
   return true;
 }
 
-/// Dead code elimination.
-static void DCE(Function *F) {
-  auto &nodes = F->getNodes();
-  auto &vars = F->getParent()->getVars();
+namespace {
+/// The nodes that a graph rewrite still has to visit. The nodes are visited
+/// once however many times they are added before their visit, and the ones
+/// that are erased before their visit are skipped.
+class NodeWorklist {
+  /// The function of the nodes.
+  Function *F_;
+  std::vector<Node *> worklist_;
+  std::unordered_set<Node *> queued_;
 
-  std::vector<VariablesList::iterator> erasedVars{};
-  std::vector<NodesList::iterator> erasedNodes{};
+public:
+  explicit NodeWorklist(Function *F) : F_(F) {}
 
-  // Remove unused nodes. Do not remove unused vars because they are the
-  // interface to the user program.
-  while (true) {
-    bool changedLocally = false;
-    for (auto it = nodes.begin(), e = nodes.end(); it != e;) {
-      if (!shouldDeleteNode(&*it)) {
-        ++it;
-        continue;
-      }
+  /// Add \p N, unless it is not a node of the function, e.g. a Variable.
+  void push(Node *N) {
+    if (N->getParent() == F_ && queued_.insert(N).second) {
+      worklist_.push_back(N);
+    }
+  }
 
-      erasedNodes.push_back(it);
-      ++it;
-      changedLocally = true;
+  /// Add \p N and its users.
+  void pushWithUsers(Node *N) {
+    push(N);
+    for (auto &U : N->getUsers()) {
+      push(U.getUser());
     }
+  }
+
+  /// Forget \p N, which is about to be erased.
+  void remove(Node *N) { queued_.erase(N); }
 
-    while (!erasedNodes.empty()) {
-      auto it = erasedNodes.back();
-      F->eraseNode(it);
-      erasedNodes.pop_back();
+  /// \returns the next node to visit, or nullptr if there is none.
+  Node *pop() {
+    while (!worklist_.empty()) {
+      Node *N = worklist_.back();
+      worklist_.pop_back();
+      if (queued_.erase(N)) {
+        return N;
+      }
     }
+    return nullptr;
+  }
+};
+} // namespace
 
-    if (!changedLocally) {
-      break;
+/// Erases the nodes in \p dead, which must have no users, and then the nodes
+/// that this leaves without users, transitively. The erased nodes are removed
+/// from \p worklist, if given, and the nodes that lost a user are added to it
+/// with their remaining users. Variables are left to DCE(), and the nodes of
+/// other functions, e.g. Placeholders, are left alone.
+static void eraseDeadNodes(Function *F, std::vector<Node *> dead,
+                           NodeWorklist *worklist = nullptr) {
+  while (!dead.empty()) {
+    Node *N = dead.back();
+    dead.pop_back();
+
+    // Each input is visited once, even if N uses several of its results.
+    llvm::SmallPtrSet<Node *, 4> inputs;
+    for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+      inputs.insert(N->getNthInput(i).getNode());
+    }
+    if (worklist) {
+      worklist->remove(N);
+    }
+    F->eraseNode(N);
+    NumDeadNodesErased++;
+
+    for (Node *in : inputs) {
+      if (in->getParent() != F) {
+        continue;
+      }
+      if (shouldDeleteNode(in)) {
+        dead.push_back(in);
+      } else if (worklist) {
+        worklist->pushWithUsers(in);
+      }
+    }
+  }
+}
+
+/// Dead code elimination. The nodes that are dead are erased together with
+/// the ones that only they use, in time linear in the size of the function.
+static void DCE(Function *F) {
+  auto &vars = F->getParent()->getVars();
+
+  // Remove unused nodes. Do not remove unused vars because they are the
+  // interface to the user program.
+  std::vector<Node *> dead;
+  for (auto &N : F->getNodes()) {
+    if (shouldDeleteNode(&N)) {
+      dead.push_back(&N);
     }
   }
+  eraseDeadNodes(F, std::move(dead));
 
   // Delete unused variables.
+  std::vector<VariablesList::iterator> erasedVars{};
   for (auto it = vars.begin(), e = vars.end(); it != e;) {
     if (!shouldDeleteNode(*it)) {
       ++it;
@@ -111,6 +194,43 @@ static void DCE(Function *F) {
   }
 }
 
+/// Applies \p rewrite to the nodes of \p F until none of them changes. A node
+/// is only visited again when a rewrite changes its inputs or its uses: the
+/// nodes created by a rewrite are visited with their users, and the nodes that
+/// it leaves dead are erased right away, as they would hide the single uses of
+/// their inputs, which are visited with their users as well. This keeps the
+/// cost linear in the size of the function, where sweeping over all of it
+/// until a fixed-point is reached is quadratic on deep graphs.
+/// \returns true if any node was rewritten.
+static bool rewriteToFixpoint(Function *F,
+                              const std::function<bool(Node *)> &rewrite) {
+  auto &nodes = F->getNodes();
+  NodeWorklist worklist(F);
+
+  // Visit the nodes in their order in the function first.
+  for (auto it = nodes.rbegin(), e = nodes.rend(); it != e; ++it) {
+    worklist.push(&*it);
+  }
+
+  bool changed = false;
+  while (Node *N = worklist.pop()) {
+    NumRewriteVisits++;
+    Node *last = &nodes.back();
+    if (!rewrite(N)) {
+      continue;
+    }
+    changed = true;
+    for (auto it = std::next(last->getIterator()), e = nodes.end(); it != e;
+         ++it) {
+      worklist.pushWithUsers(&*it);
+    }
+    if (shouldDeleteNode(N)) {
+      eraseDeadNodes(F, {N}, &worklist);
+    }
+  }
+  return changed;
+}
+
 /// \returns true if the \p shuffle corresponds to an identity operation, false
 /// otherwise.
 static bool isIdentityShuffle(llvm::ArrayRef<unsigned> shuffle) {
@@ -211,249 +331,252 @@ static Node *simplifyNode(Node *node, Function *F) {
   return node;
 }
 
-/// Code Sinking.
-/// \returns true if code sinking was successful.
-static bool sinkCode(Function *F) {
-  auto &nodes = F->getNodes();
-  bool changed = false;
-  // For each node:
-  for (auto &N : nodes) {
-    auto *node = &N;
-    // Sink Transpose below batch normalization nodes:
-    if (auto *BN = dyn_cast<BatchNormalizationNode>(node)) {
-      auto *TR = dyn_cast<TransposeNode>(BN->getInput());
+/// Sinks the transposes and RELUs above \p node below it, or removes the
+/// transposes that cancel out.
+/// \returns true if \p node was rewritten.
+static bool sinkNode(Function *F, Node *node) {
+  // Sink Transpose below batch normalization nodes:
+  if (auto *BN = dyn_cast<BatchNormalizationNode>(node)) {
+    auto *TR = dyn_cast<TransposeNode>(BN->getInput());
 
-      if (!TR) {
-        continue;
-      }
-
-      // Figure out where we transposed the channel index for batch
-      // normalization.
-      unsigned_t idx = BN->getChannelIdx();
-      unsigned_t newChannelIdx = TR->getShuffle()[idx];
+    if (!TR) {
+      return false;
+    }
 
-      auto *NewBN = F->createBatchNormalization(
-          BN->getName(), TR->getInput(), BN->getBias(), BN->getScale(),
-          BN->getMean(), BN->getVar(), newChannelIdx, BN->getEpsilon(),
-          BN->getMomentum());
-      auto *newTR = F->createTranspose(TR->getName(), NewBN, TR->getShuffle());
+    // Figure out where we transposed the channel index for batch
+    // normalization.
+    unsigned_t idx = BN->getChannelIdx();
+    unsigned_t newChannelIdx = TR->getShuffle()[idx];
 
-      BN->getResult().replaceAllUsesOfWith(newTR);
-      changed = true;
-      continue;
-    }
+    auto *NewBN = F->createBatchNormalization(
+        BN->getName(), TR->getInput(), BN->getBias(), BN->getScale(),
+        BN->getMean(), BN->getVar(), newChannelIdx, BN->getEpsilon(),
+        BN->getMomentum());
+    auto *newTR = F->createTranspose(TR->getName(), NewBN, TR->getShuffle());
 
-    // Sink Transpose below batch RELU nodes.
-    if (auto *RL = dyn_cast<ReluNode>(node)) {
-      auto *TR = dyn_cast<TransposeNode>(RL->getInput());
+    BN->getResult().replaceAllUsesOfWith(newTR);
+    NumTransposesSunk++;
+    return true;
+  }
 
-      if (!TR) {
-        continue;
-      }
+  // Sink Transpose below batch RELU nodes.
+  if (auto *RL = dyn_cast<ReluNode>(node)) {
+    auto *TR = dyn_cast<TransposeNode>(RL->getInput());
 
-      // Keep the same quantization parameters for ReLU output, but
-      // change the shape to appropriate value.
-      auto reluOutTy = F->getParent()->uniqueTypeWithNewShape(
-          RL->getResult().getType(), TR->getInput().dims());
-      auto *NRL = F->createRELU(RL->getName(), TR->getInput(), reluOutTy);
-      auto *newTR = F->createTranspose(TR->getName(), NRL, TR->getShuffle());
-      RL->getResult().replaceAllUsesOfWith(newTR);
-      changed = true;
-      continue;
+    if (!TR) {
+      return false;
     }
 
-    // Sink Transpose below Sigmoid nodes.
-    if (auto *SI = dyn_cast<SigmoidNode>(node)) {
-      auto *TR = dyn_cast<TransposeNode>(SI->getInput());
+    // Keep the same quantization parameters for ReLU output, but
+    // change the shape to appropriate value.
+    auto reluOutTy = F->getParent()->uniqueTypeWithNewShape(
+        RL->getResult().getType(), TR->getInput().dims());
+    auto *NRL = F->createRELU(RL->getName(), TR->getInput(), reluOutTy);
+    auto *newTR = F->createTranspose(TR->getName(), NRL, TR->getShuffle());
+    RL->getResult().replaceAllUsesOfWith(newTR);
+    NumTransposesSunk++;
+    return true;
+  }
 
-      if (!TR) {
-        continue;
-      }
+  // Sink Transpose below Sigmoid nodes.
+  if (auto *SI = dyn_cast<SigmoidNode>(node)) {
+    auto *TR = dyn_cast<TransposeNode>(SI->getInput());
 
-      auto *NSI = F->createSigmoid(SI->getName(), TR->getInput());
-      auto *newTR = F->createTranspose(TR->getName(), NSI, TR->getShuffle());
-      SI->getResult().replaceAllUsesOfWith(newTR);
-      changed = true;
-      continue;
+    if (!TR) {
+      return false;
     }
 
-    // Sink Transpose below Tanh nodes.
-    if (auto *TN = dyn_cast<TanhNode>(node)) {
-      auto *TR = dyn_cast<TransposeNode>(TN->getInput());
+    auto *NSI = F->createSigmoid(SI->getName(), TR->getInput());
+    auto *newTR = F->createTranspose(TR->getName(), NSI, TR->getShuffle());
+    SI->getResult().replaceAllUsesOfWith(newTR);
+    NumTransposesSunk++;
+    return true;
+  }
 
-      if (!TR) {
-        continue;
-      }
+  // Sink Transpose below Tanh nodes.
+  if (auto *TN = dyn_cast<TanhNode>(node)) {
+    auto *TR = dyn_cast<TransposeNode>(TN->getInput());
 
-      auto *NTN = F->createTanh(TN->getName(), TR->getInput());
-      auto *newTR = F->createTranspose(TR->getName(), NTN, TR->getShuffle());
-      TN->getResult().replaceAllUsesOfWith(newTR);
-      changed = true;
-      continue;
+    if (!TR) {
+      return false;
     }
 
-    // Remove 'identity' transpose operations.
-    if (auto *TR = dyn_cast<TransposeNode>(node)) {
-      auto mask = TR->getShuffle();
+    auto *NTN = F->createTanh(TN->getName(), TR->getInput());
+    auto *newTR = F->createTranspose(TR->getName(), NTN, TR->getShuffle());
+    TN->getResult().replaceAllUsesOfWith(newTR);
+    NumTransposesSunk++;
+    return true;
+  }
 
-      if (isIdentityShuffle(mask)) {
-        TR->getResult().replaceAllUsesOfWith(TR->getInput());
-        changed = true;
-        continue;
-      }
+  // Remove 'identity' transpose operations.
+  if (auto *TR = dyn_cast<TransposeNode>(node)) {
+    auto mask = TR->getShuffle();
+
+    if (isIdentityShuffle(mask)) {
+      TR->getResult().replaceAllUsesOfWith(TR->getInput());
+      NumTransposesCancelled++;
+      return true;
     }
+  }
 
-    // Merge consecutive Transpose operations.
-    if (auto *TR1 = dyn_cast<TransposeNode>(node)) {
-      auto *TR2 = dyn_cast<TransposeNode>(TR1->getInput());
+  // Merge consecutive Transpose operations.
+  if (auto *TR1 = dyn_cast<TransposeNode>(node)) {
+    auto *TR2 = dyn_cast<TransposeNode>(TR1->getInput());
 
-      if (!TR2) {
-        continue;
-      }
+    if (!TR2) {
+      return false;
+    }
 
-      auto mask1 = TR1->getShuffle();
-      auto mask2 = TR2->getShuffle();
-      assert(mask1.size() == mask2.size() && "Invalid mask size");
+    auto mask1 = TR1->getShuffle();
+    auto mask2 = TR2->getShuffle();
+    assert(mask1.size() == mask2.size() && "Invalid mask size");
 
-      // The two transposes are reversing one another. We can skip both of
-      // them alltogether.
-      if (isIdentityShuffle(mask1, mask2)) {
-        TR1->getResult().replaceAllUsesOfWith(TR2->getInput());
-        changed = true;
-        continue;
-      }
+    // The two transposes are reversing one another. We can skip both of
+    // them alltogether.
+    if (isIdentityShuffle(mask1, mask2)) {
+      TR1->getResult().replaceAllUsesOfWith(TR2->getInput());
+      NumTransposesCancelled++;
+      return true;
     }
+  }
 
-    // Sink Transpose below Arithmetic nodes. Note: For simplicity, we
-    // assume for the arithmetic node, LHS is the 0th input, RHS is 1st, and
-    // Result is 0th result.
-    if (node->isArithmetic()) {
+  // Sink Transpose below Arithmetic nodes. Note: For simplicity, we
+  // assume for the arithmetic node, LHS is the 0th input, RHS is 1st, and
+  // Result is 0th result.
+  if (node->isArithmetic()) {
 #define GET_LHS(NODE_) NODE_->getNthInput(0)
 #define GET_RHS(NODE_) NODE_->getNthInput(1)
-      TransposeNode *LTR = dyn_cast<TransposeNode>(GET_LHS(node));
-      TransposeNode *RTR = dyn_cast<TransposeNode>(GET_RHS(node));
-
-      if (!LTR || !RTR) {
-        // If one of the sides is a splat, it can be seen as
-        // transpose (splat').
-        if (isa<SplatNode>(GET_LHS(node)) && RTR) {
-          // Build splat' for LHS.
-          auto *SN = dyn_cast<SplatNode>(GET_LHS(node));
-          auto *NS = F->createSplat("splat", RTR->getInput().getType(),
-                                    SN->getValue());
-          LTR = F->createTranspose("transpose", NS, RTR->getShuffle());
-          changed = true;
-        } else if (isa<SplatNode>(GET_RHS(node)) && LTR) {
-          // Build splat' for RHS.
-          auto *SN = dyn_cast<SplatNode>(GET_RHS(node));
-          auto *NS = F->createSplat("splat", LTR->getInput().getType(),
-                                    SN->getValue());
-          RTR = F->createTranspose("transpose", NS, LTR->getShuffle());
-          changed = true;
-        } else {
-          continue;
-        }
+    TransposeNode *LTR = dyn_cast<TransposeNode>(GET_LHS(node));
+    TransposeNode *RTR = dyn_cast<TransposeNode>(GET_RHS(node));
+
+    if (!LTR || !RTR) {
+      // If one of the sides is a splat, it can be seen as
+      // transpose (splat').
+      if (isa<SplatNode>(GET_LHS(node)) && RTR) {
+        // Build splat' for LHS.
+        auto *SN = dyn_cast<SplatNode>(GET_LHS(node));
+        auto *NS = F->createSplat("splat", RTR->getInput().getType(),
+                                  SN->getValue());
+        LTR = F->createTranspose("transpose", NS, RTR->getShuffle());
+      } else if (isa<SplatNode>(GET_RHS(node)) && LTR) {
+        // Build splat' for RHS.
+        auto *SN = dyn_cast<SplatNode>(GET_RHS(node));
+        auto *NS = F->createSplat("splat", LTR->getInput().getType(),
+                                  SN->getValue());
+        RTR = F->createTranspose("transpose", NS, LTR->getShuffle());
+      } else {
+        return false;
       }
+    }
 #undef GET_LHS
 #undef GET_RHS
-      // The masks of the transposes on both sizes must match.
-      if (LTR->getShuffle() != RTR->getShuffle()) {
-        continue;
-      }
+    // The masks of the transposes on both sizes must match.
+    if (LTR->getShuffle() != RTR->getShuffle()) {
+      return false;
+    }
 
-      Node *newAN = nullptr;
+    Node *newAN = nullptr;
 
 #define ARITHMETIC_CASE(NODE_NAME_)                                            \
-  case glow::Kinded::Kind::NODE_NAME_##NodeKind:                               \
-    newAN = F->create##NODE_NAME_(                                             \
-        node->getName(),                                                       \
-        F->getParent()->uniqueTypeWithNewShape(                                \
-            node->getType(0), LTR->getInput().getType()->dims()),              \
-        LTR->getInput(), RTR->getInput());                                     \
-    break;
+case glow::Kinded::Kind::NODE_NAME_##NodeKind:                               \
+  newAN = F->create##NODE_NAME_(                                             \
+      node->getName(),                                                       \
+      F->getParent()->uniqueTypeWithNewShape(                                \
+          node->getType(0), LTR->getInput().getType()->dims()),              \
+      LTR->getInput(), RTR->getInput());                                     \
+  break;
 
 #define BOOLEAN_OP_CASE(NODE_NAME_)                                            \
-  case glow::Kinded::Kind::NODE_NAME_##NodeKind:                               \
-    newAN = F->create##NODE_NAME_(node->getName(), LTR->getInput(),            \
-                                  RTR->getInput());                            \
-    break;
-
-      switch (node->getKind()) {
-        ARITHMETIC_CASE(Add);
-        ARITHMETIC_CASE(Mul);
-        ARITHMETIC_CASE(Sub);
-        ARITHMETIC_CASE(Div);
-        ARITHMETIC_CASE(Max);
-        ARITHMETIC_CASE(Min);
-        BOOLEAN_OP_CASE(CmpLTE);
-        BOOLEAN_OP_CASE(CmpEQ);
-      default:
-        llvm_unreachable("Unhandled node");
-      }
+case glow::Kinded::Kind::NODE_NAME_##NodeKind:                               \
+  newAN = F->create##NODE_NAME_(node->getName(), LTR->getInput(),            \
+                                RTR->getInput());                            \
+  break;
+
+    switch (node->getKind()) {
+      ARITHMETIC_CASE(Add);
+      ARITHMETIC_CASE(Mul);
+      ARITHMETIC_CASE(Sub);
+      ARITHMETIC_CASE(Div);
+      ARITHMETIC_CASE(Max);
+      ARITHMETIC_CASE(Min);
+      BOOLEAN_OP_CASE(CmpLTE);
+      BOOLEAN_OP_CASE(CmpEQ);
+    default:
+      llvm_unreachable("Unhandled node");
+    }
 #undef BOOLEAN_OP_CASE
 #undef ARITHMETIC_CASE
 
-      changed = true;
-      auto *newTR =
-          F->createTranspose(LTR->getName(), newAN, LTR->getShuffle());
+    auto *newTR =
+        F->createTranspose(LTR->getName(), newAN, LTR->getShuffle());
 #define GET_RESULT(NODE_) NODE_->getNthResult(0)
-      GET_RESULT(node).replaceAllUsesOfWith(newTR);
+    GET_RESULT(node).replaceAllUsesOfWith(newTR);
 #undef GET_RESULT
+    NumTransposesSunk++;
+    return true;
+  }
+
+  // Sink RELU below batch concat nodes.
+  if (auto *CN = dyn_cast<ConcatNode>(node)) {
+    if (CN->getInputs().size() != 2) {
+      return false;
     }
+    auto LInput = CN->getInputs()[0];
+    auto RInput = CN->getInputs()[1];
+    auto *L = dyn_cast<ReluNode>(LInput);
+    auto *R = dyn_cast<ReluNode>(RInput);
 
-    // Sink RELU below batch concat nodes.
-    if (auto *CN = dyn_cast<ConcatNode>(node)) {
-      if (CN->getInputs().size() != 2) {
-        continue;
-      }
-      auto LInput = CN->getInputs()[0];
-      auto RInput = CN->getInputs()[1];
-      auto *L = dyn_cast<ReluNode>(LInput);
-      auto *R = dyn_cast<ReluNode>(RInput);
+    if (L && R) {
+      auto *newCN = F->createConcat(
+          CN->getName(), {L->getInput(), R->getInput()}, CN->getDim());
+      auto *newRL =
+          F->createRELU(L->getName(), newCN, CN->getResult().getType());
+      CN->getResult().replaceAllUsesOfWith(newRL);
+      NumRelusSunk++;
+      return true;
+    }
+  }
 
-      if (L && R) {
-        auto *newCN = F->createConcat(
-            CN->getName(), {L->getInput(), R->getInput()}, CN->getDim());
-        auto *newRL =
-            F->createRELU(L->getName(), newCN, CN->getResult().getType());
-        CN->getResult().replaceAllUsesOfWith(newRL);
-      }
+  // Sink Transpose below concat nodes.
+  if (auto *CN = dyn_cast<ConcatNode>(node)) {
+    if (CN->getInputs().size() != 2) {
+      return false;
     }
+    auto LInput = CN->getInputs()[0];
+    auto RInput = CN->getInputs()[1];
+    auto *L = dyn_cast<TransposeNode>(LInput);
+    auto *R = dyn_cast<TransposeNode>(RInput);
 
-    // Sink Transpose below concat nodes.
-    if (auto *CN = dyn_cast<ConcatNode>(node)) {
-      if (CN->getInputs().size() != 2) {
-        continue;
-      }
-      auto LInput = CN->getInputs()[0];
-      auto RInput = CN->getInputs()[1];
-      auto *L = dyn_cast<TransposeNode>(LInput);
-      auto *R = dyn_cast<TransposeNode>(RInput);
+    // Both sides must be a transpose instruction.
+    if (!L || !R) {
+      return false;
+    }
 
-      // Both sides must be a transpose instruction.
-      if (!L || !R) {
-        continue;
-      }
+    // If the shuffle masks don't agree then bail out.
+    if (L->getShuffle() != R->getShuffle()) {
+      return false;
+    }
 
-      // If the shuffle masks don't agree then bail out.
-      if (L->getShuffle() != R->getShuffle()) {
-        continue;
-      }
+    // Figure out where we transposed the channel index for batch
+    // normalization.
+    unsigned_t idx = CN->getDim();
+    unsigned_t newChannelIdx = L->getShuffle()[idx];
 
-      // Figure out where we transposed the channel index for batch
-      // normalization.
-      unsigned_t idx = CN->getDim();
-      unsigned_t newChannelIdx = L->getShuffle()[idx];
+    auto *newCN = F->createConcat(
+        CN->getName(), {L->getInput(), R->getInput()}, newChannelIdx);
+    auto *newTR = F->createTranspose(L->getName(), newCN, L->getShuffle());
+    CN->getResult().replaceAllUsesOfWith(newTR);
+    NumTransposesSunk++;
+    return true;
+  }
 
-      auto *newCN = F->createConcat(
-          CN->getName(), {L->getInput(), R->getInput()}, newChannelIdx);
-      auto *newTR = F->createTranspose(L->getName(), newCN, L->getShuffle());
-      CN->getResult().replaceAllUsesOfWith(newTR);
-      changed = true;
-    }
-  } // For all nodes in the graph.
+  return false;
+}
 
-  return changed;
+/// Code Sinking.
+/// \returns true if code sinking was successful.
+static bool sinkCode(Function *F) {
+  return rewriteToFixpoint(F, [F](Node *N) { return sinkNode(F, N); });
 }
 
 /// \returns True if node A may depend on the result of B. The relationship
@@ -533,6 +656,10 @@ static void mergeMatMul(Function *F) {
       if (MM->getResult().getType()->isQuantizedType()) {
         continue;
       }
+      // The merged matrices are concatenated in the untransposed layout.
+      if (MM->getTransposeRHS()) {
+        continue;
+      }
 
       rightMatrixUsers[MM->getRHS().getNode()].push_back(MM);
       leftMatrixUsers[MM->getLHS().getNode()].push_back(MM);
@@ -870,43 +997,68 @@ static void optimizeBatchNorm(Function *F) {
       Variable *biasV = cast<Variable>(BN->getBias());
       Variable *meanV = cast<Variable>(BN->getMean());
       Variable *var = cast<Variable>(BN->getVar());
-
-      auto filterH = filterV->getHandle<>();
-
-      auto cbiasH = cbiasV->getHandle<>();
-
-      auto scaleH = scaleV->getHandle<>();
-      auto biasH = biasV->getHandle<>();
-      auto meanH = meanV->getHandle<>();
-      auto varH = var->getHandle<>();
-
-      // Update the filter/bias variables of the Conv node.
-      auto epsilon = BN->getEpsilon();
-      for (size_t i = 0, e = filterH.size(); i < e; i++) {
-        // Dimension zero is the 'channel' dimension. If we ever change the
-        // layout of the filter then we need to change this optimization.
-        size_t channelId = filterH.getDimForPtr(0, i);
-        float var = varH.at({channelId});
-        float stdvar = 1.0f / std::sqrt(var + epsilon);
-        float gamma = scaleH.at({channelId});
-        float A = gamma * stdvar;
-        filterH.raw(i) = filterH.raw(i) * A;
-      }
-
-      for (size_t i = 0, e = cbiasH.size(); i < e; i++) {
-        // Dimension zero is the 'channel' dimension. If we ever change the
-        // layout of the filter then we need to change this optimization.
-        size_t channelId = cbiasH.getDimForPtr(0, i);
-        float mu = meanH.at({channelId});
-        float var = varH.at({channelId});
-        float stdvar = 1.0f / std::sqrt(var + epsilon);
-        float gamma = scaleH.at({channelId});
-        float beta = biasH.at({channelId});
-        float A = gamma * stdvar;
-        float B = beta - mu * A;
-        cbiasH.raw(i) = cbiasH.raw(i) * A + B;
+      Variable *vars[] = {filterV, cbiasV, scaleV, biasV, meanV, var};
+      if (std::any_of(std::begin(vars), std::end(vars),
+                      [](Variable *V) { return !V->isPrivate(); })) {
+        continue;
       }
 
+      // The filter and the bias of the Conv node are derived from the
+      // variables, so that new weights can be folded in the same way.
+      auto epsilon = BN->getEpsilon();
+      auto *M = F->getParent();
+      auto *newFilterV = M->getDerivedVariable(
+          {filterV, scaleV, var}, filterV->getType(),
+          "batchnorm-filter," + std::to_string(epsilon),
+          [epsilon](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+            auto filterH = srcs[0]->getHandle<>();
+            auto scaleH = srcs[1]->getHandle<>();
+            auto varH = srcs[2]->getHandle<>();
+            auto newFilterH = T.getHandle<>();
+            for (size_t i = 0, e = filterH.size(); i < e; i++) {
+              // Dimension zero is the 'channel' dimension. If we ever change
+              // the layout of the filter then we need to change this
+              // optimization.
+              size_t channelId = filterH.getDimForPtr(0, i);
+              float var = varH.at({channelId});
+              float stdvar = 1.0f / std::sqrt(var + epsilon);
+              float gamma = scaleH.at({channelId});
+              float A = gamma * stdvar;
+              newFilterH.raw(i) = filterH.raw(i) * A;
+            }
+            return true;
+          });
+
+      auto *newBiasV = M->getDerivedVariable(
+          {cbiasV, scaleV, biasV, meanV, var}, cbiasV->getType(),
+          "batchnorm-bias," + std::to_string(epsilon),
+          [epsilon](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+            auto cbiasH = srcs[0]->getHandle<>();
+            auto scaleH = srcs[1]->getHandle<>();
+            auto biasH = srcs[2]->getHandle<>();
+            auto meanH = srcs[3]->getHandle<>();
+            auto varH = srcs[4]->getHandle<>();
+            auto newBiasH = T.getHandle<>();
+            for (size_t i = 0, e = cbiasH.size(); i < e; i++) {
+              // Dimension zero is the 'channel' dimension. If we ever change
+              // the layout of the filter then we need to change this
+              // optimization.
+              size_t channelId = cbiasH.getDimForPtr(0, i);
+              float mu = meanH.at({channelId});
+              float var = varH.at({channelId});
+              float stdvar = 1.0f / std::sqrt(var + epsilon);
+              float gamma = scaleH.at({channelId});
+              float beta = biasH.at({channelId});
+              float A = gamma * stdvar;
+              float B = beta - mu * A;
+              newBiasH.raw(i) = cbiasH.raw(i) * A + B;
+            }
+            return true;
+          });
+
+      // The variables are only used by the Conv node.
+      filterV->getOutput().replaceAllUsesOfWith(newFilterV);
+      cbiasV->getOutput().replaceAllUsesOfWith(newBiasV);
       BN->getResult().replaceAllUsesOfWith(CV);
     }
   } // For all nodes in the graph.
@@ -1135,6 +1287,32 @@ static void optimizeConcatNodes(Function *F) {
   }
 }
 
+/// Absorb the 2D transposes that feed the RHS of matrix multiplications into
+/// the TransposeRHS flag of the MatMul, so that the backends read the
+/// transposed layout directly instead of materializing the transpose.
+static void foldTransposeIntoMatMul(Function *F) {
+  auto &nodes = F->getNodes();
+
+  for (auto &node : nodes) {
+    auto *MM = dyn_cast<MatMulNode>(&node);
+    if (!MM) {
+      continue;
+    }
+    auto *TN = dyn_cast<TransposeNode>(MM->getRHS());
+    if (!TN || TN->getShuffle().size() != 2 || TN->getShuffle()[0] != 1) {
+      continue;
+    }
+    // The transpose of a transposed operand is the original layout.
+    auto *NMM =
+        F->createMatMul(MM->getName(), MM->getResult().getType(), MM->getLHS(),
+                        TN->getInput(), !MM->getTransposeRHS());
+    if (MM->hasPredicate()) {
+      NMM->setPredicate(MM->getPredicate());
+    }
+    MM->getResult().replaceAllUsesOfWith(NMM);
+  }
+}
+
 /// Simplify and canonicalize arithmetic nodes by detecting simple arithmetic
 /// identities.
 static void optimizeArithmeticNodes(Function *F) {
@@ -1193,38 +1371,516 @@ static void optimizeTranspose(Function *F) {
     if (!V || !V->hasOneUse() || !V->isPrivate()) {
       continue;
     }
-    // Create a new variable NV to hold the transposed result.
-    auto *NV =
-        F->getParent()->createVariable(TN->getResult().getType(), V->getName(),
-                                       V->getVisibilityKind(), V->isTraining());
-    // Transpose the value of V into NV.
-    genericTranspose(&V->getPayload(), &NV->getPayload(), TN->getShuffle());
+    // Get a variable NV that holds the transposed value of V, which the
+    // clones of F share.
+    std::string recipe = "transpose";
+    for (auto idx : TN->getShuffle()) {
+      recipe += "," + std::to_string(idx);
+    }
+    std::vector<unsigned_t> shuffle(TN->getShuffle().begin(),
+                                    TN->getShuffle().end());
+    auto *NV = F->getParent()->getDerivedVariable(
+        {V}, TN->getResult().getType(), recipe,
+        [shuffle](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+          genericTranspose(srcs[0], &T, shuffle);
+          return true;
+        });
     // Rewrite uses of TN to reference NV.
     TN->getResult().replaceAllUsesOfWith(NV);
   }
 }
 
+/// \returns true if the node \p N computes its result elementwise or along a
+/// single dimension, so that it can operate in any layout. The regions of
+/// such nodes are the ones whose layout assignLayouts() chooses.
+static bool isLayoutAgnostic(const Node *N) {
+  if (N->getNumResults() != 1 || N->hasPredicate()) {
+    return false;
+  }
+  switch (N->getKind()) {
+  case Kinded::Kind::SigmoidNodeKind:
+  case Kinded::Kind::TanhNodeKind:
+    // The quantized variants have an output type of their own.
+    return !N->getType(0)->isQuantizedType();
+  case Kinded::Kind::ReluNodeKind:
+  case Kinded::Kind::BatchNormalizationNodeKind:
+  case Kinded::Kind::ConcatNodeKind:
+    return true;
+  default:
+    return N->isArithmetic();
+  }
+}
+
+/// \returns the number of leading inputs of the layout agnostic node \p N that
+/// are in the layout of its result. The other inputs of batch normalization
+/// are per-channel vectors.
+static unsigned getNumLayoutInputs(const Node *N) {
+  return isa<BatchNormalizationNode>(N) ? 1 : N->getNumInputs();
+}
+
+/// \returns the shuffle of the transpose that is equivalent to transposing
+/// with \p first and then with \p second.
+static std::vector<unsigned_t>
+composeShuffles(llvm::ArrayRef<unsigned_t> first,
+                llvm::ArrayRef<unsigned_t> second) {
+  assert(first.size() == second.size() && "Invalid mask size");
+  std::vector<unsigned_t> shuffle(second.size());
+  for (size_t i = 0, e = second.size(); i < e; i++) {
+    shuffle[i] = first[second[i]];
+  }
+  return shuffle;
+}
+
+/// \returns the shuffle that reverses \p shuffle.
+static std::vector<unsigned_t>
+invertShuffle(llvm::ArrayRef<unsigned_t> shuffle) {
+  std::vector<unsigned_t> inverse(shuffle.size());
+  for (size_t i = 0, e = shuffle.size(); i < e; i++) {
+    inverse[shuffle[i]] = i;
+  }
+  return inverse;
+}
+
+/// \returns an existing transpose of \p V in \p F with the mask \p shuffle, or
+/// nullptr if there is none. Variables are shared, so their transposes may
+/// belong to other functions.
+static TransposeNode *findTranspose(const Function *F, NodeValue V,
+                                    llvm::ArrayRef<unsigned_t> shuffle) {
+  for (auto &U : V.getUsers()) {
+    auto *TR = dyn_cast<TransposeNode>(U.getUser());
+    if (TR && TR->getParent() == F && TR->getInput() == V &&
+        TR->getShuffle() == shuffle) {
+      return TR;
+    }
+  }
+  return nullptr;
+}
+
+namespace {
+
+/// A connected set of layout agnostic nodes of a function. All the values of a
+/// region are kept in one layout, which is described by the shuffle Q: a value
+/// v of the original function is computed as v' such that v is
+/// Transpose(v', Q). Transposes are needed at the boundary of the region,
+/// unless they cancel out with the transposes that are already there.
+class LayoutRegion {
+  /// The function of the region.
+  Function *F_;
+  /// The compilation mode of the function.
+  CompilationMode mode_;
+  /// The region of every node of the function that is in a region.
+  const std::unordered_map<const Node *, unsigned> &regionOf_;
+  /// The index of this region.
+  unsigned id_;
+  /// The nodes of the region, in topological order.
+  std::vector<Node *> nodes_;
+  /// The values defined outside of the region that nodes of the region use in
+  /// their layout.
+  std::vector<NodeValue> inputs_;
+
+  /// \returns true if \p N is a node of the region.
+  bool contains(const Node *N) const {
+    auto it = regionOf_.find(N);
+    return it != regionOf_.end() && it->second == id_;
+  }
+
+  /// \returns the transpose that computes \p V if it only feeds the region,
+  /// in which case it is replaced by the region's own transpose.
+  TransposeNode *getAbsorbedTranspose(NodeValue V) const {
+    auto *TR = dyn_cast<TransposeNode>(V.getNode());
+    if (!TR || contains(TR->getInput().getNode())) {
+      return nullptr;
+    }
+    for (auto &U : TR->getUsers()) {
+      if (!contains(U.getUser())) {
+        return nullptr;
+      }
+    }
+    return TR;
+  }
+
+  /// \returns true if a transpose of \p V costs nothing at runtime: splats
+  /// are recreated in the new shape, and the transposes of constant weights
+  /// are folded in inference mode.
+  bool isFreeToTranspose(NodeValue V) const {
+    if (isa<SplatNode>(V.getNode())) {
+      return true;
+    }
+    if (auto *TR = getAbsorbedTranspose(V)) {
+      V = TR->getInput();
+    }
+    auto *W = dyn_cast<Variable>(V.getNode());
+    return mode_ == CompilationMode::Infer && W && W->isPrivate() &&
+           W->hasOneUse();
+  }
+
+  /// \returns the type \p T of a value of the original function in the layout
+  /// \p shuffle.
+  TypeRef getTransposedType(TypeRef T,
+                            llvm::ArrayRef<unsigned_t> shuffle) const {
+    std::vector<size_t> dims(T->dims().size());
+    for (size_t i = 0, e = dims.size(); i < e; i++) {
+      dims[shuffle[i]] = T->dims()[i];
+    }
+    return F_->getParent()->uniqueTypeWithNewShape(T, dims);
+  }
+
+  /// \returns the value of \p V in the layout \p shuffle, whose inverse is
+  /// \p inverse, for a value \p V that is defined outside of the region.
+  NodeValue getTransposedInput(NodeValue V, llvm::ArrayRef<unsigned_t> shuffle,
+                               llvm::ArrayRef<unsigned_t> inverse) {
+    if (auto *SN = dyn_cast<SplatNode>(V.getNode())) {
+      return F_->createSplat(SN->getName(),
+                             getTransposedType(SN->getResult().getType(),
+                                               shuffle),
+                             SN->getValue());
+    }
+    if (auto *TR = getAbsorbedTranspose(V)) {
+      auto mask = composeShuffles(TR->getShuffle(), inverse);
+      if (isIdentityShuffle(mask)) {
+        return TR->getInput();
+      }
+      return F_->createTranspose(TR->getName(), TR->getInput(), mask);
+    }
+    if (auto *TR = findTranspose(F_, V, inverse)) {
+      return TR;
+    }
+    return F_->createTranspose("layout", V, inverse);
+  }
+
+public:
+  LayoutRegion(Function *F, CompilationMode mode,
+               const std::unordered_map<const Node *, unsigned> &regionOf,
+               unsigned id)
+      : F_(F), mode_(mode), regionOf_(regionOf), id_(id) {}
+
+  /// Add the node \p N to the region. Nodes are added in topological order.
+  void addNode(Node *N) {
+    nodes_.push_back(N);
+    for (unsigned i = 0, e = getNumLayoutInputs(N); i < e; i++) {
+      NodeValue in = N->getNthInput(i);
+      if (!contains(in.getNode()) &&
+          std::find(inputs_.begin(), inputs_.end(), in) == inputs_.end()) {
+        inputs_.push_back(in);
+      }
+    }
+  }
+
+  /// \returns true if the region can be rewritten. A transpose that leaves the
+  /// region and comes back into it is left alone, as the cost model does not
+  /// account for it.
+  bool isRewritable() const {
+    for (auto *N : nodes_) {
+      for (auto &U : N->getUsers()) {
+        auto *TR = dyn_cast<TransposeNode>(U.getUser());
+        if (!TR || contains(TR)) {
+          continue;
+        }
+        for (auto &TU : TR->getUsers()) {
+          if (contains(TU.getUser())) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  /// \returns the layouts worth considering for the region: the ones that
+  /// make one of the transposes at its boundary unnecessary.
+  std::vector<std::vector<unsigned_t>> getCandidateLayouts() const {
+    std::vector<std::vector<unsigned_t>> layouts;
+    auto addLayout = [&](std::vector<unsigned_t> shuffle) {
+      if (std::find(layouts.begin(), layouts.end(), shuffle) ==
+          layouts.end()) {
+        layouts.push_back(std::move(shuffle));
+      }
+    };
+    for (const auto &in : inputs_) {
+      if (auto *TR = getAbsorbedTranspose(in)) {
+        addLayout(TR->getShuffle());
+      }
+    }
+    for (auto *N : nodes_) {
+      for (auto &U : N->getUsers()) {
+        auto *TR = dyn_cast<TransposeNode>(U.getUser());
+        if (TR && !contains(TR)) {
+          addLayout(invertShuffle(TR->getShuffle()));
+        }
+      }
+    }
+    return layouts;
+  }
+
+  /// \returns the number of transposes that the boundary of the region needs
+  /// when the region uses the layout \p shuffle.
+  unsigned getNumTransposes(llvm::ArrayRef<unsigned_t> shuffle) const {
+    auto inverse = invertShuffle(shuffle);
+    bool isIdentity = isIdentityShuffle(shuffle);
+    unsigned count = 0;
+    for (const auto &in : inputs_) {
+      if (isFreeToTranspose(in)) {
+        continue;
+      }
+      if (auto *TR = getAbsorbedTranspose(in)) {
+        count += !isIdentityShuffle(composeShuffles(TR->getShuffle(), inverse));
+        continue;
+      }
+      count += !isIdentity && !findTranspose(F_, in, inverse);
+    }
+    for (auto *N : nodes_) {
+      bool hasOtherUsers = false;
+      for (auto &U : N->getUsers()) {
+        if (contains(U.getUser())) {
+          continue;
+        }
+        if (auto *TR = dyn_cast<TransposeNode>(U.getUser())) {
+          count +=
+              !isIdentityShuffle(composeShuffles(shuffle, TR->getShuffle()));
+          continue;
+        }
+        hasOtherUsers = true;
+      }
+      count += hasOtherUsers && !isIdentity;
+    }
+    return count;
+  }
+
+  /// Recompute the nodes of the region in the layout \p shuffle and replace
+  /// their uses outside of the region.
+  void rewrite(llvm::ArrayRef<unsigned_t> shuffle) {
+    auto inverse = invertShuffle(shuffle);
+    std::unordered_map<NodeValue, NodeValue> newValues;
+    auto getNewInput = [&](NodeValue in) -> NodeValue {
+      auto it = newValues.find(in);
+      if (it != newValues.end()) {
+        return it->second;
+      }
+      NodeValue newIn = getTransposedInput(in, shuffle, inverse);
+      newValues[in] = newIn;
+      return newIn;
+    };
+
+    for (auto *N : nodes_) {
+      auto name = N->getName();
+      auto newTy = getTransposedType(N->getType(0), shuffle);
+      Node *newN = nullptr;
+
+#define ARITHMETIC_CASE(NODE_NAME_)                                            \
+  case glow::Kinded::Kind::NODE_NAME_##NodeKind:                               \
+    newN = F_->create##NODE_NAME_(name, newTy,                                 \
+                                  getNewInput(N->getNthInput(0)),              \
+                                  getNewInput(N->getNthInput(1)));             \
+    break;
+
+#define BOOLEAN_OP_CASE(NODE_NAME_)                                            \
+  case glow::Kinded::Kind::NODE_NAME_##NodeKind:                               \
+    newN = F_->create##NODE_NAME_(name, getNewInput(N->getNthInput(0)),        \
+                                  getNewInput(N->getNthInput(1)));             \
+    break;
+
+      switch (N->getKind()) {
+        ARITHMETIC_CASE(Add);
+        ARITHMETIC_CASE(Mul);
+        ARITHMETIC_CASE(Sub);
+        ARITHMETIC_CASE(Div);
+        ARITHMETIC_CASE(Max);
+        ARITHMETIC_CASE(Min);
+        ARITHMETIC_CASE(Pow);
+        BOOLEAN_OP_CASE(CmpLTE);
+        BOOLEAN_OP_CASE(CmpEQ);
+      case Kinded::Kind::ReluNodeKind:
+        newN = F_->createRELU(name, getNewInput(N->getNthInput(0)), newTy);
+        break;
+      case Kinded::Kind::SigmoidNodeKind:
+        newN = F_->createSigmoid(name, getNewInput(N->getNthInput(0)));
+        break;
+      case Kinded::Kind::TanhNodeKind:
+        newN = F_->createTanh(name, getNewInput(N->getNthInput(0)));
+        break;
+      case Kinded::Kind::BatchNormalizationNodeKind: {
+        auto *BN = cast<BatchNormalizationNode>(N);
+        newN = F_->createBatchNormalization(
+            name, getNewInput(BN->getInput()), BN->getBias(), BN->getScale(),
+            BN->getMean(), BN->getVar(), shuffle[BN->getChannelIdx()],
+            BN->getEpsilon(), BN->getMomentum());
+        break;
+      }
+      case Kinded::Kind::ConcatNodeKind: {
+        auto *CN = cast<ConcatNode>(N);
+        std::vector<NodeValue> newInputs;
+        for (const auto &in : CN->getInputs()) {
+          newInputs.push_back(getNewInput(in));
+        }
+        newN = F_->createConcat(name, newInputs, shuffle[CN->getDim()], newTy);
+        break;
+      }
+      default:
+        llvm_unreachable("Unhandled node");
+      }
+#undef BOOLEAN_OP_CASE
+#undef ARITHMETIC_CASE
+
+      newValues[NodeValue(N, 0)] = NodeValue(newN, 0);
+    }
+
+    // Transposes of the results fold into a single transpose from the new
+    // layout, and every other user gets the result back in the original
+    // layout.
+    for (auto *N : nodes_) {
+      NodeValue newV = newValues[NodeValue(N, 0)];
+      std::vector<TransposeNode *> transposes;
+      bool hasOtherUsers = false;
+      for (auto &U : N->getUsers()) {
+        auto *user = const_cast<Node *>(U.getUser());
+        if (contains(user)) {
+          continue;
+        }
+        if (auto *TR = dyn_cast<TransposeNode>(user)) {
+          transposes.push_back(TR);
+        } else {
+          hasOtherUsers = true;
+        }
+      }
+      for (auto *TR : transposes) {
+        auto mask = composeShuffles(shuffle, TR->getShuffle());
+        NodeValue replacement = newV;
+        if (!isIdentityShuffle(mask)) {
+          replacement = F_->createTranspose(TR->getName(), newV, mask);
+        }
+        TR->getResult().replaceAllUsesOfWith(replacement);
+      }
+      if (hasOtherUsers) {
+        auto *TR = F_->createTranspose(N->getName(), newV, shuffle);
+        NodeValue(N, 0).replaceAllUsesOfWith(TR);
+      }
+    }
+  }
+};
+
+} // namespace
+
+/// Find the regions of layout agnostic nodes of \p F, and rewrite the first
+/// one that needs fewer transposes in another layout. \returns the number of
+/// transposes that were removed, or 0 if no region was rewritten.
+static unsigned assignLayoutOfOneRegion(Function *F, CompilationMode mode) {
+  // Group the layout agnostic nodes that use each other's results in their
+  // layout, with a union-find over the nodes in post order.
+  GraphPostOrderVisitor visitor(*F);
+  std::vector<Node *> members;
+  std::vector<unsigned> parent;
+  auto findRoot = [&](unsigned i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  };
+  std::unordered_map<const Node *, unsigned> regionOf;
+  for (auto *N : visitor.getPostOrder()) {
+    if (!isLayoutAgnostic(N)) {
+      continue;
+    }
+    unsigned id = members.size();
+    members.push_back(N);
+    parent.push_back(id);
+    regionOf[N] = id;
+    for (unsigned i = 0, e = getNumLayoutInputs(N); i < e; i++) {
+      auto it = regionOf.find(N->getNthInput(i).getNode());
+      if (it != regionOf.end()) {
+        parent[findRoot(it->second)] = findRoot(id);
+      }
+    }
+  }
+  for (auto *N : members) {
+    regionOf[N] = findRoot(regionOf[N]);
+  }
+
+  std::unordered_map<unsigned, LayoutRegion> regions;
+  std::vector<unsigned> order;
+  for (auto *N : members) {
+    unsigned id = regionOf[N];
+    auto it = regions.find(id);
+    if (it == regions.end()) {
+      it = regions.emplace(id, LayoutRegion(F, mode, regionOf, id)).first;
+      order.push_back(id);
+    }
+    it->second.addNode(N);
+  }
+
+  for (auto id : order) {
+    auto &region = regions.find(id)->second;
+    if (!region.isRewritable()) {
+      continue;
+    }
+    auto layouts = region.getCandidateLayouts();
+    if (layouts.empty()) {
+      continue;
+    }
+    std::vector<unsigned_t> identity(layouts.front().size());
+    for (size_t i = 0, e = identity.size(); i < e; i++) {
+      identity[i] = i;
+    }
+    unsigned currentCount = region.getNumTransposes(identity);
+    unsigned bestCount = currentCount;
+    const std::vector<unsigned_t> *best = nullptr;
+    for (const auto &layout : layouts) {
+      unsigned count = region.getNumTransposes(layout);
+      if (count < bestCount) {
+        bestCount = count;
+        best = &layout;
+      }
+    }
+    if (!best) {
+      continue;
+    }
+    region.rewrite(*best);
+    NumLayoutTransposesRemoved += currentCount;
+    NumLayoutTransposesAdded += bestCount;
+    return currentCount - bestCount;
+  }
+  return 0;
+}
+
+unsigned glow::assignLayouts(Function *F, CompilationMode mode) {
+  unsigned removed = 0;
+  while (unsigned count = assignLayoutOfOneRegion(F, mode)) {
+    removed += count;
+    // Remove the nodes of the rewritten region before looking at the next.
+    DCE(F);
+  }
+  return removed;
+}
+
 namespace {
 
-/// A helper type for hasing Node pointers when they are used as keys in hash
-/// maps.
-struct NodeHasher {
-  size_t operator()(Node *N) const { return N->getHash(); }
+/// A node together with its hash, which is computed once when the node is
+/// looked up, instead of on every probe and rehash of the CSE map.
+struct HashedNode {
+  Node *node;
+  size_t hash;
 };
 
-/// A helper type implementing the Node equality predicate that can be used
-/// when Node pointers are used as keys in hash maps.
-struct NodeEq {
-  bool operator()(const Node *lhs, const Node *rhs) const {
-    return lhs->isEqual(*rhs);
+/// A helper type for hashing the nodes in the CSE map.
+struct HashedNodeHasher {
+  size_t operator()(const HashedNode &H) const { return H.hash; }
+};
+
+/// A helper type implementing the Node equality predicate for the CSE map.
+/// The nodes are only compared if their hashes match.
+struct HashedNodeEq {
+  bool operator()(const HashedNode &lhs, const HashedNode &rhs) const {
+    return lhs.hash == rhs.hash && lhs.node->isEqual(*rhs.node);
   }
 };
 
 /// This visitor is used to walk the the graph and
 /// perform a common subexpression evaluation.
 struct CSEVisitor : NodeWalker {
-  // Mapping from the original node to its canonical representation under CSE.
-  std::unordered_map<Node *, Node *, NodeHasher, NodeEq> cseNodes_;
+  // The canonical representations of the nodes under CSE. The nodes in the
+  // set are not changed during CSE, as the users of a node are only visited
+  // after it, so their cached hashes stay valid.
+  std::unordered_set<HashedNode, HashedNodeHasher, HashedNodeEq> cseNodes_;
   // Set of visited nodes.
   std::unordered_set<Node *> visitedNodes_;
 
@@ -1238,17 +1894,18 @@ struct CSEVisitor : NodeWalker {
   /// This callback is called after visiting the children of \p N.
   /// It means that all of its dependencies are processed already.
   void post(Node *parent, Node *N) override {
-    // Try to find a node equivalent to the current one.
-    auto FoundI = cseNodes_.find(N);
-    if (FoundI == cseNodes_.end()) {
-      // No node CSE-equivalent to the current one has been seen yet.
-      // Remember this node, so that the next occurrence can be
-      // replaced by this one.
-      cseNodes_.insert({N, N});
-      assert(cseNodes_.find(N) != cseNodes_.end());
+    // Recomputed activations duplicate existing nodes on purpose.
+    if (N->isRecomputation()) {
+      return;
+    }
+    // Try to find a node equivalent to the current one. If no node
+    // CSE-equivalent to the current one has been seen yet, remember this
+    // node, so that the next occurrence can be replaced by this one.
+    auto inserted = cseNodes_.insert({N, N->getHash()});
+    if (inserted.second) {
       return;
     }
-    Node *foundN = FoundI->second;
+    Node *foundN = inserted.first->node;
 
     // Same node cannot be visited.
     assert(N != foundN);
@@ -1271,23 +1928,12 @@ struct CSEVisitor : NodeWalker {
 
 /// A helper type for hashing Variable pointers when they are used as keys in
 /// hash maps for deduplication. The hash is based on the type of the Variable
-/// (element type, dimensions), as well as a constant number of elements from
-/// the Variable to balance collisions with hash calclulation time.
+/// (element type, dimensions) and on its whole content. This is fast enough
+/// even for large tensors, and makes VarsEqDedup only compare the payloads that
+/// are very likely to be equal.
 struct VarsHasherDedup {
   size_t operator()(Variable *V) const {
-    auto hash = llvm::hash_value(V->getType());
-    auto &T = V->getPayload();
-    // Only use the first 8 elements in the hash. It's likely that if two
-    // tensors have different content they will diverge quickly. Fall back to
-    // full equality check in VarsEqDedup.
-    constexpr size_t maxNumEls = 8;
-    size_t numEls = std::min(T.getType().size(), maxNumEls);
-    size_t bufSize = T.getType().getElementSize() * numEls;
-    auto *data = T.getUnsafePtr();
-    for (size_t i = 0; i < bufSize; i++) {
-      hash = llvm::hash_combine(hash, data[i]);
-    }
-    return hash;
+    return V->getPayload().getContentHash();
   }
 };
 
@@ -1343,12 +1989,12 @@ static void deduplicateConstants(Module *M) {
       duplicateVars;
 
   for (auto &V : M->getVars()) {
-    // Only perform deduplication on vars of small enough size. Otherwise just
-    // skip them. constVarDedupSizeOpt defaults to 256 as a heuristic, to keep
-    // compile time reasonable.
+    // Only perform deduplication on vars of small enough size, if a limit is
+    // set. Each var is hashed once, so the cost is linear in the size of the
+    // constants.
     size_t maxNumEls = constVarDedupSizeOpt;
     size_t numEls = V->getType()->size();
-    if (numEls > maxNumEls) {
+    if (maxNumEls && numEls > maxNumEls) {
       continue;
     }
 
@@ -1362,16 +2008,20 @@ static void deduplicateConstants(Module *M) {
       continue;
     }
 
-    // Try to find a var that has the same data as the current one.
-    auto foundI = duplicateVars.find(V);
-    if (foundI == duplicateVars.end()) {
-      // No node equivalent to the current one has been seen yet. Remember this
-      // variable, so that the next occurrence can be replaced by this one.
-      duplicateVars.emplace(V, V);
-      assert(duplicateVars.find(V) != duplicateVars.end());
+    // The transformations of derived vars and of their sources are replayed
+    // on new weights, which a merged var would miss.
+    if (M->isDerivationOperand(V)) {
+      continue;
+    }
+
+    // Try to find a var that has the same data as the current one. If no var
+    // equivalent to the current one has been seen yet, remember this variable,
+    // so that the next occurrence can be replaced by this one.
+    auto inserted = duplicateVars.emplace(V, V);
+    if (inserted.second) {
       continue;
     }
-    Variable *foundV = foundI->second;
+    Variable *foundV = inserted.first->second;
     assert(V != foundV && "Variables should not be visited multiple times.");
 
     // Replace current var by a found var, which is equivalent to it.
@@ -1444,6 +2094,41 @@ static void optimizeReshape(Function *F) {
   }
 }
 
+/// Optimize floating point conversions. Variables are never converted here,
+/// because keeping the weights in half precision is the point of a conversion
+/// of a Variable.
+static void optimizeConversions(Function *F) {
+  for (auto &node : F->getNodes()) {
+    auto *CN = dyn_cast<ConvertToNode>(&node);
+    if (!CN) {
+      continue;
+    }
+    NodeValue input = CN->getInput();
+    // Eliminate conversions to the type of the input.
+    if (input.getType() == CN->getResult().getType()) {
+      CN->getResult().replaceAllUsesOfWith(input);
+      continue;
+    }
+    // ConvertTo(Splat(args)) -> Splat(args').
+    if (auto *SN = dyn_cast<SplatNode>(input)) {
+      auto *newSplat = F->createSplat(SN->getName(), CN->getResult().getType(),
+                                      SN->getValue());
+      CN->getResult().replaceAllUsesOfWith(newSplat);
+      continue;
+    }
+    // Widening to float is exact, so a conversion back to the original type
+    // cancels out: ConvertTo(ConvertTo(x)) -> x.
+    if (auto *inputCN = dyn_cast<ConvertToNode>(input)) {
+      NodeValue orig = inputCN->getInput();
+      if (orig.getType() == CN->getResult().getType() &&
+          inputCN->getResult().getElementType() == ElemKind::FloatTy) {
+        CN->getResult().replaceAllUsesOfWith(orig);
+        continue;
+      }
+    }
+  }
+}
+
 /// Optimize: Max(Splat(), otherInput) or Max(otherInput, Splat()) for
 /// quantized operations.
 /// Splat and Max can be eliminated if Splat value cannot impact the result.
@@ -1527,6 +2212,35 @@ static void optimizeQuantization(Function *F) {
         continue;
       }
 
+      if (auto *CN = dyn_cast<ConcatNode>(Q->getInput())) {
+        // Quantize(Concat(Dequantize(X1), ..., Dequantize(Xn))) ->
+        // Concat(Rescale(X1), ..., Rescale(Xn))
+        // The inputs may have different {S,O}, so rescale each of them into
+        // the type of the Quantize and concatenate the int8 data.
+        auto inputs = CN->getInputs();
+        bool allDequantized =
+            CN->hasOneUse() &&
+            std::all_of(inputs.begin(), inputs.end(), [](const NodeValue &NV) {
+              return isa<DequantizeNode>(NV.getNode());
+            });
+        if (allDequantized) {
+          std::vector<NodeValue> rescaled;
+          for (auto &NV : inputs) {
+            auto *DQ = cast<DequantizeNode>(NV.getNode());
+            auto rescaleTy = F->getParent()->uniqueTypeWithNewShape(
+                Q->getResult().getType(), DQ->getResult().dims());
+            auto *RS = F->createRescaleQuantized(DQ->getName(), DQ->getInput(),
+                                                 rescaleTy);
+            worklist.push_back(RS);
+            rescaled.push_back(RS);
+          }
+          auto *newCN = F->createConcat(CN->getName(), rescaled, CN->getDim(),
+                                        Q->getResult().getType());
+          Q->getResult().replaceAllUsesOfWith(newCN);
+          continue;
+        }
+      }
+
       if (auto *V = dyn_cast<Variable>(Q->getInput())) {
         // Quantize(Variable) -> Variable
         // V must be a private variable.
@@ -1536,18 +2250,29 @@ static void optimizeQuantization(Function *F) {
         if (!V || !V->isPrivate()) {
           continue;
         }
-        // Create a new variable NV to hold the quantized result.
-        auto *NV = F->getParent()->createVariable(
-            Q->getResult().getType(), V->getName(), V->getVisibilityKind(),
-            false);
-        // Quantize V into NV.
-        auto srcHandle = V->getHandle();
-        auto destHandle = NV->getHandle<int8_t>();
-        TensorQuantizationParams params{Q->getResult().getType()->getScale(),
-                                        Q->getResult().getType()->getOffset()};
-        for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
-          destHandle.raw(i) = quantization::quantize(srcHandle.raw(i), params);
-        }
+        // Get a variable NV that holds the quantized value of V, which the
+        // clones of F share.
+        auto *NV = F->getParent()->getDerivedVariable(
+            {V}, Q->getResult().getType(), "quantize",
+            [](llvm::ArrayRef<Tensor *> srcs, Tensor &T) {
+              auto srcHandle = srcs[0]->getHandle();
+              TensorQuantizationParams params{T.getType().getScale(),
+                                              T.getType().getOffset()};
+              if (T.getElementType() == ElemKind::Int16QTy) {
+                auto destHandle = T.getHandle<int16_t>();
+                for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
+                  destHandle.raw(i) =
+                      quantization::quantize<int16_t>(srcHandle.raw(i), params);
+                }
+              } else {
+                auto destHandle = T.getHandle<int8_t>();
+                for (size_t i = 0, e = destHandle.size(); i < e; ++i) {
+                  destHandle.raw(i) =
+                      quantization::quantize(srcHandle.raw(i), params);
+                }
+              }
+              return true;
+            });
         Q->getResult().replaceAllUsesOfWith(NV);
         continue;
       }
@@ -1559,6 +2284,15 @@ static void optimizeQuantization(Function *F) {
         DQ->getResult().replaceAllUsesOfWith(Q->getInput());
         continue;
       }
+
+      if (auto *RS = dyn_cast<RescaleQuantizedNode>(DQ->getInput())) {
+        // Dequantize(Rescale(X)) -> Dequantize(X)
+        // The rescale can only lose precision, so dequantize its input.
+        auto *newDQ = F->createDequantize(DQ->getName(), RS->getInput());
+        DQ->getResult().replaceAllUsesOfWith(newDQ);
+        worklist.push_back(newDQ);
+        continue;
+      }
     }
 
     if (auto *RS = dyn_cast<RescaleQuantizedNode>(node)) {
@@ -1568,7 +2302,14 @@ static void optimizeQuantization(Function *F) {
         continue;
       }
 
-      if (auto *MN = dyn_cast<MaxNode>(RS->getInput())) {
+      // Folding the rescale into the node that computes its input gives the
+      // node the element kind of the rescale. Kernels do not mix 8-bit and
+      // 16-bit operands, so keep the rescales that convert between them.
+      bool sameKind =
+          RS->getInput().getElementType() == RS->getResult().getElementType();
+
+      auto *MN = dyn_cast<MaxNode>(RS->getInput());
+      if (MN && sameKind) {
         // Rescale(MAX(X, Y)) -> MAX(Rescale(X), Rescale(Y)).
         // It's okay to rescale the operands because even if the output range is
         // smaller then truncation would have happened during the rescale. On
@@ -1599,17 +2340,20 @@ static void optimizeQuantization(Function *F) {
     continue;                                                                  \
   }
 
-      COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Add);
-      COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Sub);
-      COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Mul);
-      COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Div);
-      COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Min);
-      COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Max);
+      if (sameKind) {
+        COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Add);
+        COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Sub);
+        COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Mul);
+        COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Div);
+        COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Min);
+        COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE(Max);
+      }
 #undef COMBINE_UP_RESCALE_TO_ARITHMETIC_NODE
 
       // Combine the rescale node up into the convolution.
       // Rescale(Conv()) -> Conv()
-      if (auto *CN = dyn_cast<ConvolutionNode>(RS->getInput())) {
+      auto *CN = dyn_cast<ConvolutionNode>(RS->getInput());
+      if (CN && sameKind) {
         // Create the exact same convolution but with a different scaling
         // return type.
         auto *newCN = F->createConv(
@@ -1656,6 +2400,18 @@ static void optimizeQuantization(Function *F) {
   optimizeQuantizedMaxSplat(F);
 }
 
+/// \returns the Rescale node computing \p NV if it keeps the element kind of
+/// its input, or null otherwise. A Rescale converting between 8-bit and 16-bit
+/// values can not be combined into its user, as kernels do not mix operands
+/// of different widths.
+static RescaleQuantizedNode *getSameKindRescale(NodeValue NV) {
+  auto *RS = dyn_cast<RescaleQuantizedNode>(NV.getNode());
+  if (RS && RS->getInput().getElementType() == NV.getElementType()) {
+    return RS;
+  }
+  return nullptr;
+}
+
 /// Sink Rescale nodes down when possible.
 static bool sinkRescaleQuantizedNode(Function *F) {
   bool changed = false;
@@ -1723,7 +2479,7 @@ static bool sinkRescaleQuantizedNode(Function *F) {
 // Apply this transformation for AvgPool and MaxPool.
 #define SINK_DOWN_RESCALE_TO_POOLING_NODE(NODE_NAME_)                          \
   if (auto *PN = dyn_cast<NODE_NAME_##Node>(&node)) {                          \
-    if (auto *rescale = dyn_cast<RescaleQuantizedNode>(PN->getInput())) {      \
+    if (auto *rescale = getSameKindRescale(PN->getInput())) {                  \
       auto *newPN = F->create##NODE_NAME_(PN->getName(), rescale->getInput(),  \
                                           PN->getKernels(), PN->getStrides(),  \
                                           PN->getPads());                      \
@@ -1743,7 +2499,7 @@ static bool sinkRescaleQuantizedNode(Function *F) {
     // Combine Rescale down with FullyConnected node.
     // FullyConnected(Rescale(X)) -> FullyConnected(X).
     if (auto *FC = dyn_cast<FullyConnectedNode>(&node)) {
-      auto *rescale = dyn_cast<RescaleQuantizedNode>(FC->getInput());
+      auto *rescale = getSameKindRescale(FC->getInput());
       if (!rescale) {
         continue;
       }
@@ -1763,9 +2519,9 @@ static bool sinkRescaleQuantizedNode(Function *F) {
     // Convolution(X, F, Rescale(B)) -> Convolution(X, F, B).
     // ... and different combinations.
     if (auto *CN = dyn_cast<ConvolutionNode>(&node)) {
-      auto *rescaleX = dyn_cast<RescaleQuantizedNode>(CN->getInput());
-      auto *rescaleF = dyn_cast<RescaleQuantizedNode>(CN->getFilter());
-      auto *rescaleB = dyn_cast<RescaleQuantizedNode>(CN->getBias());
+      auto *rescaleX = getSameKindRescale(CN->getInput());
+      auto *rescaleF = getSameKindRescale(CN->getFilter());
+      auto *rescaleB = getSameKindRescale(CN->getBias());
       auto newX = rescaleX ? rescaleX->getInput() : CN->getInput();
       auto newF = rescaleF ? rescaleF->getInput() : CN->getFilter();
       auto newB = rescaleB ? rescaleB->getInput() : CN->getBias();
@@ -1786,7 +2542,7 @@ static bool sinkRescaleQuantizedNode(Function *F) {
 // Apply this optimization for Add, Sub, Mul, Div, Min, Max.
 #define COMBINE_DOWN_RESCALE_TO_ARITHMETIC_NODE(NODE_NAME_)                    \
   if (auto *AN = dyn_cast<NODE_NAME_##Node>(&node)) {                          \
-    if (auto *rescale = dyn_cast<RescaleQuantizedNode>(AN->getLHS())) {        \
+    if (auto *rescale = getSameKindRescale(AN->getLHS())) {                    \
       auto *newAN =                                                            \
           F->create##NODE_NAME_(AN->getName(), AN->getResult().getType(),      \
                                 rescale->getInput(), AN->getRHS());            \
@@ -1794,7 +2550,7 @@ static bool sinkRescaleQuantizedNode(Function *F) {
       AN = newAN;                                                              \
       changed = true;                                                          \
     }                                                                          \
-    if (auto *rescale = dyn_cast<RescaleQuantizedNode>(AN->getRHS())) {        \
+    if (auto *rescale = getSameKindRescale(AN->getRHS())) {                    \
       auto *newAN =                                                            \
           F->create##NODE_NAME_(AN->getName(), AN->getResult().getType(),      \
                                 AN->getLHS(), rescale->getInput());            \
@@ -1815,61 +2571,225 @@ static bool sinkRescaleQuantizedNode(Function *F) {
   return changed;
 }
 
+/// Sink Dequantize nodes below the layout operations that consume them, so
+/// that layout operations left in floating point move int8 data instead and
+/// the Dequantize can meet the Quantize that often follows them.
+/// Only Dequantize nodes with a single user are sunk, so that no conversion
+/// is duplicated.
+static bool sinkDequantizeNode(Function *F) {
+  bool changed = false;
+  for (auto &node : F->getNodes()) {
+    // Reshape(Dequantize(X)) -> Dequantize(Reshape(X)).
+    if (auto *reshape = dyn_cast<ReshapeNode>(&node)) {
+      auto *DQ = dyn_cast<DequantizeNode>(reshape->getInput());
+      if (!DQ || !DQ->hasOneUse()) {
+        continue;
+      }
+
+      auto *newReshape = F->createReshape(reshape->getName(), DQ->getInput(),
+                                          reshape->getResult().dims());
+      auto *newDQ = F->createDequantize(DQ->getName(), newReshape);
+      reshape->getResult().replaceAllUsesOfWith(newDQ);
+
+      changed = true;
+      continue;
+    }
+
+    // Slice(Dequantize(X)) -> Dequantize(Slice(X)).
+    if (auto *slice = dyn_cast<SliceNode>(&node)) {
+      auto *DQ = dyn_cast<DequantizeNode>(slice->getInput());
+      if (!DQ || !DQ->hasOneUse()) {
+        continue;
+      }
+
+      auto sliceOutTy = F->getParent()->uniqueTypeWithNewShape(
+          DQ->getInput().getType(), slice->getResult().dims());
+      auto *newSlice = F->createSlice(slice->getName(), DQ->getInput(),
+                                      slice->getStart(), sliceOutTy);
+      auto *newDQ = F->createDequantize(DQ->getName(), newSlice);
+      slice->getResult().replaceAllUsesOfWith(newDQ);
+
+      changed = true;
+      continue;
+    }
+
+    // Transpose(Dequantize(X)) -> Dequantize(Transpose(X)).
+    if (auto *transpose = dyn_cast<TransposeNode>(&node)) {
+      auto *DQ = dyn_cast<DequantizeNode>(transpose->getInput());
+      if (!DQ || !DQ->hasOneUse()) {
+        continue;
+      }
+
+      auto *newTranspose = F->createTranspose(
+          transpose->getName(), DQ->getInput(), transpose->getShuffle());
+      auto *newDQ = F->createDequantize(DQ->getName(), newTranspose);
+      transpose->getResult().replaceAllUsesOfWith(newDQ);
+
+      changed = true;
+      continue;
+    }
+
+    // Concat(Dequantize(X1), ..., Dequantize(Xn)) ->
+    // Dequantize(Concat(X1, ..., Xn)), when all Xi have the same {S,O}.
+    if (auto *CN = dyn_cast<ConcatNode>(&node)) {
+      auto inputs = CN->getInputs();
+      auto *firstDQ = dyn_cast<DequantizeNode>(inputs[0].getNode());
+      if (!firstDQ) {
+        continue;
+      }
+      TypeRef firstTy = firstDQ->getInput().getType();
+      bool canSink = true;
+      std::vector<NodeValue> quantizedInputs;
+      for (auto &NV : inputs) {
+        auto *DQ = dyn_cast<DequantizeNode>(NV.getNode());
+        if (!DQ || !DQ->hasOneUse() ||
+            DQ->getInput().getType()->getScale() != firstTy->getScale() ||
+            DQ->getInput().getType()->getOffset() != firstTy->getOffset()) {
+          canSink = false;
+          break;
+        }
+        quantizedInputs.push_back(DQ->getInput());
+      }
+      if (!canSink) {
+        continue;
+      }
+
+      auto concatOutTy = F->getParent()->uniqueTypeWithNewShape(
+          firstTy, CN->getResult().dims());
+      auto *newCN = F->createConcat(CN->getName(), quantizedInputs,
+                                    CN->getDim(), concatOutTy);
+      auto *newDQ = F->createDequantize(firstDQ->getName(), newCN);
+      CN->getResult().replaceAllUsesOfWith(newDQ);
+
+      changed = true;
+      continue;
+    }
+  }
+
+  return changed;
+}
+
+/// \returns the number of Quantize, Dequantize and RescaleQuantized nodes in
+/// \p F.
+static unsigned countQuantizationConversions(Function *F) {
+  unsigned count = 0;
+  for (auto &node : F->getNodes()) {
+    if (isa<QuantizeNode>(node) || isa<DequantizeNode>(node) ||
+        isa<RescaleQuantizedNode>(node)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+unsigned glow::optimizeQuantizationConversions(Function *F) {
+  DCE(F);
+  unsigned numBefore = countQuantizationConversions(F);
+
+  optimizeQuantization(F);
+
+  // Sink the conversions through the layout operations until they meet and
+  // cancel out, or until a fixed-point is reached. Dead nodes are removed
+  // first, as their uses would otherwise block the sinking of Dequantize.
+  bool changed;
+  do {
+    DCE(F);
+    changed = sinkDequantizeNode(F);
+    changed |= sinkRescaleQuantizedNode(F);
+    optimizeQuantization(F);
+  } while (changed);
+
+  DCE(F);
+  unsigned numAfter = countQuantizationConversions(F);
+  unsigned numRemoved = numBefore > numAfter ? numBefore - numAfter : 0;
+  DEBUG_GLOW(llvm::dbgs() << "Removed " << numRemoved
+                          << " quantization conversions from "
+                          << F->getName() << "\n");
+  return numRemoved;
+}
+
+/// Verify \p F after a pass of the graph optimizer if the -verify-level asks
+/// for it, so that a broken pass is caught right where it breaks the graph.
+static void verifyAfterPass(Function *F) {
+  if (VerifyLevel == VerificationLevel::Passes) {
+    F->verify();
+  }
+}
+
 void glow::optimize(Function *F, CompilationMode mode) {
-  // Sink transpose operations in an attempt to cancel them out.
-  // Perform code sinking until a fixed-point is reached.
-  // On big functions, the number of iterations until the fixpoint
-  // is usually at most 2 or 3 iterations.
-  while (sinkCode(F)) {
-    // Perform Dead Code Elimination between rounds of code sinking.
+  // Sink transpose operations in an attempt to cancel them out. The sinking
+  // reaches a fixed-point by itself and erases the nodes it leaves dead.
+  if (sinkCode(F)) {
     DCE(F);
+    verifyAfterPass(F);
+  }
+
+  // Pick the layout of the regions of layout agnostic nodes that needs the
+  // fewest transposes, and sink the transposes that are left.
+  if (assignLayouts(F, mode) && sinkCode(F)) {
+    DCE(F);
+    verifyAfterPass(F);
   }
 
   // Optimize the pooling operation.
   optimizePool(F);
+  verifyAfterPass(F);
 
   // Perform Common Subexpression Elimination.
   CSE(F);
+  verifyAfterPass(F);
 
   // Merge multiple matmul nodes into a single large matmul.
   mergeMatMul(F);
+  verifyAfterPass(F);
 
   // Merge multiple batched adds into a larger batched add.
   mergeBatchedAdd(F);
+  verifyAfterPass(F);
 
   // Perform Dead Code Elimination.
   DCE(F);
+  verifyAfterPass(F);
 
   if (mode == CompilationMode::Infer) {
     // Merge batch normalization operations.
     optimizeBatchNorm(F);
+    verifyAfterPass(F);
 
     // Constant-fold transpose operations.
     optimizeTranspose(F);
+    verifyAfterPass(F);
   }
 
+  // Read the transposes that are left on the RHS of matmuls in place.
+  foldTransposeIntoMatMul(F);
+  DCE(F);
+  verifyAfterPass(F);
+
   // Perform Common Subexpression Elimination.
   CSE(F);
+  verifyAfterPass(F);
 
   // Optimize Concat nodes.
   optimizeConcatNodes(F);
+  verifyAfterPass(F);
 
   // Optimize arithmetic nodes based on algebraic identities.
   optimizeArithmeticNodes(F);
+  verifyAfterPass(F);
 
   // Optimize Tensor shape transformations.
   optimizeSliceOfSplat(F);
+  verifyAfterPass(F);
 
   optimizeReshape(F);
+  verifyAfterPass(F);
 
-  // Optimize quantization related operators.
-  optimizeQuantization(F);
+  // Optimize floating point conversions.
+  optimizeConversions(F);
+  verifyAfterPass(F);
 
-  while (sinkRescaleQuantizedNode(F)) {
-    DCE(F);
-    optimizeQuantization(F);
-  }
-
-  // Perform Dead Code Elimination.
-  DCE(F);
+  // Optimize quantization related operators.
+  optimizeQuantizationConversions(F);
+  verifyAfterPass(F);
 }
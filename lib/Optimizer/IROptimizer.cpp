@@ -23,6 +23,7 @@
 #include "glow/IR/Instrs.h"
 #include "glow/Optimizer/Optimizer.h"
 #include "glow/Support/Debug.h"
+#include "glow/Support/CompileReport.h"
 
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/CommandLine.h"
@@ -463,8 +464,32 @@ static Instruction *getSingleWriter(const Value *V) {
   return singleUser;
 }
 
+/// \returns the weights of \p M whose variables are written to by other
+/// functions of the module, e.g. the weights that a separate function updates
+/// during training.
+static std::unordered_set<const Value *>
+getWeightsWrittenElsewhere(IRFunction &M) {
+  std::unordered_set<const Value *> written;
+  for (auto &VW : M.getVariableMap()) {
+    for (auto &U : VW.first->getUsers()) {
+      auto *N = U.getUser();
+      if (N->getParent() == M.getGraph()) {
+        continue;
+      }
+      for (unsigned i = 0, e = N->getNumInputs(); i < e; i++) {
+        if (N->isOverwrittenNthInput(i) &&
+            N->getNthInput(i).getNode() == VW.first) {
+          written.insert(VW.second);
+        }
+      }
+    }
+  }
+  return written;
+}
+
 /// Marks non-mutable weights as constants.
 void makeWeightsConst(IRFunction &M) {
+  auto writtenElsewhere = getWeightsWrittenElsewhere(M);
   // For each weight:
   for (auto *W : M.getWeights()) {
     if (W->getVisibility() == VisibilityKind::Public) {
@@ -472,6 +497,9 @@ void makeWeightsConst(IRFunction &M) {
              "Public vars can not be Constant.");
       continue;
     }
+    if (writtenElsewhere.count(W)) {
+      continue;
+    }
     bool readOnly = true;
     // For each instruction that uses the weight:
     for (const auto &U : ValueUses(W)) {
@@ -659,8 +687,12 @@ static bool isEnclosedInside(Interval &lhs, Interval &rhs) {
 }
 
 /// \returns true of any intervals from \p Ints overlap with interval \p I.
-static bool hasOverlappingIntervals(Intervals &intervals, Interval I) {
+/// The interval \p ignored of \p Ints, if any, is not considered.
+static bool hasOverlappingIntervals(Intervals &intervals, Interval I,
+                                    const Interval *ignored = nullptr) {
   for (const auto &curI : intervals) {
+    if (&curI == ignored)
+      continue;
     if (std::max(curI.begin_, I.begin_) < std::min(curI.end_, I.end_))
       return true;
   }
@@ -682,6 +714,18 @@ getCompatibleValueForReplacement(IRBuilder &B, Instruction *Before,
     return std::make_pair(&with, false);
   }
 
+  // A broadcast view is replaced by a broadcast view of the replacement of
+  // its source.
+  if (isBroadcastView(&val)) {
+    auto *TVI = cast<TensorViewInst>(&val);
+    auto *src =
+        getCompatibleValueForReplacement(B, Before, *TVI->getSrc(), with).first;
+    auto *tv = B.createTensorViewInst(val.getName(), src, val.getType(),
+                                      TVI->getOffsets());
+    B.getIRFunction().moveInstruction(Before, tv);
+    return std::make_pair(tv, true);
+  }
+
   Value *replacement = getOrigin(&with);
   if (val.getType() == replacement->getType()) {
     return std::make_pair(replacement, false);
@@ -712,9 +756,13 @@ static void moveInterval(Intervals &from, Intervals &to, Interval &interval) {
     }
   }
   if (!isEnclosed) {
-    to.push_back(interval);
-    // Let sort find a right position for it.
-    // std::sort(to.begin(), to.end());
+    // Keep the list sorted, because the last interval of a list is the one
+    // holding the final value of a buffer.
+    auto pos = std::lower_bound(to.begin(), to.end(), interval,
+                                [](const Interval &lhs, const Interval &rhs) {
+                                  return lhs.begin_ < rhs.begin_;
+                                });
+    to.insert(pos, interval);
   }
   // Delete from the from list.
   from.erase(fromIt);
@@ -902,9 +950,14 @@ class BufferSharingOptimizer {
     // if they have the same value.
 
     // If dest interval overlaps with any srcIntervals, it cannot be replaced.
+    // A copy propagation only allows the overlap with the interval of the
+    // copied value, other values of src must not be alive inside of the dest
+    // interval.
     bool destIntvalCannotBeReplaced =
-        !isCopyPropagation() &&
-        hasOverlappingIntervals(srcIntervals_, *destInterval_);
+        isCopyPropagation()
+            ? hasOverlappingIntervals(srcIntervals_, *destInterval_,
+                                      srcInterval_)
+            : hasOverlappingIntervals(srcIntervals_, *destInterval_);
     // If src interval overlaps with any dest Intervals, it cannot be replaced.
     bool srcIntervalCannotBeReplaced =
         hasOverlappingIntervals(destIntervals_, *srcInterval_);
@@ -1073,16 +1126,43 @@ public:
   }
 };
 
+/// \returns true if the operands \p dest and \p src may be backed by the same
+/// memory. The types do not have to be identical, e.g. quantized operands
+/// of an elementwise instruction may differ in their scales and offsets, but
+/// the elements have to be laid out in the same way.
+static bool haveCompatibleLayouts(const Value *dest, const Value *src) {
+  if (dest->getType() == src->getType()) {
+    return true;
+  }
+  return dest->getElementType() == src->getElementType() &&
+         dest->getType()->size() == src->getType()->size();
+}
+
+/// \returns true if the live interval of \p src that covers the instruction
+/// with number \p instIdx ends at this instruction, i.e. the instruction is
+/// the last reader of the value held in \p src.
+static bool isLastUseOf(LiveIntervalsMap &intervalsMap, const Value *src,
+                        unsigned instIdx) {
+  auto readIdx =
+      LiveIntervalsInstructionNumbering::getInstrReadSlotNumber(instIdx);
+  auto &srcIntervals = intervalsMap[src];
+  auto srcIntervalIt = getEnclosingInterval(srcIntervals, readIdx);
+  return srcIntervalIt != srcIntervals.end() &&
+         srcIntervalIt->end_ == size_t(readIdx + 1);
+}
+
 /// Tries to share a buffer for two operands of the same instruction.
 /// An operand X cannot reuse the buffer of another operand Y,
 /// if the live interval of X overlaps with any live intervals of Y.
 /// The only exception is the copy instruction, where the live interval
 /// of the X may be enclosed into a live interval of Y because they have
 /// the same value after the copy instruction.
+/// If \p onlyDyingSources is true, only the sources whose value dies at the
+/// instruction are considered, which makes the instruction execute in place.
 static void tryToShareBuffersForInstr(
     LiveIntervalsMap &intervalsMap,
     const LiveIntervalsInstructionNumbering &instrNumbering, Instruction *I,
-    unsigned instIdx) {
+    unsigned instIdx, bool onlyDyingSources) {
   IRFunction &M = *I->getParent();
   // Consider all pair of operands. Check if their respective buffers can be
   // reused in principle.
@@ -1096,8 +1176,13 @@ static void tryToShareBuffersForInstr(
       Value *src = getAllocationOrigin(srcOp.first);
       if (!src)
         src = srcOp.first;
-      // Operands must be different, but of the same type.
-      if (destOp.first->getType() != srcOp.first->getType()) {
+      // Operands must be different, but of the same layout.
+      if (!haveCompatibleLayouts(destOp.first, srcOp.first)) {
+        continue;
+      }
+
+      // Broadcast views are smaller than their type, and may only be read.
+      if (isBroadcastView(destOp.first) || isBroadcastView(srcOp.first)) {
         continue;
       }
 
@@ -1118,6 +1203,16 @@ static void tryToShareBuffersForInstr(
         continue;
       }
 
+      // Bail if the source is still used after the current instruction. Only
+      // activations are executed in place, weights are left to the general
+      // sharing, which knows when their values need to be preserved.
+      if (onlyDyingSources &&
+          (!isa<AllocActivationInst>(dest) || !isa<AllocActivationInst>(src) ||
+           srcOp.second != OperandKind::In ||
+           !isLastUseOf(intervalsMap, src, instIdx))) {
+        continue;
+      }
+
       // The buffers can be reused in principle, thus try to share the buffers.
       BufferSharingOptimizer opt(M, intervalsMap, instrNumbering, I, instIdx,
                                  dest, src);
@@ -1150,6 +1245,19 @@ static void shareBuffers(IRFunction &M) {
   // parameter.
   auto &instrs = M.getInstrs();
 
+  // First, execute instructions in place whenever their source dies at the
+  // instruction. This is done in the program order, so that chains of such
+  // instructions collapse into a single buffer. Copies are left to the copy
+  // propagation below.
+  for (auto it = instrs.begin(), e = instrs.end(); it != e; ++it) {
+    Instruction *I = &*it;
+    auto instIdx = instrNumbering.getInstrNumber(I);
+    if (instIdx < 0 || isa<CopyInst>(I))
+      continue;
+    tryToShareBuffersForInstr(intervalsMap, instrNumbering, I, instIdx,
+                              /* onlyDyingSources */ true);
+  }
+
   // For each instruction, in reverse order.
   for (auto it = instrs.rbegin(), e = instrs.rend(); it != e; ++it) {
     Instruction *I = &*it;
@@ -1157,7 +1265,8 @@ static void shareBuffers(IRFunction &M) {
     if (instIdx < 0)
       continue;
     // Try to reuse the operand memory buffers.
-    tryToShareBuffersForInstr(intervalsMap, instrNumbering, I, instIdx);
+    tryToShareBuffersForInstr(intervalsMap, instrNumbering, I, instIdx,
+                              /* onlyDyingSources */ false);
   }
 
   // Fix eventual issues with allocs and deallocs that shareBuffers may
@@ -1260,38 +1369,266 @@ static void eliminateDeadStores(IRFunction &M) {
   eraseInstructions(M, erasedInstructions);
 }
 
-/// \returns true if the first dimension in \p offsets has a non-zero value.
-static bool isOnlyOffsetInFirstDim(llvm::ArrayRef<size_t> offsets) {
-  if (offsets.size() > 1) {
-    for (size_t i = 1; i < offsets.size(); ++i) {
-      if (offsets[i] != 0) {
+/// \returns true if the operand \p op of an instruction is in the memory of
+/// \p origin, which is an allocation or a weight. Tensorviews are looked
+/// through, and all of the views of the same memory may alias.
+static bool isInMemoryOf(const InstructionOperand &op, const Value *origin) {
+  return getOrigin(op.first) == origin;
+}
+
+/// \returns true if \p I reads or writes the memory of \p origin, or
+/// allocates or deallocates it.
+static bool accessesMemoryOf(const Instruction *I, const Value *origin) {
+  if (I == origin) {
+    return true;
+  }
+  for (const auto &op : I->getOperands()) {
+    if (isInMemoryOf(op, origin)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// \returns true if \p I writes the memory of \p origin, or deallocates it.
+static bool writesMemoryOf(const Instruction *I, const Value *origin) {
+  for (const auto &op : I->getOperands()) {
+    if (op.second != OperandKind::In && isInMemoryOf(op, origin)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// \returns true if \p V is read or written through a tensorview.
+static bool hasTensorViews(const Value *V) {
+  for (const auto &U : V->getUsers()) {
+    if (isa<TensorViewInst>(U.get())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// The ways in which an instruction accesses a value that has no tensorviews.
+struct DirectAccess {
+  /// The value is read by an In operand.
+  bool reads{false};
+  /// The value is written in full by an Out operand, or deallocated.
+  bool kills{false};
+  /// The value is read and written by an InOut operand.
+  bool updates{false};
+};
+
+/// \returns how \p I accesses \p V, which has no tensorviews.
+static DirectAccess getDirectAccess(const Instruction *I, const Value *V) {
+  DirectAccess access;
+  for (const auto &op : I->getOperands()) {
+    if (op.first != V) {
+      continue;
+    }
+    access.reads |= op.second == OperandKind::In;
+    access.kills |= op.second == OperandKind::Out;
+    access.updates |= op.second == OperandKind::InOut;
+  }
+  return access;
+}
+
+/// Replaces the reads of \p from by \p I with reads of \p to.
+static void replaceReads(Instruction *I, Value *from, Value *to) {
+  for (unsigned idx = 0, e = I->getNumOperands(); idx < e; idx++) {
+    auto op = I->getOperand(idx);
+    if (op.first == from && op.second == OperandKind::In) {
+      I->setOperand(idx, to);
+    }
+  }
+}
+
+/// Collects into \p reads the instructions after \p copy that read the value
+/// of \p V that \p copy reads or writes, until \p V is killed. The instructions
+/// must not access \p clobbered, which holds the other copy of the value, after
+/// it is written: \p clobbered is not written by the instructions that read
+/// \p V, and is not read after it is written. \returns false if some access
+/// does not fit, or if the value of \p V reaches the end of the function and
+/// is observable.
+static bool collectReadsUntilKill(Instruction *copy, Value *V,
+                                  const Value *clobbered,
+                                  std::vector<Instruction *> &reads) {
+  auto &instrs = copy->getParent()->getInstrs();
+  bool isClobbered = false;
+  for (auto it = std::next(copy->getIterator()), e = instrs.end(); it != e;
+       ++it) {
+    Instruction *I = &*it;
+    auto access = getDirectAccess(I, V);
+    if (access.updates) {
+      return false;
+    }
+    // Reading the copied value from the other copy must neither alias the
+    // operands of the instruction, nor read it after it changed.
+    if (access.reads) {
+      if (isClobbered || writesMemoryOf(I, clobbered)) {
         return false;
       }
+      reads.push_back(I);
     }
+    if (access.kills) {
+      return true;
+    }
+    isClobbered |= writesMemoryOf(I, clobbered);
   }
-  return true;
+  // The final value of a weight is observable.
+  return !isa<WeightVar>(V);
 }
 
-/// \returns true if the dimensions of \p sourceDims, other than the first
-/// dimension, all equal the dimensions in \p destDims.
-static bool allButFirstDimsEqual(llvm::ArrayRef<size_t> sourceDims,
-                                 llvm::ArrayRef<size_t> destDims) {
-  assert(sourceDims.size() == destDims.size() &&
-         "Source and dest dims must have same number of dims.");
-  if (sourceDims.size() > 1) {
-    for (size_t i = 1; i < sourceDims.size(); ++i) {
-      if (sourceDims[i] != destDims[i]) {
+/// Removes the copy \p CI by making the last instruction that writes its
+/// source write its destination instead, and the readers of the source read
+/// the destination. This forwards, for example, the results of the
+/// computations that the Save nodes copy into the output weights, when
+/// shareBuffers could not reuse the output because the result is read
+/// afterwards. \returns true if the copy was removed.
+static bool forwardCopySource(CopyInst *CI) {
+  auto *src = CI->getSrc();
+  auto *dest = CI->getDest();
+  if (getOrigin(src) != src || getOrigin(dest) != dest ||
+      src->getType() != dest->getType() || hasTensorViews(src) ||
+      hasTensorViews(dest)) {
+    return false;
+  }
+
+  // Find the writer of the source. The instructions in between must not
+  // access the destination, and may only read the source.
+  std::vector<Instruction *> reads;
+  Instruction *writer = nullptr;
+  auto &instrs = CI->getParent()->getInstrs();
+  for (auto it = CI->getIterator(); it != instrs.begin();) {
+    Instruction *I = &*--it;
+    if (accessesMemoryOf(I, dest)) {
+      return false;
+    }
+    auto access = getDirectAccess(I, src);
+    if (access.updates || I == src) {
+      return false;
+    }
+    // The writer may also read the previous value of the source, which stays
+    // where it is.
+    if (access.kills) {
+      if (isa<DeallocActivationInst>(I)) {
         return false;
       }
+      writer = I;
+      break;
+    }
+    if (access.reads) {
+      reads.push_back(I);
+    }
+  }
+  if (!writer) {
+    return false;
+  }
+
+  // The readers of the copied value after the copy read the destination,
+  // until the source is written again.
+  if (!collectReadsUntilKill(CI, src, dest, reads)) {
+    return false;
+  }
+
+  for (unsigned idx = 0, e = writer->getNumOperands(); idx < e; idx++) {
+    auto op = writer->getOperand(idx);
+    if (op.first == src && op.second == OperandKind::Out) {
+      writer->setOperand(idx, dest);
+    }
+  }
+  for (auto *I : reads) {
+    replaceReads(I, src, dest);
+  }
+  CI->getParent()->eraseInstruction(CI);
+  return true;
+}
+
+/// Removes the copy \p CI by making the readers of its destination read its
+/// source instead, until the destination is written again. This propagates,
+/// for example, the reshaped views of the input weights. \returns true if the
+/// copy was removed.
+static bool propagateCopySource(CopyInst *CI) {
+  auto *src = CI->getSrc();
+  auto *dest = CI->getDest();
+  if (getOrigin(dest) != dest || src->getType() != dest->getType() ||
+      hasTensorViews(dest)) {
+    return false;
+  }
+
+  std::vector<Instruction *> reads;
+  if (!collectReadsUntilKill(CI, dest, getOrigin(src), reads)) {
+    return false;
+  }
+  // The copies of broadcast views are kept for the readers that cannot read
+  // the view.
+  if (isBroadcastView(src) &&
+      !std::all_of(reads.begin(), reads.end(), canReadBroadcastViews)) {
+    return false;
+  }
+  for (auto *I : reads) {
+    replaceReads(I, dest, src);
+  }
+  CI->getParent()->eraseInstruction(CI);
+  return true;
+}
+
+/// Eliminates the copies whose source or destination can be used in place of
+/// the other, which is decided by looking at the accesses to the memory of
+/// both of them.
+static void eliminateCopies(IRFunction &M) {
+  auto &instrs = M.getInstrs();
+  for (auto it = instrs.begin(), e = instrs.end(); it != e;) {
+    auto *CI = dyn_cast<CopyInst>(&*it);
+    ++it;
+    if (CI && getOrigin(CI->getSrc()) != getOrigin(CI->getDest())) {
+      forwardCopySource(CI) || propagateCopySource(CI);
+    }
+  }
+}
+
+/// \returns true if the region of the shape \p regionDims at the offsets
+/// \p offsets of a tensor of the shape \p dims is contiguous in memory. This is
+/// the case if the region spans all of the tensor in the dimensions after some
+/// dimension, and has a single element in the dimensions before it, like a
+/// slice along any dimension of a tensor whose outer dimensions are 1.
+static bool isContiguousRegion(llvm::ArrayRef<size_t> offsets,
+                               llvm::ArrayRef<size_t> regionDims,
+                               llvm::ArrayRef<size_t> dims) {
+  assert(regionDims.size() == dims.size() &&
+         "The region and the tensor must have the same number of dims.");
+  assert((offsets.empty() || offsets.size() == dims.size()) &&
+         "The offsets must have the number of dims of the tensor.");
+  // Find the innermost dimension in which the region does not span the
+  // tensor.
+  size_t d = dims.size();
+  while (d > 0 && regionDims[d - 1] == dims[d - 1]) {
+    d--;
+  }
+  if (d == 0) {
+    return true;
+  }
+  // The region must span the inner dimensions fully, so only the offset can
+  // be non-zero in them.
+  for (size_t i = d; i < offsets.size(); i++) {
+    if (offsets[i] != 0) {
+      return false;
+    }
+  }
+  // The outer dimensions must select a single element.
+  for (size_t i = 0; i + 1 < d; i++) {
+    if (regionDims[i] != 1) {
+      return false;
     }
   }
   return true;
 }
 
-/// Replace InsertTensors that are only offset in the first dimension with
+/// Replace InsertTensors into a contiguous region of their destination with
 /// writing directly into the destination using TensorViews with the same
-/// offsets. This is possible because this means the underlying memory is
-/// contiguous in this case.
+/// offsets. Besides the inserts offset in the first dimension, this covers the
+/// concatenations along any dimension whose outer dimensions are 1.
 void optimizeInserts(IRFunction &M) {
   auto &instrs = M.getInstrs();
   InstructionPtrSet erasedInstructions;
@@ -1314,13 +1651,6 @@ void optimizeInserts(IRFunction &M) {
       continue;
     }
 
-    // TVI with offsets currently only works for this optimization if the insert
-    // is only into the first dimension. This is because the tensor memory must
-    // be contiguous.
-    if (!isOnlyOffsetInFirstDim(ITI->getOffsets())) {
-      continue;
-    }
-
     // For now only support an InsertTensor with an alloc as its source. This is
     // the pattern usually seen via IRGen'd ConcatNodes.
     auto *insertSourceAAI = dyn_cast<AllocActivationInst>(ITI->getSrc());
@@ -1336,11 +1666,11 @@ void optimizeInserts(IRFunction &M) {
       continue;
     }
 
-    // Make sure that all but the first dimension of the inserttensor's source
-    // and dest are equal. This means that the writes to the destination of the
-    // insert are contiguous.
+    // TensorViews only cover contiguous memory, so the writes to the
+    // destination of the insert must be contiguous.
     auto *insertDest = ITI->getDest();
-    if (!allButFirstDimsEqual(insertSourceAAI->dims(), insertDest->dims())) {
+    if (!isContiguousRegion(ITI->getOffsets(), insertSourceAAI->dims(),
+                            insertDest->dims())) {
       continue;
     }
 
@@ -1381,10 +1711,8 @@ void optimizeInserts(IRFunction &M) {
   eraseInstructions(M, erasedInstructions);
 }
 
-/// Replace ExtractTensors that are only offset in the first dimension with
-/// reading directly from the destination using TensorViews with the same
-/// offsets. This is possible because this means the underlying memory is
-/// contiguous in this case.
+/// Replace ExtractTensors from a contiguous region of their source with
+/// reading directly from the source using TensorViews with the same offsets.
 void optimizeExtracts(IRFunction &M) {
   auto &instrs = M.getInstrs();
   InstructionPtrSet erasedInstructions;
@@ -1397,13 +1725,6 @@ void optimizeExtracts(IRFunction &M) {
       continue;
     }
 
-    // TVI with offsets currently only works for this optimization if the
-    // extract is only into the first dimension. This is because the tensor
-    // memory must be contiguous.
-    if (!isOnlyOffsetInFirstDim(ETI->getOffsets())) {
-      continue;
-    }
-
     // Verify that the source of the extract is not written to more than once.
     // This is to ensure that all uses of the extract's output can be replaced
     // by a view of the source instead, since it should be read-only after the
@@ -1420,9 +1741,10 @@ void optimizeExtracts(IRFunction &M) {
       continue;
     }
 
-    // Make sure that all but the first dimension of the extract's source and
-    // dest are equal. This means that the accesses are contiguous.
-    if (!allButFirstDimsEqual(extractSrc->dims(), extractDestAAI->dims())) {
+    // TensorViews only cover contiguous memory, so the reads from the source
+    // of the extract must be contiguous.
+    if (!isContiguousRegion(ETI->getOffsets(), extractDestAAI->dims(),
+                            extractSrc->dims())) {
       continue;
     }
 
@@ -1464,7 +1786,8 @@ static void performDebugInstrumentation(IRFunction &M) {
     }
     auto instrName = I->getName();
     for (const auto &Op : I->getOperands()) {
-      // Dump inputs of the current instruction before the instruction.
+      // Dump inputs of the current instruction before the instruction. The
+      // broadcast views are dumped as their source.
       if (Op.second != OperandKind::Out) {
         std::string name = "debug_print.before.";
         name += Op.first->getName();
@@ -1472,7 +1795,11 @@ static void performDebugInstrumentation(IRFunction &M) {
         name += instrName;
         name += ".";
         name += I->getKindName();
-        auto *dumpInstr = new DebugPrintInst(name, Op.first);
+        auto *input = Op.first;
+        if (isBroadcastView(input)) {
+          input = cast<TensorViewInst>(input)->getSrc();
+        }
+        auto *dumpInstr = new DebugPrintInst(name, input);
         M.insertInstruction(I, dumpInstr);
       }
 
@@ -1575,7 +1902,8 @@ void performPeepholeOptimizations(IRFunction &M) {
       auto *src = CI->getSrc();
       auto *dest = CI->getDest();
       if (getOrigin(src) == getOrigin(dest)) {
-        if (src->getType()->size() != dest->getType()->size()) {
+        if (src->getType()->size() != dest->getType()->size() ||
+            isBroadcastView(src)) {
           continue;
         }
 
@@ -1593,16 +1921,26 @@ void performPeepholeOptimizations(IRFunction &M) {
 }
 
 std::unique_ptr<IRFunction>
-glow::generateAndOptimizeIR(Function *F, bool shouldShareBuffers) {
+glow::generateAndOptimizeIR(Function *F, bool shouldShareBuffers,
+                            SchedulerKind schedulerKind) {
   auto IR = llvm::make_unique<IRFunction>(F);
-  IR->generateIR();
-  ::glow::optimize(*IR, shouldShareBuffers);
+  auto numInstrs = [&IR]() -> size_t { return IR->getInstrs().size(); };
+  {
+    ScopedCompilePhase phase("IRGen", "instructions", numInstrs);
+    IR->generateIR(schedulerKind);
+  }
+  {
+    ScopedCompilePhase phase("optimizeIR", "instructions", numInstrs);
+    ::glow::optimize(*IR, shouldShareBuffers);
+  }
   return IR;
 }
 
 /// Perform optimizations on the IR representation.
 void glow::optimize(IRFunction &M, bool shouldShareBuffers) {
-  M.verify();
+  if (VerifyLevel != VerificationLevel::None) {
+    M.verify();
+  }
   if (!optimizeIR)
     return;
 
@@ -1618,6 +1956,9 @@ void glow::optimize(IRFunction &M, bool shouldShareBuffers) {
   if (shouldShareBuffers)
     shareBuffers(M);
 
+  // Remove the copies whose source and destination can stand for each other.
+  eliminateCopies(M);
+
   performPeepholeOptimizations(M);
 
   // Shorten the lifetime of buffers.
@@ -1635,7 +1976,9 @@ void glow::optimize(IRFunction &M, bool shouldShareBuffers) {
   // Perform a debug instrumentation if required.
   performDebugInstrumentation(M);
 
-  M.verify();
+  if (VerifyLevel != VerificationLevel::None) {
+    M.verify();
+  }
 
   // If requested, dump IR to stdout for debugging.
   if (dumpIR) {
@@ -23,8 +23,13 @@
 
 #include "llvm/Support/Casting.h"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
 using namespace glow;
 using llvm::dyn_cast;
+using llvm::isa;
 
 void lowerAddGradNode(Function *F, AddGradNode &node) {
   /// The chain rule for addition:
@@ -116,9 +121,9 @@ void lowerFullyConnectedGradNode(Function *F, FullyConnectedGradNode &FCG) {
   // https://github.com/huyouare/CS231n/blob/master/assignment2/cs231n/layers.py#L53
   auto dout = FCG.getGradOfOriginalOutputNamedResult();
 
-  // dx = dout * w.T
-  auto *wT = F->createTranspose("fcg.wT", FCG.getWeights(), {1, 0});
-  auto *dx2 = F->createMatMul("fcg.dot", dout, wT);
+  // dx = dout * w.T, which reads w transposed in place.
+  auto *dx2 = F->createMatMul("fcg.dot", dout, FCG.getWeights(),
+                              /* transposeRHS */ true);
   auto *dx = F->createReshape("fcg.inG", dx2, FCG.getInput().getType()->dims());
   FCG.getGradOfInputNamedInput().replaceAllUsesOfWith(dx);
 
@@ -187,70 +192,34 @@ void lowerReluNode(Function *F, ReluNode &R) {
   R.getResult().replaceAllUsesOfWith(relu);
 }
 
-void lowerQuantizedTanhNode(Function *F, TanhNode *TN) {
-  // Quantized tanh operator expects input to be in a certain floating point
-  // range. This operator works based on the precomputed table and has to
-  // process input in a range of [-3.0, 3.0]. Tanh asymptotically approaches
-  // +/-1.0 and is already +/-.995 at +/-3.0.
-  // The output quantization parameters are chosen to represent the floating
-  // point range of [-1.0, 1.0].
-  auto inputQuantizationParams =
-      glow::quantization::chooseQuantizationParams(-3.0, 3.0);
-  auto tanhInTy = F->getParent()->uniqueType(
-      ElemKind::Int8QTy, TN->getResult().dims(), inputQuantizationParams.scale,
-      inputQuantizationParams.offset);
-
-  // Make sure input is clipped in [-3.0, 3.0] floating point range.
-  auto *rescaleInputNode =
-      F->createRescaleQuantized(TN->getName(), TN->getInput(), tanhInTy);
-
-  // Make sure output is clipped in [-1.0, 1.0] floating point range.
-  auto outputQuantizationParams =
-      glow::quantization::chooseQuantizationParams(-1.0, 1.0);
-  auto resultOutTy = F->getParent()->uniqueType(
-      ElemKind::Int8QTy, rescaleInputNode->getResult().dims(),
-      outputQuantizationParams.scale, outputQuantizationParams.offset);
-
-  auto *quantizedNode =
-      F->createIntTanh(TN->getName(), rescaleInputNode, resultOutTy);
-
-  auto *rescaleOutputNode = F->createRescaleQuantized(
-      TN->getName(), quantizedNode, TN->getResult().getType());
-
-  TN->getResult().replaceAllUsesOfWith(rescaleOutputNode);
-}
+/// Replace the quantized pointwise operation \p node, which computes \p fn
+/// on every element of \p input into \p result, with a lookup table. The
+/// table maps each of the 256 input values straight to the output scale, so
+/// no rescaling is needed around it. Values that the output type can't
+/// represent saturate, and undefined ones (e.g. the log of a negative number)
+/// map to the lowest value.
+static void lowerQuantizedUnaryNode(Function *F, Node *node, NodeValue input,
+                                    NodeValue result,
+                                    const std::function<float(float)> &fn) {
+  TypeRef inTy = input.getType();
+  TypeRef outTy = result.getType();
+  assert(inTy->getElementType() == ElemKind::Int8QTy &&
+         outTy->getElementType() == ElemKind::Int8QTy &&
+         "Lookup tables are only built for int8 operations");
+  TensorQuantizationParams inTQP{inTy->getScale(), inTy->getOffset()};
+  TensorQuantizationParams outTQP{outTy->getScale(), outTy->getOffset()};
+  float lowest = quantization::dequantize<int8_t>(-128, outTQP);
+  float highest = quantization::dequantize<int8_t>(127, outTQP);
+
+  std::vector<int8_t> table(256);
+  for (int i = 0; i < 256; i++) {
+    float y = fn(quantization::dequantize<int8_t>(i - 128, inTQP));
+    y = std::isnan(y) ? lowest : std::max(lowest, std::min(highest, y));
+    table[i] = quantization::quantize<int8_t>(y, outTQP);
+  }
 
-void lowerQuantizedSigmoidNode(Function *F, SigmoidNode *SN) {
-  // Quantized sigmoid operator expects input to be in a certain floating
-  // point range. This operator works based on the precomputed table and has
-  // to process input in a range of [-6.0, 6.0]. Sigmoid asymptotically
-  // approaches 0 at -inf and 1 at +inf. It has values of 0.00247262 and
-  // 0.997527 at -6.0 and 6.0 correspondingly. The output quantization
-  // parameters are chosen to represent the floating point range of [0, 1.0].
-  auto inputQuantizationParams =
-      glow::quantization::chooseQuantizationParams(-6.0, 6.0);
-  auto sigmoidInTy = F->getParent()->uniqueType(
-      ElemKind::Int8QTy, SN->getResult().dims(), inputQuantizationParams.scale,
-      inputQuantizationParams.offset);
-
-  // Make sure input is clipped in [-6.0, 6.0] floating point range.
-  auto *rescaleInputNode =
-      F->createRescaleQuantized(SN->getName(), SN->getInput(), sigmoidInTy);
-
-  // Make sure output is clipped in [0.0, 1.0] floating point range.
-  auto outputQuantizationParams =
-      glow::quantization::chooseQuantizationParams(0.0, 1.0);
-  auto resultOutTy = F->getParent()->uniqueType(
-      ElemKind::Int8QTy, rescaleInputNode->getResult().dims(),
-      outputQuantizationParams.scale, outputQuantizationParams.offset);
-
-  auto *quantizedNode =
-      F->createIntSigmoid(SN->getName(), rescaleInputNode, resultOutTy);
-
-  auto *rescaleOutputNode = F->createRescaleQuantized(
-      SN->getName(), quantizedNode, SN->getResult().getType());
-
-  SN->getResult().replaceAllUsesOfWith(rescaleOutputNode);
+  auto *LT = F->createIntLookupTable(node->getName(), input, table, outTy);
+  result.replaceAllUsesOfWith(LT);
 }
 
 void lowerSGDNode(Function *F, SGDNode &SGD) {
@@ -320,6 +289,22 @@ void lowerSGDNode(Function *F, SGDNode &SGD) {
   SGD.getUpdatedWeight().replaceAllUsesOfWith(newW);
 }
 
+/// Replace the SGD node \p SGD, which has a momentum and which the backend
+/// updates with a single kernel, with a MomentumSGD node that keeps the
+/// accumulated update in a new variable.
+void lowerSGDNodeToMomentumSGD(Function *F, SGDNode &SGD) {
+  NodeValue W = SGD.getWeight();
+  Variable *Gsum = F->getParent()->createVariable(
+      W.getType(), "gsum", VisibilityKind::Private, true);
+  Gsum->getPayload().zero();
+
+  auto *MSGD = F->addNode(new MomentumSGDNode(
+      SGD.getName(), SGD.getGradient(), W, Gsum, SGD.getL1Decay(),
+      SGD.getL2Decay(), SGD.getLearningRate(), SGD.getMomentum(),
+      SGD.getBatchSize()));
+  SGD.getUpdatedWeight().replaceAllUsesOfWith(MSGD);
+}
+
 void lowerBatchNormalizationNode(Function *F, BatchNormalizationNode &BN) {
   auto in = BN.getInput();
   auto out = BN.getResult();
@@ -578,6 +563,56 @@ void lowerGroupConvolutionNode(Function *F, ConvolutionNode &BNG) {
   BNG.getResult().replaceAllUsesOfWith(result);
 }
 
+void lowerBatchedMatMulNode(Function *F, BatchedMatMulNode &BMM) {
+  // Multiply every batch entry separately: slice the operands, multiply the
+  // matrices and concatenate the results back into a 3d tensor.
+  auto lhs = BMM.getLHS();
+  auto rhs = BMM.getRHS();
+  auto name = BMM.getName();
+  const size_t numBatches = lhs.dims()[0];
+  const size_t N = lhs.dims()[1];
+  const size_t M = lhs.dims()[2];
+  const size_t P = rhs.dims()[2];
+
+  auto *resultTy = BMM.getResult().getType();
+  auto *mulTy = F->getParent()->uniqueTypeWithNewShape(resultTy, {N, P});
+  std::vector<NodeValue> MMS(numBatches);
+  for (size_t i = 0; i < numBatches; i++) {
+    auto *sliceA = F->createSlice(name.str() + ".sliceA." + std::to_string(i),
+                                  lhs, {i, 0, 0}, {i + 1, N, M});
+    auto *sliceB = F->createSlice(name.str() + ".sliceB." + std::to_string(i),
+                                  rhs, {i, 0, 0}, {i + 1, M, P});
+    auto *reshapeA =
+        F->createReshape(sliceA->getName().str() + ".reshape", sliceA, {N, M});
+    auto *reshapeB =
+        F->createReshape(sliceB->getName().str() + ".reshape", sliceB, {M, P});
+    MMS[i] = F->createMatMul(name.str() + ".MatMul." + std::to_string(i),
+                             mulTy, reshapeA, reshapeB);
+  }
+
+  auto *concatTy =
+      F->getParent()->uniqueTypeWithNewShape(resultTy, {numBatches * N, P});
+  auto *concat = F->createConcat(name.str() + ".concat", MMS, 0, concatTy);
+  auto *result = F->createReshape(name.str() + ".FinalReshape", concat,
+                                  {numBatches, N, P});
+  BMM.getResult().replaceAllUsesOfWith(result);
+}
+
+void lowerBroadcastNode(Function *F, BroadcastNode &BN) {
+  // Create a Tile (which is really a Concat) in each direction that needs to be
+  // broadcasted.
+  auto inDims = BN.getInput().dims();
+  auto outDims = BN.getResult().dims();
+  NodeValue result = BN.getInput();
+  for (size_t i = 0, e = outDims.size(); i < e; i++) {
+    if (inDims[i] == 1 && outDims[i] != 1) {
+      result = F->createTile(BN.getName().str() + ".tile" + std::to_string(i),
+                             result, outDims[i], i);
+    }
+  }
+  BN.getResult().replaceAllUsesOfWith(result);
+}
+
 void lowerSigmoidCrossEntropyWithLogitsNode(
     Function *F, SigmoidCrossEntropyWithLogitsNode &SCEL) {
   // Following Caffe2 implementation closely to lower this Node.
@@ -624,8 +659,15 @@ void glow::lower(Function *F, const Backend &B) {
   for (auto &N : nodes) {
     auto *node = &N;
     if (!B.shouldLower(node)) {
+      // The momentum of the SGD nodes that are kept needs a variable.
+      auto *SGD = dyn_cast<SGDNode>(node);
+      if (SGD && SGD->getMomentum() > 0) {
+        lowerSGDNodeToMomentumSGD(F, *SGD);
+      }
       continue;
     }
+    // Nodes created by the lowering are appended to the end of the list.
+    auto *last = &nodes.back();
     if (auto *RN = dyn_cast<RegressionNode>(node)) {
       lowerRegressionNode(*RN);
     } else if (auto *RGN = dyn_cast<RegressionGradNode>(node)) {
@@ -660,23 +702,58 @@ void glow::lower(Function *F, const Backend &B) {
       lowerBatchNormalizationGradNode(F, *BNG);
     } else if (auto *SCEL = dyn_cast<SigmoidCrossEntropyWithLogitsNode>(node)) {
       lowerSigmoidCrossEntropyWithLogitsNode(F, *SCEL);
+    } else if (auto *BMM = dyn_cast<BatchedMatMulNode>(node)) {
+      lowerBatchedMatMulNode(F, *BMM);
+    } else if (auto *BN = dyn_cast<BroadcastNode>(node)) {
+      lowerBroadcastNode(F, *BN);
+    } else if (isa<LSTMCellNode>(node) || isa<LSTMUnitNode>(node) ||
+               isa<GRUCellNode>(node) || isa<GRUUnitNode>(node) ||
+               isa<RNNSequenceNode>(node) || isa<LSTMSequenceNode>(node) ||
+               isa<GRUSequenceNode>(node)) {
+      F->expandRecurrentNode(node);
     } else if (auto *CN = dyn_cast<ConvolutionNode>(node)) {
+      // This is only the fallback for the backends that can't run grouped
+      // convolutions, which keep the node by returning false from shouldLower.
       if (CN->getGroup() > 1)
         lowerGroupConvolutionNode(F, *CN);
     } else if (auto *SN = dyn_cast<SigmoidNode>(node)) {
       if (SN->getResult().getType()->isQuantizedType()) {
-        lowerQuantizedSigmoidNode(F, SN);
+        lowerQuantizedUnaryNode(F, SN, SN->getInput(), SN->getResult(),
+                                [](float x) { return 1 / (1 + std::exp(-x)); });
       }
     } else if (auto *TN = dyn_cast<TanhNode>(node)) {
       if (TN->getResult().getType()->isQuantizedType()) {
-        lowerQuantizedTanhNode(F, TN);
+        lowerQuantizedUnaryNode(F, TN, TN->getInput(), TN->getResult(),
+                                [](float x) { return std::tanh(x); });
+      }
+    } else if (auto *LN = dyn_cast<LogNode>(node)) {
+      if (LN->getResult().getType()->isQuantizedType()) {
+        lowerQuantizedUnaryNode(F, LN, LN->getInput(), LN->getResult(),
+                                [](float x) { return std::log(x); });
+      }
+    } else if (auto *PN = dyn_cast<PowNode>(node)) {
+      // Only a constant exponent makes the power a function of the base alone.
+      auto *exp = dyn_cast<SplatNode>(PN->getRHS());
+      if (PN->getResult().getType()->isQuantizedType() && exp) {
+        float e = exp->getValue();
+        lowerQuantizedUnaryNode(F, PN, PN->getLHS(), PN->getResult(),
+                                [e](float x) { return std::pow(x, e); });
+      }
+    }
+    // The lowered form of a recomputed node is a recomputation as well.
+    if (node->isRecomputation()) {
+      for (auto it = std::next(last->getIterator()), e = nodes.end(); it != e;
+           ++it) {
+        it->setRecomputation(true);
       }
     }
   }
 
   for (auto it = F->getNodes().begin(), e = F->getNodes().end(); it != e;) {
     auto cur = &*(it++);
-    if (dyn_cast<SGDNode>(cur))
+    // The SGD nodes have side effects, so the ones that were replaced are not
+    // removed by the dead code elimination.
+    if (isa<SGDNode>(cur) && !cur->getNumUsers())
       F->eraseNode(cur);
   }
 }
@@ -22,8 +22,16 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace glow;
+using llvm::dyn_cast;
 using llvm::isa;
 
 namespace {
@@ -63,20 +71,20 @@ public:
   Function *operator[](Node *n) { return nodeToFunction_[n]; }
 };
 
-/// If \p node has a single input that is not a variable, return it.  Otherwise
-/// return nullptr.
-Node *singleNonVariableInput(Node *node) {
-  Node *nonVarInput = nullptr;
+/// If \p node has a single input that is not a storage node, return it.
+/// Otherwise return nullptr.
+Node *singleNonStorageInput(Node *node) {
+  Node *nonStorageInput = nullptr;
 
   for (unsigned i = 0, e = node->getNumInputs(); i < e; i++) {
     Node *in = node->getNthInput(i).getNode();
-    if (isa<Variable>(in))
+    if (isa<Storage>(in))
       continue;
-    if (nonVarInput)
+    if (nonStorageInput)
       return nullptr;
-    nonVarInput = in;
+    nonStorageInput = in;
   }
-  return nonVarInput;
+  return nonStorageInput;
 }
 
 /// Assign nodes to partitions and return the mapping.  This algorithm
@@ -90,12 +98,12 @@ NodeFunctionMap selectBasicBlockPartitions(Function *F) {
   // assigned to a partition before it is assigned.
   GraphPostOrderVisitor visitor(*F);
   for (auto *node : visitor.getPostOrder()) {
-    if (isa<Variable>(node))
+    if (isa<Storage>(node))
       continue;
 
     // If node has only one input, and that input has only one output, place it
     // in the same partition.
-    auto *in = singleNonVariableInput(node);
+    auto *in = singleNonStorageInput(node);
     if (in && in->getNumUsers() == 1) {
       auto it = mapping.find(in);
       assert(it != mapping.end());
@@ -126,14 +134,14 @@ FunctionDAG doPartitioning(Function *F, NodeFunctionMap &mapping) {
     mapping[&N]->addNode(clone);
   }
 
-  // For any dependency that crosses a partition, add a variable and save
+  // For any dependency that crosses a partition, add a placeholder and save
   // node. Record the dependence in the function graph.
-  llvm::DenseMap<Node *, Variable *> variables;
+  std::unordered_map<NodeValue, Placeholder *> placeholders;
   for (auto *F : mapping.getFunctions()) {
     for (auto &N : F->getNodes()) {
       for (unsigned inp = 0, e = N.getNumInputs(); inp < e; inp++) {
         auto input = N.getNthInput(inp);
-        if (isa<Variable>(input.getNode()))
+        if (isa<Storage>(input.getNode()))
           continue;
 
         auto *inputF = mapping[input.getNode()];
@@ -143,32 +151,33 @@ FunctionDAG doPartitioning(Function *F, NodeFunctionMap &mapping) {
         // Add this dependence to the FunctionDAG.
         G.add(F, inputF);
 
-        // If we've already created a variable for this dependence, use it.
-        auto it = variables.find(input.getNode());
-        if (it != variables.end()) {
+        // If we've already created a placeholder for this dependence, use it.
+        auto it = placeholders.find(input);
+        if (it != placeholders.end()) {
           N.setNthInput(inp, it->second);
           continue;
         }
 
-        // Create a new variable to represent this dependence.
-        auto *tmp = mod->createVariable(
+        // Create a new placeholder to represent this dependence. The producer
+        // and the consumers share the tensor that backs it at runtime.
+        auto *tmp = mod->createPlaceholder(
             input.getType(), std::string(input.getNode()->getName()) + "_tmp",
-            VisibilityKind::Private, false);
+            false);
         inputF->createSave("tmp", input, tmp);
-        variables[input.getNode()] = tmp;
+        placeholders[input] = tmp;
         N.setNthInput(inp, tmp);
       }
     }
   }
 
-  // Update links between nodes in the cloned functions.  Add variables (and
-  // save nodes) where a link crosses a partition boundary.
+  // Update links between nodes in the cloned functions. The links that cross
+  // a partition boundary already go through a placeholder.
   for (auto *F : mapping.getFunctions()) {
     for (auto &N : F->getNodes()) {
       for (unsigned inp = 0, e = N.getNumInputs(); inp < e; inp++) {
         auto input = N.getNthInput(inp);
 
-        if (isa<Variable>(input.getNode()))
+        if (isa<Storage>(input.getNode()))
           continue;
 
         // Link this node to the clone of its input.
@@ -181,8 +190,251 @@ FunctionDAG doPartitioning(Function *F, NodeFunctionMap &mapping) {
   return G;
 }
 
+/// Assign nodes to the pipeline stages described by \p config and return the
+/// mapping. The nodes are laid out in post order and each stage receives a
+/// contiguous range of them.
+NodeFunctionMap selectPipelinePartitions(Function *F,
+                                         const PipelineConfig &config) {
+  std::vector<Node *> order;
+  llvm::DenseMap<const Node *, size_t> position;
+  GraphPostOrderVisitor visitor(*F);
+  for (auto *node : visitor.getPostOrder()) {
+    if (isa<Storage>(node))
+      continue;
+    position[node] = order.size();
+    order.push_back(node);
+  }
+  size_t n = order.size();
+  size_t numStages = std::min<size_t>(config.numStages, n);
+  assert(numStages > 0 && "Nothing to partition");
+
+  // prefixCost[j] is the cost of the first j nodes. The cost of a node is the
+  // time it takes on a device that is either compute or memory bound.
+  std::vector<uint64_t> prefixCost(n + 1, 0);
+  for (size_t i = 0; i < n; i++) {
+    auto cost = estimateNodeCost(order[i]);
+    prefixCost[i + 1] =
+        prefixCost[i] + std::max(cost.flops, cost.bytes * config.flopsPerByte);
+  }
+
+  // cut[p] is the number of bytes that flow from the nodes before position p
+  // to the nodes at or after it.
+  std::vector<int64_t> cut(n + 1, 0);
+  {
+    llvm::DenseMap<const Node *, size_t> lastUse;
+    for (size_t i = 0; i < n; i++) {
+      for (unsigned inp = 0, e = order[i]->getNumInputs(); inp < e; inp++) {
+        auto *in = order[i]->getNthInput(inp).getNode();
+        if (!isa<Storage>(in))
+          lastUse[in] = i;
+      }
+    }
+    for (auto &use : lastUse) {
+      size_t def = position[use.first];
+      int64_t bytes = 0;
+      for (unsigned r = 0, e = use.first->getNumResults(); r < e; r++) {
+        bytes += use.first->getNthResult(r).getType()->getSizeInBytes();
+      }
+      cut[def + 1] += bytes;
+      cut[use.second + 1] -= bytes;
+    }
+    for (size_t p = 1; p <= n; p++) {
+      cut[p] += cut[p - 1];
+    }
+  }
+
+  // maxEnd[i] is the end of the longest range starting at i that fits in the
+  // memory limit. The range uses the memory of its results and of the
+  // weights and cut tensors that it reads.
+  std::vector<size_t> maxEnd(n, n);
+  if (config.memoryLimit) {
+    for (size_t i = 0; i < n; i++) {
+      std::unordered_set<NodeValue> inputs;
+      uint64_t memory = 0;
+      size_t j = i;
+      for (; j < n; j++) {
+        Node *node = order[j];
+        for (unsigned r = 0, e = node->getNumResults(); r < e; r++) {
+          memory += node->getNthResult(r).getType()->getSizeInBytes();
+        }
+        for (unsigned inp = 0, e = node->getNumInputs(); inp < e; inp++) {
+          auto in = node->getNthInput(inp);
+          if ((isa<Storage>(in.getNode()) || position[in.getNode()] < i) &&
+              inputs.insert(in).second) {
+            memory += in.getType()->getSizeInBytes();
+          }
+        }
+        if (memory > config.memoryLimit)
+          break;
+      }
+      if (j == i) {
+        // The node alone exceeds the limit, so it gets a stage of its own.
+        llvm::errs() << "Node " << order[i]->getName()
+                     << " exceeds the pipeline memory limit of "
+                     << config.memoryLimit << " bytes\n";
+        j = i + 1;
+      }
+      maxEnd[i] = j;
+    }
+  }
+
+  // Split the nodes into stages with dynamic programming over the stage
+  // boundaries. The first pass finds the smallest achievable cost of the
+  // slowest stage. The second pass minimizes the bytes crossing the stage
+  // boundaries among the splits whose stages stay within the tolerance of
+  // that cost.
+  constexpr uint64_t inf = std::numeric_limits<uint64_t>::max();
+  auto rangeCost = [&](size_t i, size_t j) {
+    return prefixCost[j] - prefixCost[i];
+  };
+
+  // slowest[k][j] is the best cost of the slowest stage when the first j
+  // nodes form k stages.
+  std::vector<std::vector<uint64_t>> slowest;
+  auto findSlowest = [&]() {
+    slowest.assign(numStages + 1, std::vector<uint64_t>(n + 1, inf));
+    slowest[0][0] = 0;
+    for (size_t k = 1; k <= numStages; k++) {
+      for (size_t i = k - 1; i < n; i++) {
+        if (slowest[k - 1][i] == inf)
+          continue;
+        for (size_t j = i + 1; j <= maxEnd[i]; j++) {
+          auto cost = std::max(slowest[k - 1][i], rangeCost(i, j));
+          slowest[k][j] = std::min(slowest[k][j], cost);
+        }
+      }
+    }
+  };
+  findSlowest();
+  if (slowest[numStages][n] == inf) {
+    // Too few stages to stay within the limit. Balance them without it.
+    llvm::errs() << F->getName() << " does not fit in " << numStages
+                 << " pipeline stages of " << config.memoryLimit
+                 << " bytes, the memory limit is ignored\n";
+    std::fill(maxEnd.begin(), maxEnd.end(), n);
+    findSlowest();
+  }
+  auto bound = uint64_t(slowest[numStages][n] * (1 + config.balanceTolerance));
+  bound = std::max(bound, slowest[numStages][n]);
+
+  // crossing[k][j] is the fewest bytes crossing the boundaries when the first
+  // j nodes form k stages within the bound, and start[k][j] is where the last
+  // of these stages starts.
+  std::vector<std::vector<uint64_t>> crossing(
+      numStages + 1, std::vector<uint64_t>(n + 1, inf));
+  std::vector<std::vector<size_t>> start(numStages + 1,
+                                         std::vector<size_t>(n + 1, 0));
+  crossing[0][0] = 0;
+  for (size_t k = 1; k <= numStages; k++) {
+    for (size_t i = k - 1; i < n; i++) {
+      if (crossing[k - 1][i] == inf)
+        continue;
+      uint64_t bytes = crossing[k - 1][i] + cut[i];
+      for (size_t j = i + 1; j <= maxEnd[i] && rangeCost(i, j) <= bound; j++) {
+        if (bytes < crossing[k][j]) {
+          crossing[k][j] = bytes;
+          start[k][j] = i;
+        }
+      }
+    }
+  }
+  assert(crossing[numStages][n] != inf && "No split within the bound");
+
+  // Recover the stage boundaries and create the stages.
+  std::vector<size_t> boundaries(numStages + 1, n);
+  for (size_t k = numStages; k > 0; k--) {
+    boundaries[k - 1] = start[k][boundaries[k]];
+  }
+  NodeFunctionMap mapping;
+  for (size_t k = 0; k < numStages; k++) {
+    auto *stageF = F->getParent()->createFunction(
+        std::string(F->getName()) + "_stage" + std::to_string(k));
+    mapping.create(order[boundaries[k]], stageF);
+    for (size_t i = boundaries[k] + 1; i < boundaries[k + 1]; i++) {
+      mapping.add(order[i], stageF);
+    }
+  }
+  return mapping;
+}
+
+/// Assign nodes to the device islands given by \p deviceOf and return the
+/// mapping. \p devices receives the device of each partition.
+NodeFunctionMap selectDevicePartitions(Function *F,
+                                       const DeviceOfNodeFn &deviceOf,
+                                       std::vector<unsigned> &devices) {
+  // An island is identified by its device and by its stage: the number of
+  // device changes along the longest path from the inputs of the function.
+  // Edges between islands always go to a later stage, so the islands form a
+  // DAG, ordered by their stage.
+  llvm::DenseMap<Node *, std::pair<unsigned, unsigned>> island;
+  std::map<std::pair<unsigned, unsigned>, std::vector<Node *>> islands;
+  GraphPostOrderVisitor visitor(*F);
+  for (auto *node : visitor.getPostOrder()) {
+    if (isa<Storage>(node))
+      continue;
+    unsigned device = deviceOf(node);
+    unsigned stage = 0;
+    for (unsigned i = 0, e = node->getNumInputs(); i < e; i++) {
+      auto *in = node->getNthInput(i).getNode();
+      if (isa<Storage>(in))
+        continue;
+      auto &inIsland = island[in];
+      stage = std::max(stage, inIsland.first + (inIsland.second != device));
+    }
+    island[node] = {stage, device};
+    islands[{stage, device}].push_back(node);
+  }
+
+  NodeFunctionMap mapping;
+  devices.clear();
+  for (auto &it : islands) {
+    auto *newF = F->getParent()->createFunction(
+        std::string(F->getName()) + "_part" + std::to_string(mapping.size()));
+    mapping.create(it.second.front(), newF);
+    for (auto *node : it.second) {
+      mapping.add(node, newF);
+    }
+    devices.push_back(it.first.second);
+  }
+  return mapping;
+}
+
 } // end namespace
 
+NodeCost glow::estimateNodeCost(const Node *N) {
+  NodeCost cost;
+  uint64_t resultSize = 0;
+  for (unsigned r = 0, e = N->getNumResults(); r < e; r++) {
+    auto type = N->getNthResult(r).getType();
+    resultSize += type->size();
+    cost.bytes += type->getSizeInBytes();
+  }
+  for (unsigned inp = 0, e = N->getNumInputs(); inp < e; inp++) {
+    cost.bytes += N->getNthInput(inp).getType()->getSizeInBytes();
+  }
+
+  // Every result element takes a multiply and an add per element of the
+  // reduction that produces it.
+  if (auto *FC = dyn_cast<FullyConnectedNode>(N)) {
+    cost.flops = 2 * resultSize * FC->getWeights().dims()[0];
+  } else if (auto *MM = dyn_cast<MatMulNode>(N)) {
+    cost.flops = 2 * resultSize * MM->getLHS().dims()[1];
+  } else if (auto *BMM = dyn_cast<BatchedMatMulNode>(N)) {
+    cost.flops = 2 * resultSize * BMM->getLHS().dims()[2];
+  } else if (auto *CN = dyn_cast<ConvolutionNode>(N)) {
+    auto filterDims = CN->getFilter().dims();
+    cost.flops =
+        2 * resultSize * (CN->getFilter().getType()->size() / filterDims[0]);
+  } else if (auto *MP = dyn_cast<MaxPoolNode>(N)) {
+    cost.flops = resultSize * MP->getKernels()[0] * MP->getKernels()[1];
+  } else if (auto *AP = dyn_cast<AvgPoolNode>(N)) {
+    cost.flops = resultSize * AP->getKernels()[0] * AP->getKernels()[1];
+  } else {
+    cost.flops = resultSize;
+  }
+  return cost;
+}
+
 FunctionDAG::FunctionDAG(const FunctionList &functions)
     : functions_(functions) {
   for (auto *F : functions_) {
@@ -208,3 +460,19 @@ FunctionDAG glow::partition(Function *F) {
   assert(G.verify());
   return G;
 }
+
+FunctionDAG glow::partitionPipeline(Function *F,
+                                    const PipelineConfig &config) {
+  NodeFunctionMap partitionMap = selectPipelinePartitions(F, config);
+  auto G = doPartitioning(F, partitionMap);
+  assert(G.verify());
+  return G;
+}
+
+FunctionDAG glow::partitionByDevice(Function *F, const DeviceOfNodeFn &deviceOf,
+                                    std::vector<unsigned> &devices) {
+  NodeFunctionMap partitionMap = selectDevicePartitions(F, deviceOf, devices);
+  auto G = doPartitioning(F, partitionMap);
+  assert(G.verify());
+  return G;
+}
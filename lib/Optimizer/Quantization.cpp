@@ -34,6 +34,13 @@ Function *glow::profileQuantization(Function *F, llvm::StringRef newFuncName) {
   // Clone the function.
   Function *G = F->clone(newFuncName);
 
+  // The backends don't run the recurrent cells in quantized precision, so
+  // quantizeFunction expands them, and the profile must cover their gates.
+  // The cells are kept, as they stay in float precision when their kind is not
+  // quantized, and their consumers need the profiles of their outputs.
+  G->expandRecurrentCells([](const Node *) { return true; },
+                          /* keepExpanded */ true);
+
   // Iterate over all nodes in the graph and insert QuantizationProfile nodes
   // to observe tensor values from every node's output.
   std::unordered_set<NodeValue> nodesToInstrument;
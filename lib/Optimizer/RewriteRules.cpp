@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define DEBUG_TYPE "rewrite-rules"
+
+#include "glow/Optimizer/RewriteRules.h"
+#include "glow/Graph/Node.h"
+
+#include "llvm/ADT/Statistic.h"
+
+using namespace glow;
+
+STATISTIC(NumRewritesApplied, "Number of nodes replaced by rewrite rules");
+
+RewriteRuleSet &RewriteRuleSet::add(RewriteRule rule) {
+  assert(rule.replacement && "The rule must have a replacement");
+  size_t idx = static_cast<size_t>(rule.kind);
+  if (rules_.size() <= idx) {
+    rules_.resize(idx + 1);
+  }
+  rules_[idx].push_back(std::move(rule));
+  return *this;
+}
+
+llvm::ArrayRef<RewriteRule> RewriteRuleSet::getRules(Kinded::Kind kind) const {
+  size_t idx = static_cast<size_t>(kind);
+  if (idx >= rules_.size()) {
+    return {};
+  }
+  return rules_[idx];
+}
+
+size_t RewriteRuleSet::size() const {
+  size_t num = 0;
+  for (const auto &rules : rules_) {
+    num += rules.size();
+  }
+  return num;
+}
+
+bool RewriteRuleSet::apply(Function *F) const {
+  bool changed = false;
+  for (auto &node : F->getNodes()) {
+    for (const auto &rule : getRules(node.getKind())) {
+      if (rule.predicate && !rule.predicate(&node)) {
+        continue;
+      }
+      Node *NN = rule.replacement(&node, F);
+      if (!NN) {
+        continue;
+      }
+      NodeValue(&node, 0).replaceAllUsesOfWith(NN);
+      NumRewritesApplied++;
+      changed = true;
+      break;
+    }
+  }
+  return changed;
+}
+
+RewriteRule::Predicate
+rewrite::allOf(std::vector<RewriteRule::Predicate> predicates) {
+  return [predicates](const Node *N) {
+    for (const auto &predicate : predicates) {
+      if (!predicate(N)) {
+        return false;
+      }
+    }
+    return true;
+  };
+}
+
+RewriteRule::Predicate rewrite::hasElemType(ElemKind elemTy) {
+  return [elemTy](const Node *N) {
+    return N->getType(0)->getElementType() == elemTy;
+  };
+}
+
+RewriteRule::Predicate rewrite::isQuantized() {
+  return [](const Node *N) { return N->getType(0)->isQuantizedType(); };
+}
+
+RewriteRule::Predicate rewrite::hasSingleUser() {
+  return [](const Node *N) { return N->hasOneUse(); };
+}
+
+RewriteRule::Predicate rewrite::inputIs(unsigned idx, Kinded::Kind kind) {
+  return [idx, kind](const Node *N) {
+    return idx < N->getNumInputs() &&
+           N->getNthInput(idx).getNode()->getKind() == kind;
+  };
+}
@@ -21,15 +21,6 @@
 namespace glow {
 namespace quantization {
 
-int8_t quantize(float input, const TensorQuantizationParams &TQP) {
-  float result = input / TQP.scale + TQP.offset;
-  return quantization::clip<int32_t, int8_t>((int32_t)nearbyintf(result));
-}
-
-float dequantize(int8_t input, const TensorQuantizationParams &TQP) {
-  return TQP.scale * (input - TQP.offset);
-}
-
 QuantizationTransform32To8 quantizeScaleOffset32To8(float scale,
                                                     int32_t offset) {
   // In this function we compute an efficient way to convert signed 32-bit
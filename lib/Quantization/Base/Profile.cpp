@@ -16,7 +16,10 @@
 
 #include "glow/Quantization/Base/Profile.h"
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <limits>
 
 namespace glow {
 namespace quantization {
@@ -33,12 +36,57 @@ static size_t getBin(size_t nBins, float binWidth, float minValue,
   return result;
 }
 
+/// Redistribute the counts of \p histogram, which covers the range
+/// [\p min, \p max], over the wider range [\p newMin, \p newMax].
+static void rescaleHistogram(Handle<float> histogram, float min, float max,
+                             float newMin, float newMax) {
+  size_t nBins = histogram.size();
+  float destBinWidth = (newMax - newMin) / nBins;
+  float srcBinWidth = (max - min) / nBins;
+
+  std::vector<float> scaledHistogram(nBins);
+
+  for (size_t i = 0; i < nBins; ++i) {
+    if (histogram.raw(i) == 0)
+      continue;
+
+    float srcBinBegin = min + srcBinWidth * i;
+    size_t destBin = (srcBinBegin - newMin) / destBinWidth;
+    float destBinEnd = newMin + destBinWidth * (destBin + 1);
+
+    float srcBinEnd = srcBinBegin + srcBinWidth;
+    size_t destBinToVerify = (srcBinEnd - newMin) / destBinWidth;
+    // Make sure that destination bin is mapped at most to 2 final bins, based
+    // on that redistribute percentage is calculated.
+    assert(destBinToVerify <= destBin + 2);
+    (void)destBinToVerify;
+
+    // Calculate how much we need to redistribute.
+    uint64_t dstBinCnt = static_cast<uint64_t>(
+        std::min(static_cast<float>(round((destBinEnd - srcBinBegin) /
+                                          srcBinWidth * histogram.raw(i))),
+                 histogram.raw(i)));
+
+    size_t newBin = getBin(nBins, destBinWidth, newMin, srcBinBegin);
+    scaledHistogram[newBin] += dstBinCnt;
+
+    if (dstBinCnt < histogram.raw(i)) {
+      size_t newBin =
+          getBin(nBins, destBinWidth, newMin, srcBinBegin + destBinWidth);
+      scaledHistogram[newBin] += histogram.raw(i) - dstBinCnt;
+    }
+  }
+
+  // Copy scaled histogram back to the existing histogram.
+  histogram = scaledHistogram;
+}
+
 void generateTensorHistogram(const Handle<float> inputTensor,
                              Handle<float> existingHistogram, float &min,
                              float &max) {
-  auto minMaxPos = inputTensor.minMaxArg();
-  float minInput = inputTensor.raw(minMaxPos.first);
-  float maxInput = inputTensor.raw(minMaxPos.second);
+  auto minMaxInput = inputTensor.minMax();
+  float minInput = minMaxInput.first;
+  float maxInput = minMaxInput.second;
 
   if (existingHistogram.isZero()) {
     min = minInput;
@@ -51,58 +99,190 @@ void generateTensorHistogram(const Handle<float> inputTensor,
   if (minInput < min || maxInput > max) {
     float newMin = std::min(minInput, min);
     float newMax = std::max(maxInput, max);
+    rescaleHistogram(existingHistogram, min, max, newMin, newMax);
 
-    float destBinWidth = (newMax - newMin) / nBins;
-    float srcBinWidth = (max - min) / nBins;
+    // Update global min and max.
+    min = newMin;
+    max = newMax;
+  }
 
-    std::vector<float> scaledHistogram(nBins);
+  float binWidth = (max - min) / nBins;
+  float *bins = existingHistogram.begin();
+  for (float value : inputTensor) {
+    bins[getBin(nBins, binWidth, min, value)]++;
+  }
+}
 
-    for (size_t i = 0; i < nBins; ++i) {
-      if (existingHistogram.raw(i) == 0)
-        continue;
+void mergeTensorHistograms(Handle<float> srcHistogram, float srcMin,
+                           float srcMax, Handle<float> destHistogram,
+                           float &destMin, float &destMax) {
+  assert(srcHistogram.size() == destHistogram.size() &&
+         "Histograms must have the same number of bins");
+  if (srcHistogram.isZero()) {
+    return;
+  }
+  if (destHistogram.isZero()) {
+    destMin = srcMin;
+    destMax = srcMax;
+  }
 
-      float srcBinBegin = min + srcBinWidth * i;
-      size_t destBin = (srcBinBegin - newMin) / destBinWidth;
-      float destBinEnd = newMin + destBinWidth * (destBin + 1);
+  // Bring both histograms to the union of their ranges.
+  float newMin = std::min(srcMin, destMin);
+  float newMax = std::max(srcMax, destMax);
+  if (destMin != newMin || destMax != newMax) {
+    rescaleHistogram(destHistogram, destMin, destMax, newMin, newMax);
+  }
 
-      float srcBinEnd = srcBinBegin + srcBinWidth;
-      size_t destBinToVerify = (srcBinEnd - newMin) / destBinWidth;
-      // Make sure that destination bin is mapped at most to 2 final bins, based
-      // on that redistribute percentage is calculated.
-      assert(destBinToVerify <= destBin + 2);
-      (void)destBinToVerify;
+  Tensor scaledSrc(ElemKind::FloatTy, {srcHistogram.size()});
+  auto scaledSrcH = scaledSrc.getHandle<float>();
+  scaledSrcH = srcHistogram.getRawData();
+  if (srcMin != newMin || srcMax != newMax) {
+    rescaleHistogram(scaledSrcH, srcMin, srcMax, newMin, newMax);
+  }
 
-      // Calculate how much we need to redistribute.
-      uint64_t dstBinCnt = static_cast<uint64_t>(std::min(
-          static_cast<float>(round((destBinEnd - srcBinBegin) / srcBinWidth *
-                                   existingHistogram.raw(i))),
-          existingHistogram.raw(i)));
+  std::transform(destHistogram.begin(), destHistogram.end(),
+                 scaledSrcH.begin(), destHistogram.begin(), std::plus<float>());
+  destMin = newMin;
+  destMax = newMax;
+}
 
-      size_t newBin = getBin(nBins, destBinWidth, newMin, srcBinBegin);
-      scaledHistogram[newBin] += dstBinCnt;
+/// Turn the bin counts \p dist into a probability distribution. Empty bins
+/// get the small probability \p eps before normalization so that the
+/// divergence against this distribution stays finite.
+static void normalizeDistribution(std::vector<float> &dist,
+                                  float eps = 0.0001) {
+  double sum = 0;
+  for (float v : dist) {
+    sum += v;
+  }
+  if (sum == 0) {
+    std::fill(dist.begin(), dist.end(), 1.0f / dist.size());
+    return;
+  }
 
-      if (dstBinCnt < existingHistogram.raw(i)) {
-        size_t newBin =
-            getBin(nBins, destBinWidth, newMin, srcBinBegin + destBinWidth);
-        scaledHistogram[newBin] += existingHistogram.raw(i) - dstBinCnt;
+  double smoothedSum = 0;
+  for (auto &v : dist) {
+    v = v == 0 ? eps : v / sum;
+    smoothedSum += v;
+  }
+  for (auto &v : dist) {
+    v /= smoothedSum;
+  }
+}
+
+/// \returns the Kullback-Leibler divergence of \p Q from \p P. Both are
+/// given as bin counts and are normalized in place.
+static double computeKL(std::vector<float> &P, std::vector<float> &Q) {
+  assert(P.size() == Q.size() && "Distributions must have the same size");
+  normalizeDistribution(P);
+  normalizeDistribution(Q);
+
+  double result = 0;
+  for (size_t i = 0, e = P.size(); i < e; ++i) {
+    result += P[i] * std::log(P[i] / Q[i]);
+  }
+  return result;
+}
+
+/// \returns the Kullback-Leibler divergence between \p histogram clipped to
+/// the bins [\p begin, \p end) and its quantization with \p numQuantizedBins
+/// levels. \p prefix holds the prefix sums of the histogram. \p P and \p Q
+/// are scratch buffers.
+static double computeClippedKL(const Handle<float> &histogram,
+                               const std::vector<double> &prefix,
+                               size_t begin, size_t end,
+                               size_t numQuantizedBins, std::vector<float> &P,
+                               std::vector<float> &Q) {
+  size_t width = end - begin;
+
+  // The reference distribution is the histogram clipped to the candidate
+  // range: values outside of it saturate to the boundary bins.
+  P.resize(width);
+  for (size_t i = 0; i < width; ++i) {
+    P[i] = histogram.raw(begin + i);
+  }
+  P.front() += prefix[begin];
+  P.back() += prefix.back() - prefix[end];
+
+  // The candidate distribution merges the bins of the range into
+  // numQuantizedBins levels and spreads the count of every level evenly over
+  // the non-empty bins it covers.
+  Q.assign(width, 0);
+  for (size_t q = 0; q < numQuantizedBins; ++q) {
+    size_t qBegin = q * width / numQuantizedBins;
+    size_t qEnd = (q + 1) * width / numQuantizedBins;
+    double sum = prefix[begin + qEnd] - prefix[begin + qBegin];
+    size_t nonEmpty = 0;
+    for (size_t i = qBegin; i < qEnd; ++i) {
+      nonEmpty += P[i] != 0;
+    }
+    if (nonEmpty == 0) {
+      continue;
+    }
+    for (size_t i = qBegin; i < qEnd; ++i) {
+      if (P[i] != 0) {
+        Q[i] = sum / nonEmpty;
       }
     }
+  }
 
-    // Copy scaled histogram back to the existing histogram.
-    for (size_t i = 0, e = scaledHistogram.size(); i < e; ++i) {
-      existingHistogram.raw(i) = scaledHistogram[i];
-    }
+  return computeKL(P, Q);
+}
 
-    // Update global min and max.
-    min = newMin;
-    max = newMax;
+std::pair<float, float> optimizeKLRange(const Handle<float> histogram,
+                                        float min, float max,
+                                        size_t numQuantizedBins) {
+  size_t nBins = histogram.size();
+  if (nBins <= numQuantizedBins || !(min < max) || histogram.isZero()) {
+    return {min, max};
   }
 
   float binWidth = (max - min) / nBins;
-  for (size_t i = 0, e = inputTensor.size(); i < e; ++i) {
-    size_t newBin = getBin(nBins, binWidth, min, inputTensor.raw(i));
-    existingHistogram.raw(newBin)++;
+  // The quantized range always contains zero, so the candidate ranges must
+  // not exclude it either.
+  float zeroBin = std::min(std::max(-min / binWidth, 0.f), float(nBins));
+  size_t maxBegin = std::floor(zeroBin);
+  size_t minEnd = std::ceil(zeroBin);
+
+  // Prefix sums of the bin counts, used to compute the clipped mass.
+  std::vector<double> prefix(nBins + 1, 0);
+  for (size_t i = 0; i < nBins; ++i) {
+    prefix[i + 1] = prefix[i] + histogram.raw(i);
   }
+
+  std::vector<float> P;
+  std::vector<float> Q;
+  size_t begin = 0;
+  size_t end = nBins;
+
+  // Select the upper bound with the full lower range first, then the lower
+  // bound. The outliers on each side are usually independent.
+  double bestKL = std::numeric_limits<double>::infinity();
+  size_t bestEnd = end;
+  for (size_t e = std::max(begin + numQuantizedBins, minEnd); e <= nBins;
+       ++e) {
+    double KL =
+        computeClippedKL(histogram, prefix, begin, e, numQuantizedBins, P, Q);
+    if (KL < bestKL) {
+      bestKL = KL;
+      bestEnd = e;
+    }
+  }
+  end = bestEnd;
+
+  bestKL = std::numeric_limits<double>::infinity();
+  size_t bestBegin = begin;
+  for (size_t b = 0; b <= maxBegin && b + numQuantizedBins <= end; ++b) {
+    double KL =
+        computeClippedKL(histogram, prefix, b, end, numQuantizedBins, P, Q);
+    if (KL < bestKL) {
+      bestKL = KL;
+      bestBegin = b;
+    }
+  }
+  begin = bestBegin;
+
+  return {min + begin * binWidth, min + end * binWidth};
 }
 
 } // namespace quantization
@@ -17,48 +17,117 @@
 #include "glow/Quantization/Quantization.h"
 
 #include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Quantization/Base/Profile.h"
 
 #include <cmath>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 using llvm::cast;
+using llvm::isa;
 
 namespace glow {
 namespace quantization {
 
 std::vector<NodeQuantizationInfo>
-generateNodeQuantizationInfos(const Function *F, Schema schema) {
+generateNodeQuantizationInfos(const Function *F, Schema schema,
+                              Calibration calibration) {
+  return generateNodeQuantizationInfos(generateNodeProfilingInfos(F), schema,
+                                       calibration);
+}
+
+std::vector<NodeQuantizationInfo>
+generateNodeQuantizationInfos(llvm::ArrayRef<NodeProfilingInfo> profilingInfos,
+                              Schema schema, Calibration calibration) {
   std::vector<NodeQuantizationInfo> quantizationInfos;
 
+  for (const auto &PI : profilingInfos) {
+    float min = PI.min_;
+    float max = PI.max_;
+    if (calibration == Calibration::KLMinimization && !PI.histogram_.empty()) {
+      Type histTy(ElemKind::FloatTy, {PI.histogram_.size()});
+      Tensor histogram(const_cast<float *>(PI.histogram_.data()), &histTy);
+      std::tie(min, max) =
+          optimizeKLRange(histogram.getHandle<float>(), min, max);
+    }
+
+    TensorQuantizationParams TQP = chooseQuantizationParams(min, max, schema);
+
+    quantizationInfos.emplace_back(PI.nodeOutputName_, TQP);
+  }
+
+  return quantizationInfos;
+}
+
+std::vector<NodeProfilingInfo> generateNodeProfilingInfos(const Function *F) {
+  std::vector<NodeProfilingInfo> profilingInfos;
+
   for (auto &node : F->getNodes()) {
     auto *QPN = llvm::dyn_cast<QuantizationProfileNode>(&node);
 
     if (QPN) {
       auto CI = QPN->getComputationInfoVar()->getHandle<float>();
       auto histogram = QPN->getHistogramVar()->getHandle<float>();
-      float min = CI.raw(0);
-      float max = CI.raw(1);
 
       std::string fullOutputName = NodeQuantizationInfo::generateNodeOutputName(
           QPN->getProfiledNodeName(), QPN->getProfiledOutputNumber());
 
-      // TODO: Ideally tensor quantization params should be calculated
-      // based on the histogram distribution. Use simplistic approach for now.
-      (void)histogram;
-      TensorQuantizationParams TQP = chooseQuantizationParams(min, max, schema);
+      std::vector<float> bins(histogram.begin(), histogram.end());
+      profilingInfos.emplace_back(fullOutputName, CI.raw(0), CI.raw(1),
+                                  std::move(bins));
+    }
+  }
 
-      quantizationInfos.emplace_back(fullOutputName, TQP);
+  return profilingInfos;
+}
+
+void mergeNodeProfilingInfos(std::vector<NodeProfilingInfo> &dest,
+                             llvm::ArrayRef<NodeProfilingInfo> src) {
+  std::unordered_map<std::string, size_t> destIndex;
+  for (size_t i = 0, e = dest.size(); i < e; i++) {
+    destIndex[dest[i].nodeOutputName_] = i;
+  }
+
+  for (const auto &PI : src) {
+    auto it = destIndex.find(PI.nodeOutputName_);
+    if (it == destIndex.end()) {
+      destIndex[PI.nodeOutputName_] = dest.size();
+      dest.push_back(PI);
+      continue;
     }
+
+    NodeProfilingInfo &D = dest[it->second];
+    GLOW_ASSERT(D.histogram_.size() == PI.histogram_.size() &&
+                "Profiles must have the same number of histogram bins");
+    // Wrap the histograms in tensors to reuse the histogram helpers.
+    Type histTy(ElemKind::FloatTy, {D.histogram_.size()});
+    Tensor srcHist(const_cast<float *>(PI.histogram_.data()), &histTy);
+    Tensor destHist(D.histogram_.data(), &histTy);
+    mergeTensorHistograms(srcHist.getHandle<float>(), PI.min_, PI.max_,
+                          destHist.getHandle<float>(), D.min_, D.max_);
   }
+}
 
-  return quantizationInfos;
+/// \returns the parameters quantizing to \p qTy the range that \p TQP
+/// quantizes to int8. Profiles always hold int8 parameters; a 16-bit value
+/// covers the same range with 256 times finer steps, and still represents
+/// zero exactly. The int8 offset is rounded, so the profiled range may extend
+/// up to half an int8 step past the int8 range. The 16-bit range covers these
+/// half steps too.
+static TensorQuantizationParams
+convertQuantizationParams(const TensorQuantizationParams &TQP, ElemKind qTy) {
+  if (qTy == ElemKind::Int16QTy) {
+    return {TQP.scale / 256, TQP.offset * 256 + 128};
+  }
+  return TQP;
 }
 
-/// Quantize all inputs for \p node and return back pointers to the newly
-/// created qunatization nodes.
+/// Quantize all inputs for \p node to \p qTy and return back pointers to the
+/// newly created qunatization nodes.
 static llvm::SmallVector<NodeValue, 6>
-quantizeInputs(Function *F, Node *node,
+quantizeInputs(Function *F, Node *node, ElemKind qTy,
                const std::unordered_map<std::string, TensorQuantizationParams>
                    &nodeToTQP) {
   llvm::SmallVector<NodeValue, 6> quantizedInputs;
@@ -76,10 +145,9 @@ quantizeInputs(Function *F, Node *node,
     assert(nodeToTQP.find(nodeOutputName) != nodeToTQP.end() &&
            "Missing quantization params for a node");
 
-    const TensorQuantizationParams &TQP =
-        nodeToTQP.find(nodeOutputName)->second;
-    auto QT = F->getParent()->uniqueType(ElemKind::Int8QTy, NV.dims(),
-                                         TQP.scale, TQP.offset);
+    const TensorQuantizationParams TQP =
+        convertQuantizationParams(nodeToTQP.find(nodeOutputName)->second, qTy);
+    auto QT = F->getParent()->uniqueType(qTy, NV.dims(), TQP.scale, TQP.offset);
 
     Node *quantizeNode = F->createQuantize("quantize", NV, QT);
     quantizedInputs.push_back(quantizeNode);
@@ -103,6 +171,12 @@ static bool canBeQuantized(const Node *node) {
     auto *SMN = cast<SoftMaxNode>(node);
     return SMN->getInput().getElementType() == ElemKind::FloatTy;
   }
+  case Kinded::Kind::PowNodeKind: {
+    // The quantized power is a lookup table, which needs a constant exponent.
+    auto *PN = cast<PowNode>(node);
+    return isa<SplatNode>(PN->getRHS()) &&
+           PN->getLHS().getElementType() == ElemKind::FloatTy;
+  }
   default:
     // Let the general procedure handle this node kind.
     break;
@@ -119,15 +193,16 @@ static bool canBeQuantized(const Node *node) {
 }
 
 /// Quantize the \p node such that all floating point inputs and outputs
-/// are quantized to int8 type with some scale and offset.
+/// are quantized to \p qTy type with some scale and offset.
 /// \returns Quantized node.
 ///
 /// \param F Function which holds the non quantized \p node.
 /// \param node Node to be quantized.
+/// \param qTy Quantized element kind, Int8QTy or Int16QTy.
 /// \param quantizedInputs Array of already quantized inputs to the result node.
 /// \param qParams Tensor quantization parameters for all outputs of the
-///        \p node.
-static Node *quantizeNode(Function *F, Node *node,
+///        \p node, for \p qTy.
+static Node *quantizeNode(Function *F, Node *node, ElemKind qTy,
                           llvm::MutableArrayRef<NodeValue> quantizedInputs,
                           llvm::ArrayRef<TensorQuantizationParams> qParams) {
   Node *quantizedNode{};
@@ -137,9 +212,8 @@ static Node *quantizeNode(Function *F, Node *node,
     auto *FC = cast<FullyConnectedNode>(node);
     assert(quantizedInputs.size() == 3 && "Invalid number of inputs");
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
-    auto QT =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, FC->getResult().dims(),
-                                   qParams[0].scale, qParams[0].offset);
+    auto QT = F->getParent()->uniqueType(qTy, FC->getResult().dims(),
+                                         qParams[0].scale, qParams[0].offset);
     quantizedNode =
         F->createFullyConnected(FC->getName(), quantizedInputs[0],
                                 quantizedInputs[1], quantizedInputs[2], QT);
@@ -150,9 +224,8 @@ static Node *quantizeNode(Function *F, Node *node,
     auto *CV = cast<ConvolutionNode>(node);
     assert(quantizedInputs.size() == 3 && "Invalid number of inputs");
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
-    auto QT =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, CV->getResult().dims(),
-                                   qParams[0].scale, qParams[0].offset);
+    auto QT = F->getParent()->uniqueType(qTy, CV->getResult().dims(),
+                                         qParams[0].scale, qParams[0].offset);
     quantizedNode =
         F->createConv(CV->getName(), quantizedInputs[0], quantizedInputs[1],
                       quantizedInputs[2], QT, CV->getKernels(),
@@ -165,7 +238,7 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
 
     auto QT =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, S->getResult().dims(),
+        F->getParent()->uniqueType(qTy, S->getResult().dims(),
                                    quantizedInputs[0].getType()->getScale(),
                                    quantizedInputs[0].getType()->getOffset());
 
@@ -178,9 +251,8 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(quantizedInputs.size() == 1 && "Invalid number of inputs");
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
 
-    auto QT =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, R->getResult().dims(),
-                                   qParams[0].scale, qParams[0].offset);
+    auto QT = F->getParent()->uniqueType(qTy, R->getResult().dims(),
+                                         qParams[0].scale, qParams[0].offset);
 
     quantizedNode = F->createRELU(R->getName(), quantizedInputs[0], QT);
     break;
@@ -201,6 +273,17 @@ static Node *quantizeNode(Function *F, Node *node,
         F->createReshape(R->getName(), quantizedInputs[0], R->getDims());
     break;
   }
+  case Kinded::Kind::BroadcastNodeKind: {
+    // The repeated elements keep the quantization parameters of the input.
+    auto *B = cast<BroadcastNode>(node);
+    assert(quantizedInputs.size() == 1 && "Invalid number of inputs");
+    assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+    auto QT = F->getParent()->uniqueTypeWithNewShape(
+        quantizedInputs[0].getType(), B->getResult().dims());
+    quantizedNode =
+        F->addNode(new BroadcastNode(B->getName(), QT, quantizedInputs[0]));
+    break;
+  }
   case Kinded::Kind::MaxPoolNodeKind: {
     auto *P = cast<MaxPoolNode>(node);
     assert(quantizedInputs.size() == 1 && "Invalid number of inputs");
@@ -226,9 +309,9 @@ static Node *quantizeNode(Function *F, Node *node,
     auto *AN = cast<NODE_NAME_##Node>(node);                                   \
     assert(quantizedInputs.size() == 2 && "Invalid number of inputs");         \
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");      \
-    auto outTy =                                                               \
-        F->getParent()->uniqueType(ElemKind::Int8QTy, AN->getResult().dims(),  \
-                                   qParams[0].scale, qParams[0].offset);       \
+    auto outTy = F->getParent()->uniqueType(qTy, AN->getResult().dims(),     \
+                                            qParams[0].scale,                  \
+                                            qParams[0].offset);                \
     quantizedNode = F->create##NODE_NAME_(                                     \
         AN->getName(), outTy, quantizedInputs[0], quantizedInputs[1]);         \
     break;                                                                     \
@@ -249,7 +332,7 @@ static Node *quantizeNode(Function *F, Node *node,
     // same {S,O} params.
     for (size_t qi = 0, e = quantizedInputs.size(); qi < e; qi++) {
       auto argOutTy = F->getParent()->uniqueType(
-          ElemKind::Int8QTy, quantizedInputs[qi].dims(), qParams[0].scale,
+          qTy, quantizedInputs[qi].dims(), qParams[0].scale,
           qParams[0].offset);
 
       quantizedInputs[qi] =
@@ -258,7 +341,7 @@ static Node *quantizeNode(Function *F, Node *node,
     }
 
     auto outTy =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, C->getResult().dims(),
+        F->getParent()->uniqueType(qTy, C->getResult().dims(),
                                    qParams[0].scale, qParams[0].offset);
     quantizedNode =
         F->createConcat(node->getName(), quantizedInputs, C->getDim(), outTy);
@@ -269,7 +352,7 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(quantizedInputs.size() == 0 && "Invalid number of inputs");
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
     auto outTy =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, SPN->getResult().dims(),
+        F->getParent()->uniqueType(qTy, SPN->getResult().dims(),
                                    qParams[0].scale, qParams[0].offset);
     quantizedNode = F->createSplat(node->getName(), outTy, SPN->getValue());
     break;
@@ -315,6 +398,34 @@ static Node *quantizeNode(Function *F, Node *node,
     quantizedNode = F->createSigmoid(SN->getName(), quantizedInputs[0]);
     break;
   }
+  case Kinded::Kind::LogNodeKind: {
+    auto *LN = cast<LogNode>(node);
+    assert(quantizedInputs.size() == 1 && "Invalid number of inputs");
+    assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+    auto outTy =
+        F->getParent()->uniqueType(qTy, LN->getResult().dims(),
+                                   qParams[0].scale, qParams[0].offset);
+
+    // Note: This is lowered into an IntLookupTable.
+    quantizedNode = F->createLog(LN->getName(), quantizedInputs[0], outTy);
+    break;
+  }
+  case Kinded::Kind::PowNodeKind: {
+    auto *PN = cast<PowNode>(node);
+    assert(quantizedInputs.size() == 2 && "Invalid number of inputs");
+    assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+    auto outTy =
+        F->getParent()->uniqueType(qTy, PN->getResult().dims(),
+                                   qParams[0].scale, qParams[0].offset);
+
+    // Note: This is lowered into an IntLookupTable. The splat keeps the
+    // exponent in floating point, so it is not rounded to the input scale.
+    auto *exp = F->createSplat(PN->getRHS().getNode()->getName(),
+                               quantizedInputs[1].getType(),
+                               cast<SplatNode>(PN->getRHS())->getValue());
+    quantizedNode = F->createPow(PN->getName(), outTy, quantizedInputs[0], exp);
+    break;
+  }
   case Kinded::Kind::LocalResponseNormalizationNodeKind: {
     auto *LRN = cast<LocalResponseNormalizationNode>(node);
     assert(quantizedInputs.size() == 1 && "Invalid number of inputs");
@@ -330,7 +441,7 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(quantizedInputs.size() == 1 && "Invalid number of inputs");
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
     auto outTy =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, SMN->getResult().dims(),
+        F->getParent()->uniqueType(qTy, SMN->getResult().dims(),
                                    qParams[0].scale, qParams[0].offset);
     quantizedNode = F->createSoftMax(SMN->getName(), quantizedInputs[0],
                                      SMN->getSelected(), outTy);
@@ -342,7 +453,7 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
 
     auto outTy =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, BRAN->getResult().dims(),
+        F->getParent()->uniqueType(qTy, BRAN->getResult().dims(),
                                    qParams[0].scale, qParams[0].offset);
     quantizedNode = F->createBatchedReduceAdd(
         BRAN->getName(), outTy, quantizedInputs[0], BRAN->getAxis());
@@ -354,10 +465,23 @@ static Node *quantizeNode(Function *F, Node *node,
     assert(qParams.size() == 1 && "Invalid number of quantized outputs");
 
     auto outTy =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, MMN->getResult().dims(),
+        F->getParent()->uniqueType(qTy, MMN->getResult().dims(),
                                    qParams[0].scale, qParams[0].offset);
     quantizedNode = F->createMatMul(MMN->getName(), outTy, quantizedInputs[0],
-                                    quantizedInputs[1]);
+                                    quantizedInputs[1], MMN->getTransposeRHS());
+    break;
+  }
+  case Kinded::Kind::BatchedMatMulNodeKind: {
+    auto *BMM = cast<BatchedMatMulNode>(node);
+    assert(quantizedInputs.size() == 2 && "Invalid number of inputs");
+    assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+
+    auto outTy =
+        F->getParent()->uniqueType(qTy, BMM->getResult().dims(),
+                                   qParams[0].scale, qParams[0].offset);
+    quantizedNode = F->createBatchedMatMul(BMM->getName(), outTy,
+                                           quantizedInputs[0],
+                                           quantizedInputs[1]);
     break;
   }
   default:
@@ -367,6 +491,78 @@ static Node *quantizeNode(Function *F, Node *node,
   return quantizedNode;
 }
 
+/// Quantize the float Convolution \p node with a separate scale and offset for
+/// every output channel of its filter. Per-tensor filter parameters lose too
+/// much accuracy on depthwise and late-stage layers, whose channels often have
+/// very different ranges. This requires the filter and the bias to be private
+/// variables, so that they can be quantized here. \returns the quantized
+/// node, or nullptr if \p node cannot be quantized channel-wise.
+///
+/// \param F Function which holds the non quantized \p node.
+/// \param node Node to be quantized.
+/// \param quantizedInputs Array of already quantized inputs to the node.
+/// \param qParams Tensor quantization parameters for the output of \p node.
+static Node *
+quantizeConvChannelwise(Function *F, Node *node,
+                        llvm::ArrayRef<NodeValue> quantizedInputs,
+                        llvm::ArrayRef<TensorQuantizationParams> qParams) {
+  auto *CV = llvm::dyn_cast<ConvolutionNode>(node);
+  if (!CV) {
+    return nullptr;
+  }
+  auto *filter = llvm::dyn_cast<Variable>(CV->getFilter().getNode());
+  auto *bias = llvm::dyn_cast<Variable>(CV->getBias().getNode());
+  if (!filter || !bias || !filter->isPrivate() || !bias->isPrivate()) {
+    return nullptr;
+  }
+  assert(quantizedInputs.size() == 3 && "Invalid number of inputs");
+  assert(qParams.size() == 1 && "Invalid number of quantized outputs");
+
+  Module *M = F->getParent();
+  auto filterDims = filter->dims();
+  size_t depth = filterDims[0];
+  size_t sliceSize = filter->getType()->size() / depth;
+  float inScale = quantizedInputs[0].getType()->getScale();
+
+  auto *QF = M->createVariable(ElemKind::Int8QTy, filterDims, 1.0, 0,
+                               filter->getName(), VisibilityKind::Private,
+                               false);
+  auto *QB = M->createVariable(ElemKind::Int32QTy, {depth}, 1.0, 0,
+                               bias->getName(), VisibilityKind::Private, false);
+  auto *scales =
+      M->createVariable(ElemKind::FloatTy, {depth}, "scales",
+                        VisibilityKind::Private, false);
+  auto *offsets = M->createVariable(ElemKind::Int32QTy, {depth}, 1.0, 0,
+                                    "offsets", VisibilityKind::Private, false);
+
+  auto FH = filter->getHandle<float>();
+  auto BH = bias->getHandle<float>();
+  auto QFH = QF->getHandle<int8_t>();
+  auto QBH = QB->getHandle<int32_t>();
+  auto SH = scales->getHandle<float>();
+  auto OH = offsets->getHandle<int32_t>();
+  for (size_t d = 0; d < depth; d++) {
+    // Pick the range of every output channel separately.
+    auto range = FH.minMax(d * sliceSize, (d + 1) * sliceSize);
+    TensorQuantizationParams TQP =
+        chooseQuantizationParams(range.first, range.second);
+    for (size_t i = d * sliceSize, e = i + sliceSize; i < e; i++) {
+      QFH.raw(i) = quantize(FH.raw(i), TQP);
+    }
+    SH.at({d}) = TQP.scale;
+    OH.at({d}) = TQP.offset;
+    // The bias is added to the int32 accumulator, so quantize it with the
+    // scale of the matrix multiplication of this channel.
+    QBH.at({d}) = std::round(BH.at({d}) / (inScale * TQP.scale));
+  }
+
+  auto QT = M->uniqueType(ElemKind::Int8QTy, CV->getResult().dims(),
+                          qParams[0].scale, qParams[0].offset);
+  return F->createChannelwiseQuantizedConv(
+      CV->getName(), quantizedInputs[0], QF, QB, scales, offsets, QT,
+      CV->getKernels(), CV->getStrides(), CV->getPads(), CV->getGroup());
+}
+
 /// \returns Tensor quantization parameters for all eligible (floating point)
 /// outputs of the \p node.
 ///
@@ -396,7 +592,7 @@ static llvm::SmallVector<TensorQuantizationParams, 6> getQuantizationParameters(
 /// Some of the nodes need special post processing after quantization.
 /// For example, MaxPool node needs to have adjusted quantization parameters.
 static Node *
-postProcessQuantizedNode(Function *F, Node *quantizedNode,
+postProcessQuantizedNode(Function *F, Node *quantizedNode, ElemKind qTy,
                          llvm::ArrayRef<TensorQuantizationParams> qParams) {
   if (quantizedNode->getKind() == Kinded::Kind::MaxPoolNodeKind ||
       quantizedNode->getKind() == Kinded::Kind::AvgPoolNodeKind ||
@@ -405,7 +601,7 @@ postProcessQuantizedNode(Function *F, Node *quantizedNode,
     // {S,O} as the input. Make sure that rescale is applied to comply with
     // the taken profile from the node.
     auto outTy =
-        F->getParent()->uniqueType(ElemKind::Int8QTy, quantizedNode->dims(0),
+        F->getParent()->uniqueType(qTy, quantizedNode->dims(0),
                                    qParams[0].scale, qParams[0].offset);
     return F->createRescaleQuantized(quantizedNode->getName(), quantizedNode,
                                      outTy);
@@ -413,11 +609,60 @@ postProcessQuantizedNode(Function *F, Node *quantizedNode,
   return quantizedNode;
 }
 
+/// The largest factor by which the unification of the scales of the inputs of
+/// a Concat may coarsen the scale of an input, i.e. one bit of precision.
+static constexpr float maxConcatScaleCoarsening = 2;
+
+/// Assign the quantization parameters of every Concat of \p F to the outputs
+/// that feed it in \p nodeToTQP, as long as this coarsens their scales by at
+/// most maxConcatScaleCoarsening. The producers then compute their int8
+/// results with the parameters of the Concat, so no RescaleQuantized is needed
+/// between them and the Concat, and the results can be written straight into
+/// the concatenated buffer. An output that feeds several Concats keeps the
+/// parameters of the first one.
+static void unifyConcatScales(
+    Function *F,
+    std::unordered_map<std::string, TensorQuantizationParams> &nodeToTQP) {
+  std::unordered_set<std::string> unified;
+  // Visit the outer Concats of nested ones first, so that the parameters of an
+  // inner Concat are final before they are propagated to its inputs.
+  auto &nodes = F->getNodes();
+  for (auto it = nodes.rbegin(), e = nodes.rend(); it != e; ++it) {
+    auto *C = llvm::dyn_cast<ConcatNode>(&*it);
+    if (!C || C->getResult().getElementType() != ElemKind::FloatTy) {
+      continue;
+    }
+    auto concatIt = nodeToTQP.find(
+        NodeQuantizationInfo::generateNodeOutputName(C->getName(), 0));
+    if (concatIt == nodeToTQP.end()) {
+      continue;
+    }
+    const TensorQuantizationParams concatTQP = concatIt->second;
+
+    for (unsigned i = 0, e = C->getNumInputs(); i < e; i++) {
+      auto NV = C->getNthInput(i);
+      auto name = NodeQuantizationInfo::generateNodeOutputName(
+          NV.getNode()->getName(), NV.getResNo());
+      auto inputIt = nodeToTQP.find(name);
+      if (inputIt == nodeToTQP.end() || unified.count(name)) {
+        continue;
+      }
+      if (concatTQP.scale > inputIt->second.scale * maxConcatScaleCoarsening) {
+        continue;
+      }
+      inputIt->second = concatTQP;
+      unified.insert(name);
+    }
+  }
+}
+
 Function *
 quantizeFunction(const ExecutionEngine &EE,
                  llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
                  Function *F, llvm::StringRef newFuncName,
-                 const KindSet &doNotQuantizeKinds) {
+                 const KindSet &doNotQuantizeKinds, bool enableChannelwise,
+                 const KindSet &int16Kinds,
+                 llvm::ArrayRef<NodePrecisionInfo> nodePrecisions) {
   std::string tmpName;
   if (newFuncName.empty()) {
     tmpName = std::string(F->getName()) + "_quantized";
@@ -426,6 +671,11 @@ quantizeFunction(const ExecutionEngine &EE,
 
   Function *G = F->clone(newFuncName);
 
+  bool channelwiseConv =
+      enableChannelwise &&
+      EE.isOpSupported(Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind,
+                       ElemKind::Int8QTy);
+
   // Build a mapping between node name and TensorQuantizatonParams.
   std::unordered_map<std::string, TensorQuantizationParams> nodeToTQP;
   for (const auto &quantizationInfo : quantizationInfos) {
@@ -433,6 +683,35 @@ quantizeFunction(const ExecutionEngine &EE,
                       quantizationInfo.tensorQuantizationParams_);
   }
 
+  // The clone keeps the names of the nodes.
+  std::unordered_map<std::string, ElemKind> precisions;
+  for (const auto &info : nodePrecisions) {
+    precisions[info.nodeName_] = info.precision_;
+  }
+
+  // \returns true if the caller asked to keep \p node in float precision.
+  auto keepsFloat = [&](const Node *node) {
+    auto precisionIt = precisions.find(node->getName());
+    if (precisionIt != precisions.end()) {
+      return precisionIt->second == ElemKind::FloatTy;
+    }
+    return doNotQuantizeKinds.count(node->getKind()) != 0;
+  };
+
+  // Quantize the gates of the recurrent cells that the backend can't run in
+  // quantized precision, as the lowering would only expand them after the
+  // quantization. profileQuantization profiles the expanded nodes.
+  G->expandRecurrentCells([&](const Node *node) {
+    return !keepsFloat(node) &&
+           !EE.isOpSupported(node->getKind(), ElemKind::Int8QTy);
+  });
+
+  // Let the producers of the inputs of the Concats use the parameters of the
+  // Concat, unless the Concats are not quantized.
+  if (!doNotQuantizeKinds.count(Kinded::Kind::ConcatNodeKind)) {
+    unifyConcatScales(G, nodeToTQP);
+  }
+
   // For every unprocessed node in the graph we keep the invariant of having
   // all inputs to be float typed.
   auto nodeIt = G->getNodes().end();
@@ -441,25 +720,50 @@ quantizeFunction(const ExecutionEngine &EE,
     --nodeIt;
     Node *node = &*nodeIt;
 
-    // The caller may request some node kinds to not be quantized.
-    if (doNotQuantizeKinds.count(node->getKind())) {
+    // The caller may request some node kinds to not be quantized, or to be
+    // quantized in 16-bit precision, unless the node has its own precision.
+    if (keepsFloat(node)) {
       continue;
     }
+    auto precisionIt = precisions.find(node->getName());
+    bool hasPrecision = precisionIt != precisions.end();
+
+    // Nodes requested in 16-bit precision fall back to 8-bit when the backend
+    // does not support them.
+    bool wantsInt16 = hasPrecision
+                          ? precisionIt->second == ElemKind::Int16QTy
+                          : int16Kinds.count(node->getKind()) != 0;
+    ElemKind qTy = ElemKind::Int8QTy;
+    if (wantsInt16 && EE.isOpSupported(node->getKind(), ElemKind::Int16QTy)) {
+      qTy = ElemKind::Int16QTy;
+    }
 
-    // Make sure that all inputs are floats and int8 operation is supported by
-    // the backend. Not all backends support particular quantized operation and
-    // also we should not quantize Index type inputs.
-    if (canBeQuantized(node) &&
-        EE.isOpSupported(node->getKind(), ElemKind::Int8QTy)) {
+    // Make sure that all inputs are floats and the quantized operation is
+    // supported by the backend. Not all backends support particular quantized
+    // operation and also we should not quantize Index type inputs.
+    if (canBeQuantized(node) && EE.isOpSupported(node->getKind(), qTy)) {
       // 1) Quantize all of the inputs based on the profiles.
       //    Quantize only floating point inputs.
-      auto quantizedInputs = quantizeInputs(G, node, nodeToTQP);
+      auto quantizedInputs = quantizeInputs(G, node, qTy, nodeToTQP);
 
       auto qParams = getQuantizationParameters(node, nodeToTQP);
+      llvm::SmallVector<TensorQuantizationParams, 6> qTyParams;
+      for (const auto &TQP : qParams) {
+        qTyParams.push_back(convertQuantizationParams(TQP, qTy));
+      }
 
-      // 2) Quantize the node.
-      Node *quantizedNode = quantizeNode(G, node, quantizedInputs, qParams);
-      quantizedNode = postProcessQuantizedNode(G, quantizedNode, qParams);
+      // 2) Quantize the node. Use per-channel filter parameters when
+      //    requested and supported, and fall back to per-tensor ones.
+      Node *quantizedNode = nullptr;
+      if (channelwiseConv && qTy == ElemKind::Int8QTy) {
+        quantizedNode =
+            quantizeConvChannelwise(G, node, quantizedInputs, qParams);
+      }
+      if (!quantizedNode) {
+        quantizedNode = quantizeNode(G, node, qTy, quantizedInputs, qTyParams);
+      }
+      quantizedNode =
+          postProcessQuantizedNode(G, quantizedNode, qTy, qTyParams);
       assert(quantizedNode != nullptr && "Node must be quantized");
 
       // 3) Dequantize all outputs of the node so that invariant is kept.
@@ -468,8 +772,7 @@ quantizeFunction(const ExecutionEngine &EE,
            outNum++) {
         // Dequantize only quantized outputs.
         // In case output was not quantized we still need to relink the node.
-        if (quantizedNode->getNthResult(outNum).getElementType() !=
-            ElemKind::Int8QTy) {
+        if (quantizedNode->getNthResult(outNum).getElementType() != qTy) {
           node->getNthResult(outNum).replaceAllUsesOfWith(
               quantizedNode->getNthResult(outNum));
           continue;
@@ -493,5 +796,62 @@ quantizeFunction(const ExecutionEngine &EE,
   return G;
 }
 
+/// Replace every FullyConnected of \p F whose weights are a private float
+/// variable by the node of kind \p kind that \p createFC builds from the
+/// name, the input, the float weights and the bias of the layer, provided the
+/// backend of \p EE supports it. \returns the number of replaced layers.
+template <typename CreateFnTy>
+static unsigned replaceFullyConnected(const ExecutionEngine &EE, Function *F,
+                                      Kinded::Kind kind, CreateFnTy createFC) {
+  if (!EE.isOpSupported(kind, ElemKind::FloatTy)) {
+    return 0;
+  }
+
+  llvm::SmallVector<FullyConnectedNode *, 16> FCs;
+  for (auto &node : F->getNodes()) {
+    if (auto *FC = llvm::dyn_cast<FullyConnectedNode>(&node)) {
+      FCs.push_back(FC);
+    }
+  }
+
+  Module *M = F->getParent();
+  unsigned numReplaced = 0;
+  for (auto *FC : FCs) {
+    auto *W = llvm::dyn_cast<Variable>(FC->getWeights().getNode());
+    if (!W || !W->isPrivate() || W->getElementType() != ElemKind::FloatTy ||
+        FC->getInput().getElementType() != ElemKind::FloatTy ||
+        FC->getBias().getElementType() != ElemKind::FloatTy) {
+      continue;
+    }
+
+    Node *QFC = createFC(FC->getName(), FC->getInput(), W->getPayload(),
+                         FC->getBias());
+    FC->getResult().replaceAllUsesOfWith(QFC);
+    F->eraseNode(FC);
+    // The float weights are dead unless another function still uses them.
+    if (W->getNumUsers() == 0) {
+      M->eraseVariable(W);
+    }
+    numReplaced++;
+  }
+  return numReplaced;
+}
+
+unsigned quantizeWeightsOnly(const ExecutionEngine &EE, Function *F) {
+  return replaceFullyConnected(
+      EE, F, Kinded::Kind::RowwiseQuantizedFullyConnectedNodeKind,
+      [F](llvm::StringRef name, NodeValue input, Tensor &W, NodeValue bias) {
+        return F->createRowwiseQuantizedFullyConnected(name, input, W, bias);
+      });
+}
+
+unsigned quantizeDynamically(const ExecutionEngine &EE, Function *F) {
+  return replaceFullyConnected(
+      EE, F, Kinded::Kind::DynamicQuantizedFullyConnectedNodeKind,
+      [F](llvm::StringRef name, NodeValue input, Tensor &W, NodeValue bias) {
+        return F->createDynamicQuantizedFullyConnected(name, input, W, bias);
+      });
+}
+
 } // namespace quantization
 } // namespace glow
@@ -34,12 +34,45 @@ template <> struct MappingTraits<glow::NodeQuantizationInfo> {
   }
 };
 
+/// Mapping for NodeProfilingInfo yaml serializer.
+template <> struct MappingTraits<glow::NodeProfilingInfo> {
+  static void mapping(IO &io, glow::NodeProfilingInfo &info) {
+    io.mapRequired("nodeOutputName", info.nodeOutputName_);
+    io.mapRequired("min", info.min_);
+    io.mapRequired("max", info.max_);
+    io.mapRequired("histogram", info.histogram_);
+  }
+};
+
+/// The precisions of a mixed precision policy.
+template <> struct ScalarEnumerationTraits<glow::ElemKind> {
+  static void enumeration(IO &io, glow::ElemKind &kind) {
+    io.enumCase(kind, "float", glow::ElemKind::FloatTy);
+    io.enumCase(kind, "int8", glow::ElemKind::Int8QTy);
+    io.enumCase(kind, "int16", glow::ElemKind::Int16QTy);
+  }
+};
+
+/// Mapping for NodePrecisionInfo yaml serializer.
+template <> struct MappingTraits<glow::NodePrecisionInfo> {
+  static void mapping(IO &io, glow::NodePrecisionInfo &info) {
+    io.mapRequired("nodeName", info.nodeName_);
+    io.mapRequired("precision", info.precision_);
+  }
+};
+
 } // end namespace yaml
 } // end namespace llvm
 
 /// Yaml serializer for vector of NodeQuantizationInfo.
 LLVM_YAML_IS_SEQUENCE_VECTOR(glow::NodeQuantizationInfo);
 
+/// Yaml serializer for vector of NodeProfilingInfo.
+LLVM_YAML_IS_SEQUENCE_VECTOR(glow::NodeProfilingInfo);
+
+/// Yaml serializer for vector of NodePrecisionInfo.
+LLVM_YAML_IS_SEQUENCE_VECTOR(glow::NodePrecisionInfo);
+
 namespace glow {
 
 void serializeToYaml(llvm::StringRef fileName,
@@ -72,4 +105,62 @@ deserializeFromYaml(llvm::StringRef fileName) {
   return result;
 }
 
+void serializeProfilingInfosToYaml(
+    llvm::StringRef fileName,
+    llvm::ArrayRef<NodeProfilingInfo> profilingInfos) {
+  std::error_code EC;
+  llvm::raw_fd_ostream outputStream(fileName, EC, llvm::sys::fs::F_None);
+  GLOW_ASSERT(!EC && "Unable to create output stream");
+
+  llvm::yaml::Output yout(outputStream);
+  std::vector<NodeProfilingInfo> info = profilingInfos;
+  yout << info;
+}
+
+std::vector<NodeProfilingInfo>
+deserializeProfilingInfosFromYaml(llvm::StringRef fileName) {
+  std::vector<NodeProfilingInfo> result;
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> text =
+      llvm::MemoryBuffer::getFileAsStream(fileName);
+  GLOW_ASSERT(!text.getError() && "Unable to open file");
+
+  std::unique_ptr<llvm::MemoryBuffer> buffer = std::move(*text);
+  llvm::yaml::Input yin(buffer->getBuffer());
+  yin >> result;
+
+  GLOW_ASSERT(!yin.error() && "Error reading yaml file");
+
+  return result;
+}
+
+void serializePrecisionPolicyToYaml(
+    llvm::StringRef fileName,
+    llvm::ArrayRef<NodePrecisionInfo> nodePrecisions) {
+  std::error_code EC;
+  llvm::raw_fd_ostream outputStream(fileName, EC, llvm::sys::fs::F_None);
+  GLOW_ASSERT(!EC && "Unable to create output stream");
+
+  llvm::yaml::Output yout(outputStream);
+  std::vector<NodePrecisionInfo> info = nodePrecisions;
+  yout << info;
+}
+
+std::vector<NodePrecisionInfo>
+deserializePrecisionPolicyFromYaml(llvm::StringRef fileName) {
+  std::vector<NodePrecisionInfo> result;
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> text =
+      llvm::MemoryBuffer::getFileAsStream(fileName);
+  GLOW_ASSERT(!text.getError() && "Unable to open file");
+
+  std::unique_ptr<llvm::MemoryBuffer> buffer = std::move(*text);
+  llvm::yaml::Input yin(buffer->getBuffer());
+  yin >> result;
+
+  GLOW_ASSERT(!yin.error() && "Error reading yaml file");
+
+  return result;
+}
+
 } // namespace glow
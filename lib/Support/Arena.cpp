@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/Arena.h"
+#include "glow/Support/Memory.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace glow;
+
+/// The current arena of the thread.
+static thread_local Arena *currentArena = nullptr;
+
+constexpr size_t Arena::slabSize;
+constexpr size_t Arena::blockAlignment;
+constexpr size_t Arena::maxRecycledSize;
+
+Arena::~Arena() {
+  for (void *slab : slabs_) {
+    alignedFree(slab);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+  assert(alignment && !(alignment & (alignment - 1)) && "Invalid alignment");
+  alignment = std::max(alignment, blockAlignment);
+  size = alignedSize(std::max<size_t>(size, 1), blockAlignment);
+
+  if (alignment == blockAlignment && size <= maxRecycledSize) {
+    void *&head = freeLists_[size / blockAlignment - 1];
+    if (head) {
+      void *block = head;
+      head = *static_cast<void **>(block);
+      return block;
+    }
+  }
+
+  // Blocks that would waste a large part of a slab get their own allocation.
+  if (size > slabSize / 4) {
+    void *block = alignedAlloc(alignedSize(size, alignment), alignment);
+    slabs_.push_back(block);
+    bytesAllocated_ += size;
+    return block;
+  }
+
+  auto padding = (alignment - (size_t)cur_ % alignment) % alignment;
+  if (!cur_ || (size_t)(end_ - cur_) < padding + size) {
+    cur_ = static_cast<char *>(alignedAlloc(slabSize, TensorAlignment));
+    end_ = cur_ + slabSize;
+    slabs_.push_back(cur_);
+    bytesAllocated_ += slabSize;
+    padding = (alignment - (size_t)cur_ % alignment) % alignment;
+  }
+  char *block = cur_ + padding;
+  cur_ = block + size;
+  return block;
+}
+
+void Arena::deallocate(void *p, size_t size, size_t alignment) {
+  size = alignedSize(std::max<size_t>(size, 1), blockAlignment);
+  if (alignment > blockAlignment || size > maxRecycledSize) {
+    return;
+  }
+  void *&head = freeLists_[size / blockAlignment - 1];
+  *static_cast<void **>(p) = head;
+  head = p;
+}
+
+ArenaScope::ArenaScope(Arena *arena) : prev_(currentArena) {
+  currentArena = arena;
+}
+
+ArenaScope::~ArenaScope() { currentArena = prev_; }
+
+Arena *ArenaScope::getCurrent() { return currentArena; }
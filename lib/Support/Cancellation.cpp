@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/Cancellation.h"
+
+using namespace glow;
+
+/// The cancellation scope of the runs executing on this thread.
+static thread_local ScopedCancellation *currentScope = nullptr;
+
+bool CancellationToken::isCancelled() const {
+  if (cancelled_) {
+    return true;
+  }
+  int64_t deadline = deadlineNs_;
+  if (deadline && std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now().time_since_epoch())
+                          .count() >= deadline) {
+    return true;
+  }
+  return parent_ && parent_->isCancelled();
+}
+
+ScopedCancellation::ScopedCancellation(const CancellationToken &token)
+    : token_(token), previous_(currentScope) {
+  currentScope = this;
+}
+
+ScopedCancellation::~ScopedCancellation() { currentScope = previous_; }
+
+bool glow::shouldStopRun() {
+  if (!currentScope || !currentScope->token_.isCancelled()) {
+    return false;
+  }
+  currentScope->stopped_ = true;
+  return true;
+}
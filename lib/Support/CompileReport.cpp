@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/CompileReport.h"
+
+#include "llvm/Support/Format.h"
+
+using namespace glow;
+
+/// The report of the compilation running on this thread.
+static thread_local CompileReport *currentReport = nullptr;
+
+/// \returns the sum of the wall times of \p phases in seconds.
+static double
+getPhasesSeconds(const std::vector<CompileReport::Phase> &phases) {
+  double total = 0;
+  for (const auto &phase : phases) {
+    total += phase.seconds;
+  }
+  return total;
+}
+
+double CompileReport::getTotalSeconds() const {
+  return totalSeconds_ > 0 ? totalSeconds_ : getPhasesSeconds(phases_);
+}
+
+void CompileReport::clear() {
+  phases_.clear();
+  memory_.clear();
+  totalSeconds_ = 0;
+}
+
+void CompileReport::dump(llvm::raw_ostream &os) const {
+  double total = getTotalSeconds();
+  os << "Compilation report: "
+     << llvm::format("%.3f", total * 1e3) << " ms\n";
+  os << "      time(ms)      %  phase\n";
+  for (const auto &phase : phases_) {
+    os << llvm::format("%14.3f %6.2f  ", phase.seconds * 1e3,
+                       total > 0 ? phase.seconds * 100 / total : 0.)
+       << phase.name;
+    if (!phase.unit.empty()) {
+      os << " (" << phase.sizeBefore << " -> " << phase.sizeAfter << " "
+         << phase.unit << ")";
+    }
+    os << "\n";
+  }
+  double other = total - getPhasesSeconds(phases_);
+  if (other > 0) {
+    os << llvm::format("%14.3f %6.2f  ", other * 1e3, other * 100 / total)
+       << "other\n";
+  }
+  for (const auto &memory : memory_) {
+    os << "Peak memory of " << memory.name << ": " << memory.bytes
+       << " bytes\n";
+  }
+}
+
+void CompileReport::dump() const { dump(llvm::outs()); }
+
+CompileReport *glow::getCurrentCompileReport() { return currentReport; }
+
+CompileReportScope::CompileReportScope(CompileReport &report)
+    : previous_(currentReport) {
+  currentReport = &report;
+}
+
+CompileReportScope::~CompileReportScope() { currentReport = previous_; }
+
+ScopedCompilePhase::ScopedCompilePhase(llvm::StringRef name,
+                                       llvm::StringRef unit,
+                                       std::function<size_t()> size)
+    : size_(std::move(size)), phase_{name, 0, unit, 0, 0},
+      report_(currentReport), begin_(std::chrono::steady_clock::now()),
+      trace_(name, "compile") {
+  if (report_ && size_) {
+    phase_.sizeBefore = size_();
+  }
+}
+
+ScopedCompilePhase::~ScopedCompilePhase() {
+  if (!report_) {
+    return;
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin_;
+  phase_.seconds = elapsed.count();
+  if (size_) {
+    phase_.sizeAfter = size_();
+  }
+  report_->addPhase(std::move(phase_));
+}
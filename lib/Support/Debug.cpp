@@ -36,8 +36,24 @@ static llvm::cl::opt<std::string, true>
                   llvm::cl::desc("Enable a specific type of debug output"),
                   llvm::cl::Hidden, llvm::cl::location(DebugOnlyType));
 
+/// -verify-level - Command line option to choose how often the graph and the
+/// IR are verified.
+static llvm::cl::opt<VerificationLevel, true> VerifyLevelOpt(
+    "verify-level",
+    llvm::cl::desc("How often the graph and the IR are verified"),
+    llvm::cl::values(
+        clEnumValN(VerificationLevel::None, "none", "Never verify them"),
+        clEnumValN(VerificationLevel::Boundaries, "boundaries",
+                   "Verify them before and after the optimizations"),
+        clEnumValN(VerificationLevel::Passes, "passes",
+                   "Also verify the graph after every optimization pass")),
+    llvm::cl::Hidden, llvm::cl::location(VerifyLevel));
+
 namespace glow {
 
+/// Exported level set by -verify-level option.
+VerificationLevel VerifyLevel = VerificationLevel::Boundaries;
+
 /// Exported boolean set by -debug-glow option.
 bool DebugFlag = false;
 
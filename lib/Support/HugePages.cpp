@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/HugePages.h"
+#include "glow/Support/Memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+using namespace glow;
+
+/// The size of the transparent huge pages and of the small explicit ones.
+static constexpr size_t hugePageSize2MB = size_t(2) << 20;
+
+/// The minimum size of the tensor payloads that use transparent huge pages,
+/// or 0 if they don't.
+static std::atomic<size_t> tensorHugePageMinSize{0};
+
+size_t glow::getHugePageSize(HugePagePolicy policy) {
+  switch (policy) {
+  case HugePagePolicy::None:
+    return 4096;
+  case HugePagePolicy::Transparent:
+  case HugePagePolicy::Explicit2MB:
+    return hugePageSize2MB;
+  case HugePagePolicy::Explicit1GB:
+    return size_t(1) << 30;
+  }
+  return 4096;
+}
+
+#ifdef __linux__
+/// \returns an anonymous mapping of \p size bytes, which is a multiple of the
+/// page size, with the additional mmap flags \p flags, or null.
+static void *mapAnonymous(size_t size, int flags) {
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return p == MAP_FAILED ? nullptr : p;
+}
+#endif
+
+void *glow::mapHugePages(size_t size, HugePagePolicy policy,
+                         HugePagePolicy &used) {
+  assert(policy != HugePagePolicy::None && "No huge pages to map");
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+  if (policy == HugePagePolicy::Explicit1GB) {
+#ifdef MAP_HUGE_1GB
+    size_t mapSize = alignedSize(size, getHugePageSize(policy));
+    if (void *p = mapAnonymous(mapSize, MAP_HUGETLB | MAP_HUGE_1GB)) {
+      used = policy;
+      return p;
+    }
+#endif
+    policy = HugePagePolicy::Explicit2MB;
+  }
+  if (policy == HugePagePolicy::Explicit2MB) {
+    size_t mapSize = alignedSize(size, hugePageSize2MB);
+    if (void *p = mapAnonymous(mapSize, MAP_HUGETLB)) {
+      used = policy;
+      return p;
+    }
+  }
+#endif
+  // Map one more huge page, so that the block can start on a huge page
+  // boundary, and give the slack back.
+  size_t mapSize = alignedSize(size, hugePageSize2MB);
+  auto *p = static_cast<char *>(mapAnonymous(mapSize + hugePageSize2MB, 0));
+  if (!p) {
+    return nullptr;
+  }
+  auto *begin = reinterpret_cast<char *>(
+      alignedSize(reinterpret_cast<uintptr_t>(p), hugePageSize2MB));
+  if (begin != p) {
+    munmap(p, begin - p);
+  }
+  munmap(begin + mapSize, p + mapSize + hugePageSize2MB - (begin + mapSize));
+#ifdef MADV_HUGEPAGE
+  madvise(begin, mapSize, MADV_HUGEPAGE);
+#endif
+  used = HugePagePolicy::Transparent;
+  return begin;
+#else
+  return nullptr;
+#endif
+}
+
+void glow::unmapHugePages(void *p, size_t size, HugePagePolicy used) {
+#ifdef __linux__
+  munmap(p, alignedSize(size, getHugePageSize(used)));
+#endif
+}
+
+void glow::adviseTransparentHugePages(void *p, size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  auto begin = alignedSize(reinterpret_cast<uintptr_t>(p), hugePageSize2MB);
+  auto end = (reinterpret_cast<uintptr_t>(p) + size) & ~(hugePageSize2MB - 1);
+  if (begin < end) {
+    madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+void glow::setTensorHugePages(bool enable, size_t minSize) {
+  tensorHugePageMinSize = enable ? std::max(minSize, size_t(1)) : 0;
+}
+
+size_t glow::getTensorPayloadAlignment(size_t size, size_t alignment) {
+  size_t minSize = tensorHugePageMinSize.load(std::memory_order_relaxed);
+  if (!minSize || size < minSize) {
+    return alignment;
+  }
+  return std::max(alignment, hugePageSize2MB);
+}
+
+void glow::adviseTensorPayload(void *p, size_t size) {
+  size_t minSize = tensorHugePageMinSize.load(std::memory_order_relaxed);
+  if (minSize && size >= minSize) {
+    adviseTransparentHugePages(p, size);
+  }
+}
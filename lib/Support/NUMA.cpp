@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/NUMA.h"
+
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+using namespace glow;
+
+namespace {
+
+/// The CPUs of every NUMA node, as described by the kernel.
+struct NUMATopology {
+  /// The CPUs of every node, indexed by the node number.
+  std::vector<std::vector<unsigned>> cpusOfNode;
+  /// The node of every CPU, indexed by the CPU number.
+  std::vector<unsigned> nodeOfCPU;
+
+  NUMATopology() {
+#ifdef __linux__
+    // The nodes are numbered contiguously on all but exotic systems.
+    for (unsigned node = 0;; node++) {
+      std::ifstream file("/sys/devices/system/node/node" +
+                         std::to_string(node) + "/cpulist");
+      std::string list;
+      if (!file || !std::getline(file, list)) {
+        break;
+      }
+      cpusOfNode.push_back(parseCPUList(list));
+    }
+#endif
+    if (cpusOfNode.empty()) {
+      cpusOfNode.emplace_back();
+    }
+    for (unsigned node = 0, e = cpusOfNode.size(); node < e; node++) {
+      for (auto cpu : cpusOfNode[node]) {
+        if (cpu >= nodeOfCPU.size()) {
+          nodeOfCPU.resize(cpu + 1, 0);
+        }
+        nodeOfCPU[cpu] = node;
+      }
+    }
+  }
+
+  /// \returns the CPUs of a list like "0-3,8,10-11".
+  static std::vector<unsigned> parseCPUList(const std::string &list) {
+    std::vector<unsigned> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+      if (range.empty()) {
+        continue;
+      }
+      auto dash = range.find('-');
+      unsigned first = std::stoul(range.substr(0, dash));
+      unsigned last = dash == std::string::npos
+                          ? first
+                          : std::stoul(range.substr(dash + 1));
+      for (unsigned cpu = first; cpu <= last; cpu++) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  /// \returns the topology of the machine, which is read once.
+  static const NUMATopology &get() {
+    static const NUMATopology topology;
+    return topology;
+  }
+};
+
+} // namespace
+
+unsigned glow::getNumNUMANodes() {
+  return NUMATopology::get().cpusOfNode.size();
+}
+
+std::vector<unsigned> glow::getCPUsOfNUMANode(unsigned node) {
+  const auto &topology = NUMATopology::get();
+  assert(node < topology.cpusOfNode.size() && "Unknown NUMA node");
+  return topology.cpusOfNode[node];
+}
+
+unsigned glow::getCurrentNUMANode() {
+#ifdef __linux__
+  const auto &topology = NUMATopology::get();
+  int cpu = sched_getcpu();
+  if (cpu >= 0 && unsigned(cpu) < topology.nodeOfCPU.size()) {
+    return topology.nodeOfCPU[cpu];
+  }
+#endif
+  return 0;
+}
+
+bool glow::pinCurrentThread(llvm::ArrayRef<unsigned> cpus) {
+#ifdef __linux__
+  if (cpus.empty()) {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    CPU_SET(cpu, &set);
+  }
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/PerfCounters.h"
+
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace glow;
+
+/// The raw event of the floating point operations, or 0.
+static std::atomic<uint64_t> fpEventConfig{0};
+
+/// The counters that any thread could open, as a mask of bits indexed by
+/// PerfCounter.
+static std::atomic<unsigned> availableCounters{0};
+
+namespace {
+
+/// The counters of a thread, in a single group so that they are read
+/// together and are scheduled on the PMU at the same time.
+struct PerfCounterGroup {
+  /// The file descriptor of every counter, or -1 if it is unavailable.
+  int fds[NumPerfCounters];
+  /// The position of every available counter in the values read from the
+  /// group leader.
+  unsigned positions[NumPerfCounters];
+  /// The number of available counters.
+  unsigned numOpened{0};
+  /// The file descriptor of the group leader, or -1 if there is none.
+  int leader{-1};
+
+  PerfCounterGroup() {
+    for (unsigned i = 0; i < NumPerfCounters; i++) {
+      fds[i] = -1;
+      positions[i] = 0;
+    }
+#ifdef __linux__
+    std::pair<uint32_t, uint64_t> events[NumPerfCounters] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_RAW, fpEventConfig.load()},
+    };
+    for (unsigned i = 0; i < NumPerfCounters; i++) {
+      if (events[i].first == PERF_TYPE_RAW && !events[i].second) {
+        continue;
+      }
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      attr.read_format = PERF_FORMAT_GROUP;
+      // Only count the calling thread in user space, which most values of
+      // perf_event_paranoid allow.
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      int fd = syscall(__NR_perf_event_open, &attr, /* pid */ 0, /* cpu */ -1,
+                       leader, /* flags */ 0);
+      if (fd < 0) {
+        continue;
+      }
+      if (leader < 0) {
+        leader = fd;
+      }
+      fds[i] = fd;
+      positions[i] = numOpened++;
+      availableCounters |= 1u << i;
+    }
+#endif
+  }
+
+  ~PerfCounterGroup() {
+#ifdef __linux__
+    for (auto fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  bool read(uint64_t values[NumPerfCounters]) const {
+    for (unsigned i = 0; i < NumPerfCounters; i++) {
+      values[i] = 0;
+    }
+#ifdef __linux__
+    if (leader < 0) {
+      return false;
+    }
+    // The group is read as the number of counters followed by their values.
+    uint64_t buffer[1 + NumPerfCounters];
+    auto size = (1 + numOpened) * sizeof(uint64_t);
+    if (::read(leader, buffer, size) != ssize_t(size)) {
+      return false;
+    }
+    for (unsigned i = 0; i < NumPerfCounters; i++) {
+      if (fds[i] >= 0) {
+        values[i] = buffer[1 + positions[i]];
+      }
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+};
+
+} // namespace
+
+const char *glow::getPerfCounterName(PerfCounter counter) {
+  switch (counter) {
+  case PerfCounter::Cycles:
+    return "cycles";
+  case PerfCounter::Instructions:
+    return "instructions";
+  case PerfCounter::LLCMisses:
+    return "LLC misses";
+  case PerfCounter::FPOps:
+    return "FP ops";
+  }
+  return "unknown";
+}
+
+void glow::setPerfCounterFPEvent(uint64_t config) { fpEventConfig = config; }
+
+bool glow::readPerfCounters(uint64_t values[NumPerfCounters]) {
+  static thread_local PerfCounterGroup group;
+  return group.read(values);
+}
+
+bool glow::isPerfCounterAvailable(PerfCounter counter) {
+  return availableCounters & (1u << unsigned(counter));
+}
@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/RuntimeAllocator.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/NUMA.h"
+
+#include <cassert>
+
+using namespace glow;
+
+void *HeapRuntimeAllocator::allocate(size_t size, size_t alignment,
+                                     RuntimeMemoryKind kind) {
+  assert(size && "Allocating an empty block");
+  return alignedAlloc(size, alignment);
+}
+
+void HeapRuntimeAllocator::deallocate(void *p, size_t size, size_t alignment,
+                                      RuntimeMemoryKind kind) {
+  alignedFree(p);
+}
+
+HugePageRuntimeAllocator::~HugePageRuntimeAllocator() {
+  assert(mapped_.empty() && "Blocks on huge pages were not deallocated");
+}
+
+void *HugePageRuntimeAllocator::allocate(size_t size, size_t alignment,
+                                         RuntimeMemoryKind kind) {
+  HugePagePolicy policy = getPolicy(kind);
+  // The huge pages are aligned beyond what any tensor needs.
+  if (policy != HugePagePolicy::None && size >= minSize_ &&
+      alignment <= getHugePageSize(HugePagePolicy::Transparent)) {
+    HugePagePolicy used;
+    if (void *p = mapHugePages(size, policy, used)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      mapped_[p] = used;
+      mappedBytes_ += size;
+      return p;
+    }
+  }
+  return upstream_.allocate(size, alignment, kind);
+}
+
+void HugePageRuntimeAllocator::deallocate(void *p, size_t size,
+                                          size_t alignment,
+                                          RuntimeMemoryKind kind) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = mapped_.find(p);
+    if (it != mapped_.end()) {
+      HugePagePolicy used = it->second;
+      mapped_.erase(it);
+      mappedBytes_ -= size;
+      unmapHugePages(p, size, used);
+      return;
+    }
+  }
+  upstream_.deallocate(p, size, alignment, kind);
+}
+
+size_t HugePageRuntimeAllocator::getMappedBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return mappedBytes_;
+}
+
+PoolRuntimeAllocator::~PoolRuntimeAllocator() { releasePooledMemory(); }
+
+void *PoolRuntimeAllocator::allocate(size_t size, size_t alignment,
+                                     RuntimeMemoryKind kind) {
+  if (kind != RuntimeMemoryKind::Activations) {
+    return upstream_.allocate(size, alignment, kind);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto key = std::make_tuple(getCurrentNUMANode(), size, alignment);
+    auto it = pool_.find(key);
+    if (it != pool_.end() && !it->second.empty()) {
+      void *p = it->second.back();
+      it->second.pop_back();
+      pooledBytes_ -= size;
+      return p;
+    }
+    numUpstreamAllocations_++;
+  }
+  return upstream_.allocate(size, alignment, kind);
+}
+
+void PoolRuntimeAllocator::deallocate(void *p, size_t size, size_t alignment,
+                                      RuntimeMemoryKind kind) {
+  if (kind == RuntimeMemoryKind::Activations) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pooledBytes_ + size <= maxPooledBytes_) {
+      auto key = std::make_tuple(getCurrentNUMANode(), size, alignment);
+      pool_[key].push_back(p);
+      pooledBytes_ += size;
+      return;
+    }
+  }
+  upstream_.deallocate(p, size, alignment, kind);
+}
+
+void PoolRuntimeAllocator::releasePooledMemory() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &entry : pool_) {
+    size_t size = std::get<1>(entry.first);
+    size_t alignment = std::get<2>(entry.first);
+    for (void *p : entry.second) {
+      upstream_.deallocate(p, size, alignment, RuntimeMemoryKind::Activations);
+    }
+  }
+  pool_.clear();
+  pooledBytes_ = 0;
+}
+
+size_t PoolRuntimeAllocator::getPooledBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pooledBytes_;
+}
+
+size_t PoolRuntimeAllocator::getNumUpstreamAllocations() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numUpstreamAllocations_;
+}
+
+RuntimeAllocator &glow::getHeapRuntimeAllocator() {
+  static auto *heap = new HeapRuntimeAllocator();
+  return *heap;
+}
+
+RuntimeAllocator &glow::getDefaultRuntimeAllocator() {
+  // The allocators are never destroyed, so that the functions that are
+  // destroyed during the exit of the program can still return their memory.
+  static auto *pool = new PoolRuntimeAllocator(getHeapRuntimeAllocator());
+  return *pool;
+}
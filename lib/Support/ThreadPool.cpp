@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/ThreadPool.h"
+#include "glow/Support/NUMA.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+
+using namespace glow;
+
+static llvm::cl::opt<bool> sharedThreadPool(
+    "shared-thread-pool",
+    llvm::cl::desc("Run the parallel loops of all the compiled functions of "
+                   "the process on one pool of threads, instead of a pool "
+                   "per function"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> sharedThreadPoolThreads(
+    "shared-thread-pool-threads",
+    llvm::cl::desc("Number of threads of the shared pool, including the "
+                   "threads that post the loops (0 for one per core)"),
+    llvm::cl::init(0));
+
+/// The priority of the loops posted by the current thread.
+static thread_local RunPriority currentPriority = RunPriority::LatencyCritical;
+
+ThreadPool::ThreadPool(unsigned numThreads, std::vector<unsigned> cpus) {
+  for (unsigned i = 1; i < numThreads; i++) {
+    workers_.emplace_back([this, cpus]() { workerLoop(cpus); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  workCV_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+ThreadPool &ThreadPool::getShared() {
+  static ThreadPool pool(sharedThreadPoolThreads
+                             ? unsigned(sharedThreadPoolThreads)
+                             : std::thread::hardware_concurrency());
+  return pool;
+}
+
+bool ThreadPool::isSharedPoolEnabled() { return sharedThreadPool; }
+
+RunPriority ThreadPool::getCurrentPriority() { return currentPriority; }
+
+void ThreadPool::setCurrentPriority(RunPriority priority) {
+  currentPriority = priority;
+}
+
+bool ThreadPool::claimChunk(Job &job, size_t &chunk) {
+  if (job.nextChunk >= job.numChunks) {
+    return false;
+  }
+  chunk = job.nextChunk++;
+  if (job.nextChunk == job.numChunks) {
+    auto &queue = queues_[unsigned(job.priority)];
+    queue.erase(std::find(queue.begin(), queue.end(), &job));
+  }
+  return true;
+}
+
+void ThreadPool::runChunk(Job &job, size_t chunk) {
+  size_t begin = chunk * job.chunkSize;
+  size_t end = std::min(begin + job.chunkSize, job.numIterations);
+  {
+    ScopedRunPriority priority(job.priority);
+    (*job.fn)(begin, end);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job.doneChunks++;
+  }
+  doneCV_.notify_all();
+}
+
+void ThreadPool::workerLoop(const std::vector<unsigned> &cpus) {
+  if (!cpus.empty()) {
+    pinCurrentThread(cpus);
+  }
+  for (;;) {
+    Job *job = nullptr;
+    size_t chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      workCV_.wait(lock, [&]() {
+        if (shutdown_) {
+          return true;
+        }
+        for (auto &queue : queues_) {
+          if (!queue.empty()) {
+            return true;
+          }
+        }
+        return false;
+      });
+      if (shutdown_) {
+        return;
+      }
+      // Take a chunk of the oldest job of the highest priority.
+      for (auto &queue : queues_) {
+        if (!queue.empty()) {
+          job = queue.front();
+          break;
+        }
+      }
+      claimChunk(*job, chunk);
+    }
+    runChunk(*job, chunk);
+  }
+}
+
+void ThreadPool::parallelFor(size_t numIterations, size_t minChunkSize,
+                             const RangeFn &fn) {
+  if (numIterations == 0) {
+    return;
+  }
+  minChunkSize = std::max<size_t>(minChunkSize, 1);
+  // Compute the size of a chunk: spread the iterations evenly between the
+  // threads, but keep every chunk a multiple of the minimal chunk size.
+  size_t maxChunks = (numIterations + minChunkSize - 1) / minChunkSize;
+  size_t numChunks = std::min<size_t>(getNumThreads(), maxChunks);
+  size_t chunkSize = (numIterations + numChunks - 1) / numChunks;
+  chunkSize = (chunkSize + minChunkSize - 1) / minChunkSize * minChunkSize;
+  numChunks = (numIterations + chunkSize - 1) / chunkSize;
+
+  // There is nothing to split. Run the whole range on the calling thread.
+  if (numChunks < 2) {
+    fn(0, numIterations);
+    return;
+  }
+
+  Job job;
+  job.fn = &fn;
+  job.numIterations = numIterations;
+  job.chunkSize = chunkSize;
+  job.numChunks = numChunks;
+  job.priority = currentPriority;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queues_[unsigned(job.priority)].push_back(&job);
+  }
+  workCV_.notify_all();
+
+  // The calling thread takes its share of the work as well, and only waits
+  // for the chunks that the workers claimed, which are running. This is what
+  // makes the nested loops safe.
+  for (;;) {
+    size_t chunk;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!claimChunk(job, chunk)) {
+        break;
+      }
+    }
+    runChunk(job, chunk);
+  }
+
+  // Wait until all chunks are processed. The workers only touch the job
+  // under the lock, so it can be destroyed once they are done.
+  std::unique_lock<std::mutex> lock(mutex_);
+  doneCV_.wait(lock, [&]() { return job.doneChunks == job.numChunks; });
+}
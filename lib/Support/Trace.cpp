@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Support/Trace.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+using namespace glow;
+
+static llvm::cl::opt<std::string> traceFile(
+    "trace-file",
+    llvm::cl::desc("Record the compilation phases, the executions, the kernels "
+                   "and the copies between the host and the devices, and "
+                   "write them to this file in the Chrome trace format when "
+                   "the program exits"),
+    llvm::cl::init(""));
+
+namespace {
+
+/// Holds the recorded events of the process.
+struct TraceRecorder {
+  /// The start of the trace.
+  std::chrono::steady_clock::time_point start{
+      std::chrono::steady_clock::now()};
+  /// The recorded events.
+  std::vector<TraceEvent> events;
+  /// Protects the events.
+  std::mutex mutex;
+
+  ~TraceRecorder() {
+    if (!traceFile.empty()) {
+      dumpTraceEvents(traceFile);
+    }
+  }
+};
+
+/// Whether setTracingEnabled() enabled the tracing.
+std::atomic<bool> tracingEnabled{false};
+
+/// \returns the recorder of the process. It is destroyed at exit, which
+/// writes the -trace-file.
+TraceRecorder &getRecorder() {
+  static TraceRecorder recorder;
+  return recorder;
+}
+
+/// Write \p str to \p os as a JSON string.
+void writeJSONString(llvm::raw_ostream &os, llvm::StringRef str) {
+  os << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << llvm::format("\\u%04x", c);
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+} // namespace
+
+bool glow::isTracingEnabled() { return tracingEnabled || !traceFile.empty(); }
+
+void glow::setTracingEnabled(bool enable) {
+  // Start the clock of the trace.
+  getRecorder();
+  tracingEnabled = enable;
+}
+
+uint64_t glow::getTraceTimestamp() {
+  auto elapsed = std::chrono::steady_clock::now() - getRecorder().start;
+  return std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+      .count();
+}
+
+uint64_t glow::getTraceThread() {
+  static std::atomic<uint64_t> numThreads{0};
+  thread_local uint64_t thread = numThreads++;
+  return thread;
+}
+
+void glow::addTraceEvent(llvm::StringRef name, llvm::StringRef category,
+                         uint64_t begin, uint64_t end, TraceProcess process,
+                         uint64_t thread) {
+  if (!isTracingEnabled()) {
+    return;
+  }
+  auto &recorder = getRecorder();
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  recorder.events.push_back({name, category, begin,
+                             end > begin ? end - begin : 0, process, thread});
+}
+
+std::vector<TraceEvent> glow::getTraceEvents() {
+  auto &recorder = getRecorder();
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  return recorder.events;
+}
+
+void glow::clearTraceEvents() {
+  auto &recorder = getRecorder();
+  std::lock_guard<std::mutex> lock(recorder.mutex);
+  recorder.events.clear();
+}
+
+void glow::dumpTraceEvents(llvm::raw_ostream &os) {
+  auto events = getTraceEvents();
+  os << "{\"traceEvents\":[\n";
+  // Name the processes of the timeline.
+  os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+        "\"args\":{\"name\":\"host\"}},\n"
+     << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"args\":{\"name\":\"device\"}}";
+  for (const auto &event : events) {
+    os << ",\n{\"name\":";
+    writeJSONString(os, event.name);
+    os << ",\"cat\":";
+    writeJSONString(os, event.category);
+    os << ",\"ph\":\"X\",\"ts\":" << event.timestamp
+       << ",\"dur\":" << event.duration
+       << ",\"pid\":" << static_cast<unsigned>(event.process)
+       << ",\"tid\":" << event.thread << "}";
+  }
+  os << "\n]}\n";
+}
+
+bool glow::dumpTraceEvents(llvm::StringRef filename) {
+  std::error_code EC;
+  llvm::raw_fd_ostream os(filename, EC, llvm::sys::fs::F_None);
+  if (EC) {
+    return false;
+  }
+  dumpTraceEvents(os);
+  return true;
+}
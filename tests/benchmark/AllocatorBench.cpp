@@ -0,0 +1,392 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Bench.h"
+#include "ModelZoo.h"
+
+#include "glow/Backends/Backend.h"
+#include "glow/CodeGen/MemoryAllocator.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Graph.h"
+#include "glow/IR/IR.h"
+#include "glow/IR/Instrs.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/Compiler.h"
+#include "glow/Support/Memory.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory allocatorBenchCat("Allocator Benchmark Options");
+
+llvm::cl::opt<std::string> modelsDir(
+    "models-dir",
+    llvm::cl::desc("Directory holding the models downloaded by "
+                   "utils/download_caffe2_models.sh or "
+                   "utils/download_onnx_models.sh"),
+    llvm::cl::init("."), llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::list<std::string> modelsOpt(
+    "models",
+    llvm::cl::desc("Models to benchmark (default: all of them that are "
+                   "available)"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::opt<BackendKind> backendOpt(
+    "backend",
+    llvm::cl::desc("The backend whose lowering produces the IR (default: "
+                   "interpreter)"),
+    llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
+                                "Use interpreter"),
+                     clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
+                     clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
+    llvm::cl::init(BackendKind::Interpreter),
+    llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::list<SchedulerKind> schedulersOpt(
+    "schedulers",
+    llvm::cl::desc("The schedulers that order the IR (default: all of them)"),
+    llvm::cl::values(
+        clEnumValN(SchedulerKind::ChildMemSize, "child-mem-size",
+                   "Children that free the most memory first"),
+        clEnumValN(SchedulerKind::MinPeakMemory, "min-peak-memory",
+                   "Minimize the peak memory usage"),
+        clEnumValN(SchedulerKind::DataParallel, "data-parallel",
+                   "Keep data parallel nodes together"),
+        clEnumValN(SchedulerKind::CacheLocality, "cache-locality",
+                   "Consumers right after their producers")),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::list<std::string> tracesOpt(
+    "traces",
+    llvm::cl::desc("Sequences of allocations written by -dump-dir to replay "
+                   "in addition to the models"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::opt<std::string> dumpDirOpt(
+    "dump-dir",
+    llvm::cl::desc("Write the sequence of allocations of every model and "
+                   "scheduler to this directory"),
+    llvm::cl::value_desc("dir"), llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::opt<unsigned>
+    repsOpt("reps",
+            llvm::cl::desc("The number of times every planner runs, of which "
+                           "the fastest is reported"),
+            llvm::cl::init(10), llvm::cl::cat(allocatorBenchCat));
+
+llvm::cl::opt<std::string>
+    jsonFileOpt("json",
+                llvm::cl::desc("Write the results to this file as JSON"),
+                llvm::cl::value_desc("file.json"),
+                llvm::cl::cat(allocatorBenchCat));
+} // namespace
+
+using AllocList = std::vector<MemoryAllocator::Allocation>;
+
+/// Assigns addresses to the buffers of \p allocs, and \returns the memory that
+/// the assignment needs, or MemoryAllocator::npos if it fails.
+using PlannerFn = uint64_t (*)(const AllocList &allocs);
+
+/// Replay \p allocs through the first-fit allocate() and deallocate(), in the
+/// order of the program.
+static uint64_t planFirstFit(const AllocList &allocs) {
+  MemoryAllocator MA("activations", 0);
+  for (const auto &A : allocs) {
+    if (!A.alloc) {
+      MA.deallocate(A.handle);
+    } else if (MA.allocate(A.size, A.handle) == MemoryAllocator::npos) {
+      return MemoryAllocator::npos;
+    }
+  }
+  return MA.getMaxMemoryUsage();
+}
+
+/// Place all of the buffers of \p allocs at once with allocateAll(), which is
+/// what the backends do.
+static uint64_t planAll(const AllocList &allocs) {
+  MemoryAllocator MA("activations", 0);
+  return MA.allocateAll(allocs);
+}
+
+/// The planners that are compared. A new planner is benchmarked by adding it
+/// here.
+static const struct {
+  const char *name;
+  PlannerFn plan;
+} planners[] = {
+    {"first-fit", planFirstFit},
+    {"allocate-all", planAll},
+};
+
+/// A sequence of allocations and the name of where it comes from.
+struct Trace {
+  std::string name;
+  AllocList allocs;
+  /// The handles of the allocations of a trace read from a file.
+  std::vector<char> handles;
+};
+
+/// \returns the largest total size of the buffers that are live at the same
+/// time in \p allocs, with the alignment of the tensors. No planner needs
+/// less memory. The buffers that are not freed live until the end.
+static uint64_t getLowerBound(const AllocList &allocs) {
+  std::unordered_map<MemoryAllocator::Handle, uint64_t> live;
+  uint64_t liveBytes = 0;
+  uint64_t maxLiveBytes = 0;
+  for (const auto &A : allocs) {
+    if (A.alloc) {
+      uint64_t size = alignedSize(A.size, TensorAlignment);
+      live[A.handle] = size;
+      liveBytes += size;
+      maxLiveBytes = std::max(maxLiveBytes, liveBytes);
+    } else {
+      liveBytes -= live[A.handle];
+      live.erase(A.handle);
+    }
+  }
+  return maxLiveBytes;
+}
+
+/// Optimize and lower \p F for inference on \p B, as the ExecutionEngine does
+/// before it hands the function to the backend.
+static void optimizeFunction(Function *F, const Backend &B) {
+  auto mode = CompilationMode::Infer;
+  ::glow::optimize(F, mode);
+  if (constantFold(F)) {
+    ::glow::optimize(F, mode);
+  }
+  if (B.transformPreLowering(F, mode)) {
+    ::glow::optimize(F, mode);
+  }
+  ::glow::lower(F, B);
+  ::glow::optimize(F, mode);
+  if (B.transformPostLowering(F, mode)) {
+    ::glow::optimize(F, mode);
+  }
+}
+
+/// \returns the sequence of the allocations and deallocations of the
+/// activations of \p IR, in the order of its instructions.
+static AllocList collectAllocations(const IRFunction &IR) {
+  AllocList allocs;
+  for (const auto &I : IR.getInstrs()) {
+    if (auto *A = llvm::dyn_cast<AllocActivationInst>(&I)) {
+      allocs.emplace_back(A, true, I.getSizeInBytes());
+    } else if (auto *D = llvm::dyn_cast<DeallocActivationInst>(&I)) {
+      allocs.emplace_back(D->getAlloc(), false, 0);
+    }
+  }
+  return allocs;
+}
+
+/// Write \p trace to the file \p path, one allocation per line: "a <id>
+/// <size>" or "d <id>".
+static void writeTrace(const Trace &trace, const std::string &path) {
+  std::ofstream os(path);
+  GLOW_ASSERT(os && "Can't write the trace.");
+  std::unordered_map<MemoryAllocator::Handle, size_t> ids;
+  for (const auto &A : trace.allocs) {
+    if (A.alloc) {
+      size_t id = ids.size();
+      ids[A.handle] = id;
+      os << "a " << id << " " << A.size << "\n";
+    } else {
+      os << "d " << ids[A.handle] << "\n";
+    }
+  }
+}
+
+/// Read the trace that writeTrace() wrote to \p path.
+static void readTrace(const std::string &path, Trace &trace) {
+  std::ifstream is(path);
+  GLOW_ASSERT(is && "Can't read the trace.");
+  // The handles point into trace.handles, which has an entry for every id.
+  std::vector<std::pair<size_t, uint64_t>> steps;
+  std::string kind;
+  size_t numIds = 0;
+  size_t id;
+  while (is >> kind >> id) {
+    uint64_t size = 0;
+    if (kind == "a") {
+      GLOW_ASSERT(is >> size && "Invalid trace.");
+      steps.emplace_back(id, size);
+    } else {
+      GLOW_ASSERT(kind == "d" && "Invalid trace.");
+      steps.emplace_back(id, MemoryAllocator::npos);
+    }
+    numIds = std::max(numIds, id + 1);
+  }
+  trace.name = path;
+  trace.handles.resize(numIds);
+  for (const auto &step : steps) {
+    bool alloc = step.second != MemoryAllocator::npos;
+    trace.allocs.emplace_back(&trace.handles[step.first], alloc,
+                              alloc ? step.second : 0);
+  }
+}
+
+/// Run \p planner on the allocations of \p trace.
+class PlannerBench : public Benchmark {
+  const Trace &trace_;
+  PlannerFn planner_;
+  uint64_t memory_{0};
+
+public:
+  PlannerBench(const Trace &trace, PlannerFn planner)
+      : trace_(trace), planner_(planner) {}
+
+  void setup() override {}
+  void run() override { memory_ = planner_(trace_.allocs); }
+  void teardown() override {}
+
+  /// \returns the memory that the last run of the planner needed.
+  uint64_t getMemory() const { return memory_; }
+};
+
+/// One run of a planner on a trace.
+struct BenchResult {
+  std::string trace;
+  std::string planner;
+  size_t numBuffers;
+  double seconds;
+  uint64_t peak;
+  uint64_t lowerBound;
+};
+
+/// Benchmark every planner on \p trace, print the results and append them to
+/// \p results.
+static void benchTrace(const Trace &trace, std::vector<BenchResult> &results) {
+  size_t numBuffers = 0;
+  for (const auto &A : trace.allocs) {
+    numBuffers += A.alloc;
+  }
+  uint64_t lowerBound = getLowerBound(trace.allocs);
+  for (const auto &planner : planners) {
+    PlannerBench b(trace, planner.plan);
+    double seconds = bench(&b, repsOpt);
+    results.push_back({trace.name, planner.name, numBuffers, seconds,
+                       b.getMemory(), lowerBound});
+    const auto &R = results.back();
+    printf("%s, %s, %zu, %.1lf, %.1lf, %.1lf, %.2lf\n", R.trace.c_str(),
+           R.planner.c_str(), R.numBuffers, R.seconds * 1e6, R.peak / 1024.0,
+           R.lowerBound / 1024.0,
+           R.lowerBound ? (double(R.peak) / R.lowerBound - 1) * 100 : 0.0);
+  }
+}
+
+static const char *getSchedulerName(SchedulerKind kind) {
+  switch (kind) {
+  case SchedulerKind::ChildMemSize:
+    return "child-mem-size";
+  case SchedulerKind::MinPeakMemory:
+    return "min-peak-memory";
+  case SchedulerKind::DataParallel:
+    return "data-parallel";
+  case SchedulerKind::CacheLocality:
+    return "cache-locality";
+  }
+  GLOW_UNREACHABLE("Unknown scheduler.");
+}
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the planning of the activations of the models of the zoo\n\n"
+      "Replays the allocations and deallocations of the activations of the "
+      "IR of every model and scheduler through every planner, and prints "
+      "the time of the planning, the memory it needs and the lower bound, "
+      "which is the largest total size of the buffers that are live at the "
+      "same time.\n");
+
+  std::vector<SchedulerKind> schedulers(schedulersOpt.begin(),
+                                        schedulersOpt.end());
+  if (schedulers.empty()) {
+    schedulers = {SchedulerKind::ChildMemSize, SchedulerKind::MinPeakMemory,
+                  SchedulerKind::DataParallel, SchedulerKind::CacheLocality};
+  }
+  std::unique_ptr<Backend> backend(createBackend(backendOpt));
+
+  std::vector<BenchResult> results;
+  printf("trace, planner, buffers, time(us), peak(KB), lower bound(KB), "
+         "overhead(%%)\n");
+  for (const auto &model : zooModels) {
+    if (!modelsOpt.empty() &&
+        std::find(modelsOpt.begin(), modelsOpt.end(), model.name) ==
+            modelsOpt.end()) {
+      continue;
+    }
+    if (!isModelAvailable(model, modelsDir)) {
+      llvm::errs() << "Skipping " << model.name << ": it is not in "
+                   << modelsDir << "\n";
+      continue;
+    }
+    // The graph is optimized once. Only the schedule of the IR changes.
+    Module mod;
+    Function *F = mod.createFunction(model.name);
+    importModel(model, modelsDir, F);
+    optimizeFunction(F, *backend);
+    for (auto kind : schedulers) {
+      auto IR = generateAndOptimizeIR(F, backend->shouldShareBuffers(), kind);
+      Trace trace;
+      trace.name = std::string(model.name) + "/" + getSchedulerName(kind);
+      trace.allocs = collectAllocations(*IR);
+      if (!dumpDirOpt.empty()) {
+        writeTrace(trace, dumpDirOpt + "/" + model.name + "." +
+                              getSchedulerName(kind) + ".trace");
+      }
+      benchTrace(trace, results);
+    }
+  }
+
+  for (const auto &path : tracesOpt) {
+    Trace trace;
+    readTrace(path, trace);
+    benchTrace(trace, results);
+  }
+
+  if (!jsonFileOpt.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(jsonFileOpt, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Can't write " << jsonFileOpt << ": " << EC.message()
+                   << "\n";
+      return 1;
+    }
+    writeJSON(os, results, [](llvm::raw_ostream &out, const BenchResult &R) {
+      out << "\"trace\": \"" << R.trace << "\", \"planner\": \"" << R.planner
+          << "\", \"buffers\": " << R.numBuffers
+          << ", \"seconds\": " << llvm::format("%.9f", R.seconds)
+          << ", \"peak\": " << R.peak << ", \"lowerBound\": " << R.lowerBound;
+    });
+  }
+  return 0;
+}
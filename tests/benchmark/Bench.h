@@ -16,9 +16,13 @@
 #ifndef GLOW_TESTS_BENCHMARK_H
 #define GLOW_TESTS_BENCHMARK_H
 
+#include "llvm/Support/raw_ostream.h"
+
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <limits>
+#include <vector>
 
 namespace glow {
 
@@ -46,6 +50,50 @@ double bench(Benchmark *b, size_t reps) {
   return best;
 }
 
+/// Run a benchmark \p warmup times without measuring it, then \p reps times,
+/// and \returns the execution time of each of the \p reps runs in seconds.
+std::vector<double> benchLatencies(Benchmark *b, size_t reps,
+                                   size_t warmup = 0) {
+  std::vector<double> times;
+  b->setup();
+  for (size_t i = 0; i < warmup; i++) {
+    b->run();
+  }
+  for (size_t i = 0; i < reps; i++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    b->run();
+    auto end = std::chrono::high_resolution_clock::now();
+    times.push_back(std::chrono::duration<double>(end - start).count());
+  }
+  b->teardown();
+  return times;
+}
+
+/// \returns the \p p-th percentile, between 0 and 100, of \p times with the
+/// nearest-rank method, or 0 if \p times is empty.
+double percentile(std::vector<double> times, double p) {
+  if (times.empty()) {
+    return 0;
+  }
+  std::sort(times.begin(), times.end());
+  size_t rank = std::ceil(p / 100 * times.size());
+  return times[std::min(std::max<size_t>(rank, 1), times.size()) - 1];
+}
+
+/// Write \p results to \p os as a JSON array of objects, whose fields
+/// \p writeFields writes to the stream for each result.
+template <typename Result, typename WriteFields>
+void writeJSON(llvm::raw_ostream &os, const std::vector<Result> &results,
+               WriteFields writeFields) {
+  os << "[\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    os << "  {";
+    writeFields(os, results[i]);
+    os << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "]\n";
+}
+
 } // namespace glow
 
 #endif // GLOW_TESTS_BENCHMARK_H
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Bench.h"
+
+#include "CPUBackend.h"
+#include "CPUFunction.h"
+
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdio>
+#include <memory>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory callBenchCat("Call Overhead Benchmark Options");
+
+llvm::cl::opt<unsigned>
+    callsOpt("calls", llvm::cl::desc("Number of calls of each measured run"),
+             llvm::cl::init(100000), llvm::cl::cat(callBenchCat));
+
+llvm::cl::opt<unsigned>
+    iterationsOpt("iterations",
+                  llvm::cl::desc("Number of measured runs of each entry"),
+                  llvm::cl::init(10), llvm::cl::cat(callBenchCat));
+} // namespace
+
+/// The ways of calling a compiled function.
+enum class CallKind {
+  /// CompiledFunction::execute(), with the context of the compilation.
+  Execute,
+  /// CompiledFunction::execute(Context &).
+  ExecuteContext,
+  /// CPUFunction::ExecutionHandle::run().
+  Handle,
+};
+
+/// Benchmark the calls of a network that copies a single element from its
+/// input to its output, whose execution time is the overhead of a call.
+class CallOverheadBench : public Benchmark {
+  CallKind kind_;
+  Module mod_;
+  Context ctx_;
+  Placeholder *input_{nullptr};
+  Placeholder *output_{nullptr};
+  std::unique_ptr<CompiledFunction> function_;
+  std::unique_ptr<CPUFunction::ExecutionHandle> handle_;
+  void *buffers_[2];
+
+public:
+  explicit CallOverheadBench(CallKind kind) : kind_(kind) {}
+
+  virtual void setup() override {
+    Function *F = mod_.createFunction("main");
+    input_ = mod_.createPlaceholder(ElemKind::FloatTy, {1}, "input", false);
+    output_ = mod_.createPlaceholder(ElemKind::FloatTy, {1}, "output", false);
+    buffers_[0] = ctx_.allocate(input_)->getUnsafePtr();
+    buffers_[1] = ctx_.allocate(output_)->getUnsafePtr();
+    F->createSave("save", input_, output_);
+
+    CPUBackend backend;
+    backend.setNumThreads(1);
+    ::glow::lower(F, backend);
+    ::glow::optimize(F, CompilationMode::Infer);
+    function_ = backend.compile(F, ctx_);
+    handle_ = static_cast<CPUFunction *>(function_.get())
+                  ->createExecutionHandle({input_, output_});
+  }
+
+  virtual void run() override {
+    for (unsigned i = 0; i < callsOpt; i++) {
+      switch (kind_) {
+      case CallKind::Execute:
+        function_->execute();
+        break;
+      case CallKind::ExecuteContext:
+        function_->execute(ctx_);
+        break;
+      case CallKind::Handle:
+        handle_->run(buffers_);
+        break;
+      }
+    }
+  }
+
+  virtual void teardown() override {
+    handle_.reset();
+    function_.reset();
+  }
+};
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the overhead of a call of a function compiled for the CPU\n\n"
+      "Prints the time of a call of a network that copies a single element, "
+      "for each way of calling it.\n");
+
+  struct {
+    CallKind kind;
+    const char *name;
+  } entries[] = {
+      {CallKind::Execute, "execute()"},
+      {CallKind::ExecuteContext, "execute(ctx)"},
+      {CallKind::Handle, "ExecutionHandle::run"},
+  };
+  printf("entry, ns/call\n");
+  for (const auto &entry : entries) {
+    CallOverheadBench b(entry.kind);
+    double time = bench(&b, iterationsOpt);
+    printf("%s, %.1lf\n", entry.name, time * 1e9 / callsOpt);
+  }
+  return 0;
+}
@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Bench.h"
+#include "ModelZoo.h"
+
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Importer/Caffe2.h"
+#include "glow/Importer/ONNX.h"
+#include "glow/Support/Compiler.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory compileBenchCat("Compile Benchmark Options");
+
+llvm::cl::opt<std::string> modelsDir(
+    "models-dir",
+    llvm::cl::desc("Directory holding the models downloaded by "
+                   "utils/download_caffe2_models.sh or "
+                   "utils/download_onnx_models.sh"),
+    llvm::cl::init("."), llvm::cl::cat(compileBenchCat));
+
+llvm::cl::opt<std::string> testModelsDir(
+    "test-models-dir",
+    llvm::cl::desc("Directory holding the models of tests/models"),
+    llvm::cl::init("tests/models"), llvm::cl::cat(compileBenchCat));
+
+llvm::cl::list<std::string> modelsOpt(
+    "models",
+    llvm::cl::desc("Models to benchmark (default: all of them that are "
+                   "available)"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(compileBenchCat));
+
+llvm::cl::list<BackendKind> backendsOpt(
+    "backends", llvm::cl::desc("Backends to benchmark (default: all of them)"),
+    llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
+                                "Use interpreter"),
+                     clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
+                     clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(compileBenchCat));
+
+llvm::cl::opt<unsigned> iterationsOpt(
+    "iterations",
+    llvm::cl::desc("Number of compilations of each model, whose median "
+                   "times are reported"),
+    llvm::cl::init(3), llvm::cl::cat(compileBenchCat));
+
+llvm::cl::opt<std::string>
+    jsonFileOpt("json",
+                llvm::cl::desc("Write the results to this file as JSON"),
+                llvm::cl::value_desc("file.json"),
+                llvm::cl::cat(compileBenchCat));
+} // namespace
+
+/// An input of a model: its name and its dimensions.
+struct ModelInput {
+  const char *name;
+  std::vector<size_t> dims;
+};
+
+/// A model whose compilation is measured: the small models of tests/models,
+/// and the image classifiers of the zoo that examples/bundles are built from.
+struct ModelInfo {
+  /// The name of the model, which is also its directory in the zoo.
+  const char *name;
+  /// The network and the weights of the Caffe2 model, or the ONNX model and
+  /// no weights, relative to the -test-models-dir. They are null for the
+  /// models of the zoo, which are found in the -models-dir.
+  const char *netFile;
+  const char *weightsFile;
+  /// The inputs of the Caffe2 model.
+  std::vector<ModelInput> caffe2Inputs;
+  /// The inputs of the ONNX model.
+  std::vector<ModelInput> onnxInputs;
+};
+
+static const ModelInfo benchModels[] = {
+    {"caffe2_conv",
+     "caffe2Models/predict_net.pbtxt",
+     "caffe2Models/init_net.pbtxt",
+     {{"data", {1, 1, 3, 3}}},
+     {}},
+    {"caffe2_parallel_matmul",
+     "caffe2Models/parallel_matmul_predict_net.pbtxt",
+     "caffe2Models/empty_init_net.pbtxt",
+     {{"inputs_0", {3, 10, 7}}, {"inputs_1", {3, 7, 10}}},
+     {}},
+    {"caffe2_sum",
+     "caffe2Models/sum_predict_net.pbtxt",
+     "caffe2Models/empty_init_net.pbtxt",
+     {{"inputs_0", {6, 9}},
+      {"inputs_1", {6, 9}},
+      {"inputs_2", {6, 9}},
+      {"inputs_3", {6, 9}}},
+     {}},
+    {"onnx_conv",
+     "onnxModels/simpleConv.onnxtxt",
+     nullptr,
+     {},
+     {{"data", {1, 1, 3, 3}}}},
+    {"resnet50",
+     nullptr,
+     nullptr,
+     {{"gpu_0/data", {1, 3, 224, 224}}},
+     {{"gpu_0/data_0", {1, 3, 224, 224}}}},
+    {"vgg19",
+     nullptr,
+     nullptr,
+     {{"data", {1, 3, 224, 224}}},
+     {{"data_0", {1, 3, 224, 224}}}},
+    {"zfnet512",
+     nullptr,
+     nullptr,
+     {{"gpu_0/data", {1, 3, 224, 224}}},
+     {{"gpu_0/data_0", {1, 3, 224, 224}}}},
+};
+
+/// The files of a model: the Caffe2 network and weights, or the ONNX model
+/// and an empty weights file.
+struct ModelFiles {
+  std::string net;
+  std::string weights;
+};
+
+/// \returns the files of \p model, with empty names if they do not exist.
+static ModelFiles findModelFiles(const ModelInfo &model) {
+  if (model.netFile) {
+    std::string net = testModelsDir + "/" + model.netFile;
+    std::string weights =
+        model.weightsFile ? testModelsDir + "/" + model.weightsFile : "";
+    if (llvm::sys::fs::exists(net) &&
+        (weights.empty() || llvm::sys::fs::exists(weights))) {
+      return {net, weights};
+    }
+    return {};
+  }
+  std::string dir = modelsDir + "/" + model.name;
+  if (llvm::sys::fs::exists(dir + "/predict_net.pb")) {
+    return {dir + "/predict_net.pb", dir + "/init_net.pb"};
+  }
+  if (llvm::sys::fs::exists(dir + "/model.onnx")) {
+    return {dir + "/model.onnx", ""};
+  }
+  return {};
+}
+
+/// The median time of a phase of the compilation of a model.
+struct BenchResult {
+  const char *model;
+  const char *backend;
+  std::string phase;
+  double seconds;
+};
+
+/// The times of the phases of the compilations of a model, in the order in
+/// which the phases first ran.
+class PhaseTimes {
+  std::vector<std::string> names_;
+  std::vector<std::vector<double>> times_;
+
+public:
+  /// Add \p seconds to the time of the phase \p name in the compilation
+  /// \p iteration. Phases that run several times in a compilation add up.
+  void add(llvm::StringRef name, unsigned iteration, double seconds) {
+    auto it = std::find(names_.begin(), names_.end(), name);
+    size_t index = it - names_.begin();
+    if (it == names_.end()) {
+      names_.push_back(name.str());
+      times_.emplace_back();
+    }
+    auto &times = times_[index];
+    if (times.size() <= iteration) {
+      times.resize(iteration + 1);
+    }
+    times[iteration] += seconds;
+  }
+
+  /// Append the median time of every phase of \p model and \p backend to
+  /// \p results.
+  void collect(const char *model, const char *backend,
+               std::vector<BenchResult> &results) const {
+    for (size_t i = 0, e = names_.size(); i < e; i++) {
+      results.push_back({model, backend, names_[i], percentile(times_[i], 50)});
+    }
+  }
+};
+
+/// Load \p files of \p model into \p F, and \returns the loading time in
+/// seconds.
+static double importModel(const ModelInfo &model, const ModelFiles &files,
+                          Function *F) {
+  bool isONNX = files.weights.empty();
+  const auto &inputs = isONNX ? model.onnxInputs : model.caffe2Inputs;
+  std::vector<Tensor> tensors;
+  std::vector<const char *> names;
+  for (const auto &input : inputs) {
+    tensors.emplace_back(ElemKind::FloatTy, input.dims);
+    names.push_back(input.name);
+  }
+  std::vector<Tensor *> tensorPtrs;
+  for (auto &T : tensors) {
+    tensorPtrs.push_back(&T);
+  }
+  auto begin = std::chrono::steady_clock::now();
+  if (isONNX) {
+    ONNXModelLoader(files.net, names, tensorPtrs, *F);
+  } else {
+    caffe2ModelLoader(files.net, files.weights, names, tensorPtrs, *F);
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the compilation of the models of tests/models and of the "
+      "zoo\n\n"
+      "Prints the median time of every phase of the compilation, from the "
+      "import to the generation of the machine code, for every model and "
+      "backend.\n");
+
+  std::vector<BackendKind> backends(backendsOpt.begin(), backendsOpt.end());
+  if (backends.empty()) {
+    backends.push_back(BackendKind::Interpreter);
+#ifdef GLOW_WITH_CPU
+    backends.push_back(BackendKind::CPU);
+#endif
+#ifdef GLOW_WITH_OPENCL
+    backends.push_back(BackendKind::OpenCL);
+#endif
+  }
+  unsigned iterations = std::max(1u, unsigned(iterationsOpt));
+
+  std::vector<BenchResult> results;
+  printf("model, backend, phase, time(ms)\n");
+  for (const auto &model : benchModels) {
+    if (!modelsOpt.empty() &&
+        std::find(modelsOpt.begin(), modelsOpt.end(), model.name) ==
+            modelsOpt.end()) {
+      continue;
+    }
+    ModelFiles files = findModelFiles(model);
+    if (files.net.empty()) {
+      llvm::errs() << "Skipping " << model.name << ": it is not in "
+                   << (model.netFile ? testModelsDir : modelsDir) << "\n";
+      continue;
+    }
+    for (auto backend : backends) {
+      // Every compilation starts from a fresh engine, so that nothing is
+      // reused from the previous one.
+      PhaseTimes times;
+      for (unsigned i = 0; i < iterations; i++) {
+        ExecutionEngine EE(backend);
+        Function *F = EE.getModule().createFunction(model.name);
+        times.add("import", i, importModel(model, files, F));
+        Context ctx;
+        EE.compile(CompilationMode::Infer, F, ctx);
+        const auto &report = EE.getCompileReport();
+        for (const auto &phase : report.getPhases()) {
+          times.add(phase.name, i, phase.seconds);
+        }
+        times.add("total compile", i, report.getTotalSeconds());
+      }
+      size_t first = results.size();
+      times.collect(model.name, getBackendName(backend), results);
+      for (size_t i = first, e = results.size(); i < e; i++) {
+        const auto &R = results[i];
+        printf("%s, %s, %s, %.3lf\n", R.model, R.backend, R.phase.c_str(),
+               R.seconds * 1e3);
+      }
+    }
+  }
+
+  if (!jsonFileOpt.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(jsonFileOpt, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Can't write " << jsonFileOpt << ": " << EC.message()
+                   << "\n";
+      return 1;
+    }
+    writeJSON(os, results, [](llvm::raw_ostream &out, const BenchResult &R) {
+      out << "\"model\": \"" << R.model << "\", \"backend\": \"" << R.backend
+          << "\", \"phase\": \"" << R.phase << "\""
+          << llvm::format(", \"ms\": %.3f", R.seconds * 1e3);
+    });
+  }
+  return 0;
+}
@@ -25,8 +25,32 @@ extern "C" {
 extern void libjit_matmul_f(float *c, const float *a, const float *b,
                             const size_t *cDims, const size_t *aDims,
                             const size_t *bDims);
+extern void libjit_matmul_avx2_f(float *c, const float *a, const float *b,
+                                 const size_t *cDims, const size_t *aDims,
+                                 const size_t *bDims);
+extern void libjit_matmul_avx512_f(float *c, const float *a, const float *b,
+                                   const size_t *cDims, const size_t *aDims,
+                                   const size_t *bDims);
 }
 
+/// Signature of the libjit matrix multiplication kernels.
+using GemmKernelTy = void (*)(float *c, const float *a, const float *b,
+                              const size_t *cDims, const size_t *aDims,
+                              const size_t *bDims);
+
+/// The microkernel variants to benchmark. They are compiled for the host with
+/// the flags of CPURuntimeNative, so the ISA-specific variants only reach
+/// their peak when the runtime is built for a matching CPU (e.g. with
+/// -march=native).
+static const struct {
+  const char *name;
+  GemmKernelTy kernel;
+} kernels[] = {
+    {"generic", libjit_matmul_f},
+    {"avx2", libjit_matmul_avx2_f},
+    {"avx512", libjit_matmul_avx512_f},
+};
+
 /// Benchmark an (m x k) * (k x n) = (m x n) matrix multiplication.
 class GemmBench : public Benchmark {
   /// Matrices.
@@ -39,9 +63,12 @@ class GemmBench : public Benchmark {
   size_t bDims[2];
   size_t cDims[2];
 
+  /// The kernel to run.
+  GemmKernelTy kernel;
+
 public:
-  GemmBench(size_t m, size_t n, size_t k)
-      : aDims{m, k}, bDims{k, n}, cDims{m, n} {}
+  GemmBench(size_t m, size_t n, size_t k, GemmKernelTy kernel)
+      : aDims{m, k}, bDims{k, n}, cDims{m, n}, kernel(kernel) {}
 
   virtual void setup() override {
     size_t m = cDims[0];
@@ -56,7 +83,7 @@ public:
   }
 
   virtual void run() override {
-    libjit_matmul_f(c.data(), a.data(), b.data(), cDims, aDims, bDims);
+    kernel(c.data(), a.data(), b.data(), cDims, aDims, bDims);
   }
 
   virtual void teardown() override {}
@@ -77,23 +104,26 @@ private:
 
 int main() {
   constexpr int reps = 100;
-  printf("outX, outY, lhsX, lhsY, rhsX, rhsY, gflops/s, \n");
+  printf("kernel, outX, outY, lhsX, lhsY, rhsX, rhsY, gflops/s, \n");
 
-  for (int i = 0; i < 2; i++) {
-    for (int j = 0; j < 2; j++) {
-      for (int p = 0; p < 2; p++) {
-        if (i == 1 && j == 1 && p == 1) {
-          break;
-        }
-        for (size_t x = 32; x <= 1024; x += 32) {
-          size_t m = i ? 32 : x;
-          size_t n = j ? 32 : x;
-          size_t k = p ? 32 : x;
-
-          GemmBench b(m, n, k);
-          auto time = bench(&b, reps);
-          printf("%4zu, %-4zu,   %4zu, %-4zu,   %4zu,  %-4zu,   %5.2lf\n", m, n,
-                 m, k, k, n, b.gflops() / time);
+  for (const auto &K : kernels) {
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < 2; j++) {
+        for (int p = 0; p < 2; p++) {
+          if (i == 1 && j == 1 && p == 1) {
+            break;
+          }
+          for (size_t x = 32; x <= 1024; x += 32) {
+            size_t m = i ? 32 : x;
+            size_t n = j ? 32 : x;
+            size_t k = p ? 32 : x;
+
+            GemmBench b(m, n, k, K.kernel);
+            auto time = bench(&b, reps);
+            printf("%-7s, %4zu, %-4zu,   %4zu, %-4zu,   %4zu,  %-4zu,   "
+                   "%5.2lf\n",
+                   K.name, m, n, m, k, k, n, b.gflops() / time);
+          }
         }
       }
     }
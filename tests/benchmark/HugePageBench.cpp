@@ -0,0 +1,244 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Bench.h"
+
+#include "glow/Support/HugePages.h"
+#include "glow/Support/Memory.h"
+#include "glow/Support/RuntimeAllocator.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory hugePageBenchCat("Huge Page Benchmark Options");
+
+llvm::cl::opt<unsigned>
+    tableMBOpt("table-mb",
+               llvm::cl::desc("Size of the embedding table and of the fully "
+                              "connected weights in MB"),
+               llvm::cl::init(1024), llvm::cl::cat(hugePageBenchCat));
+
+llvm::cl::opt<unsigned>
+    lookupsOpt("lookups",
+               llvm::cl::desc("Number of rows gathered by each measured run"),
+               llvm::cl::init(1 << 20), llvm::cl::cat(hugePageBenchCat));
+
+llvm::cl::opt<unsigned>
+    iterationsOpt("iterations",
+                  llvm::cl::desc("Number of measured runs of each entry"),
+                  llvm::cl::init(5), llvm::cl::cat(hugePageBenchCat));
+} // namespace
+
+/// Counts the data TLB misses of the loads of the calling thread, when the
+/// system lets the process read the hardware counters.
+class DTLBMissCounter {
+  int fd_{-1};
+
+public:
+  DTLBMissCounter() {
+#ifdef __linux__
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~DTLBMissCounter() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+#endif
+  }
+
+  /// \returns true if the misses can be counted.
+  bool isAvailable() const { return fd_ >= 0; }
+
+  /// Reset the count and start counting.
+  void start() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  /// Stop counting. \returns the number of misses since start().
+  uint64_t stop() {
+    uint64_t count = 0;
+#ifdef __linux__
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+#endif
+    return count;
+  }
+};
+
+/// The access patterns of the layers whose weights are too large for the
+/// TLB reach of the ordinary pages.
+enum class AccessKind {
+  /// Random rows of an embedding table, as SparseLengthsSum reads them.
+  Gather,
+  /// All the rows of the weights of a fully connected layer with a batch of
+  /// one, as a matrix-vector product reads them.
+  MatVec,
+};
+
+/// Benchmark an access pattern over weights allocated by the runtime
+/// allocator with a huge page policy.
+class HugePageBench : public Benchmark {
+  AccessKind kind_;
+  HugePageRuntimeAllocator allocator_;
+  size_t size_;
+  size_t rowSize_{64};
+  float *table_{nullptr};
+  std::vector<float> vec_;
+  std::vector<size_t> indices_;
+  DTLBMissCounter &counter_;
+  uint64_t misses_{0};
+  size_t mappedBytes_{0};
+  volatile float sink_{0};
+
+public:
+  HugePageBench(AccessKind kind, HugePagePolicy policy,
+                DTLBMissCounter &counter)
+      : kind_(kind), allocator_(getHeapRuntimeAllocator()),
+        size_(size_t(tableMBOpt) << 20), counter_(counter) {
+    allocator_.setPolicy(RuntimeMemoryKind::ConstantWeights, policy);
+  }
+
+  /// \returns the number of bytes of the weights that were on huge pages.
+  size_t getMappedBytes() const { return mappedBytes_; }
+
+  /// \returns the TLB misses of the last run.
+  uint64_t getMisses() const { return misses_; }
+
+  virtual void setup() override {
+    table_ = static_cast<float *>(allocator_.allocate(
+        size_, TensorAlignment, RuntimeMemoryKind::ConstantWeights));
+    size_t numElements = size_ / sizeof(float);
+    for (size_t i = 0; i < numElements; i++) {
+      table_[i] = float(i % 7) * 0.25f;
+    }
+    vec_.assign(rowSize_, 1.f);
+    std::mt19937_64 rng(1234);
+    std::uniform_int_distribution<size_t> dist(0,
+                                               numElements / rowSize_ - 1);
+    indices_.resize(lookupsOpt);
+    for (auto &idx : indices_) {
+      idx = dist(rng);
+    }
+  }
+
+  virtual void run() override {
+    counter_.start();
+    float sum = 0;
+    if (kind_ == AccessKind::Gather) {
+      for (auto idx : indices_) {
+        const float *row = table_ + idx * rowSize_;
+        for (size_t j = 0; j < rowSize_; j++) {
+          sum += row[j];
+        }
+      }
+    } else {
+      size_t numRows = size_ / sizeof(float) / rowSize_;
+      for (size_t i = 0; i < numRows; i++) {
+        const float *row = table_ + i * rowSize_;
+        for (size_t j = 0; j < rowSize_; j++) {
+          sum += row[j] * vec_[j];
+        }
+      }
+    }
+    misses_ = counter_.stop();
+    mappedBytes_ = allocator_.getMappedBytes();
+    sink_ = sum;
+  }
+
+  virtual void teardown() override {
+    allocator_.deallocate(table_, size_, TensorAlignment,
+                          RuntimeMemoryKind::ConstantWeights);
+  }
+};
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the weights of large layers on huge pages\n\n"
+      "Prints the time and the data TLB misses of gathering embedding rows "
+      "and of a matrix-vector product, for each huge page policy. A policy "
+      "whose pages are not reserved falls back to the next smaller one, as "
+      "the mapped MB show.\n");
+
+  DTLBMissCounter counter;
+  if (!counter.isAvailable()) {
+    printf("# The TLB misses can't be counted, see "
+           "/proc/sys/kernel/perf_event_paranoid.\n");
+  }
+  struct {
+    HugePagePolicy policy;
+    const char *name;
+  } policies[] = {
+      {HugePagePolicy::None, "none"},
+      {HugePagePolicy::Transparent, "thp"},
+      {HugePagePolicy::Explicit2MB, "2mb"},
+      {HugePagePolicy::Explicit1GB, "1gb"},
+  };
+  struct {
+    AccessKind kind;
+    const char *name;
+  } accesses[] = {
+      {AccessKind::Gather, "gather"},
+      {AccessKind::MatVec, "matvec"},
+  };
+  printf("access, policy, time(ms), dTLB misses, mapped(MB)\n");
+  for (const auto &access : accesses) {
+    for (const auto &policy : policies) {
+      HugePageBench b(access.kind, policy.policy, counter);
+      double time = bench(&b, iterationsOpt);
+      printf("%s, %s, %.3lf, %llu, %zu\n", access.name, policy.name,
+             time * 1e3, (unsigned long long)b.getMisses(),
+             b.getMappedBytes() >> 20);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,598 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern void libjit_convolution_f(float *outW, const float *inW,
+                                 const float *filterW, const float *biasW,
+                                 const size_t *outWdims, const size_t *inWdims,
+                                 const size_t *filterWdims,
+                                 const size_t *biasWdims,
+                                 const size_t *kernelSizes,
+                                 const size_t *strides, const size_t *pads,
+                                 size_t group, unsigned depthUnroll);
+extern void libjit_convDKKC8_f(float *outW, const float *inW,
+                               const float *filterW, const float *biasW,
+                               const size_t *outWdims, const size_t *inWdims,
+                               const size_t *filterWdims,
+                               const size_t *biasWdims,
+                               const size_t *kernelSizes, const size_t *strides,
+                               const size_t *pads, size_t group,
+                               unsigned pixelScanFirst, unsigned numDepthRegs,
+                               unsigned sizeGroupY, unsigned depthStrips);
+extern void libjit_convolution_i8(
+    int8_t *outW, const int8_t *inW, const int8_t *filterW, const int8_t *biasW,
+    const size_t *outWdims, const size_t *inWdims, const size_t *filterWdims,
+    const size_t *biasWdims, const size_t *kernelSizes, const size_t *strides,
+    const size_t *pads, size_t group, int32_t outOffset, int32_t inOffset,
+    int32_t filterOffset, int32_t biasOffset, int32_t biasPre, int32_t biasPost,
+    int32_t biasScale, int32_t outPre, int32_t outPost, int32_t outScale,
+    unsigned depthUnroll);
+extern void libjit_max_pool_f(const float *inW, float *outW,
+                              const size_t *inWdims, const size_t *outWdims,
+                              size_t *kernelSizes, size_t *strides,
+                              size_t *pads);
+extern void libjit_avg_pool_f(const float *inW, float *outW,
+                              const size_t *inWdims, const size_t *outWdims,
+                              size_t *kernelSizes, size_t *strides,
+                              size_t *pads);
+extern void libjit_transpose_f(const float *inW, float *outW,
+                               const size_t *idim, const size_t *odim,
+                               const size_t *shuffle, size_t numDims);
+extern void libjit_gather_f(float *dest, const float *data,
+                            const size_t *indices, size_t numIndices,
+                            size_t sliceSize, size_t numSamples,
+                            size_t sampleSize);
+extern void libjit_batchedreduceadd_f(float *dest, const float *batch,
+                                      size_t destSize, const size_t *destDims,
+                                      const size_t *batchDims, size_t axis);
+extern void libjit_softmax_f(const float *inW, float *outW, const size_t *idim,
+                             const size_t *odim);
+}
+
+/// Fill \p v with random values in [\p low, \p high].
+template <typename T> static void randomize(std::vector<T> &v, T low, T high) {
+  std::mt19937 gen;
+  std::uniform_real_distribution<> dis(low, high);
+  for (auto &x : v) {
+    x = dis(gen);
+  }
+}
+
+/// \returns the product of the \p n first elements of \p dims.
+static size_t product(const size_t *dims, size_t n) {
+  size_t size = 1;
+  for (size_t i = 0; i < n; i++) {
+    size *= dims[i];
+  }
+  return size;
+}
+
+/// A benchmark of a libjit kernel, which knows the amount of work that one run
+/// of the kernel performs.
+class KernelBench : public Benchmark {
+public:
+  /// \returns a description of the shape of the kernel.
+  virtual std::string shape() const = 0;
+  /// \returns the number of arithmetic operations of one run.
+  virtual double flops() const = 0;
+  /// \returns the minimal number of bytes that one run reads and writes.
+  virtual double bytes() const = 0;
+  virtual void teardown() override {}
+};
+
+/// The libjit implementations of the convolution.
+enum class ConvKind { Generic, DKKC8, Int8 };
+
+/// Benchmark a convolution of an NHWC input, with a square kernel.
+class ConvBench : public KernelBench {
+  ConvKind kind_;
+  size_t inDims_[4], outDims_[4], filterDims_[4], biasDims_[1];
+  size_t kernels_[2], strides_[2], pads_[4];
+  std::vector<float> in_, filter_, bias_, out_;
+  std::vector<int8_t> inI8_, filterI8_, biasI8_, outI8_;
+
+public:
+  ConvBench(ConvKind kind, size_t size, size_t inChannels, size_t outChannels,
+            size_t kernel, size_t stride, size_t pad)
+      : kind_(kind), inDims_{1, size, size, inChannels},
+        filterDims_{outChannels, kernel, kernel, inChannels},
+        biasDims_{outChannels}, kernels_{kernel, kernel},
+        strides_{stride, stride}, pads_{pad, pad, pad, pad} {
+    size_t outSize = (size + 2 * pad - kernel) / stride + 1;
+    outDims_[0] = 1;
+    outDims_[1] = outSize;
+    outDims_[2] = outSize;
+    outDims_[3] = outChannels;
+  }
+
+  virtual void setup() override {
+    size_t inSize = product(inDims_, 4);
+    size_t filterSize = product(filterDims_, 4);
+    size_t outSize = product(outDims_, 4);
+    if (kind_ == ConvKind::Int8) {
+      inI8_.resize(inSize);
+      filterI8_.resize(filterSize);
+      biasI8_.resize(biasDims_[0]);
+      outI8_.resize(outSize);
+      randomize(inI8_, int8_t(-4), int8_t(4));
+      randomize(filterI8_, int8_t(-4), int8_t(4));
+      randomize(biasI8_, int8_t(-4), int8_t(4));
+      return;
+    }
+    in_.resize(inSize);
+    filter_.resize(filterSize);
+    bias_.resize(biasDims_[0]);
+    out_.resize(outSize);
+    randomize(in_, -1.f, 1.f);
+    randomize(filter_, -1.f, 1.f);
+    randomize(bias_, -1.f, 1.f);
+  }
+
+  virtual void run() override {
+    size_t inChannels = inDims_[3];
+    size_t outChannels = outDims_[3];
+    // Pick the parameters that the CPU backend picks for these layers.
+    unsigned depthUnroll = outChannels % 8 == 0 ? 8 : 1;
+    switch (kind_) {
+    case ConvKind::Generic:
+      libjit_convolution_f(out_.data(), in_.data(), filter_.data(),
+                           bias_.data(), outDims_, inDims_, filterDims_,
+                           biasDims_, kernels_, strides_, pads_, 1,
+                           depthUnroll);
+      break;
+    case ConvKind::DKKC8: {
+      // The filter is in the [D/8, K, K, C, 8] layout, which has the same
+      // size.
+      size_t filter8Dims[5] = {outChannels / 8, kernels_[0], kernels_[1],
+                               inChannels, 8};
+      bool pixelScanFirst = inChannels < 16;
+      unsigned numDepthRegs = pixelScanFirst ? 8 : 2;
+      unsigned sizeGroupY = pixelScanFirst ? 1 : 5;
+      unsigned depthStrips = 1;
+      unsigned stripSize = 8 * numDepthRegs * inChannels;
+      while (2 * depthStrips * stripSize <= 16384 &&
+             2 * depthStrips * numDepthRegs * 8 <= outChannels &&
+             depthStrips < 8) {
+        depthStrips *= 2;
+      }
+      libjit_convDKKC8_f(out_.data(), in_.data(), filter_.data(), bias_.data(),
+                         outDims_, inDims_, filter8Dims, biasDims_, kernels_,
+                         strides_, pads_, 1, pixelScanFirst, numDepthRegs,
+                         sizeGroupY, depthStrips);
+      break;
+    }
+    case ConvKind::Int8:
+      libjit_convolution_i8(outI8_.data(), inI8_.data(), filterI8_.data(),
+                            biasI8_.data(), outDims_, inDims_, filterDims_,
+                            biasDims_, kernels_, strides_, pads_, 1, 0, 0, 0,
+                            0, 0, 0, 1, 0, 8, 1, depthUnroll);
+      break;
+    }
+  }
+
+  virtual std::string shape() const override {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%zux%zux%zu k%zu s%zu -> %zu", inDims_[1],
+             inDims_[2], inDims_[3], kernels_[0], strides_[0], outDims_[3]);
+    return buf;
+  }
+
+  virtual double flops() const override {
+    return 2.0 * product(outDims_, 4) * product(filterDims_ + 1, 3);
+  }
+
+  virtual double bytes() const override {
+    double elemSize = kind_ == ConvKind::Int8 ? 1 : 4;
+    return elemSize * (product(inDims_, 4) + product(filterDims_, 4) +
+                       biasDims_[0] + product(outDims_, 4));
+  }
+};
+
+/// Benchmark a max or an average pooling of an NHWC input.
+class PoolBench : public KernelBench {
+  bool isMax_;
+  size_t inDims_[4], outDims_[4];
+  size_t kernels_[2], strides_[2], pads_[4];
+  std::vector<float> in_, out_;
+
+public:
+  PoolBench(bool isMax, size_t size, size_t channels, size_t kernel,
+            size_t stride, size_t pad)
+      : isMax_(isMax), inDims_{1, size, size, channels},
+        kernels_{kernel, kernel}, strides_{stride, stride},
+        pads_{pad, pad, pad, pad} {
+    size_t outSize = (size + 2 * pad - kernel) / stride + 1;
+    outDims_[0] = 1;
+    outDims_[1] = outSize;
+    outDims_[2] = outSize;
+    outDims_[3] = channels;
+  }
+
+  virtual void setup() override {
+    in_.resize(product(inDims_, 4));
+    out_.resize(product(outDims_, 4));
+    randomize(in_, -1.f, 1.f);
+  }
+
+  virtual void run() override {
+    if (isMax_) {
+      libjit_max_pool_f(in_.data(), out_.data(), inDims_, outDims_, kernels_,
+                        strides_, pads_);
+    } else {
+      libjit_avg_pool_f(in_.data(), out_.data(), inDims_, outDims_, kernels_,
+                        strides_, pads_);
+    }
+  }
+
+  virtual std::string shape() const override {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%zux%zux%zu k%zu s%zu", inDims_[1],
+             inDims_[2], inDims_[3], kernels_[0], strides_[0]);
+    return buf;
+  }
+
+  virtual double flops() const override {
+    return double(product(outDims_, 4)) * kernels_[0] * kernels_[1];
+  }
+
+  virtual double bytes() const override {
+    return 4.0 * (product(inDims_, 4) + product(outDims_, 4));
+  }
+};
+
+/// Benchmark the transposition of a 4-dimensional tensor.
+class TransposeBench : public KernelBench {
+  size_t inDims_[4], outDims_[4], shuffle_[4];
+  std::vector<float> in_, out_;
+
+public:
+  TransposeBench(std::vector<size_t> dims, std::vector<size_t> shuffle) {
+    for (size_t i = 0; i < 4; i++) {
+      inDims_[i] = dims[i];
+      shuffle_[i] = shuffle[i];
+      outDims_[i] = dims[shuffle[i]];
+    }
+  }
+
+  virtual void setup() override {
+    in_.resize(product(inDims_, 4));
+    out_.resize(in_.size());
+    randomize(in_, -1.f, 1.f);
+  }
+
+  virtual void run() override {
+    libjit_transpose_f(in_.data(), out_.data(), inDims_, outDims_, shuffle_,
+                       4);
+  }
+
+  virtual std::string shape() const override {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%zux%zux%zux%zu {%zu,%zu,%zu,%zu}", inDims_[0],
+             inDims_[1], inDims_[2], inDims_[3], shuffle_[0], shuffle_[1],
+             shuffle_[2], shuffle_[3]);
+    return buf;
+  }
+
+  virtual double flops() const override { return 0; }
+
+  virtual double bytes() const override {
+    return 2 * 4.0 * product(inDims_, 4);
+  }
+};
+
+/// Benchmark the lookup of \p numIndices rows of an embedding table.
+class GatherBench : public KernelBench {
+  size_t numRows_, rowSize_, numIndices_;
+  std::vector<float> data_, out_;
+  std::vector<size_t> indices_;
+
+public:
+  GatherBench(size_t numRows, size_t rowSize, size_t numIndices)
+      : numRows_(numRows), rowSize_(rowSize), numIndices_(numIndices) {}
+
+  virtual void setup() override {
+    data_.resize(numRows_ * rowSize_);
+    out_.resize(numIndices_ * rowSize_);
+    randomize(data_, -1.f, 1.f);
+    std::mt19937 gen;
+    std::uniform_int_distribution<size_t> dis(0, numRows_ - 1);
+    indices_.resize(numIndices_);
+    for (auto &index : indices_) {
+      index = dis(gen);
+    }
+  }
+
+  virtual void run() override {
+    libjit_gather_f(out_.data(), data_.data(), indices_.data(), numIndices_,
+                    rowSize_, 1, numRows_ * rowSize_);
+  }
+
+  virtual std::string shape() const override {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%zux%zu [%zu]", numRows_, rowSize_,
+             numIndices_);
+    return buf;
+  }
+
+  virtual double flops() const override { return 0; }
+
+  virtual double bytes() const override {
+    return 2 * 4.0 * out_.size() + sizeof(size_t) * numIndices_;
+  }
+};
+
+/// Benchmark the sum of a 2-dimensional batch along one of its axes.
+class ReduceAddBench : public KernelBench {
+  size_t batchDims_[6], destDims_[6], axis_;
+  std::vector<float> batch_, dest_;
+
+public:
+  ReduceAddBench(size_t rows, size_t cols, size_t axis)
+      : batchDims_{rows, cols, 1, 1, 1, 1},
+        destDims_{axis == 0 ? 1 : rows, axis == 1 ? 1 : cols, 1, 1, 1, 1},
+        axis_(axis) {}
+
+  virtual void setup() override {
+    batch_.resize(product(batchDims_, 6));
+    dest_.resize(product(destDims_, 6));
+    randomize(batch_, -1.f, 1.f);
+  }
+
+  virtual void run() override {
+    libjit_batchedreduceadd_f(dest_.data(), batch_.data(), dest_.size(),
+                              destDims_, batchDims_, axis_);
+  }
+
+  virtual std::string shape() const override {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%zux%zu axis %zu", batchDims_[0],
+             batchDims_[1], axis_);
+    return buf;
+  }
+
+  virtual double flops() const override { return batch_.size(); }
+
+  virtual double bytes() const override {
+    return 4.0 * (batch_.size() + dest_.size());
+  }
+};
+
+/// Benchmark the softmax of the rows of a 2-dimensional tensor.
+class SoftmaxBench : public KernelBench {
+  size_t dims_[2];
+  std::vector<float> in_, out_;
+
+public:
+  SoftmaxBench(size_t rows, size_t cols) : dims_{rows, cols} {}
+
+  virtual void setup() override {
+    in_.resize(dims_[0] * dims_[1]);
+    out_.resize(in_.size());
+    randomize(in_, -4.f, 4.f);
+  }
+
+  virtual void run() override {
+    libjit_softmax_f(in_.data(), out_.data(), dims_, dims_);
+  }
+
+  virtual std::string shape() const override {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%zux%zu", dims_[0], dims_[1]);
+    return buf;
+  }
+
+  /// The maximum, the exponential, the sum and the division of every element.
+  virtual double flops() const override { return 4.0 * in_.size(); }
+
+  virtual double bytes() const override { return 2 * 4.0 * in_.size(); }
+};
+
+/// Benchmark a copy of \p size bytes. It is only used to measure the peak
+/// memory bandwidth of the machine.
+class CopyBench : public KernelBench {
+  size_t size_;
+  std::vector<char> src_, dest_;
+
+public:
+  explicit CopyBench(size_t size) : size_(size) {}
+
+  virtual void setup() override {
+    src_.assign(size_, 1);
+    dest_.assign(size_, 0);
+  }
+
+  virtual void run() override { memcpy(dest_.data(), src_.data(), size_); }
+
+  virtual std::string shape() const override { return ""; }
+  virtual double flops() const override { return 0; }
+  virtual double bytes() const override { return 2.0 * size_; }
+};
+
+/// Vectors of floats, which the compiler maps to the registers of the target.
+typedef float float8 __attribute__((vector_size(32)));
+typedef float float16 __attribute__((vector_size(64)));
+
+/// The number of independent accumulators of the peak compute loops, which
+/// hides the latency of the multiply-adds.
+constexpr size_t numAccumulators = 8;
+
+/// Define the function NAME that performs \p iters multiply-adds on each
+/// float of numAccumulators vectors of type VEC, compiled with the target
+/// attribute ATTR, and \returns their sum so that the loop is not removed.
+#define DEFINE_PEAK_LOOP(NAME, VEC, ATTR)                                      \
+  ATTR static float NAME(size_t iters, float x) {                              \
+    VEC acc[numAccumulators];                                                  \
+    VEC mul = {};                                                              \
+    VEC add = {};                                                              \
+    mul += 0.999f;                                                             \
+    add += x;                                                                  \
+    for (size_t i = 0; i < numAccumulators; i++) {                             \
+      acc[i] = add * float(i + 1);                                             \
+    }                                                                          \
+    for (size_t n = 0; n < iters; n++) {                                       \
+      for (size_t i = 0; i < numAccumulators; i++) {                           \
+        acc[i] = acc[i] * mul + add;                                           \
+      }                                                                        \
+    }                                                                          \
+    float sum = 0;                                                             \
+    for (size_t i = 0; i < numAccumulators; i++) {                             \
+      for (size_t j = 0; j < sizeof(VEC) / sizeof(float); j++) {               \
+        sum += acc[i][j];                                                      \
+      }                                                                        \
+    }                                                                          \
+    return sum;                                                                \
+  }
+
+DEFINE_PEAK_LOOP(peakLoopGeneric, float8, )
+#if defined(__x86_64__) || defined(__i386__)
+DEFINE_PEAK_LOOP(peakLoopAVX2, float8, __attribute__((target("avx2,fma"))))
+DEFINE_PEAK_LOOP(peakLoopAVX512, float16, __attribute__((target("avx512f"))))
+#endif
+
+/// Benchmark a loop of independent multiply-adds, which runs at the peak
+/// compute throughput of a core. It is only used to measure the compute roof.
+class PeakFlopsBench : public KernelBench {
+  using LoopTy = float (*)(size_t, float);
+  LoopTy loop_;
+  size_t vectorSize_;
+  size_t iters_{1 << 20};
+  float result_{0};
+
+public:
+  PeakFlopsBench(LoopTy loop, size_t vectorSize)
+      : loop_(loop), vectorSize_(vectorSize) {}
+
+  virtual void setup() override {}
+  virtual void run() override { result_ += loop_(iters_, result_ * 1e-9f); }
+
+  virtual std::string shape() const override { return ""; }
+  virtual double flops() const override {
+    return 2.0 * iters_ * numAccumulators * vectorSize_;
+  }
+  virtual double bytes() const override { return 0; }
+};
+
+/// \returns the peak compute throughput of a core in GFLOP/s, with the widest
+/// vectors that the host supports.
+static double measurePeakGFlops(size_t reps) {
+  std::vector<PeakFlopsBench> benches = {{peakLoopGeneric, 8}};
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    benches.push_back({peakLoopAVX2, 8});
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    benches.push_back({peakLoopAVX512, 16});
+  }
+#endif
+  double peak = 0;
+  for (auto &b : benches) {
+    peak = std::max(peak, b.flops() / bench(&b, reps) / 1e9);
+  }
+  return peak;
+}
+
+/// \returns the value of the environment variable \p name as a number, or 0 if
+/// it is not set.
+static double getEnvNumber(const char *name) {
+  const char *value = getenv(name);
+  return value ? atof(value) : 0;
+}
+
+int main() {
+  constexpr int reps = 10;
+
+  // The roofs of a core of the machine. The compute roof is the throughput of
+  // multiply-adds with the widest vectors of the host and the memory roof the
+  // bandwidth of a copy that does not fit in the caches, unless the vendor
+  // numbers are given with GLOW_PEAK_GFLOPS and GLOW_PEAK_GBPS.
+  double peakGFlops = getEnvNumber("GLOW_PEAK_GFLOPS");
+  if (peakGFlops <= 0) {
+    peakGFlops = measurePeakGFlops(reps);
+  }
+  double peakGBps = getEnvNumber("GLOW_PEAK_GBPS");
+  if (peakGBps <= 0) {
+    CopyBench b(256 << 20);
+    peakGBps = b.bytes() / bench(&b, reps) / 1e9;
+  }
+  printf("peak: %.2lf GFLOP/s, %.2lf GB/s\n", peakGFlops, peakGBps);
+
+  // Shapes of the layers of resnet50, vgg19, zfnet512 and of the embeddings
+  // and classifiers of the translation and language models.
+  std::vector<std::pair<const char *, KernelBench *>> benches = {
+      {"convolution_f", new ConvBench(ConvKind::Generic, 224, 3, 64, 7, 2, 3)},
+      {"convolution_f", new ConvBench(ConvKind::Generic, 56, 64, 64, 3, 1, 1)},
+      {"convolution_f", new ConvBench(ConvKind::Generic, 56, 64, 256, 1, 1, 0)},
+      {"convolution_f",
+       new ConvBench(ConvKind::Generic, 28, 128, 128, 3, 1, 1)},
+      {"convolution_f",
+       new ConvBench(ConvKind::Generic, 14, 256, 256, 3, 1, 1)},
+      {"convolution_f", new ConvBench(ConvKind::Generic, 7, 512, 512, 3, 1, 1)},
+      {"convDKKC8_f", new ConvBench(ConvKind::DKKC8, 224, 3, 96, 7, 2, 3)},
+      {"convDKKC8_f", new ConvBench(ConvKind::DKKC8, 56, 64, 64, 3, 1, 1)},
+      {"convDKKC8_f", new ConvBench(ConvKind::DKKC8, 56, 256, 256, 3, 1, 1)},
+      {"convDKKC8_f", new ConvBench(ConvKind::DKKC8, 28, 128, 128, 3, 1, 1)},
+      {"convDKKC8_f", new ConvBench(ConvKind::DKKC8, 14, 256, 256, 3, 1, 1)},
+      {"convolution_i8", new ConvBench(ConvKind::Int8, 56, 64, 64, 3, 1, 1)},
+      {"convolution_i8", new ConvBench(ConvKind::Int8, 28, 128, 128, 3, 1, 1)},
+      {"convolution_i8", new ConvBench(ConvKind::Int8, 14, 256, 256, 3, 1, 1)},
+      {"max_pool_f", new PoolBench(true, 112, 64, 3, 2, 1)},
+      {"max_pool_f", new PoolBench(true, 224, 64, 2, 2, 0)},
+      {"avg_pool_f", new PoolBench(false, 7, 2048, 7, 1, 0)},
+      {"transpose_f", new TransposeBench({1, 3, 224, 224}, {0, 2, 3, 1})},
+      {"transpose_f", new TransposeBench({1, 64, 56, 56}, {0, 2, 3, 1})},
+      {"transpose_f", new TransposeBench({1, 7, 7, 2048}, {0, 3, 1, 2})},
+      {"gather_f", new GatherBench(20000, 512, 128)},
+      {"gather_f", new GatherBench(1000, 256, 4096)},
+      {"batchedreduceadd_f", new ReduceAddBench(64, 1000, 0)},
+      {"batchedreduceadd_f", new ReduceAddBench(2048, 49, 1)},
+      {"softmax_f", new SoftmaxBench(1, 1000)},
+      {"softmax_f", new SoftmaxBench(64, 1000)},
+      {"softmax_f", new SoftmaxBench(16, 30000)},
+  };
+
+  // The efficiency is the fraction of the roofline bound of the kernel, the
+  // lower of the compute roof and of the bandwidth times the arithmetic
+  // intensity. The kernels without arithmetic are bound by the bandwidth.
+  printf("kernel, shape, time(us), gflops/s, gb/s, flops/byte, efficiency\n");
+  for (auto &KB : benches) {
+    KernelBench *b = KB.second;
+    double time = bench(b, reps);
+    double gflops = b->flops() / time / 1e9;
+    double gbps = b->bytes() / time / 1e9;
+    double intensity = b->flops() / b->bytes();
+    double efficiency = gbps / peakGBps;
+    if (b->flops() > 0) {
+      efficiency = gflops / std::min(peakGFlops, intensity * peakGBps);
+    }
+    printf("%-18s, %-28s, %10.2lf, %8.2lf, %7.2lf, %7.2lf, %5.3lf\n", KB.first,
+           b->shape().c_str(), time * 1e6, gflops, gbps, intensity,
+           efficiency);
+    delete b;
+  }
+  return 0;
+}
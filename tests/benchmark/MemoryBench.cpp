@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Bench.h"
+#include "ModelZoo.h"
+
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Support/Compiler.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory memoryBenchCat("Memory Benchmark Options");
+
+llvm::cl::opt<std::string> modelsDir(
+    "models-dir",
+    llvm::cl::desc("Directory holding the models downloaded by "
+                   "utils/download_caffe2_models.sh or "
+                   "utils/download_onnx_models.sh"),
+    llvm::cl::init("."), llvm::cl::cat(memoryBenchCat));
+
+llvm::cl::list<std::string> modelsOpt(
+    "models",
+    llvm::cl::desc("Models to benchmark (default: all of them that are "
+                   "available)"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(memoryBenchCat));
+
+llvm::cl::list<BackendKind> backendsOpt(
+    "backends", llvm::cl::desc("Backends to benchmark (default: all of them)"),
+    llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
+                                "Use interpreter"),
+                     clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
+                     clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(memoryBenchCat));
+
+llvm::cl::opt<std::string>
+    jsonFileOpt("json",
+                llvm::cl::desc("Write the results to this file as JSON"),
+                llvm::cl::value_desc("file.json"),
+                llvm::cl::cat(memoryBenchCat));
+
+llvm::cl::opt<std::string> baselineFileOpt(
+    "baseline",
+    llvm::cl::desc("Compare the results with the ones that -json wrote to "
+                   "this file, and fail if any of them grew too much"),
+    llvm::cl::value_desc("file.json"), llvm::cl::cat(memoryBenchCat));
+
+llvm::cl::opt<double> maxGrowthOpt(
+    "max-growth",
+    llvm::cl::desc("The growth over the -baseline, in percent, above which "
+                   "a measurement is a regression"),
+    llvm::cl::init(5), llvm::cl::cat(memoryBenchCat));
+} // namespace
+
+/// One measurement of a model on a backend, in bytes.
+struct BenchResult {
+  std::string model;
+  std::string backend;
+  std::string metric;
+  uint64_t bytes;
+};
+
+namespace llvm {
+namespace yaml {
+/// The -baseline is read back as YAML, which JSON is a subset of.
+template <> struct MappingTraits<BenchResult> {
+  static void mapping(IO &io, BenchResult &R) {
+    io.mapRequired("model", R.model);
+    io.mapRequired("backend", R.backend);
+    io.mapRequired("metric", R.metric);
+    io.mapRequired("bytes", R.bytes);
+  }
+};
+} // namespace yaml
+} // namespace llvm
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(BenchResult);
+
+/// Reset the peak resident set size of the process to its current size, so
+/// that the next getPeakRSS() only covers what happens in between. Only Linux
+/// can do it; elsewhere the peak of the whole process is measured.
+static void resetPeakRSS() {
+#ifdef __linux__
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5";
+#endif
+}
+
+/// \returns the peak resident set size of the process, in bytes, since the
+/// last resetPeakRSS().
+static uint64_t getPeakRSS() {
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    unsigned long long kb;
+    if (sscanf(line.c_str(), "VmHWM: %llu kB", &kb) == 1) {
+      return kb * 1024;
+    }
+  }
+#endif
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/// Import and compile \p model with \p backend, and append the peak resident
+/// set sizes of both steps and the memory used by the compiled function to
+/// \p results.
+static void benchModel(const ZooModel &model, BackendKind backend,
+                       std::vector<BenchResult> &results) {
+  ExecutionEngine EE(backend);
+  Function *F = EE.getModule().createFunction(model.name);
+  resetPeakRSS();
+  importModel(model, modelsDir, F);
+  uint64_t importRSS = getPeakRSS();
+  resetPeakRSS();
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  uint64_t compileRSS = getPeakRSS();
+
+  // The activations are the heap of AllocationsInfo::activationsMemSize_ on
+  // the CPU backend, and the code is the size of the objects in the JIT.
+  auto usage = EE.getMemoryUsage();
+  const char *backendName = getBackendName(backend);
+  std::pair<const char *, uint64_t> metrics[] = {
+      {"import peak rss", importRSS},
+      {"compile peak rss", compileRSS},
+      {"activations", usage.activations},
+      {"weights", usage.constantWeights + usage.mutableWeights},
+      {"code", usage.code},
+      {"scratch", usage.scratch},
+  };
+  for (const auto &metric : metrics) {
+    results.push_back({model.name, backendName, metric.first, metric.second});
+  }
+}
+
+/// Compare \p results with the ones of the -baseline, print the ones that
+/// grew by more than -max-growth, and \returns the number of them. The
+/// measurements that are not in the baseline are not compared.
+static unsigned checkBaseline(const std::vector<BenchResult> &results) {
+  auto text = llvm::MemoryBuffer::getFile(baselineFileOpt);
+  GLOW_ASSERT(text && "Can't read the baseline.");
+  std::vector<BenchResult> baseline;
+  llvm::yaml::Input yin(text.get()->getBuffer());
+  yin >> baseline;
+  GLOW_ASSERT(!yin.error() && "Invalid baseline.");
+
+  unsigned regressions = 0;
+  for (const auto &R : results) {
+    for (const auto &B : baseline) {
+      if (B.model != R.model || B.backend != R.backend ||
+          B.metric != R.metric) {
+        continue;
+      }
+      double limit = B.bytes * (1 + maxGrowthOpt / 100);
+      if (R.bytes > limit) {
+        llvm::errs() << llvm::format(
+            "Regression: %s, %s, %s grew from %llu to %llu bytes (%+.1f%%)\n",
+            R.model.c_str(), R.backend.c_str(), R.metric.c_str(),
+            (unsigned long long)B.bytes, (unsigned long long)R.bytes,
+            B.bytes ? (double(R.bytes) / B.bytes - 1) * 100 : 100.0);
+        regressions++;
+      }
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the memory of the compilation of the models of the zoo\n\n"
+      "Prints the peak resident set size of the import and of the "
+      "compilation, and the activations, weights and code of the compiled "
+      "function, for every model and backend. With -baseline, fails if any "
+      "of them grew by more than -max-growth percent.\n");
+
+  std::vector<BackendKind> backends(backendsOpt.begin(), backendsOpt.end());
+  if (backends.empty()) {
+    backends.push_back(BackendKind::Interpreter);
+#ifdef GLOW_WITH_CPU
+    backends.push_back(BackendKind::CPU);
+#endif
+#ifdef GLOW_WITH_OPENCL
+    backends.push_back(BackendKind::OpenCL);
+#endif
+  }
+
+  std::vector<BenchResult> results;
+  printf("model, backend, metric, size(KB)\n");
+  for (const auto &model : zooModels) {
+    if (!modelsOpt.empty() &&
+        std::find(modelsOpt.begin(), modelsOpt.end(), model.name) ==
+            modelsOpt.end()) {
+      continue;
+    }
+    if (!isModelAvailable(model, modelsDir)) {
+      llvm::errs() << "Skipping " << model.name << ": it is not in "
+                   << modelsDir << "\n";
+      continue;
+    }
+    for (auto backend : backends) {
+      size_t first = results.size();
+      benchModel(model, backend, results);
+      for (size_t i = first, e = results.size(); i < e; i++) {
+        const auto &R = results[i];
+        printf("%s, %s, %s, %.1lf\n", R.model.c_str(), R.backend.c_str(),
+               R.metric.c_str(), R.bytes / 1024.0);
+      }
+    }
+  }
+
+  if (!jsonFileOpt.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(jsonFileOpt, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Can't write " << jsonFileOpt << ": " << EC.message()
+                   << "\n";
+      return 1;
+    }
+    writeJSON(os, results, [](llvm::raw_ostream &out, const BenchResult &R) {
+      out << "\"model\": \"" << R.model << "\", \"backend\": \"" << R.backend
+          << "\", \"metric\": \"" << R.metric << "\", \"bytes\": " << R.bytes;
+    });
+  }
+
+  if (!baselineFileOpt.empty() && checkBaseline(results)) {
+    return 1;
+  }
+  return 0;
+}
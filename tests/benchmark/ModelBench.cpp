@@ -0,0 +1,289 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Bench.h"
+#include "ModelZoo.h"
+
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Support/Compiler.h"
+#include "glow/Support/Random.h"
+
+#ifdef GLOW_WITH_CPU
+#include "CPUBackend.h"
+#endif
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory modelBenchCat("Model Benchmark Options");
+
+llvm::cl::opt<std::string> modelsDir(
+    "models-dir",
+    llvm::cl::desc("Directory holding the models downloaded by "
+                   "utils/download_caffe2_models.sh or "
+                   "utils/download_onnx_models.sh"),
+    llvm::cl::init("."), llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<std::string> modelsOpt(
+    "models",
+    llvm::cl::desc("Models to benchmark: resnet50, vgg19, zfnet512 and lstm "
+                   "(default: all of them)"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<BackendKind> backendsOpt(
+    "backends", llvm::cl::desc("Backends to benchmark (default: all of them)"),
+    llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
+                                "Use interpreter"),
+                     clEnumValN(BackendKind::CPU, "cpu", "Use CPU"),
+                     clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<unsigned>
+    batchSizesOpt("batch-sizes",
+                  llvm::cl::desc("Batch sizes to benchmark (default: 1,8)"),
+                  llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+                  llvm::cl::cat(modelBenchCat));
+
+llvm::cl::list<unsigned> threadsOpt(
+    "threads",
+    llvm::cl::desc("Numbers of threads of the CPU backend to benchmark "
+                   "(default: 1,4). The other backends run with 1"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<unsigned>
+    iterationsOpt("iterations",
+                  llvm::cl::desc("Number of measured runs of each setting"),
+                  llvm::cl::init(20), llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<unsigned>
+    warmupOpt("warmup",
+              llvm::cl::desc("Number of runs before the measured ones"),
+              llvm::cl::init(2), llvm::cl::cat(modelBenchCat));
+
+llvm::cl::opt<std::string>
+    jsonFileOpt("json",
+                llvm::cl::desc("Write the results to this file as JSON"),
+                llvm::cl::value_desc("file.json"),
+                llvm::cl::cat(modelBenchCat));
+} // namespace
+
+/// The recurrent network: a single layer LSTM over a sequence.
+constexpr unsigned lstmSteps = 20;
+constexpr unsigned lstmInputSize = 128;
+constexpr unsigned lstmHiddenSize = 256;
+constexpr unsigned lstmOutputSize = 128;
+
+/// Benchmark the inference of a model with a given backend, batch size and
+/// number of threads.
+class ModelBench : public Benchmark {
+  const ZooModel &model_;
+  BackendKind backend_;
+  unsigned batchSize_;
+  unsigned numThreads_;
+  std::unique_ptr<ExecutionEngine> EE_;
+
+public:
+  ModelBench(const ZooModel &model, BackendKind backend, unsigned batchSize,
+             unsigned numThreads)
+      : model_(model), backend_(backend), batchSize_(batchSize),
+        numThreads_(numThreads) {}
+
+  virtual void setup() override {
+    EE_ = llvm::make_unique<ExecutionEngine>(backend_);
+#ifdef GLOW_WITH_CPU
+    if (backend_ == BackendKind::CPU) {
+      auto *backend = new CPUBackend();
+      backend->setNumThreads(numThreads_);
+      EE_->setBackend(backend);
+    }
+#endif
+    Function *F = EE_->getModule().createFunction(model_.name);
+    if (model_.caffe2Input) {
+      loadImageClassifier(F);
+    } else {
+      buildLSTM(F);
+    }
+    Context ctx;
+    EE_->compile(CompilationMode::Infer, F, ctx);
+  }
+
+  virtual void run() override { EE_->run(); }
+
+  virtual void teardown() override { EE_.reset(); }
+
+private:
+  /// Load the image classifier into \p F, with random images as input.
+  void loadImageClassifier(Function *F) {
+    PseudoRNG PRNG;
+    Tensor data(ElemKind::FloatTy, {batchSize_, 3, 224, 224});
+    data.getHandle().randomize(0, 1, PRNG);
+    std::string dir = modelsDir + "/" + model_.name;
+    if (llvm::sys::fs::exists(dir + "/predict_net.pb")) {
+      caffe2ModelLoader(dir + "/predict_net.pb", dir + "/init_net.pb",
+                        {model_.caffe2Input}, {&data}, *F);
+    } else {
+      ONNXModelLoader(dir + "/model.onnx", {model_.onnxInput}, {&data}, *F);
+    }
+  }
+
+  /// Build the recurrent network into \p F, with a random sequence as input.
+  void buildLSTM(Function *F) {
+    PseudoRNG PRNG;
+    auto &mod = EE_->getModule();
+    auto *X = mod.createVariable(ElemKind::FloatTy,
+                                 {batchSize_, lstmSteps, lstmInputSize}, "X",
+                                 VisibilityKind::Public, false);
+    X->getPayload().getHandle().randomize(-1, 1, PRNG);
+    std::vector<Node *> inputs;
+    for (unsigned t = 0; t < lstmSteps; t++) {
+      auto *slice = F->createSlice("X", X, {0, t, 0},
+                                   {batchSize_, t + 1, lstmInputSize});
+      inputs.push_back(
+          F->createReshape("X", slice, {batchSize_, lstmInputSize}));
+    }
+    std::vector<NodeValue> outputs;
+    F->createLSTM("lstm", inputs, batchSize_, lstmHiddenSize, lstmOutputSize,
+                  outputs);
+    for (auto &O : outputs) {
+      F->createSave("save", O);
+    }
+  }
+};
+
+/// The measurements of one setting.
+struct BenchResult {
+  const char *model;
+  const char *backend;
+  unsigned batchSize;
+  unsigned numThreads;
+  /// Inferences per second.
+  double throughput;
+  /// Latencies of a batch in seconds.
+  double p50;
+  double p90;
+  double p99;
+};
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the inference of the models of the zoo\n\n"
+      "Prints the throughput and the latency percentiles of every model, "
+      "backend, batch size and number of threads.\n");
+
+  std::vector<BackendKind> backends(backendsOpt.begin(), backendsOpt.end());
+  if (backends.empty()) {
+    backends.push_back(BackendKind::Interpreter);
+#ifdef GLOW_WITH_CPU
+    backends.push_back(BackendKind::CPU);
+#endif
+#ifdef GLOW_WITH_OPENCL
+    backends.push_back(BackendKind::OpenCL);
+#endif
+  }
+  std::vector<unsigned> batchSizes(batchSizesOpt.begin(), batchSizesOpt.end());
+  if (batchSizes.empty()) {
+    batchSizes = {1, 8};
+  }
+  std::vector<unsigned> threads(threadsOpt.begin(), threadsOpt.end());
+  if (threads.empty()) {
+    threads = {1, 4};
+  }
+
+  // The image classifiers are loaded from the Caffe2 or the ONNX files of the
+  // zoo, the recurrent network is built in memory.
+  std::vector<ZooModel> models(std::begin(zooModels), std::end(zooModels));
+  models.push_back({"lstm", nullptr, nullptr});
+
+  std::vector<BenchResult> results;
+  printf("model, backend, batch, threads, inferences/s, p50(ms), p90(ms), "
+         "p99(ms)\n");
+  for (const auto &model : models) {
+    if (!modelsOpt.empty() &&
+        std::find(modelsOpt.begin(), modelsOpt.end(), model.name) ==
+            modelsOpt.end()) {
+      continue;
+    }
+    if (model.caffe2Input && !isModelAvailable(model, modelsDir)) {
+      llvm::errs() << "Skipping " << model.name << ": it is not in "
+                   << modelsDir << "\n";
+      continue;
+    }
+    for (auto backend : backends) {
+      for (unsigned batchSize : batchSizes) {
+        // Only the CPU backend has a number of threads.
+        std::vector<unsigned> backendThreads{1};
+        if (backend == BackendKind::CPU) {
+          backendThreads = threads;
+        }
+        for (unsigned numThreads : backendThreads) {
+          ModelBench b(model, backend, batchSize, numThreads);
+          auto times = benchLatencies(&b, iterationsOpt, warmupOpt);
+          double total = 0;
+          for (double t : times) {
+            total += t;
+          }
+          BenchResult R{model.name,
+                        getBackendName(backend),
+                        batchSize,
+                        numThreads,
+                        total > 0 ? batchSize * times.size() / total : 0,
+                        percentile(times, 50),
+                        percentile(times, 90),
+                        percentile(times, 99)};
+          printf("%s, %s, %u, %u, %.2lf, %.3lf, %.3lf, %.3lf\n", R.model,
+                 R.backend, R.batchSize, R.numThreads, R.throughput,
+                 R.p50 * 1e3, R.p90 * 1e3, R.p99 * 1e3);
+          results.push_back(R);
+        }
+      }
+    }
+  }
+
+  if (!jsonFileOpt.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(jsonFileOpt, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Can't write " << jsonFileOpt << ": " << EC.message()
+                   << "\n";
+      return 1;
+    }
+    writeJSON(os, results, [](llvm::raw_ostream &out, const BenchResult &R) {
+      out << "\"model\": \"" << R.model << "\", \"backend\": \"" << R.backend
+          << "\", \"batch_size\": " << R.batchSize
+          << ", \"threads\": " << R.numThreads
+          << llvm::format(", \"throughput\": %.3f", R.throughput)
+          << llvm::format(", \"p50_ms\": %.4f", R.p50 * 1e3)
+          << llvm::format(", \"p90_ms\": %.4f", R.p90 * 1e3)
+          << llvm::format(", \"p99_ms\": %.4f", R.p99 * 1e3);
+    });
+  }
+  return 0;
+}
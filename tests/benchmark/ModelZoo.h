@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_TESTS_BENCHMARK_MODELZOO_H
+#define GLOW_TESTS_BENCHMARK_MODELZOO_H
+
+#include "glow/Backends/Backend.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Importer/Caffe2.h"
+#include "glow/Importer/ONNX.h"
+#include "glow/Support/Compiler.h"
+
+#include "llvm/Support/FileSystem.h"
+
+#include <string>
+
+namespace glow {
+
+/// A model of the zoo: its name, which is also its directory, and the names
+/// of the input of its Caffe2 and ONNX files.
+struct ZooModel {
+  const char *name;
+  const char *caffe2Input;
+  const char *onnxInput;
+};
+
+/// The image classifiers of the zoo, which utils/download_caffe2_models.sh
+/// and utils/download_onnx_models.sh download.
+static const ZooModel zooModels[] = {
+    {"resnet50", "gpu_0/data", "gpu_0/data_0"},
+    {"vgg19", "data", "data_0"},
+    {"zfnet512", "gpu_0/data", "gpu_0/data_0"},
+};
+
+/// \returns true if the Caffe2 or the ONNX files of \p model are in
+/// \p modelsDir.
+inline bool isModelAvailable(const ZooModel &model,
+                             const std::string &modelsDir) {
+  std::string dir = modelsDir + "/" + model.name;
+  return llvm::sys::fs::exists(dir + "/predict_net.pb") ||
+         llvm::sys::fs::exists(dir + "/model.onnx");
+}
+
+/// Load \p model from its directory in \p modelsDir into \p F, with a single
+/// image as input. The Caffe2 files are preferred over the ONNX one.
+inline void importModel(const ZooModel &model, const std::string &modelsDir,
+                        Function *F) {
+  Tensor data(ElemKind::FloatTy, {1, 3, 224, 224});
+  std::string dir = modelsDir + "/" + model.name;
+  if (llvm::sys::fs::exists(dir + "/predict_net.pb")) {
+    caffe2ModelLoader(dir + "/predict_net.pb", dir + "/init_net.pb",
+                      {model.caffe2Input}, {&data}, *F);
+  } else {
+    ONNXModelLoader(dir + "/model.onnx", {model.onnxInput}, {&data}, *F);
+  }
+}
+
+/// \returns the name of \p kind in the options and in the results of the
+/// benchmarks.
+inline const char *getBackendName(BackendKind kind) {
+  switch (kind) {
+  case BackendKind::Interpreter:
+    return "interpreter";
+  case BackendKind::CPU:
+    return "cpu";
+  case BackendKind::OpenCL:
+    return "opencl";
+  }
+  GLOW_UNREACHABLE("Unknown backend.");
+}
+
+} // namespace glow
+
+#endif // GLOW_TESTS_BENCHMARK_MODELZOO_H
@@ -0,0 +1,393 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Base.h"
+#include "Bench.h"
+
+#include "glow/Importer/ONNX.h"
+#include "glow/Support/Compiler.h"
+#include "glow/Support/Memory.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "onnx/onnx.pb.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory onnxifiBenchCat("ONNXIFI Benchmark Options");
+
+llvm::cl::opt<std::string> modelsDir(
+    "models-dir",
+    llvm::cl::desc("Directory holding the models downloaded by "
+                   "utils/download_onnx_models.sh"),
+    llvm::cl::init("."), llvm::cl::cat(onnxifiBenchCat));
+
+llvm::cl::opt<std::string> testModelsDir(
+    "test-models-dir",
+    llvm::cl::desc("Directory holding the models of tests/models"),
+    llvm::cl::init("tests/models"), llvm::cl::cat(onnxifiBenchCat));
+
+llvm::cl::list<std::string> modelsOpt(
+    "models",
+    llvm::cl::desc("Models to benchmark (default: all of them that are "
+                   "available)"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated,
+    llvm::cl::cat(onnxifiBenchCat));
+
+llvm::cl::opt<unsigned> runsOpt("runs",
+                                llvm::cl::desc("Number of measured runs of "
+                                               "each model"),
+                                llvm::cl::init(1000),
+                                llvm::cl::cat(onnxifiBenchCat));
+
+llvm::cl::opt<unsigned>
+    warmupOpt("warmup",
+              llvm::cl::desc("Number of runs of each model before the "
+                             "measured ones"),
+              llvm::cl::init(10), llvm::cl::cat(onnxifiBenchCat));
+
+llvm::cl::opt<bool> unalignedOpt(
+    "unaligned-io",
+    llvm::cl::desc("Pass buffers that are not aligned like the tensor "
+                   "payloads, so that the inputs and outputs are copied"),
+    llvm::cl::init(false), llvm::cl::cat(onnxifiBenchCat));
+
+llvm::cl::opt<std::string>
+    jsonFileOpt("json",
+                llvm::cl::desc("Write the results to this file as JSON"),
+                llvm::cl::value_desc("file.json"),
+                llvm::cl::cat(onnxifiBenchCat));
+} // namespace
+
+/// A model driven through ONNXIFI: its name and its file, relative to the
+/// -test-models-dir or to the -models-dir.
+struct ModelInfo {
+  const char *name;
+  const char *file;
+  bool inZoo;
+};
+
+static const ModelInfo benchModels[] = {
+    {"onnx_conv", "onnxModels/simpleConv.onnxtxt", false},
+    {"resnet50", "resnet50/model.onnx", true},
+    {"vgg19", "vgg19/model.onnx", true},
+};
+
+/// A buffer of the caller with its descriptor, like the ones Caffe2 passes for
+/// the weights, the inputs and the outputs.
+struct IOBuffer {
+  std::string name;
+  std::vector<uint64_t> shape;
+  uint64_t dataType;
+  size_t size;
+  /// The allocation, which the buffer starts in, or right after if it is
+  /// unaligned.
+  char *memory{nullptr};
+  char *data{nullptr};
+
+  IOBuffer(const std::string &name, std::vector<uint64_t> shape,
+           uint64_t dataType, size_t elemSize, bool unaligned)
+      : name(name), shape(std::move(shape)), dataType(dataType) {
+    size = elemSize;
+    for (auto d : this->shape) {
+      size *= d;
+    }
+    memory = static_cast<char *>(alignedAlloc(size + 8, TensorAlignment));
+    data = memory + (unaligned ? 4 : 0);
+    memset(data, 0, size);
+  }
+  ~IOBuffer() { alignedFree(memory); }
+  IOBuffer(const IOBuffer &) = delete;
+  IOBuffer &operator=(const IOBuffer &) = delete;
+
+  onnxTensorDescriptorV1 getDescriptor() const {
+    onnxTensorDescriptorV1 desc;
+    desc.tag = ONNXIFI_TAG_TENSOR_DESCRIPTOR_V1;
+    desc.name = name.c_str();
+    desc.dataType = dataType;
+    desc.memoryType = ONNXIFI_MEMORY_TYPE_CPU;
+    desc.dimensions = shape.size();
+    desc.shape = shape.data();
+    desc.buffer = reinterpret_cast<onnxPointer>(data);
+    return desc;
+  }
+};
+
+/// \returns the ONNXIFI data type and the size of an element of the ONNX
+/// element type \p elemType, or a size of 0 if it is not supported.
+static std::pair<uint64_t, size_t> getDataType(int elemType) {
+  switch (elemType) {
+  case ONNX_NAMESPACE::TensorProto::FLOAT:
+    return {ONNXIFI_DATATYPE_FLOAT32, sizeof(float)};
+  case ONNX_NAMESPACE::TensorProto::INT64:
+    return {ONNXIFI_DATATYPE_INT64, sizeof(int64_t)};
+  default:
+    return {0, 0};
+  }
+}
+
+/// Create the buffer of the weight \p T in \p weights, the way Caffe2 passes
+/// the initializers of the network. \returns false if its type is not
+/// supported.
+static bool addWeight(const ONNX_NAMESPACE::TensorProto &T,
+                      std::vector<std::unique_ptr<IOBuffer>> &weights) {
+  auto type = getDataType(T.data_type());
+  if (!type.second) {
+    return false;
+  }
+  std::vector<uint64_t> shape(T.dims().begin(), T.dims().end());
+  weights.emplace_back(
+      new IOBuffer(T.name(), shape, type.first, type.second, false));
+  auto &buffer = *weights.back();
+  if (!T.raw_data().empty()) {
+    memcpy(buffer.data, T.raw_data().data(),
+           std::min(buffer.size, T.raw_data().size()));
+  } else if (type.first == ONNXIFI_DATATYPE_FLOAT32) {
+    memcpy(buffer.data, T.float_data().data(),
+           std::min<size_t>(buffer.size, T.float_data_size() * sizeof(float)));
+  } else {
+    memcpy(buffer.data, T.int64_data().data(),
+           std::min<size_t>(buffer.size,
+                            T.int64_data_size() * sizeof(int64_t)));
+  }
+  return true;
+}
+
+/// Create the buffer of the input or output \p V in \p buffers. The
+/// dimensions that are not known, e.g. the batch size, are 1. \returns false
+/// if its type is not supported.
+static bool addIO(const ONNX_NAMESPACE::ValueInfoProto &V,
+                  std::vector<std::unique_ptr<IOBuffer>> &buffers) {
+  const auto &tensorType = V.type().tensor_type();
+  auto type = getDataType(tensorType.elem_type());
+  if (!type.second || !tensorType.has_shape()) {
+    return false;
+  }
+  std::vector<uint64_t> shape;
+  for (const auto &dim : tensorType.shape().dim()) {
+    shape.push_back(dim.dim_value() > 0 ? dim.dim_value() : 1);
+  }
+  buffers.emplace_back(
+      new IOBuffer(V.name(), shape, type.first, type.second, unalignedOpt));
+  return true;
+}
+
+/// The mean time of a step of the runs of a model, in seconds.
+struct BenchResult {
+  const char *model;
+  std::string step;
+  double seconds;
+};
+
+/// \returns the seconds elapsed since \p begin.
+static double secondsSince(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       begin)
+      .count();
+}
+
+/// Drive \p model through ONNXIFI the way the Caffe2 operator does, and
+/// append the times of the steps of a run to \p results. \returns false if
+/// the model cannot be run.
+static bool benchModel(const ModelInfo &model, const std::string &path,
+                       onnxBackend backend, std::vector<BenchResult> &results) {
+  // Caffe2 passes the initializers as weights, and the network without them.
+  ONNX_NAMESPACE::ModelProto proto;
+  if (!ONNXModelLoader::loadProto(proto, path)) {
+    llvm::errs() << "Can't load " << path << "\n";
+    return false;
+  }
+  auto &graph = *proto.mutable_graph();
+  std::vector<std::unique_ptr<IOBuffer>> weights, inputs, outputs;
+  std::unordered_set<std::string> weightNames;
+  for (const auto &T : graph.initializer()) {
+    weightNames.insert(T.name());
+    if (!addWeight(T, weights)) {
+      llvm::errs() << "Unsupported type of the weight " << T.name() << "\n";
+      return false;
+    }
+  }
+  graph.clear_initializer();
+  for (const auto &V : graph.input()) {
+    if (!weightNames.count(V.name()) && !addIO(V, inputs)) {
+      llvm::errs() << "Unsupported type of the input " << V.name() << "\n";
+      return false;
+    }
+  }
+  for (const auto &V : graph.output()) {
+    if (!addIO(V, outputs)) {
+      llvm::errs() << "Unsupported type of the output " << V.name() << "\n";
+      return false;
+    }
+  }
+  std::string bytes;
+  proto.SerializeToString(&bytes);
+
+  std::vector<onnxTensorDescriptorV1> weightDescs, inputDescs, outputDescs;
+  for (const auto &B : weights) {
+    weightDescs.push_back(B->getDescriptor());
+  }
+  for (const auto &B : inputs) {
+    inputDescs.push_back(B->getDescriptor());
+  }
+  for (const auto &B : outputs) {
+    outputDescs.push_back(B->getDescriptor());
+  }
+  onnxGraph graphHandle;
+  if (onnxInitGraph(backend, nullptr, bytes.size(), bytes.data(),
+                    weightDescs.size(), weightDescs.data(),
+                    &graphHandle) != ONNXIFI_STATUS_SUCCESS) {
+    llvm::errs() << "Can't initialize the graph of " << model.name << "\n";
+    return false;
+  }
+  auto *glowGraph = static_cast<onnxifi::GraphPtr>(graphHandle);
+
+  // The measured steps of a run on the side of the caller.
+  double setIOSeconds = 0, submitSeconds = 0, waitSeconds = 0;
+  std::vector<double> totals;
+  unsigned numRuns = std::max(1u, unsigned(runsOpt));
+  for (unsigned i = 0, e = warmupOpt + numRuns; i < e; i++) {
+    if (i == warmupOpt) {
+      glowGraph->resetRunProfile();
+    }
+    bool measured = i >= warmupOpt;
+    auto begin = std::chrono::steady_clock::now();
+    // Caffe2 binds the buffers of its blobs before every run.
+    auto status =
+        onnxSetGraphIO(graphHandle, inputDescs.size(), inputDescs.data(),
+                       outputDescs.size(), outputDescs.data());
+    GLOW_ASSERT(status == ONNXIFI_STATUS_SUCCESS && "Can't set the IO.");
+    auto setIOEnd = std::chrono::steady_clock::now();
+
+    onnxMemoryFenceV1 inputFence, outputFence;
+    inputFence.tag = outputFence.tag = ONNXIFI_TAG_MEMORY_FENCE_V1;
+    inputFence.type = outputFence.type = ONNXIFI_SYNCHRONIZATION_EVENT;
+    status = onnxInitEvent(backend, &inputFence.event);
+    GLOW_ASSERT(status == ONNXIFI_STATUS_SUCCESS && "Can't create a fence.");
+    status = onnxRunGraph(graphHandle, &inputFence, &outputFence);
+    GLOW_ASSERT(status == ONNXIFI_STATUS_SUCCESS && "Can't run the graph.");
+    status = onnxSignalEvent(inputFence.event);
+    GLOW_ASSERT(status == ONNXIFI_STATUS_SUCCESS && "Can't signal a fence.");
+    auto submitEnd = std::chrono::steady_clock::now();
+
+    status = onnxWaitEvent(outputFence.event);
+    GLOW_ASSERT(status == ONNXIFI_STATUS_SUCCESS && "Can't wait a fence.");
+    if (measured) {
+      waitSeconds += secondsSince(submitEnd);
+      setIOSeconds += std::chrono::duration<double>(setIOEnd - begin).count();
+      submitSeconds +=
+          std::chrono::duration<double>(submitEnd - setIOEnd).count();
+      totals.push_back(secondsSince(begin));
+    }
+    (void)onnxReleaseEvent(outputFence.event);
+    (void)onnxReleaseEvent(inputFence.event);
+  }
+  auto profile = glowGraph->getRunProfile();
+  (void)onnxReleaseGraph(graphHandle);
+
+  // The steps measured by the graph happen while the caller waits, so they
+  // break the wait down.
+  std::pair<const char *, double> steps[] = {
+      {"set io", setIOSeconds},
+      {"submit", submitSeconds},
+      {"input fence", profile.inputFenceSeconds},
+      {"input copy", profile.inputCopySeconds},
+      {"execution", profile.executionSeconds},
+      {"output copy", profile.outputCopySeconds},
+      {"output fence", profile.outputFenceSeconds},
+      {"wait", waitSeconds},
+  };
+  for (const auto &step : steps) {
+    results.push_back({model.name, step.first, step.second / numRuns});
+  }
+  results.push_back({model.name, "total p50", percentile(totals, 50)});
+  results.push_back({model.name, "total p99", percentile(totals, 99)});
+  return true;
+}
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv,
+      " Benchmark the overhead of the runs of ONNX models through ONNXIFI\n\n"
+      "Drives onnxInitGraph, onnxSetGraphIO and onnxRunGraph the way the "
+      "Caffe2 operator does, and prints the mean time of every step of a "
+      "run: the binding of the buffers, the submission, the input fence, the "
+      "copies of the inputs, the execution, the copies of the outputs, the "
+      "output fence and the wait of the caller.\n");
+
+  onnxBackendID backendID;
+  size_t numBackends = 1;
+  onnxBackend backend;
+  if (onnxGetBackendIDs(&backendID, &numBackends) != ONNXIFI_STATUS_SUCCESS ||
+      onnxInitBackend(backendID, nullptr, &backend) != ONNXIFI_STATUS_SUCCESS) {
+    llvm::errs() << "Can't initialize the ONNXIFI backend\n";
+    return 1;
+  }
+
+  std::vector<BenchResult> results;
+  printf("model, step, time(us)\n");
+  for (const auto &model : benchModels) {
+    if (!modelsOpt.empty() &&
+        std::find(modelsOpt.begin(), modelsOpt.end(), model.name) ==
+            modelsOpt.end()) {
+      continue;
+    }
+    const std::string &dir = model.inZoo ? modelsDir : testModelsDir;
+    std::string path = dir + "/" + model.file;
+    if (!llvm::sys::fs::exists(path)) {
+      llvm::errs() << "Skipping " << model.name << ": it is not in " << dir
+                   << "\n";
+      continue;
+    }
+    size_t first = results.size();
+    if (!benchModel(model, path, backend, results)) {
+      continue;
+    }
+    for (size_t i = first, e = results.size(); i < e; i++) {
+      const auto &R = results[i];
+      printf("%s, %s, %.3lf\n", R.model, R.step.c_str(), R.seconds * 1e6);
+    }
+  }
+  (void)onnxReleaseBackend(backend);
+  (void)onnxReleaseBackendID(backendID);
+
+  if (!jsonFileOpt.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(jsonFileOpt, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Can't write " << jsonFileOpt << ": " << EC.message()
+                   << "\n";
+      return 1;
+    }
+    writeJSON(os, results, [](llvm::raw_ostream &out, const BenchResult &R) {
+      out << "\"model\": \"" << R.model << "\", \"step\": \"" << R.step << "\""
+          << llvm::format(", \"us\": %.3f", R.seconds * 1e6);
+    });
+  }
+  return 0;
+}
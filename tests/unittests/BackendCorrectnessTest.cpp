@@ -200,6 +200,13 @@ TEST_P(CPUOnly, localResponseNormalizationTest) {
   inferLocalResponseNormalizationNet(&inputs, &out2, BackendKind::Interpreter);
 
   EXPECT_TRUE(out1.isEqual(out2));
+
+  // The exponent 0.75 of AlexNet is computed with square roots instead of
+  // pow.
+  inferLocalResponseNormalizationNet(&inputs, &out1, backendKind_, 0.75);
+  inferLocalResponseNormalizationNet(&inputs, &out2, BackendKind::Interpreter,
+                                     0.75);
+  EXPECT_TRUE(out1.isEqual(out2));
 }
 
 TEST_P(CPUOnly, localResponseNormalizationGradTest) {
@@ -336,6 +343,25 @@ TEST_P(BackendCorrectnessTest, matMulTest) {
   EXPECT_TRUE(out1.isEqual(out2, 0.001));
 }
 
+/// Multiply matrices that span several blocks of the register blocked kernels,
+/// with partial blocks at the edges.
+TEST_P(BackendCorrectnessTest, largeMatMulTest) {
+  PseudoRNG PRNG;
+  Tensor lhs(ElemKind::FloatTy, {70, 37});
+  Tensor rhs(ElemKind::FloatTy, {37, 45});
+  lhs.getHandle().randomize(-1.0, 1.0, PRNG);
+  rhs.getHandle().randomize(-1.0, 1.0, PRNG);
+  std::array<size_t, 2> S{{70, 45}};
+  llvm::ArrayRef<size_t> shape(S);
+  Tensor out1(ElemKind::FloatTy, shape);
+  Tensor out2(ElemKind::FloatTy, shape);
+
+  inferMatMulNet(&lhs, &rhs, &out1, backendKind_);
+  inferMatMulNet(&lhs, &rhs, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 0.001));
+}
+
 TEST_P(CPUOnly, quantizedMatMulTest) {
   PseudoRNG PRNG;
   Tensor lhs(ElemKind::Int8QTy, {10, 9}, 2.7, 31);
@@ -441,6 +467,24 @@ TEST_P(BackendCorrectnessTest, MaxPoolTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+/// Check the pooling kernels on a number of channels that is not a multiple of
+/// the channel block that they process together.
+TEST_P(CPUOnly, poolChannelBlocksTest) {
+  PseudoRNG PRNG;
+  Tensor inputs(ElemKind::FloatTy, {2, 11, 9, 70});
+  inputs.getHandle().initXavier(1, PRNG);
+  Tensor out1;
+  Tensor out2;
+
+  inferMaxPoolNet(&inputs, &out1, backendKind_);
+  inferMaxPoolNet(&inputs, &out2, BackendKind::Interpreter);
+  EXPECT_TRUE(out1.isEqual(out2));
+
+  inferAvgPoolNet(&inputs, &out1, backendKind_);
+  inferAvgPoolNet(&inputs, &out2, BackendKind::Interpreter);
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
 TEST_P(BackendCorrectnessTest, MaxPoolGradTest) {
   PseudoRNG PRNG;
   Tensor inputs(ElemKind::FloatTy, {4, 8, 7, 2});
@@ -691,6 +735,32 @@ TEST_P(BackendCorrectnessTest, softmaxGradTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+TEST_P(BackendCorrectnessTest, optimizersTest) {
+  PseudoRNG PRNG;
+  Tensor inputs(ElemKind::FloatTy, {8, 23});
+  Tensor weights(ElemKind::FloatTy, {23, 23});
+  Tensor bias(ElemKind::FloatTy, {23});
+  Tensor selected(ElemKind::Int64ITy, {8, 1});
+  inputs.getHandle().initXavier(1, PRNG);
+  weights.getHandle().randomize(0.0, 0.5, PRNG);
+  bias.getHandle().randomize(-0.2, 0.0, PRNG);
+  auto selectedH = selected.getHandle<int64_t>();
+  for (size_t i = 0; i < 8; i++) {
+    selectedH.raw(i) = PRNG.nextRandInt(0, 22);
+  }
+
+  for (auto optimizer : {OptimizerKind::Adagrad, OptimizerKind::RMSProp,
+                         OptimizerKind::Adam}) {
+    Tensor out1;
+    Tensor out2;
+    trainOptimizerNet(&inputs, &weights, &bias, &selected, optimizer, &out1,
+                      backendKind_);
+    trainOptimizerNet(&inputs, &weights, &bias, &selected, optimizer, &out2,
+                      BackendKind::Interpreter);
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
 TEST_P(BackendCorrectnessTest, tanhTest) {
   PseudoRNG PRNG;
   Tensor inputs(ElemKind::FloatTy, {14151});
@@ -808,6 +878,275 @@ TEST_P(CPUOnly, maxSplatTest) {
   EXPECT_TRUE(out1.isEqual(out2));
 }
 
+// Test the pre-packed FullyConnected weights in the CPU backend, for batch-1
+// inference and for batches that are not multiples of the row block.
+TEST_P(CPUOnly, packedFCTest) {
+  PseudoRNG PRNG;
+  for (size_t batch : {1, 7}) {
+    Tensor inputs(ElemKind::FloatTy, {batch, 45});
+    inputs.getHandle().randomize(-1, 1, PRNG);
+    Tensor out1, out2;
+
+    inferPackedFCNet(&inputs, &out1, backendKind_);
+    inferPackedFCNet(&inputs, &out2, BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2, 0.001));
+  }
+}
+
+// Test the sparse FullyConnected weights in the CPU backend, with a fused
+// ReLU and for batches that are not multiples of the row block.
+TEST_P(CPUOnly, sparseFCTest) {
+  PseudoRNG PRNG;
+  for (size_t batch : {1, 7}) {
+    Tensor inputs(ElemKind::FloatTy, {batch, 45});
+    inputs.getHandle().randomize(-1, 1, PRNG);
+    Tensor out1, out2;
+
+    inferSparseFCNet(&inputs, &out1, backendKind_);
+    inferSparseFCNet(&inputs, &out2, BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2, 0.001));
+  }
+}
+
+// Test the Winograd convolution in the CPU backend. The first shape uses
+// F(4x4, 3x3) with ragged tiles at the edges, the second one F(2x2, 3x3).
+TEST_P(CPUOnly, winogradConvTest) {
+  PseudoRNG PRNG;
+  using Dims = llvm::ArrayRef<size_t>;
+  for (auto shape : {std::array<size_t, 5>{{2, 10, 9, 64, 80}},
+                     std::array<size_t, 5>{{1, 5, 6, 64, 64}}}) {
+    Tensor input(ElemKind::FloatTy, Dims(shape).slice(0, 4));
+    Tensor filter(ElemKind::FloatTy, {shape[4], 3, 3, shape[3]});
+    Tensor bias(ElemKind::FloatTy, {shape[4]});
+    input.getHandle().randomize(0, 1.0, PRNG);
+    filter.getHandle().initXavier(1.0, PRNG);
+    bias.getHandle().randomize(0, 1.0, PRNG);
+    Tensor out1, out2;
+
+    inferWinogradConv(&input, &filter, &bias, &out1, backendKind_);
+    inferWinogradConv(&input, &filter, &bias, &out2, BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2, 0.001));
+  }
+}
+
+/// Check the im2col + GEMM convolution against the Interpreter, including a
+/// non-square kernel and a number of output channels that is not a multiple
+/// of the panel width.
+TEST_P(CPUOnly, im2colConvTest) {
+  PseudoRNG PRNG;
+  struct ConvParams {
+    std::array<unsigned_t, 2> kernels;
+    std::array<unsigned_t, 2> strides;
+  };
+  for (auto params : {ConvParams{{{3, 3}}, {{2, 2}}},
+                      ConvParams{{{5, 3}}, {{1, 2}}}}) {
+    Tensor input(ElemKind::FloatTy, {2, 9, 11, 20});
+    Tensor filter(ElemKind::FloatTy,
+                  {24, params.kernels[0], params.kernels[1], 20});
+    Tensor bias(ElemKind::FloatTy, {24});
+    input.getHandle().randomize(0, 1.0, PRNG);
+    filter.getHandle().initXavier(1.0, PRNG);
+    bias.getHandle().randomize(0, 1.0, PRNG);
+    std::array<unsigned_t, 4> pads = {{1, 1, 1, 1}};
+    Tensor out1, out2;
+
+    inferIm2colConv(&input, &filter, &bias, &out1, params.kernels,
+                    params.strides, pads, backendKind_);
+    inferIm2colConv(&input, &filter, &bias, &out2, params.kernels,
+                    params.strides, pads, BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2, 0.001));
+  }
+}
+
+/// Check the quantized im2col convolution, which multiplies with the
+/// pre-packed int8 kernels, against the generic int8 kernel, which is used
+/// when the filter is not constant. The results must be identical, including
+/// at the padded borders and for a number of output channels that is not a
+/// multiple of the panel width.
+TEST_P(CPUOnly, quantizedIm2colConvTest) {
+  PseudoRNG PRNG;
+  struct ConvParams {
+    std::array<unsigned_t, 2> kernels;
+    std::array<unsigned_t, 2> strides;
+  };
+  for (auto params : {ConvParams{{{3, 3}}, {{1, 1}}},
+                      ConvParams{{{5, 3}}, {{2, 1}}},
+                      ConvParams{{{1, 1}}, {{1, 1}}}}) {
+    Tensor input(ElemKind::Int8QTy, {2, 9, 11, 36}, 0.05, 4);
+    Tensor filter(ElemKind::Int8QTy,
+                  {21, params.kernels[0], params.kernels[1], 36}, 0.01, -3);
+    Tensor bias(ElemKind::Int8QTy, {21}, 0.1, 2);
+    input.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    filter.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    bias.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    std::array<unsigned_t, 4> pads = {{1, 1, 1, 1}};
+    auto outSz = calculateConvPoolOutputDims(9, 11, params.kernels,
+                                             params.strides, pads);
+    Tensor out1(ElemKind::Int8QTy, {2, outSz.first, outSz.second, 21}, 1.5,
+                -1);
+    Tensor out2(ElemKind::Int8QTy, {2, outSz.first, outSz.second, 21}, 1.5,
+                -1);
+
+    inferQuantizedConv(&input, &filter, &bias, &out1, params.kernels,
+                       params.strides, pads, true, backendKind_);
+    inferQuantizedConv(&input, &filter, &bias, &out2, params.kernels,
+                       params.strides, pads, false, backendKind_);
+
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
+/// Check the depthwise convolution kernels against the Interpreter, with a
+/// number of channels that is not a multiple of the channel block.
+TEST_P(CPUOnly, depthwiseConvTest) {
+  PseudoRNG PRNG;
+  Tensor input(ElemKind::FloatTy, {2, 9, 8, 70});
+  Tensor filter(ElemKind::FloatTy, {70, 3, 3, 1});
+  Tensor bias(ElemKind::FloatTy, {70});
+  input.getHandle().randomize(-1.0, 1.0, PRNG);
+  filter.getHandle().randomize(-1.0, 1.0, PRNG);
+  bias.getHandle().randomize(0, 1.0, PRNG);
+  Tensor out1(ElemKind::FloatTy, {2, 5, 4, 70});
+  Tensor out2(ElemKind::FloatTy, {2, 5, 4, 70});
+
+  inferGroupedConv(&input, &filter, &bias, &out1, 3, 2, 1, 70, backendKind_);
+  inferGroupedConv(&input, &filter, &bias, &out2, 3, 2, 1, 70,
+                   BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 0.0001));
+
+  Tensor qInput(ElemKind::Int8QTy, {2, 9, 8, 70}, 0.025, -7);
+  Tensor qFilter(ElemKind::Int8QTy, {70, 3, 3, 1}, 0.003, 3);
+  Tensor qBias(ElemKind::Int8QTy, {70}, 0.5, -4);
+  qInput.getHandle<int8_t>().randomize(-128, 127, PRNG);
+  qFilter.getHandle<int8_t>().randomize(-128, 127, PRNG);
+  qBias.getHandle<int8_t>().randomize(-11, 8, PRNG);
+  Tensor qOut1(ElemKind::Int8QTy, {2, 9, 8, 70}, 0.01, -2);
+  Tensor qOut2(ElemKind::Int8QTy, {2, 9, 8, 70}, 0.01, -2);
+
+  inferGroupedConv(&qInput, &qFilter, &qBias, &qOut1, 3, 1, 1, 70,
+                   backendKind_);
+  inferGroupedConv(&qInput, &qFilter, &qBias, &qOut2, 3, 1, 1, 70,
+                   BackendKind::Interpreter);
+
+  EXPECT_TRUE(qOut1.isEqual(qOut2, 1.0));
+}
+
+/// Check the kernels of the grouped convolutions with few channels per group
+/// against the Interpreter. The 100 output channels span two blocks, and the
+/// groups of 4 output channels do not line up with the blocks.
+TEST_P(CPUOnly, smallGroupConvTest) {
+  PseudoRNG PRNG;
+  Tensor input(ElemKind::FloatTy, {2, 7, 6, 75});
+  Tensor filter(ElemKind::FloatTy, {100, 3, 3, 3});
+  Tensor bias(ElemKind::FloatTy, {100});
+  input.getHandle().randomize(-1.0, 1.0, PRNG);
+  filter.getHandle().randomize(-1.0, 1.0, PRNG);
+  bias.getHandle().randomize(0, 1.0, PRNG);
+  Tensor out1(ElemKind::FloatTy, {2, 7, 6, 100});
+  Tensor out2(ElemKind::FloatTy, {2, 7, 6, 100});
+
+  inferGroupedConv(&input, &filter, &bias, &out1, 3, 1, 1, 25, backendKind_);
+  inferGroupedConv(&input, &filter, &bias, &out2, 3, 1, 1, 25,
+                   BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2, 0.0001));
+
+  Tensor qInput(ElemKind::Int8QTy, {2, 7, 6, 75}, 0.025, -7);
+  Tensor qFilter(ElemKind::Int8QTy, {100, 3, 3, 3}, 0.003, 3);
+  Tensor qBias(ElemKind::Int8QTy, {100}, 0.5, -4);
+  qInput.getHandle<int8_t>().randomize(-128, 127, PRNG);
+  qFilter.getHandle<int8_t>().randomize(-128, 127, PRNG);
+  qBias.getHandle<int8_t>().randomize(-11, 8, PRNG);
+  Tensor qOut1(ElemKind::Int8QTy, {2, 4, 3, 100}, 0.01, -2);
+  Tensor qOut2(ElemKind::Int8QTy, {2, 4, 3, 100}, 0.01, -2);
+
+  inferGroupedConv(&qInput, &qFilter, &qBias, &qOut1, 3, 2, 1, 25,
+                   backendKind_);
+  inferGroupedConv(&qInput, &qFilter, &qBias, &qOut2, 3, 2, 1, 25,
+                   BackendKind::Interpreter);
+
+  EXPECT_TRUE(qOut1.isEqual(qOut2, 1.0));
+}
+
+/// Check the activations that are fused into the DKKC8, Winograd, and im2col
+/// convolutions against the Interpreter.
+TEST_P(CPUOnly, fusedConvActivationTest) {
+  PseudoRNG PRNG;
+  using Dims = llvm::ArrayRef<size_t>;
+  // {N, H, W, C, D, kernel, stride}
+  for (auto shape : {std::array<size_t, 7>{{2, 8, 8, 16, 64, 3, 1}},
+                     std::array<size_t, 7>{{1, 8, 8, 64, 64, 3, 1}},
+                     std::array<size_t, 7>{{2, 9, 11, 20, 24, 3, 2}}}) {
+    for (auto activation :
+         {Kinded::Kind::ReluNodeKind, Kinded::Kind::SigmoidNodeKind,
+          Kinded::Kind::TanhNodeKind}) {
+      Tensor input(ElemKind::FloatTy, Dims(shape).slice(0, 4));
+      Tensor filter(ElemKind::FloatTy,
+                    {shape[4], shape[5], shape[5], shape[3]});
+      Tensor bias(ElemKind::FloatTy, {shape[4]});
+      input.getHandle().randomize(-1.0, 1.0, PRNG);
+      filter.getHandle().initXavier(1.0, PRNG);
+      bias.getHandle().randomize(-1.0, 1.0, PRNG);
+      Tensor out1, out2;
+
+      inferConvActivation(&input, &filter, &bias, &out1, shape[5], shape[6],
+                          1, activation, backendKind_);
+      inferConvActivation(&input, &filter, &bias, &out2, shape[5], shape[6],
+                          1, activation, BackendKind::Interpreter);
+
+      EXPECT_TRUE(out1.isEqual(out2, 0.001));
+    }
+  }
+}
+
+/// Check the activations that are fused into the pre-packed MatMul against
+/// the Interpreter.
+TEST_P(CPUOnly, fusedMatMulActivationTest) {
+  PseudoRNG PRNG;
+  for (auto activation :
+       {Kinded::Kind::ReluNodeKind, Kinded::Kind::SigmoidNodeKind,
+        Kinded::Kind::TanhNodeKind}) {
+    Tensor lhs(ElemKind::FloatTy, {7, 45});
+    Tensor rhs(ElemKind::FloatTy, {45, 37});
+    lhs.getHandle().randomize(-1.0, 1.0, PRNG);
+    rhs.getHandle().randomize(-0.5, 0.5, PRNG);
+    Tensor out1, out2;
+
+    inferMatMulActivation(&lhs, &rhs, &out1, activation, backendKind_);
+    inferMatMulActivation(&lhs, &rhs, &out2, activation,
+                          BackendKind::Interpreter);
+
+    EXPECT_TRUE(out1.isEqual(out2, 0.001));
+  }
+}
+
+// Test the pre-packed int8 MatMul in the CPU backend against the generic int8
+// kernel, which is used when the weights are not constant. The results must
+// be identical.
+TEST_P(CPUOnly, quantizedPackedMatMulTest) {
+  PseudoRNG PRNG;
+  for (auto shape : {std::array<size_t, 3>{{7, 45, 37}},
+                     std::array<size_t, 3>{{1, 64, 16}},
+                     std::array<size_t, 3>{{16, 257, 33}}}) {
+    Tensor lhs(ElemKind::Int8QTy, {shape[0], shape[1]}, 0.05, 3);
+    Tensor rhs(ElemKind::Int8QTy, {shape[1], shape[2]}, 0.02, -5);
+    lhs.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    rhs.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    Tensor out1(ElemKind::Int8QTy, {shape[0], shape[2]}, 2.5, 2);
+    Tensor out2(ElemKind::Int8QTy, {shape[0], shape[2]}, 2.5, 2);
+
+    inferQuantizedMatMul(&lhs, &rhs, &out1, true, backendKind_);
+    inferQuantizedMatMul(&lhs, &rhs, &out2, false, backendKind_);
+
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
 #ifdef GLOW_WITH_CPU
 INSTANTIATE_TEST_CASE_P(CPU, BackendCorrectnessTest,
                         ::testing::Values(BackendKind::CPU));
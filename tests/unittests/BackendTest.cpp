@@ -14,16 +14,29 @@
  * limitations under the License.
  */
 
+#include "Interpreter.h"
+
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Context.h"
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IRBuilder.h"
+#include "glow/Support/Cancellation.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/Trace.h"
 
 #include "gtest/gtest.h"
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Casting.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 using namespace glow;
 
 class BackendTest : public ::testing::TestWithParam<BackendKind> {
@@ -43,6 +56,9 @@ TEST(Interpreter, NotImplementedSave) {
                                            VisibilityKind::Public, false));
 
   EXPECT_DEATH(EE.save(CompilationMode::Infer, F, "output", "network"), "");
+  EXPECT_DEATH(EE.save(CompilationMode::Infer, {{F, "network"}}, "output",
+                       "bundle"),
+               "");
 }
 
 TEST(Interpreter, profileQuantizationForANetwork) {
@@ -101,6 +117,57 @@ TEST(Interpreter, profileQuantizationForANetwork) {
   EXPECT_NEAR(1.6, max, 0.00001);
 }
 
+/// Compile a network of the kernels that the interpreter splits between
+/// threads for an interpreter using \p numThreads threads, run it on \p input
+/// and \returns the result.
+static Tensor runInterpreterKernels(unsigned numThreads, const Tensor &input) {
+  ExecutionEngine EE;
+  auto *backend = new Interpreter();
+  backend->setNumThreads(numThreads);
+  EE.setBackend(backend);
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *in = mod.createPlaceholder(ElemKind::FloatTy, input.dims(), "in", false);
+  auto *out = mod.createPlaceholder(ElemKind::FloatTy, {2, 64}, "out", false);
+  auto *data = mod.createVariable(ElemKind::FloatTy, {10, 64}, "data");
+  auto *weights = mod.createVariable(ElemKind::FloatTy, {6}, "weights");
+  auto *indices = mod.createVariable(ElemKind::Int64ITy, {6}, "indices");
+  auto *lengths = mod.createVariable(ElemKind::Int64ITy, {2}, "lengths");
+  PseudoRNG PRNG;
+  data->getPayload().getHandle().randomize(-1, 1, PRNG);
+  weights->getPayload().getHandle() = {1, -2, 0.5, 3, 1, -1};
+  indices->getPayload().getHandle<int64_t>() = {9, 0, 3, 3, 7, 1};
+  lengths->getPayload().getHandle<int64_t>() = {4, 2};
+
+  Node *O = F->createConv("conv", in, 16, 3, 1, 1, 1);
+  O = F->createTanh("tanh", O);
+  O = F->createFullyConnected("fc", O, 64);
+  O = F->createSigmoid("sigmoid", O);
+  auto *SLWS = F->createSparseLengthsWeightedSum("SLWS", data, weights,
+                                                 indices, lengths);
+  O = F->createAdd("add", O, SLWS);
+  F->createSave("ret", O, out);
+
+  Context ctx;
+  ctx.allocate(in)->assign(&input);
+  ctx.allocate(out);
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+  return ctx.get(out)->clone();
+}
+
+/// Check that splitting the kernels between threads does not change the
+/// results of the interpreter.
+TEST(Interpreter, multiThreadedKernels) {
+  Tensor input(ElemKind::FloatTy, {2, 16, 16, 8});
+  PseudoRNG PRNG;
+  input.getHandle().randomize(-1, 1, PRNG);
+  Tensor expected = runInterpreterKernels(1, input);
+  Tensor result = runInterpreterKernels(4, input);
+  EXPECT_TRUE(result.isEqual(expected));
+}
+
 TEST_P(BackendTest, simpleInference) {
   Tensor inputs(ElemKind::FloatTy, {1, 32, 32, 3});
   Context ctx;
@@ -202,6 +269,781 @@ TEST_P(BackendTest, simplePlaceholderValue) {
   EXPECT_TRUE(res.isEqual(data));
 }
 
+/// Check that the compilation phases and the executions are traced.
+TEST_P(BackendTest, traceEvents) {
+  auto &mod = EE_.getModule();
+  Function *F = mod.createFunction("traced");
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4}, "input", false);
+  auto *tanh = F->createTanh("tanh", input);
+  F->createSave("ret", tanh);
+  Context ctx;
+  ctx.allocate(input)->getHandle().clear(1);
+
+  setTracingEnabled(true);
+  clearTraceEvents();
+  EE_.compile(CompilationMode::Infer, F, ctx);
+  EE_.run();
+  EE_.run();
+  setTracingEnabled(false);
+
+  auto events = getTraceEvents();
+  auto count = [&](llvm::StringRef name, llvm::StringRef category) {
+    return std::count_if(events.begin(), events.end(),
+                         [&](const TraceEvent &event) {
+                           return event.name == name &&
+                                  event.category == category;
+                         });
+  };
+  EXPECT_EQ(count("compile traced", "compile"), 1);
+  EXPECT_EQ(count("lower", "compile"), 1);
+  EXPECT_EQ(count("IRGen", "compile"), 1);
+  EXPECT_EQ(count("traced", "execute"), 2);
+
+  // The dump is a Chrome trace of the events.
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  dumpTraceEvents(os);
+  EXPECT_EQ(os.str().find("{\"traceEvents\":["), 0);
+  EXPECT_NE(os.str().find("\"name\":\"compile traced\""), std::string::npos);
+  clearTraceEvents();
+}
+
+/// Check that the compilation fills in the compile report of the engine.
+TEST_P(BackendTest, compileReport) {
+  auto &mod = EE_.getModule();
+  Function *F = mod.createFunction("reported");
+  Context ctx;
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "input", false);
+  auto *FC = F->createFullyConnected("fc", input, 16);
+  F->createSave("ret", FC);
+  ctx.allocate(input);
+  EE_.compile(CompilationMode::Infer, F, ctx);
+
+  const auto &report = EE_.getCompileReport();
+  auto findPhase = [&](llvm::StringRef name) -> const CompileReport::Phase * {
+    for (const auto &phase : report.getPhases()) {
+      if (phase.name == name) {
+        return &phase;
+      }
+    }
+    return nullptr;
+  };
+  const auto *lower = findPhase("lower");
+  ASSERT_TRUE(lower);
+  EXPECT_EQ(lower->unit, "nodes");
+  // Lowering the fully connected node adds nodes.
+  EXPECT_GT(lower->sizeAfter, lower->sizeBefore);
+  const auto *IRGen = findPhase("IRGen");
+  ASSERT_TRUE(IRGen);
+  EXPECT_EQ(IRGen->sizeBefore, 0);
+  EXPECT_GT(IRGen->sizeAfter, 0);
+  EXPECT_GE(report.getTotalSeconds(), lower->seconds + IRGen->seconds);
+
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  report.dump(os);
+  EXPECT_NE(os.str().find("IRGen (0 -> "), std::string::npos);
+
+  // Recompiling starts a new report.
+  size_t numPhases = report.getPhases().size();
+  EE_.compile(CompilationMode::Infer, F, ctx);
+  EXPECT_EQ(EE_.getCompileReport().getPhases().size(), numPhases);
+}
+
+/// Check that the same compiled function may be executed concurrently from
+/// several threads, each one using its own context.
+TEST_P(BackendTest, concurrentContextExecution) {
+  auto &mod = EE_.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {64}, "input", false);
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {64}, "output", false);
+  auto *tanh = F->createTanh("tanh", input);
+  auto *mul = F->createMul("mul", tanh, input);
+  F->createSave("ret", mul, output);
+
+  Context compileCtx;
+  compileCtx.allocate(input);
+  compileCtx.allocate(output);
+  EE_.compile(CompilationMode::Infer, F, compileCtx);
+
+  constexpr unsigned numThreads = 4;
+  constexpr unsigned numIterations = 50;
+  std::vector<Context> contexts(numThreads);
+  for (unsigned t = 0; t < numThreads; t++) {
+    auto H = contexts[t].allocate(input)->getHandle();
+    for (size_t i = 0; i < H.size(); i++) {
+      H.raw(i) = float(t) - float(i) / 16;
+    }
+    contexts[t].allocate(output)->zero();
+  }
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < numThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (unsigned iter = 0; iter < numIterations; iter++) {
+        EE_.run(contexts[t]);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (unsigned t = 0; t < numThreads; t++) {
+    auto IH = contexts[t].get(input)->getHandle();
+    auto OH = contexts[t].get(output)->getHandle();
+    for (size_t i = 0; i < IH.size(); i++) {
+      EXPECT_NEAR(OH.raw(i), std::tanh(IH.raw(i)) * IH.raw(i), 1E-5);
+    }
+  }
+}
+
+/// Check that asynchronous runs complete in submission order, invoke their
+/// callbacks and produce the same results as synchronous runs.
+TEST_P(BackendTest, runAsync) {
+  auto &mod = EE_.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {16}, "input", false);
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {16}, "output", false);
+  auto *add = F->createAdd("add", input, input);
+  F->createSave("ret", add, output);
+
+  Context compileCtx;
+  compileCtx.allocate(input);
+  compileCtx.allocate(output);
+  EE_.compile(CompilationMode::Infer, F, compileCtx);
+
+  constexpr unsigned numRuns = 8;
+  std::vector<Context> contexts(numRuns);
+  std::vector<std::future<bool>> results;
+  std::vector<unsigned> completed;
+  for (unsigned r = 0; r < numRuns; r++) {
+    contexts[r].allocate(input)->getHandle().clear(float(r));
+    contexts[r].allocate(output)->zero();
+    auto callback = [&completed, r]() { completed.push_back(r); };
+    results.push_back(EE_.runAsync(contexts[r], callback));
+  }
+
+  for (unsigned r = 0; r < numRuns; r++) {
+    results[r].wait();
+    auto H = contexts[r].get(output)->getHandle();
+    for (size_t i = 0; i < H.size(); i++) {
+      EXPECT_EQ(H.raw(i), 2 * float(r));
+    }
+  }
+  ASSERT_EQ(completed.size(), numRuns);
+  for (unsigned r = 0; r < numRuns; r++) {
+    EXPECT_EQ(completed[r], r);
+  }
+}
+
+/// Check that the runs whose token is cancelled, or whose deadline has passed,
+/// are dropped, and that the other ones complete.
+TEST_P(BackendTest, cancelledRuns) {
+  auto &mod = EE_.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {16}, "input", false);
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {16}, "output", false);
+  auto *add = F->createAdd("add", input, input);
+  F->createSave("ret", add, output);
+
+  Context ctx;
+  ctx.allocate(input)->getHandle().clear(1);
+  ctx.allocate(output)->zero();
+  EE_.compile(CompilationMode::Infer, F, ctx);
+
+  CancellationToken cancelled;
+  cancelled.cancel();
+  EXPECT_FALSE(EE_.run(ctx, cancelled));
+  CancellationToken expired(std::chrono::nanoseconds(0));
+  EXPECT_FALSE(EE_.run(ctx, expired));
+  bool called = false;
+  auto asyncToken = std::make_shared<CancellationToken>();
+  asyncToken->cancel();
+  auto dropped =
+      EE_.runAsync(ctx, asyncToken, [&called]() { called = true; });
+  EXPECT_FALSE(dropped.get());
+  EXPECT_TRUE(called);
+  auto H = ctx.get(output)->getHandle();
+  for (size_t i = 0; i < H.size(); i++) {
+    EXPECT_EQ(H.raw(i), 0);
+  }
+
+  CancellationToken parent;
+  CancellationToken token(&parent);
+  EXPECT_TRUE(EE_.run(ctx, token));
+  for (size_t i = 0; i < H.size(); i++) {
+    EXPECT_EQ(H.raw(i), 2);
+  }
+  parent.cancel();
+  EXPECT_TRUE(token.isCancelled());
+}
+
+/// Check that a run on the backend \p kind whose deadline passes while it
+/// executes a chain of fully connected layers stops between two of them: it
+/// returns false and does not write the output of the last layer.
+static void testDeadlineDuringRun(BackendKind kind) {
+  constexpr size_t batch = 32;
+  constexpr size_t width = 256;
+  constexpr size_t numLayers = 64;
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {batch, width}, "input", false);
+  // The output has a type of its own, so no earlier layer writes to it.
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {batch, 8}, "output", false);
+  NodeValue V = input;
+  for (size_t i = 0; i < numLayers; i++) {
+    V = F->createTanh("tanh", F->createFullyConnected("fc", V, width));
+  }
+  F->createSave("ret", F->createFullyConnected("last", V, 8), output);
+
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(output)->zero();
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  // The fastest of a few complete runs.
+  auto duration = std::chrono::steady_clock::duration::max();
+  for (int i = 0; i < 3; i++) {
+    CancellationToken token;
+    auto begin = std::chrono::steady_clock::now();
+    EXPECT_TRUE(EE.run(ctx, token));
+    duration = std::min(duration, std::chrono::steady_clock::now() - begin);
+  }
+
+  // The deadline passes in the middle of the run, after the check at its
+  // start.
+  auto H = ctx.get(output)->getHandle();
+  H.clear(-2);
+  CancellationToken token(duration / 2);
+  EXPECT_FALSE(EE.run(ctx, token));
+  for (size_t i = 0; i < H.size(); i++) {
+    EXPECT_EQ(H.raw(i), -2);
+  }
+
+  // The next runs complete.
+  CancellationToken next;
+  EXPECT_TRUE(EE.run(ctx, next));
+  for (size_t i = 0; i < H.size(); i++) {
+    EXPECT_NE(H.raw(i), -2);
+  }
+}
+
+TEST(Interpreter, deadlineDuringRun) {
+  testDeadlineDuringRun(BackendKind::Interpreter);
+}
+
+#ifdef GLOW_WITH_CPU
+/// The JITted code checks the token before every instruction and every
+/// data-parallel kernel, and branches to the return of the function.
+TEST(CPU, deadlineDuringRun) { testDeadlineDuringRun(BackendKind::CPU); }
+#endif
+
+/// Check that functions compiled from the same module for different batch
+/// sizes compute correctly with the constant weights they share, also after
+/// one of them is destroyed.
+TEST_P(BackendTest, sharedConstantWeights) {
+  auto &mod = EE_.getModule();
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4, 4}, "W",
+                               VisibilityKind::Private, false);
+  W->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+
+  std::vector<std::unique_ptr<ExecutionEngine>> engines;
+  std::vector<Context> contexts(2);
+  std::vector<Placeholder *> inputs, outputs;
+  for (size_t batch : {1, 3}) {
+    Function *F = mod.createFunction("batch" + std::to_string(batch));
+    auto *input =
+        mod.createPlaceholder(ElemKind::FloatTy, {batch, 4}, "input", false);
+    auto *output =
+        mod.createPlaceholder(ElemKind::FloatTy, {batch, 4}, "output", false);
+    F->createSave("ret", F->createMatMul("mm", input, W), output);
+    engines.emplace_back(llvm::make_unique<ExecutionEngine>(GetParam()));
+    Context compileCtx;
+    engines.back()->compile(CompilationMode::Infer, F, compileCtx);
+    auto &ctx = contexts[inputs.size()];
+    ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+    ctx.allocate(output)->zero();
+    inputs.push_back(input);
+    outputs.push_back(output);
+  }
+
+  auto check = [&](size_t i) {
+    auto IH = contexts[i].get(inputs[i])->getHandle();
+    auto OH = contexts[i].get(outputs[i])->getHandle();
+    auto WH = W->getPayload().getHandle();
+    for (size_t n = 0; n < OH.dims()[0]; n++) {
+      for (size_t j = 0; j < 4; j++) {
+        float expected = 0;
+        for (size_t k = 0; k < 4; k++) {
+          expected += IH.at({n, k}) * WH.at({k, j});
+        }
+        EXPECT_NEAR(OH.at({n, j}), expected, 1E-5);
+      }
+    }
+  };
+  for (size_t i = 0; i < 2; i++) {
+    engines[i]->run(contexts[i]);
+    check(i);
+  }
+
+  engines[0].reset();
+  contexts[1].get(outputs[1])->zero();
+  engines[1]->run(contexts[1]);
+  check(1);
+}
+
+/// Check that the weights of a compiled function can be replaced, including
+/// the ones that the optimizer folded together and that the backend changed
+/// the layout of, and that the results match the ones of a function compiled
+/// with the new weights.
+TEST_P(BackendTest, updateWeights) {
+  // The names and the types of the weights of the network.
+  struct WeightInfo {
+    const char *name;
+    std::vector<size_t> dims;
+  } weightInfos[] = {{"filter", {64, 3, 3, 4}}, {"bias", {64}},
+                     {"gamma", {64}},           {"beta", {64}},
+                     {"mean", {64}},            {"var", {64}},
+                     {"fcWeights", {4096, 16}}, {"fcBias", {16}}};
+  constexpr size_t numWeights = llvm::array_lengthof(weightInfos);
+
+  // Build a network with the weights \p weights in the engine \p EE, compile
+  // it and \returns the placeholders of its input and output.
+  auto build = [&](ExecutionEngine &EE, Tensor **weights, Context &ctx) {
+    auto &mod = EE.getModule();
+    Function *F = mod.createFunction("main");
+    Variable *vars[numWeights];
+    for (size_t i = 0; i < numWeights; i++) {
+      vars[i] =
+          mod.createVariable(ElemKind::FloatTy, weightInfos[i].dims,
+                             weightInfos[i].name, VisibilityKind::Private,
+                             false);
+      vars[i]->getPayload().assign(weights[i]);
+    }
+    auto *input =
+        mod.createPlaceholder(ElemKind::FloatTy, {1, 8, 8, 4}, "input", false);
+    auto *output =
+        mod.createPlaceholder(ElemKind::FloatTy, {1, 16}, "output", false);
+    auto *CV = F->createConv(
+        "conv", input, vars[0], vars[1],
+        mod.uniqueType(ElemKind::FloatTy, {1, 8, 8, 64}), 3, 1, 1, 1);
+    auto *BN = F->createBatchNormalization("bn", CV, vars[3], vars[2],
+                                           vars[4], vars[5], 3);
+    auto *FC = F->createFullyConnected("fc", BN, vars[6], vars[7]);
+    F->createSave("ret", FC, output);
+    ctx.allocate(input);
+    ctx.allocate(output);
+    EE.compile(CompilationMode::Infer, F, ctx);
+    return std::make_pair(input, output);
+  };
+
+  auto &PRNG = EE_.getModule().getPRNG();
+  std::vector<Tensor> oldWeights, newWeights;
+  for (size_t i = 0; i < numWeights; i++) {
+    for (auto *weights : {&oldWeights, &newWeights}) {
+      weights->emplace_back(ElemKind::FloatTy, weightInfos[i].dims);
+      // The variances must be positive.
+      float low = weightInfos[i].name == llvm::StringRef("var") ? 0.5 : -1;
+      weights->back().getHandle().randomize(low, 1, PRNG);
+    }
+  }
+  std::vector<Tensor *> oldPtrs, newPtrs;
+  std::vector<llvm::StringRef> names;
+  for (size_t i = 0; i < numWeights; i++) {
+    oldPtrs.push_back(&oldWeights[i]);
+    newPtrs.push_back(&newWeights[i]);
+    names.push_back(weightInfos[i].name);
+  }
+
+  Context ctx;
+  auto PHs = build(EE_, oldPtrs.data(), ctx);
+  ctx.get(PHs.first)->getHandle().randomize(-1, 1, PRNG);
+  EE_.run(ctx);
+  Tensor oldResult = ctx.get(PHs.second)->clone();
+
+  // The updates that would require a new compilation are rejected.
+  Tensor wrongTy(ElemKind::FloatTy, {32});
+  EXPECT_FALSE(EE_.updateWeights({"bias"}, {&wrongTy}));
+  EXPECT_FALSE(EE_.updateWeights({"unknown"}, {&newWeights[1]}));
+  EE_.run(ctx);
+  EXPECT_TRUE(ctx.get(PHs.second)->isEqual(oldResult));
+
+  ASSERT_TRUE(EE_.updateWeights(names, newPtrs));
+  EE_.run(ctx);
+
+  ExecutionEngine refEE(GetParam());
+  Context refCtx;
+  auto refPHs = build(refEE, newPtrs.data(), refCtx);
+  refCtx.get(refPHs.first)->assign(ctx.get(PHs.first));
+  refEE.run(refCtx);
+  EXPECT_FALSE(ctx.get(PHs.second)->isEqual(oldResult));
+  EXPECT_TRUE(ctx.get(PHs.second)->isEqual(*refCtx.get(refPHs.second)));
+}
+
+/// Build in \p mod a function that computes relu(FC) + tanh(FC), where FC
+/// is the fully connected layer with the weights \p W and \p B of the module,
+/// for a batch of \p batch rows. The two branches keep an activation alive
+/// in any schedule. \returns the function, and its input and output in
+/// \p input and \p output.
+static Function *createFCFunction(Module &mod, Variable *W, Variable *B,
+                                  size_t batch, Placeholder *&input,
+                                  Placeholder *&output) {
+  Function *F = mod.createFunction("fc" + std::to_string(batch));
+  input = mod.createPlaceholder(ElemKind::FloatTy, {batch, W->dims()[0]},
+                                "input" + std::to_string(batch), false);
+  output = mod.createPlaceholder(ElemKind::FloatTy, {batch, W->dims()[1]},
+                                 "output" + std::to_string(batch), false);
+  auto *FC = F->createFullyConnected("fc", input, W, B);
+  auto *add = F->createAdd("add", F->createRELU("relu", FC),
+                           F->createTanh("tanh", FC));
+  F->createSave("ret", add, output);
+  return F;
+}
+
+namespace {
+/// A backend that compiles the functions with the Interpreter, and reports
+/// that the functions compiled with the scheduler it prefers use a gigabyte
+/// more than their activations, to exercise the retry of the engine with the
+/// scheduler that minimizes the peak memory.
+class OversizedScheduleBackend final : public Backend {
+  /// A function of the Interpreter with an inflated memory usage.
+  class OversizedFunction final : public CompiledFunction {
+    std::unique_ptr<CompiledFunction> compiled_;
+    uint64_t extra_;
+
+  public:
+    OversizedFunction(std::unique_ptr<CompiledFunction> compiled,
+                      uint64_t extra)
+        : compiled_(std::move(compiled)), extra_(extra) {}
+    void execute() override { compiled_->execute(); }
+    void execute(Context &ctx) override { compiled_->execute(ctx); }
+    MemoryUsage getMemoryUsage() const override {
+      auto usage = compiled_->getMemoryUsage();
+      usage.activations += extra_;
+      return usage;
+    }
+  };
+
+  std::unique_ptr<Backend> interpreter_{
+      createBackend(BackendKind::Interpreter)};
+
+public:
+  /// The memory that the preferred schedule wastes.
+  static constexpr uint64_t kExtraBytes = 1ull << 30;
+
+  /// The schedulers of the compilations, in order.
+  mutable std::vector<SchedulerKind> compiles;
+  /// Protects compiles, since the engine may compile on several threads.
+  mutable std::mutex compilesMutex;
+
+  std::unique_ptr<CompiledFunction> compile(Function *F,
+                                            const Context &ctx) const override {
+    auto kind = getCompileSchedulerKind();
+    {
+      std::lock_guard<std::mutex> lock(compilesMutex);
+      compiles.push_back(kind);
+    }
+    if (kind != SchedulerKind::MinPeakMemory) {
+      return llvm::make_unique<OversizedFunction>(
+          interpreter_->compile(F, ctx), kExtraBytes);
+    }
+    // The engine retries one function at a time.
+    interpreter_->setMinimizePeakMemory(true);
+    auto compiled = interpreter_->compile(F, ctx);
+    interpreter_->setMinimizePeakMemory(false);
+    return llvm::make_unique<OversizedFunction>(std::move(compiled), 0);
+  }
+
+  bool isOpSupported(Kinded::Kind opKind, ElemKind elementTy) const override {
+    return interpreter_->isOpSupported(opKind, elementTy);
+  }
+
+  bool shouldLower(const Node *N) const override {
+    return interpreter_->shouldLower(N);
+  }
+};
+} // namespace
+
+/// Check that a function whose weights alone exceed the memory budget fails
+/// before its code is generated, and that it compiles without the budget.
+TEST_P(BackendTest, memoryBudgetWeights) {
+  auto &mod = EE_.getModule();
+  auto *W = mod.createVariable(ElemKind::FloatTy, {64, 64}, "W",
+                               VisibilityKind::Private, false);
+  auto *B = mod.createVariable(ElemKind::FloatTy, {64}, "B",
+                               VisibilityKind::Private, false);
+  Placeholder *input, *output;
+  Function *F = createFCFunction(mod, W, B, 4, input, output);
+  Context ctx;
+  ctx.allocate(input);
+  ctx.allocate(output);
+
+  EE_.setMemoryBudget(W->getType()->getSizeInBytes());
+  EXPECT_FALSE(EE_.compile(CompilationMode::Infer, F, ctx));
+  for (const auto &phase : EE_.getCompileReport().getPhases()) {
+    EXPECT_NE(phase.name, "IRGen");
+  }
+
+  EE_.setMemoryBudget(0);
+  EXPECT_TRUE(EE_.compile(CompilationMode::Infer, F, ctx));
+  auto usage = EE_.getMemoryUsage();
+  EXPECT_GE(usage.constantWeights + usage.mutableWeights,
+            (64 * 64 + 64) * sizeof(float));
+}
+
+/// Check that a function that does not fit in the memory budget with the
+/// schedule of the backend is compiled again with the schedule that
+/// minimizes the peak memory, and fails if it does not fit either.
+TEST(MemoryBudget, minPeakMemoryFallback) {
+  ExecutionEngine EE;
+  auto *backend = new OversizedScheduleBackend();
+  EE.setBackend(backend);
+  auto &mod = EE.getModule();
+  auto *W = mod.createVariable(ElemKind::FloatTy, {16, 8}, "W",
+                               VisibilityKind::Private, false);
+  auto *B = mod.createVariable(ElemKind::FloatTy, {8}, "B",
+                               VisibilityKind::Private, false);
+  W->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  B->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  Placeholder *input, *output;
+  Function *F = createFCFunction(mod, W, B, 4, input, output);
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(output);
+
+  // Without a budget, the schedule of the backend is kept.
+  ASSERT_TRUE(EE.compile(CompilationMode::Infer, F, ctx));
+  ASSERT_EQ(backend->compiles.size(), 1);
+  EXPECT_EQ(backend->compiles[0], SchedulerKind::ChildMemSize);
+  auto oversized = EE.getMemoryUsage();
+  ASSERT_GT(oversized.activations, OversizedScheduleBackend::kExtraBytes);
+  EE.run(ctx);
+  Tensor expected = ctx.get(output)->clone();
+
+  // The second compilation fits.
+  backend->compiles.clear();
+  EE.setMemoryBudget(oversized.getTotal() -
+                     OversizedScheduleBackend::kExtraBytes / 2);
+  ASSERT_TRUE(EE.compile(CompilationMode::Infer, F, ctx));
+  ASSERT_EQ(backend->compiles.size(), 2);
+  EXPECT_EQ(backend->compiles[1], SchedulerKind::MinPeakMemory);
+  auto fitted = EE.getMemoryUsage();
+  EXPECT_LE(fitted.getTotal(), EE.getMemoryBudget());
+  ctx.get(output)->zero();
+  EE.run(ctx);
+  EXPECT_TRUE(ctx.get(output)->isEqual(expected));
+
+  // The weights fit, but not the activations of any schedule.
+  backend->compiles.clear();
+  ASSERT_GT(fitted.activations, 0);
+  EE.setMemoryBudget(fitted.getTotal() - 1);
+  EXPECT_FALSE(EE.compile(CompilationMode::Infer, F, ctx));
+  ASSERT_EQ(backend->compiles.size(), 2);
+  EXPECT_EQ(backend->compiles[1], SchedulerKind::MinPeakMemory);
+}
+
+/// The functions of a module built by createFCFunctions().
+struct FCFunctions {
+  std::vector<Function *> functions;
+  std::vector<Placeholder *> inputs;
+  std::vector<Placeholder *> outputs;
+};
+
+/// Build in \p mod the functions of createFCFunction() for the batches of 1
+/// to 8 rows, which share the weights \p W and \p B, and allocate their
+/// inputs, with random values, and their outputs in \p ctx.
+static FCFunctions createFCFunctions(Module &mod, const Tensor &W,
+                                     const Tensor &B, Context &ctx) {
+  auto *WV = mod.createVariable(ElemKind::FloatTy, W.dims(), "W",
+                                VisibilityKind::Private, false);
+  auto *BV = mod.createVariable(ElemKind::FloatTy, B.dims(), "B",
+                                VisibilityKind::Private, false);
+  WV->getPayload().assign(&W);
+  BV->getPayload().assign(&B);
+  FCFunctions fns;
+  for (size_t batch = 1; batch <= 8; batch++) {
+    Placeholder *input, *output;
+    fns.functions.push_back(createFCFunction(mod, WV, BV, batch, input,
+                                             output));
+    ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+    ctx.allocate(output)->zero();
+    fns.inputs.push_back(input);
+    fns.outputs.push_back(output);
+  }
+  return fns;
+}
+
+/// Compile the functions of createFCFunctions() with the weights \p W and
+/// \p B one at a time, with the single-function compile() of an engine of
+/// \p kind, run them on \p inputs and \returns their results.
+static std::vector<Tensor> runSerially(BackendKind kind, const Tensor &W,
+                                       const Tensor &B,
+                                       llvm::ArrayRef<Tensor *> inputs) {
+  ExecutionEngine EE(kind);
+  Context ctx;
+  auto fns = createFCFunctions(EE.getModule(), W, B, ctx);
+  std::vector<Tensor> results;
+  for (size_t i = 0, e = fns.functions.size(); i < e; i++) {
+    ctx.get(fns.inputs[i])->assign(inputs[i]);
+    EE.compile(CompilationMode::Infer, fns.functions[i], ctx);
+    EE.run(ctx);
+    results.push_back(ctx.get(fns.outputs[i])->clone());
+  }
+  return results;
+}
+
+/// \returns random weights for createFCFunctions(), drawn from \p PRNG.
+static std::pair<Tensor, Tensor> createFCWeights(PseudoRNG &PRNG) {
+  std::pair<Tensor, Tensor> weights{Tensor(ElemKind::FloatTy, {32, 16}),
+                                    Tensor(ElemKind::FloatTy, {16})};
+  weights.first.getHandle().randomize(-1, 1, PRNG);
+  weights.second.getHandle().randomize(-1, 1, PRNG);
+  return weights;
+}
+
+/// \returns the tensors of the inputs of \p fns in \p ctx.
+static std::vector<Tensor *> getInputs(const FCFunctions &fns, Context &ctx) {
+  std::vector<Tensor *> inputs;
+  for (auto *PH : fns.inputs) {
+    inputs.push_back(ctx.get(PH));
+  }
+  return inputs;
+}
+
+/// Check that the functions of a module compiled together, on one thread per
+/// core by default, compute the results of the functions compiled one at a
+/// time.
+TEST_P(BackendTest, compileFunctionsInParallel) {
+  auto &mod = EE_.getModule();
+  auto weights = createFCWeights(mod.getPRNG());
+  Context ctx;
+  auto fns = createFCFunctions(mod, weights.first, weights.second, ctx);
+  ASSERT_TRUE(EE_.compile(CompilationMode::Infer, fns.functions, ctx));
+  auto expected = runSerially(GetParam(), weights.first, weights.second,
+                              getInputs(fns, ctx));
+
+  // The functions do not share mutable tensors, so they run concurrently.
+  std::vector<std::thread> threads;
+  for (auto *F : fns.functions) {
+    EXPECT_TRUE(EE_.isCompiled(F));
+    threads.emplace_back([&, F] { EE_.run(F); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (size_t i = 0, e = fns.functions.size(); i < e; i++) {
+    EXPECT_TRUE(ctx.get(fns.outputs[i])->isEqual(expected[i]));
+  }
+
+  // The phases of every function are reported under its name.
+  const auto &phases = EE_.getCompileReport().getPhases();
+  for (auto *F : fns.functions) {
+    auto prefix = F->getName().str() + ": ";
+    EXPECT_TRUE(std::any_of(phases.begin(), phases.end(), [&](const auto &P) {
+      return llvm::StringRef(P.name).startswith(prefix);
+    }));
+  }
+}
+
+/// Check that the lazily compiled functions are compiled by their first run,
+/// once even if several threads race to run them, and compute the results of
+/// the functions compiled one at a time.
+TEST_P(BackendTest, compileLazily) {
+  auto &mod = EE_.getModule();
+  auto weights = createFCWeights(mod.getPRNG());
+  Context ctx;
+  auto fns = createFCFunctions(mod, weights.first, weights.second, ctx);
+  EE_.compileLazily(CompilationMode::Infer, fns.functions, ctx);
+  for (auto *F : fns.functions) {
+    EXPECT_FALSE(EE_.isCompiled(F));
+  }
+  auto expected = runSerially(GetParam(), weights.first, weights.second,
+                              getInputs(fns, ctx));
+
+  // Several threads run the last function first, each with its own tensors.
+  size_t last = fns.functions.size() - 1;
+  std::vector<Context> contexts(4);
+  std::vector<std::thread> threads;
+  for (auto &threadCtx : contexts) {
+    threadCtx.allocate(fns.inputs[last])->assign(ctx.get(fns.inputs[last]));
+    threadCtx.allocate(fns.outputs[last])->zero();
+    Context *runCtx = &threadCtx;
+    threads.emplace_back(
+        [&, runCtx] { EE_.run(fns.functions[last], *runCtx); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto &threadCtx : contexts) {
+    EXPECT_TRUE(threadCtx.get(fns.outputs[last])->isEqual(expected[last]));
+  }
+  for (size_t i = 0; i < last; i++) {
+    EXPECT_FALSE(EE_.isCompiled(fns.functions[i]));
+  }
+  EXPECT_TRUE(EE_.isCompiled(fns.functions[last]));
+
+  // The other functions run with the tensors of the context of the
+  // compilation.
+  EE_.run(fns.functions[0]);
+  EXPECT_TRUE(EE_.isCompiled(fns.functions[0]));
+  EXPECT_TRUE(ctx.get(fns.outputs[0])->isEqual(expected[0]));
+}
+
+/// Check that the functions compiled together or lazily that do not fit in
+/// the memory budget with the schedule of the backend are compiled again with
+/// the MinPeakMemory schedule, and compute the results of the functions
+/// compiled one at a time.
+TEST(MemoryBudget, compileFunctionsWithinBudget) {
+  // The schedule of the backend takes a gigabyte too much, and the other one
+  // a few kilobytes.
+  const uint64_t budget = OversizedScheduleBackend::kExtraBytes / 2;
+  ExecutionEngine EE;
+  auto *backend = new OversizedScheduleBackend();
+  EE.setBackend(backend);
+  EE.setMemoryBudget(budget);
+  auto weights = createFCWeights(EE.getModule().getPRNG());
+  Context ctx;
+  auto fns =
+      createFCFunctions(EE.getModule(), weights.first, weights.second, ctx);
+  auto expected = runSerially(BackendKind::Interpreter, weights.first,
+                              weights.second, getInputs(fns, ctx));
+  ASSERT_TRUE(EE.compile(CompilationMode::Infer, fns.functions, ctx));
+  size_t numFunctions = fns.functions.size();
+  ASSERT_EQ(backend->compiles.size(), 2 * numFunctions);
+  EXPECT_EQ(std::count(backend->compiles.begin(), backend->compiles.end(),
+                       SchedulerKind::MinPeakMemory),
+            numFunctions);
+  for (size_t i = 0; i < numFunctions; i++) {
+    EE.run(fns.functions[i]);
+    EXPECT_TRUE(ctx.get(fns.outputs[i])->isEqual(expected[i]));
+  }
+
+  ExecutionEngine lazyEE;
+  auto *lazyBackend = new OversizedScheduleBackend();
+  lazyEE.setBackend(lazyBackend);
+  lazyEE.setMemoryBudget(budget);
+  Context lazyCtx;
+  auto lazyFns = createFCFunctions(lazyEE.getModule(), weights.first,
+                                   weights.second, lazyCtx);
+  for (size_t i = 0; i < numFunctions; i++) {
+    lazyCtx.get(lazyFns.inputs[i])->assign(ctx.get(fns.inputs[i]));
+  }
+  lazyEE.compileLazily(CompilationMode::Infer, lazyFns.functions, lazyCtx);
+  EXPECT_TRUE(lazyBackend->compiles.empty());
+  lazyEE.run(lazyFns.functions[2]);
+  ASSERT_EQ(lazyBackend->compiles.size(), 2);
+  EXPECT_EQ(lazyBackend->compiles[1], SchedulerKind::MinPeakMemory);
+  EXPECT_TRUE(lazyCtx.get(lazyFns.outputs[2])->isEqual(expected[2]));
+}
+
 /// Test the basic functionality of the context.
 TEST(Context, basicContextTest) {
   Module mod;
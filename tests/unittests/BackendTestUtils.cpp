@@ -190,12 +190,12 @@ void inferGatherNet(Tensor *data, Tensor *indices, Tensor *dest,
 }
 
 void inferLocalResponseNormalizationNet(Tensor *inputs, Tensor *out,
-                                        BackendKind kind) {
+                                        BackendKind kind, float beta) {
   ExecutionEngine EE(kind);
   auto &mod = EE.getModule();
   Function *F = mod.createFunction("main");
   auto *var = VarFrom(inputs);
-  auto *lrn = F->createLocalResponseNormalization("lrn", var, 5, 3.0, 0.5, 1.5);
+  auto *lrn = F->createLocalResponseNormalization("lrn", var, 5, 3.0, beta, 1.5);
   auto result = F->createSave("ret", lrn);
   Context ctx;
   EE.compile(CompilationMode::Infer, F, ctx);
@@ -440,6 +440,32 @@ void inferQuantizeNet(Tensor *inputs, float scale, int32_t offset, Tensor *out,
   out->assign(&result->getVariable()->getPayload());
 }
 
+void inferQuantizedAddMulNet(Tensor *lhs, Tensor *rhs, Tensor *addOut,
+                             Tensor *mulOut, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *lhsVar = VarFrom(lhs);
+  auto *rhsVar = VarFrom(rhs);
+  auto addTy = mod.uniqueType(ElemKind::Int8QTy, addOut->dims(),
+                              addOut->getType().getScale(),
+                              addOut->getType().getOffset());
+  auto mulTy = mod.uniqueType(ElemKind::Int8QTy, mulOut->dims(),
+                              mulOut->getType().getScale(),
+                              mulOut->getType().getOffset());
+  auto *add = F->createAdd("add", addTy, lhsVar, rhsVar);
+  auto *mul = F->createMul("mul", mulTy, lhsVar, rhsVar);
+  auto addResult = F->createSave("addRet", add);
+  auto mulResult = F->createSave("mulRet", mul);
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({lhsVar, rhsVar}, {lhs, rhs});
+  EE.run();
+  addOut->assign(&addResult->getVariable()->getPayload());
+  mulOut->assign(&mulResult->getVariable()->getPayload());
+}
+
 void inferReluNet(Tensor *inputs, Tensor *out, BackendKind kind) {
   ExecutionEngine EE(kind);
   auto &mod = EE.getModule();
@@ -746,6 +772,41 @@ void trainSoftMaxNet(Tensor *inputs, Tensor *weights, Tensor *bias,
   out->assign(&result->getVariable()->getPayload());
 }
 
+void trainOptimizerNet(Tensor *inputs, Tensor *weights, Tensor *bias,
+                       Tensor *selected, OptimizerKind optimizer, Tensor *out,
+                       BackendKind kind) {
+  ExecutionEngine EE(kind);
+  TrainingConfig TC;
+
+  // This variable records the number of the next sample to be used for
+  // training.
+  size_t sampleCounter = 0;
+
+  TC.optimizer = optimizer;
+  TC.learningRate = 0.01;
+  TC.L2Decay = 0.001;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var1 = VarFrom(inputs);
+  auto *var2 = VarFrom(selected);
+  auto *fc = F->createFullyConnected("fc", var1, bias->dims()[0]);
+  cast<Variable>(fc->getWeights())->assign(weights);
+  cast<Variable>(fc->getBias())->assign(bias);
+  auto *softmax = F->createSoftMax("softmax", fc, var2);
+  auto result = F->createSave("ret", softmax);
+
+  Function *TF = glow::differentiate(F, TC);
+  Context ctx;
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  runBatch(EE, 30, sampleCounter, {var1, var2}, {inputs, selected});
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({var1, var2}, {inputs, selected});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
 void inferTanhNet(Tensor *inputs, Tensor *out, BackendKind kind) {
   ExecutionEngine EE(kind);
   auto &mod = EE.getModule();
@@ -798,6 +859,28 @@ void inferTanhConcatNet(Tensor *input1, Tensor *input2, Tensor *input3,
   out->assign(&result->getVariable()->getPayload());
 }
 
+void inferReshapeSliceNet(Tensor *input, Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = VarFrom(input);
+  auto *T = F->createTanh("tanh", var);
+  auto *R = F->createReshape("reshape", T, {6, 4});
+  auto *S1 = F->createSlice("slice1", R, {0, 0}, {3, 4});
+  auto *S2 = F->createSlice("slice2", R, {3, 0}, {6, 4});
+  auto *M = F->createMul("mul", S1, S2);
+  auto *A = F->createAdd("add", R, R);
+  auto *AR = F->createReshape("reshape2", A, {3, 8});
+  Node *C = F->createConcat("concat", {M, AR}, 1);
+  auto *result = F->createSave("ret", C);
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({var}, {input});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
 void inferBasicConvNet(Tensor *inputs, Tensor *out, BackendKind kind,
                        size_t convDepth) {
   ExecutionEngine EE(kind);
@@ -918,6 +1001,21 @@ static void initConv(ConvolutionNode *C, Tensor &filter, Tensor &bias) {
   cast<Variable>(C->getFilter())->getPayload().assign(&filter);
   cast<Variable>(C->getBias())->getPayload().assign(&bias);
 }
+
+// Helper for creating a Relu, Sigmoid, or Tanh node of the kind \p kind.
+static Node *createActivation(Function *F, Kinded::Kind kind,
+                              NodeValue input) {
+  switch (kind) {
+  case Kinded::Kind::ReluNodeKind:
+    return F->createRELU("relu", input);
+  case Kinded::Kind::SigmoidNodeKind:
+    return F->createSigmoid("sigmoid", input);
+  case Kinded::Kind::TanhNodeKind:
+    return F->createTanh("tanh", input);
+  default:
+    llvm_unreachable("Unsupported activation");
+  }
+}
 } // namespace
 
 void inferTinyResnet(Tensor *input, Tensor *out, std::vector<Tensor> &weights,
@@ -1009,4 +1107,234 @@ void inferMaxSplat(Tensor *input, Tensor *out, BackendKind kind) {
   out->assign(&result->getVariable()->getPayload());
 }
 
+void inferPackedFCNet(Tensor *inputs, Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = VarFrom(inputs);
+  // The widths of the layers are not multiples of the panel width of the
+  // pre-packed weights, so the last panel is zero-padded.
+  auto *fc = F->createFullyConnected("fc", var, 37);
+  auto *rl0 = F->createRELU("relu", fc);
+  auto *fc2 = F->createFullyConnected("fc2", rl0, 70);
+  for (auto *W : {cast<Variable>(fc->getWeights()),
+                  cast<Variable>(fc2->getWeights())}) {
+    auto WH = W->getHandle();
+    for (size_t i = 0, e = WH.size(); i < e; i++) {
+      WH.raw(i) = ((i * 37) % 17) / 17.0 - 0.5;
+    }
+  }
+  auto result = F->createSave("ret", fc2);
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({var}, {inputs});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferSparseFCNet(Tensor *inputs, Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *var = VarFrom(inputs);
+  auto *fc = F->createFullyConnected("fc", var, 37);
+  auto *rl0 = F->createRELU("relu", fc);
+  auto *fc2 = F->createFullyConnected("fc2", rl0, 70);
+  // Prune about 88% of the weights, so that the CPU backend stores them as
+  // sparse matrices.
+  for (auto *W : {cast<Variable>(fc->getWeights()),
+                  cast<Variable>(fc2->getWeights())}) {
+    auto WH = W->getHandle();
+    for (size_t i = 0, e = WH.size(); i < e; i++) {
+      size_t h = (i * 37) % 17;
+      WH.raw(i) = h < 2 ? h - 0.7 : 0;
+    }
+  }
+  auto result = F->createSave("ret", fc2);
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({var}, {inputs});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferWinogradConv(Tensor *input, Tensor *filter, Tensor *bias,
+                       Tensor *out, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *in = VarFrom(input);
+  auto *conv = F->createConv("conv", in, filter->dims()[0], 3, 1, 1, 1);
+  initConv(conv, *filter, *bias);
+  auto *result = F->createSave("ret", conv);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({in}, {input});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferIm2colConv(Tensor *input, Tensor *filter, Tensor *bias, Tensor *out,
+                     llvm::ArrayRef<unsigned_t> kernels,
+                     llvm::ArrayRef<unsigned_t> strides,
+                     llvm::ArrayRef<unsigned_t> pads, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *in = VarFrom(input);
+  auto *conv = F->createConv("conv", in, filter->dims()[0], kernels, strides,
+                             pads, 1);
+  initConv(conv, *filter, *bias);
+  auto *result = F->createSave("ret", conv);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({in}, {input});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferGroupedConv(Tensor *input, Tensor *filter, Tensor *bias, Tensor *out,
+                      unsigned_t kernel, unsigned_t stride, unsigned_t pad,
+                      unsigned_t group, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *inputVar = VarFrom(input);
+  auto *filterVar = VarFrom(filter);
+  auto *biasVar = VarFrom(bias);
+  auto *outVar = VarFrom(out);
+  auto OT = mod.uniqueType(out->getType());
+  auto *conv = F->createConv("conv", inputVar, filterVar, biasVar, OT, kernel,
+                             stride, pad, group);
+  auto result = F->createSave("ret", conv, outVar);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({inputVar, filterVar, biasVar}, {input, filter, bias});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferConvActivation(Tensor *input, Tensor *filter, Tensor *bias,
+                         Tensor *out, unsigned_t kernel, unsigned_t stride,
+                         unsigned_t pad, Kinded::Kind activation,
+                         BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *in = VarFrom(input);
+  auto *conv =
+      F->createConv("conv", in, filter->dims()[0], kernel, stride, pad, 1);
+  initConv(conv, *filter, *bias);
+  auto *act = createActivation(F, activation, conv);
+  auto *result = F->createSave("ret", act);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({in}, {input});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferMatMulActivation(Tensor *lhs, Tensor *rhs, Tensor *out,
+                           Kinded::Kind activation, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *lhsVar = VarFrom(lhs);
+  auto *rhsVar = mod.createVariable(ElemKind::FloatTy, rhs->dims(), "rhs",
+                                    VisibilityKind::Private, false);
+  rhsVar->getPayload().assign(rhs);
+  auto *MM = F->createMatMul("matmul", lhsVar, rhsVar);
+  auto *act = createActivation(F, activation, MM);
+  auto *result = F->createSave("ret", act);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  updateVariables({lhsVar}, {lhs});
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferQuantizedMatMul(Tensor *lhs, Tensor *rhs, Tensor *out,
+                          bool constantRHS, BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *lhsVar = VarFrom(lhs);
+  auto *outVar = VarFrom(out);
+  Variable *rhsVar;
+  if (constantRHS) {
+    rhsVar = mod.createVariable(&rhs->getType(), "rhs",
+                                VisibilityKind::Private, false);
+    rhsVar->getPayload().assign(rhs);
+  } else {
+    rhsVar = VarFrom(rhs);
+  }
+  auto &outType = out->getType();
+  auto OT = mod.uniqueType(out->getElementType(), out->dims(),
+                           outType.getScale(), outType.getOffset());
+  auto *MM = F->createMatMul("matmul", OT, lhsVar, rhsVar);
+  auto result = F->createSave("ret", MM, outVar);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  if (constantRHS) {
+    updateVariables({lhsVar}, {lhs});
+  } else {
+    updateVariables({lhsVar, rhsVar}, {lhs, rhs});
+  }
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
+void inferQuantizedConv(Tensor *input, Tensor *filter, Tensor *bias,
+                        Tensor *out, llvm::ArrayRef<unsigned_t> kernels,
+                        llvm::ArrayRef<unsigned_t> strides,
+                        llvm::ArrayRef<unsigned_t> pads, bool constantFilter,
+                        BackendKind kind) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *inputVar = VarFrom(input);
+  auto *outVar = VarFrom(out);
+  Variable *filterVar, *biasVar;
+  if (constantFilter) {
+    filterVar = mod.createVariable(&filter->getType(), "filter",
+                                   VisibilityKind::Private, false);
+    filterVar->getPayload().assign(filter);
+    biasVar = mod.createVariable(&bias->getType(), "bias",
+                                 VisibilityKind::Private, false);
+    biasVar->getPayload().assign(bias);
+  } else {
+    filterVar = VarFrom(filter);
+    biasVar = VarFrom(bias);
+  }
+  auto OT = mod.uniqueType(out->getType());
+  auto *conv = F->createConv("conv", inputVar, filterVar, biasVar, OT,
+                             kernels, strides, pads, 1);
+  auto result = F->createSave("ret", conv, outVar);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+
+  if (constantFilter) {
+    updateVariables({inputVar}, {input});
+  } else {
+    updateVariables({inputVar, filterVar, biasVar}, {input, filter, bias});
+  }
+  EE.run();
+  out->assign(&result->getVariable()->getPayload());
+}
+
 } // namespace glow
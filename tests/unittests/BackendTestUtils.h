@@ -24,6 +24,7 @@ namespace glow {
 class MockBackend : public Backend {
   class MockFunction : public CompiledFunction {
     void execute() override {}
+    void execute(Context &ctx) override {}
   };
   std::unique_ptr<CompiledFunction> compile(Function *F,
                                             const Context &ctx) const override {
@@ -51,7 +52,7 @@ void inferGatherNet(Tensor *data, Tensor *indices, Tensor *dest,
                     BackendKind kind);
 
 void inferLocalResponseNormalizationNet(Tensor *inputs, Tensor *out,
-                                        BackendKind kind);
+                                        BackendKind kind, float beta = 0.5);
 
 void trainLocalResponseNormalizationNet(Tensor *inputs, Tensor *weights,
                                         Tensor *bias, Tensor *selected,
@@ -87,6 +88,9 @@ void inferIntLookupTableNet(Tensor *input, Tensor *out,
 void inferQuantizeNet(Tensor *inputs, float scale, int32_t offset, Tensor *out,
                       BackendKind kind);
 
+void inferQuantizedAddMulNet(Tensor *lhs, Tensor *rhs, Tensor *addOut,
+                             Tensor *mulOut, BackendKind kind);
+
 void inferReluNet(Tensor *inputs, Tensor *out, BackendKind kind);
 
 void inferReshapeNet(Tensor *inputs, llvm::ArrayRef<size_t> shape, Tensor *out,
@@ -115,6 +119,10 @@ void inferSoftMaxNet(Tensor *inputs, Tensor *selected, Tensor *out,
 void trainSoftMaxNet(Tensor *inputs, Tensor *weights, Tensor *bias,
                      Tensor *selected, Tensor *out, BackendKind kind);
 
+void trainOptimizerNet(Tensor *inputs, Tensor *weights, Tensor *bias,
+                       Tensor *selected, OptimizerKind optimizer, Tensor *out,
+                       BackendKind kind);
+
 void inferTanhNet(Tensor *inputs, Tensor *out, BackendKind kind);
 
 void inferTransposeNet(Tensor *inputs, Tensor *out, BackendKind kind);
@@ -125,6 +133,8 @@ void inferBasicConvNet(Tensor *inputs, Tensor *out, BackendKind kind,
 void inferTanhConcatNet(Tensor *input1, Tensor *input2, Tensor *input3,
                         Tensor *out, BackendKind kind);
 
+void inferReshapeSliceNet(Tensor *input, Tensor *out, BackendKind kind);
+
 void inferBasicFCNet(Tensor *inputs, Tensor *out, BackendKind kind);
 
 void inferMixedNet(Tensor *inputs, Tensor *out, BackendKind kind);
@@ -139,4 +149,37 @@ void inferExtract3D(Tensor *input, Tensor *out, BackendKind kind);
 
 void inferMaxSplat(Tensor *input, Tensor *out, BackendKind kind);
 
+void inferPackedFCNet(Tensor *inputs, Tensor *out, BackendKind kind);
+
+void inferSparseFCNet(Tensor *inputs, Tensor *out, BackendKind kind);
+
+void inferWinogradConv(Tensor *input, Tensor *filter, Tensor *bias,
+                       Tensor *out, BackendKind kind);
+
+void inferIm2colConv(Tensor *input, Tensor *filter, Tensor *bias, Tensor *out,
+                     llvm::ArrayRef<unsigned_t> kernels,
+                     llvm::ArrayRef<unsigned_t> strides,
+                     llvm::ArrayRef<unsigned_t> pads, BackendKind kind);
+
+void inferGroupedConv(Tensor *input, Tensor *filter, Tensor *bias, Tensor *out,
+                      unsigned_t kernel, unsigned_t stride, unsigned_t pad,
+                      unsigned_t group, BackendKind kind);
+
+void inferConvActivation(Tensor *input, Tensor *filter, Tensor *bias,
+                         Tensor *out, unsigned_t kernel, unsigned_t stride,
+                         unsigned_t pad, Kinded::Kind activation,
+                         BackendKind kind);
+
+void inferMatMulActivation(Tensor *lhs, Tensor *rhs, Tensor *out,
+                           Kinded::Kind activation, BackendKind kind);
+
+void inferQuantizedMatMul(Tensor *lhs, Tensor *rhs, Tensor *out,
+                          bool constantRHS, BackendKind kind);
+
+void inferQuantizedConv(Tensor *input, Tensor *filter, Tensor *bias,
+                        Tensor *out, llvm::ArrayRef<unsigned_t> kernels,
+                        llvm::ArrayRef<unsigned_t> strides,
+                        llvm::ArrayRef<unsigned_t> pads, bool constantFilter,
+                        BackendKind kind);
+
 } // namespace glow
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/Batcher.h"
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Graph.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <future>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+/// Compile a function that computes 2 * input + 1 for a batch of
+/// \p batchSize samples of 3 elements.
+Function *createScaleNet(ExecutionEngine &EE, size_t batchSize,
+                         Placeholder *&input, Placeholder *&output) {
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  input = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 3}, "input",
+                                false);
+  output = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 3}, "output",
+                                 false);
+  auto *two = F->createSplat("two", input->getType(), 2);
+  auto *one = F->createSplat("one", input->getType(), 1);
+  auto *mul = F->createMul("mul", input, two);
+  auto *add = F->createAdd("add", mul, one);
+  F->createSave("ret", add, output);
+
+  Context ctx;
+  ctx.allocate(input);
+  ctx.allocate(output);
+  EE.compile(CompilationMode::Infer, F, ctx);
+  return F;
+}
+} // namespace
+
+/// Check that full batches are formed and the outputs are scattered to the
+/// right requests.
+TEST(Batcher, fullBatches) {
+  ExecutionEngine EE;
+  Placeholder *input, *output;
+  createScaleNet(EE, 4, input, output);
+
+  constexpr unsigned numRequests = 16;
+  std::vector<Tensor> inputs;
+  std::vector<Tensor> outputs;
+  for (unsigned i = 0; i < numRequests; i++) {
+    inputs.emplace_back(ElemKind::FloatTy, llvm::ArrayRef<size_t>{3});
+    inputs.back().getHandle() = {float(i), float(i) + 1, float(i) + 2};
+    outputs.emplace_back(ElemKind::FloatTy, llvm::ArrayRef<size_t>{3});
+  }
+
+  std::vector<std::future<void>> results;
+  {
+    Batcher batcher(EE, {input}, {output}, std::chrono::seconds(10));
+    for (unsigned i = 0; i < numRequests; i++) {
+      results.push_back(batcher.enqueue({&inputs[i]}, {&outputs[i]}));
+    }
+    for (auto &result : results) {
+      result.wait();
+    }
+  }
+
+  for (unsigned i = 0; i < numRequests; i++) {
+    auto H = outputs[i].getHandle();
+    for (size_t j = 0; j < 3; j++) {
+      EXPECT_EQ(H.at({j}), 2 * (float(i) + j) + 1);
+    }
+  }
+}
+
+/// Check that a partial batch is flushed once the latency deadline expires.
+TEST(Batcher, latencyDeadline) {
+  ExecutionEngine EE;
+  Placeholder *input, *output;
+  createScaleNet(EE, 8, input, output);
+
+  Batcher batcher(EE, {input}, {output}, std::chrono::milliseconds(1));
+  Tensor in(ElemKind::FloatTy, {3});
+  Tensor out(ElemKind::FloatTy, {3});
+  in.getHandle() = {1, 2, 3};
+  auto result = batcher.enqueue({&in}, {&out});
+  EXPECT_EQ(result.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+
+  auto H = out.getHandle();
+  EXPECT_EQ(H.at({0}), 3);
+  EXPECT_EQ(H.at({1}), 5);
+  EXPECT_EQ(H.at({2}), 7);
+}
+
+/// Check that a repeated request is answered from the result cache without
+/// waiting for a batch.
+TEST(Batcher, resultCache) {
+  ExecutionEngine EE;
+  Placeholder *input, *output;
+  createScaleNet(EE, 8, input, output);
+
+  ResultCache cache(1 << 20);
+  Batcher batcher(EE, {input}, {output}, std::chrono::milliseconds(1), 0,
+                  &cache, 1);
+  Tensor in(ElemKind::FloatTy, {3});
+  Tensor out(ElemKind::FloatTy, {3});
+  in.getHandle() = {1, 2, 3};
+  auto result = batcher.enqueue({&in}, {&out});
+  EXPECT_EQ(result.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+
+  // The second request hits the cache, so its results are written by the
+  // time enqueue returns.
+  Tensor cachedOut(ElemKind::FloatTy, {3});
+  auto cachedResult = batcher.enqueue({&in}, {&cachedOut});
+  EXPECT_EQ(cachedResult.wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  EXPECT_TRUE(cachedOut.isEqual(out, 0));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+}
@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/BucketedFunctionCache.h"
+#include "glow/Graph/Graph.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace glow;
+
+namespace {
+/// Builds a network that computes input * input for batches of 2 elements.
+void buildSquareNet(Function *F, size_t batchSize,
+                    std::vector<Placeholder *> &inputs,
+                    std::vector<Placeholder *> &outputs) {
+  auto &mod = *F->getParent();
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 2},
+                                      "input", false);
+  auto *output = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 2},
+                                       "output", false);
+  auto *mul = F->createMul("mul", input, input);
+  F->createSave("ret", mul, output);
+  inputs.push_back(input);
+  outputs.push_back(output);
+}
+
+/// Run \p cache on a batch of \p batchSize samples and check the results.
+void checkBatch(BucketedFunctionCache &cache, size_t batchSize) {
+  Tensor input(ElemKind::FloatTy, {batchSize, 2});
+  Tensor output(ElemKind::FloatTy, {batchSize, 2});
+  auto IH = input.getHandle();
+  for (size_t i = 0; i < IH.size(); i++) {
+    IH.raw(i) = float(i);
+  }
+  cache.run({&input}, {&output});
+  auto OH = output.getHandle();
+  for (size_t i = 0; i < OH.size(); i++) {
+    EXPECT_EQ(OH.raw(i), float(i) * float(i));
+  }
+}
+} // namespace
+
+TEST(BucketedFunctionCache, bucketSelection) {
+  BucketedFunctionCache cache(buildSquareNet, {16, 1, 4});
+  EXPECT_EQ(cache.getBucketSize(1), 1);
+  EXPECT_EQ(cache.getBucketSize(2), 4);
+  EXPECT_EQ(cache.getBucketSize(4), 4);
+  EXPECT_EQ(cache.getBucketSize(5), 16);
+  EXPECT_EQ(cache.getBucketSize(100), 16);
+}
+
+/// Check that the buckets are compiled lazily, reused, and that the padding
+/// does not leak into the results.
+TEST(BucketedFunctionCache, paddedRuns) {
+  BucketedFunctionCache cache(buildSquareNet, {1, 4, 16});
+  EXPECT_EQ(cache.getNumCompiledBuckets(), 0);
+
+  checkBatch(cache, 3);
+  EXPECT_EQ(cache.getNumCompiledBuckets(), 1);
+  checkBatch(cache, 4);
+  EXPECT_EQ(cache.getNumCompiledBuckets(), 1);
+  checkBatch(cache, 1);
+  EXPECT_EQ(cache.getNumCompiledBuckets(), 2);
+
+  // Larger batches are split into chunks of the largest bucket.
+  checkBatch(cache, 37);
+  EXPECT_EQ(cache.getNumCompiledBuckets(), 3);
+}
@@ -0,0 +1,407 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BundleSaver.h"
+
+#include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Graph/Graph.h"
+#include "glow/Support/Float16.h"
+#include "glow/Support/Random.h"
+
+#include "gtest/gtest.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace glow;
+
+extern "C" {
+// Forward declare functions from libjit.
+extern size_t libjit_decompress_weights(const uint8_t *src, size_t srcSize,
+                                        uint8_t *dest, size_t destSize);
+}
+
+/// Decode the compressed weights file \p file into \p out, which has
+/// \p destSize bytes. \returns the result of libjit_decompress_weights.
+static size_t decompress(llvm::StringRef file, size_t destSize,
+                         std::vector<char> &out) {
+  out.assign(destSize, '\x55');
+  return libjit_decompress_weights(
+      reinterpret_cast<const uint8_t *>(file.data()), file.size(),
+      reinterpret_cast<uint8_t *>(out.data()), out.size());
+}
+
+/// \returns an area of \p size bytes of random bytes, interrupted by runs of
+/// zeros of various lengths, and ending with \p trailingZeros zeros.
+static std::vector<char> createWeightsImage(size_t size, size_t trailingZeros,
+                                            PseudoRNG &PRNG) {
+  std::vector<char> image(size);
+  for (auto &byte : image) {
+    byte = PRNG.nextRandInt(1, 255);
+  }
+  size_t pos = 0;
+  for (size_t run : {1, 31, 32, 33, 100, 700}) {
+    pos += PRNG.nextRandInt(1, 64);
+    std::fill(image.begin() + pos, image.begin() + pos + run, 0);
+    pos += run;
+  }
+  EXPECT_LE(pos + trailingZeros, size);
+  std::fill(image.end() - trailingZeros, image.end(), 0);
+  return image;
+}
+
+/// The sparse files decode to the area, whatever the lengths of the runs of
+/// zeros, including the one at the end, and however many records the runs
+/// need.
+TEST(BundleWeights, sparseRoundTrip) {
+  PseudoRNG PRNG;
+  for (size_t trailingZeros : {0, 1, 5, 32, 200}) {
+    auto image = createWeightsImage(4096, trailingZeros, PRNG);
+    for (size_t maxRecordCount : {size_t(7), size_t(16), size_t(1000),
+                                  maxWeightsRecordCount}) {
+      auto file = compressBundleWeights(image, {}, maxRecordCount);
+      std::vector<char> out;
+      EXPECT_EQ(decompress(file, image.size(), out), image.size());
+      EXPECT_EQ(out, image);
+      // The large runs of zeros take a few bytes only.
+      if (maxRecordCount == maxWeightsRecordCount) {
+        EXPECT_LT(file.size(), image.size() - 700);
+      }
+    }
+  }
+}
+
+/// The fp16 files decode the floats to their values rounded to half
+/// precision, and the other bytes to themselves.
+TEST(BundleWeights, float16RoundTrip) {
+  PseudoRNG PRNG;
+  constexpr size_t numFloats = 1000;
+  for (size_t trailingZeros : {0, 3, 64}) {
+    auto image = createWeightsImage(numFloats * 2 * sizeof(float),
+                                    trailingZeros, PRNG);
+    std::vector<bool> isFloat(image.size() / sizeof(float), false);
+    std::vector<float> floats(numFloats);
+    for (size_t i = 0; i < numFloats; i++) {
+      floats[i] = i % 100 < 20 ? 0 : PRNG.nextRandReal(-4, 4);
+      isFloat[i] = true;
+    }
+    memcpy(image.data(), floats.data(), numFloats * sizeof(float));
+    for (size_t maxRecordCount :
+         {size_t(5), size_t(64), maxWeightsRecordCount}) {
+      auto file = compressBundleWeights(image, isFloat, maxRecordCount);
+      std::vector<char> out;
+      EXPECT_EQ(decompress(file, image.size(), out), image.size());
+      for (size_t i = 0; i < numFloats; i++) {
+        float value;
+        memcpy(&value, &out[i * sizeof(float)], sizeof(value));
+        EXPECT_EQ(value, halfBitsToFloat(floatToHalfBits(floats[i])));
+      }
+      std::vector<char> rest(image.begin() + numFloats * sizeof(float),
+                             image.end());
+      EXPECT_TRUE(std::equal(rest.begin(), rest.end(),
+                             out.begin() + numFloats * sizeof(float)));
+    }
+  }
+}
+
+/// The decoder rejects the files that are not a complete encoding of an area
+/// that fits into the destination.
+TEST(BundleWeights, rejectMalformedFiles) {
+  PseudoRNG PRNG;
+  auto image = createWeightsImage(2048, 40, PRNG);
+  auto file = compressBundleWeights(image, {});
+  std::vector<char> out;
+  ASSERT_EQ(decompress(file, image.size(), out), image.size());
+  // A larger destination is fine, but not a smaller one.
+  EXPECT_EQ(decompress(file, image.size() + 1, out), image.size());
+  EXPECT_EQ(decompress(file, image.size() - 1, out), 0);
+
+  // The magic and the size are missing or wrong.
+  EXPECT_EQ(decompress(llvm::StringRef(file).take_front(15), image.size(),
+                       out),
+            0);
+  std::string badMagic = file;
+  badMagic[0] = 'X';
+  EXPECT_EQ(decompress(badMagic, image.size(), out), 0);
+
+  // The last record, which is the run of zeros at the end, is missing.
+  EXPECT_EQ(decompress(llvm::StringRef(file).drop_back(4), image.size(), out),
+            0);
+  // A header is cut.
+  EXPECT_EQ(decompress(llvm::StringRef(file).drop_back(2), image.size(), out),
+            0);
+
+  auto appendHeader = [](std::string data, uint32_t kind, uint32_t count) {
+    uint32_t header = (kind << 30) | count;
+    data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    return data;
+  };
+  std::string header(file.data(), 16);
+  // The records decode past the end of the area.
+  EXPECT_EQ(decompress(appendHeader(header, 1, image.size() + 1),
+                       image.size(), out),
+            0);
+  EXPECT_EQ(decompress(appendHeader(file, 1, 1), image.size(), out), 0);
+  // The payload of a record is cut.
+  EXPECT_EQ(decompress(appendHeader(header, 0, 8) + "1234", image.size(),
+                       out),
+            0);
+  EXPECT_EQ(decompress(appendHeader(header, 2, 4) + "1234", image.size(),
+                       out),
+            0);
+  // The kind of the record is unknown.
+  EXPECT_EQ(decompress(appendHeader(header, 3, 1), image.size(), out), 0);
+}
+
+namespace {
+/// Sets the option \p name to \p value, given as on the command line, during
+/// its lifetime, and then to \p restored.
+class ScopedOption final {
+  llvm::cl::Option *option_;
+  std::string name_;
+  std::string restored_;
+  llvm::cl::NumOccurrencesFlag occurrences_;
+
+public:
+  ScopedOption(llvm::StringRef name, llvm::StringRef value,
+               llvm::StringRef restored)
+      : name_(name), restored_(restored) {
+    auto &options = llvm::cl::getRegisteredOptions();
+    auto it = options.find(name);
+    GLOW_ASSERT(it != options.end() && "The option is not registered");
+    option_ = it->second;
+    // The option may be set more than once.
+    occurrences_ = option_->getNumOccurrencesFlag();
+    option_->setNumOccurrencesFlag(llvm::cl::ZeroOrMore);
+    GLOW_ASSERT(!option_->addOccurrence(0, name_, value) && "Invalid value");
+  }
+  ~ScopedOption() {
+    option_->addOccurrence(0, name_, restored_);
+    option_->setNumOccurrencesFlag(occurrences_);
+  }
+};
+
+/// A temporary directory, removed with its contents at the end of its
+/// lifetime.
+class TempDir final {
+  llvm::SmallString<64> path_;
+
+public:
+  TempDir() {
+    auto EC = llvm::sys::fs::createUniqueDirectory("bundle", path_);
+    GLOW_ASSERT(!EC && "Could not create a temporary directory");
+  }
+  ~TempDir() { llvm::sys::fs::remove_directories(path_); }
+  llvm::StringRef path() const { return path_; }
+};
+} // namespace
+
+/// \returns the contents of the file \p path.
+static std::string readFile(const llvm::Twine &path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  GLOW_ASSERT(buffer && "Could not read the file");
+  return buffer.get()->getBuffer().str();
+}
+
+/// \returns the names of the symbols that the object file \p path defines.
+static std::vector<std::string> getDefinedSymbols(const llvm::Twine &path) {
+  auto object = llvm::object::ObjectFile::createObjectFile(path.str());
+  GLOW_ASSERT(object && "Could not read the object file");
+  std::vector<std::string> names;
+  for (const auto &symbol : object->getBinary()->symbols()) {
+#if LLVM_VERSION_MAJOR > 10
+    auto flagsOrErr = symbol.getFlags();
+    GLOW_ASSERT(flagsOrErr && "Could not read the symbol flags");
+    uint32_t flags = *flagsOrErr;
+#else
+    uint32_t flags = symbol.getFlags();
+#endif
+    auto name = symbol.getName();
+    GLOW_ASSERT(name && "Could not read the symbol name");
+    if (!(flags & llvm::object::SymbolRef::SF_Undefined)) {
+      // The symbols of Mach-O files start with an underscore.
+      llvm::StringRef str = *name;
+      str.consume_front("_");
+      names.push_back(str.str());
+    }
+  }
+  return names;
+}
+
+/// \returns the first \p count size_t fields of the variable \p name, which
+/// the object file \p path defines.
+static std::vector<size_t> readSizes(const llvm::Twine &path,
+                                     llvm::StringRef name, size_t count) {
+  auto object = llvm::object::ObjectFile::createObjectFile(path.str());
+  GLOW_ASSERT(object && "Could not read the object file");
+  for (const auto &symbol : object->getBinary()->symbols()) {
+    auto symbolName = symbol.getName();
+    GLOW_ASSERT(symbolName && "Could not read the symbol name");
+    llvm::StringRef str = *symbolName;
+    str.consume_front("_");
+    if (str != name) {
+      continue;
+    }
+    auto section = symbol.getSection();
+    auto address = symbol.getAddress();
+    GLOW_ASSERT(section && address && "Could not locate the symbol");
+#if LLVM_VERSION_MAJOR > 8
+    auto contents = (*section)->getContents();
+    GLOW_ASSERT(contents && "Could not read the section");
+    llvm::StringRef data = *contents;
+#else
+    llvm::StringRef data;
+    GLOW_ASSERT(!(*section)->getContents(data) && "Could not read the section");
+#endif
+    size_t offset = *address - (*section)->getAddress();
+    GLOW_ASSERT(offset + count * sizeof(size_t) <= data.size() &&
+                "The variable is outside of its section");
+    std::vector<size_t> sizes(count);
+    memcpy(sizes.data(), data.data() + offset, count * sizeof(size_t));
+    return sizes;
+  }
+  GLOW_UNREACHABLE("The variable is not defined");
+}
+
+/// Save the bundle "net" of a fully connected layer, whose weights have runs of
+/// zeros, to \p dir.
+static void saveFCBundle(llvm::StringRef dir) {
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("fc");
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 64}, "input",
+                                   VisibilityKind::Public);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {64, 32}, "W",
+                               VisibilityKind::Private, false);
+  auto *B = mod.createVariable(ElemKind::FloatTy, {32}, "B",
+                               VisibilityKind::Private, false);
+  auto WH = W->getPayload().getHandle();
+  WH.randomize(-1, 1, mod.getPRNG());
+  for (size_t i = 0; i < 16 * 32; i++) {
+    WH.raw(i) = 0;
+  }
+  B->getPayload().zero();
+  auto *FC = F->createFullyConnected("fc", input, W, B);
+  F->createSave("ret", FC);
+  EE.save(CompilationMode::Infer, F, dir, "net");
+}
+
+/// The bundles saved with compressed weights export a function that decodes
+/// the weights file into the constant weights of the bundle saved without
+/// compression.
+TEST(BundleWeights, decompressBundleWeights) {
+  TempDir raw;
+  saveFCBundle(raw.path());
+  auto rawWeights = readFile(raw.path() + "/net.weights");
+  auto rawSymbols = getDefinedSymbols(raw.path() + "/net.o");
+  EXPECT_EQ(std::count(rawSymbols.begin(), rawSymbols.end(),
+                       "net_decompress_weights"),
+            0);
+
+  for (const char *mode : {"sparse", "fp16"}) {
+    TempDir compressed;
+    {
+      ScopedOption option("bundle-weights-compression", mode, "none");
+      saveFCBundle(compressed.path());
+    }
+    auto symbols = getDefinedSymbols(compressed.path() + "/net.o");
+    EXPECT_EQ(std::count(symbols.begin(), symbols.end(),
+                         "net_decompress_weights"),
+              1);
+    EXPECT_EQ(std::count(symbols.begin(), symbols.end(), "net"), 1);
+
+    auto weights = readFile(compressed.path() + "/net.weights");
+    EXPECT_LT(weights.size(), rawWeights.size());
+    std::vector<char> out;
+    ASSERT_EQ(decompress(weights, rawWeights.size(), out), rawWeights.size());
+    // The weights are all floats.
+    for (size_t i = 0; i < rawWeights.size(); i += sizeof(float)) {
+      float expected, value;
+      memcpy(&expected, &rawWeights[i], sizeof(float));
+      memcpy(&value, &out[i], sizeof(float));
+      if (llvm::StringRef(mode) == "fp16") {
+        expected = halfBitsToFloat(floatToHalfBits(expected));
+      }
+      EXPECT_EQ(value, expected);
+    }
+  }
+}
+
+/// The entry points of a bundle that holds two functions of a module are
+/// linked into one object file, next to one weights file. Each has its own
+/// config, whose activations sizes differ, while the weights are shared.
+TEST(BundleSaver, severalEntryPoints) {
+  TempDir dir;
+  ExecutionEngine EE(BackendKind::CPU);
+  auto &mod = EE.getModule();
+  auto *input = mod.createVariable(ElemKind::FloatTy, {4, 64}, "input",
+                                   VisibilityKind::Public);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {64, 64}, "W",
+                               VisibilityKind::Private, false);
+  auto *B = mod.createVariable(ElemKind::FloatTy, {64}, "B",
+                               VisibilityKind::Private, false);
+  W->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  B->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  // A single layer.
+  Function *F1 = mod.createFunction("one");
+  F1->createSave("ret", F1->createFullyConnected("fc", input, W, B));
+  // The same layer applied 4 times, with larger activations.
+  Function *F2 = mod.createFunction("four");
+  NodeValue V = input;
+  for (int i = 0; i < 4; i++) {
+    V = F2->createTanh("tanh", F2->createFullyConnected("fc", V, W, B));
+  }
+  F2->createSave("ret", V);
+  EE.save(CompilationMode::Infer, {{F1, "one"}, {F2, "four"}}, dir.path(),
+          "net");
+
+  // One object file and one weights file.
+  std::vector<std::string> files;
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator it(dir.path(), EC), end;
+       !EC && it != end; it.increment(EC)) {
+    files.push_back(llvm::sys::path::filename(it->path()).str());
+  }
+  ASSERT_FALSE(EC);
+  std::sort(files.begin(), files.end());
+  EXPECT_EQ(files, std::vector<std::string>({"net.o", "net.weights"}));
+
+  auto symbols = getDefinedSymbols(dir.path() + "/net.o");
+  for (const char *name : {"one", "four", "one_config", "four_config"}) {
+    EXPECT_EQ(std::count(symbols.begin(), symbols.end(), name), 1) << name;
+  }
+  EXPECT_EQ(std::count(symbols.begin(), symbols.end(), "net_config"), 0);
+
+  // The configs start with the sizes of the constant weights, of the mutable
+  // weights and of the activations.
+  auto one = readSizes(dir.path() + "/net.o", "one_config", 3);
+  auto four = readSizes(dir.path() + "/net.o", "four_config", 3);
+  auto weights = readFile(dir.path() + "/net.weights");
+  EXPECT_EQ(one[0], weights.size());
+  EXPECT_EQ(four[0], weights.size());
+  EXPECT_EQ(one[1], four[1]);
+  EXPECT_LT(one[2], four[2]);
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/DataLoader.h"
+#include "glow/Graph/Graph.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace glow;
+
+namespace {
+/// A dataset whose sample i is the pair (i, 2 * i).
+class CountingSource final : public DataSource {
+  size_t size_;
+
+public:
+  CountingSource(size_t size) : size_(size) {}
+
+  size_t size() const override { return size_; }
+
+  void read(size_t index, llvm::ArrayRef<Tensor *> batch,
+            size_t slot) override {
+    batch[0]->getHandle<>().at({slot, 0}) = index;
+    batch[1]->getHandle<int64_t>().at({slot, 0}) = 2 * index;
+  }
+};
+} // namespace
+
+/// Check that the samples are read in order without shuffling, and that the
+/// reading wraps around at the end of the dataset.
+TEST(DataLoader, inOrder) {
+  Module mod;
+  CountingSource source(10);
+  auto *imageTy = mod.uniqueType(ElemKind::FloatTy, {4, 1});
+  auto *labelTy = mod.uniqueType(ElemKind::Int64ITy, {4, 1});
+  DataLoader loader(source, {imageTy, labelTy}, /* shuffle */ false);
+  EXPECT_EQ(loader.getBatchSize(), 4);
+
+  size_t expected = 0;
+  for (unsigned i = 0; i < 6; i++) {
+    auto batch = loader.next();
+    ASSERT_EQ(batch.size(), 2);
+    for (size_t j = 0; j < 4; j++) {
+      EXPECT_EQ(batch[0]->getHandle<>().at({j, 0}), expected);
+      EXPECT_EQ(batch[1]->getHandle<int64_t>().at({j, 0}), 2 * expected);
+      expected = (expected + 1) % 10;
+    }
+  }
+  EXPECT_GE(loader.getEpoch(), 2);
+}
+
+/// Check that each pass visits every sample exactly once in a shuffled
+/// order, and that the contexts bind the placeholders to the batches.
+TEST(DataLoader, shuffledContexts) {
+  Module mod;
+  CountingSource source(64);
+  auto *image = mod.createPlaceholder(ElemKind::FloatTy, {8, 1}, "image",
+                                      false);
+  auto *label = mod.createPlaceholder(ElemKind::Int64ITy, {8, 1}, "label",
+                                      false);
+  DataLoader loader(source, {image, label}, /* shuffle */ true,
+                    /* numBatches */ 3);
+
+  std::vector<unsigned> seen(64);
+  bool shuffled = false;
+  for (size_t i = 0; i < 8; i++) {
+    Context &ctx = loader.nextContext();
+    auto IH = ctx.get(image)->getHandle<>();
+    auto LH = ctx.get(label)->getHandle<int64_t>();
+    for (size_t j = 0; j < 8; j++) {
+      size_t index = IH.at({j, 0});
+      EXPECT_EQ(LH.at({j, 0}), 2 * index);
+      shuffled |= index != i * 8 + j;
+      seen[index]++;
+    }
+  }
+  for (auto count : seen) {
+    EXPECT_EQ(count, 1);
+  }
+  EXPECT_TRUE(shuffled);
+}
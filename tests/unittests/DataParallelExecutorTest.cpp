@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/DataParallelExecutor.h"
+#include "glow/Graph/Graph.h"
+
+#include "gtest/gtest.h"
+
+#include <numeric>
+#include <vector>
+
+using namespace glow;
+
+namespace {
+/// Builds a network that multiplies samples of 2 elements by 3.
+void buildScaleNet(Function *F, size_t batchSize,
+                   std::vector<Placeholder *> &inputs,
+                   std::vector<Placeholder *> &outputs) {
+  auto &mod = *F->getParent();
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 2},
+                                      "input", false);
+  auto *output = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 2},
+                                       "output", false);
+  auto *weight = mod.createVariable(ElemKind::FloatTy, {batchSize, 2}, "weight",
+                                    VisibilityKind::Private, false);
+  weight->getPayload().getHandle().clear(3);
+  auto *mul = F->createMul("mul", input, weight);
+  F->createSave("ret", mul, output);
+  inputs.push_back(input);
+  outputs.push_back(output);
+}
+
+/// Run \p executor on a batch of \p batchSize samples and check the results.
+void checkBatch(DataParallelExecutor &executor, size_t batchSize) {
+  Tensor input(ElemKind::FloatTy, {batchSize, 2});
+  Tensor output(ElemKind::FloatTy, {batchSize, 2});
+  auto IH = input.getHandle();
+  for (size_t i = 0; i < IH.size(); i++) {
+    IH.raw(i) = float(i);
+  }
+  executor.run({&input}, {&output});
+  auto OH = output.getHandle();
+  for (size_t i = 0; i < OH.size(); i++) {
+    EXPECT_EQ(OH.raw(i), float(i) * 3);
+  }
+}
+} // namespace
+
+TEST(DataParallelExecutor, equalSplitBeforeMeasuring) {
+  DataParallelExecutor executor(buildScaleNet, 2, BackendKind::Interpreter, 3);
+  EXPECT_EQ(executor.getNumDevices(), 3);
+  EXPECT_EQ(executor.getSplit(7), std::vector<size_t>({3, 2, 2}));
+  EXPECT_EQ(executor.getSplit(2), std::vector<size_t>({1, 1, 0}));
+}
+
+TEST(DataParallelExecutor, runSplitBatches) {
+  DataParallelExecutor executor(buildScaleNet, 2, BackendKind::Interpreter, 3);
+  for (size_t batchSize : {1, 2, 7, 16, 5}) {
+    checkBatch(executor, batchSize);
+    // Every sample is assigned to exactly one device.
+    auto split = executor.getSplit(batchSize);
+    EXPECT_EQ(std::accumulate(split.begin(), split.end(), size_t(0)),
+              batchSize);
+  }
+}
+
+TEST(DataParallelExecutor, allDevices) {
+  DataParallelExecutor executor(buildScaleNet, 4, BackendKind::Interpreter);
+  EXPECT_EQ(executor.getNumDevices(), 1);
+  checkBatch(executor, 9);
+}
+
+namespace {
+/// Builds a softmax classifier of samples of 4 elements into 3 classes for
+/// the batch size \p batchSize. The weights are initialized with \p weights
+/// and \p bias, and are returned with the placeholders of the inputs.
+Function *buildClassifier(Module &mod, size_t batchSize, const Tensor &weights,
+                          const Tensor &bias,
+                          std::vector<Placeholder *> &inputs,
+                          std::vector<Variable *> &trained) {
+  Function *F = mod.createFunction("main");
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {batchSize, 4},
+                                      "input", false);
+  auto *selected = mod.createPlaceholder(ElemKind::Int64ITy, {batchSize, 1},
+                                         "selected", false);
+  auto *FC = F->createFullyConnected("fc", input, 3);
+  auto *W = llvm::cast<Variable>(FC->getWeights());
+  auto *B = llvm::cast<Variable>(FC->getBias());
+  W->assign(&weights);
+  B->assign(&bias);
+  auto *SM = F->createSoftMax("softmax", FC, selected);
+  F->createSave("ret", SM);
+  inputs = {input, selected};
+  trained = {W, B};
+  return F;
+}
+} // namespace
+
+/// Check that training with several replicas updates the weights the same way
+/// as training a single function on the whole batch.
+TEST(DataParallelTrainer, matchesSingleFunction) {
+  constexpr size_t numReplicas = 3;
+  constexpr size_t shardSize = 2;
+  constexpr size_t batchSize = numReplicas * shardSize;
+  PseudoRNG PRNG;
+  Tensor weights(ElemKind::FloatTy, {4, 3});
+  Tensor bias(ElemKind::FloatTy, {3});
+  weights.getHandle().randomize(-1, 1, PRNG);
+  bias.getHandle().randomize(-1, 1, PRNG);
+
+  TrainingConfig TC;
+  TC.learningRate = 0.1;
+  TC.momentum = 0.5;
+  TC.batchSize = batchSize;
+
+  Tensor input(ElemKind::FloatTy, {batchSize, 4});
+  Tensor selected(ElemKind::Int64ITy, {batchSize, 1});
+  input.getHandle().randomize(-1, 1, PRNG);
+  for (size_t i = 0; i < batchSize; i++) {
+    selected.getHandle<int64_t>().at({i, 0}) = i % 3;
+  }
+
+  // Train a single function on the whole batch.
+  ExecutionEngine EE;
+  std::vector<Placeholder *> inputs;
+  std::vector<Variable *> expected;
+  Function *F = buildClassifier(EE.getModule(), batchSize, weights, bias,
+                                inputs, expected);
+  Function *TF = glow::differentiate(F, TC);
+  Context ctx;
+  ctx.allocate(inputs[0])->assign(&input);
+  ctx.allocate(inputs[1])->assign(&selected);
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  // Train the replicas on their shards.
+  ExecutionEngine replicaEE;
+  std::vector<Placeholder *> shardInputs;
+  std::vector<Variable *> trained;
+  Function *shardF = buildClassifier(replicaEE.getModule(), shardSize,
+                                     weights, bias, shardInputs, trained);
+  DataParallelTrainer trainer(shardF, shardInputs, TC, numReplicas);
+  EXPECT_EQ(trainer.getNumReplicas(), numReplicas);
+
+  for (unsigned step = 0; step < 4; step++) {
+    EE.run(ctx);
+    trainer.train({&input, &selected});
+    for (size_t i = 0; i < trained.size(); i++) {
+      EXPECT_TRUE(
+          trained[i]->getPayload().isEqual(expected[i]->getPayload(), 1e-5));
+    }
+  }
+  EXPECT_FALSE(trained[0]->getPayload().isEqual(weights));
+}
+
+/// Check that accumulating the gradients of micro-batches updates the weights
+/// the same way as training a single function on the whole batch.
+TEST(MicroBatchTrainer, matchesSingleFunction) {
+  constexpr size_t numMicroBatches = 3;
+  constexpr size_t microBatchSize = 2;
+  constexpr size_t batchSize = numMicroBatches * microBatchSize;
+  PseudoRNG PRNG;
+  Tensor weights(ElemKind::FloatTy, {4, 3});
+  Tensor bias(ElemKind::FloatTy, {3});
+  weights.getHandle().randomize(-1, 1, PRNG);
+  bias.getHandle().randomize(-1, 1, PRNG);
+
+  TrainingConfig TC;
+  TC.learningRate = 0.1;
+  TC.momentum = 0.5;
+  TC.batchSize = batchSize;
+
+  Tensor input(ElemKind::FloatTy, {batchSize, 4});
+  Tensor selected(ElemKind::Int64ITy, {batchSize, 1});
+  input.getHandle().randomize(-1, 1, PRNG);
+  for (size_t i = 0; i < batchSize; i++) {
+    selected.getHandle<int64_t>().at({i, 0}) = i % 3;
+  }
+
+  // Train a single function on the whole batch.
+  ExecutionEngine EE;
+  std::vector<Placeholder *> inputs;
+  std::vector<Variable *> expected;
+  Function *F = buildClassifier(EE.getModule(), batchSize, weights, bias,
+                                inputs, expected);
+  Function *TF = glow::differentiate(F, TC);
+  Context ctx;
+  ctx.allocate(inputs[0])->assign(&input);
+  ctx.allocate(inputs[1])->assign(&selected);
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  // Train on the micro-batches one after another.
+  ExecutionEngine microEE;
+  std::vector<Placeholder *> microInputs;
+  std::vector<Variable *> trained;
+  Function *microF = buildClassifier(microEE.getModule(), microBatchSize,
+                                     weights, bias, microInputs, trained);
+  MicroBatchTrainer trainer(microF, microInputs, TC, numMicroBatches);
+  EXPECT_EQ(trainer.getNumMicroBatches(), numMicroBatches);
+
+  for (unsigned step = 0; step < 4; step++) {
+    EE.run(ctx);
+    trainer.train({&input, &selected});
+    for (size_t i = 0; i < trained.size(); i++) {
+      EXPECT_TRUE(
+          trained[i]->getPayload().isEqual(expected[i]->getPayload(), 1e-5));
+    }
+  }
+  EXPECT_FALSE(trained[0]->getPayload().isEqual(weights));
+}
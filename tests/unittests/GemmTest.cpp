@@ -26,7 +26,9 @@
 #include "gtest/gtest.h"
 
 #include <cassert>
+#include <cmath>
 #include <string>
+#include <vector>
 
 using namespace glow;
 using llvm::cast;
@@ -36,6 +38,15 @@ extern "C" {
 extern void libjit_matmul_f(float *c, const float *a, const float *b,
                             const size_t *cDims, const size_t *aDims,
                             const size_t *bDims);
+extern void libjit_matmul_avx2_f(float *c, const float *a, const float *b,
+                                 const size_t *cDims, const size_t *aDims,
+                                 const size_t *bDims);
+extern void libjit_matmul_avx512_f(float *c, const float *a, const float *b,
+                                   const size_t *cDims, const size_t *aDims,
+                                   const size_t *bDims);
+extern void libjit_sigmoid_f(const float *inW, float *outW, size_t numElem);
+extern float libjit_tanh_kernel_f(size_t idx, const float *LHS,
+                                  const float *RHS, const float *op3);
 }
 
 void infer(Tensor *out, Tensor *lhs, Tensor *rhs) {
@@ -85,3 +96,51 @@ TEST(Gemm, jitTest) {
     }
   }
 }
+
+/// Check that the target-specific microkernels compute the same result as the
+/// generic one, including ragged edges and sizes that use packing.
+TEST(Gemm, microkernelVariants) {
+  PseudoRNG PRNG;
+
+  for (auto *kernel : {libjit_matmul_avx2_f, libjit_matmul_avx512_f}) {
+    for (size_t m : {1, 6, 14, 33}) {
+      for (size_t n : {16, 31, 1030}) {
+        for (size_t k : {1, 7, 300}) {
+          Tensor lhs(ElemKind::FloatTy, {m, k});
+          Tensor rhs(ElemKind::FloatTy, {k, n});
+          lhs.getHandle().randomize(-1.0, 1.0, PRNG);
+          rhs.getHandle().randomize(-1.0, 1.0, PRNG);
+          Tensor out1(ElemKind::FloatTy, {m, n});
+          Tensor out2(ElemKind::FloatTy, {m, n});
+
+          libjit_matmul_f((float *)out1.getUnsafePtr(),
+                          (float *)lhs.getUnsafePtr(),
+                          (float *)rhs.getUnsafePtr(), out1.dims().data(),
+                          lhs.dims().data(), rhs.dims().data());
+          kernel((float *)out2.getUnsafePtr(), (float *)lhs.getUnsafePtr(),
+                 (float *)rhs.getUnsafePtr(), out2.dims().data(),
+                 lhs.dims().data(), rhs.dims().data());
+
+          EXPECT_TRUE(out1.isEqual(out2, 0.001));
+        }
+      }
+    }
+  }
+}
+
+/// Check that the vectorizable approximations of sigmoid and tanh stay within
+/// their documented absolute errors.
+TEST(Gemm, activationErrorBounds) {
+  std::vector<float> in;
+  for (float x = -30; x <= 30; x += 1.0f / 64) {
+    in.push_back(x);
+  }
+  std::vector<float> out(in.size());
+  libjit_sigmoid_f(in.data(), out.data(), in.size());
+  for (size_t i = 0, e = in.size(); i < e; i++) {
+    double x = in[i];
+    EXPECT_NEAR(out[i], 1 / (1 + std::exp(-x)), 2e-7);
+    EXPECT_NEAR(libjit_tanh_kernel_f(i, in.data(), nullptr, nullptr),
+                std::tanh(x), 3e-7);
+  }
+}
@@ -190,6 +190,34 @@ TEST(Optimizer, copyPropagation) {
       }));
 }
 
+/// Check that a copy is not propagated if its source is redefined while the
+/// destination is still alive.
+TEST(Optimizer, copyPropagationRedefinedSource) {
+  Module mod;
+  Function *F = mod.createFunction("ShareBuffers");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {1, 1}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *alloc1 =
+      bb.createAllocActivationInst("alloc1", glow::ElemKind::FloatTy, {1, 1});
+  auto *alloc2 =
+      bb.createAllocActivationInst("alloc2", glow::ElemKind::FloatTy, {1, 1});
+  bb.createSplatInst("splat1", alloc1, 1.0);
+  bb.createCopyInst("copy", alloc2, alloc1);
+  bb.createSplatInst("splat2", alloc1, 2.0);
+  auto *matmul = bb.createMatMulInst("matmul", output, alloc2, alloc1, false);
+  bb.createDeallocActivationInst("dealloc2", alloc2);
+  bb.createDeallocActivationInst("dealloc1", alloc1);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  // Both values of alloc1 are alive at the matmul.
+  EXPECT_NE(getOrigin(matmul->getLHS()), getOrigin(matmul->getRHS()));
+}
+
 TEST(Optimizer, copyPropagationSimple) {
   Module mod;
   auto *F = mod.createFunction("ShareBuffers");
@@ -249,16 +277,166 @@ TEST(Optimizer, copyPropagationTranspose) {
 
   optimize(M, MockBackend().shouldShareBuffers());
 
-  EXPECT_EQ(M.getInstrs().size(), 5);
+  // The copy of the output of the splat into output2 is forwarded to the splat.
+  EXPECT_EQ(M.getInstrs().size(), 4);
 
   auto &instrs = M.getInstrs();
   EXPECT_TRUE(std::none_of(
       instrs.begin(), instrs.end(), [](const Instruction &I) -> bool {
         return isa<TransposeInst>(&I) || isa<AllocActivationInst>(&I) ||
-               isa<DeallocActivationInst>(&I);
+               isa<DeallocActivationInst>(&I) || isa<CopyInst>(&I);
       }));
 }
 
+/// Check that a result that is copied into an output weight and read
+/// afterwards is computed in the output directly.
+TEST(Optimizer, forwardCopyIntoOutput) {
+  Module mod;
+  Function *F = mod.createFunction("forwardCopyIntoOutput");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {8}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *output1 = bb.createWeightVar(glow::ElemKind::FloatTy, {8}, "output1",
+                                     WeightVar::MutabilityKind::Mutable);
+  auto *output2 = bb.createWeightVar(glow::ElemKind::FloatTy, {8}, "output2",
+                                     WeightVar::MutabilityKind::Mutable);
+
+  auto *alloc =
+      bb.createAllocActivationInst("alloc", glow::ElemKind::FloatTy, {8});
+  auto *tanh = bb.createTanhInst("tanh", alloc, input);
+  bb.createCopyInst("copy", output1, alloc);
+  auto *add = bb.createElementAddInst("add", output2, alloc, input);
+  bb.createDeallocActivationInst("dealloc", alloc);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  EXPECT_EQ(M.getInstrs().size(), 2);
+  EXPECT_EQ(tanh->getDest(), output1);
+  EXPECT_EQ(add->getLHS(), output1);
+}
+
+/// Check that the readers of a copy of a view of an input read the view, until
+/// the copy is overwritten in place.
+TEST(Optimizer, propagateCopyOfView) {
+  Module mod;
+  Function *F = mod.createFunction("propagateCopyOfView");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 8}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *bias = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "bias",
+                                  WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *view = bb.createTensorViewInst(
+      "reshape", input, mod.uniqueType(Type(glow::ElemKind::FloatTy, {16})),
+      {0, 0});
+  bb.createCopyInst("copy", output, view);
+  auto *add = bb.createElementAddInst("add", output, output, bias);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  EXPECT_EQ(add->getLHS(), view);
+  for (auto &I : M.getInstrs()) {
+    EXPECT_FALSE(isa<CopyInst>(&I));
+  }
+}
+
+/// Check that the readers of a copy of a broadcast view that can read the view
+/// read it directly.
+TEST(Optimizer, propagateCopyOfBroadcastView) {
+  Module mod;
+  Function *F = mod.createFunction("propagateCopyOfBroadcastView");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 4}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *bias = bb.createWeightVar(glow::ElemKind::FloatTy, {1, 4}, "bias",
+                                  WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 4}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *view = bb.createTensorViewInst(
+      "broadcast", bias, mod.uniqueType(Type(glow::ElemKind::FloatTy, {2, 4})),
+      {0, 0});
+  auto *alloc =
+      bb.createAllocActivationInst("alloc", glow::ElemKind::FloatTy, {2, 4});
+  bb.createCopyInst("copy", alloc, view);
+  auto *add = bb.createElementAddInst("add", output, input, alloc);
+  bb.createDeallocActivationInst("dealloc", alloc);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  EXPECT_EQ(add->getRHS(), view);
+  for (auto &I : M.getInstrs()) {
+    EXPECT_FALSE(isa<CopyInst>(&I));
+  }
+}
+
+/// Check that a broadcast view is copied for the readers that cannot read it.
+TEST(Optimizer, keepCopyOfBroadcastView) {
+  Module mod;
+  Function *F = mod.createFunction("keepCopyOfBroadcastView");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {1, 4}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *weights = bb.createWeightVar(glow::ElemKind::FloatTy, {4, 2},
+                                     "weights",
+                                     WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 2}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *view = bb.createTensorViewInst(
+      "broadcast", input,
+      mod.uniqueType(Type(glow::ElemKind::FloatTy, {2, 4})), {0, 0});
+  auto *alloc =
+      bb.createAllocActivationInst("alloc", glow::ElemKind::FloatTy, {2, 4});
+  bb.createCopyInst("copy", alloc, view);
+  auto *matmul = bb.createMatMulInst("matmul", output, alloc, weights, false);
+  bb.createDeallocActivationInst("dealloc", alloc);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  EXPECT_EQ(matmul->getLHS(), alloc);
+  EXPECT_EQ(std::count_if(M.getInstrs().begin(), M.getInstrs().end(),
+                          [](const Instruction &I) -> bool {
+                            return isa<CopyInst>(&I);
+                          }),
+            1);
+}
+
+/// Check that a copy is kept if its source changes before the copy is read.
+TEST(Optimizer, keepCopyOfClobberedSource) {
+  Module mod;
+  Function *F = mod.createFunction("keepCopyOfClobberedSource");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {8}, "input",
+                                   WeightVar::MutabilityKind::Mutable);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {8}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *alloc =
+      bb.createAllocActivationInst("alloc", glow::ElemKind::FloatTy, {8});
+  bb.createCopyInst("copy", alloc, input);
+  bb.createSplatInst("splat", input, 0.0);
+  auto *add = bb.createElementAddInst("add", output, alloc, input);
+  bb.createDeallocActivationInst("dealloc", alloc);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  // The add reads both values of input.
+  EXPECT_NE(getOrigin(add->getLHS()), getOrigin(add->getRHS()));
+}
+
 /// Simple test where a single insert is replaced by a tensor view with offsets.
 TEST(Optimizer, insertOptimizer) {
   Module mod;
@@ -337,6 +515,49 @@ TEST(Optimizer, twoInsertsWithBuffersOptimizer) {
       }));
 }
 
+/// Check that inserts along an inner dimension are turned into tensorviews
+/// when the outer dimensions are 1, as the regions that they write are then
+/// contiguous, and are kept otherwise.
+TEST(Optimizer, insertsAlongInnerDimOptimizer) {
+  Module mod;
+  Function *F = mod.createFunction("InsertAlongInnerDimOptimizer");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *output =
+      bb.createWeightVar(glow::ElemKind::FloatTy, {1, 4, 5}, "output",
+                         WeightVar::MutabilityKind::Mutable);
+  auto *strided =
+      bb.createWeightVar(glow::ElemKind::FloatTy, {2, 4, 5}, "strided",
+                         WeightVar::MutabilityKind::Mutable);
+
+  auto *allocSrc1 = bb.createAllocActivationInst(
+      "allocSrc1", glow::ElemKind::FloatTy, {1, 2, 5});
+  auto *allocSrc2 = bb.createAllocActivationInst(
+      "allocSrc2", glow::ElemKind::FloatTy, {2, 2, 5});
+
+  bb.createSplatInst("splatSrc1", allocSrc1, 1.0);
+  bb.createSplatInst("splatSrc2", allocSrc2, 2.0);
+
+  bb.createInsertTensorInst("insert1", output, allocSrc1, {0, 2, 0}, 1, 0);
+  bb.createInsertTensorInst("insert2", strided, allocSrc2, {0, 2, 0}, 1, 0);
+
+  bb.createDeallocActivationInst("deallocSrc2", allocSrc2);
+  bb.createDeallocActivationInst("deallocSrc1", allocSrc1);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  // The first splat writes into a tensorview of the output, while the second
+  // one still needs its buffer and the insert.
+  unsigned numViews = 0, numInserts = 0;
+  for (const auto &I : M.getInstrs()) {
+    numViews += isa<TensorViewInst>(&I);
+    numInserts += isa<InsertTensorInst>(&I);
+  }
+  EXPECT_EQ(numViews, 1);
+  EXPECT_EQ(numInserts, 1);
+}
+
 /// This is representative of what a SliceNode is IRGen'd into: src is the
 /// original source tensor, and then two slices are created into dest1 and
 /// dest2.
@@ -713,3 +934,85 @@ TEST(Optimizer, bufferReuseWithoutDefsPlusCasts) {
   EXPECT_EQ(inputCast ? getOrigin(inputCast) : nullptr, input);
   EXPECT_EQ(inputCast ? inputCast->getOperand(0).first : nullptr, input);
 }
+
+/// Check that a chain of elementwise instructions, each of which is the last
+/// user of its input, is executed in place through a reshaping tensorview.
+TEST(Optimizer, inplaceElementwiseChain) {
+  Module mod;
+  Function *F = mod.createFunction("inplaceElementwiseChain");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {2, 8}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *bias = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "bias",
+                                  WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {16}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *tmp1 =
+      bb.createAllocActivationInst("tmp1", glow::ElemKind::FloatTy, {2, 8});
+  auto *tmp2 =
+      bb.createAllocActivationInst("tmp2", glow::ElemKind::FloatTy, {16});
+  auto *tmp3 =
+      bb.createAllocActivationInst("tmp3", glow::ElemKind::FloatTy, {16});
+  auto *tmp4 =
+      bb.createAllocActivationInst("tmp4", glow::ElemKind::FloatTy, {16});
+  bb.createSigmoidInst("sigmoid", tmp1, input);
+  auto *view = bb.createTensorViewInst(
+      "reshape", tmp1, mod.uniqueType(Type(glow::ElemKind::FloatTy, {16})),
+      {0, 0});
+  bb.createTanhInst("tanh", tmp2, view);
+  bb.createElementAddInst("add", tmp3, tmp2, bias);
+  bb.createElementMulInst("mul", tmp4, tmp3, tmp3);
+  bb.createElementSubInst("sub", output, tmp4, bias);
+  bb.createDeallocActivationInst("dealloc4", tmp4);
+  bb.createDeallocActivationInst("dealloc3", tmp3);
+  bb.createDeallocActivationInst("dealloc2", tmp2);
+  bb.createDeallocActivationInst("dealloc1", tmp1);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  // Every instruction reuses the buffer of its dying input, so the whole
+  // chain runs inside the output weight.
+  for (auto &I : M.getInstrs()) {
+    EXPECT_FALSE(isa<AllocActivationInst>(&I));
+  }
+}
+
+/// Check that quantized elementwise instructions run in place even though the
+/// source and destination differ in their quantization parameters.
+TEST(Optimizer, inplaceQuantizedRescale) {
+  Module mod;
+  Function *F = mod.createFunction("inplaceQuantizedRescale");
+  IRFunction M(F);
+  IRBuilder bb(&M);
+
+  auto *input = bb.createWeightVar(glow::ElemKind::FloatTy, {32}, "input",
+                                   WeightVar::MutabilityKind::Constant);
+  auto *output = bb.createWeightVar(glow::ElemKind::FloatTy, {32}, "output",
+                                    WeightVar::MutabilityKind::Mutable);
+
+  auto *q1 = bb.createAllocActivationInst(
+      "q1", mod.uniqueType(glow::ElemKind::Int8QTy, {32}, 0.5, 3));
+  auto *q2 = bb.createAllocActivationInst(
+      "q2", mod.uniqueType(glow::ElemKind::Int8QTy, {32}, 0.25, -1));
+  auto *q3 = bb.createAllocActivationInst(
+      "q3", mod.uniqueType(glow::ElemKind::Int8QTy, {32}, 0.125, 0));
+  bb.createQuantizeInst("quantize", q1, input);
+  bb.createRescaleQuantizedInst("rescale", q2, q1);
+  bb.createElementAddInst("add", q3, q2, q2);
+  bb.createDequantizeInst("dequantize", output, q3);
+  bb.createDeallocActivationInst("dealloc3", q3);
+  bb.createDeallocActivationInst("dealloc2", q2);
+  bb.createDeallocActivationInst("dealloc1", q1);
+
+  optimize(M, MockBackend().shouldShareBuffers());
+
+  // All of the quantized values share a single buffer.
+  unsigned numAllocs = 0;
+  for (auto &I : M.getInstrs()) {
+    numAllocs += isa<AllocActivationInst>(&I);
+  }
+  EXPECT_EQ(numAllocs, 1);
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/Base/Image.h"
+#include "glow/Base/Tensor.h"
+
+#include "gtest/gtest.h"
+
+using namespace glow;
+
+/// Check that the image \p n of \p batch, in the layout \p layout and the
+/// channel order \p order, is equal to the HWC RGB image \p image.
+static void checkBatchImage(Tensor &batch, size_t n, Tensor &image,
+                            ImageChannelOrder order, ImageLayout layout) {
+  auto BH = batch.getHandle<>();
+  auto IH = image.getHandle<>();
+  size_t height = image.dims()[0];
+  size_t width = image.dims()[1];
+  size_t numChannels = image.dims()[2];
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      for (size_t z = 0; z < numChannels; z++) {
+        size_t c = order == ImageChannelOrder::BGR ? numChannels - 1 - z : z;
+        float value = layout == ImageLayout::NCHW ? BH.at({n, c, y, x})
+                                                  : BH.at({n, y, x, c});
+        EXPECT_EQ(value, IH.at({y, x, z}));
+      }
+    }
+  }
+}
+
+TEST(Image, readPngImage) {
+  Tensor image;
+  ASSERT_FALSE(readPngImage(&image, "tests/images/imagenet/cat_285.png",
+                            {0., 1.}));
+  EXPECT_EQ(image.dims(), llvm::ArrayRef<size_t>({224, 224, 3}));
+  auto H = image.getHandle<>();
+  for (size_t i = 0, e = H.size(); i < e; i++) {
+    EXPECT_GE(H.raw(i), 0.);
+    EXPECT_LE(H.raw(i), 1.);
+  }
+
+  Tensor gray;
+  ASSERT_FALSE(
+      readPngImage(&gray, "tests/images/mnist/0_1009.png", {-1., 1.}));
+  EXPECT_EQ(gray.dims(), llvm::ArrayRef<size_t>({28, 28, 1}));
+
+  EXPECT_TRUE(readPngImage(&image, "tests/images/missing.png", {0., 1.}));
+}
+
+TEST(Image, readPngImageIntoBatch) {
+  const char *files[] = {"tests/images/imagenet/cat_285.png",
+                         "tests/images/imagenet/dog_207.png",
+                         "tests/images/mnist/0_1009.png"};
+  auto range = normModeToRange(ImageNormalizationMode::kneg128to127);
+  for (auto layout : {ImageLayout::NCHW, ImageLayout::NHWC}) {
+    for (auto order : {ImageChannelOrder::BGR, ImageChannelOrder::RGB}) {
+      for (const char *file : files) {
+        Tensor image;
+        ASSERT_FALSE(readPngImage(&image, file, range));
+        size_t height = image.dims()[0];
+        size_t width = image.dims()[1];
+        size_t numChannels = image.dims()[2];
+        Tensor batch(ElemKind::FloatTy,
+                     layout == ImageLayout::NCHW
+                         ? llvm::ArrayRef<size_t>({2, numChannels, height,
+                                                   width})
+                         : llvm::ArrayRef<size_t>({2, height, width,
+                                                   numChannels}));
+        ASSERT_FALSE(readPngImageIntoBatch(&batch, 1, file, range, order,
+                                           layout));
+        checkBatchImage(batch, 1, image, order, layout);
+      }
+    }
+  }
+}
+
+TEST(Image, readPngImageIntoBatchMismatch) {
+  auto range = normModeToRange(ImageNormalizationMode::k0to1);
+  const char *file = "tests/images/imagenet/cat_285.png";
+  Tensor batch(ElemKind::FloatTy, {2, 3, 224, 224});
+  // The image is out of the batch.
+  EXPECT_TRUE(readPngImageIntoBatch(&batch, 2, file, range,
+                                    ImageChannelOrder::BGR, ImageLayout::NCHW));
+  // The batch is not in the NHWC layout.
+  EXPECT_TRUE(readPngImageIntoBatch(&batch, 0, file, range,
+                                    ImageChannelOrder::BGR, ImageLayout::NHWC));
+  // The image is not gray.
+  Tensor grayBatch(ElemKind::FloatTy, {1, 1, 224, 224});
+  EXPECT_TRUE(readPngImageIntoBatch(&grayBatch, 0, file, range,
+                                    ImageChannelOrder::BGR, ImageLayout::NCHW));
+}
@@ -16,11 +16,20 @@
 
 #include "LLVMIRGen.h"
 #include "AllocationsInfo.h"
+#include "CPUBackend.h"
+#include "CPUFunction.h"
 
+#include "glow/Graph/Context.h"
+#include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Support/CompileReport.h"
+#include "glow/Support/ThreadPool.h"
 
 #include "gtest/gtest.h"
 
+#include <cmath>
+
 using namespace glow;
 
 #ifndef GLOW_WITH_CPU
@@ -41,3 +50,684 @@ TEST(LLVMIRGen, getEntryName) {
   llvmIRGen.setMainEntryName("");
   EXPECT_EQ(llvmIRGen.getMainEntryName(), "main");
 }
+
+/// Check that the instrumented code times its instructions and kernels.
+TEST(LLVMIRGen, instrumentTime) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *LHS = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "lhs", false);
+  auto *RHS = mod.createPlaceholder(ElemKind::FloatTy, {8, 16}, "rhs", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 16}, "res", false);
+  ctx.allocate(LHS)->getHandle().clear(1);
+  ctx.allocate(RHS)->getHandle().clear(2);
+  ctx.allocate(res);
+  auto *MM = F->createMatMul("matmul", LHS, RHS);
+  auto *tanh = F->createTanh("tanh", MM);
+  F->createSave("save", tanh, res);
+
+  CPUBackend backend;
+  backend.setInstrumentTime(true);
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  CF->execute(ctx);
+  CF->execute(ctx);
+
+  auto regions = CF->getTimeProfileRegions();
+  auto profile = CF->getTimeProfile();
+  ASSERT_FALSE(regions.empty());
+  ASSERT_EQ(profile.size(), regions.size());
+  EXPECT_EQ(CF->getNumProfiledExecutions(), 2);
+  uint64_t total = 0;
+  bool hasMatMul = false;
+  for (size_t i = 0, e = regions.size(); i < e; i++) {
+    total += profile[i];
+    EXPECT_GT(regions[i].bytes, 0);
+    if (regions[i].flops == 2 * 4 * 16 * 8) {
+      hasMatMul = true;
+    }
+  }
+  EXPECT_GT(total, 0);
+  EXPECT_TRUE(hasMatMul);
+
+  CF->resetTimeProfile();
+  EXPECT_EQ(CF->getNumProfiledExecutions(), 0);
+  EXPECT_EQ(CF->getTimeProfile()[0], 0);
+}
+
+/// Check that data-parallel instructions of the same size are bundled into
+/// one kernel when an independent instruction of another size separates them.
+TEST(LLVMIRGen, nonAdjacentBundles) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *A = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "A", false);
+  auto *C = mod.createPlaceholder(ElemKind::FloatTy, {8, 8}, "C", false);
+  auto *res1 = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res1", false);
+  auto *res2 = mod.createPlaceholder(ElemKind::FloatTy, {8, 8}, "res2", false);
+  auto *res3 = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res3", false);
+  PseudoRNG PRNG;
+  ctx.allocate(A)->getHandle().randomize(-1, 1, PRNG);
+  ctx.allocate(C)->getHandle().randomize(-1, 1, PRNG);
+  ctx.allocate(res1);
+  ctx.allocate(res2);
+  ctx.allocate(res3);
+  F->createSave("save1", F->createTanh("tanh", A), res1);
+  F->createSave("save2", F->createSigmoid("sigmoidC", C), res2);
+  F->createSave("save3", F->createSigmoid("sigmoid", A), res3);
+
+  CPUBackend backend;
+  backend.setInstrumentTime(true);
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  CF->execute(ctx);
+
+  unsigned numKernels = 0;
+  for (const auto &region : CF->getTimeProfileRegions()) {
+    numKernels += region.kind == "DataParallel";
+  }
+  EXPECT_EQ(numKernels, 2);
+  auto AH = ctx.get(A)->getHandle();
+  auto CH = ctx.get(C)->getHandle();
+  for (size_t i = 0; i < AH.size(); i++) {
+    EXPECT_NEAR(ctx.get(res1)->getHandle().raw(i), std::tanh(AH.raw(i)), 1e-5);
+    EXPECT_NEAR(ctx.get(res3)->getHandle().raw(i),
+                1 / (1 + std::exp(-AH.raw(i))), 1e-5);
+  }
+  for (size_t i = 0; i < CH.size(); i++) {
+    EXPECT_NEAR(ctx.get(res2)->getHandle().raw(i),
+                1 / (1 + std::exp(-CH.raw(i))), 1e-5);
+  }
+}
+
+/// Check that the health instrumentation samples the executions and reports
+/// the ranges and the NaNs of the outputs.
+TEST(LLVMIRGen, instrumentHealth) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res", false);
+  auto IH = ctx.allocate(input)->getHandle();
+  for (size_t i = 0, e = IH.size(); i < e; i++) {
+    IH.raw(i) = float(i) - 8;
+  }
+  ctx.allocate(res);
+  auto *add = F->createAdd("add", input, input);
+  F->createSave("save", add, res);
+
+  CPUBackend backend;
+  backend.setInstrumentHealth(true, 2);
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  ASSERT_FALSE(CF->getHealthTensors().empty());
+
+  // Only the first and the third executions are sampled.
+  CF->execute(ctx);
+  EXPECT_EQ(CF->getNumHealthSamples(), 1);
+  auto sample = CF->getHealthSample(0).back();
+  EXPECT_EQ(sample.min, -16);
+  EXPECT_EQ(sample.max, 46);
+  EXPECT_EQ(sample.numFinite, 32);
+  EXPECT_EQ(sample.numNaNs, 0);
+
+  IH.raw(31) = NAN;
+  CF->execute(ctx);
+  EXPECT_EQ(CF->getNumHealthSamples(), 1);
+  CF->execute(ctx);
+  EXPECT_EQ(CF->getNumHealthSamples(), 2);
+  sample = CF->getHealthSample(0).back();
+  EXPECT_EQ(sample.max, 44);
+  EXPECT_EQ(sample.numFinite, 31);
+  EXPECT_EQ(sample.numNaNs, 1);
+  EXPECT_EQ(CF->getHealthSample(1).back().max, 46);
+}
+
+/// Check that a function compiled in tiers computes the same results before
+/// and after it switches to the fully optimized code.
+TEST(LLVMIRGen, tieredCompilation) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 16}, "res", false);
+  auto IH = ctx.allocate(input)->getHandle();
+  for (size_t i = 0, e = IH.size(); i < e; i++) {
+    IH.raw(i) = float(i) / 16 - 1;
+  }
+  ctx.allocate(res);
+  auto *FC = F->createFullyConnected("fc", input, 16);
+  auto *tanh = F->createTanh("tanh", FC);
+  F->createSave("save", tanh, res);
+
+  CPUBackend backend;
+  backend.setTieredCompilation(true);
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  CF->execute(ctx);
+  Tensor quick = ctx.get(res)->clone();
+
+  CF->waitForTierUp();
+  EXPECT_TRUE(CF->hasTieredUp());
+  ctx.get(res)->zero();
+  CF->execute(ctx);
+  EXPECT_TRUE(ctx.get(res)->isEqual(quick));
+}
+
+/// Check that a function reads a variable from the tensor that is bound to it
+/// after the compilation.
+TEST(LLVMIRGen, bindVariable) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res", false);
+  auto *bias = mod.createVariable(ElemKind::FloatTy, {4, 8}, "bias");
+  ctx.allocate(input)->getHandle().clear(1);
+  ctx.allocate(res);
+  bias->getPayload().getHandle().clear(2);
+  auto *add = F->createAdd("add", input, bias);
+  F->createSave("save", add, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  CF->execute(ctx);
+  EXPECT_EQ(ctx.get(res)->getHandle().at({3, 7}), 3);
+
+  Tensor newBias(ElemKind::FloatTy, {4, 8});
+  newBias.getHandle().clear(5);
+  EXPECT_TRUE(CF->bindVariable(bias, &newBias));
+  CF->execute(ctx);
+  EXPECT_EQ(ctx.get(res)->getHandle().at({3, 7}), 6);
+  EXPECT_EQ(bias->getPayload().getHandle().at({3, 7}), 2);
+}
+
+/// Check that the executions with replicated weights compute the results of
+/// the ones with the payloads, and that the replicas are only updated from
+/// the payloads by updateWeights.
+TEST(LLVMIRGen, numaReplicas) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res", false);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {8, 8}, "W",
+                               VisibilityKind::Private, false);
+  auto *bias = mod.createVariable(ElemKind::FloatTy, {4, 8}, "bias",
+                                  VisibilityKind::Private, false);
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(res);
+  W->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  bias->getPayload().getHandle().clear(2);
+  auto *matMul = F->createMatMul("matmul", input, W);
+  auto *add = F->createAdd("add", matMul, bias);
+  F->createSave("save", add, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  CF->execute(ctx);
+  Tensor expected = ctx.get(res)->clone();
+  auto scratch = CF->getMemoryUsage().scratch;
+
+  // The calling thread runs on node 0, whose replica is not the payload.
+  CF->replicateWeightsPerNUMANode(2);
+  EXPECT_EQ(CF->getNumWeightReplicas(), 2);
+  EXPECT_GE(CF->getMemoryUsage().scratch,
+            scratch + 2 * bias->getType()->getSizeInBytes());
+  ctx.get(res)->zero();
+  CF->execute(ctx);
+  EXPECT_TRUE(ctx.get(res)->isEqual(expected, 0));
+  ctx.get(res)->zero();
+  CF->execute();
+  EXPECT_TRUE(ctx.get(res)->isEqual(expected, 0));
+
+  // The payload modified in place is not seen until it is copied.
+  bias->getPayload().getHandle().clear(3);
+  CF->execute(ctx);
+  EXPECT_TRUE(ctx.get(res)->isEqual(expected, 0));
+  CF->updateWeights({bias});
+  CF->execute(ctx);
+  auto H = ctx.get(res)->getHandle();
+  auto EH = expected.getHandle();
+  for (size_t i = 0; i < H.size(); i++) {
+    EXPECT_FLOAT_EQ(H.raw(i), EH.raw(i) + 1);
+  }
+}
+
+/// Check that an execution handle reads and writes the buffers of each call.
+TEST(LLVMIRGen, executionHandle) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res", false);
+  ctx.allocate(input);
+  ctx.allocate(res);
+  auto *tanh = F->createTanh("tanh", input);
+  F->createSave("save", tanh, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  auto handle = CF->createExecutionHandle({input, res});
+
+  Tensor in(ElemKind::FloatTy, {4, 8});
+  Tensor out(ElemKind::FloatTy, {4, 8});
+  for (float value : {0.5f, -1.0f}) {
+    in.getHandle().clear(value);
+    void *buffers[] = {in.getUnsafePtr(), out.getUnsafePtr()};
+    handle->run(buffers);
+    EXPECT_NEAR(out.getHandle().at({3, 7}), std::tanh(value), 1E-5);
+  }
+}
+
+/// Check that Dequantize and Quantize are stacked with the float element-wise
+/// instructions between them into a single data-parallel kernel.
+TEST(LLVMIRGen, fuseQuantizeDequantize) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *qTy = mod.uniqueType(ElemKind::Int8QTy, {64}, 0.25, -3);
+  auto *input = mod.createPlaceholder(qTy, "in", false);
+  auto *bias = mod.createPlaceholder(ElemKind::FloatTy, {64}, "bias", false);
+  auto *res = mod.createPlaceholder(qTy, "res", false);
+  auto IH = ctx.allocate(input)->getHandle<int8_t>();
+  auto BH = ctx.allocate(bias)->getHandle();
+  for (size_t i = 0; i < 64; i++) {
+    IH.raw(i) = int8_t(i) - 32;
+    BH.raw(i) = float(i % 8) / 4;
+  }
+  ctx.allocate(res);
+  auto *DQ = F->createDequantize("dequantize", input);
+  auto *add = F->createAdd("add", DQ, bias);
+  auto *Q = F->createQuantize("quantize", add, qTy);
+  F->createSave("save", Q, res);
+
+  CPUBackend backend;
+  backend.setInstrumentTime(true);
+  auto compiled = backend.compile(F, ctx);
+  auto *CF = static_cast<CPUFunction *>(compiled.get());
+  CF->execute(ctx);
+
+  for (const auto &region : CF->getTimeProfileRegions()) {
+    EXPECT_NE(region.kind, "Quantize");
+    EXPECT_NE(region.kind, "Dequantize");
+  }
+  auto RH = ctx.get(res)->getHandle<int8_t>();
+  for (size_t i = 0; i < 64; i++) {
+    float expected = 0.25 * (IH.raw(i) + 3) + BH.raw(i);
+    EXPECT_EQ(RH.raw(i), int8_t(std::nearbyint(expected / 0.25 - 3)));
+  }
+}
+
+/// Check that the machine code generated in parallel partitions computes the
+/// same results as the code generated in one piece.
+TEST(LLVMIRGen, parallelCodeGen) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 16}, "res", false);
+  auto IH = ctx.allocate(input)->getHandle();
+  for (size_t i = 0, e = IH.size(); i < e; i++) {
+    IH.raw(i) = float(i) / 16 - 1;
+  }
+  ctx.allocate(res);
+  auto *FC1 = F->createFullyConnected("fc1", input, 16);
+  auto *tanh = F->createTanh("tanh", FC1);
+  auto *FC2 = F->createFullyConnected("fc2", tanh, 16);
+  auto *sigmoid = F->createSigmoid("sigmoid", FC2);
+  F->createSave("save", sigmoid, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  backend.compile(F, ctx)->execute(ctx);
+  Tensor expected = ctx.get(res)->clone();
+
+  backend.setCodeGenThreads(4);
+  ctx.get(res)->zero();
+  backend.compile(F, ctx)->execute(ctx);
+  EXPECT_TRUE(ctx.get(res)->isEqual(expected));
+}
+
+/// Check that the identical data-parallel kernels of two layers of the same
+/// shape are emitted once, and that the results do not change.
+TEST(LLVMIRGen, shareKernels) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {4, 8}, "res", false);
+  PseudoRNG PRNG;
+  auto IH = ctx.allocate(input)->getHandle();
+  IH.randomize(-1, 1, PRNG);
+  ctx.allocate(res);
+  auto *W1 = mod.createVariable(ElemKind::FloatTy, {8, 8}, "W1");
+  auto *W2 = mod.createVariable(ElemKind::FloatTy, {8, 8}, "W2");
+  W1->getPayload().getHandle().randomize(-1, 1, PRNG);
+  W2->getPayload().getHandle().randomize(-1, 1, PRNG);
+  auto *tanh1 = F->createTanh("tanh1", F->createMatMul("mm1", input, W1));
+  auto *tanh2 = F->createTanh("tanh2", F->createMatMul("mm2", tanh1, W2));
+  F->createSave("save", tanh2, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  CompileReport report;
+  {
+    CompileReportScope scope(report);
+    backend.compile(F, ctx)->execute(ctx);
+  }
+  bool shared = false;
+  for (const auto &phase : report.getPhases()) {
+    if (phase.name == "share kernels") {
+      shared = true;
+      EXPECT_LT(phase.sizeAfter, phase.sizeBefore);
+    }
+  }
+  EXPECT_TRUE(shared);
+
+  // Compute the layers by hand.
+  auto W1H = W1->getPayload().getHandle();
+  auto W2H = W2->getPayload().getHandle();
+  auto RH = ctx.get(res)->getHandle();
+  for (size_t i = 0; i < 4; i++) {
+    float hidden[8];
+    for (size_t j = 0; j < 8; j++) {
+      float sum = 0;
+      for (size_t k = 0; k < 8; k++) {
+        sum += IH.at({i, k}) * W1H.at({k, j});
+      }
+      hidden[j] = std::tanh(sum);
+    }
+    for (size_t j = 0; j < 8; j++) {
+      float sum = 0;
+      for (size_t k = 0; k < 8; k++) {
+        sum += hidden[k] * W2H.at({k, j});
+      }
+      EXPECT_NEAR(RH.at({i, j}), std::tanh(sum), 1e-5);
+    }
+  }
+}
+
+/// Check that the convolution executed on the thread pool and the pooling are
+/// specialized for their constant dimensions, although the convolution is
+/// called with the runtime range of the samples of a chunk.
+TEST(LLVMIRGen, shapeSpecialization) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {4, 8, 8, 8}, "in", false);
+  auto *res =
+      mod.createPlaceholder(ElemKind::FloatTy, {4, 4, 4, 16}, "res", false);
+  ctx.allocate(input);
+  ctx.allocate(res);
+  auto *conv = F->createConv("conv", input, 16, 3, 1, 1, 1);
+  auto *pool = F->createMaxPool("pool", conv, 2, 2, 0);
+  F->createSave("save", pool, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  auto IR = generateAndOptimizeIR(F, true, backend.getSchedulerKind());
+  AllocationsInfo allocationsInfo;
+  LLVMIRGen irgen(IR.get(), allocationsInfo, "");
+  irgen.initTargetMachine("", llvm::CodeModel::Model::Large);
+  irgen.initCodeGen();
+  allocationsInfo.numberValues(IR.get());
+  allocationsInfo.allocateActivations(IR.get());
+  allocationsInfo.allocateWeightVars(IR.get(), ctx, true);
+  allocationsInfo.allocateTensorViews(IR.get());
+  ThreadPool threads(2);
+  irgen.setThreadPool(&threads);
+  irgen.performCodeGen();
+
+  const auto &stats = irgen.getSpecializationStats();
+  auto convStats = stats.lookup("libjit_convolution_samples_f");
+  EXPECT_EQ(convStats.numCalls, 1);
+  EXPECT_EQ(convStats.numSpecializations, 1);
+  auto poolStats = stats.lookup("libjit_max_pool_f");
+  EXPECT_EQ(poolStats.numCalls, 1);
+  EXPECT_EQ(poolStats.numSpecializations, 1);
+}
+
+/// Check that the weights of the next layers are prefetched as long as they
+/// fit the budget, and that the results do not change.
+TEST(LLVMIRGen, weightPrefetch) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input = mod.createPlaceholder(ElemKind::FloatTy, {1, 64}, "in", false);
+  auto *res = mod.createPlaceholder(ElemKind::FloatTy, {1, 64}, "res", false);
+  PseudoRNG PRNG;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, PRNG);
+  ctx.allocate(res);
+  // Every layer has 16KB of weights.
+  Node *layer = input;
+  for (unsigned i = 0; i < 3; i++) {
+    layer = F->createTanh("tanh", F->createFullyConnected("fc", layer, 64));
+  }
+  F->createSave("save", layer, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  backend.compile(F, ctx)->execute(ctx);
+  Tensor expected = ctx.get(res)->clone();
+
+  // Before the first layer, the weights of the two others fit in 40KB.
+  auto IR = generateAndOptimizeIR(F, true, backend.getSchedulerKind());
+  AllocationsInfo allocationsInfo;
+  LLVMIRGen irgen(IR.get(), allocationsInfo, "");
+  irgen.initTargetMachine("", llvm::CodeModel::Model::Large);
+  irgen.initCodeGen();
+  allocationsInfo.numberValues(IR.get());
+  allocationsInfo.allocateActivations(IR.get());
+  allocationsInfo.allocateWeightVars(IR.get(), ctx, true);
+  allocationsInfo.allocateTensorViews(IR.get());
+  irgen.setWeightPrefetchBudget(40 << 10);
+  irgen.performCodeGen();
+  auto *prefetchVar =
+      irgen.getModule().getNamedGlobal(LLVMIRGen::getPrefetchWeightsVarName());
+  ASSERT_TRUE(prefetchVar);
+  // The optimizations may share the loads of the variable between the calls.
+  unsigned numPrefetches = 0;
+  for (auto *load : prefetchVar->users()) {
+    for (auto *user : load->users()) {
+      numPrefetches += llvm::isa<llvm::CallInst>(user);
+    }
+  }
+  EXPECT_EQ(numPrefetches, 2);
+
+  backend.setWeightPrefetchBudget(40 << 10);
+  ctx.get(res)->zero();
+  backend.compile(F, ctx)->execute(ctx);
+  EXPECT_TRUE(ctx.get(res)->isEqual(expected));
+}
+
+/// Check that a chain of convolutions, activations and pools that is tiled
+/// into strips computes the same results as the untiled chain.
+TEST(LLVMIRGen, spatialTiling) {
+  Module mod;
+  Function *F = mod.createFunction("main");
+  Context ctx;
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {1, 30, 12, 8}, "in", false);
+  auto *res =
+      mod.createPlaceholder(ElemKind::FloatTy, {1, 7, 3, 16}, "res", false);
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(res);
+  Node *N = F->createConv("conv1", input, 16, 3, 1, 1, 1);
+  N = F->createRELU("relu", N);
+  N = F->createConv("conv2", N, 16, 3, 2, 1, 1);
+  N = F->createTanh("tanh", N);
+  N = F->createMaxPool("pool", N, 3, 2, 0);
+  F->createSave("save", N, res);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  Function *untiled = F->clone("untiled");
+  backend.transformPostLowering(untiled, CompilationMode::Infer);
+  backend.compile(untiled, ctx)->execute(ctx);
+  Tensor expected = ctx.get(res)->clone();
+
+  backend.setSpatialTilingCacheSize(4096);
+  EXPECT_TRUE(backend.transformPostLowering(F, CompilationMode::Infer));
+  ::glow::optimize(F, CompilationMode::Infer);
+  size_t numConcats = 0;
+  for (auto &node : F->getNodes()) {
+    numConcats += llvm::isa<ConcatNode>(&node);
+  }
+  EXPECT_EQ(numConcats, 1);
+  ctx.get(res)->zero();
+  backend.compile(F, ctx)->execute(ctx);
+  EXPECT_TRUE(ctx.get(res)->isEqual(expected));
+}
+
+/// Check that the clustered weights of a fully connected layer and of an
+/// embedding table give the results of the float weights when they have few
+/// distinct values, and close ones otherwise.
+TEST(LLVMIRGen, weightClustering) {
+  for (unsigned codeBits : {4u, 8u}) {
+    Module mod;
+    Function *F = mod.createFunction("main");
+    Context ctx;
+    auto *input =
+        mod.createPlaceholder(ElemKind::FloatTy, {3, 201}, "in", false);
+    auto *indices =
+        mod.createPlaceholder(ElemKind::Int64ITy, {6}, "indices", false);
+    auto *lengths =
+        mod.createPlaceholder(ElemKind::Int64ITy, {2}, "lengths", false);
+    auto *fcRes =
+        mod.createPlaceholder(ElemKind::FloatTy, {3, 50}, "fcRes", false);
+    auto *tableRes =
+        mod.createPlaceholder(ElemKind::FloatTy, {2, 31}, "tableRes", false);
+    ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+    ctx.allocate(indices)->getHandle<int64_t>() = {0, 5, 7, 99, 42, 5};
+    ctx.allocate(lengths)->getHandle<int64_t>() = {2, 4};
+    ctx.allocate(fcRes);
+    ctx.allocate(tableRes);
+
+    auto *fc = F->createFullyConnected("fc", input, 50);
+    auto *table = mod.createVariable(ElemKind::FloatTy, {100, 31}, "table",
+                                     VisibilityKind::Private, false);
+    auto *weights = mod.createVariable(ElemKind::FloatTy, {6}, "weights",
+                                       VisibilityKind::Private, false);
+    weights->getHandle() = {0.5, -1, 0.25, 1, 2, -0.5};
+    // The 4-bit codebook holds the 9 distinct values exactly.
+    for (auto *W : {llvm::cast<Variable>(fc->getWeights()), table}) {
+      auto WH = W->getHandle();
+      if (codeBits == 4) {
+        for (size_t i = 0, e = WH.size(); i < e; i++) {
+          WH.raw(i) = int((i * 37) % 9) * 0.03 - 0.12;
+        }
+      } else {
+        WH.randomize(-0.2, 0.2, mod.getPRNG());
+      }
+    }
+    auto *SLWS = F->createSparseLengthsWeightedSum("slws", table, weights,
+                                                   indices, lengths);
+    F->createSave("saveFC", fc, fcRes);
+    F->createSave("saveTable", SLWS, tableRes);
+
+    CPUBackend backend;
+    ::glow::lower(F, backend);
+    ::glow::optimize(F, CompilationMode::Infer);
+    backend.compile(F, ctx)->execute(ctx);
+    Tensor expectedFC = ctx.get(fcRes)->clone();
+    Tensor expectedTable = ctx.get(tableRes)->clone();
+
+    backend.setWeightClustering(codeBits, 1000);
+    EXPECT_TRUE(backend.transformPostLowering(F, CompilationMode::Infer));
+    ::glow::optimize(F, CompilationMode::Infer);
+    size_t numClustered = 0;
+    for (auto &node : F->getNodes()) {
+      numClustered +=
+          llvm::isa<CPUClusteredMatMulNode>(&node) ||
+          llvm::isa<CPUClusteredSparseLengthsWeightedSumNode>(&node);
+    }
+    EXPECT_EQ(numClustered, 2);
+    ctx.get(fcRes)->zero();
+    ctx.get(tableRes)->zero();
+    backend.compile(F, ctx)->execute(ctx);
+    float tolerance = codeBits == 4 ? 0.0001 : 0.05;
+    EXPECT_TRUE(ctx.get(fcRes)->isEqual(expectedFC, tolerance));
+    EXPECT_TRUE(ctx.get(tableRes)->isEqual(expectedTable, tolerance));
+  }
+}
+
+/// Check that the weight gradient matmul of a FullyConnected reads its
+/// transposed input in place and computes the bias gradient in the same
+/// node.
+TEST(LLVMIRGen, transposedLHSMatMul) {
+  Module mod;
+  Function *F = mod.createFunction("F");
+  Context ctx;
+  auto *x = mod.createPlaceholder(ElemKind::FloatTy, {70, 37}, "x", false);
+  auto *dout =
+      mod.createPlaceholder(ElemKind::FloatTy, {70, 45}, "dout", false);
+  auto *dwRes = mod.createPlaceholder(ElemKind::FloatTy, {37, 45}, "dw", false);
+  auto *dbRes = mod.createPlaceholder(ElemKind::FloatTy, {45}, "db", false);
+  auto XH = ctx.allocate(x)->getHandle();
+  auto DH = ctx.allocate(dout)->getHandle();
+  XH.randomize(-1, 1, mod.getPRNG());
+  DH.randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(dwRes);
+  ctx.allocate(dbRes);
+
+  auto *xT = F->createTranspose("xT", x, {1, 0});
+  auto *dw = F->createMatMul("dw", xT, dout);
+  auto *db = F->createBatchedReduceAdd("db", dout, /* axis */ 0);
+  F->createSave("saveDW", dw, dwRes);
+  F->createSave("saveDB", db, dbRes);
+
+  CPUBackend backend;
+  ::glow::lower(F, backend);
+  ::glow::optimize(F, CompilationMode::Infer);
+  EXPECT_TRUE(backend.transformPostLowering(F, CompilationMode::Infer));
+  ::glow::optimize(F, CompilationMode::Infer);
+  size_t numTransposedLHS = 0;
+  for (auto &node : F->getNodes()) {
+    numTransposedLHS += llvm::isa<CPUTransposedLHSMatMulNode>(&node);
+    EXPECT_FALSE(llvm::isa<TransposeNode>(&node));
+    EXPECT_FALSE(llvm::isa<BatchedReduceAddNode>(&node));
+  }
+  EXPECT_EQ(numTransposedLHS, 1);
+  backend.compile(F, ctx)->execute(ctx);
+
+  auto DWH = ctx.get(dwRes)->getHandle();
+  auto DBH = ctx.get(dbRes)->getHandle();
+  for (size_t j = 0; j < 45; j++) {
+    float bias = 0;
+    for (size_t p = 0; p < 70; p++) {
+      bias += DH.at({p, j});
+    }
+    EXPECT_NEAR(DBH.at({j}), bias, 1e-4);
+    for (size_t i = 0; i < 37; i++) {
+      float sum = 0;
+      for (size_t p = 0; p < 70; p++) {
+        sum += XH.at({p, i}) * DH.at({p, j});
+      }
+      EXPECT_NEAR(DWH.at({i, j}), sum, 1e-4);
+    }
+  }
+}
@@ -15,6 +15,7 @@
  */
 
 #include "BackendTestUtils.h"
+#include "OpenCL.h"
 
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Graph.h"
@@ -24,6 +25,23 @@
 
 #include "gtest/gtest.h"
 
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+
+#if defined(__APPLE__) || defined(__MACOSX)
+#include "OpenCL/opencl.h"
+#else
+#include <CL/cl.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 using namespace glow;
 using llvm::cast;
 
@@ -154,3 +172,386 @@ TEST(OpenCLCorrectnessTest, tanhConcatTest) {
 
   EXPECT_TRUE(out1.isEqual(out2));
 }
+
+TEST(OpenCLCorrectnessTest, reshapeSliceTest) {
+  PseudoRNG PRNG;
+  Tensor input(ElemKind::FloatTy, {4, 6});
+  input.getHandle().initXavier(1, PRNG);
+  Tensor out1;
+  Tensor out2;
+
+  inferReshapeSliceNet(&input, &out1, BackendKind::OpenCL);
+  inferReshapeSliceNet(&input, &out2, BackendKind::Interpreter);
+
+  EXPECT_TRUE(out1.isEqual(out2));
+}
+
+/// The sizes of the tensors below are not multiples of the vector sizes, so
+/// that the last work items of the vectorized kernels compute the remainders.
+TEST(OpenCLCorrectnessTest, unalignedElementwiseTest) {
+  PseudoRNG PRNG;
+  for (size_t size : {5, 13, 37, 1001}) {
+    Tensor cond(ElemKind::FloatTy, {size});
+    Tensor lhs(ElemKind::FloatTy, {size});
+    Tensor rhs(ElemKind::FloatTy, {size});
+    auto condH = cond.getHandle();
+    for (size_t i = 0; i < size; i++) {
+      condH.raw(i) = PRNG.nextRandInt(0, 1);
+    }
+    lhs.getHandle().initXavier(1, PRNG);
+    rhs.getHandle().initXavier(1, PRNG);
+    Tensor out1;
+    Tensor out2;
+
+    inferMaxNet(&lhs, &rhs, &out1, BackendKind::OpenCL);
+    inferMaxNet(&lhs, &rhs, &out2, BackendKind::Interpreter);
+    EXPECT_TRUE(out1.isEqual(out2));
+
+    inferSelectNet(&cond, &lhs, &rhs, &out1, BackendKind::OpenCL);
+    inferSelectNet(&cond, &lhs, &rhs, &out2, BackendKind::Interpreter);
+    EXPECT_TRUE(out1.isEqual(out2));
+  }
+}
+
+TEST(OpenCLCorrectnessTest, unalignedQuantizedElementwiseTest) {
+  PseudoRNG PRNG;
+  for (size_t size : {5, 13, 37, 1001}) {
+    Tensor lhs(ElemKind::Int8QTy, {size}, 0.875, -1);
+    Tensor rhs(ElemKind::Int8QTy, {size}, 1.4, 5);
+    lhs.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    rhs.getHandle<int8_t>().randomize(-128, 127, PRNG);
+    Tensor add1(ElemKind::Int8QTy, {size}, 1.5, -3);
+    Tensor add2(ElemKind::Int8QTy, {size}, 1.5, -3);
+    Tensor mul1(ElemKind::Int8QTy, {size}, 120, 2);
+    Tensor mul2(ElemKind::Int8QTy, {size}, 120, 2);
+
+    inferQuantizedAddMulNet(&lhs, &rhs, &add1, &mul1, BackendKind::OpenCL);
+    inferQuantizedAddMulNet(&lhs, &rhs, &add2, &mul2,
+                            BackendKind::Interpreter);
+    EXPECT_TRUE(add1.isEqual(add2, 1.0));
+    EXPECT_TRUE(mul1.isEqual(mul2, 1.0));
+  }
+}
+
+namespace {
+/// Sets the option \p name of the OpenCL functions compiled during its
+/// lifetime to \p value.
+template <typename T> class ScopedOption final {
+  llvm::cl::opt<T> *option_;
+  T saved_;
+
+public:
+  ScopedOption(llvm::StringRef name, T value) {
+    auto &options = llvm::cl::getRegisteredOptions();
+    auto it = options.find(name);
+    GLOW_ASSERT(it != options.end() && "The option is not registered");
+    option_ = static_cast<llvm::cl::opt<T> *>(it->second);
+    saved_ = *option_;
+    option_->setValue(value);
+  }
+  ~ScopedOption() { option_->setValue(saved_); }
+};
+} // namespace
+
+/// The number of rows of the input of inferFCChain().
+static constexpr size_t kChainBatch = 4;
+/// The number of features of the layers of inferFCChain().
+static constexpr size_t kChainWidth = 256;
+
+/// Run once per input of \p inputs a chain of fully connected layers with the
+/// weights \p weights and the biases \p biases, whose first layer is applied
+/// again at the end, on the backend \p kind. The runs are made one after the
+/// other, or from one thread each if \p concurrently is true, each with its
+/// own context. The results of the runs are stored to \p out. \returns the
+/// names of the memory usages of the compilation.
+static std::vector<std::string>
+inferFCChain(llvm::ArrayRef<Tensor> weights, llvm::ArrayRef<Tensor> biases,
+             llvm::ArrayRef<Tensor> inputs, Tensor *out, BackendKind kind,
+             bool concurrently = false) {
+  ExecutionEngine EE(kind);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("chain");
+  auto *input = mod.createPlaceholder(
+      ElemKind::FloatTy, {kChainBatch, kChainWidth}, "input", false);
+  auto *output = mod.createPlaceholder(
+      ElemKind::FloatTy, {kChainBatch, kChainWidth}, "output", false);
+  std::vector<Variable *> W, B;
+  for (size_t i = 0, e = weights.size(); i < e; i++) {
+    W.push_back(mod.createVariable(ElemKind::FloatTy,
+                                   {kChainWidth, kChainWidth},
+                                   "W" + std::to_string(i),
+                                   VisibilityKind::Private, false));
+    B.push_back(mod.createVariable(ElemKind::FloatTy, {kChainWidth},
+                                   "B" + std::to_string(i),
+                                   VisibilityKind::Private, false));
+    W[i]->getPayload().assign(&weights[i]);
+    B[i]->getPayload().assign(&biases[i]);
+  }
+  NodeValue V = input;
+  for (size_t i = 0, e = W.size(); i <= e; i++) {
+    size_t layer = i % e;
+    V = F->createTanh("tanh", F->createFullyConnected("fc", V, W[layer],
+                                                      B[layer]));
+  }
+  F->createSave("ret", V, output);
+
+  Context ctx;
+  ctx.allocate(input);
+  ctx.allocate(output);
+  EE.compile(CompilationMode::Infer, F, ctx);
+  std::vector<Context> contexts(inputs.size());
+  auto runChain = [&](size_t r) {
+    contexts[r].allocate(input)->assign(&inputs[r]);
+    contexts[r].allocate(output)->zero();
+    EE.run(contexts[r]);
+  };
+  std::vector<std::thread> threads;
+  for (size_t r = 0, e = inputs.size(); r < e; r++) {
+    if (concurrently) {
+      threads.emplace_back(runChain, r);
+    } else {
+      runChain(r);
+    }
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (size_t r = 0, e = inputs.size(); r < e; r++) {
+    out[r].assign(contexts[r].get(output));
+  }
+  std::vector<std::string> names;
+  for (const auto &memory : EE.getCompileReport().getMemoryUsage()) {
+    names.push_back(memory.name);
+  }
+  return names;
+}
+
+/// \returns true if \p names contains \p name.
+static bool contains(llvm::ArrayRef<std::string> names, llvm::StringRef name) {
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+/// The 2 MiB of weights do not fit in the 1 MiB of device memory, so they are
+/// streamed through a pool that holds a few of them: the weights are evicted
+/// during each run and uploaded again by the following layers and runs.
+TEST(OpenCLCorrectnessTest, streamedWeightsTest) {
+  PseudoRNG PRNG;
+  constexpr size_t numLayers = 8;
+  std::vector<Tensor> weights, biases, inputs;
+  for (size_t i = 0; i < numLayers; i++) {
+    weights.emplace_back(ElemKind::FloatTy,
+                         std::initializer_list<size_t>{kChainWidth,
+                                                       kChainWidth});
+    weights.back().getHandle().initXavier(kChainWidth, PRNG);
+    biases.emplace_back(ElemKind::FloatTy,
+                        std::initializer_list<size_t>{kChainWidth});
+    biases.back().getHandle().randomize(-0.1, 0.1, PRNG);
+  }
+  for (size_t r = 0; r < 2; r++) {
+    inputs.emplace_back(ElemKind::FloatTy,
+                        std::initializer_list<size_t>{kChainBatch,
+                                                      kChainWidth});
+    inputs.back().getHandle().randomize(-1, 1, PRNG);
+  }
+  Tensor out1[2], out2[2];
+
+  {
+    ScopedOption<unsigned> limit("opencl-device-memory-limit", 1);
+    EXPECT_TRUE(
+        contains(inferFCChain(weights, biases, inputs, out1,
+                              BackendKind::OpenCL),
+                 "streamed weights pool"));
+  }
+  EXPECT_FALSE(
+      contains(inferFCChain(weights, biases, inputs, out2,
+                            BackendKind::Interpreter),
+               "streamed weights pool"));
+
+  for (size_t r = 0; r < 2; r++) {
+    EXPECT_TRUE(out1[r].isEqual(out2[r], 0.001));
+  }
+}
+
+/// The runs of a context upload their inputs through the staging buffers,
+/// before they wait for the run on the device. The concurrent runs share the
+/// staging buffers, or wait for one, and compute the results of the runs made
+/// without them.
+TEST(OpenCLCorrectnessTest, stagingBuffersTest) {
+  PseudoRNG PRNG;
+  constexpr size_t numLayers = 2;
+  constexpr size_t numRuns = 6;
+  std::vector<Tensor> weights, biases, inputs;
+  for (size_t i = 0; i < numLayers; i++) {
+    weights.emplace_back(ElemKind::FloatTy,
+                         std::initializer_list<size_t>{kChainWidth,
+                                                       kChainWidth});
+    weights.back().getHandle().initXavier(kChainWidth, PRNG);
+    biases.emplace_back(ElemKind::FloatTy,
+                        std::initializer_list<size_t>{kChainWidth});
+    biases.back().getHandle().randomize(-0.1, 0.1, PRNG);
+  }
+  for (size_t r = 0; r < numRuns; r++) {
+    inputs.emplace_back(ElemKind::FloatTy,
+                        std::initializer_list<size_t>{kChainBatch,
+                                                      kChainWidth});
+    inputs.back().getHandle().randomize(-1, 1, PRNG);
+  }
+  Tensor expected[numRuns];
+  EXPECT_FALSE(contains(inferFCChain(weights, biases, inputs, expected,
+                                     BackendKind::Interpreter),
+                        "pinned staging buffers"));
+
+  for (unsigned numBuffers : {0, 1, 2}) {
+    ScopedOption<unsigned> buffers("opencl-staging-buffers", numBuffers);
+    for (bool concurrently : {false, true}) {
+      Tensor out[numRuns];
+      auto names = inferFCChain(weights, biases, inputs, out,
+                                BackendKind::OpenCL, concurrently);
+      // The device buffer is not in host memory without -opencl-zero-copy.
+      EXPECT_EQ(contains(names, "pinned staging buffers"), numBuffers != 0);
+      EXPECT_EQ(contains(names, "device staging buffers"), numBuffers != 0);
+      for (size_t r = 0; r < numRuns; r++) {
+        EXPECT_TRUE(out[r].isEqual(expected[r], 0.001));
+      }
+    }
+  }
+}
+
+/// With -opencl-zero-copy, the tensors of getMappedTensor() are the regions
+/// of the device buffer. A context that binds them is run in place: the input
+/// written to them is read by the kernels and the output is found in them.
+/// The other tensors are still copied, into and out of the host memory.
+TEST(OpenCLCorrectnessTest, zeroCopyTest) {
+  ScopedOption<bool> zeroCopy("opencl-zero-copy", true);
+  Module mod;
+  Function *F = mod.createFunction("main");
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {4, 16}, "input", false);
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {4, 16}, "output", false);
+  F->createSave("ret", F->createTanh("tanh", input), output);
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(output);
+  Tensor expected(ElemKind::FloatTy, {4, 16});
+  for (size_t i = 0, e = expected.size(); i < e; i++) {
+    expected.getHandle().raw(i) =
+        std::tanh(ctx.get(input)->getHandle().raw(i));
+  }
+
+  OCLBackend backend;
+  auto compiled = backend.compile(F, ctx);
+  auto *OF = static_cast<OpenCLFunction *>(compiled.get());
+  Tensor mappedInput = OF->getMappedTensor(input);
+  Tensor mappedOutput = OF->getMappedTensor(output);
+  if (!mappedInput.isUnowned()) {
+    // The device does not share memory with the host.
+    EXPECT_FALSE(mappedOutput.isUnowned());
+    return;
+  }
+  ASSERT_TRUE(mappedInput.getType().isEqual(*input->getType()));
+  ASSERT_TRUE(mappedOutput.getType().isEqual(*output->getType()));
+
+  // Copied tensors.
+  OF->execute(ctx);
+  EXPECT_TRUE(ctx.get(output)->isEqual(expected, 0.0001));
+
+  // Mapped tensors.
+  Context mapped;
+  mapped.insert(input, mappedInput.getUnowned(input->dims()));
+  mapped.insert(output, mappedOutput.getUnowned(output->dims()));
+  mappedInput.copyRawFrom(ctx.get(input));
+  mappedOutput.zero();
+  OF->execute(mapped);
+  EXPECT_TRUE(mappedOutput.isEqual(expected, 0.0001));
+  EXPECT_EQ(mapped.get(output)->getUnsafePtr(), mappedOutput.getUnsafePtr());
+
+  // A mapped input with a copied output.
+  ctx.get(output)->zero();
+  Context mixed;
+  mixed.insert(input, mappedInput.getUnowned(input->dims()));
+  mixed.insert(output, ctx.get(output)->clone());
+  OF->execute(mixed);
+  EXPECT_TRUE(mixed.get(output)->isEqual(expected, 0.0001));
+}
+
+/// \returns true if the first device of the first platform, which the
+/// backend uses by default, has cl_khr_fp16.
+static bool defaultDeviceHasFP16() {
+  cl_platform_id platform;
+  cl_device_id device;
+  EXPECT_EQ(clGetPlatformIDs(1, &platform, nullptr), CL_SUCCESS);
+  EXPECT_EQ(
+      clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, nullptr),
+      CL_SUCCESS);
+  size_t size;
+  EXPECT_EQ(
+      clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &size),
+      CL_SUCCESS);
+  std::string extensions(size, '\0');
+  EXPECT_EQ(clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size,
+                            &extensions[0], nullptr),
+            CL_SUCCESS);
+  llvm::SmallVector<llvm::StringRef, 32> names;
+  llvm::StringRef(extensions.c_str()).split(names, ' ', -1, false);
+  return std::find(names.begin(), names.end(), "cl_khr_fp16") != names.end();
+}
+
+/// The half precision arithmetic kernels are only compiled for the devices
+/// with cl_khr_fp16, so the backend must only claim the operators there, and
+/// then compute them with half precision values. Moving and converting half
+/// precision values is supported everywhere.
+TEST(OpenCLCorrectnessTest, float16ArithmeticTest) {
+  bool hasFP16 = defaultDeviceHasFP16();
+  std::unique_ptr<Backend> backend(createBackend(BackendKind::OpenCL, 0));
+  for (auto kind :
+       {Kinded::Kind::AddNodeKind, Kinded::Kind::SubNodeKind,
+        Kinded::Kind::MulNodeKind, Kinded::Kind::DivNodeKind,
+        Kinded::Kind::MinNodeKind, Kinded::Kind::MaxNodeKind,
+        Kinded::Kind::SplatNodeKind}) {
+    EXPECT_EQ(backend->isOpSupported(kind, ElemKind::Float16Ty), hasFP16);
+  }
+  for (auto kind :
+       {Kinded::Kind::ConvertToNodeKind, Kinded::Kind::ConcatNodeKind,
+        Kinded::Kind::ReshapeNodeKind, Kinded::Kind::SliceNodeKind,
+        Kinded::Kind::TransposeNodeKind}) {
+    EXPECT_TRUE(backend->isOpSupported(kind, ElemKind::Float16Ty));
+  }
+  if (!hasFP16) {
+    return;
+  }
+
+  // Not a multiple of the vector sizes, so that the remainders are computed.
+  constexpr size_t size = 37;
+  ExecutionEngine EE(BackendKind::OpenCL);
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A = mod.createVariable(ElemKind::Float16Ty, {size}, "A",
+                               VisibilityKind::Public);
+  auto *B = mod.createVariable(ElemKind::Float16Ty, {size}, "B",
+                               VisibilityKind::Public);
+  A->getPayload().getHandle<float16_t>().randomize(-1, 1, mod.getPRNG());
+  B->getPayload().getHandle<float16_t>().randomize(1, 2, mod.getPRNG());
+  auto AH = A->getPayload().getHandle<float16_t>();
+  auto BH = B->getPayload().getHandle<float16_t>();
+
+  // R = max(min((A + B) * A - B, 1), A) / B.
+  auto *one = F->createSplat("one", A->getType(), 1);
+  auto *add = F->createAdd("add", A, B);
+  auto *mul = F->createMul("mul", add, A);
+  auto *sub = F->createSub("sub", mul, B);
+  auto *min = F->createMin("min", sub, one);
+  auto *max = F->createMax("max", min, A);
+  auto *div = F->createDiv("div", max, B);
+  auto *save = F->createSave("save", div);
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+
+  auto RH = save->getVariable()->getPayload().getHandle<float16_t>();
+  for (size_t i = 0; i < size; i++) {
+    float a = AH.raw(i), b = BH.raw(i);
+    float expected = std::max(std::min((a + b) * a - b, 1.0f), a) / b;
+    EXPECT_NEAR(float(RH.raw(i)), expected, 0.01);
+  }
+}
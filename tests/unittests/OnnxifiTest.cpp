@@ -0,0 +1,288 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Base.h"
+
+#include "glow/Support/Memory.h"
+
+#include "onnx/onnx.pb.h"
+
+#include "gtest/gtest.h"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace glow;
+using namespace glow::onnxifi;
+
+/// The number of elements of the input and of the output of the test model.
+static constexpr size_t kSize = 16;
+
+/// Make \p V a float tensor of \p size elements named \p name.
+static void setFloatVector(ONNX_NAMESPACE::ValueInfoProto *V, const char *name,
+                           size_t size) {
+  V->set_name(name);
+  auto *type = V->mutable_type()->mutable_tensor_type();
+  type->set_elem_type(ONNX_NAMESPACE::TensorProto::FLOAT);
+  type->mutable_shape()->add_dim()->set_dim_value(size);
+}
+
+/// \returns the serialized ONNX model that computes y = Relu(x), for a float
+/// input x of \p size elements.
+static std::string getReluModel(size_t size = kSize) {
+  ONNX_NAMESPACE::ModelProto model;
+  model.set_ir_version(3);
+  model.add_opset_import()->set_version(7);
+  auto *graph = model.mutable_graph();
+  graph->set_name("relu");
+  auto *node = graph->add_node();
+  node->set_op_type("Relu");
+  node->set_name("relu");
+  node->add_input("x");
+  node->add_output("y");
+  setFloatVector(graph->add_input(), "x", size);
+  setFloatVector(graph->add_output(), "y", size);
+  std::string bytes;
+  model.SerializeToString(&bytes);
+  return bytes;
+}
+
+/// Make \p V a float tensor of the shape \p dims named \p name. The
+/// dimensions that are 0 are left unknown.
+static void setFloatTensor(ONNX_NAMESPACE::ValueInfoProto *V, const char *name,
+                           llvm::ArrayRef<size_t> dims) {
+  V->set_name(name);
+  auto *type = V->mutable_type()->mutable_tensor_type();
+  type->set_elem_type(ONNX_NAMESPACE::TensorProto::FLOAT);
+  auto *shape = type->mutable_shape();
+  for (auto d : dims) {
+    auto *dim = shape->add_dim();
+    if (d) {
+      dim->set_dim_value(d);
+    }
+  }
+}
+
+/// \returns the serialized ONNX model that computes y = MatMul(a, b), for
+/// float inputs of the shapes [\p m, \p k] and [\p k, \p n].
+static std::string getMatMulModel(size_t m, size_t k, size_t n) {
+  ONNX_NAMESPACE::ModelProto model;
+  model.set_ir_version(3);
+  model.add_opset_import()->set_version(7);
+  auto *graph = model.mutable_graph();
+  graph->set_name("matmul");
+  auto *node = graph->add_node();
+  node->set_op_type("MatMul");
+  node->set_name("matmul");
+  node->add_input("a");
+  node->add_input("b");
+  node->add_output("y");
+  setFloatTensor(graph->add_input(), "a", {m, k});
+  setFloatTensor(graph->add_input(), "b", {k, n});
+  setFloatTensor(graph->add_output(), "y", {m, n});
+  std::string bytes;
+  model.SerializeToString(&bytes);
+  return bytes;
+}
+
+/// \returns the descriptor of the float buffer \p data of the shape \p shape
+/// named \p name.
+static onnxTensorDescriptorV1 getDescriptor(const char *name, float *data,
+                                            const uint64_t *shape) {
+  onnxTensorDescriptorV1 desc;
+  desc.tag = ONNXIFI_TAG_TENSOR_DESCRIPTOR_V1;
+  desc.name = name;
+  desc.dataType = ONNXIFI_DATATYPE_FLOAT32;
+  desc.memoryType = ONNXIFI_MEMORY_TYPE_CPU;
+  desc.dimensions = 1;
+  desc.shape = shape;
+  desc.buffer = reinterpret_cast<onnxPointer>(data);
+  return desc;
+}
+
+/// Two inferences are queued with different buffers before either input
+/// fence is signalled. Each of them must read and write the buffers that were
+/// set when it was queued, whether the buffers back the placeholders or are
+/// copied, and whichever fence is signalled first.
+TEST(Onnxifi, inFlightRunsKeepTheirIO) {
+  std::string model = getReluModel();
+  const uint64_t shape[] = {kSize};
+  for (bool unaligned : {false, true}) {
+    BackendId backendId(BackendKind::Interpreter, 0);
+    Backend backend(&backendId);
+    Graph graph(&backend);
+    ASSERT_EQ(graph.initGraph(model.data(), model.size(), 0, nullptr),
+              ONNXIFI_STATUS_SUCCESS);
+
+    // The buffers of the two runs, which start one float past the alignment
+    // of the tensor payloads when they must be copied.
+    size_t offset = unaligned ? 1 : 0;
+    size_t bytes = (kSize + 1) * sizeof(float);
+    float *memory[4];
+    float *in[2], *out[2];
+    for (size_t i = 0; i < 4; i++) {
+      memory[i] = static_cast<float *>(alignedAlloc(bytes, TensorAlignment));
+    }
+    for (size_t r = 0; r < 2; r++) {
+      in[r] = memory[r] + offset;
+      out[r] = memory[2 + r] + offset;
+      for (size_t i = 0; i < kSize; i++) {
+        // The first run has negative inputs at the even indices, the second
+        // one at the odd indices.
+        in[r][i] = ((i + r) % 2 ? 1.0f : -1.0f) * (i + 1) * (r + 1);
+        out[r][i] = -100;
+      }
+    }
+
+    Event inputEvents[2], outputEvents[2];
+    for (size_t r = 0; r < 2; r++) {
+      auto inDesc = getDescriptor("x", in[r], shape);
+      auto outDesc = getDescriptor("y", out[r], shape);
+      ASSERT_EQ(graph.setIO(1, &inDesc, 1, &outDesc), ONNXIFI_STATUS_SUCCESS);
+      graph.runAfter(&inputEvents[r], &outputEvents[r]);
+    }
+    // The second run is ready first, but must use its own buffers and start
+    // after the first one.
+    inputEvents[1].signal();
+    inputEvents[0].signal();
+    outputEvents[0].wait();
+    outputEvents[1].wait();
+
+    for (size_t r = 0; r < 2; r++) {
+      for (size_t i = 0; i < kSize; i++) {
+        EXPECT_EQ(out[r][i], std::max(in[r][i], 0.0f));
+      }
+    }
+    for (size_t i = 0; i < 4; i++) {
+      alignedFree(memory[i]);
+    }
+  }
+}
+
+/// The callers of a graph do not wait for its inferences in flight: setIO and
+/// runAfter return while an earlier inference of the same graph runs, even
+/// when another inference waits for it to copy its inputs.
+TEST(Onnxifi, runAfterReturnsWhileRunInFlight) {
+  // Large enough for an inference to take much longer than the calls.
+  constexpr size_t size = 1 << 22;
+  std::string model = getReluModel(size);
+  const uint64_t shape[] = {size};
+  BackendId backendId(BackendKind::Interpreter, 0);
+  Backend backend(&backendId);
+  Graph graph(&backend);
+  ASSERT_EQ(graph.initGraph(model.data(), model.size(), 0, nullptr),
+            ONNXIFI_STATUS_SUCCESS);
+
+  // The input is one float past the alignment of the tensor payloads, so it
+  // is copied, and the second inference, which has the same bindings, waits
+  // for the first one before copying it.
+  size_t bytes = (size + 1) * sizeof(float);
+  float *memory[3];
+  for (size_t i = 0; i < 3; i++) {
+    memory[i] = static_cast<float *>(alignedAlloc(bytes, TensorAlignment));
+  }
+  float *in = memory[0] + 1;
+  float *out[2] = {memory[1], memory[2]};
+  for (size_t i = 0; i < size; i++) {
+    in[i] = i % 2 ? 1.0f : -1.0f;
+  }
+
+  Event inputEvents[3], outputEvents[3];
+  auto inDesc = getDescriptor("x", in, shape);
+  auto outDesc = getDescriptor("y", out[0], shape);
+  ASSERT_EQ(graph.setIO(1, &inDesc, 1, &outDesc), ONNXIFI_STATUS_SUCCESS);
+  for (size_t r = 0; r < 2; r++) {
+    inputEvents[r].signal();
+    graph.runAfter(&inputEvents[r], &outputEvents[r]);
+  }
+  // Let the workers submit the first inference.
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  outDesc = getDescriptor("y", out[1], shape);
+  ASSERT_EQ(graph.setIO(1, &inDesc, 1, &outDesc), ONNXIFI_STATUS_SUCCESS);
+  graph.runAfter(&inputEvents[2], &outputEvents[2]);
+  EXPECT_FALSE(outputEvents[0].isSignalled());
+
+  inputEvents[2].signal();
+  for (size_t r = 0; r < 3; r++) {
+    outputEvents[r].wait();
+  }
+  for (size_t r = 0; r < 2; r++) {
+    EXPECT_EQ(out[r][0], 0);
+    EXPECT_EQ(out[r][size - 1], 1);
+  }
+  EXPECT_EQ(graph.getRunProfile().numRuns, 3u);
+
+  for (size_t i = 0; i < 3; i++) {
+    alignedFree(memory[i]);
+  }
+}
+
+/// The cost of an element-wise operator is one operation per element and
+/// the bytes of its input and output, and the cost of a matmul counts a
+/// multiply and an add per element of the reduced dimension.
+TEST(Onnxifi, estimateOperatorCost) {
+  NodeCost cost;
+  std::string model = getReluModel(1000);
+  ASSERT_TRUE(
+      ModelLoader::estimateOperatorCost(model.data(), model.size(), cost));
+  EXPECT_EQ(cost.flops, 1000u);
+  EXPECT_EQ(cost.bytes, 2 * 1000 * sizeof(float));
+
+  model = getMatMulModel(3, 5, 7);
+  ASSERT_TRUE(
+      ModelLoader::estimateOperatorCost(model.data(), model.size(), cost));
+  EXPECT_EQ(cost.flops, 2u * 3 * 5 * 7);
+  EXPECT_EQ(cost.bytes, (3 * 5 + 5 * 7 + 3 * 7) * sizeof(float));
+
+  // The cost of an operator with an unknown dimension cannot be estimated.
+  model = getMatMulModel(0, 5, 7);
+  EXPECT_FALSE(
+      ModelLoader::estimateOperatorCost(model.data(), model.size(), cost));
+}
+
+/// Small operators are not worth the overhead of an offloaded run on the
+/// CPU and OpenCL backends, large ones are, and the Interpreter takes every
+/// operator that it supports.
+TEST(Onnxifi, isOffloadProfitable) {
+  NodeCost small, large;
+  std::string model = getReluModel(kSize);
+  ASSERT_TRUE(
+      ModelLoader::estimateOperatorCost(model.data(), model.size(), small));
+  model = getMatMulModel(256, 256, 256);
+  ASSERT_TRUE(
+      ModelLoader::estimateOperatorCost(model.data(), model.size(), large));
+
+  std::vector<BackendKind> kinds;
+#ifdef GLOW_WITH_CPU
+  kinds.push_back(BackendKind::CPU);
+#endif // GLOW_WITH_CPU
+#ifdef GLOW_WITH_OPENCL
+  kinds.push_back(BackendKind::OpenCL);
+#endif // GLOW_WITH_OPENCL
+  for (auto kind : kinds) {
+    BackendId backendId(kind, 0);
+    EXPECT_FALSE(backendId.isOffloadProfitable(small));
+    EXPECT_TRUE(backendId.isOffloadProfitable(large));
+  }
+  BackendId interpreter(BackendKind::Interpreter, 0);
+  EXPECT_TRUE(interpreter.isOffloadProfitable(small));
+  EXPECT_TRUE(interpreter.isOffloadProfitable(large));
+}
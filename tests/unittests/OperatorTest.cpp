@@ -25,6 +25,11 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
 using namespace glow;
 
 class Operator : public ::testing::TestWithParam<BackendKind> {
@@ -79,6 +84,40 @@ TEST_P(Operator, pow) {
   EXPECT_NEAR(HZ.at({1}), 0.01, 1E-5);
 }
 
+/// Check the elementwise sum of several inputs, including a repeated input
+/// and a sum of a single input.
+TEST_P(Operator, variadicSum) {
+  std::vector<NodeValue> inputs;
+  for (size_t i = 0; i < 4; i++) {
+    auto *X = mod_.createVariable(ElemKind::FloatTy, {3, 37},
+                                  "X" + std::to_string(i));
+    X->getPayload().getHandle().randomize(-10, 10, mod_.getPRNG());
+    inputs.push_back(X);
+  }
+  inputs.push_back(inputs[1]);
+
+  auto *S1 = F_->createSum("sum", inputs);
+  auto *S2 = F_->createSum("single", {inputs[0]});
+  auto *Save1 = F_->createSave("save", S1);
+  auto *Save2 = F_->createSave("save", S2);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H1 = llvm::cast<Variable>(Save1->getOutput())->getPayload().getHandle();
+  auto H2 = llvm::cast<Variable>(Save2->getOutput())->getPayload().getHandle();
+  for (size_t i = 0, e = H1.size(); i < e; i++) {
+    float expected = 0;
+    for (auto &in : inputs) {
+      expected += llvm::cast<Variable>(in.getNode())->getHandle().raw(i);
+    }
+    EXPECT_NEAR(H1.raw(i), expected, 1E-4);
+    EXPECT_EQ(H2.raw(i),
+              llvm::cast<Variable>(inputs[0].getNode())->getHandle().raw(i));
+  }
+}
+
 TEST_P(InterpAndCPU, log) {
   auto *X = mod_.createVariable(ElemKind::FloatTy, {6}, "X");
   auto XH = X->getPayload().getHandle();
@@ -146,6 +185,143 @@ TEST_P(Operator, matmul) {
   EXPECT_NEAR(H.at({2, 0}), 95, 0.001);
 }
 
+/// Check that a MatMul reads a transposed RHS in place, with sizes that leave
+/// ragged edges around the blocks of the kernels.
+TEST_P(Operator, matmulTransposedRHS) {
+  const size_t M = 37, K = 70, N = 50;
+  auto *lhs = mod_.createVariable(ElemKind::FloatTy, {M, K}, "lhs",
+                                  VisibilityKind::Public);
+  auto *rhs = mod_.createVariable(ElemKind::FloatTy, {N, K}, "rhs",
+                                  VisibilityKind::Public);
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {M, N}, "result");
+  auto LH = lhs->getPayload().getHandle();
+  auto RH = rhs->getPayload().getHandle();
+  LH.randomize(-1, 1, mod_.getPRNG());
+  RH.randomize(-1, 1, mod_.getPRNG());
+
+  auto *MM = F_->createMatMul("MM", lhs, rhs, /* transposeRHS */ true);
+  F_->createSave("save", MM, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H = result->getPayload().getHandle();
+  for (size_t m = 0; m < M; m++) {
+    for (size_t n = 0; n < N; n++) {
+      float sum = 0;
+      for (size_t k = 0; k < K; k++) {
+        sum += LH.at({m, k}) * RH.at({n, k});
+      }
+      EXPECT_NEAR(H.at({m, n}), sum, 1e-4);
+    }
+  }
+}
+
+/// Check that floats survive a conversion to half precision and back, up to
+/// the rounding to half precision.
+TEST_P(InterpAndCPU, convertToFloat16) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {4, 7}, "input",
+                                    VisibilityKind::Public);
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {4, 7}, "result");
+  auto IH = input->getPayload().getHandle();
+  IH.randomize(-100, 100, mod_.getPRNG());
+
+  auto *half = F_->createConvertTo("half", input, ElemKind::Float16Ty);
+  auto *back = F_->createConvertTo("back", half, ElemKind::FloatTy);
+  F_->createSave("save", back, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H = result->getPayload().getHandle();
+  for (size_t i = 0, e = H.size(); i < e; i++) {
+    EXPECT_EQ(H.raw(i), float(float16_t(IH.raw(i))));
+  }
+}
+
+/// Check that a MatMul with weights that are stored in half precision computes
+/// the product with the expanded weights.
+TEST_P(InterpAndCPU, matmulFloat16Weights) {
+  const size_t M = 5, K = 24, N = 40;
+  auto *lhs = mod_.createVariable(ElemKind::FloatTy, {M, K}, "lhs",
+                                  VisibilityKind::Public);
+  auto *weights = mod_.createVariable(ElemKind::Float16Ty, {K, N}, "weights");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {M, N}, "result");
+  auto LH = lhs->getPayload().getHandle();
+  LH.randomize(-1, 1, mod_.getPRNG());
+  weights->getPayload().getHandle<float16_t>().randomize(-1, 1,
+                                                         mod_.getPRNG());
+  // The backend may repack the weights.
+  Tensor W = weights->getPayload().clone();
+  auto WH = W.getHandle<float16_t>();
+
+  auto *CT = F_->createConvertTo("expand", weights, ElemKind::FloatTy);
+  auto *MM = F_->createMatMul("MM", lhs, CT);
+  F_->createSave("save", MM, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H = result->getPayload().getHandle();
+  for (size_t m = 0; m < M; m++) {
+    for (size_t n = 0; n < N; n++) {
+      float sum = 0;
+      for (size_t k = 0; k < K; k++) {
+        sum += LH.at({m, k}) * WH.at({k, n});
+      }
+      EXPECT_NEAR(H.at({m, n}), sum, 1e-4);
+    }
+  }
+}
+
+/// Check that a MatMul with weights that are stored in bfloat16 computes the
+/// product with the widened weights, and that floats survive a conversion to
+/// bfloat16 and back up to the rounding to bfloat16.
+TEST_P(InterpAndCPU, matmulBFloat16Weights) {
+  const size_t M = 5, K = 24, N = 40;
+  auto *lhs = mod_.createVariable(ElemKind::FloatTy, {M, K}, "lhs",
+                                  VisibilityKind::Public);
+  auto *weights = mod_.createVariable(ElemKind::BFloat16Ty, {K, N}, "weights");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {M, N}, "result");
+  auto *roundTrip = mod_.createVariable(ElemKind::FloatTy, {M, K}, "round");
+  auto LH = lhs->getPayload().getHandle();
+  LH.randomize(-1, 1, mod_.getPRNG());
+  weights->getPayload().getHandle<bfloat16_t>().randomize(-1, 1,
+                                                          mod_.getPRNG());
+  // The backend may repack the weights.
+  Tensor W = weights->getPayload().clone();
+  auto WH = W.getHandle<bfloat16_t>();
+
+  auto *CT = F_->createConvertTo("expand", weights, ElemKind::FloatTy);
+  auto *MM = F_->createMatMul("MM", lhs, CT);
+  F_->createSave("save", MM, result);
+  auto *narrow = F_->createConvertTo("narrow", lhs, ElemKind::BFloat16Ty);
+  auto *back = F_->createConvertTo("back", narrow, ElemKind::FloatTy);
+  F_->createSave("saveRound", back, roundTrip);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H = result->getPayload().getHandle();
+  for (size_t m = 0; m < M; m++) {
+    for (size_t n = 0; n < N; n++) {
+      float sum = 0;
+      for (size_t k = 0; k < K; k++) {
+        sum += LH.at({m, k}) * WH.at({k, n});
+      }
+      EXPECT_NEAR(H.at({m, n}), sum, 1e-4);
+    }
+  }
+  auto RH = roundTrip->getPayload().getHandle();
+  for (size_t i = 0, e = RH.size(); i < e; i++) {
+    EXPECT_EQ(RH.raw(i), float(bfloat16_t(LH.raw(i))));
+  }
+}
+
 /// Test that the broadcasted batch mat mul operator works as expected.
 TEST_P(Operator, BroadcastedBatchMatMul) {
   auto *lhs = mod_.createVariable(ElemKind::FloatTy, {2, 3, 2}, "lhs");
@@ -195,6 +371,350 @@ TEST_P(Operator, ParallelBatchMatMul) {
   EXPECT_NEAR(H.at({1, 2, 0}), -54, 0.001);
 }
 
+/// Check that a batched matrix multiply with several blocks per batch entry
+/// matches the product of each pair of slices.
+TEST_P(Operator, BatchedMatMul) {
+  const size_t B = 3, N = 37, M = 21, P = 43;
+  auto *lhs = mod_.createVariable(ElemKind::FloatTy, {B, N, M}, "lhs");
+  auto *rhs = mod_.createVariable(ElemKind::FloatTy, {B, M, P}, "rhs");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {B, N, P}, "result");
+  auto LH = lhs->getPayload().getHandle();
+  auto RH = rhs->getPayload().getHandle();
+  LH.randomize(-1, 1, mod_.getPRNG());
+  RH.randomize(-1, 1, mod_.getPRNG());
+
+  auto *R = F_->createBatchedMatMul("BMM", lhs, rhs);
+  F_->createSave("save", R, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H = result->getPayload().getHandle();
+  for (size_t b = 0; b < B; b++) {
+    for (size_t n = 0; n < N; n++) {
+      for (size_t p = 0; p < P; p++) {
+        float sum = 0;
+        for (size_t m = 0; m < M; m++) {
+          sum += LH.at({b, n, m}) * RH.at({b, m, p});
+        }
+        EXPECT_NEAR(H.at({b, n, p}), sum, 0.001);
+      }
+    }
+  }
+}
+
+static float refSigmoid(float x) { return 1 / (1 + std::exp(-x)); }
+
+/// \returns the row \p n of \p input times \p weights plus \p bias.
+static std::vector<float> refGates(Handle<float> input, Handle<float> weights,
+                                   Handle<float> bias, size_t n) {
+  std::vector<float> gates(bias.size());
+  for (size_t j = 0; j < gates.size(); j++) {
+    gates[j] = bias.at({j});
+    for (size_t k = 0; k < input.dims()[1]; k++) {
+      gates[j] += input.at({n, k}) * weights.at({k, j});
+    }
+  }
+  return gates;
+}
+
+/// Check one step of an LSTM against a direct computation of the gates.
+TEST_P(Operator, LSTMCell) {
+  const size_t B = 3, X = 5, H = 7;
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {B, X}, "input");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *c = mod_.createVariable(ElemKind::FloatTy, {B, H}, "c");
+  auto *Wx = mod_.createVariable(ElemKind::FloatTy, {X, 4 * H}, "Wx");
+  auto *Bx = mod_.createVariable(ElemKind::FloatTy, {4 * H}, "Bx");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, 4 * H}, "Wh");
+  auto *Bh = mod_.createVariable(ElemKind::FloatTy, {4 * H}, "Bh");
+  for (auto *V : {input, h, c, Wx, Bx, Wh, Bh}) {
+    V->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  }
+  auto *newH = mod_.createVariable(ElemKind::FloatTy, {B, H}, "newH");
+  auto *newC = mod_.createVariable(ElemKind::FloatTy, {B, H}, "newC");
+
+  auto *LC = F_->createLSTMCell("lstm", input, h, c, Wx, Bx, Wh, Bh);
+  F_->createSave("saveH", LC->getNewH(), newH);
+  F_->createSave("saveC", LC->getNewC(), newC);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto CH = c->getPayload().getHandle();
+  auto newHH = newH->getPayload().getHandle();
+  auto newCH = newC->getPayload().getHandle();
+  for (size_t n = 0; n < B; n++) {
+    auto xg = refGates(input->getHandle(), Wx->getHandle(), Bx->getHandle(), n);
+    auto hg = refGates(h->getHandle(), Wh->getHandle(), Bh->getHandle(), n);
+    for (size_t j = 0; j < H; j++) {
+      float i = refSigmoid(xg[j] + hg[j]);
+      float f = refSigmoid(xg[H + j] + hg[H + j]);
+      float g = std::tanh(xg[2 * H + j] + hg[2 * H + j]);
+      float o = refSigmoid(xg[3 * H + j] + hg[3 * H + j]);
+      float refC = f * CH.at({n, j}) + i * g;
+      EXPECT_NEAR(newCH.at({n, j}), refC, 0.001);
+      EXPECT_NEAR(newHH.at({n, j}), o * std::tanh(refC), 0.001);
+    }
+  }
+}
+
+/// Check one step of a GRU against a direct computation of the gates.
+TEST_P(Operator, GRUCell) {
+  const size_t B = 3, X = 5, H = 7;
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {B, X}, "input");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *Wx = mod_.createVariable(ElemKind::FloatTy, {X, 3 * H}, "Wx");
+  auto *Bx = mod_.createVariable(ElemKind::FloatTy, {3 * H}, "Bx");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, 3 * H}, "Wh");
+  auto *Bh = mod_.createVariable(ElemKind::FloatTy, {3 * H}, "Bh");
+  for (auto *V : {input, h, Wx, Bx, Wh, Bh}) {
+    V->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  }
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {B, H}, "result");
+
+  auto *GC = F_->createGRUCell("gru", input, h, Wx, Bx, Wh, Bh);
+  F_->createSave("save", GC, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto HH = h->getPayload().getHandle();
+  auto resultH = result->getPayload().getHandle();
+  for (size_t n = 0; n < B; n++) {
+    auto xg = refGates(input->getHandle(), Wx->getHandle(), Bx->getHandle(), n);
+    auto hg = refGates(h->getHandle(), Wh->getHandle(), Bh->getHandle(), n);
+    for (size_t j = 0; j < H; j++) {
+      float r = refSigmoid(xg[j] + hg[j]);
+      float z = refSigmoid(xg[H + j] + hg[H + j]);
+      float g = std::tanh(xg[2 * H + j] + r * hg[2 * H + j]);
+      float prev = HH.at({n, j});
+      EXPECT_NEAR(resultH.at({n, j}), g + z * (prev - g), 0.001);
+    }
+  }
+}
+
+/// Check a whole LSTM sequence against the recurrence computed step by step.
+TEST_P(Operator, LSTMSequence) {
+  const size_t T = 4, B = 3, H = 5;
+  auto *inputGates =
+      mod_.createVariable(ElemKind::FloatTy, {T, B, 4 * H}, "inputGates");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *c = mod_.createVariable(ElemKind::FloatTy, {B, H}, "c");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, 4 * H}, "Wh");
+  auto *Bh = mod_.createVariable(ElemKind::FloatTy, {4 * H}, "Bh");
+  for (auto *V : {inputGates, h, c, Wh, Bh}) {
+    V->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  }
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "result");
+
+  auto *LS = F_->createLSTMSequence("lstm", inputGates, h, c, Wh, Bh);
+  F_->createSave("save", LS, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  Tensor refH = h->getPayload().clone();
+  Tensor refC = c->getPayload().clone();
+  auto IG = inputGates->getPayload().getHandle();
+  auto resultH = result->getPayload().getHandle();
+  for (size_t t = 0; t < T; t++) {
+    Tensor newH = refH.clone();
+    for (size_t n = 0; n < B; n++) {
+      auto hg = refGates(refH.getHandle(), Wh->getHandle(), Bh->getHandle(), n);
+      for (size_t j = 0; j < H; j++) {
+        float i = refSigmoid(IG.at({t, n, j}) + hg[j]);
+        float f = refSigmoid(IG.at({t, n, H + j}) + hg[H + j]);
+        float g = std::tanh(IG.at({t, n, 2 * H + j}) + hg[2 * H + j]);
+        float o = refSigmoid(IG.at({t, n, 3 * H + j}) + hg[3 * H + j]);
+        float &cell = refC.getHandle().at({n, j});
+        cell = f * cell + i * g;
+        newH.getHandle().at({n, j}) = o * std::tanh(cell);
+        EXPECT_NEAR(resultH.at({t, n, j}), o * std::tanh(cell), 0.001);
+      }
+    }
+    refH.assign(&newH);
+  }
+}
+
+/// Check that running the step of an LSTM layer once per time step, with the
+/// states carried over between the runs, gives the outputs of the layer.
+TEST_P(Operator, LSTMStep) {
+  const size_t T = 4, B = 3, X = 5, H = 6, O = 7;
+  std::vector<Node *> inputs;
+  std::vector<Variable *> results;
+  std::vector<NodeValue> outputs;
+  for (size_t t = 0; t < T; t++) {
+    auto *input = mod_.createVariable(ElemKind::FloatTy, {B, X}, "input");
+    input->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+    inputs.push_back(input);
+  }
+  F_->createLSTM("lstm", inputs, B, H, O, outputs);
+  for (size_t t = 0; t < T; t++) {
+    results.push_back(F_->createSave("save", outputs[t])->getVariable());
+  }
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  Function *stepF = mod_.createFunction("step");
+  auto *x = mod_.createVariable(ElemKind::FloatTy, {B, X}, "x");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *c = mod_.createVariable(ElemKind::FloatTy, {B, H}, "c");
+  h->getPayload().zero();
+  c->getPayload().zero();
+  auto *stepResult =
+      stepF->createSave("save", stepF->createLSTMStep("lstm", x, h, c));
+  EE_.compile(CompilationMode::Infer, stepF, ctx);
+  for (size_t t = 0; t < T; t++) {
+    updateVariables({x}, {&cast<Variable>(inputs[t])->getPayload()});
+    EE_.run();
+    EXPECT_TRUE(stepResult->getVariable()->getPayload().isEqual(
+        results[t]->getPayload(), 0.001));
+  }
+}
+
+/// Check a whole GRU sequence against the recurrence computed step by step.
+TEST_P(Operator, GRUSequence) {
+  const size_t T = 4, B = 3, H = 5;
+  auto *inputGates =
+      mod_.createVariable(ElemKind::FloatTy, {T, B, 3 * H}, "inputGates");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, 3 * H}, "Wh");
+  auto *Bh = mod_.createVariable(ElemKind::FloatTy, {3 * H}, "Bh");
+  for (auto *V : {inputGates, h, Wh, Bh}) {
+    V->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  }
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "result");
+
+  auto *GS = F_->createGRUSequence("gru", inputGates, h, Wh, Bh);
+  F_->createSave("save", GS, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  Tensor refH = h->getPayload().clone();
+  auto IG = inputGates->getPayload().getHandle();
+  auto resultH = result->getPayload().getHandle();
+  for (size_t t = 0; t < T; t++) {
+    Tensor newH = refH.clone();
+    for (size_t n = 0; n < B; n++) {
+      auto hg = refGates(refH.getHandle(), Wh->getHandle(), Bh->getHandle(), n);
+      for (size_t j = 0; j < H; j++) {
+        float r = refSigmoid(IG.at({t, n, j}) + hg[j]);
+        float z = refSigmoid(IG.at({t, n, H + j}) + hg[H + j]);
+        float g = std::tanh(IG.at({t, n, 2 * H + j}) + r * hg[2 * H + j]);
+        float prev = refH.getHandle().at({n, j});
+        newH.getHandle().at({n, j}) = g + z * (prev - g);
+        EXPECT_NEAR(resultH.at({t, n, j}), g + z * (prev - g), 0.001);
+      }
+    }
+    refH.assign(&newH);
+  }
+}
+
+/// Check a simple RNN sequence whose gates are large enough to be split
+/// between threads against the recurrence computed step by step. The entries
+/// past their lengths keep their state.
+TEST_P(Operator, RNNSequence) {
+  const size_t T = 3, B = 3, H = 256;
+  auto *inputGates =
+      mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "inputGates");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, H}, "Wh");
+  auto *Bh = mod_.createVariable(ElemKind::FloatTy, {H}, "Bh");
+  for (auto *V : {inputGates, h, Bh}) {
+    V->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  }
+  // Keep the pre-activations in the range where tanh is not saturated.
+  Wh->getPayload().getHandle().randomize(-0.1, 0.1, mod_.getPRNG());
+  auto *lengths = mod_.createVariable(ElemKind::Int64ITy, {B}, "lengths",
+                                      VisibilityKind::Private, false);
+  lengths->getPayload().getHandle<int64_t>() = {3, 1, 0};
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "result");
+
+  F_->createSave(
+      "save", F_->createRNNSequence("rnn", inputGates, h, Wh, Bh, lengths),
+      result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  Tensor refH = h->getPayload().clone();
+  auto IG = inputGates->getPayload().getHandle();
+  auto LH = lengths->getPayload().getHandle<int64_t>();
+  auto resultH = result->getPayload().getHandle();
+  for (size_t t = 0; t < T; t++) {
+    Tensor newH = refH.clone();
+    for (size_t n = 0; n < B; n++) {
+      if (size_t(LH.at({n})) > t) {
+        auto hg =
+            refGates(refH.getHandle(), Wh->getHandle(), Bh->getHandle(), n);
+        for (size_t j = 0; j < H; j++) {
+          newH.getHandle().at({n, j}) = std::tanh(IG.at({t, n, j}) + hg[j]);
+        }
+      }
+      for (size_t j = 0; j < H; j++) {
+        EXPECT_NEAR(resultH.at({t, n, j}), newH.getHandle().at({n, j}),
+                    0.001);
+      }
+    }
+    refH.assign(&newH);
+  }
+}
+
+/// Check that the entries of a GRU sequence stop at their lengths, and repeat
+/// their last state afterwards.
+TEST_P(Operator, GRUSequenceLengths) {
+  const size_t T = 4, B = 3, H = 5;
+  auto *inputGates =
+      mod_.createVariable(ElemKind::FloatTy, {T, B, 3 * H}, "inputGates");
+  auto *h = mod_.createVariable(ElemKind::FloatTy, {B, H}, "h");
+  auto *Wh = mod_.createVariable(ElemKind::FloatTy, {H, 3 * H}, "Wh");
+  auto *Bh = mod_.createVariable(ElemKind::FloatTy, {3 * H}, "Bh");
+  for (auto *V : {inputGates, h, Wh, Bh}) {
+    V->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  }
+  auto *lengths = mod_.createVariable(ElemKind::Int64ITy, {B}, "lengths",
+                                      VisibilityKind::Private, false);
+  lengths->getPayload().getHandle<int64_t>() = {2, 4, 0};
+  auto *full = mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "full");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {T, B, H}, "result");
+
+  F_->createSave("save.full",
+                 F_->createGRUSequence("gru.full", inputGates, h, Wh, Bh),
+                 full);
+  F_->createSave(
+      "save", F_->createGRUSequence("gru", inputGates, h, Wh, Bh, lengths),
+      result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto fullH = full->getPayload().getHandle();
+  auto resultH = result->getPayload().getHandle();
+  auto HH = h->getPayload().getHandle();
+  auto LH = lengths->getPayload().getHandle<int64_t>();
+  for (size_t n = 0; n < B; n++) {
+    size_t length = LH.at({n});
+    for (size_t t = 0; t < T; t++) {
+      for (size_t j = 0; j < H; j++) {
+        float expected = t < length ? fullH.at({t, n, j})
+                                    : length ? fullH.at({length - 1, n, j})
+                                             : HH.at({n, j});
+        EXPECT_NEAR(resultH.at({t, n, j}), expected, 0.001);
+      }
+    }
+  }
+}
+
 TEST_P(Operator, batchedReduceAdd) {
   auto *batch = mod_.createVariable(ElemKind::FloatTy, {2, 4}, "batch");
   auto *result = mod_.createVariable(ElemKind::FloatTy, {4}, "result");
@@ -235,7 +755,7 @@ TEST_P(InterpAndCPU, batchedReduceAddWithAxis) {
   EXPECT_NEAR(H.at({1, 1}), 27, 0.001);
 }
 
-TEST_P(InterpAndCPU, batchedReduceAddQuantized) {
+TEST_P(Operator, batchedReduceAddQuantized) {
   auto BT = mod_.uniqueType(ElemKind::Int8QTy, {3, 8}, 0.5, 3);
   auto OT = mod_.uniqueType(ElemKind::Int8QTy, {8}, 2.0, -1);
 
@@ -571,6 +1091,41 @@ TEST_P(InterpAndCPU, broadcast) {
   }
 }
 
+/// Add a broadcasted bias of shape (3) along axis 1 to a tensor of shape
+/// (2,3,4), and multiply the sum by a broadcasted tensor of shape (2,1,4).
+TEST_P(InterpAndCPU, broadcastArithmetic) {
+  auto *A = mod_.createVariable(ElemKind::FloatTy, {2, 3, 4}, "A");
+  auto *bias = mod_.createVariable(ElemKind::FloatTy, {3}, "bias");
+  auto *scale = mod_.createVariable(ElemKind::FloatTy, {2, 1, 4}, "scale");
+  auto *result = mod_.createVariable(ElemKind::FloatTy, {2, 3, 4}, "result");
+  A->getPayload().getHandle().randomize(-1.0, 1.0, mod_.getPRNG());
+  bias->getPayload().getHandle() = {1, 2, 3};
+  scale->getPayload().getHandle() = {1, 2, 3, 4, -1, -2, -3, -4};
+
+  auto *BB = F_->createBroadcast("bias.broadcast", bias, {2, 3, 4}, 1);
+  auto *BS = F_->createBroadcast("scale.broadcast", scale, {2, 3, 4}, 0);
+  auto *add = F_->createAdd("add", A, BB);
+  auto *mul = F_->createMul("mul", add, BS);
+  F_->createSave("save", mul, result);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto HA = A->getPayload().getHandle();
+  auto HB = bias->getPayload().getHandle();
+  auto HS = scale->getPayload().getHandle();
+  auto HR = result->getPayload().getHandle();
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      for (size_t k = 0; k < 4; k++) {
+        EXPECT_NEAR(HR.at({i, j, k}),
+                    (HA.at({i, j, k}) + HB.at({j})) * HS.at({i, 0, k}), 1E-5);
+      }
+    }
+  }
+}
+
 /// Perform a simple weighted sum.
 TEST_P(Operator, weightedSum) {
   // Create the data.
@@ -670,6 +1225,46 @@ TEST_P(Operator, TopK) {
   EXPECT_EQ(I.at({2, 0, 2}), 3);
 }
 
+// Check TopK on rows that are much longer than K and have many equal values,
+// which must be ordered by increasing index.
+TEST_P(Operator, TopKLongRows) {
+  const size_t rows = 3, n = 1000, k = 5;
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {rows, n}, "input");
+  auto *values = mod_.createVariable(ElemKind::FloatTy, {rows, k}, "values");
+  auto *indices = mod_.createVariable(ElemKind::Int64ITy, {rows, k}, "indices");
+
+  auto IH = inp->getPayload().getHandle();
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t i = 0; i < n; i++) {
+      IH.at({r, i}) = ((i + r * 11) * 37) % 101;
+    }
+  }
+
+  auto R = F_->createTopK("TopK", inp, k);
+
+  F_->createSave("save.values", {R, 0}, values);
+  F_->createSave("save.indices", {R, 1}, indices);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+
+  EE_.run();
+
+  auto V = values->getPayload().getHandle();
+  auto I = indices->getPayload().getHandle<int64_t>();
+  for (size_t r = 0; r < rows; r++) {
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return IH.at({r, a}) > IH.at({r, b});
+    });
+    for (size_t j = 0; j < k; j++) {
+      EXPECT_FLOAT_EQ(V.at({r, j}), IH.at({r, order[j]}));
+      EXPECT_EQ(I.at({r, j}), order[j]);
+    }
+  }
+}
+
 // Check that concatenating Nodes with multiple outputs works correctly.
 TEST_P(InterpAndCPU, ConcatTopK) {
   auto *inp1 = mod_.createVariable(ElemKind::FloatTy, {2, 1, 3}, "input");
@@ -803,7 +1398,43 @@ TEST_P(InterpAndCPU, TopK1) {
   EXPECT_EQ(I.at({2, 0, 0}), 2);
 }
 
-TEST_P(InterpAndCPU, QuantizedTopK) {
+// Check that TopK with K=1 skips the NaNs after the first element of a row,
+// wherever they are, selects a NaN first element, and selects the first of
+// the largest elements.
+TEST_P(InterpAndCPU, TopK1NaN) {
+  auto *inp = mod_.createVariable(ElemKind::FloatTy, {4, 1, 5}, "input");
+  auto *values = mod_.createVariable(ElemKind::FloatTy, {4, 1, 1}, "values");
+  auto *indices = mod_.createVariable(ElemKind::Int64ITy, {4, 1, 1}, "indices");
+
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  inp->getPayload().getHandle() = {
+      3, 9, nan, 4, 1, 2, 7, 5, 8, nan, nan, 6, 2, 6, 1, 1, 6, nan, 6, 2,
+  };
+
+  auto R = F_->createTopK("TopK", inp, 1);
+
+  F_->createSave("save.values", {R, 0}, values);
+  F_->createSave("save.indices", {R, 1}, indices);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+
+  EE_.run();
+
+  auto V = values->getPayload().getHandle();
+  auto I = indices->getPayload().getHandle<int64_t>();
+
+  EXPECT_FLOAT_EQ(V.at({0, 0, 0}), 9);
+  EXPECT_EQ(I.at({0, 0, 0}), 1);
+  EXPECT_FLOAT_EQ(V.at({1, 0, 0}), 8);
+  EXPECT_EQ(I.at({1, 0, 0}), 3);
+  EXPECT_TRUE(std::isnan(V.at({2, 0, 0})));
+  EXPECT_EQ(I.at({2, 0, 0}), 0);
+  EXPECT_FLOAT_EQ(V.at({3, 0, 0}), 6);
+  EXPECT_EQ(I.at({3, 0, 0}), 1);
+}
+
+TEST_P(Operator, QuantizedTopK) {
   auto *INV =
       mod_.createVariable(ElemKind::Int8QTy, {3, 1, 5}, 1.2, 5, "input");
   auto *OV =
@@ -1242,6 +1873,46 @@ TEST_P(Operator, IntMatMul) {
   EXPECT_NEAR(H.at({2, 2}), 58.8, 1.0);
 }
 
+/// Check that a quantized batched matrix multiply, which the quantization
+/// creates on these backends, matches the product of each pair of slices.
+TEST_P(InterpAndCPU, IntBatchedMatMul) {
+  const size_t B = 2, N = 3, M = 4, P = 5;
+  EXPECT_TRUE(EE_.isOpSupported(Kinded::Kind::BatchedMatMulNodeKind,
+                                ElemKind::Int8QTy));
+  auto *lhs = mod_.createVariable(ElemKind::FloatTy, {B, N, M}, "lhs");
+  auto *rhs = mod_.createVariable(ElemKind::FloatTy, {B, M, P}, "rhs");
+  auto *res = mod_.createVariable(ElemKind::FloatTy, {B, N, P}, "res");
+  auto LH = lhs->getPayload().getHandle();
+  auto RH = rhs->getPayload().getHandle();
+  LH.randomize(-1, 1, mod_.getPRNG());
+  RH.randomize(-1, 1, mod_.getPRNG());
+
+  TypeRef lhsTy = mod_.uniqueType(ElemKind::Int8QTy, {B, N, M}, 0.008, 0);
+  TypeRef rhsTy = mod_.uniqueType(ElemKind::Int8QTy, {B, M, P}, 0.008, 0);
+  TypeRef resTy = mod_.uniqueType(ElemKind::Int8QTy, {B, N, P}, 0.032, 0);
+  auto *lhsq = F_->createQuantize("lhs.q", lhs, lhsTy);
+  auto *rhsq = F_->createQuantize("rhs.q", rhs, rhsTy);
+  auto *BMM = F_->createBatchedMatMul("BMM.q", resTy, lhsq, rhsq);
+  F_->createSave("save", F_->createDequantize("dequant", BMM), res);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto H = res->getPayload().getHandle();
+  for (size_t b = 0; b < B; b++) {
+    for (size_t n = 0; n < N; n++) {
+      for (size_t p = 0; p < P; p++) {
+        float sum = 0;
+        for (size_t m = 0; m < M; m++) {
+          sum += LH.at({b, n, m}) * RH.at({b, m, p});
+        }
+        EXPECT_NEAR(H.at({b, n, p}), sum, 0.1);
+      }
+    }
+  }
+}
+
 TEST_P(InterpAndCPU, IntBatchedArith) {
   TypeRef resTy = mod_.uniqueType(ElemKind::Int8QTy, {1, 3, 3}, 0.10, 1.0);
   TypeRef lhsTy = mod_.uniqueType(ElemKind::Int8QTy, {1, 3, 3}, 0.11, 4.0);
@@ -1427,6 +2098,109 @@ TEST_P(InterpAndCPU, IntFC) {
   EXPECT_LT(count, 2);
 }
 
+/// Check a 16-bit quantized FC, which is lowered to a MatMul and a
+/// BatchedAdd, against the floating point one.
+TEST_P(InterpAndCPU, Int16FC) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {4, 300}, "in");
+  auto *fc = F_->createFullyConnected("FC", input, 30);
+  auto *res =
+      mod_.createVariable(ElemKind::FloatTy, fc->getResult().dims(), "res");
+
+  auto weights = fc->getWeights();
+  auto bias = fc->getBias();
+
+  input->getPayload().getHandle().randomize(-1.0, 1.0, mod_.getPRNG());
+  llvm::cast<Variable>(bias)->getPayload().getHandle().randomize(
+      -0.1, 0.1, mod_.getPRNG());
+  llvm::cast<Variable>(weights)->getPayload().getHandle().randomize(
+      -1.1, 1.1, mod_.getPRNG());
+
+  TypeRef resTy = mod_.uniqueType(ElemKind::Int16QTy, res->dims(), 0.002, 3);
+  TypeRef inputTy =
+      mod_.uniqueType(ElemKind::Int16QTy, input->dims(), 0.0001, 0);
+  TypeRef weightsTy =
+      mod_.uniqueType(ElemKind::Int16QTy, weights.dims(), 0.0001, 2);
+  TypeRef biasTy =
+      mod_.uniqueType(ElemKind::Int16QTy, bias.dims(), 0.00001, -1);
+
+  auto *inputq = F_->createQuantize("input.q", input, inputTy);
+  auto *weightsq = F_->createQuantize("filter.q", weights, weightsTy);
+  auto *biasq = F_->createQuantize("bias.q", bias, biasTy);
+
+  auto *fcq = F_->createFullyConnected("fcq", inputq, weightsq, biasq, resTy);
+  auto *dequantRes = F_->createDequantize("dequant", fcq);
+  auto *sub = F_->createSub("compare", dequantRes, fc);
+
+  F_->createSave("save", sub, res);
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  // The sums of 300 products are within a few steps of the result scale.
+  auto H = res->getPayload().getHandle();
+  for (size_t i = 0, e = H.size(); i < e; i++) {
+    EXPECT_NEAR(H.raw(i), 0, 0.01);
+  }
+}
+
+/// Check the 16-bit quantized Add, Sub and Mul, the rescales between 8-bit and
+/// 16-bit values, and the concatenation of 16-bit values.
+TEST_P(InterpAndCPU, Int16Arithmetic) {
+  const size_t len = 100;
+  auto *A = mod_.createVariable(ElemKind::FloatTy, {len}, "A",
+                                VisibilityKind::Public);
+  auto *B = mod_.createVariable(ElemKind::FloatTy, {len}, "B",
+                                VisibilityKind::Public);
+  auto *O1 = mod_.createVariable(ElemKind::FloatTy, {3 * len}, "AddSubMul",
+                                 VisibilityKind::Public, false);
+  auto *O2 = mod_.createVariable(ElemKind::FloatTy, {len}, "Rescaled",
+                                 VisibilityKind::Public, false);
+  A->getHandle().randomize(-10, 10, mod_.getPRNG());
+  B->getHandle().randomize(-10, 10, mod_.getPRNG());
+
+  auto TA = mod_.uniqueType(ElemKind::Int16QTy, {len}, 0.001, 7);
+  auto TB8 = mod_.uniqueType(ElemKind::Int8QTy, {len}, 0.1, -3);
+  auto TB = mod_.uniqueType(ElemKind::Int16QTy, {len}, 0.0005, 0);
+  auto TAdd = mod_.uniqueType(ElemKind::Int16QTy, {len}, 0.002, -5);
+  auto TSub = mod_.uniqueType(ElemKind::Int16QTy, {len}, 0.002, 0);
+  auto TMul = mod_.uniqueType(ElemKind::Int16QTy, {len}, 0.005, 11);
+  auto TOut8 = mod_.uniqueType(ElemKind::Int8QTy, {len}, 0.2, 1);
+
+  // B goes through 8-bit first, so its 16-bit values are rescaled.
+  auto *QA = F_->createQuantize("QA", A, TA);
+  auto *QB8 = F_->createQuantize("QB8", B, TB8);
+  auto *QB = F_->createRescaleQuantized("QB", QB8, TB);
+
+  Node *add = F_->createAdd("add", TAdd, QA, QB);
+  Node *sub = F_->createSub("sub", TSub, QA, QB);
+  Node *mul = F_->createMul("mul", TMul, QA, QB);
+  auto *concat = F_->createConcat("concat", {add, sub, mul}, 0);
+  F_->createSave("saveAll", F_->createDequantize("dqAll", concat), O1);
+
+  auto *add8 = F_->createRescaleQuantized("add8", add, TOut8);
+  F_->createSave("saveRescaled", F_->createDequantize("dqAdd8", add8), O2);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto AH = A->getHandle();
+  auto BH = B->getHandle();
+  auto O1H = O1->getHandle();
+  auto O2H = O2->getHandle();
+  TensorQuantizationParams B8Q{TB8->getScale(), TB8->getOffset()};
+  for (size_t i = 0; i < len; i++) {
+    // B is only as precise as its 8-bit quantization.
+    float a = AH.raw(i);
+    float b = quantization::dequantize(quantization::quantize(BH.raw(i), B8Q),
+                                       B8Q);
+    EXPECT_NEAR(O1H.raw(i), a + b, 0.003);
+    EXPECT_NEAR(O1H.raw(len + i), a - b, 0.003);
+    EXPECT_NEAR(O1H.raw(2 * len + i), a * b, 0.02);
+    EXPECT_NEAR(O2H.raw(i), a + b, 0.2);
+  }
+}
+
 TEST_P(InterpAndCPU, EntropyLossTest) {
   auto *P = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "P");
   auto *Y = mod_.createVariable(ElemKind::Int64ITy, {2}, "Y");
@@ -1443,6 +2217,26 @@ TEST_P(InterpAndCPU, EntropyLossTest) {
   EXPECT_NEAR(R.at({0}), -log(0.5) - log(0.3), 0.1);
 }
 
+TEST_P(InterpAndCPU, SoftMaxCrossEntropyLoss) {
+  // The logits are large enough to overflow a naive exp.
+  auto *X = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "X");
+  auto *Y = mod_.createVariable(ElemKind::Int64ITy, {2}, "Y");
+  auto *L = mod_.createVariable(ElemKind::FloatTy, {1}, "L");
+
+  X->getPayload().getHandle() = {1000, 1001, 1002, -3, 0, 2};
+  Y->getPayload().getHandle<int64_t>() = {1, 2};
+  auto *loss = F_->createSoftMaxCrossEntropyLoss("loss", X, Y);
+  F_->createSave("save", loss, L);
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  // -log(softmax(x)[y]) = log(sum(exp(x - x[y]))).
+  double expected = std::log(std::exp(-1.0) + 1 + std::exp(1.0)) +
+                    std::log(std::exp(-5.0) + std::exp(-2.0) + 1);
+  EXPECT_NEAR(L->getPayload().getHandle().at({0}), expected, 1e-4);
+}
+
 TEST_P(Operator, RescaleNode) {
   // Check the outputs of the RescaleQuantized operation.
   auto *input = mod_.createVariable(ElemKind::Int8QTy, {4, 10}, 0.4, -3,
@@ -2643,7 +3437,7 @@ TEST_P(Operator, Int8MaxPool) {
   }
 }
 
-TEST_P(InterpAndCPU, Int8Tanh) {
+TEST_P(Operator, Int8Tanh) {
   constexpr size_t size = 10;
   auto *input = mod_.createVariable(ElemKind::FloatTy, {size}, "input");
   input->getHandle().randomize(-10.0, 10.0, mod_.getPRNG());
@@ -2821,7 +3615,7 @@ TEST_P(InterpAndCPU, NonSquareStrideMaxPool) {
     EXPECT_EQ(result.getHandle().raw(i), ref[i]);
 }
 
-TEST_P(InterpAndCPU, Int8Sigmoid) {
+TEST_P(Operator, Int8Sigmoid) {
   constexpr size_t size = 10;
   auto *input = mod_.createVariable(ElemKind::FloatTy, {size}, "input");
   input->getHandle().randomize(-10.0, 10.0, mod_.getPRNG());
@@ -2856,7 +3650,7 @@ TEST_P(InterpAndCPU, Int8Sigmoid) {
   }
 }
 
-TEST_P(InterpAndCPU, IntLookupTable) {
+TEST_P(Operator, IntLookupTable) {
   constexpr size_t size = 6;
   auto *input = mod_.createVariable(ElemKind::Int8QTy, {size}, 1, 0, "input");
   input->getHandle<int8_t>() = {0, 1, 2, 3, 4, 5};
@@ -2883,6 +3677,87 @@ TEST_P(InterpAndCPU, IntLookupTable) {
   }
 }
 
+/// Check that the quantized log and power, which are lowered into lookup
+/// tables computed at compile time, match their floating point versions.
+TEST_P(Operator, Int8LogAndPow) {
+  constexpr size_t size = 20;
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {size}, "input");
+  input->getHandle().randomize(0.1, 4.0, mod_.getPRNG());
+
+  auto *saveFpLog = F_->createSave("fpLogSave", F_->createLog("fpLog", input));
+  auto *saveFpPow =
+      F_->createSave("fpPowSave", F_->createPow("fpPow", input, 1.5));
+
+  auto inParams = glow::quantization::chooseQuantizationParams(0.0, 4.0);
+  auto inTy = mod_.uniqueType(ElemKind::Int8QTy, {size}, inParams.scale,
+                              inParams.offset);
+  auto *quantize = F_->createQuantize("quantize", input, inTy);
+
+  auto logParams = glow::quantization::chooseQuantizationParams(-2.5, 1.5);
+  auto logTy = mod_.uniqueType(ElemKind::Int8QTy, {size}, logParams.scale,
+                               logParams.offset);
+  auto *intLog = F_->createLog("int8Log", quantize, logTy);
+  auto *saveIntLog =
+      F_->createSave("int8LogSave", F_->createDequantize("logDQ", intLog));
+
+  auto powParams = glow::quantization::chooseQuantizationParams(0.0, 8.0);
+  auto powTy = mod_.uniqueType(ElemKind::Int8QTy, {size}, powParams.scale,
+                               powParams.offset);
+  auto *exp = F_->createSplat("exp", inTy, 1.5);
+  auto *intPow = F_->createPow("int8Pow", powTy, quantize, exp);
+  auto *saveIntPow =
+      F_->createSave("int8PowSave", F_->createDequantize("powDQ", intPow));
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto fpLog = saveFpLog->getVariable()->getHandle();
+  auto intLogH = saveIntLog->getVariable()->getHandle();
+  auto fpPow = saveFpPow->getVariable()->getHandle();
+  auto intPowH = saveIntPow->getVariable()->getHandle();
+  for (size_t i = 0; i < size; i++) {
+    // The error of the input quantization grows where the slope is steep.
+    float x = input->getHandle().raw(i);
+    EXPECT_NEAR(fpLog.raw(i), intLogH.raw(i), 0.03 + inParams.scale / x);
+    EXPECT_NEAR(fpPow.raw(i), intPowH.raw(i), 0.1);
+  }
+}
+
+/// Check the int8 softmax against the floating point one.
+TEST_P(InterpAndCPU, Int8SoftMax) {
+  constexpr size_t rows = 3;
+  constexpr size_t cols = 40;
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {rows, cols}, "input");
+  input->getHandle().randomize(-6.0, 6.0, mod_.getPRNG());
+  auto *selected =
+      mod_.createVariable(ElemKind::Int64ITy, {rows, 1}, "selected");
+
+  auto *saveFp =
+      F_->createSave("fpSave", F_->createSoftMax("fpSM", input, selected));
+
+  auto inParams = glow::quantization::chooseQuantizationParams(-6.0, 6.0);
+  auto inTy = mod_.uniqueType(ElemKind::Int8QTy, {rows, cols}, inParams.scale,
+                              inParams.offset);
+  auto outParams = glow::quantization::chooseQuantizationParams(0.0, 1.0);
+  auto outTy = mod_.uniqueType(ElemKind::Int8QTy, {rows, cols},
+                               outParams.scale, outParams.offset);
+  auto *quantize = F_->createQuantize("quantize", input, inTy);
+  auto *intSM = F_->createSoftMax("int8SM", quantize, selected, outTy);
+  auto *saveInt =
+      F_->createSave("int8Save", F_->createDequantize("dequantize", intSM));
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto fpResult = saveFp->getVariable()->getHandle();
+  auto intResult = saveInt->getVariable()->getHandle();
+  for (size_t i = 0; i < rows * cols; i++) {
+    EXPECT_NEAR(fpResult.raw(i), intResult.raw(i), 0.01);
+  }
+}
+
 /// Check that the sequence of extract-batchedadd-concat works.
 TEST_P(Operator, testBatchAdd) {
   unsigned numSlices = 10;
@@ -2981,7 +3856,7 @@ TEST_P(Operator, testQuantizedBatchAdd) {
   }
 }
 
-TEST_P(InterpOnly, SparseLengthsSum) {
+TEST_P(InterpAndCPU, SparseLengthsSum) {
   /*
     DATA  = [
         [1.0, 1.2],
@@ -3028,7 +3903,7 @@ TEST_P(InterpOnly, SparseLengthsSum) {
   EXPECT_TRUE(expected.isEqual(result));
 }
 
-TEST_P(InterpOnly, SparseLengthsWeightedSum) {
+TEST_P(InterpAndCPU, SparseLengthsWeightedSum) {
   /*
     DATA  =   [2.0, -0.5, 13]
     WEIGHTS = [3, 1, 0, 0, 0, 0, 2, -0.5]
@@ -3079,8 +3954,178 @@ TEST_P(InterpOnly, SparseLengthsWeightedSum) {
   EXPECT_TRUE(expected.isEqual(result));
 }
 
+/// Fill \p indices with random rows of a table of \p numRows rows, and
+/// \p lengths with the sizes of segments that partition the indices.
+static void randomSparseSegments(Tensor &indices, Tensor &lengths,
+                                 size_t numRows, PseudoRNG &PRNG) {
+  auto IH = indices.getHandle<int64_t>();
+  auto LH = lengths.getHandle<int64_t>();
+  for (size_t i = 0, e = IH.size(); i < e; i++) {
+    IH.raw(i) = PRNG.nextRandInt(0, numRows - 1);
+  }
+  // Put all of the remaining indices into the last segment.
+  size_t left = IH.size();
+  for (size_t i = 0, e = LH.size(); i < e; i++) {
+    LH.raw(i) = i + 1 == e ? left : std::min<size_t>(left, i % 9);
+    left -= LH.raw(i);
+  }
+}
+
+/// \returns the reference SparseLengthsWeightedSum of the float \p data.
+static Tensor referenceSparseLengthsWeightedSum(Tensor &data, Tensor &weights,
+                                                Tensor &indices,
+                                                Tensor &lengths) {
+  size_t lineSize = data.size() / data.dims()[0];
+  Tensor result(ElemKind::FloatTy, {lengths.size(), lineSize});
+  result.zero();
+  auto DH = data.getHandle();
+  auto WH = weights.getHandle();
+  auto IH = indices.getHandle<int64_t>();
+  auto LH = lengths.getHandle<int64_t>();
+  auto RH = result.getHandle();
+  size_t curIdx = 0;
+  for (size_t i = 0, e = LH.size(); i < e; i++) {
+    for (int64_t j = 0; j < LH.raw(i); j++, curIdx++) {
+      for (size_t k = 0; k < lineSize; k++) {
+        RH.at({i, k}) += DH.at({(size_t)IH.raw(curIdx), k}) * WH.raw(curIdx);
+      }
+    }
+  }
+  return result;
+}
+
+/// Check SparseLengthsWeightedSum of a half precision table, with rows that
+/// are not a multiple of the vector width and more indices than the prefetch
+/// distance.
+TEST_P(InterpAndCPU, SparseLengthsWeightedSumFloat16) {
+  const size_t numRows = 50, lineSize = 19, numIndices = 40, segments = 7;
+  auto *data =
+      mod_.createVariable(ElemKind::Float16Ty, {numRows, lineSize}, "data");
+  auto *weights =
+      mod_.createVariable(ElemKind::FloatTy, {numIndices}, "weights");
+  auto *indices =
+      mod_.createVariable(ElemKind::Int64ITy, {numIndices}, "indices");
+  auto *lengths =
+      mod_.createVariable(ElemKind::Int64ITy, {segments}, "lengths");
+  data->getPayload().getHandle<float16_t>().randomize(-10, 10,
+                                                      mod_.getPRNG());
+  weights->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  randomSparseSegments(indices->getPayload(), lengths->getPayload(), numRows,
+                       mod_.getPRNG());
+
+  // The reference accumulates the half precision values in float.
+  Tensor floatData(ElemKind::FloatTy, {numRows, lineSize});
+  auto DH = data->getPayload().getHandle<float16_t>();
+  for (size_t i = 0, e = DH.size(); i < e; i++) {
+    floatData.getHandle().raw(i) = DH.raw(i);
+  }
+  Tensor expected =
+      referenceSparseLengthsWeightedSum(floatData, weights->getPayload(),
+                                        indices->getPayload(),
+                                        lengths->getPayload());
+
+  auto *R = F_->createSparseLengthsWeightedSum("SLWS", data, weights, indices,
+                                               lengths);
+  EXPECT_EQ(R->getResult().getElementType(), ElemKind::FloatTy);
+  auto *S = F_->createSave("save", R);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  Tensor &result = llvm::cast<Variable>(S->getOutput())->getPayload();
+  EXPECT_TRUE(expected.isEqual(result, 0.0001));
+}
+
+/// Check SparseLengthsWeightedSum of a table whose rows are quantized to
+/// int8 separately. Every row has a very different range, so a single scale
+/// would lose the small rows.
+TEST_P(InterpAndCPU, RowwiseQuantizedSparseLengthsWeightedSum) {
+  const size_t numRows = 50, lineSize = 21, numIndices = 40, segments = 7;
+  Tensor data(ElemKind::FloatTy, {numRows, lineSize});
+  auto DH = data.getHandle();
+  DH.randomize(-1, 1, mod_.getPRNG());
+  for (size_t r = 0; r < numRows; r++) {
+    for (size_t k = 0; k < lineSize; k++) {
+      DH.at({r, k}) = DH.at({r, k}) * (r + 1) + r;
+    }
+  }
+  auto *weights =
+      mod_.createVariable(ElemKind::FloatTy, {numIndices}, "weights");
+  auto *indices =
+      mod_.createVariable(ElemKind::Int64ITy, {numIndices}, "indices");
+  auto *lengths =
+      mod_.createVariable(ElemKind::Int64ITy, {segments}, "lengths");
+  weights->getPayload().getHandle().randomize(-1, 1, mod_.getPRNG());
+  randomSparseSegments(indices->getPayload(), lengths->getPayload(), numRows,
+                       mod_.getPRNG());
+
+  Tensor expected = referenceSparseLengthsWeightedSum(
+      data, weights->getPayload(), indices->getPayload(),
+      lengths->getPayload());
+
+  auto *R = F_->createRowwiseQuantizedSparseLengthsWeightedSum(
+      "RQSLWS", data, weights, indices, lengths);
+  auto *S = F_->createSave("save", R);
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  // Every row is quantized with a step of 1/127.5 of its range.
+  Tensor &result = llvm::cast<Variable>(S->getOutput())->getPayload();
+  auto RH = result.getHandle();
+  auto EH = expected.getHandle();
+  auto IH = indices->getPayload().getHandle<int64_t>();
+  auto WH = weights->getPayload().getHandle();
+  auto LH = lengths->getPayload().getHandle<int64_t>();
+  size_t curIdx = 0;
+  for (size_t i = 0; i < segments; i++) {
+    float tolerance = 1e-5;
+    for (int64_t j = 0; j < LH.raw(i); j++, curIdx++) {
+      float range = 2 * (IH.raw(curIdx) + 1);
+      tolerance += std::abs(WH.raw(curIdx)) * range / 255;
+    }
+    for (size_t k = 0; k < lineSize; k++) {
+      EXPECT_NEAR(RH.at({i, k}), EH.at({i, k}), tolerance);
+    }
+  }
+}
+
 /// Stack many slices/reshapes together. Some of these may be turned into tensor
 /// views stacked onto each other.
+/// Check the concatenations and the slices along an inner dimension of tensors
+/// whose outer dimensions are 1, which read and write their operands in place.
+TEST_P(Operator, concatAndSliceInnerDim) {
+  auto *A = mod_.createVariable(ElemKind::FloatTy, {1, 3, 4}, "A");
+  auto *B = mod_.createVariable(ElemKind::FloatTy, {1, 2, 4}, "B");
+  A->getHandle().randomize(-2.0, 2.0, mod_.getPRNG());
+  B->getHandle().randomize(-2.0, 2.0, mod_.getPRNG());
+
+  auto *C = F_->createConcat(
+      "concat", {F_->createTanh("tanhA", A), F_->createTanh("tanhB", B)}, 1);
+  auto *S = F_->createSlice("slice", F_->createTanh("tanhC", C), {0, 1, 0},
+                            {1, 4, 4});
+  auto *save = F_->createSave("save", F_->createTanh("tanhS", S));
+
+  Context ctx;
+  EE_.compile(CompilationMode::Infer, F_, ctx);
+  EE_.run();
+
+  auto AH = A->getHandle();
+  auto BH = B->getHandle();
+  auto RH = save->getVariable()->getHandle();
+  ASSERT_EQ(RH.dims(), llvm::ArrayRef<size_t>({1, 3, 4}));
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      // Row i of the slice is row i + 1 of the concatenation.
+      size_t row = i + 1;
+      float x = row < 3 ? AH.at({0, row, j}) : BH.at({0, row - 3, j});
+      EXPECT_NEAR(RH.at({0, i, j}), std::tanh(std::tanh(std::tanh(x))), 1e-5);
+    }
+  }
+}
+
 TEST_P(Operator, sliceReshape) {
   auto *X = mod_.createVariable(ElemKind::FloatTy, {3, 3}, "X");
   auto *resultSX = mod_.createVariable(ElemKind::FloatTy, {1, 3}, "resultSX",
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "glow/ExecutionEngine/ResultCache.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace glow;
+
+namespace {
+/// \returns a tensor of 4 floats that are all \p value.
+Tensor createSample(float value) {
+  Tensor T(ElemKind::FloatTy, {4});
+  T.getHandle().clear(value);
+  return T;
+}
+
+/// Cache the result \p out of the input \p in for the model \p version.
+void insertSample(ResultCache &cache, uint64_t version, Tensor &in,
+                  Tensor &out) {
+  std::vector<Tensor> inputs;
+  inputs.push_back(in.clone());
+  cache.insert(ResultCache::getKeyHash(version, {&in}), version,
+               std::move(inputs), {&out});
+}
+
+/// \returns true if the result of \p in for the model \p version is cached,
+/// and copies it to \p out.
+bool lookupSample(ResultCache &cache, uint64_t version, Tensor &in,
+                  Tensor &out) {
+  return cache.lookup(ResultCache::getKeyHash(version, {&in}), version, {&in},
+                      {&out});
+}
+} // namespace
+
+/// Check that the results are keyed by the content of the inputs and the
+/// version of the model, and that the hit rate is counted.
+TEST(ResultCache, lookup) {
+  ResultCache cache(1 << 20);
+  Tensor in = createSample(1);
+  Tensor result = createSample(2);
+  Tensor out = createSample(0);
+
+  EXPECT_FALSE(lookupSample(cache, 0, in, out));
+  insertSample(cache, 0, in, result);
+
+  // An identical copy of the input hits the cache.
+  Tensor sameIn = createSample(1);
+  EXPECT_TRUE(lookupSample(cache, 0, sameIn, out));
+  EXPECT_TRUE(out.isEqual(result, 0));
+
+  // Other inputs, or another version of the model, miss it.
+  Tensor otherIn = createSample(3);
+  EXPECT_FALSE(lookupSample(cache, 0, otherIn, out));
+  EXPECT_FALSE(lookupSample(cache, 1, in, out));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.numEntries, 1);
+  EXPECT_EQ(stats.sizeInBytes, 2 * 4 * sizeof(float));
+  EXPECT_DOUBLE_EQ(stats.getHitRate(), 0.25);
+
+  cache.clear();
+  EXPECT_FALSE(lookupSample(cache, 0, in, out));
+  EXPECT_EQ(cache.getStats().numEntries, 0);
+}
+
+/// Check that the least recently used entries are evicted to stay within the
+/// memory budget.
+TEST(ResultCache, evictLeastRecentlyUsed) {
+  // Every entry takes 32 bytes, so the budget holds two of them.
+  ResultCache cache(2 * 2 * 4 * sizeof(float));
+  Tensor in0 = createSample(0), in1 = createSample(1), in2 = createSample(2);
+  Tensor out = createSample(0);
+  insertSample(cache, 0, in0, in0);
+  insertSample(cache, 0, in1, in1);
+
+  // Use the first entry, so that the second one is the oldest.
+  EXPECT_TRUE(lookupSample(cache, 0, in0, out));
+  insertSample(cache, 0, in2, in2);
+
+  EXPECT_TRUE(lookupSample(cache, 0, in0, out));
+  EXPECT_FALSE(lookupSample(cache, 0, in1, out));
+  EXPECT_TRUE(lookupSample(cache, 0, in2, out));
+  EXPECT_TRUE(out.isEqual(in2, 0));
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_EQ(stats.numEntries, 2);
+}
@@ -14,10 +14,18 @@
  * limitations under the License.
  */
 
+#include "glow/Support/NUMA.h"
 #include "glow/Support/Random.h"
+#include "glow/Support/RuntimeAllocator.h"
+#include "glow/Support/ThreadPool.h"
+#include "glow/Support/Trace.h"
 
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 using namespace glow;
 
 // Test that nextRandInt generates every number in the closed interval [lb, ub].
@@ -49,3 +57,202 @@ TEST(Utils, deterministicPRNG) {
     EXPECT_EQ(dist(genA), dist(genB));
   }
 }
+
+// Test that parallelFor visits every iteration exactly once and respects the
+// minimal chunk size.
+TEST(Utils, threadPoolParallelFor) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.getNumThreads(), 4);
+
+  for (size_t numIterations : {1, 7, 64, 1000, 4097}) {
+    std::vector<std::atomic<unsigned>> visited(numIterations);
+    for (auto &v : visited) {
+      v = 0;
+    }
+    std::atomic<size_t> numChunks{0};
+    pool.parallelFor(numIterations, 16, [&](size_t begin, size_t end) {
+      EXPECT_LT(begin, end);
+      EXPECT_LE(end, numIterations);
+      // Only the last chunk may be smaller than the minimal chunk size.
+      if (end != numIterations) {
+        EXPECT_EQ((end - begin) % 16, 0);
+      }
+      for (size_t i = begin; i < end; i++) {
+        visited[i]++;
+      }
+      numChunks++;
+    });
+    EXPECT_LE(numChunks, pool.getNumThreads());
+    for (auto &v : visited) {
+      EXPECT_EQ(v, 1);
+    }
+  }
+}
+
+// Test that a pool can be reused for many jobs and that a single-threaded pool
+// executes the job on the calling thread.
+TEST(Utils, threadPoolReuse) {
+  ThreadPool pool(3);
+  std::atomic<size_t> sum{0};
+  for (unsigned i = 0; i < 100; i++) {
+    pool.parallelFor(30, 1, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; j++) {
+        sum += j;
+      }
+    });
+  }
+  EXPECT_EQ(sum, 100 * (29 * 30 / 2));
+
+  ThreadPool serialPool(1);
+  EXPECT_EQ(serialPool.getNumThreads(), 1);
+  auto caller = std::this_thread::get_id();
+  serialPool.parallelFor(100, 1, [&](size_t begin, size_t end) {
+    EXPECT_EQ(begin, 0);
+    EXPECT_EQ(end, 100);
+    EXPECT_EQ(std::this_thread::get_id(), caller);
+  });
+}
+
+// Test that several threads may post loops to the same pool at once, and that
+// the chunks of a loop may post nested loops without deadlocking.
+TEST(Utils, threadPoolConcurrentAndNested) {
+  ThreadPool pool(4);
+  std::atomic<size_t> sum{0};
+  std::vector<std::thread> callers;
+  for (unsigned i = 0; i < 3; i++) {
+    callers.emplace_back([&, i]() {
+      ScopedRunPriority priority(i ? RunPriority::Batch
+                                   : RunPriority::LatencyCritical);
+      for (unsigned j = 0; j < 20; j++) {
+        pool.parallelFor(8, 1, [&](size_t begin, size_t end) {
+          // The nested loops inherit the priority of the caller.
+          EXPECT_EQ(ThreadPool::getCurrentPriority(),
+                    i ? RunPriority::Batch : RunPriority::LatencyCritical);
+          pool.parallelFor(10 * (end - begin), 1,
+                           [&](size_t b, size_t e) { sum += e - b; });
+        });
+      }
+    });
+  }
+  for (auto &caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(sum, 3 * 20 * 80);
+  EXPECT_EQ(ThreadPool::getCurrentPriority(), RunPriority::LatencyCritical);
+}
+
+// Test that the NUMA topology is consistent and that a pool pinned to the CPUs
+// of a node runs its workers on that node.
+TEST(Utils, threadPoolNUMAPinning) {
+  unsigned numNodes = getNumNUMANodes();
+  ASSERT_GE(numNodes, 1);
+  EXPECT_LT(getCurrentNUMANode(), numNodes);
+
+  unsigned node = getCurrentNUMANode();
+  auto cpus = getCPUsOfNUMANode(node);
+  ThreadPool pool(4, cpus);
+  auto caller = std::this_thread::get_id();
+  std::atomic<unsigned> numRemote{0};
+  pool.parallelFor(4, 1, [&](size_t, size_t) {
+    if (std::this_thread::get_id() != caller && getCurrentNUMANode() != node) {
+      numRemote++;
+    }
+  });
+  // The pinning may be rejected, e.g. if the process is restricted to other
+  // CPUs, so only single-node topologies give a guarantee.
+  if (numNodes == 1) {
+    EXPECT_EQ(numRemote, 0);
+  }
+}
+
+// Test that the pool allocator reuses the released activation buffers, and
+// passes the weights through to the upstream allocator.
+TEST(Utils, poolRuntimeAllocator) {
+  // The blocks are pooled by NUMA node, so keep the thread on its node.
+  unsigned numNodes = getNumNUMANodes();
+  if (numNodes > 1) {
+    pinCurrentThread(getCPUsOfNUMANode(getCurrentNUMANode()));
+  }
+  PoolRuntimeAllocator pool(getHeapRuntimeAllocator(), 4096);
+  auto act = RuntimeMemoryKind::Activations;
+  void *a = pool.allocate(1024, 64, act);
+  EXPECT_EQ(reinterpret_cast<size_t>(a) % 64, 0);
+  pool.deallocate(a, 1024, 64, act);
+  EXPECT_EQ(pool.getPooledBytes(), 1024);
+
+  // The same size and alignment get the pooled block back.
+  void *b = pool.allocate(1024, 64, act);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(pool.getPooledBytes(), 0);
+  EXPECT_EQ(pool.getNumUpstreamAllocations(), 1);
+
+  // Other sizes and the weights come from the upstream allocator.
+  void *c = pool.allocate(2048, 64, act);
+  void *w = pool.allocate(1024, 64, RuntimeMemoryKind::ConstantWeights);
+  EXPECT_EQ(pool.getNumUpstreamAllocations(), 2);
+  pool.deallocate(w, 1024, 64, RuntimeMemoryKind::ConstantWeights);
+  EXPECT_EQ(pool.getPooledBytes(), 0);
+
+  // The blocks that exceed the capacity of the pool are not kept.
+  void *d = pool.allocate(4096, 64, act);
+  pool.deallocate(b, 1024, 64, act);
+  pool.deallocate(c, 2048, 64, act);
+  pool.deallocate(d, 4096, 64, act);
+  EXPECT_EQ(pool.getPooledBytes(), 3072);
+  pool.releasePooledMemory();
+  EXPECT_EQ(pool.getPooledBytes(), 0);
+}
+
+/// Check that the huge page allocator maps the large blocks of the regions that
+/// have a policy, aligned to the huge pages, and passes the others through.
+TEST(Utils, hugePageRuntimeAllocator) {
+  HugePageRuntimeAllocator allocator(getHeapRuntimeAllocator());
+  allocator.setPolicy(RuntimeMemoryKind::ConstantWeights,
+                      HugePagePolicy::Explicit2MB);
+  size_t large = size_t(3) << 20;
+  auto *w = static_cast<char *>(
+      allocator.allocate(large, 64, RuntimeMemoryKind::ConstantWeights));
+  void *a = allocator.allocate(large, 64, RuntimeMemoryKind::Activations);
+  void *small =
+      allocator.allocate(4096, 64, RuntimeMemoryKind::ConstantWeights);
+#ifdef __linux__
+  // Without reserved huge pages, the block falls back to transparent ones.
+  EXPECT_EQ(allocator.getMappedBytes(), large);
+  EXPECT_EQ(reinterpret_cast<size_t>(w) % (size_t(2) << 20), 0);
+#endif
+  w[0] = 1;
+  w[large - 1] = 2;
+  EXPECT_EQ(w[0] + w[large - 1], 3);
+  allocator.deallocate(small, 4096, 64, RuntimeMemoryKind::ConstantWeights);
+  allocator.deallocate(a, large, 64, RuntimeMemoryKind::Activations);
+  allocator.deallocate(w, large, 64, RuntimeMemoryKind::ConstantWeights);
+  EXPECT_EQ(allocator.getMappedBytes(), 0);
+}
+
+/// Check the recording of the trace events and their Chrome trace format.
+TEST(Utils, traceEvents) {
+  setTracingEnabled(true);
+  clearTraceEvents();
+  { ScopedTraceEvent trace("scoped \"event\"", "compile"); }
+  addTraceEvent("kernel", "kernel", 10, 30, TraceProcess::Device, 3);
+  setTracingEnabled(false);
+  addTraceEvent("ignored", "kernel", 10, 30);
+
+  auto events = getTraceEvents();
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_EQ(events[0].name, "scoped \"event\"");
+  EXPECT_EQ(events[0].process, TraceProcess::Host);
+  EXPECT_EQ(events[0].thread, getTraceThread());
+  EXPECT_EQ(events[1].duration, 20);
+  EXPECT_EQ(events[1].process, TraceProcess::Device);
+
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  dumpTraceEvents(os);
+  EXPECT_NE(os.str().find("\"name\":\"scoped \\\"event\\\"\""),
+            std::string::npos);
+  EXPECT_NE(os.str().find("\"name\":\"kernel\",\"cat\":\"kernel\",\"ph\":"
+                          "\"X\",\"ts\":10,\"dur\":20,\"pid\":1,\"tid\":3}"),
+            std::string::npos);
+  clearTraceEvents();
+}
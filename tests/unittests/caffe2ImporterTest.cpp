@@ -348,3 +348,54 @@ TEST(caffe2, parallelBatchedMatmulRHS) {
   // We don't actually check that the output is correct, because this
   // should be covered in the OperatorTest for MatMul already.
 }
+
+/// Test loading a Sum of more than two inputs, which becomes a single Sum node
+/// instead of a chain of Adds.
+TEST(caffe2, variadicSum) {
+  ExecutionEngine EE{BackendKind::Interpreter};
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  std::string NetDescFilename(
+      "tests/models/caffe2Models/sum_predict_net.pbtxt");
+  std::string NetWeightFilename(
+      "tests/models/caffe2Models/empty_init_net.pbtxt");
+
+  Variable *output;
+  Tensor inputs_0(ElemKind::FloatTy, {6, 9});
+  Tensor inputs_1(ElemKind::FloatTy, {6, 9});
+  Tensor inputs_2(ElemKind::FloatTy, {6, 9});
+  Tensor inputs_3(ElemKind::FloatTy, {6, 9});
+  Tensor *inputs[] = {&inputs_0, &inputs_1, &inputs_2, &inputs_3};
+  for (auto *T : inputs) {
+    T->getHandle().randomize(-3.0, 3.0, mod.getPRNG());
+  }
+  // Destroy the loader after the graph is loaded since the following execution
+  // will not depend on anyting from the loader.
+  {
+    caffe2ModelLoader caffe2LD(
+        NetDescFilename, NetWeightFilename,
+        {"inputs_0", "inputs_1", "inputs_2", "inputs_3"},
+        {&inputs_0, &inputs_1, &inputs_2, &inputs_3}, *F);
+    output = caffe2LD.getSingleOutput();
+  }
+
+  // We have 1 sum, and 1 save.
+  EXPECT_EQ(F->getNodes().size(), 2);
+  auto *saveNode = getSaveNodeFromVariable(output);
+  auto *sum = llvm::dyn_cast<SumNode>(saveNode->getInput().getNode());
+  ASSERT_TRUE(sum);
+  EXPECT_EQ(sum->getInputs().size(), 4);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+
+  auto result = output->getHandle();
+  for (size_t i = 0, e = result.size(); i < e; i++) {
+    float expected = 0;
+    for (auto *T : inputs) {
+      expected += T->getHandle().raw(i);
+    }
+    EXPECT_NEAR(result.raw(i), expected, 1E-5);
+  }
+}
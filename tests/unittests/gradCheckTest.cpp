@@ -277,6 +277,41 @@ TEST_P(InterpreterGrad, gradientCheckBatchNorm) {
   performGradCheck(EE_, result, A, Ex, &inputs, &outputs, 0.001, 0.004);
 }
 
+/// Check the gradient of a batch normalization whose channel is not the last
+/// dimension, on the backends that run it with a single kernel.
+TEST_P(GradCheck, gradientCheckBatchNormChannelFirst) {
+  size_t numDim = 4;
+  size_t numOutputElem = 2 * 3 * numDim * numDim;
+
+  auto &mod = EE_.getModule();
+  Function *F = mod.createFunction("main");
+  auto *A = mod.createVariable(ElemKind::FloatTy, {2, 3, numDim, numDim}, "A",
+                               VisibilityKind::Public, false);
+  auto *Ex = mod.createVariable(ElemKind::FloatTy, {1, numOutputElem}, "exp",
+                                VisibilityKind::Public, false);
+
+  Node *O = F->createBatchNormalization("batch", A, 1, 0.0001, 0.9);
+  O = F->createReshape("reshape", O, {1, numOutputElem});
+  O = F->createRegression("reg", O, Ex);
+  auto result = F->createSave("ret", O);
+
+  Tensor inputs(ElemKind::FloatTy, {2, 3, numDim, numDim});
+  Tensor outputs(ElemKind::FloatTy, {1, numOutputElem});
+
+  auto inputsH = inputs.getHandle<>();
+  auto outputsH = outputs.getHandle<>();
+
+  inputsH.initXavier(1, mod.getPRNG());
+  outputsH.initXavier(1, mod.getPRNG());
+
+  for (int i = 0, e = inputsH.size(); i < e; i++) {
+    inputsH.raw(i) *= 6;
+    inputsH.raw(i) += 4;
+  }
+
+  performGradCheck(EE_, result, A, Ex, &inputs, &outputs, 0.001, 0.004);
+}
+
 TEST_P(InterpreterGrad, gradientCheckArithmeticDiv) {
   // The test creates a net: A / B = Exp. Where A is trainable weight,
   // B and Exp are external data (initialized randomly once). SGD will find
@@ -23,6 +23,8 @@
 #include "gtest/gtest.h"
 
 #include <cassert>
+#include <cmath>
+#include <functional>
 #include <string>
 
 using namespace glow;
@@ -186,3 +188,407 @@ TEST(GraphAutoGrad, checkPlaceholderGradTest) {
   /// node will be added.
   EXPECT_GE(A->getNumUsers(), 1);
 }
+
+/// Check that recomputing forward activations under a memory budget produces
+/// the same gradients as keeping all of them alive.
+TEST(GraphAutoGrad, recomputeActivations) {
+  ExecutionEngine EE;
+  Context ctx;
+  TrainingConfig TC;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *X = mod.createVariable(ElemKind::FloatTy, {4, 8}, "X",
+                               VisibilityKind::Public, false);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4, 8}, "W");
+  auto *Y = mod.createVariable(ElemKind::FloatTy, {4, 4}, "Y",
+                               VisibilityKind::Public, false);
+  X->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  W->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  Y->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+
+  auto *H = F->createTanh("tanh", F->createMul("mul", X, W));
+  auto *R = F->createRELU("relu", F->createAdd("add", H, X));
+  auto *S = F->createSigmoid("sigmoid", F->createMul("square", R, R));
+  auto *FC = F->createFullyConnected("fc", S, 4);
+  auto *reg = F->createRegression("reg", FC, Y);
+  F->createSave("return", reg);
+
+  VariableGradientsList keepGrads;
+  Function *keepF = glow::differentiate(F, TC, "keep", &keepGrads);
+
+  // A single byte of budget recomputes every cheap activation.
+  TC.activationMemoryBudget = 1;
+  VariableGradientsList recomputeGrads;
+  Function *recomputeF =
+      glow::differentiate(F, TC, "recompute", &recomputeGrads);
+
+  unsigned numRecomputed = 0;
+  for (auto &N : recomputeF->getNodes()) {
+    numRecomputed += N.isRecomputation();
+  }
+  // The backward pass reads the results of the tanh, relu, square and sigmoid
+  // activations.
+  EXPECT_GE(numRecomputed, 4);
+  for (auto &N : keepF->getNodes()) {
+    EXPECT_FALSE(N.isRecomputation());
+  }
+
+  EE.compile(CompilationMode::Train, keepF, ctx);
+  EE.run();
+  EE.compile(CompilationMode::Train, recomputeF, ctx);
+  EE.run();
+
+  ASSERT_EQ(keepGrads.size(), recomputeGrads.size());
+  for (auto it = keepGrads.begin(), rit = recomputeGrads.begin(),
+            e = keepGrads.end();
+       it != e; ++it, ++rit) {
+    EXPECT_EQ(it->first, rit->first);
+    auto &keepGrad = llvm::cast<Variable>(it->second)->getPayload();
+    auto &recomputeGrad = llvm::cast<Variable>(rit->second)->getPayload();
+    EXPECT_TRUE(keepGrad.isEqual(recomputeGrad));
+  }
+}
+
+/// Check that storing the backward inputs in half precision with a loss
+/// scale produces gradients close to the ones computed in float.
+TEST(GraphAutoGrad, float16Gradients) {
+  ExecutionEngine EE;
+  Context ctx;
+  TrainingConfig TC;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *X = mod.createVariable(ElemKind::FloatTy, {4, 8}, "X",
+                               VisibilityKind::Public, false);
+  auto *Y = mod.createVariable(ElemKind::FloatTy, {4, 4}, "Y",
+                               VisibilityKind::Public, false);
+  X->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+  Y->getPayload().getHandle().randomize(-1, 1, mod.getPRNG());
+
+  auto *H = F->createTanh("tanh", F->createFullyConnected("fc1", X, 8));
+  auto *FC = F->createFullyConnected("fc2", H, 4);
+  auto *reg = F->createRegression("reg", FC, Y);
+  F->createSave("return", reg);
+
+  VariableGradientsList floatGrads;
+  Function *floatF = glow::differentiate(F, TC, "float", &floatGrads);
+
+  TC.float16Gradients = true;
+  TC.lossScale = 1024;
+  VariableGradientsList halfGrads;
+  Function *halfF = glow::differentiate(F, TC, "half", &halfGrads);
+
+  unsigned numConversions = 0;
+  for (auto &N : halfF->getNodes()) {
+    auto *CN = llvm::dyn_cast<ConvertToNode>(&N);
+    numConversions +=
+        CN && CN->getResult().getElementType() == ElemKind::Float16Ty;
+  }
+  EXPECT_GT(numConversions, 0);
+
+  EE.compile(CompilationMode::Train, floatF, ctx);
+  EE.run();
+  EE.compile(CompilationMode::Train, halfF, ctx);
+  EE.run();
+
+  ASSERT_EQ(floatGrads.size(), halfGrads.size());
+  for (auto it = floatGrads.begin(), hit = halfGrads.begin(),
+            e = floatGrads.end();
+       it != e; ++it, ++hit) {
+    EXPECT_EQ(it->first, hit->first);
+    auto &floatGrad = llvm::cast<Variable>(it->second)->getPayload();
+    auto &halfGrad = llvm::cast<Variable>(hit->second)->getPayload();
+    EXPECT_TRUE(floatGrad.isEqual(halfGrad, 1e-2));
+  }
+}
+
+/// Check that the dynamic loss scale skips the update of a step whose
+/// gradients overflow and halves the scale, and that it grows after a step
+/// without overflow.
+TEST(GraphAutoGrad, dynamicLossScaling) {
+  ExecutionEngine EE;
+  Context ctx;
+  TrainingConfig TC;
+  TC.learningRate = 0.5;
+  TC.dynamicLossScaling = true;
+  TC.lossScale = 3e38;
+  TC.lossScaleGrowthInterval = 1;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *X = mod.createVariable(ElemKind::FloatTy, {4}, "X",
+                               VisibilityKind::Public, false);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4}, "W");
+  auto *Y = mod.createVariable(ElemKind::FloatTy, {4}, "Y",
+                               VisibilityKind::Public, false);
+  X->getPayload().getHandle().clear(1);
+  W->getPayload().getHandle() = {1, -2, 3, 0};
+  Y->getPayload().getHandle() = {0, 1, 1, -1};
+
+  auto *reg = F->createRegression("reg", F->createMul("mul", X, W), Y);
+  F->createSave("return", reg);
+
+  Function *TF = glow::differentiate(F, TC);
+  auto *scale = mod.getVariableByName("lossScale");
+  ASSERT_TRUE(scale);
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  // The gradients W - Y overflow when multiplied by the scale.
+  const float w[] = {1, -2, 3, 0};
+  const float y[] = {0, 1, 1, -1};
+  EE.run();
+  auto H = W->getPayload().getHandle();
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_EQ(H.at({i}), w[i]);
+  }
+  EXPECT_FLOAT_EQ(scale->getPayload().getHandle().at({0}), 1.5e38);
+
+  // A smaller scale keeps the gradients finite.
+  scale->getPayload().getHandle().at({0}) = 1e30;
+  EE.run();
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_NEAR(H.at({i}), w[i] - TC.learningRate * (w[i] - y[i]), 1e-5);
+  }
+  EXPECT_FLOAT_EQ(scale->getPayload().getHandle().at({0}), 2e30);
+}
+
+/// Check that the SGD with momentum that the backends keep as a single node
+/// accumulates the updates of the previous iterations.
+TEST(GraphAutoGrad, momentumSGD) {
+  ExecutionEngine EE;
+  Context ctx;
+  TrainingConfig TC;
+  TC.learningRate = 0.5;
+  TC.momentum = 0.25;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *X = mod.createVariable(ElemKind::FloatTy, {4}, "X",
+                               VisibilityKind::Public, false);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4}, "W");
+  auto *Y = mod.createVariable(ElemKind::FloatTy, {4}, "Y",
+                               VisibilityKind::Public, false);
+  X->getPayload().getHandle().clear(1);
+  W->getPayload().getHandle() = {1, -2, 3, 0};
+  Y->getPayload().getHandle() = {0, 1, 1, -1};
+
+  auto *reg = F->createRegression("reg", F->createMul("mul", X, W), Y);
+  F->createSave("return", reg);
+
+  Function *TF = glow::differentiate(F, TC);
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  unsigned numMomentumSGD = 0;
+  for (auto &N : TF->getNodes()) {
+    EXPECT_FALSE(llvm::isa<SGDNode>(&N));
+    numMomentumSGD += llvm::isa<MomentumSGDNode>(&N);
+  }
+  EXPECT_EQ(numMomentumSGD, 1);
+
+  // The gradient of the regression is (W * X - Y) * X = W - Y.
+  const float w[] = {1, -2, 3, 0};
+  const float y[] = {0, 1, 1, -1};
+  float expected[4], gsum[4];
+  for (size_t i = 0; i < 4; i++) {
+    expected[i] = w[i];
+    gsum[i] = 0;
+  }
+  for (unsigned iter = 0; iter < 3; iter++) {
+    EE.run();
+    auto H = W->getPayload().getHandle();
+    for (size_t i = 0; i < 4; i++) {
+      gsum[i] = TC.momentum * gsum[i] -
+                TC.learningRate * (expected[i] - y[i]);
+      expected[i] += gsum[i];
+      EXPECT_NEAR(H.at({i}), expected[i], 1e-5);
+    }
+  }
+}
+
+/// Trains for three iterations the weight W of the regression of W * X, with X
+/// all ones, towards Y, with the configuration \p TC, and compares W with the
+/// reference \p update, which updates the weight \p w of index \p i with the
+/// gradient \p g in every iteration.
+static void checkOptimizer(
+    const TrainingConfig &TC,
+    const std::function<float(size_t i, float w, float g)> &update) {
+  ExecutionEngine EE;
+  Context ctx;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *X = mod.createVariable(ElemKind::FloatTy, {4}, "X",
+                               VisibilityKind::Public, false);
+  auto *W = mod.createVariable(ElemKind::FloatTy, {4}, "W");
+  auto *Y = mod.createVariable(ElemKind::FloatTy, {4}, "Y",
+                               VisibilityKind::Public, false);
+  X->getPayload().getHandle().clear(1);
+  W->getPayload().getHandle() = {1, -2, 3, 0};
+  Y->getPayload().getHandle() = {0, 1, 1, -1};
+
+  auto *reg = F->createRegression("reg", F->createMul("mul", X, W), Y);
+  F->createSave("return", reg);
+
+  Function *TF = glow::differentiate(F, TC);
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  float expected[] = {1, -2, 3, 0};
+  const float y[] = {0, 1, 1, -1};
+  for (unsigned iter = 0; iter < 3; iter++) {
+    EE.run();
+    auto H = W->getPayload().getHandle();
+    for (size_t i = 0; i < 4; i++) {
+      // The gradient of the regression is W - Y.
+      expected[i] = update(i, expected[i], expected[i] - y[i]);
+      EXPECT_NEAR(H.at({i}), expected[i], 1e-5);
+    }
+  }
+}
+
+TEST(GraphAutoGrad, adagrad) {
+  TrainingConfig TC;
+  TC.optimizer = OptimizerKind::Adagrad;
+  TC.learningRate = 0.5;
+  float sumSq[4] = {0};
+  checkOptimizer(TC, [&](size_t i, float w, float g) {
+    sumSq[i] += g * g;
+    return w - TC.learningRate * g / (std::sqrt(sumSq[i]) + TC.epsilon);
+  });
+}
+
+TEST(GraphAutoGrad, rmsprop) {
+  TrainingConfig TC;
+  TC.optimizer = OptimizerKind::RMSProp;
+  TC.learningRate = 0.1;
+  TC.decay = 0.8;
+  float meanSq[4] = {0};
+  checkOptimizer(TC, [&](size_t i, float w, float g) {
+    meanSq[i] = TC.decay * meanSq[i] + (1 - TC.decay) * g * g;
+    return w - TC.learningRate * g / (std::sqrt(meanSq[i]) + TC.epsilon);
+  });
+}
+
+TEST(GraphAutoGrad, adam) {
+  TrainingConfig TC;
+  TC.optimizer = OptimizerKind::Adam;
+  TC.learningRate = 0.1;
+  float m[4] = {0}, v[4] = {0};
+  unsigned steps[4] = {0};
+  checkOptimizer(TC, [&](size_t i, float w, float g) {
+    float t = ++steps[i];
+    m[i] = TC.beta1 * m[i] + (1 - TC.beta1) * g;
+    v[i] = TC.beta2 * v[i] + (1 - TC.beta2) * g * g;
+    float mHat = m[i] / (1 - std::pow(TC.beta1, t));
+    float vHat = v[i] / (1 - std::pow(TC.beta2, t));
+    return w - TC.learningRate * mHat / (std::sqrt(vHat) + TC.epsilon);
+  });
+}
+
+/// Check that training an embedding table looked up by SparseLengthsWeightedSum
+/// updates only the rows that are looked up, with a row gradient per index.
+TEST(GraphAutoGrad, sparseLengthsWeightedSumSGD) {
+  ExecutionEngine EE;
+  Context ctx;
+  TrainingConfig TC;
+  TC.learningRate = 0.5;
+
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *data = mod.createVariable(ElemKind::FloatTy, {4, 2}, "data");
+  auto *weights = mod.createVariable(ElemKind::FloatTy, {3}, "weights",
+                                     VisibilityKind::Public, false);
+  auto *indices = mod.createVariable(ElemKind::Int64ITy, {3}, "indices",
+                                     VisibilityKind::Public, false);
+  auto *lengths = mod.createVariable(ElemKind::Int64ITy, {2}, "lengths",
+                                     VisibilityKind::Public, false);
+  auto *Y = mod.createVariable(ElemKind::FloatTy, {2, 2}, "Y",
+                               VisibilityKind::Public, false);
+  data->getPayload().getHandle() = {1, 2, 3, 4, 5, 6, 7, 8};
+  weights->getPayload().getHandle() = {1, 2, 3};
+  indices->getPayload().getHandle<int64_t>() = {0, 2, 0};
+  lengths->getPayload().getHandle<int64_t>() = {2, 1};
+  Y->getPayload().getHandle() = {0, 1, 2, 3};
+
+  auto *SLWS = F->createSparseLengthsWeightedSum("slws", data, weights,
+                                                 indices, lengths);
+  auto *reg = F->createRegression("reg", SLWS, Y);
+  F->createSave("return", reg);
+
+  Function *TF = glow::differentiate(F, TC);
+  EE.compile(CompilationMode::Train, TF, ctx);
+
+  unsigned numSparseSGD = 0;
+  for (auto &N : TF->getNodes()) {
+    EXPECT_FALSE(llvm::isa<SGDNode>(&N));
+    numSparseSGD += llvm::isa<SparseSGDNode>(&N);
+  }
+  EXPECT_EQ(numSparseSGD, 1);
+
+  EE.run();
+
+  // The results are {1 * data[0] + 2 * data[2], 3 * data[0]} = {{11, 14},
+  // {3, 6}}, and their gradients are {{11, 13}, {1, 3}}. Row 0 gets the
+  // gradient of the first segment once and the one of the second segment
+  // three times, and row 2 gets the gradient of the first segment twice.
+  auto H = data->getPayload().getHandle();
+  const float expected[] = {1 - 0.5 * (11 + 3 * 1),
+                            2 - 0.5 * (13 + 3 * 3),
+                            3,
+                            4,
+                            5 - 0.5 * 2 * 11,
+                            6 - 0.5 * 2 * 13,
+                            7,
+                            8};
+  for (size_t i = 0; i < 8; i++) {
+    EXPECT_NEAR(H.raw(i), expected[i], 1e-5);
+  }
+}
+
+/// Check that training with the fused SoftMaxCrossEntropyLoss updates the
+/// weights like training with a SoftMax whose Selected input is the labels.
+TEST(GraphAutoGrad, softMaxCrossEntropyLoss) {
+  TrainingConfig TC;
+  TC.learningRate = 0.1;
+
+  Tensor trained[2];
+  for (unsigned fused = 0; fused < 2; fused++) {
+    ExecutionEngine EE;
+    Context ctx;
+    auto &mod = EE.getModule();
+    Function *F = mod.createFunction("main");
+
+    auto *X = mod.createVariable(ElemKind::FloatTy, {2, 3}, "X",
+                                 VisibilityKind::Public, false);
+    auto *W = mod.createVariable(ElemKind::FloatTy, {3, 4}, "W");
+    auto *B = mod.createVariable(ElemKind::FloatTy, {4}, "B");
+    auto *labels = mod.createVariable(ElemKind::Int64ITy, {2, 1}, "labels",
+                                      VisibilityKind::Public, false);
+    X->getPayload().getHandle() = {1, -2, 0.5, 0, 3, -1};
+    W->getPayload().getHandle() = {0.1, -0.2, 0.3, 0.4, -0.5, 0.6,
+                                   0.7, -0.8, 0.9, 1.0, -1.1, 1.2};
+    B->getPayload().getHandle().clear(0);
+    labels->getPayload().getHandle<int64_t>() = {3, 0};
+
+    auto *FC = F->createFullyConnected("fc", X, W, B);
+    if (fused) {
+      F->createSave("loss",
+                    F->createSoftMaxCrossEntropyLoss("xent", FC, labels));
+    } else {
+      F->createSave("probs", F->createSoftMax("sm", FC, labels));
+    }
+
+    Function *TF = glow::differentiate(F, TC);
+    EE.compile(CompilationMode::Train, TF, ctx);
+    EE.run();
+    trained[fused].assign(&W->getPayload());
+  }
+
+  EXPECT_TRUE(trained[0].isEqual(trained[1], 1e-5));
+}
@@ -14,11 +14,13 @@
  * limitations under the License.
  */
 
+#include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Graph/Node.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/IR/IR.h"
 #include "glow/Optimizer/Optimizer.h"
+#include "glow/Optimizer/RewriteRules.h"
 
 #include "gtest/gtest.h"
 
@@ -270,6 +272,30 @@ TEST_F(GraphOptz, sinkTransposeBelowTanh) {
   EXPECT_EQ(F_->getNodes().size(), 3);
 }
 
+/// A transpose is sunk through a long chain of nodes until it meets the
+/// transpose that cancels it out.
+TEST_F(GraphOptz, sinkTransposeThroughLongChain) {
+  constexpr unsigned chainLength = 200;
+  Node *A = mod_.createVariable(ElemKind::FloatTy, {1, 5, 10, 15}, "input",
+                                VisibilityKind::Public, false);
+  NodeValue V = F_->createTranspose("transpose", A, NHWC2NCHW);
+  for (unsigned i = 0; i < chainLength; i++) {
+    V = (i % 2) ? NodeValue(F_->createTanh("tanh", V))
+                : NodeValue(F_->createRELU("relu", V));
+  }
+  V = F_->createTranspose("transpose", V, NCHW2NHWC);
+  SaveNode *O = F_->createSave("ret", V);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  // Only the chain and the save are left.
+  EXPECT_EQ(F_->getNodes().size(), chainLength + 1);
+  for (auto &N : F_->getNodes()) {
+    EXPECT_FALSE(llvm::isa<TransposeNode>(&N));
+  }
+  EXPECT_EQ(O->getInput().dims(), A->dims(0));
+}
+
 TEST_F(GraphOptz, cancelTwoTransposes) {
   Node *A = mod_.createVariable(ElemKind::FloatTy, {1, 5, 10, 15}, "input",
                                 VisibilityKind::Public, false);
@@ -1052,6 +1078,60 @@ static unsigned countNodeKind(Function *F, Kinded::Kind kind) {
   return count;
 }
 
+TEST_F(GraphOptz, sinkDequantizeThroughLayoutNodes) {
+  // Check that the conversions around layout operations that were left in
+  // floating point cancel out.
+  Variable *input = mod_.createVariable(ElemKind::Int8QTy, {4, 10}, 0.5, 11,
+                                        "input", VisibilityKind::Public, true);
+
+  // dequantize -> slice -> reshape -> transpose -> quantize -> save.
+  auto *DQ = F_->createDequantize("dequantize", input);
+  auto *slice = F_->createSlice("slice", DQ, {0, 0}, {3, 4});
+  auto *reshape = F_->createReshape("reshape", slice, {2, 6});
+  auto *transpose = F_->createTranspose("transpose", reshape, {1, 0});
+  auto *Q = F_->createQuantize(
+      "quantize", transpose,
+      mod_.uniqueType(ElemKind::Int8QTy, {6, 2}, 0.25, 4));
+  auto *save = F_->createSave("ret", Q);
+
+  EXPECT_EQ(F_->getNodes().size(), 6);
+  EXPECT_EQ(::glow::optimizeQuantizationConversions(F_), 1);
+
+  // The layout operations now work on int8 data and a single rescale is left.
+  auto *RS = llvm::dyn_cast<RescaleQuantizedNode>(save->getInput());
+  ASSERT_TRUE(RS);
+  EXPECT_EQ(RS->getResult().getType()->getScale(), 0.25);
+  auto *T = llvm::dyn_cast<TransposeNode>(RS->getInput());
+  ASSERT_TRUE(T);
+  EXPECT_TRUE(T->getResult().getType()->isQuantizedType());
+  EXPECT_EQ(F_->getNodes().size(), 5);
+}
+
+TEST_F(GraphOptz, mergeConversionsAroundConcat) {
+  // Check that Quantize(Concat(Dequantize(X), Dequantize(Y))) becomes a
+  // quantized concat of rescaled inputs.
+  Variable *X = mod_.createVariable(ElemKind::Int8QTy, {2, 5}, 0.5, 11, "X",
+                                    VisibilityKind::Public, true);
+  Variable *Y = mod_.createVariable(ElemKind::Int8QTy, {3, 5}, 0.2, -3, "Y",
+                                    VisibilityKind::Public, true);
+  auto *DQX = F_->createDequantize("dequantize", X);
+  auto *DQY = F_->createDequantize("dequantize", Y);
+  auto *CN = F_->createConcat("concat", {DQX, DQY}, 0);
+  auto *Q = F_->createQuantize(
+      "quantize", CN, mod_.uniqueType(ElemKind::Int8QTy, {5, 5}, 0.5, 11));
+  auto *save = F_->createSave("ret", Q);
+
+  EXPECT_EQ(::glow::optimizeQuantizationConversions(F_), 2);
+
+  // X already has the requested type, so only Y needs a rescale.
+  auto *newCN = llvm::dyn_cast<ConcatNode>(save->getInput());
+  ASSERT_TRUE(newCN);
+  EXPECT_EQ(newCN->getInputs()[0].getNode(), X);
+  EXPECT_TRUE(llvm::isa<RescaleQuantizedNode>(newCN->getInputs()[1].getNode()));
+  EXPECT_EQ(countNodeKind(F_, Kinded::Kind::DequantizeNodeKind), 0);
+  EXPECT_EQ(countNodeKind(F_, Kinded::Kind::QuantizeNodeKind), 0);
+}
+
 // Check that we are able to merge some small matmuls into a larger one.
 TEST_F(GraphOptz, mergeMatMulNodes) {
   Node *input = mod_.createVariable(ElemKind::FloatTy, {10, 10, 10}, "input");
@@ -1335,3 +1415,350 @@ TEST_F(GraphOptz, eliminateSingleConcat) {
   // Save node should just save the input.
   EXPECT_TRUE(SN->getInput().getNode() == input);
 }
+
+/// Test that a conversion of half precision values to float and back is
+/// eliminated, while the half precision storage of the variable is kept.
+TEST_F(GraphOptz, eliminateRoundTripConversion) {
+  Node *input = mod_.createVariable(ElemKind::Float16Ty, {10}, "input",
+                                    VisibilityKind::Public, false);
+
+  auto *toFloat = F_->createConvertTo("toFloat", input, ElemKind::FloatTy);
+  auto *toHalf = F_->createConvertTo("toHalf", toFloat, ElemKind::Float16Ty);
+  SaveNode *SN = F_->createSave("ret", toHalf);
+
+  // The two ConvertToNodes and the SaveNode.
+  EXPECT_EQ(F_->getNodes().size(), 3);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  // Just the SaveNode should be left, saving the input.
+  EXPECT_EQ(F_->getNodes().size(), 1);
+  EXPECT_TRUE(SN->getInput().getNode() == input);
+  EXPECT_EQ(input->getType(0)->getElementType(), ElemKind::Float16Ty);
+}
+
+/// Test that the conversion of a splat is folded into the splat.
+TEST_F(GraphOptz, foldConvertedSplat) {
+  auto *splat = F_->createSplat(
+      "splat", mod_.uniqueType(ElemKind::FloatTy, {10}), 1.5);
+  auto *CN = F_->createConvertTo("toHalf", splat, ElemKind::Float16Ty);
+  SaveNode *SN = F_->createSave("ret", CN);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  // The SaveNode and the new SplatNode should be left.
+  EXPECT_EQ(F_->getNodes().size(), 2);
+  auto *newSplat = llvm::dyn_cast<SplatNode>(SN->getInput().getNode());
+  ASSERT_TRUE(newSplat);
+  EXPECT_EQ(newSplat->getResult().getElementType(), ElemKind::Float16Ty);
+  EXPECT_EQ(newSplat->getValue(), 1.5);
+}
+
+/// Check that a chain of operations on constant weights is evaluated ahead of
+/// time and replaced by a single variable.
+TEST_F(GraphOptz, constantFoldWeightChain) {
+  auto *input = mod_.createPlaceholder(ElemKind::FloatTy, {2, 4}, "input",
+                                       /* isTrainable */ false);
+  auto *W = mod_.createVariable(ElemKind::FloatTy, {3, 4}, "W",
+                                VisibilityKind::Private, false);
+  W->getHandle() = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  Tensor weights = W->getPayload().clone();
+  auto *T = F_->createTranspose("transpose", W, {1, 0});
+  auto *two = F_->createSplat("two", T->getResult().getType(), 2);
+  auto *M = F_->createMul("mul", T, two);
+  auto *MM = F_->createMatMul("matmul", input, M);
+  F_->createSave("save", MM);
+
+  EXPECT_TRUE(constantFold(F_));
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  // Only the matmul and the save remain.
+  EXPECT_EQ(F_->getNodes().size(), 2);
+  auto *folded = llvm::dyn_cast<Variable>(MM->getRHS().getNode());
+  ASSERT_TRUE(folded);
+  EXPECT_EQ(folded->dims(), llvm::ArrayRef<size_t>({4, 3}));
+  auto H = folded->getHandle();
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      EXPECT_EQ(H.at({i, j}), 2 * weights.getHandle().at({j, i}));
+    }
+  }
+
+  // The function that evaluated the chain is gone.
+  EXPECT_EQ(mod_.getFunctions().size(), 1);
+}
+
+/// Check that the transpose of a RHS that can't be constant-folded is absorbed
+/// by the MatMul, and that the transpose of a transposed RHS cancels out.
+TEST_F(GraphOptz, foldTransposeIntoMatMul) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {2, 4}, "input",
+                                    VisibilityKind::Public, false);
+  auto *W = mod_.createVariable(ElemKind::FloatTy, {3, 4}, "W",
+                                VisibilityKind::Public, false);
+  auto *V = mod_.createVariable(ElemKind::FloatTy, {4, 3}, "V",
+                                VisibilityKind::Public, false);
+  auto *TW = F_->createTranspose("tw", W, {1, 0});
+  F_->createSave("save1", F_->createMatMul("mm1", input, TW));
+  auto *TV = F_->createTranspose("tv", V, {1, 0});
+  F_->createSave("save2", F_->createMatMul("mm2", input, TV, true));
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  EXPECT_EQ(countNodeKind(F_, Kinded::Kind::TransposeNodeKind), 0);
+  for (auto &N : F_->getNodes()) {
+    auto *MM = llvm::dyn_cast<MatMulNode>(&N);
+    if (!MM) {
+      continue;
+    }
+    if (MM->getRHS().getNode() == W) {
+      EXPECT_TRUE(MM->getTransposeRHS());
+    } else {
+      EXPECT_EQ(MM->getRHS().getNode(), V);
+      EXPECT_FALSE(MM->getTransposeRHS());
+    }
+  }
+  EXPECT_EQ(countNodeKind(F_, Kinded::Kind::MatMulNodeKind), 2);
+}
+
+/// Check that trainable, public and written variables are not folded.
+TEST_F(GraphOptz, constantFoldOnlyConstantVariables) {
+  auto *trainable = mod_.createVariable(ElemKind::FloatTy, {2, 2}, "trainable",
+                                        VisibilityKind::Private, true);
+  auto *pub = mod_.createVariable(ElemKind::FloatTy, {2, 2}, "public",
+                                  VisibilityKind::Public, false);
+  auto *written = mod_.createVariable(ElemKind::FloatTy, {2, 2}, "written",
+                                      VisibilityKind::Private, false);
+  F_->createSave("save1", F_->createTranspose("t1", trainable, {1, 0}));
+  F_->createSave("save2", F_->createTranspose("t2", pub, {1, 0}));
+  F_->createSave("save3", F_->createTranspose("t3", written, {1, 0}));
+  F_->createSave("write", pub, written);
+
+  EXPECT_FALSE(constantFold(F_));
+  EXPECT_EQ(F_->getNodes().size(), 7);
+}
+
+/// Check that a concat of more than two transposed values is computed in the
+/// layout of its inputs, which local sinking does not handle.
+TEST_F(GraphOptz, assignLayoutOfConcat) {
+  std::vector<NodeValue> inputs;
+  for (unsigned i = 0; i < 3; i++) {
+    auto *V = mod_.createVariable(ElemKind::FloatTy, {1, 5, 10, 15}, "input",
+                                  VisibilityKind::Public, false);
+    inputs.push_back(F_->createTranspose("transpose", V, NCHW2NHWC));
+  }
+  auto *CN = F_->createConcat("concat", inputs, 3);
+  auto *O = F_->createSave("ret", CN);
+
+  EXPECT_EQ(::glow::assignLayouts(F_, CompilationMode::Infer), 2);
+  EXPECT_EQ(countNodeKind(F_, Kinded::Kind::TransposeNodeKind), 1);
+
+  // The concat is now done on the channel dimension of the NCHW inputs.
+  auto *TR = llvm::dyn_cast<TransposeNode>(O->getInput());
+  ASSERT_TRUE(TR);
+  auto *newCN = llvm::dyn_cast<ConcatNode>(TR->getInput());
+  ASSERT_TRUE(newCN);
+  EXPECT_EQ(newCN->getDim(), 1);
+  EXPECT_EQ(newCN->getResult().dims(), llvm::ArrayRef<size_t>({1, 15, 10, 15}));
+  EXPECT_EQ(O->getInput().dims(), CN->getResult().dims());
+}
+
+/// Check that a bias add between two layout conversions is done in the layout
+/// of its input, and that the transpose of the bias is folded.
+TEST_F(GraphOptz, assignLayoutBetweenTransposes) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {1, 5, 10, 15}, "input",
+                                    VisibilityKind::Public, false);
+  auto *bias = mod_.createVariable(ElemKind::FloatTy, {1, 10, 15, 5}, "bias",
+                                   VisibilityKind::Private, false);
+  auto *T1 = F_->createTranspose("transpose1", input, NCHW2NHWC);
+  auto *A = F_->createAdd("add", T1, bias);
+  auto *T2 = F_->createTranspose("transpose2", A, NHWC2NCHW);
+  auto *O = F_->createSave("ret", T2);
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  EXPECT_EQ(countNodeKind(F_, Kinded::Kind::TransposeNodeKind), 0);
+  auto *newA = llvm::dyn_cast<AddNode>(O->getInput());
+  ASSERT_TRUE(newA);
+  EXPECT_EQ(newA->getLHS().getNode(), input);
+  auto *newBias = llvm::dyn_cast<Variable>(newA->getRHS().getNode());
+  ASSERT_TRUE(newBias);
+  EXPECT_EQ(newBias->dims(), llvm::ArrayRef<size_t>({1, 5, 10, 15}));
+}
+
+/// Check that the layout of a region is kept when another layout would not
+/// need fewer transposes.
+TEST_F(GraphOptz, assignLayoutKeepsLayoutIfNotProfitable) {
+  auto *A = mod_.createVariable(ElemKind::FloatTy, {1, 5, 10, 15}, "A",
+                                VisibilityKind::Public, false);
+  auto *B = mod_.createVariable(ElemKind::FloatTy, {1, 10, 15, 5}, "B",
+                                VisibilityKind::Public, false);
+  auto *T = F_->createTranspose("transpose", A, NCHW2NHWC);
+  auto *R = F_->createRELU("relu", F_->createAdd("add", T, B));
+  F_->createSave("ret", R);
+
+  EXPECT_EQ(::glow::assignLayouts(F_, CompilationMode::Infer), 0);
+  EXPECT_EQ(F_->getNodes().size(), 4);
+}
+
+/// Check that the rewrite rules only apply to the nodes of their kind that
+/// satisfy their predicates, that they are tried in order, and that a rule
+/// can match the node created by another.
+TEST_F(GraphOptz, rewriteRules) {
+  Node *A = mod_.createVariable(ElemKind::FloatTy, {4, 8}, "A");
+  Node *B = mod_.createVariable(ElemKind::FloatTy, {4, 8}, "B");
+  Node *twice = F_->createAdd("twice", A, A);
+  Node *sum = F_->createAdd("sum", A, B);
+  Node *tanh = F_->createTanh("tanh", twice);
+  SaveNode *O1 = F_->createSave("ret1", tanh);
+  SaveNode *O2 = F_->createSave("ret2", sum);
+
+  unsigned numDeclined = 0;
+  RewriteRuleSet rules;
+  rules.add<AddNode>(Kinded::Kind::AddNodeKind, "decline",
+                     [&](AddNode *AN, Function *F) -> Node * {
+                       numDeclined++;
+                       return nullptr;
+                     },
+                     rewrite::hasElemType(ElemKind::FloatTy));
+  rules.add<AddNode>(
+      Kinded::Kind::AddNodeKind, "add-to-mul",
+      [](AddNode *AN, Function *F) -> Node * {
+        auto *two = F->createSplat("two", AN->getResult().getType(), 2);
+        return F->createMul("mul", AN->getLHS(), two);
+      },
+      [](const Node *N) {
+        auto *AN = llvm::cast<AddNode>(N);
+        return AN->getLHS() == AN->getRHS();
+      });
+  rules.add<TanhNode>(Kinded::Kind::TanhNodeKind, "tanh-of-mul",
+                      [](TanhNode *TN, Function *F) -> Node * {
+                        return F->createSigmoid("sigmoid", TN->getInput());
+                      },
+                      rewrite::allOf({rewrite::hasSingleUser(),
+                                      rewrite::inputIs(
+                                          0, Kinded::Kind::MulNodeKind)}));
+  EXPECT_EQ(rules.size(), 3);
+  EXPECT_EQ(rules.getRules(Kinded::Kind::AddNodeKind).size(), 2);
+  EXPECT_TRUE(rules.getRules(Kinded::Kind::SubNodeKind).empty());
+
+  EXPECT_TRUE(rules.apply(F_));
+  EXPECT_EQ(numDeclined, 2);
+
+  auto *SN = llvm::dyn_cast<SigmoidNode>(O1->getInput().getNode());
+  ASSERT_TRUE(SN);
+  auto *MN = llvm::dyn_cast<MulNode>(SN->getInput().getNode());
+  ASSERT_TRUE(MN);
+  EXPECT_EQ(MN->getLHS().getNode(), A);
+  EXPECT_TRUE(llvm::isa<SplatNode>(MN->getRHS().getNode()));
+  EXPECT_EQ(O2->getInput().getNode(), sum);
+
+  // Nothing is left to rewrite once the replaced nodes are erased.
+  F_->eraseNode(tanh);
+  F_->eraseNode(twice);
+  EXPECT_FALSE(rules.apply(F_));
+  EXPECT_EQ(numDeclined, 3);
+}
+
+/// Check that large constants with the same content are deduplicated, and
+/// that the ones that only differ in their last element are not.
+TEST_F(GraphOptz, dedupLargeConstants) {
+  constexpr size_t numRows = 1024;
+  constexpr size_t numCols = 64;
+  Node *in = mod_.createVariable(ElemKind::FloatTy, {numRows, numCols}, "in",
+                                 VisibilityKind::Public, false);
+  Variable *E[3];
+  for (unsigned i = 0; i < 3; i++) {
+    E[i] = mod_.createVariable(ElemKind::FloatTy, {numRows, numCols}, "table",
+                               VisibilityKind::Private, false);
+    auto H = E[i]->getPayload().getHandle();
+    for (size_t j = 0, e = H.size(); j < e; j++) {
+      H.raw(j) = j % 17;
+    }
+  }
+  E[2]->getPayload().getHandle().raw(numRows * numCols - 1) = -1;
+
+  SaveNode *O[3];
+  for (unsigned i = 0; i < 3; i++) {
+    O[i] = F_->createSave("ret", F_->createAdd("add", E[i], in));
+  }
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+
+  // The first two tables are merged, and so are the additions that use them.
+  EXPECT_EQ(O[0]->getInput().getNode(), O[1]->getInput().getNode());
+  EXPECT_NE(O[0]->getInput().getNode(), O[2]->getInput().getNode());
+  // The input, two of the tables and the outputs of the saves are left.
+  EXPECT_EQ(mod_.getVars().size(), 6);
+}
+
+/// Check that the variants of a function built from its clones share the
+/// quantized weights, unless the original weights change in between.
+TEST_F(GraphOptz, clonesShareDerivedWeights) {
+  auto *W = mod_.createVariable(ElemKind::FloatTy, {64, 64}, "weights",
+                                VisibilityKind::Private, false);
+  W->getPayload().getHandle().randomize(-1.0, 1.0, mod_.getPRNG());
+  auto *qTy = mod_.uniqueType(ElemKind::Int8QTy, {64, 64}, 0.01, 0);
+  SaveNode *O = F_->createSave("ret", F_->createQuantize("quantize", W, qTy));
+
+  llvm::DenseMap<Node *, Node *> mapG, mapH;
+  Function *G = F_->clone("G", &mapG);
+  Function *H = F_->clone("H", &mapH);
+  auto *OG = llvm::cast<SaveNode>(mapG[O]);
+  auto *OH = llvm::cast<SaveNode>(mapH[O]);
+  EXPECT_EQ(G->getNodes().size(), F_->getNodes().size());
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+  ::glow::optimize(G, CompilationMode::Infer);
+  auto *QW = llvm::dyn_cast<Variable>(O->getInput().getNode());
+  ASSERT_TRUE(QW);
+  EXPECT_EQ(OG->getInput().getNode(), QW);
+
+  // A change of the weights is seen by the variants built afterwards.
+  W->getPayload().getHandle().raw(0) = 2;
+  ::glow::optimize(H, CompilationMode::Infer);
+  auto *QWH = llvm::dyn_cast<Variable>(OH->getInput().getNode());
+  ASSERT_TRUE(QWH);
+  EXPECT_NE(QWH, QW);
+  EXPECT_EQ(QWH->getHandle<int8_t>().raw(0), 127);
+  EXPECT_EQ(QW->getHandle<int8_t>().raw(1), QWH->getHandle<int8_t>().raw(1));
+}
+
+/// Check that updateWeights() replays the transformations of the weights on
+/// new data, also for the sources that were erased after they were
+/// transformed, and rejects the updates that it can't replay.
+TEST_F(GraphOptz, updateWeightsReplaysTransformations) {
+  auto *A = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "A",
+                                VisibilityKind::Private, false);
+  A->getHandle() = {1, 2, 3, 4, 5, 6};
+  SaveNode *O = F_->createSave("ret", F_->createTranspose("tr", A, {1, 0}));
+
+  ::glow::optimize(F_, CompilationMode::Infer);
+  auto *TA = llvm::dyn_cast<Variable>(O->getInput().getNode());
+  ASSERT_TRUE(TA);
+  EXPECT_EQ(mod_.getVariableByName("A"), nullptr);
+
+  Tensor newA(ElemKind::FloatTy, {2, 3});
+  newA.getHandle() = {6, 5, 4, 3, 2, 1};
+  std::vector<Variable *> updated;
+  ASSERT_TRUE(mod_.updateWeights({"A"}, {&newA}, &updated));
+  ASSERT_EQ(updated.size(), 1);
+  EXPECT_EQ(updated[0], TA);
+  EXPECT_EQ(TA->getHandle().at({0, 1}), 3);
+  EXPECT_EQ(TA->getHandle().at({2, 0}), 4);
+
+  // Derived variables can't be written to, and the types must match.
+  Tensor newTA(ElemKind::FloatTy, {3, 2});
+  EXPECT_FALSE(mod_.updateWeights({TA->getName()}, {&newTA}));
+  EXPECT_FALSE(mod_.updateWeights({"A"}, {&newTA}));
+  EXPECT_FALSE(mod_.updateWeights({"B"}, {&newA}));
+
+  // The transformations that can't be replayed reject the updates.
+  auto *B = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "B",
+                                VisibilityKind::Private, false);
+  auto *C = mod_.createVariable(ElemKind::FloatTy, {2, 3}, "C",
+                                VisibilityKind::Private, false);
+  mod_.addDerivedVariable({B}, C, "opaque", nullptr);
+  EXPECT_FALSE(mod_.updateWeights({"B"}, {&newA}));
+  EXPECT_EQ(B->getHandle().at({0, 0}), 0);
+  EXPECT_EQ(TA->getHandle().at({0, 1}), 3);
+}
@@ -22,7 +22,11 @@
 
 #include "gtest/gtest.h"
 
+#include <unordered_map>
+#include <vector>
+
 using namespace glow;
+using llvm::isa;
 
 /// Tests a case in which the memory required to store a node's
 /// output is greater than the memory required to store its input.
@@ -85,3 +89,132 @@ TEST(GraphScheduler, testMaxSizeLessThanResultSize) {
   // before concatSmall.
   EXPECT_LT(sliceBigIt, concatSmallIt);
 }
+
+/// \returns true if every node of \p F is scheduled exactly once in
+/// \p schedule and after all of its inputs.
+static bool isValidSchedule(Function *F, const NodesPtrList &schedule) {
+  std::unordered_map<const Node *, size_t> positions;
+  for (auto *N : schedule) {
+    if (!positions.insert({N, positions.size()}).second) {
+      return false;
+    }
+  }
+  if (positions.size() != F->getNodes().size()) {
+    return false;
+  }
+  for (auto &N : F->getNodes()) {
+    for (unsigned idx = 0, e = N.getNumInputs(); idx < e; ++idx) {
+      Node *input = N.getNthInput(idx);
+      if (!isa<Storage>(input) && positions[input] > positions[&N]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Check that all of the schedulers produce valid schedules.
+TEST(GraphScheduler, allSchedulersAreValid) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *A = MD.createVariable(ElemKind::FloatTy, {4, 8}, "A",
+                              VisibilityKind::Public);
+  auto *B = MD.createVariable(ElemKind::FloatTy, {8, 4}, "B",
+                              VisibilityKind::Public);
+  Node *tanh = F->createTanh("tanh", A);
+  Node *transpose = F->createTranspose("transpose", B, {1, 0});
+  Node *sigmoid = F->createSigmoid("sigmoid", transpose);
+  Node *add = F->createAdd("add", tanh, sigmoid);
+  Node *matmul = F->createMatMul("matmul", add, B);
+  Node *mul = F->createMul("mul", matmul, matmul);
+  F->createSave("save1", mul);
+  F->createSave("save2", add);
+
+  for (auto kind :
+       {SchedulerKind::ChildMemSize, SchedulerKind::MinPeakMemory,
+        SchedulerKind::DataParallel, SchedulerKind::CacheLocality}) {
+    NodesPtrList schedule;
+    createScheduler(kind, *F, schedule)->schedule();
+    EXPECT_TRUE(isValidSchedule(F, schedule));
+  }
+}
+
+/// Check that the dynamic programming finds a schedule with a smaller peak
+/// memory usage than ChildMemSizeBasedScheduler, which computes the children
+/// of each node one after the other.
+TEST(GraphScheduler, minPeakMemory) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  Node *small = F->createSplat("small", MD.uniqueType(ElemKind::FloatTy, {1}),
+                               1.0);
+  Node *large = F->createSplat("large", MD.uniqueType(ElemKind::FloatTy, {2}),
+                               2.0);
+  Node *slice = F->createSlice("slice", small, {0}, {1});
+  F->createSave("save1", F->createConcat("concat1", {slice, large}, 0));
+  F->createSave("save2", F->createConcat("concat2", {slice, small}, 0));
+
+  NodesPtrList childMemSizeSchedule;
+  ChildMemSizeBasedScheduler childMemSizeScheduler(*F, childMemSizeSchedule);
+  childMemSizeScheduler.schedule();
+  NodesPtrList minPeakSchedule;
+  MinPeakMemoryScheduler minPeakScheduler(*F, minPeakSchedule);
+  minPeakScheduler.schedule();
+
+  // Computing concat2 first frees small before large is computed.
+  EXPECT_TRUE(isValidSchedule(F, minPeakSchedule));
+  EXPECT_EQ(getSchedulePeakMemory(*F, childMemSizeSchedule), 28);
+  EXPECT_EQ(getSchedulePeakMemory(*F, minPeakSchedule), 24);
+}
+
+/// Check that shape compatible data parallel nodes are scheduled together.
+TEST(GraphScheduler, dataParallel) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *A = MD.createVariable(ElemKind::FloatTy, {4, 8}, "A",
+                              VisibilityKind::Public);
+  auto *B = MD.createVariable(ElemKind::FloatTy, {8, 4}, "B",
+                              VisibilityKind::Public);
+  Node *tanh = F->createTanh("tanh", A);
+  Node *transpose = F->createTranspose("transpose", B, {1, 0});
+  Node *sigmoid = F->createSigmoid("sigmoid", A);
+  Node *add = F->createAdd("add", tanh, transpose);
+  Node *mul = F->createMul("mul", add, sigmoid);
+  F->createSave("save", mul);
+
+  NodesPtrList schedule;
+  DataParallelScheduler scheduler(*F, schedule);
+  scheduler.schedule();
+  EXPECT_TRUE(isValidSchedule(F, schedule));
+
+  // The only node that is not data parallel goes first, so that all of the
+  // others form a single data parallel kernel.
+  EXPECT_EQ(schedule.front(), transpose);
+}
+
+/// Check that the consumers of a value are scheduled right after it.
+TEST(GraphScheduler, cacheLocality) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *A = MD.createVariable(ElemKind::FloatTy, {4, 8}, "A",
+                              VisibilityKind::Public);
+  Node *tanh = F->createTanh("tanh", A);
+  Node *sigmoid = F->createSigmoid("sigmoid", A);
+  Node *tanh2 = F->createTanh("tanh2", tanh);
+  Node *sigmoid2 = F->createSigmoid("sigmoid2", sigmoid);
+  F->createSave("save", F->createAdd("add", tanh2, sigmoid2));
+
+  NodesPtrList schedule;
+  CacheLocalityScheduler scheduler(*F, schedule);
+  scheduler.schedule();
+  EXPECT_TRUE(isValidSchedule(F, schedule));
+
+  std::vector<Node *> order(schedule.begin(), schedule.end());
+  for (size_t i = 0; i + 1 < order.size(); ++i) {
+    if (order[i] == tanh) {
+      EXPECT_EQ(order[i + 1], tanh2);
+    }
+    if (order[i] == sigmoid) {
+      EXPECT_EQ(order[i + 1], sigmoid2);
+    }
+  }
+}
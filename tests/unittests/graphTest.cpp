@@ -19,13 +19,17 @@
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Node.h"
 #include "glow/Graph/Nodes.h"
+#include "glow/Graph/Serialization.h"
 #include "glow/Graph/Utils.h"
 #include "glow/IR/IR.h"
 
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/FileSystem.h"
 
 #include "gtest/gtest.h"
 
+#include <cmath>
+
 using namespace glow;
 
 TEST(Graph, testVariableErasure) {
@@ -189,6 +193,57 @@ TEST(Graph, simpleTestFC) {
   EXPECT_GT(M.getInstrs().size(), 0);
 }
 
+/// Check that a backend that does not implement BatchedMatMul gets one MatMul
+/// per batch entry.
+TEST(Graph, lowerBatchedMatMul) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *lhs = MD.createVariable(ElemKind::FloatTy, {3, 4, 5}, "lhs");
+  auto *rhs = MD.createVariable(ElemKind::FloatTy, {3, 5, 6}, "rhs");
+  auto *BMM = F->createBatchedMatMul("BMM", lhs, rhs);
+  EXPECT_EQ(BMM->getResult().dims(), llvm::ArrayRef<size_t>({3, 4, 6}));
+  F->createSave("Save", BMM);
+
+  lower(F, MockBackend());
+  ::optimize(F, CompilationMode::Infer);
+
+  unsigned numMatMuls = 0;
+  for (auto &N : F->getNodes()) {
+    EXPECT_FALSE(llvm::isa<BatchedMatMulNode>(&N));
+    numMatMuls += llvm::isa<MatMulNode>(&N);
+  }
+  EXPECT_EQ(numMatMuls, 3);
+}
+
+/// Check that the recurrent cells are lowered to fully connected and
+/// element-wise nodes when the backend doesn't implement the units.
+TEST(Graph, lowerRecurrentCells) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *X = MD.createVariable(ElemKind::FloatTy, {1, 3, 4}, "X");
+  std::vector<Node *> inputs;
+  for (unsigned t = 0; t < 3; t++) {
+    inputs.push_back(F->createSlice("X", X, {0, t, 0}, {1, t + 1, 4}));
+  }
+  std::vector<NodeValue> outputs;
+  F->createLSTM("lstm", inputs, 1, 5, 2, outputs);
+  F->createGRU("gru", inputs, 1, 5, 2, outputs);
+  for (auto &O : outputs) {
+    F->createSave("save", O);
+  }
+
+  lower(F, MockBackend());
+  ::optimize(F, CompilationMode::Infer);
+
+  for (auto &N : F->getNodes()) {
+    EXPECT_FALSE(llvm::isa<LSTMCellNode>(&N) || llvm::isa<LSTMUnitNode>(&N) ||
+                 llvm::isa<GRUCellNode>(&N) || llvm::isa<GRUUnitNode>(&N));
+  }
+  IRFunction M(F);
+  M.generateIR();
+  EXPECT_GT(M.getInstrs().size(), 0);
+}
+
 TEST(Graph, QuantizationProfileNodes) {
   unsigned numInputs = 10;
   Module MD;
@@ -372,6 +427,50 @@ TEST(Graph, cloneTest2) {
   EXPECT_EQ(newF->getParent(), F->getParent());
 }
 
+/// Check that the members of an ensemble share their input and their common
+/// preprocessing once they are compiled together.
+TEST(Graph, createEnsemble) {
+  ExecutionEngine EE;
+  auto &M = EE.getModule();
+  Context ctx;
+  auto *input = M.createPlaceholder(ElemKind::FloatTy, {2, 3}, "input", false);
+  auto *res1 = M.createPlaceholder(ElemKind::FloatTy, {2, 3}, "res1", false);
+  auto *res2 = M.createPlaceholder(ElemKind::FloatTy, {2, 3}, "res2", false);
+  auto IH = ctx.allocate(input)->getHandle();
+  IH = {-1.5, -1, -0.5, 0, 0.5, 1};
+  ctx.allocate(res1);
+  ctx.allocate(res2);
+
+  auto *F1 = M.createFunction("model1");
+  F1->createSave("save",
+                 F1->createTanh("tanh", F1->createAdd("pre", input, input)),
+                 res1);
+  auto *F2 = M.createFunction("model2");
+  F2->createSave(
+      "save", F2->createSigmoid("sigmoid", F2->createAdd("pre", input, input)),
+      res2);
+
+  auto *ensemble = M.createEnsemble("ensemble", {F1, F2});
+  ensemble->verify();
+  EXPECT_EQ(ensemble->getNodes().size(),
+            F1->getNodes().size() + F2->getNodes().size());
+
+  EE.compile(CompilationMode::Infer, ensemble, ctx);
+  unsigned numAdds = 0;
+  for (auto &N : ensemble->getNodes()) {
+    numAdds += N.getKind() == Kinded::Kind::AddNodeKind;
+  }
+  EXPECT_EQ(numAdds, 1);
+
+  EE.run(ctx);
+  auto R1 = ctx.get(res1)->getHandle();
+  auto R2 = ctx.get(res2)->getHandle();
+  for (size_t i = 0; i < IH.size(); i++) {
+    EXPECT_NEAR(R1.raw(i), std::tanh(2 * IH.raw(i)), 1e-5);
+    EXPECT_NEAR(R2.raw(i), 1 / (1 + std::exp(-2 * IH.raw(i))), 1e-5);
+  }
+}
+
 TEST(Graph, NodeValue) {
   ExecutionEngine EE;
   auto &mod = EE.getModule();
@@ -912,3 +1011,317 @@ TEST(Graph, placeholder) {
   K = F->createSoftMax("SoftMax", K, S);
   F->createSave("Save", K);
 }
+
+/// \returns the placeholder of \p M named \p name, or nullptr.
+static Placeholder *findPlaceholder(Module &M, llvm::StringRef name) {
+  for (auto *P : M.getPlaceholders()) {
+    if (P->getName() == name) {
+      return P;
+    }
+  }
+  return nullptr;
+}
+
+/// Check that a serialized module is restored with the same nodes, storage
+/// and payloads.
+TEST(Graph, serializeModule) {
+  Module MD;
+  Function *F = MD.createFunction("F");
+  auto *input =
+      MD.createPlaceholder(ElemKind::FloatTy, {4, 8}, "input", false);
+  auto *output =
+      MD.createPlaceholder(ElemKind::FloatTy, {4, 3}, "output", false);
+  auto *FC = F->createFullyConnected("FC", input, 3);
+  auto *T = F->createTranspose("Transpose", FC, {1, 0});
+  auto *R = F->createReshape("Reshape", T, {4, 3});
+  auto *Q = F->createQuantize(
+      "Quantize", R, MD.uniqueType(ElemKind::Int8QTy, {4, 3}, 0.5, 3));
+  auto *D = F->createDequantize("Dequantize", Q);
+  F->createSave("Save", D, output);
+
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("glowModule", "bin", path);
+  ASSERT_TRUE(saveModule(MD, path));
+
+  Module loaded;
+  ASSERT_TRUE(loadModule(path, loaded));
+  llvm::sys::fs::remove(path);
+  loaded.verify();
+
+  ASSERT_EQ(loaded.getVars().size(), MD.getVars().size());
+  for (auto *V : MD.getVars()) {
+    auto *LV = loaded.getVariableByName(V->getName());
+    ASSERT_TRUE(LV);
+    EXPECT_TRUE(LV->getType()->isEqual(V->getType()));
+    EXPECT_EQ(LV->getVisibilityKind(), V->getVisibilityKind());
+    EXPECT_EQ(LV->isTraining(), V->isTraining());
+    EXPECT_TRUE(LV->getPayload().isEqual(V->getPayload()));
+    EXPECT_EQ(size_t(LV->getPayload().getUnsafePtr()) % TensorAlignment, 0);
+  }
+  ASSERT_EQ(loaded.getPlaceholders().size(), 2);
+  EXPECT_TRUE(findPlaceholder(loaded, "input"));
+  EXPECT_TRUE(findPlaceholder(loaded, "output"));
+
+  Function *LF = loaded.getFunction("F");
+  ASSERT_TRUE(LF);
+  ASSERT_EQ(LF->getNodes().size(), F->getNodes().size());
+  for (auto &N : F->getNodes()) {
+    auto *LN = LF->getNodeByName(N.getName());
+    ASSERT_TRUE(LN);
+    EXPECT_EQ(LN->getKind(), N.getKind());
+    EXPECT_EQ(LN->getDebugDesc(), N.getDebugDesc());
+  }
+}
+
+/// Check that a function that was optimized and serialized by one engine
+/// computes the same results when another engine restores and compiles it.
+TEST(Graph, serializeAndCompileOptimized) {
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("glowModule", "bin", path);
+
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {2, 16}, "input", false);
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {2, 4}, "output", false);
+  auto *FC = F->createFullyConnected("FC", input, 4);
+  auto *RL = F->createRELU("Relu", FC);
+  F->createSave("Save", RL, output);
+  ASSERT_TRUE(EE.serialize(CompilationMode::Infer, F, path));
+
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(output);
+  EE.compileOptimized(F, ctx);
+  EE.run(ctx);
+
+  ExecutionEngine loadedEE;
+  auto &loaded = loadedEE.getModule();
+  ASSERT_TRUE(loadModule(path, loaded));
+  llvm::sys::fs::remove(path);
+  Function *LF = loaded.getFunction("main");
+  ASSERT_TRUE(LF);
+  Context loadedCtx;
+  loadedCtx.allocate(findPlaceholder(loaded, "input"))
+      ->assign(ctx.get(input));
+  auto *loadedOutput = loadedCtx.allocate(findPlaceholder(loaded, "output"));
+  loadedEE.compileOptimized(LF, loadedCtx);
+  loadedEE.run(loadedCtx);
+
+  EXPECT_TRUE(loadedOutput->isEqual(*ctx.get(output)));
+}
+
+/// Check that a module mapped read-only shares the payloads of its private
+/// variables with the file, copies the public ones, computes the same results
+/// and refuses to update its weights.
+TEST(Graph, loadModuleSharedReadOnly) {
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("glowModule", "bin", path);
+
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+  auto *input =
+      mod.createPlaceholder(ElemKind::FloatTy, {2, 16}, "input", false);
+  auto *output =
+      mod.createPlaceholder(ElemKind::FloatTy, {2, 4}, "output", false);
+  auto *state = mod.createVariable(ElemKind::FloatTy, {2, 4}, "state",
+                                   VisibilityKind::Public, false);
+  auto *FC = F->createFullyConnected("FC", input, 4);
+  auto *add = F->createAdd("add", FC, state);
+  F->createSave("Save", add, output);
+  state->getHandle().randomize(-1, 1, mod.getPRNG());
+  ASSERT_TRUE(EE.serialize(CompilationMode::Infer, F, path));
+
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod.getPRNG());
+  ctx.allocate(output);
+  EE.compileOptimized(F, ctx);
+  EE.run(ctx);
+
+  ExecutionEngine loadedEE;
+  auto &loaded = loadedEE.getModule();
+  ASSERT_TRUE(loadModule(path, loaded, ModuleMapping::SharedReadOnly));
+  llvm::sys::fs::remove(path);
+  std::vector<llvm::StringRef> privateNames;
+  for (auto *V : loaded.getVars()) {
+    EXPECT_EQ(loaded.isPayloadReadOnly(V), V->isPrivate());
+    if (V->isPrivate()) {
+      privateNames.push_back(V->getName());
+    }
+  }
+  ASSERT_FALSE(privateNames.empty());
+
+  Function *LF = loaded.getFunction("main");
+  ASSERT_TRUE(LF);
+  Context loadedCtx;
+  loadedCtx.allocate(findPlaceholder(loaded, "input"))
+      ->assign(ctx.get(input));
+  auto *loadedOutput = loadedCtx.allocate(findPlaceholder(loaded, "output"));
+  loadedEE.compileOptimized(LF, loadedCtx);
+  loadedEE.run(loadedCtx);
+  EXPECT_TRUE(loadedOutput->isEqual(*ctx.get(output)));
+
+  auto *loadedVar = loaded.getVariableByName(privateNames[0]);
+  Tensor newPayload(loadedVar->getType());
+  EXPECT_FALSE(loaded.updateWeights({privateNames[0]}, {&newPayload}));
+}
+
+/// Check that files that are not serialized modules are rejected.
+TEST(Graph, loadModuleRejectsOtherFiles) {
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("glowModule", "bin", path);
+  {
+    std::error_code EC;
+    llvm::raw_fd_ostream os(path, EC, llvm::sys::fs::F_None);
+    os << "this is not a serialized module, but it is long enough";
+  }
+
+  Module M;
+  EXPECT_FALSE(loadModule(path, M));
+  llvm::sys::fs::remove(path);
+  EXPECT_FALSE(loadModule(path, M));
+  EXPECT_TRUE(M.getVars().empty());
+}
+
+/// Check that the nodes and the small payloads that are created in a scope of
+/// the arena of the module come from it, and that erased nodes are recycled.
+TEST(Graph, arenaAllocation) {
+  Module M;
+  Function *F = M.createFunction("main");
+  Arena &arena = M.getArena();
+
+  Variable *small;
+  Variable *large;
+  {
+    ArenaScope scope(&arena);
+    small = M.createVariable(ElemKind::FloatTy, {4, 4}, "small");
+    large = M.createVariable(ElemKind::FloatTy, {256, 256}, "large");
+    NodeValue add = small;
+    for (unsigned i = 0; i < 1000; i++) {
+      add = F->createAdd("add", add, small);
+    }
+    F->createSave("save", add);
+  }
+  EXPECT_TRUE(small->getHandle().isZero());
+  EXPECT_TRUE(large->getHandle().isZero());
+  small->getHandle().clear(1);
+  EXPECT_EQ(small->getHandle().at({3, 3}), 1);
+  size_t used = arena.getBytesAllocated();
+  EXPECT_GT(used, 0);
+
+  // Cloning allocates the new nodes from the same arena. Once erased, their
+  // memory is reused by the next clone.
+  Function *G = F->clone("clone");
+  size_t usedWithClone = arena.getBytesAllocated();
+  EXPECT_GT(usedWithClone, used);
+  M.eraseFunction(G);
+  G = F->clone("clone2");
+  EXPECT_EQ(arena.getBytesAllocated(), usedWithClone);
+  EXPECT_EQ(G->getNodes().size(), F->getNodes().size());
+  G->verify();
+
+  // Outside of a scope, the nodes come from the heap.
+  F->createTanh("tanh", small);
+  EXPECT_EQ(arena.getBytesAllocated(), usedWithClone);
+}
+
+/// Check that types are uniqued on their contents.
+TEST(Graph, uniqueTypes) {
+  Module M;
+  // Many distinct shapes, each asked for twice.
+  std::vector<TypeRef> types;
+  for (size_t i = 1; i <= 1000; i++) {
+    types.push_back(M.uniqueType(ElemKind::FloatTy, {i, 3}));
+  }
+  for (size_t i = 1; i <= 1000; i++) {
+    EXPECT_EQ(M.uniqueType(ElemKind::FloatTy, {i, 3}), types[i - 1]);
+  }
+
+  EXPECT_NE(M.uniqueType(ElemKind::FloatTy, {3, 1}),
+            M.uniqueType(ElemKind::FloatTy, {3}));
+  EXPECT_NE(M.uniqueType(ElemKind::FloatTy, {4}),
+            M.uniqueType(ElemKind::Int64ITy, {4}));
+
+  // The scale and offset of quantized types are part of the type.
+  auto *Q = M.uniqueType(ElemKind::Int8QTy, {2, 2}, 0.5, 3);
+  EXPECT_EQ(Q, M.uniqueType(ElemKind::Int8QTy, {2, 2}, 0.5, 3));
+  EXPECT_NE(Q, M.uniqueType(ElemKind::Int8QTy, {2, 2}, 0.25, 3));
+  EXPECT_NE(Q, M.uniqueType(ElemKind::Int8QTy, {2, 2}, 0.5, 4));
+  EXPECT_EQ(M.uniqueType(ElemKind::Int8QTy, {2}, 0.0, 0),
+            M.uniqueType(ElemKind::Int8QTy, {2}, -0.0, 0));
+  EXPECT_EQ(M.uniqueTypeWithNewShape(Q, {4}),
+            M.uniqueType(ElemKind::Int8QTy, {4}, 0.5, 3));
+}
+
+/// Check the static cost of the nodes and of the function.
+TEST(Graph, nodeCost) {
+  Module M;
+  Function *F = M.createFunction("F");
+  auto *A = M.createVariable(ElemKind::FloatTy, {4, 8}, "A");
+  // A multiply-add for every input of every output.
+  auto *FC = F->createFullyConnected("FC", A, 16);
+  Cost cost = FC->getCost();
+  EXPECT_EQ(cost.flops, 2u * 4 * 16 * 8);
+  EXPECT_EQ(cost.bytesRead, (4 * 8 + 8 * 16 + 16) * sizeof(float));
+  EXPECT_EQ(cost.bytesWritten, 4 * 16 * sizeof(float));
+
+  // An operation per element of the result.
+  auto *R = F->createRELU("Relu", FC);
+  EXPECT_EQ(R->getCost().flops, 4u * 16);
+  F->createSave("Save", R);
+
+  EXPECT_EQ(F->getCost().flops, 2u * 4 * 16 * 8 + 4 * 16);
+}
+
+/// Check that a graph whose nodes have many users verifies, which used to
+/// scan the whole use-list of a node for each of its users.
+TEST(Graph, verifyManyUsers) {
+  Module M;
+  Function *F = M.createFunction("F");
+  auto *A = M.createPlaceholder(ElemKind::FloatTy, {2}, "A", false);
+  NodeValue sum = A;
+  for (unsigned i = 0; i < 10000; i++) {
+    sum = F->createAdd("add", sum, A);
+  }
+  F->createSave("save", sum);
+  F->verify();
+  EXPECT_EQ(A->getNumUsers(), 10000u);
+}
+
+/// Check the estimate of the memory of a function whose activations are all
+/// alive at the same time.
+TEST(Graph, estimateMemoryUsage) {
+  Module M;
+  Function *F = M.createFunction("F");
+  auto *in = M.createVariable(ElemKind::FloatTy, {2, 4}, "in");
+  auto *W = M.createVariable(ElemKind::FloatTy, {4, 4}, "W");
+  auto *out = M.createVariable(ElemKind::FloatTy, {2, 4}, "out");
+  // The result of the matrix multiplication is alive until the addition,
+  // which reads it with the result of the tanh.
+  auto *MM = F->createMatMul("mm", in, W);
+  auto *TH = F->createTanh("tanh", MM);
+  auto *add = F->createAdd("add", MM, TH);
+  F->createSave("save", add, out);
+
+  auto usage = F->estimateMemoryUsage();
+  EXPECT_EQ(usage.constantWeights, (2 * 4 + 4 * 4) * sizeof(float));
+  EXPECT_EQ(usage.mutableWeights, 2 * 4 * sizeof(float));
+  EXPECT_EQ(usage.activations, 3 * 2 * 4 * sizeof(float));
+  EXPECT_EQ(usage.code, 0);
+  EXPECT_EQ(usage.scratch, 0);
+
+  // A variable that is read and written is mutable, and the results of a
+  // chain of nodes are freed as soon as the next node is computed.
+  Function *G = M.createFunction("G");
+  auto *R1 = G->createTanh("tanh1", out);
+  auto *R2 = G->createTanh("tanh2", R1);
+  auto *R3 = G->createTanh("tanh3", R2);
+  G->createSave("save", R3, out);
+  usage = G->estimateMemoryUsage();
+  EXPECT_EQ(usage.constantWeights, 0);
+  EXPECT_EQ(usage.mutableWeights, 2 * 4 * sizeof(float));
+  EXPECT_EQ(usage.activations, 2 * 2 * 4 * sizeof(float));
+}
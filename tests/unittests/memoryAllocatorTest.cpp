@@ -320,3 +320,150 @@ TEST(MemAlloc, testGetMemorySize) {
   MemoryAllocator MA2("test1", 102);
   EXPECT_EQ(MA2.getMemorySize(), 102);
 }
+
+/// Check that the allocator makes the same choices as a linear first-fit scan
+/// of the live buffers, for a long random sequence of allocations.
+TEST(MemAlloc, firstFitMatchesLinearScan) {
+  MemoryAllocator MA("test", 0);
+  // The live buffers of the reference, sorted by address.
+  std::vector<std::pair<uint64_t, uint64_t>> live;
+  std::vector<uint64_t> handles;
+  uint64_t maxUsage = 0;
+  uint32_t seed = 1;
+  auto next = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+  };
+
+  for (uintptr_t i = 1; i < 3000; i++) {
+    if (!handles.empty() && next() % 3 == 0) {
+      size_t victim = next() % handles.size();
+      const void *handle = reinterpret_cast<void *>(handles[victim]);
+      uint64_t address = MA.getAddress(handle);
+      MA.deallocate(handle);
+      handles.erase(handles.begin() + victim);
+      for (auto it = live.begin(); it != live.end(); ++it) {
+        if (it->first == address) {
+          live.erase(it);
+          break;
+        }
+      }
+      continue;
+    }
+
+    uint64_t size = 1 + next() % 1000;
+    uint64_t segmentSize = (size + 63) / 64 * 64;
+    // The reference first-fit scan.
+    uint64_t expected = 0;
+    auto it = live.begin();
+    for (; it != live.end(); ++it) {
+      if (it->first - expected >= segmentSize) {
+        break;
+      }
+      expected = it->second;
+    }
+    live.insert(it, std::make_pair(expected, expected + segmentSize));
+    maxUsage = std::max(maxUsage, expected + segmentSize);
+
+    const void *handle = reinterpret_cast<void *>(i);
+    EXPECT_EQ(MA.allocate(size, handle), expected);
+    handles.push_back(i);
+    EXPECT_TRUE(MA.contains(expected));
+    EXPECT_TRUE(MA.contains(expected + size - 1));
+  }
+  EXPECT_EQ(MA.getMaxMemoryUsage(), maxUsage);
+}
+
+/// Check that allocating a whole sequence at once packs the buffers more
+/// tightly than allocating them one by one.
+TEST(MemAlloc, allocateAllPacksBuffers) {
+  const void *handle0 = reinterpret_cast<void *>(0);
+  const void *handle1 = reinterpret_cast<void *>(1);
+  const void *handle2 = reinterpret_cast<void *>(2);
+  using Allocation = MemoryAllocator::Allocation;
+  std::vector<Allocation> allocList = {
+      Allocation(handle0, true, 64),  Allocation(handle1, true, 64),
+      Allocation(handle0, false, 0),  Allocation(handle2, true, 128),
+      Allocation(handle1, false, 0),  Allocation(handle2, false, 0),
+  };
+
+  // First-fit cannot put the buffer of handle2 into the hole of handle0.
+  MemoryAllocator online("online", 0);
+  online.allocate(64, handle0);
+  online.allocate(64, handle1);
+  online.deallocate(handle0);
+  online.allocate(128, handle2);
+  EXPECT_EQ(online.getMaxMemoryUsage(), 256);
+
+  MemoryAllocator MA("test", 0);
+  EXPECT_EQ(MA.allocateAll(allocList), 192);
+  EXPECT_EQ(MA.getMaxMemoryUsage(), 192);
+  // The buffers of handle1 and handle2 are live at the same time, so this is
+  // optimal.
+  EXPECT_EQ(MA.getMemoryUsageLowerBound(), 192);
+  EXPECT_EQ(MA.getSize(handle2), 128);
+  // The buffers of handle1 and handle2 are live at the same time.
+  uint64_t p1 = MA.getAddress(handle1);
+  uint64_t p2 = MA.getAddress(handle2);
+  EXPECT_TRUE(p1 + 64 <= p2 || p2 + 128 <= p1);
+
+  // The pool is too small for the sequence.
+  MemoryAllocator small("small", 128);
+  EXPECT_EQ(small.allocateAll(allocList), MemoryAllocator::npos);
+}
+
+/// Check that the buffers that allocateAll assigns never overlap while they
+/// are live, and that they need no more memory than first-fit and no less than
+/// the lower bound.
+TEST(MemAlloc, allocateAllRandomSequence) {
+  using Allocation = MemoryAllocator::Allocation;
+  std::vector<Allocation> allocList;
+  std::vector<uintptr_t> live;
+  uint32_t seed = 7;
+  auto next = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+  };
+  for (uintptr_t i = 1; i < 500; i++) {
+    if (!live.empty() && next() % 2 == 0) {
+      size_t victim = next() % live.size();
+      allocList.emplace_back(reinterpret_cast<void *>(live[victim]), false, 0);
+      live.erase(live.begin() + victim);
+    }
+    allocList.emplace_back(reinterpret_cast<void *>(i), true,
+                           1 + next() % 5000);
+    live.push_back(i);
+  }
+
+  MemoryAllocator online("online", 0);
+  for (auto &A : allocList) {
+    if (A.alloc) {
+      online.allocate(A.size, A.handle);
+    } else {
+      online.deallocate(A.handle);
+    }
+  }
+
+  MemoryAllocator MA("test", 0);
+  uint64_t required = MA.allocateAll(allocList);
+  EXPECT_LE(required, online.getMaxMemoryUsage());
+  EXPECT_GE(required, MA.getMemoryUsageLowerBound());
+
+  // Replay the sequence and check the live buffers.
+  std::set<const void *> liveHandles;
+  for (auto &A : allocList) {
+    if (!A.alloc) {
+      liveHandles.erase(A.handle);
+      continue;
+    }
+    uint64_t begin = MA.getAddress(A.handle);
+    uint64_t end = begin + MA.getSize(A.handle);
+    EXPECT_LE(end, required);
+    for (auto *other : liveHandles) {
+      uint64_t otherBegin = MA.getAddress(other);
+      uint64_t otherEnd = otherBegin + MA.getSize(other);
+      EXPECT_TRUE(end <= otherBegin || otherEnd <= begin);
+    }
+    liveHandles.insert(A.handle);
+  }
+}
@@ -78,3 +78,71 @@ TEST(onnx, importConv) {
   for (size_t i = 0; i < 4 * 4; i++)
     EXPECT_FLOAT_EQ(result.raw(i), expectedValues[i]);
 }
+
+/// Test loading a model whose weights are stored in an external data file
+/// and in raw data. The model computes the same convolution as importConv.
+TEST(onnx, importExternalData) {
+  ExecutionEngine EE{BackendKind::Interpreter};
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  std::string NetFilename(
+      "tests/models/onnxModels/simpleConvExternalData.onnxtxt");
+
+  Variable *graphOutputVar;
+  {
+    Tensor data;
+    getNCHWData(&data, 1, 1, 3, 3);
+    ONNXModelLoader onnxLD(NetFilename, {"data"}, {&data}, *F);
+    graphOutputVar = onnxLD.getSingleOutput();
+  }
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+  auto result = graphOutputVar->getHandle();
+  std::vector<size_t> expectedDims = {1, 1, 4, 4};
+  std::vector<float> expectedValues = {2,  3,  5,  4,  5, 10, 14, 9,
+                                       11, 22, 26, 15, 8, 15, 17, 10};
+  EXPECT_TRUE(result.dims().vec() == expectedDims);
+  for (size_t i = 0; i < 4 * 4; i++)
+    EXPECT_FLOAT_EQ(result.raw(i), expectedValues[i]);
+}
+
+/// Test that the Shape->Gather->Concat chain that computes the shape of a
+/// Reshape is folded while loading, so that only the Reshape is left.
+TEST(onnx, foldShapeComputation) {
+  ExecutionEngine EE{BackendKind::Interpreter};
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  std::string NetFilename("tests/models/onnxModels/shapeFolding.onnxtxt");
+
+  Variable *graphOutputVar;
+  Tensor data(ElemKind::FloatTy, {2, 3, 4});
+  for (size_t i = 0; i < data.size(); i++) {
+    data.getHandle().raw(i) = i;
+  }
+  {
+    ONNXModelLoader onnxLD(NetFilename, {"data"}, {&data}, *F);
+    graphOutputVar = onnxLD.getSingleOutput();
+  }
+
+  // The input and the output are the only Variables, and the Reshape and the
+  // Save are the only nodes.
+  EXPECT_EQ(F->getNodes().size(), 2);
+  EXPECT_EQ(mod.getVars().size(), 2);
+  auto *saveNode = getSaveNodeFromVariable(graphOutputVar);
+  EXPECT_TRUE(saveNode->getInput().getNode()->getKind() ==
+              Kinded::Kind::ReshapeNodeKind);
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+  auto result = graphOutputVar->getHandle();
+  std::vector<size_t> expectedDims = {2, 12};
+  EXPECT_TRUE(result.dims().vec() == expectedDims);
+  for (size_t i = 0; i < data.size(); i++) {
+    EXPECT_FLOAT_EQ(result.raw(i), i);
+  }
+}
@@ -16,6 +16,7 @@
 
 #include "BackendTestUtils.h"
 
+#include "glow/ExecutionEngine/FunctionDAGExecutor.h"
 #include "glow/Graph/Graph.h"
 #include "glow/Optimizer/Partition.h"
 
@@ -34,16 +35,21 @@ protected:
   Function *F_;
 };
 
-/// Execute a graph of functions serially, which is the simplest approach.
+/// Execute a graph of functions serially, which is the simplest approach. The
+/// functions pass their results to each other through the placeholders.
 static void executeSerial(const FunctionDAG &G, llvm::ArrayRef<Variable *> vars,
                           llvm::ArrayRef<Tensor *> inputs) {
+  Context ctx;
+  for (auto *P : G.getFunctions().front()->getParent()->getPlaceholders()) {
+    ctx.allocate(P);
+  }
   for (auto *F : G.getFunctions()) {
     ExecutionEngine EE;
-    Context ctx;
-    EE.compile(CompilationMode::Infer, F, ctx);
+    Context compileCtx;
+    EE.compile(CompilationMode::Infer, F, compileCtx);
 
     updateVariables(vars, inputs);
-    EE.run();
+    EE.run(ctx);
   }
 }
 
@@ -158,6 +164,212 @@ TEST_F(PartitionTest, Branchover) {
   EXPECT_TRUE(ref.isEqual(test));
 }
 
+/// Check that the executor runs the independent branches of a DAG and
+/// passes the tensors between the functions through the context.
+TEST_F(PartitionTest, ConcurrentExecution) {
+  auto *input = mod_.createPlaceholder(ElemKind::FloatTy, {1, 32}, "input",
+                                       false);
+  Node *I = F_->createFullyConnected("initial_fc", input, 16);
+  I = F_->createSigmoid("initial_sigmoid", I);
+  Node *L = F_->createFullyConnected("left_fc", I, 16);
+  L = F_->createSigmoid("left_sigmoid", L);
+  Node *R = F_->createFullyConnected("right_fc", I, 16);
+  R = F_->createSigmoid("right_sigmoid", R);
+  auto *mul = F_->createMul("mul", L, R);
+  auto *output = mod_.createPlaceholder(ElemKind::FloatTy, {1, 16}, "output",
+                                        false);
+  F_->createSave("ret", mul, output);
+
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod_.getPRNG());
+  ctx.allocate(output);
+
+  // Infer using the un-partitioned graph.
+  Tensor ref;
+  {
+    ExecutionEngine EE;
+    EE.compile(CompilationMode::Infer, F_->clone("ref"), ctx);
+    EE.run(ctx);
+    ref = ctx.get(output)->clone();
+    ctx.get(output)->zero();
+  }
+
+  // The two branches do not depend on each other.
+  auto G = glow::partition(F_);
+  ASSERT_EQ(G.getFunctions().size(), 4);
+  FunctionDAGExecutor executor(2);
+  executor.compile(CompilationMode::Infer, G);
+  for (unsigned i = 0; i < 3; i++) {
+    executor.run(ctx);
+    EXPECT_TRUE(ref.isEqual(*ctx.get(output)));
+    ctx.get(output)->zero();
+  }
+}
+
+/// Check that a node that goes to another device splits its users off into a
+/// later island, while the independent nodes stay in the first one.
+TEST_F(PartitionTest, DeviceIslands) {
+  auto *input = mod_.createPlaceholder(ElemKind::FloatTy, {2, 16}, "input",
+                                       false);
+  Node *A = F_->createFullyConnected("fc1", input, 16);
+  auto *S = F_->createSigmoid("sigmoid", A);
+  auto *TK = F_->createTopK("topk", F_->createTanh("tanh", A), 4);
+  auto *C = F_->createFullyConnected("fc2", TK->getValues(), 8);
+  auto *side =
+      mod_.createPlaceholder(ElemKind::FloatTy, {2, 16}, "side", false);
+  auto *output =
+      mod_.createPlaceholder(ElemKind::FloatTy, {2, 8}, "output", false);
+  F_->createSave("saveSide", S, side);
+  F_->createSave("saveOutput", C, output);
+
+  Context ctx;
+  ctx.allocate(input)->getHandle().randomize(-1, 1, mod_.getPRNG());
+  ctx.allocate(side);
+  ctx.allocate(output);
+
+  // Infer using the un-partitioned graph.
+  Tensor refSide, refOutput;
+  {
+    ExecutionEngine EE;
+    EE.compile(CompilationMode::Infer, F_->clone("ref"), ctx);
+    EE.run(ctx);
+    refSide = ctx.get(side)->clone();
+    refOutput = ctx.get(output)->clone();
+    ctx.get(side)->zero();
+    ctx.get(output)->zero();
+  }
+
+  // Run the TopK on a device of its own.
+  std::vector<unsigned> devices;
+  auto G = glow::partitionByDevice(
+      F_, [](const Node *N) { return llvm::isa<TopKNode>(N) ? 1 : 0; },
+      devices);
+  ASSERT_EQ(G.getFunctions().size(), 3);
+  EXPECT_EQ(devices, std::vector<unsigned>({0, 1, 0}));
+
+  auto it = G.getFunctions().begin();
+  {
+    // fc1, sigmoid, tanh, saveSide and the save of the tanh.
+    auto *F = *it++;
+    EXPECT_EQ(F->getNodes().size(), 5);
+    EXPECT_EQ(G.getDependencies(F).size(), 0);
+  }
+  {
+    // The TopK and the save of its values.
+    auto *F = *it++;
+    EXPECT_EQ(F->getNodes().size(), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 1);
+  }
+  {
+    // fc2 and saveOutput.
+    auto *F = *it++;
+    EXPECT_EQ(F->getNodes().size(), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 1);
+  }
+
+  FunctionDAGExecutor executor(2);
+  executor.compile(CompilationMode::Infer, G);
+  executor.run(ctx);
+  EXPECT_TRUE(refSide.isEqual(*ctx.get(side)));
+  EXPECT_TRUE(refOutput.isEqual(*ctx.get(output)));
+}
+
+/// Check that a function whose nodes are all supported by the preferred
+/// backend is not split.
+TEST_F(PartitionTest, PartitionForBackends) {
+  auto *input = mod_.createPlaceholder(ElemKind::FloatTy, {2, 16}, "input",
+                                       false);
+  auto *TK = F_->createTopK("topk", F_->createTanh("tanh", input), 4);
+  F_->createSave("save", TK->getValues());
+
+  FunctionDAGExecutor::BackendAssignment assignment;
+  auto G = glow::partitionForBackends(F_, {BackendKind::Interpreter},
+                                      assignment);
+  ASSERT_EQ(G.getFunctions().size(), 1);
+  EXPECT_EQ(assignment.size(), 1);
+  EXPECT_EQ(assignment[G.getFunctions().front()], BackendKind::Interpreter);
+}
+
+#ifdef GLOW_WITH_CPU
+/// \returns true if \p F has a node of the kind \p kind.
+static bool hasNodeKind(const Function *F, Kinded::Kind kind) {
+  for (const auto &N : F->getNodes()) {
+    if (N.getKind() == kind) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Check that a node that the preferred backend rejects goes to the next one:
+/// the CPU backend has no quantized Gather, which runs on the Interpreter
+/// between the quantization and the dequantization on the CPU.
+TEST_F(PartitionTest, PartitionForBackendsRejectedOp) {
+  auto *data =
+      mod_.createPlaceholder(ElemKind::FloatTy, {8, 4}, "data", false);
+  auto *indices =
+      mod_.createPlaceholder(ElemKind::Int64ITy, {3}, "indices", false);
+  auto *output =
+      mod_.createPlaceholder(ElemKind::FloatTy, {3, 4}, "output", false);
+  auto *Q = F_->createQuantize(
+      "quantize", data, mod_.uniqueType(ElemKind::Int8QTy, {8, 4}, 0.05, 0));
+  auto *gather = F_->createGather("gather", Q, indices);
+  F_->createSave("save", F_->createDequantize("dequantize", gather), output);
+
+  Context ctx;
+  ctx.allocate(data)->getHandle().randomize(-2, 2, mod_.getPRNG());
+  auto indicesH = ctx.allocate(indices)->getHandle<int64_t>();
+  indicesH = {7, 0, 3};
+  ctx.allocate(output);
+
+  // Infer using the un-partitioned graph.
+  Tensor ref;
+  {
+    ExecutionEngine EE;
+    EE.compile(CompilationMode::Infer, F_->clone("ref"), ctx);
+    EE.run(ctx);
+    ref = ctx.get(output)->clone();
+    ctx.get(output)->zero();
+  }
+
+  FunctionDAGExecutor::BackendAssignment assignment;
+  auto G = glow::partitionForBackends(
+      F_, {BackendKind::CPU, BackendKind::Interpreter}, assignment);
+  ASSERT_EQ(G.getFunctions().size(), 3);
+  EXPECT_EQ(assignment.size(), 3);
+  auto it = G.getFunctions().begin();
+  {
+    // The quantization and its save.
+    auto *F = *it++;
+    EXPECT_EQ(assignment[F], BackendKind::CPU);
+    EXPECT_TRUE(hasNodeKind(F, Kinded::Kind::QuantizeNodeKind));
+    EXPECT_EQ(F->getNodes().size(), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 0);
+  }
+  {
+    // The Gather and its save.
+    auto *F = *it++;
+    EXPECT_EQ(assignment[F], BackendKind::Interpreter);
+    EXPECT_TRUE(hasNodeKind(F, Kinded::Kind::GatherNodeKind));
+    EXPECT_EQ(F->getNodes().size(), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 1);
+  }
+  {
+    // The dequantization and the save of the output.
+    auto *F = *it++;
+    EXPECT_EQ(assignment[F], BackendKind::CPU);
+    EXPECT_TRUE(hasNodeKind(F, Kinded::Kind::DequantizeNodeKind));
+    EXPECT_EQ(F->getNodes().size(), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 1);
+  }
+
+  FunctionDAGExecutor executor(2);
+  executor.compile(CompilationMode::Infer, G, assignment);
+  executor.run(ctx);
+  EXPECT_TRUE(ref.isEqual(*ctx.get(output)));
+}
+#endif
+
 TEST_F(PartitionTest, Train) {
   auto *input = mod_.createVariable(ElemKind::FloatTy, {1, 8}, "input",
                                     VisibilityKind::Public, false);
@@ -193,3 +405,197 @@ TEST_F(PartitionTest, VerifyCyclicFails) {
   G.add(F1, F1);
   EXPECT_FALSE(G.verify());
 }
+
+/// \returns the number of FullyConnected nodes in \p F.
+static unsigned countFullyConnected(const Function *F) {
+  unsigned count = 0;
+  for (auto &N : F->getNodes()) {
+    count += llvm::isa<FullyConnectedNode>(&N);
+  }
+  return count;
+}
+
+TEST_F(PartitionTest, PipelineBalanced) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {1, 32}, "input",
+                                    VisibilityKind::Public, false);
+  Node *N = input;
+  for (unsigned i = 0; i < 4; i++) {
+    N = F_->createFullyConnected("fc", N, 32);
+    N = F_->createSigmoid("sigmoid", N);
+  }
+  auto *save = F_->createSave("ret", N);
+  auto &res = save->getVariable()->getPayload();
+
+  PipelineConfig config;
+  config.numStages = 2;
+  auto G = glow::partitionPipeline(F_, config);
+  ASSERT_EQ(G.getFunctions().size(), 2);
+
+  // Each stage runs two of the identical layers.
+  auto it = G.getFunctions().begin();
+  {
+    auto *F = *it++;
+    EXPECT_EQ(countFullyConnected(F), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 0);
+  }
+  {
+    auto *F = *it++;
+    EXPECT_EQ(countFullyConnected(F), 2);
+    EXPECT_EQ(G.getDependencies(F).size(), 1);
+  }
+
+  // Infer using the un-partitioned graph.
+  Tensor in(ElemKind::FloatTy, {1, 32});
+  in.getHandle().randomize(-1, 1, mod_.getPRNG());
+  ExecutionEngine EE;
+  Context ctx;
+
+  EE.compile(CompilationMode::Infer, F_, ctx);
+  updateVariables({input}, {&in});
+  EE.run();
+  Tensor ref = res.clone();
+
+  // Infer using the partitioned graph.
+  executeSerial(G, {input}, {&in});
+  Tensor test = res.clone();
+  EXPECT_TRUE(ref.isEqual(test));
+}
+
+/// Check that the stages are split where the smallest tensor flows when that
+/// keeps the stages almost balanced.
+TEST_F(PartitionTest, PipelineSmallestCut) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {1, 64}, "input",
+                                    VisibilityKind::Public, false);
+  Node *N = F_->createFullyConnected("fc1", input, 64);
+  N = F_->createSigmoid("sigmoid1", N);
+  N = F_->createFullyConnected("narrow", N, 4);
+  N = F_->createFullyConnected("fc2", N, 64);
+  N = F_->createSigmoid("sigmoid2", N);
+  N = F_->createFullyConnected("fc3", N, 64);
+  N = F_->createSigmoid("sigmoid3", N);
+  N = F_->createFullyConnected("fc4", N, 64);
+  F_->createSave("ret", N);
+
+  // The best balance splits after the second sigmoid.
+  PipelineConfig config;
+  config.numStages = 2;
+  config.balanceTolerance = 0;
+  auto balanced = glow::partitionPipeline(F_->clone("balanced"), config);
+  ASSERT_EQ(balanced.getFunctions().size(), 2);
+  EXPECT_EQ(countFullyConnected(balanced.getFunctions().front()), 3);
+
+  // Splitting after the narrow layer is slightly less balanced.
+  config.balanceTolerance = 0.1;
+  auto G = glow::partitionPipeline(F_, config);
+  ASSERT_EQ(G.getFunctions().size(), 2);
+  EXPECT_EQ(countFullyConnected(G.getFunctions().front()), 2);
+
+  // The second stage only receives the output of the narrow layer.
+  auto *second = G.getFunctions().back();
+  unsigned numCutInputs = 0;
+  for (auto &N : second->getNodes()) {
+    for (unsigned i = 0, e = N.getNumInputs(); i < e; i++) {
+      auto *P = llvm::dyn_cast<Placeholder>(N.getNthInput(i).getNode());
+      if (P) {
+        EXPECT_EQ(P->getType()->size(), 4);
+        numCutInputs++;
+      }
+    }
+  }
+  EXPECT_EQ(numCutInputs, 1);
+}
+
+TEST_F(PartitionTest, PipelineMemoryLimit) {
+  auto *input = mod_.createVariable(ElemKind::FloatTy, {64, 16}, "input",
+                                    VisibilityKind::Public, false);
+  Node *N = F_->createFullyConnected("fc1", input, 16);
+  N = F_->createFullyConnected("fc2", N, 16);
+  for (unsigned i = 0; i < 4; i++) {
+    N = F_->createTanh("tanh", N);
+  }
+  F_->createSave("ret", N);
+
+  // Balance the stages by their flops only. The second layer then goes with
+  // the cheap activations.
+  PipelineConfig config;
+  config.numStages = 2;
+  config.flopsPerByte = 0;
+  config.balanceTolerance = 0;
+  auto unlimited = glow::partitionPipeline(F_->clone("unlimited"), config);
+  ASSERT_EQ(unlimited.getFunctions().size(), 2);
+  EXPECT_EQ(countFullyConnected(unlimited.getFunctions().front()), 1);
+
+  // That second stage uses 29760 bytes, which exceeds the limit.
+  config.memoryLimit = 28000;
+  auto G = glow::partitionPipeline(F_->clone("limited"), config);
+  ASSERT_EQ(G.getFunctions().size(), 2);
+  EXPECT_EQ(countFullyConnected(G.getFunctions().front()), 2);
+
+  // Every node exceeds 100 bytes. With a stage per node, each holds one.
+  config.memoryLimit = 100;
+  config.numStages = 7;
+  auto perNode = glow::partitionPipeline(F_->clone("perNode"), config);
+  ASSERT_EQ(perNode.getFunctions().size(), 7);
+  unsigned stage = 0;
+  for (auto *stageF : perNode.getFunctions()) {
+    EXPECT_EQ(countFullyConnected(stageF), stage++ < 2 ? 1u : 0u);
+  }
+
+  // Two stages cannot stay within 100 bytes, so the limit is ignored.
+  config.numStages = 2;
+  auto ignored = glow::partitionPipeline(F_, config);
+  ASSERT_EQ(ignored.getFunctions().size(), 2);
+  EXPECT_EQ(countFullyConnected(ignored.getFunctions().front()), 1);
+}
+
+/// Check that a stream of requests flowing through the stages of a pipeline
+/// produces the results of the un-partitioned function.
+TEST_F(PartitionTest, PipelinedExecution) {
+  auto *input = mod_.createPlaceholder(ElemKind::FloatTy, {1, 32}, "input",
+                                       false);
+  Node *N = input;
+  for (unsigned i = 0; i < 4; i++) {
+    N = F_->createFullyConnected("fc", N, 32);
+    N = F_->createTanh("tanh", N);
+  }
+  auto *output =
+      mod_.createPlaceholder(ElemKind::FloatTy, {1, 32}, "output", false);
+  F_->createSave("ret", N, output);
+
+  constexpr unsigned numRequests = 8;
+  std::vector<std::unique_ptr<Context>> contexts;
+  for (unsigned i = 0; i < numRequests; i++) {
+    contexts.emplace_back(llvm::make_unique<Context>());
+    contexts.back()->allocate(input)->getHandle().randomize(-1, 1,
+                                                            mod_.getPRNG());
+    contexts.back()->allocate(output);
+  }
+
+  // Infer using the un-partitioned graph.
+  std::vector<Tensor> refs;
+  {
+    ExecutionEngine EE;
+    EE.compile(CompilationMode::Infer, F_->clone("ref"), *contexts.front());
+    for (auto &ctx : contexts) {
+      EE.run(*ctx);
+      refs.push_back(ctx->get(output)->clone());
+      ctx->get(output)->zero();
+    }
+  }
+
+  PipelineConfig config;
+  config.numStages = 3;
+  auto G = glow::partitionPipeline(F_, config);
+  ASSERT_EQ(G.getFunctions().size(), 3);
+
+  PipelineExecutor executor(/* queueCapacity */ 1);
+  executor.compile(CompilationMode::Infer, G);
+  std::vector<std::future<void>> futures;
+  for (auto &ctx : contexts) {
+    futures.push_back(executor.submit(*ctx));
+  }
+  for (unsigned i = 0; i < numRequests; i++) {
+    futures[i].wait();
+    EXPECT_TRUE(refs[i].isEqual(*contexts[i]->get(output)));
+  }
+}
@@ -18,6 +18,7 @@
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/Graph/Graph.h"
 #include "glow/IR/IR.h"
+#include "glow/Quantization/Base/Profile.h"
 #include "glow/Quantization/Serialization.h"
 
 #include "gtest/gtest.h"
@@ -26,6 +27,8 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
 
+#include <unordered_map>
+
 namespace glow {
 
 using llvm::cast;
@@ -73,6 +76,125 @@ TEST(Quantization, SerializeEmpty) {
   testSerialization(expected);
 }
 
+TEST(Quantization, SerializeProfilingInfos) {
+  std::vector<NodeProfilingInfo> expected{{"first", -1, 2, {0, 3, 1, 0}},
+                                          {"second", 0.5, 10, {7, 0, 0, 1}}};
+
+  llvm::SmallVector<char, 10> resultPath;
+  llvm::sys::fs::createTemporaryFile("prefix", "suffix", resultPath);
+  std::string filePath(resultPath.begin(), resultPath.end());
+
+  serializeProfilingInfosToYaml(filePath, expected);
+  std::vector<NodeProfilingInfo> deserialized =
+      deserializeProfilingInfosFromYaml(filePath);
+
+  ASSERT_EQ(expected.size(), deserialized.size());
+  for (size_t i = 0, e = expected.size(); i < e; i++) {
+    EXPECT_EQ(expected[i].nodeOutputName_, deserialized[i].nodeOutputName_);
+    EXPECT_EQ(expected[i].min_, deserialized[i].min_);
+    EXPECT_EQ(expected[i].max_, deserialized[i].max_);
+    EXPECT_EQ(expected[i].histogram_, deserialized[i].histogram_);
+  }
+}
+
+/// Check that profiles gathered on separate shards of the data merge into a
+/// profile that covers all of the data.
+TEST(Quantization, mergeProfilingInfos) {
+  Tensor first(ElemKind::FloatTy, {100});
+  Tensor second(ElemKind::FloatTy, {60});
+  auto firstH = first.getHandle();
+  auto secondH = second.getHandle();
+  for (size_t i = 0; i < 100; i++) {
+    firstH.raw(i) = float(i) / 10 - 2;
+  }
+  for (size_t i = 0; i < 60; i++) {
+    secondH.raw(i) = float(i) / 5 + 3;
+  }
+
+  // Profile a single tensor into a histogram of 50 bins.
+  auto profile = [](Tensor &T) {
+    Tensor hist(ElemKind::FloatTy, {50});
+    hist.zero();
+    float min = 0, max = 0;
+    quantization::generateTensorHistogram(T.getHandle(), hist.getHandle(), min,
+                                          max);
+    std::vector<float> bins(50);
+    for (size_t i = 0; i < 50; i++) {
+      bins[i] = hist.getHandle().raw(i);
+    }
+    return NodeProfilingInfo("node:0", min, max, bins);
+  };
+
+  std::vector<NodeProfilingInfo> merged{profile(first)};
+  NodeProfilingInfo other("other:0", 1, 2, std::vector<float>(50, 1));
+  quantization::mergeNodeProfilingInfos(merged, {profile(second), other});
+
+  ASSERT_EQ(merged.size(), 2);
+  EXPECT_EQ(merged[0].nodeOutputName_, "node:0");
+  EXPECT_FLOAT_EQ(merged[0].min_, -2);
+  EXPECT_FLOAT_EQ(merged[0].max_, 14.8);
+  float total = 0;
+  for (float bin : merged[0].histogram_) {
+    total += bin;
+  }
+  EXPECT_EQ(total, 160);
+  EXPECT_EQ(merged[1].nodeOutputName_, "other:0");
+
+  // The parameters are chosen from the merged range.
+  auto QI = quantization::generateNodeQuantizationInfos(merged);
+  auto expected = quantization::chooseQuantizationParams(-2, 14.8);
+  EXPECT_FLOAT_EQ(QI[0].Scale(), expected.scale);
+  EXPECT_EQ(QI[0].Offset(), expected.offset);
+}
+
+/// Check that the KL calibration clips rare outliers but keeps the range of
+/// distributions without outliers.
+TEST(Quantization, optimizeKLRange) {
+  PseudoRNG PRNG;
+  Tensor T(ElemKind::FloatTy, {20000});
+  auto TH = T.getHandle();
+  // The sum of two uniform variables is concentrated around zero.
+  TH.randomize(-1, 1, PRNG);
+  Tensor N(ElemKind::FloatTy, {20000});
+  N.getHandle().randomize(-1, 1, PRNG);
+  for (size_t i = 0, e = TH.size(); i < e; i++) {
+    TH.raw(i) += N.getHandle().raw(i);
+  }
+  TH.raw(0) = 40;
+
+  Tensor hist(ElemKind::FloatTy, {2000});
+  hist.zero();
+  float min = 0, max = 0;
+  quantization::generateTensorHistogram(TH, hist.getHandle(), min, max);
+  EXPECT_FLOAT_EQ(max, 40);
+  auto range = quantization::optimizeKLRange(hist.getHandle(), min, max);
+  EXPECT_LE(range.first, -1);
+  EXPECT_GE(range.second, 1);
+  EXPECT_LT(range.second, 10);
+
+  // The range of a uniform distribution is not clipped significantly.
+  TH.randomize(0, 10, PRNG);
+  hist.zero();
+  quantization::generateTensorHistogram(TH, hist.getHandle(), min, max);
+  range = quantization::optimizeKLRange(hist.getHandle(), min, max);
+  EXPECT_FLOAT_EQ(range.first, min);
+  EXPECT_GT(range.second, 0.9 * max);
+
+  // Choosing the params from the profile uses the clipped range.
+  std::vector<float> bins(hist.getHandle().size());
+  for (size_t i = 0, e = bins.size(); i < e; i++) {
+    bins[i] = hist.getHandle().raw(i);
+  }
+  NodeProfilingInfo PI("node:0", min, max, bins);
+  auto QI = quantization::generateNodeQuantizationInfos(
+      {PI}, quantization::Schema::Asymmetric,
+      quantization::Calibration::KLMinimization);
+  auto expected = quantization::chooseQuantizationParams(range.first,
+                                                         range.second);
+  EXPECT_FLOAT_EQ(QI[0].Scale(), expected.scale);
+  EXPECT_EQ(QI[0].Offset(), expected.offset);
+}
+
 template <typename From, typename To> static To clip(From in) {
   static_assert(sizeof(From) >= sizeof(To),
                 "Clip should reduce the variable size");
@@ -274,6 +396,312 @@ TEST_P(Operator, end2end) {
   }
 }
 
+/// Check that convolutions whose filter channels have very different ranges
+/// keep their accuracy when quantized with per-channel filter parameters.
+TEST_P(Operator, end2endChannelwiseConv) {
+  auto *mod = &interpreterEE.getModule();
+
+  auto *A = mod->createVariable(ElemKind::FloatTy, {2, 10, 10, 8}, "A",
+                                VisibilityKind::Public, false);
+  fillStableRandomData(A->getHandle(), 1100, 1);
+
+  Function *F1 = mod->createFunction("main");
+  ConvolutionNode *CV = F1->createConv("conv", A, 12, 3, 1, 1, 1);
+  auto filterH = cast<Variable>(CV->getFilter())->getHandle();
+  auto biasH = cast<Variable>(CV->getBias())->getHandle();
+  fillStableRandomData(filterH, 1000, 1);
+  fillStableRandomData(biasH, 2001, 1);
+
+  // Give every output channel a range that differs by up to 2^11 from the
+  // other channels.
+  size_t sliceSize = filterH.size() / 12;
+  for (size_t i = 0, e = filterH.size(); i < e; i++) {
+    filterH.raw(i) *= float(1 << (i / sliceSize)) / 1024;
+  }
+  for (size_t d = 0; d < 12; d++) {
+    biasH.raw(d) *= float(1 << d) / 1024;
+  }
+  F1->createSave("save", CV);
+  Function *F2 = F1->clone("main2");
+  SaveNode *result1 = cast<SaveNode>(F1->getNodeByName("save"));
+
+  Context ctx;
+  F1 = glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1, ctx);
+  interpreterEE.run();
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+  // Both functions save into the same variable, keep the float result.
+  Tensor floatResult = result1->getVariable()->getPayload().clone();
+
+  SaveNode *result2 = cast<SaveNode>(F2->getNodeByName("save"));
+  F2 = quantization::quantizeFunction(backendSpecificEE, QI, F2, "", {},
+                                      /* enableChannelwise */ true);
+
+  bool supported = backendSpecificEE.isOpSupported(
+      Kinded::Kind::ChannelwiseQuantizedConvolutionNodeKind, ElemKind::Int8QTy);
+  bool found = false;
+  for (auto &node : F2->getNodes()) {
+    found |= llvm::isa<ChannelwiseQuantizedConvolutionNode>(&node);
+  }
+  EXPECT_EQ(found, supported);
+
+  backendSpecificEE.compile(CompilationMode::Infer, F2, ctx);
+  backendSpecificEE.run();
+
+  auto H1 = floatResult.getHandle();
+  auto H2 = result2->getVariable()->getHandle();
+  ASSERT_EQ(H1.size(), H2.size());
+
+  // The output range is dominated by the widest channel, so compare against
+  // the largest magnitude of the whole result.
+  float mx = std::max(std::fabs(H1.raw(H1.minMaxArg().first)),
+                      std::fabs(H1.raw(H1.minMaxArg().second)));
+  for (size_t i = 0, e = H1.size(); i < e; i++) {
+    EXPECT_NEAR(H1.raw(i) / mx, H2.raw(i) / mx, 0.03);
+  }
+}
+
+/// Builds a graph \p name of two fully connected layers, with a ReLU in
+/// between if \p withRelu is set, profiles it on the interpreter, and
+/// quantizes it for the backend of \p EE with the node kinds \p int16Kinds
+/// in 16-bit. \p foundInt16 is set if a 16-bit layer was created.
+/// \returns the largest difference between the float and the quantized
+/// results, relative to the largest float result.
+static float runTwoLayerFC(ExecutionEngine &interpreterEE, ExecutionEngine &EE,
+                           llvm::StringRef name, bool withRelu,
+                           const KindSet &int16Kinds, bool &foundInt16) {
+  auto *mod = &interpreterEE.getModule();
+  auto *A = mod->createVariable(ElemKind::FloatTy, {8, 64}, "A",
+                                VisibilityKind::Public, false);
+  fillStableRandomData(A->getHandle(), 1100, 1);
+
+  Function *F1 = mod->createFunction(name);
+  // The biases are set to zero: the product of the lowered FC is computed in
+  // the quantized type of the result, and would saturate before the bias is
+  // added, hiding the precision of the layer.
+  auto *FC1 = F1->createFullyConnected("fc1", A, 32);
+  fillStableRandomData(cast<Variable>(FC1->getWeights())->getHandle(), 1000, 1);
+  cast<Variable>(FC1->getBias())->getPayload().zero();
+  Node *hidden = FC1;
+  if (withRelu) {
+    hidden = F1->createRELU("relu", FC1);
+  }
+  auto *FC2 = F1->createFullyConnected("fc2", hidden, 16);
+  fillStableRandomData(cast<Variable>(FC2->getWeights())->getHandle(), 1200, 1);
+  cast<Variable>(FC2->getBias())->getPayload().zero();
+  F1->createSave("save", FC2);
+  Function *F2 = F1->clone(std::string(name) + "2");
+  SaveNode *result1 = cast<SaveNode>(F1->getNodeByName("save"));
+
+  Context ctx;
+  F1 = glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1, ctx);
+  interpreterEE.run();
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+  // Both functions save into the same variable, keep the float result.
+  Tensor floatResult = result1->getVariable()->getPayload().clone();
+
+  SaveNode *result2 = cast<SaveNode>(F2->getNodeByName("save"));
+  F2 = quantization::quantizeFunction(EE, QI, F2, "", {},
+                                      /* enableChannelwise */ false,
+                                      int16Kinds);
+  foundInt16 = false;
+  for (auto &node : F2->getNodes()) {
+    if (auto *FC = llvm::dyn_cast<FullyConnectedNode>(&node)) {
+      foundInt16 |= FC->getResult().getElementType() == ElemKind::Int16QTy;
+    }
+  }
+
+  EE.compile(CompilationMode::Infer, F2, ctx);
+  EE.run();
+
+  auto H1 = floatResult.getHandle();
+  auto H2 = result2->getVariable()->getHandle();
+  float mx = std::max(std::fabs(H1.raw(H1.minMaxArg().first)),
+                      std::fabs(H1.raw(H1.minMaxArg().second)));
+  float maxError = 0;
+  for (size_t i = 0, e = H1.size(); i < e; i++) {
+    maxError = std::max(maxError, std::fabs(H1.raw(i) - H2.raw(i)) / mx);
+  }
+  return maxError;
+}
+
+/// Check that fully connected layers quantized to 16-bit are much more
+/// accurate than in 8-bit, and fall back to 8-bit on backends without 16-bit
+/// support.
+TEST_P(Operator, end2endInt16FC) {
+  bool supported = backendSpecificEE.isOpSupported(
+      Kinded::Kind::FullyConnectedNodeKind, ElemKind::Int16QTy);
+  bool foundInt16;
+  float error8 = runTwoLayerFC(interpreterEE, backendSpecificEE, "int8", false,
+                               {}, foundInt16);
+  EXPECT_FALSE(foundInt16);
+  EXPECT_LT(error8, 0.05);
+
+  KindSet int16Kinds;
+  int16Kinds.insert(Kinded::Kind::FullyConnectedNodeKind);
+  float error16 = runTwoLayerFC(interpreterEE, backendSpecificEE, "int16",
+                                false, int16Kinds, foundInt16);
+  EXPECT_EQ(foundInt16, supported);
+  if (supported) {
+    EXPECT_LT(error16 * 10, error8);
+  }
+}
+
+/// Check that a graph mixing 16-bit fully connected layers and an 8-bit ReLU
+/// converts between the two precisions.
+TEST_P(Operator, end2endMixedPrecision) {
+  KindSet int16Kinds;
+  int16Kinds.insert(Kinded::Kind::FullyConnectedNodeKind);
+  bool foundInt16;
+  float error = runTwoLayerFC(interpreterEE, backendSpecificEE, "mixed", true,
+                              int16Kinds, foundInt16);
+  EXPECT_EQ(foundInt16, backendSpecificEE.isOpSupported(
+                            Kinded::Kind::FullyConnectedNodeKind,
+                            ElemKind::Int16QTy));
+  EXPECT_LT(error, 0.05);
+}
+
+/// Run two fully connected layers in float and after quantizing them without
+/// a profile on \p EE, with quantizeDynamically if \p dynamic is set and
+/// quantizeWeightsOnly otherwise. The output columns and the input rows have
+/// very different ranges, which a single scale for a whole tensor would
+/// lose. \returns the number of quantized layers after checking that the
+/// results are close.
+static unsigned runFCWithoutProfile(ExecutionEngine &EE, bool dynamic) {
+  auto *mod = &EE.getModule();
+  auto *A = mod->createVariable(ElemKind::FloatTy, {5, 70}, "A",
+                                VisibilityKind::Public, false);
+  auto AH = A->getHandle();
+  fillStableRandomData(AH, 1100, 1);
+  for (size_t b = 0; b < 5; b++) {
+    for (size_t k = 0; k < 70; k++) {
+      AH.at({b, k}) = AH.at({b, k}) * (b * 10 + 1) + b;
+    }
+  }
+
+  Function *F1 = mod->createFunction("float");
+  auto *FC1 = F1->createFullyConnected("fc1", A, 41);
+  auto W1 = cast<Variable>(FC1->getWeights())->getHandle();
+  fillStableRandomData(W1, 1000, 1);
+  for (size_t k = 0; k < 70; k++) {
+    for (size_t n = 0; n < 41; n++) {
+      W1.at({k, n}) *= (n % 7) * (n % 7) + 0.01;
+    }
+  }
+  auto *relu = F1->createRELU("relu", FC1);
+  auto *FC2 = F1->createFullyConnected("fc2", relu, 16);
+  fillStableRandomData(cast<Variable>(FC2->getWeights())->getHandle(), 1200, 1);
+  auto *save = F1->createSave("save", FC2);
+  Function *F2 = F1->clone("quantized");
+
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F1, ctx);
+  EE.run();
+  Tensor floatResult = save->getVariable()->getPayload().clone();
+
+  unsigned numQuantized = dynamic ? quantization::quantizeDynamically(EE, F2)
+                                  : quantization::quantizeWeightsOnly(EE, F2);
+  if (!numQuantized) {
+    return 0;
+  }
+  for (auto &node : F2->getNodes()) {
+    EXPECT_FALSE(llvm::isa<FullyConnectedNode>(&node));
+  }
+
+  EE.compile(CompilationMode::Infer, F2, ctx);
+  EE.run();
+
+  // Compare every row with the range of its float result.
+  auto H1 = floatResult.getHandle();
+  auto H2 = save->getVariable()->getHandle();
+  for (size_t b = 0; b < 5; b++) {
+    float mx = 0;
+    for (size_t n = 0; n < 16; n++) {
+      mx = std::max(mx, std::fabs(H1.at({b, n})));
+    }
+    for (size_t n = 0; n < 16; n++) {
+      EXPECT_NEAR(H1.at({b, n}), H2.at({b, n}), 0.02 * mx);
+    }
+  }
+  return numQuantized;
+}
+
+/// Check that quantizing only the weights of fully connected layers needs no
+/// profile and stays close to the float result.
+TEST_P(Operator, end2endWeightsOnly) {
+  bool supported = backendSpecificEE.isOpSupported(
+      Kinded::Kind::RowwiseQuantizedFullyConnectedNodeKind, ElemKind::FloatTy);
+  EXPECT_EQ(runFCWithoutProfile(backendSpecificEE, false), supported ? 2u : 0u);
+}
+
+/// Check that fully connected layers whose inputs are quantized at runtime
+/// stay close to the float result, although every input row has a different
+/// range.
+TEST_P(Operator, end2endDynamicQuantization) {
+  bool supported = backendSpecificEE.isOpSupported(
+      Kinded::Kind::DynamicQuantizedFullyConnectedNodeKind, ElemKind::FloatTy);
+  EXPECT_EQ(runFCWithoutProfile(backendSpecificEE, true), supported ? 2u : 0u);
+}
+
+/// Builds a small graph for profiling in the module \p M.
+static Function *createGraphForProfiling(Module *M) {
+  Function *F = M->createFunction("main");
+  auto *A = M->createVariable(ElemKind::FloatTy, {3, 40}, "A",
+                              VisibilityKind::Public, false);
+  fillStableRandomData(A->getHandle(), 1100, 3);
+  auto *FC = F->createFullyConnected("fc", A, 17);
+  fillStableRandomData(cast<Variable>(FC->getWeights())->getHandle(), 1000, 1);
+  fillStableRandomData(cast<Variable>(FC->getBias())->getHandle(), 2001, 1);
+  auto *RL = F->createRELU("relu", FC);
+  F->createSave("save", RL);
+  return F;
+}
+
+/// Check that the backend captures the same profile as the Interpreter.
+TEST_P(Quantization, profileOnBackend) {
+  Context ctx;
+  Function *F1 = createGraphForProfiling(&interpreterEE.getModule());
+  F1 = glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1, ctx);
+  interpreterEE.run();
+  interpreterEE.run();
+
+  Function *F2 = createGraphForProfiling(&backendSpecificEE.getModule());
+  F2 = glow::profileQuantization(F2);
+  backendSpecificEE.compile(CompilationMode::Infer, F2, ctx);
+  backendSpecificEE.run();
+  backendSpecificEE.run();
+
+  auto P1 = quantization::generateNodeProfilingInfos(F1);
+  auto P2 = quantization::generateNodeProfilingInfos(F2);
+  ASSERT_EQ(P1.size(), P2.size());
+  std::unordered_map<std::string, const NodeProfilingInfo *> byName;
+  for (const auto &PI : P1) {
+    byName[PI.nodeOutputName_] = &PI;
+  }
+  for (const auto &PI : P2) {
+    ASSERT_TRUE(byName.count(PI.nodeOutputName_));
+    const NodeProfilingInfo *expected = byName[PI.nodeOutputName_];
+    EXPECT_FLOAT_EQ(PI.min_, expected->min_);
+    EXPECT_FLOAT_EQ(PI.max_, expected->max_);
+    ASSERT_EQ(PI.histogram_.size(), expected->histogram_.size());
+
+    // Values on the bin boundaries may land in a neighbouring bin, as the
+    // kernels are compiled with fast-math.
+    float total = 0, expectedTotal = 0, diff = 0;
+    for (size_t i = 0, e = PI.histogram_.size(); i < e; i++) {
+      total += PI.histogram_[i];
+      expectedTotal += expected->histogram_[i];
+      diff += std::fabs(PI.histogram_[i] - expected->histogram_[i]);
+    }
+    EXPECT_EQ(total, expectedTotal);
+    EXPECT_LE(diff, expectedTotal / 50);
+  }
+}
+
 /// Fills the tensor \p H with some stable random integers with the seed \p seed
 /// and the range [0, scale).
 static void fillStableRandomIndex(Handle<int64_t> H, size_t seed,
@@ -410,6 +838,82 @@ TEST_P(Operator, end2endGRU) {
   }
 }
 
+/// Check that the recurrent cells are quantized through their expansion, so
+/// that no cell is left in floating point, and stay close to the float result.
+TEST_P(Operator, end2endRecurrentCells) {
+  auto *mod = &interpreterEE.getModule();
+  constexpr size_t B = 4, X = 6, H = 8;
+  auto createVar = [&](llvm::ArrayRef<size_t> dims, llvm::StringRef name,
+                       VisibilityKind visibility, size_t seed) {
+    auto *V = mod->createVariable(ElemKind::FloatTy, dims, name, visibility,
+                                  /* isTrainable */ false);
+    fillStableRandomData(V->getHandle(), seed, 1);
+    return V;
+  };
+  auto *input = createVar({B, X}, "input", VisibilityKind::Public, 1100);
+  auto *h = createVar({B, H}, "h", VisibilityKind::Public, 2001);
+  auto *c = createVar({B, H}, "c", VisibilityKind::Public, 3001);
+
+  // STEP1 - Generate the first network to record the quantization parameters.
+  Function *F1 = mod->createFunction("main");
+  auto *LC = F1->createLSTMCell(
+      "lstm", input, h, c,
+      createVar({X, 4 * H}, "lstm.wx", VisibilityKind::Private, 1000),
+      createVar({4 * H}, "lstm.bx", VisibilityKind::Private, 1200),
+      createVar({H, 4 * H}, "lstm.wh", VisibilityKind::Private, 1400),
+      createVar({4 * H}, "lstm.bh", VisibilityKind::Private, 1600));
+  auto *GC = F1->createGRUCell(
+      "gru", LC->getNewH(), LC->getNewC(),
+      createVar({H, 3 * H}, "gru.wx", VisibilityKind::Private, 1800),
+      createVar({3 * H}, "gru.bx", VisibilityKind::Private, 2000),
+      createVar({H, 3 * H}, "gru.wh", VisibilityKind::Private, 2200),
+      createVar({3 * H}, "gru.bh", VisibilityKind::Private, 2400));
+  SaveNode *result1 = F1->createSave("save", GC);
+  Function *F2 = F1->clone("main2");
+
+  Context ctx;
+  F1 = glow::profileQuantization(F1);
+  interpreterEE.compile(CompilationMode::Infer, F1, ctx);
+
+  // Run graph to capture profile.
+  interpreterEE.run();
+
+  // Get quantization infos and build new quantized graph.
+  std::vector<NodeQuantizationInfo> QI =
+      quantization::generateNodeQuantizationInfos(F1);
+
+  // STEP2 - Use the profile to quantize a network.
+  SaveNode *result2 = cast<SaveNode>(F2->getNodeByName("save"));
+  F2 = quantization::quantizeFunction(backendSpecificEE, QI, F2);
+
+  unsigned numQuantizedFCs = 0;
+  for (auto &N : F2->getNodes()) {
+    EXPECT_FALSE(llvm::isa<LSTMCellNode>(&N) || llvm::isa<LSTMUnitNode>(&N) ||
+                 llvm::isa<GRUCellNode>(&N) || llvm::isa<GRUUnitNode>(&N));
+    if (auto *FC = llvm::dyn_cast<FullyConnectedNode>(&N)) {
+      numQuantizedFCs += FC->getResult().getType()->isQuantizedType();
+    }
+  }
+  // Both cells compute their input and hidden gates with one FC each.
+  EXPECT_EQ(numQuantizedFCs, 4u);
+
+  backendSpecificEE.compile(CompilationMode::Infer, F2, ctx);
+  backendSpecificEE.run();
+
+  // STEP3 - Compare the results of the original and quantized functions.
+  auto result1Handle = result1->getVariable()->getHandle();
+  auto result2Handle = result2->getVariable()->getHandle();
+  EXPECT_EQ(result1Handle.size(), result2Handle.size());
+
+  float mx = result2Handle.raw(result2Handle.minMaxArg().second);
+  for (size_t i = 0, e = result1Handle.size(); i < e; ++i) {
+    double diff = std::fabs(result2Handle.raw(i) - result1Handle.raw(i)) / mx;
+
+    // The quantized sigmoids and tanhs of both cells add up, allow 5%.
+    EXPECT_NEAR(diff, 0, 0.05);
+  }
+}
+
 TEST(Quantization, rescaleSameType) {
   ExecutionEngine EE;
   auto &mod = EE.getModule();
@@ -926,6 +1430,147 @@ TEST(Quantization, quantizeGraphPartiallyMultipleKinds) {
   }
 }
 
+/// Test that the per-node precisions of a policy survive serialization and
+/// take precedence over the node kinds that are not to be quantized.
+TEST(Quantization, quantizeGraphWithPrecisionPolicy) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *LHS = mod.createVariable(ElemKind::FloatTy, {3, 3}, "lhs",
+                                 VisibilityKind::Private, true);
+  auto *RHS = mod.createVariable(ElemKind::FloatTy, {3, 3}, "rhs",
+                                 VisibilityKind::Private, true);
+  auto *result = mod.createVariable(ElemKind::FloatTy, {3, 3}, "result");
+  LHS->getPayload().init(Tensor::InitKind::Xavier, 3, mod.getPRNG());
+  RHS->getPayload().init(Tensor::InitKind::Xavier, 3, mod.getPRNG());
+
+  auto *MMN = F->createMatMul("matmul", LHS, RHS);
+  auto *TN1 = F->createTanh("tanh1", MMN);
+  auto *TN2 = F->createTanh("tanh2", TN1);
+  F->createSave("ret", TN2, result);
+
+  std::vector<NodeQuantizationInfo> QI{
+      {NodeQuantizationInfo::generateNodeOutputName(LHS->getName()), {0.3f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(RHS->getName()), {0.4f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(MMN->getName()), {0.6f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(TN1->getName()), {0.5f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(TN2->getName()), {0.5f, 0}},
+  };
+
+  // The matmul and the first tanh stay in float, the second tanh does not.
+  std::vector<NodePrecisionInfo> policy{{"matmul", ElemKind::FloatTy},
+                                        {"tanh1", ElemKind::FloatTy},
+                                        {"tanh2", ElemKind::Int8QTy}};
+  llvm::SmallVector<char, 10> resultPath;
+  llvm::sys::fs::createTemporaryFile("prefix", "suffix", resultPath);
+  std::string filePath(resultPath.begin(), resultPath.end());
+  serializePrecisionPolicyToYaml(filePath, policy);
+  std::vector<NodePrecisionInfo> deserialized =
+      deserializePrecisionPolicyFromYaml(filePath);
+  ASSERT_EQ(policy.size(), deserialized.size());
+  for (size_t i = 0, e = policy.size(); i < e; i++) {
+    EXPECT_EQ(policy[i].nodeName_, deserialized[i].nodeName_);
+    EXPECT_EQ(policy[i].precision_, deserialized[i].precision_);
+  }
+
+  KindSet doNotQuantize;
+  doNotQuantize.insert(Kinded::Kind::TanhNodeKind);
+  auto *QF = quantization::quantizeFunction(EE, QI, F, "_quantized",
+                                            doNotQuantize, false, {},
+                                            deserialized);
+  QF->getParent()->eraseFunction(F);
+  F = QF;
+
+  auto *SN = llvm::dyn_cast<SaveNode>(result->getUsers().begin()->getUser());
+  ASSERT_TRUE(SN);
+  auto *DN = llvm::dyn_cast<DequantizeNode>(SN->getInput());
+  ASSERT_TRUE(DN);
+  auto *QTN2 = llvm::dyn_cast<TanhNode>(DN->getInput());
+  ASSERT_TRUE(QTN2);
+  EXPECT_TRUE(QTN2->getResult().getType()->isQuantizedType());
+  auto *QN = llvm::dyn_cast<QuantizeNode>(QTN2->getInput());
+  ASSERT_TRUE(QN);
+  auto *QTN1 = llvm::dyn_cast<TanhNode>(QN->getInput());
+  ASSERT_TRUE(QTN1);
+  EXPECT_FALSE(QTN1->getResult().getType()->isQuantizedType());
+  auto *QMMN = llvm::dyn_cast<MatMulNode>(QTN1->getInput());
+  ASSERT_TRUE(QMMN);
+  EXPECT_FALSE(QMMN->getResult().getType()->isQuantizedType());
+
+  // Make sure that graph can be compiled and run.
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+}
+
+/// Check that the inputs of a quantized Concat are produced with the scale of
+/// the Concat when their profiles are close enough, and rescaled otherwise.
+TEST(Quantization, unifyConcatScales) {
+  ExecutionEngine EE;
+  auto &mod = EE.getModule();
+  Function *F = mod.createFunction("main");
+
+  auto *LHS = mod.createVariable(ElemKind::FloatTy, {3, 3}, "lhs",
+                                 VisibilityKind::Private, true);
+  auto *RHS = mod.createVariable(ElemKind::FloatTy, {3, 3}, "rhs",
+                                 VisibilityKind::Private, true);
+  auto *result = mod.createVariable(ElemKind::FloatTy, {9, 3}, "result");
+  LHS->getPayload().init(Tensor::InitKind::Xavier, 3, mod.getPRNG());
+  RHS->getPayload().init(Tensor::InitKind::Xavier, 3, mod.getPRNG());
+
+  auto *MM1 = F->createMatMul("matmul1", LHS, RHS);
+  auto *MM2 = F->createMatMul("matmul2", LHS, RHS);
+  auto *MM3 = F->createMatMul("matmul3", LHS, RHS);
+  auto *CN = F->createConcat("concat", {MM1, MM2, MM3}, 0);
+  F->createSave("ret", CN, result);
+
+  std::vector<NodeQuantizationInfo> QI{
+      {NodeQuantizationInfo::generateNodeOutputName(LHS->getName()), {0.3f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(RHS->getName()), {0.4f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(MM1->getName()), {0.5f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(MM2->getName()), {0.6f, 0}},
+      // Adopting the scale of the concat would lose more than one bit here.
+      {NodeQuantizationInfo::generateNodeOutputName(MM3->getName()), {0.1f, 0}},
+      {NodeQuantizationInfo::generateNodeOutputName(CN->getName()), {0.6f, 0}},
+  };
+
+  auto *QF = quantization::quantizeFunction(EE, QI, F, "_quantized");
+  QF->getParent()->eraseFunction(F);
+  F = QF;
+  ::glow::optimize(F, CompilationMode::Infer);
+
+  ASSERT_EQ(result->getUsers().size(), 1);
+  auto *SN = llvm::dyn_cast<SaveNode>(result->getUsers().begin()->getUser());
+  ASSERT_TRUE(SN);
+  auto *DN = llvm::dyn_cast<DequantizeNode>(SN->getInput());
+  ASSERT_TRUE(DN);
+  auto *QCN = llvm::dyn_cast<ConcatNode>(DN->getInput());
+  ASSERT_TRUE(QCN);
+  ASSERT_EQ(QCN->getInputs().size(), 3);
+  EXPECT_EQ(QCN->getResult().getType()->getScale(), 0.6f);
+
+  // The first two matmuls compute their results with the scale of the concat.
+  for (unsigned i = 0; i < 2; i++) {
+    auto *MMN = llvm::dyn_cast<MatMulNode>(QCN->getInputs()[i].getNode());
+    ASSERT_TRUE(MMN);
+    EXPECT_EQ(MMN->getResult().getType()->getScale(), 0.6f);
+  }
+
+  // The last one keeps its own scale and is rescaled.
+  auto *RQ =
+      llvm::dyn_cast<RescaleQuantizedNode>(QCN->getInputs()[2].getNode());
+  ASSERT_TRUE(RQ);
+  auto *MM3Q = llvm::dyn_cast<MatMulNode>(RQ->getInput());
+  ASSERT_TRUE(MM3Q);
+  EXPECT_EQ(MM3Q->getResult().getType()->getScale(), 0.1f);
+
+  // Make sure that graph can be compiled and run.
+  Context ctx;
+  EE.compile(CompilationMode::Infer, F, ctx);
+  EE.run();
+}
+
 INSTANTIATE_TEST_CASE_P(Interpreter, Quantization,
                         ::testing::Values(BackendKind::Interpreter));
 INSTANTIATE_TEST_CASE_P(Interpreter, Operator,
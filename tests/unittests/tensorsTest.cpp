@@ -15,9 +15,14 @@
  */
 
 #include "glow/Base/Tensor.h"
+#include "glow/Base/TensorFile.h"
 
 #include "gtest/gtest.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
 using namespace glow;
 
 TEST(Tensor, init) {
@@ -62,6 +67,25 @@ TEST(Tensor, randomizeInt) {
   }
 }
 
+/// Check that the Xavier initialization of a tensor that is filled in
+/// parallel does not depend on how it is split.
+TEST(Tensor, initXavierParallel) {
+  PseudoRNG PRNG1, PRNG2;
+  Tensor T(ElemKind::FloatTy, {512, 1024});
+  T.init(Tensor::InitKind::Xavier, 3, PRNG1);
+  auto H = T.getHandle<>();
+
+  // The same sequence, generated serially.
+  CounterRNG CRNG(PRNG2);
+  double sum = 0;
+  for (size_t i = 0, e = H.size(); i < e; i++) {
+    ASSERT_EQ(H.raw(i), float(CRNG.nextRandReal(i, -1, 1)));
+    sum += H.raw(i);
+  }
+  EXPECT_NEAR(sum / H.size(), 0, 0.01);
+  EXPECT_NEAR(H.calculateMeanVariance().second, 1.0 / 3, 0.01);
+}
+
 TEST(Tensor, clone) {
   Tensor T = {1.2f, 12.1f, 51.0f, 1515.2f};
   auto H = T.getHandle<>();
@@ -112,6 +136,40 @@ TEST(Tensor, isZero) {
   }
 }
 
+TEST(Tensor, bulkAccess) {
+  // Longer than the blocks in which the elements are compared.
+  Tensor T(ElemKind::FloatTy, {1000});
+  auto H = T.getHandle<>();
+  std::vector<int64_t> values(1000);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = int64_t(i % 7) - 3;
+  }
+  H.copyFrom(llvm::makeArrayRef(values));
+  EXPECT_EQ(H.at({5}), 2);
+  EXPECT_EQ(H.getRawData().size(), 1000);
+
+  auto range = H.minMax();
+  EXPECT_EQ(range.first, -3);
+  EXPECT_EQ(range.second, 3);
+  range = H.minMax(1, 4);
+  EXPECT_EQ(range.first, -2);
+  EXPECT_EQ(range.second, 0);
+
+  std::vector<int32_t> copy(1000);
+  H.copyTo(llvm::makeMutableArrayRef(copy));
+  EXPECT_TRUE(std::equal(copy.begin(), copy.end(), values.begin()));
+
+  Tensor U = T.clone();
+  EXPECT_TRUE(T.isEqual(U));
+  U.getHandle<>().raw(999) += 1;
+  EXPECT_FALSE(T.isEqual(U));
+
+  H.clear();
+  EXPECT_TRUE(H.isZero());
+  H.raw(700) = 1;
+  EXPECT_FALSE(H.isZero());
+}
+
 TEST(Tensor, inBounds) {
   Tensor A(ElemKind::FloatTy, {15, 5, 3});
 
@@ -293,6 +351,27 @@ TEST(Tensor, copySlice) {
   }
 }
 
+TEST(Tensor, insertSlice) {
+  PseudoRNG PRNG;
+  Tensor A(ElemKind::FloatTy, {10, 5, 3});
+  Tensor B(ElemKind::FloatTy, {5, 3});
+  Tensor C(ElemKind::FloatTy, {5, 3});
+
+  A.zero();
+  B.getHandle<>().randomize(-2.0, 2.0, PRNG);
+
+  A.insertSlice(&B, 7);
+  C.copySlice(&A, 7);
+  EXPECT_TRUE(B.isEqual(C));
+
+  // The other slices are not changed.
+  C.copySlice(&A, 6);
+  auto CH = C.getHandle<>();
+  for (size_t i = 0; i < CH.size(); i++) {
+    EXPECT_EQ(CH.raw(i), 0);
+  }
+}
+
 TEST(Tensor, reset) {
   Tensor A(ElemKind::FloatTy, {2, 3});
   Tensor QA(ElemKind::Int8QTy, {3, 4}, 2.2, 7);
@@ -363,6 +442,86 @@ TEST(Tensor, transpose2) {
   }
 }
 
+/// Check transposes that span several tiles, for all the element sizes, and
+/// with dimensions of size one that get merged away.
+TEST(Tensor, transposeTiled) {
+  PseudoRNG PRNG;
+  Tensor X(ElemKind::Int8QTy, {3, 1, 70, 2, 130}, 1.0, 0);
+  X.getHandle<int8_t>().randomize(-100, 100, PRNG);
+  Tensor Xhat;
+  X.transpose(&Xhat, {4, 1, 0, 3, 2});
+  auto H = X.getHandle<int8_t>();
+  auto XhatH = Xhat.getHandle<int8_t>();
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 70; j++) {
+      for (size_t k = 0; k < 2; k++) {
+        for (size_t l = 0; l < 130; l++) {
+          EXPECT_EQ(H.at({i, 0, j, k, l}), XhatH.at({l, 0, i, k, j}));
+        }
+      }
+    }
+  }
+
+  Tensor Y(ElemKind::Int64ITy, {33, 67});
+  Y.getHandle<int64_t>().randomize(-1000, 1000, PRNG);
+  Tensor Yhat;
+  Y.transpose(&Yhat, {1, 0});
+  auto YH = Y.getHandle<int64_t>();
+  auto YhatH = Yhat.getHandle<int64_t>();
+  for (size_t i = 0; i < 33; i++) {
+    for (size_t j = 0; j < 67; j++) {
+      EXPECT_EQ(YH.at({i, j}), YhatH.at({j, i}));
+    }
+  }
+
+  Tensor Z(ElemKind::Float16Ty, {4, 5, 6});
+  Z.getHandle<float16_t>().randomize(-2.0, 2.0, PRNG);
+  Tensor Zhat;
+  Z.transpose(&Zhat, {0, 2, 1});
+  auto ZH = Z.getHandle<float16_t>();
+  auto ZhatH = Zhat.getHandle<float16_t>();
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 5; j++) {
+      for (size_t k = 0; k < 6; k++) {
+        EXPECT_EQ(ZH.at({i, j, k}), ZhatH.at({i, k, j}));
+      }
+    }
+  }
+}
+
+/// Check that a region in the middle of a tensor round trips through
+/// extractTensors and insertTensors.
+TEST(Tensor, extractAndInsertRegion) {
+  PseudoRNG PRNG;
+  Tensor big(ElemKind::FloatTy, {4, 6, 9});
+  big.getHandle().randomize(-2.0, 2.0, PRNG);
+  Tensor region(ElemKind::FloatTy, {2, 3, 5});
+  auto bigH = big.getHandle();
+  auto regionH = region.getHandle();
+  bigH.extractTensors(regionH, {1, 2, 3});
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      for (size_t k = 0; k < 5; k++) {
+        EXPECT_EQ(regionH.at({i, j, k}), bigH.at({i + 1, j + 2, k + 3}));
+      }
+    }
+  }
+
+  Tensor other(ElemKind::FloatTy, {4, 6, 9});
+  other.zero();
+  auto otherH = other.getHandle();
+  otherH.insertTensors(regionH, {2, 0, 4});
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 6; j++) {
+      for (size_t k = 0; k < 9; k++) {
+        bool inside = i >= 2 && j < 3 && k >= 4;
+        EXPECT_EQ(otherH.at({i, j, k}),
+                  inside ? regionH.at({i - 2, j, k - 4}) : 0);
+      }
+    }
+  }
+}
+
 TEST(Tensor, nonOwnedTensor) {
   Tensor T1 = {1.2f, 12.1f, 51.0f, 1515.2f};
 
@@ -588,6 +747,94 @@ TEST(Tensor, insertWithCountAndAxis) {
   }
 }
 
+/// Check the rounding of floats to half precision and the exact expansion of
+/// half precision values to floats.
+TEST(Tensor, float16Conversion) {
+  EXPECT_EQ(float16_t(1.0f).getBits(), 0x3c00);
+  EXPECT_EQ(float16_t(-2.0f).getBits(), 0xc000);
+  EXPECT_EQ(float16_t(0.0f).getBits(), 0x0000);
+  EXPECT_EQ(float16_t(-0.0f).getBits(), 0x8000);
+  // The largest half and the overflow to infinity.
+  EXPECT_EQ(float16_t(65504.0f).getBits(), 0x7bff);
+  EXPECT_EQ(float16_t(65519.0f).getBits(), 0x7bff);
+  EXPECT_EQ(float16_t(65520.0f).getBits(), 0x7c00);
+  EXPECT_EQ(float16_t(-1e10f).getBits(), 0xfc00);
+  // Ties round to even.
+  EXPECT_EQ(float16_t(1.0f + std::ldexp(1.0f, -11)).getBits(), 0x3c00);
+  EXPECT_EQ(float16_t(1.0f + 3 * std::ldexp(1.0f, -11)).getBits(), 0x3c02);
+  // The smallest subnormal, and the underflow of half of it to zero.
+  EXPECT_EQ(float16_t(std::ldexp(1.0f, -24)).getBits(), 0x0001);
+  EXPECT_EQ(float16_t(std::ldexp(1.0f, -25)).getBits(), 0x0000);
+  // NaNs stay NaNs. Compare encodings, as the tests may build with fast-math.
+  uint32_t nanBits = 0x7fc00000;
+  float nan;
+  memcpy(&nan, &nanBits, sizeof(nan));
+  EXPECT_GT(float16_t(nan).getBits() & 0x7fff, 0x7c00);
+
+  // Every half precision value that is not a NaN survives a round trip.
+  for (uint32_t bits = 0; bits < 0x10000; bits++) {
+    if ((bits & 0x7fff) > 0x7c00) {
+      continue;
+    }
+    float value = float16_t::fromBits(bits);
+    EXPECT_EQ(float16_t(value).getBits(), bits);
+  }
+}
+
+/// Check the basic operations on half precision tensors.
+TEST(Tensor, float16Tensor) {
+  Tensor T(ElemKind::Float16Ty, {2, 3});
+  EXPECT_EQ(T.getType().getSizeInBytes(), 12);
+  EXPECT_EQ(T.getType().getElementName(), "float16");
+
+  auto H = T.getHandle<float16_t>();
+  H = {1, 2, 3, 4.5, 5, -6};
+  EXPECT_EQ(H.at({1, 1}), 5);
+  H.at({1, 1}) += 0.25;
+  EXPECT_EQ(H.at({1, 1}), 5.25);
+
+  Tensor TT;
+  T.transpose(&TT, {1, 0});
+  EXPECT_EQ(TT.getElementType(), ElemKind::Float16Ty);
+  EXPECT_EQ(TT.getHandle<float16_t>().at({2, 1}), -6);
+
+  Tensor C = T.clone();
+  EXPECT_TRUE(C.isEqual(T));
+  C.getHandle<float16_t>().at({0, 0}) = 1.5;
+  EXPECT_FALSE(C.isEqual(T));
+}
+
+/// Check the rounding of floats to bfloat16 and the basic operations on
+/// bfloat16 tensors.
+TEST(Tensor, bfloat16) {
+  EXPECT_EQ(bfloat16_t(1.0f).getBits(), 0x3f80);
+  EXPECT_EQ(bfloat16_t(-2.0f).getBits(), 0xc000);
+  // bfloat16 has the range of float.
+  EXPECT_EQ(float(bfloat16_t(std::ldexp(1.0f, 100))), std::ldexp(1.0f, 100));
+  // Ties round to even.
+  EXPECT_EQ(bfloat16_t(1.0f + std::ldexp(1.0f, -8)).getBits(), 0x3f80);
+  EXPECT_EQ(bfloat16_t(1.0f + 3 * std::ldexp(1.0f, -8)).getBits(), 0x3f82);
+  // NaNs stay NaNs.
+  uint32_t nanBits = 0x7f800001;
+  float nan;
+  memcpy(&nan, &nanBits, sizeof(nan));
+  EXPECT_GT(bfloat16_t(nan).getBits() & 0x7fff, 0x7f80);
+
+  Tensor T(ElemKind::BFloat16Ty, {2, 3});
+  EXPECT_EQ(T.getType().getSizeInBytes(), 12);
+  EXPECT_EQ(T.getType().getElementName(), "bfloat16");
+  auto H = T.getHandle<bfloat16_t>();
+  H = {1, 2, 3, 4.5, 5, -6};
+  H.at({1, 1}) += 0.25;
+  EXPECT_EQ(H.at({1, 1}), 5.25);
+
+  Tensor TT;
+  T.transpose(&TT, {1, 0});
+  EXPECT_EQ(TT.getElementType(), ElemKind::BFloat16Ty);
+  EXPECT_EQ(TT.getHandle<bfloat16_t>().at({2, 1}), -6);
+  EXPECT_TRUE(T.clone().isEqual(T));
+}
+
 TEST(ZeroDimensionalTensor, handleAt) {
   Tensor T(ElemKind::FloatTy, {});
   auto H = T.getHandle<>();
@@ -650,3 +897,64 @@ TEST(Type, compare) {
   EXPECT_FALSE(T1.isEqual(T3));
   EXPECT_FALSE(T1.isEqual(T4));
 }
+
+/// Write an NPY file \p path of version 1 with the header dict \p dict and
+/// the array \p data.
+static void writeNpy(llvm::StringRef path, llvm::StringRef dict,
+                     llvm::StringRef data) {
+  std::error_code EC;
+  llvm::raw_fd_ostream os(path, EC, llvm::sys::fs::F_None);
+  ASSERT_FALSE(EC);
+  // The header is padded with spaces and ends with a newline.
+  std::string header = dict.str();
+  header.append(63 - (10 + header.size()) % 64, ' ');
+  header += '\n';
+  os << "\x93NUMPY" << char(1) << char(0) << char(header.size() & 0xff)
+     << char(header.size() >> 8) << header << data;
+}
+
+/// Check that the samples of an NPY file are read without a copy, and that
+/// the uint8 ones are normalized.
+TEST(Tensor, npyFile) {
+  llvm::SmallString<64> path;
+  llvm::sys::fs::createTemporaryFile("glowTensors", "npy", path);
+
+  std::vector<float> values(3 * 2 * 2);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = i;
+  }
+  writeNpy(path,
+           "{'descr': '<f4', 'fortran_order': False, 'shape': (3, 2, 2), }",
+           llvm::StringRef(reinterpret_cast<const char *>(values.data()),
+                           values.size() * sizeof(float)));
+  auto file = NpyFile::open(path);
+  ASSERT_TRUE(file);
+  EXPECT_EQ(file->getKind(), NpyFile::Kind::Float32);
+  EXPECT_EQ(file->getNumSamples(), 3);
+  EXPECT_EQ(file->getSampleDims(), llvm::ArrayRef<size_t>({2, 2}));
+  Tensor samples = file->getSamples(1, 2);
+  EXPECT_EQ(samples.dims(), llvm::ArrayRef<size_t>({2, 2, 2}));
+  auto H = samples.getHandle<>();
+  for (size_t i = 0; i < H.size(); i++) {
+    EXPECT_EQ(H.raw(i), 4 + i);
+  }
+
+  writeNpy(path, "{'descr': '|u1', 'fortran_order': False, 'shape': (2, 2), }",
+           llvm::StringRef("\x00\xff\x33\x66", 4));
+  file = NpyFile::open(path);
+  ASSERT_TRUE(file);
+  EXPECT_EQ(file->getKind(), NpyFile::Kind::UInt8);
+  Tensor batch(ElemKind::FloatTy, {2, 2});
+  file->copySamples(0, 2, &batch, {0, 1});
+  auto BH = batch.getHandle<>();
+  EXPECT_FLOAT_EQ(BH.at({0, 0}), 0);
+  EXPECT_FLOAT_EQ(BH.at({0, 1}), 1);
+  EXPECT_FLOAT_EQ(BH.at({1, 0}), 0.2);
+  EXPECT_FLOAT_EQ(BH.at({1, 1}), 0.4);
+
+  writeNpy(path, "{'descr': '<f4', 'fortran_order': True, 'shape': (1,), }",
+           llvm::StringRef("\0\0\0\0", 4));
+  EXPECT_FALSE(NpyFile::open(path));
+  file.reset();
+  llvm::sys::fs::remove(path);
+}
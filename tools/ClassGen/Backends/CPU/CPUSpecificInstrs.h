@@ -32,6 +32,97 @@ BB.newBackendSpecificInstr("CPUConvDKKC8")
     .addMember(MemberType::VectorUnsigned, "Strides")
     .addMember(MemberType::VectorUnsigned, "Pads")
     .addMember(MemberType::Unsigned, "Group")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .setFlops("2 * getDest()->size() * "
+              "(getFilter()->size() / getDest()->dims().back())")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUWinogradConv")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Filter", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addMember(MemberType::VectorUnsigned, "Pads")
+    .addMember(MemberType::Unsigned, "TileSize")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUIm2colConv")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Filter", OperandKind::In)
+    .addMember(MemberType::VectorUnsigned, "Kernels")
+    .addMember(MemberType::VectorUnsigned, "Strides")
+    .addMember(MemberType::VectorUnsigned, "Pads")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .setFlops("2 * getDest()->size() * "
+              "(getFilter()->size() / getDest()->dims().back())")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUQuantizedIm2colConv")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Src", OperandKind::In)
+    .addOperand("Filter", OperandKind::In)
+    .addOperand("ColSums", OperandKind::In)
+    .addOperand("Bias", OperandKind::In)
+    .addMember(MemberType::VectorUnsigned, "Kernels")
+    .addMember(MemberType::VectorUnsigned, "Strides")
+    .addMember(MemberType::VectorUnsigned, "Pads")
+    .setFlops("2 * getDest()->size() * getFilter()->dims()[1] * 4")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUPackedMatMul")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("RHS", OperandKind::In)
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .setFlops("2 * getDest()->size() * getLHS()->dims()[1]")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUQuantizedPackedMatMul")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("RHS", OperandKind::In)
+    .addOperand("ColSums", OperandKind::In)
+    .setFlops("2 * getDest()->size() * getLHS()->dims()[1]")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUSparseMatMul")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("Values", OperandKind::In)
+    .addOperand("RowIndices", OperandKind::In)
+    .addOperand("ColOffsets", OperandKind::In)
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .setFlops("2 * getValues()->size() * getLHS()->dims()[0]")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUClusteredMatMul")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("Codebook", OperandKind::In)
+    .addOperand("Codes", OperandKind::In)
+    .addMember(MemberType::Unsigned, "CodeBits")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .setFlops("2 * getDest()->size() * getLHS()->dims()[1]")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUClusteredSparseLengthsWeightedSum")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("Codebook", OperandKind::In)
+    .addOperand("Codes", OperandKind::In)
+    .addOperand("Weights", OperandKind::In)
+    .addOperand("Indices", OperandKind::In)
+    .addOperand("Lengths", OperandKind::In)
+    .addMember(MemberType::Unsigned, "CodeBits")
+    .autoIRGen();
+
+BB.newBackendSpecificInstr("CPUTransposedLHSMatMul")
+    .addOperand("Dest", OperandKind::Out)
+    .addOperand("RHSColSums", OperandKind::Out)
+    .addOperand("LHS", OperandKind::In)
+    .addOperand("RHS", OperandKind::In)
+    .setFlops("2 * getDest()->size() * getLHS()->dims()[0]")
     .autoIRGen();
 
 BB.includeBackendSpecificVerification("glow/CPUSpecificInstrsVerification.h");
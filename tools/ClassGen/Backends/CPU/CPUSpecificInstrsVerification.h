@@ -33,4 +33,111 @@ void CPUConvDKKC8Inst::verify() const {
          "Invalid Element Type");
 }
 
+void CPUWinogradConvInst::verify() const {
+  assert(getDest()->getElementType() == getSrc()->getElementType() &&
+         "Invalid Element Type");
+  assert(getDest()->getElementType() == getFilter()->getElementType() &&
+         "Invalid Element Type");
+  assert(getDest()->getElementType() == getBias()->getElementType() &&
+         "Invalid Element Type");
+  assert(getFilter()->dims()[1] == getSrc()->dims()[3] &&
+         getFilter()->dims()[2] == getDest()->dims()[3] &&
+         "Invalid transformed filter dimensions");
+}
+
+void CPUIm2colConvInst::verify() const {
+  assert(getDest()->getElementType() == getSrc()->getElementType() &&
+         "Invalid Element Type");
+  assert(getDest()->getElementType() == getFilter()->getElementType() &&
+         "Invalid Element Type");
+  assert(getFilter()->dims().size() == 3 && "Invalid packed filter shape");
+}
+
+void CPUQuantizedIm2colConvInst::verify() const {
+  assert(getDest()->getElementType() == ElemKind::Int8QTy &&
+         getSrc()->getElementType() == ElemKind::Int8QTy &&
+         getFilter()->getElementType() == ElemKind::Int8QTy &&
+         getColSums()->getElementType() == ElemKind::Int32QTy &&
+         getBias()->getElementType() == ElemKind::Int32QTy &&
+         "Invalid Element Type");
+  assert(getFilter()->dims().size() == 3 && "Invalid packed filter shape");
+}
+
+void CPUPackedMatMulInst::verify() const {
+  assert(getDest()->getElementType() == getLHS()->getElementType() &&
+         "Invalid Element Type");
+  // The weights may be stored in half precision or bfloat16.
+  assert((getDest()->getElementType() == getRHS()->getElementType() ||
+          getRHS()->getElementType() == ElemKind::Float16Ty ||
+          getRHS()->getElementType() == ElemKind::BFloat16Ty) &&
+         "Invalid Element Type");
+  assert(getDest()->dims()[0] == getLHS()->dims()[0] &&
+         getLHS()->dims()[1] == getRHS()->dims()[1] && "Invalid shape");
+}
+
+void CPUQuantizedPackedMatMulInst::verify() const {
+  assert(getDest()->getElementType() == ElemKind::Int8QTy &&
+         getLHS()->getElementType() == ElemKind::Int8QTy &&
+         getRHS()->getElementType() == ElemKind::Int8QTy &&
+         getColSums()->getElementType() == ElemKind::Int32QTy &&
+         "Invalid Element Type");
+  assert(getDest()->dims()[0] == getLHS()->dims()[0] &&
+         (getLHS()->dims()[1] + 3) / 4 == getRHS()->dims()[1] &&
+         "Invalid shape");
+}
+
+void CPUSparseMatMulInst::verify() const {
+  assert(getDest()->getElementType() == ElemKind::FloatTy &&
+         getLHS()->getElementType() == ElemKind::FloatTy &&
+         getValues()->getElementType() == ElemKind::FloatTy &&
+         "Invalid Element Type");
+  assert(getRowIndices()->getElementType() == ElemKind::Int32QTy &&
+         getColOffsets()->getElementType() == ElemKind::Int32QTy &&
+         "Invalid index type");
+  assert(getDest()->dims()[0] == getLHS()->dims()[0] &&
+         getColOffsets()->dims()[0] == getDest()->dims()[1] + 1 &&
+         "Invalid shape");
+}
+
+void CPUClusteredMatMulInst::verify() const {
+  assert(getDest()->getElementType() == ElemKind::FloatTy &&
+         getLHS()->getElementType() == ElemKind::FloatTy &&
+         getCodebook()->getElementType() == ElemKind::FloatTy &&
+         getCodes()->getElementType() == ElemKind::Int8QTy &&
+         "Invalid Element Type");
+  assert((getCodeBits() == 4 || getCodeBits() == 8) && "Invalid code size");
+  assert(getDest()->dims()[0] == getLHS()->dims()[0] &&
+         getCodes()->dims()[0] == getDest()->dims()[1] &&
+         getCodes()->dims()[1] ==
+             (getLHS()->dims()[1] * getCodeBits() + 7) / 8 &&
+         "Invalid shape");
+}
+
+void CPUClusteredSparseLengthsWeightedSumInst::verify() const {
+  assert(getDest()->getElementType() == ElemKind::FloatTy &&
+         getCodebook()->getElementType() == ElemKind::FloatTy &&
+         getCodes()->getElementType() == ElemKind::Int8QTy &&
+         getWeights()->getElementType() == ElemKind::FloatTy &&
+         "Invalid Element Type");
+  assert((getCodeBits() == 4 || getCodeBits() == 8) && "Invalid code size");
+  assert(getDest()->dims()[0] == getLengths()->dims()[0] &&
+         getCodes()->dims()[1] ==
+             (getDest()->size() / getDest()->dims()[0] * getCodeBits() + 7) /
+                 8 &&
+         "Invalid shape");
+}
+
+void CPUTransposedLHSMatMulInst::verify() const {
+  assert(getDest()->getElementType() == ElemKind::FloatTy &&
+         getRHSColSums()->getElementType() == ElemKind::FloatTy &&
+         getLHS()->getElementType() == ElemKind::FloatTy &&
+         getRHS()->getElementType() == ElemKind::FloatTy &&
+         "Invalid Element Type");
+  assert(getDest()->dims()[0] == getLHS()->dims()[1] &&
+         getDest()->dims()[1] == getRHS()->dims()[1] &&
+         getLHS()->dims()[0] == getRHS()->dims()[0] &&
+         getRHSColSums()->dims()[0] == getRHS()->dims()[1] &&
+         "Invalid shape");
+}
+
 #endif // GLOW_WITH_CPU
@@ -29,9 +29,134 @@ BB.newNode("CPUConvDKKC8")
     .addMember(MemberType::VectorUnsigned, "Strides")
     .addMember(MemberType::VectorUnsigned, "Pads")
     .addMember(MemberType::Unsigned, "Group")
+    .addMember(MemberType::Unsigned, "FusedActivation")
     .addResultFromCtorArg()
     .setDocstring("This is a cpu-specific convolution implementation where the "
-                  "filter is transposed to the shape [D/8, K, K, C, 8]");
+                  "filter is transposed to the shape [D/8, K, K, C, 8]. "
+                  "FusedActivation is applied to the result");
+
+BB.newNode("CPUWinogradConv")
+    .addInput("Input")
+    .addInput("Filter")
+    .addInput("Bias")
+    .addMember(MemberType::VectorUnsigned, "Pads")
+    .addMember(MemberType::Unsigned, "TileSize")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .addResultFromCtorArg()
+    .setDocstring("This is a cpu-specific 3x3 stride-1 convolution that uses "
+                  "the Winograd algorithm F(TileSize x TileSize, 3x3). The "
+                  "filter is pre-transformed to the shape "
+                  "[(TileSize + 2)^2, C, D]. FusedActivation is applied to "
+                  "the result");
+
+BB.newNode("CPUIm2colConv")
+    .addInput("Input")
+    .addInput("Filter")
+    .addMember(MemberType::VectorUnsigned, "Kernels")
+    .addMember(MemberType::VectorUnsigned, "Strides")
+    .addMember(MemberType::VectorUnsigned, "Pads")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .addResultFromCtorArg()
+    .setDocstring("This is a cpu-specific convolution that copies the input "
+                  "patches into a matrix (im2col) and multiplies it with the "
+                  "filter. The filter and the bias are pre-packed into "
+                  "panels of 16 output channels, with the shape "
+                  "[ceil(D/16), K*K*C + 1, 16]. FusedActivation is applied "
+                  "to the result");
+
+BB.newNode("CPUQuantizedIm2colConv")
+    .addInput("Input")
+    .addInput("Filter")
+    .addInput("ColSums")
+    .addInput("Bias")
+    .addMember(MemberType::VectorUnsigned, "Kernels")
+    .addMember(MemberType::VectorUnsigned, "Strides")
+    .addMember(MemberType::VectorUnsigned, "Pads")
+    .addResultFromCtorArg()
+    .setDocstring("This is a cpu-specific quantized int8 convolution that "
+                  "copies the input patches into a matrix (im2col) and "
+                  "multiplies it with the filter like "
+                  "CPUQuantizedPackedMatMul. The filter is pre-packed into "
+                  "panels of 16 output channels of 4 consecutive values, with "
+                  "the shape [ceil(D/16), ceil(K*K*C/4), 64]. ColSums holds "
+                  "the sums of the filter of each output channel, and Bias "
+                  "the int32 bias in the scale of the products, both padded "
+                  "to the panels");
+
+BB.newBackendSpecificNode("CPUPackedMatMul")
+    .addInput("LHS")
+    .addInput("RHS")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .addResultFromCtorArg()
+    .setDocstring("A MatMul whose RHS is a constant weight matrix that is "
+                  "pre-packed into panels of 16 columns, with the shape "
+                  "[ceil(N/16), K, 16]. FusedActivation is applied to the "
+                  "result; CPU specific.");
+
+BB.newBackendSpecificNode("CPUQuantizedPackedMatMul")
+    .addInput("LHS")
+    .addInput("RHS")
+    .addInput("ColSums")
+    .addResultFromCtorArg()
+    .setDocstring("A quantized int8 MatMul whose RHS is a constant weight "
+                  "matrix that is pre-packed into panels of 16 columns of 4 "
+                  "consecutive values, with the shape [ceil(N/16), "
+                  "ceil(K/4), 64]. ColSums holds the sums of the columns of "
+                  "the weights; CPU specific.");
+
+BB.newBackendSpecificNode("CPUSparseMatMul")
+    .addInput("LHS")
+    .addInput("Values")
+    .addInput("RowIndices")
+    .addInput("ColOffsets")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .addResultFromCtorArg()
+    .setDocstring("A MatMul whose RHS is a mostly zero constant weight "
+                  "matrix that is stored by columns in the compressed sparse "
+                  "column format: the non-zero Values of column n and their "
+                  "RowIndices are the entries [ColOffsets[n], "
+                  "ColOffsets[n + 1]). FusedActivation is applied to the "
+                  "result; CPU specific.");
+
+BB.newBackendSpecificNode("CPUClusteredMatMul")
+    .addInput("LHS")
+    .addInput("Codebook")
+    .addInput("Codes")
+    .addMember(MemberType::Unsigned, "CodeBits")
+    .addMember(MemberType::Unsigned, "FusedActivation")
+    .addResultFromCtorArg()
+    .setDocstring("A MatMul whose RHS is a constant weight matrix that is "
+                  "clustered into the 2^CodeBits float centroids of "
+                  "Codebook. Codes has a row for each column of the "
+                  "weights, holding the index of the centroid of every "
+                  "weight of the column in CodeBits bits, two 4-bit indices "
+                  "per byte with the first one in the low bits. "
+                  "FusedActivation is applied to the result; CPU specific.");
+
+BB.newBackendSpecificNode("CPUClusteredSparseLengthsWeightedSum")
+    .addInput("Codebook")
+    .addInput("Codes")
+    .addInput("Weights")
+    .addInput("Indices")
+    .addInput("Lengths")
+    .addMember(MemberType::Unsigned, "CodeBits")
+    .addResultFromCtorArg()
+    .setDocstring("A SparseLengthsWeightedSum whose Data is a constant table "
+                  "that is clustered into the 2^CodeBits float centroids of "
+                  "Codebook. Codes has a row for each row of the table, with "
+                  "the layout of the codes of CPUClusteredMatMul; CPU "
+                  "specific.");
+
+BB.newBackendSpecificNode("CPUTransposedLHSMatMul")
+    .addInput("LHS")
+    .addInput("RHS")
+    .addResultFromCtorArg("Result")
+    .addResultFromCtorArg("RHSColSums")
+    .setDocstring("A MatMul of the transpose of LHS with RHS, which reads LHS "
+                  "in place instead of transposing it first. RHSColSums holds "
+                  "the sums of the columns of RHS, which is the bias gradient "
+                  "when this computes the weight gradient of a "
+                  "FullyConnected; CPU specific.");
 
 BB.includeBackendSpecificVerification("glow/CPUSpecificNodesVerification.h");
 
@@ -30,4 +30,187 @@ void CPUConvDKKC8Node::verify() const {
   assert(exp == odim && "Invalid output dimensions");
 }
 
+void CPUWinogradConvNode::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  ShapeNHWC odim(getResult().getType()->dims());
+  auto outSz = calculateConvPoolOutputDims(idim.h, idim.w, {3, 3}, {1, 1},
+                                           getPads());
+  ShapeNHWC exp(idim.n, outSz.first, outSz.second, getBias().dims()[0]);
+  (void)exp;
+  assert(exp == odim && "Invalid output dimensions");
+  size_t alpha = getTileSize() + 2;
+  (void)alpha;
+  assert((getTileSize() == 2 || getTileSize() == 4) && "Invalid tile size");
+  assert(getFilter().dims()[0] == alpha * alpha &&
+         getFilter().dims()[1] == idim.c && getFilter().dims()[2] == odim.c &&
+         "Invalid transformed filter dimensions");
+}
+
+void CPUIm2colConvNode::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  ShapeNHWC odim(getResult().getType()->dims());
+  ShapeHW kdim(getKernels());
+  auto outSz = calculateConvPoolOutputDims(idim.h, idim.w, getKernels(),
+                                           getStrides(), getPads());
+  ShapeNHWC exp(idim.n, outSz.first, outSz.second, odim.c);
+  (void)exp;
+  (void)kdim;
+  assert(exp == odim && "Invalid output dimensions");
+  assert(getFilter().dims()[1] == kdim.height * kdim.width * idim.c + 1 &&
+         getFilter().dims()[0] * getFilter().dims()[2] >= odim.c &&
+         "Invalid packed filter dimensions");
+}
+
+void CPUQuantizedIm2colConvNode::verify() const {
+  ShapeNHWC idim(getInput().getType()->dims());
+  ShapeNHWC odim(getResult().getType()->dims());
+  ShapeHW kdim(getKernels());
+  auto outSz = calculateConvPoolOutputDims(idim.h, idim.w, getKernels(),
+                                           getStrides(), getPads());
+  ShapeNHWC exp(idim.n, outSz.first, outSz.second, odim.c);
+  (void)exp;
+  (void)kdim;
+  assert(exp == odim && "Invalid output dimensions");
+  auto filter = getFilter().dims();
+  (void)filter;
+  assert(filter.size() == 3 &&
+         filter[1] == (kdim.height * kdim.width * idim.c + 3) / 4 &&
+         filter[2] == 64 && filter[0] * 16 >= odim.c &&
+         (filter[0] - 1) * 16 < odim.c && "Invalid packed filter dimensions");
+  assert(getColSums().dims().size() == 1 &&
+         getColSums().dims()[0] == filter[0] * 16 &&
+         getBias().dims() == getColSums().dims() &&
+         "Invalid column sums or bias");
+  assert(getInput().getElementType() == ElemKind::Int8QTy &&
+         getFilter().getElementType() == ElemKind::Int8QTy &&
+         getResult().getElementType() == ElemKind::Int8QTy &&
+         getColSums().getElementType() == ElemKind::Int32QTy &&
+         getBias().getElementType() == ElemKind::Int32QTy &&
+         "Invalid element type");
+}
+
+void CPUPackedMatMulNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto rhs = getRHS().dims();
+  auto dest = getResult().dims();
+  (void)lhs;
+  (void)rhs;
+  (void)dest;
+  assert(lhs.size() == 2 && rhs.size() == 3 && dest.size() == 2 &&
+         "Invalid MatMul shape");
+  assert(lhs[0] == dest[0] && lhs[1] == rhs[1] && "Invalid MatMul shape");
+  assert(rhs[0] * rhs[2] >= dest[1] && (rhs[0] - 1) * rhs[2] < dest[1] &&
+         "Invalid number of panels");
+}
+
+void CPUQuantizedPackedMatMulNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto rhs = getRHS().dims();
+  auto dest = getResult().dims();
+  (void)lhs;
+  (void)rhs;
+  (void)dest;
+  assert(lhs.size() == 2 && rhs.size() == 3 && dest.size() == 2 &&
+         "Invalid MatMul shape");
+  assert(lhs[0] == dest[0] && (lhs[1] + 3) / 4 == rhs[1] && rhs[2] == 64 &&
+         "Invalid MatMul shape");
+  assert(rhs[0] * 16 >= dest[1] && (rhs[0] - 1) * 16 < dest[1] &&
+         "Invalid number of panels");
+  assert(getColSums().dims().size() == 1 &&
+         getColSums().dims()[0] == rhs[0] * 16 && "Invalid column sums");
+  assert(getLHS().getElementType() == ElemKind::Int8QTy &&
+         getRHS().getElementType() == ElemKind::Int8QTy &&
+         getResult().getElementType() == ElemKind::Int8QTy &&
+         getColSums().getElementType() == ElemKind::Int32QTy &&
+         "Invalid element type");
+}
+
+void CPUSparseMatMulNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto dest = getResult().dims();
+  (void)lhs;
+  (void)dest;
+  assert(lhs.size() == 2 && dest.size() == 2 && lhs[0] == dest[0] &&
+         "Invalid MatMul shape");
+  assert(getValues().dims().size() == 1 &&
+         getValues().dims() == getRowIndices().dims() &&
+         "Invalid non-zero values");
+  assert(getColOffsets().dims().size() == 1 &&
+         getColOffsets().dims()[0] == dest[1] + 1 && "Invalid column offsets");
+  assert(getLHS().getElementType() == ElemKind::FloatTy &&
+         getValues().getElementType() == ElemKind::FloatTy &&
+         getResult().getElementType() == ElemKind::FloatTy &&
+         getRowIndices().getElementType() == ElemKind::Int32QTy &&
+         getColOffsets().getElementType() == ElemKind::Int32QTy &&
+         "Invalid element type");
+}
+
+/// Check that \p codebook and \p codes hold the clustered weights of
+/// \p rows rows of \p lineSize elements, with indices of \p codeBits bits.
+static void verifyClusteredWeights(NodeValue codebook, NodeValue codes,
+                                   unsigned codeBits, size_t rows,
+                                   size_t lineSize) {
+  (void)codebook;
+  (void)codes;
+  (void)rows;
+  (void)lineSize;
+  assert((codeBits == 4 || codeBits == 8) && "Invalid code size");
+  assert(codebook.dims().size() == 1 &&
+         codebook.dims()[0] == (size_t(1) << codeBits) && "Invalid codebook");
+  assert(codes.dims().size() == 2 && codes.dims()[0] == rows &&
+         codes.dims()[1] == (lineSize * codeBits + 7) / 8 && "Invalid codes");
+  assert(codebook.getElementType() == ElemKind::FloatTy &&
+         codes.getElementType() == ElemKind::Int8QTy &&
+         "Invalid element type");
+}
+
+void CPUClusteredMatMulNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto dest = getResult().dims();
+  assert(lhs.size() == 2 && dest.size() == 2 && lhs[0] == dest[0] &&
+         "Invalid MatMul shape");
+  assert(getLHS().getElementType() == ElemKind::FloatTy &&
+         getResult().getElementType() == ElemKind::FloatTy &&
+         "Invalid element type");
+  verifyClusteredWeights(getCodebook(), getCodes(), getCodeBits(), dest[1],
+                         lhs[1]);
+}
+
+void CPUClusteredSparseLengthsWeightedSumNode::verify() const {
+  auto dest = getResult().dims();
+  assert(getResult().getElementType() == ElemKind::FloatTy &&
+         getWeights().getElementType() == ElemKind::FloatTy &&
+         "Invalid element type");
+  assert(getIndices().getElementType() == ElemKind::Int64ITy &&
+         getLengths().getElementType() == ElemKind::Int64ITy &&
+         "Invalid index type");
+  assert(getIndices().dims().size() == 1 &&
+         getLengths().dims().size() == 1 &&
+         getWeights().dims() == getIndices().dims() &&
+         dest[0] == getLengths().dims()[0] && "Invalid shape");
+  verifyClusteredWeights(getCodebook(), getCodes(), getCodeBits(),
+                         getCodes().dims()[0],
+                         getResult().getType()->size() / dest[0]);
+}
+
+void CPUTransposedLHSMatMulNode::verify() const {
+  auto lhs = getLHS().dims();
+  auto rhs = getRHS().dims();
+  auto dest = getResult().dims();
+  (void)lhs;
+  (void)rhs;
+  (void)dest;
+  assert(lhs.size() == 2 && rhs.size() == 2 && dest.size() == 2 &&
+         "Invalid MatMul shape");
+  assert(lhs[0] == rhs[0] && lhs[1] == dest[0] && rhs[1] == dest[1] &&
+         "Invalid MatMul shape");
+  assert(getRHSColSums().dims().size() == 1 &&
+         getRHSColSums().dims()[0] == rhs[1] && "Invalid column sums");
+  assert(getLHS().getElementType() == ElemKind::FloatTy &&
+         getRHS().getElementType() == ElemKind::FloatTy &&
+         getResult().getElementType() == ElemKind::FloatTy &&
+         getRHSColSums().getElementType() == ElemKind::FloatTy &&
+         "Invalid element type");
+}
+
 #endif // GLOW_WITH_CPU
@@ -120,9 +120,23 @@ void InstrBuilder::emitDataParallelProperty(std::ostream &os) const {
   os << "    return " << (isDataParallel_ ? "true" : "false") << ";\n  }\n";
 }
 
+void InstrBuilder::emitFlopsProperty(std::ostream &os) const {
+  os << "\n  uint64_t getFlops() const {\n";
+  os << "    return ";
+  if (!flops_.empty()) {
+    os << flops_;
+  } else if (!operands_.empty()) {
+    os << "getOperand(0).first->size()";
+  } else {
+    os << "0";
+  }
+  os << ";\n  }\n";
+}
+
 void InstrBuilder::emitProperties(std::ostream &os) const {
   emitInplaceMethod(os);
   emitDataParallelProperty(os);
+  emitFlopsProperty(os);
 }
 
 void InstrBuilder::emitClassMembers(std::ostream &os) const {
@@ -329,8 +343,9 @@ void InstrBuilder::emitAutoIRGen(std::ostream &os) const {
 
   // Note: The convention is for Nodes to have 'Input's and 'Output's, and for
   // Instrs to have 'Src's and 'Dest's. Thus we map between the two below.
-  std::string destOpName = "";
-  std::string resNodeName = "";
+  // Every Out operand is allocated for the result of the node with the same
+  // name, and the first one is the destination of the node.
+  std::vector<std::pair<std::string, std::string>> dests;
   for (const auto &opPair : operands_) {
     if (opPair.second == OperandKind::In) {
       const std::string opNodeName =
@@ -338,23 +353,27 @@ void InstrBuilder::emitAutoIRGen(std::ostream &os) const {
       os << "  auto *" << opPair.first << " = valueForNode(CN__->get"
          << opNodeName << "());\n";
     } else if (opPair.second == OperandKind::Out) {
-      assert(resNodeName.empty() && destOpName.empty() &&
-             "Must have multiple results; don't support autogen yet.");
-      resNodeName = (opPair.first == "Dest") ? "Result" : opPair.first;
-      destOpName = opPair.first;
+      dests.push_back({opPair.first,
+                       (opPair.first == "Dest") ? "Result" : opPair.first});
     }
   }
 
-  assert(!resNodeName.empty() && !destOpName.empty() &&
+  assert(!dests.empty() &&
          "Didn't find a result; Maybe using InOut which isn't yet supported");
   os << "  std::string allocName = std::string(N->getName()) + \".res\";\n";
-  os << "  auto *dest__ = builder_.createAllocActivationInst(allocName,"
-     << "CN__->get" << resNodeName << "().getType());\n";
+  for (size_t i = 0, e = dests.size(); i < e; i++) {
+    os << "  auto *" << (i ? dests[i].first + "__" : "dest__")
+       << " = builder_.createAllocActivationInst(allocName,"
+       << "CN__->get" << dests[i].second << "().getType());\n";
+  }
   os << "  auto *V = builder_.create" << name_ << "Inst(\"" << autoIRGenNodeName
-     << "\", dest__";
+     << "\"";
   for (const auto &opPair : operands_) {
     if (opPair.second == OperandKind::In) {
       os << ", " << opPair.first;
+    } else if (opPair.second == OperandKind::Out) {
+      os << ", " << (opPair.first == dests[0].first ? "dest__"
+                                                     : opPair.first + "__");
     }
   }
   for (const auto &memPair : members_) {
@@ -365,7 +384,11 @@ void InstrBuilder::emitAutoIRGen(std::ostream &os) const {
   os << "  V->setName(N->getName());\n";
   os << "  if (N->hasPredicate()) { "
         "V->setPredicate(valueForNode(N->getPredicate())); }\n";
-  os << "  registerIR(N, V->get" << destOpName << "());\n";
+  os << "  registerIR(N, V->get" << dests[0].first << "());\n";
+  for (size_t i = 1, e = dests.size(); i < e; i++) {
+    os << "  registerIR(CN__->get" << dests[i].second << "(), V->get"
+       << dests[i].first << "());\n";
+  }
   os << "  nodeToInstr_[N] = V;\n";
   os << "  break;\n";
   os << "}\n";
@@ -101,6 +101,11 @@ class InstrBuilder {
 
   bool isDataParallel_{false};
 
+  /// The c++ expression that computes the number of arithmetic operations
+  /// performed by the instruction. If empty, an operation per element of the
+  /// first operand is assumed.
+  std::string flops_;
+
   /// \returns the index of the operand with the name \p name. Aborts if no such
   /// name.
   unsigned getOperandIndexByName(llvm::StringRef name) const;
@@ -196,6 +201,14 @@ public:
     return *this;
   }
 
+  /// Set the c++ expression that computes the number of arithmetic
+  /// operations performed by the instruction. For example:
+  /// "2 * getDest()->size() * getLHS()->dims()[1]".
+  InstrBuilder &setFlops(const std::string &flops) {
+    flops_ = flops;
+    return *this;
+  }
+
   ~InstrBuilder();
 
 private:
@@ -214,6 +227,10 @@ private:
   /// Emits the property that returns true if the instruction is data parallel.
   void emitDataParallelProperty(std::ostream &os) const;
 
+  /// Emits the method that returns the number of arithmetic operations
+  /// performed by the instruction.
+  void emitFlopsProperty(std::ostream &os) const;
+
   /// Emits the methods that are properties of the instructions.
   void emitProperties(std::ostream &os) const;
 
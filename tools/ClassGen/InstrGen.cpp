@@ -85,11 +85,29 @@ int main(int argc, char **argv) {
       .addMember(MemberType::VectorUnsigned, "Strides")
       .addMember(MemberType::VectorUnsigned, "Pads")
       .addMember(MemberType::Unsigned, "Group")
+      .setFlops("2 * getDest()->size() * "
+                "(getFilter()->size() / getDest()->dims().back())")
       .autoIRGen()
       .autoVerify(VerifyKind::SameElementType,
                   {"Dest", "Src", "Filter", "Bias"})
       .addGradientInstr({"Src", "Filter"}, {"Dest", "Src", "Filter", "Bias"});
 
+  BB.newInstr("ChannelwiseQuantizedConvolution")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Filter", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .addOperand("Scales", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addMember(MemberType::VectorUnsigned, "Kernels")
+      .addMember(MemberType::VectorUnsigned, "Strides")
+      .addMember(MemberType::VectorUnsigned, "Pads")
+      .addMember(MemberType::Unsigned, "Group")
+      .setFlops("2 * getDest()->size() * "
+                "(getFilter()->size() / getDest()->dims().back())")
+      .autoIRGen()
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Filter"});
+
   // MaxPool version caching XY coordinates to speedup gradient-based
   // computations.
   BB.newInstr("MaxPoolWithXY")
@@ -99,6 +117,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::VectorUnsigned, "Kernels")
       .addMember(MemberType::VectorUnsigned, "Strides")
       .addMember(MemberType::VectorUnsigned, "Pads")
+      .setFlops("getDest()->size() * getKernels()[0] * getKernels()[1]")
       .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"})
       .addGradientInstr({"Dest", "SrcXY"}, {"Dest", "Src"});
 
@@ -108,6 +127,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::VectorUnsigned, "Kernels")
       .addMember(MemberType::VectorUnsigned, "Strides")
       .addMember(MemberType::VectorUnsigned, "Pads")
+      .setFlops("getDest()->size() * getKernels()[0] * getKernels()[1]")
       .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"});
 
   BB.newInstr("AvgPool")
@@ -116,6 +136,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::VectorUnsigned, "Kernels")
       .addMember(MemberType::VectorUnsigned, "Strides")
       .addMember(MemberType::VectorUnsigned, "Pads")
+      .setFlops("getDest()->size() * getKernels()[0] * getKernels()[1]")
       .autoIRGen()
       .autoVerify(VerifyKind::SameElementType, {"Dest", "Src"})
       .addGradientInstr({"Dest"}, {"Dest", "Src"});
@@ -132,6 +153,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Float, "Alpha")
       .addMember(MemberType::Float, "Beta")
       .addMember(MemberType::Float, "K")
+      .setFlops("2 * getDest()->size() * (2 * getHalfWindowSize() + 1)")
       .setType("Src->getType()")
       .inplaceOperand({
           "Dest",
@@ -140,6 +162,39 @@ int main(int argc, char **argv) {
       .autoVerify(VerifyKind::SameType, {"Dest", "Src", "Scale"})
       .addGradientInstr({"Dest", "Src", "Scale"}, {"Dest", "Src"});
 
+  /// Normalizes Src with the Mean and the Var of its channels, and applies
+  /// the Scale and the Bias, in one pass. The gradient computes the gradients
+  /// of Src, Scale and Bias with one reduction pass and one elementwise pass
+  /// per channel.
+  BB.newInstr("BatchNormalization")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Scale", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .addOperand("Mean", OperandKind::In)
+      .addOperand("Var", OperandKind::In)
+      .addMember(MemberType::Unsigned, "ChannelIdx")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Float, "Momentum")
+      .inplaceOperand({"Dest", "Src"})
+      .autoVerify(VerifyKind::SameType, {"Dest", "Src"})
+      .autoVerify(VerifyKind::SameType, {"Scale", "Bias", "Mean", "Var"})
+      .autoIRGen()
+      .addGradientInstr({"Src", "Scale", "Mean", "Var"},
+                        {"Dest", "Src", "Scale", "Bias"});
+
+  /// Computes the mean and the variance of every channel of Src in two
+  /// passes, and blends them with Mean and Var with the Momentum.
+  BB.newInstr("MeanVarNormalization")
+      .addOperand("NewMean", OperandKind::Out)
+      .addOperand("NewVar", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Mean", OperandKind::In)
+      .addOperand("Var", OperandKind::In)
+      .addMember(MemberType::Unsigned, "ChannelIdx")
+      .addMember(MemberType::Float, "Momentum")
+      .autoVerify(VerifyKind::SameType, {"NewMean", "NewVar", "Mean", "Var"});
+
   //===--------------------------------------------------------------------===//
   //                      Loss functions
   //===--------------------------------------------------------------------===//
@@ -171,6 +226,34 @@ int main(int argc, char **argv) {
       .addOperand("Labelsgrad", OperandKind::Out)
       .autoVerify(VerifyKind::NoVerify);
 
+  BB.newInstr("SoftMaxCrossEntropyLoss")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Logits", OperandKind::In)
+      .addOperand("Labels", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Logits"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Labels", "ElemKind::Int64ITy"})
+      .autoIRGen();
+
+  BB.newInstr("SoftMaxCrossEntropyLossGrad")
+      .addOperand("Logits", OperandKind::In)
+      .addOperand("Labels", OperandKind::In)
+      .addOperand("LogitsGrad", OperandKind::Out)
+      .autoVerify(VerifyKind::SameType, {"Logits", "LogitsGrad"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Labels", "ElemKind::Int64ITy"});
+
+  /// The mean over the last dimension of the sigmoid cross entropy of the
+  /// Logits with the Targets, in a single pass instead of the lowered
+  /// elementwise operations.
+  BB.newInstr("SigmoidCrossEntropyWithLogits")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Logits", OperandKind::In)
+      .addOperand("Targets", OperandKind::In)
+      .autoVerify(VerifyKind::SameType, {"Logits", "Targets"})
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Logits"})
+      .autoIRGen();
+
   //===--------------------------------------------------------------------===//
   //                      Arithmetic
   //===--------------------------------------------------------------------===//
@@ -181,6 +264,57 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("LHS", OperandKind::In)
       .addOperand("RHS", OperandKind::In)
+      .addMember(MemberType::Boolean, "TransposeRHS")
+      .setFlops("2 * getDest()->size() * getLHS()->dims()[1]")
+      .autoIRGen()
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "LHS", "RHS"});
+
+  /// Perform a fully connected layer with float Src and Bias and int8 Weights
+  /// whose rows are quantized separately. The weights are dequantized in
+  /// registers.
+  BB.newInstr("RowwiseQuantizedFullyConnected")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Scales", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .setFlops("2 * getDest()->size() * getWeights()->dims()[1]")
+      .autoIRGen()
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Bias"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Weights", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Offsets", "ElemKind::Int32QTy"});
+
+  /// Same as RowwiseQuantizedFullyConnected, but every row of Src is
+  /// quantized to int8 at runtime. The quantized rows and their parameters
+  /// are stored in Scratch, so that the int8 products can be computed in
+  /// parallel afterwards.
+  BB.newInstr("DynamicQuantizedFullyConnected")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Scales", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addOperand("Bias", OperandKind::In)
+      .addOperand("Scratch", OperandKind::InOut)
+      .setFlops("2 * getDest()->size() * getWeights()->dims()[1]")
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Src", "Bias"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Weights", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Offsets", "ElemKind::Int32QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Scratch", "ElemKind::Int8QTy"});
+
+  /// Perform a matrix multiplication for every batch entry of the 3d tensors
+  /// LHS and RHS, whose leading dimension is the batch size.
+  BB.newInstr("BatchedMatMul")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("LHS", OperandKind::In)
+      .addOperand("RHS", OperandKind::In)
+      .setFlops("2 * getDest()->size() * getLHS()->dims()[2]")
       .autoIRGen()
       .autoVerify(VerifyKind::SameElementType, {"Dest", "LHS", "RHS"});
 
@@ -191,6 +325,7 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Batch", OperandKind::In)
       .addMember(MemberType::Unsigned, "Axis")
+      .setFlops("getBatch()->size()")
       .autoVerify(VerifyKind::SameElementType, {"Dest", "Batch"})
       .autoIRGen();
 
@@ -200,14 +335,38 @@ int main(int argc, char **argv) {
       .addOperand("Weights", OperandKind::In)
       .addOperand("Indices", OperandKind::In)
       .addOperand("Lengths", OperandKind::In)
+      .setFlops("2 * getIndices()->size() * "
+                "(getData()->size() / getData()->dims()[0])")
       .autoIRGen()
-      .autoVerify(VerifyKind::SameElementType, {"Dest", "Data", "Weights"})
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Weights"})
       .autoVerify(VerifyKind::SameElementType,
                   {"Indices", "ElemKind::Int64ITy"})
       .autoVerify(VerifyKind::SameElementType,
                   {"Lengths", "ElemKind::Int64ITy"})
       .autoVerify(VerifyKind::SameShape, {"Weights", "Indices"});
 
+  BB.newInstr("RowwiseQuantizedSparseLengthsWeightedSum")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Data", OperandKind::In)
+      .addOperand("Scales", OperandKind::In)
+      .addOperand("Offsets", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .setFlops("2 * getIndices()->size() * "
+                "(getData()->size() / getData()->dims()[0])")
+      .autoIRGen()
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "Weights"})
+      .autoVerify(VerifyKind::SameElementType, {"Data", "ElemKind::Int8QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Offsets", "ElemKind::Int32QTy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "ElemKind::Int64ITy"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Lengths", "ElemKind::Int64ITy"})
+      .autoVerify(VerifyKind::SameShape, {"Weights", "Indices"})
+      .autoVerify(VerifyKind::SameShape, {"Scales", "Offsets"});
+
   /// Adds the 'Slice' operand to each one of the slices in the batch.
   BB.newInstr("BatchedAdd")
       .addOperand("Dest", OperandKind::Out)
@@ -393,6 +552,143 @@ int main(int argc, char **argv) {
       .autoVerify(VerifyKind::SameElementType,
                   {"Indices", "ElemKind::Int64ITy"});
 
+  BB.newInstr("ConvertTo")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("Src", OperandKind::In)
+      .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
+      .autoIRGen();
+
+  //===--------------------------------------------------------------------===//
+  //                Instructions used for training
+  //===--------------------------------------------------------------------===//
+
+  /// Computes the SGD update of Weight with Gradient in a single pass, for the
+  /// backends that do not lower SGD nodes.
+  BB.newInstr("SGD")
+      .addOperand("UpdatedWeight", OperandKind::Out)
+      .addOperand("Weight", OperandKind::In)
+      .addOperand("Gradient", OperandKind::In)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .inplaceOperand({"UpdatedWeight", "Weight"})
+      .autoVerify(VerifyKind::SameType,
+                  {"UpdatedWeight", "Weight", "Gradient"})
+      .autoIRGen();
+
+  /// Same as SGD, but also updates the accumulated update Gsum with the
+  /// momentum.
+  BB.newInstr("MomentumSGD")
+      .addOperand("UpdatedWeight", OperandKind::Out)
+      .addOperand("Weight", OperandKind::In)
+      .addOperand("Gradient", OperandKind::In)
+      .addOperand("Gsum", OperandKind::InOut)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Momentum")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .inplaceOperand({"UpdatedWeight", "Weight"})
+      .autoVerify(VerifyKind::SameType,
+                  {"UpdatedWeight", "Weight", "Gradient", "Gsum"});
+
+  /// Computes the Adagrad update of Weight in a single pass, and adds the
+  /// squares of the gradients to SumSq.
+  BB.newInstr("Adagrad")
+      .addOperand("UpdatedWeight", OperandKind::Out)
+      .addOperand("Weight", OperandKind::In)
+      .addOperand("Gradient", OperandKind::In)
+      .addOperand("SumSq", OperandKind::InOut)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .inplaceOperand({"UpdatedWeight", "Weight"})
+      .autoVerify(VerifyKind::SameType,
+                  {"UpdatedWeight", "Weight", "Gradient", "SumSq"});
+
+  /// Computes the RMSProp update of Weight in a single pass, and updates the
+  /// moving average of the squared gradients MeanSq.
+  BB.newInstr("RMSProp")
+      .addOperand("UpdatedWeight", OperandKind::Out)
+      .addOperand("Weight", OperandKind::In)
+      .addOperand("Gradient", OperandKind::In)
+      .addOperand("MeanSq", OperandKind::InOut)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Decay")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .inplaceOperand({"UpdatedWeight", "Weight"})
+      .autoVerify(VerifyKind::SameType,
+                  {"UpdatedWeight", "Weight", "Gradient", "MeanSq"});
+
+  /// Computes the Adam update of Weight in a single pass, updates the moment
+  /// estimates and increments the number of updates in Step.
+  BB.newInstr("Adam")
+      .addOperand("UpdatedWeight", OperandKind::Out)
+      .addOperand("Weight", OperandKind::In)
+      .addOperand("Gradient", OperandKind::In)
+      .addOperand("FirstMoment", OperandKind::InOut)
+      .addOperand("SecondMoment", OperandKind::InOut)
+      .addOperand("Step", OperandKind::InOut)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Beta1")
+      .addMember(MemberType::Float, "Beta2")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .inplaceOperand({"UpdatedWeight", "Weight"})
+      .autoVerify(VerifyKind::SameType, {"UpdatedWeight", "Weight", "Gradient",
+                                         "FirstMoment", "SecondMoment"});
+
+  /// Computes the gradients of the rows of the Data of a
+  /// SparseLengthsWeightedSum, one row per index.
+  BB.newInstr("SparseLengthsWeightedSumRowGrad")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("OutputGrad", OperandKind::In)
+      .addOperand("Weights", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType, {"Dest", "OutputGrad"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Lengths", "ElemKind::Int64ITy"})
+      .autoIRGen();
+
+  /// Updates the rows Indices of Weight in place with the SGD steps of the
+  /// rows of Gradient.
+  BB.newInstr("SparseSGD")
+      .addOperand("Weight", OperandKind::InOut)
+      .addOperand("Gradient", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .autoVerify(VerifyKind::SameElementType, {"Weight", "Gradient"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "ElemKind::Int64ITy"});
+
+  /// Same as SparseSGD, but with the Adagrad steps, which add the squares of
+  /// the gradients to the rows of SumSq.
+  BB.newInstr("SparseAdagrad")
+      .addOperand("Weight", OperandKind::InOut)
+      .addOperand("Gradient", OperandKind::In)
+      .addOperand("Indices", OperandKind::In)
+      .addOperand("SumSq", OperandKind::InOut)
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .autoVerify(VerifyKind::SameType, {"Weight", "SumSq"})
+      .autoVerify(VerifyKind::SameElementType, {"Weight", "Gradient"})
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Indices", "ElemKind::Int64ITy"});
+
   //===--------------------------------------------------------------------===//
   //             Instructions used for debugging/profiling/printing
   //===--------------------------------------------------------------------===//
@@ -416,15 +712,17 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
       .addOperand("Mapping", OperandKind::In)
+      .inplaceOperand({"Dest", "Src"})
       .autoVerify(VerifyKind::SameElementType,
                   {"Dest", "Src", "ElemKind::Int8QTy"})
       .dataParallel()
       .autoIRGen();
 
+  // The quantized operands of Quantize, Dequantize and RescaleQuantized may be
+  // either Int8QTy or Int16QTy. The graph nodes verify this.
   BB.newInstr("Quantize")
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
-      .autoVerify(VerifyKind::SameElementType, {"Dest", "ElemKind::Int8QTy"})
       .autoVerify(VerifyKind::SameElementType, {"Src", "ElemKind::FloatTy"})
       .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
       .autoIRGen();
@@ -433,15 +731,13 @@ int main(int argc, char **argv) {
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
       .autoVerify(VerifyKind::SameElementType, {"Dest", "ElemKind::FloatTy"})
-      .autoVerify(VerifyKind::SameElementType, {"Src", "ElemKind::Int8QTy"})
       .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
       .autoIRGen();
 
   BB.newInstr("RescaleQuantized")
       .addOperand("Dest", OperandKind::Out)
       .addOperand("Src", OperandKind::In)
-      .autoVerify(VerifyKind::SameElementType,
-                  {"Dest", "Src", "ElemKind::Int8QTy"})
+      .inplaceOperand({"Dest", "Src"})
       .autoVerify(VerifyKind::SameShape, {"Dest", "Src"})
       .autoIRGen();
 
@@ -458,6 +754,75 @@ int main(int argc, char **argv) {
       .autoVerify(VerifyKind::SameElementType, {"Values", "Input"})
       .autoVerify(VerifyKind::SameShape, {"Values", "Indices"});
 
+  /// Computes the new hidden and cell states of an LSTM from the gate
+  /// pre-activations contributed by the input and by the hidden state, and
+  /// from the cell state C.
+  BB.newInstr("LSTMUnit")
+      .addOperand("NewH", OperandKind::Out)
+      .addOperand("NewC", OperandKind::Out)
+      .addOperand("InputGates", OperandKind::In)
+      .addOperand("HiddenGates", OperandKind::In)
+      .addOperand("C", OperandKind::In)
+      .autoVerify(VerifyKind::SameElementType,
+                  {"NewH", "NewC", "InputGates", "HiddenGates", "C"})
+      .autoVerify(VerifyKind::SameShape, {"NewH", "NewC", "C"})
+      .autoVerify(VerifyKind::SameShape, {"InputGates", "HiddenGates"});
+
+  /// Computes the new hidden state of a GRU from the gate contributions of
+  /// the input and of the hidden state H.
+  BB.newInstr("GRUUnit")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("InputGates", OperandKind::In)
+      .addOperand("HiddenGates", OperandKind::In)
+      .addOperand("H", OperandKind::In)
+      .autoIRGen()
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "InputGates", "HiddenGates", "H"})
+      .autoVerify(VerifyKind::SameShape, {"Dest", "H"})
+      .autoVerify(VerifyKind::SameShape, {"InputGates", "HiddenGates"});
+
+  /// Run a recurrent layer over the time steps of a sequence. The gates of the
+  /// hidden state are computed into Scratch, which for the LSTM also holds the
+  /// cell state after the gates. The steps stop at the largest of Lengths, and
+  /// the batch entries past their length repeat their last hidden state.
+  BB.newInstr("RNNSequence")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("InputGates", OperandKind::In)
+      .addOperand("InitH", OperandKind::In)
+      .addOperand("HiddenWeights", OperandKind::In)
+      .addOperand("HiddenBias", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .addOperand("Scratch", OperandKind::InOut)
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "InputGates", "InitH", "HiddenWeights",
+                   "HiddenBias", "Scratch"});
+
+  BB.newInstr("LSTMSequence")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("InputGates", OperandKind::In)
+      .addOperand("InitH", OperandKind::In)
+      .addOperand("InitC", OperandKind::In)
+      .addOperand("HiddenWeights", OperandKind::In)
+      .addOperand("HiddenBias", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .addOperand("Scratch", OperandKind::InOut)
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "InputGates", "InitH", "InitC", "HiddenWeights",
+                   "HiddenBias", "Scratch"})
+      .autoVerify(VerifyKind::SameShape, {"InitH", "InitC"});
+
+  BB.newInstr("GRUSequence")
+      .addOperand("Dest", OperandKind::Out)
+      .addOperand("InputGates", OperandKind::In)
+      .addOperand("InitH", OperandKind::In)
+      .addOperand("HiddenWeights", OperandKind::In)
+      .addOperand("HiddenBias", OperandKind::In)
+      .addOperand("Lengths", OperandKind::In)
+      .addOperand("Scratch", OperandKind::InOut)
+      .autoVerify(VerifyKind::SameElementType,
+                  {"Dest", "InputGates", "InitH", "HiddenWeights",
+                   "HiddenBias", "Scratch"});
+
   //===--------------------------------------------------------------------===//
   //                Backend-Specific Instructions
   //===--------------------------------------------------------------------===//
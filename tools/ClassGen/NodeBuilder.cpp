@@ -232,6 +232,20 @@ void NodeBuilder::emitEdges(std::ostream &os) const {
   os << "  llvm_unreachable(\"Invalid index\");\n}\n";
 }
 
+void NodeBuilder::emitFlops(std::ostream &os) const {
+  os << "  uint64_t getFlops() const { return ";
+  if (!flops_.empty()) {
+    os << flops_;
+  } else if (nodeOutputs_.empty()) {
+    os << "0";
+  } else {
+    for (unsigned i = 0, e = nodeOutputs_.size(); i < e; i++) {
+      os << (i ? " + " : "") << "getType(" << i << ")->size()";
+    }
+  }
+  os << "; }\n";
+}
+
 void NodeBuilder::emitPrettyPrinter(std::ostream &os) const {
   os << "\nstd::string " << name_ << "Node::getDebugDesc() const {\n"
      << "  DescriptionBuilder db(getKindName());\n"
@@ -394,6 +408,55 @@ void NodeBuilder::emitVisitor(std::ostream &os) const {
   os << "  visitor->post(parent, this);\n}\n";
 }
 
+void NodeBuilder::emitSerializer(std::ostream &os) const {
+  os << "\nvoid " << name_ << "Node::serialize(ModuleWriter &W) const {\n";
+  for (const auto &paramName : ctorTypeParams_) {
+    os << "  W.write(get" << paramName << "().getType());\n";
+  }
+  if (!enum_.empty()) {
+    os << "  W.write(unsigned_t(getMode()));\n";
+  }
+  for (const auto &op : nodeInputs_) {
+    os << "  W.write(get" << op << "());\n";
+  }
+  for (const auto &op : members_) {
+    os << "  W.write(get" << op.second << "());\n";
+  }
+  os << "}\n";
+
+  // The fields are read into locals first, in the order in which they were
+  // written, and then passed to the constructor.
+  os << "\nNode *" << name_
+     << "Node::deserialize(llvm::StringRef name, ModuleReader &R) {\n";
+  for (const auto &paramName : ctorTypeParams_) {
+    os << "  TypeRef " << paramName << ";\n  R.read(" << paramName << ");\n";
+  }
+  if (!enum_.empty()) {
+    os << "  unsigned_t mode;\n  R.read(mode);\n";
+  }
+  for (const auto &op : nodeInputs_) {
+    os << "  NodeValue " << op << ";\n  R.read(" << op << ");\n";
+  }
+  for (const auto &op : members_) {
+    os << "  " << getCtorArgTypename(op.first) << " " << op.second
+       << ";\n  R.read(" << op.second << ");\n";
+  }
+  os << "  return new " << name_ << "Node(name";
+  for (const auto &paramName : ctorTypeParams_) {
+    os << ", " << paramName;
+  }
+  if (!enum_.empty()) {
+    os << ", Mode(mode)";
+  }
+  for (const auto &op : nodeInputs_) {
+    os << ", " << op;
+  }
+  for (const auto &op : members_) {
+    os << ", " << op.second;
+  }
+  os << ");\n}\n";
+}
+
 void NodeBuilder::emitDocstring(std::ostream &os) const {
   std::istringstream stream(docstring_);
   std::string line;
@@ -427,8 +490,12 @@ void NodeBuilder::emitNodeClass(std::ostream &os) const {
      << "  llvm::hash_code getHash() const;\n"
      << "  void visit(Node *parent, NodeWalker *visitor);\n"
      << "  Node* clone() const;\n"
+     << "  void serialize(ModuleWriter &W) const;\n"
+     << "  static Node *deserialize(llvm::StringRef name, ModuleReader &R);\n"
      << "  void verify() const;\n";
 
+  emitFlops(os);
+
   if (!enum_.empty()) {
     os << "  const char *getModeStr() const { return getModeStr(mode_); }\n"
        << "  static const char *getModeStr(Mode m);\n";
@@ -448,6 +515,7 @@ void NodeBuilder::emitCppMethods(std::ostream &os) const {
   emitEquator(os);
   emitCloner(os);
   emitHasher(os);
+  emitSerializer(os);
   if (!enum_.empty()) {
     emitEnumModePrinters(os);
   }
@@ -65,6 +65,10 @@ class NodeBuilder {
   bool hasSideEffects_{false};
   /// Specifies if this Node is backend specific.
   bool isBackendSpecific_{false};
+  /// The c++ expression that computes the number of arithmetic operations
+  /// performed by the node. If empty, an operation per element of the results
+  /// is assumed.
+  std::string flops_;
 
 public:
   NodeBuilder(std::ofstream &H, std::ofstream &C, std::ofstream &D,
@@ -130,6 +134,14 @@ public:
     return *this;
   }
 
+  /// Set the c++ expression that computes the number of arithmetic
+  /// operations performed by the node. For example:
+  /// "2 * getResult().getType()->size() * getLHS().dims()[1]".
+  NodeBuilder &setFlops(const std::string &flops) {
+    flops_ = flops;
+    return *this;
+  }
+
   NodeBuilder &addOverwrittenInput(const std::string &name) {
     // Find the index of the overwritten input.
     for (unsigned idx = 0, e = nodeInputs_.size(); idx < e; ++idx) {
@@ -171,6 +183,10 @@ private:
   /// Emit getters for input/output names and input nodes.
   void emitEdges(std::ostream &os) const;
 
+  /// Emit the getFlops method that returns the number of arithmetic
+  /// operations performed by the node.
+  void emitFlops(std::ostream &os) const;
+
   /// Emit the methods that print a textual summary of the node.
   void emitPrettyPrinter(std::ostream &os) const;
 
@@ -186,6 +202,10 @@ private:
   /// Emit the 'visit' method that implements node visitors.
   void emitVisitor(std::ostream &os) const;
 
+  /// Emit the methods that write the node to a serialized module and read it
+  /// back.
+  void emitSerializer(std::ostream &os) const;
+
   /// Emit the class-level documentation string, if any.
   void emitDocstring(std::ostream &os) const;
 
@@ -209,6 +229,7 @@ public:
       : hStream(H), cStream(C), dStream(D) {
     cStream << "#include \"glow/Graph/Nodes.h\"\n"
                "#include \"glow/Base/Type.h\"\n"
+               "#include \"glow/Graph/Serialization.h\"\n"
                "#include \"glow/Support/Support.h\"\n\n"
                "using namespace glow;\n";
     dStream << "#ifndef DEF_NODE\n#error The macro DEF_NODE was not declared.\n"
@@ -68,10 +68,30 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Unsigned, "Group")
       .addResultFromCtorArg()
       .addGradient()
+      .setFlops("2 * getResult().getType()->size() * "
+                "(getFilter().getType()->size() / getResult().dims().back())")
       .setDocstring("Performs Convolution using a given Input, Filter, and "
                     "Bias tensors, as well as provided Kernels, Strides, Pads, "
                     "and Group.");
 
+  BB.newNode("ChannelwiseQuantizedConvolution")
+      .addInput("Input")
+      .addInput("Filter")
+      .addInput("Bias")
+      .addInput("Scales")
+      .addInput("Offsets")
+      .addMember(MemberType::VectorUnsigned, "Kernels")
+      .addMember(MemberType::VectorUnsigned, "Strides")
+      .addMember(MemberType::VectorUnsigned, "Pads")
+      .addMember(MemberType::Unsigned, "Group")
+      .addResultFromCtorArg()
+      .setFlops("2 * getResult().getType()->size() * "
+                "(getFilter().getType()->size() / getResult().dims().back())")
+      .setDocstring("Performs a quantized Convolution where every output "
+                    "channel of the Filter has its own scale and offset, "
+                    "given in the Scales and Offsets tensors. The Bias is "
+                    "int32 in the scale of Input times the channel scale.");
+
   BB.newNode("MaxPool")
       .addInput("Input")
       .addMember(MemberType::VectorUnsigned, "Kernels")
@@ -79,6 +99,8 @@ int main(int argc, char **argv) {
       .addMember(MemberType::VectorUnsigned, "Pads")
       .addResultFromCtorArg()
       .addGradient()
+      .setFlops("getResult().getType()->size() * "
+                "getKernels()[0] * getKernels()[1]")
       .setDocstring("Performs a Max Pool operation on the Input given provided "
                     "Kernels, Strides, and Pads.");
 
@@ -89,6 +111,8 @@ int main(int argc, char **argv) {
       .addMember(MemberType::VectorUnsigned, "Pads")
       .addResultFromCtorArg()
       .addGradient()
+      .setFlops("getResult().getType()->size() * "
+                "getKernels()[0] * getKernels()[1]")
       .setDocstring("Performs an Average Pool operation on the Input given "
                     "provided Kernels, Strides, and Pads.");
 
@@ -98,10 +122,39 @@ int main(int argc, char **argv) {
       .addInput("Bias")
       .addResultFromCtorArg()
       .addGradient()
+      .setFlops("2 * getResult().getType()->size() * getWeights().dims()[0]")
       .setDocstring("Creates a FullyConnected node where the Input tensor and "
                     "Weights tensor are multiplied, and then the Bias tensor "
                     "is added to it, producing the Output.");
 
+  BB.newNode("RowwiseQuantizedFullyConnected")
+      .addInput("Input")
+      .addInput("Weights")
+      .addInput("Scales")
+      .addInput("Offsets")
+      .addInput("Bias")
+      .addResultFromCtorArg()
+      .setFlops("2 * getResult().getType()->size() * getWeights().dims()[1]")
+      .setDocstring("Same as FullyConnected, but Weights is an int8 matrix "
+                    "with a row for every output column, and row j "
+                    "dequantizes as Scales[j] * (Weights[j] - Offsets[j]). "
+                    "Input, Bias and the result are float, so only the "
+                    "weights are quantized.");
+
+  BB.newNode("DynamicQuantizedFullyConnected")
+      .addInput("Input")
+      .addInput("Weights")
+      .addInput("Scales")
+      .addInput("Offsets")
+      .addInput("Bias")
+      .addResultFromCtorArg()
+      .setFlops("2 * getResult().getType()->size() * getWeights().dims()[1]")
+      .setDocstring("Same as RowwiseQuantizedFullyConnected, but every row "
+                    "of the float Input is quantized to int8 at runtime with "
+                    "the range of its actual values, and the products are "
+                    "accumulated in int32. This needs no profile of the "
+                    "activations.");
+
   //===--------------------------------------------------------------------===//
   //                     Normalization
   //===--------------------------------------------------------------------===//
@@ -117,6 +170,7 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Float, "Momentum")
       .addResult("Input.getType()")
       .addGradient()
+      .setFlops("2 * getResult().getType()->size()")
       .setDocstring("Performs batch normalization on the Input tensor with the "
                     "provided Scale, Bias, Mean, Var, ChannelIdx, Epsilon, and "
                     "Momentum. Similar to Caffe2 SpatialBN, and ONNX "
@@ -141,6 +195,8 @@ int main(int argc, char **argv) {
       .addMember(MemberType::Float, "K")
       .addResult("Input.getType()")
       .addGradient()
+      .setFlops("2 * getResult().getType()->size() * "
+                "(2 * getHalfWindowSize() + 1)")
       .setDocstring("Performs local response normalization on the Input tensor "
                     "with the provided Scale, Bias, Mean, Var, ChannelIdx, "
                     "Epsilon, and Momentum. Similar to Caffe2 and ONNX LRN.");
@@ -154,6 +210,7 @@ int main(int argc, char **argv) {
       .addInput("Selected")
       .addResultFromCtorArg()
       .addGradient()
+      .setFlops("4 * getResult().getType()->size()")
       .setDocstring("Performs SoftMax normalization on the Input tensor.");
 
   BB.newNode("CrossEntropyLoss")
@@ -163,6 +220,18 @@ int main(int argc, char **argv) {
       .addGradient()
       .setDocstring("Computes the average cross entropy loss of the input.");
 
+  BB.newNode("SoftMaxCrossEntropyLoss")
+      .addInput("Logits")
+      .addInput("Labels")
+      .addResultFromCtorArg()
+      .addGradient()
+      .setFlops("4 * getLogits().getType()->size()")
+      .setDocstring("Computes the cross entropy loss of the SoftMax of the "
+                    "Logits with the Labels in a single pass, from the log of "
+                    "the sum of the exponentials of every row, without "
+                    "materializing the probabilities. The gradient of the "
+                    "Logits is the SoftMax minus the one-hot Labels.");
+
   BB.newNode("Regression")
       .addInput("Input")
       .addInput("Expected")
@@ -188,6 +257,12 @@ int main(int argc, char **argv) {
       .addGradient()
       .setDocstring("Performs Add on the LHS and RHS operands.");
 
+  BB.newNode("Sum")
+      .addMember(MemberType::VectorNodeValue, "Inputs")
+      .addResultFromCtorArg()
+      .setDocstring("Performs the elementwise sum of all of the Inputs, which "
+                    "have the same type as the result, in a single pass.");
+
   BB.newNode("Mul")
       .addInput("LHS")
       .addInput("RHS")
@@ -268,14 +343,28 @@ int main(int argc, char **argv) {
   BB.newNode("MatMul")
       .addInput("LHS")
       .addInput("RHS")
+      .addMember(MemberType::Boolean, "TransposeRHS")
       .addResultFromCtorArg()
+      .setFlops("2 * getResult().getType()->size() * getLHS().dims()[1]")
       .setDocstring("Performs matrix multiplication between the LHS RHS."
-                    "Example: (A, Z) x (Z, B) => (A, B)");
+                    "Example: (A, Z) x (Z, B) => (A, B). If TransposeRHS "
+                    "is set, RHS is stored as (B, Z) and is read transposed "
+                    "without materializing the transpose.");
+
+  BB.newNode("BatchedMatMul")
+      .addInput("LHS")
+      .addInput("RHS")
+      .addResultFromCtorArg()
+      .setFlops("2 * getResult().getType()->size() * getLHS().dims()[2]")
+      .setDocstring("Performs a matrix multiplication for every batch entry of "
+                    "LHS and RHS. "
+                    "Example: (N, A, Z) x (N, Z, B) => (N, A, B)");
 
   BB.newNode("BatchedReduceAdd")
       .addInput("Batch")
       .addMember(MemberType::Unsigned, "Axis")
       .addResultFromCtorArg()
+      .setFlops("getBatch().getType()->size()")
       .setDocstring("Accumulates all of the layers in the batch and produce a "
                     "tensor that has the same dimensions as the input tensor "
                     "without the first dimension.");
@@ -286,6 +375,8 @@ int main(int argc, char **argv) {
       .addInput("Indices")
       .addInput("Lengths")
       .addResultFromCtorArg()
+      .setFlops("2 * getIndices().getType()->size() * "
+                "(getData().getType()->size() / getData().dims()[0])")
       .setDocstring("Gathers slices of the outer-most dimension of Data "
                     "indexed by Indices vector, and then accumulates them into "
                     "len(Lengths) entries: first Lengths[0] slices are "
@@ -296,6 +387,21 @@ int main(int argc, char **argv) {
                     "Weights[0] * Slice(0) + Weights[1] * Slice(1) + ... "
                     "It implies that len(Weights) == len(Indices).");
 
+  BB.newNode("RowwiseQuantizedSparseLengthsWeightedSum")
+      .addInput("Data")
+      .addInput("Scales")
+      .addInput("Offsets")
+      .addInput("Weights")
+      .addInput("Indices")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setFlops("2 * getIndices().getType()->size() * "
+                "(getData().getType()->size() / getData().dims()[0])")
+      .setDocstring("Same as SparseLengthsWeightedSum, but Data is an int8 "
+                    "table whose rows are quantized separately: row i "
+                    "dequantizes as Scales[i] * (Data[i] - Offsets[i]). The "
+                    "slices are accumulated in float.");
+
   //===--------------------------------------------------------------------===//
   //                Non-linearities
   //===--------------------------------------------------------------------===//
@@ -366,6 +472,24 @@ int main(int argc, char **argv) {
                     "Small is inserted Count times along Axis. The resulting "
                     "Tensor will have the same type as the input Big tensor.");
 
+  BB.newNode("Broadcast")
+      .addInput("Input")
+      .addResultFromCtorArg()
+      .addExtraMethod(
+          "bool hasOnlyArithmeticUsers() const;",
+          "bool BroadcastNode::hasOnlyArithmeticUsers() const { "
+          "for (const auto &U : getUsers()) { auto *N = U.getUser(); "
+          "if (!llvm::isa<AddNode>(N) && !llvm::isa<SubNode>(N) && "
+          "!llvm::isa<MulNode>(N) && !llvm::isa<DivNode>(N) && "
+          "!llvm::isa<MaxNode>(N) && !llvm::isa<MinNode>(N)) { return false; "
+          "} } return true; }")
+      .setDocstring("Broadcasts the Input tensor to the shape of the result. "
+                    "Input has the rank of the result, and each of its "
+                    "dimensions either matches the result or is 1, in which "
+                    "case the elements are repeated along it. Backends that "
+                    "do not lower it read the Input in place from the "
+                    "arithmetic users.");
+
   BB.newNode("Gather")
       .addInput("Data")
       .addInput("Indices")
@@ -390,6 +514,13 @@ int main(int argc, char **argv) {
                     "Data {{1,2},{3,4},{5,6}}, Slices {{-3,-4}}, and Indices "
                     "{1}, the result is {{1,2},{-3,-4},{5,6}}.");
 
+  BB.newNode("ConvertTo")
+      .addInput("Input")
+      .addResultFromCtorArg()
+      .setDocstring("Convert the elements of Input to the floating point "
+                    "element type of the result, e.g. to store weights in "
+                    "half precision or bfloat16. The shape does not change.");
+
   //===--------------------------------------------------------------------===//
   //                Nodes used for network training
   //===--------------------------------------------------------------------===//
@@ -415,6 +546,123 @@ int main(int argc, char **argv) {
                     "Produces the updated weight that needs to be used "
                     "instead of Weight for the next iteration.");
 
+  BB.newNode("MomentumSGD")
+      .addInput("Gradient")
+      .addInput("Weight")
+      .addInput("Gsum")
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Momentum")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .addResult("Weight.getType()", "UpdatedWeight")
+      .addOverwrittenInput("Gsum")
+      .setHasSideEffects(true)
+      .setDocstring("An SGD node with momentum, whose accumulated update is "
+                    "kept in Gsum, which the node overwrites. It is created "
+                    "by the backends that do not lower SGD nodes.");
+
+  BB.newNode("Adagrad")
+      .addInput("Gradient")
+      .addInput("Weight")
+      .addInput("SumSq")
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .addResult("Weight.getType()", "UpdatedWeight")
+      .addOverwrittenInput("SumSq")
+      .setHasSideEffects(true)
+      .setDocstring("Adagrad update of Weight, which divides the steps by the "
+                    "root of the sum of the squared gradients. The sum is kept "
+                    "in SumSq, which the node overwrites.");
+
+  BB.newNode("RMSProp")
+      .addInput("Gradient")
+      .addInput("Weight")
+      .addInput("MeanSq")
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Decay")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .addResult("Weight.getType()", "UpdatedWeight")
+      .addOverwrittenInput("MeanSq")
+      .setHasSideEffects(true)
+      .setDocstring("RMSProp update of Weight, which divides the steps by the "
+                    "root of the moving average of the squared gradients. The "
+                    "average is kept in MeanSq, which the node overwrites.");
+
+  BB.newNode("Adam")
+      .addInput("Gradient")
+      .addInput("Weight")
+      .addInput("FirstMoment")
+      .addInput("SecondMoment")
+      .addInput("Step")
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Beta1")
+      .addMember(MemberType::Float, "Beta2")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .addResult("Weight.getType()", "UpdatedWeight")
+      .addOverwrittenInput("FirstMoment")
+      .addOverwrittenInput("SecondMoment")
+      .addOverwrittenInput("Step")
+      .setHasSideEffects(true)
+      .setDocstring("Adam update of Weight. The moment estimates of the "
+                    "gradient are kept in FirstMoment and SecondMoment, and "
+                    "the number of previous updates, which corrects their "
+                    "bias, in the single element of Step. The node "
+                    "overwrites the three of them.");
+
+  BB.newNode("SparseLengthsWeightedSumRowGrad")
+      .addInput("OutputGrad")
+      .addInput("Weights")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setDocstring("Computes the sparse gradient of the Data of a "
+                    "SparseLengthsWeightedSum node, with a row per index: "
+                    "row i is Weights[i] times the row of OutputGrad of the "
+                    "segment that index i belongs to, as given by Lengths. "
+                    "The Indices of the node tell which rows of Data the rows "
+                    "of the result belong to.");
+
+  BB.newNode("SparseSGD")
+      .addInput("Gradient")
+      .addInput("Weight")
+      .addInput("Indices")
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .addOverwrittenInput("Weight")
+      .setHasSideEffects(true)
+      .setDocstring("SGD update of the rows Indices of Weight, whose "
+                    "gradients are the rows of Gradient, in place. The other "
+                    "rows are not touched, and a row that appears several "
+                    "times in Indices is updated once per occurrence.");
+
+  BB.newNode("SparseAdagrad")
+      .addInput("Gradient")
+      .addInput("Weight")
+      .addInput("Indices")
+      .addInput("SumSq")
+      .addMember(MemberType::Float, "L1Decay")
+      .addMember(MemberType::Float, "L2Decay")
+      .addMember(MemberType::Float, "LearningRate")
+      .addMember(MemberType::Float, "Epsilon")
+      .addMember(MemberType::Unsigned, "BatchSize")
+      .addOverwrittenInput("Weight")
+      .addOverwrittenInput("SumSq")
+      .setHasSideEffects(true)
+      .setDocstring("Same as SparseSGD, but with the Adagrad update, which "
+                    "keeps the sums of the squared gradients of the rows in "
+                    "SumSq.");
+
   //===--------------------------------------------------------------------===//
   //                Nodes used by quantization.
   //===--------------------------------------------------------------------===//
@@ -490,6 +738,108 @@ int main(int argc, char **argv) {
                     "the outputs {D_0, D_1, ... D_n-1, K}, sorted in "
                     "non-decreasing order.");
 
+  BB.newNode("LSTMCell")
+      .addInput("Input")
+      .addInput("H")
+      .addInput("C")
+      .addInput("InputWeights")
+      .addInput("InputBias")
+      .addInput("HiddenWeights")
+      .addInput("HiddenBias")
+      .addResultFromCtorArg("NewH")
+      .addResultFromCtorArg("NewC")
+      .setDocstring("Computes one time step of an LSTM layer. The four gates "
+                    "are computed together, in the order input, forget, cell "
+                    "and output, from Input {B, X} with InputWeights {X, 4H} "
+                    "and InputBias {4H}, and from H {B, H} with HiddenWeights "
+                    "{H, 4H} and HiddenBias {4H}. C is the cell state. It "
+                    "is lowered to two fully connected layers and an "
+                    "LSTMUnit.");
+
+  BB.newNode("LSTMUnit")
+      .addInput("InputGates")
+      .addInput("HiddenGates")
+      .addInput("C")
+      .addResultFromCtorArg("NewH")
+      .addResultFromCtorArg("NewC")
+      .setDocstring("Computes the new hidden and cell states of an LSTM from "
+                    "the sum of InputGates and HiddenGates, which hold the "
+                    "pre-activations of the input, forget, cell and output "
+                    "gates, and from the cell state C.");
+
+  BB.newNode("GRUCell")
+      .addInput("Input")
+      .addInput("H")
+      .addInput("InputWeights")
+      .addInput("InputBias")
+      .addInput("HiddenWeights")
+      .addInput("HiddenBias")
+      .addResultFromCtorArg()
+      .setDocstring("Computes one time step of a GRU layer. The three gates "
+                    "are computed together, in the order reset, update and "
+                    "new, from Input {B, X} with InputWeights {X, 3H} and "
+                    "InputBias {3H}, and from H {B, H} with HiddenWeights "
+                    "{H, 3H} and HiddenBias {3H}. It is lowered to two fully "
+                    "connected layers and a GRUUnit.");
+
+  BB.newNode("GRUUnit")
+      .addInput("InputGates")
+      .addInput("HiddenGates")
+      .addInput("H")
+      .addResultFromCtorArg()
+      .setDocstring("Computes the new hidden state of a GRU from the hidden "
+                    "state H and from InputGates and HiddenGates, the "
+                    "contributions of the input and of H to the reset, "
+                    "update and new gates. The reset gate scales the hidden "
+                    "contribution to the new gate.");
+
+  BB.newNode("RNNSequence")
+      .addInput("InputGates")
+      .addInput("InitH")
+      .addInput("HiddenWeights")
+      .addInput("HiddenBias")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setDocstring("Runs a simple RNN over a sequence. InputGates {T, B, H} "
+                    "holds the contribution of the input at every time step, "
+                    "and the hidden state, which starts as InitH {B, H}, "
+                    "becomes tanh(InputGates[t] + H * HiddenWeights + "
+                    "HiddenBias). The result {T, B, H} holds the hidden state "
+                    "of every time step. Lengths {B} (Int64) holds the number "
+                    "of steps of every batch entry, at most T; the later steps "
+                    "repeat its last hidden state.");
+
+  BB.newNode("LSTMSequence")
+      .addInput("InputGates")
+      .addInput("InitH")
+      .addInput("InitC")
+      .addInput("HiddenWeights")
+      .addInput("HiddenBias")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setDocstring("Runs an LSTM over a sequence. InputGates {T, B, 4H} holds "
+                    "the contribution of the input to the gates at every time "
+                    "step, and every step combines it with the gates of the "
+                    "hidden state in an LSTMUnit. The states start as InitH "
+                    "and InitC {B, H}. The result {T, B, H} holds the hidden "
+                    "state of every time step. Lengths {B} is the same as in "
+                    "RNNSequence.");
+
+  BB.newNode("GRUSequence")
+      .addInput("InputGates")
+      .addInput("InitH")
+      .addInput("HiddenWeights")
+      .addInput("HiddenBias")
+      .addInput("Lengths")
+      .addResultFromCtorArg()
+      .setDocstring("Runs a GRU over a sequence. InputGates {T, B, 3H} holds "
+                    "the contribution of the input to the gates at every time "
+                    "step, and every step combines it with the gates of the "
+                    "hidden state in a GRUUnit. The hidden state starts as "
+                    "InitH {B, H}. The result {T, B, H} holds the hidden "
+                    "state of every time step. Lengths {B} is the same as in "
+                    "RNNSequence.");
+
   //===--------------------------------------------------------------------===//
   //                Backend-Specific Nodes
   //===--------------------------------------------------------------------===//
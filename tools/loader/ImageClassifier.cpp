@@ -17,35 +17,25 @@
 #include "Loader.h"
 
 #include "glow/Base/Image.h"
+#include "glow/Base/TensorFile.h"
 #include "glow/Graph/Nodes.h"
 #include "glow/Importer/Caffe2.h"
 #include "glow/Importer/ONNX.h"
+#include "glow/Support/ThreadPool.h"
 
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <memory>
+#include <thread>
 
 using namespace glow;
 
-enum class ImageNormalizationMode {
-  kneg1to1,     // Values are in the range: -1 and 1.
-  k0to1,        // Values are in the range: 0 and 1.
-  k0to256,      // Values are in the range: 0 and 256.
-  kneg128to127, // Values are in the range: -128 .. 127
-};
-
-enum class ImageLayout {
-  NCHW,
-  NHWC,
-};
-
-enum class ImageChannelOrder {
-  BGR,
-  RGB,
-};
-
 ImageNormalizationMode strToImageNormalizationMode(const std::string &str) {
   return llvm::StringSwitch<ImageNormalizationMode>(str)
       .Case("neg1to1", ImageNormalizationMode::kneg1to1)
@@ -55,29 +45,16 @@ ImageNormalizationMode strToImageNormalizationMode(const std::string &str) {
   GLOW_ASSERT(false && "Unknown image format");
 }
 
-/// Convert the normalization to numeric floating poing ranges.
-std::pair<float, float> normModeToRange(ImageNormalizationMode mode) {
-  switch (mode) {
-  case ImageNormalizationMode::kneg1to1:
-    return {-1., 1.};
-  case ImageNormalizationMode::k0to1:
-    return {0., 1.0};
-  case ImageNormalizationMode::k0to256:
-    return {0., 256.0};
-  case ImageNormalizationMode::kneg128to127:
-    return {-128., 127.};
-  default:
-    GLOW_ASSERT(false && "Image format not defined.");
-  }
-}
-
 namespace {
 
 /// Image loader options.
 llvm::cl::OptionCategory imageLoaderCat("Image Loader Options");
-llvm::cl::list<std::string> inputImageFilenames(llvm::cl::Positional,
-                                                llvm::cl::desc("<input files>"),
-                                                llvm::cl::OneOrMore);
+llvm::cl::list<std::string> inputImageFilenames(
+    llvm::cl::Positional,
+    llvm::cl::desc("<input files>: PNG images, or a single NPY file of "
+                   "preprocessed images in the requested layout, whose uint8 "
+                   "elements are normalized like the pixels"),
+    llvm::cl::OneOrMore);
 llvm::cl::opt<ImageNormalizationMode> imageNormMode(
     "image_mode", llvm::cl::desc("Specify the image mode:"), llvm::cl::Required,
     llvm::cl::cat(imageLoaderCat),
@@ -118,58 +95,127 @@ llvm::cl::opt<std::string> modelInputName(
     llvm::cl::desc("The name of the variable for the model's input image."),
     llvm::cl::value_desc("string_name"), llvm::cl::Required,
     llvm::cl::cat(imageLoaderCat));
+
+llvm::cl::opt<unsigned> throughputBatchSize(
+    "throughput-batch-size",
+    llvm::cl::desc("Classify the images in batches of this size, decoding the "
+                   "next batch while the network runs on the current one, "
+                   "and report the number of images per second. By default "
+                   "all the images form a single batch"),
+    llvm::cl::Optional, llvm::cl::init(0), llvm::cl::cat(imageLoaderCat));
+
+llvm::cl::opt<unsigned> decodeThreads(
+    "decode-threads",
+    llvm::cl::desc("Number of threads that decode and preprocess the images"),
+    llvm::cl::Optional, llvm::cl::init(std::thread::hardware_concurrency()),
+    llvm::cl::cat(imageLoaderCat));
 } // namespace
 
-/// Loads and normalizes all PNGs into a tensor in the NHWC format with the
-/// requested channel ordering.
-void loadImagesAndPreprocess(const llvm::cl::list<std::string> &filenames,
-                             Tensor *result) {
-  assert(!filenames.empty() &&
-         "There must be at least one filename in filenames.");
-  auto range = normModeToRange(imageNormMode);
-  unsigned numImages = filenames.size();
-
-  // Get first image's dimensions and check if grayscale or color.
-  size_t imgHeight, imgWidth;
+/// Decodes and normalizes the PNG \p filename into the image \p n of \p batch,
+/// which is in the requested layout and channel ordering.
+static void loadImageIntoBatch(const std::string &filename, size_t n,
+                               Tensor *batch) {
+  bool loadSuccess = !readPngImageIntoBatch(
+      batch, n, filename.c_str(), normModeToRange(imageNormMode),
+      imageChannelOrder, imageLayout);
+  GLOW_ASSERT(loadSuccess && "Error reading input image, or the images do "
+                             "not all have the same shape.");
+}
+
+/// \returns the shape of a batch of \p batchSize images like \p filename in
+/// the requested layout.
+static std::vector<size_t> getBatchDims(const std::string &filename,
+                                        size_t batchSize) {
+  size_t height, width;
   bool isGray;
-  std::tie(imgHeight, imgWidth, isGray) = getPngInfo(filenames[0].c_str());
-  const size_t numChannels = isGray ? 1 : 3;
-
-  // N x C x H x W
-  result->reset(ElemKind::FloatTy,
-                {numImages, numChannels, imgHeight, imgWidth});
-  auto RH = result->getHandle<>();
-
-  // We iterate over all the png files, reading them all into our result tensor
-  // for processing
-  for (unsigned n = 0; n < filenames.size(); n++) {
-    Tensor localCopy;
-    // PNG images are loaded as NHWC & RGB
-    bool loadSuccess = !readPngImage(&localCopy, filenames[n].c_str(), range);
-    GLOW_ASSERT(loadSuccess && "Error reading input image.");
-    auto imageH = localCopy.getHandle<>();
-
-    auto dims = localCopy.dims();
-    assert((dims[0] == imgHeight && dims[1] == imgWidth) &&
-           "All images must have the same Height and Width");
-    assert(dims[2] == numChannels &&
-           "All images must have the same number of channels");
-    assert((imageChannelOrder == ImageChannelOrder::BGR ||
-            imageChannelOrder == ImageChannelOrder::RGB) &&
-           "Invalid image format");
-
-    // Convert to NCHW with the requested channel ordering.
-    for (unsigned z = 0; z < numChannels; z++) {
-      for (unsigned y = 0; y < dims[1]; y++) {
-        for (unsigned x = 0; x < dims[0]; x++) {
-          if (imageChannelOrder == ImageChannelOrder::BGR) {
-            RH.at({n, numChannels - 1 - z, x, y}) = (imageH.at({x, y, z}));
-          } else { // RGB
-            RH.at({n, z, x, y}) = (imageH.at({x, y, z}));
-          }
+  std::tie(height, width, isGray) = getPngInfo(filename.c_str());
+  size_t numChannels = isGray ? 1 : 3;
+  if (imageLayout == ImageLayout::NCHW) {
+    return {batchSize, numChannels, height, width};
+  }
+  return {batchSize, height, width, numChannels};
+}
+
+/// The images of the run, which are decoded from PNG files or taken from the
+/// samples of an NPY file.
+class ImageSource {
+  /// The PNG files, if there is no NPY file.
+  const llvm::cl::list<std::string> &filenames_;
+  /// The NPY file of the images, if any.
+  std::unique_ptr<NpyFile> npy_;
+  /// The names of the images in the results.
+  std::vector<std::string> names_;
+
+public:
+  /// Open the images of \p filenames. An NPY file is mapped in memory.
+  explicit ImageSource(const llvm::cl::list<std::string> &filenames)
+      : filenames_(filenames) {
+    if (!llvm::StringRef(filenames[0]).endswith(".npy")) {
+      names_.assign(filenames.begin(), filenames.end());
+      return;
+    }
+    GLOW_ASSERT(filenames.size() == 1 &&
+                "The images must be in a single NPY file.");
+    npy_ = NpyFile::open(filenames[0]);
+    GLOW_ASSERT(npy_ && npy_->getKind() != NpyFile::Kind::Int64 &&
+                "The NPY file must hold float32 or uint8 images.");
+    for (size_t i = 0, e = npy_->getNumSamples(); i < e; i++) {
+      names_.push_back(filenames[0] + "[" + std::to_string(i) + "]");
+    }
+  }
+
+  /// \returns the number of images.
+  size_t size() const { return names_.size(); }
+
+  /// \returns the name of the image \p i.
+  const std::string &getName(size_t i) const { return names_[i]; }
+
+  /// \returns the shape of a batch of \p batchSize images.
+  std::vector<size_t> getBatchDims(size_t batchSize) const {
+    if (!npy_) {
+      return ::getBatchDims(filenames_[0], batchSize);
+    }
+    std::vector<size_t> dims{batchSize};
+    auto sampleDims = npy_->getSampleDims();
+    dims.insert(dims.end(), sampleDims.begin(), sampleDims.end());
+    return dims;
+  }
+
+  /// Load the \p count images starting at \p first, and \returns the batch
+  /// that holds them as its first images. The float images of an NPY file
+  /// fill a whole batch without being copied: \p view is set to the slice of
+  /// the file. The other ones are decoded, in parallel on \p pool, or copied
+  /// into \p buffer.
+  Tensor *loadBatch(size_t first, size_t count, Tensor *buffer, Tensor *view,
+                    ThreadPool &pool) const {
+    if (!npy_) {
+      pool.parallelFor(count, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          loadImageIntoBatch(filenames_[first + i], i, buffer);
         }
-      }
+      });
+      return buffer;
+    }
+    if (npy_->getKind() == NpyFile::Kind::Float32 &&
+        count == buffer->dims()[0]) {
+      *view = npy_->getSamples(first, count);
+      return view;
     }
+    npy_->copySamples(first, count, buffer, normModeToRange(imageNormMode));
+    return buffer;
+  }
+};
+
+/// Print the class of the \p count first images of the batch \p res, which
+/// are the images starting at \p first of \p images.
+static void printResults(const ImageSource &images, size_t first, size_t count,
+                         Tensor &res) {
+  auto H = res.getHandle<>();
+  for (size_t i = 0; i < count; i++) {
+    Tensor slice = H.extractSlice(i);
+    auto SH = slice.getHandle<>();
+    llvm::outs() << " File: " << images.getName(first + i)
+                 << " Result:" << SH.minMaxArg().second << "\n";
   }
 }
 
@@ -178,19 +224,20 @@ int main(int argc, char **argv) {
   // the ExecutionEngine and Function.
   Loader loader(argc, argv);
 
-  // Load and process the image data into the data Tensor.
-  Tensor data;
-  loadImagesAndPreprocess(inputImageFilenames, &data);
-
-  // For ONNX graphs with input in NHWC layout, we transpose the data.
-  switch (imageLayout) {
-  case ImageLayout::NCHW:
-    break;
-  case ImageLayout::NHWC:
-    Tensor dataNHWC;
-    data.transpose(&dataNHWC, NCHW2NHWC);
-    data = std::move(dataNHWC);
-    break;
+  // In the throughput mode the network classifies batches of images while
+  // the next batch is decoded, otherwise all the images form one batch.
+  ImageSource images(inputImageFilenames);
+  size_t numImages = images.size();
+  size_t batchSize = throughputBatchSize ? throughputBatchSize : numImages;
+  Tensor batches[2];
+  Tensor views[2];
+  for (auto &batch : batches) {
+    batch.reset(ElemKind::FloatTy, images.getBatchDims(batchSize));
+  }
+  ThreadPool pool(decodeThreads);
+  Tensor *firstBatch = &batches[0];
+  if (!throughputBatchSize) {
+    firstBatch = images.loadBatch(0, numImages, &batches[0], &views[0], pool);
   }
 
   // The image name that the model expects must be passed on the command line.
@@ -202,10 +249,10 @@ int main(int argc, char **argv) {
   if (c2Model) {
     LD.reset(new caffe2ModelLoader(
         loader.getCaffe2NetDescFilename(), loader.getCaffe2NetWeightFilename(),
-        {inputName}, {&data}, *loader.getFunction()));
+        {inputName}, {firstBatch}, *loader.getFunction()));
   } else {
     LD.reset(new ONNXModelLoader(loader.getOnnxModelFilename(), {inputName},
-                                 {&data}, *loader.getFunction()));
+                                 {firstBatch}, *loader.getFunction()));
   }
   // Get the Variable that the final expected Softmax writes into at the end of
   // image inference.
@@ -222,20 +269,47 @@ int main(int argc, char **argv) {
   loader.compile();
 
   // If in bundle mode, do not run inference.
-  if (!emittingBundle()) {
-    loader.runInference({inputImage}, {&data});
+  if (emittingBundle()) {
+    return 0;
+  }
+
+  if (!throughputBatchSize) {
+    loader.runInference({inputImage}, {firstBatch});
 
     // Print out the inferred image classification.
-    Tensor &res = SMVar->getPayload();
-    auto H = res.getHandle<>();
     llvm::outs() << "Model: " << loader.getFunction()->getName() << "\n";
-    for (unsigned i = 0; i < inputImageFilenames.size(); i++) {
-      Tensor slice = H.extractSlice(i);
-      auto SH = slice.getHandle<>();
-      llvm::outs() << " File: " << inputImageFilenames[i]
-                   << " Result:" << SH.minMaxArg().second << "\n";
-    }
+    printResults(images, 0, numImages, SMVar->getPayload());
+    return 0;
   }
 
+  // Decode the next batch into one buffer while the network runs on the
+  // other. The batch is copied into the input variable before the run starts,
+  // so the buffer is free again when the run returns. The images of the last
+  // batch that are past the end of the list are left over from the previous
+  // batch and ignored.
+  llvm::outs() << "Model: " << loader.getFunction()->getName() << "\n";
+  auto start = std::chrono::steady_clock::now();
+  auto decodeBatch = [&](size_t first, size_t cur) {
+    return std::async(std::launch::async, [&, first, cur]() {
+      size_t count = std::min(batchSize, numImages - first);
+      return images.loadBatch(first, count, &batches[cur], &views[cur], pool);
+    });
+  };
+  auto decoded = decodeBatch(0, 0);
+  for (size_t first = 0, cur = 0; first < numImages;
+       first += batchSize, cur ^= 1) {
+    Tensor *batch = decoded.get();
+    if (first + batchSize < numImages) {
+      decoded = decodeBatch(first + batchSize, cur ^ 1);
+    }
+    loader.runBatch({inputImage}, {batch});
+    printResults(images, first, std::min(batchSize, numImages - first),
+                 SMVar->getPayload());
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  loader.dumpProfiles();
+  llvm::outs() << llvm::format("Throughput: %.2f images/s\n",
+                               numImages / elapsed.count());
   return 0;
 }
@@ -20,10 +20,12 @@
 #include "glow/ExecutionEngine/ExecutionEngine.h"
 #include "glow/IR/IR.h"
 #include "glow/Quantization/Serialization.h"
+#include "glow/Support/HugePages.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
@@ -58,6 +60,13 @@ llvm::cl::opt<bool>
                            "takes for the program to execute"),
             llvm::cl::Optional, llvm::cl::cat(loaderCat));
 
+llvm::cl::opt<bool> compileReportOpt(
+    "compile-report",
+    llvm::cl::desc("Print the wall time of the compilation phases, the node "
+                   "and instruction counts before and after each of them, "
+                   "and the peak memory usage to stderr"),
+    llvm::cl::Optional, llvm::cl::cat(loaderCat));
+
 llvm::cl::opt<unsigned> iterationsOpt(
     "iterations", llvm::cl::desc("Number of iterations to perform"),
     llvm::cl::Optional, llvm::cl::init(1), llvm::cl::cat(loaderCat));
@@ -69,6 +78,14 @@ llvm::cl::opt<std::string> dumpProfileFileOpt(
     llvm::cl::value_desc("profile.yaml"), llvm::cl::Optional,
     llvm::cl::cat(loaderCat));
 
+llvm::cl::opt<std::string> dumpRawProfileFileOpt(
+    "dump_raw_profile",
+    llvm::cl::desc("Perform quantization profiling for a given graph and dump "
+                   "the raw ranges and histograms to the file. Raw profiles "
+                   "of several runs can be merged with -load_raw_profiles."),
+    llvm::cl::value_desc("raw_profile.yaml"), llvm::cl::Optional,
+    llvm::cl::cat(loaderCat));
+
 llvm::cl::opt<quantization::Schema> quantizationSchema(
     "quantization-schema",
     llvm::cl::desc("Specify which quantization schema to use"),
@@ -82,12 +99,33 @@ llvm::cl::opt<quantization::Schema> quantizationSchema(
                    "Use symmetric ranges with potentially uint8 ranges")),
     llvm::cl::init(quantization::Schema::Asymmetric), llvm::cl::cat(loaderCat));
 
+llvm::cl::opt<quantization::Calibration> quantizationCalibration(
+    "quantization-calibration",
+    llvm::cl::desc("Specify how the quantization ranges are selected from the "
+                   "profile"),
+    llvm::cl::values(
+        clEnumValN(quantization::Calibration::MinMax, "minmax",
+                   "Use the profiled minimum and maximum"),
+        clEnumValN(quantization::Calibration::KLMinimization, "kl",
+                   "Clip the ranges to minimize the KL divergence of the "
+                   "profiled histograms")),
+    llvm::cl::init(quantization::Calibration::MinMax),
+    llvm::cl::cat(loaderCat));
+
 llvm::cl::opt<std::string> loadProfileFileOpt(
     "load_profile",
     llvm::cl::desc("Load quantization profile file and quantize the graph"),
     llvm::cl::value_desc("profile.yaml"), llvm::cl::Optional,
     llvm::cl::cat(loaderCat));
 
+llvm::cl::list<std::string> loadRawProfilesOpt(
+    "load_raw_profiles",
+    llvm::cl::desc("Merge the raw profiles dumped by -dump_raw_profile, "
+                   "choose the quantization parameters with the given "
+                   "-quantization-schema and quantize the graph"),
+    llvm::cl::value_desc("raw_profile1.yaml,raw_profile2.yaml"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated, llvm::cl::cat(loaderCat));
+
 llvm::cl::list<std::string> doNotQuantizeNodesOpt(
     "do_not_quantize_nodes",
     llvm::cl::desc(
@@ -98,6 +136,45 @@ llvm::cl::list<std::string> doNotQuantizeNodesOpt(
     llvm::cl::value_desc("NodeNames (e.g. Add,Div)"), llvm::cl::ZeroOrMore,
     llvm::cl::CommaSeparated, llvm::cl::cat(loaderCat));
 
+llvm::cl::list<std::string> int16NodesOpt(
+    "int16_nodes",
+    llvm::cl::desc(
+        "Use to specify the name of nodes (e.g. FullyConnected, MatMul, etc.) "
+        "that should be quantized to 16-bit instead of 8-bit integers, for "
+        "layers that lose too much accuracy in 8-bit. Nodes that the backend "
+        "can not execute in 16-bit are quantized to 8-bit."),
+    llvm::cl::value_desc("NodeNames (e.g. FullyConnected,Add)"),
+    llvm::cl::ZeroOrMore, llvm::cl::CommaSeparated, llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<std::string> loadPrecisionPolicyOpt(
+    "load_precision_policy",
+    llvm::cl::desc("Quantize every node named in the file with the precision "
+                   "given there (float, int8 or int16), e.g. as chosen by "
+                   "mixed-precision-search. The precisions take priority over "
+                   "-do_not_quantize_nodes and -int16_nodes."),
+    llvm::cl::value_desc("policy.yaml"), llvm::cl::Optional,
+    llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<bool> enableChannelwiseOpt(
+    "enable-channelwise",
+    llvm::cl::desc("Quantize the filters of convolutions with a separate "
+                   "scale and offset for every output channel."),
+    llvm::cl::Optional, llvm::cl::init(false), llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<bool> quantizeWeightsOnlyOpt(
+    "quantize-weights-only",
+    llvm::cl::desc("Store the weights of fully connected layers as int8 with "
+                   "a separate scale and offset for every output column, and "
+                   "keep the activations in float. No profile is needed."),
+    llvm::cl::Optional, llvm::cl::init(false), llvm::cl::cat(loaderCat));
+
+llvm::cl::opt<bool> quantizeDynamicallyOpt(
+    "quantize-dynamically",
+    llvm::cl::desc("Quantize the fully connected layers to int8 without a "
+                   "profile: the weights ahead of time, and the inputs at "
+                   "runtime with the range of their actual values."),
+    llvm::cl::Optional, llvm::cl::init(false), llvm::cl::cat(loaderCat));
+
 llvm::cl::opt<BackendKind> ExecutionBackend(
     llvm::cl::desc("Backend to use:"),
     llvm::cl::values(clEnumValN(BackendKind::Interpreter, "interpreter",
@@ -106,6 +183,14 @@ llvm::cl::opt<BackendKind> ExecutionBackend(
                      clEnumValN(BackendKind::OpenCL, "opencl", "Use OpenCL")),
     llvm::cl::init(BackendKind::Interpreter), llvm::cl::cat(loaderCat));
 
+llvm::cl::opt<bool> tensorHugePagesOpt(
+    "tensor-huge-pages",
+    llvm::cl::desc("Align the tensor payloads of at least 2MB, such as the "
+                   "weights of large fully connected and embedding layers, "
+                   "to the huge pages and back them with transparent huge "
+                   "pages"),
+    llvm::cl::Optional, llvm::cl::init(false), llvm::cl::cat(loaderCat));
+
 /// Debugging options.
 llvm::cl::OptionCategory
     modelExportCat("How to export the Glow Intermediate Representation/Graphs",
@@ -122,6 +207,18 @@ llvm::cl::opt<bool> dumpGraphOpt("dumpGraph",
                                  llvm::cl::desc("Prints Graph to stdout"),
                                  llvm::cl::cat(modelExportCat));
 
+llvm::cl::opt<bool> dumpCostOpt(
+    "dump-cost",
+    llvm::cl::desc("Prints the operations and the bytes moved by every node of "
+                   "the optimized graph to stdout"),
+    llvm::cl::cat(modelExportCat));
+
+llvm::cl::opt<bool> dumpMemoryUsageOpt(
+    "dump-memory-usage",
+    llvm::cl::desc("Prints the memory estimated from the optimized graph and "
+                   "the memory used by the compiled function to stdout"),
+    llvm::cl::cat(modelExportCat));
+
 /// Emit a bundle into the specified output directory.
 llvm::cl::opt<std::string>
     emitBundle("emit-bundle",
@@ -148,12 +245,87 @@ llvm::StringRef Loader::getModelOptPath() {
 // This is the execution context of the program.
 Context ctx;
 
+Context &Loader::getContext() { return ctx; }
+
 bool glow::emittingBundle() { return !emitBundle.empty(); }
 
+bool glow::parseValidationInput(llvm::StringRef spec, ValidationInput &input) {
+  llvm::SmallVector<llvm::StringRef, 3> parts;
+  spec.split(parts, ':', 2);
+  if (parts.size() != 3) {
+    return false;
+  }
+  std::vector<size_t> dims;
+  llvm::SmallVector<llvm::StringRef, max_tensor_dimensions> dimStrs;
+  parts[1].split(dimStrs, 'x');
+  for (auto d : dimStrs) {
+    size_t dim;
+    if (d.getAsInteger(10, dim) || !dim) {
+      return false;
+    }
+    dims.push_back(dim);
+  }
+  if (dims.empty() || dims.size() > max_tensor_dimensions) {
+    return false;
+  }
+  auto buffer = llvm::MemoryBuffer::getFile(parts[2]);
+  if (!buffer) {
+    return false;
+  }
+  Tensor sample(ElemKind::FloatTy, dims);
+  size_t sampleBytes = sample.getType().getSizeInBytes();
+  size_t fileBytes = (*buffer)->getBufferSize();
+  if (!fileBytes || fileBytes % sampleBytes) {
+    return false;
+  }
+  input.name = parts[0].str();
+  for (size_t offset = 0; offset < fileBytes; offset += sampleBytes) {
+    memcpy(sample.getUnsafePtr(), (*buffer)->getBufferStart() + offset,
+           sampleBytes);
+    input.samples.push_back(sample.clone());
+  }
+  return true;
+}
+
+/// \returns true if the graph is instrumented to capture a profile.
+static bool profilingGraph() {
+  return !dumpProfileFileOpt.empty() || !dumpRawProfileFileOpt.empty();
+}
+
+/// \returns true if the graph is quantized based on a captured profile.
+static bool quantizingGraph() {
+  return !loadProfileFileOpt.empty() || !loadRawProfilesOpt.empty();
+}
+
 static bool commandLineIsInvalid() {
-  if (!dumpProfileFileOpt.empty() && !loadProfileFileOpt.empty()) {
-    llvm::errs() << "Loader: the -" << dumpProfileFileOpt.ArgStr << " and -"
-                 << loadProfileFileOpt.ArgStr
+  if (profilingGraph() && quantizingGraph()) {
+    llvm::errs() << "Loader: the profile dumping and loading options may not "
+                    "be specified together.\n";
+    return true;
+  }
+
+  for (auto *opt : {&quantizeWeightsOnlyOpt, &quantizeDynamicallyOpt}) {
+    if (*opt && (profilingGraph() || quantizingGraph())) {
+      llvm::errs() << "Loader: -" << opt->ArgStr
+                   << " may not be combined with the profile options.\n";
+      return true;
+    }
+  }
+  if (quantizeWeightsOnlyOpt && quantizeDynamicallyOpt) {
+    llvm::errs() << "Loader: the -" << quantizeWeightsOnlyOpt.ArgStr
+                 << " and -" << quantizeDynamicallyOpt.ArgStr
+                 << " options may not be specified together.\n";
+    return true;
+  }
+
+  if (!loadPrecisionPolicyOpt.empty() && !quantizingGraph()) {
+    llvm::errs() << "Loader: -" << loadPrecisionPolicyOpt.ArgStr
+                 << " needs a profile to quantize the graph with.\n";
+    return true;
+  }
+  if (!loadProfileFileOpt.empty() && !loadRawProfilesOpt.empty()) {
+    llvm::errs() << "Loader: the -" << loadProfileFileOpt.ArgStr << " and -"
+                 << loadRawProfilesOpt.ArgStr
                  << " options may not be specified together.\n";
     return true;
   }
@@ -209,7 +381,7 @@ static Kinded::Kind getKindFromNodeName(llvm::StringRef nodeName) {
 
 void Loader::compile() {
   // Handle the request to profile the graph in preperation for quantization.
-  if (!dumpProfileFileOpt.empty()) {
+  if (profilingGraph()) {
     // Perform the high-level optimizations before instrumenting the graph. This
     // optimization phase will remove stuff like repetitive transpose operations
     // perform CSE, etc.
@@ -220,13 +392,17 @@ void Loader::compile() {
   }
 
   // Load the quantization profile and transform the graph.
-  if (!loadProfileFileOpt.empty()) {
+  if (quantizingGraph()) {
     // The profiled graph was optimized before it was instrumentated. In this
     // part of the code we repeat the same transformation in order to create
     // the same graph structure.
     ::optimize(F_, glow::CompilationMode::Infer);
 
-    auto quantizationInfos = deserializeFromYaml(loadProfileFileOpt);
+    std::vector<NodePrecisionInfo> nodePrecisions;
+    if (!loadPrecisionPolicyOpt.empty()) {
+      nodePrecisions =
+          deserializePrecisionPolicyFromYaml(loadPrecisionPolicyOpt);
+    }
 
     // In AOT compilation mode the name of the symbol depends on the name of the
     // function. Our tutorial expects the quantized name to be identical to the
@@ -235,18 +411,8 @@ void Loader::compile() {
     std::string oldName = F_->getName();
     F_->setName("old");
 
-    // By default, when quantizing loaded models, all nodes that can be
-    // quantized are quantized. However, some models that are loaded may need to
-    // keep higher precision for some nodes to prevent high accuracy loss. This
-    // set is passed into quantizeFunction() to prevent quantization.
-    KindSet doNotQuantizeKinds;
-    for (llvm::StringRef kindName : doNotQuantizeNodesOpt) {
-      doNotQuantizeKinds.insert(getKindFromNodeName(kindName));
-    }
-
     // Quantize the graph based on the captured profile.
-    auto *Q = quantization::quantizeFunction(EE_, quantizationInfos, F_,
-                                             oldName, doNotQuantizeKinds);
+    auto *Q = quantize(F_, loadQuantizationInfos(), oldName, nodePrecisions);
 
     // Erase the original function so that the redundant variables that are only
     // referenced by the original function will be removed.
@@ -254,22 +420,88 @@ void Loader::compile() {
     F_ = Q;
   }
 
+  // Quantize the fully connected layers without a profile.
+  if (quantizeWeightsOnlyOpt) {
+    quantization::quantizeWeightsOnly(EE_, F_);
+  }
+  if (quantizeDynamicallyOpt) {
+    quantization::quantizeDynamically(EE_, F_);
+  }
+
   if (emittingBundle()) {
     // Emit IR for the graph, compile it and save as a bundle.
     EE_.save(CompilationMode::Infer, F_, emitBundle, networkName);
   } else {
     // Emit IR for the graph and compile it.
-    EE_.compile(CompilationMode::Infer, F_, ctx);
+    bool fits = EE_.compile(CompilationMode::Infer, F_, ctx);
+    if (compileReportOpt) {
+      EE_.getCompileReport().dump(llvm::errs());
+    }
+    if (!fits) {
+      llvm::errs() << "Loader: the network does not fit in the memory "
+                      "budget.\n";
+      std::exit(1);
+    }
+    if (dumpMemoryUsageOpt) {
+      llvm::outs() << "Estimated from the graph: ";
+      F_->estimateMemoryUsage().dump(llvm::outs());
+      llvm::outs() << "Compiled: ";
+      EE_.getMemoryUsage().dump(llvm::outs());
+    }
   }
 
   if (dumpGraphOpt) {
     F_->dump();
   }
+  if (dumpCostOpt) {
+    F_->dumpCost(llvm::outs());
+  }
   if (!dumpGraphDAGFileOpt.empty()) {
     F_->dumpDAG(dumpGraphDAGFileOpt.c_str());
   }
 }
 
+std::vector<NodeQuantizationInfo> Loader::loadQuantizationInfos() {
+  if (!loadProfileFileOpt.empty()) {
+    return deserializeFromYaml(loadProfileFileOpt);
+  }
+
+  // Merge the raw profiles of all shards before choosing the parameters.
+  std::vector<NodeProfilingInfo> profilingInfos;
+  for (const std::string &fileName : loadRawProfilesOpt) {
+    quantization::mergeNodeProfilingInfos(
+        profilingInfos, deserializeProfilingInfosFromYaml(fileName));
+  }
+  if (profilingInfos.empty()) {
+    return {};
+  }
+  return quantization::generateNodeQuantizationInfos(
+      profilingInfos, quantizationSchema, quantizationCalibration);
+}
+
+Function *
+Loader::quantize(Function *F,
+                 llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+                 llvm::StringRef newName,
+                 llvm::ArrayRef<NodePrecisionInfo> nodePrecisions) {
+  // By default, when quantizing loaded models, all nodes that can be
+  // quantized are quantized. However, some models that are loaded may need to
+  // keep higher precision for some nodes to prevent high accuracy loss. This
+  // set is passed into quantizeFunction() to prevent quantization.
+  KindSet doNotQuantizeKinds;
+  for (llvm::StringRef kindName : doNotQuantizeNodesOpt) {
+    doNotQuantizeKinds.insert(getKindFromNodeName(kindName));
+  }
+  KindSet int16Kinds;
+  for (llvm::StringRef kindName : int16NodesOpt) {
+    int16Kinds.insert(getKindFromNodeName(kindName));
+  }
+
+  return quantization::quantizeFunction(
+      EE_, quantizationInfos, F, newName, doNotQuantizeKinds,
+      enableChannelwiseOpt, int16Kinds, nodePrecisions);
+}
+
 void Loader::runInference(llvm::ArrayRef<Variable *> variables,
                           llvm::ArrayRef<Tensor *> tensors) {
   assert(!emittingBundle() &&
@@ -290,11 +522,28 @@ void Loader::runInference(llvm::ArrayRef<Variable *> variables,
                                       iterationsOpt);
   }
 
+  dumpProfiles();
+}
+
+void Loader::runBatch(llvm::ArrayRef<Variable *> variables,
+                      llvm::ArrayRef<Tensor *> tensors) {
+  assert(!emittingBundle() &&
+         "No inference is performed in the bundle generation mode.");
+  updateVariables(variables, tensors);
+  EE_.run();
+}
+
+void Loader::dumpProfiles() {
   if (!dumpProfileFileOpt.empty()) {
     std::vector<NodeQuantizationInfo> QI =
-        quantization::generateNodeQuantizationInfos(F_, quantizationSchema);
+        quantization::generateNodeQuantizationInfos(F_, quantizationSchema,
+                                                    quantizationCalibration);
     serializeToYaml(dumpProfileFileOpt, QI);
   }
+  if (!dumpRawProfileFileOpt.empty()) {
+    serializeProfilingInfosToYaml(
+        dumpRawProfileFileOpt, quantization::generateNodeProfilingInfos(F_));
+  }
 }
 
 Loader::Loader(int argc, char **argv) {
@@ -307,6 +556,9 @@ Loader::Loader(int argc, char **argv) {
     std::exit(1);
   }
 
+  // The weights are loaded after this point, so they all follow the policy.
+  setTensorHugePages(tensorHugePagesOpt);
+
   if (modelPathOpt.size() > 2) {
     llvm::errs() << "-model flag should have either 1 or 2 paths assigned. "
                     "Please see flag's description.\n";
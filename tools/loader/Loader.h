@@ -16,15 +16,28 @@
 #ifndef GLOW_TOOLS_LOADER_LOADER_H
 #define GLOW_TOOLS_LOADER_LOADER_H
 
+#include "glow/Base/Tensor.h"
 #include "glow/ExecutionEngine/ExecutionEngine.h"
+#include "glow/Quantization/Quantization.h"
 
 namespace glow {
 
-class Tensor;
-
 /// \return true if emit bundle mode is enabled.
 bool emittingBundle();
 
+/// A validation input of the model: the name of its variable, and one tensor
+/// per sample.
+struct ValidationInput {
+  std::string name;
+  std::vector<Tensor> samples;
+};
+
+/// Parse the validation input \p spec, given as name:dims:file with the
+/// dimensions of one sample separated by 'x', and read the samples of the
+/// file of raw floats into \p input. \returns false if it is malformed or the
+/// file can not be read.
+bool parseValidationInput(llvm::StringRef spec, ValidationInput &input);
+
 /// Driver class for loading, compiling, and running inference for ONNX and
 /// Caffe2 models.
 class Loader {
@@ -42,6 +55,11 @@ class Loader {
 public:
   /// Getter for the Function.
   Function *getFunction() { return F_; }
+  /// Getter for the ExecutionEngine.
+  ExecutionEngine &getExecutionEngine() { return EE_; }
+  /// \returns the context the Function is compiled with, which must hold a
+  /// tensor for every placeholder of the Function before compile().
+  Context &getContext();
   /// Getter for the Caffe2 network file name.
   llvm::StringRef getCaffe2NetDescFilename() { return caffe2NetDescFilename_; }
   /// Getter for the Caffe2 weights file name.
@@ -58,11 +76,33 @@ public:
   /// dumping debug information.
   void compile();
 
+  /// \returns the quantization parameters of the profile given with
+  /// -load_profile or -load_raw_profiles, or nothing if no profile is given.
+  std::vector<NodeQuantizationInfo> loadQuantizationInfos();
+
+  /// \returns a copy of \p F named \p newName, quantized with the parameters
+  /// \p quantizationInfos and the node kinds chosen on the command line. The
+  /// precisions of \p nodePrecisions override the command line for the nodes
+  /// they name. \p F must be optimized as it was when it was profiled.
+  Function *quantize(Function *F,
+                     llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+                     llvm::StringRef newName,
+                     llvm::ArrayRef<NodePrecisionInfo> nodePrecisions = {});
+
   /// Runs inference, unless emit bundle mode is enabled. If inference is run
   /// then it will \return true, else false.
   void runInference(llvm::ArrayRef<Variable *> variables,
                     llvm::ArrayRef<Tensor *> tensors);
 
+  /// Update \p variables with \p tensors and run the inference once. Unlike
+  /// runInference(), it neither times the run nor dumps the profiles.
+  void runBatch(llvm::ArrayRef<Variable *> variables,
+                llvm::ArrayRef<Tensor *> tensors);
+
+  /// Write the quantization profiles captured during the inferences, if they
+  /// were requested from the command line.
+  void dumpProfiles();
+
   /// Create the Loader driver object, and parse/verify the command line
   /// parameters.
   Loader(int argc, char **argv);
@@ -0,0 +1,345 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Loader.h"
+
+#include "glow/Graph/Nodes.h"
+#include "glow/Importer/Caffe2.h"
+#include "glow/Importer/ONNX.h"
+#include "glow/Optimizer/Optimizer.h"
+#include "glow/Quantization/Serialization.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <unordered_set>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory searchCat("Mixed Precision Search Options");
+
+llvm::cl::list<std::string> validationInputsOpt(
+    "validation-input",
+    llvm::cl::desc("An input of the model as name:d0xd1x...:file, where the "
+                   "file holds the raw float values of consecutive validation "
+                   "samples of the input, each of the given dimensions"),
+    llvm::cl::value_desc("name:dims:file"), llvm::cl::OneOrMore,
+    llvm::cl::cat(searchCat));
+
+llvm::cl::opt<std::string> policyOutputOpt(
+    "precision-policy-output",
+    llvm::cl::desc("The file that receives the chosen precision of every "
+                   "node, to be used with -load_precision_policy"),
+    llvm::cl::value_desc("policy.yaml"), llvm::cl::Required,
+    llvm::cl::cat(searchCat));
+
+llvm::cl::opt<float> accuracyBudgetOpt(
+    "accuracy-budget",
+    llvm::cl::desc("The largest acceptable loss of accuracy against the float "
+                   "model, as measured by -accuracy-metric"),
+    llvm::cl::init(0.01), llvm::cl::cat(searchCat));
+
+/// How the outputs of a mixed precision model are compared to the outputs of
+/// the float model.
+enum class AccuracyMetric {
+  /// The fraction of the rows of the output whose largest element moves.
+  Top1,
+  /// The mean relative L2 distance of the outputs of the samples.
+  RelativeError,
+};
+
+llvm::cl::opt<AccuracyMetric> accuracyMetricOpt(
+    "accuracy-metric",
+    llvm::cl::desc("How the outputs are compared to the float outputs"),
+    llvm::cl::values(clEnumValN(AccuracyMetric::Top1, "top1",
+                                "The fraction of changed top-1 results over "
+                                "the rows of the output"),
+                     clEnumValN(AccuracyMetric::RelativeError, "relative",
+                                "The mean relative L2 error of the outputs")),
+    llvm::cl::init(AccuracyMetric::Top1), llvm::cl::cat(searchCat));
+
+llvm::cl::opt<unsigned> timingRunsOpt(
+    "timing-runs",
+    llvm::cl::desc("The number of timed inferences of every candidate, of "
+                   "which the fastest counts"),
+    llvm::cl::init(5), llvm::cl::cat(searchCat));
+} // namespace
+
+/// The measured cost of a candidate precision assignment.
+struct Measurement {
+  /// The accuracy loss against the float outputs.
+  double error;
+  /// The wall time of the fastest inference, in seconds.
+  double seconds;
+};
+
+/// Runs the candidate functions of a model over the validation samples.
+class Evaluator {
+  Loader &loader_;
+  /// The input variables, and the tensors of every sample.
+  std::vector<Variable *> inputs_;
+  std::vector<std::vector<Tensor *>> samples_;
+  Variable *output_;
+  /// The outputs of the float model for every sample.
+  std::vector<Tensor> reference_;
+
+  /// Compile \p F and run it on every sample, whose outputs are stored in
+  /// \p outputs. \returns the wall time of the fastest timed inference.
+  double run(Function *F, std::vector<Tensor> &outputs) {
+    auto &EE = loader_.getExecutionEngine();
+    EE.compile(CompilationMode::Infer, F, loader_.getContext());
+    outputs.clear();
+    for (auto &sample : samples_) {
+      loader_.runBatch(inputs_, sample);
+      outputs.push_back(output_->getPayload().clone());
+    }
+    double best = INFINITY;
+    for (unsigned i = 0; i < std::max(1u, unsigned(timingRunsOpt)); i++) {
+      auto start = std::chrono::steady_clock::now();
+      loader_.runBatch(inputs_, samples_[0]);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    return best;
+  }
+
+  /// \returns the accuracy loss of \p outputs against the float outputs.
+  double error(std::vector<Tensor> &outputs) {
+    double total = 0;
+    size_t count = 0;
+    for (size_t i = 0, e = outputs.size(); i < e; i++) {
+      auto out = outputs[i].getHandle();
+      auto ref = reference_[i].getHandle();
+      size_t size = out.size();
+      if (accuracyMetricOpt == AccuracyMetric::RelativeError) {
+        double diff = 0, norm = 0;
+        for (size_t j = 0; j < size; j++) {
+          diff += (out.raw(j) - ref.raw(j)) * (out.raw(j) - ref.raw(j));
+          norm += ref.raw(j) * ref.raw(j);
+        }
+        total += std::sqrt(diff) / std::max(std::sqrt(norm), 1e-12);
+        count++;
+        continue;
+      }
+      // Every row of the innermost dimension is a separate top-1 result.
+      size_t rowSize = outputs[i].dims().back();
+      for (size_t row = 0; row < size; row += rowSize) {
+        size_t outMax = row, refMax = row;
+        for (size_t j = row; j < row + rowSize; j++) {
+          outMax = out.raw(j) > out.raw(outMax) ? j : outMax;
+          refMax = ref.raw(j) > ref.raw(refMax) ? j : refMax;
+        }
+        total += outMax != refMax;
+        count++;
+      }
+    }
+    return count ? total / count : 0;
+  }
+
+public:
+  Evaluator(Loader &loader, llvm::ArrayRef<Variable *> inputs,
+            std::vector<ValidationInput> &validation, Variable *output)
+      : loader_(loader), inputs_(inputs), output_(output) {
+    for (size_t s = 0, e = validation[0].samples.size(); s < e; s++) {
+      std::vector<Tensor *> sample;
+      for (auto &input : validation) {
+        sample.push_back(&input.samples[s]);
+      }
+      samples_.push_back(sample);
+    }
+  }
+
+  /// Measure a copy of the float function \p F, whose outputs become the
+  /// reference of the later measurements.
+  Measurement measureFloat(Function *F) {
+    Function *copy = F->clone("float_candidate");
+    double seconds = run(copy, reference_);
+    copy->getParent()->eraseFunction(copy);
+    return {0, seconds};
+  }
+
+  /// Measure \p F quantized with \p quantizationInfos and the precisions
+  /// \p policy.
+  Measurement measure(Function *F,
+                      llvm::ArrayRef<NodeQuantizationInfo> quantizationInfos,
+                      llvm::ArrayRef<NodePrecisionInfo> policy) {
+    Function *Q =
+        loader_.quantize(F, quantizationInfos, "mixed_candidate", policy);
+    std::vector<Tensor> outputs;
+    double seconds = run(Q, outputs);
+    Q->getParent()->eraseFunction(Q);
+    return {error(outputs), seconds};
+  }
+};
+
+/// A change of the precision of a single node, with the effect it had when it
+/// was measured on its own.
+struct PrecisionMove {
+  size_t node;
+  ElemKind precision;
+  double errorGain;
+  double timeCost;
+};
+
+int main(int argc, char **argv) {
+  // The loader verifies/initializes command line parameters, and initializes
+  // the ExecutionEngine and Function.
+  Loader loader(argc, argv);
+  if (emittingBundle()) {
+    llvm::errs() << "MixedPrecisionSearch: bundles are not supported.\n";
+    return 1;
+  }
+
+  std::vector<ValidationInput> validation(validationInputsOpt.size());
+  for (size_t i = 0, e = validationInputsOpt.size(); i < e; i++) {
+    if (!parseValidationInput(validationInputsOpt[i], validation[i]) ||
+        validation[i].samples.size() != validation[0].samples.size()) {
+      llvm::errs() << "MixedPrecisionSearch: invalid -"
+                   << validationInputsOpt.ArgStr << " "
+                   << validationInputsOpt[i] << "\n";
+      return 1;
+    }
+  }
+  std::vector<NodeQuantizationInfo> quantizationInfos =
+      loader.loadQuantizationInfos();
+  if (quantizationInfos.empty()) {
+    llvm::errs() << "MixedPrecisionSearch: a profile is needed, given with "
+                    "-load_profile or -load_raw_profiles.\n";
+    return 1;
+  }
+
+  // Create the model based on the input net, with the first samples giving
+  // the types of the inputs.
+  std::vector<const char *> inputNames;
+  std::vector<Tensor *> inputTensors;
+  for (auto &input : validation) {
+    inputNames.push_back(input.name.c_str());
+    inputTensors.push_back(&input.samples[0]);
+  }
+  std::unique_ptr<ProtobufLoader> LD;
+  Function *F = loader.getFunction();
+  if (!loader.getCaffe2NetDescFilename().empty()) {
+    LD.reset(new caffe2ModelLoader(loader.getCaffe2NetDescFilename(),
+                                   loader.getCaffe2NetWeightFilename(),
+                                   inputNames, inputTensors, *F));
+  } else {
+    LD.reset(new ONNXModelLoader(loader.getOnnxModelFilename(), inputNames,
+                                 inputTensors, *F));
+  }
+  std::vector<Variable *> inputs;
+  for (auto &input : validation) {
+    inputs.push_back(LD->getVariableByName(input.name));
+  }
+  Evaluator evaluator(loader, inputs, validation, LD->getSingleOutput());
+
+  // The profile was captured on the optimized graph, whose node names the
+  // policy refers to.
+  ::optimize(F, CompilationMode::Infer);
+
+  // The candidates are the nodes that the profile covers.
+  std::unordered_set<std::string> profiled;
+  for (const auto &info : quantizationInfos) {
+    profiled.insert(info.nodeOutputName_);
+  }
+  auto &EE = loader.getExecutionEngine();
+  std::vector<NodePrecisionInfo> policy;
+  for (auto &N : F->getNodes()) {
+    if (N.getNumResults() &&
+        profiled.count(NodeQuantizationInfo::generateNodeOutputName(
+            N.getName().str()))) {
+      policy.emplace_back(N.getName().str(), ElemKind::Int8QTy);
+    }
+  }
+
+  Measurement reference = evaluator.measureFloat(F);
+  Measurement current = evaluator.measure(F, quantizationInfos, policy);
+  llvm::outs() << llvm::formatv("float: {0:f6} s, int8: {1:f6} s with an "
+                                "error of {2:f6}\n",
+                                reference.seconds, current.seconds,
+                                current.error);
+
+  // Measure the effect of raising the precision of every node on its own.
+  std::vector<PrecisionMove> moves;
+  if (current.error > accuracyBudgetOpt) {
+    for (size_t i = 0, e = policy.size(); i < e; i++) {
+      Node *N = F->getNodeByName(policy[i].nodeName_);
+      std::vector<ElemKind> precisions = {ElemKind::FloatTy};
+      if (EE.isOpSupported(N->getKind(), ElemKind::Int16QTy)) {
+        precisions.push_back(ElemKind::Int16QTy);
+      }
+      for (ElemKind precision : precisions) {
+        policy[i].precision_ = precision;
+        Measurement m = evaluator.measure(F, quantizationInfos, policy);
+        if (m.error < current.error) {
+          moves.push_back({i, precision, current.error - m.error,
+                           m.seconds - current.seconds});
+        }
+      }
+      policy[i].precision_ = ElemKind::Int8QTy;
+    }
+  }
+
+  // Greedily apply the moves that buy the most accuracy per second, keeping
+  // those that still help once combined with the previous ones.
+  std::sort(moves.begin(), moves.end(),
+            [](const PrecisionMove &a, const PrecisionMove &b) {
+              return a.errorGain * std::max(b.timeCost, 1e-9) >
+                     b.errorGain * std::max(a.timeCost, 1e-9);
+            });
+  std::vector<bool> moved(policy.size());
+  for (const auto &move : moves) {
+    if (current.error <= accuracyBudgetOpt) {
+      break;
+    }
+    if (moved[move.node]) {
+      continue;
+    }
+    policy[move.node].precision_ = move.precision;
+    Measurement m = evaluator.measure(F, quantizationInfos, policy);
+    if (m.error < current.error) {
+      moved[move.node] = true;
+      current = m;
+    } else {
+      policy[move.node].precision_ = ElemKind::Int8QTy;
+    }
+  }
+
+  serializePrecisionPolicyToYaml(policyOutputOpt, policy);
+  size_t counts[3] = {0, 0, 0};
+  for (const auto &info : policy) {
+    counts[info.precision_ == ElemKind::FloatTy
+               ? 0
+               : info.precision_ == ElemKind::Int16QTy ? 1 : 2]++;
+  }
+  llvm::outs() << llvm::formatv(
+      "policy: {0} float, {1} int16 and {2} int8 nodes, {3:f6} s ({4:f2}x "
+      "the float model) with an error of {5:f6}\n",
+      counts[0], counts[1], counts[2], current.seconds,
+      reference.seconds / current.seconds, current.error);
+  if (current.error > accuracyBudgetOpt) {
+    llvm::errs() << "MixedPrecisionSearch: no policy meets the accuracy "
+                    "budget; the most accurate one found was written.\n";
+    return 1;
+  }
+  return 0;
+}
@@ -15,31 +15,216 @@
  */
 
 #include "Loader.h"
+#include "ModelServer.h"
 
 #include "glow/Graph/Nodes.h"
 #include "glow/Importer/Caffe2.h"
 #include "glow/Importer/ONNX.h"
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <csignal>
 #include <memory>
+#include <unistd.h>
 
 using namespace glow;
 
+namespace {
+llvm::cl::OptionCategory modelRunnerCat("Model Runner Options");
+
+llvm::cl::opt<bool> serverOpt(
+    "server",
+    llvm::cl::desc("Keep the compiled model resident and serve the inferences "
+                   "of the requests read from -server-socket, or from stdin "
+                   "with the responses written to stdout, instead of running "
+                   "once"),
+    llvm::cl::Optional, llvm::cl::init(false), llvm::cl::cat(modelRunnerCat));
+
+llvm::cl::list<std::string> serverInputsOpt(
+    "server-input",
+    llvm::cl::desc("An input of the model served with -server, whose first "
+                   "dimension is the batch, as name:d0xd1x... for float or "
+                   "name:i64:d0xd1x... for int64 inputs"),
+    llvm::cl::value_desc("name:dims"), llvm::cl::ZeroOrMore,
+    llvm::cl::cat(modelRunnerCat));
+
+llvm::cl::opt<std::string> serverSocketOpt(
+    "server-socket",
+    llvm::cl::desc("The Unix domain socket that -server listens on for "
+                   "clients, which are served concurrently"),
+    llvm::cl::value_desc("path"), llvm::cl::Optional,
+    llvm::cl::cat(modelRunnerCat));
+
+llvm::cl::opt<unsigned> serverLatencyUsOpt(
+    "server-max-latency-us",
+    llvm::cl::desc("The time in microseconds that a request of -server waits "
+                   "for the batch to fill up"),
+    llvm::cl::Optional, llvm::cl::init(1000), llvm::cl::cat(modelRunnerCat));
+
+llvm::cl::opt<unsigned> serverBatchersOpt(
+    "server-batchers",
+    llvm::cl::desc("The number of batches of -server that run at the same "
+                   "time, each with its own context"),
+    llvm::cl::Optional, llvm::cl::init(1), llvm::cl::cat(modelRunnerCat));
+
+llvm::cl::opt<unsigned> serverCacheMBOpt(
+    "server-cache-mb",
+    llvm::cl::desc("The memory budget in MB of the cache of the results of "
+                   "-server, which answers repeated requests without running "
+                   "the model, or 0 to disable it"),
+    llvm::cl::Optional, llvm::cl::init(0), llvm::cl::cat(modelRunnerCat));
+} // namespace
+
+/// Parse the -server-input \p spec into \p name and a zero tensor \p T of
+/// its type. \returns false if it is malformed.
+static bool parseServerInput(llvm::StringRef spec, std::string &name,
+                             Tensor &T) {
+  llvm::SmallVector<llvm::StringRef, 3> parts;
+  spec.split(parts, ':');
+  if (parts.size() < 2 || parts.size() > 3 ||
+      (parts.size() == 3 && parts[1] != "i64")) {
+    return false;
+  }
+  std::vector<size_t> dims;
+  llvm::SmallVector<llvm::StringRef, max_tensor_dimensions> dimStrs;
+  parts.back().split(dimStrs, 'x');
+  for (auto d : dimStrs) {
+    size_t dim;
+    if (d.getAsInteger(10, dim) || !dim) {
+      return false;
+    }
+    dims.push_back(dim);
+  }
+  if (dims.empty() || dims.size() > max_tensor_dimensions) {
+    return false;
+  }
+  name = parts[0];
+  T.reset(parts.size() == 3 ? ElemKind::Int64ITy : ElemKind::FloatTy, dims);
+  return true;
+}
+
+/// Replace the public variable \p V of \p F, which the loader created for an
+/// input or an output of the model, with a placeholder of the same type.
+/// \returns the placeholder.
+static Placeholder *replaceWithPlaceholder(Function *F, Variable *V) {
+  auto *M = F->getParent();
+  std::string name = V->getName();
+  TypeRef T = V->getType();
+  // The output variables are written by a save node, which is recreated.
+  SaveNode *save = nullptr;
+  for (auto &N : F->getNodes()) {
+    auto *SN = llvm::dyn_cast<SaveNode>(&N);
+    if (SN && SN->getOutput().getNode() == V) {
+      save = SN;
+      break;
+    }
+  }
+  NodeValue saved = save ? save->getInput() : NodeValue();
+  if (save) {
+    F->eraseNode(save);
+  }
+  auto *PH = M->createPlaceholder(T, name, false);
+  NodeValue(V, 0).replaceAllUsesOfWith(PH);
+  M->eraseVariable(V);
+  if (saved.getNode()) {
+    F->createSave("save_" + name, saved, PH);
+  }
+  return PH;
+}
+
+/// Compile the model of \p loader, whose inputs \p inputNames and outputs
+/// \p LD are replaced with placeholders, and serve its inferences until the
+/// process is killed or the stdin stream ends. \returns the exit code.
+static int serve(Loader &loader, ProtobufLoader &LD,
+                 llvm::ArrayRef<std::string> inputNames) {
+  Function *F = loader.getFunction();
+  std::vector<Placeholder *> inputs;
+  std::vector<Placeholder *> outputs;
+  for (const auto &name : inputNames) {
+    inputs.push_back(replaceWithPlaceholder(F, LD.getVariableByName(name)));
+  }
+  // The outputs are served in the order of their names.
+  std::vector<std::string> outputNames;
+  for (const auto &output : LD.getOutputs()) {
+    outputNames.push_back(output.getKey());
+  }
+  std::sort(outputNames.begin(), outputNames.end());
+  for (const auto &name : outputNames) {
+    outputs.push_back(replaceWithPlaceholder(F, LD.getOutputByName(name)));
+  }
+  for (auto *PH : inputs) {
+    loader.getContext().allocate(PH);
+  }
+  for (auto *PH : outputs) {
+    loader.getContext().allocate(PH);
+  }
+  loader.compile();
+
+  ModelServer server(loader.getExecutionEngine(), inputs, outputs,
+                     std::chrono::microseconds(serverLatencyUsOpt),
+                     serverBatchersOpt, size_t(serverCacheMBOpt) << 20);
+  // A client that goes away must not kill the server.
+  std::signal(SIGPIPE, SIG_IGN);
+  if (serverSocketOpt.empty()) {
+    bool served = server.serveStream(STDIN_FILENO, STDOUT_FILENO);
+    if (auto *cache = server.getResultCache()) {
+      auto stats = cache->getStats();
+      llvm::errs() << "Result cache: " << stats.hits << " hits, "
+                   << stats.misses << " misses (hit rate "
+                   << stats.getHitRate() << "), " << stats.evictions
+                   << " evictions, " << stats.numEntries << " entries of "
+                   << stats.sizeInBytes << " bytes\n";
+    }
+    return served ? 0 : 1;
+  }
+  server.serveSocket(serverSocketOpt);
+  return 1;
+}
+
 int main(int argc, char **argv) {
   // The loader verifies/initializes command line parameters, and initializes
   // the ExecutionEngine and Function.
   Loader loader(argc, argv);
 
+  // The inputs of the served model are fed by the clients.
+  std::vector<std::string> inputNames(serverInputsOpt.size());
+  std::vector<Tensor> inputTensors(serverInputsOpt.size());
+  for (size_t i = 0, e = serverInputsOpt.size(); i < e; i++) {
+    if (!serverOpt ||
+        !parseServerInput(serverInputsOpt[i], inputNames[i], inputTensors[i])) {
+      llvm::errs() << "ModelRunner: invalid -" << serverInputsOpt.ArgStr << " "
+                   << serverInputsOpt[i] << "\n";
+      return 1;
+    }
+  }
+  if (serverOpt && (inputNames.empty() || emittingBundle())) {
+    llvm::errs() << "ModelRunner: -" << serverOpt.ArgStr << " needs at least "
+                 << "one -" << serverInputsOpt.ArgStr
+                 << " and no bundle.\n";
+    return 1;
+  }
+  std::vector<const char *> inputNamePtrs;
+  std::vector<Tensor *> inputTensorPtrs;
+  for (size_t i = 0, e = inputNames.size(); i < e; i++) {
+    inputNamePtrs.push_back(inputNames[i].c_str());
+    inputTensorPtrs.push_back(&inputTensors[i]);
+  }
+
   // Create the model based on the input net, and get SaveNode for the output.
   std::unique_ptr<ProtobufLoader> LD;
   if (!loader.getCaffe2NetDescFilename().empty()) {
     LD.reset(new caffe2ModelLoader(loader.getCaffe2NetDescFilename(),
-                                   loader.getCaffe2NetWeightFilename(), {}, {},
+                                   loader.getCaffe2NetWeightFilename(),
+                                   inputNamePtrs, inputTensorPtrs,
                                    *loader.getFunction()));
   } else {
-    LD.reset(new ONNXModelLoader(loader.getOnnxModelFilename(), {}, {},
-                                 *loader.getFunction()));
+    LD.reset(new ONNXModelLoader(loader.getOnnxModelFilename(), inputNamePtrs,
+                                 inputTensorPtrs, *loader.getFunction()));
+  }
+  if (serverOpt) {
+    return serve(loader, *LD, inputNames);
   }
   Variable *output = LD->getSingleOutput();
 
@@ -0,0 +1,281 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ModelServer.h"
+
+#include "glow/Graph/Nodes.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace glow;
+
+namespace {
+/// The kinds of the elements of the tensors of the stream.
+enum class WireKind : uint32_t { Float = 0, Int64 = 1 };
+
+/// Read \p size bytes from \p fd to \p buf. \returns false if the stream ends
+/// or fails before.
+bool readFull(int fd, void *buf, size_t size) {
+  auto *ptr = static_cast<char *>(buf);
+  while (size) {
+    ssize_t n = ::read(fd, ptr, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Write the \p size bytes of \p buf to \p fd. \returns false if it fails.
+bool writeFull(int fd, const void *buf, size_t size) {
+  auto *ptr = static_cast<const char *>(buf);
+  while (size) {
+    ssize_t n = ::write(fd, ptr, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// A tensor read from the stream, before it is checked against its
+/// placeholder.
+struct WireTensor {
+  uint32_t kind;
+  std::vector<size_t> dims;
+  std::vector<char> payload;
+};
+
+/// \returns the size of the elements of the kind \p kind, or 0 if the kind is
+/// unknown.
+size_t getWireElementSize(uint32_t kind) {
+  switch (static_cast<WireKind>(kind)) {
+  case WireKind::Float:
+    return sizeof(float);
+  case WireKind::Int64:
+    return sizeof(int64_t);
+  }
+  return 0;
+}
+
+/// Read a tensor from \p fd to \p T. \returns false if the stream ends or
+/// the tensor is malformed, in which case the rest of the stream can't be
+/// parsed.
+bool readTensor(int fd, WireTensor &T) {
+  uint32_t header[2];
+  if (!readFull(fd, header, sizeof(header))) {
+    return false;
+  }
+  T.kind = header[0];
+  size_t elementSize = getWireElementSize(T.kind);
+  if (!elementSize || header[1] > max_tensor_dimensions) {
+    return false;
+  }
+  uint64_t dims[max_tensor_dimensions];
+  if (!readFull(fd, dims, header[1] * sizeof(uint64_t))) {
+    return false;
+  }
+  T.dims.assign(dims, dims + header[1]);
+  size_t size = elementSize;
+  for (auto d : T.dims) {
+    size *= d;
+  }
+  T.payload.resize(size);
+  return readFull(fd, T.payload.data(), size);
+}
+
+/// Write \p T to \p fd. \returns false if it fails.
+bool writeTensor(int fd, const Tensor &T) {
+  uint32_t header[2] = {
+      uint32_t(T.getElementType() == ElemKind::Int64ITy ? WireKind::Int64
+                                                         : WireKind::Float),
+      uint32_t(T.dims().size())};
+  std::vector<uint64_t> dims(T.dims().begin(), T.dims().end());
+  return writeFull(fd, header, sizeof(header)) &&
+         writeFull(fd, dims.data(), dims.size() * sizeof(uint64_t)) &&
+         writeFull(fd, T.getUnsafePtr(), T.getType().getSizeInBytes());
+}
+
+/// Write an error response with the message \p message to \p fd. \returns
+/// false if it fails.
+bool writeError(int fd, const std::string &message) {
+  uint32_t header[2] = {1, uint32_t(message.size())};
+  return writeFull(fd, header, sizeof(header)) &&
+         writeFull(fd, message.data(), message.size());
+}
+
+/// \returns the type of the samples of the batched placeholder \p PH.
+Type getSampleType(const Placeholder *PH) {
+  return Type::newShape(*PH->getType(), PH->getType()->dims().drop_front());
+}
+
+/// \returns an empty string if \p T is a sample of \p PH, or else the reason
+/// why it is not.
+std::string checkSample(const WireTensor &T, const Placeholder *PH) {
+  auto kind = PH->getElementType();
+  bool sameKind =
+      (kind == ElemKind::FloatTy && T.kind == uint32_t(WireKind::Float)) ||
+      (kind == ElemKind::Int64ITy && T.kind == uint32_t(WireKind::Int64));
+  if (!sameKind) {
+    return "the element kind of " + PH->getName().str() + " does not match";
+  }
+  if (llvm::ArrayRef<size_t>(T.dims) != PH->getType()->dims().drop_front()) {
+    return "the dims of " + PH->getName().str() +
+           " are not those of a sample";
+  }
+  return "";
+}
+} // namespace
+
+ModelServer::ModelServer(ExecutionEngine &EE,
+                         llvm::ArrayRef<Placeholder *> inputs,
+                         llvm::ArrayRef<Placeholder *> outputs,
+                         std::chrono::microseconds maxLatency,
+                         unsigned numBatchers, size_t cacheBytes)
+    : inputs_(inputs.begin(), inputs.end()),
+      outputs_(outputs.begin(), outputs.end()) {
+  if (cacheBytes) {
+    cache_ = llvm::make_unique<ResultCache>(cacheBytes);
+  }
+  // The server holds a single model, so its version is always 0.
+  for (unsigned i = 0; i < std::max(numBatchers, 1u); i++) {
+    batchers_.push_back(llvm::make_unique<Batcher>(
+        EE, inputs_, outputs_, maxLatency, /* maxBatchSize */ 0, cache_.get(),
+        /* modelVersion */ 0));
+  }
+}
+
+bool ModelServer::serveStream(int inFD, int outFD) {
+  while (true) {
+    uint32_t numTensors;
+    if (!readFull(inFD, &numTensors, sizeof(numTensors))) {
+      // The client is done.
+      return true;
+    }
+    std::vector<WireTensor> wire(numTensors);
+    for (auto &T : wire) {
+      if (!readTensor(inFD, T)) {
+        return false;
+      }
+    }
+
+    std::string error;
+    if (numTensors != inputs_.size()) {
+      error = "expected " + std::to_string(inputs_.size()) + " inputs";
+    }
+    for (size_t i = 0; error.empty() && i < numTensors; i++) {
+      error = checkSample(wire[i], inputs_[i]);
+    }
+    if (!error.empty()) {
+      if (!writeError(outFD, error)) {
+        return false;
+      }
+      continue;
+    }
+
+    std::vector<Tensor> samples;
+    std::vector<Tensor> results;
+    for (size_t i = 0; i < numTensors; i++) {
+      samples.emplace_back(getSampleType(inputs_[i]));
+      memcpy(samples.back().getUnsafePtr(), wire[i].payload.data(),
+             wire[i].payload.size());
+    }
+    for (auto *PH : outputs_) {
+      results.emplace_back(getSampleType(PH));
+    }
+    std::vector<Tensor *> sampleRefs;
+    std::vector<Tensor *> resultRefs;
+    for (auto &T : samples) {
+      sampleRefs.push_back(&T);
+    }
+    for (auto &T : results) {
+      resultRefs.push_back(&T);
+    }
+    // Spread the requests between the batchers, so that the batches of the
+    // concurrent clients run at the same time.
+    auto &batcher = *batchers_[nextBatcher_++ % batchers_.size()];
+    batcher.enqueue(sampleRefs, resultRefs).wait();
+
+    uint32_t header[2] = {0, uint32_t(results.size())};
+    if (!writeFull(outFD, header, sizeof(header))) {
+      return false;
+    }
+    for (auto &T : results) {
+      if (!writeTensor(outFD, T)) {
+        return false;
+      }
+    }
+  }
+}
+
+bool ModelServer::serveSocket(llvm::StringRef path) {
+  sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    llvm::errs() << "ModelServer: the socket path is too long.\n";
+    return false;
+  }
+  int listenFD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFD < 0) {
+    llvm::errs() << "ModelServer: " << strerror(errno) << "\n";
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.data(), path.size());
+  // Replace the socket of a previous server.
+  ::unlink(addr.sun_path);
+  if (::bind(listenFD, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ||
+      ::listen(listenFD, SOMAXCONN)) {
+    llvm::errs() << "ModelServer: " << strerror(errno) << "\n";
+    ::close(listenFD);
+    return false;
+  }
+
+  while (true) {
+    int clientFD = ::accept(listenFD, nullptr, nullptr);
+    if (clientFD < 0) {
+      if (errno != EINTR) {
+        llvm::errs() << "ModelServer: " << strerror(errno) << "\n";
+      }
+      continue;
+    }
+    // The server runs until the process is killed, so the clients never
+    // outlive it.
+    std::thread([this, clientFD]() {
+      serveStream(clientFD, clientFD);
+      ::close(clientFD);
+    }).detach();
+  }
+}
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef GLOW_TOOLS_LOADER_MODELSERVER_H
+#define GLOW_TOOLS_LOADER_MODELSERVER_H
+
+#include "glow/ExecutionEngine/Batcher.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace glow {
+
+class Placeholder;
+
+/// Serves the inferences of a function compiled by an ExecutionEngine to the
+/// clients of a stream, so that the model is imported and compiled once for
+/// all of them. The requests hold one sample of every input: the first
+/// dimension of the placeholders is the batch, and the samples of concurrent
+/// clients are packed into batches by several Batchers, which run with their
+/// own contexts at the same time. Optionally, the results are cached by the
+/// content of the requests, which are then answered without a batch when they
+/// repeat.
+///
+/// A request is a list of tensors, one per input placeholder in order, and
+/// its response is either the list of the output tensors, in order, or an
+/// error. All of the integers are in the byte order of the host:
+///
+///   request:  uint32 numTensors, tensor * numTensors
+///   response: uint32 status == 0, uint32 numTensors, tensor * numTensors
+///             or uint32 status != 0, uint32 length, char message[length]
+///   tensor:   uint32 kind (0 for float, 1 for int64), uint32 numDims,
+///             uint64 dims[numDims], the elements in row-major order
+///
+/// The dims of a tensor are the dims of its placeholder without the batch.
+/// A client closes the stream once it is done.
+class ModelServer final {
+  /// The input placeholders of the function.
+  std::vector<Placeholder *> inputs_;
+  /// The output placeholders of the function.
+  std::vector<Placeholder *> outputs_;
+  /// The cache of the results shared by the batchers, or null.
+  std::unique_ptr<ResultCache> cache_;
+  /// The batchers that the clients are spread between.
+  std::vector<std::unique_ptr<Batcher>> batchers_;
+  /// The batcher of the next request.
+  std::atomic<size_t> nextBatcher_{0};
+
+public:
+  /// Ctor. The function compiled by \p EE reads the batched \p inputs and
+  /// writes the batched \p outputs. The samples are served by \p numBatchers
+  /// batchers, whose partial batches run when their oldest request waited for
+  /// \p maxLatency. If \p cacheBytes is not zero, the results of up to that
+  /// many bytes of requests and responses are cached.
+  ModelServer(ExecutionEngine &EE, llvm::ArrayRef<Placeholder *> inputs,
+              llvm::ArrayRef<Placeholder *> outputs,
+              std::chrono::microseconds maxLatency, unsigned numBatchers,
+              size_t cacheBytes = 0);
+
+  /// \returns the result cache, or null if the results are not cached.
+  const ResultCache *getResultCache() const { return cache_.get(); }
+
+  /// Serve the requests read from the file descriptor \p inFD, writing the
+  /// responses to \p outFD, until the end of the stream. \returns false if
+  /// the stream ended in the middle of a request or could not be written.
+  bool serveStream(int inFD, int outFD);
+
+  /// Listen on the Unix domain socket \p path and serve every client that
+  /// connects to it on a thread of its own. It only returns, false, if the
+  /// socket can't be set up.
+  bool serveSocket(llvm::StringRef path);
+};
+
+} // namespace glow
+
+#endif // GLOW_TOOLS_LOADER_MODELSERVER_H
@@ -0,0 +1,407 @@
+/**
+ * Copyright (c) 2017-present, Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Loader.h"
+
+#include "glow/Graph/Nodes.h"
+#include "glow/Importer/Caffe2.h"
+#include "glow/Importer/ONNX.h"
+#include "glow/Optimizer/Optimizer.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <unordered_set>
+
+using namespace glow;
+
+namespace {
+llvm::cl::OptionCategory reportCat("Quantization Report Options");
+
+llvm::cl::list<std::string> validationInputsOpt(
+    "validation-input",
+    llvm::cl::desc("An input of the model as name:d0xd1x...:file, where the "
+                   "file holds the raw float values of consecutive validation "
+                   "samples of the input, each of the given dimensions"),
+    llvm::cl::value_desc("name:dims:file"), llvm::cl::OneOrMore,
+    llvm::cl::cat(reportCat));
+
+llvm::cl::opt<std::string> validationLabelsOpt(
+    "validation-labels",
+    llvm::cl::desc("A text file with the expected class of every row of the "
+                   "outputs of the validation samples, in order. Without it, "
+                   "the top-1 results of the float model are the labels"),
+    llvm::cl::value_desc("labels.txt"), llvm::cl::cat(reportCat));
+
+llvm::cl::opt<unsigned> timingRunsOpt(
+    "timing-runs",
+    llvm::cl::desc("The number of timed inferences of each model, whose "
+                   "median and 99th percentile latencies are reported"),
+    llvm::cl::init(20), llvm::cl::cat(reportCat));
+
+llvm::cl::opt<unsigned> layerSamplesOpt(
+    "layer-error-samples",
+    llvm::cl::desc("The number of validation samples on which the error of "
+                   "the output of every layer is measured"),
+    llvm::cl::init(4), llvm::cl::cat(reportCat));
+
+llvm::cl::opt<unsigned> reportLayersOpt(
+    "report-layers",
+    llvm::cl::desc("The number of layers with the largest errors that are "
+                   "reported"),
+    llvm::cl::init(20), llvm::cl::cat(reportCat));
+
+llvm::cl::opt<float> maxTop1DropOpt(
+    "max-top1-drop",
+    llvm::cl::desc("Fail if the top-1 accuracy of the quantized model is "
+                   "lower than the one of the float model by more than this"),
+    llvm::cl::init(1), llvm::cl::cat(reportCat));
+} // namespace
+
+/// The accuracy and the speed of a model on the validation set.
+struct ModelStats {
+  double top1{0};
+  double top5{0};
+  /// The median and the 99th percentile latencies of an inference, in
+  /// seconds.
+  double medianSeconds{0};
+  double p99Seconds{0};
+  /// The number of rows of the output computed per second.
+  double rowsPerSecond{0};
+};
+
+/// The largest error of the output of a layer of the quantized model, and
+/// the largest magnitude of the same output in the float model.
+struct LayerError {
+  std::string name;
+  double maxError;
+  double maxMagnitude;
+};
+
+/// Compiles the functions of a model and runs them over the validation
+/// samples.
+class Runner {
+  Loader &loader_;
+  /// The input variables, and the tensors of every sample.
+  std::vector<Variable *> inputs_;
+  std::vector<std::vector<Tensor *>> samples_;
+
+public:
+  Runner(Loader &loader, llvm::ArrayRef<Variable *> inputs,
+         std::vector<ValidationInput> &validation)
+      : loader_(loader), inputs_(inputs) {
+    for (size_t s = 0, e = validation[0].samples.size(); s < e; s++) {
+      std::vector<Tensor *> sample;
+      for (auto &input : validation) {
+        sample.push_back(&input.samples[s]);
+      }
+      samples_.push_back(sample);
+    }
+  }
+
+  size_t getNumSamples() const { return samples_.size(); }
+
+  /// Compile \p F and run it on the first \p numSamples samples. After every
+  /// run, the payloads of \p outputs are appended to \p results.
+  void run(Function *F, size_t numSamples, llvm::ArrayRef<Variable *> outputs,
+           std::vector<Tensor> &results) {
+    auto &EE = loader_.getExecutionEngine();
+    EE.compile(CompilationMode::Infer, F, loader_.getContext());
+    for (size_t s = 0; s < std::min(numSamples, samples_.size()); s++) {
+      loader_.runBatch(inputs_, samples_[s]);
+      for (auto *output : outputs) {
+        results.push_back(output->getPayload().clone());
+      }
+    }
+  }
+
+  /// \returns the sorted latencies of -timing-runs inferences of the last
+  /// function run, cycling through the samples.
+  std::vector<double> time() {
+    std::vector<double> times;
+    for (unsigned i = 0; i < std::max(1u, unsigned(timingRunsOpt)); i++) {
+      auto start = std::chrono::steady_clock::now();
+      loader_.runBatch(inputs_, samples_[i % samples_.size()]);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      times.push_back(elapsed.count());
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+  }
+};
+
+/// \returns the \p p-th percentile, between 0 and 100, of the sorted
+/// \p times with the nearest-rank method.
+static double percentile(llvm::ArrayRef<double> times, double p) {
+  size_t rank = std::ceil(p / 100 * times.size());
+  return times[std::min(std::max<size_t>(rank, 1), times.size()) - 1];
+}
+
+/// Read the whitespace separated class indices of \p file into \p labels.
+/// \returns false if the file can not be read or holds anything else.
+static bool readLabels(llvm::StringRef file, std::vector<size_t> &labels) {
+  auto buffer = llvm::MemoryBuffer::getFile(file);
+  if (!buffer) {
+    return false;
+  }
+  auto token = llvm::getToken((*buffer)->getBuffer());
+  for (; !token.first.empty(); token = llvm::getToken(token.second)) {
+    size_t label;
+    if (token.first.getAsInteger(10, label)) {
+      return false;
+    }
+    labels.push_back(label);
+  }
+  return true;
+}
+
+/// \returns the number of rows of the innermost dimension of \p outputs,
+/// every one of which holds the scores of the classes of one result.
+static size_t getNumRows(llvm::ArrayRef<Tensor> outputs) {
+  size_t rows = 0;
+  for (const auto &T : outputs) {
+    rows += T.size() / T.dims().back();
+  }
+  return rows;
+}
+
+/// \returns the class with the highest score of every row of \p outputs.
+static std::vector<size_t> getTop1(std::vector<Tensor> &outputs) {
+  std::vector<size_t> classes;
+  for (auto &T : outputs) {
+    auto H = T.getHandle();
+    size_t rowSize = T.dims().back();
+    for (size_t row = 0, e = H.size(); row < e; row += rowSize) {
+      size_t best = row;
+      for (size_t j = row; j < row + rowSize; j++) {
+        best = H.raw(j) > H.raw(best) ? j : best;
+      }
+      classes.push_back(best - row);
+    }
+  }
+  return classes;
+}
+
+/// Set the top-1 and top-5 accuracies of \p stats from \p outputs and
+/// \p labels, one for every row of the outputs. A row is counted as top-k
+/// when fewer than k classes score strictly higher than its label.
+static void measureAccuracy(std::vector<Tensor> &outputs,
+                            llvm::ArrayRef<size_t> labels, ModelStats &stats) {
+  size_t top1 = 0, top5 = 0, r = 0;
+  for (auto &T : outputs) {
+    auto H = T.getHandle();
+    size_t rowSize = T.dims().back();
+    for (size_t row = 0, e = H.size(); row < e; row += rowSize, r++) {
+      if (labels[r] >= rowSize) {
+        continue;
+      }
+      float score = H.raw(row + labels[r]);
+      size_t higher = 0;
+      for (size_t j = row; j < row + rowSize; j++) {
+        higher += H.raw(j) > score;
+      }
+      top1 += higher < 1;
+      top5 += higher < 5;
+    }
+  }
+  stats.top1 = r ? double(top1) / r : 0;
+  stats.top5 = r ? double(top5) / r : 0;
+}
+
+/// Set the latencies and the throughput of \p stats from the sorted \p times
+/// of inferences of samples with \p rowsPerSample rows of output.
+static void measureSpeed(llvm::ArrayRef<double> times, double rowsPerSample,
+                         ModelStats &stats) {
+  stats.medianSeconds = percentile(times, 50);
+  stats.p99Seconds = percentile(times, 99);
+  stats.rowsPerSecond = rowsPerSample / std::max(stats.medianSeconds, 1e-12);
+}
+
+int main(int argc, char **argv) {
+  // The loader verifies/initializes command line parameters, and initializes
+  // the ExecutionEngine and Function.
+  Loader loader(argc, argv);
+  if (emittingBundle()) {
+    llvm::errs() << "QuantizationReport: bundles are not supported.\n";
+    return 1;
+  }
+
+  std::vector<ValidationInput> validation(validationInputsOpt.size());
+  for (size_t i = 0, e = validationInputsOpt.size(); i < e; i++) {
+    if (!parseValidationInput(validationInputsOpt[i], validation[i]) ||
+        validation[i].samples.size() != validation[0].samples.size()) {
+      llvm::errs() << "QuantizationReport: invalid -"
+                   << validationInputsOpt.ArgStr << " "
+                   << validationInputsOpt[i] << "\n";
+      return 1;
+    }
+  }
+  std::vector<NodeQuantizationInfo> quantizationInfos =
+      loader.loadQuantizationInfos();
+  if (quantizationInfos.empty()) {
+    llvm::errs() << "QuantizationReport: a profile is needed, given with "
+                    "-load_profile or -load_raw_profiles.\n";
+    return 1;
+  }
+
+  // Create the model based on the input net, with the first samples giving
+  // the types of the inputs.
+  std::vector<const char *> inputNames;
+  std::vector<Tensor *> inputTensors;
+  for (auto &input : validation) {
+    inputNames.push_back(input.name.c_str());
+    inputTensors.push_back(&input.samples[0]);
+  }
+  std::unique_ptr<ProtobufLoader> LD;
+  Function *F = loader.getFunction();
+  if (!loader.getCaffe2NetDescFilename().empty()) {
+    LD.reset(new caffe2ModelLoader(loader.getCaffe2NetDescFilename(),
+                                   loader.getCaffe2NetWeightFilename(),
+                                   inputNames, inputTensors, *F));
+  } else {
+    LD.reset(new ONNXModelLoader(loader.getOnnxModelFilename(), inputNames,
+                                 inputTensors, *F));
+  }
+  std::vector<Variable *> inputs;
+  for (auto &input : validation) {
+    inputs.push_back(LD->getVariableByName(input.name));
+  }
+  Variable *output = LD->getSingleOutput();
+  Runner runner(loader, inputs, validation);
+
+  // The profile was captured on the optimized graph, whose node names it
+  // refers to.
+  ::optimize(F, CompilationMode::Infer);
+
+  // Both models are compiled for the same backend and run on all of the
+  // samples, from which the accuracies are taken, and are then timed.
+  size_t numSamples = runner.getNumSamples();
+  std::vector<Tensor> floatOutputs, quantizedOutputs;
+  ModelStats floatStats, quantizedStats;
+  Function *floatF = F->clone("float_report");
+  runner.run(floatF, numSamples, output, floatOutputs);
+  double rowsPerSample = double(getNumRows(floatOutputs)) / numSamples;
+  measureSpeed(runner.time(), rowsPerSample, floatStats);
+  F->getParent()->eraseFunction(floatF);
+
+  Function *Q = loader.quantize(F, quantizationInfos, "quantized_report");
+  runner.run(Q, numSamples, output, quantizedOutputs);
+  measureSpeed(runner.time(), rowsPerSample, quantizedStats);
+  F->getParent()->eraseFunction(Q);
+
+  std::vector<size_t> labels;
+  if (validationLabelsOpt.empty()) {
+    labels = getTop1(floatOutputs);
+  } else if (!readLabels(validationLabelsOpt, labels) ||
+             labels.size() != getNumRows(floatOutputs)) {
+    llvm::errs() << "QuantizationReport: -" << validationLabelsOpt.ArgStr
+                 << " needs one label for each of the "
+                 << getNumRows(floatOutputs) << " rows of the outputs.\n";
+    return 1;
+  }
+  measureAccuracy(floatOutputs, labels, floatStats);
+  measureAccuracy(quantizedOutputs, labels, quantizedStats);
+
+  // Save the output of every profiled layer of a copy of the model, so that
+  // the float and quantized outputs of the layers can be compared. The
+  // quantizer dequantizes the outputs of the quantized copy before the saves.
+  std::unordered_set<std::string> profiled;
+  for (const auto &info : quantizationInfos) {
+    profiled.insert(info.nodeOutputName_);
+  }
+  Function *layersF = F->clone("float_layers");
+  std::vector<Node *> layers;
+  for (auto &N : layersF->getNodes()) {
+    if (N.getNumResults() && N.getElementType(0) == ElemKind::FloatTy &&
+        profiled.count(NodeQuantizationInfo::generateNodeOutputName(
+            N.getName().str()))) {
+      layers.push_back(&N);
+    }
+  }
+  std::vector<Variable *> layerOutputs;
+  for (Node *N : layers) {
+    auto *save = layersF->createSave("layer_" + N->getName().str(), N);
+    layerOutputs.push_back(save->getVariable());
+  }
+  std::vector<Tensor> floatLayers, quantizedLayers;
+  runner.run(layersF, layerSamplesOpt, layerOutputs, floatLayers);
+  Function *layersQ =
+      loader.quantize(layersF, quantizationInfos, "quantized_layers");
+  runner.run(layersQ, layerSamplesOpt, layerOutputs, quantizedLayers);
+
+  std::vector<LayerError> errors;
+  for (size_t l = 0, e = layers.size(); l < e; l++) {
+    LayerError error{layers[l]->getName().str(), 0, 0};
+    for (size_t i = l; i < floatLayers.size(); i += e) {
+      auto ref = floatLayers[i].getHandle();
+      auto out = quantizedLayers[i].getHandle();
+      for (size_t j = 0, n = ref.size(); j < n; j++) {
+        error.maxError =
+            std::max<double>(error.maxError, std::abs(out.raw(j) - ref.raw(j)));
+        error.maxMagnitude =
+            std::max<double>(error.maxMagnitude, std::abs(ref.raw(j)));
+      }
+    }
+    errors.push_back(error);
+  }
+  F->getParent()->eraseFunction(layersQ);
+  F->getParent()->eraseFunction(layersF);
+  std::sort(errors.begin(), errors.end(),
+            [](const LayerError &a, const LayerError &b) {
+              return a.maxError > b.maxError;
+            });
+
+  llvm::outs() << llvm::formatv("{0,-24}{1,12}{2,12}{3,12}\n", "", "float",
+                                "quantized", "delta");
+  auto printRow = [](const char *name, double f, double q) {
+    llvm::outs() << llvm::formatv("{0,-24}{1,12:f4}{2,12:f4}{3,12:f4}\n",
+                                  name, f, q, q - f);
+  };
+  printRow("top-1 accuracy", floatStats.top1, quantizedStats.top1);
+  printRow("top-5 accuracy", floatStats.top5, quantizedStats.top5);
+  printRow("latency p50 (ms)", floatStats.medianSeconds * 1e3,
+           quantizedStats.medianSeconds * 1e3);
+  printRow("latency p99 (ms)", floatStats.p99Seconds * 1e3,
+           quantizedStats.p99Seconds * 1e3);
+  printRow("throughput (rows/s)", floatStats.rowsPerSecond,
+           quantizedStats.rowsPerSecond);
+
+  llvm::outs() << "\nlargest errors of the outputs of the layers:\n";
+  for (size_t i = 0; i < std::min<size_t>(reportLayersOpt, errors.size());
+       i++) {
+    const auto &error = errors[i];
+    llvm::outs() << llvm::formatv(
+        "  {0}: {1:e3} ({2:f2}% of the float range)\n", error.name,
+        error.maxError,
+        100 * error.maxError / std::max(error.maxMagnitude, 1e-12));
+  }
+
+  if (floatStats.top1 - quantizedStats.top1 > maxTop1DropOpt) {
+    llvm::errs() << "QuantizationReport: the top-1 accuracy drops by more "
+                    "than -"
+                 << maxTop1DropOpt.ArgStr << ".\n";
+    return 1;
+  }
+  return 0;
+}
@@ -21,6 +21,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -54,6 +55,13 @@ llvm::cl::opt<double>
                                     "highest likelihood output sentence."),
                      llvm::cl::Optional, llvm::cl::init(0.0f),
                      llvm::cl::cat(textTranslatorCat));
+
+llvm::cl::opt<std::string> inputTextFileOpt(
+    "input_text_file",
+    llvm::cl::desc("Translate the sentences of this file, one per line, and "
+                   "report the throughput, instead of reading the sentences "
+                   "from the standard input."),
+    llvm::cl::Optional, llvm::cl::init(""), llvm::cl::cat(textTranslatorCat));
 } // namespace
 
 /// These should be kept in sync with pytorch_translate/vocab_constants.py
@@ -331,6 +339,31 @@ int main(int argc, char **argv) {
   Variable *outputPrevIndexBeamList =
       LD.getOutputByName("output_prev_index_beam_list");
 
+  if (!inputTextFileOpt.empty()) {
+    // Translate the whole file, one sentence per run since the model is
+    // exported with a batch size of 1, and report the throughput.
+    std::ifstream file(inputTextFileOpt);
+    GLOW_ASSERT(file && "Cannot open the input text file.");
+    std::string sentence;
+    size_t numSentences = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (getline(file, sentence)) {
+      encodeString(sentence, &encoderInputs);
+      loader.runBatch({encoderInputsVar}, {&encoderInputs});
+      processAndPrintDecodedTranslation(outputTokenBeamList,
+                                        outputScoreBeamList,
+                                        outputPrevIndexBeamList);
+      numSentences++;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    loader.dumpProfiles();
+    llvm::outs() << "Translated " << numSentences << " sentences in "
+                 << elapsed.count() << " s ("
+                 << numSentences / elapsed.count() << " sentences/s)\n";
+    return 0;
+  }
+
   while (true) {
     // Load the next string into encoderInputs.
     loadNextInputTranslationText(&encoderInputs);